@@ -0,0 +1,24 @@
+# profileLoadGenerator <H264 file> <Max streams> [Step] [Bitrate (kbps)] [Loss (%)] [Jitter (ms)]
+# A loadgenerator serving and receiving from 1 up to <Max streams> streams of <H264 file> will be
+# run for 30 seconds for each stream count, adding a line to profileLoadGenerator.stats each time.
+
+step=${3:-1}
+bitrate=${4:-0}
+loss=${5:-0}
+jitter=${6:-0}
+
+date > profileLoadGenerator.log
+echo $0 $@ >> profileLoadGenerator.log
+
+date >> profileLoadGenerator.stats
+echo $0 $@ >> profileLoadGenerator.stats
+echo "Streams, Shards, Bitrate (kbps), Loss (%), Jitter (ms), Playing, Failed, In Bitrate (kbps), Avg. Latency (us), P50 Latency (us), P99 Latency (us), Max Latency (us), Lost AUs, RTP Losses (%)" >> profileLoadGenerator.stats
+
+for streams in `seq $step $step $2`
+do
+    commandline="./loadgenerator -v "$1" -streams "$streams" -bitrate "$bitrate
+    commandline+=" -loss "$loss" -jitter "$jitter" -duration 30 -statsfile profileLoadGenerator.stats"
+    echo $commandline
+    echo $commandline >> profileLoadGenerator.log
+    $commandline >> profileLoadGenerator.log 2>&1
+done
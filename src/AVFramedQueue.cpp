@@ -24,99 +24,445 @@
 #include "AVFramedQueue.hh"
 #include "VideoFrame.hh"
 #include "AudioFrame.hh"
+#include "FramePool.hh"
 #include "Utils.hh"
+#include "AsyncLog.hh"
 
 AVFramedQueue::AVFramedQueue(ConnectionData cData, const StreamInfo *si, unsigned maxFrames) :
-        FrameQueue(cData, si), max(maxFrames)
+        FrameQueue(cData, si), max(cData.maxFrames > 0 ? cData.maxFrames : maxFrames), 
+        maxBytes(cData.maxBytes), dropPolicy(DROP_NEWEST), 
+        typedFrames(si && si->type == VIDEO && si->video.frameTypes), maxLatency(cData.maxLatency), 
+        dropTarget(0), depth(0), queuedBytes(0), skipping(SKIP_NONE), catchUp(false), 
+        tuneWrites(0), tuneFull(0), refused(false), usedFrames(0)
 {
+    //NOTE: frames are dropped by type only if the writer sets it
+    if (typedFrames && cData.dropPolicy != DP_NONE) {
+        dropPolicy = cData.dropPolicy;
+    }
+    
     if (max > MAX_FRAMES) {
         utils::errorMsg(std::string("Created an AVFramedQueue with ") + std::to_string(max) + " frames. " +
                 "Reducing to " + std::to_string(MAX_FRAMES));
         max = MAX_FRAMES;
     }
-    memset(frames, 0, sizeof(frames));
+    
+    if (max < 2) {
+        utils::errorMsg("AVFramedQueue needs at least 2 frames. Setting it to 2");
+        max = 2;
+    }
+    
+    //NOTE: the configured depth is the ceiling of the tuned one
+    depth = max - 1;
+    
+    if (cData.dropTarget > 0 && cData.dropTarget < 1) {
+        dropTarget = cData.dropTarget;
+        tuneOccupancy.assign(max, 0);
+    }
+    
+    frames.assign(max, NULL);
+    lengths.assign(max, 0);
+    addTimes.assign(max, std::chrono::steady_clock::time_point());
+    types.assign(max, 0);
 }
 
 AVFramedQueue::~AVFramedQueue()
 {
     for (unsigned i = 0; i<max; i++) {
-        delete frames[i];
+        FramePool::getInstance()->releaseFrame(frames[i]);
     }
 }
 
 Frame* AVFramedQueue::getRear() 
 {
-    if ((rear + 1) % max == front){
+    Frame* frame;
+    size_t r = rearIdx.load(std::memory_order_relaxed);
+    size_t f = frontIdx.load();
+    
+    //NOTE: the tuned depth is never above the slots, a frame waiting for room is only accounted once
+    if (dropTarget > 0 && (r + max - f) % max >= depth.load(std::memory_order_relaxed)) {
+        if (!refused) {
+            tuneFull++;
+            refused = true;
+        }
         return NULL;
     }
     
-    return frames[rear];
+    if ((r + 1) % max == f){
+        return NULL;
+    }
+    
+    //NOTE: at least one frame is kept, so flushing never drops the frame being read
+    if (maxBytes > 0 && queuedBytes >= maxBytes && (r + max - f) % max > 1){
+        return NULL;
+    }
+    
+    if (dropTarget > 0) {
+        recycleFrames();
+    }
+    
+    if (!frames[r]){
+        if (!(frames[r] = allocFrame())){
+            utils::errorMsg("AVFramedQueue could not allocate a frame");
+            return NULL;
+        }
+        chargeBytes(FramePool::getInstance()->getFrameBytes(frames[r]));
+        usedFrames++;
+    }
+    
+    //NOTE: a consumer retained the frame, the slot gets a new one and the retained 
+    //frame is recycled by its last reference
+    if (frames[r]->getRefs() > 1 && (frame = FramePool::getInstance()->getFrameLike(frames[r])) != NULL){
+        FramePool::getInstance()->releaseFrame(frames[r]);
+        frames[r] = frame;
+    }
+
+    //NOTE: the metadata of the previous frame written to the slot must not reach the next one
+    frames[r]->getSideData().clear();
+
+    return frames[r];
 }
 
 Frame* AVFramedQueue::getFront() 
 {
-    if(rear == front) {
+    size_t f;
+    
+    if (catchUp.load(std::memory_order_relaxed) && catchUp.exchange(false)) {
+        skipToKeyFrame();
+    }
+    
+    f = frontIdx.load(std::memory_order_relaxed);
+    
+    if(rearIdx.load() == f) {
         return NULL;
     }
+    
+    if (maxLatency.count() > 0 && Frame::getOriginNow() - frames[f]->getOriginTime() > maxLatency) {
+        skipLateFrames();
+        f = frontIdx.load(std::memory_order_relaxed);
+    }
 
-    return frames[front];
+    return frames[f];
 }
 
-std::vector<int> AVFramedQueue::addFrame() 
+const std::vector<int>& AVFramedQueue::addFrame() 
 {
-    std::vector<int> ret;
+    size_t r = rearIdx.load(std::memory_order_relaxed);
     
-    for (auto& r : connectionData.readers){
-        ret.push_back(r.rFilterId);
+    if ((r + 1) % max == frontIdx.load()){
+        return getReaderIds();
     }
     
-    if ((rear + 1) % max == front){
-        return ret;
+    if (!advanceRear()) {
+        return noReaderIds();
     }
-    rear =  (rear + 1) % max;
     
-    return ret;
+    return getReaderIds();
+}
+
+bool AVFramedQueue::advanceRear(bool pictureStart)
+{
+    size_t r = rearIdx.load(std::memory_order_relaxed);
+    VideoFrame *vFrame;
+    
+    if (typedFrames) {
+        //NOTE: only video queues have typed frames
+        vFrame = static_cast<VideoFrame*>(frames[r]);
+        types[r] = vFrame->isReference() ? REFERENCE_SLOT : 0;
+        
+        if (pictureStart) {
+            types[r] |= vFrame->isKeyFrame() ? START_SLOT | KEY_SLOT : START_SLOT;
+            
+            if (skipping == SKIP_PICTURE || (skipping == SKIP_TO_KEY && vFrame->isKeyFrame())) {
+                skipping = SKIP_NONE;
+            }
+        }
+        
+        if (skipping != SKIP_NONE) {
+            lostBlocs++;
+            return false;
+        }
+    }
+    
+    lengths[r] = frames[r]->getLength();
+    addTimes[r] = std::chrono::steady_clock::now();
+    queuedBytes += lengths[r];
+    rearIdx.store((r + 1) % max);
+    
+    countWrite(getElements(), max - 1);
+    tuneDepth(getElements());
+    return true;
+}
+
+void AVFramedQueue::recycleFrames()
+{
+    size_t r = rearIdx.load(std::memory_order_relaxed);
+    size_t f = frontIdx.load();
+    size_t spare = (f + max - 2) % max;
+    size_t bytes;
+    
+    //NOTE: the slot before front is returned by forceGetFront, the one before it is no longer read. 
+    //It is only taken if it is not the rear one
+    if ((r + max - f) % max + 3 > max || !frames[spare]) {
+        return;
+    }
+    
+    if (!frames[r]) {
+        frames[r] = frames[spare];
+        frames[spare] = NULL;
+        return;
+    }
+    
+    if (usedFrames > depth.load(std::memory_order_relaxed) + 2) {
+        bytes = FramePool::getInstance()->getFrameBytes(frames[spare]);
+        FramePool::getInstance()->releaseFrame(frames[spare]);
+        frames[spare] = NULL;
+        dischargeBytes(bytes);
+        usedFrames--;
+    }
+}
+
+void AVFramedQueue::tuneDepth(unsigned elements)
+{
+    unsigned current = depth.load(std::memory_order_relaxed);
+    unsigned allowed, above, held;
+    
+    refused = false;
+    
+    if (dropTarget <= 0) {
+        return;
+    }
+    
+    tuneOccupancy[std::min(elements, max - 1)]++;
+    
+    if (++tuneWrites < TUNE_WINDOW) {
+        return;
+    }
+    
+    allowed = (unsigned) (dropTarget*tuneWrites);
+    
+    if (tuneFull > allowed) {
+        depth.store(std::min(current*2, max - 1), std::memory_order_relaxed);
+    } else {
+        //NOTE: the occupancy exceeded by at most the allowed share of frames is held, plus one frame of headroom
+        held = max - 1;
+        above = 0;
+        
+        while (held > 0 && above + tuneOccupancy[held] <= allowed) {
+            above += tuneOccupancy[held];
+            held--;
+        }
+        
+        held = std::max(std::max(held + 1, (unsigned) MIN_TUNED_DEPTH), current/2);
+        
+        if (held < current) {
+            depth.store(held, std::memory_order_relaxed);
+        }
+    }
+    
+    std::fill(tuneOccupancy.begin(), tuneOccupancy.end(), 0);
+    tuneWrites = 0;
+    tuneFull = 0;
+}
+
+bool AVFramedQueue::fillFrames()
+{
+    for (unsigned i = 0; i < max; i++) {
+        //NOTE: the last slot is the one returned by forceGetFront before the first frame is read
+        if ((maxBytes > 0 || dropTarget > 0) && i != 0 && i != max - 1) {
+            continue;
+        }
+        
+        if (!(frames[i] = allocFrame())) {
+            return false;
+        }
+        
+        chargeBytes(FramePool::getInstance()->getFrameBytes(frames[i]));
+        usedFrames++;
+    }
+    
+    return true;
 }
 
 int AVFramedQueue::removeFrame() 
 {
-    if (rear == front){
+    size_t f = frontIdx.load(std::memory_order_relaxed);
+    
+    if (rearIdx.load() == f){
         return -1;
     }
-    front = (front + 1) % max;
+    queuedBytes -= lengths[f];
+    countRead(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - addTimes[f]));
+    frontIdx.store((f + 1) % max);
     return connectionData.wFilterId;
 }
 
 void AVFramedQueue::doFlush() 
 {
-    rear = (rear + (max - 1)) % max;
+    size_t r = (rearIdx.load(std::memory_order_relaxed) + (max - 1)) % max;
+    
+    queuedBytes -= lengths[r];
+    rearIdx.store(r);
 }
 
 Frame* AVFramedQueue::forceGetRear()
 {
     Frame *frame;
     while ((frame = getRear()) == NULL) {
-        utils::warningMsg("Frame discarted by AVFramedQueue");
-        flush();
+        WARNING_MSG("Frame discarted by AVFramedQueue");
+        countForcedFlush();
+        dropFrames();
     }
     return frame;
 }
 
+void AVFramedQueue::dropFrames()
+{
+    switch (dropPolicy) {
+        case DROP_NON_REFERENCE:
+            //NOTE: the pictures following a dropped reference one cannot be decoded until a keyframe
+            skipping = dropBack(false) ? SKIP_PICTURE : SKIP_TO_KEY;
+            return;
+        case DROP_GOP:
+            dropBack(true);
+            skipping = SKIP_TO_KEY;
+            return;
+        case DROP_TO_KEYFRAME:
+            dropBack(true);
+            skipping = SKIP_TO_KEY;
+            catchUp.store(true);
+            return;
+        default:
+            flush();
+            return;
+    }
+}
+
+bool AVFramedQueue::dropBack(bool toKey)
+{
+    size_t f = frontIdx.load();
+    size_t r = rearIdx.load(std::memory_order_relaxed);
+    size_t i = r;
+    bool found = false;
+    bool reference = false;
+    
+    //NOTE: the front frame might be being read, it is never dropped
+    while (!found && (i + max - f) % max > 1) {
+        i = (i + max - 1) % max;
+        reference |= (types[i] & REFERENCE_SLOT) != 0;
+        found = (types[i] & (toKey ? KEY_SLOT : START_SLOT)) != 0;
+    }
+    
+    if (i == r) {
+        flush();
+        return false;
+    }
+    
+    for (size_t j = i; j != r; j = (j + 1) % max) {
+        queuedBytes -= lengths[j];
+        lostBlocs++;
+    }
+    
+    rearIdx.store(i);
+    return found && !reference;
+}
+
+void AVFramedQueue::skipToKeyFrame()
+{
+    size_t f = frontIdx.load(std::memory_order_relaxed);
+    size_t r = rearIdx.load();
+    size_t key = f;
+    
+    for (size_t i = (f + 1) % max; i != r; i = (i + 1) % max) {
+        if (types[i] & KEY_SLOT) {
+            key = i;
+        }
+    }
+    
+    skipTo(key);
+}
+
+void AVFramedQueue::skipLateFrames()
+{
+    size_t f = frontIdx.load(std::memory_order_relaxed);
+    size_t r = rearIdx.load();
+    size_t next = f;
+    std::chrono::system_clock::time_point bound = Frame::getOriginNow() - 
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(maxLatency);
+    
+    if (streamInfo && streamInfo->type == VIDEO && streamInfo->video.codec != RAW) {
+        //NOTE: coded pictures depend on the previous ones, decoding only resumes at a keyframe
+        if (!typedFrames) {
+            return;
+        }
+        
+        for (size_t i = (f + 1) % max; i != r; i = (i + 1) % max) {
+            if (types[i] & KEY_SLOT) {
+                next = i;
+                
+                if (frames[i]->getOriginTime() >= bound) {
+                    break;
+                }
+            }
+        }
+    } else {
+        while ((next + 1) % max != r && frames[next]->getOriginTime() < bound) {
+            next = (next + 1) % max;
+        }
+    }
+    
+    skipTo(next);
+}
+
+void AVFramedQueue::skipTo(size_t slot)
+{
+    size_t f = frontIdx.load(std::memory_order_relaxed);
+    
+    //NOTE: a full queue writer may have dropped the slot, the newest frames are kept then
+    if (slot == f || (slot + max - f) % max >= (rearIdx.load() + max - f) % max) {
+        return;
+    }
+    
+    while (f != slot) {
+        queuedBytes -= lengths[f];
+        countSkippedFrame();
+        f = (f + 1) % max;
+    }
+    
+    frontIdx.store(f);
+}
+
 Frame* AVFramedQueue::forceGetFront()
 {
-    return frames[(front + (max - 1)) % max]; 
+    return frames[(frontIdx.load(std::memory_order_relaxed) + (max - 1)) % max]; 
 }
 
 unsigned AVFramedQueue::getElements() const
 {
-    return front > rear ? (max - front + rear) : (rear - front);
+    size_t f = frontIdx.load();
+    size_t r = rearIdx.load();
+    
+    return f > r ? (max - f + r) : (r - f);
 }
 
 bool AVFramedQueue::isFull() const
 {
+    if (maxBytes > 0 && ((float) queuedBytes)/maxBytes >= FULL_THRESHOLD) {
+        return true;
+    }
+    
+    if (dropTarget > 0) {
+        return ((float) getElements())/getDepth() >= FULL_THRESHOLD;
+    }
+    
     return ((float) getElements())/max >= FULL_THRESHOLD;
 }
 
+void AVFramedQueue::doGetState(Jzon::Object &node) const
+{
+    node.Add("depth", (int) getDepth());
+    node.Add("dropTarget", (double) dropTarget);
+}
+
 ////////////////////////////////////////////
 //VIDEO FRAME QUEUE METHODS IMPLEMENTATION//
 ////////////////////////////////////////////
@@ -142,36 +488,35 @@ VideoFrameQueue::VideoFrameQueue(ConnectionData cData, const StreamInfo *si,
 }
 
 bool VideoFrameQueue::setup()
+{
+    return fillFrames();
+}
+
+Frame* VideoFrameQueue::allocFrame()
 {
     switch(streamInfo->video.codec) {
         case H264:
         case H265:
-            for (unsigned i=0; i<max; i++) {
-                frames[i] = InterleavedVideoFrame::createNew(streamInfo->video.codec, MAX_H264_OR_5_NAL_SIZE);
-            }
-            break;
+            return FramePool::getInstance()->getVideoFrame(streamInfo->video.codec, MAX_H264_OR_5_NAL_SIZE);
         case VP8:
-            for (unsigned i=0; i<max; i++) {
-                frames[i] = InterleavedVideoFrame::createNew(streamInfo->video.codec, LENGTH_VP8);
-            }
-            break;
+            return FramePool::getInstance()->getVideoFrame(streamInfo->video.codec, LENGTH_VP8);
+        case VP9:
+            return FramePool::getInstance()->getVideoFrame(streamInfo->video.codec, LENGTH_VP9);
+        case AV1:
+            return FramePool::getInstance()->getVideoFrame(streamInfo->video.codec, LENGTH_AV1);
+        case MJPEG:
+            return FramePool::getInstance()->getVideoFrame(streamInfo->video.codec, LENGTH_MJPEG);
         case RAW:
             if (streamInfo->video.pixelFormat == P_NONE) {
                 utils::errorMsg("No pixel fromat defined");
-                return false;
-                break;
+                return NULL;
             }
-            for (unsigned i=0; i<max; i++) {
-                frames[i] = InterleavedVideoFrame::createNew(streamInfo->video.codec,
-                        DEFAULT_WIDTH, DEFAULT_HEIGHT, streamInfo->video.pixelFormat);
-            }
-            break;
+            return FramePool::getInstance()->getVideoFrame(streamInfo->video.codec,
+                    DEFAULT_WIDTH, DEFAULT_HEIGHT, streamInfo->video.pixelFormat);
         default:
             utils::errorMsg("[Video Frame Queue] Codec not supported!");
-            return false;
+            return NULL;
     }
-
-    return true;
 }
 
 ////////////////////////////////////////////
@@ -200,57 +545,47 @@ AudioFrameQueue::AudioFrameQueue(ConnectionData cData, const StreamInfo *si,
 }
 
 bool AudioFrameQueue::setup()
+{
+    return fillFrames();
+}
+
+Frame* AudioFrameQueue::allocFrame()
 {
     switch(streamInfo->audio.codec) {
         case OPUS:
         case AAC:
         case MP3:
-            for (unsigned i=0; i<max; i++) {
-                frames[i] = InterleavedAudioFrame::createNew(streamInfo->audio.channels,
-                        streamInfo->audio.sampleRate,
-                        AudioFrame::getMaxSamples(streamInfo->audio.sampleRate),
-                        streamInfo->audio.codec, streamInfo->audio.sampleFormat);
-            }
-            break;
+            return FramePool::getInstance()->getAudioFrame(false, streamInfo->audio.channels,
+                    streamInfo->audio.sampleRate,
+                    AudioFrame::getMaxSamples(streamInfo->audio.sampleRate),
+                    streamInfo->audio.codec, streamInfo->audio.sampleFormat);
         case PCMU:
         case PCM:
             if (streamInfo->audio.sampleFormat == U8 || streamInfo->audio.sampleFormat == S16 || streamInfo->audio.sampleFormat == FLT) {
-                for (unsigned i=0; i<max; i++) {
-                    frames[i] = InterleavedAudioFrame::createNew(
-                            streamInfo->audio.channels,
-                            streamInfo->audio.sampleRate,
-                            AudioFrame::getMaxSamples(streamInfo->audio.sampleRate),
-                            streamInfo->audio.codec, streamInfo->audio.sampleFormat);
-                }
+                return FramePool::getInstance()->getAudioFrame(false,
+                        streamInfo->audio.channels,
+                        streamInfo->audio.sampleRate,
+                        AudioFrame::getMaxSamples(streamInfo->audio.sampleRate),
+                        streamInfo->audio.codec, streamInfo->audio.sampleFormat);
             } else if (streamInfo->audio.sampleFormat == U8P ||
                        streamInfo->audio.sampleFormat == S16P ||
                        streamInfo->audio.sampleFormat == FLTP) {
-                for (unsigned i=0; i<max; i++) {
-                    frames[i] = PlanarAudioFrame::createNew(
-                            streamInfo->audio.channels,
-                            streamInfo->audio.sampleRate,
-                            AudioFrame::getMaxSamples(streamInfo->audio.sampleRate),
-                            streamInfo->audio.codec, streamInfo->audio.sampleFormat);
-                }
-            } else {
-                 utils::errorMsg("[Audio Frame Queue] Sample format not supported!");
-                 return false;
-            }
-            break;
-        case G711:
-            for (unsigned i=0; i<max; i++) {
-                frames[i] = InterleavedAudioFrame::createNew(
+                return FramePool::getInstance()->getAudioFrame(true,
                         streamInfo->audio.channels,
                         streamInfo->audio.sampleRate,
                         AudioFrame::getMaxSamples(streamInfo->audio.sampleRate),
                         streamInfo->audio.codec, streamInfo->audio.sampleFormat);
             }
-            break;
+            utils::errorMsg("[Audio Frame Queue] Sample format not supported!");
+            return NULL;
+        case G711:
+            return FramePool::getInstance()->getAudioFrame(false,
+                    streamInfo->audio.channels,
+                    streamInfo->audio.sampleRate,
+                    AudioFrame::getMaxSamples(streamInfo->audio.sampleRate),
+                    streamInfo->audio.codec, streamInfo->audio.sampleFormat);
         default:
             utils::errorMsg("[Audio Frame Queue] Codec not supported!");
-            return false;
+            return NULL;
     }
-
-    return true;
-
 }
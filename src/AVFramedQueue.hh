@@ -24,14 +24,34 @@
 #ifndef _AV_FRAMED_QUEUE_HH
 #define _AV_FRAMED_QUEUE_HH
 
-#define MAX_FRAMES 250 //!< The highest value for DEFAULT_AUDIO_FRAMES, DEFAULT_VIDEO_FRAMES, ...
+#define MAX_FRAMES 5000 //!< The highest queue depth, either a default one (DEFAULT_VIDEO_FRAMES, ...) or set per connection
+#define TUNE_WINDOW 256 //!< Added frames between depth adjustments of an auto-tuned queue
+#define MIN_TUNED_DEPTH 2 //!< The lowest depth an auto-tuned queue shrinks to
+
+#include <vector>
 
 #include "FrameQueue.hh"
 #include "AudioFrame.hh"
 #include "StreamInfo.hh"
 
 /*! It is an abstract class that represents a discrete buffering structure. 
-*   Each queue position is associated to a frame. It is implemented by VideoFrameQueue and AudioFrameQueue
+*   Each queue position is associated to a frame. It is implemented by VideoFrameQueue and AudioFrameQueue.
+*   It is a single producer single consumer lock free queue: rear is only moved by the writer and front by 
+*   the reader, which is the only consumer even if it is shared among filters (see Reader).
+*   The depth can be set per connection (see ConnectionData). With a bytes budget the queue is also full 
+*   once the queued frames lengths reach the budget, and frames are allocated when the writer first 
+*   reaches their slot, so memory follows the actual frame sizes instead of the depth.
+*   Coded video queues whose frames carry their type (see StreamInfo) drop frames by type when they 
+*   are full, following the DropPolicy of the connection. Pictures are dropped from the rear, as the 
+*   writer is the only one moving it, but DROP_TO_KEYFRAME also makes the reader jump forward.
+*   With a latency bound set per connection, the reader skips the frames older than it, see getFront.
+*   With a drop target set per connection, the depth is tuned by the writer: the occupancy found by the 
+*   added frames, which follows both the producer bursts and the consumer service time, is measured 
+*   every TUNE_WINDOW frames. The depth doubles if the frames finding the queue full, either
+*   dropped or waiting for the reader, exceed the target and otherwise 
+*   shrinks, at most by half, to the occupancy not exceeded by that share of the frames. Slots are then 
+*   allocated lazily and the frames freed by the reader are moved to the rear, so memory follows the 
+*   queued frames too.
 */
 class AVFramedQueue : public FrameQueue {
 
@@ -42,14 +62,17 @@ public:
     virtual Frame *getRear();
 
     /**
-    * See FrameQueue::getFront
+    * See FrameQueue::getFront. If the front frame origin time is older than the latency bound, the reader
+    * catches up: coded video jumps to the first queued keyframe within the bound, or the newest one, 
+    * and raw video and audio skip the late frames, keeping the newest one. Coded video frames without 
+    * type (see StreamInfo) are never skipped.
     */
     Frame *getFront();
 
     /**
     * See FrameQueue::addFrame
     */
-    virtual std::vector<int> addFrame();
+    virtual const std::vector<int>& addFrame();
 
     /**
     * See FrameQueue::removeFrame
@@ -57,7 +80,11 @@ public:
     int removeFrame();
 
     /**
-    * See FrameQueue::forceGetRear
+    * See FrameQueue::forceGetRear. If the queue is full, frames are dropped following its DropPolicy:
+    * DROP_NEWEST drops the newest frame, DROP_NON_REFERENCE the newest picture if no other frame 
+    * depends on it, DROP_GOP the pictures back to the newest keyframe and the next ones until a new 
+    * keyframe is added, and DROP_TO_KEYFRAME does the same and the reader jumps to the newest queued 
+    * keyframe. Dropping a reference picture, if there is no other choice, also skips to the next keyframe.
     */
     virtual Frame *forceGetRear();
 
@@ -77,6 +104,36 @@ public:
      */
     unsigned getMaxFrames() const {return max;}
     
+    /**
+     * @returns the bytes budget of the queue, 0 if it is only limited by its depth
+     */
+    size_t getMaxBytes() const {return maxBytes;}
+    
+    /**
+     * @returns the sum of the lengths of the queued frames
+     */
+    size_t getBytes() const {return queuedBytes;}
+    
+    /**
+     * @returns the drop policy applied, DROP_NEWEST if the frames do not carry their type
+     */
+    DropPolicy getDropPolicy() const {return dropPolicy;}
+    
+    /**
+     * @returns the latency the reader catches up from, 0 if there is no bound
+     */
+    std::chrono::microseconds getMaxLatency() const {return maxLatency;}
+    
+    /**
+     * @returns the frames the queue holds before it is full, tuned if there is a drop target
+     */
+    unsigned getDepth() const {return depth.load(std::memory_order_relaxed);}
+    
+    /**
+     * @returns the share of frames the depth tuning targets to drop, 0 if the depth is fixed
+     */
+    float getDropTarget() const {return dropTarget;}
+    
     /**
     * Tests if the current queue is full or not
     * @return true if the number of elements exceeds the threshold level
@@ -88,8 +145,95 @@ public:
 protected:
     AVFramedQueue(ConnectionData cData, const StreamInfo *si, unsigned maxFrames);
     void doFlush();
-    Frame* frames[MAX_FRAMES];
+    void doGetState(Jzon::Object &node) const;
+    
+    /**
+    * Allocates a frame for a queue slot, implemented by queues that support lazy allocation
+    * @return a new frame or NULL if not implemented
+    */
+    virtual Frame *allocFrame() {return NULL;};
+    
+    /**
+    * Allocates the frames of the queue slots, only the first and last ones with a bytes budget or a drop target
+    * @return false if any of the frames could not be allocated
+    */
+    bool fillFrames();
+    
+    /**
+    * Moves rear one position, accounting the length of the added frame. Frames following a dropped 
+    * picture that cannot be decoded without it are dropped instead.
+    * @param pictureStart the frame is the first one of a picture, coded pictures may take many frames
+    * @return false if the frame has been dropped, rear is not moved then
+    */
+    bool advanceRear(bool pictureStart = true);
+    
+    /**
+    * Drops queued frames to make room for a new one, following the queue DropPolicy, writer side only
+    */
+    void dropFrames();
+    
+    std::vector<Frame*> frames;
     unsigned max;
+    size_t maxBytes;
+    DropPolicy dropPolicy;
+    bool typedFrames;                   //!< Frames carry their type, so keyframes are known
+    std::chrono::microseconds maxLatency;
+    float dropTarget;
+    std::atomic<unsigned> depth;
+    
+    QueueIndex rearIdx;
+    QueueIndex frontIdx;
+
+private:
+    enum SlotType {START_SLOT = 1, KEY_SLOT = 2, REFERENCE_SLOT = 4};
+    enum DropSkip {SKIP_NONE, SKIP_PICTURE, SKIP_TO_KEY};
+    
+    /**
+    * Drops the newest queued picture, or the pictures back to the newest keyframe
+    * @param toKey drop back to the newest keyframe
+    * @return true if the dropped frames are a whole picture that is not a reference one
+    */
+    bool dropBack(bool toKey);
+    
+    /**
+    * Moves front to the newest queued keyframe, reader side only
+    */
+    void skipToKeyFrame();
+    
+    /**
+    * Moves front past the frames older than the latency bound, reader side only
+    */
+    void skipLateFrames();
+    
+    /**
+    * Moves front to a queued slot, unless the writer dropped it meanwhile, reader side only
+    * @param slot new front
+    */
+    void skipTo(size_t slot);
+    
+    /**
+    * Gives the rear slot a frame freed by the reader if it has none, or releases one if the queue 
+    * holds more frames than its depth needs, writer side only
+    */
+    void recycleFrames();
+    
+    /**
+    * Accounts an added frame in the depth tuning window and adjusts the depth at its end, writer side only
+    * @param elements queued elements after the addition
+    */
+    void tuneDepth(unsigned elements);
+    
+    std::vector<unsigned> lengths;
+    std::vector<std::chrono::steady_clock::time_point> addTimes;
+    std::vector<unsigned char> types;   //!< SlotType flags of each slot, only with a drop policy
+    std::atomic<size_t> queuedBytes;
+    DropSkip skipping;                  //!< Frames dropped by the writer after a dropped picture
+    std::atomic<bool> catchUp;          //!< The reader has to jump to the newest queued keyframe
+    std::vector<unsigned> tuneOccupancy; //!< Added frames per occupancy in the current tuning window
+    unsigned tuneWrites;
+    unsigned tuneFull;                  //!< Added frames that found the queue full in the current tuning window
+    bool refused;                       //!< The frame being written has already found the queue full
+    unsigned usedFrames;                //!< Slots holding a frame
 };
 
 /*! It represents a video AVFramedQueue */
@@ -108,6 +252,7 @@ public:
 
 protected:
     VideoFrameQueue(ConnectionData cData, const StreamInfo *si, unsigned maxFrames);
+    Frame *allocFrame();
 
 private:
     bool setup();
@@ -131,6 +276,7 @@ public:
 
 protected:
     AudioFrameQueue(ConnectionData cData, const StreamInfo *si, unsigned maxFrames);
+    Frame *allocFrame();
 
 private:
     bool setup();
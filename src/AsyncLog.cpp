@@ -0,0 +1,231 @@
+/*
+ *  AsyncLog.cpp - Asynchronous logger, off the processing threads
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "AsyncLog.hh"
+
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+#include <log4cplus/consoleappender.h>
+#include <log4cplus/configurator.h>
+
+using namespace log4cplus;
+using namespace log4cplus::helpers;
+
+static void consoleSink(DefinedLogLevel level, const char *message)
+{
+    Logger logger = Logger::getInstance(LOG4CPLUS_TEXT("main"));
+
+    switch (level) {
+        case ERROR:
+            LOG4CPLUS_ERROR(logger, "\e[1;31m" << message << "\e[0m");
+            break;
+        case WARNING:
+            LOG4CPLUS_WARN(logger, "\e[2;91m" << message << "\e[0m");
+            break;
+        case INFO:
+            LOG4CPLUS_INFO(logger, "\e[1;33m" << message << "\e[0m");
+            break;
+        case DEBUG:
+            LOG4CPLUS_DEBUG(logger, "\e[2;37m" << message << "\e[0m");
+            break;
+    }
+}
+
+static void configureConsole()
+{
+    SharedObjectPtr<Appender> append_1(new ConsoleAppender());
+    append_1->setName(LOG4CPLUS_TEXT("First"));
+    log4cplus::tstring pattern = LOG4CPLUS_TEXT("%-5p - %m %n");
+    append_1->setLayout(std::auto_ptr<Layout>(new PatternLayout(pattern)));
+    Logger::getRoot().addAppender(append_1);
+
+    //NOTE: levels are filtered by AsyncLog before messages are queued
+    Logger logger = Logger::getInstance(LOG4CPLUS_TEXT("main"));
+    logger.setLogLevel(ALL_LOG_LEVEL);
+}
+
+bool LogRateLimit::allow(unsigned &suppressedBefore)
+{
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t start = periodStart.load(std::memory_order_relaxed);
+
+    if (now - start >= LOG_RATE_PERIOD &&
+        periodStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        count.store(0, std::memory_order_relaxed);
+    }
+
+    if (count.fetch_add(1, std::memory_order_relaxed) >= LOG_RATE_BURST) {
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    suppressedBefore = suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+AsyncLog* AsyncLog::getInstance()
+{
+    //NOTE: log4cplus is configured while constructing the instance, so it outlives it at exit
+    static AsyncLog instance((configureConsole(), LogSink(consoleSink)));
+
+    return &instance;
+}
+
+AsyncLog::AsyncLog(LogSink sink_) : sink(sink_), enqueuePos(0), dropped(0), maxLevel(INFO),
+    dequeuePos(0), droppedReported(0), running(true)
+{
+    slots = new Slot[LOG_SLOTS];
+
+    for (size_t i = 0; i < LOG_SLOTS; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    drainer = std::thread(&AsyncLog::drainLoop, this);
+}
+
+AsyncLog::~AsyncLog()
+{
+    running = false;
+
+    if (drainer.joinable()) {
+        drainer.join();
+    }
+
+    flush();
+    delete[] slots;
+}
+
+void AsyncLog::setLevel(DefinedLogLevel level)
+{
+    maxLevel.store(level, std::memory_order_relaxed);
+}
+
+AsyncLog::Slot* AsyncLog::acquire(size_t &pos)
+{
+    Slot *slot;
+    size_t sequence;
+
+    pos = enqueuePos.load(std::memory_order_relaxed);
+
+    while (true) {
+        slot = &slots[pos % LOG_SLOTS];
+        sequence = slot->sequence.load(std::memory_order_acquire);
+
+        if (sequence == pos) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                return slot;
+            }
+        } else if ((intptr_t) (sequence - pos) < 0) {
+            //NOTE: the slot still holds a message LOG_SLOTS positions behind, the ring is full
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return NULL;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void AsyncLog::publish(Slot *slot, size_t pos)
+{
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void AsyncLog::write(DefinedLogLevel level, unsigned suppressed, const char *format, ...)
+{
+    va_list args;
+    size_t pos;
+    int length;
+    Slot *slot = acquire(pos);
+
+    if (!slot) {
+        return;
+    }
+
+    va_start(args, format);
+    length = vsnprintf(slot->text, LOG_MESSAGE_LENGTH, format, args);
+    va_end(args);
+
+    if (length < 0) {
+        slot->text[0] = '\0';
+    } else if (suppressed > 0 && length < LOG_MESSAGE_LENGTH) {
+        snprintf(slot->text + length, LOG_MESSAGE_LENGTH - length, " (%u similar messages suppressed)", suppressed);
+    }
+
+    slot->level = level;
+    publish(slot, pos);
+}
+
+void AsyncLog::write(DefinedLogLevel level, const std::string &message)
+{
+    size_t pos;
+    size_t length = std::min(message.size(), (size_t) LOG_MESSAGE_LENGTH - 1);
+    Slot *slot = acquire(pos);
+
+    if (!slot) {
+        return;
+    }
+
+    memcpy(slot->text, message.data(), length);
+    slot->text[length] = '\0';
+    slot->level = level;
+    publish(slot, pos);
+}
+
+void AsyncLog::flush()
+{
+    std::lock_guard<std::mutex> guard(drainMtx);
+    size_t lost;
+    Slot *slot;
+
+    while (true) {
+        slot = &slots[dequeuePos % LOG_SLOTS];
+
+        if (slot->sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+            break;
+        }
+
+        sink(slot->level, slot->text);
+        slot->sequence.store(dequeuePos + LOG_SLOTS, std::memory_order_release);
+        dequeuePos++;
+    }
+
+    lost = dropped.load(std::memory_order_relaxed);
+    if (lost != droppedReported) {
+        std::string msg = "[AsyncLog] " + std::to_string(lost - droppedReported) + " log messages dropped";
+        sink(WARNING, msg.c_str());
+        droppedReported = lost;
+    }
+}
+
+void AsyncLog::drainLoop()
+{
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(LOG_DRAIN_PERIOD));
+        flush();
+    }
+}
@@ -0,0 +1,185 @@
+/*
+ *  AsyncLog.hh - Asynchronous logger, off the processing threads
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _ASYNC_LOG_HH
+#define _ASYNC_LOG_HH
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <functional>
+#include <stdint.h>
+
+#include "Utils.hh"
+
+#define LOG_SLOTS 4096              //!< Messages waiting to be written, further ones are dropped
+#define LOG_MESSAGE_LENGTH 256      //!< Bytes of a message including the terminator, longer ones are truncated
+#define LOG_DRAIN_PERIOD 10         //!< Time in msec between writes of the queued messages
+#define LOG_RATE_PERIOD 1000        //!< Time in msec of a rate limiting period
+#define LOG_RATE_BURST 10           //!< Messages written by a call site per period, the rest are only counted
+
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL DEBUG         //!< Most verbose level compiled in, i.e. -DLOG_MAX_LEVEL=WARNING
+#endif
+
+/**
+ * @param level log level
+ * @return verbosity of the level, ERROR is the least verbose
+ */
+constexpr unsigned logVerbosity(DefinedLogLevel level)
+{
+    return level == ERROR ? 0 : level == WARNING ? 1 : level == INFO ? 2 : 3;
+}
+
+typedef std::function<void(DefinedLogLevel level, const char *message)> LogSink;
+
+/*! Rate limit of a logging call site, kept as a static by the logging macros. A site writes up to
+    LOG_RATE_BURST messages per LOG_RATE_PERIOD, the next message written reports how many were
+    suppressed meanwhile. Counters are relaxed atomics, so the limit is approximate under contention
+*/
+class LogRateLimit {
+
+public:
+    constexpr LogRateLimit() : periodStart(0), count(0), suppressed(0) {};
+
+    /**
+     * Accounts a message of the call site
+     * @param suppressedBefore messages suppressed since the last one allowed, only set if it is allowed
+     * @return true if the message has to be written
+     */
+    bool allow(unsigned &suppressedBefore);
+
+private:
+    std::atomic<int64_t> periodStart;
+    std::atomic<unsigned> count;
+    std::atomic<unsigned> suppressed;
+};
+
+/*! Asynchronous logger. Messages are formatted by the calling thread straight into a slot of a
+    bounded lock-free ring, without allocating, and written to the sink by a drain thread, so slow
+    consoles or files never stall the workers. When the ring is full messages are dropped and counted,
+    the drain thread reports them. Messages above the runtime level are discarded before being
+    formatted, and the logging macros also discard the ones above LOG_MAX_LEVEL at compile time.
+*/
+class AsyncLog {
+
+public:
+    /**
+     * Gets the process logger, it writes to the console through log4cplus. It is created the first
+     * time it is requested and its pending messages are written at exit
+     * @return the process logger
+     */
+    static AsyncLog* getInstance();
+
+    /**
+     * @param sink where the drain thread writes the messages
+     */
+    AsyncLog(LogSink sink);
+    ~AsyncLog();
+
+    /**
+     * @param level most verbose level written
+     */
+    void setLevel(DefinedLogLevel level);
+
+    /**
+     * @return most verbose level written
+     */
+    DefinedLogLevel getLevel() const {return maxLevel.load(std::memory_order_relaxed);};
+
+    /**
+     * @param level log level to check
+     * @return true if messages of this level are written
+     */
+    bool isEnabled(DefinedLogLevel level) const
+    {
+        return logVerbosity(level) <= logVerbosity(maxLevel.load(std::memory_order_relaxed));
+    };
+
+    /**
+     * Queues a printf formatted message, it does not check the level
+     * @param level log level of the message
+     * @param suppressed similar messages suppressed before it, appended to the message if any
+     * @param format printf format
+     */
+    void write(DefinedLogLevel level, unsigned suppressed, const char *format, ...) __attribute__((format(printf, 4, 5)));
+
+    /**
+     * Queues a message, it does not check the level
+     * @param level log level of the message
+     * @param message text of the message
+     */
+    void write(DefinedLogLevel level, const std::string &message);
+
+    /**
+     * Writes the queued messages from the calling thread
+     */
+    void flush();
+
+    /**
+     * @return messages dropped because the ring was full
+     */
+    size_t getDropped() const {return dropped.load(std::memory_order_relaxed);};
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        DefinedLogLevel level;
+        char text[LOG_MESSAGE_LENGTH];
+    };
+
+    Slot* acquire(size_t &pos);
+    void publish(Slot *slot, size_t pos);
+    void drainLoop();
+
+    LogSink sink;
+    Slot *slots;
+    std::atomic<size_t> enqueuePos;
+    std::atomic<size_t> dropped;
+    std::atomic<DefinedLogLevel> maxLevel;
+
+    std::mutex drainMtx;                    //!< Only taken by the drain side, producers never wait
+    size_t dequeuePos;
+    size_t droppedReported;
+    std::atomic<bool> running;
+    std::thread drainer;
+};
+
+//NOTE: arguments are not evaluated unless the message is written
+#define LOG_MSG(lvl, ...) \
+    do { \
+        if (logVerbosity(lvl) <= logVerbosity(LOG_MAX_LEVEL) && AsyncLog::getInstance()->isEnabled(lvl)) { \
+            static LogRateLimit logRateLimit; \
+            unsigned logSuppressed; \
+            if (logRateLimit.allow(logSuppressed)) { \
+                AsyncLog::getInstance()->write(lvl, logSuppressed, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+#define ERROR_MSG(...) LOG_MSG(ERROR, __VA_ARGS__)
+#define WARNING_MSG(...) LOG_MSG(WARNING, __VA_ARGS__)
+#define INFO_MSG(...) LOG_MSG(INFO, __VA_ARGS__)
+#define DEBUG_MSG(...) LOG_MSG(DEBUG, __VA_ARGS__)
+
+#endif
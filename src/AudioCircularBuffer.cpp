@@ -21,12 +21,77 @@
  */
 
 #include "AudioCircularBuffer.hh"
+#include "SampleConverter.hh"
 #include "Utils.hh"
+#include "AsyncLog.hh"
 #include <cstring>
+#include <cmath>
+#include <algorithm>
 #include <iostream>
 
 #define MAX_DEVIATION_SAMPLES 64
 
+#define DRIFT_CUTOFF 0.9        //!< Resampler cutoff, relative to the Nyquist frequency
+#define DRIFT_GAIN 0.002        //!< Ratio adjustment per relative deviation from the target fill
+#define DRIFT_SMOOTHING 0.01    //!< Weight of each pop in the smoothed fill level
+
+//NOTE: Blackman windowed sinc bank, each phase normalised to unity gain. Tap t of a phase weights the
+//      input sample t - DRIFT_TAPS/2 + 1 positions away from the integer part of the output position
+static std::vector<float> buildDriftBank()
+{
+    std::vector<float> bank(DRIFT_PHASES*DRIFT_TAPS);
+    double x, w, sum;
+
+    for (unsigned p = 0; p < DRIFT_PHASES; p++) {
+        sum = 0;
+
+        for (unsigned t = 0; t < DRIFT_TAPS; t++) {
+            x = (double) t - (DRIFT_TAPS/2 - 1) - (double) p/DRIFT_PHASES;
+            w = 0.42 + 0.5*cos(2*M_PI*x/DRIFT_TAPS) + 0.08*cos(4*M_PI*x/DRIFT_TAPS);
+            bank[p*DRIFT_TAPS + t] = w*(x == 0 ? DRIFT_CUTOFF : sin(M_PI*DRIFT_CUTOFF*x)/(M_PI*x));
+            sum += bank[p*DRIFT_TAPS + t];
+        }
+
+        for (unsigned t = 0; t < DRIFT_TAPS; t++) {
+            bank[p*DRIFT_TAPS + t] /= sum;
+        }
+    }
+
+    return bank;
+}
+
+static const std::vector<float>& driftBank()
+{
+    static const std::vector<float> bank = buildDriftBank();
+    return bank;
+}
+
+SIMD_REDUCTION_KERNEL
+static void resampleSpan(float const* __restrict__ in, float* __restrict__ out, unsigned n,
+                         double position, double step, float const* __restrict__ bank)
+{
+    for (unsigned j = 0; j < n; j++) {
+        double p = position + j*step;
+        unsigned i = (unsigned) p;
+        unsigned phase = (unsigned) ((p - i)*DRIFT_PHASES + 0.5);
+        float const* coefs;
+        float acc = 0;
+
+        if (phase == DRIFT_PHASES) {
+            i++;
+            phase = 0;
+        }
+
+        coefs = bank + phase*DRIFT_TAPS;
+
+        for (unsigned t = 0; t < DRIFT_TAPS; t++) {
+            acc += coefs[t]*in[i + t];
+        }
+
+        out[j] = acc;
+    }
+}
+
 AudioCircularBuffer* AudioCircularBuffer::createNew(struct ConnectionData cData, unsigned ch, unsigned sRate, unsigned maxSamples, SampleFmt sFmt)
 {
     AudioCircularBuffer* b = new AudioCircularBuffer(cData, ch, sRate, maxSamples, sFmt);
@@ -41,11 +106,19 @@ AudioCircularBuffer* AudioCircularBuffer::createNew(struct ConnectionData cData,
 }
 
 AudioCircularBuffer::AudioCircularBuffer(struct ConnectionData cData, unsigned ch, unsigned sRate, unsigned maxSamples, SampleFmt sFmt)
-: FrameQueue(cData), channels(ch), sampleRate(sRate), bytesPerSample(0), chMaxSamples(maxSamples), channelMaxLength(0), 
-sampleFormat(sFmt), fillNewFrame(true), inputFrame(NULL), outputFrame(NULL), dummyFrame(NULL), 
-synchronized(false), setupSuccess(false), tsDeviationThreshold(0), elements(0)
+: FrameQueue(cData, &pcmInfo), channels(ch), sampleRate(sRate), bytesPerSample(0), chMaxSamples(maxSamples), channelMaxLength(0), 
+sampleFormat(sFmt), interleaved(false), fillNewFrame(true), inputFrame(NULL), outputFrame(NULL),
+inputPlanes(NULL), outputPlanes(NULL), syncTimestamp(0), syncSeq(0),
+synchronized(false), setupSuccess(false), tsDeviationThreshold(0), driftTarget(0), driftRatio(1), 
+driftPhase(0), driftFill(0), driftFront(0), driftSync(0), driftOutput(0), driftStride(0), 
+ringToFloat(NULL), frameFromFloat(NULL), pcmInfo(AUDIO)
 {
-
+    orgTime = std::chrono::system_clock::time_point();
+    
+    pcmInfo.audio.codec = PCM;
+    pcmInfo.audio.sampleRate = sRate;
+    pcmInfo.audio.channels = ch;
+    pcmInfo.audio.sampleFormat = sFmt;
 }
 
 AudioCircularBuffer::~AudioCircularBuffer()
@@ -53,7 +126,7 @@ AudioCircularBuffer::~AudioCircularBuffer()
     if (setupSuccess) {
 
         for (unsigned i=0; i<channels; i++) {
-            delete[] data[i];
+            Frame::freeBuffer(data[i]);
         }        
         
         delete inputFrame;
@@ -69,86 +142,91 @@ Frame* AudioCircularBuffer::getRear()
 Frame* AudioCircularBuffer::getFront()
 {
     std::chrono::microseconds ts;
-    unsigned frontSampleIdx;
-
-    std::lock_guard<std::mutex> guard(mtx);
+    size_t frontPos;
+    size_t sync;
+    int64_t syncTs;
 
     if (!fillNewFrame) {
         return outputFrame;
     }
 
-    frontSampleIdx = front/bytesPerSample;
-    ts = std::chrono::microseconds(frontSampleIdx*std::micro::den/sampleRate) + syncTimestamp;
-    outputFrame->setPresentationTime(ts);
+    sync = readSync(syncTs);
+
+    if (driftTarget > 0 ? !popResampled(outputPlanes, outputFrame->getSamples(), sync, frontPos) :
+                          !popFront(outputPlanes, outputFrame->getSamples(), sync, frontPos)) {
+        DEBUG_MSG("There is not enough data to fill a frame. Impossible to get new frame!");
+        return NULL;
+    }
 
-    if (!popFront(outputFrame->getPlanarDataBuf(), outputFrame->getSamples())) {
-        utils::debugMsg("There is not enough data to fill a frame. Impossible to get new frame!");
+    //NOTE: a flush during the pop frees the samples behind the new sync point, the writer may have overwritten them
+    if (readSync(syncTs) != sync) {
+        DEBUG_MSG("Buffer flushed while reading. Discarding frame");
         return NULL;
     }
 
-    outputFrame->setOriginTime(orgTime - std::chrono::microseconds(elements*std::micro::den/(bytesPerSample*sampleRate)));
+    ts = std::chrono::microseconds(((frontPos - sync)/bytesPerSample)*std::micro::den/sampleRate + syncTs);
+    outputFrame->setPresentationTime(ts);
+    outputFrame->setOriginTime(orgTime.load() - std::chrono::microseconds(queuedBytes()*std::micro::den/(bytesPerSample*sampleRate)));
+    
+    //NOTE: samples are read in order at the sample rate, they stayed as long as the queued ones last
+    countRead(std::chrono::microseconds((queuedBytes()/bytesPerSample + outputFrame->getSamples())*std::micro::den/sampleRate));
     
     fillNewFrame = false;
     return outputFrame;
 }
 
-//TODO it should return a vector of filter ids
-std::vector<int> AudioCircularBuffer::addFrame()
+const std::vector<int>& AudioCircularBuffer::addFrame()
 {
     std::chrono::microseconds inTs;
     std::chrono::microseconds rearTs;
     std::chrono::microseconds deviation;
-    std::vector<int> ret;
     unsigned paddingSamples;
-    unsigned rearSampleIdx;
+    size_t rearSampleIdx;
 
     inTs = inputFrame->getPresentationTime();
 
     if (!synchronized) {
-        syncTimestamp = inTs;
+        publishSync(rearIdx.load(std::memory_order_relaxed), inTs.count());
         synchronized = true;
     }
 
-    rearSampleIdx = rear/bytesPerSample;
-    rearTs = std::chrono::microseconds(rearSampleIdx*std::micro::den/sampleRate) + syncTimestamp;
+    rearSampleIdx = (rearIdx.load(std::memory_order_relaxed) - syncIdx.load(std::memory_order_relaxed))/bytesPerSample;
+    rearTs = std::chrono::microseconds(rearSampleIdx*std::micro::den/sampleRate + syncTimestamp.load(std::memory_order_relaxed));
     deviation = inTs - rearTs;
 
     if (deviation.count() < -tsDeviationThreshold) {
-        utils::warningMsg("[AudioCircularBuffer] Timestamp from the past, discarding entire frame");
-        return ret;
+        WARNING_MSG("[AudioCircularBuffer] Timestamp from the past, discarding entire frame");
+        return noReaderIds();
     }
 
     if (deviation.count() > tsDeviationThreshold) {
-        utils::warningMsg("[AudioCircularBuffer] Deviation exceeded, introducing silence");
+        WARNING_MSG("[AudioCircularBuffer] Deviation exceeded, introducing silence");
 
         paddingSamples = (deviation.count()*sampleRate)/std::micro::den;
 
         if (paddingSamples >= chMaxSamples) {
-            utils::warningMsg("[AudioCircularBuffer] Time discontinuity. Flushing buffer!");
+            WARNING_MSG("[AudioCircularBuffer] Time discontinuity. Flushing buffer!");
             flush();
-            return ret;
+            return noReaderIds();
         }
 
-        if(!pushBack(dummyFrame->getPlanarDataBuf(), paddingSamples)) {
-            utils::warningMsg("[AudioCircularBuffer] Cannot push padding");
-            return ret;
+        if(!pushBack(NULL, paddingSamples)) {
+            WARNING_MSG("[AudioCircularBuffer] Cannot push padding");
+            return noReaderIds();
         }
     }
 
-    if(!pushBack(inputFrame->getPlanarDataBuf(), inputFrame->getSamples())) {
-        utils::warningMsg("[AudioCircularBuffer] Cannot push frame");
-        return ret;
-    }
-    
-    std::lock_guard<std::mutex> guard(mtx);
-    
+    //NOTE: origin time is stored before the samples are published by pushBack
     orgTime = inputFrame->getOriginTime();
-    
-    for (auto& r : connectionData.readers){
-        ret.push_back(r.rFilterId);
+
+    if(!pushBack(inputPlanes, inputFrame->getSamples())) {
+        WARNING_MSG("[AudioCircularBuffer] Cannot push frame");
+        return noReaderIds();
     }
     
-    return ret;
+    countWrite(getElements(), channelMaxLength/(outputFrame->getSamples()*bytesPerSample));
+    
+    return getReaderIds();
 }
 
 int AudioCircularBuffer::removeFrame()
@@ -157,15 +235,46 @@ int AudioCircularBuffer::removeFrame()
     return connectionData.wFilterId;
 }
 
+//NOTE: only the writer flushes, queued samples are dropped by the reader when it finds them behind the sync point
 void AudioCircularBuffer::doFlush()
 {
-    std::lock_guard<std::mutex> guard(mtx);
-    rear = 0;
-    front = 0;
-    elements = 0;
+    publishSync(rearIdx.load(std::memory_order_relaxed), syncTimestamp.load(std::memory_order_relaxed));
     synchronized = false;
 }
 
+void AudioCircularBuffer::publishSync(size_t idx, int64_t ts)
+{
+    unsigned seq = syncSeq.load(std::memory_order_relaxed);
+
+    syncSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    syncTimestamp.store(ts, std::memory_order_relaxed);
+    syncIdx.store(idx, std::memory_order_relaxed);
+
+    syncSeq.store(seq + 2, std::memory_order_release);
+}
+
+size_t AudioCircularBuffer::readSync(int64_t &ts) const
+{
+    unsigned seq;
+    size_t sync;
+
+    do {
+        seq = syncSeq.load(std::memory_order_acquire);
+        sync = syncIdx.load(std::memory_order_relaxed);
+        ts = syncTimestamp.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != syncSeq.load(std::memory_order_relaxed));
+
+    return sync;
+}
+
+size_t AudioCircularBuffer::usedFront() const
+{
+    return std::max(frontIdx.load(), syncIdx.load(std::memory_order_relaxed));
+}
+
 
 Frame* AudioCircularBuffer::forceGetRear()
 {
@@ -183,35 +292,45 @@ bool AudioCircularBuffer::setup()
         return false;
     }
 
-    switch(sampleFormat) {
-        case U8P:
-            bytesPerSample = 1;
-            break;
-        case S16P:
-            bytesPerSample = 2;
-            break;
-        case FLTP:
-            bytesPerSample = 4;
-            break;
-        default:
-            bytesPerSample = 0;
-            utils::errorMsg("[Audio Circular Buffer] Only planar sample formats are supported (U8P, S16P, FLTP)");
-            return false;
+    if (channels > MAX_CHANNELS) {
+        utils::errorMsg("[Audio Circular Buffer] Up to " + std::to_string(MAX_CHANNELS) + " channels are supported");
+        return false;
+    }
+
+    bytesPerSample = utils::getBytesPerSampleFromFormat(sampleFormat);
+
+    if (bytesPerSample <= 0) {
+        utils::errorMsg("[Audio Circular Buffer] Only U8, S16 and FLT sample formats are supported, planar or interleaved");
+        return false;
     }
 
+    //NOTE: samples are always kept planar, interleaved frames are deinterleaved when pushed and interleaved again when popped
+    interleaved = !SampleConverter::isPlanar(sampleFormat);
+
     channelMaxLength = chMaxSamples*(sampleRate/1000) * bytesPerSample;
 
     for (unsigned i=0; i<channels; i++) {
-        data[i] = new unsigned char [channelMaxLength]();
+        data[i] = Frame::allocBuffer(channelMaxLength);
     }
 
-    inputFrame = PlanarAudioFrame::createNew(channels, sampleRate, AudioFrame::getMaxSamples(sampleRate), PCM, sampleFormat);
-    outputFrame = PlanarAudioFrame::createNew(channels, sampleRate, AudioFrame::getMaxSamples(sampleRate), PCM, sampleFormat);
-    dummyFrame = PlanarAudioFrame::createNew(channels, sampleRate, AudioFrame::getMaxSamples(sampleRate), PCM, sampleFormat);
-    dummyFrame->fillWithValue(0);
+    if (interleaved) {
+        inputFrame = InterleavedAudioFrame::createNew(channels, sampleRate, AudioFrame::getMaxSamples(sampleRate), PCM, sampleFormat);
+        outputFrame = InterleavedAudioFrame::createNew(channels, sampleRate, AudioFrame::getMaxSamples(sampleRate), PCM, sampleFormat);
+        inputBuffer[0] = inputFrame->getDataBuf();
+        outputBuffer[0] = outputFrame->getDataBuf();
+        inputPlanes = inputBuffer;
+        outputPlanes = outputBuffer;
+    } else {
+        inputFrame = PlanarAudioFrame::createNew(channels, sampleRate, AudioFrame::getMaxSamples(sampleRate), PCM, sampleFormat);
+        outputFrame = PlanarAudioFrame::createNew(channels, sampleRate, AudioFrame::getMaxSamples(sampleRate), PCM, sampleFormat);
+        inputPlanes = inputFrame->getPlanarDataBuf();
+        outputPlanes = outputFrame->getPlanarDataBuf();
+    }
 
-    outputFrame->setSamples(AudioFrame::getDefaultSamples(sampleRate));
-    outputFrame->setLength(AudioFrame::getDefaultSamples(sampleRate)*bytesPerSample);
+    setOutputFrameSamples(AudioFrame::getDefaultSamples(sampleRate));
+    
+    //NOTE: the input and output frames take as many bytes as a frame of the maximum samples
+    chargeBytes((channelMaxLength + 2*AudioFrame::getMaxSamples(sampleRate)*bytesPerSample)*channels);
 
     tsDeviationThreshold = MAX_DEVIATION_SAMPLES*std::micro::den/sampleRate;
     setupSuccess = true;
@@ -220,94 +339,211 @@ bool AudioCircularBuffer::setup()
 }
 
 
-bool AudioCircularBuffer::pushBack(unsigned char **buffer, int samplesRequested)
+bool AudioCircularBuffer::pushBack(unsigned char **buffer, unsigned samplesRequested)
 {
     unsigned bytesRequested = samplesRequested * bytesPerSample;
+    size_t rear = rearIdx.load(std::memory_order_relaxed);
+    size_t front = usedFront();
     unsigned rearMod;
-    int firstCopiedBytes;
+    unsigned firstCopiedBytes;
 
-    if (bytesRequested > (channelMaxLength - elements)) {
+    if (bytesRequested > channelMaxLength - (rear - front)) {
         return false;
     }
 
     rearMod = rear % channelMaxLength;
+    firstCopiedBytes = std::min(bytesRequested, channelMaxLength - rearMod);
 
-    if ((rearMod + bytesRequested) < channelMaxLength) {
-
-        for (unsigned i=0; i<channels; i++) {
-            memcpy(data[i] + rearMod, buffer[i], bytesRequested);
-        }
-
-    } else {
+    if (buffer && interleaved) {
+        deinterleave(buffer[0], rearMod, firstCopiedBytes/bytesPerSample);
+        deinterleave(buffer[0] + firstCopiedBytes*channels, 0, (bytesRequested - firstCopiedBytes)/bytesPerSample);
+        rearIdx.store(rear + bytesRequested);
+        return true;
+    }
 
-        firstCopiedBytes = channelMaxLength - rearMod;
-        
-        for (unsigned i=0; i<channels;  i++) {
+    for (unsigned i=0; i<channels; i++) {
+        if (buffer) {
             memcpy(data[i] + rearMod, buffer[i], firstCopiedBytes);
             memcpy(data[i], buffer[i] + firstCopiedBytes, bytesRequested - firstCopiedBytes);
+        } else {
+            memset(data[i] + rearMod, 0, firstCopiedBytes);
+            memset(data[i], 0, bytesRequested - firstCopiedBytes);
         }
     }
 
-    elements += bytesRequested;
-    rear += bytesRequested;
+    rearIdx.store(rear + bytesRequested);
     return true;
 }
 
-bool AudioCircularBuffer::popFront(unsigned char **buffer, unsigned samplesRequested)
+bool AudioCircularBuffer::popFront(unsigned char **buffer, unsigned samplesRequested, size_t sync, size_t &frontPos)
 {
     unsigned bytesRequested = samplesRequested * bytesPerSample;
+    size_t rear = rearIdx.load();
+    size_t front = std::max(frontIdx.load(std::memory_order_relaxed), sync);
+    unsigned frontMod;
+    unsigned firstCopiedBytes;
 
-    if (elements < bytesRequested) {
+    if (rear < front + bytesRequested) {
         return false;
     }
 
-    fillOutputBuffers(buffer, bytesRequested);
+    frontMod = front % channelMaxLength;
+    firstCopiedBytes = std::min(bytesRequested, channelMaxLength - frontMod);
+
+    if (interleaved) {
+        interleave(buffer[0], frontMod, firstCopiedBytes/bytesPerSample);
+        interleave(buffer[0] + firstCopiedBytes*channels, 0, (bytesRequested - firstCopiedBytes)/bytesPerSample);
+    } else {
+        for (unsigned i=0; i<channels; i++) {
+            memcpy(buffer[i], data[i] + frontMod, firstCopiedBytes);
+            memcpy(buffer[i] + firstCopiedBytes, data[i], bytesRequested - firstCopiedBytes);
+        }
+    }
+
+    frontPos = front;
+    frontIdx.store(front + bytesRequested);
 
     return true;
 }
 
-void AudioCircularBuffer::fillOutputBuffers(unsigned char **buffer, int bytesRequested)
+void AudioCircularBuffer::setDriftCompensation(unsigned targetSamples)
+{
+    unsigned maxSamples = AudioFrame::getMaxSamples(sampleRate);
+
+    driftTarget = std::min(targetSamples, channelMaxLength/(2*bytesPerSample));
+    driftRatio = 1;
+
+    if (driftTarget == 0) {
+        driftWindow.clear();
+        driftOut.clear();
+        return;
+    }
+
+    //NOTE: a pop consumes up to DRIFT_MAX_PPM more samples than it outputs, plus the filter length
+    driftStride = maxSamples + maxSamples*DRIFT_MAX_PPM/1000000 + 1 + DRIFT_TAPS + 2;
+    driftWindow.assign(channels*driftStride, 0);
+    driftOut.assign(maxSamples, 0);
+    ringToFloat = SampleConverter::getToFloatKernel(SampleConverter::toPlanar(sampleFormat));
+    frameFromFloat = SampleConverter::getFromFloatKernel(sampleFormat, interleaved ? channels : 1);
+
+    //NOTE: forces a reset on next pop
+    driftSync = syncIdx.load() + 1;
+}
+
+void AudioCircularBuffer::resetDrift(size_t front, size_t sync)
+{
+    for (unsigned i = 0; i < channels; i++) {
+        std::fill(driftWindow.begin() + i*driftStride, driftWindow.begin() + i*driftStride + DRIFT_TAPS/2 - 1, 0);
+    }
+
+    driftPhase = 0;
+    driftRatio = 1;
+    driftFill = driftTarget;
+    driftFront = front;
+    driftSync = sync;
+    driftOutput = front;
+}
+
+bool AudioCircularBuffer::popResampled(unsigned char **buffer, unsigned samplesRequested, size_t sync, size_t &frontPos)
 {
-    int firstCopiedBytes = 0;
+    size_t rear = rearIdx.load();
+    size_t front = std::max(frontIdx.load(std::memory_order_relaxed), sync);
+    unsigned history = DRIFT_TAPS/2 - 1;
+    unsigned queued = rear > front ? (rear - front)/bytesPerSample : 0;
+    unsigned consumed;
+    unsigned loaded;
     unsigned frontMod;
+    unsigned firstSamples;
+    double deviation;
+    float* window;
+    unsigned char* dst;
+
+    //NOTE: after a flush the samples before the front are not the history of the next ones
+    if (sync != driftSync || front != driftFront) {
+        resetDrift(front, sync);
+    }
+
+    deviation = (driftFill - driftTarget)/driftTarget;
+    driftRatio = 1 + std::max(-DRIFT_MAX_PPM/1e6, std::min(DRIFT_MAX_PPM/1e6, DRIFT_GAIN*deviation));
+
+    consumed = (unsigned) (driftPhase + samplesRequested*driftRatio);
+    loaded = consumed + DRIFT_TAPS/2 + 2;
+
+    if (queued < loaded) {
+        return false;
+    }
+
+    driftFill += DRIFT_SMOOTHING*(queued - driftFill);
 
     frontMod = front % channelMaxLength;
+    firstSamples = std::min(loaded*bytesPerSample, channelMaxLength - frontMod)/bytesPerSample;
 
-    if (frontMod + bytesRequested < channelMaxLength) {
-        for (unsigned i=0; i<channels; i++) {
-            memcpy(buffer[i], data[i] + frontMod, bytesRequested);
-        }
+    for (unsigned i = 0; i < channels; i++) {
+        window = driftWindow.data() + i*driftStride;
 
-    } else {
-        firstCopiedBytes = channelMaxLength - frontMod;
+        ringToFloat(data[i] + frontMod, window + history, firstSamples, 1);
+        ringToFloat(data[i], window + history + firstSamples, loaded - firstSamples, 1);
 
-        for (unsigned i=0; i<channels;  i++) {
-            memcpy(buffer[i], data[i] + frontMod, firstCopiedBytes);
-            memcpy(buffer[i] + firstCopiedBytes, data[i], bytesRequested - firstCopiedBytes);
-        }
+        resampleSpan(window, driftOut.data(), samplesRequested, driftPhase, driftRatio, driftBank().data());
+
+        dst = interleaved ? buffer[0] + i*bytesPerSample : buffer[i];
+        frameFromFloat(driftOut.data(), dst, samplesRequested, interleaved ? channels : 1);
+
+        //NOTE: the last consumed samples are the history of the next pop
+        std::copy(window + consumed, window + consumed + history, window);
     }
 
-    elements -= bytesRequested;
-    front += bytesRequested;
+    driftPhase += samplesRequested*driftRatio - consumed;
+
+    frontPos = driftOutput;
+    driftOutput += samplesRequested*bytesPerSample;
+    driftFront = front + consumed*bytesPerSample;
+    frontIdx.store(driftFront);
+
+    return true;
 }
 
-int AudioCircularBuffer::getFreeSamples()
+void AudioCircularBuffer::deinterleave(unsigned char const* src, unsigned ringPos, unsigned samples)
+{
+    unsigned char* planes[MAX_CHANNELS];
+
+    for (unsigned i=0; i<channels; i++) {
+        planes[i] = data[i] + ringPos;
+    }
+
+    SampleConverter::convert(&src, sampleFormat, planes, SampleConverter::toPlanar(sampleFormat), channels, samples);
+}
+
+void AudioCircularBuffer::interleave(unsigned char* dst, unsigned ringPos, unsigned samples)
 {
-    int freeBytes = channelMaxLength - elements;
+    unsigned char const* planes[MAX_CHANNELS];
 
-    if (freeBytes == 0) {
-        return freeBytes;
+    for (unsigned i=0; i<channels; i++) {
+        planes[i] = data[i] + ringPos;
     }
 
-    return (freeBytes/bytesPerSample);
+    SampleConverter::convert(planes, SampleConverter::toPlanar(sampleFormat), &dst, sampleFormat, channels, samples);
+}
+
+size_t AudioCircularBuffer::queuedBytes() const
+{
+    size_t rear = rearIdx.load();
+    size_t front = std::max(frontIdx.load(), syncIdx.load());
+
+    return rear > front ? rear - front : 0;
+}
+
+int AudioCircularBuffer::getFreeSamples()
+{
+    return (channelMaxLength - (rearIdx.load(std::memory_order_relaxed) - usedFront()))/bytesPerSample;
 }
 
 bool AudioCircularBuffer::forcePushBack(unsigned char **buffer, int samplesRequested)
 {
-    if(!pushBack(inputFrame->getPlanarDataBuf(), inputFrame->getSamples())) {
-        utils::debugMsg("There is not enough free space in the buffer. Discarding samples");
+    if(!pushBack(inputPlanes, inputFrame->getSamples())) {
+        DEBUG_MSG("There is not enough free space in the buffer. Discarding samples");
         if (getFreeSamples() != 0) {
-            pushBack(inputFrame->getPlanarDataBuf(), getFreeSamples());
+            pushBack(inputPlanes, getFreeSamples());
         }
         return false;
     }
@@ -318,16 +554,15 @@ bool AudioCircularBuffer::forcePushBack(unsigned char **buffer, int samplesReque
 void AudioCircularBuffer::setOutputFrameSamples(int samples) 
 {
     outputFrame->setSamples(samples);
-    outputFrame->setLength(samples*bytesPerSample);
+    outputFrame->setLength(samples*bytesPerSample*(interleaved ? channels : 1));
 }
 
 unsigned AudioCircularBuffer::getElements() const
 {
-    return elements/(outputFrame->getSamples()*bytesPerSample);
+    return queuedBytes()/(outputFrame->getSamples()*bytesPerSample);
 }
 
 bool AudioCircularBuffer::isFull() const
 {
-    return ((float) elements)/chMaxSamples >= FULL_THRESHOLD;
+    return ((float) queuedBytes())/chMaxSamples >= FULL_THRESHOLD;
 }
-
@@ -26,12 +26,31 @@
 #include "Types.hh"
 #include "FrameQueue.hh"
 #include "AudioFrame.hh"
-#include <mutex>
+#include "SampleConverter.hh"
+#include <atomic>
+#include <vector>
 
 #define DEFAULT_BUFFER_SIZE 32768 //samples (~600ms at 48KHz)
 
-
- class AudioCircularBuffer : public FrameQueue {
+#define DRIFT_TAPS 16           //!< Taps of each phase of the drift compensation resampler
+#define DRIFT_PHASES 256        //!< Fractional positions of the resampler, the nearest one is used
+#define DRIFT_MAX_PPM 1000      //!< Largest ratio adjustment, well beyond the drift of real clocks
+
+/*! Queue of audio samples. The writer pushes frames of any size and the reader
+*   gets frames of a fixed number of samples, timestamped by their position since synchronization.
+*   It is a single producer single consumer lock free ring: rear is only moved by the writer and front
+*   by the reader. Flushes are done by the writer moving the synchronization point, the reader skips
+*   the samples behind it and the writer counts them as free. The synchronization point and its
+*   timestamp are published together under a sequence counter, and a frame popped while the point
+*   moved is dropped, as its samples may have been overwritten. Samples are stored planar,
+*   interleaved formats are deinterleaved and interleaved again by SampleConverter.
+*   With drift compensation the reader resamples the samples it pops by a ratio slightly off 1, driven
+*   by the fill level, so a writer whose clock drifts from the reader one is followed without padding 
+*   or dropping samples and the buffer stays at the target depth. Output frames are then timestamped 
+*   at the nominal rate from the synchronization point, as the reader consumes them.
+*/
+
+class AudioCircularBuffer : public FrameQueue {
 
 public:
     static AudioCircularBuffer* createNew(struct ConnectionData cData, unsigned ch, unsigned sRate, unsigned maxSamples, SampleFmt sFmt);
@@ -51,7 +70,7 @@ public:
     /**
     * See FrameQueue::addFrame
     */
-    std::vector<int> addFrame();
+    const std::vector<int>& addFrame();
     
     /**
     * See FrameQueue::removeFrame
@@ -94,13 +113,65 @@ public:
     */
     bool isFull() const;
 
+    /**
+    * Enables the continuous compensation of the clock drift between the writer and the reader. It must
+    * be set by the reader (e.g. from its events), and only pays off if the reader is paced by its own
+    * clock, otherwise the fill level does not reflect the drift
+    * @param targetSamples fill level per channel the buffer is kept at, 0 to disable it
+    */
+    void setDriftCompensation(unsigned targetSamples);
+
+    /**
+    * @return fill level the drift compensation keeps, 0 if disabled
+    */
+    unsigned getDriftTarget() const {return driftTarget;};
+
+    /**
+    * @return input samples consumed per output sample, 1 without drift compensation
+    */
+    double getDriftRatio() const {return driftRatio;};
+
 private:
     AudioCircularBuffer(struct ConnectionData cData, unsigned ch, unsigned sRate, unsigned maxSamples, SampleFmt sFmt);
 
-    bool pushBack(unsigned char **buffer, int samplesRequested);
+    /**
+    * Copies samples to the rear of the buffer, with at most two copies per channel
+    * @param buffer planes to copy, NULL to push silence
+    * @param samplesRequested number of samples per channel
+    * @return false if there is not enough free space
+    */
+    bool pushBack(unsigned char **buffer, unsigned samplesRequested);
     bool forcePushBack(unsigned char **buffer, int samplesRequested);
-    bool popFront(unsigned char **buffer, unsigned samplesRequested);
-    void fillOutputBuffers(unsigned char **buffer, int bytesRequested);
+    bool popFront(unsigned char **buffer, unsigned samplesRequested, size_t sync, size_t &frontPos);
+
+    /**
+    * Pops samples resampled by the drift ratio, see popFront. frontPos is set to the position of the 
+    * first output sample in the output timeline, which advances by samplesRequested on every pop
+    */
+    bool popResampled(unsigned char **buffer, unsigned samplesRequested, size_t sync, size_t &frontPos);
+
+    /**
+    * Moves the synchronization point, writer side only
+    * @param idx ring position the timestamp refers to
+    * @param ts presentation time of the sample at idx, in microseconds
+    */
+    void publishSync(size_t idx, int64_t ts);
+
+    /**
+    * Reads the synchronization point and its timestamp as a pair, reader side
+    * @param ts set to the timestamp of the returned position
+    * @return ring position of the synchronization point
+    */
+    size_t readSync(int64_t &ts) const;
+
+    /**
+    * @return position the writer may not pass, the samples behind the synchronization point are free
+    */
+    size_t usedFront() const;
+    void resetDrift(size_t front, size_t sync);
+    size_t queuedBytes() const;
+    void deinterleave(unsigned char const* src, unsigned ringPos, unsigned samples);
+    void interleave(unsigned char* dst, unsigned ringPos, unsigned samples);
     bool setup();
 
     unsigned channels;
@@ -110,22 +181,42 @@ private:
     unsigned channelMaxLength;
     unsigned char *data[MAX_CHANNELS];
     SampleFmt sampleFormat;
+    bool interleaved;
     bool fillNewFrame;
 
-    PlanarAudioFrame* inputFrame;
-    PlanarAudioFrame* outputFrame;
-    PlanarAudioFrame* dummyFrame;
-
-    std::chrono::microseconds syncTimestamp;
+    AudioFrame* inputFrame;
+    AudioFrame* outputFrame;
+    unsigned char **inputPlanes;
+    unsigned char **outputPlanes;
+    unsigned char *inputBuffer[1];
+    unsigned char *outputBuffer[1];
+
+    QueueIndex rearIdx;
+    QueueIndex frontIdx;
+    QueueIndex syncIdx;
+    std::atomic<int64_t> syncTimestamp;
+    std::atomic<unsigned> syncSeq;      //!< Odd while the writer moves the synchronization point
     bool synchronized;
     bool setupSuccess;
     
-    std::chrono::system_clock::time_point orgTime;
+    std::atomic<std::chrono::system_clock::time_point> orgTime;
 
     int tsDeviationThreshold;
-    std::mutex mtx;
 
-    unsigned elements;
+    //NOTE: drift compensation state, only used by the reader
+    unsigned driftTarget;
+    double driftRatio;
+    double driftPhase;          //!< Fractional input position of the next output sample
+    double driftFill;           //!< Smoothed fill level driving the ratio
+    size_t driftFront;          //!< Ring position the next pop starts at, a flush moves it
+    size_t driftSync;
+    size_t driftOutput;         //!< Output timeline position of the next output sample
+    unsigned driftStride;
+    std::vector<float> driftWindow;     //!< Per channel, the history samples followed by the new ones
+    std::vector<float> driftOut;
+    SampleConverter::ToFloatKernel ringToFloat;
+    SampleConverter::FromFloatKernel frameFromFloat;
+    StreamInfo pcmInfo;     //!< Raw samples description, so readers can check the frames of the buffer
 };
 
 #endif
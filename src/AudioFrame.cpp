@@ -24,6 +24,7 @@
 #include <iostream>
 #include <assert.h>
 #include <string.h>
+#include <algorithm>
 #include "Utils.hh"
 
 int AudioFrame::getMaxSamples(int sampleRate)
@@ -31,9 +32,23 @@ int AudioFrame::getMaxSamples(int sampleRate)
     return (MAX_FRAME_TIME*sampleRate)/1000;
 }
 
+std::atomic<int> AudioFrame::defaultFrameTime(DEFAULT_FRAME_TIME);
+
 int AudioFrame::getDefaultSamples(int sampleRate)
 {
-    return (DEFAULT_FRAME_TIME*sampleRate)/1000000;
+    return ((long long) defaultFrameTime*sampleRate)/1000000;
+}
+
+bool AudioFrame::setDefaultFrameTime(std::chrono::microseconds frameTime)
+{
+    if (frameTime.count() < MIN_FRAME_TIME || frameTime.count() > MAX_FRAME_TIME*1000) {
+        utils::errorMsg("Audio frame time must be in [" + std::to_string(MIN_FRAME_TIME) + ", " + 
+                        std::to_string(MAX_FRAME_TIME*1000) + "] us");
+        return false;
+    }
+
+    defaultFrameTime = frameTime.count();
+    return true;
 }
 
 
@@ -61,26 +76,53 @@ InterleavedAudioFrame* InterleavedAudioFrame::createNew(int ch, int sRate, int m
         return NULL;
     }
 
+    if (ch > MAX_CHANNELS) {
+        utils::errorMsg("[InterleavedAudioFrame] Too many channels");
+        return NULL;
+    }
+
     return new InterleavedAudioFrame(ch, sRate, maxSamples, codec, sFmt);
 }
 
 InterleavedAudioFrame::InterleavedAudioFrame(int ch, int sRate, int maxSamples, ACodecType codec, SampleFmt sFmt)
 : AudioFrame(ch, sRate, maxSamples, codec, sFmt)
 {
-    bufferMaxLen = bytesPerSample * maxSamples * MAX_CHANNELS;
-    frameBuff = new unsigned char [bufferMaxLen]();
+    //NOTE: stereo is always allocated, as the coded frames of streams without channels information expect
+    allocatedChannels = std::max(ch, DEFAULT_CHANNELS);
+    bufferMaxLen = bytesPerSample * maxSamples * allocatedChannels;
+    frameBuff = allocBuffer(bufferMaxLen);
 }
 
 InterleavedAudioFrame::~InterleavedAudioFrame() 
 {
-    delete[] frameBuff;
+    freeBuffer(frameBuff);
 }
 
 void InterleavedAudioFrame::fillWithValue(int value)
 {
-    memset(frameBuff, value, bufferMaxLen*channels);
+    //NOTE: bufferMaxLen already accounts all the channels
+    memset(frameBuff, value, bufferMaxLen);
 }    
 
+void InterleavedAudioFrame::setChannels(int ch)
+{
+    if (ch > MAX_CHANNELS) {
+        utils::errorMsg("[InterleavedAudioFrame] Too many channels");
+        return;
+    }
+
+    //NOTE: the buffer only grows, its content is not kept
+    if ((unsigned) ch > allocatedChannels) {
+        freeBuffer(frameBuff);
+        allocatedChannels = ch;
+        bufferMaxLen = bytesPerSample * maxSamples * allocatedChannels;
+        frameBuff = allocBuffer(bufferMaxLen);
+        bufferLen = 0;
+    }
+
+    channels = ch;
+}
+
 
 
 /////////////////////////////////////////////
@@ -94,6 +136,11 @@ PlanarAudioFrame* PlanarAudioFrame::createNew(int ch, int sRate, int maxSamples,
         return NULL;
     }
 
+    if (ch > MAX_CHANNELS) {
+        utils::errorMsg("[PlanarAudioFrame] Too many channels");
+        return NULL;
+    }
+
     return new PlanarAudioFrame(ch, sRate, maxSamples, codec, sFmt);
 }
 
@@ -101,19 +148,35 @@ PlanarAudioFrame::PlanarAudioFrame(int ch, int sRate, int maxSamples, ACodecType
 : AudioFrame(ch, sRate, maxSamples, codec, sFmt)
 {
     bufferMaxLen = bytesPerSample * maxSamples;
+    allocatedChannels = std::max(ch, DEFAULT_CHANNELS);
 
-    for (int i=0; i<MAX_CHANNELS; i++) {
-        frameBuff[i] = new unsigned char [bufferMaxLen]();
+    //NOTE: planes are allocated on demand, see setChannels
+    for (unsigned i = 0; i < MAX_CHANNELS; i++) {
+        frameBuff[i] = i < allocatedChannels ? allocBuffer(bufferMaxLen) : NULL;
     }
 }
 
 PlanarAudioFrame::~PlanarAudioFrame()
 {
-    for (int i = 0; i < MAX_CHANNELS; i++) {
-        delete[] frameBuff[i];
+    for (unsigned i = 0; i < allocatedChannels; i++) {
+        freeBuffer(frameBuff[i]);
     }
 }
 
+void PlanarAudioFrame::setChannels(int ch)
+{
+    if (ch > MAX_CHANNELS) {
+        utils::errorMsg("[PlanarAudioFrame] Too many channels");
+        return;
+    }
+
+    for (; allocatedChannels < (unsigned) ch; allocatedChannels++) {
+        frameBuff[allocatedChannels] = allocBuffer(bufferMaxLen);
+    }
+
+    channels = ch;
+}
+
 void PlanarAudioFrame::fillWithValue(int value)
 {
     for (unsigned i = 0; i < channels; i++) {
@@ -26,12 +26,14 @@
 #include "Frame.hh"
 #include <vector>
 #include <string>
+#include <atomic>
 
 #define DEFAULT_CHANNELS 2
-#define MAX_CHANNELS 2
+#define MAX_CHANNELS 8 //!< Up to 7.1 layouts
 #define DEFAULT_SAMPLE_RATE 48000
 #define MAX_FRAME_TIME 100 //ms
 #define DEFAULT_FRAME_TIME 20000 //us
+#define MIN_FRAME_TIME 2500 //us, the shortest Opus frame
 
 class AudioFrame : public Frame {
     
@@ -39,7 +41,7 @@ class AudioFrame : public Frame {
         AudioFrame(int ch, int sRate, int maxSmpls, ACodecType codec, SampleFmt sFmt);
         AudioFrame() {};
 
-        void setChannels(int ch) {channels = ch;};
+        virtual void setChannels(int ch) {channels = ch;};
         void setSampleRate(int sRate) {sampleRate = sRate;};
         void setSampleFormat(SampleFmt sFmt) {sampleFmt = sFmt;};
         void setCodec(ACodecType cType) {fCodec = cType;};
@@ -55,11 +57,27 @@ class AudioFrame : public Frame {
         static int getMaxSamples(int sampleRate);
         static int getDefaultSamples(int sampleRate);
         std::chrono::nanoseconds getDuration() const;
+
+        /**
+        * Sets the duration of the frames of the filters and queues created from now on, process wide. 
+        * Short frames (2.5 to 10 ms) reduce the audio buffering of low latency paths, e.g. talkback feeds,
+        * at the cost of more frames to process (see BaseFilter::setBurst)
+        * @param frameTime frame duration, between MIN_FRAME_TIME and MAX_FRAME_TIME
+        * @return false if the duration is out of range, it is not changed then
+        */
+        static bool setDefaultFrameTime(std::chrono::microseconds frameTime);
+
+        /**
+        * @return default duration of the audio frames, see setDefaultFrameTime
+        */
+        static std::chrono::microseconds getDefaultFrameTime() {return std::chrono::microseconds(defaultFrameTime);};
               
     protected:
         unsigned channels, sampleRate, samples, maxSamples, bytesPerSample;
         ACodecType fCodec;
         SampleFmt sampleFmt;
+
+        static std::atomic<int> defaultFrameTime;
 };
 
 class InterleavedAudioFrame : public AudioFrame {
@@ -74,12 +92,14 @@ class InterleavedAudioFrame : public AudioFrame {
         bool isPlanar() {return false;};
         void setLength(unsigned int length) {bufferLen = length;};
         void fillWithValue(int value);
+        void setChannels(int ch);
 
     protected:
         InterleavedAudioFrame(int ch, int sRate, int maxSamples, ACodecType codec, SampleFmt sFmt);
 
     private:
         unsigned char *frameBuff;
+        unsigned allocatedChannels;
         unsigned int bufferLen;
         unsigned int bufferMaxLen;
 };
@@ -96,10 +116,12 @@ class PlanarAudioFrame : public AudioFrame {
         bool isPlanar() {return true;};
         void setLength(unsigned int length) {bufferLen = length;};
         void fillWithValue(int value);
+        void setChannels(int ch);
 
     private:
         PlanarAudioFrame(int ch, int sRate, int maxSamples, ACodecType codec, SampleFmt sFmt);
         unsigned char* frameBuff[MAX_CHANNELS];
+        unsigned allocatedChannels;
         unsigned int bufferLen;
         unsigned int bufferMaxLen;
 };
@@ -0,0 +1,80 @@
+/*
+ *  BitrateController.cpp - Congestion control from receiver reports
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "BitrateController.hh"
+#include <algorithm>
+
+BitrateController::BitrateController() : 
+    minBitrate(BRC_MIN_BITRATE), maxBitrate(BRC_MAX_BITRATE), bitrate(0), minRtt(0)
+{
+}
+
+bool BitrateController::setBounds(unsigned minBitrate_, unsigned maxBitrate_)
+{
+    if (minBitrate_ == 0 || minBitrate_ > maxBitrate_) {
+        return false;
+    }
+    
+    minBitrate = minBitrate_;
+    maxBitrate = maxBitrate_;
+    
+    if (bitrate > 0) {
+        bitrate = std::min(std::max(bitrate, (double) minBitrate), (double) maxBitrate);
+    }
+    
+    return true;
+}
+
+void BitrateController::reset()
+{
+    bitrate = 0;
+    minRtt = 0;
+}
+
+unsigned BitrateController::update(float loss, unsigned rtt, unsigned sentBitrate)
+{
+    bool queuing = false;
+    
+    if (bitrate <= 0) {
+        bitrate = sentBitrate > 0 ? sentBitrate : maxBitrate;
+    }
+    
+    if (rtt > 0) {
+        minRtt = minRtt == 0 ? rtt : std::min(minRtt, rtt);
+        queuing = rtt > minRtt + std::max(minRtt/2, (unsigned) BRC_DELAY_MARGIN);
+    }
+    
+    if (loss > BRC_HIGH_LOSS) {
+        bitrate *= 1 - 0.5*loss;
+    } else if (queuing) {
+        bitrate *= BRC_DELAY_DECREASE;
+    } else if (loss < BRC_LOW_LOSS) {
+        bitrate *= BRC_INCREASE;
+        //NOTE: an estimate not used by the sender has not been probed, it is not increased further
+        if (sentBitrate > 0) {
+            bitrate = std::min(bitrate, std::max(sentBitrate*BRC_PROBE_MARGIN, bitrate/BRC_INCREASE));
+        }
+    }
+    
+    bitrate = std::min(std::max(bitrate, (double) minBitrate), (double) maxBitrate);
+    return getBitrate();
+}
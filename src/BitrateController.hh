@@ -0,0 +1,81 @@
+/*
+ *  BitrateController.hh - Congestion control from receiver reports
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _BITRATE_CONTROLLER_HH
+#define _BITRATE_CONTROLLER_HH
+
+#define BRC_MIN_BITRATE 100         //!< Default lower bound of the estimate in kbps
+#define BRC_MAX_BITRATE 100000      //!< Default upper bound of the estimate in kbps
+#define BRC_LOW_LOSS 0.02           //!< Loss fraction below which the estimate grows
+#define BRC_HIGH_LOSS 0.10          //!< Loss fraction above which the estimate decreases
+#define BRC_INCREASE 1.08           //!< Growth of the estimate on each report without congestion
+#define BRC_PROBE_MARGIN 1.5        //!< The estimate does not grow beyond this factor of the sent bitrate
+#define BRC_DELAY_MARGIN 20         //!< Minimum round trip time increase in ms considered as queuing
+#define BRC_DELAY_DECREASE 0.85     //!< Decrease of the estimate when queuing delay is detected
+
+/*! Estimates the bitrate a network path can carry from the receiver reports (loss fraction and round
+    trip time). The loss based part follows the usual RTP congestion control rules: the estimate
+    decreases proportionally to heavy losses, it holds with moderate ones and grows slowly without
+    them. A round trip time rising well above its minimum means that a queue is building up on the
+    path, so the estimate is decreased before the link saturates and bursts of losses appear.
+    The estimate only grows while the sender uses it, so it does not run away on idle links.
+*/
+class BitrateController {
+
+public:
+    BitrateController();
+    
+    /**
+    * Sets the bounds of the estimate, it is clamped to them
+    * @param minBitrate lower bound in kbps
+    * @param maxBitrate upper bound in kbps
+    * @return false if the bounds are not valid
+    */
+    bool setBounds(unsigned minBitrate, unsigned maxBitrate);
+    
+    /**
+    * Updates the estimate with a new receiver report
+    * @param loss fraction of packets lost since the previous report, from 0 to 1
+    * @param rtt round trip time in ms, 0 if it is unknown
+    * @param sentBitrate bitrate sent in kbps, 0 if it is unknown
+    * @return the new estimate in kbps
+    */
+    unsigned update(float loss, unsigned rtt, unsigned sentBitrate);
+    
+    /**
+    * @return the estimate in kbps, 0 if there has been no report yet
+    */
+    unsigned getBitrate() const {return (unsigned) (bitrate + 0.5);};
+    
+    /**
+    * Discards the estimate and the round trip time history
+    */
+    void reset();
+
+private:
+    unsigned minBitrate;
+    unsigned maxBitrate;
+    double bitrate;
+    unsigned minRtt;
+};
+
+#endif
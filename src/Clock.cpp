@@ -0,0 +1,142 @@
+/*
+ *  Clock.cpp - Injectable clock of the scheduling and synchronisation logic
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <thread>
+
+#include "Clock.hh"
+
+std::atomic<Clock*> Clock::current(NULL);
+
+void Clock::install(Clock* clock)
+{
+    current.store(clock, std::memory_order_release);
+}
+
+Clock* Clock::get()
+{
+    Clock* clock = current.load(std::memory_order_acquire);
+
+    return clock ? clock : SystemClock::getInstance();
+}
+
+///////////////////////////
+// SYSTEM CLOCK          //
+///////////////////////////
+
+SystemClock* SystemClock::getInstance()
+{
+    static SystemClock instance;
+    return &instance;
+}
+
+SystemClock::SystemClock() :
+    systemBase(std::chrono::system_clock::now()), steadyBase(std::chrono::steady_clock::now())
+{
+}
+
+std::chrono::system_clock::time_point SystemClock::time()
+{
+    return systemBase + std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::steady_clock::now() - steadyBase);
+}
+
+void SystemClock::sleep(std::chrono::system_clock::time_point until)
+{
+    std::chrono::system_clock::duration left = until - time();
+
+    if (left.count() > 0){
+        std::this_thread::sleep_for(left);
+    }
+}
+
+std::chrono::system_clock::time_point SystemClock::deadline(std::chrono::system_clock::time_point until)
+{
+    return std::chrono::system_clock::now() + (until - time());
+}
+
+///////////////////////////
+// SIMULATED CLOCK       //
+///////////////////////////
+
+SimulatedClock::SimulatedClock(bool autoAdvance_, std::chrono::system_clock::time_point start) :
+    autoAdvance(autoAdvance_), ticks(start.time_since_epoch().count())
+{
+}
+
+std::chrono::system_clock::time_point SimulatedClock::time()
+{
+    return std::chrono::system_clock::time_point(
+        std::chrono::system_clock::duration(ticks.load(std::memory_order_acquire)));
+}
+
+void SimulatedClock::sleep(std::chrono::system_clock::time_point until)
+{
+    if (autoAdvance){
+        advanceTo(until);
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(mtx);
+    advanced.wait(guard, [this, until]{
+        return time() >= until;
+    });
+}
+
+std::chrono::system_clock::time_point SimulatedClock::deadline(std::chrono::system_clock::time_point until)
+{
+    std::chrono::microseconds left = std::chrono::duration_cast<std::chrono::microseconds>(until - time());
+
+    //NOTE: the clock is advanced without notifying the waiters, so they wake up periodically to check it
+    if (left.count() <= 0){
+        return std::chrono::system_clock::now();
+    }
+
+    return std::chrono::system_clock::now() + std::min(left, std::chrono::microseconds(SIMULATED_WAIT));
+}
+
+void SimulatedClock::advance(std::chrono::microseconds step)
+{
+    if (step.count() <= 0){
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        ticks.fetch_add(std::chrono::duration_cast<std::chrono::system_clock::duration>(step).count(),
+                        std::memory_order_acq_rel);
+    }
+    advanced.notify_all();
+}
+
+void SimulatedClock::advanceTo(std::chrono::system_clock::time_point until)
+{
+    std::chrono::system_clock::rep target = until.time_since_epoch().count();
+
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        if (target <= ticks.load(std::memory_order_acquire)){
+            return;
+        }
+        ticks.store(target, std::memory_order_release);
+    }
+    advanced.notify_all();
+}
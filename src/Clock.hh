@@ -0,0 +1,127 @@
+/*
+ *  Clock.hh - Injectable clock of the scheduling and synchronisation logic
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _CLOCK_HH
+#define _CLOCK_HH
+
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#define SIMULATED_EPOCH 1000000000  /*!< Start time in seconds of the simulated clocks, origin times of 0 mean unset */
+#define SIMULATED_WAIT 1000         /*!< Longest real wait in usec on a condition variable with a simulated deadline */
+
+/*! Time source of the runnables schedule, the workers waits and the frames origin times. The
+    system clock is used by default; a simulated one can be installed so schedules and delays
+    of tests and benchmarks are replayed exactly. Processing times (i.e. profiles) are always
+    measured with the real clocks.
+*/
+class Clock {
+
+public:
+    virtual ~Clock() {};
+
+    /**
+    * @return current time in the origin time base
+    */
+    virtual std::chrono::system_clock::time_point time() = 0;
+
+    /**
+    * Blocks the calling thread until the time point is reached
+    */
+    virtual void sleep(std::chrono::system_clock::time_point until) = 0;
+
+    /**
+    * @return real system time point to wait on a condition variable for the time point
+    */
+    virtual std::chrono::system_clock::time_point deadline(std::chrono::system_clock::time_point until) = 0;
+
+    /**
+    * Installs the clock used from now on. It is not owned, so it must outlive its use
+    * @param clock clock to install, NULL restores the system clock
+    */
+    static void install(Clock* clock);
+    static Clock* get();
+
+    static std::chrono::system_clock::time_point now() {return get()->time();};
+    static void sleepUntil(std::chrono::system_clock::time_point until) {get()->sleep(until);};
+    static std::chrono::system_clock::time_point waitDeadline(std::chrono::system_clock::time_point until)
+        {return get()->deadline(until);};
+
+private:
+    //NOTE: constant initialised, so the clock can be used by other static initialisers
+    static std::atomic<Clock*> current;
+};
+
+/*! System time at start up advanced by a monotonic clock, so delays are not skewed when NTP
+    slews the system clock
+*/
+class SystemClock : public Clock {
+
+public:
+    static SystemClock* getInstance();
+
+    std::chrono::system_clock::time_point time();
+    void sleep(std::chrono::system_clock::time_point until);
+    std::chrono::system_clock::time_point deadline(std::chrono::system_clock::time_point until);
+
+private:
+    SystemClock();
+
+    const std::chrono::system_clock::time_point systemBase;
+    const std::chrono::steady_clock::time_point steadyBase;
+};
+
+/*! Clock only advanced explicitly. With auto advance, sleeping jumps the clock to the wake up
+    time, so a single thread driving the runnables replays a schedule without waiting; otherwise
+    sleepers wait for the clock to be advanced by another thread.
+*/
+class SimulatedClock : public Clock {
+
+public:
+    SimulatedClock(bool autoAdvance = true,
+                   std::chrono::system_clock::time_point start =
+                       std::chrono::system_clock::time_point(std::chrono::seconds(SIMULATED_EPOCH)));
+
+    std::chrono::system_clock::time_point time();
+    void sleep(std::chrono::system_clock::time_point until);
+    std::chrono::system_clock::time_point deadline(std::chrono::system_clock::time_point until);
+
+    /**
+    * Advances the clock, waking up the sleepers whose time is reached
+    */
+    void advance(std::chrono::microseconds step);
+
+    /**
+    * Advances the clock to the time point, a past one is ignored
+    */
+    void advanceTo(std::chrono::system_clock::time_point until);
+
+private:
+    const bool autoAdvance;
+    std::atomic<std::chrono::system_clock::rep> ticks;
+    std::mutex mtx;
+    std::condition_variable advanced;
+};
+
+#endif
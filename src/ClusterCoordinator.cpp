@@ -0,0 +1,637 @@
+/*
+ *  ClusterCoordinator.cpp - Placement of pipeline graphs across nodes
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <algorithm>
+
+#include "ClusterCoordinator.hh"
+#include "MemoryBudget.hh"
+#include "Utils.hh"
+
+ClusterPlanner::ClusterPlanner(std::vector<ClusterNode> &nodes_, int linkIdBase) :
+    nodes(nodes_), nextId(linkIdBase), links(0)
+{
+}
+
+float ClusterPlanner::getDefaultCost(FilterType type)
+{
+    switch (type) {
+        case VIDEO_ENCODER:
+        case VIDEO_LADDER_ENCODER:
+        case VIDEO_VPX_ENCODER:
+            return 1.0;
+        case VIDEO_DECODER:
+        case VIDEO_MIXER:
+        case VIDEO_SPLITTER:
+            return 0.5;
+        case VIDEO_HW_ENCODER:
+        case VIDEO_RESAMPLER:
+        case VIDEO_LADDER_RESAMPLER:
+        case VIDEO_PREVIEWER:
+            return 0.25;
+        case AUDIO_DECODER:
+        case AUDIO_ENCODER:
+        case AUDIO_MULTI_ENCODER:
+        case AUDIO_MIXER:
+            return 0.1;
+        default:
+            return 0.05;
+    }
+}
+
+int ClusterPlanner::getNode(int filterId) const
+{
+    std::map<int, Placed>::const_iterator it = placed.find(filterId);
+    return it == placed.end() ? -1 : it->second.node;
+}
+
+bool ClusterPlanner::fits(int node, const Placed &p) const
+{
+    return nodes[node].capacity >= p.cost && (nodes[node].memory < 0 || nodes[node].memory >= p.memory);
+}
+
+bool ClusterPlanner::collectFilters(Jzon::Node &graph)
+{
+    FilterType type;
+    Placed p;
+    int id;
+
+    if (!graph.Has("filters") || !graph.Get("filters").IsArray()) {
+        error = "Error placing graph. Invalid filters array...";
+        return false;
+    }
+
+    for (auto &f : graph.Get("filters").AsArray()) {
+        if (!f.IsObject() || !f.Has("id") || !f.Get("id").IsNumber() || !f.Has("type")) {
+            error = "Error placing graph. Invalid filter...";
+            return false;
+        }
+
+        id = f.Get("id").ToInt();
+        type = utils::getFilterTypeFromString(f.Get("type").ToString());
+
+        if (type == FT_NONE || filterParams.count(id) > 0 || id >= nextId) {
+            error = "Error placing graph. Filter " + std::to_string(id) + " type or ID is not valid...";
+            return false;
+        }
+
+        p.node = -1;
+        p.cost = f.Has("cost") && f.Get("cost").IsNumber() ? f.Get("cost").ToFloat() : getDefaultCost(type);
+        p.memory = f.Has("memory") && f.Get("memory").IsNumber() ? f.Get("memory").ToDouble() :
+                   MEMORY_FILTER_RESERVE + MEMORY_QUEUE_RESERVE;
+
+        //NOTE: pinned filters (e.g. receivers bound to an ingress address) are placed whatever they cost
+        if (f.Has("node")) {
+            for (size_t n = 0; n < nodes.size(); n++) {
+                if ((f.Get("node").IsNumber() && f.Get("node").ToInt() == (int) n) ||
+                    (f.Get("node").IsString() && f.Get("node").ToString() == nodes[n].name)) {
+                    p.node = n;
+                }
+            }
+
+            if (p.node < 0) {
+                error = "Error placing graph. Filter " + std::to_string(id) + " is pinned to an unknown node...";
+                return false;
+            }
+
+            nodes[p.node].capacity -= p.cost;
+            nodes[p.node].memory -= nodes[p.node].memory < 0 ? 0 : p.memory;
+        }
+
+        placed[id] = p;
+        filterParams[id] = &f;
+    }
+
+    return true;
+}
+
+bool ClusterPlanner::place(int id, int preferred)
+{
+    Placed &p = placed[id];
+    int best = -1;
+
+    if (p.node >= 0) {
+        return true;
+    }
+
+    //NOTE: staying with the connected filter saves a link, otherwise the least loaded node is taken
+    if (preferred >= 0 && fits(preferred, p)) {
+        best = preferred;
+    } else {
+        for (size_t n = 0; n < nodes.size(); n++) {
+            if (fits(n, p) && (best < 0 || nodes[n].capacity > nodes[best].capacity)) {
+                best = n;
+            }
+        }
+    }
+
+    if (best < 0) {
+        error = "Error placing graph. Filter " + std::to_string(id) + " does not fit in any node...";
+        return false;
+    }
+
+    p.node = best;
+    nodes[best].capacity -= p.cost;
+    nodes[best].memory -= nodes[best].memory < 0 ? 0 : p.memory;
+
+    return true;
+}
+
+bool ClusterPlanner::plan(Jzon::Node &graph)
+{
+    std::vector<Jzon::Array> filters(nodes.size()), paths(nodes.size()), events(nodes.size());
+    std::vector<std::vector<int>> chains;
+    std::vector<Jzon::Node*> pathParams;
+    int node;
+
+    //NOTE: Jzon objects are deep copied on construction only, so the graphs are built in place
+    graphs.clear();
+    graphs.resize(nodes.size());
+
+    if (nodes.empty()) {
+        error = "Error placing graph. There are no nodes...";
+        return false;
+    }
+
+    if (!collectFilters(graph)) {
+        return false;
+    }
+
+    if (graph.Has("paths")) {
+        if (!graph.Get("paths").IsArray()) {
+            error = "Error placing graph. Invalid paths array...";
+            return false;
+        }
+
+        for (auto &p : graph.Get("paths").AsArray()) {
+            if (!p.IsObject() || !p.Has("id") || !p.Has("orgFilterId") || !p.Has("dstFilterId") ||
+                !p.Has("orgWriterId") || !p.Has("dstReaderId") || !p.Has("midFiltersIds") ||
+                !p.Get("midFiltersIds").IsArray() || p.Get("id").ToInt() >= nextId) {
+                error = "Error placing graph. Invalid path...";
+                return false;
+            }
+
+            std::vector<int> chain = {p.Get("orgFilterId").ToInt()};
+
+            for (auto &m : p.Get("midFiltersIds").AsArray()) {
+                chain.push_back(m.ToInt());
+            }
+
+            chain.push_back(p.Get("dstFilterId").ToInt());
+
+            for (auto id : chain) {
+                if (placed.count(id) == 0) {
+                    error = "Error placing graph. Path " + std::to_string(p.Get("id").ToInt()) +
+                            " uses unknown filter " + std::to_string(id) + "...";
+                    return false;
+                }
+            }
+
+            chains.push_back(chain);
+            pathParams.push_back(&p);
+        }
+    }
+
+    //NOTE: filters follow their upstream one, or the downstream one of a path starting at an unplaced origin
+    for (auto &chain : chains) {
+        for (size_t i = 0; i < chain.size(); i++) {
+            node = i > 0 ? placed[chain[i - 1]].node : -1;
+
+            if (node < 0 && i + 1 < chain.size()) {
+                node = placed[chain[i + 1]].node;
+            }
+
+            if (!place(chain[i], node)) {
+                return false;
+            }
+        }
+    }
+
+    for (auto &it : filterParams) {
+        if (!place(it.first, -1)) {
+            return false;
+        }
+    }
+
+    for (auto &it : filterParams) {
+        Jzon::Object f(*it.second);
+
+        for (auto key : {"node", "cost", "memory"}) {
+            f.Remove(key);
+        }
+
+        filters[placed[it.first].node].Add(f);
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        graphs[i].Add("filters", filters[i]);
+        graphs[i].Add("paths", paths[i]);
+        graphs[i].Add("events", events[i]);
+    }
+
+    for (auto p : pathParams) {
+        splitPath(*p);
+    }
+
+    if (graph.Has("events") && graph.Get("events").IsArray()) {
+        for (auto &e : graph.Get("events").AsArray()) {
+            if (!e.IsObject() || !e.Has("filterId") || getNode(e.Get("filterId").ToInt()) < 0) {
+                error = "Error placing graph. Invalid event...";
+                return false;
+            }
+
+            graphs[getNode(e.Get("filterId").ToInt())].Get("events").AsArray().Add(e);
+        }
+    }
+
+    return true;
+}
+
+void ClusterPlanner::addSegment(int node, Jzon::Node &path, int id, int org, int dst, std::vector<int> &mids,
+                                bool first, bool last)
+{
+    Jzon::Object s(path);
+    Jzon::Array midIds;
+
+    for (auto key : {"id", "orgFilterId", "dstFilterId", "midFiltersIds", "link", "outputProfile"}) {
+        s.Remove(key);
+    }
+
+    //NOTE: link filters have a single reader or writer, only the original ends keep their IDs
+    if (!first) {
+        s.Remove("orgWriterId");
+        s.Add("orgWriterId", -1);
+    }
+
+    if (!last) {
+        s.Remove("dstReaderId");
+        s.Add("dstReaderId", -1);
+        s.Remove("syncGroup");
+    }
+
+    for (auto m : mids) {
+        midIds.Add(m);
+    }
+
+    s.Add("id", id);
+    s.Add("orgFilterId", org);
+    s.Add("dstFilterId", dst);
+    s.Add("midFiltersIds", midIds);
+
+    graphs[node].Get("paths").AsArray().Add(s);
+}
+
+void ClusterPlanner::addLink(int from, int to, Jzon::Node &path, int &senderId, int &receiverId)
+{
+    Jzon::Object sender, receiver;
+
+    senderId = nextId++;
+    receiverId = nextId++;
+
+    sender.Add("id", senderId);
+    sender.Add("type", "frameLinkSender");
+    sender.Add("host", nodes[to].linkHost);
+    sender.Add("port", (int) nodes[to].linkPort);
+
+    //NOTE: the receiver declares the stream the sender is going to announce
+    if (path.Has("link") && path.Get("link").IsObject()) {
+        for (auto it : path.Get("link").AsObject()) {
+            receiver.Add(it.first, it.second);
+        }
+    } else {
+        receiver.Add("codec", "H264");
+    }
+
+    receiver.Add("id", receiverId);
+    receiver.Add("type", "frameLinkReceiver");
+    receiver.Add("port", (int) nodes[to].linkPort++);
+
+    graphs[from].Get("filters").AsArray().Add(sender);
+    graphs[to].Get("filters").AsArray().Add(receiver);
+    links++;
+}
+
+void ClusterPlanner::splitPath(Jzon::Node &path)
+{
+    std::vector<int> chain = {path.Get("orgFilterId").ToInt()};
+    std::vector<int> mids;
+    int org, senderId, receiverId, node;
+    int id = path.Get("id").ToInt();
+
+    for (auto &m : path.Get("midFiltersIds").AsArray()) {
+        chain.push_back(m.ToInt());
+    }
+
+    chain.push_back(path.Get("dstFilterId").ToInt());
+
+    if (std::all_of(chain.begin(), chain.end(), [&](int f) {return placed[f].node == placed[chain.front()].node;})) {
+        graphs[placed[chain.front()].node].Get("paths").AsArray().Add(path);
+        return;
+    }
+
+    org = chain.front();
+
+    for (size_t i = 1; i < chain.size(); i++) {
+        node = placed[chain[i - 1]].node;
+
+        if (placed[chain[i]].node == node) {
+            if (i + 1 < chain.size()) {
+                mids.push_back(chain[i]);
+                continue;
+            }
+
+            addSegment(node, path, id, org, chain[i], mids, org == chain.front(), true);
+            break;
+        }
+
+        addLink(node, placed[chain[i]].node, path, senderId, receiverId);
+        addSegment(node, path, id, org, senderId, mids, org == chain.front(), false);
+
+        //NOTE: the first segment keeps the path ID, each node change starts a new one
+        id = nextId++;
+        org = receiverId;
+        mids.clear();
+
+        if (i + 1 < chain.size()) {
+            mids.push_back(chain[i]);
+            continue;
+        }
+
+        addSegment(placed[chain[i]].node, path, id, org, chain[i], mids, false, true);
+    }
+}
+
+ClusterCoordinator::ClusterCoordinator() : deployments(0), failures(0)
+{
+}
+
+bool ClusterCoordinator::parseNodes(Jzon::Node &list, std::vector<ClusterNode> &nodes, std::string &error)
+{
+    std::set<std::string> names;
+    ClusterNode node;
+
+    if (!list.IsArray() || list.GetCount() == 0) {
+        error = "Error creating cluster graph. Invalid nodes array...";
+        return false;
+    }
+
+    for (auto &n : list.AsArray()) {
+        node.local = n.IsObject() && n.Has("local") && n.Get("local").ToBool();
+
+        if (!n.IsObject() || (!node.local && (!n.Has("host") || !n.Has("port") || !n.Get("port").IsNumber()))) {
+            error = "Error creating cluster graph. Invalid node...";
+            return false;
+        }
+
+        node.host = n.Has("host") ? n.Get("host").ToString() : "localhost";
+        node.port = n.Has("port") && n.Get("port").IsNumber() ? n.Get("port").ToInt() : 0;
+        node.name = n.Has("name") ? n.Get("name").ToString() : node.host + ":" + std::to_string(node.port);
+        node.linkHost = n.Has("linkHost") ? n.Get("linkHost").ToString() : node.host;
+        node.capacity = 0;
+        node.memory = -1;
+
+        //NOTE: links of earlier deployments keep their ports, so new ones start after them
+        if (n.Has("linkPort") && n.Get("linkPort").IsNumber()) {
+            node.linkPort = n.Get("linkPort").ToInt();
+        } else {
+            node.linkPort = CLUSTER_LINK_PORT;
+        }
+
+        if (linkPorts.count(node.name) > 0 && linkPorts[node.name] > node.linkPort) {
+            node.linkPort = linkPorts[node.name];
+        }
+
+        if (!names.insert(node.name).second) {
+            error = "Error creating cluster graph. Node " + node.name + " is not unique...";
+            return false;
+        }
+
+        nodes.push_back(node);
+    }
+
+    return true;
+}
+
+void ClusterCoordinator::setCapacity(Jzon::Node &state, ClusterNode &node)
+{
+    float workers = 1;
+    float utilisation = 0;
+    double budget;
+
+    //NOTE: the thread budget is the node cores, the pool may not be created yet
+    if (state.Has("threadBudget") && state.Get("threadBudget").Has("threadBudget")) {
+        workers = state.Get("threadBudget").Get("threadBudget").ToInt();
+    } else if (state.Has("pool") && state.Get("pool").Has("maxWorkers")) {
+        workers = state.Get("pool").Get("maxWorkers").ToInt();
+    }
+
+    if (state.Has("pool") && state.Get("pool").Has("utilisation")) {
+        utilisation = state.Get("pool").Get("utilisation").ToFloat();
+    }
+
+    node.capacity = workers*(1 - std::min(std::max(utilisation, 0.0f), 1.0f));
+    node.memory = -1;
+
+    if (state.Has("memoryBudget") && state.Get("memoryBudget").Has("memoryBudget")) {
+        budget = state.Get("memoryBudget").Get("memoryBudget").ToDouble();
+
+        if (budget > 0) {
+            node.memory = std::max(0.0, budget - state.Get("memoryBudget").Get("usedBytes").ToDouble());
+        }
+    }
+}
+
+bool ClusterCoordinator::request(const ClusterNode &node, Jzon::Node &events, Jzon::Object &response)
+{
+    struct addrinfo hints, *result;
+    struct timeval timeout = {CLUSTER_TIMEOUT/1000, (CLUSTER_TIMEOUT%1000)*1000};
+    Jzon::Object root;
+    std::string message, in;
+    size_t length = 0, header;
+    char buffer[4096];
+    ssize_t n;
+    int fd = -1;
+
+    root.Add("events", events);
+
+    Jzon::Writer writer(root, Jzon::NoFormat);
+    writer.Write();
+    message = std::to_string(writer.GetResult().size()) + "\n" + writer.GetResult();
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(node.host.c_str(), std::to_string(node.port).c_str(), &hints, &result) != 0 || !result) {
+        utils::errorMsg("[ClusterCoordinator] Could not resolve node " + node.name);
+        return false;
+    }
+
+    //NOTE: blocking socket bounded by its timeouts, a silent node does not stall the control thread for long
+    if ((fd = socket(result->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        connect(fd, result->ai_addr, result->ai_addrlen) != 0 ||
+        send(fd, message.data(), message.size(), MSG_NOSIGNAL) != (ssize_t) message.size()) {
+        utils::errorMsg("[ClusterCoordinator] Could not send the request to node " + node.name);
+        freeaddrinfo(result);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    freeaddrinfo(result);
+
+    //NOTE: the response is framed as the request, its length and a newline go first
+    while ((header = in.find('\n')) == std::string::npos || in.size() < header + 1 + length) {
+        if (header != std::string::npos && length == 0) {
+            length = std::strtoul(in.c_str(), NULL, 10);
+
+            if (length == 0 || length > CLUSTER_MAX_RESPONSE) {
+                break;
+            }
+
+            continue;
+        }
+
+        if ((n = recv(fd, buffer, sizeof(buffer), 0)) <= 0) {
+            break;
+        }
+
+        in.append(buffer, n);
+    }
+
+    close(fd);
+
+    if (header == std::string::npos || length == 0 || in.size() < header + 1 + length) {
+        utils::errorMsg("[ClusterCoordinator] Node " + node.name + " did not answer");
+        return false;
+    }
+
+    Jzon::Parser parser(response, in.substr(header + 1, length));
+
+    if (!parser.Parse()) {
+        utils::errorMsg("[ClusterCoordinator] Invalid response from node " + node.name);
+        return false;
+    }
+
+    return true;
+}
+
+bool ClusterCoordinator::queryCapacity(ClusterNode &node)
+{
+    Jzon::Array events;
+    Jzon::Object event, params, response;
+
+    event.Add("action", "getState");
+    event.Add("params", params);
+    events.Add(event);
+
+    if (!request(node, events, response)) {
+        return false;
+    }
+
+    setCapacity(response, node);
+
+    return true;
+}
+
+bool ClusterCoordinator::createGraph(const ClusterNode &node, Jzon::Object &graph, std::string &error)
+{
+    Jzon::Array events;
+    Jzon::Object event, response;
+
+    event.Add("action", "createGraph");
+    event.Add("params", graph);
+    events.Add(event);
+
+    if (!request(node, events, response)) {
+        error = "Error creating cluster graph. Node " + node.name + " did not answer...";
+        return false;
+    }
+
+    if (!response.Has("error") || !response.Get("error").IsNull()) {
+        error = "Error creating cluster graph. Node " + node.name + ": " +
+                (response.Has("error") ? response.Get("error").ToString() : "unknown error");
+        return false;
+    }
+
+    return true;
+}
+
+void ClusterCoordinator::removeFilters(const ClusterNode &node, Jzon::Object &graph)
+{
+    Jzon::Array events;
+    Jzon::Object response;
+
+    for (auto &f : graph.Get("filters").AsArray()) {
+        Jzon::Object event, params;
+        params.Add("id", f.Get("id").ToInt());
+        event.Add("action", "removeFilter");
+        event.Add("params", params);
+        events.Add(event);
+    }
+
+    if (events.GetCount() > 0) {
+        request(node, events, response);
+    }
+}
+
+void ClusterCoordinator::deployed(std::vector<ClusterNode> &nodes, ClusterPlanner &planner, Jzon::Node &graph)
+{
+    int node;
+
+    for (auto &n : nodes) {
+        linkPorts[n.name] = n.linkPort;
+    }
+
+    for (auto &f : graph.Get("filters").AsArray()) {
+        if ((node = planner.getNode(f.Get("id").ToInt())) >= 0) {
+            placement[f.Get("id").ToInt()] = nodes[node].name;
+        }
+    }
+
+    deployments++;
+}
+
+void ClusterCoordinator::getState(Jzon::Object &node)
+{
+    Jzon::Array filters;
+
+    for (auto &it : placement) {
+        Jzon::Object f;
+        f.Add("id", it.first);
+        f.Add("node", it.second);
+        filters.Add(f);
+    }
+
+    node.Add("deployments", (int) deployments);
+    node.Add("failures", (int) failures);
+    node.Add("placement", filters);
+}
@@ -0,0 +1,181 @@
+/*
+ *  ClusterCoordinator.hh - Placement of pipeline graphs across nodes
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _CLUSTER_COORDINATOR_HH
+#define _CLUSTER_COORDINATOR_HH
+
+#include <map>
+#include <set>
+#include <vector>
+#include <string>
+
+#include "Types.hh"
+#include "Jzon.h"
+
+#define CLUSTER_TIMEOUT 2000                /*!< Milliseconds a node is given to answer a request */
+#define CLUSTER_LINK_PORT 21000             /*!< First TCP port of the link receivers of a node */
+#define CLUSTER_MAX_RESPONSE (16*1024*1024) /*!< Longer node responses are refused */
+
+/*! A node of the cluster, as given by the orchestrator, and its spare capacity */
+struct ClusterNode {
+    std::string name;
+    std::string host;                       //!< Controller host
+    unsigned port;                          //!< Controller port
+    std::string linkHost;                   //!< Address the other nodes send their links to
+    unsigned linkPort;                      //!< Next link receiver port
+    bool local;                             //!< This process, its graph is created without any request
+    float capacity;                         //!< Spare workers
+    double memory;                          //!< Spare bytes, negative if the node has no memory budget
+};
+
+/*! Places the filters of a graph on the cluster nodes and splits it into a graph per node. Filters
+    are placed one by one, pinned ones first and then following the paths, on the node of the filter
+    they are connected to as long as it fits there, otherwise on the node with the most spare workers.
+    The cost of a filter is the workers it is expected to take, from its "cost" field, which the
+    orchestrator fills from the filters profiling, or from a default cost of its type. Its memory is the
+    one given in "memory" or the filter and queue reserves of the memory budget. Paths whose filters
+    end up on different nodes are cut at each node change and joined by a frameLinkSender and
+    frameLinkReceiver pair, their stream is described by the "link" object of the path (H.264 video
+    by default). Link filters and cut path segments get IDs from linkIdBase on.
+*/
+class ClusterPlanner {
+
+public:
+    /**
+    * @param nodes nodes with their spare capacity. Their link port is moved past the ones the plan uses
+    * @param linkIdBase first ID of the link filters and path segments, higher than any graph ID
+    */
+    ClusterPlanner(std::vector<ClusterNode> &nodes, int linkIdBase);
+
+    /**
+    * Places the filters and splits the graph
+    * @param graph createGraph parameters, filters may have "node", "cost" and "memory" fields
+    * @return false if some filter does not fit in the cluster or the graph is not valid, see getError
+    */
+    bool plan(Jzon::Node &graph);
+
+    const std::string& getError() const {return error;};
+
+    /**
+    * @param node node index
+    * @return createGraph parameters of the node, empty if nothing is placed on it
+    */
+    Jzon::Object &getGraph(size_t node) {return graphs[node];};
+
+    /**
+    * @return node index of the filter, -1 if it is not placed
+    */
+    int getNode(int filterId) const;
+
+    unsigned getLinks() const {return links;};
+
+    /**
+    * @return workers a filter of this type is expected to take
+    */
+    static float getDefaultCost(FilterType type);
+
+private:
+    struct Placed {
+        int node;
+        float cost;
+        double memory;
+    };
+
+    bool collectFilters(Jzon::Node &graph);
+    bool place(int id, int preferred);
+    bool fits(int node, const Placed &p) const;
+    void splitPath(Jzon::Node &path);
+    void addLink(int from, int to, Jzon::Node &path, int &senderId, int &receiverId);
+    void addSegment(int node, Jzon::Node &path, int id, int org, int dst, std::vector<int> &mids, bool first, bool last);
+
+    std::vector<ClusterNode> &nodes;
+    std::vector<Jzon::Object> graphs;
+    std::map<int, Placed> placed;
+    std::map<int, Jzon::Node*> filterParams;
+    int nextId;
+    unsigned links;
+    std::string error;
+};
+
+/*! Deploys graphs on a cluster of nodes through their Controllers, which keep their own API: the
+    capacity of each node comes from its getState event (spare workers from the thread budget and the
+    workers utilisation, spare bytes from its memory budget) and each node gets its part of the graph
+    in a createGraph event. Requests are length framed and bounded by CLUSTER_TIMEOUT, the control
+    thread is blocked meanwhile. The local node is handled by the PipelineManager itself.
+*/
+class ClusterCoordinator {
+
+public:
+    ClusterCoordinator();
+
+    /**
+    * Parses the nodes of a request, each one with "host" and "port" or "local", and optional "name",
+    * "linkHost" and "linkPort" fields
+    * @return false if some node is not valid
+    */
+    bool parseNodes(Jzon::Node &list, std::vector<ClusterNode> &nodes, std::string &error);
+
+    /**
+    * Fills the node spare capacity from its getState response
+    */
+    static void setCapacity(Jzon::Node &state, ClusterNode &node);
+
+    /**
+    * Requests the state of a remote node and sets its capacity
+    * @return false if the node does not answer
+    */
+    bool queryCapacity(ClusterNode &node);
+
+    /**
+    * Creates a graph on a remote node
+    * @param error set to the node error, if any
+    * @return false if the node does not answer or fails creating it
+    */
+    bool createGraph(const ClusterNode &node, Jzon::Object &graph, std::string &error);
+
+    /**
+    * Removes the filters of a graph from a remote node, errors are ignored
+    */
+    void removeFilters(const ClusterNode &node, Jzon::Object &graph);
+
+    /**
+    * Records a deployed plan, so the next links of its nodes get new ports
+    */
+    void deployed(std::vector<ClusterNode> &nodes, ClusterPlanner &planner, Jzon::Node &graph);
+
+    /**
+    * Records a plan that could not be deployed
+    */
+    void failed() {failures++;};
+
+    void getState(Jzon::Object &node);
+
+private:
+    bool request(const ClusterNode &node, Jzon::Node &events, Jzon::Object &response);
+
+    std::map<std::string, unsigned> linkPorts;
+    std::map<int, std::string> placement;
+    size_t deployments;
+    size_t failures;
+};
+
+#endif
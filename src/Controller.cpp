@@ -26,15 +26,60 @@
 #include "Utils.hh"
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 Controller* Controller::ctrlInstance = NULL;
 PipelineManager* PipelineManager::pipeMngrInstance = NULL;
 
-Controller::Controller()
+static bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/**
+* @return length of the JSON object at the beginning of data, 0 if it is not complete yet
+*/
+static size_t getObjectLength(const std::string &data)
+{
+    int depth = 0;
+    bool inString = false;
+    bool escaped = false;
+
+    for (size_t i = 0; i < data.size(); i++) {
+        if (inString) {
+            if (escaped) {
+                escaped = false;
+            } else if (data[i] == '\\') {
+                escaped = true;
+            } else if (data[i] == '"') {
+                inString = false;
+            }
+            continue;
+        }
+
+        if (data[i] == '"') {
+            inString = true;
+        } else if (data[i] == '{' || data[i] == '[') {
+            depth++;
+        } else if ((data[i] == '}' || data[i] == ']') && --depth == 0) {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+Controller::Controller() : listeningSocket(-1), epollFd(-1), wakeFd(-1), nextSerial(0), stopping(false)
 {
     ctrlInstance = this;
     pipeMngrInstance = PipelineManager::getInstance();
@@ -42,6 +87,18 @@ Controller::Controller()
     parser = new Jzon::Parser(*inputRootNode);
     initializeEventMap();
     runFlag = true;
+    current.fd = -1;
+    current.serial = 0;
+    current.lengthFramed = false;
+}
+
+Controller::~Controller()
+{
+    stopWorkers();
+
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
 }
 
 Controller* Controller::getInstance()
@@ -71,6 +128,7 @@ PipelineManager* Controller::pipelineManager()
 bool Controller::createSocket(int port)
 {
     struct sockaddr_in serv_addr;
+    struct epoll_event ev;
     int yes=1;
 
     listeningSocket = socket(AF_INET, SOCK_STREAM, 0);
@@ -95,64 +153,263 @@ bool Controller::createSocket(int port)
         return false;
     }
 
+    if (listen(listeningSocket, SOMAXCONN) < 0 || !setNonBlocking(listeningSocket)) {
+        utils::errorMsg("Listening on socket");
+        return false;
+    }
+
+    epollFd = epoll_create1(0);
+    ev.events = EPOLLIN;
+    ev.data.fd = listeningSocket;
+
+    if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listeningSocket, &ev) < 0) {
+        utils::errorMsg("Creating the socket event loop");
+        return false;
+    }
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+
+    if (wakeFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) < 0) {
+        utils::errorMsg("Creating the control threads wake up descriptor");
+        return false;
+    }
+
+    startWorkers();
     return true;
 }
 
-bool Controller::listenSocket()
+void Controller::startWorkers()
 {
-    socklen_t clilen;
-    struct sockaddr cli_addr;
-    clilen = sizeof(cli_addr);
-    struct timeval tv;
-    int ret;
-    
-    listen(listeningSocket,5);
-    
-    tv.tv_sec = 0;
-    tv.tv_usec = TIMEOUT;
-    
-    FD_ZERO(&readfds);
-    FD_SET(listeningSocket, &readfds);
-    
-    ret = select(listeningSocket + 1, &readfds, NULL, NULL, &tv);
-
-    if (ret <= 0){
-        return false;
+    stopping = false;
+
+    for (unsigned i = workers.size(); i < CTRL_WORKERS; i++) {
+        workers.push_back(std::thread(&Controller::workerLoop, this));
     }
-    
-    if (!FD_ISSET(listeningSocket, &readfds)){
-        return false;
+}
+
+void Controller::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> guard(workersMtx);
+        stopping = true;
+        dispatched.clear();
+    }
+
+    workersCv.notify_all();
+
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    workers.clear();
+    responses.clear();
+}
+
+void Controller::workerLoop()
+{
+    Jzon::Object root;
+    Jzon::Parser parser(root);
+    Request request;
+    Response response;
+    uint64_t one = 1;
+
+    std::unique_lock<std::mutex> lock(workersMtx);
+
+    while (true) {
+        workersCv.wait(lock, [this] () {return stopping || !dispatched.empty();});
+
+        if (stopping) {
+            return;
+        }
+
+        request = dispatched.front();
+        dispatched.pop_front();
+        lock.unlock();
+
+        root.Clear();
+        parser.SetJson(request.message);
+        response.fd = request.fd;
+        response.serial = request.serial;
+        response.lengthFramed = request.lengthFramed;
+
+        //NOTE: the request ID is unknown, so the connection is closed after the error
+        if (!parser.Parse()) {
+            utils::errorMsg("Error parsing JSON");
+            response.message = "{\"error\":\"Error parsing JSON\"}";
+            response.close = true;
+        } else {
+            response.message.clear();
+            response.close = processRoot(root, response.message);
+        }
+
+        lock.lock();
+        responses.push_back(response);
+
+        if (write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            utils::warningMsg("Could not wake the control loop up");
+        }
+    }
+}
+
+//NOTE: only the first request of each idle connection is dispatched, so its requests are processed in order
+void Controller::dispatchRequests()
+{
+    std::deque<Request> waiting;
+    bool added = false;
+
+    if (workers.empty() || requests.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(workersMtx);
+
+        for (auto &r : requests) {
+            if (connections.count(r.fd) == 0 || connections[r.fd]->serial != r.serial) {
+                continue;
+            }
+
+            if (connections[r.fd]->busy) {
+                waiting.push_back(r);
+                continue;
+            }
+
+            connections[r.fd]->busy = true;
+            dispatched.push_back(r);
+            added = true;
+        }
+    }
+
+    requests.swap(waiting);
+
+    if (added) {
+        workersCv.notify_all();
+    }
+}
+
+void Controller::deliverResponses()
+{
+    std::deque<Response> done;
+    Connection *conn;
+    uint64_t value;
+
+    {
+        std::lock_guard<std::mutex> guard(workersMtx);
+        while (read(wakeFd, &value, sizeof(value)) > 0);
+        done.swap(responses);
+    }
+
+    //NOTE: responses of connections closed meanwhile are dropped
+    for (auto &r : done) {
+        if (connections.count(r.fd) == 0 || connections[r.fd]->serial != r.serial) {
+            continue;
+        }
+
+        conn = connections[r.fd];
+        conn->busy = false;
+        queueResponse(conn, r.message, r.lengthFramed, r.close);
     }
-    
-    connectionSocket = accept(listeningSocket, (struct sockaddr *) &cli_addr, &clilen);
-    
-    if (connectionSocket < 0) {
+}
+
+bool Controller::listenSocket()
+{
+    struct epoll_event events[CTRL_MAX_EVENTS];
+    Connection *conn;
+    int n;
+
+    if (epollFd < 0) {
         return false;
     }
-    
-    return true;
+
+    //NOTE: requests waiting for their connection to be idle are dispatched when a response wakes the loop up
+    n = epoll_wait(epollFd, events, CTRL_MAX_EVENTS, requests.empty() || !workers.empty() ? TIMEOUT/1000 : 0);
+
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.fd == listeningSocket) {
+            acceptConnections();
+            continue;
+        }
+
+        if (events[i].data.fd == wakeFd) {
+            deliverResponses();
+            continue;
+        }
+
+        if (connections.count(events[i].data.fd) == 0) {
+            continue;
+        }
+
+        conn = connections[events[i].data.fd];
+
+        if ((events[i].events & EPOLLOUT) && !writeConnection(conn)) {
+            continue;
+        }
+
+        //NOTE: the peer is gone once its connection hangs up after being half closed
+        if ((events[i].events & (EPOLLERR | EPOLLHUP)) && conn->readClosed) {
+            closeConnection(conn);
+            continue;
+        }
+
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            readConnection(conn);
+        }
+    }
+
+    dispatchRequests();
+
+    pipeMngrInstance->exportMetrics();
+    pipeMngrInstance->governLoad();
+
+    return workers.empty() && !requests.empty();
 }
 
 void Controller::stopAndCloseSocket()
 {
+    stopWorkers();
+
+    while (!connections.empty()) {
+        closeConnection(connections.begin()->second);
+    }
+
+    requests.clear();
+
+    if (epollFd >= 0) {
+        close(epollFd);
+        epollFd = -1;
+    }
+
+    if (wakeFd >= 0) {
+        close(wakeFd);
+        wakeFd = -1;
+    }
+
     close(listeningSocket);
+    listeningSocket = -1;
 }
 
-
 bool Controller::readAndParse()
 {
-    bzero(inBuffer, MSG_BUFFER_MAX_LENGTH);
+    Jzon::Object outputNode;
+
     inputRootNode->Clear();
-    
-    if (read(connectionSocket, inBuffer, MSG_BUFFER_MAX_LENGTH - 1) < 0) {
-        utils::errorMsg("Reading from socket");
+
+    if (requests.empty()) {
         return false;
     }
 
-    parser->SetJson(inBuffer);
+    current = requests.front();
+    requests.pop_front();
 
+    parser->SetJson(current.message);
+
+    //NOTE: the request ID is unknown, so the connection is closed after the error
     if (!parser->Parse()) {
         utils::errorMsg("Error parsing JSON");
+        outputNode.Add("error", "Error parsing JSON");
+        sendResponse(outputNode, true);
         return false;
     }
 
@@ -160,58 +417,74 @@ bool Controller::readAndParse()
 }
 
 void Controller::processRequest()
+{
+    std::string result;
+    bool close;
+
+    close = processRoot(*inputRootNode, result);
+    sendResponse(result, close);
+}
+
+//NOTE: it may be run by several control threads at once, it returns true if the connection has to be closed
+bool Controller::processRoot(Jzon::Object &root, std::string &result)
 {
     Jzon::Object outputNode;
+    bool persistent = root.Has("id");
 
-    if (!inputRootNode->Has("events") || !inputRootNode->Get("events").IsArray()) {
-        utils::warningMsg("Invalid JSON, missing 'events' tag");
-        outputNode.Add("error", "Invalid JSON, missing 'events' tag");
-        sendAndClose(outputNode, connectionSocket);
-        return;
+    if (persistent) {
+        outputNode.Add("id", root.Get("id"));
     }
 
-    const Jzon::Array &events = inputRootNode->Get("events").AsArray();
+    if (!root.Has("events") || !root.Get("events").IsArray()) {
+        utils::warningMsg("Invalid JSON, missing 'events' tag");
+        outputNode.Add("error", "Invalid JSON, missing 'events' tag");
+    } else {
+        const Jzon::Array &events = root.Get("events").AsArray();
+
+        //NOTE: metrics are serialised straight into the response, without building a Jzon tree
+        if (events.GetCount() == 1 && !(*events.begin()).Has("filterId") && (*events.begin()).Has("action") &&
+            (*events.begin()).Get("action").ToString() == "getMetrics") {
+            writeMetrics(root, *events.begin(), result);
+            return !persistent;
+        }
 
-    for (Jzon::Array::const_iterator it = events.begin(); it != events.end(); ++it) {
-        if ((*it).Has("filterId")) {
-            processFilterEvent(*it, outputNode);
-        } else {
-            processInternalEvent(*it, outputNode);
+        for (Jzon::Array::const_iterator it = events.begin(); it != events.end(); ++it) {
+            if ((*it).Has("filterId")) {
+                processFilterEvent(*it, outputNode);
+            } else {
+                processInternalEvent(*it, outputNode);
+            }
         }
     }
 
-    sendAndClose(outputNode, connectionSocket);
+    Jzon::Writer writer(outputNode, Jzon::NoFormat);
+    writer.Write();
+    result = writer.GetResult();
+    return !persistent;
 }
 
-void Controller::processFilterEvent(Jzon::Object event, Jzon::Object &outputNode)
+void Controller::processFilterEvent(const Jzon::Node &event, Jzon::Object &outputNode)
 {
-    int filterId;
     int delay = -1;
-    BaseFilter *filter = NULL;
 
     if (!event.Has("action") || !event.Has("params")) {
         outputNode.Add("error", "Error processing filter event. Invalid JSON format...");
         return ;
     }
 
-    filterId = event.Get("filterId").ToInt();
-    filter = pipeMngrInstance->getFilter(filterId);
+    if (event.Has("delay")) {
+        delay = event.Get("delay").ToInt();
+    }
 
-    if (!filter) {
+    if (!pipeMngrInstance->pushFilterEvent(event, delay)) {
         outputNode.Add("error", "Error while processing event. There is no filter with this ID...");
         return;
     }
 
-    if (event.Has("delay")) {
-        delay = event.Get("delay").ToInt();
-    }
-
-    Event e(event, std::chrono::system_clock::now(), delay);
-    filter->pushEvent(e);
     outputNode.Add("error", Jzon::null);
 }
 
-void Controller::processInternalEvent(Jzon::Object event, Jzon::Object &outputNode)
+void Controller::processInternalEvent(const Jzon::Node &event, Jzon::Object &outputNode)
 {
     if (!event.Has("action") || !event.Has("params")) {
         outputNode.Add("error", "Error processing internal event. Invalid JSON format...");
@@ -219,14 +492,18 @@ void Controller::processInternalEvent(Jzon::Object event, Jzon::Object &outputNo
     }
 
     std::string action = event.Get("action").ToString();
-    Jzon::Object params = event.Get("params");
+    //NOTE: events are dispatched with the params of the parsed request, they are not copied
+    Jzon::Node &params = event.Get("params");
 
-    if (eventMap.count(action) <= 0) {
+    //NOTE: the map is only read once initialized, so control threads look it up concurrently
+    auto it = eventMap.find(action);
+
+    if (it == eventMap.end()) {
         outputNode.Add("error", "Error processing internal event. Invalid action...");
         return;
     }
 
-    eventMap[action](&params, outputNode);
+    it->second(&params, outputNode);
 }
 
 void Controller::initializeEventMap()
@@ -235,30 +512,281 @@ void Controller::initializeEventMap()
                                             std::placeholders::_1, std::placeholders::_2);
     eventMap["createPath"] = std::bind(&PipelineManager::createPathEvent, pipeMngrInstance,
                                             std::placeholders::_1, std::placeholders::_2);
+    eventMap["createGraph"] = std::bind(&PipelineManager::createGraphEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
     eventMap["removePath"] = std::bind(&PipelineManager::removePathEvent, pipeMngrInstance,
                                             std::placeholders::_1, std::placeholders::_2);
+    eventMap["suspendPath"] = std::bind(&PipelineManager::suspendPathEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+    eventMap["resumePath"] = std::bind(&PipelineManager::resumePathEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
     eventMap["createFilter"] = std::bind(&PipelineManager::createFilterEvent, pipeMngrInstance,
                                             std::placeholders::_1, std::placeholders::_2);
     eventMap["removeFilter"] = std::bind(&PipelineManager::removeFilterEvent, pipeMngrInstance,
                                             std::placeholders::_1, std::placeholders::_2);
+    eventMap["configurePool"] = std::bind(&PipelineManager::configurePoolEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
     eventMap["stop"] = std::bind(&PipelineManager::stopEvent, pipeMngrInstance,
                                             std::placeholders::_1, std::placeholders::_2);
+    eventMap["configureMetrics"] = std::bind(&PipelineManager::configureMetricsEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+    eventMap["createClusterGraph"] = std::bind(&PipelineManager::createClusterGraphEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+    eventMap["configureGovernor"] = std::bind(&PipelineManager::configureGovernorEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+    eventMap["configureTracing"] = std::bind(&PipelineManager::configureTracingEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+    eventMap["configureLocks"] = std::bind(&PipelineManager::configureLocksEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+    eventMap["configureCounters"] = std::bind(&PipelineManager::configureCountersEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+    eventMap["configureAudioFraming"] = std::bind(&PipelineManager::configureAudioFramingEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+    eventMap["dumpTrace"] = std::bind(&PipelineManager::dumpTraceEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+    eventMap["configureSnapshot"] = std::bind(&PipelineManager::configureSnapshotEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+    eventMap["saveSnapshot"] = std::bind(&PipelineManager::saveSnapshotEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+    eventMap["restoreSnapshot"] = std::bind(&PipelineManager::restoreSnapshotEvent, pipeMngrInstance,
+                                            std::placeholders::_1, std::placeholders::_2);
+
+}
 
+void Controller::writeMetrics(Jzon::Object &root, const Jzon::Node &event, std::string &result)
+{
+    bool delta = event.Has("params") && event.Get("params").Has("delta") && event.Get("params").Get("delta").ToBool();
+
+    result = "{";
+
+    if (root.Has("id")) {
+        Jzon::Writer writer(root.Get("id"), Jzon::NoFormat);
+        writer.Write();
+        result += "\"id\":" + writer.GetResult() + ",";
+    }
+
+    result += "\"error\":null,\"metrics\":";
+    pipeMngrInstance->getMetrics(result, delta);
+    result += "}";
 }
 
-void Controller::sendAndClose(Jzon::Object outputNode, int socket)
+void Controller::sendResponse(Jzon::Object outputNode, bool close)
 {
     Jzon::Writer writer(outputNode, Jzon::NoFormat);
+
     writer.Write();
-    std::string result = writer.GetResult();
-    const char* res = result.c_str();
-    int ret = write(socket, res, result.size());
+    sendResponse(writer.GetResult(), close);
+}
+
+void Controller::sendResponse(std::string result, bool close)
+{
+    //NOTE: the connection may have been closed while the request was waiting
+    if (connections.count(current.fd) == 0 || connections[current.fd]->serial != current.serial) {
+        return;
+    }
+
+    queueResponse(connections[current.fd], result, current.lengthFramed, close);
+}
+
+void Controller::queueResponse(Connection *conn, const std::string &result, bool lengthFramed, bool close)
+{
+    if (lengthFramed) {
+        conn->out += std::to_string(result.size()) + "\n" + result;
+    } else {
+        conn->out += result + "\n";
+    }
+
+    if (close) {
+        conn->closeAfter = true;
+    }
+
+    writeConnection(conn);
+}
+
+void Controller::acceptConnections()
+{
+    struct epoll_event ev;
+    Connection *conn;
+    int fd;
+
+    while ((fd = accept(listeningSocket, NULL, NULL)) >= 0) {
+        if (connections.size() >= CTRL_MAX_CONNECTIONS || !setNonBlocking(fd)) {
+            utils::warningMsg("Refusing control connection");
+            close(fd);
+            continue;
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+
+        conn = new Connection();
+        conn->fd = fd;
+        conn->serial = ++nextSerial;
+        conn->busy = false;
+        conn->closeAfter = false;
+        conn->readClosed = false;
+        connections[fd] = conn;
+    }
+}
+
+void Controller::readConnection(Connection *conn)
+{
+    char buffer[MSG_BUFFER_MAX_LENGTH];
+    ssize_t len = 1;
+
+    //NOTE: epoll is level triggered, data left unread is notified again
+    while (conn->in.size() <= CTRL_MAX_MESSAGE && (len = recv(conn->fd, buffer, sizeof(buffer), 0)) > 0) {
+        conn->in.append(buffer, len);
+    }
+
+    if ((len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) || !extractRequests(conn)) {
+        utils::warningMsg("Invalid control message or connection error, closing the connection");
+        closeConnection(conn);
+        return;
+    }
+
+    //NOTE: requests already read are still answered when the client half closes its connection
+    if (len == 0) {
+        conn->readClosed = true;
+        conn->closeAfter = true;
+
+        if (conn->out.empty() && !hasRequests(conn)) {
+            closeConnection(conn);
+            return;
+        }
+
+        watchOutput(conn, !conn->out.empty());
+    }
+}
+
+bool Controller::hasRequests(Connection *conn)
+{
+    if (conn->busy) {
+        return true;
+    }
+
+    for (auto r : requests) {
+        if (r.fd == conn->fd) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Controller::extractRequests(Connection *conn)
+{
+    Request request;
+    size_t start, lineEnd, length;
+    char *end;
+
+    request.fd = conn->fd;
+    request.serial = conn->serial;
+
+    while (true) {
+        start = 0;
+
+        while (start < conn->in.size() && isspace((unsigned char) conn->in[start])) {
+            start++;
+        }
+
+        conn->in.erase(0, start);
+
+        if (conn->in.empty()) {
+            return true;
+        }
+
+        if (isdigit((unsigned char) conn->in[0])) {
+            lineEnd = conn->in.find('\n');
 
-    if (ret < 0) {
-        utils::errorMsg("Error writting socket");
+            //NOTE: no valid length prefix is that long
+            if (lineEnd == std::string::npos) {
+                return conn->in.size() <= 16;
+            }
+
+            length = strtoul(conn->in.c_str(), &end, 10);
+
+            if (end != conn->in.c_str() + lineEnd && (*end != '\r' || end + 1 != conn->in.c_str() + lineEnd)) {
+                return false;
+            }
+
+            if (length > CTRL_MAX_MESSAGE) {
+                return false;
+            }
+
+            if (conn->in.size() < lineEnd + 1 + length) {
+                return true;
+            }
+
+            request.message = conn->in.substr(lineEnd + 1, length);
+            request.lengthFramed = true;
+            conn->in.erase(0, lineEnd + 1 + length);
+        } else if (conn->in[0] == '{') {
+            length = getObjectLength(conn->in);
+
+            if (length == 0) {
+                return conn->in.size() <= CTRL_MAX_MESSAGE;
+            }
+
+            request.message = conn->in.substr(0, length);
+            request.lengthFramed = false;
+            conn->in.erase(0, length);
+        } else {
+            return false;
+        }
+
+        requests.push_back(request);
+    }
+}
+
+bool Controller::writeConnection(Connection *conn)
+{
+    ssize_t len;
+
+    while (!conn->out.empty()) {
+        len = send(conn->fd, conn->out.data(), conn->out.size(), MSG_NOSIGNAL);
+
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            watchOutput(conn, true);
+            return true;
+        }
+
+        if (len < 0) {
+            utils::errorMsg("Error writting socket");
+            closeConnection(conn);
+            return false;
+        }
+
+        conn->out.erase(0, len);
     }
 
-    if (socket >= 0){
-        close(socket);
+    if (conn->closeAfter && !hasRequests(conn)) {
+        closeConnection(conn);
+        return false;
     }
+
+    watchOutput(conn, false);
+    return true;
+}
+
+void Controller::watchOutput(Connection *conn, bool enable)
+{
+    struct epoll_event ev;
+
+    ev.events = (conn->readClosed ? 0 : EPOLLIN) | (enable ? EPOLLOUT : 0);
+    ev.data.fd = conn->fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+void Controller::closeConnection(Connection *conn)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    connections.erase(conn->fd);
+    delete conn;
 }
@@ -26,15 +26,33 @@
 
 #include <vector>
 #include <map>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
 #include <functional>
+#include <condition_variable>
 
 #include "PipelineManager.hh"
 
 #define MSG_BUFFER_MAX_LENGTH 4096*4
 #define TIMEOUT 100000 //usec
+#define CTRL_MAX_MESSAGE 1024*1024          //!< Longer messages close their connection
+#define CTRL_MAX_CONNECTIONS 64             //!< Further connections are refused
+#define CTRL_MAX_EVENTS 32                  //!< Events handled per epoll_wait call
+#define CTRL_WORKERS 4                      //!< Threads processing the requests of the socket
 
 /*! Controller class is a singleton class defines the control protocol
-    by events and through sockets
+    by events and through sockets. The socket is served by a non-blocking epoll loop with persistent
+    connections, each one may carry any number of JSON messages, either one after the other (i.e. one
+    per line) or length framed, prefixed by their length in ASCII decimal digits and a newline.
+    Requests are processed in order and may be pipelined, responses are framed as their request was,
+    with a trailing newline otherwise. A request with an "id" gets it back in its response and leaves
+    the connection open, requests without it are answered and their connection closed, as in the one
+    request per connection protocol. Socket requests are processed by CTRL_WORKERS control threads, one
+    request of each connection at a time, so different connections are served concurrently (e.g. building
+    independent pipelines) while the requests of a connection keep their order. The calling thread only
+    serves the socket, listenSocket never leaves requests to readAndParse then.
 */
 class Controller {
 public:
@@ -50,6 +68,11 @@ public:
     */
     static void destroyInstance();
 
+    /**
+    * Class destructor, stops the control threads
+    */
+    ~Controller();
+
     /**
     * Returns the pipelinemanager object of the controller
     */
@@ -63,18 +86,19 @@ public:
     bool createSocket(int port);
 
     /**
-    * Listens incoming data from socket
-    * @return true if succes, otherwise returns false
+    * Waits up to TIMEOUT for socket activity, accepting connections, reading their requests and
+    * writing pending responses. It does not wait if requests are already pending
+    * @return true if there are requests pending, otherwise returns false
     */
     bool listenSocket();
 
     /**
-    * Stops and closes socket
+    * Stops and closes socket and all the connections
     */
     void stopAndCloseSocket();
 
     /**
-    * Reads and parses incoming data from socket
+    * Parses the next pending request, a request that cannot be parsed is answered with an error
     * @return true if succes, otherwise returns false
     */
     bool readAndParse();
@@ -86,7 +110,7 @@ public:
     bool run() {return runFlag;};
 
     /**
-    * Processes the incoming requests from socket
+    * Processes the parsed request and queues its response
     */
     void processRequest();
 
@@ -94,14 +118,68 @@ protected:
     void initializeEventMap();
 
 private:
+    struct Connection {
+        int fd;
+        unsigned long serial;               //!< Tells apart connections reusing a descriptor
+        bool busy;                          //!< A request is being processed by a control thread
+        std::string in;
+        std::string out;                    //!< Responses not yet written
+        bool closeAfter;                    //!< Closed once its responses are written
+        bool readClosed;                    //!< Half closed by the client, nothing else is read
+    };
+
+    struct Request {
+        int fd;
+        unsigned long serial;
+        std::string message;
+        bool lengthFramed;
+    };
+
+    struct Response {
+        int fd;
+        unsigned long serial;
+        std::string message;
+        bool lengthFramed;
+        bool close;
+    };
+
     Controller();
     bool processEvent(Jzon::Object event);
-    void processFilterEvent(Jzon::Object event, Jzon::Object &outputNode);
-    void processInternalEvent(Jzon::Object event, Jzon::Object &outputNode);
-    void sendAndClose(Jzon::Object outputNode, int socket);
-
-    int listeningSocket, connectionSocket;
-    char inBuffer[MSG_BUFFER_MAX_LENGTH];
+    bool processRoot(Jzon::Object &root, std::string &result);
+    void processFilterEvent(const Jzon::Node &event, Jzon::Object &outputNode);
+    void processInternalEvent(const Jzon::Node &event, Jzon::Object &outputNode);
+    void sendResponse(Jzon::Object outputNode, bool close);
+    void sendResponse(std::string result, bool close);
+    void queueResponse(Connection *conn, const std::string &result, bool lengthFramed, bool close);
+    void writeMetrics(Jzon::Object &root, const Jzon::Node &event, std::string &result);
+
+    void startWorkers();
+    void stopWorkers();
+    void workerLoop();
+    void dispatchRequests();
+    void deliverResponses();
+    void acceptConnections();
+    void readConnection(Connection *conn);
+    bool hasRequests(Connection *conn);
+    bool extractRequests(Connection *conn);
+    bool writeConnection(Connection *conn);
+    void closeConnection(Connection *conn);
+    void watchOutput(Connection *conn, bool enable);
+
+    int listeningSocket, epollFd;
+    int wakeFd;                             //!< eventfd written by the control threads with responses
+    unsigned long nextSerial;
+    std::map<int, Connection*> connections;
+    std::deque<Request> requests;
+
+    std::vector<std::thread> workers;
+    std::mutex workersMtx;                  //!< Guards the dispatched requests and their responses
+    std::condition_variable workersCv;
+    std::deque<Request> dispatched;
+    std::deque<Response> responses;
+    bool stopping;
+
+    Request current;                        //!< Request being processed
     Jzon::Object* inputRootNode;
     Jzon::Parser* parser;
     std::map<std::string, std::function<void(Jzon::Node* params, Jzon::Object &outputNode)> > eventMap;
@@ -109,8 +187,6 @@ private:
 
     static Controller* ctrlInstance;
     PipelineManager* pipeMngrInstance;
-
-    fd_set readfds;
 };
 
 #endif
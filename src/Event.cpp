@@ -31,9 +31,9 @@ bool Event::operator<(const Event& e) const
     return timestamp > e.timestamp;
 }
 
-Event::Event(Jzon::Object rootNode, std::chrono::system_clock::time_point timestamp, int delay) 
+Event::Event(const Jzon::Object &rootNode, std::chrono::system_clock::time_point timestamp, int delay) 
 {
-    inputRootNode = new Jzon::Object(rootNode);
+    inputRootNode = std::make_shared<Jzon::Object>(rootNode);
     this->timestamp = timestamp;
     this->delay = std::chrono::milliseconds(delay);
 }
@@ -43,7 +43,7 @@ Event::~Event()
 
 }
 
-bool Event::canBeExecuted(std::chrono::system_clock::time_point currentTime)
+bool Event::canBeExecuted(std::chrono::system_clock::time_point currentTime) const
 {
     return std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - timestamp) >= delay;
 }
@@ -68,9 +68,43 @@ Jzon::Node* Event::getParams()
     return NULL;
 }
 
+EventInbox::EventInbox() : head(NULL)
+{
+
+}
 
+EventInbox::~EventInbox()
+{
+    Node* node = head.exchange(NULL);
+    Node* next;
 
+    while (node) {
+        next = node->next;
+        delete node;
+        node = next;
+    }
+}
 
+void EventInbox::push(Event e)
+{
+    Node* node = new Node(std::move(e));
 
+    node->next = head.load(std::memory_order_relaxed);
 
+    while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
 
+void EventInbox::take(std::priority_queue<Event> &queue)
+{
+    //NOTE: the list is taken in pushing reverse order, the queue sorts the events by their timestamp anyway
+    Node* node = head.exchange(NULL, std::memory_order_acquire);
+    Node* next;
+
+    while (node) {
+        next = node->next;
+        queue.push(std::move(node->event));
+        delete node;
+        node = next;
+    }
+}
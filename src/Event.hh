@@ -26,23 +26,67 @@
 
 #include <string>
 #include <chrono>
+#include <memory>
+#include <atomic>
+#include <queue>
 #include "Jzon.h"
 
+/*! Filter event, an action with its params. The event node is shared by the copies of the event,
+    so queueing and moving events never copies it.
+*/
 class Event {
     
 public:
-    Event(Jzon::Object rootNode, std::chrono::system_clock::time_point timestamp, int delay = 0 /*ms*/);
+    Event(const Jzon::Object &rootNode, std::chrono::system_clock::time_point timestamp, int delay = 0 /*ms*/);
     ~Event();    
-    bool canBeExecuted(std::chrono::system_clock::time_point currentTime);
+    bool canBeExecuted(std::chrono::system_clock::time_point currentTime) const;
     std::string getAction();
     Jzon::Node* getParams();
     bool operator<(const Event& e) const;
 
 private:
-    Jzon::Object* inputRootNode;
+    std::shared_ptr<Jzon::Object> inputRootNode;
     std::chrono::system_clock::time_point timestamp;
     std::chrono::milliseconds delay;
 
 };
 
+/*! Multiple producers single consumer inbox of events. Producers push without locking, linking the 
+    event to the head of a list with a compare and swap, and the consumer takes the whole list at once. 
+    Control threads pushing events do not contend with the filter processing its frames this way.
+*/
+class EventInbox {
+
+public:
+    EventInbox();
+    ~EventInbox();
+
+    /**
+    * Pushes an event, it can be called from any thread
+    * @param e event, moved into the inbox
+    */
+    void push(Event e);
+
+    /**
+    * Checks if there are pushed events without locking, so the processing threads test it on every frame
+    * @return true if no event has been pushed since the last take
+    */
+    bool empty() const {return head.load(std::memory_order_acquire) == NULL;};
+
+    /**
+    * Moves the pushed events to the consumer queue, it must be called by one thread at a time
+    * @param queue consumer queue, which sorts events by their timestamp
+    */
+    void take(std::priority_queue<Event> &queue);
+
+private:
+    struct Node {
+        Node(Event e) : event(std::move(e)), next(NULL) {};
+        Event event;
+        Node* next;
+    };
+
+    std::atomic<Node*> head;
+};
+
 #endif
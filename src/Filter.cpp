@@ -24,6 +24,7 @@
 
 #include "Filter.hh"
 #include "Utils.hh"
+#include "FrameTracer.hh"
 
 #include <thread>
 #include <algorithm>
@@ -31,13 +32,25 @@
 
 BaseFilter::BaseFilter(unsigned readersNum, unsigned writersNum, FilterRole fRole_, bool periodic): 
     Runnable(periodic), maxReaders(readersNum), maxWriters(writersNum),  frameTime(std::chrono::microseconds(0)), 
-    syncMargin(std::chrono::microseconds(DEFAULT_SYNC_MARGIN)), fRole(fRole_), syncTs(std::chrono::microseconds(0)), sync(false)
+    syncMargin(std::chrono::microseconds(DEFAULT_SYNC_MARGIN)), queuedEvents(false), fRole(fRole_), syncTs(std::chrono::microseconds(0)), sync(false),
+    edgeTriggered(false), blocked(false), throughput(false), eosDone(false), readFrames(0), writtenFrames(0),
+    burstFrames(1), burstTime(std::chrono::microseconds(0)), burstedFrames(0), bursted(false)
 {
+    readers.reserve(maxReaders);
+    writers.reserve(maxWriters);
+    originFrames.reserve(maxReaders);
+    destinationFrames.reserve(maxWriters);
+    updatedReaders.reserve(maxReaders);
+    syncedReaders.reserve(maxReaders);
+    passedReaders.reserve(maxReaders);
+    readerTimes.reserve(maxReaders);
+    groupStates.reserve(maxReaders);
+    syncGroups.reserve(maxReaders);
 }
 
 BaseFilter::~BaseFilter()
 {
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
     for (auto it : readers) {
         if (it.second && it.first >= 0){
             it.second->disconnect(getId());
@@ -50,7 +63,7 @@ BaseFilter::~BaseFilter()
 
 bool BaseFilter::isWConnected (int wId) 
 {
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
 
     if (writers.count(wId) > 0 && writers[wId]->isConnected()){
         return true;
@@ -61,7 +74,7 @@ bool BaseFilter::isWConnected (int wId)
 
 ConnectionData BaseFilter::getWConnectionData (int wId) 
 {   
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
 
     if (writers.count(wId) > 0 && writers[wId]->isConnected()){
         return writers[wId]->getCData();
@@ -82,6 +95,39 @@ std::chrono::microseconds BaseFilter::getAvgReaderDelay (int rId)
     return r->getAvgDelay();
 }
 
+std::chrono::microseconds BaseFilter::getReaderDelayPercentile (int rId, double p)
+{
+    std::shared_ptr<Reader> r = getReader(rId);
+
+    if (!r) {
+        return std::chrono::microseconds(-1);
+    }
+
+    return r->getDelayPercentile(p);
+}
+
+std::chrono::microseconds BaseFilter::getReaderRunDelayPercentile (int rId, double p)
+{
+    std::shared_ptr<Reader> r = getReader(rId);
+
+    if (!r) {
+        return std::chrono::microseconds(-1);
+    }
+
+    return r->getRunDelayPercentile(p);
+}
+
+void BaseFilter::clearReadersRunDelays()
+{
+    std::lock_guard<ProfiledMutex> guard(mtx);
+
+    for (auto it : readers) {
+        if (it.second) {
+            it.second->clearRunDelays();
+        }
+    }
+}
+
 size_t BaseFilter::getLostBlocs (int rId)
 {
     std::shared_ptr<Reader> r = getReader(rId);
@@ -93,9 +139,45 @@ size_t BaseFilter::getLostBlocs (int rId)
     return r->getLostBlocs();
 }
 
+const StreamInfo* BaseFilter::getWriterStreamInfo(int wId)
+{
+    std::lock_guard<ProfiledMutex> guard(mtx);
+
+    if (writers.count(wId) == 0 || !writers[wId]->isConnected() || !writers[wId]->getQueue()) {
+        return NULL;
+    }
+
+    return writers[wId]->getQueue()->getStreamInfo();
+}
+
+bool BaseFilter::getReaderQueueState (int rId, Jzon::Object &node)
+{
+    std::shared_ptr<Reader> r = getReader(rId);
+
+    if (!r) {
+        return false;
+    }
+
+    return r->getQueueState(node);
+}
+
+std::chrono::microseconds BaseFilter::getMaxReaderResidency ()
+{
+    std::lock_guard<ProfiledMutex> guard(mtx);
+    std::chrono::microseconds residency(0);
+
+    for (auto it : readers) {
+        if (it.second && it.second->getQueue()) {
+            residency = std::max(residency, it.second->getQueue()->getAvgResidency());
+        }
+    }
+
+    return residency;
+}
+
 bool BaseFilter::isRConnected (int rId) 
 {
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
 
     if (readers.count(rId) > 0 && readers[rId]->isConnected()){
         return true;
@@ -111,7 +193,7 @@ void BaseFilter::setFrameTime(std::chrono::microseconds fTime)
 
 std::shared_ptr<Reader> BaseFilter::getReader(int id)
 {
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
     if (readers.count(id) <= 0) {
         return NULL;
     }
@@ -119,12 +201,26 @@ std::shared_ptr<Reader> BaseFilter::getReader(int id)
     return readers[id];
 }
 
+std::shared_ptr<Writer> BaseFilter::getWriter(int id)
+{
+    std::lock_guard<ProfiledMutex> guard(mtx);
+    if (writers.count(id) <= 0) {
+        return NULL;
+    }
+
+    return writers[id];
+}
+
 std::shared_ptr<Reader> BaseFilter::setReader(int readerID, FrameQueue* queue)
 {
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
     if (readers.size() >= getMaxReaders() || readers.count(readerID) > 0 ) {
         return NULL;
     }
+    
+    if (!acceptsReaderQueue(queue)) {
+        return NULL;
+    }
 
     std::shared_ptr<Reader> r (new Reader());
     
@@ -139,7 +235,7 @@ std::shared_ptr<Reader> BaseFilter::setReader(int readerID, FrameQueue* queue)
 
 unsigned BaseFilter::generateReaderID()
 {
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
     if (maxReaders == 1) {
         return DEFAULT_ID;
     }
@@ -155,7 +251,7 @@ unsigned BaseFilter::generateReaderID()
 
 unsigned BaseFilter::generateWriterID()
 {
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
     if (maxWriters == 1) {
         return DEFAULT_ID;
     }
@@ -169,25 +265,35 @@ unsigned BaseFilter::generateWriterID()
     return id;
 }
 
-bool BaseFilter::demandDestinationFrames(std::map<int, Frame*> &dFrames)
+bool BaseFilter::demandDestinationFrames(FrameMap &dFrames)
 {
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
     
     if (maxWriters == 0) {
         return true;
     }
     
     bool newFrame = false;
-    for (std::map<int, std::shared_ptr<Writer>>::iterator it = writers.begin() ; it != writers.end(); ) {
+    for (auto it = writers.begin() ; it != writers.end(); ) {
         if (!it->second->isConnected()){
             it->second->disconnect();
-            int wId = it->first;
+            //NOTE: erasing the writer moves the following ones to its slot
+            size_t idx = it - writers.begin();
+            deleteWriter(it->first);
+            it = writers.begin() + idx;
+            continue;
+        }
+        
+        if (suspendedWriters.size() > 0 && suspendedWriters.count(it->first) > 0){
             ++it;
-            deleteWriter(wId);
             continue;
         }
 
-        Frame *f = it->second->getFrame(true);
+        //NOTE: in throughput mode a full queue blocks the writer instead of being flushed
+        Frame *f = it->second->getFrame(!throughput || fRole != REGULAR);
+        if (!f) {
+            return false;
+        }
         f->setConsumed(false);
         dFrames[it->first] = f;
         newFrame = true;
@@ -197,58 +303,75 @@ bool BaseFilter::demandDestinationFrames(std::map<int, Frame*> &dFrames)
     return newFrame;
 }
 
-std::vector<int> BaseFilter::addFrames(std::map<int, Frame*> &dFrames)
+void BaseFilter::addFrames(FrameMap &dFrames, std::vector<int> &enabledJobs)
 {
-    std::lock_guard<std::mutex> guard(mtx);    
-    std::vector<int> enabledJobs;
+    std::lock_guard<ProfiledMutex> guard(mtx);    
     
-    for (auto it : dFrames){
+    for (auto &it : dFrames){
         if (it.second->getConsumed()) {
-            int wId = it.first;
-            if (writers.count(wId) > 0 && writers[wId]->isConnected()){
-                std::vector<int> addFrameReturn = writers[wId]->addFrame();
-                enabledJobs.insert(enabledJobs.begin(), addFrameReturn.begin(), addFrameReturn.end());
+            auto w = writers.find(it.first);
+            if (w != writers.end() && w->second->isConnected()){
+                if (FrameTracer::getInstance()->isTraced(it.second)) {
+                    FrameTracer::getInstance()->stamp(it.second, getId(), ENQUEUE);
+                }
+                const std::vector<int> &addFrameReturn = w->second->addFrame();
+                enabledJobs.insert(enabledJobs.end(), addFrameReturn.begin(), addFrameReturn.end());
+                writtenFrames.fetch_add(1, std::memory_order_relaxed);
             }
         }
     }
-
-    return enabledJobs;
 }
 
-bool BaseFilter::removeFrames(std::vector<int> framesToRemove)
+void BaseFilter::removeFrames(const std::vector<int> &framesToRemove, std::vector<int> &enabledJobs)
 {
-    bool removed = true;
+    bool wasFull;
+    int wFilterId;
     
     if (maxReaders == 0) {
-        return removed;
+        return;
     }
     
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
     
     for (auto id : framesToRemove){
         if (readers.count(id) > 0){
-            readers[id]->removeFrame(getId());
-        } else {
-            removed = false;
+            wasFull = readers[id]->isConnected() && readers[id]->isFull();
+            wFilterId = readers[id]->removeFrame(getId());
+            readFrames.fetch_add(1, std::memory_order_relaxed);
+            //NOTE: only writers that could be waiting for a free slot are re-armed
+            if (wasFull && wFilterId >= 0){
+                enabledJobs.push_back(wFilterId);
+            }
         }
     }
-
-    return removed;
 }
 
 bool BaseFilter::pendingJobs()
 {
-    for (auto it : readers){
+    if (edgeTriggered && blocked){
+        return false;
+    }
+    
+
+    for (auto &it : readers){
         if (it.second && it.second->getQueueElements() > 0){
             return true;
         }
     }
+    
+    std::lock_guard<std::mutex> guard(fusedMtx);
+    for (auto stage : fused){
+        if (stage->pendingJobs()){
+            return true;
+        }
+    }
+    
     return false;
 }
 
 bool BaseFilter::shareReader(BaseFilter *shared, int sharedRId, int orgRId)
 {
-    std::lock_guard<std::mutex> guard(mtx);  
+    std::lock_guard<ProfiledMutex> guard(mtx);  
     
     if (getId() == shared->getId()){
         utils::errorMsg("Shared filter and base filter are the same!!");
@@ -270,7 +393,8 @@ bool BaseFilter::shareReader(BaseFilter *shared, int sharedRId, int orgRId)
         return false;
     }
     
-    if (!shared->specificReaderConfig(sharedRId, readers[orgRId]->getQueue())){
+    if (!shared->acceptsReaderQueue(readers[orgRId]->getQueue()) ||
+        !shared->specificReaderConfig(sharedRId, readers[orgRId]->getQueue())){
         return false;
     }
     
@@ -309,13 +433,15 @@ bool BaseFilter::deleteWriter(int writerID)
     if (writers.count(writerID)){
         writers.erase(writerID);
         seqNums.erase(writerID);
+        suspendedWriters.erase(writerID);
         return specificWriterDelete(writerID);
     }
         
     return false;
 }
 
-bool BaseFilter::connect(BaseFilter *R, int writerID, int readerID)
+bool BaseFilter::connect(BaseFilter *R, int writerID, int readerID, unsigned maxFrames, size_t maxBytes, DropPolicy dropPolicy,
+                         std::chrono::microseconds maxLatency, float dropTarget)
 {
     std::shared_ptr<Reader> r;
     FrameQueue *queue = NULL;
@@ -325,7 +451,7 @@ bool BaseFilter::connect(BaseFilter *R, int writerID, int readerID)
     processEvent();
     R->processEvent();
 
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
     
     if (R->getReader(readerID) && R->getReader(readerID)->isConnected()){
         utils::errorMsg("Reader " + std::to_string(readerID) + " null or already connected");
@@ -342,12 +468,23 @@ bool BaseFilter::connect(BaseFilter *R, int writerID, int readerID)
     reader.rFilterId = R->getId();
     reader.readerId = readerID;
     cData.readers.push_back(reader);
+    cData.maxFrames = maxFrames;
+    cData.maxBytes = maxBytes;
+    cData.dropPolicy = dropPolicy;
+    cData.maxLatency = maxLatency;
+    cData.dropTarget = dropTarget;
     
-    queue = allocQueue(cData);
+    queue = allocNodeLocalQueue(cData);
     if (!queue){
         deleteWriter(writerID);
         return false;
     }
+    
+    if (!acceptsWriterQueue(queue)){
+        delete queue;
+        deleteWriter(writerID);
+        return false;
+    }
 
     if (!(r = R->setReader(readerID, queue))) {
         deleteWriter(writerID);
@@ -360,33 +497,66 @@ bool BaseFilter::connect(BaseFilter *R, int writerID, int readerID)
     return writers[writerID]->connect(r);
 }
 
-bool BaseFilter::connectOneToOne(BaseFilter *R)
+FrameQueue *BaseFilter::allocNodeLocalQueue(struct ConnectionData cData)
+{
+    FrameQueue *queue = NULL;
+    std::vector<unsigned> cpus;
+    std::vector<unsigned> prevCpus;
+    
+    if (getAffinity() >= 0){
+        cpus = utils::getNumaNodeCpus(getAffinity());
+    }
+    
+    //NOTE: frames are touched at setup, so the pages are placed by the kernel in the
+    //node of the calling thread
+    if (!cpus.empty()){
+        prevCpus = utils::getCurrentThreadAffinity();
+        if (!utils::setCurrentThreadAffinity(cpus)){
+            utils::warningMsg("Could not allocate the queue in NUMA node " + std::to_string(getAffinity()));
+            prevCpus.clear();
+        }
+    }
+    
+    queue = allocQueue(cData);
+    
+    if (!prevCpus.empty()){
+        utils::setCurrentThreadAffinity(prevCpus);
+    }
+    
+    return queue;
+}
+
+bool BaseFilter::connectOneToOne(BaseFilter *R, unsigned maxFrames, size_t maxBytes, DropPolicy dropPolicy,
+                         std::chrono::microseconds maxLatency, float dropTarget)
 {
     int writerID = generateWriterID();
     int readerID = R->generateReaderID();
-    return connect(R, writerID, readerID);
+    return connect(R, writerID, readerID, maxFrames, maxBytes, dropPolicy, maxLatency, dropTarget);
 }
 
-bool BaseFilter::connectManyToOne(BaseFilter *R, int writerID)
+bool BaseFilter::connectManyToOne(BaseFilter *R, int writerID, unsigned maxFrames, size_t maxBytes, DropPolicy dropPolicy,
+                         std::chrono::microseconds maxLatency, float dropTarget)
 {
     int readerID = R->generateReaderID();
-    return connect(R, writerID, readerID);
+    return connect(R, writerID, readerID, maxFrames, maxBytes, dropPolicy, maxLatency, dropTarget);
 }
 
-bool BaseFilter::connectManyToMany(BaseFilter *R, int readerID, int writerID)
+bool BaseFilter::connectManyToMany(BaseFilter *R, int readerID, int writerID, unsigned maxFrames, size_t maxBytes, DropPolicy dropPolicy,
+                         std::chrono::microseconds maxLatency, float dropTarget)
 {
-    return connect(R, writerID, readerID);
+    return connect(R, writerID, readerID, maxFrames, maxBytes, dropPolicy, maxLatency, dropTarget);
 }
 
-bool BaseFilter::connectOneToMany(BaseFilter *R, int readerID)
+bool BaseFilter::connectOneToMany(BaseFilter *R, int readerID, unsigned maxFrames, size_t maxBytes, DropPolicy dropPolicy,
+                         std::chrono::microseconds maxLatency, float dropTarget)
 {
     int writerID = generateWriterID();
-    return connect(R, writerID, readerID);
+    return connect(R, writerID, readerID, maxFrames, maxBytes, dropPolicy, maxLatency, dropTarget);
 }
 
 bool BaseFilter::disconnectWriter(int writerId)
 {    
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
     
     if (writers.count(writerId) <= 0) {
         utils::warningMsg("Required writer does not exist");
@@ -402,7 +572,7 @@ bool BaseFilter::disconnectWriter(int writerId)
 
 bool BaseFilter::disconnectReader(int readerId)
 {   
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
     
     if (readers.count(readerId) <= 0) {
         utils::warningMsg("Required reader does not exist");
@@ -421,26 +591,33 @@ void BaseFilter::processEvent()
     std::string action;
     Jzon::Node* params;
 
-    std::lock_guard<std::mutex> guard(mtx);
+    //NOTE: checked without locking, as most calls find no event to execute
+    if (eventInbox.empty() && !queuedEvents.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    std::lock_guard<ProfiledMutex> guard(mtx);
+
+    eventInbox.take(eventQueue);
 
     while(newEvent()) {
 
         Event e = eventQueue.top();
+        eventQueue.pop();
         action = e.getAction();
         params = e.getParams();
 
         if (action.empty() || eventMap.count(action) <= 0) {
             utils::errorMsg("Wrong action name while processing event in filter");
-            eventQueue.pop();
             continue;
         }
 
         if (!eventMap[action](params)) {
             utils::errorMsg("Error executing filter event");
         }
-        
-        eventQueue.pop();
     }
+
+    queuedEvents.store(!eventQueue.empty(), std::memory_order_release);
 }
 
 bool BaseFilter::newEvent()
@@ -449,38 +626,100 @@ bool BaseFilter::newEvent()
         return false;
     }
 
-    Event tmp = eventQueue.top();
-    if (!tmp.canBeExecuted(std::chrono::system_clock::now())) {
-        return false;
-    }
-
-    return true;
+    return eventQueue.top().canBeExecuted(Clock::now());
 }
 
 void BaseFilter::pushEvent(Event e)
 {
-    std::lock_guard<std::mutex> guard(mtx);
-    eventQueue.push(e);
+    eventInbox.push(std::move(e));
 }
 
 void BaseFilter::getState(Jzon::Object &filterNode)
 {
-    std::lock_guard<std::mutex> guard(mtx);
+    std::lock_guard<ProfiledMutex> guard(mtx);
     filterNode.Add("type", utils::getFilterTypeAsString(fType));
     filterNode.Add("role", utils::getRoleAsString(fRole));
+    filterNode.Add("priority", utils::getPriorityAsString(getPriority()));
+    filterNode.Add("dedicated", isDedicated());
+    filterNode.Add("throughput", throughput);
+    filterNode.Add("endOfStream", isEndOfStream());
+    
+    if (burstFrames > 1){
+        Jzon::Object burst;
+        burst.Add("frames", (int) burstFrames);
+        burst.Add("time", (int) burstTime.count());
+        burst.Add("burstedFrames", (double) burstedFrames);
+        filterNode.Add("burst", burst);
+    }
+    filterNode.Add("memoryBytes", (double) getMemoryBytes());
+    filterNode.Add("internalBytes", (double) getInternalBytes());
+    
+    std::vector<BaseFilter*> fusedStages = getFused();
+    if (!fusedStages.empty()){
+        Jzon::Array fusedList;
+        for (auto stage : fusedStages){
+            fusedList.Add(stage->getId());
+        }
+        filterNode.Add("fusedFilters", fusedList);
+    }
+    
+    //NOTE: the head of a fused chain also accounts the time of its stages
+    const ProcessProfile &prof = getProfile();
+    Jzon::Object profile;
+    Jzon::Object wall;
+    Jzon::Object cpu;
+    profile.Add("calls", (int) prof.getCalls());
+    profile.Add("frames", (int) prof.getFrames());
+    profile.Add("waits", (int) prof.getStalls());
+    profile.Add("readFrames", (double) readFrames);
+    profile.Add("writtenFrames", (double) writtenFrames);
+    wall.Add("total", (double) prof.getWallTime());
+    wall.Add("p50", (int) prof.getWallPercentile(50));
+    wall.Add("p95", (int) prof.getWallPercentile(95));
+    wall.Add("p99", (int) prof.getWallPercentile(99));
+    cpu.Add("total", (double) prof.getCpuTime());
+    cpu.Add("p50", (int) prof.getCpuPercentile(50));
+    cpu.Add("p95", (int) prof.getCpuPercentile(95));
+    cpu.Add("p99", (int) prof.getCpuPercentile(99));
+    profile.Add("wallTime", wall);
+    profile.Add("cpuTime", cpu);
+    if (prof.getCountedCalls() > 0) {
+        Jzon::Object counters;
+        double cycles = prof.getCounter(PERF_CYCLES);
+        counters.Add("calls", (double) prof.getCountedCalls());
+        counters.Add("cycles", cycles);
+        counters.Add("instructions", (double) prof.getCounter(PERF_INSTRUCTIONS));
+        counters.Add("ipc", cycles > 0 ? prof.getCounter(PERF_INSTRUCTIONS)/cycles : 0);
+        counters.Add("cacheMisses", (double) prof.getCounter(PERF_CACHE_MISSES));
+        counters.Add("branchMisses", (double) prof.getCounter(PERF_BRANCH_MISSES));
+        profile.Add("counters", counters);
+    }
+    filterNode.Add("profile", profile);
     doGetState(filterNode);
 }
 
-std::vector<int> BaseFilter::processFrame(int& ret)
+void BaseFilter::getMetrics(uint64_t (&values)[FILTER_METRICS]) const
 {
-    std::vector<int> enabledJobs;
+    const ProcessProfile &prof = getProfile();
+
+    values[0] = prof.getCalls();
+    values[1] = prof.getFrames();
+    values[2] = prof.getStalls();
+    values[3] = prof.getWallTime();
+    values[4] = prof.getCpuTime();
+    values[5] = readFrames.load(std::memory_order_relaxed);
+    values[6] = writtenFrames.load(std::memory_order_relaxed);
+}
 
+void BaseFilter::processFrame(int& ret, std::vector<int> &enabledJobs)
+{
     switch(fRole) {
         case REGULAR:
-            enabledJobs = regularProcessFrame(ret);
+            regularProcessFrame(ret, enabledJobs);
+            burstProcessFrame(ret, enabledJobs);
             break;
         case SERVER:
-            enabledJobs = serverProcessFrame(ret);
+            serverProcessFrame(ret, enabledJobs);
             break;
         default:
             ret = WAIT;
@@ -490,59 +729,271 @@ std::vector<int> BaseFilter::processFrame(int& ret)
     if (isPeriodic()){
         enabledJobs.push_back(getId());
     }
+    
+    fusedProcessFrame(enabledJobs);
+}
 
+std::vector<int> BaseFilter::processFrame(int& ret)
+{
+    std::vector<int> enabledJobs;
+    
+    processFrame(ret, enabledJobs);
+    
     return enabledJobs;
 }
 
+void BaseFilter::burstProcessFrame(int& ret, std::vector<int> &enabledJobs)
+{
+    std::chrono::steady_clock::time_point start;
+    unsigned frames = burstFrames;
+    
+    bursted = false;
+    
+    if (frames <= 1 || frameTime.count() > 0 || blocked){
+        return;
+    }
+    
+    if (burstTime.count() > 0){
+        start = std::chrono::steady_clock::now();
+    }
+    
+    //NOTE: it stops as soon as the filter would wait, either for input, for output or for a delay it asked for
+    for (unsigned i = 1; i < frames && !blocked && ret <= 0 && !eosDone; i++){
+        if (burstTime.count() > 0 && std::chrono::steady_clock::now() - start >= burstTime){
+            break;
+        }
+        
+        regularProcessFrame(ret, enabledJobs);
+        
+        if (!blocked){
+            burstedFrames++;
+        }
+    }
+    
+    //NOTE: the burst ends blocked once the input is drained, the activation is not accounted as a wait
+    bursted = blocked;
+}
+
+void BaseFilter::setBurst(unsigned frames, std::chrono::microseconds budget)
+{
+    burstFrames = frames > 0 ? frames : 1;
+    burstTime = budget.count() > 0 ? budget : std::chrono::microseconds(0);
+}
 
-std::vector<int> BaseFilter::regularProcessFrame(int& ret)
+void BaseFilter::fusedProcessFrame(std::vector<int> &enabledJobs)
 {
-    std::vector<int> enabledJobs;
-    std::map<int, Frame*> oFrames;
-    std::map<int, Frame*> dFrames;
-    std::vector<int> newFrames;
+    size_t stage;
+    int stageRet;
+    
+    std::lock_guard<std::mutex> guard(fusedMtx);
+    
+    if (fused.empty()){
+        return;
+    }
+    
+    stageJobs.clear();
+    stageJobs.swap(enabledJobs);
+    
+    for (size_t i = 0; i <= fused.size(); i++){
+        if (i > 0){
+            stageJobs.clear();
+            fused[i - 1]->profiledProcessFrame(stageRet, stageJobs);
+        }
+        
+        //NOTE: following stages are processed right away, previous ones are 
+        //enabled through the head of the chain (e.g. a full queue got a free slot)
+        for (auto id : stageJobs){
+            //NOTE: chains are short, a linear search finds the stage of the job
+            for (stage = 0; stage < fused.size() && fused[stage]->getId() != id; stage++);
+            
+            if (stage == fused.size()){
+                enabledJobs.push_back(id);
+            } else if (stage + 1 <= i){
+                enabledJobs.push_back(getId());
+            }
+        }
+    }
+}
+
+bool BaseFilter::fuse(std::vector<BaseFilter*> chain)
+{
+    BaseFilter *prev = this;
+    ConnectionData cData;
+    
+    for (auto stage : chain){
+        if (!prev->isFusable() || !stage->isFusable() || stage->getPriority() != getPriority()){
+            utils::errorMsg("Filter " + std::to_string(stage->getId()) + " cannot be fused");
+            return false;
+        }
+        
+        if (prev->writers.size() != 1){
+            utils::errorMsg("Filter " + std::to_string(prev->getId()) + " must have a single writer to be fused");
+            return false;
+        }
+        
+        cData = prev->getWConnectionData(prev->writers.begin()->first);
+        if (cData.readers.size() != 1 || cData.readers.front().rFilterId != stage->getId()){
+            utils::errorMsg("Filter " + std::to_string(stage->getId()) + " is not the only reader of the previous one");
+            return false;
+        }
+        
+        prev = stage;
+    }
+    
+    std::lock_guard<std::mutex> guard(fusedMtx);
+    fused = chain;
+    
+    return true;
+}
+
+std::vector<BaseFilter*> BaseFilter::getFused()
+{
+    std::lock_guard<std::mutex> guard(fusedMtx);
+    return fused;
+}
+
+bool BaseFilter::isFusable()
+{
+    return fRole == REGULAR && !isPeriodic() && !isDedicated() && 
+        dynamic_cast<OneToOneFilter*>(this) != NULL;
+}
+
+
+void BaseFilter::regularProcessFrame(int& ret, std::vector<int> &enabledJobs)
+{
+    bool originReady;
+    
+    originFrames.clear();
+    destinationFrames.clear();
+    updatedReaders.clear();
     
     processEvent();
     
-    if (!demandOriginFrames(oFrames, newFrames) || !demandDestinationFrames(dFrames)){
-        ret = WAIT;
-        removeFrames(newFrames);
-        return enabledJobs;
+    if (throughput && inputEnded()){
+        endOfStreamProcessFrame(ret, enabledJobs);
+        return;
+    }
+    
+    //NOTE: the input started a new stream, so does the output
+    if (eosDone){
+        setEndOfStream(false, enabledJobs);
+        eosDone = false;
+    }
+    
+    originReady = demandOriginFrames(originFrames, updatedReaders);
+    if (!originReady && updatedReaders.empty() && !originFrames.empty()){
+        originReady = hasPendingOutput();
+    }
+    
+    if (!originReady || !demandDestinationFrames(destinationFrames)){
+        blocked = true;
+        ret = edgeTriggered ? 0 : WAIT;
+        removeFrames(updatedReaders, enabledJobs);
+        return;
     }
 
-    runDoProcessFrame(oFrames, dFrames, newFrames, ret);
+    blocked = false;
+    traceOriginFrames(originFrames, updatedReaders);
+    runDoProcessFrame(originFrames, destinationFrames, updatedReaders, ret);
     
     //TODO: manage ret value
-    enabledJobs = addFrames(dFrames);
+    addFrames(destinationFrames, enabledJobs);
+    removeFrames(updatedReaders, enabledJobs);
+}
+
+void BaseFilter::endOfStreamProcessFrame(int& ret, std::vector<int> &enabledJobs)
+{
+    destinationFrames.clear();
     
-    removeFrames(newFrames);
+    if (eosDone || !demandDestinationFrames(destinationFrames)){
+        blocked = true;
+        ret = edgeTriggered ? 0 : WAIT;
+        return;
+    }
+    
+    blocked = false;
+    
+    //NOTE: the filter is scheduled again right away until it is drained
+    if (runDrainFrame(destinationFrames)){
+        ret = 0;
+        addFrames(destinationFrames, enabledJobs);
+        enabledJobs.push_back(getId());
+        return;
+    }
+    
+    setEndOfStream(true, enabledJobs);
+    eosDone = true;
+    ret = WAIT;
+    
+    utils::infoMsg("Filter " + std::to_string(getId()) + " reached the end of the stream");
+}
 
-    return enabledJobs;
+void BaseFilter::setEndOfStream(bool eos, std::vector<int> &enabledJobs)
+{
+    std::lock_guard<ProfiledMutex> guard(mtx);
+    std::vector<int> readersJobs;
+    
+    for (auto &it : writers){
+        readersJobs = it.second->setEndOfStream(eos);
+        enabledJobs.insert(enabledJobs.end(), readersJobs.begin(), readersJobs.end());
+    }
 }
 
-std::vector<int> BaseFilter::serverProcessFrame(int& ret)
+bool BaseFilter::inputEnded()
 {
-    std::vector<int> enabledJobs;
-    std::map<int, Frame*> oFrames;
-    std::map<int, Frame*> dFrames;
-    std::vector<int> newFrames;
+    if (maxReaders == 0 || readers.empty()){
+        return false;
+    }
+    
+    for (auto &it : readers){
+        if (it.second && !it.second->isEndOfStream()){
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void BaseFilter::serverProcessFrame(int& ret, std::vector<int> &enabledJobs)
+{
+    originFrames.clear();
+    destinationFrames.clear();
+    updatedReaders.clear();
     
     processEvent();
     
-    demandOriginFrames(oFrames, newFrames);
-    demandDestinationFrames(dFrames);
+    demandOriginFrames(originFrames, updatedReaders);
+    demandDestinationFrames(destinationFrames);
 
-    runDoProcessFrame(oFrames, dFrames, newFrames, ret);
+    traceOriginFrames(originFrames, updatedReaders);
+    runDoProcessFrame(originFrames, destinationFrames, updatedReaders, ret);
 
-    enabledJobs = addFrames(dFrames);
-    removeFrames(newFrames);
+    addFrames(destinationFrames, enabledJobs);
+    removeFrames(updatedReaders, enabledJobs);
     
     //ret = 0;
-    
-    return enabledJobs;
 }
 
-bool BaseFilter::demandOriginFrames(std::map<int, Frame*> &oFrames, std::vector<int> &newFrames)
+void BaseFilter::traceOriginFrames(FrameMap &oFrames, std::vector<int> &newFrames)
+{
+    FrameTracer *tracer = FrameTracer::getInstance();
+    FrameQueue *queue;
+
+    if (tracer->getSampling() == 0) {
+        return;
+    }
+
+    for (auto id : newFrames) {
+        if (oFrames.count(id) == 0 || !tracer->isTraced(oFrames[id]) || readers.count(id) == 0) {
+            continue;
+        }
+
+        queue = readers[id]->getQueue();
+        tracer->stamp(oFrames[id], getId(), DEQUEUE, queue ? queue->getCData().wFilterId : -1);
+    }
+}
+
+bool BaseFilter::demandOriginFrames(FrameMap &oFrames, std::vector<int> &newFrames)
 {
     if (maxReaders == 0) {
         return true;
@@ -552,7 +1003,7 @@ bool BaseFilter::demandOriginFrames(std::map<int, Frame*> &oFrames, std::vector<
         return false;
     }
     
-    std::vector<int> readersVec = framesSync();
+    const std::vector<int> &readersVec = framesSync();
     
     if (readersVec.empty()){
         return false;
@@ -565,51 +1016,126 @@ bool BaseFilter::demandOriginFrames(std::map<int, Frame*> &oFrames, std::vector<
     }
 }
 
-std::vector<int> BaseFilter::framesSync()
+const std::vector<int> &BaseFilter::framesSync()
 {      
-    std::vector<int> allReaders;
-    std::vector<int> framesToPass;
+    std::vector<int> &allReaders = syncedReaders;
+    std::vector<int> &framesToPass = passedReaders;
+    SlotMap<int>::iterator groupIt;
+    SyncGroup *group;
     
-    std::chrono::microseconds wallClock = std::chrono::microseconds(0);
-    std::chrono::microseconds currentFTime;
+    allReaders.clear();
+    framesToPass.clear();
+    readerTimes.clear();
+    groupStates.clear();
     
-    for(std::map<int, std::shared_ptr<Reader>>::iterator r = readers.begin() ; r != readers.end(); ){
-        if (!r->second){
-            ++r;
+    for (auto &r : readers) {
+        if (!r.second){
             continue;
         }
-        allReaders.push_back(r->first);
-        if (sync && wallClock < r->second->getCurrentTime()){
-            wallClock = r->second->getCurrentTime();
+        
+        allReaders.push_back(r.first);
+        
+        if (!sync){
+            continue;
+        }
+        
+        //NOTE: each reader front is peeked once, the time is kept for the whole decision
+        groupIt = syncGroups.find(r.first);
+        readerTimes.push_back({r.first, groupIt == syncGroups.end() ? 0 : groupIt->second, 
+                               r.second->getCurrentTime(), r.second->isFull()});
+        
+        group = &getGroupState(readerTimes.back().group);
+        
+        if (readerTimes.back().time == NO_DTS){
+            group->emptyQueue = true;
+        } else if (group->wallClock < readerTimes.back().time){
+            group->wallClock = readerTimes.back().time;
         }
-        ++r;
     }
     
     if (!sync){
         return allReaders;
     }
     
-    bool emptyQueue = false;
-    for (std::map<int, std::shared_ptr<Reader>>::iterator r = readers.begin() ; r != readers.end(); ) {
-        currentFTime = r->second->getCurrentTime();
-        if (currentFTime == NO_DTS){
-            ++r;
-            emptyQueue = true;
-            continue;
-        } 
+    for (auto &r : readerTimes) {
+        group = &getGroupState(r.group);
         
-        if (r->second->isFull() || wallClock - syncMargin > currentFTime){
-            framesToPass.push_back(r->first);
+        if (r.time != NO_DTS && (r.full || group->wallClock - syncMargin > r.time)){
+            group->lagging = true;
         }
+    }
+    
+    //NOTE: groups waiting for an empty reader only pass their lagging readers, the rest pass all of them
+    for (auto &r : readerTimes) {
+        group = &getGroupState(r.group);
         
-        ++r;
+        if (!group->emptyQueue && !group->lagging){
+            framesToPass.push_back(r.id);
+        } else if (r.time != NO_DTS && (r.full || group->wallClock - syncMargin > r.time)){
+            framesToPass.push_back(r.id);
+        }
     }
     
-    if (emptyQueue || !framesToPass.empty()){
-        return framesToPass;
+    return framesToPass;
+}
+
+SyncGroup &BaseFilter::getGroupState(int id)
+{
+    //NOTE: filters have a few groups, a linear search beats any lookup structure
+    for (auto &g : groupStates) {
+        if (g.id == id){
+            return g;
+        }
     }
+    
+    groupStates.push_back({id, std::chrono::microseconds(0), false, false});
+    return groupStates.back();
+}
 
-    return allReaders;
+bool BaseFilter::suspendWriter(int writerId, bool suspend)
+{
+    std::lock_guard<ProfiledMutex> guard(mtx);
+    
+    if (writers.count(writerId) == 0 || !writers[writerId]->isConnected()){
+        utils::errorMsg("Writer " + std::to_string(writerId) + " is not connected");
+        return false;
+    }
+    
+    if (suspend){
+        suspendedWriters[writerId] = true;
+    } else {
+        suspendedWriters.erase(writerId);
+    }
+    
+    return true;
+}
+
+bool BaseFilter::isWriterSuspended(int writerId)
+{
+    std::lock_guard<ProfiledMutex> guard(mtx);
+    return suspendedWriters.count(writerId) > 0;
+}
+
+void BaseFilter::setSyncGroup(int readerId, int group)
+{
+    std::lock_guard<ProfiledMutex> guard(mtx);
+    
+    //NOTE: groups are set while configuring the filter, their slots are reserved so they are not reallocated
+    
+    if (group == 0){
+        syncGroups.erase(readerId);
+        return;
+    }
+    
+    syncGroups[readerId] = group;
+}
+
+int BaseFilter::getSyncGroup(int readerId)
+{
+    std::lock_guard<ProfiledMutex> guard(mtx);
+    SlotMap<int>::iterator it = syncGroups.find(readerId);
+    
+    return it == syncGroups.end() ? 0 : it->second;
 }
 
 bool BaseFilter::deleteReader(int readerId)
@@ -623,7 +1149,7 @@ bool BaseFilter::deleteReader(int readerId)
     return false;
 }
 
-bool BaseFilter::demandOriginFramesBestEffort(std::map<int, Frame*> &oFrames, std::vector<int> &newFrames, std::vector<int> readersVec) 
+bool BaseFilter::demandOriginFramesBestEffort(FrameMap &oFrames, std::vector<int> &newFrames, const std::vector<int> &readersVec) 
 {
     bool newFrame;
     Frame* frame;
@@ -652,7 +1178,7 @@ bool BaseFilter::demandOriginFramesBestEffort(std::map<int, Frame*> &oFrames, st
     return !newFrames.empty();
 }
 
-bool BaseFilter::demandOriginFramesFrameTime(std::map<int, Frame*> &oFrames, std::vector<int> &newFrames) 
+bool BaseFilter::demandOriginFramesFrameTime(FrameMap &oFrames, std::vector<int> &newFrames) 
 {
     Frame* frame;
     std::chrono::microseconds outOfScopeTs = std::chrono::microseconds(-1);
@@ -660,11 +1186,12 @@ bool BaseFilter::demandOriginFramesFrameTime(std::map<int, Frame*> &oFrames, std
     bool validFrame = false;
     bool outDated = false;
 
-    for (std::map<int, std::shared_ptr<Reader>>::iterator r = readers.begin() ; r != readers.end(); ) {
+    for (auto r = readers.begin() ; r != readers.end(); ) {
         if (!r->second || !r->second->isConnected()) {
-            int rId = r->first;
-            ++r;
-            deleteReader(rId);
+            //NOTE: erasing the reader moves the following ones to its slot
+            size_t idx = r - readers.begin();
+            deleteReader(r->first);
+            r = readers.begin() + idx;
             continue;
         }
 
@@ -733,9 +1260,9 @@ OneToOneFilter::OneToOneFilter(FilterRole fRole_, bool periodic) :
 {
 }
 
-bool OneToOneFilter::runDoProcessFrame(std::map<int, Frame*> &oFrames, 
-                                       std::map<int, Frame*> &dFrames, 
-                                       std::vector<int> /*newFrames*/, int& /*ret*/)
+bool OneToOneFilter::runDoProcessFrame(FrameMap &oFrames, 
+                                       FrameMap &dFrames, 
+                                       std::vector<int> &/*newFrames*/, int& /*ret*/)
 {
     if (!doProcessFrame(oFrames.begin()->second, dFrames.begin()->second)) {
         return false;
@@ -744,14 +1271,23 @@ bool OneToOneFilter::runDoProcessFrame(std::map<int, Frame*> &oFrames,
     return true;
 }
 
+bool OneToOneFilter::runDrainFrame(FrameMap &dFrames)
+{
+    if (dFrames.empty()) {
+        return false;
+    }
+    
+    return drainFrame(dFrames.begin()->second);
+}
+
 OneToManyFilter::OneToManyFilter(unsigned writersNum, FilterRole fRole_, bool periodic) :
     BaseFilter(1, writersNum, fRole_, periodic)
 {
 }
 
-bool OneToManyFilter::runDoProcessFrame(std::map<int, Frame*> &oFrames, 
-                                        std::map<int, Frame*> &dFrames, 
-                                        std::vector<int> /*newFrames*/, int& /*ret*/)
+bool OneToManyFilter::runDoProcessFrame(FrameMap &oFrames, 
+                                        FrameMap &dFrames, 
+                                        std::vector<int> &/*newFrames*/, int& /*ret*/)
 {
     if (!doProcessFrame(oFrames.begin()->second, dFrames)) {
         return false;
@@ -770,9 +1306,9 @@ HeadFilter::HeadFilter(unsigned writersNum, FilterRole fRole_, bool periodic) :
 {
 }
 
-bool HeadFilter::runDoProcessFrame(std::map<int, Frame*> &oFrames, 
-                                   std::map<int, Frame*> &dFrames, 
-                                   std::vector<int> /*newFrames*/, int& ret)
+bool HeadFilter::runDoProcessFrame(FrameMap &oFrames, 
+                                   FrameMap &dFrames, 
+                                   std::vector<int> &/*newFrames*/, int& ret)
 {
     if (!doProcessFrame(dFrames, ret)) {
         return false;
@@ -780,7 +1316,7 @@ bool HeadFilter::runDoProcessFrame(std::map<int, Frame*> &oFrames,
 
     for (auto it : dFrames) {
         if (it.second->getConsumed()){
-            it.second->setOriginTime(std::chrono::high_resolution_clock::now());
+            it.second->setOriginTime(Frame::getOriginNow());
             it.second->setSequenceNumber(seqNums[it.first]++);
         }
     }
@@ -815,9 +1351,9 @@ TailFilter::TailFilter(unsigned readersNum, FilterRole fRole_, bool periodic) :
     setSync(true);
 }
 
-bool TailFilter::runDoProcessFrame(std::map<int, Frame*> &oFrames, 
-                                   std::map<int, Frame*> &dFrames, 
-                                   std::vector<int> newFrames, int& ret)
+bool TailFilter::runDoProcessFrame(FrameMap &oFrames, 
+                                   FrameMap &dFrames, 
+                                   std::vector<int> &newFrames, int& ret)
 {
     return doProcessFrame(oFrames, newFrames, ret);
 }
@@ -846,16 +1382,36 @@ ManyToOneFilter::ManyToOneFilter(unsigned readersNum, FilterRole fRole_, bool pe
 {
 }
 
-bool ManyToOneFilter::runDoProcessFrame(std::map<int, Frame*> &oFrames, 
-                                        std::map<int, Frame*> &dFrames, 
-                                        std::vector<int> newFrames, int& /*ret*/)
+bool ManyToOneFilter::runDoProcessFrame(FrameMap &oFrames, 
+                                        FrameMap &dFrames, 
+                                        std::vector<int> &newFrames, int& /*ret*/)
 {
     if (!doProcessFrame(oFrames, dFrames.begin()->second, newFrames)) {
         return false;
     }
 
-    dFrames.begin()->second->setOriginTime(std::chrono::high_resolution_clock::now());
+    dFrames.begin()->second->setOriginTime(Frame::getOriginNow());
     dFrames.begin()->second->setSequenceNumber(seqNums[dFrames.begin()->first]++);
     return true;
 }
 
+ManyToManyFilter::ManyToManyFilter(unsigned readersNum, unsigned writersNum, FilterRole fRole_, bool periodic) :
+    BaseFilter(readersNum, writersNum, fRole_, periodic)
+{
+}
+
+bool ManyToManyFilter::runDoProcessFrame(FrameMap &oFrames, 
+                                         FrameMap &dFrames, 
+                                         std::vector<int> &newFrames, int& /*ret*/)
+{
+    if (!doProcessFrame(oFrames, dFrames, newFrames)) {
+        return false;
+    }
+
+    for (auto it : dFrames) {
+        it.second->setOriginTime(Frame::getOriginNow());
+        it.second->setSequenceNumber(seqNums[it.first]++);
+    }
+
+    return true;
+}
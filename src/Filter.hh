@@ -30,17 +30,58 @@
 #include <queue>
 #include <mutex>
 #include <memory>
+#include <atomic>
 
 #include "FrameQueue.hh"
 #include "IOInterface.hh"
 #include "Runnable.hh"
 #include "Event.hh"
 #include "StreamInfo.hh"
+#include "VideoFrame.hh"
+#include "AudioFrame.hh"
+#include "SlotMap.hh"
 
 #define DEFAULT_ID 1                /*!< Default ID for unique filter's readers and/or writers. */
 #define MAX_WRITERS 16              /*!< Default maximum writers for a filter. */
 #define MAX_READERS 16              /*!< Default maximum readers for a filter. */
 #define WAIT 1000                   /*!< Default wait time in usec when there are no origin or destionation frames */
+#define FILTER_METRICS 7            /*!< Values of a filter metrics snapshot, see BaseFilter::getMetrics */
+
+typedef SlotMap<Frame*> FrameMap;   /*!< Origin or destination frames of a process call by reader or writer id */
+
+/*! Tells if the frames of a stream are instances of a frame class. Typed filters check
+    their queues with it at connection time, so their frames are cast statically while processing
+*/
+template <class FrameClass>
+struct FrameType;
+
+template <>
+struct FrameType<VideoFrame> {
+    static bool accepts(const StreamInfo *si) {return si && si->type == VIDEO;};
+    static const char *name() {return "video";};
+};
+
+template <>
+struct FrameType<AudioFrame> {
+    static bool accepts(const StreamInfo *si) {return si && si->type == AUDIO;};
+    static const char *name() {return "audio";};
+};
+
+/*! Reader front time sampled once by the synchronisation of a process call */
+struct SyncedReader {
+    int id;
+    int group;
+    std::chrono::microseconds time;     //!< Time of the reader front frame, NO_DTS if its queue is empty
+    bool full;
+};
+
+/*! State of a synchronisation group along a process call */
+struct SyncGroup {
+    int id;
+    std::chrono::microseconds wallClock;    //!< Latest front time of the group readers
+    bool emptyQueue;
+    bool lagging;                           //!< Some reader is behind the wall clock, only the lagging ones pass
+};
 
 /*! Generic filter class methods. It is an interface to different specific filters
     so it cannot be instantiated
@@ -52,31 +93,58 @@ public:
     /**
     * Creates a one to one connection from an available writer to an available reader
     * @param BaseFilter pointer of the filter to be connected
+    * @param maxFrames depth of the connection queue, 0 keeps the filter default
+    * @param maxBytes bytes budget of the connection queue, 0 means no budget
+    * @param dropPolicy frames dropped by the connection queue when it is full
+    * @param maxLatency the connection reader skips the frames older than it, 0 means no bound
+    * @param dropTarget share of frames the connection queue depth is tuned to drop, 0 keeps a fixed depth
     * @return True if succeeded and false if not
     */
-    bool connectOneToOne(BaseFilter *R);
+    bool connectOneToOne(BaseFilter *R, unsigned maxFrames = 0, size_t maxBytes = 0, DropPolicy dropPolicy = DROP_NEWEST,
+                         std::chrono::microseconds maxLatency = std::chrono::microseconds(0), float dropTarget = 0);
     /**
     * Creates a many to one connection from specific writer to an available reader
     * @param BaseFilter pointer of the filter to be connected
     * @param Integer writer ID
+    * @param maxFrames see connectOneToOne
+    * @param maxBytes see connectOneToOne
+    * @param dropPolicy see connectOneToOne
+    * @param maxLatency see connectOneToOne
+    * @param dropTarget see connectOneToOne
     * @return True if succeeded and false if not
     */
-    bool connectManyToOne(BaseFilter *R, int writerID);
+    bool connectManyToOne(BaseFilter *R, int writerID, unsigned maxFrames = 0, size_t maxBytes = 0, 
+                          DropPolicy dropPolicy = DROP_NEWEST,
+                          std::chrono::microseconds maxLatency = std::chrono::microseconds(0), float dropTarget = 0);
     /**
     * Creates a one to many connection from an available writer to specific reader
     * @param BaseFilter pointer of the filter to be connected
     * @param Integer reader ID
+    * @param maxFrames see connectOneToOne
+    * @param maxBytes see connectOneToOne
+    * @param dropPolicy see connectOneToOne
+    * @param maxLatency see connectOneToOne
+    * @param dropTarget see connectOneToOne
     * @return True if succeeded and false if not
     */
-    bool connectOneToMany(BaseFilter *R, int readerID);
+    bool connectOneToMany(BaseFilter *R, int readerID, unsigned maxFrames = 0, size_t maxBytes = 0, 
+                          DropPolicy dropPolicy = DROP_NEWEST,
+                          std::chrono::microseconds maxLatency = std::chrono::microseconds(0), float dropTarget = 0);
     /**
     * Creates a many to many connection from specific reader to specific writer
     * @param BaseFilter pointer of the filter to be connected
     * @param Integer reader ID
     * @param Integer writer ID
+    * @param maxFrames see connectOneToOne
+    * @param maxBytes see connectOneToOne
+    * @param dropPolicy see connectOneToOne
+    * @param maxLatency see connectOneToOne
+    * @param dropTarget see connectOneToOne
     * @return True if succeeded and false if not
     */
-    bool connectManyToMany(BaseFilter *R, int readerID, int writerID);
+    bool connectManyToMany(BaseFilter *R, int readerID, int writerID, unsigned maxFrames = 0, size_t maxBytes = 0, 
+                          DropPolicy dropPolicy = DROP_NEWEST,
+                          std::chrono::microseconds maxLatency = std::chrono::microseconds(0), float dropTarget = 0);
     /**
     * Disconnects and cleans specified writer
     * @param Integer writer ID
@@ -133,16 +201,135 @@ public:
     */
     virtual void pushEvent(Event e);
     /**
+    * Suspends a writer. Suspended writers are skipped when the destination frames are demanded, so nothing
+    * is processed nor copied for them and their readers get no frames until they are resumed. A filter 
+    * whose writers are all suspended waits as if they were full
+    * @param writerId writer ID
+    * @param suspend true to suspend the writer, false to resume it
+    * @return false if the writer is not connected
+    */
+    bool suspendWriter(int writerId, bool suspend);
+    /**
+    * @param writerId writer ID
+    * @return true if the writer is suspended
+    */
+    bool isWriterSuspended(int writerId);
+    /**
+    * Assigns a reader to a synchronisation group. Synchronised filters only hold the readers of a group 
+    * waiting for the other readers of the same group, so unrelated inputs do not wait for each other
+    * @param readerId reader ID, the reader does not need to be connected yet
+    * @param group group ID, every reader is in group 0 by default
+    */
+    void setSyncGroup(int readerId, int group);
+    /**
+    * @param readerId reader ID
+    * @return synchronisation group of the reader
+    */
+    int getSyncGroup(int readerId);
+    /**
     * Get the state for this filter node
     * @param filter node pointer
     */
     void getState(Jzon::Object &filterNode);
     /**
+    * Gets a snapshot of the filter counters without locking it, so it can be polled often while the
+    * filter runs: calls, frames, waits, wall time, cpu time (both in usec), frames read and frames written
+    * @param values where the counters are copied, in that order
+    */
+    void getMetrics(uint64_t (&values)[FILTER_METRICS]) const;
+    /**
+    * Gets the memory held by the filter: the bytes charged by its output queues (see MemoryBudget)
+    * and the ones it holds internally (codec contexts, segment buffers...)
+    * @return held bytes
+    */
+    size_t getMemoryBytes() {return MemoryBudget::getInstance()->getFilterBytes(getId()) + getInternalBytes();};
+    /**
+    * Reports the bytes held by the filter out of its queues, if it can account them
+    * @return held bytes, 0 by default
+    */
+    virtual size_t getInternalBytes() {return 0;};
+    /**
+    * Gets the description of the stream given by a writer. By default it is only known once the writer is
+    * connected, filters that know their streams beforehand (e.g. receivers) give it before
+    * @param wId writer id
+    * @return the stream info, NULL if it is not known
+    */
+    virtual const StreamInfo* getWriterStreamInfo(int wId);
+    /**
     * Returns true if filter is enabled or false if not
     * @return Bool enabled
     */
     bool isEnabled(){return enabled;};
     /**
+    * Sets the edge-triggered scheduling mode. When enabled, a filter that cannot
+    * process because of missing origin frames is not polled again, it is only 
+    * scheduled when one of its readers gets a new frame or one of its writers frees a slot
+    * @param edge true to enable edge-triggered mode, false to poll every WAIT usec
+    */
+    void setEdgeTriggered(bool edge) {edgeTriggered = edge;};
+    /**
+    * Returns true if the filter is scheduled in edge-triggered mode
+    * @return Bool edgeTriggered
+    */
+    bool isEdgeTriggered() const {return edgeTriggered;};
+    /**
+    * Sets the throughput mode, meant to process file inputs offline as fast as possible. Full
+    * output queues block the filter instead of being flushed, so no frame is dropped, and the
+    * end of the stream is propagated: once every reader reaches it the filter drains its buffered
+    * output (see runDrainFrame) and marks the end of the stream to the filters reading from it
+    * @param throughput_ true for throughput mode, false for live processing
+    */
+    void setThroughput(bool throughput_) {throughput = throughput_;};
+    /**
+    * Returns true if the filter runs in throughput mode
+    * @return Bool throughput
+    */
+    bool isThroughput() const {return throughput;};
+    /**
+    * Sets the burst mode. Each activation of a regular filter then keeps processing while its input is
+    * available, up to a number of frames or a time budget, before yielding the worker, so the locks and 
+    * the scheduling of every activation are shared by several frames. Filters with a frame time keep
+    * processing one frame per activation, since the frame time paces them
+    * @param frames largest number of frames processed per activation, 0 or 1 disables the burst mode
+    * @param budget largest time spent per activation, 0 means no time bound
+    */
+    void setBurst(unsigned frames, std::chrono::microseconds budget = std::chrono::microseconds(0));
+    /**
+    * Returns the largest number of frames processed per activation
+    * @return frames, 1 if the burst mode is disabled
+    */
+    unsigned getBurstFrames() const {return burstFrames;};
+    /**
+    * Returns the time budget of an activation in burst mode
+    * @return budget, 0 if it is not bound
+    */
+    std::chrono::microseconds getBurstTime() const {return burstTime;};
+    /**
+    * Returns true once the filter has drained its output at the end of the stream, throughput mode only
+    * @return Bool end of stream
+    */
+    bool isEndOfStream() const {return eosDone;};
+    /**
+    * Fuses a linear chain of filters after this one. Fused filters are not meant to be 
+    * scheduled by themselves, they are processed inline and in order after this filter, 
+    * so each frame is consumed by the same thread right after being produced
+    * @param chain filters to fuse, each one must be the only reader of the previous one.
+    * An empty chain unfuses the current one
+    * @return True if succeeded and false if any filter of the chain cannot be fused
+    */
+    bool fuse(std::vector<BaseFilter*> chain);
+    /**
+    * Returns the filters fused after this one
+    * @return Vector of fused filters, empty if there is no fused chain
+    */
+    std::vector<BaseFilter*> getFused();
+    /**
+    * Tests if the filter can be part of a fused chain. Only regular OneToOne filters 
+    * that are neither periodic nor dedicated can be fused
+    * @return True if the filter can be fused
+    */
+    bool isFusable();
+    /**
     * Class destructor. Deletes and clears its writers, readers, oframes, dframes and rupdates
     */
     virtual ~BaseFilter();
@@ -151,8 +338,14 @@ public:
     /**
     * Processes frames
     * @param integer this integer contains the delay until the method can be executed again
-    * @return A vector containing the ids of the filters that can be exectued after 
-    * this process (e.g new data has been generated)
+    * @param enabledJobs the ids of the filters that can be exectued after 
+    * this process (e.g new data has been generated) are appended to it
+    */
+    void processFrame(int &ret, std::vector<int> &enabledJobs);
+    /**
+    * Processes frames
+    * @param integer this integer contains the delay until the method can be executed again
+    * @return A vector containing the ids of the filters that can be exectued after this process
     */
     std::vector<int> processFrame(int &ret);
     /**
@@ -184,23 +377,62 @@ public:
      * @return the average delay of the reader 
      */
     std::chrono::microseconds getAvgReaderDelay (int rId);
+    /**
+     * gets a frame delay percentile of the reader over its last stats window
+     * @param readerId of the reader
+     * @param p percentile, between 0 and 100, 100 gives the maximum delay
+     * @return the delay percentile of the reader
+     */
+    std::chrono::microseconds getReaderDelayPercentile (int rId, double p);
+    /**
+     * gets a frame delay percentile of the reader since it was connected or since the last
+     * clearReadersRunDelays call, see Reader::getRunDelayPercentile
+     * @param readerId of the reader
+     * @param p percentile, between 0 and 100, 100 gives the maximum delay
+     * @return the delay percentile of the reader
+     */
+    std::chrono::microseconds getReaderRunDelayPercentile (int rId, double p);
+    /**
+     * discards the delays measured so far by the run percentiles of all the readers
+     */
+    void clearReadersRunDelays();
     /**
      * get losts blocs
      * @param readerId of the reader
      * @return the losts blocs of the reader
      */
     size_t getLostBlocs (int rId);
+    /**
+     * gets the telemetry of the reader queue, see FrameQueue::getState
+     * @param readerId of the reader
+     * @param node Jzon object to fill
+     * @return false if the reader does not exist or it is not connected
+     */
+    bool getReaderQueueState (int rId, Jzon::Object &node);
+    /**
+     * gets the highest average residency of the reader queues, see FrameQueue::getAvgResidency
+     * @return the residency, 0 if there is no connected reader
+     */
+    std::chrono::microseconds getMaxReaderResidency ();
 
 protected:
     BaseFilter(unsigned readersNum = MAX_READERS, unsigned writersNum = MAX_WRITERS, FilterRole fRole_ = REGULAR, bool periodic = false);
 
-    std::vector<int> addFrames(std::map<int, Frame*> &dFrames);
-    bool removeFrames(std::vector<int> framesToRemove);
+    void addFrames(FrameMap &dFrames, std::vector<int> &enabledJobs);
+    void removeFrames(const std::vector<int> &framesToRemove, std::vector<int> &enabledJobs);
     virtual FrameQueue *allocQueue(struct ConnectionData cData) = 0;
+    /**
+     * Allocates the queue from a thread bound to the affinity node of this filter, 
+     * so the frame buffers are placed near the writer.
+     * @param cData connection data of the queue
+     * @return the allocated queue or NULL if failed
+     */
+    FrameQueue *allocNodeLocalQueue(struct ConnectionData cData);
 
     std::chrono::microseconds getFrameTime() {return frameTime;};
 
     std::shared_ptr<Reader> getReader(int id);
+    std::shared_ptr<Writer> getWriter(int id);
     
     //TODO: this should get stream info parameters insted of FrameQueue or get from reader.
     virtual bool specificReaderConfig(int readerID, FrameQueue* queue) = 0;
@@ -208,12 +440,20 @@ protected:
     
     virtual bool specificWriterConfig(int writerID) = 0;
     virtual bool specificWriterDelete(int writerID) = 0;
+    
+    /**
+    * Typed filters override them to check the frames of a queue once, when it is connected
+    * @param queue queue to be read or written by the filter
+    * @return true if the filter can process the frames of the queue
+    */
+    virtual bool acceptsReaderQueue(FrameQueue */*queue*/) {return true;};
+    virtual bool acceptsWriterQueue(FrameQueue */*queue*/) {return true;};
 
-    bool demandOriginFrames(std::map<int, Frame*> &oFrames, std::vector<int> &newFrames);
-    bool demandOriginFramesBestEffort(std::map<int, Frame*> &oFrames, std::vector<int> &newFrames, std::vector<int> readersVec);
-    bool demandOriginFramesFrameTime(std::map<int, Frame*> &oFrames, std::vector<int> &newFrames); 
+    bool demandOriginFrames(FrameMap &oFrames, std::vector<int> &newFrames);
+    bool demandOriginFramesBestEffort(FrameMap &oFrames, std::vector<int> &newFrames, const std::vector<int> &readersVec);
+    bool demandOriginFramesFrameTime(FrameMap &oFrames, std::vector<int> &newFrames); 
 
-    bool demandDestinationFrames(std::map<int, Frame*> &dFrames);
+    bool demandDestinationFrames(FrameMap &dFrames);
 
     bool newEvent();
     void processEvent();
@@ -221,18 +461,46 @@ protected:
 
     std::map<std::string, std::function<bool(Jzon::Node* params)> > eventMap;
 
-    virtual bool runDoProcessFrame(std::map<int, Frame*> &oFrames, 
-                                   std::map<int, Frame*> &dFrames, 
-                                   std::vector<int> newFrames, int& ret) = 0;
+    virtual bool runDoProcessFrame(FrameMap &oFrames, 
+                                   FrameMap &dFrames, 
+                                   std::vector<int> &newFrames, int& ret) = 0;
 
     void setSyncTs(std::chrono::microseconds ts){syncTs = ts;};
     std::chrono::microseconds getSyncTs(){return syncTs;};
     
     void setSync(bool sync_){sync = sync_;};
     
+    bool stalled() {return blocked && !bursted;};
+    
+    /**
+    * Filters with input of their own (e.g. frames retained while an encoder is drained) extend it
+    * @return true if the filter has to be processed again, see Runnable::pendingJobs
+    */
+    bool pendingJobs();
+    
+    /**
+    * Filters producing output out of their processing (e.g. from an encoding thread) override it,
+    * so they are processed when woken up without new input. Then origin frames are not consumed.
+    * @return true if there is output waiting to be written
+    */
+    virtual bool hasPendingOutput() {return false;};
+    
+    /**
+    * Tests the end of the input in throughput mode. Head filters override it to tell the end of their source
+    * @return true if every reader has reached the end of the stream
+    */
+    virtual bool inputEnded();
+    
+    /**
+    * Called once the input has ended to write the output the filter still holds (e.g. delayed encoded frames)
+    * @param dFrames destination frames, the written ones are set as consumed
+    * @return true while there may be output left, false once the filter is drained
+    */
+    virtual bool runDrainFrame(FrameMap &/*dFrames*/) {return false;};
+    
 protected:
-    std::map<int, std::shared_ptr<Reader>> readers;
-    std::map<int, std::shared_ptr<Writer>> writers;
+    SlotMap<std::shared_ptr<Reader>> readers;
+    SlotMap<std::shared_ptr<Writer>> writers;
     std::map<int, size_t> seqNums;
     FilterType fType;
 
@@ -242,9 +510,15 @@ protected:
     const std::chrono::microseconds syncMargin;
 
 private:
-    bool connect(BaseFilter *R, int writerID, int readerID);
-    std::vector<int> regularProcessFrame(int& ret);
-    std::vector<int> serverProcessFrame(int& ret);
+    bool connect(BaseFilter *R, int writerID, int readerID, unsigned maxFrames, size_t maxBytes, DropPolicy dropPolicy,
+                 std::chrono::microseconds maxLatency, float dropTarget);
+    void regularProcessFrame(int& ret, std::vector<int> &enabledJobs);
+    void serverProcessFrame(int& ret, std::vector<int> &enabledJobs);
+    void traceOriginFrames(FrameMap &oFrames, std::vector<int> &newFrames);
+    void endOfStreamProcessFrame(int& ret, std::vector<int> &enabledJobs);
+    void setEndOfStream(bool eos, std::vector<int> &enabledJobs);
+    void fusedProcessFrame(std::vector<int> &enabledJobs);
+    void burstProcessFrame(int& ret, std::vector<int> &enabledJobs);
 
     std::shared_ptr<Reader> setReader(int readerID, FrameQueue* queue);
     bool setWriter(int writerID);
@@ -252,17 +526,47 @@ private:
     bool deleteReader(int readerId);
     bool deleteWriter(int readerId);
     
-    bool pendingJobs();
-    std::vector<int> framesSync();
+    const std::vector<int> &framesSync();
+    SyncGroup &getGroupState(int id);
 
 private:
+    EventInbox eventInbox;
+    //NOTE: events taken from the inbox wait here until they can be executed, it is only used with mtx locked
     std::priority_queue<Event> eventQueue;
+    std::atomic<bool> queuedEvents;
     
     bool enabled;
     FilterRole const fRole;
     std::chrono::microseconds syncTs;
     
     bool sync;
+    
+    bool edgeTriggered;
+    bool blocked;
+    bool throughput;
+    std::atomic<bool> eosDone;
+    std::atomic<uint64_t> readFrames;
+    std::atomic<uint64_t> writtenFrames;
+    
+    std::atomic<unsigned> burstFrames;
+    std::chrono::microseconds burstTime;
+    std::atomic<uint64_t> burstedFrames;   //!< Frames processed after the first one of an activation
+    bool bursted;                           //!< The last activation processed frames before it blocked
+    
+    std::vector<BaseFilter*> fused;
+    std::mutex fusedMtx;
+    
+    //NOTE: reused by every process call, so the steady state does not allocate
+    FrameMap originFrames;
+    FrameMap destinationFrames;
+    std::vector<int> updatedReaders;
+    std::vector<int> syncedReaders;
+    std::vector<int> passedReaders;
+    std::vector<SyncedReader> readerTimes;
+    std::vector<SyncGroup> groupStates;
+    SlotMap<int> syncGroups;
+    SlotMap<bool> suspendedWriters;
+    std::vector<int> stageJobs;
 };
 
 class OneToOneFilter : public BaseFilter {
@@ -270,13 +574,20 @@ class OneToOneFilter : public BaseFilter {
 protected:
     OneToOneFilter(FilterRole fRole_= REGULAR, bool periodic = false);
     virtual bool doProcessFrame(Frame *org, Frame *dst) = 0;
+    /**
+    * Writes output buffered by the filter once its input has ended, see BaseFilter::runDrainFrame
+    * @param dst destination frame, set as consumed if written
+    * @return true while there may be output left
+    */
+    virtual bool drainFrame(Frame */*dst*/) {return false;};
     using BaseFilter::setFrameTime;
     using BaseFilter::getFrameTime;
 
 private:
-    bool runDoProcessFrame(std::map<int, Frame*> &oFrames, 
-                           std::map<int, Frame*> &dFrames, 
-                           std::vector<int> /*newFrames*/, int& /*ret*/);
+    bool runDoProcessFrame(FrameMap &oFrames, 
+                           FrameMap &dFrames, 
+                           std::vector<int> &/*newFrames*/, int& /*ret*/);
+    bool runDrainFrame(FrameMap &dFrames);
     
     using BaseFilter::demandOriginFrames;
     using BaseFilter::demandDestinationFrames;
@@ -292,18 +603,59 @@ private:
     using BaseFilter::mtx;
 };
 
+/*! OneToOneFilter processing frames of known classes, e.g. OneToOneFilterT<VideoFrame, VideoFrame>.
+    The frames of its queues are checked when connecting them, so the typed doProcessFrame gets
+    them cast statically. OrgFrame and DstFrame must have a FrameType specialization.
+*/
+template <class OrgFrame, class DstFrame>
+class OneToOneFilterT : public OneToOneFilter {
+
+protected:
+    OneToOneFilterT(FilterRole fRole_= REGULAR, bool periodic = false) : OneToOneFilter(fRole_, periodic) {};
+    virtual bool doProcessFrame(OrgFrame *org, DstFrame *dst) = 0;
+    virtual bool drainFrame(DstFrame */*dst*/) {return false;};
+    
+    bool acceptsReaderQueue(FrameQueue *queue)
+    {
+        if (!FrameType<OrgFrame>::accepts(queue->getStreamInfo())) {
+            utils::errorMsg("Filter " + std::to_string(getId()) + " only reads " + FrameType<OrgFrame>::name() + " frames");
+            return false;
+        }
+        
+        return true;
+    };
+    
+    bool acceptsWriterQueue(FrameQueue *queue) 
+    {
+        if (!FrameType<DstFrame>::accepts(queue->getStreamInfo())) {
+            utils::errorMsg("Filter " + std::to_string(getId()) + " only writes " + FrameType<DstFrame>::name() + " frames");
+            return false;
+        }
+        
+        return true;
+    };
+
+private:
+    bool doProcessFrame(Frame *org, Frame *dst) 
+    {
+        return doProcessFrame(static_cast<OrgFrame*>(org), static_cast<DstFrame*>(dst));
+    };
+    
+    bool drainFrame(Frame *dst) {return drainFrame(static_cast<DstFrame*>(dst));};
+};
+
 class OneToManyFilter : public BaseFilter {
 
 protected:
     OneToManyFilter(unsigned writersNum = MAX_WRITERS, FilterRole fRole_= REGULAR, bool periodic = false);
-    virtual bool doProcessFrame(Frame *org, std::map<int, Frame *> &dstFrames) = 0;
+    virtual bool doProcessFrame(Frame *org, FrameMap &dstFrames) = 0;
     using BaseFilter::setFrameTime;
     using BaseFilter::getFrameTime;
 
 private:
-    bool runDoProcessFrame(std::map<int, Frame*> &oFrames, 
-                           std::map<int, Frame*> &dFrames, 
-                           std::vector<int> /*newFrames*/, int& /*ret*/);
+    bool runDoProcessFrame(FrameMap &oFrames, 
+                           FrameMap &dFrames, 
+                           std::vector<int> &/*newFrames*/, int& /*ret*/);
 
     using BaseFilter::demandOriginFrames;
     using BaseFilter::demandDestinationFrames;
@@ -320,22 +672,61 @@ private:
     using BaseFilter::mtx;
 };
 
+/*! OneToManyFilter reading frames of a known class, e.g. OneToManyFilterT<VideoFrame, VideoFrame>.
+    The frames of its queues are checked when connecting them, so the origin frame is cast
+    statically and the destination ones can be cast statically to DstFrame by the filter.
+*/
+template <class OrgFrame, class DstFrame>
+class OneToManyFilterT : public OneToManyFilter {
+
+protected:
+    OneToManyFilterT(unsigned writersNum = MAX_WRITERS, FilterRole fRole_= REGULAR, bool periodic = false) : 
+        OneToManyFilter(writersNum, fRole_, periodic) {};
+    virtual bool doProcessFrame(OrgFrame *org, FrameMap &dstFrames) = 0;
+    
+    bool acceptsReaderQueue(FrameQueue *queue)
+    {
+        if (!FrameType<OrgFrame>::accepts(queue->getStreamInfo())) {
+            utils::errorMsg("Filter " + std::to_string(getId()) + " only reads " + FrameType<OrgFrame>::name() + " frames");
+            return false;
+        }
+        
+        return true;
+    };
+    
+    bool acceptsWriterQueue(FrameQueue *queue) 
+    {
+        if (!FrameType<DstFrame>::accepts(queue->getStreamInfo())) {
+            utils::errorMsg("Filter " + std::to_string(getId()) + " only writes " + FrameType<DstFrame>::name() + " frames");
+            return false;
+        }
+        
+        return true;
+    };
+
+private:
+    bool doProcessFrame(Frame *org, FrameMap &dstFrames) 
+    {
+        return doProcessFrame(static_cast<OrgFrame*>(org), dstFrames);
+    };
+};
+
 class HeadFilter : public BaseFilter {
 public:
     void pushEvent(Event e);
 
 protected:
     HeadFilter(unsigned writersNum = MAX_WRITERS, FilterRole fRole_ = REGULAR, bool periodic = true);
-    virtual bool doProcessFrame(std::map<int, Frame*> &dstFrames, int& ret) = 0;
+    virtual bool doProcessFrame(FrameMap &dstFrames, int& ret) = 0;
     
     int getNullWriterID();
     using BaseFilter::setFrameTime;
     using BaseFilter::getFrameTime;
 
 private: 
-    bool runDoProcessFrame(std::map<int, Frame*> &oFrames, 
-                           std::map<int, Frame*> &dFrames, 
-                           std::vector<int> /*newFrames*/, int& ret);
+    bool runDoProcessFrame(FrameMap &oFrames, 
+                           FrameMap &dFrames, 
+                           std::vector<int> &/*newFrames*/, int& ret);
     
     //NOTE: There is no need of specific reader configuration
     bool specificReaderConfig(int /*readerID*/, FrameQueue* /*queue*/)  {return true;};
@@ -361,16 +752,22 @@ public:
 
 protected:
     TailFilter(unsigned readersNum = MAX_READERS, FilterRole fRole_ = REGULAR, bool periodic = false);
+    /**
+    * Finishes the output once every reader has reached the end of the stream, see BaseFilter::runDrainFrame
+    * @return true while there may be output left
+    */
+    virtual bool drainFrame() {return false;};
     using BaseFilter::setFrameTime;
     using BaseFilter::getFrameTime;
 
 private:
     FrameQueue *allocQueue(struct ConnectionData cData) {return NULL;};
-    bool runDoProcessFrame(std::map<int, Frame*> &oFrames, 
-                           std::map<int, Frame*> &dFrames, 
-                           std::vector<int> newFrames, int& ret);
+    bool runDoProcessFrame(FrameMap &oFrames, 
+                           FrameMap &dFrames, 
+                           std::vector<int> &newFrames, int& ret);
+    bool runDrainFrame(FrameMap &/*dFrames*/) {return drainFrame();};
     
-    virtual bool doProcessFrame(std::map<int, Frame*> &orgFrames, std::vector<int> newFrames, int& ret) = 0;
+    virtual bool doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& ret) = 0;
     
     //NOTE: There is no need of specific writer configuration
     bool specificWriterConfig(int /*writerID*/) {return true;};
@@ -394,14 +791,43 @@ class ManyToOneFilter : public BaseFilter {
 
 protected:
     ManyToOneFilter(unsigned readersNum = MAX_READERS, FilterRole fRole_ = REGULAR, bool periodic = false);
-    virtual bool doProcessFrame(std::map<int, Frame *> &orgFrames, Frame *dst, std::vector<int> newFrames) = 0;
+    virtual bool doProcessFrame(FrameMap &orgFrames, Frame *dst, std::vector<int> &newFrames) = 0;
+    using BaseFilter::setFrameTime;
+    using BaseFilter::getFrameTime;
+
+private:   
+    bool runDoProcessFrame(FrameMap &oFrames, 
+                           FrameMap &dFrames, 
+                           std::vector<int> &newFrames, int& /*ret*/);
+
+    using BaseFilter::demandOriginFrames;
+    using BaseFilter::demandDestinationFrames;
+    using BaseFilter::addFrames;
+    using BaseFilter::removeFrames;
+    using BaseFilter::writers;
+    using BaseFilter::readers;
+    using BaseFilter::seqNums;
+    using BaseFilter::processEvent;
+    using BaseFilter::frameTime;
+    using BaseFilter::maxReaders;
+    using BaseFilter::maxWriters;
+    using BaseFilter::mtx;
+};
+
+class ManyToManyFilter : public BaseFilter {
+
+protected:
+    ManyToManyFilter(unsigned readersNum = MAX_READERS, unsigned writersNum = MAX_WRITERS, 
+                     FilterRole fRole_ = REGULAR, bool periodic = false);
+    virtual bool doProcessFrame(FrameMap &orgFrames, FrameMap &dstFrames, 
+                                std::vector<int> &newFrames) = 0;
     using BaseFilter::setFrameTime;
     using BaseFilter::getFrameTime;
 
 private:   
-    bool runDoProcessFrame(std::map<int, Frame*> &oFrames, 
-                           std::map<int, Frame*> &dFrames, 
-                           std::vector<int> newFrames, int& /*ret*/);
+    bool runDoProcessFrame(FrameMap &oFrames, 
+                           FrameMap &dFrames, 
+                           std::vector<int> &newFrames, int& /*ret*/);
 
     using BaseFilter::demandOriginFrames;
     using BaseFilter::demandDestinationFrames;
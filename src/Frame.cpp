@@ -22,10 +22,53 @@
  */
 
 #include "Frame.hh"
+#include "Clock.hh"
 
-Frame::Frame() : decodeTime(NO_DTS)
+#include <new>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+std::atomic<bool> Frame::hugePagesEnabled(false);
+
+unsigned char* Frame::allocBuffer(size_t length, bool hugePages)
+{
+    void *buffer = NULL;
+    size_t alignment = FRAME_ALIGNMENT;
+    size_t size = ((length + FRAME_PADDING + FRAME_ALIGNMENT - 1)/FRAME_ALIGNMENT)*FRAME_ALIGNMENT;
+    
+    hugePages = hugePages && hugePagesEnabled && size >= HUGE_PAGE_SIZE;
+    
+    //NOTE: huge pages need the whole range to be huge page aligned
+    if (hugePages) {
+        alignment = HUGE_PAGE_SIZE;
+        size = ((size + HUGE_PAGE_SIZE - 1)/HUGE_PAGE_SIZE)*HUGE_PAGE_SIZE;
+    }
+    
+    if (posix_memalign(&buffer, alignment, size) != 0) {
+        throw std::bad_alloc();
+    }
+    
+#ifdef MADV_HUGEPAGE
+    if (hugePages) {
+        madvise(buffer, size, MADV_HUGEPAGE);
+    }
+#endif
+    
+    memset(buffer, 0, size);
+    
+    return (unsigned char*) buffer;
+}
+
+void Frame::freeBuffer(unsigned char* buffer)
+{
+    free(buffer);
+}
+
+Frame::Frame() : decodeTime(NO_DTS), refs(1)
 {
-    originTime = std::chrono::system_clock::now();
+    originTime = getOriginNow();
     consumed = false;
 }
 
@@ -34,6 +77,11 @@ void Frame::setPresentationTime(std::chrono::microseconds pTime)
     presentationTime = pTime;
 }
 
+std::chrono::system_clock::time_point Frame::getOriginNow()
+{
+    return Clock::now();
+}
+
 void Frame::setOriginTime(std::chrono::system_clock::time_point orgTime)
 {
     originTime = orgTime;
@@ -57,3 +105,121 @@ std::chrono::microseconds Frame::getFrameTime() const
     
     return presentationTime;
 }
+
+FrameSideData::FrameSideData(const FrameSideData& other) : entries(0), inlineUsed(0)
+{
+    *this = other;
+}
+
+//NOTE: only the used bytes are copied, the spill buffer keeps its capacity
+FrameSideData& FrameSideData::operator=(const FrameSideData& other)
+{
+    if (this == &other) {
+        return *this;
+    }
+
+    entries = other.entries;
+    inlineUsed = other.inlineUsed;
+    std::copy(other.items, other.items + other.entries, items);
+    memcpy(inlineData, other.inlineData, other.inlineUsed);
+    spill.assign(other.spill.begin(), other.spill.end());
+
+    return *this;
+}
+
+bool FrameSideData::add(SideDataType type, const unsigned char* data, unsigned size)
+{
+    if (entries >= SIDE_DATA_MAX_ENTRIES || (size > 0 && !data)) {
+        return false;
+    }
+
+    Entry &e = items[entries];
+    e.type = type;
+    e.size = size;
+    e.spilled = inlineUsed + size > SIDE_DATA_INLINE_SIZE;
+
+    if (e.spilled) {
+        e.offset = spill.size();
+        spill.insert(spill.end(), data, data + size);
+    } else {
+        e.offset = inlineUsed;
+        memcpy(inlineData + inlineUsed, data, size);
+        inlineUsed += size;
+    }
+
+    entries++;
+    return true;
+}
+
+bool FrameSideData::set(SideDataType type, const unsigned char* data, unsigned size)
+{
+    remove(type);
+    return add(type, data, size);
+}
+
+//NOTE: the payloads after a removed one are moved back, so the buffers stay packed
+void FrameSideData::remove(SideDataType type)
+{
+    unsigned kept = 0;
+
+    for (unsigned i = 0; i < entries; i++) {
+        Entry e = items[i];
+
+        if (e.type != type) {
+            items[kept++] = e;
+            continue;
+        }
+
+        if (e.spilled) {
+            spill.erase(spill.begin() + e.offset, spill.begin() + e.offset + e.size);
+        } else {
+            memmove(inlineData + e.offset, inlineData + e.offset + e.size, inlineUsed - e.offset - e.size);
+            inlineUsed -= e.size;
+        }
+
+        for (unsigned j = i + 1; j < entries; j++) {
+            if (items[j].spilled == e.spilled && items[j].offset > e.offset) {
+                items[j].offset -= e.size;
+            }
+        }
+    }
+
+    entries = kept;
+}
+
+const unsigned char* FrameSideData::get(SideDataType type, unsigned& size, unsigned index) const
+{
+    for (unsigned i = 0; i < entries; i++) {
+        if (items[i].type != type) {
+            continue;
+        }
+
+        if (index-- == 0) {
+            size = items[i].size;
+            return getData(i);
+        }
+    }
+
+    size = 0;
+    return NULL;
+}
+
+bool FrameSideData::has(SideDataType type) const
+{
+    for (unsigned i = 0; i < entries; i++) {
+        if (items[i].type == type) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const unsigned char* FrameSideData::getData(unsigned entry) const
+{
+    if (entry >= entries) {
+        return NULL;
+    }
+
+    return items[entry].spilled ? spill.data() + items[entry].offset : inlineData + items[entry].offset;
+}
@@ -26,10 +26,82 @@
 
 #include <sys/time.h>
 #include <chrono>
+#include <atomic>
+#include <vector>
 #include "Types.hh"
 #include <iostream>
 
 #define NO_DTS std::chrono::microseconds(-1)
+#define FRAME_ALIGNMENT 64                  /*!< Frame buffers alignment in bytes, one cache line and the widest SIMD register */
+#define FRAME_PADDING 64                    /*!< Extra bytes at the end of frame buffers, so SIMD kernels can read past the data */
+#define HUGE_PAGE_SIZE (2*1024*1024)        /*!< Buffers of at least this size can be backed by huge pages */
+#define SIDE_DATA_INLINE_SIZE 256           /*!< Side data bytes stored in the frame itself, larger payloads spill to the heap */
+#define SIDE_DATA_MAX_ENTRIES 8             /*!< Side data entries of a frame */
+
+/*! Metadata travelling with a frame (see SideDataType), so it survives transcoding and consumers do not
+    parse the bitstream again for it. Payloads are stored inline up to SIDE_DATA_INLINE_SIZE bytes, which
+    covers timecodes and the captions of a picture. Bigger ones go to a spill buffer that keeps its capacity
+    when the frame is recycled, so steady streams do not allocate either. The frame queues clear it when
+    handing a frame to its writer.
+*/
+class FrameSideData {
+public:
+    FrameSideData() : entries(0), inlineUsed(0) {};
+    FrameSideData(const FrameSideData& other);
+    FrameSideData& operator=(const FrameSideData& other);
+
+    /**
+    * Appends an entry, there can be several of the same type
+    * @param type payload type
+    * @param data payload, copied
+    * @param size payload size in bytes
+    * @return false if there are SIDE_DATA_MAX_ENTRIES entries already
+    */
+    bool add(SideDataType type, const unsigned char* data, unsigned size);
+
+    /**
+    * Replaces the entries of a type by a single one
+    * @see add
+    */
+    bool set(SideDataType type, const unsigned char* data, unsigned size);
+
+    /**
+    * Removes the entries of a type
+    * @param type payload type
+    */
+    void remove(SideDataType type);
+
+    /**
+    * @param type payload type
+    * @param size set to the payload size in bytes
+    * @param index entry of that type, in the order they were added
+    * @return the payload, NULL if there is no such entry
+    */
+    const unsigned char* get(SideDataType type, unsigned& size, unsigned index = 0) const;
+
+    bool has(SideDataType type) const;
+    unsigned getEntries() const {return entries;};
+    SideDataType getType(unsigned entry) const {return items[entry].type;};
+    unsigned getSize(unsigned entry) const {return items[entry].size;};
+    const unsigned char* getData(unsigned entry) const;
+
+    void clear() {entries = 0; inlineUsed = 0; spill.clear();};
+    bool empty() const {return entries == 0;};
+
+private:
+    struct Entry {
+        SideDataType type;
+        unsigned offset;
+        unsigned size;
+        bool spilled;
+    };
+
+    Entry items[SIDE_DATA_MAX_ENTRIES];
+    unsigned char inlineData[SIDE_DATA_INLINE_SIZE];
+    std::vector<unsigned char> spill;
+    unsigned entries;
+    unsigned inlineUsed;
+};
 
 /*! Frame is an abstract class that handles byte array of a video or audio frame
     and frame related information
@@ -66,6 +138,14 @@ public:
     */
     void setSequenceNumber(size_t seqNum);
 
+    /**
+    * Gets the current time to stamp origin times with, from the installed Clock. By default it is the
+    * system time at start up advanced by a monotonic clock, so delays measured against origin times
+    * are not skewed when NTP slews the clock
+    * @return current time in the origin time base
+    */
+    static std::chrono::system_clock::time_point getOriginNow();
+
     /**
     * Get frame presentation time
     * @return presentation time of the frame.
@@ -143,6 +223,61 @@ public:
     * @param bool the value to set.
     */
     void setConsumed(bool c) { consumed=c; }
+    
+    /**
+    * Adds a reference to the frame. The queue holding the frame owns the first reference, 
+    * consumers can retain the frame to keep it beyond Reader::removeFrame without copying it.
+    * Each retain must be followed by a FramePool::releaseFrame once the frame is not needed.
+    */
+    void retain() { refs++; }
+    
+    /**
+    * Drops a reference of the frame, used by FramePool::releaseFrame
+    * @return the remaining references, the frame can be recycled when it is 0
+    */
+    unsigned dropRef() { return --refs; }
+    
+    /**
+    * Gets the references of the frame
+    * @return 1 if only the owner queue uses it, more if it is retained
+    */
+    unsigned getRefs() const { return refs; }
+    
+    /**
+    * Sets the frame as owned by a single reference again, used when the frame is recycled
+    */
+    void resetRefs() { refs = 1; }
+    
+    /**
+    * Allocates a zeroed frame buffer aligned to FRAME_ALIGNMENT and padded with FRAME_PADDING bytes
+    * @param length usable length of the buffer in bytes
+    * @param hugePages true to back the buffer with huge pages when enabled, see setHugePages
+    * @return the buffer, it must be freed with freeBuffer
+    */
+    static unsigned char* allocBuffer(size_t length, bool hugePages = false);
+    
+    /**
+    * Frees a buffer allocated with allocBuffer
+    * @param buffer the buffer to free, it can be NULL
+    */
+    static void freeBuffer(unsigned char* buffer);
+    
+    /**
+    * Enables transparent huge pages for the large buffers that request them (raw video frames)
+    * @param enable true to enable huge pages, process wide
+    */
+    static void setHugePages(bool enable) { hugePagesEnabled = enable; }
+    
+    /**
+    * @return true if huge pages are enabled for raw video frames
+    */
+    static bool getHugePages() { return hugePagesEnabled; }
+    
+    /**
+    * @return metadata of the frame, see FrameSideData
+    */
+    FrameSideData& getSideData() { return sideData; }
+    const FrameSideData& getSideData() const { return sideData; }
 
 protected:
     std::chrono::microseconds presentationTime;
@@ -150,6 +285,12 @@ protected:
     std::chrono::system_clock::time_point originTime;
     size_t sequenceNumber;
     bool consumed;
+    FrameSideData sideData;
+    
+private:
+    std::atomic<unsigned> refs;
+    
+    static std::atomic<bool> hugePagesEnabled;
 };
 
 #endif
@@ -0,0 +1,413 @@
+/*
+ *  FramePool.cpp - Process wide pool of reusable frames
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  David Cassany <david.cassany@i2cat.net>
+ */
+
+#include "FramePool.hh"
+#include "VideoFrame.hh"
+#include "HardwareVideoFrame.hh"
+#include "AudioFrame.hh"
+#include "Utils.hh"
+
+#include <cstring>
+
+std::string FramePool::FrameSpec::key() const
+{
+    return std::to_string(kind) + ":" + std::to_string(codec) + ":" + std::to_string(maxLength) + ":" +
+        std::to_string(width) + "x" + std::to_string(height) + ":" + std::to_string(pixelFormat) + ":" +
+        std::to_string(channels) + ":" + std::to_string(sampleRate) + ":" + std::to_string(maxSamples) + ":" +
+        std::to_string(sampleFormat);
+}
+
+FramePool* FramePool::getInstance()
+{
+    static FramePool instance;
+    
+    return &instance;
+}
+
+FramePool::FramePool() : maxIdleBytes(POOL_MAX_IDLE_BYTES), idleBytes(0), idleFrames(0), hits(0), misses(0)
+{
+}
+
+FramePool::~FramePool()
+{
+    trim();
+}
+
+Frame* FramePool::getVideoFrame(VCodecType codec, unsigned maxLength)
+{
+    FrameSpec spec = {VIDEO_CODED, codec, maxLength, 0, 0, P_NONE, 0, 0, 0, S_NONE};
+    
+    return getFrame(spec);
+}
+
+Frame* FramePool::getVideoFrame(VCodecType codec, int width, int height, PixType pixelFormat)
+{
+    FrameKind kind = VideoFrame::isPlanarFormat(pixelFormat) ? VIDEO_PLANAR : VIDEO_RAW;
+    
+    if (pixelFormat == HW_SURFACE){
+        kind = VIDEO_HARDWARE;
+    }
+    
+    FrameSpec spec = {kind, codec, 0, width, height, pixelFormat, 0, 0, 0, S_NONE};
+    
+    return getFrame(spec);
+}
+
+Frame* FramePool::getSliceRefFrame(VCodecType codec)
+{
+    FrameSpec spec = {VIDEO_SLICE_REF, codec, 0, 0, 0, P_NONE, 0, 0, 0, S_NONE};
+    
+    return getFrame(spec);
+}
+
+Frame* FramePool::getAudioFrame(bool planar, int ch, int sRate, int maxSamples, ACodecType codec, SampleFmt sFmt)
+{
+    FrameSpec spec = {planar ? AUDIO_PLANAR : AUDIO_INTERLEAVED, codec, 0, 0, 0, P_NONE, ch, sRate, maxSamples, sFmt};
+    
+    return getFrame(spec);
+}
+
+Frame* FramePool::getFrameLike(Frame* frame)
+{
+    FrameSpec spec;
+    
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        
+        auto it = owned.find(frame);
+        if (it == owned.end()){
+            return NULL;
+        }
+        spec = it->second;
+    }
+    
+    return getFrame(spec);
+}
+
+bool FramePool::isPooled(Frame* frame)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    
+    return owned.count(frame) > 0;
+}
+
+Frame* FramePool::hold(Frame* frame)
+{
+    VideoFrame* video = dynamic_cast<VideoFrame*>(frame);
+    VideoFrame* copy;
+    unsigned char* srcData[MAX_PLANES];
+    unsigned char* dstData[MAX_PLANES];
+    int srcLinesize[MAX_PLANES];
+    int dstLinesize[MAX_PLANES];
+    int lineBytes, rows;
+    
+    if (isPooled(frame)) {
+        frame->retain();
+        return frame;
+    }
+    
+    if (!video) {
+        utils::errorMsg("[FramePool] Only video frames can be copied to be held");
+        return NULL;
+    }
+    
+    if (video->getCodec() != RAW) {
+        copy = dynamic_cast<VideoFrame*>(getVideoFrame(video->getCodec(), video->getLength()));
+        
+        if (!copy || !video->getDataBuf()) {
+            releaseFrame(copy);
+            return NULL;
+        }
+        
+        memcpy(copy->getDataBuf(), video->getDataBuf(), video->getLength());
+        copy->setLength(video->getLength());
+        copy->setSize(video->getWidth(), video->getHeight());
+        copy->setFrameType(video->isKeyFrame(), video->isReference());
+    } else {
+        copy = dynamic_cast<VideoFrame*>(getVideoFrame(RAW, video->getWidth(), video->getHeight(), video->getPixelFormat()));
+        
+        if (!copy) {
+            return NULL;
+        }
+        
+        copy->fitBuffer(video->getWidth(), video->getHeight(), video->getPixelFormat());
+        
+        if (video->getPlanes(srcData, srcLinesize) == 0 || copy->getPlanes(dstData, dstLinesize) == 0) {
+            releaseFrame(copy);
+            return NULL;
+        }
+        
+        //NOTE: lines are copied one by one, the strides of both frames may differ
+        for (unsigned p = 0; VideoFrame::planeSize(video->getPixelFormat(), video->getWidth(), video->getHeight(),
+             p, lineBytes, rows); p++) {
+            for (int r = 0; r < rows; r++) {
+                memcpy(dstData[p] + r*dstLinesize[p], srcData[p] + r*srcLinesize[p], lineBytes);
+            }
+        }
+    }
+    
+    copy->setPresentationTime(video->getPresentationTime());
+    copy->setDecodeTime(video->getDecodeTime());
+    copy->setOriginTime(video->getOriginTime());
+    copy->setSequenceNumber(video->getSequenceNumber());
+    copy->setFormatVersion(video->getFormatVersion());
+    copy->setFieldOrder(video->getFieldOrder());
+    copy->getSideData() = video->getSideData();
+    
+    return copy;
+}
+
+Frame* FramePool::getFrame(const FrameSpec &spec)
+{
+    Frame* frame;
+    
+    std::unique_lock<std::mutex> guard(mtx);
+    
+    std::vector<Frame*> &frames = idle[spec.key()];
+    if (!frames.empty()){
+        frame = frames.back();
+        frames.pop_back();
+        idleFrames--;
+        idleBytes -= frameBytes(frame, spec);
+        hits++;
+        return frame;
+    }
+    
+    misses++;
+    guard.unlock();
+    
+    //NOTE: allocation is done out of the lock, it is the expensive part
+    frame = createFrame(spec);
+    if (!frame){
+        return NULL;
+    }
+    
+    guard.lock();
+    owned[frame] = spec;
+    
+    return frame;
+}
+
+Frame* FramePool::createFrame(const FrameSpec &spec)
+{
+    switch(spec.kind){
+        case VIDEO_CODED:
+            return InterleavedVideoFrame::createNew((VCodecType) spec.codec, spec.maxLength);
+        case VIDEO_RAW:
+            return InterleavedVideoFrame::createNew((VCodecType) spec.codec, spec.width, spec.height, spec.pixelFormat);
+        case VIDEO_PLANAR:
+            return PlanarVideoFrame::createNew((VCodecType) spec.codec, spec.width, spec.height, spec.pixelFormat);
+        case VIDEO_HARDWARE:
+            return HardwareVideoFrame::createNew(spec.width, spec.height);
+        case VIDEO_SLICE_REF:
+            return SliceRefVideoFrame::createNew((VCodecType) spec.codec);
+        case AUDIO_INTERLEAVED:
+            return InterleavedAudioFrame::createNew(spec.channels, spec.sampleRate, spec.maxSamples, 
+                                                    (ACodecType) spec.codec, spec.sampleFormat);
+        case AUDIO_PLANAR:
+            return PlanarAudioFrame::createNew(spec.channels, spec.sampleRate, spec.maxSamples, 
+                                               (ACodecType) spec.codec, spec.sampleFormat);
+    }
+    
+    return NULL;
+}
+
+void FramePool::resetFrame(Frame* frame, const FrameSpec &spec)
+{
+    VideoFrame* vFrame;
+    HardwareVideoFrame* hwFrame;
+    SliceRefVideoFrame* refFrame;
+    PlanarVideoFrame* planarFrame;
+    InterleavedVideoFrame* interleavedFrame;
+    AudioFrame* aFrame;
+    
+    frame->setLength(0);
+    frame->setSequenceNumber(0);
+    frame->setConsumed(false);
+    frame->getSideData().clear();
+    
+    //NOTE: idle frames must not keep device memory
+    if ((hwFrame = dynamic_cast<HardwareVideoFrame*>(frame)) != NULL){
+        hwFrame->releaseSurface();
+    }
+    
+    //NOTE: idle frames must not keep slice stores either, their writer reuses them
+    if ((refFrame = dynamic_cast<SliceRefVideoFrame*>(frame)) != NULL){
+        refFrame->releaseSlice();
+    }
+    
+    //NOTE: nor pictures decoded or captured in place, their producer gets the buffers back
+    if ((planarFrame = dynamic_cast<PlanarVideoFrame*>(frame)) != NULL){
+        planarFrame->releasePlanes();
+    }
+    
+    if ((interleavedFrame = dynamic_cast<InterleavedVideoFrame*>(frame)) != NULL){
+        interleavedFrame->releaseBuffer();
+    }
+    
+    if ((vFrame = dynamic_cast<VideoFrame*>(frame)) != NULL){
+        vFrame->setSize(spec.width, spec.height);
+        vFrame->setPixelFormat(spec.pixelFormat);
+    }
+    
+    if ((aFrame = dynamic_cast<AudioFrame*>(frame)) != NULL){
+        aFrame->setChannels(spec.channels);
+        aFrame->setSampleRate(spec.sampleRate);
+        aFrame->setMaxSamples(spec.maxSamples);
+        aFrame->setSampleFormat(spec.sampleFormat);
+        aFrame->setCodec((ACodecType) spec.codec);
+        aFrame->setSamples(0);
+    }
+}
+
+size_t FramePool::frameBytes(Frame* frame, const FrameSpec &spec)
+{
+    if (spec.kind == AUDIO_PLANAR){
+        return frame->getMaxLength()*spec.channels;
+    }
+    
+    return frame->getMaxLength();
+}
+
+size_t FramePool::getFrameBytes(Frame* frame)
+{
+    if (!frame){
+        return 0;
+    }
+    
+    std::lock_guard<std::mutex> guard(mtx);
+    
+    auto it = owned.find(frame);
+    if (it == owned.end()){
+        return frame->getMaxLength();
+    }
+    
+    return frameBytes(frame, it->second);
+}
+
+void FramePool::releaseFrame(Frame* frame)
+{
+    size_t bytes;
+    
+    if (!frame || frame->dropRef() > 0){
+        return;
+    }
+    
+    std::unique_lock<std::mutex> guard(mtx);
+    
+    auto it = owned.find(frame);
+    if (it == owned.end()){
+        guard.unlock();
+        delete frame;
+        return;
+    }
+    
+    bytes = frameBytes(frame, it->second);
+    if (idleBytes + bytes > maxIdleBytes){
+        owned.erase(it);
+        guard.unlock();
+        delete frame;
+        return;
+    }
+    
+    resetFrame(frame, it->second);
+    frame->resetRefs();
+    idle[it->second.key()].push_back(frame);
+    idleFrames++;
+    idleBytes += bytes;
+}
+
+void FramePool::setMaxIdleBytes(size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        maxIdleBytes = bytes;
+    }
+    
+    shrink(bytes);
+}
+
+void FramePool::trim()
+{
+    shrink(0);
+}
+
+void FramePool::shrink(size_t bytes)
+{
+    std::vector<Frame*> extra;
+    
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        
+        for (auto &it : idle){
+            while (idleBytes > bytes && !it.second.empty()){
+                Frame* frame = it.second.back();
+                it.second.pop_back();
+                idleBytes -= frameBytes(frame, owned[frame]);
+                idleFrames--;
+                owned.erase(frame);
+                extra.push_back(frame);
+            }
+        }
+    }
+    
+    for (auto frame : extra){
+        delete frame;
+    }
+}
+
+size_t FramePool::getHits()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return hits;
+}
+
+size_t FramePool::getMisses()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return misses;
+}
+
+size_t FramePool::getIdleFrames()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return idleFrames;
+}
+
+size_t FramePool::getIdleBytes()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return idleBytes;
+}
+
+void FramePool::getState(Jzon::Object &node)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    
+    node.Add("hits", (int) hits);
+    node.Add("misses", (int) misses);
+    node.Add("idleFrames", (int) idleFrames);
+    node.Add("usedFrames", (int) (owned.size() - idleFrames));
+    node.Add("idleBytes", (double) idleBytes);
+    node.Add("maxIdleBytes", (double) maxIdleBytes);
+    node.Add("hugePages", Frame::getHugePages());
+}
@@ -0,0 +1,190 @@
+/*
+ *  FramePool.hh - Process wide pool of reusable frames
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  David Cassany <david.cassany@i2cat.net>
+ */
+
+#ifndef _FRAME_POOL_HH
+#define _FRAME_POOL_HH
+
+#include <map>
+#include <vector>
+#include <string>
+#include <mutex>
+
+#include "Frame.hh"
+#include "Types.hh"
+#include "Jzon.h"
+
+#define POOL_MAX_IDLE_BYTES (256*1024*1024)  /*!< Default limit of memory kept by idle frames */
+
+/*! FramePool is a process wide pool of frames shared by all the queues. Frames are 
+    grouped by their kind and allocation parameters (codec, max length, pixel or sample 
+    format...), queues take them at setup and give them back when they are deleted, so 
+    creating and removing paths reuses buffers instead of allocating them again. Idle 
+    frames are kept until they exceed a memory limit, further released frames are deleted.
+*/
+class FramePool {
+
+public:
+    /**
+     * Gets the FramePool instance, it is created the first time it is requested
+     * @return the process wide pool
+     */
+    static FramePool* getInstance();
+    
+    /**
+     * Gets an interleaved video frame, see InterleavedVideoFrame::createNew
+     * @return an idle pooled frame or a new one if there is none
+     */
+    Frame* getVideoFrame(VCodecType codec, unsigned maxLength);
+    
+    /**
+     * Gets a raw video frame, a HardwareVideoFrame for HW_SURFACE, a PlanarVideoFrame for planar pixel
+     * formats and an InterleavedVideoFrame otherwise, see VideoFrame::isPlanarFormat
+     * @return an idle pooled frame or a new one if there is none
+     */
+    Frame* getVideoFrame(VCodecType codec, int width, int height, PixType pixelFormat);
+    
+    /**
+     * Gets a coded video frame without buffer that points to a SliceStore, see SliceRefVideoFrame
+     * @return an idle pooled frame or a new one if there is none
+     */
+    Frame* getSliceRefFrame(VCodecType codec);
+    
+    /**
+     * Gets an audio frame, see InterleavedAudioFrame::createNew and PlanarAudioFrame::createNew
+     * @param planar true for a PlanarAudioFrame, false for an InterleavedAudioFrame
+     * @return an idle pooled frame or a new one if there is none
+     */
+    Frame* getAudioFrame(bool planar, int ch, int sRate, int maxSamples, ACodecType codec, SampleFmt sFmt);
+    
+    /**
+     * Gets a frame allocated with the same parameters than a pooled one
+     * @param frame a frame obtained from the pool
+     * @return an equivalent frame, NULL if the frame does not come from the pool
+     */
+    Frame* getFrameLike(Frame* frame);
+    
+    /**
+     * Checks if a frame comes from the pool. Queues replace the pooled frames that are retained
+     * by a consumer instead of writing them again, which is not the case of other frames.
+     * @param frame frame to check
+     * @return true if the frame has been obtained from the pool
+     */
+    bool isPooled(Frame* frame);
+    
+    /**
+     * Keeps a video frame after its reader removes it from the queue. Pooled frames are retained,
+     * others are copied into a pooled frame, since their queue would write them again (see isPooled).
+     * The copy carries the picture or the coded data and the timing and side data of the frame.
+     * @param frame video frame to keep
+     * @return the retained frame or its copy, to be given back with releaseFrame. NULL if it can not be copied
+     */
+    Frame* hold(Frame* frame);
+    
+    /**
+     * Drops a reference of a frame (see Frame::retain). When there are no references left
+     * the frame goes back to the pool, frames not obtained from the pool are deleted.
+     * @param frame frame to release, it must not be used afterwards
+     */
+    void releaseFrame(Frame* frame);
+    
+    /**
+     * Sets the memory limit of idle frames, extra idle frames are deleted
+     * @param bytes maximum amount of bytes kept by idle frames
+     */
+    void setMaxIdleBytes(size_t bytes);
+    
+    /**
+     * Deletes all the idle frames
+     */
+    void trim();
+    
+    /**
+     * Adds the pool counters to the state node: hits, misses, idle and used frames, idle bytes and its limit
+     * @param node Jzon object to fill
+     */
+    void getState(Jzon::Object &node);
+    
+    /**
+     * @return number of frames served from idle pooled ones
+     */
+    size_t getHits();
+    
+    /**
+     * @param frame a frame got from the pool
+     * @return bytes of the frame buffers, its max length if it is not a pooled frame
+     */
+    size_t getFrameBytes(Frame* frame);
+    
+    /**
+     * @return number of frames that had to be allocated
+     */
+    size_t getMisses();
+    
+    /**
+     * @return number of idle frames kept by the pool
+     */
+    size_t getIdleFrames();
+    
+    /**
+     * @return amount of bytes kept by idle frames
+     */
+    size_t getIdleBytes();
+
+private:
+    enum FrameKind {VIDEO_CODED, VIDEO_RAW, VIDEO_PLANAR, VIDEO_HARDWARE, VIDEO_SLICE_REF, AUDIO_INTERLEAVED, AUDIO_PLANAR};
+    
+    struct FrameSpec {
+        FrameKind kind;
+        int codec;
+        unsigned maxLength;
+        int width;
+        int height;
+        PixType pixelFormat;
+        int channels;
+        int sampleRate;
+        int maxSamples;
+        SampleFmt sampleFormat;
+        
+        std::string key() const;
+    };
+    
+    FramePool();
+    ~FramePool();
+    
+    Frame* getFrame(const FrameSpec &spec);
+    Frame* createFrame(const FrameSpec &spec);
+    void resetFrame(Frame* frame, const FrameSpec &spec);
+    size_t frameBytes(Frame* frame, const FrameSpec &spec);
+    void shrink(size_t bytes);
+    
+    std::map<std::string, std::vector<Frame*>> idle;
+    std::map<Frame*, FrameSpec> owned;
+    std::mutex mtx;
+    
+    size_t maxIdleBytes;
+    size_t idleBytes;
+    size_t idleFrames;
+    size_t hits;
+    size_t misses;
+};
+
+#endif
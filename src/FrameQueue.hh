@@ -32,11 +32,36 @@
 #include <chrono>
 #include <list>
 #include <vector>
+#include <atomic>
+#include <algorithm>
 #include "Types.hh"
 #include "StreamInfo.hh"
 #include "Utils.hh"
+#include "Jzon.h"
+#include "MemoryBudget.hh"
 
 #define FULL_THRESHOLD 0.9
+#define OCCUPANCY_BUCKETS 10    //!< Occupancy histogram buckets, each one covers a tenth of the queue capacity
+#define RESIDENCY_WINDOW 64     //!< Frames averaged for each published residency time
+#define CACHE_LINE 64  //!< Cache line size in bytes, used to keep queue indices apart
+
+/*! Ring buffer index only written by one side of the queue (writer or reader) and
+*   read by the other one. Stores release and loads acquire by default, so the frame 
+*   behind the index is visible once the index is. It fills a whole cache line, this 
+*   way writer and reader indices are not invalidated by each other.
+*/
+class QueueIndex {
+
+public:
+    QueueIndex() : value(0) {};
+    
+    size_t load(std::memory_order order = std::memory_order_acquire) const {return value.load(order);};
+    void store(size_t v, std::memory_order order = std::memory_order_release) {value.store(v, order);};
+
+private:
+    std::atomic<size_t> value;
+    char padding[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
 
 /*! FrameQueue class is pure abstract class that represents buffering structure
     of the pipeline
@@ -56,6 +81,9 @@ struct ReaderData
 /**
  * A structure to represent connection identifiers. The writer ID of the producer filter, producer filter ID, 
  * and an array of the consumers data structs. By default all values are set to -1, which is an invalid id.
+ * It also carries the queue size requested for the connection, a zero value keeps the filter default, 
+ * the frames a full queue drops and the latency its reader catches up from, a zero value means no bound.
+ * With a drop target the queue tunes its depth, up to the requested or default one, see AVFramedQueue.
  */
 
 struct ConnectionData
@@ -63,6 +91,11 @@ struct ConnectionData
     int wFilterId = -1;
     int writerId = -1;
     std::list<ReaderData> readers;
+    unsigned maxFrames = 0;
+    size_t maxBytes = 0;
+    DropPolicy dropPolicy = DROP_NEWEST;
+    std::chrono::microseconds maxLatency = std::chrono::microseconds(0);
+    float dropTarget = 0;
 };
 
 
@@ -77,12 +110,24 @@ public:
     */
     FrameQueue(ConnectionData cData, const StreamInfo *si = NULL) :
             rear(0), front(0), connected(false), firstFrame(false),
-            lostBlocs(0), connectionData(cData), streamInfo(si) {};
+            lostBlocs(0), connectionData(cData), streamInfo(si), 
+            highWater(0), forcedFlushes(0), skippedFrames(0), avgResidency(0), residencySum(0), residencyCount(0), 
+            readerFrameTime(0), readerBitrate(0), readerPictureSize(0), readerKeyFrameTime(0), endOfStream(false), allocatedBytes(0)
+    {
+        for (unsigned i = 0; i < OCCUPANCY_BUCKETS; i++) {
+            occupancy[i] = 0;
+        }
+        
+        updateReaderIds();
+    };
 
     /**
-    * Class destructor
+    * Class destructor, releases the bytes charged to the writer
     */
-    virtual ~FrameQueue() {};
+    virtual ~FrameQueue() 
+    {
+        MemoryBudget::getInstance()->discharge(connectionData.wFilterId, connectionData.writerId, allocatedBytes);
+    };
 
     /**
     * Returns frame object from queue's rear
@@ -98,9 +143,9 @@ public:
 
     /**
     * Adds frame to queue elements
-    * @return the ids of the reader filters that has a new frame available.
+    * @return the ids of the reader filters that has a new frame available, valid until the readers change.
     */
-    virtual std::vector<int> addFrame() = 0;
+    virtual const std::vector<int>& addFrame() = 0;
 
     /**
     * Removes frame from queue elements
@@ -127,6 +172,69 @@ public:
     */
     size_t getLostBlocs() { return lostBlocs; };
 
+    /**
+    * @return the highest number of queued elements seen by the writer
+    */
+    unsigned getHighWater() const {return highWater.load(std::memory_order_relaxed);};
+    
+    /**
+    * @return number of flushes done by forceGetRear because the queue was full
+    */
+    size_t getForcedFlushes() const {return forcedFlushes.load(std::memory_order_relaxed);};
+    
+    /**
+    * @return number of frames skipped by the reader to catch up, see AVFramedQueue::getFront
+    */
+    size_t getSkippedFrames() const {return skippedFrames.load(std::memory_order_relaxed);};
+    
+    /**
+    * @return average time between writing and reading a frame, measured over the last RESIDENCY_WINDOW frames
+    */
+    std::chrono::microseconds getAvgResidency() const 
+    {
+        return std::chrono::microseconds(avgResidency.load(std::memory_order_relaxed));
+    };
+    
+    /**
+    * @return bytes of the buffers allocated by the queue, charged to its writer (see MemoryBudget)
+    */
+    size_t getAllocatedBytes() const {return allocatedBytes.load(std::memory_order_relaxed);};
+    
+    /**
+    * Gets an occupancy histogram bucket, sampled each time a frame is added
+    * @param bucket index from 0 to OCCUPANCY_BUCKETS - 1, each one covers a tenth of the capacity
+    * @return number of added frames that left the queue within the bucket occupancy
+    */
+    size_t getOccupancy(unsigned bucket) const 
+    {
+        return bucket < OCCUPANCY_BUCKETS ? occupancy[bucket].load(std::memory_order_relaxed) : 0;
+    };
+    
+    /**
+    * Adds the queue telemetry to the node: elements, high water mark, occupancy histogram, 
+    * lost blocs, forced flushes, skipped frames, average residency in microseconds and allocated bytes
+    * @param node Jzon object to fill
+    */
+    void getState(Jzon::Object &node) const
+    {
+        Jzon::Array histogram;
+        
+        for (unsigned i = 0; i < OCCUPANCY_BUCKETS; i++) {
+            histogram.Add((double) getOccupancy(i));
+        }
+        
+        node.Add("elements", (int) getElements());
+        node.Add("highWater", (int) getHighWater());
+        node.Add("occupancy", histogram);
+        node.Add("lostBlocs", (int) lostBlocs);
+        node.Add("forcedFlushes", (int) getForcedFlushes());
+        node.Add("skippedFrames", (int) getSkippedFrames());
+        node.Add("avgResidency", (int) getAvgResidency().count());
+        node.Add("allocatedBytes", (double) getAllocatedBytes());
+        node.Add("endOfStream", isEndOfStream());
+        doGetState(node);
+    };
+
     /**
     * Forces getting frame from queue's rear
     * @return frame object
@@ -188,6 +296,7 @@ public:
         reader.readerId = readerId;
         
         connectionData.readers.push_back(reader);
+        updateReaderIds();
         
         return true;
     };
@@ -203,6 +312,7 @@ public:
         {
             if ((*i).rFilterId == fId){
                 i = connectionData.readers.erase(i);
+                updateReaderIds();
                 return true;
             } else {
                 ++i;
@@ -217,6 +327,102 @@ public:
     * @return the struct that contains the connection data.
     */
     const StreamInfo *getStreamInfo() const {return streamInfo;};
+    
+    /**
+    * Publishes the frame time the reader selects frames with (see FrameRateScheduler), the writer
+    * can use it to avoid producing the frames the reader will drop
+    * @param fTime reader frame time, 0 if the reader consumes all the frames
+    */
+    void setReaderFrameTime(std::chrono::microseconds fTime) 
+    {
+        readerFrameTime.store(fTime.count(), std::memory_order_relaxed);
+    };
+    
+    /**
+    * @return the frame time published by the reader, 0 if it consumes all the frames
+    */
+    std::chrono::microseconds getReaderFrameTime() const 
+    {
+        return std::chrono::microseconds(readerFrameTime.load(std::memory_order_relaxed));
+    };
+    
+    /**
+    * Publishes the bitrate the reader can deliver (e.g. estimated from network feedback, see 
+    * BitrateController), the writer can use it to adapt its output
+    * @param kbps bitrate in kbps, 0 if the reader has no limit
+    */
+    void setReaderBitrate(unsigned kbps) 
+    {
+        readerBitrate.store(kbps, std::memory_order_relaxed);
+    };
+    
+    /**
+    * @return the bitrate published by the reader in kbps, 0 if it has no limit
+    */
+    unsigned getReaderBitrate() const 
+    {
+        return readerBitrate.load(std::memory_order_relaxed);
+    };
+    
+    /**
+    * Publishes the largest picture size the reader needs (e.g. the tile size of a mixer channel), the writer 
+    * can use it to produce smaller pictures, i.e. decoders decoding at a reduced resolution
+    * @param width picture width, 0 if the reader needs the full size pictures
+    * @param height picture height, 0 if the reader needs the full size pictures
+    */
+    void setReaderPictureSize(unsigned width, unsigned height) 
+    {
+        readerPictureSize.store(((uint64_t) width << 32) | height, std::memory_order_relaxed);
+    };
+    
+    /**
+    * Gets the picture size published by the reader, both 0 if it needs the full size pictures
+    * @param width picture width
+    * @param height picture height
+    */
+    void getReaderPictureSize(unsigned &width, unsigned &height) const 
+    {
+        uint64_t size = readerPictureSize.load(std::memory_order_relaxed);
+        
+        width = size >> 32;
+        height = size & 0xFFFFFFFF;
+    };
+    
+    /**
+    * Publishes the presentation time from which the reader needs a keyframe (e.g. the next segment boundary 
+    * of a Dasher), the writer can force it on the first frame reaching that time instead of placing them 
+    * periodically
+    * @param time frames presentation time, 0 if the reader does not place the keyframes
+    */
+    void setReaderKeyFrameTime(std::chrono::microseconds time) 
+    {
+        readerKeyFrameTime.store(time.count(), std::memory_order_relaxed);
+    };
+    
+    /**
+    * @return the keyframe time published by the reader, 0 if it does not place the keyframes
+    */
+    std::chrono::microseconds getReaderKeyFrameTime() const 
+    {
+        return std::chrono::microseconds(readerKeyFrameTime.load(std::memory_order_relaxed));
+    };
+    
+    /**
+    * Marks the end of the stream, set by the writer once its last frame has been added
+    * @param eos false when the writer starts a new stream
+    */
+    void setEndOfStream(bool eos) 
+    {
+        endOfStream.store(eos, std::memory_order_release);
+    };
+    
+    /**
+    * @return true if the writer will not add any other frame, the queued ones are still to be read
+    */
+    bool isEndOfStream() const 
+    {
+        return endOfStream.load(std::memory_order_acquire);
+    };
 
 protected:
     size_t rear;
@@ -224,11 +430,116 @@ protected:
     bool connected;
     bool firstFrame;
     size_t lostBlocs;
+    
+    /**
+    * Accounts an added frame in the high water mark and the occupancy histogram, writer side only
+    * @param elements queued elements after the addition
+    * @param capacity maximum elements of the queue
+    */
+    void countWrite(size_t elements, size_t capacity)
+    {
+        size_t bucket;
+        
+        if (elements > highWater.load(std::memory_order_relaxed)) {
+            highWater.store(elements, std::memory_order_relaxed);
+        }
+        
+        bucket = capacity > 0 ? elements*OCCUPANCY_BUCKETS/capacity : 0;
+        occupancy[std::min(bucket, (size_t) OCCUPANCY_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+    };
+    
+    /**
+    * Accounts the residency of a read frame, reader side only
+    * @param residency time the frame spent queued
+    */
+    void countRead(std::chrono::microseconds residency)
+    {
+        residencySum += residency.count();
+        
+        if (++residencyCount >= RESIDENCY_WINDOW) {
+            avgResidency.store(residencySum/residencyCount, std::memory_order_relaxed);
+            residencySum = 0;
+            residencyCount = 0;
+        }
+    };
+    
+    /**
+    * Accounts a flush forced by a full queue, writer side only
+    */
+    void countForcedFlush() {forcedFlushes.fetch_add(1, std::memory_order_relaxed);};
+    
+    /**
+    * Accounts a frame skipped to catch up, reader side only
+    */
+    void countSkippedFrame() {skippedFrames.fetch_add(1, std::memory_order_relaxed);};
+    
+    /**
+    * @return the ids of the reader filters, kept along the connection data so adding frames does not allocate
+    */
+    const std::vector<int>& getReaderIds() const {return readerIds;};
+    
+    /**
+    * @return an empty list of reader filters, returned by addFrame when the frame is not added
+    */
+    static const std::vector<int>& noReaderIds() 
+    {
+        static const std::vector<int> none;
+        return none;
+    };
+    
+    /**
+    * Accounts buffers allocated by the queue, they are charged to its writer until the queue is deleted
+    * @param bytes allocated bytes
+    */
+    void chargeBytes(size_t bytes)
+    {
+        MemoryBudget::getInstance()->charge(connectionData.wFilterId, connectionData.writerId, bytes);
+        allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    };
+    
+    /**
+    * Accounts buffers released by the queue before it is deleted
+    * @param bytes released bytes, previously charged
+    */
+    void dischargeBytes(size_t bytes)
+    {
+        MemoryBudget::getInstance()->discharge(connectionData.wFilterId, connectionData.writerId, bytes);
+        allocatedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    };
+    
+    /**
+    * Adds the telemetry specific to the queue implementation, see getState
+    * @param node Jzon object to fill
+    */
+    virtual void doGetState(Jzon::Object &/*node*/) const {};
 
     ConnectionData connectionData;
 
     const StreamInfo *streamInfo;
 
+private:
+    void updateReaderIds()
+    {
+        readerIds.clear();
+        for (auto& r : connectionData.readers){
+            readerIds.push_back(r.rFilterId);
+        }
+    };
+    
+    std::vector<int> readerIds;
+    std::atomic<size_t> highWater;
+    std::atomic<size_t> occupancy[OCCUPANCY_BUCKETS];
+    std::atomic<size_t> forcedFlushes;
+    std::atomic<size_t> skippedFrames;
+    std::atomic<int64_t> avgResidency;
+    int64_t residencySum;
+    unsigned residencyCount;
+    std::atomic<int64_t> readerFrameTime;
+    std::atomic<unsigned> readerBitrate;
+    std::atomic<uint64_t> readerPictureSize;
+    std::atomic<int64_t> readerKeyFrameTime;
+    std::atomic<bool> endOfStream;
+    std::atomic<size_t> allocatedBytes;
 };
 
 #endif
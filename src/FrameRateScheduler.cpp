@@ -0,0 +1,73 @@
+/*
+ *  FrameRateScheduler.cpp - Timestamp based frame selection for frame rate conversion
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "FrameRateScheduler.hh"
+
+FrameRateScheduler::FrameRateScheduler() : 
+    frameTime(0), nextSlot(0), started(false), dropped(0)
+{
+}
+
+void FrameRateScheduler::setFrameTime(std::chrono::microseconds fTime)
+{
+    if (fTime == frameTime) {
+        return;
+    }
+    
+    frameTime = fTime;
+    reset();
+}
+
+void FrameRateScheduler::reset()
+{
+    started = false;
+}
+
+bool FrameRateScheduler::keep(std::chrono::microseconds ts)
+{
+    std::chrono::microseconds jitter = frameTime/FRS_JITTER_DIV;
+    
+    if (frameTime.count() <= 0) {
+        return true;
+    }
+    
+    if (started && (ts > nextSlot + frameTime*FRS_MAX_GAP || ts < nextSlot - frameTime*FRS_MAX_GAP)) {
+        started = false;
+    }
+    
+    //NOTE: slots lie on multiples of the frame time, so schedulers started at different frames agree
+    if (!started) {
+        nextSlot = ((ts + jitter)/frameTime)*frameTime;
+        started = true;
+    }
+    
+    if (ts < nextSlot - jitter) {
+        dropped++;
+        return false;
+    }
+    
+    while (nextSlot <= ts + jitter) {
+        nextSlot += frameTime;
+    }
+    
+    return true;
+}
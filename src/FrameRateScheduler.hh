@@ -0,0 +1,79 @@
+/*
+ *  FrameRateScheduler.hh - Timestamp based frame selection for frame rate conversion
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _FRAME_RATE_SCHEDULER_HH
+#define _FRAME_RATE_SCHEDULER_HH
+
+#include <chrono>
+#include <cstddef>
+
+#define FRS_JITTER_DIV 8        //!< Frames up to this fraction of the frame time ahead of their slot are kept
+#define FRS_MAX_GAP 8           //!< Timestamp jumps beyond this number of frame times restart the schedule
+
+/*! Selects the frames of a stream to keep for a lower frame rate, only from their timestamps, so 
+    it can be done before decoding or scaling them. Output slots are the multiples of the frame time 
+    and the first frame reaching a slot is kept, so jitter does not accumulate and slots skipped by 
+    late frames are not caught up. Schedulers fed with the same timestamps take the same decisions, 
+    even if they started at different frames (the first frame is always kept), which lets a writer 
+    predict the frames its reader will drop (see FrameQueue::setReaderFrameTime).
+*/
+class FrameRateScheduler {
+
+public:
+    FrameRateScheduler();
+    
+    /**
+    * Sets the output frame time, the schedule restarts if it changes
+    * @param fTime time between output frames, 0 keeps all the frames
+    */
+    void setFrameTime(std::chrono::microseconds fTime);
+    
+    /**
+    * @return time between output frames, 0 if all the frames are kept
+    */
+    std::chrono::microseconds getFrameTime() const {return frameTime;};
+    
+    /**
+    * Decides if a frame is kept and advances the schedule
+    * @param ts frame timestamp
+    * @return true if the frame has to be kept, false if it has to be dropped
+    */
+    bool keep(std::chrono::microseconds ts);
+    
+    /**
+    * Restarts the schedule at the next frame
+    */
+    void reset();
+    
+    /**
+    * @return number of frames dropped since the creation of the scheduler
+    */
+    size_t getDropped() const {return dropped;};
+
+private:
+    std::chrono::microseconds frameTime;
+    std::chrono::microseconds nextSlot;
+    bool started;
+    size_t dropped;
+};
+
+#endif
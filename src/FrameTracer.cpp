@@ -0,0 +1,169 @@
+/*
+ *  FrameTracer.cpp - Sampled per frame latency tracing
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "FrameTracer.hh"
+
+#include <set>
+#include <algorithm>
+
+static int64_t toMicros(std::chrono::system_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+}
+
+static void appendEvent(std::string &buffer, std::string name, int tid, std::chrono::system_clock::time_point start,
+                        std::chrono::system_clock::time_point end, std::string args)
+{
+    buffer += ",{\"name\":\"" + name + "\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(tid);
+    buffer += ",\"ts\":" + std::to_string(toMicros(start));
+    buffer += ",\"dur\":" + std::to_string(std::max<int64_t>(toMicros(end) - toMicros(start), 0));
+    buffer += ",\"args\":{" + args + "}}";
+}
+
+FrameTracer* FrameTracer::getInstance()
+{
+    static FrameTracer instance;
+
+    return &instance;
+}
+
+FrameTracer::FrameTracer() : sampling(0), next(0)
+{
+}
+
+void FrameTracer::setSampling(unsigned interval)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    stamps.clear();
+    next = 0;
+    sampling = interval;
+}
+
+void FrameTracer::stamp(const Frame *frame, int filterId, TracePhase phase, int peerId)
+{
+    TraceStamp s;
+
+    s.key = getKey(frame);
+    s.origin = frame->getOriginTime();
+    s.time = Frame::getOriginNow();
+    s.filterId = filterId;
+    s.peerId = peerId;
+    s.phase = phase;
+
+    std::lock_guard<std::mutex> guard(mtx);
+
+    if (stamps.size() < TRACE_MAX_STAMPS) {
+        stamps.push_back(s);
+    } else {
+        stamps[next] = s;
+        next = (next + 1) % TRACE_MAX_STAMPS;
+    }
+}
+
+size_t FrameTracer::getStamps()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    return stamps.size();
+}
+
+size_t FrameTracer::getChromeTrace(std::string &buffer, const std::map<int, std::string> &filterNames)
+{
+    std::map<uint64_t, std::vector<TraceStamp>> traces;
+    std::set<int> tracks;
+    std::chrono::system_clock::time_point last;
+    std::string args;
+
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+
+        //NOTE: once the buffer wraps the oldest stamp is the next one to be overwritten
+        for (size_t i = 0; i < stamps.size(); i++) {
+            const TraceStamp &s = stamps[(next + i) % stamps.size()];
+            traces[s.key].push_back(s);
+        }
+    }
+
+    buffer += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    buffer += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"frames\"}}";
+
+    for (auto &trace : traces) {
+        std::vector<TraceStamp> &hops = trace.second;
+        std::set<std::pair<int, size_t>> processed;
+
+        std::stable_sort(hops.begin(), hops.end(),
+                         [](const TraceStamp &a, const TraceStamp &b) {return a.time < b.time;});
+
+        last = hops.back().time;
+        args = "\"trace\":\"" + std::to_string(trace.first) + "\"";
+        appendEvent(buffer, "frame", 0, hops.front().origin, last, args);
+
+        for (size_t i = 0; i < hops.size(); i++) {
+            const TraceStamp &s = hops[i];
+            size_t j = i;
+
+            tracks.insert(s.filterId);
+
+            if (s.phase == DEQUEUE) {
+                //NOTE: the frame was queued since its writer enqueued it
+                while (j-- > 0) {
+                    if (hops[j].phase == ENQUEUE && hops[j].filterId == s.peerId) {
+                        appendEvent(buffer, "queue", s.filterId, hops[j].time, s.time,
+                                    args + ",\"from\":" + std::to_string(s.peerId));
+                        break;
+                    }
+                }
+                continue;
+            }
+
+            //NOTE: processing starts when the filter dequeued the frame, or at its origin for head filters
+            while (j-- > 0) {
+                if (hops[j].phase == DEQUEUE && hops[j].filterId == s.filterId) {
+                    break;
+                }
+            }
+
+            if (j == (size_t) -1) {
+                j = hops.size();
+            }
+
+            //NOTE: filters with several writers enqueue the same frame once per writer
+            if (!processed.insert(std::make_pair(s.filterId, j)).second) {
+                continue;
+            }
+
+            appendEvent(buffer, "process", s.filterId, j < hops.size() ? hops[j].time : s.origin, s.time, args);
+        }
+    }
+
+    for (auto id : tracks) {
+        std::string name = filterNames.count(id) > 0 ? filterNames.at(id) : "filter";
+
+        buffer += ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(id);
+        buffer += ",\"args\":{\"name\":\"" + std::to_string(id) + " " + name + "\"}}";
+    }
+
+    buffer += "]}";
+
+    return traces.size();
+}
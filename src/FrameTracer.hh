@@ -0,0 +1,126 @@
+/*
+ *  FrameTracer.hh - Sampled per frame latency tracing
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _FRAME_TRACER_HH
+#define _FRAME_TRACER_HH
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "Frame.hh"
+
+#define TRACE_MAX_STAMPS 65536      //!< Stamps kept by the tracer, the oldest ones are overwritten
+
+enum TracePhase {ENQUEUE, DEQUEUE};
+
+/*! Process wide tracer of sampled frames along the pipeline. Frames are identified by their origin
+    time, which is set by the head filters and carried along by the filters transforming them (see
+    Frame::setOriginTime), so every hop makes the same sampling decision without tagging the frames.
+    Filters stamp the traced frames when they dequeue them to be processed and when they enqueue the
+    results, and the stamps are turned into Chrome trace events (also read by Perfetto) with the time
+    frames spend queued between filters and being processed by each one. Tracing is disabled by default,
+    then the cost per hop is a relaxed atomic load.
+*/
+class FrameTracer {
+
+public:
+    /**
+     * Gets the FrameTracer instance, it is created the first time it is requested
+     * @return the process wide tracer
+     */
+    static FrameTracer* getInstance();
+
+    /**
+     * Sets how many frames are traced, the stamps taken so far are discarded
+     * @param interval one of every interval frames is traced, 0 disables tracing
+     */
+    void setSampling(unsigned interval);
+
+    /**
+     * @return sampling interval, 0 if tracing is disabled
+     */
+    unsigned getSampling() const {return sampling.load(std::memory_order_relaxed);};
+
+    /**
+     * @param frame frame to check
+     * @return true if the frame is sampled
+     */
+    bool isTraced(const Frame *frame) const
+    {
+        unsigned interval = sampling.load(std::memory_order_relaxed);
+
+        return interval != 0 && frame && (getKey(frame) >> 32) % interval == 0;
+    };
+
+    /**
+     * Stamps a traced frame at a filter
+     * @param frame traced frame, see isTraced
+     * @param filterId filter handling the frame
+     * @param phase ENQUEUE when the filter writes the frame, DEQUEUE when it takes it to be processed
+     * @param peerId for DEQUEUE stamps, the filter that wrote the frame
+     */
+    void stamp(const Frame *frame, int filterId, TracePhase phase, int peerId = -1);
+
+    /**
+     * @return number of stamps kept
+     */
+    size_t getStamps();
+
+    /**
+     * Writes the traces in Chrome trace event format, one track per filter. Each traced frame has a
+     * "frame" event from its origin time to its last stamp, and "queue" and "process" events for each hop
+     * @param buffer where the JSON object is appended
+     * @param filterNames track names by filter id
+     * @return number of traced frames written
+     */
+    size_t getChromeTrace(std::string &buffer, const std::map<int, std::string> &filterNames);
+
+private:
+    struct TraceStamp {
+        uint64_t key;
+        std::chrono::system_clock::time_point origin;
+        std::chrono::system_clock::time_point time;
+        int filterId;
+        int peerId;
+        TracePhase phase;
+    };
+
+    FrameTracer();
+
+    static uint64_t getKey(const Frame *frame)
+    {
+        //NOTE: origin times are scrambled, otherwise periodic sources would only hit a few residues
+        return (uint64_t) frame->getOriginTime().time_since_epoch().count() * 0x9E3779B97F4A7C15ULL;
+    };
+
+    std::mutex mtx;
+    std::atomic<unsigned> sampling;
+    std::vector<TraceStamp> stamps;
+    size_t next;
+};
+
+#endif
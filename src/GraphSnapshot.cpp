@@ -0,0 +1,226 @@
+/*
+ *  GraphSnapshot.cpp - Record of the pipeline graph for warm restarts
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstdio>
+#include <fstream>
+
+#include "GraphSnapshot.hh"
+#include "Utils.hh"
+
+GraphSnapshot::GraphSnapshot() : autoSave(false), dirty(false), held(false), saves(0), failures(0)
+{
+}
+
+void GraphSnapshot::configure(std::string file_, bool autoSave_)
+{
+    file = file_;
+    autoSave = autoSave_ && !file.empty();
+}
+
+void GraphSnapshot::addFilter(const Jzon::Node &params)
+{
+    int id = params.Get("id").ToInt();
+
+    filters.erase(id);
+    filters.emplace(id, Jzon::Object(params));
+    dirty = true;
+}
+
+void GraphSnapshot::addPath(const Jzon::Node &params)
+{
+    int id = params.Get("id").ToInt();
+
+    paths.erase(id);
+    paths.emplace(id, Jzon::Object(params));
+    dirty = true;
+}
+
+void GraphSnapshot::addEvent(const Jzon::Node &event)
+{
+    Jzon::Object recorded;
+    std::string json;
+
+    recorded.Add("filterId", event.Get("filterId").ToInt());
+    recorded.Add("action", event.Get("action").ToString());
+    recorded.Add("params", event.Get("params"));
+
+    Jzon::Writer writer(recorded, Jzon::NoFormat);
+    writer.Write();
+    json = writer.GetResult();
+
+    if (json == lastEvent) {
+        return;
+    }
+
+    lastEvent = json;
+    events.push_back(recorded);
+    dirty = true;
+}
+
+void GraphSnapshot::addSetting(std::string action, const Jzon::Node &params)
+{
+    Jzon::Object &setting = settings[action];
+
+    if (!params.IsObject()) {
+        return;
+    }
+
+    for (auto it : params.AsObject()) {
+        if (setting.Has(it.first)) {
+            setting.Remove(it.first);
+        }
+        setting.Add(it.first, it.second);
+    }
+
+    dirty = true;
+}
+
+void GraphSnapshot::removeFilter(int id)
+{
+    if (filters.erase(id) == 0) {
+        return;
+    }
+
+    events.remove_if([id](const Jzon::Object &e) {return e.Get("filterId").ToInt() == id;});
+    lastEvent.clear();
+    dirty = true;
+}
+
+void GraphSnapshot::removePath(int id)
+{
+    if (paths.erase(id) > 0) {
+        dirty = true;
+    }
+}
+
+void GraphSnapshot::serialise(std::string &buffer)
+{
+    Jzon::Object root, settingsNode, graph;
+    Jzon::Array filterList, pathList, eventList;
+
+    for (auto &it : settings) {
+        settingsNode.Add(it.first, it.second);
+    }
+
+    for (auto &it : filters) {
+        filterList.Add(it.second);
+    }
+
+    for (auto &it : paths) {
+        pathList.Add(it.second);
+    }
+
+    for (auto &e : events) {
+        eventList.Add(e);
+    }
+
+    graph.Add("filters", filterList);
+    graph.Add("paths", pathList);
+    graph.Add("events", eventList);
+
+    root.Add("version", SNAPSHOT_VERSION);
+    root.Add("settings", settingsNode);
+    root.Add("graph", graph);
+
+    Jzon::Writer writer(root, Jzon::NoFormat);
+    writer.Write();
+    buffer.append(writer.GetResult());
+}
+
+bool GraphSnapshot::save(std::string file_)
+{
+    std::string target = file_.empty() ? file : file_;
+    std::string tmp = target + ".tmp";
+    std::string buffer;
+    std::ofstream out;
+
+    if (target.empty()) {
+        utils::errorMsg("[GraphSnapshot] No snapshot file configured");
+        return false;
+    }
+
+    serialise(buffer);
+
+    out.open(tmp.c_str(), std::ios::out | std::ios::trunc);
+    if (!out.is_open() || !out.write(buffer.data(), buffer.size())) {
+        utils::errorMsg("[GraphSnapshot] Could not write " + tmp);
+        failures++;
+        return false;
+    }
+    out.close();
+
+    if (out.fail() || std::rename(tmp.c_str(), target.c_str()) != 0) {
+        utils::errorMsg("[GraphSnapshot] Could not replace " + target);
+        std::remove(tmp.c_str());
+        failures++;
+        return false;
+    }
+
+    if (target == file) {
+        dirty = false;
+    }
+
+    saves++;
+    return true;
+}
+
+bool GraphSnapshot::load(std::string file, Jzon::Object &snapshot, std::string &error)
+{
+    Jzon::FileReader reader(file);
+
+    if (!reader.Read(snapshot)) {
+        error = "Snapshot " + file + " could not be read: " + reader.GetError();
+        return false;
+    }
+
+    if (!snapshot.Has("version") || !snapshot.Get("version").IsNumber() ||
+        snapshot.Get("version").ToInt() > SNAPSHOT_VERSION) {
+        error = "Snapshot " + file + " version is not supported";
+        return false;
+    }
+
+    if (!snapshot.Has("graph") || !snapshot.Get("graph").IsObject() ||
+        (snapshot.Has("settings") && !snapshot.Get("settings").IsObject())) {
+        error = "Snapshot " + file + " is not valid";
+        return false;
+    }
+
+    return true;
+}
+
+void GraphSnapshot::commit()
+{
+    if (autoSave && dirty && !held) {
+        save();
+    }
+}
+
+void GraphSnapshot::getState(Jzon::Object &node)
+{
+    node.Add("file", file);
+    node.Add("autoSave", autoSave);
+    node.Add("filters", (int) filters.size());
+    node.Add("paths", (int) paths.size());
+    node.Add("events", (int) events.size());
+    node.Add("saves", (int) saves);
+    node.Add("failures", (int) failures);
+}
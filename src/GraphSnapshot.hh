@@ -0,0 +1,135 @@
+/*
+ *  GraphSnapshot.hh - Record of the pipeline graph for warm restarts
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _GRAPH_SNAPSHOT_HH
+#define _GRAPH_SNAPSHOT_HH
+
+#include <map>
+#include <list>
+#include <string>
+
+#include "Jzon.h"
+
+#define SNAPSHOT_VERSION 1                  /*!< Format of the snapshot files written */
+
+/*! Records how the pipeline graph was built, so it can be saved to a file and rebuilt in a single
+    createGraph event after a restart. Filters do not expose their configuration, so the snapshot keeps
+    the params each filter and path was created with, the events pushed to the filters in order and the
+    last value of each pipeline setting (pool, governor, metrics and tracing). Replaying them takes the
+    pipeline to the same graph, filters deleted internally (shared decoders, bypassed transcoders) are
+    deleted again on the way. The file is a compact JSON object:
+    {"version":1,"settings":{"configurePool":{..},..},"graph":{"filters":[..],"paths":[..],"events":[..]}}
+*/
+class GraphSnapshot {
+
+public:
+    GraphSnapshot();
+
+    /**
+    * Sets the snapshot file. It is not written until the next change, so configuring the file a
+    * snapshot is restored from does not overwrite it
+    * @param file snapshot file, empty to stop saving it automatically
+    * @param autoSave true to save the file on every commit, so a crash leaves it up to date
+    */
+    void configure(std::string file, bool autoSave);
+
+    /**
+    * Holds the commits, e.g. while a snapshot is restored, so a failed restore does not overwrite it
+    */
+    void hold(bool held_) {held = held_;};
+
+    const std::string& getFile() const {return file;};
+
+    /**
+    * Records the params of a created filter, replacing any previous one with the same ID
+    */
+    void addFilter(const Jzon::Node &params);
+
+    /**
+    * Records the params of a created path, replacing any previous one with the same ID
+    */
+    void addPath(const Jzon::Node &params);
+
+    /**
+    * Records a filter event. Its delay is dropped, since it was relative to the old process, and an
+    * event equal to the previous one is not recorded twice
+    */
+    void addEvent(const Jzon::Node &event);
+
+    /**
+    * Merges the params of a pipeline setting event into the recorded ones of the same action
+    */
+    void addSetting(std::string action, const Jzon::Node &params);
+
+    /**
+    * Forgets a removed filter and its events
+    */
+    void removeFilter(int id);
+
+    /**
+    * Forgets a removed path
+    */
+    void removePath(int id);
+
+    /**
+    * Saves the file if it is saved automatically and anything was recorded since the last commit. It is
+    * called once per request, so a whole graph is written at once
+    */
+    void commit();
+
+    /**
+    * Writes the snapshot as compact JSON
+    */
+    void serialise(std::string &buffer);
+
+    /**
+    * Writes the snapshot to a temporary file and renames it, so the previous one is kept if it fails
+    * @param file snapshot file, the configured one if empty
+    * @return false if the file cannot be written
+    */
+    bool save(std::string file = "");
+
+    /**
+    * Reads a snapshot file
+    * @param snapshot where the parsed snapshot is set, with its "settings" and "graph" objects
+    * @param error set if it fails
+    * @return false if the file cannot be read or it is not a valid snapshot
+    */
+    static bool load(std::string file, Jzon::Object &snapshot, std::string &error);
+
+    void getState(Jzon::Object &node);
+
+private:
+    std::map<int, Jzon::Object> filters;
+    std::map<int, Jzon::Object> paths;
+    std::list<Jzon::Object> events;
+    std::map<std::string, Jzon::Object> settings;
+    std::string lastEvent;
+    std::string file;
+    bool autoSave;
+    bool dirty;
+    bool held;
+    size_t saves;
+    size_t failures;
+};
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ *  HardwareVideoFrame - Video frame holding a hardware surface
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  David Cassany <david.cassany@i2cat.net>
+ */
+
+#include "HardwareVideoFrame.hh"
+#include "Utils.hh"
+
+extern "C" {
+    #include <libavutil/frame.h>
+    #include <libavutil/hwcontext.h>
+}
+
+HardwareVideoFrame* HardwareVideoFrame::createNew(int width, int height)
+{
+    return new HardwareVideoFrame(width, height);
+}
+
+HardwareVideoFrame::HardwareVideoFrame(int width, int height) : 
+VideoFrame(RAW, width, height, HW_SURFACE)
+{
+    surface = av_frame_alloc();
+}
+
+HardwareVideoFrame::~HardwareVideoFrame()
+{
+    av_frame_free(&surface);
+}
+
+unsigned HardwareVideoFrame::getPlanes(unsigned char* data[], int linesize[])
+{
+    for (unsigned i = 0; i < MAX_PLANES; i++) {
+        data[i] = NULL;
+        linesize[i] = 0;
+    }
+    
+    return 0;
+}
+
+bool HardwareVideoFrame::setSurface(AVFrame *frame)
+{
+    if (!frame || !frame->hw_frames_ctx) {
+        utils::errorMsg("[HardwareVideoFrame] Frame is not backed by a hardware frames context");
+        return false;
+    }
+    
+    av_frame_unref(surface);
+    
+    if (av_frame_ref(surface, frame) < 0) {
+        utils::errorMsg("[HardwareVideoFrame] Could not reference the surface");
+        return false;
+    }
+    
+    setSize(frame->width, frame->height);
+    
+    return true;
+}
+
+AVFrame* HardwareVideoFrame::getSurface()
+{
+    if (!surface->hw_frames_ctx) {
+        return NULL;
+    }
+    
+    return surface;
+}
+
+bool HardwareVideoFrame::download(AVFrame *dst)
+{
+    if (!surface->hw_frames_ctx) {
+        utils::errorMsg("[HardwareVideoFrame] There is no surface to download");
+        return false;
+    }
+    
+    av_frame_unref(dst);
+    
+    if (av_hwframe_transfer_data(dst, surface, 0) < 0) {
+        utils::errorMsg("[HardwareVideoFrame] Could not download the surface");
+        return false;
+    }
+    
+    av_frame_copy_props(dst, surface);
+    
+    return true;
+}
+
+void HardwareVideoFrame::releaseSurface()
+{
+    av_frame_unref(surface);
+}
@@ -0,0 +1,83 @@
+/*
+ *  HardwareVideoFrame - Video frame holding a hardware surface
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  David Cassany <david.cassany@i2cat.net>
+ */
+
+#ifndef _HARDWARE_VIDEO_FRAME_HH
+#define _HARDWARE_VIDEO_FRAME_HH
+
+#include "VideoFrame.hh"
+
+struct AVFrame;
+
+/*! Raw video frame whose picture lives in device memory (CUDA, VAAPI or QSV surfaces). It holds a
+    reference to a libav hardware frame, so surfaces go from filter to filter without being copied.
+    Its pixel format is HW_SURFACE and it has no host buffer, consumers needing host pixels must 
+    download the surface.
+*/
+class HardwareVideoFrame : public VideoFrame {
+    
+public:
+    static HardwareVideoFrame* createNew(int width, int height);
+    ~HardwareVideoFrame();
+
+    unsigned char *getDataBuf() {return NULL;};
+    unsigned char **getPlanarDataBuf() {return NULL;};
+    unsigned int getLength() {return 0;};
+    unsigned int getMaxLength() {return 0;};
+    void setLength(unsigned int /*length*/) {};
+    bool isPlanar() {return false;};
+    
+    /**
+    * See VideoFrame::getPlanes, hardware frames have no host planes
+    */
+    unsigned getPlanes(unsigned char* data[], int linesize[]);
+    
+    /**
+    * Sets the surface of the frame, releasing the previous one
+    * @param surface libav frame backed by an AVHWFramesContext, it is referenced not copied
+    * @return false if it is not a hardware frame or it could not be referenced
+    */
+    bool setSurface(AVFrame *surface);
+    
+    /**
+    * @return the libav hardware frame, NULL if there is no surface
+    */
+    AVFrame* getSurface();
+    
+    /**
+    * Copies the surface to host memory
+    * @param dst libav frame filled with the picture, its previous buffers are released
+    * @return false if there is no surface or it could not be transferred
+    */
+    bool download(AVFrame *dst);
+    
+    /**
+    * Releases the surface reference, giving it back to its hardware frames pool
+    */
+    void releaseSurface();
+
+private:
+    HardwareVideoFrame(int width, int height);
+    
+    AVFrame *surface;
+};
+
+#endif
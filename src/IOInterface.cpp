@@ -25,11 +25,93 @@
 #include "IOInterface.hh"
 #include "Utils.hh"
 
+#include <algorithm>
+
+//////////////////////////////////
+//DELAY HISTOGRAM IMPLEMENTATION//
+//////////////////////////////////
+
+DelayHistogram::DelayHistogram()
+{
+    clear();
+}
+
+void DelayHistogram::clear()
+{
+    for (size_t i = 0; i < DELAY_BUCKETS; i++) {
+        buckets[i] = 0;
+    }
+
+    count = 0;
+    max = 0;
+}
+
+//NOTE: delays below DELAY_SUB_BUCKETS usec have a bucket each, then each power of two has DELAY_SUB_BUCKETS
+size_t DelayHistogram::bucketOf(int64_t us)
+{
+    unsigned msb = 0;
+    size_t bucket;
+
+    if (us < DELAY_SUB_BUCKETS) {
+        return us;
+    }
+
+    while ((us >> msb) >= 2*DELAY_SUB_BUCKETS) {
+        msb++;
+    }
+
+    bucket = (msb + 1)*DELAY_SUB_BUCKETS + (us >> msb) - DELAY_SUB_BUCKETS;
+    return bucket < DELAY_BUCKETS ? bucket : DELAY_BUCKETS - 1;
+}
+
+int64_t DelayHistogram::upperBound(size_t bucket)
+{
+    unsigned shift;
+
+    if (bucket < DELAY_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    shift = bucket/DELAY_SUB_BUCKETS - 1;
+    return ((int64_t) (bucket % DELAY_SUB_BUCKETS + DELAY_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+void DelayHistogram::add(std::chrono::microseconds delay)
+{
+    int64_t us = delay.count() > 0 ? delay.count() : 0;
+
+    buckets[bucketOf(us)]++;
+    count++;
+
+    if (us > max) {
+        max = us;
+    }
+}
+
+std::chrono::microseconds DelayHistogram::getPercentile(double p) const
+{
+    size_t acc = 0;
+
+    if (count == 0) {
+        return std::chrono::microseconds(0);
+    }
+
+    //NOTE: the last bucket is unbounded
+    for (size_t i = 0; i < DELAY_BUCKETS - 1; i++) {
+        acc += buckets[i];
+        if (acc*100.0 >= p*count) {
+            return std::chrono::microseconds(std::min(upperBound(i), max));
+        }
+    }
+
+    return std::chrono::microseconds(max);
+}
+
 /////////////////////////
 //READER IMPLEMENTATION//
 /////////////////////////
 
-Reader::Reader(std::chrono::microseconds wDelay) : queue(NULL), frame(NULL), ready(true),
+Reader::Reader(std::chrono::microseconds wDelay) : queue(NULL), frame(NULL), ready(true), lck(READER_LOCK),
                     avgDelay(std::chrono::microseconds(0)), delay(std::chrono::microseconds(0)), windowDelay(wDelay), 
                     lastTs(std::chrono::microseconds(-1)), timeCounter(std::chrono::microseconds(0)), frameCounter(0)
 {
@@ -59,7 +141,7 @@ bool Reader::disconnectQueue()
 
 void Reader::addReader(int fId, int rId)
 {
-    std::lock_guard<std::mutex> guard(lck);
+    std::lock_guard<ProfiledMutex> guard(lck);
         
     if (queue && queue->isConnected() && queue->addReaderCData(fId, rId)){
         filters[fId].first = false;
@@ -67,9 +149,16 @@ void Reader::addReader(int fId, int rId)
     }
 }
 
+bool Reader::isShared()
+{
+    std::lock_guard<ProfiledMutex> guard(lck);
+    
+    return filters.size() > 1;
+}
+
 Frame* Reader::getFrame(int fId, bool &newFrame)
 {
-    std::lock_guard<std::mutex> guard(lck);
+    std::lock_guard<ProfiledMutex> guard(lck);
     
     if (!queue || !queue->isConnected()) {
         utils::errorMsg("The queue is not connected");
@@ -121,7 +210,7 @@ bool Reader::allRead()
 
 int Reader::removeFrame(int fId)
 {
-    std::lock_guard<std::mutex> guard(lck);
+    std::lock_guard<ProfiledMutex> guard(lck);
     
     if (filters.count(fId) > 0){
         filters[fId].second = false;
@@ -139,6 +228,8 @@ int Reader::removeFrame(int fId)
 
 void Reader::measureDelay()
 {
+    std::chrono::microseconds frameDelay;
+
     if(lastTs.count() < 0){
         lastTs = frame->getFrameTime();
     }
@@ -152,32 +243,71 @@ void Reader::measureDelay()
 
     if(timeCounter >= windowDelay && frameCounter > 0){
         avgDelay = delay / frameCounter;
+        windowDelays = delays;
+        delays.clear();
         timeCounter = std::chrono::microseconds(0);
         delay = std::chrono::microseconds(0);
         frameCounter = 0;
     }
 
-    delay += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now() - frame->getOriginTime());
+    //NOTE: origin times are stamped with a monotonic clock, see Frame::getOriginNow
+    frameDelay = std::chrono::duration_cast<std::chrono::microseconds>(Frame::getOriginNow() - frame->getOriginTime());
+    delay += frameDelay;
+    delays.add(frameDelay);
+    runDelays.add(frameDelay);
     frameCounter++;
 }
 
+std::chrono::microseconds Reader::getDelayPercentile(double p)
+{
+    std::lock_guard<ProfiledMutex> guard(lck);
+
+    return windowDelays.getPercentile(p);
+}
+
+std::chrono::microseconds Reader::getRunDelayPercentile(double p)
+{
+    std::lock_guard<ProfiledMutex> guard(lck);
+
+    return runDelays.getPercentile(p);
+}
+
+void Reader::clearRunDelays()
+{
+    std::lock_guard<ProfiledMutex> guard(lck);
+
+    runDelays.clear();
+}
+
 std::chrono::microseconds Reader::getAvgDelay()
 { 
-    std::lock_guard<std::mutex> guard(lck);
+    std::lock_guard<ProfiledMutex> guard(lck);
 
     return avgDelay; 
 };
 
 size_t Reader::getLostBlocs()
 { 
-    std::lock_guard<std::mutex> guard(lck);
+    std::lock_guard<ProfiledMutex> guard(lck);
 
     return queue ? queue->getLostBlocs() : 0; 
 };
 
+bool Reader::getQueueState(Jzon::Object &node)
+{
+    std::lock_guard<ProfiledMutex> guard(lck);
+    
+    if (!queue) {
+        return false;
+    }
+    
+    queue->getState(node);
+    return true;
+}
+
 void Reader::setConnection(FrameQueue *queue)
 {
-    std::lock_guard<std::mutex> guard(lck);
+    std::lock_guard<ProfiledMutex> guard(lck);
     if (!queue || isConnected()){
         return;
     }
@@ -193,7 +323,7 @@ void Reader::setConnection(FrameQueue *queue)
 
 bool Reader::disconnect(int id)
 {
-    std::lock_guard<std::mutex> guard(lck);
+    std::lock_guard<ProfiledMutex> guard(lck);
     
     if (filters.count(id) == 0){
         return false;
@@ -222,7 +352,7 @@ bool Reader::isConnected()
 
 size_t Reader::getQueueElements()
 {
-    std::lock_guard<std::mutex> guard(lck);
+    std::lock_guard<ProfiledMutex> guard(lck);
     
     if (!queue) {
         return 0;
@@ -252,6 +382,14 @@ bool Reader::isFull() const
     return queue->isFull(); 
 }
 
+bool Reader::isEndOfStream()
+{
+    std::lock_guard<ProfiledMutex> guard(lck);
+
+    //NOTE: a frame still referenced by the reader has not been removed by all its filters
+    return queue && queue->isEndOfStream() && !frame && queue->getElements() == 0;
+}
+
 
 
 /////////////////////////
@@ -334,11 +472,28 @@ Frame* Writer::getFrame(bool force) const
     return frame;
 }
 
-std::vector<int> Writer::addFrame() const
+const std::vector<int>& Writer::addFrame() const
 {
     return queue->addFrame();
 }
 
+std::vector<int> Writer::setEndOfStream(bool eos) const
+{
+    std::vector<int> readersIds;
+
+    if (!queue || !queue->isConnected()) {
+        return readersIds;
+    }
+
+    queue->setEndOfStream(eos);
+
+    for (auto r : queue->getCData().readers) {
+        readersIds.push_back(r.rFilterId);
+    }
+
+    return readersIds;
+}
+
 ConnectionData Writer::getCData()
 {
     if (queue && queue->isConnected()){
@@ -29,6 +29,7 @@
 #include <utility>
 #include <map>
 #include <memory>
+#include <stdint.h>
 
 #ifndef _FRAME_HH
 #include "Frame.hh"
@@ -38,8 +39,54 @@
 #include "FrameQueue.hh"
 #endif
 
+#include "ProfiledMutex.hh"
+
+#define DELAY_SUB_BUCKETS 8          //!< Linear sub buckets per power of two, percentiles are within 12.5%
+#define DELAY_BUCKETS 256           //!< Delay histogram buckets, the last one covers delays above 4 hours
+
 class Reader;
 
+/*! Log-linear histogram of frame delays: each power of two is split in DELAY_SUB_BUCKETS linear buckets,
+    so the relative error of the percentiles is bounded whatever the delay while the size stays fixed.
+    The maximum is kept exactly.
+*/
+class DelayHistogram {
+
+public:
+    DelayHistogram();
+
+    /**
+    * Accounts a delay, negative ones are accounted as 0
+    * @param delay frame delay
+    */
+    void add(std::chrono::microseconds delay);
+
+    /**
+    * Removes all the accounted delays
+    */
+    void clear();
+
+    /**
+    * @return number of accounted delays
+    */
+    size_t getCount() const {return count;};
+
+    /**
+    * Gets a delay percentile
+    * @param p percentile, between 0 and 100, 100 gives the maximum delay
+    * @return upper bound of the bucket containing the percentile, 0 if there are no delays
+    */
+    std::chrono::microseconds getPercentile(double p) const;
+
+private:
+    static size_t bucketOf(int64_t us);
+    static int64_t upperBound(size_t bucket);
+
+    uint32_t buckets[DELAY_BUCKETS];
+    size_t count;
+    int64_t max;
+};
+
 /*! Writer class is an IOInterface dedicated to write frames to an specific queue.
 */
 class Writer {
@@ -89,7 +136,15 @@ public:
     * Adds a frame element to its queue
     * @return a vector containing all consumer filters Ids.
     */
-    std::vector<int> addFrame() const;
+    const std::vector<int>& addFrame() const;
+
+    /**
+    * Marks the end of the stream in its queue, once the readers consume the queued frames
+    * they reach the end of the stream too
+    * @param eos false when a new stream starts
+    * @return a vector containing all consumer filters Ids.
+    */
+    std::vector<int> setEndOfStream(bool eos = true) const;
 
     /**
     * Disconnects from its queue (sets queue disconnected) or deletes the queue
@@ -103,6 +158,12 @@ public:
     * @return the connection data struct of the queue
     */
     struct ConnectionData getCData();
+    
+    /**
+    * Get FrameQueue object pointer
+    * @return FrameQueue object pointer
+    */
+    FrameQueue* getQueue() const {return queue;};
 
 protected:
     mutable FrameQueue *queue;
@@ -170,6 +231,12 @@ public:
     * @param int the reader Id that will use the filter.
     */
     void addReader(int fId, int rId);
+    
+    /**
+    * Checks if several filters share this reader, then all of them read the same frames
+    * @return true if more than one filter uses this reader
+    */
+    bool isShared();
 
     /**
     * Get FrameQueue elements number
@@ -183,12 +250,39 @@ public:
     */
     std::chrono::microseconds getAvgDelay();
 
+    /**
+    * Get a frame delay percentile over the last stats window, delays are measured as averages are
+    * @param p percentile, between 0 and 100, 100 gives the maximum delay
+    * @return frame delay percentile in microseconds
+    */
+    std::chrono::microseconds getDelayPercentile(double p);
+
+    /**
+    * Get a frame delay percentile since the reader was connected or since the last clearRunDelays call,
+    * i.e. over a whole benchmark run
+    * @param p percentile, between 0 and 100, 100 gives the maximum delay
+    * @return frame delay percentile in microseconds
+    */
+    std::chrono::microseconds getRunDelayPercentile(double p);
+
+    /**
+    * Discards the delays measured so far by the run percentiles, see getRunDelayPercentile
+    */
+    void clearRunDelays();
+
     /**
     * Get lost blocs
     * @return lost blocs in size_t
     */
     size_t getLostBlocs();
     
+    /**
+    * Adds the connected queue telemetry to the node, see FrameQueue::getState
+    * @param node Jzon object to fill
+    * @return false if the reader is not connected to a queue
+    */
+    bool getQueueState(Jzon::Object &node);
+    
     /**
     * Get the oldest presentation time of a valid frame in queue, zero time if empty queue
     * @return presentation time
@@ -200,6 +294,12 @@ public:
      * @return true if the queue is considered to be full, false otherwise.
      */
     bool isFull() const;
+    
+    /**
+     * Returns true once the writer has marked the end of the stream and every queued frame has been read
+     * @return true if there are no frames left to read
+     */
+    bool isEndOfStream();
 
 protected:
     FrameQueue *queue;
@@ -216,7 +316,7 @@ private:
     std::map<int, std::pair<bool, bool>> filters;
     bool ready;
     
-    std::mutex lck;
+    ProfiledMutex lck;
 
     //Stats
     std::chrono::microseconds avgDelay;
@@ -225,6 +325,9 @@ private:
     std::chrono::microseconds lastTs;
     std::chrono::microseconds timeCounter;
     size_t frameCounter;
+    DelayHistogram delays;
+    DelayHistogram windowDelays;
+    DelayHistogram runDelays;
 };
 
 #endif
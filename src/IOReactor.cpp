@@ -0,0 +1,398 @@
+/*
+ *  IOReactor.cpp - Process wide epoll reactor resuming suspended runnables
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "IOReactor.hh"
+#include "WorkersPool.hh"
+#include "Utils.hh"
+
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+IOReactor* IOReactor::getInstance()
+{
+    static IOReactor instance;
+
+    return &instance;
+}
+
+IOReactor::IOReactor() : epollFd(-1), wakeFd(-1), run(false), nextTimer(0)
+{
+    struct epoll_event event;
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+
+    if (epollFd < 0 || wakeFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) < 0) {
+        utils::errorMsg("[IOReactor] Could not create the epoll descriptors, the reactor is not running");
+        return;
+    }
+
+    run = true;
+    thread = std::thread(&IOReactor::loop, this);
+}
+
+IOReactor::~IOReactor()
+{
+    run = false;
+    wake();
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+}
+
+bool IOReactor::watch(int fd, unsigned events, std::function<void(unsigned)> handler)
+{
+    struct epoll_event event;
+
+    if (!run || fd < 0 || !handler) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(mtx);
+
+    if (watched.count(fd) > 0) {
+        utils::warningMsg("[IOReactor] Descriptor " + std::to_string(fd) + " is already watched");
+        return false;
+    }
+
+    event.events = events | EPOLLONESHOT;
+    event.data.fd = fd;
+
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        utils::errorMsg("[IOReactor] Could not watch descriptor " + std::to_string(fd));
+        return false;
+    }
+
+    watched[fd] = handler;
+    return true;
+}
+
+bool IOReactor::unwatch(int fd)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    if (watched.erase(fd) == 0) {
+        return false;
+    }
+
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+    return true;
+}
+
+unsigned IOReactor::addTimer(std::chrono::microseconds delay, std::function<void()> handler)
+{
+    TimerKey key;
+    bool first;
+
+    if (!run || !handler) {
+        return 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+
+        //NOTE: 0 is never given, it means no timer
+        if (++nextTimer == 0) {
+            nextTimer++;
+        }
+
+        key = TimerKey(std::chrono::steady_clock::now() + delay, nextTimer);
+        timers[key] = handler;
+        timerKeys[nextTimer] = key;
+        first = timers.begin()->first == key;
+    }
+
+    //NOTE: the loop only needs to wait less if the timer is the next one
+    if (first) {
+        wake();
+    }
+
+    return key.second;
+}
+
+bool IOReactor::cancelTimer(unsigned id)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    if (timerKeys.count(id) == 0) {
+        return false;
+    }
+
+    timers.erase(timerKeys[id]);
+    timerKeys.erase(id);
+    return true;
+}
+
+size_t IOReactor::getWatchedNum()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return watched.size();
+}
+
+size_t IOReactor::getTimersNum()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return timers.size();
+}
+
+void IOReactor::wake()
+{
+    uint64_t one = 1;
+
+    if (wakeFd >= 0 && write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        utils::warningMsg("[IOReactor] Could not wake the reactor up");
+    }
+}
+
+int IOReactor::waitTime()
+{
+    std::chrono::steady_clock::duration left;
+
+    std::lock_guard<std::mutex> guard(mtx);
+
+    if (timers.empty()) {
+        return -1;
+    }
+
+    left = timers.begin()->first.first - std::chrono::steady_clock::now();
+
+    if (left <= std::chrono::steady_clock::duration::zero()) {
+        return 0;
+    }
+
+    //NOTE: rounded up, so the timer has expired when the wait times out
+    return (int) std::min<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(left).count() + 1, INT_MAX);
+}
+
+void IOReactor::runTimers()
+{
+    std::vector<std::function<void()>> expired;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+
+        while (!timers.empty() && timers.begin()->first.first <= now) {
+            expired.push_back(timers.begin()->second);
+            timerKeys.erase(timers.begin()->first.second);
+            timers.erase(timers.begin());
+        }
+    }
+
+    for (auto &handler : expired) {
+        handler();
+    }
+}
+
+void IOReactor::loop()
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    std::vector<std::pair<std::function<void(unsigned)>, unsigned>> ready;
+    uint64_t value;
+    int n;
+
+    while (run) {
+        n = epoll_wait(epollFd, events, REACTOR_MAX_EVENTS, waitTime());
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            utils::errorMsg("[IOReactor] Wait error, the reactor is stopped");
+            break;
+        }
+
+        ready.clear();
+
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+
+            for (int i = 0; i < n; i++) {
+                if (events[i].data.fd == wakeFd) {
+                    while (read(wakeFd, &value, sizeof(value)) > 0);
+                    continue;
+                }
+
+                //NOTE: a descriptor unwatched meanwhile is not reported
+                if (watched.count(events[i].data.fd) == 0) {
+                    continue;
+                }
+
+                ready.push_back(std::make_pair(watched[events[i].data.fd], (unsigned) events[i].events));
+                watched.erase(events[i].data.fd);
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, events[i].data.fd, NULL);
+            }
+        }
+
+        for (auto &it : ready) {
+            it.first(it.second);
+        }
+
+        runTimers();
+    }
+}
+
+Awaiter::Awaiter(Runnable *job) : state(std::make_shared<State>())
+{
+    state->job = job;
+    state->pool = NULL;
+    state->resumed = false;
+    state->timer = 0;
+}
+
+Awaiter::~Awaiter()
+{
+    cancel();
+
+    //NOTE: handlers already running finish before the runnable is gone, later ones find no job
+    std::lock_guard<std::mutex> guard(state->mtx);
+    state->job = NULL;
+}
+
+void Awaiter::bind()
+{
+    WorkersPool* current = WorkersPool::current();
+
+    if (current) {
+        state->pool = current;
+    }
+}
+
+void Awaiter::resumeState(const std::shared_ptr<State> &state)
+{
+    WorkersPool* pool;
+
+    state->resumed = true;
+
+    std::lock_guard<std::mutex> guard(state->mtx);
+    pool = state->pool.load();
+
+    if (state->job && pool) {
+        pool->wakeUp(state->job->getId());
+    }
+}
+
+void Awaiter::resume()
+{
+    resumeState(state);
+}
+
+bool Awaiter::awaitFd(int fd, unsigned events)
+{
+    std::weak_ptr<State> weak = state;
+
+    std::lock_guard<std::mutex> guard(state->mtx);
+
+    if (std::find(state->fds.begin(), state->fds.end(), fd) != state->fds.end()) {
+        return true;
+    }
+
+    if (!IOReactor::getInstance()->watch(fd, events, [weak, fd] (unsigned /*events*/) {
+            std::shared_ptr<State> s = weak.lock();
+
+            if (!s) {
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(s->mtx);
+                s->fds.erase(std::remove(s->fds.begin(), s->fds.end(), fd), s->fds.end());
+            }
+
+            resumeState(s);
+        })) {
+        return false;
+    }
+
+    state->fds.push_back(fd);
+    return true;
+}
+
+bool Awaiter::awaitReadable(int fd)
+{
+    return awaitFd(fd, EPOLLIN);
+}
+
+bool Awaiter::awaitWritable(int fd)
+{
+    return awaitFd(fd, EPOLLOUT);
+}
+
+bool Awaiter::awaitTimer(std::chrono::microseconds delay)
+{
+    std::weak_ptr<State> weak = state;
+    unsigned id;
+
+    std::lock_guard<std::mutex> guard(state->mtx);
+
+    //NOTE: timer ids are not reused, cancelling one that has already expired does nothing
+    if (state->timer) {
+        IOReactor::getInstance()->cancelTimer(state->timer);
+        state->timer = 0;
+    }
+
+    id = IOReactor::getInstance()->addTimer(delay, [weak] () {
+            std::shared_ptr<State> s = weak.lock();
+
+            if (!s) {
+                return;
+            }
+
+            resumeState(s);
+        });
+
+    state->timer = id;
+    return id != 0;
+}
+
+void Awaiter::cancel()
+{
+    std::lock_guard<std::mutex> guard(state->mtx);
+
+    for (auto fd : state->fds) {
+        IOReactor::getInstance()->unwatch(fd);
+    }
+
+    state->fds.clear();
+
+    if (state->timer) {
+        IOReactor::getInstance()->cancelTimer(state->timer);
+        state->timer = 0;
+    }
+}
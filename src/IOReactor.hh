@@ -0,0 +1,209 @@
+/*
+ *  IOReactor.hh - Process wide epoll reactor resuming suspended runnables
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _IO_REACTOR_HH
+#define _IO_REACTOR_HH
+
+#include <map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+#include "Runnable.hh"
+
+#define REACTOR_MAX_EVENTS 64           //!< Ready descriptors handled by a single wait
+
+class WorkersPool;
+
+/*! Process wide reactor, a single thread waiting with epoll for descriptor readiness and timers. Handlers
+    are one-shot: a descriptor is forgotten once its handler runs and a timer once it expires, so they are
+    armed again for each wait. Handlers run in the reactor thread without any lock held, they are expected
+    to be short, usually waking a runnable up (see Awaiter). It is started the first time it is requested.
+*/
+class IOReactor {
+
+public:
+    /**
+     * Gets the IOReactor instance, it is created the first time it is requested
+     * @return the process wide reactor, it may have no thread if epoll is not available
+     */
+    static IOReactor* getInstance();
+
+    /**
+     * Class destructor, pending handlers are not run
+     */
+    ~IOReactor();
+
+    /**
+     * Runs a handler once when a descriptor is ready
+     * @param fd descriptor to wait for, it can only have a handler at a time
+     * @param events epoll events to wait for (EPOLLIN, EPOLLOUT), errors and hangups are always reported
+     * @param handler function called with the ready events
+     * @return false if the descriptor is already watched or cannot be waited for
+     */
+    bool watch(int fd, unsigned events, std::function<void(unsigned)> handler);
+
+    /**
+     * Forgets a descriptor before it is ready, it must be called before closing it
+     * @param fd watched descriptor
+     * @return false if it is not watched, e.g. its handler has already run
+     */
+    bool unwatch(int fd);
+
+    /**
+     * Runs a handler once after a delay
+     * @param delay time from now
+     * @param handler function to run
+     * @return id of the timer, 0 if the reactor is not running
+     */
+    unsigned addTimer(std::chrono::microseconds delay, std::function<void()> handler);
+
+    /**
+     * Cancels a timer before it expires
+     * @param id timer id returned by addTimer
+     * @return false if it is not pending, e.g. it has already expired
+     */
+    bool cancelTimer(unsigned id);
+
+    /**
+     * @return number of watched descriptors
+     */
+    size_t getWatchedNum();
+
+    /**
+     * @return number of pending timers
+     */
+    size_t getTimersNum();
+
+private:
+    IOReactor();
+
+    void loop();
+    void wake();
+    int waitTime();
+    void runTimers();
+
+    typedef std::pair<std::chrono::steady_clock::time_point, unsigned> TimerKey;
+
+    int epollFd;
+    int wakeFd;                                     //!< eventfd written when the next timer changes
+    std::thread thread;
+    std::atomic<bool> run;
+    std::mutex mtx;                                 //!< Guards the handlers and the timers
+
+    std::unordered_map<int, std::function<void(unsigned)>> watched;
+    std::map<TimerKey, std::function<void()>> timers;
+    std::map<unsigned, TimerKey> timerKeys;
+    unsigned nextTimer;
+};
+
+/*! Suspension point of a runnable executed by a WorkersPool, the equivalent of a coroutine co_await for
+    the C++11 filters. The runnable arms it from processFrame, waiting for a descriptor, a timer or an
+    explicit resume from another thread (e.g. an event loop that has filled a frame), and returns without
+    being polled again. Once resumed it is woken up in the pool that last executed it, so it does not
+    occupy a worker while waiting. The resumed flag is kept until consumed, so pendingJobs can tell if
+    the runnable was resumed while it was running.
+*/
+class Awaiter {
+
+public:
+    /**
+     * @param job runnable to wake up, its id is read when it is resumed
+     */
+    Awaiter(Runnable *job);
+
+    /**
+     * Class destructor, cancels the pending waits
+     */
+    ~Awaiter();
+
+    /**
+     * Takes the pool of the calling worker, to be called from the runnable execution (processFrame or
+     * pendingJobs). Resumes before the runnable has been executed by a pool only set the flag
+     */
+    void bind();
+
+    /**
+     * Resumes the runnable when a descriptor is readable
+     * @param fd descriptor to wait for
+     * @return false if the descriptor cannot be waited for
+     */
+    bool awaitReadable(int fd);
+
+    /**
+     * Resumes the runnable when a descriptor is writable
+     * @param fd descriptor to wait for
+     * @return false if the descriptor cannot be waited for
+     */
+    bool awaitWritable(int fd);
+
+    /**
+     * Resumes the runnable after a delay, a pending timer is replaced
+     * @param delay time from now
+     * @return false if the reactor is not running
+     */
+    bool awaitTimer(std::chrono::microseconds delay);
+
+    /**
+     * Resumes the runnable, it can be called from any thread
+     */
+    void resume();
+
+    /**
+     * Cancels the pending waits, the resumed flag is kept
+     */
+    void cancel();
+
+    /**
+     * @return true if the runnable has been resumed since the last consume
+     */
+    bool isResumed() const {return state->resumed;};
+
+    /**
+     * Clears the resumed flag, to be called when the runnable starts processing
+     * @return true if the runnable had been resumed
+     */
+    bool consume() {return state->resumed.exchange(false);};
+
+private:
+    /*! Shared with the reactor handlers, which may run after the awaiter is gone */
+    struct State {
+        std::mutex mtx;
+        Runnable *job;
+        std::atomic<WorkersPool*> pool;
+        std::atomic<bool> resumed;
+        std::vector<int> fds;           //!< Watched descriptors, forgotten by their handlers
+        unsigned timer;                 //!< Pending timer, 0 if there is none
+    };
+
+    static void resumeState(const std::shared_ptr<State> &state);
+    bool awaitFd(int fd, unsigned events);
+
+    std::shared_ptr<State> state;
+};
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ *  LoadGovernor.cpp - Process wide quality degradation under overload
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "LoadGovernor.hh"
+#include "Utils.hh"
+
+//NOTE: x264 and x265 share the preset names, from the fastest to the slowest
+static const char* const presets[] = {"ultrafast", "superfast", "veryfast", "faster", "fast",
+                                      "medium", "slow", "slower", "veryslow", "placebo"};
+
+LoadGovernor::LoadGovernor() : enabled(false), highLoad(GOVERNOR_HIGH_LOAD), lowLoad(GOVERNOR_LOW_LOAD),
+    highResidency(GOVERNOR_HIGH_RESIDENCY), lowResidency(GOVERNOR_LOW_RESIDENCY), period(GOVERNOR_PERIOD),
+    hold(GOVERNOR_HOLD), level(0), sinceChange(GOVERNOR_HOLD), reliefChecks(0), lastUtilisation(0),
+    lastResidency(0), degradations(0), restorations(0)
+{
+}
+
+bool LoadGovernor::configure(bool enabled_, float highLoad_, float lowLoad_, std::chrono::microseconds highResidency_,
+                             std::chrono::microseconds lowResidency_, std::chrono::seconds period_, unsigned hold_)
+{
+    if (highLoad_ <= 0 || highLoad_ > 1 || lowLoad_ < 0 || lowLoad_ >= highLoad_ ||
+        lowResidency_.count() < 0 || lowResidency_ >= highResidency_ || period_.count() <= 0 || hold_ == 0) {
+        utils::errorMsg("[LoadGovernor] Invalid thresholds");
+        return false;
+    }
+
+    enabled = enabled_;
+    highLoad = highLoad_;
+    lowLoad = lowLoad_;
+    highResidency = highResidency_;
+    lowResidency = lowResidency_;
+    period = period_;
+    hold = hold_;
+
+    //NOTE: disabling restores the full quality on next govern call
+    if (!enabled) {
+        level = 0;
+    }
+
+    sinceChange = hold;
+    reliefChecks = 0;
+
+    return true;
+}
+
+bool LoadGovernor::update(float utilisation, std::chrono::microseconds residency)
+{
+    bool overloaded = utilisation >= highLoad || residency >= highResidency;
+    bool relieved = utilisation <= lowLoad && residency <= lowResidency;
+
+    lastUtilisation = utilisation;
+    lastResidency = residency;
+
+    if (!enabled) {
+        return false;
+    }
+
+    sinceChange++;
+    reliefChecks = relieved ? reliefChecks + 1 : 0;
+
+    //NOTE: each step is given some checks to take effect before stepping further
+    if (sinceChange < hold) {
+        return false;
+    }
+
+    if (overloaded && level < GOVERNOR_LEVELS) {
+        level++;
+        degradations++;
+        sinceChange = 0;
+        utils::warningMsg("[LoadGovernor] Node overloaded, degrading quality to level " + std::to_string(level));
+        return true;
+    }
+
+    if (reliefChecks >= hold && level > 0) {
+        level--;
+        restorations++;
+        sinceChange = 0;
+        reliefChecks = 0;
+        utils::infoMsg("[LoadGovernor] Load back to normal, restoring quality to level " + std::to_string(level));
+        return true;
+    }
+
+    return false;
+}
+
+void LoadGovernor::govern(const std::map<int, BaseFilter*> &filters)
+{
+    std::map<int, Governed>::iterator g;
+    FilterType type;
+
+    for (g = governed.begin(); g != governed.end();) {
+        if (filters.count(g->first) == 0) {
+            g = governed.erase(g);
+        } else {
+            ++g;
+        }
+    }
+
+    for (auto it : filters) {
+        type = it.second->getType();
+
+        if (type != VIDEO_ENCODER && type != VIDEO_DECODER && type != VIDEO_MIXER) {
+            continue;
+        }
+
+        g = governed.find(it.first);
+
+        if (g == governed.end()) {
+            if (level == 0) {
+                continue;
+            }
+
+            g = governed.insert(std::make_pair(it.first, Governed())).first;
+            save(it.second, g->second);
+        }
+
+        while (g->second.level < level) {
+            degrade(it.second, g->second, ++g->second.level);
+        }
+
+        while (g->second.level > level) {
+            restore(it.second, g->second, g->second.level--);
+        }
+
+        if (g->second.level == 0) {
+            governed.erase(g);
+        }
+    }
+}
+
+void LoadGovernor::getState(Jzon::Object &node)
+{
+    node.Add("enabled", enabled);
+    node.Add("level", (int) level);
+    node.Add("utilisation", lastUtilisation);
+    node.Add("residency", (int) lastResidency.count());
+    node.Add("governedFilters", (int) governed.size());
+    node.Add("degradations", (int) degradations);
+    node.Add("restorations", (int) restorations);
+}
+
+void LoadGovernor::save(BaseFilter *filter, Governed &g)
+{
+    Jzon::Object state;
+
+    filter->getState(state);
+
+    g.level = 0;
+    g.preset = state.Has("preset") ? state.Get("preset").ToString() : "";
+    g.lookahead = state.Has("lookahead") ? state.Get("lookahead").ToInt() : 0;
+    g.loadShedding = state.Has("inputInfo") && state.Get("inputInfo").Has("loadShedding") &&
+                     state.Get("inputInfo").Get("loadShedding").ToBool();
+    g.fps = state.Has("fps") ? state.Get("fps").ToInt() : 0;
+}
+
+void LoadGovernor::degrade(BaseFilter *filter, Governed &g, unsigned step)
+{
+    Jzon::Object params;
+    FilterType type = filter->getType();
+
+    if (step == 1 && type == VIDEO_ENCODER && !g.preset.empty()) {
+        params.Add("preset", fasterPreset(g.preset, GOVERNOR_PRESET_STEPS));
+    } else if (step == 2 && type == VIDEO_ENCODER && g.lookahead > 0) {
+        params.Add("lookahead", g.lookahead/2);
+    } else if (step == 3 && type == VIDEO_DECODER && !g.loadShedding) {
+        params.Add("loadShedding", true);
+    } else if (step == 4 && type == VIDEO_MIXER && g.fps > 1) {
+        params.Add("fps", g.fps/2);
+    } else {
+        return;
+    }
+
+    pushConfig(filter, params);
+}
+
+void LoadGovernor::restore(BaseFilter *filter, Governed &g, unsigned step)
+{
+    Jzon::Object params;
+    FilterType type = filter->getType();
+
+    if (step == 1 && type == VIDEO_ENCODER && !g.preset.empty()) {
+        params.Add("preset", g.preset);
+    } else if (step == 2 && type == VIDEO_ENCODER && g.lookahead > 0) {
+        params.Add("lookahead", g.lookahead);
+    } else if (step == 3 && type == VIDEO_DECODER && !g.loadShedding) {
+        params.Add("loadShedding", false);
+    } else if (step == 4 && type == VIDEO_MIXER && g.fps > 1) {
+        params.Add("fps", g.fps);
+    } else {
+        return;
+    }
+
+    pushConfig(filter, params);
+}
+
+void LoadGovernor::pushConfig(BaseFilter *filter, Jzon::Object &params)
+{
+    Jzon::Object root;
+    root.Add("action", "configure");
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    filter->pushEvent(e);
+}
+
+std::string LoadGovernor::fasterPreset(std::string preset, unsigned steps)
+{
+    unsigned count = sizeof(presets)/sizeof(presets[0]);
+
+    for (unsigned i = 0; i < count; i++) {
+        if (preset == presets[i]) {
+            return presets[i > steps ? i - steps : 0];
+        }
+    }
+
+    //NOTE: unknown presets are left as they are
+    return preset;
+}
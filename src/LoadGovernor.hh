@@ -0,0 +1,130 @@
+/*
+ *  LoadGovernor.hh - Process wide quality degradation under overload
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _LOAD_GOVERNOR_HH
+#define _LOAD_GOVERNOR_HH
+
+#include <map>
+#include <string>
+#include <chrono>
+
+#include "Filter.hh"
+#include "Jzon.h"
+
+#define GOVERNOR_LEVELS 4                   /*!< Steps of the degradation ladder */
+#define GOVERNOR_HIGH_LOAD 0.9              /*!< Workers utilisation from which the node is overloaded */
+#define GOVERNOR_LOW_LOAD 0.7               /*!< Workers utilisation under which quality is restored */
+#define GOVERNOR_HIGH_RESIDENCY 300000      /*!< Queue residency in usec from which the node is overloaded */
+#define GOVERNOR_LOW_RESIDENCY 100000       /*!< Queue residency in usec under which quality is restored */
+#define GOVERNOR_PERIOD 1                   /*!< Seconds between checks */
+#define GOVERNOR_HOLD 3                     /*!< Checks a level is kept before stepping again */
+#define GOVERNOR_PRESET_STEPS 2             /*!< Presets faster the encoders go at the first level */
+
+/*! Degrades the quality of the whole pipeline step by step when the node saturates, instead of letting
+    every filter slow down and every queue overflow at once, and restores it once the load goes back.
+    The node is overloaded if the workers utilisation or the highest queue residency exceed their high
+    thresholds, and it is relieved when both are under their low ones. Each level adds a step of the
+    ladder through the filters configure events, undone in reverse order:
+    1. faster x264/x265 presets, 2. shorter rate control lookahead, 3. decoders load shedding, which
+    skips non reference frames, and 4. half output frame rate of the periodic mixers.
+    The configuration each filter had is saved when it is first degraded, and filters created while
+    degraded get the current level on next check.
+*/
+class LoadGovernor {
+
+public:
+    LoadGovernor();
+
+    /**
+     * Configures the governor. Once disabled, the filters get their configuration back on next govern call
+     * @param enabled true to govern the load
+     * @param highLoad workers utilisation from which the node is overloaded, between 0 and 1
+     * @param lowLoad workers utilisation under which quality is restored, lower than highLoad
+     * @param highResidency queue residency from which the node is overloaded
+     * @param lowResidency queue residency under which quality is restored, lower than highResidency
+     * @param period time between checks
+     * @param hold checks a level is kept before stepping again
+     * @return false if the thresholds are not valid
+     */
+    bool configure(bool enabled, float highLoad, float lowLoad, std::chrono::microseconds highResidency,
+                   std::chrono::microseconds lowResidency, std::chrono::seconds period, unsigned hold);
+
+    bool isEnabled() const {return enabled;};
+    std::chrono::seconds getPeriod() const {return period;};
+
+    /**
+     * Updates the degradation level with the load measured over the last period
+     * @param utilisation workers utilisation, between 0 and 1
+     * @param residency highest average queue residency
+     * @return true if the level has changed
+     */
+    bool update(float utilisation, std::chrono::microseconds residency);
+
+    /**
+     * @return current degradation level, 0 means full quality
+     */
+    unsigned getLevel() const {return level;};
+
+    /**
+     * Brings every filter to the current level, configuring them through their events. Filters no
+     * longer in the pipeline are forgotten. It has to be called from the control thread
+     * @param filters pipeline filters by id
+     */
+    void govern(const std::map<int, BaseFilter*> &filters);
+
+    void getState(Jzon::Object &node);
+
+private:
+    struct Governed {
+        unsigned level;
+        std::string preset;
+        int lookahead;
+        bool loadShedding;
+        int fps;
+    };
+
+    void save(BaseFilter *filter, Governed &g);
+    void degrade(BaseFilter *filter, Governed &g, unsigned step);
+    void restore(BaseFilter *filter, Governed &g, unsigned step);
+    void pushConfig(BaseFilter *filter, Jzon::Object &params);
+
+    static std::string fasterPreset(std::string preset, unsigned steps);
+
+    std::map<int, Governed> governed;
+    bool enabled;
+    float highLoad;
+    float lowLoad;
+    std::chrono::microseconds highResidency;
+    std::chrono::microseconds lowResidency;
+    std::chrono::seconds period;
+    unsigned hold;
+
+    unsigned level;
+    unsigned sinceChange;                   //!< Checks since the last level change
+    unsigned reliefChecks;                  //!< Consecutive checks the node has been relieved
+    float lastUtilisation;
+    std::chrono::microseconds lastResidency;
+    size_t degradations;
+    size_t restorations;
+};
+
+#endif
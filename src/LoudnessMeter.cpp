@@ -0,0 +1,295 @@
+/*
+ *  LoudnessMeter.cpp - EBU R128 loudness measurement
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "LoudnessMeter.hh"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#define SHELF_FREQUENCY 1681.974450955533
+#define SHELF_GAIN 3.999843853973347
+#define SHELF_Q 0.7071752369554196
+#define HIGH_PASS_FREQUENCY 38.13547087602444
+#define HIGH_PASS_Q 0.5003270373238773
+#define SURROUND_WEIGHT 1.41
+#define LFE_CHANNEL 3
+
+#define HISTOGRAM_BINS ((size_t) ((LOUDNESS_HISTOGRAM_MAX - LOUDNESS_ABSOLUTE_GATE)/LOUDNESS_HISTOGRAM_STEP))
+
+/**
+* Copies the planes of a span interleaved as lanes, lanes without channel are zeroed
+*/
+SIMD_KERNEL
+static void toLanes(float const* const* planes, unsigned channels, size_t offset, size_t n,
+                    float* __restrict__ lanes)
+{
+    memset(lanes, 0, n*LOUDNESS_LANES*sizeof(float));
+
+    for (unsigned c = 0; c < channels; c++) {
+        float const* __restrict__ plane = planes[c] + offset;
+        for (size_t i = 0; i < n; i++) {
+            lanes[i*LOUDNESS_LANES + c] = plane[i];
+        }
+    }
+}
+
+/**
+* Filters the lanes with the shelf and the high pass biquads (transposed direct form II) and adds the
+* squared output of each lane to its energy. Lanes are independent, so each step is a vector operation.
+*/
+SIMD_KERNEL
+static void kWeightLanes(float const* __restrict__ lanes, size_t n, float const* shelf, float const* highPass,
+                         float* __restrict__ state, float* __restrict__ energy)
+{
+    float s1[LOUDNESS_LANES], s2[LOUDNESS_LANES], h1[LOUDNESS_LANES], h2[LOUDNESS_LANES];
+    float e[LOUDNESS_LANES];
+    float x, y, z;
+
+    for (unsigned l = 0; l < LOUDNESS_LANES; l++) {
+        s1[l] = state[l];
+        s2[l] = state[LOUDNESS_LANES + l];
+        h1[l] = state[2*LOUDNESS_LANES + l];
+        h2[l] = state[3*LOUDNESS_LANES + l];
+        e[l] = 0;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        for (unsigned l = 0; l < LOUDNESS_LANES; l++) {
+            x = lanes[i*LOUDNESS_LANES + l];
+
+            y = shelf[0]*x + s1[l];
+            s1[l] = shelf[1]*x - shelf[3]*y + s2[l];
+            s2[l] = shelf[2]*x - shelf[4]*y;
+
+            z = highPass[0]*y + h1[l];
+            h1[l] = highPass[1]*y - highPass[3]*z + h2[l];
+            h2[l] = highPass[2]*y - highPass[4]*z;
+
+            e[l] += z*z;
+        }
+    }
+
+    for (unsigned l = 0; l < LOUDNESS_LANES; l++) {
+        state[l] = s1[l];
+        state[LOUDNESS_LANES + l] = s2[l];
+        state[2*LOUDNESS_LANES + l] = h1[l];
+        state[3*LOUDNESS_LANES + l] = h2[l];
+        energy[l] = e[l];
+    }
+}
+
+LoudnessMeter::LoudnessMeter() : channels(0), sampleRate(0), subBlockSamples(0), subBlockFill(0), gatingBlocks(0)
+{
+    memset(&k, 0, sizeof(k));
+    memset(weights, 0, sizeof(weights));
+    histogramEnergy.resize(HISTOGRAM_BINS, 0);
+    histogramBlocks.resize(HISTOGRAM_BINS, 0);
+    reset();
+}
+
+bool LoudnessMeter::configure(unsigned channels_, unsigned sampleRate_)
+{
+    double K, Vh, Vb, a0;
+
+    if (channels_ == 0 || channels_ > LOUDNESS_LANES || sampleRate_ < 8000) {
+        return false;
+    }
+
+    channels = channels_;
+    sampleRate = sampleRate_;
+    subBlockSamples = sampleRate/10;
+
+    //NOTE: BS.1770 gives the coefficients at 48 kHz, they are derived from the analog prototypes for any rate
+    K = tan(M_PI*SHELF_FREQUENCY/sampleRate);
+    Vh = pow(10.0, SHELF_GAIN/20.0);
+    Vb = pow(Vh, 0.4996667741545416);
+    a0 = 1.0 + K/SHELF_Q + K*K;
+    k.shelf[0] = (Vh + Vb*K/SHELF_Q + K*K)/a0;
+    k.shelf[1] = 2.0*(K*K - Vh)/a0;
+    k.shelf[2] = (Vh - Vb*K/SHELF_Q + K*K)/a0;
+    k.shelf[3] = 2.0*(K*K - 1.0)/a0;
+    k.shelf[4] = (1.0 - K/SHELF_Q + K*K)/a0;
+
+    K = tan(M_PI*HIGH_PASS_FREQUENCY/sampleRate);
+    a0 = 1.0 + K/HIGH_PASS_Q + K*K;
+    k.highPass[0] = 1.0;
+    k.highPass[1] = -2.0;
+    k.highPass[2] = 1.0;
+    k.highPass[3] = 2.0*(K*K - 1.0)/a0;
+    k.highPass[4] = (1.0 - K/HIGH_PASS_Q + K*K)/a0;
+
+    for (unsigned c = 0; c < LOUDNESS_LANES; c++) {
+        weights[c] = c < channels ? 1.0 : 0;
+    }
+
+    if (channels >= 6) {
+        weights[LFE_CHANNEL] = 0;
+        for (unsigned c = LFE_CHANNEL + 1; c < channels; c++) {
+            weights[c] = SURROUND_WEIGHT;
+        }
+    }
+
+    reset();
+    return true;
+}
+
+void LoudnessMeter::reset()
+{
+    memset(state, 0, sizeof(state));
+    memset(subBlockEnergy, 0, sizeof(subBlockEnergy));
+    subBlockFill = 0;
+    subBlocks.clear();
+    std::fill(histogramEnergy.begin(), histogramEnergy.end(), 0);
+    std::fill(histogramBlocks.begin(), histogramBlocks.end(), 0);
+    gatingBlocks = 0;
+}
+
+void LoudnessMeter::process(float const* const* planes, unsigned samples)
+{
+    float energy[LOUDNESS_LANES];
+    size_t offset = 0;
+    size_t n;
+
+    if (channels == 0) {
+        return;
+    }
+
+    while (offset < samples) {
+        n = std::min<size_t>(std::min<size_t>(samples - offset, LOUDNESS_BLOCK), subBlockSamples - subBlockFill);
+
+        toLanes(planes, channels, offset, n, lanes);
+        kWeightLanes(lanes, n, k.shelf, k.highPass, state, energy);
+
+        for (unsigned c = 0; c < channels; c++) {
+            subBlockEnergy[c] += energy[c];
+        }
+
+        offset += n;
+        subBlockFill += n;
+
+        if (subBlockFill == subBlockSamples) {
+            closeSubBlock();
+        }
+    }
+}
+
+void LoudnessMeter::closeSubBlock()
+{
+    double weighted = 0;
+    double block;
+    double lufs;
+    size_t bin;
+
+    for (unsigned c = 0; c < channels; c++) {
+        weighted += weights[c]*subBlockEnergy[c]/subBlockSamples;
+        subBlockEnergy[c] = 0;
+    }
+
+    subBlockFill = 0;
+    subBlocks.push_back(weighted);
+
+    if (subBlocks.size() > LOUDNESS_SUBBLOCKS_SHORT_TERM) {
+        subBlocks.pop_front();
+    }
+
+    //NOTE: gating blocks are 400 ms long and overlap by 75%, one ends with each sub-block
+    if (subBlocks.size() < LOUDNESS_SUBBLOCKS_MOMENTARY) {
+        return;
+    }
+
+    block = meanEnergy(LOUDNESS_SUBBLOCKS_MOMENTARY);
+    lufs = toLufs(block);
+
+    if (lufs <= LOUDNESS_ABSOLUTE_GATE) {
+        return;
+    }
+
+    bin = std::min(HISTOGRAM_BINS - 1, (size_t) ((lufs - LOUDNESS_ABSOLUTE_GATE)/LOUDNESS_HISTOGRAM_STEP));
+    histogramEnergy[bin] += block;
+    histogramBlocks[bin]++;
+    gatingBlocks++;
+}
+
+double LoudnessMeter::meanEnergy(unsigned count) const
+{
+    double sum = 0;
+    size_t n = std::min<size_t>(count, subBlocks.size());
+
+    if (n == 0) {
+        return 0;
+    }
+
+    for (size_t i = subBlocks.size() - n; i < subBlocks.size(); i++) {
+        sum += subBlocks[i];
+    }
+
+    return sum/n;
+}
+
+double LoudnessMeter::getMomentary() const
+{
+    return toLufs(meanEnergy(LOUDNESS_SUBBLOCKS_MOMENTARY));
+}
+
+double LoudnessMeter::getShortTerm() const
+{
+    return toLufs(meanEnergy(LOUDNESS_SUBBLOCKS_SHORT_TERM));
+}
+
+double LoudnessMeter::getIntegrated() const
+{
+    double sum = 0;
+    double threshold;
+    size_t blocks = 0;
+    size_t first;
+
+    if (gatingBlocks == 0) {
+        return LOUDNESS_SILENCE;
+    }
+
+    for (size_t i = 0; i < HISTOGRAM_BINS; i++) {
+        sum += histogramEnergy[i];
+    }
+
+    //NOTE: the relative gate is rounded down to a bin, blocks are told apart with the bin resolution
+    threshold = toLufs(sum/gatingBlocks) + LOUDNESS_RELATIVE_GATE;
+    first = threshold <= LOUDNESS_ABSOLUTE_GATE ? 0 :
+            std::min(HISTOGRAM_BINS - 1, (size_t) ((threshold - LOUDNESS_ABSOLUTE_GATE)/LOUDNESS_HISTOGRAM_STEP));
+
+    sum = 0;
+    for (size_t i = first; i < HISTOGRAM_BINS; i++) {
+        sum += histogramEnergy[i];
+        blocks += histogramBlocks[i];
+    }
+
+    return blocks > 0 ? toLufs(sum/blocks) : LOUDNESS_SILENCE;
+}
+
+double LoudnessMeter::toLufs(double energy)
+{
+    if (energy <= 0) {
+        return LOUDNESS_SILENCE;
+    }
+
+    return std::max(LOUDNESS_SILENCE, -0.691 + 10.0*log10(energy));
+}
@@ -0,0 +1,132 @@
+/*
+ *  LoudnessMeter.hh - EBU R128 loudness measurement
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _LOUDNESS_METER_HH
+#define _LOUDNESS_METER_HH
+
+#include <vector>
+#include <deque>
+#include <cstddef>
+
+#include "SampleConverter.hh"
+#include "AudioFrame.hh"
+
+#define LOUDNESS_LANES MAX_CHANNELS         //!< Channels filtered at once, 8 floats fill an AVX2 register
+#define LOUDNESS_BLOCK 256                  //!< Samples per channel filtered by each kernel call
+#define LOUDNESS_SUBBLOCKS_MOMENTARY 4      //!< 100 ms sub-blocks of the momentary window (400 ms)
+#define LOUDNESS_SUBBLOCKS_SHORT_TERM 30    //!< 100 ms sub-blocks of the short-term window (3 s)
+#define LOUDNESS_ABSOLUTE_GATE -70.0        //!< LUFS under which gating blocks are ignored
+#define LOUDNESS_RELATIVE_GATE -10.0        //!< LU under the ungated loudness under which gating blocks are ignored
+#define LOUDNESS_HISTOGRAM_MAX 5.0          //!< LUFS of the loudest gating block kept apart
+#define LOUDNESS_HISTOGRAM_STEP 0.1         //!< LU of each histogram bin
+#define LOUDNESS_SILENCE -144.0             //!< Loudness reported without any energy
+
+/*! Loudness meter of ITU-R BS.1770 / EBU R128: momentary (400 ms), short-term (3 s) and gated integrated
+    loudness of planar float samples. The channels are K-weighted (high shelf and high pass biquads) in
+    lockstep, one lane each, so the recursive filters are vectorised across channels. Energies are
+    summed in 100 ms sub-blocks, which are the steps of the overlapping gating blocks. The gating blocks
+    are kept in a histogram of LOUDNESS_HISTOGRAM_STEP bins, so the integrated loudness of streams of any
+    duration uses a fixed amount of memory. Channel weights follow the usual layouts: with 6 or more
+    channels the fourth one is the LFE, which is not measured, and the following ones are surrounds.
+*/
+class LoudnessMeter {
+
+public:
+    LoudnessMeter();
+
+    /**
+    * Sets the stream parameters and resets the measurements
+    * @param channels number of channels, up to LOUDNESS_LANES
+    * @param sampleRate sample rate in Hz
+    * @return false if the parameters are not supported
+    */
+    bool configure(unsigned channels, unsigned sampleRate);
+
+    /**
+    * Measures a span of samples
+    * @param planes one float plane per channel
+    * @param samples number of samples per channel
+    */
+    void process(float const* const* planes, unsigned samples);
+
+    /**
+    * Drops the measurements, keeping the configuration
+    */
+    void reset();
+
+    /**
+    * @return loudness of the last 400 ms in LUFS, of the samples measured if there are less
+    */
+    double getMomentary() const;
+
+    /**
+    * @return loudness of the last 3 s in LUFS, of the samples measured if there are less
+    */
+    double getShortTerm() const;
+
+    /**
+    * @return gated loudness since the last reset in LUFS, LOUDNESS_SILENCE if no block passes the gates
+    */
+    double getIntegrated() const;
+
+    /**
+    * @return gating blocks over the absolute gate
+    */
+    size_t getGatingBlocks() const {return gatingBlocks;};
+
+    unsigned getChannels() const {return channels;};
+    unsigned getSampleRate() const {return sampleRate;};
+
+    /**
+    * @param energy mean square of the weighted samples
+    * @return loudness in LUFS
+    */
+    static double toLufs(double energy);
+
+private:
+    //NOTE: coefficients of both biquads, b0 b1 b2 a1 a2 each
+    struct KWeighting {
+        float shelf[5];
+        float highPass[5];
+    };
+
+    void closeSubBlock();
+    double meanEnergy(unsigned subBlocks) const;
+
+    unsigned channels;
+    unsigned sampleRate;
+    unsigned subBlockSamples;
+    unsigned subBlockFill;
+
+    KWeighting k;
+    float state[4*LOUDNESS_LANES];          //!< Filters state, two values per biquad and lane
+    float weights[LOUDNESS_LANES];
+    float lanes[LOUDNESS_LANES*LOUDNESS_BLOCK];
+    double subBlockEnergy[LOUDNESS_LANES];
+
+    std::deque<double> subBlocks;           //!< Weighted energy of the last sub-blocks, newest last
+    std::vector<double> histogramEnergy;    //!< Summed energy of the gating blocks of each bin
+    std::vector<size_t> histogramBlocks;
+    size_t gatingBlocks;
+};
+
+#endif
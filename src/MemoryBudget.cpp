@@ -0,0 +1,120 @@
+/*
+ *  MemoryBudget.cpp - Process wide memory accounting and budget
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "MemoryBudget.hh"
+
+#include <algorithm>
+#include <limits>
+
+MemoryBudget* MemoryBudget::getInstance()
+{
+    static MemoryBudget instance;
+
+    return &instance;
+}
+
+MemoryBudget::MemoryBudget() : budget(0), charged(0)
+{
+}
+
+void MemoryBudget::setBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    budget = bytes;
+}
+
+size_t MemoryBudget::getBudget()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return budget;
+}
+
+void MemoryBudget::charge(int filterId, int writerId, size_t bytes)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    queues[std::make_pair(filterId, writerId)] += bytes;
+    charged += bytes;
+}
+
+void MemoryBudget::discharge(int filterId, int writerId, size_t bytes)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    auto it = queues.find(std::make_pair(filterId, writerId));
+    if (it == queues.end()) {
+        return;
+    }
+
+    bytes = std::min(bytes, it->second);
+    it->second -= bytes;
+    charged -= bytes;
+
+    if (it->second == 0) {
+        queues.erase(it);
+    }
+}
+
+size_t MemoryBudget::getQueueBytes(int filterId, int writerId)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    auto it = queues.find(std::make_pair(filterId, writerId));
+
+    return it == queues.end() ? 0 : it->second;
+}
+
+size_t MemoryBudget::getFilterBytes(int filterId)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    size_t bytes = 0;
+
+    //NOTE: keys are sorted by filter, so its writers are contiguous
+    for (auto it = queues.lower_bound(std::make_pair(filterId, std::numeric_limits<int>::min()));
+         it != queues.end() && it->first.first == filterId; ++it) {
+        bytes += it->second;
+    }
+
+    return bytes;
+}
+
+size_t MemoryBudget::getQueuesBytes()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return charged;
+}
+
+bool MemoryBudget::fits(size_t requested, size_t external)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    return budget == 0 || charged + external + requested <= budget;
+}
+
+void MemoryBudget::getState(Jzon::Object &node)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    node.Add("memoryBudget", (double) budget);
+    node.Add("queuesBytes", (double) charged);
+    node.Add("chargedQueues", (int) queues.size());
+}
@@ -0,0 +1,112 @@
+/*
+ *  MemoryBudget.hh - Process wide memory accounting and budget
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _MEMORY_BUDGET_HH
+#define _MEMORY_BUDGET_HH
+
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "Jzon.h"
+
+#define MEMORY_FILTER_RESERVE (16*1024*1024)    /*!< Bytes a new filter is expected to hold (codec contexts, segment buffers...) */
+#define MEMORY_QUEUE_RESERVE (32*1024*1024)     /*!< Bytes a new queue without bytes budget is expected to hold */
+
+/*! Process wide accounting of the memory held by the queues, by default without any limit.
+    Queues charge the bytes of the frames they allocate to the filter and writer that feed them,
+    so the bytes of a filter are the ones of its output queues and the bytes of a path the ones
+    of the queues along it. Memory held out of the queues (filters internals, idle pooled frames)
+    is not charged, it is given when checking the budget. With a budget set, new filters and paths
+    are refused if the memory they are expected to hold does not fit in it.
+*/
+class MemoryBudget {
+
+public:
+    /**
+     * Gets the MemoryBudget instance, it is created the first time it is requested
+     * @return the process wide budget
+     */
+    static MemoryBudget* getInstance();
+
+    /**
+     * Sets the total bytes the process may hold
+     * @param bytes total bytes, 0 for no limit
+     */
+    void setBudget(size_t bytes);
+
+    /**
+     * @return total bytes the process may hold, 0 if there is no limit
+     */
+    size_t getBudget();
+
+    /**
+     * Accounts bytes allocated by a queue
+     * @param filterId filter writing to the queue
+     * @param writerId writer of the filter
+     * @param bytes allocated bytes
+     */
+    void charge(int filterId, int writerId, size_t bytes);
+
+    /**
+     * Accounts bytes released by a queue
+     * @param filterId filter writing to the queue
+     * @param writerId writer of the filter
+     * @param bytes released bytes, at most the ones charged
+     */
+    void discharge(int filterId, int writerId, size_t bytes);
+
+    /**
+     * @return bytes held by the queue fed by the filter writer
+     */
+    size_t getQueueBytes(int filterId, int writerId);
+
+    /**
+     * @return bytes held by the output queues of the filter
+     */
+    size_t getFilterBytes(int filterId);
+
+    /**
+     * @return bytes held by all the queues
+     */
+    size_t getQueuesBytes();
+
+    /**
+     * Checks if new memory fits in the budget
+     * @param requested bytes expected to be allocated
+     * @param external bytes held out of the queues
+     * @return true if there is no budget or the charged, external and requested bytes do not exceed it
+     */
+    bool fits(size_t requested, size_t external);
+
+    void getState(Jzon::Object &node);
+
+private:
+    MemoryBudget();
+
+    std::map<std::pair<int, int>, size_t> queues;
+    std::mutex mtx;
+    size_t budget;
+    size_t charged;
+};
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ *  MetricsExporter.cpp - Prometheus metrics exposition over HTTP
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "MetricsExporter.hh"
+#include "modules/dasher/DashHttpOrigin.hh"
+
+#include <cmath>
+#include <cctype>
+#include <cstdio>
+
+MetricsExporter::MetricsExporter() : origin(NULL)
+{
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    stop();
+}
+
+bool MetricsExporter::start(unsigned port)
+{
+    stop();
+    origin = new DashHttpOrigin();
+
+    if (!origin->start(port)) {
+        delete origin;
+        origin = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void MetricsExporter::stop()
+{
+    if (origin) {
+        delete origin;
+        origin = NULL;
+    }
+}
+
+unsigned MetricsExporter::getPort()
+{
+    return origin ? origin->getPort() : 0;
+}
+
+void MetricsExporter::add(std::string name, std::string type, std::string help, const MetricLabels &labels, double value)
+{
+    Family family;
+    size_t index;
+
+    name = METRICS_PREFIX + name;
+
+    if (familyIndex.count(name) == 0) {
+        family.name = name;
+        family.type = type;
+        family.help = help;
+        familyIndex[name] = families.size();
+        families.push_back(family);
+    }
+
+    index = familyIndex[name];
+    families[index].samples += name + formatLabels(labels) + " " + formatValue(value) + "\n";
+}
+
+void MetricsExporter::addState(std::string name, const Jzon::Node &node, const MetricLabels &labels)
+{
+    MetricLabels elementLabels;
+    unsigned i = 0;
+
+    if (node.IsArray()) {
+        for (auto it = node.AsArray().begin(); it != node.AsArray().end(); ++it, ++i) {
+            if (!(*it).IsObject()) {
+                continue;
+            }
+
+            //NOTE: elements are told apart by their position and by their string values
+            elementLabels = labels;
+            elementLabels[toMetricName(name.substr(name.find_last_of('_') + 1))] = std::to_string(i);
+
+            for (auto child : (*it).AsObject()) {
+                if (child.second.IsString()) {
+                    elementLabels[toMetricName(child.first)] = child.second.ToString();
+                }
+            }
+
+            addState(name, *it, elementLabels);
+        }
+        return;
+    }
+
+    if (!node.IsObject()) {
+        return;
+    }
+
+    for (auto child : node.AsObject()) {
+        if (child.second.IsNumber()) {
+            add(name + "_" + toMetricName(child.first), "gauge", "", labels, child.second.ToDouble());
+        } else if (child.second.IsBool()) {
+            add(name + "_" + toMetricName(child.first), "gauge", "", labels, child.second.ToBool() ? 1 : 0);
+        } else if (child.second.IsObject() || child.second.IsArray()) {
+            addState(name + "_" + toMetricName(child.first), child.second, labels);
+        }
+    }
+}
+
+std::string MetricsExporter::getText() const
+{
+    std::string text;
+
+    for (auto &f : families) {
+        if (!f.help.empty()) {
+            text += "# HELP " + f.name + " " + f.help + "\n";
+        }
+        text += "# TYPE " + f.name + " " + f.type + "\n";
+        text += f.samples;
+    }
+
+    return text;
+}
+
+void MetricsExporter::publish()
+{
+    if (origin) {
+        origin->publish(METRICS_RESOURCE, getText());
+    }
+
+    families.clear();
+    familyIndex.clear();
+}
+
+std::string MetricsExporter::toMetricName(std::string key)
+{
+    std::string name;
+
+    for (size_t i = 0; i < key.size(); i++) {
+        if (isupper((unsigned char) key[i])) {
+            //NOTE: acronyms are kept together, i.e. SSRC is ssrc and avgBitrateInKbps is avg_bitrate_in_kbps
+            if (i > 0 && (islower((unsigned char) key[i - 1]) ||
+                (i + 1 < key.size() && islower((unsigned char) key[i + 1]) && isupper((unsigned char) key[i - 1])))) {
+                name += '_';
+            }
+            name += tolower((unsigned char) key[i]);
+        } else if (isalnum((unsigned char) key[i])) {
+            name += key[i];
+        } else {
+            name += '_';
+        }
+    }
+
+    if (!name.empty() && isdigit((unsigned char) name[0])) {
+        name = "_" + name;
+    }
+
+    return name;
+}
+
+std::string MetricsExporter::formatLabels(const MetricLabels &labels)
+{
+    std::string text;
+
+    if (labels.empty()) {
+        return text;
+    }
+
+    for (auto &l : labels) {
+        text += text.empty() ? "{" : ",";
+        text += l.first + "=\"";
+
+        for (char c : l.second) {
+            if (c == '\\' || c == '"') {
+                text += '\\';
+                text += c;
+            } else if (c == '\n') {
+                text += "\\n";
+            } else {
+                text += c;
+            }
+        }
+
+        text += "\"";
+    }
+
+    return text + "}";
+}
+
+std::string MetricsExporter::formatValue(double value)
+{
+    char text[32];
+
+    if (std::isnan(value)) {
+        return "NaN";
+    }
+
+    if (std::isinf(value)) {
+        return value > 0 ? "+Inf" : "-Inf";
+    }
+
+    snprintf(text, sizeof(text), "%.15g", value);
+    return std::string(text);
+}
@@ -0,0 +1,128 @@
+/*
+ *  MetricsExporter.hh - Prometheus metrics exposition over HTTP
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _METRICS_EXPORTER_HH
+#define _METRICS_EXPORTER_HH
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Jzon.h"
+
+#define METRICS_PREFIX "lms_"               //!< Prefix of all the exported metric names
+#define METRICS_RESOURCE "metrics"          //!< Exposition resource, served at /metrics
+#define METRICS_DEFAULT_PERIOD 5            //!< Default seconds between exposition updates
+
+class DashHttpOrigin;
+
+typedef std::map<std::string, std::string> MetricLabels;
+
+/*! Builds a Prometheus text exposition (format 0.0.4) and serves it at /metrics from an embedded
+    DashHttpOrigin. Samples are grouped by metric family as they are added, so families can be filled
+    in any order. Filter states can be added as they are, their numeric and boolean values are exported
+    as gauges named after their keys in snake case, and the string values of array elements become
+    labels of the values below them (e.g. the SSRC of a RTCP report). The exposition is published as
+    a whole, so scrapes never see a half built one and do not interfere with the pipeline.
+*/
+class MetricsExporter {
+
+public:
+    /**
+    * Class constructor
+    */
+    MetricsExporter();
+
+    /**
+    * Class destructor, the server is stopped
+    */
+    ~MetricsExporter();
+
+    /**
+    * Starts serving the published exposition
+    * @param port TCP port, 0 picks a free one
+    * @return false if the server cannot be started
+    */
+    bool start(unsigned port);
+
+    /**
+    * Stops serving the exposition
+    */
+    void stop();
+
+    /**
+    * @return listening port, 0 if not started
+    */
+    unsigned getPort();
+
+    /**
+    * Adds a sample to the exposition being built
+    * @param name metric name without METRICS_PREFIX, i.e. filter_frames_total
+    * @param type metric type, counter or gauge
+    * @param help family description, only the first one of each family is used
+    * @param labels sample labels
+    * @param value sample value
+    */
+    void add(std::string name, std::string type, std::string help, const MetricLabels &labels, double value);
+
+    /**
+    * Adds the numeric values of a state node as gauges, nested keys are joined with underscores
+    * @param name metric name prefix without METRICS_PREFIX, i.e. filter
+    * @param node state node, an object or an array of objects
+    * @param labels labels of all the samples
+    */
+    void addState(std::string name, const Jzon::Node &node, const MetricLabels &labels);
+
+    /**
+    * @return exposition built since the previous publish
+    */
+    std::string getText() const;
+
+    /**
+    * Serves the exposition built so far and starts building a new one
+    */
+    void publish();
+
+    /**
+    * Converts camel case to snake case and replaces characters not allowed in metric names
+    * @param key state key
+    * @return valid metric name fragment
+    */
+    static std::string toMetricName(std::string key);
+
+private:
+    struct Family {
+        std::string name;
+        std::string type;
+        std::string help;
+        std::string samples;
+    };
+
+    static std::string formatLabels(const MetricLabels &labels);
+    static std::string formatValue(double value);
+
+    std::vector<Family> families;
+    std::map<std::string, size_t> familyIndex;
+    DashHttpOrigin *origin;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ *  NalSplitter.cpp - Annex B NAL units splitter
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <cstddef>
+
+#include "NalSplitter.hh"
+
+NalSplitter::NalSplitter(unsigned char const* data, unsigned size) : end(data + size), nextLength(0)
+{
+    nextStart = findStartCode(data, end, nextLength);
+}
+
+bool NalSplitter::next(NalSpan &nal)
+{
+    unsigned char const* nalData;
+
+    if (!nextStart) {
+        return false;
+    }
+
+    nalData = nextStart + nextLength;
+    nal.data = nalData;
+    nal.startCodeLength = nextLength;
+
+    nextStart = findStartCode(nalData, end, nextLength);
+    nal.size = (nextStart ? nextStart : end) - nalData;
+
+    return true;
+}
+
+unsigned char const* NalSplitter::findStartCode(unsigned char const* data, unsigned char const* end, unsigned &length)
+{
+    unsigned char const* one;
+    unsigned char const* ptr;
+
+    if (!data || end - data < SHORT_START_CODE_LENGTH) {
+        return NULL;
+    }
+
+    ptr = data + SHORT_START_CODE_LENGTH - 1;
+
+    //NOTE: 0x01 bytes are rare in coded payloads, so each memchr call usually skips a long run of bytes
+    while (ptr < end && (one = (unsigned char const*) memchr(ptr, 0x01, end - ptr))) {
+        if (one[-1] == 0x00 && one[-2] == 0x00) {
+            if (one - data >= LONG_START_CODE_LENGTH - 1 && one[-3] == 0x00) {
+                length = LONG_START_CODE_LENGTH;
+                return one - 3;
+            }
+
+            length = SHORT_START_CODE_LENGTH;
+            return one - 2;
+        }
+
+        //NOTE: a 0x01 byte can not be any of the zero bytes of the next start code
+        ptr = one + SHORT_START_CODE_LENGTH;
+    }
+
+    return NULL;
+}
+
+unsigned NalSplitter::startCodeLength(unsigned char const* data, unsigned size)
+{
+    if (!data || size < SHORT_START_CODE_LENGTH || data[0] != 0x00 || data[1] != 0x00) {
+        return 0;
+    }
+
+    if (data[2] == 0x01) {
+        return SHORT_START_CODE_LENGTH;
+    }
+
+    if (size >= LONG_START_CODE_LENGTH && data[2] == 0x00 && data[3] == 0x01) {
+        return LONG_START_CODE_LENGTH;
+    }
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ *  NalSplitter.hh - Annex B NAL units splitter
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _NAL_SPLITTER_HH
+#define _NAL_SPLITTER_HH
+
+#define SHORT_START_CODE_LENGTH 3       //!< 0x000001
+#define LONG_START_CODE_LENGTH 4        //!< 0x00000001
+
+/*! NAL unit of an Annex B byte stream, without its start code */
+struct NalSpan {
+    unsigned char const* data;
+    unsigned size;
+    unsigned startCodeLength;
+};
+
+/*! Splits H264 and H265 Annex B byte streams into NAL units. Start codes are located looking for
+    their 0x01 byte with memchr, which is vectorised by the C library and skips most of the payload
+    bytes at once, and then checking for the zero bytes before it. Data before the first start code
+    is skipped. It does not copy nor own the data, which must outlive the splitter and its spans.
+*/
+class NalSplitter {
+
+public:
+    /**
+    * Class constructor
+    * @param data byte stream to split
+    * @param size byte stream length in bytes
+    */
+    NalSplitter(unsigned char const* data, unsigned size);
+
+    /**
+    * Gets the next NAL unit of the byte stream
+    * @param nal filled with the NAL unit data, length and start code length
+    * @return false if there are no more NAL units
+    */
+    bool next(NalSpan &nal);
+
+    /**
+    * Looks for the first start code of a buffer
+    * @param data pointer to the first byte to check
+    * @param end pointer past the last byte to check
+    * @param length filled with the start code length if it is found
+    * @return pointer to the first byte of the start code or NULL if there is none
+    */
+    static unsigned char const* findStartCode(unsigned char const* data, unsigned char const* end, unsigned &length);
+
+    /**
+    * @param data pointer to the buffer
+    * @param size buffer length in bytes
+    * @return length of the start code at the beginning of the buffer, 0 if it does not start with one
+    */
+    static unsigned startCodeLength(unsigned char const* data, unsigned size);
+
+private:
+    unsigned char const* nextStart;
+    unsigned char const* end;
+    unsigned nextLength;
+};
+
+#endif
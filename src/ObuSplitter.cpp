@@ -0,0 +1,353 @@
+/*
+ *  ObuSplitter.cpp - AV1 low overhead bitstream parsing
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstdio>
+
+#include "ObuSplitter.hh"
+
+#define AV1C_MARKER_VERSION 0x81
+#define CP_BT_709 1
+#define TC_SRGB 13
+#define MC_IDENTITY 0
+#define KEY_FRAME 0
+
+/*! MSB first bit reader over a buffer, reading past its end sets the overrun flag */
+class BitReader {
+
+public:
+    BitReader(unsigned char const* data, unsigned size) : data(data), size(size), pos(0), overrun(false) {};
+
+    uint32_t read(unsigned bits)
+    {
+        uint32_t value = 0;
+
+        for (unsigned i = 0; i < bits; i++) {
+            if (pos >= size*8) {
+                overrun = true;
+                return 0;
+            }
+
+            value = (value << 1) | ((data[pos/8] >> (7 - pos%8)) & 0x01);
+            pos++;
+        }
+
+        return value;
+    };
+
+    bool flag() {return read(1) == 1;};
+
+    uint32_t uvlc()
+    {
+        unsigned leadingZeros = 0;
+
+        while (!overrun && !flag()) {
+            leadingZeros++;
+        }
+
+        //NOTE: values of 32 leading zeros or more are reserved, they are returned saturated
+        if (leadingZeros >= 32) {
+            return UINT32_MAX;
+        }
+
+        return read(leadingZeros) + (uint32_t) ((1ULL << leadingZeros) - 1);
+    };
+
+    bool failed() const {return overrun;};
+
+private:
+    unsigned char const* data;
+    unsigned size;
+    unsigned pos;
+    bool overrun;
+};
+
+ObuSplitter::ObuSplitter(unsigned char const* data, unsigned size) : ptr(data), end(data + size), broken(false)
+{
+    if (!data) {
+        end = ptr;
+    }
+}
+
+bool ObuSplitter::next(ObuSpan &obu)
+{
+    unsigned headerSize;
+    unsigned fieldLength;
+    uint64_t payloadSize;
+
+    if (broken || ptr >= end) {
+        return false;
+    }
+
+    headerSize = (ptr[0] & OBU_EXTENSION_FLAG) ? 2 : 1;
+
+    if ((ptr[0] & 0x80) || (unsigned) (end - ptr) < headerSize) {
+        broken = true;
+        return false;
+    }
+
+    if (ptr[0] & OBU_HAS_SIZE_FLAG) {
+        fieldLength = readLeb128(ptr + headerSize, end - ptr - headerSize, payloadSize);
+
+        if (fieldLength == 0 || payloadSize > (uint64_t) (end - ptr - headerSize - fieldLength)) {
+            broken = true;
+            return false;
+        }
+
+        headerSize += fieldLength;
+    } else {
+        payloadSize = end - ptr - headerSize;
+    }
+
+    obu.data = ptr;
+    obu.headerSize = headerSize;
+    obu.size = headerSize + payloadSize;
+    obu.type = (ptr[0] >> 3) & 0x0F;
+
+    ptr += obu.size;
+    return true;
+}
+
+unsigned ObuSplitter::readLeb128(unsigned char const* data, unsigned size, uint64_t &value)
+{
+    value = 0;
+
+    for (unsigned i = 0; i < LEB128_MAX_SIZE && i < size; i++) {
+        value |= ((uint64_t) (data[i] & 0x7F)) << (i*7);
+
+        if (!(data[i] & 0x80)) {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+unsigned ObuSplitter::writeLeb128(uint64_t value, unsigned char* out)
+{
+    unsigned length = 0;
+
+    do {
+        out[length] = value & 0x7F;
+        value >>= 7;
+
+        if (value) {
+            out[length] |= 0x80;
+        }
+
+        length++;
+    } while (value && length < LEB128_MAX_SIZE);
+
+    return length;
+}
+
+bool ObuSplitter::isKeyFrame(unsigned char const* payload, unsigned size, bool reducedStillPictureHeader)
+{
+    BitReader bits(payload, size);
+
+    if (reducedStillPictureHeader) {
+        return true;
+    }
+
+    //NOTE: show_existing_frame only outputs an already decoded frame, it does not start a new one
+    if (bits.flag()) {
+        return false;
+    }
+
+    return bits.read(2) == KEY_FRAME && !bits.failed();
+}
+
+bool Av1SequenceHeader::parse(unsigned char const* payload, unsigned size)
+{
+    BitReader bits(payload, size);
+    bool timingInfo = false;
+    bool decoderModelInfo = false;
+    bool initialDisplayDelay = false;
+    bool orderHint = false;
+    bool highBitdepth;
+    bool twelveBit = false;
+    bool colorDescription;
+    unsigned bufferDelayLength = 0;
+    unsigned operatingPoints;
+    unsigned widthBits;
+    unsigned heightBits;
+    unsigned forceScreenContentTools;
+    unsigned primaries = 0;
+    unsigned transfer = 0;
+    unsigned matrix = 0;
+
+    profile = bits.read(3);
+    bits.read(1);   // still_picture
+    reducedStillPictureHeader = bits.flag();
+
+    if (reducedStillPictureHeader) {
+        level = bits.read(5);
+        tier = 0;
+    } else {
+        timingInfo = bits.flag();
+
+        if (timingInfo) {
+            bits.read(32);  // num_units_in_display_tick
+            bits.read(32);  // time_scale
+            if (bits.flag()) {
+                bits.uvlc();    // num_ticks_per_picture_minus_1
+            }
+
+            decoderModelInfo = bits.flag();
+            if (decoderModelInfo) {
+                bufferDelayLength = bits.read(5) + 1;
+                bits.read(32);  // num_units_in_decoding_tick
+                bits.read(5);   // buffer_removal_time_length_minus_1
+                bits.read(5);   // frame_presentation_time_length_minus_1
+            }
+        }
+
+        initialDisplayDelay = bits.flag();
+        operatingPoints = bits.read(5) + 1;
+
+        for (unsigned i = 0; i < operatingPoints; i++) {
+            unsigned opLevel;
+            unsigned opTier = 0;
+
+            bits.read(12);  // operating_point_idc
+            opLevel = bits.read(5);
+            if (opLevel > 7) {
+                opTier = bits.read(1);
+            }
+
+            if (decoderModelInfo && bits.flag()) {
+                bits.read(bufferDelayLength);   // decoder_buffer_delay
+                bits.read(bufferDelayLength);   // encoder_buffer_delay
+                bits.read(1);                   // low_delay_mode_flag
+            }
+
+            if (initialDisplayDelay && bits.flag()) {
+                bits.read(4);
+            }
+
+            if (i == 0) {
+                level = opLevel;
+                tier = opTier;
+            }
+        }
+    }
+
+    widthBits = bits.read(4) + 1;
+    heightBits = bits.read(4) + 1;
+    maxWidth = bits.read(widthBits) + 1;
+    maxHeight = bits.read(heightBits) + 1;
+
+    if (!reducedStillPictureHeader && bits.flag()) {
+        bits.read(4);   // delta_frame_id_length_minus_2
+        bits.read(3);   // additional_frame_id_length_minus_1
+    }
+
+    bits.read(3);   // use_128x128_superblock, enable_filter_intra, enable_intra_edge_filter
+
+    if (!reducedStillPictureHeader) {
+        bits.read(4);   // enable_interintra_compound, enable_masked_compound, enable_warped_motion, enable_dual_filter
+        orderHint = bits.flag();
+        if (orderHint) {
+            bits.read(2);   // enable_jnt_comp, enable_ref_frame_mvs
+        }
+
+        forceScreenContentTools = bits.flag() ? 2 : bits.read(1);
+        if (forceScreenContentTools > 0 && !bits.flag()) {
+            bits.read(1);   // seq_force_integer_mv
+        }
+
+        if (orderHint) {
+            bits.read(3);   // order_hint_bits_minus_1
+        }
+    }
+
+    bits.read(3);   // enable_superres, enable_cdef, enable_restoration
+
+    highBitdepth = bits.flag();
+    if (profile == 2 && highBitdepth) {
+        twelveBit = bits.flag();
+    }
+
+    bitDepth = twelveBit ? 12 : (highBitdepth ? 10 : 8);
+    monochrome = profile == 1 ? false : bits.flag();
+
+    colorDescription = bits.flag();
+    if (colorDescription) {
+        primaries = bits.read(8);
+        transfer = bits.read(8);
+        matrix = bits.read(8);
+    }
+
+    chromaSamplePosition = 0;
+
+    if (monochrome) {
+        subsamplingX = true;
+        subsamplingY = true;
+    } else if (colorDescription && primaries == CP_BT_709 && transfer == TC_SRGB && matrix == MC_IDENTITY) {
+        subsamplingX = false;
+        subsamplingY = false;
+    } else {
+        bits.read(1);   // color_range
+
+        if (profile == 0) {
+            subsamplingX = true;
+            subsamplingY = true;
+        } else if (profile == 1) {
+            subsamplingX = false;
+            subsamplingY = false;
+        } else if (bitDepth == 12) {
+            subsamplingX = bits.flag();
+            subsamplingY = subsamplingX ? bits.flag() : false;
+        } else {
+            subsamplingX = true;
+            subsamplingY = false;
+        }
+
+        if (subsamplingX && subsamplingY) {
+            chromaSamplePosition = bits.read(2);
+        }
+    }
+
+    return !bits.failed() && profile <= 2;
+}
+
+std::vector<unsigned char> Av1SequenceHeader::configRecord(unsigned char const* obu, unsigned size) const
+{
+    std::vector<unsigned char> record;
+
+    record.push_back(AV1C_MARKER_VERSION);
+    record.push_back((profile << 5) | (level & 0x1F));
+    record.push_back((tier << 7) | ((bitDepth > 8) << 6) | ((bitDepth == 12) << 5) | (monochrome << 4) |
+                     (subsamplingX << 3) | (subsamplingY << 2) | (chromaSamplePosition & 0x03));
+    //NOTE: initial_presentation_delay_present is 0
+    record.push_back(0);
+    record.insert(record.end(), obu, obu + size);
+
+    return record;
+}
+
+std::string Av1SequenceHeader::codecString() const
+{
+    char codec[32];
+
+    snprintf(codec, sizeof(codec), "av01.%u.%02u%c.%02u", profile, level, tier ? 'H' : 'M', bitDepth);
+    return std::string(codec);
+}
@@ -0,0 +1,140 @@
+/*
+ *  ObuSplitter.hh - AV1 low overhead bitstream parsing
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _OBU_SPLITTER_HH
+#define _OBU_SPLITTER_HH
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define OBU_SEQUENCE_HEADER 1
+#define OBU_TEMPORAL_DELIMITER 2
+#define OBU_FRAME_HEADER 3
+#define OBU_TILE_GROUP 4
+#define OBU_METADATA 5
+#define OBU_FRAME 6
+#define OBU_PADDING 15
+
+#define OBU_EXTENSION_FLAG 0x04
+#define OBU_HAS_SIZE_FLAG 0x02
+#define LEB128_MAX_SIZE 8
+#define AV1C_HEADER_SIZE 4              //!< AV1CodecConfigurationRecord bytes before its configOBUs
+
+/*! OBU of an AV1 temporal unit */
+struct ObuSpan {
+    unsigned char const* data;          //!< First byte of the OBU header
+    unsigned size;                      //!< OBU length, header included
+    unsigned headerSize;                //!< OBU header, extension and size field length
+    unsigned char type;
+};
+
+/*! Fields of an AV1 sequence header needed to describe the stream in ISOBMFF and DASH */
+struct Av1SequenceHeader {
+    unsigned profile;
+    unsigned level;                     //!< seq_level_idx of the first operating point
+    unsigned tier;
+    unsigned bitDepth;
+    bool monochrome;
+    bool subsamplingX;
+    bool subsamplingY;
+    unsigned chromaSamplePosition;
+    bool reducedStillPictureHeader;
+    unsigned maxWidth;
+    unsigned maxHeight;
+
+    /**
+    * @param payload sequence header OBU payload, without the OBU header
+    * @param size payload length in bytes
+    * @return false if the payload is truncated or not supported
+    */
+    bool parse(unsigned char const* payload, unsigned size);
+
+    /**
+    * @param obu whole sequence header OBU, which becomes the configOBUs
+    * @param size OBU length in bytes
+    * @return AV1CodecConfigurationRecord (av1C box payload)
+    */
+    std::vector<unsigned char> configRecord(unsigned char const* obu, unsigned size) const;
+
+    /**
+    * @return codecs parameter as defined by the AV1 ISOBMFF binding, e.g. av01.0.08M.08
+    */
+    std::string codecString() const;
+};
+
+/*! Splits AV1 temporal units in low overhead bitstream format (OBUs with size field) into OBUs.
+    The last OBU may lack its size field, then it lasts until the end of the data. It does not copy
+    nor own the data, which must outlive the splitter and its spans.
+*/
+class ObuSplitter {
+
+public:
+    /**
+    * Class constructor
+    * @param data temporal unit to split
+    * @param size temporal unit length in bytes
+    */
+    ObuSplitter(unsigned char const* data, unsigned size);
+
+    /**
+    * Gets the next OBU of the temporal unit
+    * @param obu filled with the OBU data, length, header length and type
+    * @return false if there are no more OBUs or the next one is malformed, see isBroken
+    */
+    bool next(ObuSpan &obu);
+
+    /**
+    * @return true if splitting stopped at a malformed OBU
+    */
+    bool isBroken() const {return broken;};
+
+    /**
+    * @param data pointer to the first byte of the leb128 value
+    * @param size available bytes
+    * @param value filled with the decoded value
+    * @return length of the encoded value, 0 if it is malformed
+    */
+    static unsigned readLeb128(unsigned char const* data, unsigned size, uint64_t &value);
+
+    /**
+    * @param value value to encode
+    * @param out buffer of at least LEB128_MAX_SIZE bytes
+    * @return length of the encoded value
+    */
+    static unsigned writeLeb128(uint64_t value, unsigned char* out);
+
+    /**
+    * Checks if an OBU_FRAME or OBU_FRAME_HEADER starts a key frame
+    * @param payload OBU payload, without the OBU header
+    * @param size payload length in bytes
+    * @param reducedStillPictureHeader flag of the active sequence header
+    */
+    static bool isKeyFrame(unsigned char const* payload, unsigned size, bool reducedStillPictureHeader);
+
+private:
+    unsigned char const* ptr;
+    unsigned char const* end;
+    bool broken;
+};
+
+#endif
@@ -34,6 +34,13 @@ Path::Path(int originFilterID, int destinationFilterID, int orgWriterID,
     this->dstReaderID = dstReaderID;
 
     filterIDs = midFiltersIDs;
+    queueFrames = 0;
+    queueBytes = 0;
+    dropPolicy = DROP_NEWEST;
+    maxLatency = std::chrono::microseconds(0);
+    dropTarget = 0;
+    outputProfile = {VC_NONE, 0, 0, 0};
+    suspended = false;
 }
 
 void Path::addFilterID(int filterID)
@@ -47,6 +54,18 @@ void Path::setDestinationFilter(int destinationFilterID, int dstReaderID)
     this->dstReaderID = dstReaderID;
 }
 
+bool Path::replaceFilterID(int oldID, int newID)
+{
+    std::vector<int>::iterator it = std::find(filterIDs.begin(), filterIDs.end(), oldID);
+    
+    if (it == filterIDs.end()){
+        return false;
+    }
+    
+    *it = newID;
+    return true;
+}
+
 bool Path::hasFilter(int fId)
 {
     if (std::find(filterIDs.begin(), filterIDs.end(), fId) != filterIDs.end()){
@@ -25,6 +25,20 @@
 #define _PATH_HH
 
 #include <vector>
+#include <cstddef>
+#include <chrono>
+
+#include "Types.hh"
+
+/*! Coded output a path is expected to deliver. If the stream of the path origin already matches it,
+    the decoding and encoding filters of the path are bypassed, see PipelineManager::connectPath
+*/
+struct OutputProfile {
+    VCodecType codec;           //!< VC_NONE if the path has no profile
+    unsigned width;             //!< 0 means any
+    unsigned height;            //!< 0 means any
+    unsigned bitrate;           //!< Maximum bitrate in kbps, 0 means any
+};
 
 /*! Path class determines the pipeline configuration, filters interconnections
     and data paths.
@@ -84,6 +98,90 @@ public:
     * @return true if the filter is present in path, false otherwise
     */
     bool hasFilter(int fId);
+    
+    /**
+    * Replaces a middle filter of the path, i.e. by an equivalent one shared with another path
+    * @param oldID id of the filter to replace
+    * @param newID id of the filter replacing it
+    * @return true if the filter was present in the path, false otherwise
+    */
+    bool replaceFilterID(int oldID, int newID);
+    
+    /**
+    * Removes the middle filters of the path, i.e. when its transcoding is bypassed
+    */
+    void clearFilters() {filterIDs.clear();};
+    
+    /**
+    * Sets the size of the queues created when the path is connected
+    * @param frames depth of the queues, 0 keeps the filters default
+    * @param bytes bytes budget of the queues, 0 means no budget
+    */
+    void setQueueSize(unsigned frames, size_t bytes) {queueFrames = frames; queueBytes = bytes;};
+    
+    /**
+    * @return depth of the path queues, 0 if the filters default is used
+    */
+    unsigned getQueueFrames() const {return queueFrames;};
+    
+    /**
+    * @return bytes budget of the path queues, 0 if there is no budget
+    */
+    size_t getQueueBytes() const {return queueBytes;};
+    
+    /**
+    * Sets the frames dropped by the path queues when they are full, see DropPolicy
+    * @param policy drop policy of the queues created when the path is connected
+    */
+    void setDropPolicy(DropPolicy policy) {dropPolicy = policy;};
+    
+    /**
+    * @return drop policy of the path queues
+    */
+    DropPolicy getDropPolicy() const {return dropPolicy;};
+    
+    /**
+    * Sets the latency the readers of the path queues catch up from, see AVFramedQueue::getFront
+    * @param latency latency bound, 0 means no bound
+    */
+    void setMaxLatency(std::chrono::microseconds latency) {maxLatency = latency;};
+    
+    /**
+    * @return latency bound of the path queues, 0 if there is no bound
+    */
+    std::chrono::microseconds getMaxLatency() const {return maxLatency;};
+    
+    /**
+    * Sets the share of frames the path queues depth is tuned to drop, see AVFramedQueue
+    * @param target drop target from 0 to 1, 0 keeps a fixed depth
+    */
+    void setDropTarget(float target) {dropTarget = target;};
+    
+    /**
+    * @return drop target of the path queues, 0 if their depth is fixed
+    */
+    float getDropTarget() const {return dropTarget;};
+    
+    /**
+    * Sets the output expected from the path, see OutputProfile
+    * @param profile output profile, with VC_NONE codec to remove it
+    */
+    void setOutputProfile(OutputProfile profile) {outputProfile = profile;};
+    
+    /**
+    * @return output profile of the path, with VC_NONE codec if it has none
+    */
+    OutputProfile getOutputProfile() const {return outputProfile;};
+    
+    /**
+    * Marks the path as suspended, see PipelineManager::suspendPath
+    */
+    void setSuspended(bool suspended_) {suspended = suspended_;};
+    
+    /**
+    * @return true if the path is suspended
+    */
+    bool isSuspended() const {return suspended;};
 
 protected:
     void addFilterID(int filterID);
@@ -94,6 +192,13 @@ private:
     int orgWriterID;
     int dstReaderID;
     std::vector<int> filterIDs;
+    unsigned queueFrames;
+    size_t queueBytes;
+    DropPolicy dropPolicy;
+    std::chrono::microseconds maxLatency;
+    float dropTarget;
+    OutputProfile outputProfile;
+    bool suspended;
 };
 
 
@@ -0,0 +1,140 @@
+/*
+ *  PerfCounters.cpp - Per thread hardware performance counters
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "PerfCounters.hh"
+#include "Utils.hh"
+
+std::atomic<unsigned> PerfCounters::interval(0);
+std::atomic<unsigned> PerfCounters::openedThreads(0);
+std::atomic<unsigned> PerfCounters::failedThreads(0);
+
+/*! perf_event_open group of a thread, the first counter is the leader */
+class ThreadCounters {
+
+public:
+    ThreadCounters() : opened(false), failed(false)
+    {
+        for (size_t i = 0; i < PERF_COUNTERS; i++){
+            fds[i] = -1;
+        }
+    };
+
+    ~ThreadCounters()
+    {
+        for (size_t i = 0; i < PERF_COUNTERS; i++){
+            if (fds[i] >= 0){
+                close(fds[i]);
+            }
+        }
+    };
+
+    bool open();
+    bool read(PerfSample &sample);
+
+private:
+    int fds[PERF_COUNTERS];
+    bool opened;
+    bool failed;
+};
+
+bool ThreadCounters::open()
+{
+    const uint64_t configs[PERF_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                             PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    struct perf_event_attr attr;
+
+    for (size_t i = 0; i < PERF_COUNTERS; i++){
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        //NOTE: only the user space is counted, so it works with the default perf_event_paranoid
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+        if (fds[i] < 0){
+            utils::warningMsg("[PerfCounters] Hardware counters are not available in this thread: " +
+                              std::string(strerror(errno)));
+            PerfCounters::failedThreads++;
+            failed = true;
+            return false;
+        }
+    }
+
+    opened = true;
+    PerfCounters::openedThreads++;
+    return true;
+}
+
+bool ThreadCounters::read(PerfSample &sample)
+{
+    //NOTE: nr, time enabled, time running and one value per counter
+    uint64_t data[3 + PERF_COUNTERS];
+    double scale = 1;
+
+    if (failed || (!opened && !open())){
+        return false;
+    }
+
+    if (::read(fds[0], data, sizeof(data)) != sizeof(data) || data[0] != PERF_COUNTERS){
+        return false;
+    }
+
+    //NOTE: a group is only multiplexed as a whole, the running share scales all the values
+    if (data[2] > 0 && data[2] < data[1]){
+        scale = (double) data[1] / data[2];
+    }
+
+    for (size_t i = 0; i < PERF_COUNTERS; i++){
+        sample.values[i] = data[3 + i]*scale;
+    }
+
+    return true;
+}
+
+void PerfCounters::setInterval(unsigned interval_)
+{
+    interval.store(interval_, std::memory_order_relaxed);
+}
+
+bool PerfCounters::read(PerfSample &sample)
+{
+    static thread_local ThreadCounters counters;
+
+    return counters.read(sample);
+}
+
+void PerfCounters::getState(Jzon::Object &node)
+{
+    node.Add("interval", (int) getInterval());
+    node.Add("threads", (int) openedThreads.load(std::memory_order_relaxed));
+    node.Add("failedThreads", (int) failedThreads.load(std::memory_order_relaxed));
+}
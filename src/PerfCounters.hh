@@ -0,0 +1,93 @@
+/*
+ *  PerfCounters.hh - Per thread hardware performance counters
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _PERF_COUNTERS_HH
+#define _PERF_COUNTERS_HH
+
+#include <atomic>
+#include <stdint.h>
+
+#include "Jzon.h"
+
+enum PerfCounter {PERF_CYCLES, PERF_INSTRUCTIONS, PERF_CACHE_MISSES, PERF_BRANCH_MISSES, PERF_COUNTERS};
+
+/*! Values of the hardware counters of the calling thread */
+struct PerfSample {
+    PerfSample() : values() {};
+
+    uint64_t values[PERF_COUNTERS];
+};
+
+/*! Process wide switch of the hardware performance counters read around the runnables
+    execution. Each thread opens its own perf_event_open group (cycles, instructions, cache
+    and branch misses of the user space) the first time it reads it, so readings taken by
+    the same thread before and after a call measure that call only. A read costs a system
+    call, so only one of every interval calls of each runnable is measured. Counting is
+    disabled by default, then the cost per call is a relaxed atomic load. Threads whose
+    group cannot be opened (no PMU, perf_event_paranoid, seccomp) do not try again.
+*/
+class PerfCounters {
+
+public:
+    /**
+     * Sets how many calls are measured
+     * @param interval one of every interval calls of each runnable is measured, 0 disables counting
+     */
+    static void setInterval(unsigned interval);
+
+    /**
+     * @return measuring interval, 0 if counting is disabled
+     */
+    static unsigned getInterval() {return interval.load(std::memory_order_relaxed);};
+
+    /**
+     * @param call number of the call of a runnable
+     * @return true if the call is measured
+     */
+    static bool isSampled(unsigned long call)
+    {
+        unsigned i = interval.load(std::memory_order_relaxed);
+
+        return i != 0 && call % i == 0;
+    };
+
+    /**
+     * Reads the counters of the calling thread, opening its group the first time
+     * @param sample where counter values are set, scaled if the group was multiplexed
+     * @return false if the counters are not available in this thread
+     */
+    static bool read(PerfSample &sample);
+
+    /**
+     * Adds the interval and the number of threads that opened or failed to open their group to the node
+     */
+    static void getState(Jzon::Object &node);
+
+private:
+    static std::atomic<unsigned> interval;
+    static std::atomic<unsigned> openedThreads;
+    static std::atomic<unsigned> failedThreads;
+
+    friend class ThreadCounters;
+};
+
+#endif
@@ -24,26 +24,61 @@
 
 #include "PipelineManager.hh"
 #include "modules/audioEncoder/AudioEncoderLibav.hh"
+#include "modules/audioEncoder/AudioMultiEncoderLibav.hh"
 #include "modules/audioDecoder/AudioDecoderLibav.hh"
 #include "modules/audioMixer/AudioMixer.hh"
 #include "modules/videoEncoder/VideoEncoderX264.hh"
+#include "modules/videoEncoder/VideoLadderEncoderX264.hh"
+#include "modules/videoEncoder/VideoEncoderLibav.hh"
+#include "modules/videoEncoder/VideoEncoderVpx.hh"
+#include "modules/videoEncoder/VideoEncoderSvtAv1.hh"
 #include "modules/videoDecoder/VideoDecoderLibav.hh"
 #include "modules/videoMixer/VideoMixer.hh"
 #include "modules/videoSplitter/VideoSplitter.hh"
+#include "modules/videoSwitcher/VideoSwitcher.hh"
+#include "modules/timeShift/TimeShift.hh"
+#include "modules/loudnessNormalizer/LoudnessNormalizer.hh"
+#include "modules/deinterlacer/Deinterlacer.hh"
 #include "modules/videoResampler/VideoResampler.hh"
+#include "modules/videoResampler/VideoLadderResampler.hh"
+#include "modules/videoResampler/ScalerPool.hh"
 #include "modules/receiver/SourceManager.hh"
 #include "modules/transmitter/SinkManager.hh"
 #include "modules/headDemuxer/HeadDemuxerLibav.hh"
 #include "modules/dasher/Dasher.hh"
+#include "modules/recorder/Recorder.hh"
+#include "modules/videoPreviewer/VideoPreviewer.hh"
+#include "modules/signalMonitor/SignalMonitor.hh"
 #include "modules/V4LCapture/V4LCapture.hh"
 #include "modules/sharedMemory/SharedMemory.hh"
+#include "modules/sharedMemory/SharedMemoryIngest.hh"
+#include "modules/frameLink/FrameLinkSender.hh"
+#include "modules/frameLink/FrameLinkReceiver.hh"
+#include "FramePool.hh"
+#include "ThreadBudget.hh"
+#include "MemoryBudget.hh"
+#include "NalSplitter.hh"
+#include "Clock.hh"
+extern "C" {
+    #include "modules/transmitter/SPSparser/h264_stream.h"
+}
+#include "FrameTracer.hh"
+#include "ProfiledMutex.hh"
+#include "PerfCounters.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <atomic>
 
 #define WORKER_DELETE_SLEEPING_TIME 1000 //us
 
-PipelineManager::PipelineManager(const unsigned thds) : threads(thds)
+PipelineManager::PipelineManager(const unsigned thds, const SchedulingMode mode) : threads(thds), schedMode(mode), pinnedWorkers(false), reservedWorkers(0), minWorkers(0), maxWorkers(0), handOff(false), throughput(false),
+    metricsPeriod(METRICS_DEFAULT_PERIOD), lastBusyTime(0)
 {
     pipeMngrInstance = this;
-    pool = new WorkersPool(threads);
+    pool = new WorkersPool(threads, schedMode);
 }
 
 PipelineManager::~PipelineManager()
@@ -52,13 +87,13 @@ PipelineManager::~PipelineManager()
     pipeMngrInstance = NULL;
 }
 
-PipelineManager* PipelineManager::getInstance(unsigned threads)
+PipelineManager* PipelineManager::getInstance(unsigned threads, SchedulingMode mode)
 {
     if (pipeMngrInstance != NULL) {
         return pipeMngrInstance;
     }
 
-    return new PipelineManager(threads);
+    return new PipelineManager(threads, mode);
 }
 
 void PipelineManager::destroyInstance()
@@ -71,6 +106,8 @@ void PipelineManager::destroyInstance()
 
 bool PipelineManager::stop()
 {
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
     if (!pool){
         utils::warningMsg("No thread pool to stop!");
         return false;
@@ -79,14 +116,16 @@ bool PipelineManager::stop()
     pool->stop();
     utils::infoMsg("All threads stopped");
     
-    for (auto it : paths) {
-        if (!deletePath(it.first)) {
-            utils::errorMsg("Failed deleting path " + std::to_string(it.first));
+    //NOTE: deleted paths are erased right away, deletePath checks the remaining ones
+    while (!paths.empty()) {
+        int id = paths.begin()->first;
+        if (!deletePath(id)) {
+            utils::errorMsg("Failed deleting path " + std::to_string(id));
             return false;
         }
+        paths.erase(id);
     }
 
-    paths.clear();
     utils::infoMsg("Paths deleted");
 
     for (auto it : filters) {
@@ -106,6 +145,8 @@ bool PipelineManager::stop()
 
 int PipelineManager::searchFilterIDByType(FilterType type)
 {
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
     for (auto it : filters) {
         if (it.second->getType() == type) {
             return it.first;
@@ -115,15 +156,34 @@ int PipelineManager::searchFilterIDByType(FilterType type)
     return -1;
 }
 
-bool PipelineManager::createFilter(int id, FilterType type)
+bool PipelineManager::createFilter(int id, FilterType type, ComposeBackend backend, Jzon::Node* params, bool start,
+                                   BaseFilter* built)
 {
-    BaseFilter* filter = NULL;
+    BaseFilter* filter = built;
     
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
     if (id < 0 || filters.count(id) > 0){
         utils::errorMsg("Invalid filter ID");
         return false;
     }
 
+    if (!filter) {
+        filter = buildFilter(type, backend, params);
+    }
+    
+    if (filter){
+        addFilter(id, filter, start);
+        return true;
+    }
+
+    return false;
+}
+
+BaseFilter* PipelineManager::buildFilter(FilterType type, ComposeBackend backend, Jzon::Node* params)
+{
+    BaseFilter* filter = NULL;
+
     switch (type) {
         case RECEIVER:
             filter = new SourceManager();
@@ -140,11 +200,30 @@ bool PipelineManager::createFilter(int id, FilterType type)
         case VIDEO_ENCODER:
             filter = new VideoEncoderX264();
             break;
+        case VIDEO_LADDER_ENCODER:
+            filter = new VideoLadderEncoderX264();
+            break;
+        case VIDEO_HW_ENCODER:
+            filter = new VideoEncoderLibav();
+            break;
+        case VIDEO_VPX_ENCODER:
+            filter = new VideoEncoderVpx();
+            break;
+        case VIDEO_AV1_ENCODER:
+            filter = new VideoEncoderSvtAv1();
+            break;
          case VIDEO_RESAMPLER:
             filter = new VideoResampler();
             break;
+        case DEINTERLACER:
+            filter = new Deinterlacer();
+            break;
+        case VIDEO_LADDER_RESAMPLER:
+            filter = new VideoLadderResampler();
+            break;
         case VIDEO_MIXER:
-            filter = VideoMixer::createNew();
+            filter = VideoMixer::createNew(VMIXER_MAX_CHANNELS, DEFAULT_WIDTH, DEFAULT_HEIGHT, 
+                                           std::chrono::microseconds(0), backend);
             break;
         case AUDIO_DECODER:
             filter = new AudioDecoderLibav();
@@ -152,38 +231,356 @@ bool PipelineManager::createFilter(int id, FilterType type)
         case AUDIO_ENCODER:
             filter = new AudioEncoderLibav();
             break;
+        case AUDIO_MULTI_ENCODER:
+            filter = new AudioMultiEncoderLibav();
+            break;
         case AUDIO_MIXER:
             filter = new AudioMixer();
             break;
         case DASHER:
             filter = new Dasher();
             break;
+        case RECORDER:
+            filter = new Recorder();
+            break;
+        case VIDEO_PREVIEWER:
+            filter = new VideoPreviewer();
+            break;
+        case SIGNAL_MONITOR:
+            filter = new SignalMonitor();
+            break;
         case VIDEO_SPLITTER:
-            filter = VideoSplitter::createNew();
+            filter = VideoSplitter::createNew(std::chrono::microseconds(0), backend);
+            break;
+        case VIDEO_SWITCHER:
+            filter = createVideoSwitcher(params);
+            break;
+        case TIME_SHIFT:
+            filter = createTimeShift(params);
+            break;
+        case LOUDNESS_NORMALIZER:
+            filter = createLoudnessNormalizer(params);
             break;
         case V4L_CAPTURE:
             filter = new V4LCapture();
             break;
         case SHARED_MEMORY:
-            filter = SharedMemory::createNew();
+            filter = createSharedMemory(params);
+            break;
+        case SHARED_MEMORY_INGEST:
+            filter = createSharedMemoryIngest(params);
+            break;
+        case FRAME_LINK_SENDER:
+            filter = createFrameLinkSender(params);
+            break;
+        case FRAME_LINK_RECEIVER:
+            filter = createFrameLinkReceiver(params);
             break;
         default:
             utils::errorMsg("Unknown filter type");
             break;
     }
-    
-    if (filter){
-        addFilter(id, filter);
-        return true;
+
+    return filter;
+}
+
+//NOTE: live555 filters share the static state of the library, so they are only built holding the graph lock
+BaseFilter* PipelineManager::prebuildFilter(Jzon::Node* params)
+{
+    ComposeBackend backend = CPU_COMPOSE;
+    FilterType type;
+
+    if (!params || !params->IsObject() || !params->Has("type")) {
+        return NULL;
     }
 
-    return false;
+    type = utils::getFilterTypeFromString(params->Get("type").ToString());
+
+    if (type == RECEIVER || type == TRANSMITTER) {
+        return NULL;
+    }
+
+    if (params->Has("backend")) {
+        backend = utils::getComposeBackendFromString(params->Get("backend").ToString());
+    }
+
+    if (backend == CB_NONE) {
+        return NULL;
+    }
+
+    return buildFilter(type, backend, params);
+}
+
+void PipelineManager::buildFilters(Jzon::Node* params, std::map<int, BaseFilter*> &built)
+{
+    std::vector<Jzon::Node*> jobs;
+    std::vector<BaseFilter*> results;
+    std::vector<std::thread> builders;
+    std::atomic<size_t> next(0);
+    FilterType type;
+
+    if (!params->Has("filters")) {
+        return;
+    }
+
+    for (auto &f : params->Get("filters").AsArray()) {
+        type = utils::getFilterTypeFromString(f.Get("type").ToString());
+        if (type != RECEIVER && type != TRANSMITTER) {
+            jobs.push_back(&f);
+        }
+    }
+
+    if (jobs.empty()) {
+        return;
+    }
+
+    results.resize(jobs.size(), NULL);
+
+    //NOTE: a single filter is built at the calling thread
+    if (jobs.size() == 1) {
+        results[0] = prebuildFilter(jobs[0]);
+    }
+
+    for (size_t i = 0; jobs.size() > 1 && i < std::min(jobs.size(), (size_t) std::max(std::thread::hardware_concurrency(), 1u)); i++) {
+        builders.push_back(std::thread([this, &jobs, &results, &next]() {
+            size_t j;
+
+            while ((j = next++) < jobs.size()) {
+                results[j] = prebuildFilter(jobs[j]);
+            }
+        }));
+    }
+
+    for (auto &b : builders) {
+        b.join();
+    }
+
+    for (size_t j = 0; j < jobs.size(); j++) {
+        if (results[j]) {
+            built[jobs[j]->Get("id").ToInt()] = results[j];
+        }
+    }
+}
+
+BaseFilter* PipelineManager::createSharedMemory(Jzon::Node* params)
+{
+    VCodecType codec = RAW;
+    unsigned slots = 0;
+
+    if (!params) {
+        return SharedMemory::createNew();
+    }
+
+    if (params->Has("codec")) {
+        codec = utils::getVideoCodecFromString(params->Get("codec").ToString());
+    }
+
+    if (params->Has("slots") && params->Get("slots").IsNumber()) {
+        slots = params->Get("slots").ToInt();
+    }
+
+    if (params->Has("name")) {
+        return SharedMemory::createNew(params->Get("name").ToString(), codec,
+                                       params->Has("memfd") && params->Get("memfd").ToBool() ? SHM_MEMFD : SHM_POSIX,
+                                       slots > 0 ? slots : SHM_RING_DEFAULT_SLOTS);
+    }
+
+    if (params->Has("key") && params->Get("key").IsNumber()) {
+        return SharedMemory::createNew(params->Get("key").ToInt(), codec, slots);
+    }
+
+    return SharedMemory::createNew(codec, slots);
+}
+
+BaseFilter* PipelineManager::createSharedMemoryIngest(Jzon::Node* params)
+{
+    SharedMemoryIngest* ingest;
+    VCodecType codec = RAW;
+
+    if (params && params->Has("codec")) {
+        codec = utils::getVideoCodecFromString(params->Get("codec").ToString());
+    }
+
+    if (!(ingest = SharedMemoryIngest::createNew(codec))) {
+        return NULL;
+    }
+
+    if (!params) {
+        return ingest;
+    }
+
+    if (params->Has("name") || params->Has("path")) {
+        ingest->attach(params->Get(params->Has("name") ? "name" : "path").ToString());
+    } else if (params->Has("id") && params->Get("id").IsNumber()) {
+        ingest->attach(params->Get("id").ToInt());
+    }
+
+    return ingest;
+}
+
+BaseFilter* PipelineManager::createFrameLinkSender(Jzon::Node* params)
+{
+    FrameLinkSender* sender = new FrameLinkSender();
+
+    bool configured = true;
+
+    if (!params) {
+        return sender;
+    }
+
+    if (params->Has("backpressure") && params->Get("backpressure").IsBool()) {
+        sender->setBackpressure(params->Get("backpressure").ToBool());
+    }
+
+    if (params->Has("zeroCopy") && params->Get("zeroCopy").IsBool()) {
+        configured = sender->setZeroCopy(params->Get("zeroCopy").ToBool());
+    }
+
+    //NOTE: the receiver address may also be given later with a configure event
+    if (configured && params->Has("path")) {
+        configured = sender->configurePath(params->Get("path").ToString());
+    } else if (configured && params->Has("host") && params->Has("port") && params->Get("port").IsNumber()) {
+        configured = sender->configure(params->Get("host").ToString(), params->Get("port").ToInt());
+    }
+
+    if (!configured) {
+        delete sender;
+        return NULL;
+    }
+
+    return sender;
+}
+
+BaseFilter* PipelineManager::createFrameLinkReceiver(Jzon::Node* params)
+{
+    FrameLinkReceiver* receiver;
+    StreamInfo si(VIDEO);
+    std::string codec = "H264";
+
+    if (params && params->Has("codec")) {
+        codec = params->Get("codec").ToString();
+    }
+
+    //NOTE: the stream is declared here since the queues are created before the sender connects
+    if ((si.video.codec = utils::getVideoCodecFromString(codec)) != VC_NONE) {
+        si.setCodecDefaults();
+        si.video.pixelFormat = P_NONE;
+        if (si.video.codec == RAW && params && params->Has("pixelFormat")) {
+            si.video.pixelFormat = utils::getPixTypeFromString(params->Get("pixelFormat").ToString());
+        }
+        si.video.frameTypes = params && params->Has("frameTypes") && params->Get("frameTypes").ToBool();
+    } else {
+        si.type = AUDIO;
+        si.audio.codec = utils::getAudioCodecFromString(codec);
+        si.audio.sampleRate = DEFAULT_SAMPLE_RATE;
+        si.audio.channels = DEFAULT_CHANNELS;
+        si.audio.channelLayout = CL_NONE;
+        si.audio.sampleFormat = S16;
+        si.setCodecDefaults();
+
+        if (params && params->Has("sampleRate") && params->Get("sampleRate").IsNumber()) {
+            si.audio.sampleRate = params->Get("sampleRate").ToInt();
+        }
+
+        if (params && params->Has("channels") && params->Get("channels").IsNumber()) {
+            si.audio.channels = params->Get("channels").ToInt();
+        }
+
+        if (params && params->Has("sampleFormat")) {
+            si.audio.sampleFormat = utils::getSampleFormatFromString(params->Get("sampleFormat").ToString());
+        }
+    }
+
+    if (!(receiver = FrameLinkReceiver::createNew(si))) {
+        return NULL;
+    }
+
+    if (params && params->Has("path") && !receiver->listenPath(params->Get("path").ToString())) {
+        delete receiver;
+        return NULL;
+    }
+
+    if (params && !params->Has("path") && params->Has("port") && params->Get("port").IsNumber() &&
+        !receiver->listenPort(params->Get("port").ToInt())) {
+        delete receiver;
+        return NULL;
+    }
+
+    return receiver;
+}
+
+BaseFilter* PipelineManager::createVideoSwitcher(Jzon::Node* params)
+{
+    VCodecType codec = H264;
+    unsigned inputs = VSWITCHER_MAX_INPUTS;
+
+    if (params && params->Has("codec")) {
+        codec = utils::getVideoCodecFromString(params->Get("codec").ToString());
+    }
+
+    if (params && params->Has("inputs") && params->Get("inputs").IsNumber() && params->Get("inputs").ToInt() > 0) {
+        inputs = params->Get("inputs").ToInt();
+    }
+
+    return VideoSwitcher::createNew(codec, inputs);
+}
+
+BaseFilter* PipelineManager::createTimeShift(Jzon::Node* params)
+{
+    VCodecType codec = H264;
+    std::chrono::seconds window(TSHIFT_DEFAULT_WINDOW);
+    size_t memory = TSHIFT_DEFAULT_MEMORY;
+    std::string spillFile;
+    size_t spillSize = 0;
+
+    if (params && params->Has("codec")) {
+        codec = utils::getVideoCodecFromString(params->Get("codec").ToString());
+    }
+
+    if (params && params->Has("window") && params->Get("window").IsNumber()) {
+        window = std::chrono::seconds(params->Get("window").ToInt());
+    }
+
+    if (params && params->Has("memory") && params->Get("memory").IsNumber() && params->Get("memory").ToDouble() > 0) {
+        memory = (size_t) params->Get("memory").ToDouble();
+    }
+
+    if (params && params->Has("spillFile") && params->Has("spillSize") && params->Get("spillSize").IsNumber() &&
+        params->Get("spillSize").ToDouble() > 0) {
+        spillFile = params->Get("spillFile").ToString();
+        spillSize = (size_t) params->Get("spillSize").ToDouble();
+    }
+
+    return TimeShift::createNew(codec, window, memory, spillFile, spillSize);
+}
+
+BaseFilter* PipelineManager::createLoudnessNormalizer(Jzon::Node* params)
+{
+    unsigned channels = DEFAULT_CHANNELS;
+    unsigned sampleRate = DEFAULT_SAMPLE_RATE;
+    SampleFmt sampleFormat = FLTP;
+
+    if (params && params->Has("channels") && params->Get("channels").IsNumber() && params->Get("channels").ToInt() > 0) {
+        channels = params->Get("channels").ToInt();
+    }
+
+    if (params && params->Has("sampleRate") && params->Get("sampleRate").IsNumber() && params->Get("sampleRate").ToInt() > 0) {
+        sampleRate = params->Get("sampleRate").ToInt();
+    }
+
+    if (params && params->Has("sampleFormat")) {
+        sampleFormat = utils::getSampleFormatFromString(params->Get("sampleFormat").ToString());
+    }
+
+    return LoudnessNormalizer::createNew(channels, sampleRate, sampleFormat);
 }
 
-bool PipelineManager::addFilter(int id, BaseFilter* filter)
+bool PipelineManager::addFilter(int id, BaseFilter* filter, bool start)
 {
     Runnable* run = NULL;
     
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
     if (filters.count(id) > 0) {
         utils::errorMsg("Filter ID must be unique");
         return false;
@@ -200,17 +597,48 @@ bool PipelineManager::addFilter(int id, BaseFilter* filter)
     }
     
     filters[id] = filter;
+    filter->setThroughput(throughput);
 
     if (!pool){
         utils::warningMsg("Creating new thread pool!");
-        pool = new WorkersPool(threads);
+        pool = new WorkersPool(threads, schedMode);
+        if (pinnedWorkers){
+            pool->pinWorkers(true);
+        }
+        if (maxWorkers > 0){
+            pool->setElastic(minWorkers, maxWorkers);
+        }
+        pool->reserveWorkers(reservedWorkers);
+        pool->setHandOff(handOff);
     }
     
-    return pool->addTask(filter);
+    return !start || pool->addTask(filter);
+}
+
+void PipelineManager::startFilters(std::vector<int> ids)
+{
+    std::set<BaseFilter*> fused;
+
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    //NOTE: fused filters are executed inline by the head of their chain
+    for (auto it : filters) {
+        for (auto f : it.second->getFused()) {
+            fused.insert(f);
+        }
+    }
+
+    for (auto id : ids) {
+        if (filters.count(id) > 0 && fused.count(filters[id]) == 0) {
+            pool->addTask(filters[id]);
+        }
+    }
 }
 
 BaseFilter* PipelineManager::getFilter(int id)
 {
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
     if (filters.count(id) <= 0) {
         utils::warningMsg("Could not find fitler ID: " + std::to_string(id));
         return NULL;
@@ -221,6 +649,8 @@ BaseFilter* PipelineManager::getFilter(int id)
 
 Path* PipelineManager::getPath(int id)
 {
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
     if (paths.count(id) <= 0) {
         return NULL;
     }
@@ -236,6 +666,8 @@ bool PipelineManager::createPath(int id, int orgFilter, int dstFilter, int orgWr
     int realOrgWriter = orgWriter;
     int realDstReader = dstReader;
 
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
     if (paths.count(id) > 0) {
         utils::errorMsg("[PipelineManager::createPath] Path id already exists");
         return false;
@@ -286,6 +718,8 @@ bool PipelineManager::createPath(int id, int orgFilter, int dstFilter, int orgWr
 
 bool PipelineManager::connectPath(int id)
 {
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
     if (paths.count(id) <= 0) {
         utils::errorMsg("[PipelineManager::connectPath] Path does not exist");
         return false;
@@ -296,15 +730,24 @@ bool PipelineManager::connectPath(int id)
     int dstFilterId = path->getDestinationFilterID();
 
     std::vector<int> pathFilters = path->getFilters();
+    unsigned qFrames = path->getQueueFrames();
+    size_t qBytes = path->getQueueBytes();
+    DropPolicy policy = path->getDropPolicy();
+    std::chrono::microseconds latency = path->getMaxLatency();
+    float target = path->getDropTarget();
+    bool shared, connected;
     
     for (auto id : pathFilters){
         if (filters.count(id) == 0){
             return false;
         }
     }
+    
+    shared = !bypassTranscode(id) && shareDecoder(id);
+    pathFilters = path->getFilters();
 
     if (pathFilters.empty()) {
-        if (filters[orgFilterId]->connectManyToMany(filters[dstFilterId], path->getDstReaderID(), path->getOrgWriterID()) ||
+        if (filters[orgFilterId]->connectManyToMany(filters[dstFilterId], path->getDstReaderID(), path->getOrgWriterID(), qFrames, qBytes, policy, latency, target) ||
             handleGrouping(orgFilterId, dstFilterId, path->getOrgWriterID(), path->getDstReaderID())) {
             return true;
         } else {
@@ -313,96 +756,424 @@ bool PipelineManager::connectPath(int id)
         }
     }
 
-    if (!filters[orgFilterId]->connectManyToOne(filters[pathFilters.front()], path->getOrgWriterID()) &&
+    //NOTE: a shared decoder is already connected to the head, its output is shared with the next filter
+    if (!shared && 
+        !filters[orgFilterId]->connectManyToOne(filters[pathFilters.front()], path->getOrgWriterID(), qFrames, qBytes, policy, latency, target) &&
         !handleGrouping(orgFilterId, pathFilters.front(), path->getOrgWriterID(), DEFAULT_ID)) {
         utils::errorMsg("Connecting path head to first filter!");
         return false;
     }
 
     for (unsigned i = 0; i < pathFilters.size() - 1; i++) {
-        if (!filters[pathFilters[i]]->connectOneToOne(filters[pathFilters[i+1]])) {
+        if (shared && i == 0) {
+            connected = handleGrouping(pathFilters[i], pathFilters[i+1], DEFAULT_ID, DEFAULT_ID);
+        } else {
+            connected = filters[pathFilters[i]]->connectOneToOne(filters[pathFilters[i+1]], qFrames, qBytes, policy, latency, target);
+        }
+        
+        if (!connected) {
             utils::errorMsg("Connecting path filters!");
             return false;
         }
     }
 
-    if (!filters[pathFilters.back()]->connectOneToMany(filters[dstFilterId], path->getDstReaderID())) {
-        utils::errorMsg("Connecting path last filter to path tail!");
-        return false;
+    if (shared && pathFilters.size() == 1) {
+        connected = handleGrouping(pathFilters.back(), dstFilterId, DEFAULT_ID, path->getDstReaderID());
+    } else {
+        connected = filters[pathFilters.back()]->connectOneToMany(filters[dstFilterId], path->getDstReaderID(), qFrames, qBytes, policy, latency, target);
     }
-
-    return true;
-}
-
-bool PipelineManager::handleGrouping(int orgFId, int dstFId, int orgWId, int dstRId)
-{
-    ConnectionData cData;
-
-    if (!filters[orgFId]->isWConnected(orgWId)){
+    
+    if (!connected) {
+        utils::errorMsg("Connecting path last filter to path tail!");
         return false;
     }
-
-    cData = filters[orgFId]->getWConnectionData(orgWId);
     
-    if (!validCData(cData, orgFId, dstFId)){
-        utils::errorMsg("cData not valid to share filters");
-        return false;
+    if (shared) {
+        fusePath(std::vector<int>(pathFilters.begin() + 1, pathFilters.end()));
+    } else {
+        fusePath(pathFilters);
     }
 
-    return filters[cData.readers.front().rFilterId]->shareReader(filters[dstFId], dstRId, cData.readers.front().readerId);
+    return true;
 }
 
-bool PipelineManager::validCData(ConnectionData cData, int orgFId, int dstFId)
+bool PipelineManager::fusePath(std::vector<int> pathFilters)
 {
-    if (orgFId != cData.wFilterId) {
+    std::vector<BaseFilter*> chain;
+    
+    if (pathFilters.size() < 2 || !filters[pathFilters.front()]->isFusable()) {
         return false;
     }
     
-    for (auto r : cData.readers) {
-        if (r.rFilterId == dstFId || filters.count(r.rFilterId) == 0 || 
-            !filters[r.rFilterId]->isRConnected(r.readerId)){
+    for (unsigned i = 1; i < pathFilters.size(); i++) {
+        if (!filters[pathFilters[i]]->isFusable()) {
             return false;
         }
+        chain.push_back(filters[pathFilters[i]]);
     }
     
-    if (filters.count(cData.wFilterId) > 0 && filters[cData.wFilterId]->isWConnected(cData.writerId)) {
-        return true;
+    //NOTE: fused filters are removed from the pool before being executed inline
+    for (auto f : chain) {
+        pool->removeTask(f->getId());
+        while (f->isRunning()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(WORKER_DELETE_SLEEPING_TIME));
+        }
     }
     
-    return false;
-}
-
-bool PipelineManager::removePath(int id)
-{
-    if (paths.count(id) <= 0) {
-        utils::warningMsg("Requested path not found!");
-        return true;
-    }
-
-    if (!deletePath(id)) {
+    if (!filters[pathFilters.front()]->fuse(chain)) {
+        for (auto f : chain) {
+            pool->addTask(f);
+        }
         return false;
     }
-
-    paths.erase(id);
-
+    
+    utils::infoMsg("Path filters fused in filter " + std::to_string(pathFilters.front()));
     return true;
 }
 
-bool PipelineManager::removeFilter(int id)
+//NOTE: only H.264 parameter sets are parsed, other codecs give an unknown resolution
+static bool getResolution(const StreamInfo *si, unsigned &width, unsigned &height)
 {
-    BaseFilter* filter;
-    
-    filter = getFilter(id);
-
-    if (!filter) {
+    std::shared_ptr<const ExtraData> extradata = si->getExtraData();
+    NalSplitter splitter(extradata->data(), extradata->size());
+    NalSpan nal;
+    std::vector<uint8_t> rbsp;
+    sps_t sps;
+    bs_t* b;
+    int size;
+
+    if (si->video.codec != H264) {
         return false;
     }
 
-    for (auto it : paths){
-        if (it.second->hasFilter(id)){
-            utils::warningMsg("Filters present in a path cannot be deleted");
-            utils::warningMsg("The filter is used in path " + std::to_string(it.first) + ", delete the path first");
-            return false;
+    while (splitter.next(nal)) {
+        if (nal.size < 2 || (nal.data[0] & 0x1F) != 7) {
+            continue;
+        }
+
+        size = nal.size;
+        rbsp.resize(size);
+
+        if (nal_to_rbsp(nal.data, &size, rbsp.data(), &size) < 0) {
+            return false;
+        }
+
+        memset(&sps, 0, sizeof(sps));
+        b = bs_new(rbsp.data(), size);
+
+        if (read_seq_parameter_set_rbsp(&sps, b) < 0) {
+            bs_free(b);
+            return false;
+        }
+
+        bs_free(b);
+
+        width = (sps.pic_width_in_mbs_minus1 + 1)*16;
+        height = (2 - sps.frame_mbs_only_flag)*(sps.pic_height_in_map_units_minus1 + 1)*16;
+
+        if (sps.frame_cropping_flag) {
+            width -= sps.frame_crop_left_offset*2 + sps.frame_crop_right_offset*2;
+            height -= sps.frame_crop_top_offset*2 + sps.frame_crop_bottom_offset*2;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+//NOTE: the source stream is only delivered as is to the filters that consume coded streams, and it must
+//      carry its parameter sets for them to announce it
+bool PipelineManager::bypassTranscode(int id)
+{
+    Path *path = paths[id];
+    OutputProfile profile = path->getOutputProfile();
+    std::vector<int> pathFilters = path->getFilters();
+    const StreamInfo *si;
+    FilterType type;
+    unsigned width = 0, height = 0;
+
+    if (profile.codec == VC_NONE || pathFilters.size() < 2) {
+        return false;
+    }
+
+    type = filters[path->getDestinationFilterID()]->getType();
+    if (type != TRANSMITTER && type != DASHER && type != RECORDER) {
+        return false;
+    }
+
+    type = filters[pathFilters.back()]->getType();
+    if (filters[pathFilters.front()]->getType() != VIDEO_DECODER || 
+        (type != VIDEO_ENCODER && type != VIDEO_HW_ENCODER && type != VIDEO_VPX_ENCODER)) {
+        return false;
+    }
+
+    for (auto fId : pathFilters) {
+        if (usedByOtherPath(fId, id) || (fId != pathFilters.front() && fId != pathFilters.back() && 
+            filters[fId]->getType() != VIDEO_RESAMPLER)) {
+            return false;
+        }
+    }
+
+    si = filters[path->getOriginFilterID()]->getWriterStreamInfo(path->getOrgWriterID());
+
+    if (!si || si->type != VIDEO || si->video.codec != profile.codec || !si->getExtraData() || 
+        si->getExtraData()->empty()) {
+        return false;
+    }
+
+    if ((si->video.codec == H264 || si->video.codec == H265) && !si->video.h264or5.annexb) {
+        return false;
+    }
+
+    if ((profile.width > 0 || profile.height > 0) && (!getResolution(si, width, height) || 
+        (profile.width > 0 && width != profile.width) || (profile.height > 0 && height != profile.height))) {
+        return false;
+    }
+
+    if (profile.bitrate > 0 && (si->bitrate == 0 || si->bitrate > profile.bitrate)) {
+        return false;
+    }
+
+    for (auto fId : pathFilters) {
+        pool->removeTask(fId);
+        delete filters[fId];
+        filters.erase(fId);
+    }
+
+    path->clearFilters();
+
+    utils::infoMsg("Path " + std::to_string(id) + " source already matches its output profile, " + 
+                   "transcoding bypassed");
+    return true;
+}
+
+//NOTE: decoders give the same output for the same input, so the decoding work scales with the 
+//      sources instead of the paths
+bool PipelineManager::shareDecoder(int id)
+{
+    Path *path = paths[id];
+    std::vector<int> pathFilters = path->getFilters();
+    std::vector<BaseFilter*> chain;
+    FilterType type;
+    int newDecoder, decoder;
+    
+    if (pathFilters.empty()) {
+        return false;
+    }
+    
+    newDecoder = pathFilters.front();
+    type = filters[newDecoder]->getType();
+    
+    if ((type != VIDEO_DECODER && type != AUDIO_DECODER) || usedByOtherPath(newDecoder, id) ||
+        !filters[path->getOriginFilterID()]->isWConnected(path->getOrgWriterID())) {
+        return false;
+    }
+    
+    for (auto it : paths) {
+        if (it.first == id || it.second->getFilters().empty() || it.second->isSuspended() ||
+            it.second->getOriginFilterID() != path->getOriginFilterID() || 
+            it.second->getOrgWriterID() != path->getOrgWriterID()) {
+            continue;
+        }
+        
+        decoder = it.second->getFilters().front();
+        
+        if (decoder == newDecoder || filters.count(decoder) == 0 || filters[decoder]->getType() != type || 
+            !filters[decoder]->isWConnected(DEFAULT_ID)) {
+            continue;
+        }
+        
+        //NOTE: fused filters must be the only reader of the previous one, the chain is executed again by the pool
+        chain = filters[decoder]->getFused();
+        if (!chain.empty()) {
+            filters[decoder]->fuse(std::vector<BaseFilter*>());
+            for (auto f : chain) {
+                pool->addTask(f);
+            }
+        }
+        
+        pool->removeTask(newDecoder);
+        delete filters[newDecoder];
+        filters.erase(newDecoder);
+        path->replaceFilterID(newDecoder, decoder);
+        
+        utils::infoMsg("Path " + std::to_string(id) + " shares decoder " + std::to_string(decoder) + 
+                       " instead of decoder " + std::to_string(newDecoder));
+        return true;
+    }
+    
+    return false;
+}
+
+bool PipelineManager::usedByOtherPath(int fId, int pathId)
+{
+    for (auto it : paths) {
+        if (it.first != pathId && it.second->hasFilter(fId)) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool PipelineManager::handleGrouping(int orgFId, int dstFId, int orgWId, int dstRId)
+{
+    ConnectionData cData;
+
+    if (!filters[orgFId]->isWConnected(orgWId)){
+        return false;
+    }
+
+    cData = filters[orgFId]->getWConnectionData(orgWId);
+    
+    if (!validCData(cData, orgFId, dstFId)){
+        utils::errorMsg("cData not valid to share filters");
+        return false;
+    }
+
+    return filters[cData.readers.front().rFilterId]->shareReader(filters[dstFId], dstRId, cData.readers.front().readerId);
+}
+
+bool PipelineManager::validCData(ConnectionData cData, int orgFId, int dstFId)
+{
+    if (orgFId != cData.wFilterId) {
+        return false;
+    }
+    
+    for (auto r : cData.readers) {
+        if (r.rFilterId == dstFId || filters.count(r.rFilterId) == 0 || 
+            !filters[r.rFilterId]->isRConnected(r.readerId)){
+            return false;
+        }
+    }
+    
+    if (filters.count(cData.wFilterId) > 0 && filters[cData.wFilterId]->isWConnected(cData.writerId)) {
+        return true;
+    }
+    
+    return false;
+}
+
+bool PipelineManager::removePath(int id)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (paths.count(id) <= 0) {
+        utils::warningMsg("Requested path not found!");
+        return true;
+    }
+
+    if (!deletePath(id)) {
+        return false;
+    }
+
+    paths.erase(id);
+
+    return true;
+}
+
+std::vector<int> PipelineManager::getParkedFilters(Path* path, int id)
+{
+    std::vector<int> parked;
+    
+    //NOTE: only a shared decoder can be followed by filters of this path alone
+    for (auto it : path->getFilters()) {
+        if (!usedByOtherPath(it, id)) {
+            parked.push_back(it);
+        }
+    }
+    
+    if (!usedByOtherPath(path->getDestinationFilterID(), id)) {
+        parked.push_back(path->getDestinationFilterID());
+    }
+    
+    return parked;
+}
+
+bool PipelineManager::suspendPath(int id, bool suspend)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    Path* path = getPath(id);
+    std::vector<int> chain, parked;
+    ConnectionData cData;
+    int feeder, writer, target;
+    
+    if (!path) {
+        utils::errorMsg("[PipelineManager::suspendPath] Path does not exist");
+        return false;
+    }
+    
+    if (path->isSuspended() == suspend) {
+        return true;
+    }
+    
+    chain.push_back(path->getOriginFilterID());
+    for (auto it : path->getFilters()) {
+        chain.push_back(it);
+    }
+    chain.push_back(path->getDestinationFilterID());
+    
+    for (auto it : chain) {
+        if (filters.count(it) == 0) {
+            utils::errorMsg("[PipelineManager::suspendPath] Path filters not found");
+            return false;
+        }
+    }
+    
+    //NOTE: the path is cut at the input of its first own filter, or of its destination reader
+    parked = getParkedFilters(path, id);
+    target = parked.empty() || parked.front() == path->getDestinationFilterID() ? (int) chain.size() - 1 : 
+             std::find(chain.begin(), chain.end(), parked.front()) - chain.begin();
+    feeder = chain[target - 1];
+    writer = target == 1 ? path->getOrgWriterID() : DEFAULT_ID;
+    
+    cData = filters[feeder]->getWConnectionData(writer);
+    if (cData.readers.size() != 1 || cData.readers.front().rFilterId != chain[target] ||
+        (target == (int) chain.size() - 1 && cData.readers.front().readerId != path->getDstReaderID())) {
+        utils::errorMsg("[PipelineManager::suspendPath] The input of path " + std::to_string(id) + 
+                        " is shared with another path");
+        return false;
+    }
+    
+    if (suspend) {
+        if (!filters[feeder]->suspendWriter(writer, true)) {
+            return false;
+        }
+        
+        for (auto it : parked) {
+            pool->removeTask(it);
+        }
+    } else {
+        startFilters(parked);
+        
+        if (!filters[feeder]->suspendWriter(writer, false)) {
+            return false;
+        }
+    }
+    
+    path->setSuspended(suspend);
+    return true;
+}
+
+bool PipelineManager::removeFilter(int id)
+{
+    BaseFilter* filter;
+    
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    filter = getFilter(id);
+
+    if (!filter) {
+        return false;
+    }
+
+    for (auto it : paths){
+        if (it.second->hasFilter(id)){
+            utils::warningMsg("Filters present in a path cannot be deleted");
+            utils::warningMsg("The filter is used in path " + std::to_string(it.first) + ", delete the path first");
+            return false;
         }
     }
     
@@ -440,8 +1211,20 @@ bool PipelineManager::deletePath(int id)
         return false;
     }
     
+    //NOTE: a decoder shared with other paths is kept connected, its fused chain starts after it
+    for (auto it : pathFilters) {
+        if (!usedByOtherPath(it, id)) {
+            filters[it]->fuse(std::vector<BaseFilter*>());
+            break;
+        }
+    }
+    
     std::vector<int>::reverse_iterator rit = pathFilters.rbegin();
     for (; rit!= pathFilters.rend(); ++rit){
+        if (usedByOtherPath(*rit, id)) {
+            continue;
+        }
+        
         filters[*rit]->disconnectReader(DEFAULT_ID);
         pool->removeTask(*rit);
         delete filters[*rit];
@@ -486,6 +1269,8 @@ void PipelineManager::getStateEvent(Jzon::Node* params, Jzon::Object &outputNode
     Jzon::Array pathList;
     BaseFilter* f;
 
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
     for (auto it : filters) {
         Jzon::Object filter;
         filter.Add("id", it.first);
@@ -506,18 +1291,44 @@ void PipelineManager::getStateEvent(Jzon::Node* params, Jzon::Object &outputNode
         path.Add("destinationFilter", it.second->getDestinationFilterID());
         path.Add("originWriter", it.second->getOrgWriterID());
         path.Add("destinationReader", it.second->getDstReaderID());
+        path.Add("queueFrames", (int) it.second->getQueueFrames());
+        path.Add("queueBytes", (double) it.second->getQueueBytes());
+        path.Add("dropPolicy", utils::getDropPolicyAsString(it.second->getDropPolicy()));
+        path.Add("maxLatency", (int) (it.second->getMaxLatency().count()/1000));
+        path.Add("dropTarget", (double) it.second->getDropTarget());
+        path.Add("memoryBytes", (double) getPathMemoryBytes(it.second));
+        path.Add("suspended", it.second->isSuspended());
 
         f = getFilter(it.second->getDestinationFilterID());
         if (f) {
+            Jzon::Array queues;
+            
             path.Add("avgDelay", (int)f->getAvgReaderDelay(it.second->getDstReaderID()).count());
+            path.Add("delayP50", (int)f->getReaderDelayPercentile(it.second->getDstReaderID(), 50).count());
+            path.Add("delayP90", (int)f->getReaderDelayPercentile(it.second->getDstReaderID(), 90).count());
+            path.Add("delayP99", (int)f->getReaderDelayPercentile(it.second->getDstReaderID(), 99).count());
+            path.Add("maxDelay", (int)f->getReaderDelayPercentile(it.second->getDstReaderID(), 100).count());
             totalPathLostBlocs += f->getLostBlocs(it.second->getDstReaderID());
             for (auto itt : pFilters) {
-                f = getFilter(itt);
-                if (f){
-                    totalPathLostBlocs += f->getLostBlocs(DEFAULT_ID);
+                BaseFilter* pf = getFilter(itt);
+                Jzon::Object queue;
+                if (pf){
+                    totalPathLostBlocs += pf->getLostBlocs(DEFAULT_ID);
+                    if (pf->getReaderQueueState(DEFAULT_ID, queue)) {
+                        queue.Add("filter", itt);
+                        queues.Add(queue);
+                    }
                 }
             }
             path.Add("lostBlocs", (int)totalPathLostBlocs);
+            
+            //NOTE: queues are listed hop by hop, from the first path filter to the destination
+            Jzon::Object dstQueue;
+            if (f->getReaderQueueState(it.second->getDstReaderID(), dstQueue)) {
+                dstQueue.Add("filter", it.second->getDestinationFilterID());
+                queues.Add(dstQueue);
+            }
+            path.Add("queues", queues);
         } else {
             utils::warningMsg("[PipelineManager::getStateEvent] Path filter does not exist. Ambiguous situation! Better pray Jesus...");
         }
@@ -531,85 +1342,909 @@ void PipelineManager::getStateEvent(Jzon::Node* params, Jzon::Object &outputNode
     }
 
     outputNode.Add("paths", pathList);
-}
-
-void PipelineManager::createFilterEvent(Jzon::Node* params, Jzon::Object &outputNode)
-{
-    int id;
-    FilterType fType;
 
-    if(!params) {
-        outputNode.Add("error", "Error creating filter. Invalid JSON format...");
-        return;
+    if (pool) {
+        Jzon::Object poolNode;
+        poolNode.Add("workers", (int)pool->getActiveWorkers());
+        poolNode.Add("minWorkers", (int)pool->getMinWorkers());
+        poolNode.Add("maxWorkers", (int)pool->getMaxWorkers());
+        poolNode.Add("reservedWorkers", (int)pool->getReservedWorkers());
+        poolNode.Add("utilisation", pool->getUtilisation());
+        poolNode.Add("handOff", pool->getHandOff());
+        poolNode.Add("handOffs", (double) pool->getHandOffs());
+        outputNode.Add("pool", poolNode);
     }
+    
+    Jzon::Object governorNode;
+    governor.getState(governorNode);
+    outputNode.Add("governor", governorNode);
+    
+    Jzon::Object clusterNode;
+    cluster.getState(clusterNode);
+    outputNode.Add("cluster", clusterNode);
 
-    if (!params->Has("id") || !params->Has("type")) {
-        outputNode.Add("error", "Error creating filter. Invalid JSON format...");
-        return;
-    }
+    Jzon::Object snapshotNode;
+    snapshot.getState(snapshotNode);
+    outputNode.Add("snapshot", snapshotNode);
     
-    if (!params->Get("id").IsNumber()){
-        outputNode.Add("error", "Error creating filter. ID must be numeric...");
-        return;
-    }
+    Jzon::Object framePoolNode;
+    FramePool::getInstance()->getState(framePoolNode);
+    outputNode.Add("framePool", framePoolNode);
     
-    id = params->Get("id").ToInt();
-    fType = utils::getFilterTypeFromString(params->Get("type").ToString());
+    Jzon::Object scalerPoolNode;
+    ScalerPool::getInstance()->getState(scalerPoolNode);
+    outputNode.Add("scalerPool", scalerPoolNode);
     
-    if (! createFilter(id, fType)){
-        outputNode.Add("error", "Error creating filter.");
-    } else {
-        outputNode.Add("error", Jzon::null);
-    }
+    Jzon::Object threadBudgetNode;
+    ThreadBudget::getInstance()->getState(threadBudgetNode);
+    outputNode.Add("threadBudget", threadBudgetNode);
+    
+    Jzon::Object memoryBudgetNode;
+    MemoryBudget::getInstance()->getState(memoryBudgetNode);
+    memoryBudgetNode.Add("usedBytes", (double) (MemoryBudget::getInstance()->getQueuesBytes() + getUnchargedBytes()));
+    outputNode.Add("memoryBudget", memoryBudgetNode);
+    
+    Jzon::Object locksNode;
+    ProfiledMutex::getState(locksNode);
+    outputNode.Add("locks", locksNode);
+    
+    Jzon::Object countersNode;
+    PerfCounters::getState(countersNode);
+    outputNode.Add("counters", countersNode);
+}
 
+//NOTE: pooled idle frames are held by the process even if no queue uses them
+size_t PipelineManager::getUnchargedBytes()
+{
+    size_t bytes = FramePool::getInstance()->getIdleBytes();
+    
+    for (auto it : filters) {
+        bytes += it.second->getInternalBytes();
+    }
+    
+    return bytes;
 }
 
-void PipelineManager::createPathEvent(Jzon::Node* params, Jzon::Object &outputNode)
+//NOTE: the path queues are the ones fed by its origin writer and by each of its filters
+size_t PipelineManager::getPathMemoryBytes(Path* path)
 {
-    std::vector<int> filtersIds;
-    int id, orgFilterId, dstFilterId;
-    int orgWriterId = -1;
+    size_t bytes = MemoryBudget::getInstance()->getQueueBytes(path->getOriginFilterID(), path->getOrgWriterID());
+    
+    for (auto id : path->getFilters()) {
+        bytes += MemoryBudget::getInstance()->getQueueBytes(id, DEFAULT_ID);
+    }
+    
+    return bytes;
+}
+
+void PipelineManager::getMetrics(std::string &buffer, bool delta)
+{
+    static const char* names[FILTER_METRICS] = {"calls", "frames", "waits", "wallTime", "cpuTime",
+                                                "readFrames", "writtenFrames"};
+    uint64_t values[FILTER_METRICS];
+    bool firstFilter = true;
+    bool firstValue, added;
+    bool removed = false;
+
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    buffer.reserve(buffer.size() + filters.size()*160);
+    buffer += "{\"filters\":{";
+
+    for (auto it : filters) {
+        it.second->getMetrics(values);
+        added = lastMetrics.count(it.first) == 0;
+        std::array<uint64_t, FILTER_METRICS> &last = lastMetrics[it.first];
+        firstValue = true;
+
+        for (unsigned i = 0; i < FILTER_METRICS; i++) {
+            //NOTE: all the values of filters added since the previous snapshot are written
+            if (delta && !added && values[i] == last[i]) {
+                continue;
+            }
+
+            if (firstValue) {
+                buffer += firstFilter ? "\"" : ",\"";
+                buffer += std::to_string(it.first) + "\":{";
+                firstFilter = false;
+            } else {
+                buffer += ",";
+            }
+
+            buffer += "\"";
+            buffer += names[i];
+            buffer += "\":" + std::to_string(values[i]);
+            firstValue = false;
+        }
+
+        if (!firstValue) {
+            buffer += "}";
+        }
+
+        std::copy(values, values + FILTER_METRICS, last.begin());
+    }
+
+    buffer += "}";
+
+    for (auto it = lastMetrics.begin(); it != lastMetrics.end(); ) {
+        if (filters.count(it->first) > 0) {
+            ++it;
+            continue;
+        }
+
+        if (delta) {
+            buffer += removed ? "," : ",\"removed\":[";
+            buffer += std::to_string(it->first);
+            removed = true;
+        }
+
+        it = lastMetrics.erase(it);
+    }
+
+    buffer += removed ? "]}" : "}";
+}
+
+void PipelineManager::governLoad()
+{
+    std::chrono::system_clock::time_point now;
+    std::chrono::microseconds residency(0);
+    int64_t elapsed;
+    int64_t busyTime;
+    float utilisation = 0;
+
+    //NOTE: periodic tasks skip a round instead of waiting for a control operation to finish
+    std::unique_lock<std::recursive_mutex> guard(graphMtx, std::try_to_lock);
+
+    if (!guard.owns_lock() || !governor.isEnabled() || !pool) {
+        return;
+    }
+
+    now = std::chrono::system_clock::now();
+    if (now - lastGovern < governor.getPeriod()) {
+        return;
+    }
+
+    elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - lastGovern).count();
+    busyTime = pool->getBusyTime();
+
+    if (elapsed > 0 && pool->getActiveWorkers() > 0) {
+        utilisation = std::min((float) (busyTime - lastBusyTime)/(elapsed*pool->getActiveWorkers()), 1.0f);
+    }
+
+    lastGovern = now;
+    lastBusyTime = busyTime;
+
+    for (auto it : filters) {
+        residency = std::max(residency, it.second->getMaxReaderResidency());
+    }
+
+    governor.update(utilisation, residency);
+    governor.govern(filters);
+}
+
+void PipelineManager::exportMetrics()
+{
+    uint64_t values[FILTER_METRICS];
+    std::chrono::system_clock::time_point now;
+    BaseFilter* f;
+    size_t lostBlocs;
+
+    std::unique_lock<std::recursive_mutex> guard(graphMtx, std::try_to_lock);
+
+    if (!guard.owns_lock() || metrics.getPort() == 0) {
+        return;
+    }
+
+    now = std::chrono::system_clock::now();
+    if (now - lastExport < metricsPeriod) {
+        return;
+    }
+
+    lastExport = now;
+
+    for (auto it : filters) {
+        Jzon::Object state;
+        MetricLabels labels;
+
+        labels["filter"] = std::to_string(it.first);
+        labels["type"] = utils::getFilterTypeAsString(it.second->getType());
+
+        //NOTE: rates are left to Prometheus, the counters are taken without locking the filter
+        it.second->getMetrics(values);
+        metrics.add("filter_calls_total", "counter", "Processing calls", labels, values[0]);
+        metrics.add("filter_processed_frames_total", "counter", "Frames processed", labels, values[1]);
+        metrics.add("filter_waits_total", "counter", "Processing calls without frames", labels, values[2]);
+        metrics.add("filter_wall_seconds_total", "counter", "Wall time spent processing", labels, values[3]/1e6);
+        metrics.add("filter_cpu_seconds_total", "counter", "CPU time spent processing", labels, values[4]/1e6);
+        metrics.add("filter_read_frames_total", "counter", "Frames read from the input queues", labels, values[5]);
+        metrics.add("filter_written_frames_total", "counter", "Frames written to the output queues", labels, values[6]);
+
+        //NOTE: the profile is already exported as counters, the rest of the state (i.e. encoder
+        //      bitrates or RTCP reports of the transmitter sessions) is exported as gauges
+        it.second->getState(state);
+        state.Remove("profile");
+        metrics.addState("filter_state", state, labels);
+    }
+
+    for (auto it : paths) {
+        MetricLabels labels;
+
+        labels["path"] = std::to_string(it.first);
+        labels["origin"] = std::to_string(it.second->getOriginFilterID());
+        labels["destination"] = std::to_string(it.second->getDestinationFilterID());
+
+        metrics.add("path_queue_frames", "gauge", "Frames queued along the path", labels, it.second->getQueueFrames());
+        metrics.add("path_queue_bytes", "gauge", "Bytes queued along the path", labels, it.second->getQueueBytes());
+        metrics.add("path_memory_bytes", "gauge", "Bytes allocated by the queues along the path", labels, getPathMemoryBytes(it.second));
+
+        f = getFilter(it.second->getDestinationFilterID());
+        if (!f) {
+            continue;
+        }
+
+        lostBlocs = f->getLostBlocs(it.second->getDstReaderID());
+        for (auto itt : it.second->getFilters()) {
+            if (getFilter(itt)) {
+                lostBlocs += getFilter(itt)->getLostBlocs(DEFAULT_ID);
+            }
+        }
+
+        metrics.add("path_avg_delay_seconds", "gauge", "Average frame delay at the destination reader", labels,
+                    f->getAvgReaderDelay(it.second->getDstReaderID()).count()/1e6);
+
+        for (auto q : {std::make_pair(50, "0.5"), std::make_pair(90, "0.9"), std::make_pair(99, "0.99"),
+                       std::make_pair(100, "1")}) {
+            MetricLabels quantile = labels;
+            quantile["quantile"] = q.second;
+            metrics.add("path_delay_seconds", "gauge", "Frame delay percentiles at the destination reader",
+                        quantile, f->getReaderDelayPercentile(it.second->getDstReaderID(), q.first).count()/1e6);
+        }
+        metrics.add("path_lost_blocs_total", "counter", "Blocs lost along the path", labels, lostBlocs);
+    }
+
+    if (pool) {
+        metrics.add("pool_workers", "gauge", "Active workers", MetricLabels(), pool->getActiveWorkers());
+        metrics.add("pool_reserved_workers", "gauge", "Workers reserved for high priority filters", MetricLabels(),
+                    pool->getReservedWorkers());
+        metrics.add("pool_utilisation", "gauge", "Busy fraction of the workers", MetricLabels(), pool->getUtilisation());
+    }
+
+    metrics.publish();
+}
+
+bool PipelineManager::createFilterFromParams(Jzon::Node* params, Jzon::Object &outputNode, bool start,
+                                             BaseFilter* built)
+{
+    int id;
+    FilterType fType;
+    RunnablePriority priority = NORMAL_PRIORITY;
+    ComposeBackend backend = CPU_COMPOSE;
+
+    if(!params) {
+        outputNode.Add("error", "Error creating filter. Invalid JSON format...");
+        return false;
+    }
+
+    if (!params->Has("id") || !params->Has("type")) {
+        outputNode.Add("error", "Error creating filter. Invalid JSON format...");
+        return false;
+    }
+    
+    if (!params->Get("id").IsNumber()){
+        outputNode.Add("error", "Error creating filter. ID must be numeric...");
+        return false;
+    }
+    
+    id = params->Get("id").ToInt();
+    fType = utils::getFilterTypeFromString(params->Get("type").ToString());
+    
+    if (params->Has("priority")){
+        priority = utils::getPriorityFromString(params->Get("priority").ToString());
+    }
+    
+    if (priority == RP_NONE){
+        outputNode.Add("error", "Error creating filter. Invalid priority...");
+        return false;
+    }
+    
+    if (params->Has("backend")){
+        backend = utils::getComposeBackendFromString(params->Get("backend").ToString());
+    }
+    
+    if (backend == CB_NONE){
+        outputNode.Add("error", "Error creating filter. Invalid backend...");
+        return false;
+    }
+    
+    if (!MemoryBudget::getInstance()->fits(MEMORY_FILTER_RESERVE, getUnchargedBytes())){
+        outputNode.Add("error", "Error creating filter. Memory budget exceeded...");
+        return false;
+    }
+    
+    if (! createFilter(id, fType, backend, params, start, built)){
+        outputNode.Add("error", "Error creating filter.");
+        return false;
+    }
+    
+    if (params->Has("edgeTriggered") && params->Get("edgeTriggered").IsBool()){
+        filters[id]->setEdgeTriggered(params->Get("edgeTriggered").ToBool());
+    }
+    
+    if (params->Has("burstFrames") && params->Get("burstFrames").IsNumber()){
+        filters[id]->setBurst(std::max(params->Get("burstFrames").ToInt(), 0), 
+                              std::chrono::microseconds(params->Has("burstTime") && params->Get("burstTime").IsNumber() ?
+                                                        params->Get("burstTime").ToInt() : 0));
+    }
+    
+    if (params->Has("affinity") && params->Get("affinity").IsNumber()){
+        filters[id]->setAffinity(params->Get("affinity").ToInt());
+    }
+    
+    filters[id]->setPriority(priority);
+    
+    if (params->Has("dedicated") && params->Get("dedicated").IsBool() &&
+        !pool->setDedicated(filters[id], params->Get("dedicated").ToBool())){
+        outputNode.Add("error", "Error creating filter. Could not set the execution mode...");
+        return false;
+    }
+    
+    return true;
+}
+
+void PipelineManager::createFilterEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    BaseFilter* built;
+
+    //NOTE: codecs are opened without the graph lock, so the filters of concurrent requests are built in parallel
+    built = prebuildFilter(params);
+
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (createFilterFromParams(params, outputNode, true, built)) {
+        snapshot.addFilter(*params);
+        snapshot.commit();
+        outputNode.Add("error", Jzon::null);
+        return;
+    }
+
+    for (auto it : filters) {
+        if (it.second == built) {
+            return;
+        }
+    }
+
+    delete built;
+}
+
+bool PipelineManager::getOutputProfile(Jzon::Node &node, OutputProfile &profile)
+{
+    if (!node.IsObject() || !node.Has("codec") || !node.Get("codec").IsString()) {
+        return false;
+    }
+
+    profile.codec = utils::getVideoCodecFromString(node.Get("codec").ToString());
+
+    if (profile.codec == VC_NONE) {
+        return false;
+    }
+
+    for (auto key : {"width", "height", "bitrate"}) {
+        if (node.Has(key) && (!node.Get(key).IsNumber() || node.Get(key).ToInt() < 0)) {
+            return false;
+        }
+    }
+
+    //NOTE: the bitrate is the highest one accepted, in kbps, as the encoders one
+    profile.width = node.Has("width") ? node.Get("width").ToInt() : 0;
+    profile.height = node.Has("height") ? node.Get("height").ToInt() : 0;
+    profile.bitrate = node.Has("bitrate") ? node.Get("bitrate").ToInt() : 0;
+
+    return true;
+}
+
+bool PipelineManager::createPathFromParams(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::vector<int> filtersIds;
+    int id, orgFilterId, dstFilterId;
+    int orgWriterId = -1;
     int dstReaderId = -1;
+    size_t queueBytes;
+    OutputProfile profile = {VC_NONE, 0, 0, 0};
 
     if(!params) {
         outputNode.Add("error", "Error creating path. Invalid JSON format...");
-        return;
+        return false;
     }
 
     if (!params->Has("id") || !params->Has("orgFilterId") ||
           !params->Has("dstFilterId") || !params->Has("orgWriterId") ||
             !params->Has("dstReaderId")) {
         outputNode.Add("error", "Error creating path. Invalid JSON format...");
+        return false;
+    }
+
+    id = params->Get("id").ToInt();
+    orgFilterId = params->Get("orgFilterId").ToInt();
+    dstFilterId = params->Get("dstFilterId").ToInt();
+    orgWriterId = params->Get("orgWriterId").ToInt();
+    dstReaderId = params->Get("dstReaderId").ToInt();
+    
+    if (!params->Has("midFiltersIds") || !params->Get("midFiltersIds").IsArray()){
+        outputNode.Add("error", "Invalid midfilters array");
+        return false;
+    }
+
+    Jzon::Array& jsonFiltersIds = params->Get("midFiltersIds").AsArray();
+
+    for (Jzon::Array::iterator it = jsonFiltersIds.begin(); it != jsonFiltersIds.end(); ++it) {
+        filtersIds.push_back((*it).ToInt());
+    }
+    
+    if ((params->Has("queueFrames") && (!params->Get("queueFrames").IsNumber() || params->Get("queueFrames").ToInt() < 0)) ||
+        (params->Has("queueBytes") && (!params->Get("queueBytes").IsNumber() || params->Get("queueBytes").ToDouble() < 0))) {
+        outputNode.Add("error", "Error creating path. Invalid queue size...");
+        return false;
+    }
+    
+    if (params->Has("dropPolicy") && utils::getDropPolicyFromString(params->Get("dropPolicy").ToString()) == DP_NONE) {
+        outputNode.Add("error", "Error creating path. Invalid drop policy...");
+        return false;
+    }
+    
+    if (params->Has("maxLatency") && (!params->Get("maxLatency").IsNumber() || params->Get("maxLatency").ToInt() < 0)) {
+        outputNode.Add("error", "Error creating path. Invalid maximum latency...");
+        return false;
+    }
+    
+    if (params->Has("dropTarget") && (!params->Get("dropTarget").IsNumber() || params->Get("dropTarget").ToDouble() < 0 || 
+                                      params->Get("dropTarget").ToDouble() >= 1)) {
+        outputNode.Add("error", "Error creating path. Invalid drop target...");
+        return false;
+    }
+    
+    if (params->Has("outputProfile") && !getOutputProfile(params->Get("outputProfile"), profile)) {
+        outputNode.Add("error", "Error creating path. Invalid output profile...");
+        return false;
+    }
+    
+    //NOTE: a queue is expected to fill its bytes budget, if it has one, at every hop of the path
+    queueBytes = params->Has("queueBytes") ? (size_t) params->Get("queueBytes").ToDouble() : 0;
+    if (!MemoryBudget::getInstance()->fits((filtersIds.size() + 1)*(queueBytes > 0 ? queueBytes : MEMORY_QUEUE_RESERVE), 
+                                           getUnchargedBytes())) {
+        outputNode.Add("error", "Error creating path. Memory budget exceeded...");
+        return false;
+    }
+    
+    if (!createPath(id, orgFilterId, dstFilterId, orgWriterId, dstReaderId, filtersIds)) {
+        outputNode.Add("error", "Error creating path. Check introduced filter IDs...");
+        return false;
+    }
+    
+    paths[id]->setQueueSize(params->Has("queueFrames") ? params->Get("queueFrames").ToInt() : 0, queueBytes);
+    
+    if (params->Has("dropPolicy")) {
+        paths[id]->setDropPolicy(utils::getDropPolicyFromString(params->Get("dropPolicy").ToString()));
+    }
+    
+    //NOTE: the latency bound is given in milliseconds
+    if (params->Has("maxLatency")) {
+        paths[id]->setMaxLatency(std::chrono::milliseconds(params->Get("maxLatency").ToInt()));
+    }
+    
+    //NOTE: the queues depth given or the filters default is the ceiling of the tuned one
+    if (params->Has("dropTarget")) {
+        paths[id]->setDropTarget(params->Get("dropTarget").ToDouble());
+    }
+    
+    paths[id]->setOutputProfile(profile);
+
+    //NOTE: inputs of a synchronised filter (e.g. the tracks of a muxer) only wait for the ones of their group
+    if (params->Has("syncGroup") && params->Get("syncGroup").IsNumber()) {
+        filters[dstFilterId]->setSyncGroup(paths[id]->getDstReaderID(), params->Get("syncGroup").ToInt());
+    }
+
+    if (!connectPath(id)) {
+        outputNode.Add("error", "Error connecting path. Better pray Jesus...");
+        return false;
+    }
+
+    return true;
+}
+
+void PipelineManager::createPathEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (createPathFromParams(params, outputNode)) {
+        snapshot.addPath(*params);
+        snapshot.commit();
+        outputNode.Add("error", Jzon::null);
+    }
+}
+
+std::string PipelineManager::checkGraph(Jzon::Node* params)
+{
+    std::set<int> newFilters, newPaths;
+    int id;
+
+    for (auto key : {"filters", "paths", "events"}) {
+        if (params->Has(key) && !params->Get(key).IsArray()) {
+            return "Error creating graph. Invalid filters, paths or events array...";
+        }
+    }
+
+    if (params->Has("filters")) {
+        for (auto &f : params->Get("filters").AsArray()) {
+            if (!f.IsObject() || !f.Has("id") || !f.Get("id").IsNumber() || !f.Has("type")) {
+                return "Error creating graph. Invalid filter...";
+            }
+
+            id = f.Get("id").ToInt();
+
+            if (id < 0 || filters.count(id) > 0 || !newFilters.insert(id).second) {
+                return "Error creating graph. Filter " + std::to_string(id) + " ID is not unique...";
+            }
+
+            if (utils::getFilterTypeFromString(f.Get("type").ToString()) == FT_NONE) {
+                return "Error creating graph. Filter " + std::to_string(id) + " type is not valid...";
+            }
+        }
+    }
+
+    if (params->Has("paths")) {
+        for (auto &p : params->Get("paths").AsArray()) {
+            if (!p.IsObject() || !p.Has("id") || !p.Has("orgFilterId") || !p.Has("dstFilterId") ||
+                !p.Has("orgWriterId") || !p.Has("dstReaderId") || !p.Has("midFiltersIds") ||
+                !p.Get("midFiltersIds").IsArray()) {
+                return "Error creating graph. Invalid path...";
+            }
+
+            id = p.Get("id").ToInt();
+
+            if (paths.count(id) > 0 || !newPaths.insert(id).second) {
+                return "Error creating graph. Path " + std::to_string(id) + " ID is not unique...";
+            }
+
+            std::vector<int> ids = {p.Get("orgFilterId").ToInt(), p.Get("dstFilterId").ToInt()};
+
+            for (auto &m : p.Get("midFiltersIds").AsArray()) {
+                ids.push_back(m.ToInt());
+            }
+
+            for (auto fId : ids) {
+                if (filters.count(fId) == 0 && newFilters.count(fId) == 0) {
+                    return "Error creating graph. Path " + std::to_string(id) + " uses unknown filter " + 
+                           std::to_string(fId) + "...";
+                }
+            }
+        }
+    }
+
+    if (params->Has("events")) {
+        for (auto &e : params->Get("events").AsArray()) {
+            if (!e.IsObject() || !e.Has("filterId") || !e.Has("action") || !e.Has("params")) {
+                return "Error creating graph. Invalid event...";
+            }
+
+            id = e.Get("filterId").ToInt();
+
+            if (filters.count(id) == 0 && newFilters.count(id) == 0) {
+                return "Error creating graph. Event for unknown filter " + std::to_string(id) + "...";
+            }
+        }
+    }
+
+    return "";
+}
+
+//NOTE: filters and paths of the graph did not exist before, the existing ones are only disconnected from them
+void PipelineManager::rollbackGraph(Jzon::Node* params)
+{
+    std::vector<int> newPaths, newFilters, pathFilters;
+    std::vector<BaseFilter*> chain;
+    Path *path;
+
+    if (params->Has("paths")) {
+        for (auto &p : params->Get("paths").AsArray()) {
+            newPaths.insert(newPaths.begin(), p.Get("id").ToInt());
+        }
+    }
+
+    if (params->Has("filters")) {
+        for (auto &f : params->Get("filters").AsArray()) {
+            newFilters.insert(newFilters.begin(), f.Get("id").ToInt());
+        }
+    }
+
+    for (auto id : newPaths) {
+        if (paths.count(id) == 0) {
+            continue;
+        }
+
+        path = paths[id];
+        pathFilters = path->getFilters();
+
+        if (filters.count(path->getDestinationFilterID()) > 0) {
+            filters[path->getDestinationFilterID()]->disconnectReader(path->getDstReaderID());
+        }
+
+        //NOTE: existing filters fused by the path are scheduled again
+        for (auto fId : pathFilters) {
+            if (filters.count(fId) > 0 && !usedByOtherPath(fId, id)) {
+                chain = filters[fId]->getFused();
+                filters[fId]->fuse(std::vector<BaseFilter*>());
+
+                for (auto f : chain) {
+                    if (std::find(newFilters.begin(), newFilters.end(), f->getId()) == newFilters.end()) {
+                        pool->addTask(f);
+                    }
+                }
+                break;
+            }
+        }
+
+        for (auto fId : pathFilters) {
+            if (filters.count(fId) > 0 && !usedByOtherPath(fId, id)) {
+                filters[fId]->disconnectReader(DEFAULT_ID);
+                filters[fId]->disconnectWriter(DEFAULT_ID);
+            }
+        }
+
+        //NOTE: the origin writer of a path sharing a decoder belongs to the other path
+        if (filters.count(path->getOriginFilterID()) > 0 &&
+            (pathFilters.empty() || !usedByOtherPath(pathFilters.front(), id))) {
+            filters[path->getOriginFilterID()]->disconnectWriter(path->getOrgWriterID());
+        }
+
+        delete path;
+        paths.erase(id);
+    }
+
+    for (auto id : newFilters) {
+        if (filters.count(id) == 0) {
+            continue;
+        }
+
+        pool->removeTask(id);
+        delete filters[id];
+        filters.erase(id);
+    }
+}
+
+void PipelineManager::createGraphEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::vector<int> newFilters;
+    std::map<int, BaseFilter*> built;
+    std::string error;
+    int delay;
+    int id;
+
+    if (!params) {
+        outputNode.Add("error", "Error creating graph. Invalid JSON format...");
+        return;
+    }
+
+    {
+        std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+        if (!(error = checkGraph(params)).empty()) {
+            outputNode.Add("error", error);
+            return;
+        }
+    }
+
+    //NOTE: the new filters are built concurrently and without the graph lock, then registered in order, they
+    //      are not scheduled until the whole graph is connected and configured. Built filters not registered
+    //      are deleted here
+    buildFilters(params, built);
+
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    //NOTE: another request may have taken the ids while the filters were built
+    if (!(error = checkGraph(params)).empty()) {
+        for (auto it : built) {
+            delete it.second;
+        }
+        outputNode.Add("error", error);
+        return;
+    }
+
+    if (params->Has("filters")) {
+        for (auto &f : params->Get("filters").AsArray()) {
+            id = f.Get("id").ToInt();
+            if (!createFilterFromParams(&f, outputNode, false, built.count(id) > 0 ? built[id] : NULL)) {
+                for (auto it : built) {
+                    if (filters.count(it.first) == 0) {
+                        delete it.second;
+                    }
+                }
+                rollbackGraph(params);
+                return;
+            }
+            newFilters.push_back(id);
+        }
+    }
+
+    if (params->Has("paths")) {
+        for (auto &p : params->Get("paths").AsArray()) {
+            if (!createPathFromParams(&p, outputNode)) {
+                rollbackGraph(params);
+                return;
+            }
+        }
+    }
+
+    //NOTE: events of filters not running yet are processed before their first frame, the ones of filters
+    //      deleted when connecting (shared decoders, bypassed transcoders) are dropped
+    if (params->Has("events")) {
+        for (auto &e : params->Get("events").AsArray()) {
+            if (filters.count(e.Get("filterId").ToInt()) == 0) {
+                continue;
+            }
+            delay = e.Has("delay") ? e.Get("delay").ToInt() : -1;
+            filters[e.Get("filterId").ToInt()]->pushEvent(Event(e, Clock::now(), delay));
+        }
+    }
+
+    startFilters(newFilters);
+    recordGraph(params);
+    outputNode.Add("error", Jzon::null);
+}
+
+//NOTE: the events of filters deleted when connecting are kept, a restore drops them again
+void PipelineManager::recordGraph(Jzon::Node* params)
+{
+    if (params->Has("filters")) {
+        for (auto &f : params->Get("filters").AsArray()) {
+            snapshot.addFilter(f);
+        }
+    }
+
+    if (params->Has("paths")) {
+        for (auto &p : params->Get("paths").AsArray()) {
+            snapshot.addPath(p);
+        }
+    }
+
+    if (params->Has("events")) {
+        for (auto &e : params->Get("events").AsArray()) {
+            snapshot.addEvent(e);
+        }
+    }
+
+    snapshot.commit();
+}
+
+bool PipelineManager::pushFilterEvent(const Jzon::Node &event, int delay)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (!event.Has("filterId") || filters.count(event.Get("filterId").ToInt()) == 0) {
+        return false;
+    }
+
+    filters[event.Get("filterId").ToInt()]->pushEvent(Event(event.AsObject(), Clock::now(), delay));
+    recordFilterEvent(event);
+    return true;
+}
+
+void PipelineManager::recordFilterEvent(const Jzon::Node &event)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    snapshot.addEvent(event);
+    snapshot.commit();
+}
+
+void PipelineManager::createClusterGraphEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::vector<ClusterNode> nodes;
+    std::vector<size_t> created;
+    std::string error;
+    int linkIdBase = 0;
+
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (!params || !params->Has("graph") || !params->Get("graph").IsObject() || !params->Has("nodes")) {
+        outputNode.Add("error", "Error creating cluster graph. Invalid JSON format...");
         return;
     }
 
-    id = params->Get("id").ToInt();
-    orgFilterId = params->Get("orgFilterId").ToInt();
-    dstFilterId = params->Get("dstFilterId").ToInt();
-    orgWriterId = params->Get("orgWriterId").ToInt();
-    dstReaderId = params->Get("dstReaderId").ToInt();
-    
-    if (!params->Has("midFiltersIds") || !params->Get("midFiltersIds").IsArray()){
-        outputNode.Add("error", "Invalid midfilters array");
+    Jzon::Node &graph = params->Get("graph");
+
+    if (!cluster.parseNodes(params->Get("nodes"), nodes, error)) {
+        outputNode.Add("error", error);
         return;
     }
 
-    Jzon::Array& jsonFiltersIds = params->Get("midFiltersIds").AsArray();
+    for (auto &n : nodes) {
+        if (n.local) {
+            Jzon::Object state;
+            getStateEvent(NULL, state);
+            ClusterCoordinator::setCapacity(state, n);
+        } else if (!cluster.queryCapacity(n)) {
+            outputNode.Add("error", "Error creating cluster graph. Node " + n.name + " does not answer...");
+            return;
+        }
+    }
 
-    for (Jzon::Array::iterator it = jsonFiltersIds.begin(); it != jsonFiltersIds.end(); ++it) {
-        filtersIds.push_back((*it).ToInt());
+    //NOTE: link IDs follow the graph and local ones unless the orchestrator reserves a range
+    if (params->Has("linkIdBase") && params->Get("linkIdBase").IsNumber()) {
+        linkIdBase = params->Get("linkIdBase").ToInt();
+    } else {
+        for (auto key : {"filters", "paths"}) {
+            if (graph.Has(key) && graph.Get(key).IsArray()) {
+                for (auto &e : graph.Get(key).AsArray()) {
+                    if (e.Has("id") && e.Get("id").IsNumber()) {
+                        linkIdBase = std::max(linkIdBase, e.Get("id").ToInt() + 1);
+                    }
+                }
+            }
+        }
+        if (!filters.empty()) {
+            linkIdBase = std::max(linkIdBase, filters.rbegin()->first + 1);
+        }
+        if (!paths.empty()) {
+            linkIdBase = std::max(linkIdBase, paths.rbegin()->first + 1);
+        }
     }
-    
-    if (!createPath(id, orgFilterId, dstFilterId, orgWriterId, dstReaderId, filtersIds)) {
-        outputNode.Add("error", "Error creating path. Check introduced filter IDs...");
+
+    ClusterPlanner planner(nodes, linkIdBase);
+
+    if (!planner.plan(graph)) {
+        outputNode.Add("error", "Error creating cluster graph. " + planner.getError());
         return;
     }
 
-    if (!connectPath(id)) {
-        outputNode.Add("error", "Error connecting path. Better pray Jesus...");
-        return;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        Jzon::Object &nodeGraph = planner.getGraph(i);
+        Jzon::Object result;
+
+        if (nodeGraph.Get("filters").GetCount() == 0) {
+            continue;
+        }
+
+        if (nodes[i].local) {
+            createGraphEvent(&nodeGraph, result);
+            if (result.Has("error") && !result.Get("error").IsNull()) {
+                error = "Error creating cluster graph. Node " + nodes[i].name + ": " + result.Get("error").ToString();
+            }
+        } else {
+            cluster.createGraph(nodes[i], nodeGraph, error);
+        }
+
+        if (!error.empty()) {
+            for (auto n : created) {
+                if (nodes[n].local) {
+                    for (auto &p : planner.getGraph(n).Get("paths").AsArray()) {
+                        snapshot.removePath(p.Get("id").ToInt());
+                    }
+                    for (auto &f : planner.getGraph(n).Get("filters").AsArray()) {
+                        removeFilter(f.Get("id").ToInt());
+                        snapshot.removeFilter(f.Get("id").ToInt());
+                    }
+                    snapshot.commit();
+                } else {
+                    cluster.removeFilters(nodes[n], planner.getGraph(n));
+                }
+            }
+            cluster.failed();
+            outputNode.Add("error", error);
+            return;
+        }
+
+        created.push_back(i);
+    }
+
+    cluster.deployed(nodes, planner, graph);
+
+    Jzon::Object placement;
+    for (auto &f : graph.Get("filters").AsArray()) {
+        placement.Add(std::to_string(f.Get("id").ToInt()), nodes[planner.getNode(f.Get("id").ToInt())].name);
     }
 
+    outputNode.Add("placement", placement);
+    outputNode.Add("links", (int) planner.getLinks());
     outputNode.Add("error", Jzon::null);
 }
 
@@ -617,6 +2252,8 @@ void PipelineManager::removePathEvent(Jzon::Node* params, Jzon::Object &outputNo
 {
     int id;
 
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
     if(!params) {
         outputNode.Add("error", "Error removing path. Invalid JSON format...");
         return;
@@ -634,6 +2271,38 @@ void PipelineManager::removePathEvent(Jzon::Node* params, Jzon::Object &outputNo
         return;
     }
 
+    snapshot.removePath(id);
+    snapshot.commit();
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::suspendPathEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    if (!params || !params->Has("id") || !params->Get("id").IsNumber()) {
+        outputNode.Add("error", "Error suspending path. Invalid JSON format...");
+        return;
+    }
+
+    if (!suspendPath(params->Get("id").ToInt(), true)) {
+        outputNode.Add("error", "Error suspending path. Internal error...");
+        return;
+    }
+
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::resumePathEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    if (!params || !params->Has("id") || !params->Get("id").IsNumber()) {
+        outputNode.Add("error", "Error resuming path. Invalid JSON format...");
+        return;
+    }
+
+    if (!suspendPath(params->Get("id").ToInt(), false)) {
+        outputNode.Add("error", "Error resuming path. Internal error...");
+        return;
+    }
+
     outputNode.Add("error", Jzon::null);
 }
 
@@ -641,6 +2310,8 @@ void PipelineManager::removeFilterEvent(Jzon::Node* params, Jzon::Object &output
 {
     int id;
 
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
     if(!params) {
         outputNode.Add("error", "Error removing filter. Invalid JSON format...");
         return;
@@ -658,9 +2329,423 @@ void PipelineManager::removeFilterEvent(Jzon::Node* params, Jzon::Object &output
         return;
     }
 
+    snapshot.removeFilter(id);
+    snapshot.commit();
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::setThroughput(bool throughput_)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    throughput = throughput_;
+    
+    for (auto it : filters) {
+        it.second->setThroughput(throughput);
+    }
+}
+
+bool PipelineManager::isEndOfStream()
+{
+    bool tails = false;
+    
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    for (auto it : filters) {
+        if (it.second->getMaxWriters() > 0) {
+            continue;
+        }
+        
+        if (!it.second->isEndOfStream()) {
+            return false;
+        }
+        tails = true;
+    }
+    
+    return tails;
+}
+
+void PipelineManager::configurePoolEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (!params) {
+        outputNode.Add("error", "Error configuring pool. Invalid JSON format...");
+        return;
+    }
+    
+    if (params->Has("pinWorkers") && params->Get("pinWorkers").IsBool()){
+        pinnedWorkers = params->Get("pinWorkers").ToBool();
+        if (pool && !pool->pinWorkers(pinnedWorkers)){
+            outputNode.Add("error", "Error configuring pool. Workers could not be pinned...");
+            return;
+        }
+    }
+    
+    if (params->Has("reservedWorkers") && params->Get("reservedWorkers").IsNumber()){
+        if (params->Get("reservedWorkers").ToInt() < 0 || 
+            (pool && !pool->reserveWorkers(params->Get("reservedWorkers").ToInt()))){
+            outputNode.Add("error", "Error configuring pool. Invalid number of reserved workers...");
+            return;
+        }
+        reservedWorkers = params->Get("reservedWorkers").ToInt();
+    }
+    
+    if (params->Has("minWorkers") && params->Has("maxWorkers")){
+        if (!params->Get("minWorkers").IsNumber() || !params->Get("maxWorkers").IsNumber() ||
+            params->Get("minWorkers").ToInt() <= 0 || 
+            (pool && !pool->setElastic(params->Get("minWorkers").ToInt(), params->Get("maxWorkers").ToInt()))){
+            outputNode.Add("error", "Error configuring pool. Invalid workers bounds...");
+            return;
+        }
+        minWorkers = params->Get("minWorkers").ToInt();
+        maxWorkers = params->Get("maxWorkers").ToInt();
+    }
+    
+    if (params->Has("handOff") && params->Get("handOff").IsBool()){
+        handOff = params->Get("handOff").ToBool();
+        if (pool){
+            pool->setHandOff(handOff);
+        }
+    }
+    
+    //NOTE: codec threads are rebalanced between the filters, encoders apply it on next frame
+    if (params->Has("threadBudget") && params->Get("threadBudget").IsNumber()){
+        if (params->Get("threadBudget").ToInt() < 0) {
+            outputNode.Add("error", "Error configuring pool. Invalid thread budget...");
+            return;
+        }
+        ThreadBudget::getInstance()->setBudget(params->Get("threadBudget").ToInt());
+    }
+    
+    //NOTE: memory already held is kept, the budget only refuses new filters and paths
+    if (params->Has("memoryBudget") && params->Get("memoryBudget").IsNumber()){
+        if (params->Get("memoryBudget").ToDouble() < 0) {
+            outputNode.Add("error", "Error configuring pool. Invalid memory budget...");
+            return;
+        }
+        MemoryBudget::getInstance()->setBudget((size_t) params->Get("memoryBudget").ToDouble());
+    }
+    
+    //NOTE: it only applies to raw video frames allocated afterwards
+    if (params->Has("hugePages") && params->Get("hugePages").IsBool()){
+        Frame::setHugePages(params->Get("hugePages").ToBool());
+    }
+    
+    if (params->Has("throughput") && params->Get("throughput").IsBool()){
+        setThroughput(params->Get("throughput").ToBool());
+    }
+    
+    snapshot.addSetting("configurePool", *params);
+    snapshot.commit();
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::configureMetricsEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (!params) {
+        outputNode.Add("error", "Error configuring metrics. Invalid JSON format...");
+        return;
+    }
+
+    if (params->Has("period") && params->Get("period").IsNumber()) {
+        if (params->Get("period").ToInt() <= 0) {
+            outputNode.Add("error", "Error configuring metrics. Invalid period...");
+            return;
+        }
+        metricsPeriod = std::chrono::seconds(params->Get("period").ToInt());
+    }
+
+    if (params->Has("port") && params->Get("port").IsNumber()) {
+        if (params->Get("port").ToInt() < 0) {
+            metrics.stop();
+        } else if (params->Get("port").ToInt() > 65535 || !metrics.start(params->Get("port").ToInt())) {
+            outputNode.Add("error", "Error configuring metrics. Exporter could not be started...");
+            return;
+        }
+        //NOTE: the first exposition is built on next call to exportMetrics
+        lastExport = std::chrono::system_clock::time_point();
+    }
+
+    snapshot.addSetting("configureMetrics", *params);
+    snapshot.commit();
+    outputNode.Add("port", (int) metrics.getPort());
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::configureGovernorEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    bool enabled = governor.isEnabled();
+    float highLoad = GOVERNOR_HIGH_LOAD;
+    float lowLoad = GOVERNOR_LOW_LOAD;
+    int highResidency = GOVERNOR_HIGH_RESIDENCY/1000;
+    int lowResidency = GOVERNOR_LOW_RESIDENCY/1000;
+    int period = governor.getPeriod().count();
+    int hold = GOVERNOR_HOLD;
+
+    if (!params) {
+        outputNode.Add("error", "Error configuring governor. Invalid JSON format...");
+        return;
+    }
+
+    if (params->Has("enabled") && params->Get("enabled").IsBool()) {
+        enabled = params->Get("enabled").ToBool();
+    }
+
+    if (params->Has("highLoad") && params->Get("highLoad").IsNumber()) {
+        highLoad = params->Get("highLoad").ToFloat();
+    }
+
+    if (params->Has("lowLoad") && params->Get("lowLoad").IsNumber()) {
+        lowLoad = params->Get("lowLoad").ToFloat();
+    }
+
+    if (params->Has("highResidency") && params->Get("highResidency").IsNumber()) {
+        highResidency = params->Get("highResidency").ToInt();
+    }
+
+    if (params->Has("lowResidency") && params->Get("lowResidency").IsNumber()) {
+        lowResidency = params->Get("lowResidency").ToInt();
+    }
+
+    if (params->Has("period") && params->Get("period").IsNumber()) {
+        period = params->Get("period").ToInt();
+    }
+
+    if (params->Has("hold") && params->Get("hold").IsNumber()) {
+        hold = params->Get("hold").ToInt();
+    }
+
+    if (hold <= 0 || !governor.configure(enabled, highLoad, lowLoad, std::chrono::milliseconds(highResidency),
+                                         std::chrono::milliseconds(lowResidency), std::chrono::seconds(period), hold)) {
+        outputNode.Add("error", "Error configuring governor. Invalid thresholds...");
+        return;
+    }
+
+    //NOTE: the load is measured from now on, a disabled governor restores the filters on next check
+    lastGovern = std::chrono::system_clock::now();
+    lastBusyTime = pool ? pool->getBusyTime() : 0;
+    governor.govern(filters);
+
+    snapshot.addSetting("configureGovernor", *params);
+    snapshot.commit();
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::configureTracingEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (!params || !params->Has("sampling") || !params->Get("sampling").IsNumber() ||
+        params->Get("sampling").ToInt() < 0) {
+        outputNode.Add("error", "Error configuring tracing. Invalid sampling...");
+        return;
+    }
+
+    FrameTracer::getInstance()->setSampling(params->Get("sampling").ToInt());
+    snapshot.addSetting("configureTracing", *params);
+    snapshot.commit();
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::configureLocksEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (!params || !params->Has("profiling") || !params->Get("profiling").IsBool()) {
+        outputNode.Add("error", "Error configuring locks. Invalid profiling...");
+        return;
+    }
+
+    ProfiledMutex::setProfiling(params->Get("profiling").ToBool());
+    snapshot.addSetting("configureLocks", *params);
+    snapshot.commit();
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::configureCountersEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (!params || !params->Has("interval") || !params->Get("interval").IsNumber() ||
+        params->Get("interval").ToInt() < 0) {
+        outputNode.Add("error", "Error configuring counters. Invalid interval...");
+        return;
+    }
+
+    PerfCounters::setInterval(params->Get("interval").ToInt());
+    snapshot.addSetting("configureCounters", *params);
+    snapshot.commit();
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::configureAudioFramingEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (!params || !params->Has("frameTime") || !params->Get("frameTime").IsNumber() ||
+        !AudioFrame::setDefaultFrameTime(std::chrono::microseconds(params->Get("frameTime").ToInt()))) {
+        outputNode.Add("error", "Error configuring audio framing. Invalid frameTime...");
+        return;
+    }
+
+    snapshot.addSetting("configureAudioFraming", *params);
+    snapshot.commit();
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::dumpTraceEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::map<int, std::string> names;
+    std::string trace;
+    std::ofstream file;
+    size_t traces;
+
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (!params || !params->Has("file") || !params->Get("file").IsString()) {
+        outputNode.Add("error", "Error dumping trace. Invalid JSON format...");
+        return;
+    }
+
+    for (auto it : filters) {
+        names[it.first] = utils::getFilterTypeAsString(it.second->getType());
+    }
+
+    traces = FrameTracer::getInstance()->getChromeTrace(trace, names);
+
+    file.open(params->Get("file").ToString().c_str(), std::ios::out | std::ios::trunc);
+    if (!file.is_open() || !file.write(trace.data(), trace.size())) {
+        outputNode.Add("error", "Error dumping trace. File could not be written...");
+        return;
+    }
+
+    outputNode.Add("traces", (int) traces);
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::configureSnapshotEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    bool autoSave = true;
+
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    if (!params || !params->Has("file") || !params->Get("file").IsString()) {
+        outputNode.Add("error", "Error configuring snapshot. Invalid JSON format...");
+        return;
+    }
+
+    if (params->Has("autoSave") && params->Get("autoSave").IsBool()) {
+        autoSave = params->Get("autoSave").ToBool();
+    }
+
+    snapshot.configure(params->Get("file").ToString(), autoSave);
+    outputNode.Add("error", Jzon::null);
+}
+
+void PipelineManager::saveSnapshotEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    std::string file = snapshot.getFile();
+
+    if (params && params->Has("file") && params->Get("file").IsString()) {
+        file = params->Get("file").ToString();
+    }
+
+    if (file.empty()) {
+        outputNode.Add("error", "Error saving snapshot. No file given...");
+        return;
+    }
+
+    if (!snapshot.save(file)) {
+        outputNode.Add("error", "Error saving snapshot. File could not be written...");
+        return;
+    }
+
+    outputNode.Add("file", file);
     outputNode.Add("error", Jzon::null);
 }
 
+void PipelineManager::restoreSnapshotEvent(Jzon::Node* params, Jzon::Object &outputNode)
+{
+    std::lock_guard<std::recursive_mutex> guard(graphMtx);
+
+    Jzon::Object root;
+    std::string file = snapshot.getFile();
+    std::string error;
+    bool autoSave = false;
+
+    if (params && params->Has("file") && params->Get("file").IsString()) {
+        file = params->Get("file").ToString();
+    }
+
+    if (params && params->Has("autoSave") && params->Get("autoSave").IsBool()) {
+        autoSave = params->Get("autoSave").ToBool();
+    }
+
+    if (file.empty()) {
+        outputNode.Add("error", "Error restoring snapshot. No file given...");
+        return;
+    }
+
+    if (!GraphSnapshot::load(file, root, error)) {
+        outputNode.Add("error", "Error restoring snapshot. " + error);
+        return;
+    }
+
+    snapshot.hold(true);
+
+    //NOTE: the pool and the budgets are set before the graph is created, since they bound it. A setting
+    //      that cannot be applied (e.g. a metrics port already taken) does not prevent the restore
+    if (root.Has("settings")) {
+        Jzon::Object &settings = root.Get("settings").AsObject();
+        std::vector<std::pair<std::string, void (PipelineManager::*)(Jzon::Node*, Jzon::Object&)>> handlers = {
+            {"configurePool", &PipelineManager::configurePoolEvent},
+            {"configureGovernor", &PipelineManager::configureGovernorEvent},
+            {"configureMetrics", &PipelineManager::configureMetricsEvent},
+            {"configureTracing", &PipelineManager::configureTracingEvent},
+            {"configureLocks", &PipelineManager::configureLocksEvent},
+            {"configureCounters", &PipelineManager::configureCountersEvent},
+            {"configureAudioFraming", &PipelineManager::configureAudioFramingEvent}};
+
+        for (auto &h : handlers) {
+            Jzon::Object result;
+
+            if (!settings.Has(h.first)) {
+                continue;
+            }
+
+            (this->*h.second)(&settings.Get(h.first), result);
+            if (result.Has("error") && !result.Get("error").IsNull()) {
+                utils::warningMsg("[PipelineManager] Snapshot setting " + h.first + " not restored: " +
+                                  result.Get("error").ToString());
+            }
+        }
+    }
+
+    //NOTE: the whole graph is created at once, its filters process their configuration events in
+    //      parallel on the workers before their first frame
+    createGraphEvent(&root.Get("graph"), outputNode);
+    snapshot.hold(false);
+
+    if (!outputNode.Get("error").IsNull()) {
+        return;
+    }
+
+    if (autoSave) {
+        snapshot.configure(file, true);
+    }
+
+    snapshot.commit();
+    outputNode.Add("filters", (int) root.Get("graph").Get("filters").GetCount());
+    outputNode.Add("paths", (int) root.Get("graph").Get("paths").GetCount());
+}
+
 void PipelineManager::stopEvent(Jzon::Node* params, Jzon::Object &outputNode)
 {
     if (!stop()) {
@@ -28,12 +28,25 @@
 #include "Filter.hh"
 #include "Path.hh"
 #include "WorkersPool.hh"
+#include "MetricsExporter.hh"
+#include "LoadGovernor.hh"
+#include "ClusterCoordinator.hh"
+#include "GraphSnapshot.hh"
 
 #include <map>
+#include <set>
+#include <array>
+#include <string>
+#include <chrono>
+#include <mutex>
 
 /*! PipelineManager class is a singleton class that presents the relation
     between the data flow, control and execution layers. It has all related
     information to existing filters, paths and their interconnections.
+    Its methods can be called from several control threads: the graph is guarded by
+    a lock held while filters and paths are registered, connected or read, and filters
+    are built (i.e. their codecs opened) without it, so requests creating disjoint
+    pipelines overlap.
 */
 
 class PipelineManager {
@@ -42,9 +55,11 @@ public:
     /**
     * Gets the PipelineManger object pointer of the instance. Creates a new
     * instance for first time or returns the same instance if it already exists.
+    * @param thds number of worker threads of the pool, 0 means hardware based default
+    * @param mode scheduling strategy of the workers pool (only used at first call)
     * @return PipelineManager instance pointer
     */
-    static PipelineManager* getInstance(const unsigned thds = 0);
+    static PipelineManager* getInstance(const unsigned thds = 0, const SchedulingMode mode = SHARED_QUEUE);
 
     /**
     * If PipelineManager instance exists it is destroyed.
@@ -80,9 +95,10 @@ public:
     * Adds a filter by specifing its Id and the filter object
     * @param Id of the filter to add
     * @param filter object pointer
+    * @param start false to add it without scheduling it yet
     * @return return true if succes, otherwise returns false
     */
-    bool addFilter(int id, BaseFilter* filter);
+    bool addFilter(int id, BaseFilter* filter, bool start = true);
 
 
     /**
@@ -104,17 +120,23 @@ public:
     * Gets PipelineManager's paths
     * @return a map with all path objects
     */
-    std::map<int, Path*> getPaths() {return paths;};
+    std::map<int, Path*> getPaths() {std::lock_guard<std::recursive_mutex> guard(graphMtx); return paths;};
 
     /**
     * Gets PipelineManager's filters
     * @return a map with all filters objects
     */
-    std::map<int, BaseFilter*> getFilters() {return filters;};
+    std::map<int, BaseFilter*> getFilters() {std::lock_guard<std::recursive_mutex> guard(graphMtx); return filters;};
 
     /**
     * Manage and carries out a path connection: connectManyToMany, connectManyToOne,
-    * connectOneToOne and connectOneToMany
+    * connectOneToOne and connectOneToMany. When the first middle filter is a decoder and another
+    * connected path starts with a decoder of the same type reading the same origin writer, the new
+    * decoder is deleted and the path continues from the output of the existing one, which is only
+    * deleted with the last path using it. When the path has an output profile (see OutputProfile), its middle
+    * filters are a decoder and an encoder, possibly with resamplers between them, and the coded stream of the
+    * origin writer already matches the profile, the middle filters are deleted and the origin is connected
+    * straight to the destination, as long as it is a transmitter, a dasher or a recorder
     * @param id path id
     * @return true if success, otherwise return false
     */
@@ -127,6 +149,18 @@ public:
      */
     bool removePath(int id);
     
+    /**
+     * Suspends or resumes a path. The filters used only by the path are parked, they are taken out of the
+     * workers pool with their codec contexts and queues kept, and the writer feeding the first of them is
+     * suspended, see BaseFilter::suspendWriter, so an idle path costs no processing and it resumes at once.
+     * The destination is parked as well if no other path uses it. The queue feeding the path cannot be
+     * shared with another path, e.g. after a decoder shared with other paths
+     * @param id path ID
+     * @param suspend true to suspend the path, false to resume it
+     * @return false if the path does not exist or it cannot be suspended
+     */
+    bool suspendPath(int id, bool suspend);
+    
     /**
      * Remove the filter related to the specified id, only filter which are 
      * not used in any path can be deleted
@@ -135,11 +169,48 @@ public:
      */
     bool removeFilter(int id);
 
+    /**
+    * Enables or disables the throughput mode of all the filters, also of the ones added afterwards.
+    * Input is processed as fast as possible with backpressure instead of dropping frames, and the
+    * end of file inputs is propagated to the tail filters, see BaseFilter::setThroughput
+    * @param throughput true to process file inputs offline
+    */
+    void setThroughput(bool throughput);
+
+    /**
+    * @return true if all the tail filters have reached the end of the stream in throughput mode
+    */
+    bool isEndOfStream();
+
     /**
     * Sets outputNode jzon object by getting pipeline state
     */
     void getStateEvent(Jzon::Node* params, Jzon::Object &outputNode);
 
+    /**
+    * Serialises a snapshot of the filters metrics (see BaseFilter::getMetrics) straight into a JSON
+    * object, without building a Jzon tree nor locking the filters, so it is cheap enough to be polled
+    * often. In delta mode only the values changed since the previous snapshot are written, filters
+    * without changes are omitted and the removed ones are listed
+    * @param buffer where the JSON object is appended
+    * @param delta true to write only the changes since the previous snapshot
+    */
+    void getMetrics(std::string &buffer, bool delta);
+
+    /**
+    * Updates the Prometheus exposition served at /metrics once its period has elapsed, it does nothing
+    * until the exporter is configured, see configureMetricsEvent. It has to be called periodically, a
+    * round is skipped while another thread holds the graph
+    */
+    void exportMetrics();
+
+    /**
+    * Measures the load over the governor period and brings the filters to its degradation level, see
+    * LoadGovernor. It does nothing until the governor is enabled, see configureGovernorEvent. It has to be
+    * called periodically, a round is skipped while another thread holds the graph
+    */
+    void governLoad();
+
     /**
     * Sets outputNode jzon object with the results coming from filter event
     * filled by incoming jzon object params
@@ -148,10 +219,32 @@ public:
 
     /**
     * Sets outputNode jzon object with the results coming from path event
-    * filled by incoming jzon object params
+    * filled by incoming jzon object params. Params may have an "outputProfile" object, with the "codec"
+    * and optionally the "width", "height" and maximum "bitrate" in kbps the path delivers, see connectPath
     */
     void createPathEvent(Jzon::Node* params, Jzon::Object &outputNode);
 
+    /**
+    * Sets outputNode jzon object with the results of building a whole graph at once. Params may have
+    * "filters", "paths" and "events" arrays, with the params of createFilter and createPath events and
+    * filter events respectively. The graph is validated first, then its filters are created and its paths
+    * connected, and the events pushed to their filters. The filters are built concurrently, one thread per
+    * core, since some constructors block (shared memory segments, link sockets, OpenCL probing), and
+    * registered in the graph order. Codecs are opened later on the workers, with the first frame. The new
+    * filters are only scheduled at the end, so they never run half connected or before being configured.
+    * If anything fails the filters and paths created are removed
+    */
+    void createGraphEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Sets outputNode jzon object with the results of building a graph across several nodes. Params have
+    * the "graph", as in createGraphEvent, the cluster "nodes", see ClusterCoordinator::parseNodes, and
+    * may have the "linkIdBase" of the link filters. The filters are placed by the spare capacity of the
+    * nodes, see ClusterPlanner, and each node gets its part in a createGraph request. If any node fails
+    * the parts already created are removed. The placement of the filters is set in outputNode
+    */
+    void createClusterGraphEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
     /**
     * Sets outputNode jzon object with the results coming from remove path event
     * filled by incoming jzon object params
@@ -164,25 +257,171 @@ public:
     */
     void removeFilterEvent(Jzon::Node* params, Jzon::Object &outputNode);
 
+    /**
+    * Sets outputNode jzon object with the results of suspending the params "id" path, see suspendPath
+    */
+    void suspendPathEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Sets outputNode jzon object with the results of resuming the params "id" path, see suspendPath
+    */
+    void resumePathEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Sets outputNode jzon object with results of workers pool configuration event
+    * (i.e. pinning the workers to cores, reserving workers for high priority filters
+    * or setting the bounds of an elastic pool), of the codec threads budget, see ThreadBudget, of the
+    * memory budget new filters and paths are checked against, see MemoryBudget, and of the throughput
+    * mode, see setThroughput
+    */
+    void configurePoolEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
     /**
     * Sets outputNode jzon object with results of pipeline stop event
     */
     void stopEvent(Jzon::Node* params, Jzon::Object &outputNode);
 
+    /**
+    * Sets outputNode jzon object with results of the metrics exporter configuration event. Params may
+    * have the "port" to serve the Prometheus exposition from (0 picks a free one, a negative one stops
+    * the exporter) and the "period" in seconds between updates. The listening port is set in outputNode
+    */
+    void configureMetricsEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Sets outputNode jzon object with results of the frame tracing configuration event. Params have the
+    * "sampling" interval, one of every sampling frames is traced along the pipeline and 0 disables
+    * tracing, see FrameTracer
+    */
+    void configureTracingEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Sets outputNode jzon object with results of the lock profiling configuration event. Params have the
+    * "profiling" flag, which enables the contention accounting of the filter, reader and pool mutexes and
+    * resets it, see ProfiledMutex
+    */
+    void configureLocksEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Sets outputNode jzon object with results of the hardware counters configuration event. Params have the
+    * "interval" of measured calls, one of every interval calls of each filter is measured and 0 disables
+    * the counters, see PerfCounters
+    */
+    void configureCountersEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Sets outputNode jzon object with results of the audio framing configuration event. Params have the
+    * "frameTime" in us of the audio frames requested by the filters created afterwards, shorter frames
+    * lower the audio latency at the cost of more scheduled jobs, see AudioFrame::setDefaultFrameTime
+    */
+    void configureAudioFramingEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Sets outputNode jzon object with results of the load governor configuration event. Params may have
+    * "enabled", the "highLoad" and "lowLoad" workers utilisation thresholds, the "highResidency" and
+    * "lowResidency" queue residency thresholds in ms, the "period" in seconds between checks and the
+    * "hold" checks a level is kept, see LoadGovernor::configure
+    */
+    void configureGovernorEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Sets outputNode jzon object with results of the trace dump event. The traced frames are written in
+    * Chrome trace format to the params "file", so they can be loaded in Perfetto or chrome://tracing
+    */
+    void dumpTraceEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Records a filter event pushed by the Controller in the graph snapshot, see GraphSnapshot
+    */
+    void recordFilterEvent(const Jzon::Node &event);
+
+    /**
+    * Pushes a filter event to its filter and records it, see recordFilterEvent. The filter
+    * cannot be removed meanwhile by another control thread
+    * @param event filter event, with the "filterId" of its filter
+    * @param delay in ms of the event, -1 to process it straight away
+    * @return false if there is no filter with this ID
+    */
+    bool pushFilterEvent(const Jzon::Node &event, int delay);
+
+    /**
+    * Sets outputNode jzon object with results of the snapshot configuration event. Params have the
+    * snapshot "file" (empty to disable it) and may have "autoSave", true by default, to rewrite it on
+    * every change of the graph or the pipeline settings, so a restarted process finds it up to date
+    */
+    void configureSnapshotEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Sets outputNode jzon object with results of the snapshot save event. The snapshot of the graph is
+    * written to the params "file", or to the configured one if not given
+    */
+    void saveSnapshotEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
+    /**
+    * Sets outputNode jzon object with results of the snapshot restore event. The pipeline settings of
+    * the params "file" (the configured one if not given) are applied and its graph is created in a single
+    * createGraphEvent, so the restarted filters are configured in parallel before their first frame.
+    * With "autoSave" the restored snapshot is kept up to date afterwards, see configureSnapshotEvent
+    */
+    void restoreSnapshotEvent(Jzon::Node* params, Jzon::Object &outputNode);
+
 private:
-    PipelineManager(unsigned threads = 0);
+    PipelineManager(unsigned threads = 0, SchedulingMode mode = SHARED_QUEUE);
     ~PipelineManager();
     bool deletePath(int id);
-    bool createFilter(int id, FilterType type);
+    bool createFilter(int id, FilterType type, ComposeBackend backend = CPU_COMPOSE, Jzon::Node* params = NULL,
+                      bool start = true, BaseFilter* built = NULL);
+    BaseFilter* buildFilter(FilterType type, ComposeBackend backend, Jzon::Node* params);
+    BaseFilter* prebuildFilter(Jzon::Node* params);
+    void buildFilters(Jzon::Node* params, std::map<int, BaseFilter*> &built);
+    bool createFilterFromParams(Jzon::Node* params, Jzon::Object &outputNode, bool start, BaseFilter* built = NULL);
+    bool createPathFromParams(Jzon::Node* params, Jzon::Object &outputNode);
+    void startFilters(std::vector<int> ids);
+    std::string checkGraph(Jzon::Node* params);
+    void rollbackGraph(Jzon::Node* params);
+    void recordGraph(Jzon::Node* params);
+    BaseFilter* createSharedMemory(Jzon::Node* params);
+    BaseFilter* createSharedMemoryIngest(Jzon::Node* params);
+    BaseFilter* createFrameLinkSender(Jzon::Node* params);
+    BaseFilter* createFrameLinkReceiver(Jzon::Node* params);
+    BaseFilter* createVideoSwitcher(Jzon::Node* params);
+    BaseFilter* createTimeShift(Jzon::Node* params);
+    BaseFilter* createLoudnessNormalizer(Jzon::Node* params);
     
     bool handleGrouping(int orgFId, int dstFId, int orgWId, int dstRId);
+    bool fusePath(std::vector<int> pathFilters);
+    bool shareDecoder(int id);
+    bool bypassTranscode(int id);
+    bool getOutputProfile(Jzon::Node &node, OutputProfile &profile);
+    bool usedByOtherPath(int fId, int pathId);
+    std::vector<int> getParkedFilters(Path* path, int id);
     bool validCData(ConnectionData cData, int orgFId, int dstFId);
+    size_t getUnchargedBytes();
+    size_t getPathMemoryBytes(Path* path);
 
     static PipelineManager* pipeMngrInstance;
     const unsigned threads;
+    const SchedulingMode schedMode;
+    bool pinnedWorkers;
+    unsigned reservedWorkers;
+    unsigned minWorkers;
+    unsigned maxWorkers;
+    bool handOff;
+    bool throughput;
 
+    //NOTE: recursive since the public methods call each other
+    std::recursive_mutex graphMtx;                  //!< Guards the graph, the snapshot and the metrics state
     std::map<int, Path*> paths;
     std::map<int, BaseFilter*> filters;
+    std::map<int, std::array<uint64_t, FILTER_METRICS>> lastMetrics;
+    MetricsExporter metrics;
+    std::chrono::seconds metricsPeriod;
+    std::chrono::system_clock::time_point lastExport;
+    LoadGovernor governor;
+    ClusterCoordinator cluster;
+    GraphSnapshot snapshot;
+    std::chrono::system_clock::time_point lastGovern;
+    int64_t lastBusyTime;
     WorkersPool *pool;
 };
 
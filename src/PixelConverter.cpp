@@ -0,0 +1,265 @@
+/*
+ *  PixelConverter.cpp - Vectorised pixel format conversion
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "PixelConverter.hh"
+#include "SampleConverter.hh"
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+typedef unsigned char const* Src;
+typedef unsigned char* Dst;
+
+//NOTE: kernels convert a pair of rows sharing their chroma row, both rows are the same one at the
+//      bottom of odd height pictures, so their destination rows may alias
+
+static SIMD_INLINE unsigned char clampByte(int value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+//NOTE: BT.601 limited range matrix in 8 bit fixed point
+static SIMD_INLINE void yuvToRgb(int y, int d, int e, Dst out)
+{
+    int c = 298*(y - 16) + 128;
+
+    out[0] = clampByte((c + 409*e) >> 8);
+    out[1] = clampByte((c - 100*d - 208*e) >> 8);
+    out[2] = clampByte((c + 516*d) >> 8);
+}
+
+static SIMD_INLINE unsigned char rgbToY(int r, int g, int b)
+{
+    return ((66*r + 129*g + 25*b + 128) >> 8) + 16;
+}
+
+//NOTE: chroma is computed from the sum of the four subsampled pixels
+static SIMD_INLINE unsigned char rgbSumToU(int r, int g, int b)
+{
+    return ((-38*r - 74*g + 112*b + 512) >> 10) + 128;
+}
+
+static SIMD_INLINE unsigned char rgbSumToV(int r, int g, int b)
+{
+    return ((112*r - 94*g - 18*b + 512) >> 10) + 128;
+}
+
+SIMD_KERNEL
+static void yuyvToYuv420Rows(Src __restrict__ s0, Src __restrict__ s1, Dst y0, Dst y1,
+                             Dst __restrict__ u, Dst __restrict__ v, size_t pairs)
+{
+    for (size_t i = 0; i < pairs; i++) {
+        y0[2*i] = s0[4*i];
+        y0[2*i + 1] = s0[4*i + 2];
+        y1[2*i] = s1[4*i];
+        y1[2*i + 1] = s1[4*i + 2];
+        u[i] = (s0[4*i + 1] + s1[4*i + 1] + 1) >> 1;
+        v[i] = (s0[4*i + 3] + s1[4*i + 3] + 1) >> 1;
+    }
+}
+
+SIMD_KERNEL
+static void yuv420ToYuyvRow(Src __restrict__ y, Src __restrict__ u, Src __restrict__ v, Dst __restrict__ d, size_t pairs)
+{
+    for (size_t i = 0; i < pairs; i++) {
+        d[4*i] = y[2*i];
+        d[4*i + 1] = u[i];
+        d[4*i + 2] = y[2*i + 1];
+        d[4*i + 3] = v[i];
+    }
+}
+
+SIMD_KERNEL
+static void deinterleaveRow(Src __restrict__ uv, Dst __restrict__ u, Dst __restrict__ v, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        u[i] = uv[2*i];
+        v[i] = uv[2*i + 1];
+    }
+}
+
+SIMD_KERNEL
+static void interleaveRow(Src __restrict__ u, Src __restrict__ v, Dst __restrict__ uv, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        uv[2*i] = u[i];
+        uv[2*i + 1] = v[i];
+    }
+}
+
+SIMD_KERNEL
+static void yuv420ToRgbRow(Src __restrict__ y, Src __restrict__ u, Src __restrict__ v, Dst __restrict__ d, size_t width)
+{
+    size_t pairs = width/2;
+
+    for (size_t i = 0; i < pairs; i++) {
+        yuvToRgb(y[2*i], u[i] - 128, v[i] - 128, d + 6*i);
+        yuvToRgb(y[2*i + 1], u[i] - 128, v[i] - 128, d + 6*i + 3);
+    }
+
+    if (width % 2) {
+        yuvToRgb(y[2*pairs], u[pairs] - 128, v[pairs] - 128, d + 6*pairs);
+    }
+}
+
+SIMD_KERNEL
+static void rgbToYuv420Rows(Src __restrict__ s0, Src __restrict__ s1, Dst y0, Dst y1,
+                            Dst __restrict__ u, Dst __restrict__ v, size_t width)
+{
+    size_t pairs = width/2;
+    int r, g, b;
+
+    for (size_t i = 0; i < pairs; i++) {
+        y0[2*i] = rgbToY(s0[6*i], s0[6*i + 1], s0[6*i + 2]);
+        y0[2*i + 1] = rgbToY(s0[6*i + 3], s0[6*i + 4], s0[6*i + 5]);
+        y1[2*i] = rgbToY(s1[6*i], s1[6*i + 1], s1[6*i + 2]);
+        y1[2*i + 1] = rgbToY(s1[6*i + 3], s1[6*i + 4], s1[6*i + 5]);
+
+        r = s0[6*i] + s0[6*i + 3] + s1[6*i] + s1[6*i + 3];
+        g = s0[6*i + 1] + s0[6*i + 4] + s1[6*i + 1] + s1[6*i + 4];
+        b = s0[6*i + 2] + s0[6*i + 5] + s1[6*i + 2] + s1[6*i + 5];
+        u[i] = rgbSumToU(r, g, b);
+        v[i] = rgbSumToV(r, g, b);
+    }
+
+    //NOTE: the last column of odd width pictures is subsampled alone
+    if (width % 2) {
+        y0[2*pairs] = rgbToY(s0[6*pairs], s0[6*pairs + 1], s0[6*pairs + 2]);
+        y1[2*pairs] = rgbToY(s1[6*pairs], s1[6*pairs + 1], s1[6*pairs + 2]);
+
+        r = 2*(s0[6*pairs] + s1[6*pairs]);
+        g = 2*(s0[6*pairs + 1] + s1[6*pairs + 1]);
+        b = 2*(s0[6*pairs + 2] + s1[6*pairs + 2]);
+        u[pairs] = rgbSumToU(r, g, b);
+        v[pairs] = rgbSumToV(r, g, b);
+    }
+}
+
+/**
+* Converts the rows r0 and r1 (the same one at the bottom of odd height pictures) and their chroma row
+*/
+typedef void (*RowsConverter)(Src const* src, int const* sls, Dst const* dst, int const* dls, int width, int r0, int r1);
+
+static void yuyvToYuv420(Src const* src, int const* sls, Dst const* dst, int const* dls, int width, int r0, int r1)
+{
+    yuyvToYuv420Rows(src[0] + r0*sls[0], src[0] + r1*sls[0], dst[0] + r0*dls[0], dst[0] + r1*dls[0],
+                     dst[1] + r0/2*dls[1], dst[2] + r0/2*dls[2], width/2);
+}
+
+static void yuv420ToYuyv(Src const* src, int const* sls, Dst const* dst, int const* dls, int width, int r0, int r1)
+{
+    yuv420ToYuyvRow(src[0] + r0*sls[0], src[1] + r0/2*sls[1], src[2] + r0/2*sls[2], dst[0] + r0*dls[0], width/2);
+
+    if (r1 != r0) {
+        yuv420ToYuyvRow(src[0] + r1*sls[0], src[1] + r0/2*sls[1], src[2] + r0/2*sls[2], dst[0] + r1*dls[0], width/2);
+    }
+}
+
+static void nv12ToYuv420(Src const* src, int const* sls, Dst const* dst, int const* dls, int width, int r0, int r1)
+{
+    memcpy(dst[0] + r0*dls[0], src[0] + r0*sls[0], width);
+    memcpy(dst[0] + r1*dls[0], src[0] + r1*sls[0], width);
+    deinterleaveRow(src[1] + r0/2*sls[1], dst[1] + r0/2*dls[1], dst[2] + r0/2*dls[2], (width + 1)/2);
+}
+
+static void yuv420ToNv12(Src const* src, int const* sls, Dst const* dst, int const* dls, int width, int r0, int r1)
+{
+    memcpy(dst[0] + r0*dls[0], src[0] + r0*sls[0], width);
+    memcpy(dst[0] + r1*dls[0], src[0] + r1*sls[0], width);
+    interleaveRow(src[1] + r0/2*sls[1], src[2] + r0/2*sls[2], dst[1] + r0/2*dls[1], (width + 1)/2);
+}
+
+static void yuv420ToRgb(Src const* src, int const* sls, Dst const* dst, int const* dls, int width, int r0, int r1)
+{
+    yuv420ToRgbRow(src[0] + r0*sls[0], src[1] + r0/2*sls[1], src[2] + r0/2*sls[2], dst[0] + r0*dls[0], width);
+
+    if (r1 != r0) {
+        yuv420ToRgbRow(src[0] + r1*sls[0], src[1] + r0/2*sls[1], src[2] + r0/2*sls[2], dst[0] + r1*dls[0], width);
+    }
+}
+
+static void rgbToYuv420(Src const* src, int const* sls, Dst const* dst, int const* dls, int width, int r0, int r1)
+{
+    rgbToYuv420Rows(src[0] + r0*sls[0], src[0] + r1*sls[0], dst[0] + r0*dls[0], dst[0] + r1*dls[0],
+                    dst[1] + r0/2*dls[1], dst[2] + r0/2*dls[2], width);
+}
+
+struct Conversion {
+    PixType srcFmt;
+    PixType dstFmt;
+    RowsConverter converter;
+};
+
+static const Conversion conversions[] = {
+    {YUYV422, YUV420P, yuyvToYuv420},
+    {YUV420P, YUYV422, yuv420ToYuyv},
+    {NV12, YUV420P, nv12ToYuv420},
+    {YUV420P, NV12, yuv420ToNv12},
+    {YUV420P, RGB24, yuv420ToRgb},
+    {RGB24, YUV420P, rgbToYuv420}
+};
+
+static RowsConverter getConverter(PixType srcFmt, PixType dstFmt)
+{
+    for (const Conversion &c : conversions) {
+        if (c.srcFmt == srcFmt && c.dstFmt == dstFmt) {
+            return c.converter;
+        }
+    }
+
+    return NULL;
+}
+
+bool PixelConverter::isSupported(PixType srcFmt, PixType dstFmt)
+{
+    return getConverter(srcFmt, dstFmt) != NULL;
+}
+
+bool PixelConverter::convert(unsigned char const* const* src, int const* srcLinesize, PixType srcFmt,
+                             unsigned char* const* dst, int const* dstLinesize, PixType dstFmt,
+                             int width, int height, int firstRow, int rows)
+{
+    RowsConverter converter = getConverter(srcFmt, dstFmt);
+    int lastRow;
+
+    if (rows < 0) {
+        rows = height - firstRow;
+    }
+
+    lastRow = firstRow + rows;
+
+    if (!converter || width <= 0 || height <= 0 || firstRow < 0 || firstRow % 2 != 0 || lastRow > height ||
+        (rows % 2 != 0 && lastRow != height)) {
+        return false;
+    }
+
+    //NOTE: YUYV422 macropixels hold two pixels
+    if ((srcFmt == YUYV422 || dstFmt == YUYV422) && width % 2 != 0) {
+        return false;
+    }
+
+    for (int r = firstRow; r < lastRow; r += 2) {
+        converter(src, srcLinesize, dst, dstLinesize, width, r, std::min(r + 1, height - 1));
+    }
+
+    return true;
+}
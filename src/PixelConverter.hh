@@ -0,0 +1,63 @@
+/*
+ *  PixelConverter.hh - Vectorised pixel format conversion
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _PIXEL_CONVERTER_HH
+#define _PIXEL_CONVERTER_HH
+
+#include "Types.hh"
+
+/*! Same size conversions between the pixel formats of the capture and transcoding paths: YUYV422,
+    NV12 and RGB24 to and from YUV420P. The row kernels are vectorised for the running CPU (see
+    SIMD_KERNEL), so they are much cheaper than a generic swscale pass. RGB conversions use the ITU-R
+    BT.601 limited range matrix, chroma is averaged when subsampled and replicated when upsampled.
+*/
+class PixelConverter {
+
+public:
+    /**
+    * @param srcFmt source pixel format
+    * @param dstFmt destination pixel format
+    * @return true if there is a kernel for the conversion
+    */
+    static bool isSupported(PixType srcFmt, PixType dstFmt);
+
+    /**
+    * Converts a picture, or a band of its rows so that bands can be converted in parallel
+    * @param src source planes, as given by VideoFrame::getPlanes
+    * @param srcLinesize bytes per line of each source plane
+    * @param srcFmt source pixel format
+    * @param dst destination planes, as given by VideoFrame::getPlanes
+    * @param dstLinesize bytes per line of each destination plane
+    * @param dstFmt destination pixel format
+    * @param width picture width, it has to be even for YUYV422
+    * @param height picture height
+    * @param firstRow first row to convert, it has to be even
+    * @param rows number of rows to convert, up to the end of the picture if negative. It has to be even
+    *        unless the band ends the picture
+    * @return false if the conversion is not supported or the rows are not valid
+    */
+    static bool convert(unsigned char const* const* src, int const* srcLinesize, PixType srcFmt,
+                        unsigned char* const* dst, int const* dstLinesize, PixType dstFmt,
+                        int width, int height, int firstRow = 0, int rows = -1);
+};
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ *  ProfiledMutex.cpp - Mutex accounting its contention per lock site
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "ProfiledMutex.hh"
+
+std::atomic<bool> ProfiledMutex::enabled(false);
+LockProfile ProfiledMutex::profiles[LOCK_SITES];
+
+LockProfile::LockProfile()
+{
+    reset();
+}
+
+void LockProfile::reset()
+{
+    acquisitions = 0;
+    contended = 0;
+    waitTime = 0;
+
+    for (size_t i = 0; i < LOCK_WAIT_BUCKETS; i++){
+        waitHist[i] = 0;
+    }
+}
+
+void LockProfile::addAcquisition(bool contended_, std::chrono::nanoseconds wait)
+{
+    size_t bucket = 0;
+    long long ns = wait.count();
+
+    acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (!contended_){
+        return;
+    }
+
+    while (ns > 0 && bucket < LOCK_WAIT_BUCKETS - 1){
+        ns >>= 1;
+        bucket++;
+    }
+
+    contended.fetch_add(1, std::memory_order_relaxed);
+    waitTime.fetch_add(wait.count(), std::memory_order_relaxed);
+    waitHist[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+unsigned long LockProfile::getWaitPercentile(double p) const
+{
+    unsigned long total = 0;
+    unsigned long acc = 0;
+    unsigned long counts[LOCK_WAIT_BUCKETS];
+
+    for (size_t i = 0; i < LOCK_WAIT_BUCKETS; i++){
+        counts[i] = waitHist[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    if (total == 0){
+        return 0;
+    }
+
+    for (size_t i = 0; i < LOCK_WAIT_BUCKETS; i++){
+        acc += counts[i];
+        if (acc*100.0 >= p*total){
+            return i == 0 ? 0 : 1UL << i;
+        }
+    }
+
+    return 1UL << (LOCK_WAIT_BUCKETS - 1);
+}
+
+void LockProfile::getState(Jzon::Object &node) const
+{
+    Jzon::Array histogram;
+
+    for (size_t i = 0; i < LOCK_WAIT_BUCKETS; i++){
+        histogram.Add((double) waitHist[i].load(std::memory_order_relaxed));
+    }
+
+    node.Add("acquisitions", (double) getAcquisitions());
+    node.Add("contended", (double) getContended());
+    node.Add("waitTime", (double) std::chrono::duration_cast<std::chrono::microseconds>(getWaitTime()).count());
+    node.Add("waitP50", (double) getWaitPercentile(50));
+    node.Add("waitP99", (double) getWaitPercentile(99));
+    node.Add("waitHistogram", histogram);
+}
+
+void ProfiledMutex::profiledLock()
+{
+    std::chrono::steady_clock::time_point start;
+
+    if (std::mutex::try_lock()){
+        profiles[site].addAcquisition(false, std::chrono::nanoseconds(0));
+        return;
+    }
+
+    start = std::chrono::steady_clock::now();
+    std::mutex::lock();
+    profiles[site].addAcquisition(true, std::chrono::steady_clock::now() - start);
+}
+
+void ProfiledMutex::setProfiling(bool enable)
+{
+    if (enable && !enabled.load(std::memory_order_relaxed)){
+        for (size_t i = 0; i < LOCK_SITES; i++){
+            profiles[i].reset();
+        }
+    }
+
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+LockProfile& ProfiledMutex::getProfile(LockSite site)
+{
+    return profiles[site];
+}
+
+const char* ProfiledMutex::getSiteName(LockSite site)
+{
+    switch (site){
+        case FILTER_LOCK:
+            return "filter";
+        case READER_LOCK:
+            return "reader";
+        case POOL_LOCK:
+            return "pool";
+        case WORKER_LOCK:
+            return "stealingWorker";
+        default:
+            return "unknown";
+    }
+}
+
+void ProfiledMutex::getState(Jzon::Object &node)
+{
+    Jzon::Object sites;
+
+    for (size_t i = 0; i < LOCK_SITES; i++){
+        Jzon::Object site;
+
+        profiles[i].getState(site);
+        sites.Add(getSiteName((LockSite) i), site);
+    }
+
+    node.Add("profiling", getProfiling());
+    node.Add("sites", sites);
+}
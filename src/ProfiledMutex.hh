@@ -0,0 +1,129 @@
+/*
+ *  ProfiledMutex.hh - Mutex accounting its contention per lock site
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _PROFILED_MUTEX_HH
+#define _PROFILED_MUTEX_HH
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "Jzon.h"
+
+#define LOCK_WAIT_BUCKETS 32        /*!< Log2 wait histogram buckets, the last one covers waits above 2^30 nsec */
+
+/*! Lock sites profiled, each one aggregates all the mutexes of the same member */
+enum LockSite {FILTER_LOCK, READER_LOCK, POOL_LOCK, WORKER_LOCK, LOCK_SITES};
+
+/*! Contention statistics of a lock site: acquisitions, acquisitions that found the
+    mutex taken and a histogram of the time waited by them. Updates and reads are lock
+    free, so it can be queried while the mutexes are used.
+*/
+class LockProfile {
+
+public:
+    LockProfile();
+
+    /**
+     * Accounts an acquisition
+     * @param contended true if the mutex was taken by another thread
+     * @param wait time waited for the mutex
+     */
+    void addAcquisition(bool contended, std::chrono::nanoseconds wait);
+
+    void reset();
+
+    unsigned long getAcquisitions() const {return acquisitions.load(std::memory_order_relaxed);};
+    unsigned long getContended() const {return contended.load(std::memory_order_relaxed);};
+    std::chrono::nanoseconds getWaitTime() const {return std::chrono::nanoseconds(waitTime.load(std::memory_order_relaxed));};
+
+    /**
+     * Gets a wait time percentile of the contended acquisitions
+     * @param p percentile, between 0 and 100
+     * @return upper bound in nsec of the histogram bucket containing the percentile, 0 if there is no contention
+     */
+    unsigned long getWaitPercentile(double p) const;
+
+    void getState(Jzon::Object &node) const;
+
+private:
+    std::atomic<unsigned long> acquisitions;
+    std::atomic<unsigned long> contended;
+    std::atomic<unsigned long> waitTime;
+    std::atomic<unsigned long> waitHist[LOCK_WAIT_BUCKETS];
+};
+
+/*! std::mutex accounting its acquisitions in the LockProfile of its site. Profiling is
+    disabled by default, then locking costs a relaxed atomic load more than std::mutex.
+    Only the acquisitions through lock() are accounted, so it has to be locked with
+    std::lock_guard<ProfiledMutex> or uniqueLock(); the ones relocking it after waiting
+    on a condition variable are not, as they are not contention.
+*/
+class ProfiledMutex : public std::mutex {
+
+public:
+    ProfiledMutex(LockSite site_) : site(site_) {};
+
+    void lock()
+    {
+        if (!enabled.load(std::memory_order_relaxed)) {
+            std::mutex::lock();
+            return;
+        }
+
+        profiledLock();
+    };
+
+    /**
+     * Locks the mutex, accounting the acquisition
+     * @return a lock owning the mutex, to wait on a condition variable
+     */
+    std::unique_lock<std::mutex> uniqueLock()
+    {
+        lock();
+        return std::unique_lock<std::mutex>(*this, std::adopt_lock);
+    };
+
+    /**
+     * Enables or disables the profiling of all the mutexes, the statistics are reset when enabled
+     */
+    static void setProfiling(bool enable);
+    static bool getProfiling() {return enabled.load(std::memory_order_relaxed);};
+
+    static LockProfile& getProfile(LockSite site);
+    static const char* getSiteName(LockSite site);
+
+    /**
+     * Adds the profiling state and the statistics of each site to the node
+     */
+    static void getState(Jzon::Object &node);
+
+private:
+    void profiledLock();
+
+    static std::atomic<bool> enabled;
+    static LockProfile profiles[LOCK_SITES];
+
+    const LockSite site;
+};
+
+#endif
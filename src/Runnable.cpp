@@ -23,11 +23,98 @@
  */
 
 #include <thread>
+#include <time.h>
 
 #include "Runnable.hh"
 
 
-Runnable::Runnable(bool periodic_) : run(false), time(std::chrono::system_clock::now()), periodic(periodic_), id(-1)
+static std::chrono::microseconds threadCpuTime()
+{
+    struct timespec ts;
+    
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0){
+        return std::chrono::microseconds(0);
+    }
+    
+    return std::chrono::microseconds(ts.tv_sec*1000000 + ts.tv_nsec/1000);
+}
+
+ProcessProfile::ProcessProfile() : calls(0), stalls(0), wallTime(0), cpuTime(0), countedCalls(0)
+{
+    for (size_t i = 0; i < PROFILE_BUCKETS; i++){
+        wallHist[i] = 0;
+        cpuHist[i] = 0;
+    }
+    
+    for (size_t i = 0; i < PERF_COUNTERS; i++){
+        counters[i] = 0;
+    }
+}
+
+size_t ProcessProfile::bucketOf(std::chrono::microseconds t)
+{
+    size_t bucket = 0;
+    long long us = t.count();
+    
+    while (us > 0 && bucket < PROFILE_BUCKETS - 1){
+        us >>= 1;
+        bucket++;
+    }
+    
+    return bucket;
+}
+
+void ProcessProfile::addCall(std::chrono::microseconds wall, std::chrono::microseconds cpu, bool stalled)
+{
+    //NOTE: a runnable is executed by one thread at a time, relaxed counters are enough
+    calls.fetch_add(1, std::memory_order_relaxed);
+    if (stalled){
+        stalls.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    wallTime.fetch_add(wall.count(), std::memory_order_relaxed);
+    cpuTime.fetch_add(cpu.count(), std::memory_order_relaxed);
+    wallHist[bucketOf(wall)].fetch_add(1, std::memory_order_relaxed);
+    cpuHist[bucketOf(cpu)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void ProcessProfile::addCounters(const PerfSample &start, const PerfSample &end)
+{
+    countedCalls.fetch_add(1, std::memory_order_relaxed);
+    
+    for (size_t i = 0; i < PERF_COUNTERS; i++){
+        if (end.values[i] > start.values[i]){
+            counters[i].fetch_add(end.values[i] - start.values[i], std::memory_order_relaxed);
+        }
+    }
+}
+
+unsigned long ProcessProfile::percentile(const std::atomic<unsigned long> (&hist)[PROFILE_BUCKETS], double p)
+{
+    unsigned long total = 0;
+    unsigned long acc = 0;
+    unsigned long counts[PROFILE_BUCKETS];
+    
+    for (size_t i = 0; i < PROFILE_BUCKETS; i++){
+        counts[i] = hist[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    
+    if (total == 0){
+        return 0;
+    }
+    
+    for (size_t i = 0; i < PROFILE_BUCKETS; i++){
+        acc += counts[i];
+        if (acc*100.0 >= p*total){
+            return i == 0 ? 0 : 1UL << i;
+        }
+    }
+    
+    return 1UL << (PROFILE_BUCKETS - 1);
+}
+
+Runnable::Runnable(bool periodic_) : mtx(FILTER_LOCK), run(false), time(Clock::now()), periodic(periodic_), id(-1), affinity(-1), priority(NORMAL_PRIORITY), dedicated(false)
 {
 }
 
@@ -37,7 +124,7 @@ Runnable::~Runnable()
 
 bool Runnable::ready()
 {
-    return time < std::chrono::high_resolution_clock::now();
+    return time < Clock::now();
 }
 
 std::chrono::system_clock::time_point Runnable::getTime()  const
@@ -47,27 +134,45 @@ std::chrono::system_clock::time_point Runnable::getTime()  const
 
 void Runnable::sleepUntilReady()
 {
-    std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
-    std::chrono::microseconds teaTime;
-
     if (!ready()){
-        teaTime = std::chrono::duration_cast<std::chrono::microseconds>(time - now);
-
-        std::this_thread::sleep_for(teaTime);
+        Clock::sleepUntil(time);
     }
 }
 
-std::vector<int> Runnable::runProcessFrame()
+void Runnable::runProcessFrame(std::vector<int> &enabledJobs)
 {   
     int ret = 0;
-    std::vector<int> enabledJobs;
-    enabledJobs = processFrame(ret);
+    profiledProcessFrame(ret, enabledJobs);
     
-    time = std::chrono::high_resolution_clock::now() + std::chrono::microseconds(ret);
+    time = Clock::now() + std::chrono::microseconds(ret);
+}
+
+std::vector<int> Runnable::runProcessFrame()
+{   
+    std::vector<int> enabledJobs;
+    runProcessFrame(enabledJobs);
     
     return enabledJobs;
 }
 
+void Runnable::profiledProcessFrame(int& ret, std::vector<int> &enabledJobs)
+{
+    PerfSample countersStart, countersEnd;
+    //NOTE: the counters are read out of the timed span, so measured calls are not slower in the histograms
+    bool counted = PerfCounters::isSampled(profile.getCalls()) && PerfCounters::read(countersStart);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::microseconds cpuStart = threadCpuTime();
+    
+    processFrame(ret, enabledJobs);
+    
+    profile.addCall(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start),
+                    threadCpuTime() - cpuStart, stalled());
+    
+    if (counted && PerfCounters::read(countersEnd)){
+        profile.addCounters(countersStart, countersEnd);
+    }
+}
+
 bool Runnable::setId(int id_){
     if (id_ < 0){
         utils::errorMsg("invalid filter Id, only positive values are allowed");
@@ -84,6 +189,17 @@ bool Runnable::setId(int id_){
     return true;
 }
 
+bool Runnable::setPriority(RunnablePriority prio){
+    if (prio == RP_NONE){
+        utils::errorMsg("invalid runnable priority");
+        return false;
+    }
+    
+    priority = prio;
+    
+    return true;
+}
+
 void Runnable::setRunning()
 {
     run = true;
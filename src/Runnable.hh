@@ -30,8 +30,103 @@
 #include <vector>
 #include <set>
 #include <mutex>
+#include <atomic>
 
 #include "Utils.hh"
+#include "ProfiledMutex.hh"
+#include "Clock.hh"
+#include "PerfCounters.hh"
+
+#define PROFILE_BUCKETS 32          /*!< Log2 histogram buckets, the last one covers durations above 2^30 usec */
+
+/*! ProcessProfile keeps the execution statistics of a Runnable: number of calls, 
+    calls that had nothing to process and wall/cpu time histograms. Histograms 
+    have a fixed size, being each bucket twice as wide as the previous one. Updates 
+    and reads are lock free, so it can be queried while the runnable is executed.
+*/
+class ProcessProfile {
+
+public:
+    ProcessProfile();
+    
+    /**
+     * Accounts a processFrame call
+     * @param wall wall clock time spent by the call
+     * @param cpu cpu time spent by the calling thread
+     * @param stalled true if the call had nothing to process (WAIT)
+     */
+    void addCall(std::chrono::microseconds wall, std::chrono::microseconds cpu, bool stalled);
+    
+    /**
+     * Accounts the hardware counters of a measured processFrame call, see PerfCounters
+     * @param start counters read by the calling thread before the call
+     * @param end counters read by the calling thread after the call
+     */
+    void addCounters(const PerfSample &start, const PerfSample &end);
+    
+    /**
+     * @return number of accounted calls
+     */
+    unsigned long getCalls() const {return calls;};
+    
+    /**
+     * @return number of calls that processed something
+     */
+    unsigned long getFrames() const {return calls - stalls;};
+    
+    /**
+     * @return number of calls that had nothing to process
+     */
+    unsigned long getStalls() const {return stalls;};
+    
+    /**
+     * @return accumulated wall clock time in usec
+     */
+    unsigned long getWallTime() const {return wallTime;};
+    
+    /**
+     * @return accumulated cpu time in usec
+     */
+    unsigned long getCpuTime() const {return cpuTime;};
+    
+    /**
+     * Gets a wall clock time percentile of the calls
+     * @param p percentile, between 0 and 100
+     * @return upper bound in usec of the histogram bucket containing the percentile, 0 if there are no calls
+     */
+    unsigned long getWallPercentile(double p) const {return percentile(wallHist, p);};
+    
+    /**
+     * Gets a cpu time percentile of the calls
+     * @param p percentile, between 0 and 100
+     * @return upper bound in usec of the histogram bucket containing the percentile, 0 if there are no calls
+     */
+    unsigned long getCpuPercentile(double p) const {return percentile(cpuHist, p);};
+    
+    /**
+     * @return number of calls whose hardware counters were measured
+     */
+    unsigned long getCountedCalls() const {return countedCalls;};
+    
+    /**
+     * @param counter hardware counter
+     * @return accumulated value of the counter over the measured calls
+     */
+    uint64_t getCounter(PerfCounter counter) const {return counters[counter];};
+
+private:
+    static size_t bucketOf(std::chrono::microseconds t);
+    static unsigned long percentile(const std::atomic<unsigned long> (&hist)[PROFILE_BUCKETS], double p);
+    
+    std::atomic<unsigned long> calls;
+    std::atomic<unsigned long> stalls;
+    std::atomic<unsigned long> wallTime;
+    std::atomic<unsigned long> cpuTime;
+    std::atomic<unsigned long> wallHist[PROFILE_BUCKETS];
+    std::atomic<unsigned long> cpuHist[PROFILE_BUCKETS];
+    std::atomic<unsigned long> countedCalls;
+    std::atomic<uint64_t> counters[PERF_COUNTERS];
+};
 
 
 /*! Runnable class is an interface implemented by BaseFilter, which has some
@@ -42,6 +137,12 @@ class Runnable {
 public:
     virtual ~Runnable();
 
+    /**
+    * Executes processFrame and schedules the next execution time
+    * @param enabledJobs the ids of the runnables that can be executed after
+    * this process are appended to it, so callers may reuse it among calls
+    */
+    void runProcessFrame(std::vector<int> &enabledJobs);
     std::vector<int> runProcessFrame();
 
     /**
@@ -79,7 +180,7 @@ public:
 
     /**
     * Get next time point of processFrame execution
-    * @return time point of the next execution of processFrame
+    * @return time point of the next execution of processFrame, in the installed Clock time base
     */
     std::chrono::system_clock::time_point getTime() const;
     
@@ -95,6 +196,52 @@ public:
      */
     bool setId(int id_);
     
+    /**
+     * Sets the preferred NUMA node of the runnable. It is a hint used by the WorkersPool 
+     * when its workers are pinned to cores.
+     * @param node NUMA node identifier, -1 means no preference
+     */
+    void setAffinity(int node) {affinity = node;};
+    
+    /**
+     * Gets the preferred NUMA node of the runnable
+     * @return the NUMA node identifier, -1 if there is no preference
+     */
+    int getAffinity() const {return affinity;};
+    
+    /**
+     * Sets the scheduling priority class of the runnable. High priority runnables 
+     * are always served first by the WorkersPool.
+     * @param prio priority class, RP_NONE is not allowed
+     * @return false if the priority is not valid
+     */
+    bool setPriority(RunnablePriority prio);
+    
+    /**
+     * Gets the scheduling priority class of the runnable
+     * @return the priority class, NORMAL_PRIORITY by default
+     */
+    RunnablePriority getPriority() const {return priority;};
+    
+    /**
+     * Sets the execution mode of the runnable. Dedicated runnables are executed by
+     * their own thread instead of the shared workers. It is only applied when the 
+     * runnable is added to a WorkersPool, see WorkersPool::setDedicated.
+     * @param dedicated_ true for the dedicated thread mode
+     */
+    void setDedicated(bool dedicated_) {dedicated = dedicated_;};
+    
+    /**
+     * @return true if the runnable is executed by its own thread
+     */
+    bool isDedicated() const {return dedicated;};
+    
+    /**
+     * Gets the execution statistics of processFrame calls made through runProcessFrame
+     * @return the profile of the runnable
+     */
+    const ProcessProfile& getProfile() const {return profile;};
+    
     /**
      * Used after processig its task, in order to check if there is something else to process.
      * @return true if there is something pending, false otherwise.
@@ -111,21 +258,38 @@ protected:
     /**
      * This is the virtual method that derivatives classes implements to process data
      * @param integer this integer contains the delay until the method can be executed again
-     * @return A vector containing the ids of the runnables that can be exectued after 
-     * this process (e.g new data has been generated)
+     * @param enabledJobs the ids of the runnables that can be exectued after 
+     * this process (e.g new data has been generated) are appended to it
+     */
+    virtual void processFrame(int& ret, std::vector<int> &enabledJobs) = 0;
+    
+    /**
+     * Executes processFrame accounting its wall and cpu time in the runnable profile
+     * @param ret same as processFrame
+     * @param enabledJobs same as processFrame
      */
-    virtual std::vector<int> processFrame(int& ret) = 0;
+    void profiledProcessFrame(int& ret, std::vector<int> &enabledJobs);
+    
+    /**
+     * Used after processFrame in order to profile calls with nothing to process
+     * @return true if the last processFrame call had nothing to process
+     */
+    virtual bool stalled() {return false;};
     
 private:
     
 protected:
-    std::mutex mtx;
+    ProfiledMutex mtx;
     bool run;
 
 private:
     std::chrono::system_clock::time_point time;
     const bool periodic;
     int id;
+    int affinity;
+    std::atomic<RunnablePriority> priority;
+    std::atomic<bool> dedicated;
+    ProcessProfile profile;
 };
 
 
@@ -137,5 +301,15 @@ struct RunnableLess : public std::binary_function<Runnable*, Runnable*, bool>
     }
 };
 
+/*! Orders runnables by their next execution time point, the latest first.
+    Used to keep a min-heap of timed runnables with std::push_heap/std::pop_heap */
+struct RunnableLater
+{
+    bool operator()(const Runnable* lhs, const Runnable* rhs) const
+    {
+        return lhs->getTime() > rhs->getTime();
+    }
+};
+
 
 #endif
@@ -0,0 +1,322 @@
+/*
+ *  SampleConverter.cpp - Audio sample format conversion
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "SampleConverter.hh"
+#include "Utils.hh"
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+//NOTE: multi byte samples are little endian whatever the host order is, they are composed byte by byte
+
+template <size_t S>
+SIMD_KERNEL
+static void u8ToFloat(unsigned char const* __restrict__ in, float* __restrict__ out, size_t n, size_t stride)
+{
+    const size_t st = S ? S : stride;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (in[i*st] - 128) / 128.0f;
+    }
+}
+
+template <size_t S>
+SIMD_KERNEL
+static void s16ToFloat(unsigned char const* __restrict__ in, float* __restrict__ out, size_t n, size_t stride)
+{
+    const size_t st = S ? S : stride;
+    int16_t value;
+    
+    for (size_t i = 0; i < n; i++) {
+        value = (int16_t)(in[2*i*st] | in[2*i*st + 1] << 8);
+        out[i] = value / 32768.0f;
+    }
+}
+
+template <size_t S>
+SIMD_KERNEL
+static void fltToFloat(unsigned char const* __restrict__ in, float* __restrict__ out, size_t n, size_t stride)
+{
+    const size_t st = S ? S : stride;
+    for (size_t i = 0; i < n; i++) {
+        memcpy(out + i, in + 4*i*st, 4);
+    }
+}
+
+template <size_t S>
+SIMD_KERNEL
+static void floatToU8(float const* __restrict__ in, unsigned char* __restrict__ out, size_t n, size_t stride)
+{
+    const size_t st = S ? S : stride;
+    for (size_t i = 0; i < n; i++) {
+        out[i*st] = (unsigned char) simdMin(simdMax(in[i]*128.0f + 128.0f, 0.0f), 255.0f);
+    }
+}
+
+template <size_t S>
+SIMD_KERNEL
+static void floatToS16(float const* __restrict__ in, unsigned char* __restrict__ out, size_t n, size_t stride)
+{
+    const size_t st = S ? S : stride;
+    int16_t value;
+    
+    for (size_t i = 0; i < n; i++) {
+        value = (int16_t) simdMin(simdMax(in[i]*32768.0f, -32768.0f), 32767.0f);
+        out[2*i*st] = value & 0xFF;
+        out[2*i*st + 1] = (value >> 8) & 0xFF;
+    }
+}
+
+template <size_t S>
+SIMD_KERNEL
+static void floatToFlt(float const* __restrict__ in, unsigned char* __restrict__ out, size_t n, size_t stride)
+{
+    const size_t st = S ? S : stride;
+    for (size_t i = 0; i < n; i++) {
+        memcpy(out + 4*i*st, in + i, 4);
+    }
+}
+
+/**
+* Copies the samples of one channel into an interleaved buffer
+*/
+template <size_t bytes, size_t S>
+SIMD_KERNEL
+static void interleave(unsigned char const* __restrict__ in, unsigned char* __restrict__ out, size_t n, size_t stride)
+{
+    const size_t st = S ? S : stride;
+    
+    for (size_t i = 0; i < n; i++) {
+        memcpy(out + i*st*bytes, in + i*bytes, bytes);
+    }
+}
+
+/**
+* Copies the samples of one channel out of an interleaved buffer
+*/
+template <size_t bytes, size_t S>
+SIMD_KERNEL
+static void deinterleave(unsigned char const* __restrict__ in, unsigned char* __restrict__ out, size_t n, size_t stride)
+{
+    const size_t st = S ? S : stride;
+    
+    for (size_t i = 0; i < n; i++) {
+        memcpy(out + i*bytes, in + i*st*bytes, bytes);
+    }
+}
+
+/**
+* Runs a kernel instance for the stride, mono, stereo, 5.1 and 7.1 ones have a constant stride the compiler vectorises
+*/
+template <typename In, typename Out, void (*K1)(In, Out, size_t, size_t), void (*K2)(In, Out, size_t, size_t), 
+          void (*K6)(In, Out, size_t, size_t), void (*K8)(In, Out, size_t, size_t), void (*KN)(In, Out, size_t, size_t)>
+static void runKernel(In in, Out out, size_t n, size_t stride)
+{
+    switch(stride) {
+        case 1:
+            K1(in, out, n, stride);
+            break;
+        case 2:
+            K2(in, out, n, stride);
+            break;
+        case 6:
+            K6(in, out, n, stride);
+            break;
+        case 8:
+            K8(in, out, n, stride);
+            break;
+        default:
+            KN(in, out, n, stride);
+            break;
+    }
+}
+
+/**
+* Selects the kernel instance for the stride as runKernel does, for callers that keep it
+*/
+template <typename Kernel, Kernel K1, Kernel K2, Kernel K6, Kernel K8, Kernel KN>
+static Kernel selectKernel(size_t stride)
+{
+    switch(stride) {
+        case 1:
+            return K1;
+        case 2:
+            return K2;
+        case 6:
+            return K6;
+        case 8:
+            return K8;
+        default:
+            return KN;
+    }
+}
+
+#define SELECT_KERNEL(kernel, type, stride) \
+    selectKernel<type, kernel<1>, kernel<2>, kernel<6>, kernel<8>, kernel<0>>(stride)
+
+#define RUN_COPY_KERNEL(kernel, bytes, in, out, n, stride) \
+    runKernel<decltype(in), decltype(out), kernel<bytes, 1>, kernel<bytes, 2>, kernel<bytes, 6>, kernel<bytes, 8>, \
+              kernel<bytes, 0>>(in, out, n, stride)
+
+/**
+* Copies samples of the same type between a planar and an interleaved layout
+*/
+static void copySamples(unsigned char const* in, bool interleaving, unsigned char* out, size_t n, size_t bytes, size_t stride)
+{
+    switch(bytes) {
+        case 1:
+            interleaving ? RUN_COPY_KERNEL(interleave, 1, in, out, n, stride) : RUN_COPY_KERNEL(deinterleave, 1, in, out, n, stride);
+            break;
+        case 2:
+            interleaving ? RUN_COPY_KERNEL(interleave, 2, in, out, n, stride) : RUN_COPY_KERNEL(deinterleave, 2, in, out, n, stride);
+            break;
+        default:
+            interleaving ? RUN_COPY_KERNEL(interleave, 4, in, out, n, stride) : RUN_COPY_KERNEL(deinterleave, 4, in, out, n, stride);
+            break;
+    }
+}
+
+SampleConverter::ToFloatKernel SampleConverter::getToFloatKernel(SampleFmt fmt, unsigned stride)
+{
+    switch(fmt) {
+        case U8:
+        case U8P:
+            return SELECT_KERNEL(u8ToFloat, ToFloatKernel, stride);
+        case S16:
+        case S16P:
+            return SELECT_KERNEL(s16ToFloat, ToFloatKernel, stride);
+        case FLT:
+        case FLTP:
+            return SELECT_KERNEL(fltToFloat, ToFloatKernel, stride);
+        default:
+            return NULL;
+    }
+}
+
+SampleConverter::FromFloatKernel SampleConverter::getFromFloatKernel(SampleFmt fmt, unsigned stride)
+{
+    switch(fmt) {
+        case U8:
+        case U8P:
+            return SELECT_KERNEL(floatToU8, FromFloatKernel, stride);
+        case S16:
+        case S16P:
+            return SELECT_KERNEL(floatToS16, FromFloatKernel, stride);
+        case FLT:
+        case FLTP:
+            return SELECT_KERNEL(floatToFlt, FromFloatKernel, stride);
+        default:
+            return NULL;
+    }
+}
+
+bool SampleConverter::toFloat(unsigned char const* src, SampleFmt fmt, float* dst, unsigned samples, unsigned stride)
+{
+    ToFloatKernel kernel = getToFloatKernel(fmt, stride);
+
+    if (!kernel) {
+        return false;
+    }
+
+    kernel(src, dst, samples, stride);
+    return true;
+}
+
+bool SampleConverter::fromFloat(float const* src, unsigned char* dst, SampleFmt fmt, unsigned samples, unsigned stride)
+{
+    FromFloatKernel kernel = getFromFloatKernel(fmt, stride);
+
+    if (!kernel) {
+        return false;
+    }
+
+    kernel(src, dst, samples, stride);
+    return true;
+}
+
+bool SampleConverter::convert(unsigned char const* const* src, SampleFmt srcFmt, unsigned char* const* dst, SampleFmt dstFmt,
+                              unsigned channels, unsigned samples)
+{
+    int srcBytes = utils::getBytesPerSampleFromFormat(srcFmt);
+    int dstBytes = utils::getBytesPerSampleFromFormat(dstFmt);
+    bool srcPlanar = isPlanar(srcFmt);
+    bool dstPlanar = isPlanar(dstFmt);
+    unsigned srcStride = srcPlanar ? 1 : channels;
+    unsigned dstStride = dstPlanar ? 1 : channels;
+    unsigned char const* in;
+    unsigned char* out;
+    float block[CONVERSION_BLOCK];
+    unsigned len;
+
+    if (srcBytes <= 0 || dstBytes <= 0) {
+        return false;
+    }
+
+    if (srcBytes == dstBytes && !srcPlanar && !dstPlanar) {
+        memcpy(dst[0], src[0], samples*channels*srcBytes);
+        return true;
+    }
+
+    for (unsigned c = 0; c < channels; c++) {
+        in = srcPlanar ? src[c] : src[0] + c*srcBytes;
+        out = dstPlanar ? dst[c] : dst[0] + c*dstBytes;
+
+        if (srcBytes == dstBytes && srcPlanar && dstPlanar) {
+            memcpy(out, in, samples*srcBytes);
+            continue;
+        }
+
+        if (srcBytes == dstBytes) {
+            copySamples(in, srcPlanar, out, samples, srcBytes, channels);
+            continue;
+        }
+
+        for (unsigned done = 0; done < samples; done += len) {
+            len = std::min(samples - done, (unsigned) CONVERSION_BLOCK);
+            toFloat(in + done*srcStride*srcBytes, srcFmt, block, len, srcStride);
+            fromFloat(block, out + done*dstStride*dstBytes, dstFmt, len, dstStride);
+        }
+    }
+
+    return true;
+}
+
+bool SampleConverter::isPlanar(SampleFmt fmt)
+{
+    return fmt == U8P || fmt == S16P || fmt == FLTP;
+}
+
+SampleFmt SampleConverter::toPlanar(SampleFmt fmt)
+{
+    switch(fmt) {
+        case U8:
+        case U8P:
+            return U8P;
+        case S16:
+        case S16P:
+            return S16P;
+        case FLT:
+        case FLTP:
+            return FLTP;
+        default:
+            return S_NONE;
+    }
+}
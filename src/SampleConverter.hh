@@ -0,0 +1,141 @@
+/*
+ *  SampleConverter.hh - Audio sample format conversion
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _SAMPLE_CONVERTER_HH
+#define _SAMPLE_CONVERTER_HH
+
+#include <cstddef>
+
+#include "Types.hh"
+
+//NOTE: GCC clones the kernels for each target and picks one at load time from the CPU features. 
+//      NEON is part of the AArch64 baseline, so there the default clone is already vectorised. 
+//      Kernels are optimised as with -O3 whatever the build level is, -O2 does not vectorise them.
+//      Reductions (sums, peaks) only vectorise if operations can be reordered, SIMD_REDUCTION_KERNEL allows it.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define SIMD_KERNEL __attribute__((target_clones("avx2", "sse4.2", "default"), optimize("O3")))
+#define SIMD_REDUCTION_KERNEL __attribute__((target_clones("avx2", "sse4.2", "default"), optimize("O3", "fast-math")))
+#elif defined(__GNUC__) && !defined(__clang__)
+#define SIMD_KERNEL __attribute__((optimize("O3")))
+#define SIMD_REDUCTION_KERNEL __attribute__((optimize("O3", "fast-math")))
+#else
+#define SIMD_KERNEL
+#define SIMD_REDUCTION_KERNEL
+#endif
+
+//NOTE: helpers used inside the kernels must be inlined even without optimisations, std::min and 
+//      std::max calls would keep the loops scalar
+#if defined(__GNUC__)
+#define SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define SIMD_INLINE inline
+#endif
+
+static SIMD_INLINE float simdMin(float a, float b) {return a < b ? a : b;}
+static SIMD_INLINE float simdMax(float a, float b) {return a > b ? a : b;}
+static SIMD_INLINE float simdAbs(float a) {return a < 0 ? -a : a;}
+
+#define CONVERSION_BLOCK 256    //!< Samples converted at once through the intermediate float representation
+
+/*! Conversion between the sample formats of SampleFmt (U8, S16 and FLT, planar or interleaved). 
+    Samples of different types are converted through a float representation in [-1.0, 1.0), samples 
+    of the same type are only interleaved or deinterleaved. Interleaved formats use the first plane only.
+*/
+class SampleConverter {
+
+public:
+    /**
+    * Kernel converting samples of a format to float, see toFloat
+    */
+    typedef void (*ToFloatKernel)(unsigned char const* src, float* dst, size_t samples, size_t stride);
+
+    /**
+    * Kernel converting float samples to a format, see fromFloat
+    */
+    typedef void (*FromFloatKernel)(float const* src, unsigned char* dst, size_t samples, size_t stride);
+
+    /**
+    * Selects the kernel instance for a sample format and stride, so streams with a known format
+    * resolve it once (e.g. when configuring a reader) instead of on every conversion
+    * @param fmt sample format of the source samples
+    * @param stride distance in samples between two consecutive source samples
+    * @return the kernel, NULL if the sample format is not supported
+    */
+    static ToFloatKernel getToFloatKernel(SampleFmt fmt, unsigned stride = 1);
+
+    /**
+    * Selects the kernel instance for a sample format and stride, see getToFloatKernel
+    * @param fmt sample format of the destination samples
+    * @param stride distance in samples between two consecutive destination samples
+    * @return the kernel, NULL if the sample format is not supported
+    */
+    static FromFloatKernel getFromFloatKernel(SampleFmt fmt, unsigned stride = 1);
+
+    /**
+    * Converts samples with any layout to a float buffer
+    * @param src pointer to the first sample bytes
+    * @param fmt sample format of src
+    * @param dst float buffer to fill
+    * @param samples number of samples to convert
+    * @param stride distance in samples between two consecutive src samples, the channels of interleaved formats
+    * @return false if the sample format is not supported
+    */
+    static bool toFloat(unsigned char const* src, SampleFmt fmt, float* dst, unsigned samples, unsigned stride = 1);
+
+    /**
+    * Converts float samples to any sample format, out of range values are saturated
+    * @param src float samples
+    * @param dst pointer to the first destination sample bytes
+    * @param fmt sample format of dst
+    * @param samples number of samples to convert
+    * @param stride distance in samples between two consecutive dst samples, the channels of interleaved formats
+    * @return false if the sample format is not supported
+    */
+    static bool fromFloat(float const* src, unsigned char* dst, SampleFmt fmt, unsigned samples, unsigned stride = 1);
+
+    /**
+    * Converts a whole audio buffer between sample formats and layouts
+    * @param src source planes, only src[0] is used for interleaved formats
+    * @param srcFmt source sample format
+    * @param dst destination planes, only dst[0] is used for interleaved formats
+    * @param dstFmt destination sample format
+    * @param channels number of channels
+    * @param samples number of samples per channel
+    * @return false if any of the sample formats is not supported
+    */
+    static bool convert(unsigned char const* const* src, SampleFmt srcFmt, unsigned char* const* dst, SampleFmt dstFmt,
+                        unsigned channels, unsigned samples);
+
+    /**
+    * @param fmt sample format
+    * @return true for U8P, S16P and FLTP
+    */
+    static bool isPlanar(SampleFmt fmt);
+
+    /**
+    * @param fmt sample format
+    * @return the planar format with the same sample type, S_NONE if not supported
+    */
+    static SampleFmt toPlanar(SampleFmt fmt);
+};
+
+#endif
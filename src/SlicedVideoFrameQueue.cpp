@@ -22,9 +22,22 @@
  */
 
 #include "SlicedVideoFrameQueue.hh"
+#include "FramePool.hh"
 #include "Utils.hh"
+#include "AsyncLog.hh"
+#include "NalSplitter.hh"
 #include <cstring>
 
+#define H264_NALU_TYPE_MASK 0x1F
+#define H264_NALU_REF_MASK 0x60
+#define H264_IDR 5
+#define H265_NALU_TYPE_MASK 0x7E
+#define H265_BLA_W_LP 16
+#define H265_IRAP_MAX 23
+#define H265_VCL_MAX 31
+#define H265_SUB_LAYER_NON_REF_MAX 14
+#define AVCC_LENGTH_SIZE 4
+
 SlicedVideoFrameQueue* SlicedVideoFrameQueue::createNew(struct ConnectionData cData,
         const StreamInfo *si, unsigned maxFrames, unsigned maxSliceSize)
 {
@@ -46,8 +59,14 @@ SlicedVideoFrameQueue* SlicedVideoFrameQueue::createNew(struct ConnectionData cD
 }
 
 SlicedVideoFrameQueue::SlicedVideoFrameQueue(struct ConnectionData cData, const StreamInfo *si,
-        unsigned maxFrames) : VideoFrameQueue(cData, si, maxFrames)
+        unsigned maxFrames) : VideoFrameQueue(cData, si, maxFrames), inputFrame(NULL), sliceSize(0), pictureOpen(false)
 {
+    //NOTE: the type of the pictures is taken from their NAL units headers
+    typedFrames = si->video.codec == H264 || si->video.codec == H265;
+    
+    if (typedFrames && cData.dropPolicy != DP_NONE) {
+        dropPolicy = cData.dropPolicy;
+    }
 }
 
 SlicedVideoFrameQueue::~SlicedVideoFrameQueue()
@@ -57,25 +76,33 @@ SlicedVideoFrameQueue::~SlicedVideoFrameQueue()
 
 Frame* SlicedVideoFrameQueue::getRear()
 {
-    if ((rear + 1) % max == front){
+    if (!AVFramedQueue::getRear()){
         return NULL;
     }
 
     return inputFrame;
 }
 
-std::vector<int> SlicedVideoFrameQueue::addFrame()
+const std::vector<int>& SlicedVideoFrameQueue::addFrame()
 {
-    pushBackSliceGroup(inputFrame->getSlices(), inputFrame->getSliceNum());
+    pushBackSliceGroup(inputFrame->getSlices(), inputFrame->getSliceNum(), !pictureOpen);
     inputFrame->clear();
+    inputFrame->getSideData().clear();
+    pictureOpen = false;
     
-    std::vector<int> ret;
-    
-    for (auto& r : connectionData.readers){
-        ret.push_back(r.rFilterId);
+    return getReaderIds();
+}
+
+const std::vector<int>& SlicedVideoFrameQueue::addSlices()
+{
+    if (inputFrame->getSliceNum() > 0) {
+        pushBackSliceGroup(inputFrame->getSlices(), inputFrame->getSliceNum(), !pictureOpen);
+        pictureOpen = true;
     }
+
+    inputFrame->clear();
     
-    return ret;
+    return getReaderIds();
 }
 
 Frame* SlicedVideoFrameQueue::forceGetRear()
@@ -85,26 +112,23 @@ Frame* SlicedVideoFrameQueue::forceGetRear()
 
 Frame* SlicedVideoFrameQueue::innerGetRear() 
 {
-    if ((rear + 1) % max == front){
-        return NULL;
-    }
-    
-    return frames[rear];
+    return AVFramedQueue::getRear();
 }
 
 Frame* SlicedVideoFrameQueue::innerForceGetRear()
 {
     Frame *frame;
     while ((frame = innerGetRear()) == NULL) {
-        utils::debugMsg("Frame discarted by X264 Circular Buffer");
-        flush();
+        DEBUG_MSG("Frame discarted by X264 Circular Buffer");
+        countForcedFlush();
+        dropFrames();
     }
     return frame;
 }
 
-void SlicedVideoFrameQueue::innerAddFrame() 
+void SlicedVideoFrameQueue::innerAddFrame(bool pictureStart) 
 {
-    rear =  (rear + 1) % max;
+    advanceRear(pictureStart);
 }
 
 bool SlicedVideoFrameQueue::setup(unsigned maxSliceSize)
@@ -115,21 +139,99 @@ bool SlicedVideoFrameQueue::setup(unsigned maxSliceSize)
         return false;
     }
 
-    for (unsigned i=0; i < max; i++) {
-        frames[i] = InterleavedVideoFrame::createNew(streamInfo->video.codec, maxSliceSize);
+    sliceSize = maxSliceSize;
+
+    return fillFrames();
+}
 
-        if (!frames[i]) {
-            return false;
+Frame* SlicedVideoFrameQueue::allocFrame()
+{
+    return FramePool::getInstance()->getSliceRefFrame(streamInfo->video.codec);
+}
+
+std::shared_ptr<SliceStore> SlicedVideoFrameQueue::getFreeStore()
+{
+    //NOTE: only this writer hands out store references, a store referenced by the 
+    //      list alone is not pointed by any queued, retained or pooled frame
+    for (auto& s : stores) {
+        if (s.use_count() == 1) {
+            return s;
         }
     }
+    
+    stores.push_back(std::make_shared<SliceStore>());
+    return stores.back();
+}
 
-    return true;
+void SlicedVideoFrameQueue::getPictureType(Slice* slices, int sliceNum, bool &key, bool &reference)
+{
+    unsigned char const* nal;
+    unsigned header, type;
+    bool vcl = false;
+    
+    key = false;
+    reference = false;
+    
+    for (int i = 0; i < sliceNum; i++) {
+        nal = slices[i].getData();
+        header = streamInfo->video.h264or5.annexb ? 
+            NalSplitter::startCodeLength(nal, slices[i].getDataSize()) : AVCC_LENGTH_SIZE;
+        
+        if (slices[i].getDataSize() <= header) {
+            continue;
+        }
+        
+        nal += header;
+        
+        if (streamInfo->video.codec == H264) {
+            type = nal[0] & H264_NALU_TYPE_MASK;
+            
+            if (type > 0 && type <= H264_IDR) {
+                vcl = true;
+                key |= type == H264_IDR;
+                reference |= (nal[0] & H264_NALU_REF_MASK) != 0;
+            }
+            continue;
+        }
+        
+        type = (nal[0] & H265_NALU_TYPE_MASK) >> 1;
+        
+        //NOTE: even types up to RSV_VCL_N14 are sub-layer non-reference pictures
+        if (type <= H265_VCL_MAX) {
+            vcl = true;
+            key |= type >= H265_BLA_W_LP && type <= H265_IRAP_MAX;
+            reference |= type > H265_SUB_LAYER_NON_REF_MAX || type % 2 == 1;
+        }
+    }
+    
+    //NOTE: groups without pictures (i.e. parameter sets) are needed by the next ones
+    reference |= !vcl;
 }
 
-void SlicedVideoFrameQueue::pushBackSliceGroup(Slice* slices, int sliceNum) 
+void SlicedVideoFrameQueue::pushBackSliceGroup(Slice* slices, int sliceNum, bool pictureStart) 
 {
     Frame* frame;
-    VideoFrame* vFrame;
+    SliceRefVideoFrame* vFrame;
+    std::shared_ptr<SliceStore> store;
+    unsigned offset;
+    bool key = false;
+    bool reference = true;
+    
+    if (sliceNum <= 0) {
+        return;
+    }
+    
+    if (typedFrames) {
+        getPictureType(slices, sliceNum, key, reference);
+    }
+    
+    store = getFreeStore();
+    if (!store->fill(slices, sliceNum)) {
+        ERROR_MSG("SlicedVideoFrameQueue: could not allocate slice store, slices discarded");
+        return;
+    }
+    
+    offset = 0;
 
     for (int i=0; i<sliceNum; i++) {
 
@@ -137,15 +239,20 @@ void SlicedVideoFrameQueue::pushBackSliceGroup(Slice* slices, int sliceNum)
             frame = innerForceGetRear();
         }
 
-        vFrame = dynamic_cast<VideoFrame*>(frame);
+        vFrame = dynamic_cast<SliceRefVideoFrame*>(frame);
         vFrame->setSequenceNumber(inputFrame->getSequenceNumber());
 
-        memcpy(vFrame->getDataBuf(), slices[i].getData(), slices[i].getDataSize());
-        vFrame->setLength(slices[i].getDataSize());
+        vFrame->setSlice(store, offset, slices[i].getDataSize());
+        offset += slices[i].getDataSize();
         vFrame->setPresentationTime(inputFrame->getPresentationTime());
         vFrame->setDecodeTime(inputFrame->getDecodeTime());
         vFrame->setOriginTime(inputFrame->getOriginTime());
         vFrame->setSize(inputFrame->getWidth(), inputFrame->getHeight());
-        innerAddFrame();
+        vFrame->setFrameType(key, reference);
+        //NOTE: the metadata of the access unit goes with its first NAL unit
+        if (pictureStart && i == 0) {
+            vFrame->getSideData() = inputFrame->getSideData();
+        }
+        innerAddFrame(pictureStart && i == 0);
     }
 }      
@@ -23,12 +23,16 @@
 #ifndef _SLICED_VIDEO_FRAME_QUEUE_HH
 #define _SLICED_VIDEO_FRAME_QUEUE_HH
 
+#include <memory>
+#include <vector>
+
 #include "Types.hh"
 #include "AVFramedQueue.hh"
 #include "VideoFrame.hh"
 
 /*! Virtual interface for X264VideoCircularBuffer and X265VideoCircularBuffer. In is a child class from VideoFrameQueue, modifying its 
-    input behaviour. */
+    input behaviour. Each NAL unit takes a queue slot, all of them typed as the picture they belong to (read from their headers), 
+    so the connection DropPolicy applies to H264 and H265 streams whatever the encoder is. */
 
 class SlicedVideoFrameQueue : public VideoFrameQueue {
 
@@ -52,11 +56,18 @@ public:
     Frame *getRear();
 
     /**
-    * It dumps input frame data into internal VideoFrameQueue. Each NAL unit stored in input frame is copied
-    * into a VideoFrame structure.
+    * It dumps input frame data into internal VideoFrameQueue. The NAL units stored in input frame are copied 
+    * once into a shared SliceStore and each of them is queued as a SliceRefVideoFrame pointing into it.
+    * @return the ids of the reader filters that has a new frame available.
+    */
+    const std::vector<int>& addFrame();
+
+    /**
+    * It dumps the NAL units stored in input frame so far, before the picture is complete. The first call of each picture
+    * starts it, the remaining NAL units are dumped by addFrame. Input frame metadata is kept for the rest of the picture.
     * @return the ids of the reader filters that has a new frame available.
     */
-    std::vector<int> addFrame();
+    const std::vector<int>& addSlices();
 
     /**
     * It returns the input frame, flushing the internal buffer if the internal buffer is full. It may cause data loss.
@@ -64,16 +75,24 @@ public:
     */
     Frame *forceGetRear();
 
+protected:
+    Frame *allocFrame();
+
 private:
     SlicedVideoFrameQueue(struct ConnectionData cData, const StreamInfo *si, unsigned maxFrames);
 
-    void pushBackSliceGroup(Slice* slices, int sliceNum);
+    void pushBackSliceGroup(Slice* slices, int sliceNum, bool pictureStart);
+    void getPictureType(Slice* slices, int sliceNum, bool &key, bool &reference);
     Frame *innerGetRear();
     Frame *innerForceGetRear();
-    void innerAddFrame();
+    void innerAddFrame(bool pictureStart);
     bool setup(unsigned maxSliceSize);
+    std::shared_ptr<SliceStore> getFreeStore();
 
     SlicedVideoFrame* inputFrame;
+    unsigned sliceSize;
+    bool pictureOpen;                   //!< Some NAL units of the input picture are already queued, see addSlices
+    std::vector<std::shared_ptr<SliceStore>> stores;
 
 };
 
@@ -0,0 +1,144 @@
+/*
+ *  SlotMap.hh - Flat map of filter reader and writer slots
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _SLOT_MAP_HH
+#define _SLOT_MAP_HH
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+/*! Map from reader or writer ids to their slot values, kept as a vector of pairs sorted by id.
+    Filters have a few slots, bounded by their maximum readers or writers, so the vector is reserved
+    for all of them once and filling and clearing the map on every processFrame call never allocates.
+    It offers the part of the std::map interface used by the filters, iterated in ids order as well,
+    but inserting or erasing slots invalidates iterators and references to the other slots.
+*/
+template <typename T>
+class SlotMap {
+
+public:
+    typedef std::pair<int, T> value_type;
+    typedef typename std::vector<value_type>::iterator iterator;
+    typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+    /**
+    * @param slots number of slots reserved
+    */
+    SlotMap(size_t slots = 0) {slotsVec.reserve(slots);};
+
+    /**
+    * Reserves storage for the slots, so inserting up to this number of them does not allocate
+    * @param slots number of slots
+    */
+    void reserve(size_t slots) {slotsVec.reserve(slots);};
+
+    /**
+    * Gets the value of a slot, inserting it with a default value if it does not exist
+    * @param id reader or writer id
+    * @return the slot value
+    */
+    T& operator[](int id)
+    {
+        iterator it = lower(id);
+
+        if (it == slotsVec.end() || it->first != id) {
+            it = slotsVec.insert(it, value_type(id, T()));
+        }
+
+        return it->second;
+    };
+
+    /**
+    * @param id reader or writer id
+    * @return 1 if the slot exists and 0 otherwise
+    */
+    size_t count(int id) const
+    {
+        const_iterator it = lower(id);
+        return it != slotsVec.end() && it->first == id ? 1 : 0;
+    };
+
+    iterator find(int id)
+    {
+        iterator it = lower(id);
+        return it != slotsVec.end() && it->first == id ? it : slotsVec.end();
+    };
+
+    const_iterator find(int id) const
+    {
+        const_iterator it = lower(id);
+        return it != slotsVec.end() && it->first == id ? it : slotsVec.end();
+    };
+
+    /**
+    * @param id reader or writer id
+    * @return number of erased slots
+    */
+    size_t erase(int id)
+    {
+        iterator it = find(id);
+
+        if (it == slotsVec.end()) {
+            return 0;
+        }
+
+        slotsVec.erase(it);
+        return 1;
+    };
+
+    /**
+    * @param it slot to erase
+    * @return the slot following the erased one
+    */
+    iterator erase(iterator it) {return slotsVec.erase(it);};
+
+    /**
+    * Removes all the slots, keeping the reserved storage
+    */
+    void clear() {slotsVec.clear();};
+
+    size_t size() const {return slotsVec.size();};
+    bool empty() const {return slotsVec.empty();};
+
+    iterator begin() {return slotsVec.begin();};
+    iterator end() {return slotsVec.end();};
+    const_iterator begin() const {return slotsVec.begin();};
+    const_iterator end() const {return slotsVec.end();};
+
+private:
+    iterator lower(int id)
+    {
+        return std::lower_bound(slotsVec.begin(), slotsVec.end(), id,
+                                [](const value_type &slot, int slotId) {return slot.first < slotId;});
+    };
+
+    const_iterator lower(int id) const
+    {
+        return std::lower_bound(slotsVec.begin(), slotsVec.end(), id,
+                                [](const value_type &slot, int slotId) {return slot.first < slotId;});
+    };
+
+    std::vector<value_type> slotsVec;
+};
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ *  SpeakerActivity.cpp - Process wide board of the audio mixers channel levels
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "SpeakerActivity.hh"
+
+SpeakerActivity* SpeakerActivity::getInstance()
+{
+    static SpeakerActivity instance;
+
+    return &instance;
+}
+
+void SpeakerActivity::publish(int mixerId, const std::map<int, float> &levels)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    Board &board = boards[mixerId];
+
+    board.levels = levels;
+    board.seq++;
+}
+
+void SpeakerActivity::remove(int mixerId)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    boards.erase(mixerId);
+}
+
+bool SpeakerActivity::read(int mixerId, std::map<int, float> &levels, uint64_t &seq)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    auto it = boards.find(mixerId);
+
+    if (it == boards.end() || it->second.seq == seq) {
+        return false;
+    }
+
+    levels = it->second.levels;
+    seq = it->second.seq;
+    return true;
+}
+
+SpeakerSelector::SpeakerSelector() :
+    margin(SPEAKER_MARGIN), hold(SPEAKER_HOLD), speaker(-1), switches(0)
+{
+}
+
+bool SpeakerSelector::configure(float margin_, std::chrono::milliseconds hold_)
+{
+    if (margin_ < 1 || hold_.count() < 0) {
+        return false;
+    }
+
+    margin = margin_;
+    hold = hold_;
+    return true;
+}
+
+int SpeakerSelector::select(const std::map<int, float> &levels, std::chrono::steady_clock::time_point now)
+{
+    int loudest = -1;
+    float level = SPEAKER_THRESHOLD;
+    float current = 0;
+
+    for (auto it : levels) {
+        if (it.second >= level) {
+            loudest = it.first;
+            level = it.second;
+        }
+        if (it.first == speaker) {
+            current = it.second;
+        }
+    }
+
+    if (loudest < 0 || loudest == speaker) {
+        return speaker;
+    }
+
+    //NOTE: a speaker no longer in the levels loses the floor at once
+    if (speaker >= 0 && levels.count(speaker) > 0 && (level < current*margin || now - since < hold)) {
+        return speaker;
+    }
+
+    speaker = loudest;
+    since = now;
+    switches++;
+    return speaker;
+}
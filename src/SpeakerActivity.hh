@@ -0,0 +1,125 @@
+/*
+ *  SpeakerActivity.hh - Process wide board of the audio mixers channel levels
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _SPEAKER_ACTIVITY_HH
+#define _SPEAKER_ACTIVITY_HH
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+#define SPEAKER_THRESHOLD 0.001             /*!< Level under which a channel is silent, as the mixer one */
+#define SPEAKER_MARGIN 2.0                  /*!< Times louder a channel must be to take the floor, 6 dB */
+#define SPEAKER_HOLD 1000                   /*!< Milliseconds the speaker keeps the floor at least */
+
+/*! Process wide board where the audio mixers publish the levels of their channels on every mixed
+    frame, so other filters (e.g. VideoMixer speaker layouts) follow the active speaker within one audio
+    frame, without polling the mixer state through the control API. Mixers are identified by their
+    filter ID and readers only copy the levels when a new publication is there.
+*/
+class SpeakerActivity {
+
+public:
+    /**
+     * Gets the SpeakerActivity instance, it is created the first time it is requested
+     * @return the process wide board
+     */
+    static SpeakerActivity* getInstance();
+
+    /**
+     * Publishes the levels of the channels of a mixer, replacing the previous ones
+     * @param mixerId filter ID of the mixer
+     * @param levels channel levels by channel ID
+     */
+    void publish(int mixerId, const std::map<int, float> &levels);
+
+    /**
+     * Removes a mixer from the board
+     */
+    void remove(int mixerId);
+
+    /**
+     * Reads the levels of a mixer if they were published after the given sequence
+     * @param mixerId filter ID of the mixer
+     * @param levels where the levels are copied
+     * @param seq last sequence read, updated with the one of the copied levels
+     * @return true if newer levels are copied, false if there are none or the mixer is not there
+     */
+    bool read(int mixerId, std::map<int, float> &levels, uint64_t &seq);
+
+private:
+    SpeakerActivity() {};
+
+    struct Board {
+        Board() : seq(0) {};
+        std::map<int, float> levels;
+        uint64_t seq;
+    };
+
+    std::map<int, Board> boards;
+    std::mutex mtx;
+};
+
+/*! Picks the active speaker from the channel levels with hysteresis: the loudest channel over the
+    silence threshold takes the floor if there is no speaker, or if it is margin times louder than the
+    current one once the current one has held it for the hold time. Silent channels never take it, so
+    the floor stays with the last speaker during pauses.
+*/
+class SpeakerSelector {
+
+public:
+    SpeakerSelector();
+
+    /**
+     * @param margin times louder than the speaker a channel must be to take the floor, at least 1
+     * @param hold minimum time the speaker keeps the floor
+     * @return false if the margin is lower than 1 or the hold is negative
+     */
+    bool configure(float margin, std::chrono::milliseconds hold);
+
+    /**
+     * @param levels channel levels by channel ID
+     * @param now time of the levels
+     * @return channel ID of the speaker after the levels, -1 if no channel has spoken yet
+     */
+    int select(const std::map<int, float> &levels, std::chrono::steady_clock::time_point now);
+
+    /**
+     * Forgets the speaker, e.g. when it is removed
+     */
+    void reset() {speaker = -1;};
+
+    int getSpeaker() const {return speaker;};
+    float getMargin() const {return margin;};
+    std::chrono::milliseconds getHold() const {return hold;};
+    size_t getSwitches() const {return switches;};
+
+private:
+    float margin;
+    std::chrono::milliseconds hold;
+    int speaker;
+    std::chrono::steady_clock::time_point since;
+    size_t switches;
+};
+
+#endif
@@ -25,27 +25,42 @@
 #define _STREAMINFO_HH
 
 #include "Types.hh"
-#include <string.h> // For memcpy
+#include <string.h>
+#include <memory>
+#include <vector>
+#include <atomic>
+
+/** Codec-specific info of a stream, i.e. its parameter sets. It is never modified once published */
+typedef std::vector<uint8_t> ExtraData;
 
 /** Description of a stream. It is created by filters and shared with queues through const pointers, so
- * only the filter can destroy it. #extradata belongs to this struct, do not free.
+ * only the filter can destroy it. The description is set before the queues are created, except for the
+ * extradata, which a writer may change at any time (e.g. an encoder reconfiguration). Each change publishes
+ * a new immutable and reference counted version of it, readers hold the version they use and check
+ * #getExtraDataVersion to pick up the new one when it suits them, so the queues are kept. Raw video writers
+ * may change the picture size or pixel format the same way, announcing it with #changeFormat and stamping
+ * each frame with the format version it has (see VideoFrame::setFormatVersion). Readers reconfigure at the
+ * first frame of a new version, so the queues are kept and no frame is dropped.
  */
 struct StreamInfo {
     StreamType type; //!< AUDIO or VIDEO, basically
-    uint8_t *extradata; //!< Codec-specific info. This array belongs to this struct, no-one but us should free it.
-    int extradata_size; //!< Amount of bytes in #extradata
+    unsigned bitrate; //!< Nominal bitrate in kbps, as announced by the source. 0 if unknown
     union {
         /** Audio-specific data */
         struct {
             ACodecType codec;
             unsigned sampleRate;
             unsigned channels;
+            ChannelLayout channelLayout; //!< Order of the #channels, CL_NONE if unknown
             SampleFmt sampleFormat;
         } audio;
         /** Video-specific data */
         struct {
             VCodecType codec;
             PixType pixelFormat;
+            /** If true, the writer sets the type of each frame (see VideoFrame::setFrameType), so
+             * full queues drop them by their type (see DropPolicy). */
+            bool frameTypes;
             union {
                 struct {
                     /** If true, bitstream is in Annex B format, so each NALU is prefixed with a
@@ -62,21 +77,36 @@ struct StreamInfo {
         } video;
     };
 
-    /** Preferred method to set the #extradata, since it takes care of disposing of previous values.
-     * Pass NULL to free current #extradata. */
-    void setExtraData(uint8_t *data, int size) {
-        if (extradata) {
-            delete[] extradata;
-            extradata = NULL;
-            extradata_size = 0;
-        }
-        if (data) {
-            extradata = new uint8_t[size];
-            memcpy (extradata, data, size);
-            extradata_size = size;
+    /** Publishes a new version of the extradata, the previous one is released by its last reader.
+     * Pass NULL to remove it. */
+    void setExtraData(const uint8_t *data, int size) {
+        std::shared_ptr<const ExtraData> ed;
+
+        if (data && size > 0) {
+            ed = std::make_shared<const ExtraData>(data, data + size);
         }
+
+        std::atomic_store(&extradata, ed);
+        extradataVersion++;
+    }
+
+    /** Gets the current version of the extradata, which stays valid as long as the returned pointer is held.
+     * @return the extradata, NULL if there is none */
+    std::shared_ptr<const ExtraData> getExtraData() const {
+        return std::atomic_load(&extradata);
     }
 
+    /** @return number of times the extradata has been set, readers compare it to know it has changed */
+    unsigned getExtraDataVersion() const {return extradataVersion;};
+
+    /** Announces that the frames written from now on have a different format (i.e. picture size or pixel
+     * format) than the previous ones.
+     * @return the new format version, to be stamped on the frames */
+    unsigned changeFormat() {return ++formatVersion;};
+
+    /** @return number of format changes announced by the writer, see #changeFormat */
+    unsigned getFormatVersion() const {return formatVersion;};
+
     /** Sets default values for some attributes, based on the #type and the specific codec.
      * These default values where in use throughout LMS before the introduction of #StreamInfo. */
     void setCodecDefaults() {
@@ -103,6 +133,7 @@ struct StreamInfo {
                         break;
                     case G711:
                         audio.channels = 1;
+                        audio.channelLayout = MONO;
                         audio.sampleRate = 8000;
                         audio.sampleFormat = U8;
                         break;
@@ -116,19 +147,20 @@ struct StreamInfo {
     }
 
     /** Just provide as much information as you want, the rest is initialized to sane defaults. */
-    StreamInfo(StreamType type = ST_NONE, uint8_t *extradata = NULL, int extradata_size = 0) :
-        type(type), extradata(extradata), extradata_size(extradata_size) {
+    StreamInfo(StreamType type = ST_NONE) : type(type), bitrate(0), extradataVersion(0), formatVersion(0) {
             /* These are the default values that were previously used (or assumed) in LMS. */
             switch (type) {
                 case AUDIO:
                     audio.codec = AC_NONE;
                     audio.sampleRate = 0;
                     audio.channels = 0;
+                    audio.channelLayout = CL_NONE;
                     audio.sampleFormat = S_NONE;
                     break;
                 case VIDEO:
                     video.codec = VC_NONE;
                     video.pixelFormat = P_NONE;
+                    video.frameTypes = false;
                     video.h264or5.annexb = false;
                     video.h264or5.framed = true;
                     break;
@@ -137,10 +169,10 @@ struct StreamInfo {
             }
         }
 
-
-    ~StreamInfo() {
-        setExtraData(NULL, 0);
-    }
+private:
+    std::shared_ptr<const ExtraData> extradata;
+    std::atomic<unsigned> extradataVersion;
+    std::atomic<unsigned> formatVersion;
 };
 
 #endif
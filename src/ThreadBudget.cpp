@@ -0,0 +1,133 @@
+/*
+ *  ThreadBudget.cpp - Process wide budget of codec threads
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "ThreadBudget.hh"
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+ThreadBudget* ThreadBudget::getInstance()
+{
+    static ThreadBudget instance;
+    
+    return &instance;
+}
+
+ThreadBudget::ThreadBudget() : budget(std::max(std::thread::hardware_concurrency(), 1u)), generation(0)
+{
+}
+
+void ThreadBudget::setBudget(unsigned threads)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    
+    budget = threads ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+    rebalance();
+}
+
+unsigned ThreadBudget::getBudget()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return budget;
+}
+
+void ThreadBudget::join(const void *consumer, unsigned wanted)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    
+    if (shares.count(consumer) > 0 && shares[consumer].wanted == wanted) {
+        return;
+    }
+    
+    if (shares.count(consumer) == 0) {
+        shares[consumer].allocated = 0;
+    }
+    
+    shares[consumer].wanted = wanted;
+    rebalance();
+}
+
+void ThreadBudget::leave(const void *consumer)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    
+    if (shares.erase(consumer) > 0) {
+        rebalance();
+    }
+}
+
+unsigned ThreadBudget::getThreads(const void *consumer)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    
+    if (shares.count(consumer) == 0) {
+        return 0;
+    }
+    
+    return shares[consumer].allocated;
+}
+
+//NOTE: consumers are served from the smallest demand, so the threads the small ones
+//      do not use are split between the ones wanting more
+void ThreadBudget::rebalance()
+{
+    std::vector<std::pair<unsigned, Share*>> demands;
+    unsigned remaining = budget;
+    unsigned left = shares.size();
+    unsigned share;
+    bool changed = false;
+    
+    for (auto &it : shares) {
+        demands.push_back(std::make_pair(it.second.wanted ? it.second.wanted : budget, &it.second));
+    }
+    
+    std::stable_sort(demands.begin(), demands.end(), 
+        [](const std::pair<unsigned, Share*> &a, const std::pair<unsigned, Share*> &b) {
+            return a.first < b.first;
+        });
+    
+    for (auto &d : demands) {
+        share = std::max(remaining/left, 1u);
+        share = std::min(share, d.first);
+        
+        if (d.second->allocated != share) {
+            d.second->allocated = share;
+            changed = true;
+        }
+        
+        remaining -= std::min(share, remaining);
+        left--;
+    }
+    
+    if (changed) {
+        generation++;
+    }
+}
+
+void ThreadBudget::getState(Jzon::Object &node)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    
+    node.Add("threadBudget", (int) budget);
+    node.Add("threadConsumers", (int) shares.size());
+}
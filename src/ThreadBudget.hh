@@ -0,0 +1,98 @@
+/*
+ *  ThreadBudget.hh - Process wide budget of codec threads
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _THREAD_BUDGET_HH
+#define _THREAD_BUDGET_HH
+
+#include <map>
+#include <mutex>
+#include <atomic>
+
+#include "Jzon.h"
+
+/*! Process wide budget of the threads codecs run internally (x264/x265 threads, libav thread_count), 
+    by default one per core. Each consumer (usually a filter) joins it with the threads it wants, 0 for
+    as many as it can get, and gets a share: consumers wanting less than an even share get what they 
+    want and the rest are split evenly between the others, at least one thread each. Shares are 
+    rebalanced when consumers join, leave or change their demand, and the generation counter is 
+    increased if any of them changed, so consumers only check their share when it moves.
+*/
+class ThreadBudget {
+
+public:
+    /**
+     * Gets the ThreadBudget instance, it is created the first time it is requested
+     * @return the process wide budget
+     */
+    static ThreadBudget* getInstance();
+    
+    /**
+     * Sets the total threads shared by the consumers
+     * @param threads total threads, 0 for one per core
+     */
+    void setBudget(unsigned threads);
+    
+    /**
+     * @return total threads shared by the consumers
+     */
+    unsigned getBudget();
+    
+    /**
+     * Adds a consumer to the budget or updates its demand
+     * @param consumer identifier of the consumer, usually the filter itself
+     * @param wanted maximum threads the consumer can use, 0 for no limit
+     */
+    void join(const void *consumer, unsigned wanted);
+    
+    /**
+     * Removes a consumer, its threads are given to the rest
+     */
+    void leave(const void *consumer);
+    
+    /**
+     * @return threads allocated to the consumer, 0 if it has not joined
+     */
+    unsigned getThreads(const void *consumer);
+    
+    /**
+     * @return counter increased every time any share changes
+     */
+    unsigned getGeneration() const {return generation;};
+    
+    void getState(Jzon::Object &node);
+
+private:
+    ThreadBudget();
+    void rebalance();
+    
+    struct Share {
+        unsigned wanted;
+        unsigned allocated;
+    };
+    
+    std::map<const void*, Share> shares;
+    std::mutex mtx;
+    unsigned budget;
+    std::atomic<unsigned> generation;
+};
+
+#endif
@@ -42,6 +42,9 @@
 #define MAX_H264_OR_5_NAL_SIZE 1024*1024*2 //2MB
 #define LENGTH_H264_FRAME 1024*1024*10 //10MB
 #define LENGTH_VP8 512*1024 //512KB
+#define LENGTH_VP9 1024*1024 //1MB
+#define LENGTH_AV1 1024*1024 //1MB
+#define LENGTH_MJPEG 1024*1024*2 //2MB
 #define FRAMES_OPUS 100
 #define LENGTH_OPUS 2000
 #define FRAMES_AUDIO_RAW 2000
@@ -59,12 +62,24 @@ enum StreamType {ST_NONE = -1, AUDIO, VIDEO};
 /**
 * Supported video codecs
 */
-enum VCodecType {VC_NONE = -1, H264, H265, VP8, MJPEG, RAW};
+enum VCodecType {VC_NONE = -1, H264, H265, VP8, MJPEG, RAW, VP9, AV1};
 
 /**
 * Supported video pixel formats
 */
-enum PixType {P_NONE = -1, RGB24, RGB32, YUV420P, YUV422P, YUV444P, YUYV422, YUVJ420P};
+enum PixType {P_NONE = -1, RGB24, RGB32, YUV420P, YUV422P, YUV444P, YUYV422, YUVJ420P, NV12, HW_SURFACE, YUVJ422P};
+
+/**
+* Field structure of raw video pictures, interlaced ones carry two fields captured at different times
+*/
+enum FieldOrder {FO_PROGRESSIVE, FO_TOP_FIRST, FO_BOTTOM_FIRST};
+
+/**
+* Metadata carried along with frames (see FrameSideData): SMPTE 12M timecodes as libav exports them (a 32-bit
+* count followed by up to 3 packed timecodes), CEA-708 cc_data triplets and H264/H265 user data unregistered
+* SEI payloads (16 bytes UUID followed by the data)
+*/
+enum SideDataType {SD_TIMECODE, SD_CAPTIONS, SD_SEI};
 
 /**
 * Supported audio codecs
@@ -76,16 +91,36 @@ enum ACodecType {AC_NONE = -1, G711, PCMU, OPUS, PCM, AAC, MP3};
 */
 enum SampleFmt {S_NONE = -1, U8, S16, FLT, U8P, S16P, FLTP};
 
+/**
+* Supported audio channel layouts, channels follow the libav default order
+*/
+enum ChannelLayout {CL_NONE = -1, MONO, STEREO, QUAD, SURROUND_5_1, SURROUND_7_1};
+
 /**
 * Filter types
 */
-enum FilterType {FT_NONE = -1, RECEIVER, TRANSMITTER, VIDEO_DECODER, VIDEO_ENCODER, VIDEO_RESAMPLER, VIDEO_MIXER, AUDIO_DECODER, AUDIO_ENCODER, AUDIO_MIXER, SHARED_MEMORY, DASHER, DEMUXER, VIDEO_SPLITTER, V4L_CAPTURE};
+enum FilterType {FT_NONE = -1, RECEIVER, TRANSMITTER, VIDEO_DECODER, VIDEO_ENCODER, VIDEO_RESAMPLER, VIDEO_MIXER, AUDIO_DECODER, AUDIO_ENCODER, AUDIO_MIXER, SHARED_MEMORY, DASHER, DEMUXER, VIDEO_SPLITTER, V4L_CAPTURE, VIDEO_LADDER_RESAMPLER, VIDEO_LADDER_ENCODER, VIDEO_HW_ENCODER, VIDEO_VPX_ENCODER, AUDIO_MULTI_ENCODER, SHARED_MEMORY_INGEST, RECORDER, VIDEO_PREVIEWER, FRAME_LINK_SENDER, FRAME_LINK_RECEIVER, VIDEO_SWITCHER, VIDEO_AV1_ENCODER, TIME_SHIFT, LOUDNESS_NORMALIZER, DEINTERLACER, SIGNAL_MONITOR};
 
 enum FilterRole {FR_NONE = -1, REGULAR, SERVER};
 
+/**
+* Scheduling priority classes of runnables
+*/
+enum RunnablePriority {RP_NONE = -1, NORMAL_PRIORITY, HIGH_PRIORITY};
+
 /**
 * Supported transmission formats
 */
-enum TxFormat {TX_NONE = -1, STD_RTP, ULTRAGRID, MPEGTS};
+enum TxFormat {TX_NONE = -1, STD_RTP, ULTRAGRID, MPEGTS, SIMULCAST};
+
+/**
+* Picture processing backends of the composition filters (VideoMixer and VideoSplitter)
+*/
+enum ComposeBackend {CB_NONE = -1, CPU_COMPOSE, OPENCL_COMPOSE};
+
+/**
+* Frames dropped by a full coded video queue, see AVFramedQueue::forceGetRear
+*/
+enum DropPolicy {DP_NONE = -1, DROP_NEWEST, DROP_NON_REFERENCE, DROP_GOP, DROP_TO_KEYFRAME};
 
 #endif
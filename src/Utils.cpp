@@ -22,36 +22,23 @@
  */
 
 #include "Utils.hh"
+#include "AsyncLog.hh"
 
 #include <iostream>
 #include <algorithm>
-#include <log4cplus/logger.h>
-#include <log4cplus/loggingmacros.h>
-#include <log4cplus/consoleappender.h>
-#include <log4cplus/configurator.h>
 #include <sys/time.h>
 #include <random>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
-using namespace log4cplus;
-using namespace log4cplus::helpers;
-
-static bool logConfigured = false;
+#define SYSFS_NODE_PATH "/sys/devices/system/node/node"
 
 namespace utils
 {
-    void configureLog(){
-        SharedObjectPtr<Appender> append_1(new ConsoleAppender());
-        append_1->setName(LOG4CPLUS_TEXT("First"));
-        log4cplus::tstring pattern = LOG4CPLUS_TEXT("%-5p - %m %n");
-        append_1->setLayout(std::auto_ptr<Layout>(new PatternLayout(pattern)));
-        Logger::getRoot().addAppender(append_1);
-
-        logConfigured = true;
-        Logger logger = Logger::getInstance(LOG4CPLUS_TEXT("main"));
-        logger.setLogLevel(INFO_LOG_LEVEL);
-    }
-
     SampleFmt getSampleFormatFromString(std::string stringSampleFmt)
     {
         SampleFmt sampleFormat;
@@ -74,20 +61,48 @@ namespace utils
 
         return sampleFormat;
     }
+
+    ChannelLayout getChannelLayoutFromString(std::string stringLayout)
+    {
+        ChannelLayout layout;
+
+        if (stringLayout.compare("mono") == 0) {
+            layout = MONO;
+        } else if (stringLayout.compare("stereo") == 0) {
+            layout = STEREO;
+        } else if (stringLayout.compare("quad") == 0) {
+            layout = QUAD;
+        } else if (stringLayout.compare("5.1") == 0) {
+            layout = SURROUND_5_1;
+        } else if (stringLayout.compare("7.1") == 0) {
+            layout = SURROUND_7_1;
+        } else {
+            layout = CL_NONE;
+        }
+
+        return layout;
+    }
     
     PixType getPixTypeFromString(std::string pixel)
     {
         PixType pixType;
-        if (pixel.compare("YUYV") == 0) {
+        //NOTE: getPixTypeAsString names are accepted too, so states can be fed back
+        if (pixel.compare("YUYV") == 0 || pixel.compare("YUYV422") == 0) {
             pixType = YUYV422;
-        } else if (pixel.compare("YUV420") == 0) {
+        } else if (pixel.compare("YUV420") == 0 || pixel.compare("YUV420P") == 0) {
             pixType = YUV420P;
         } else if (pixel.compare("RGB24") == 0) {
             pixType = RGB24;
-        }  else if (pixel.compare("YUV422") == 0) {
+        }  else if (pixel.compare("YUV422") == 0 || pixel.compare("YUV422P") == 0) {
             pixType = YUV422P;
-        }  else if (pixel.compare("YUVJ") == 0) {
+        }  else if (pixel.compare("YUVJ") == 0 || pixel.compare("YUVJ420P") == 0) {
             pixType = YUVJ420P;
+        }  else if (pixel.compare("YUVJ422P") == 0) {
+            pixType = YUVJ422P;
+        }  else if (pixel.compare("NV12") == 0) {
+            pixType = NV12;
+        }  else if (pixel.compare("HW") == 0) {
+            pixType = HW_SURFACE;
         }  else {
             pixType = P_NONE;
         }
@@ -126,6 +141,10 @@ namespace utils
             codec = H265;
         } else if (stringCodec.compare("VP8") == 0) {
             codec = VP8;
+        } else if (stringCodec.compare("VP9") == 0) {
+            codec = VP9;
+        } else if (stringCodec.compare("AV1") == 0) {
+            codec = AV1;
         }  else if (stringCodec.compare("MJPEG") == 0) {
             codec = MJPEG;
         }  else if (stringCodec.compare("RAW") == 0) {
@@ -169,6 +188,10 @@ namespace utils
             codec = H265;
         } else if (stringCodec.compare("vp8") == 0) {
             codec = VP8;
+        } else if (stringCodec.compare("vp9") == 0) {
+            codec = VP9;
+        } else if (stringCodec.compare("av1") == 0) {
+            codec = AV1;
         }  else if (stringCodec.compare("mjpeg") == 0) {
             codec = MJPEG;
         }  else if (stringCodec.compare("rawvideo") == 0) {
@@ -219,6 +242,12 @@ namespace utils
             case VP8:
                 stringCodec = "VP8";
                 break;
+            case VP9:
+                stringCodec = "VP9";
+                break;
+            case AV1:
+                stringCodec = "AV1";
+                break;
             case MJPEG:
                 stringCodec = "MJPEG";
                 break;
@@ -308,6 +337,54 @@ namespace utils
             case V4L_CAPTURE:
                 stringType = "v4lcapture";
                 break;
+            case VIDEO_LADDER_RESAMPLER:
+                stringType = "videoLadderResampler";
+                break;
+            case VIDEO_LADDER_ENCODER:
+                stringType = "videoLadderEncoder";
+                break;
+            case VIDEO_HW_ENCODER:
+                stringType = "videoHwEncoder";
+                break;
+            case VIDEO_VPX_ENCODER:
+                stringType = "videoVpxEncoder";
+                break;
+            case AUDIO_MULTI_ENCODER:
+                stringType = "audioMultiEncoder";
+                break;
+            case SHARED_MEMORY_INGEST:
+                stringType = "sharedMemoryIngest";
+                break;
+            case RECORDER:
+                stringType = "recorder";
+                break;
+            case VIDEO_PREVIEWER:
+                stringType = "videoPreviewer";
+                break;
+            case FRAME_LINK_SENDER:
+                stringType = "frameLinkSender";
+                break;
+            case FRAME_LINK_RECEIVER:
+                stringType = "frameLinkReceiver";
+                break;
+            case VIDEO_SWITCHER:
+                stringType = "videoSwitcher";
+                break;
+            case VIDEO_AV1_ENCODER:
+                stringType = "videoAv1Encoder";
+                break;
+            case TIME_SHIFT:
+                stringType = "timeShift";
+                break;
+            case LOUDNESS_NORMALIZER:
+                stringType = "loudnessNormalizer";
+                break;
+            case DEINTERLACER:
+                stringType = "deinterlacer";
+                break;
+            case SIGNAL_MONITOR:
+                stringType = "signalMonitor";
+                break;
             default:
                 stringType = "";
                 break;
@@ -328,10 +405,22 @@ namespace utils
            fType = VIDEO_MIXER;
         }  else if (stringFilterType.compare("videoResampler") == 0) {
            fType = VIDEO_RESAMPLER;
+        }  else if (stringFilterType.compare("videoLadderResampler") == 0) {
+           fType = VIDEO_LADDER_RESAMPLER;
+        }  else if (stringFilterType.compare("videoLadderEncoder") == 0) {
+           fType = VIDEO_LADDER_ENCODER;
+        }  else if (stringFilterType.compare("videoHwEncoder") == 0) {
+           fType = VIDEO_HW_ENCODER;
+        }  else if (stringFilterType.compare("videoVpxEncoder") == 0) {
+           fType = VIDEO_VPX_ENCODER;
+        }  else if (stringFilterType.compare("videoAv1Encoder") == 0) {
+           fType = VIDEO_AV1_ENCODER;
         }  else if (stringFilterType.compare("audioDecoder") == 0) {
            fType = AUDIO_DECODER;
         }  else if (stringFilterType.compare("audioEncoder") == 0) {
            fType = AUDIO_ENCODER;
+        }  else if (stringFilterType.compare("audioMultiEncoder") == 0) {
+           fType = AUDIO_MULTI_ENCODER;
         }  else if (stringFilterType.compare("audioMixer") == 0) {
            fType = AUDIO_MIXER;
         }  else if (stringFilterType.compare("receiver") == 0) {
@@ -340,8 +429,28 @@ namespace utils
            fType = TRANSMITTER;
         }  else if (stringFilterType.compare("sharedMemory") == 0) {
            fType = SHARED_MEMORY;
+        }  else if (stringFilterType.compare("sharedMemoryIngest") == 0) {
+           fType = SHARED_MEMORY_INGEST;
         }  else if (stringFilterType.compare("dasher") == 0) {
            fType = DASHER;
+        }  else if (stringFilterType.compare("recorder") == 0) {
+           fType = RECORDER;
+        }  else if (stringFilterType.compare("videoPreviewer") == 0) {
+           fType = VIDEO_PREVIEWER;
+        }  else if (stringFilterType.compare("frameLinkSender") == 0) {
+           fType = FRAME_LINK_SENDER;
+        }  else if (stringFilterType.compare("frameLinkReceiver") == 0) {
+           fType = FRAME_LINK_RECEIVER;
+        }  else if (stringFilterType.compare("videoSwitcher") == 0) {
+           fType = VIDEO_SWITCHER;
+        }  else if (stringFilterType.compare("timeShift") == 0) {
+           fType = TIME_SHIFT;
+        }  else if (stringFilterType.compare("loudnessNormalizer") == 0) {
+           fType = LOUDNESS_NORMALIZER;
+        }  else if (stringFilterType.compare("deinterlacer") == 0) {
+           fType = DEINTERLACER;
+        }  else if (stringFilterType.compare("signalMonitor") == 0) {
+           fType = SIGNAL_MONITOR;
         }  else if (stringFilterType.compare("demuxer") == 0) {
            fType = DEMUXER;
         }  else if (stringFilterType.compare("videoSplitter") == 0) {
@@ -388,6 +497,40 @@ namespace utils
         return stringRole;
     }
 
+    RunnablePriority getPriorityFromString(std::string stringPriority)
+    {
+        RunnablePriority priority;
+
+        if (stringPriority.compare("normal") == 0) {
+           priority = NORMAL_PRIORITY;
+        } else if (stringPriority.compare("high") == 0) {
+           priority = HIGH_PRIORITY;
+        }  else {
+           priority = RP_NONE;
+        }
+
+        return priority;
+    }
+
+    std::string getPriorityAsString(RunnablePriority priority)
+    {
+        std::string stringPriority;
+
+        switch(priority) {
+            case NORMAL_PRIORITY:
+                stringPriority = "normal";
+                break;
+            case HIGH_PRIORITY:
+                stringPriority = "high";
+                break;
+            default:
+                stringPriority = "";
+                break;
+        }
+
+        return stringPriority;
+    }
+
     std::string getSampleFormatAsString(SampleFmt sFormat)
     {
         std::string stringFormat;
@@ -419,6 +562,34 @@ namespace utils
         return stringFormat;
     }
 
+    std::string getChannelLayoutAsString(ChannelLayout layout)
+    {
+        std::string stringLayout;
+
+        switch(layout) {
+            case MONO:
+                stringLayout = "mono";
+                break;
+            case STEREO:
+                stringLayout = "stereo";
+                break;
+            case QUAD:
+                stringLayout = "quad";
+                break;
+            case SURROUND_5_1:
+                stringLayout = "5.1";
+                break;
+            case SURROUND_7_1:
+                stringLayout = "7.1";
+                break;
+            default:
+                stringLayout = "";
+                break;
+        }
+
+        return stringLayout;
+    }
+
     std::string getPixTypeAsString(PixType type)
     {
         std::string stringPixType;
@@ -445,6 +616,15 @@ namespace utils
             case YUVJ420P:
                 stringPixType = "YUVJ420P";
                 break;
+            case YUVJ422P:
+                stringPixType = "YUVJ422P";
+                break;
+            case NV12:
+                stringPixType = "NV12";
+                break;
+            case HW_SURFACE:
+                stringPixType = "HW_SURFACE";
+                break;
             default:
                 stringPixType = "Unknown";
                 break;
@@ -478,6 +658,156 @@ namespace utils
         return bytesPerSample;
     }
 
+    ChannelLayout getDefaultChannelLayout(unsigned channels)
+    {
+        ChannelLayout layout;
+
+        switch(channels) {
+            case 1:
+                layout = MONO;
+                break;
+            case 2:
+                layout = STEREO;
+                break;
+            case 4:
+                layout = QUAD;
+                break;
+            case 6:
+                layout = SURROUND_5_1;
+                break;
+            case 8:
+                layout = SURROUND_7_1;
+                break;
+            default:
+                layout = CL_NONE;
+                break;
+        }
+
+        return layout;
+    }
+
+    unsigned getChannelsFromLayout(ChannelLayout layout)
+    {
+        unsigned channels;
+
+        switch(layout) {
+            case MONO:
+                channels = 1;
+                break;
+            case STEREO:
+                channels = 2;
+                break;
+            case QUAD:
+                channels = 4;
+                break;
+            case SURROUND_5_1:
+                channels = 6;
+                break;
+            case SURROUND_7_1:
+                channels = 8;
+                break;
+            default:
+                channels = 0;
+                break;
+        }
+
+        return channels;
+    }
+
+    std::vector<unsigned> getNumaNodeCpus(int node)
+    {
+        std::vector<unsigned> cpus;
+        std::string range;
+        unsigned first, last;
+        char dash;
+
+        std::ifstream cpulist(SYSFS_NODE_PATH + std::to_string(node) + "/cpulist");
+
+        if (!cpulist.is_open()) {
+            //NOTE: without NUMA information every cpu is considered to be in node 0
+            if (node == 0) {
+                for (long i = 0; i < sysconf(_SC_NPROCESSORS_ONLN); i++) {
+                    cpus.push_back(i);
+                }
+            }
+            return cpus;
+        }
+
+        while (std::getline(cpulist, range, ',')) {
+            std::istringstream ss(range);
+            if (!(ss >> first)) {
+                continue;
+            }
+            last = first;
+            if (ss >> dash >> last && dash != '-') {
+                last = first;
+            }
+            for (unsigned i = first; i <= last; i++) {
+                cpus.push_back(i);
+            }
+        }
+
+        return cpus;
+    }
+
+    int getNumaNodeOfCpu(unsigned cpu)
+    {
+        std::vector<unsigned> cpus;
+
+        for (int node = 0; !(cpus = getNumaNodeCpus(node)).empty(); node++) {
+            if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+                return node;
+            }
+        }
+
+        return -1;
+    }
+
+    static bool setPThreadAffinity(pthread_t thread, std::vector<unsigned> cpus)
+    {
+        cpu_set_t cpuset;
+
+        if (cpus.empty()) {
+            return false;
+        }
+
+        CPU_ZERO(&cpuset);
+        for (auto cpu : cpus) {
+            CPU_SET(cpu, &cpuset);
+        }
+
+        return pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset) == 0;
+    }
+
+    bool setCurrentThreadAffinity(std::vector<unsigned> cpus)
+    {
+        return setPThreadAffinity(pthread_self(), cpus);
+    }
+
+    bool setThreadAffinity(std::thread &thread, std::vector<unsigned> cpus)
+    {
+        return setPThreadAffinity(thread.native_handle(), cpus);
+    }
+
+    std::vector<unsigned> getCurrentThreadAffinity()
+    {
+        std::vector<unsigned> cpus;
+        cpu_set_t cpuset;
+
+        CPU_ZERO(&cpuset);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0) {
+            return cpus;
+        }
+
+        for (unsigned i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &cpuset)) {
+                cpus.push_back(i);
+            }
+        }
+
+        return cpus;
+    }
+
 
     TxFormat getTxFormatFromString(std::string stringTxFormat)
     {
@@ -489,6 +819,8 @@ namespace utils
            format = ULTRAGRID;
         }  else if (stringTxFormat.compare("mpegts") == 0) {
            format = MPEGTS;
+        }  else if (stringTxFormat.compare("simulcast") == 0) {
+           format = SIMULCAST;
         }  else {
            format = TX_NONE;
         }
@@ -510,6 +842,9 @@ namespace utils
             case MPEGTS:
                 stringFormat = "mpegts";
                 break;
+            case SIMULCAST:
+                stringFormat = "simulcast";
+                break;
             default:
                 stringFormat = "";
                 break;
@@ -518,6 +853,84 @@ namespace utils
         return stringFormat;
     }
 
+    ComposeBackend getComposeBackendFromString(std::string stringBackend)
+    {
+        ComposeBackend backend;
+
+        if (stringBackend.compare("cpu") == 0) {
+           backend = CPU_COMPOSE;
+        } else if (stringBackend.compare("opencl") == 0) {
+           backend = OPENCL_COMPOSE;
+        }  else {
+           backend = CB_NONE;
+        }
+
+        return backend;
+    }
+
+    std::string getComposeBackendAsString(ComposeBackend backend)
+    {
+        std::string stringBackend;
+
+        switch(backend) {
+            case CPU_COMPOSE:
+                stringBackend = "cpu";
+                break;
+            case OPENCL_COMPOSE:
+                stringBackend = "opencl";
+                break;
+            default:
+                stringBackend = "";
+                break;
+        }
+
+        return stringBackend;
+    }
+
+    DropPolicy getDropPolicyFromString(std::string stringPolicy)
+    {
+        DropPolicy policy;
+
+        if (stringPolicy.compare("newest") == 0) {
+           policy = DROP_NEWEST;
+        } else if (stringPolicy.compare("nonReference") == 0) {
+           policy = DROP_NON_REFERENCE;
+        } else if (stringPolicy.compare("gop") == 0) {
+           policy = DROP_GOP;
+        } else if (stringPolicy.compare("toKeyframe") == 0) {
+           policy = DROP_TO_KEYFRAME;
+        }  else {
+           policy = DP_NONE;
+        }
+
+        return policy;
+    }
+
+    std::string getDropPolicyAsString(DropPolicy policy)
+    {
+        std::string stringPolicy;
+
+        switch(policy) {
+            case DROP_NEWEST:
+                stringPolicy = "newest";
+                break;
+            case DROP_NON_REFERENCE:
+                stringPolicy = "nonReference";
+                break;
+            case DROP_GOP:
+                stringPolicy = "gop";
+                break;
+            case DROP_TO_KEYFRAME:
+                stringPolicy = "toKeyframe";
+                break;
+            default:
+                stringPolicy = "";
+                break;
+        }
+
+        return stringPolicy;
+    }
+
     char randAlphaNum()
     {
         static const char alphanum[] =
@@ -538,8 +951,10 @@ namespace utils
     std::string getStreamInfoAsString(const StreamInfo *si)
     {
         std::string desc = getStreamTypeAsString(si->type);
-        if (si->extradata_size) {
-            desc += " (" + std::to_string(si->extradata_size) + " bytes of extradata)";
+        std::shared_ptr<const ExtraData> extradata = si->getExtraData();
+
+        if (extradata && !extradata->empty()) {
+            desc += " (" + std::to_string(extradata->size()) + " bytes of extradata)";
         }
 
         switch (si->type) {
@@ -547,6 +962,7 @@ namespace utils
                 desc += " codec:" + getAudioCodecAsString(si->audio.codec);
                 desc += " sampleRate:" + std::to_string(si->audio.sampleRate);
                 desc += " channels:" + std::to_string(si->audio.channels);
+                desc += " channelLayout:" + getChannelLayoutAsString(si->audio.channelLayout);
                 desc += " sampleFormat:" + getSampleFormatAsString(si->audio.sampleFormat);
                 break;
             case VIDEO:
@@ -591,82 +1007,38 @@ namespace utils
 
     void setLogLevel(DefinedLogLevel level)
     {
-        if (!logConfigured){
-            configureLog();
-        }
-
-        Logger logger = Logger::getInstance(LOG4CPLUS_TEXT("main"));
-
-        switch(level) {
-            case ERROR:
-                logger.setLogLevel(ERROR_LOG_LEVEL);
-                break;
-            case WARNING:
-                logger.setLogLevel(WARN_LOG_LEVEL);
-                break;
-            case DEBUG:
-                logger.setLogLevel(DEBUG_LOG_LEVEL);
-                break;
-            case INFO:
-                logger.setLogLevel(INFO_LOG_LEVEL);
-                break;
-        }
+        AsyncLog::getInstance()->setLevel(level);
     }
 
-    void warningMsg(std::string msg)
+    static void logMsg(DefinedLogLevel level, const std::string &msg)
     {
-        if (!logConfigured){
-            configureLog();
-        }
+        AsyncLog *log = AsyncLog::getInstance();
 
-        if (msg.empty()){
+        if (msg.empty() || !log->isEnabled(level)){
             return;
         }
 
-        Logger logger = Logger::getInstance(LOG4CPLUS_TEXT("main"));
-        LOG4CPLUS_WARN(logger, "\e[2;91m" + msg + "\e[0m");
+        log->write(level, msg);
     }
 
-    void debugMsg(std::string msg)
+    void warningMsg(const std::string &msg)
     {
-        if (!logConfigured){
-            configureLog();
-        }
-
-        if (msg.empty()){
-            return;
-        }
-
-        Logger logger = Logger::getInstance(LOG4CPLUS_TEXT("main"));
-        LOG4CPLUS_DEBUG(logger, "\e[2;37m" + msg + "\e[0m");
+        logMsg(WARNING, msg);
     }
 
-    void errorMsg(std::string msg)
+    void debugMsg(const std::string &msg)
     {
-        if (!logConfigured){
-            configureLog();
-        }
-
-        if (msg.empty()){
-            return;
-        }
-
-        Logger logger = Logger::getInstance(LOG4CPLUS_TEXT("main"));
-        LOG4CPLUS_ERROR(logger,  "\e[1;31m" + msg + "\e[0m");
+        logMsg(DEBUG, msg);
     }
 
-    void infoMsg(std::string msg)
+    void errorMsg(const std::string &msg)
     {
-        if (!logConfigured){
-            configureLog();
-        }
-
-        if (msg.empty()){
-            return;
-        }
+        logMsg(ERROR, msg);
+    }
 
-        Logger logger = Logger::getInstance(LOG4CPLUS_TEXT("main"));
-        LOG4CPLUS_INFO(logger, "\e[1;33m" + msg + "\e[0m");
+    void infoMsg(const std::string &msg)
+    {
+        logMsg(INFO, msg);
     }
 
     void printMood(bool mood){
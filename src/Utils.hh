@@ -26,6 +26,8 @@
 #include "Types.hh"
 #include "StreamInfo.hh"
 #include <string>
+#include <vector>
+#include <thread>
 
 #define ID_LENGTH 4
 #define BYTE_TO_BIT 8
@@ -35,6 +37,7 @@ enum DefinedLogLevel {ERROR, WARNING, DEBUG, INFO};
 namespace utils
 {
     SampleFmt getSampleFormatFromString(std::string stringSampleFmt);
+    ChannelLayout getChannelLayoutFromString(std::string stringLayout);
     PixType getPixTypeFromString(std::string pixel);
     ACodecType getAudioCodecFromString(std::string stringCodec);
     VCodecType getVideoCodecFromString(std::string stringCodec);
@@ -44,24 +47,45 @@ namespace utils
     TxFormat getTxFormatFromString(std::string stringTxFormat);
     FilterRole getRoleTypeFromString(std::string stringRoleType);
     std::string getRoleAsString(FilterRole role);
+    RunnablePriority getPriorityFromString(std::string stringPriority);
+    std::string getPriorityAsString(RunnablePriority priority);
     std::string getSampleFormatAsString(SampleFmt sFormat);
+    std::string getChannelLayoutAsString(ChannelLayout layout);
     std::string getPixTypeAsString(PixType type);
     std::string getStreamTypeAsString(StreamType type);
     std::string getAudioCodecAsString(ACodecType codec);
     std::string getVideoCodecAsString(VCodecType codec);
     std::string getFilterTypeAsString(FilterType type);
     std::string getTxFormatAsString(TxFormat format);
+    ComposeBackend getComposeBackendFromString(std::string stringBackend);
+    std::string getComposeBackendAsString(ComposeBackend backend);
+    DropPolicy getDropPolicyFromString(std::string stringPolicy);
+    std::string getDropPolicyAsString(DropPolicy policy);
     std::string randomIdGenerator(unsigned int length);
     std::string getStreamInfoAsString(const StreamInfo *si);
     int getPayloadFromCodec(std::string codec);
     int getBytesPerSampleFromFormat(SampleFmt fmt);
+    ChannelLayout getDefaultChannelLayout(unsigned channels);
+    unsigned getChannelsFromLayout(ChannelLayout layout);
+    std::vector<unsigned> getNumaNodeCpus(int node);
+    int getNumaNodeOfCpu(unsigned cpu);
+    bool setCurrentThreadAffinity(std::vector<unsigned> cpus);
+    bool setThreadAffinity(std::thread &thread, std::vector<unsigned> cpus);
+    std::vector<unsigned> getCurrentThreadAffinity();
 
 
-    void errorMsg(std::string msg);
-    void warningMsg(std::string msg);
-    void infoMsg(std::string msg);
-    void debugMsg(std::string msg);
+    /**
+    * Queue a message to the process AsyncLog, it is written by its drain thread. Messages built
+    * per frame should use the ERROR_MSG family of macros instead, see AsyncLog.hh
+    */
+    void errorMsg(const std::string &msg);
+    void warningMsg(const std::string &msg);
+    void infoMsg(const std::string &msg);
+    void debugMsg(const std::string &msg);
 
+    /**
+    * Set the most verbose level written, the default is INFO
+    */
     void setLogLevel(DefinedLogLevel level);
     void printMood(bool mood);
 }
@@ -23,15 +23,18 @@
 
  #include "VideoFrame.hh"
  #include <string.h>
+ #include <algorithm>
 
 VideoFrame::VideoFrame(VCodecType codec_) : 
-Frame(), codec(codec_), width(0), height(0), pixelFormat(P_NONE)
+Frame(), codec(codec_), width(0), height(0), pixelFormat(P_NONE), keyFrame(false), referenceFrame(true),
+formatVersion(0), fieldOrder(FO_PROGRESSIVE)
 {
 
 }
 
 VideoFrame::VideoFrame(VCodecType codec_, int width_, int height_, PixType pixFormat)
-: Frame(), codec(codec_), width(width_), height(height_), pixelFormat(pixFormat)
+: Frame(), codec(codec_), width(width_), height(height_), pixelFormat(pixFormat), 
+  keyFrame(false), referenceFrame(true), formatVersion(0), fieldOrder(FO_PROGRESSIVE)
 {
 
 }
@@ -52,6 +55,94 @@ void VideoFrame::setPixelFormat(PixType pixelFormat)
     this->pixelFormat = pixelFormat;
 }
 
+void VideoFrame::fitBuffer(int width, int height, PixType pixelFormat)
+{
+    setSize(width, height);
+    setPixelFormat(pixelFormat);
+}
+
+bool VideoFrame::planeSize(PixType pixelFormat, int width, int height, unsigned plane, int &lineBytes, int &rows)
+{
+    int chromaWidth = (width + 1)/2;
+    int chromaHeight = (height + 1)/2;
+    
+    switch (pixelFormat) {
+        case RGB24:
+        case RGB32:
+        case YUYV422:
+            if (plane > 0) {
+                return false;
+            }
+            lineBytes = width * (pixelFormat == RGB24 ? 3 : pixelFormat == RGB32 ? 4 : 2);
+            rows = height;
+            return true;
+        case YUV420P:
+        case YUVJ420P:
+        case YUV422P:
+        case YUVJ422P:
+        case YUV444P:
+            if (plane > 2) {
+                return false;
+            }
+            if (plane == 0 || pixelFormat == YUV444P) {
+                lineBytes = width;
+                rows = height;
+            } else {
+                lineBytes = chromaWidth;
+                rows = pixelFormat == YUV422P || pixelFormat == YUVJ422P ? height : chromaHeight;
+            }
+            return true;
+        case NV12:
+            if (plane > 1) {
+                return false;
+            }
+            lineBytes = plane == 0 ? width : chromaWidth*2;
+            rows = plane == 0 ? height : chromaHeight;
+            return true;
+        case HW_SURFACE:
+            //NOTE: hardware surfaces have no host planes
+            return false;
+        default:
+            if (plane > 0) {
+                return false;
+            }
+            lineBytes = width * DEFAULT_BYTES_PER_PIXEL;
+            rows = height;
+            return true;
+    }
+}
+
+bool VideoFrame::isPlanarFormat(PixType pixelFormat)
+{
+    int lineBytes, rows;
+    
+    return planeSize(pixelFormat, 1, 1, 1, lineBytes, rows);
+}
+
+std::atomic<float> VideoFrame::shrinkRatio(DEFAULT_SHRINK_RATIO);
+
+void VideoFrame::setShrinkRatio(float ratio)
+{
+    if (ratio < 0 || ratio > 1) {
+        utils::warningMsg("Invalid shrink ratio, it must be between 0 and 1");
+        return;
+    }
+    
+    shrinkRatio = ratio;
+}
+
+static unsigned int rawLength(int width, int height, PixType pixelFormat)
+{
+    int lineBytes, rows;
+    unsigned int length = 0;
+    
+    for (unsigned i = 0; VideoFrame::planeSize(pixelFormat, width, height, i, lineBytes, rows); i++) {
+        length += lineBytes * rows;
+    }
+
+    return length;
+}
+
 //////////////////////////////////////////////////
 //INTERLEAVED VIDEO FRAME METHODS IMPLEMENTATION//
 //////////////////////////////////////////////////
@@ -67,39 +158,350 @@ InterleavedVideoFrame* InterleavedVideoFrame::createNew(VCodecType codec, int wi
 }
 
 InterleavedVideoFrame::InterleavedVideoFrame(VCodecType codec, unsigned int maxLength)
-: VideoFrame(codec), bufferLen(0)
+: VideoFrame(codec), externalBuff(NULL), externalStride(0), bufferLen(0)
 {
     bufferMaxLen = maxLength;
-    frameBuff = new unsigned char [bufferMaxLen]();
+    frameBuff = allocBuffer(bufferMaxLen);
 }
 
+//NOTE: raw frames buffer is allocated when it is first used, see fitBuffer
 InterleavedVideoFrame::InterleavedVideoFrame(VCodecType codec, int width, int height, PixType pixelFormat)
-: VideoFrame(codec, width, height, pixelFormat), bufferLen(0)
+: VideoFrame(codec, width, height, pixelFormat), frameBuff(NULL), externalBuff(NULL), externalStride(0), bufferLen(0), bufferMaxLen(0)
 {
-    int bytesPerPixel;
+}
 
-    switch (pixelFormat) {
-        case RGB24:
-            bytesPerPixel = 3;
-            break;
-        case RGB32:
-            bytesPerPixel = 4;
-            break;
-        case YUYV422:
-            bytesPerPixel = 2;
-            break;
-        default:
-            bytesPerPixel = DEFAULT_BYTES_PER_PIXEL;
-            break;
+InterleavedVideoFrame::~InterleavedVideoFrame()
+{
+    freeBuffer(frameBuff);
+}
+
+void InterleavedVideoFrame::resizeBuffer(unsigned int length)
+{
+    freeBuffer(frameBuff);
+    bufferMaxLen = length;
+    bufferLen = 0;
+    frameBuff = allocBuffer(bufferMaxLen, codec == RAW);
+}
+
+unsigned char* InterleavedVideoFrame::getDataBuf()
+{
+    if (owner) {
+        return externalBuff;
+    }
+    
+    if (!frameBuff) {
+        resizeBuffer(rawLength(width, height, pixelFormat));
     }
+    
+    return frameBuff;
+}
 
-    bufferMaxLen = width * height * bytesPerPixel;
-    frameBuff = new unsigned char [bufferMaxLen]();
+void InterleavedVideoFrame::fitBuffer(int width, int height, PixType pixelFormat)
+{
+    unsigned int needed;
+    
+    VideoFrame::fitBuffer(width, height, pixelFormat);
+    
+    if (codec != RAW) {
+        return;
+    }
+    
+    releaseBuffer();
+    needed = rawLength(width, height, pixelFormat);
+    
+    if (!frameBuff || needed > bufferMaxLen || needed < bufferMaxLen*shrinkRatio) {
+        resizeBuffer(needed);
+    }
+    
+    bufferLen = needed;
 }
 
-InterleavedVideoFrame::~InterleavedVideoFrame()
+unsigned InterleavedVideoFrame::getPlanes(unsigned char* data[], int linesize[])
+{
+    int lineBytes, rows;
+    unsigned char* buffer;
+    unsigned length = 0;
+    
+    for (unsigned i = 0; i < MAX_PLANES; i++) {
+        data[i] = NULL;
+        linesize[i] = 0;
+    }
+    
+    if (codec != RAW || !(buffer = getDataBuf())) {
+        return 0;
+    }
+    
+    if (owner && externalStride > 0 && planeSize(pixelFormat, width, height, 0, lineBytes, rows)) {
+        data[0] = buffer;
+        linesize[0] = externalStride;
+        return bufferLen;
+    }
+    
+    for (unsigned i = 0; planeSize(pixelFormat, width, height, i, lineBytes, rows); i++) {
+        data[i] = buffer + length;
+        linesize[i] = lineBytes;
+        length += lineBytes * rows;
+    }
+    
+    if (length > (owner ? bufferLen : bufferMaxLen)) {
+        utils::errorMsg("[InterleavedVideoFrame] Buffer too small for the picture, fitBuffer must be called first");
+        return 0;
+    }
+    
+    return length;
+}
+
+bool InterleavedVideoFrame::swapBuffer(VideoFrame* other)
+{
+    InterleavedVideoFrame* frame = dynamic_cast<InterleavedVideoFrame*>(other);
+    
+    if (!frame || frame == this || codec != RAW || frame->codec != RAW) {
+        return false;
+    }
+    
+    std::swap(frameBuff, frame->frameBuff);
+    std::swap(externalBuff, frame->externalBuff);
+    std::swap(externalStride, frame->externalStride);
+    std::swap(bufferLen, frame->bufferLen);
+    std::swap(bufferMaxLen, frame->bufferMaxLen);
+    std::swap(owner, frame->owner);
+    std::swap(width, frame->width);
+    std::swap(height, frame->height);
+    std::swap(pixelFormat, frame->pixelFormat);
+    std::swap(fieldOrder, frame->fieldOrder);
+    
+    return true;
+}
+
+bool InterleavedVideoFrame::setExternalBuffer(int width, int height, PixType pixelFormat, unsigned char* data, 
+                                              std::shared_ptr<void> owner, int stride)
+{
+    int lineBytes, rows, chromaBytes, chromaRows;
+    
+    if (!owner || !data || codec != RAW || isPlanarFormat(pixelFormat)) {
+        return false;
+    }
+    
+    if (stride > 0 && (!planeSize(pixelFormat, width, height, 0, lineBytes, rows) || stride < lineBytes || 
+            planeSize(pixelFormat, width, height, 1, chromaBytes, chromaRows))) {
+        return false;
+    }
+    
+    VideoFrame::fitBuffer(width, height, pixelFormat);
+    
+    externalBuff = data;
+    externalStride = stride;
+    //NOTE: a strided picture spans up to the end of its last line
+    bufferLen = stride > 0 ? (rows - 1)*stride + lineBytes : rawLength(width, height, pixelFormat);
+    this->owner = owner;
+    
+    return true;
+}
+
+void InterleavedVideoFrame::releaseBuffer()
 {
-    delete[] frameBuff;
+    if (!owner) {
+        return;
+    }
+    
+    owner.reset();
+    externalBuff = NULL;
+    externalStride = 0;
+    bufferLen = 0;
+}
+
+//////////////////////////////////////////////
+//PLANAR VIDEO FRAME METHODS IMPLEMENTATION//
+//////////////////////////////////////////////
+
+PlanarVideoFrame* PlanarVideoFrame::createNew(VCodecType codec, int width, int height, PixType pixelFormat)
+{
+    if (codec != RAW) {
+        utils::errorMsg("[PlanarVideoFrame] Only raw frames can be planar");
+        return NULL;
+    }
+    
+    return new PlanarVideoFrame(codec, width, height, pixelFormat);
+}
+
+//NOTE: as raw interleaved frames, the buffer is allocated when it is first used
+PlanarVideoFrame::PlanarVideoFrame(VCodecType codec, int width, int height, PixType pixelFormat)
+: VideoFrame(codec, width, height, pixelFormat), frameBuff(NULL), planesWidth(0), planesHeight(0), 
+    planesFormat(P_NONE), bufferLen(0), bufferMaxLen(0)
+{
+    for (unsigned i = 0; i < MAX_PLANES; i++) {
+        planes[i] = NULL;
+        linesize[i] = 0;
+    }
+}
+
+PlanarVideoFrame::~PlanarVideoFrame()
+{
+    freeBuffer(frameBuff);
+}
+
+unsigned PlanarVideoFrame::layoutPlanes(bool assign)
+{
+    int lineBytes, rows;
+    unsigned length = 0;
+    
+    for (unsigned i = 0; i < MAX_PLANES; i++) {
+        if (!planeSize(pixelFormat, width, height, i, lineBytes, rows)) {
+            if (assign) {
+                planes[i] = NULL;
+                linesize[i] = 0;
+            }
+            continue;
+        }
+        
+        lineBytes = ((lineBytes + FRAME_ALIGNMENT - 1)/FRAME_ALIGNMENT)*FRAME_ALIGNMENT;
+        
+        if (assign) {
+            planes[i] = frameBuff + length;
+            linesize[i] = lineBytes;
+        }
+        
+        length += lineBytes * rows;
+    }
+    
+    return length;
+}
+
+void PlanarVideoFrame::fitBuffer(int width, int height, PixType pixelFormat)
+{
+    unsigned needed;
+    
+    //NOTE: planes are laid out in the own buffer again
+    owner.reset();
+    
+    VideoFrame::fitBuffer(width, height, pixelFormat);
+    needed = layoutPlanes(false);
+    
+    if (!frameBuff || needed > bufferMaxLen || needed < bufferMaxLen*shrinkRatio) {
+        freeBuffer(frameBuff);
+        bufferMaxLen = needed;
+        frameBuff = allocBuffer(bufferMaxLen, true);
+    }
+    
+    bufferLen = layoutPlanes(true);
+    planesWidth = width;
+    planesHeight = height;
+    planesFormat = pixelFormat;
+}
+
+void PlanarVideoFrame::setupPlanes()
+{
+    if (owner && planesWidth == width && planesHeight == height && planesFormat == pixelFormat) {
+        return;
+    }
+    
+    //NOTE: size or pixel format may have been set without fitBuffer, i.e. by the FramePool
+    if (!frameBuff || planesWidth != width || planesHeight != height || planesFormat != pixelFormat) {
+        fitBuffer(width, height, pixelFormat);
+    }
+}
+
+unsigned char** PlanarVideoFrame::getPlanarDataBuf()
+{
+    setupPlanes();
+    return planes;
+}
+
+int* PlanarVideoFrame::getLinesize()
+{
+    setupPlanes();
+    return linesize;
+}
+
+unsigned PlanarVideoFrame::getPlanes(unsigned char* data[], int linesize[])
+{
+    setupPlanes();
+    
+    for (unsigned i = 0; i < MAX_PLANES; i++) {
+        data[i] = planes[i];
+        linesize[i] = this->linesize[i];
+    }
+    
+    return owner ? bufferLen : layoutPlanes(false);
+}
+
+bool PlanarVideoFrame::swapBuffer(VideoFrame* other)
+{
+    PlanarVideoFrame* frame = dynamic_cast<PlanarVideoFrame*>(other);
+    
+    if (!frame || frame == this) {
+        return false;
+    }
+    
+    //NOTE: planes point into the buffer, so they move with it
+    std::swap(frameBuff, frame->frameBuff);
+    std::swap(planes, frame->planes);
+    std::swap(linesize, frame->linesize);
+    std::swap(planesWidth, frame->planesWidth);
+    std::swap(planesHeight, frame->planesHeight);
+    std::swap(planesFormat, frame->planesFormat);
+    std::swap(bufferLen, frame->bufferLen);
+    std::swap(bufferMaxLen, frame->bufferMaxLen);
+    std::swap(owner, frame->owner);
+    std::swap(width, frame->width);
+    std::swap(height, frame->height);
+    std::swap(pixelFormat, frame->pixelFormat);
+    std::swap(fieldOrder, frame->fieldOrder);
+    
+    return true;
+}
+
+bool PlanarVideoFrame::setExternalPlanes(int width, int height, PixType pixelFormat, unsigned char* data[], 
+                                         int linesize[], std::shared_ptr<void> owner)
+{
+    int lineBytes, rows;
+    unsigned length = 0;
+    
+    if (!owner || !isPlanarFormat(pixelFormat)) {
+        return false;
+    }
+    
+    for (unsigned i = 0; planeSize(pixelFormat, width, height, i, lineBytes, rows); i++) {
+        if (!data[i] || linesize[i] < lineBytes || linesize[i] % FRAME_ALIGNMENT != 0 || 
+            ((uintptr_t) data[i]) % FRAME_ALIGNMENT != 0) {
+            return false;
+        }
+        
+        length += linesize[i] * rows;
+    }
+    
+    VideoFrame::fitBuffer(width, height, pixelFormat);
+    
+    for (unsigned i = 0; i < MAX_PLANES; i++) {
+        if (planeSize(pixelFormat, width, height, i, lineBytes, rows)) {
+            planes[i] = data[i];
+            this->linesize[i] = linesize[i];
+        } else {
+            planes[i] = NULL;
+            this->linesize[i] = 0;
+        }
+    }
+    
+    planesWidth = width;
+    planesHeight = height;
+    planesFormat = pixelFormat;
+    bufferLen = length;
+    this->owner = owner;
+    
+    return true;
+}
+
+void PlanarVideoFrame::releasePlanes()
+{
+    if (!owner) {
+        return;
+    }
+    
+    owner.reset();
+    bufferLen = 0;
+    
+    //NOTE: the planes are laid out in the own buffer when they are used again, see setupPlanes
+    planesFormat = P_NONE;
 }
 
 /////////////////////////
@@ -127,6 +529,16 @@ void SlicedVideoFrame::clear()
     pointedSliceNum = 0; 
 }
 
+unsigned SlicedVideoFrame::getPlanes(unsigned char* data[], int linesize[])
+{
+    for (unsigned i = 0; i < MAX_PLANES; i++) {
+        data[i] = NULL;
+        linesize[i] = 0;
+    }
+    
+    return 0;
+}
+
 bool SlicedVideoFrame::setSlice(unsigned char *data, unsigned size)
 {
     if (pointedSliceNum >= MAX_SLICES) {
@@ -145,3 +557,118 @@ Slice::Slice() : data(NULL), dataSize(0)
 {
 
 }
+
+SliceStore::SliceStore() : buffer(NULL), length(0), maxLength(0)
+{
+
+}
+
+SliceStore::~SliceStore()
+{
+    Frame::freeBuffer(buffer);
+}
+
+bool SliceStore::fill(Slice* slices, int sliceNum)
+{
+    unsigned needed = 0;
+    unsigned char *run;
+    unsigned runLen;
+    
+    for (int i = 0; i < sliceNum; i++) {
+        needed += slices[i].getDataSize();
+    }
+    
+    if (needed > maxLength) {
+        unsigned char *newBuffer = Frame::allocBuffer(needed);
+        if (!newBuffer) {
+            return false;
+        }
+        Frame::freeBuffer(buffer);
+        buffer = newBuffer;
+        maxLength = needed;
+    }
+    
+    length = 0;
+    run = NULL;
+    runLen = 0;
+    
+    //NOTE: consecutive slices adjacent in memory are gathered into one copy
+    for (int i = 0; i < sliceNum; i++) {
+        if (run && run + runLen == slices[i].getData()) {
+            runLen += slices[i].getDataSize();
+            continue;
+        }
+        
+        if (runLen > 0) {
+            memcpy(buffer + length, run, runLen);
+            length += runLen;
+        }
+        
+        run = slices[i].getData();
+        runLen = slices[i].getDataSize();
+    }
+    
+    if (runLen > 0) {
+        memcpy(buffer + length, run, runLen);
+        length += runLen;
+    }
+    
+    return true;
+}
+
+SliceRefVideoFrame* SliceRefVideoFrame::createNew(VCodecType codec)
+{
+    return new SliceRefVideoFrame(codec);
+}
+
+SliceRefVideoFrame::SliceRefVideoFrame(VCodecType codec) :
+VideoFrame(codec), sliceOffset(0), sliceLen(0)
+{
+
+}
+
+SliceRefVideoFrame::~SliceRefVideoFrame()
+{
+
+}
+
+void SliceRefVideoFrame::setSlice(std::shared_ptr<SliceStore> store_, unsigned offset, unsigned size)
+{
+    store = store_;
+    sliceOffset = offset;
+    sliceLen = size;
+}
+
+void SliceRefVideoFrame::releaseSlice()
+{
+    store.reset();
+    sliceOffset = 0;
+    sliceLen = 0;
+}
+
+unsigned char* SliceRefVideoFrame::getDataBuf()
+{
+    if (!store) {
+        return NULL;
+    }
+    
+    return store->getData() + sliceOffset;
+}
+
+void SliceRefVideoFrame::setLength(unsigned int length)
+{
+    //NOTE: the data belongs to the store, the frame can only be trimmed
+    if (length < sliceLen) {
+        sliceLen = length;
+    }
+}
+
+unsigned SliceRefVideoFrame::getPlanes(unsigned char* data[], int linesize[])
+{
+    for (unsigned i = 0; i < MAX_PLANES; i++) {
+        data[i] = NULL;
+        linesize[i] = 0;
+    }
+    
+    return 0;
+}
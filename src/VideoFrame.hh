@@ -24,12 +24,16 @@
 #ifndef _VIDEO_FRAME_HH
 #define _VIDEO_FRAME_HH
 
+#include <memory>
+
 #include "Frame.hh"
 #include "Types.hh"
 #include "Utils.hh"
 
 #define MAX_COPIED_SLICES 8
-#define MAX_SLICES 16
+#define MAX_SLICES 128              /*!< Maximum NAL units of a coded picture, sliced threads 4K encoding can produce many of them */
+#define DEFAULT_SHRINK_RATIO 0.5    /*!< Raw frame buffers are reallocated when the needed size is below this ratio of their capacity */
+#define MAX_PLANES 4                /*!< Maximum number of picture planes of a raw pixel format */
 
 class VideoFrame : public Frame {
 
@@ -51,6 +55,90 @@ public:
     */
     void setPixelFormat(PixType pixelFormat);
     
+    /**
+    * Sets the frame size and pixel format, making room in the frame buffer if needed. It must be
+    * called before writing the frame data, which is not kept if the buffer is reallocated.
+    * @param width horizontal number of pixels
+    * @param height vertial number of pixels
+    * @param pixelFormat PixType of the frame
+    */
+    virtual void fitBuffer(int width, int height, PixType pixelFormat);
+    
+    /**
+    * Gets the picture planes of a raw frame, whatever its layout is. Planes beyond the pixel format
+    * ones are set to NULL.
+    * @param data array of MAX_PLANES pointers filled with the start of each plane
+    * @param linesize array of MAX_PLANES integers filled with the bytes between lines of each plane
+    * @return the picture size in bytes, 0 if the frame has no picture planes
+    */
+    virtual unsigned getPlanes(unsigned char* data[], int linesize[]) = 0;
+    
+    /**
+    * Exchanges the picture buffer, size, pixel format and field order with another raw frame of the same kind, 
+    * this way a picture is moved from a frame to another one without copying it
+    * @param other frame to exchange the picture with
+    * @return false if the frames are not raw frames of the same kind, nothing is exchanged then
+    */
+    virtual bool swapBuffer(VideoFrame* /*other*/) {return false;};
+    
+    /**
+    * Gets the geometry of a plane of a picture stored without padding
+    * @param pixelFormat PixType of the picture
+    * @param width horizontal number of pixels
+    * @param height vertical number of pixels
+    * @param plane index of the plane
+    * @param lineBytes filled with the bytes of a plane line
+    * @param rows filled with the number of lines of the plane
+    * @return false if the pixel format has no such plane
+    */
+    static bool planeSize(PixType pixelFormat, int width, int height, unsigned plane, int &lineBytes, int &rows);
+    
+    /**
+    * @param pixelFormat PixType to check
+    * @return true if the pixel format stores each component in its own plane
+    */
+    static bool isPlanarFormat(PixType pixelFormat);
+    
+    /**
+    * Sets the shrink policy of raw frames buffers, process wide
+    * @param ratio buffers are reallocated when the needed size is below ratio times their capacity, 
+    * 0 means that buffers never shrink
+    */
+    static void setShrinkRatio(float ratio);
+    
+    /**
+    * @return the shrink ratio of raw frames buffers
+    */
+    static float getShrinkRatio() {return shrinkRatio;};
+    
+    /**
+    * Sets the type of a coded frame, only meaningful if the writer stream info says so (see StreamInfo)
+    * @param key the frame is a random access point, decoding can start with it
+    * @param reference later frames depend on it, so it cannot be dropped without corrupting them
+    */
+    void setFrameType(bool key, bool reference) {keyFrame = key; referenceFrame = reference;};
+    
+    bool isKeyFrame() {return keyFrame;};
+    bool isReference() {return referenceFrame;};
+    
+    /**
+    * Stamps the frame with the format version of its writer stream (see StreamInfo::changeFormat), 
+    * the first frame with a new version is the one where readers reconfigure
+    * @param version format version of the writer stream info
+    */
+    void setFormatVersion(unsigned version) {formatVersion = version;};
+    
+    unsigned getFormatVersion() {return formatVersion;};
+    
+    /**
+    * Sets the field structure of a raw picture, writers of interlaced pictures set it for each frame
+    * since queue frames are reused (see Deinterlacer)
+    * @param order FieldOrder of the picture
+    */
+    void setFieldOrder(FieldOrder order) {fieldOrder = order;};
+    
+    FieldOrder getFieldOrder() {return fieldOrder;};
+    
     VCodecType getCodec() {return codec;};
     int getWidth() {return width;};
     int getHeight() {return height;};
@@ -60,6 +148,12 @@ protected:
     VCodecType codec;
     int width, height;
     PixType pixelFormat;
+    bool keyFrame;
+    bool referenceFrame;
+    unsigned formatVersion;
+    FieldOrder fieldOrder;
+    
+    static std::atomic<float> shrinkRatio;
 };
 
 class InterleavedVideoFrame : public VideoFrame {
@@ -70,20 +164,151 @@ public:
     ~InterleavedVideoFrame();
 
     unsigned char **getPlanarDataBuf() {return NULL;};
-    unsigned char* getDataBuf() {return frameBuff;};
+    unsigned char* getDataBuf();
     unsigned int getLength() {return bufferLen;};
     unsigned int getMaxLength() {return bufferMaxLen;};
     void setLength(unsigned int length) {bufferLen = length;};
     bool isPlanar() {return false;};
+    
+    /**
+    * See VideoFrame::fitBuffer. Raw frames buffer grows or shrinks (see setShrinkRatio) to the 
+    * needed size and their length is set to the picture size, coded frames keep their maximum length.
+    */
+    void fitBuffer(int width, int height, PixType pixelFormat);
+    
+    /**
+    * See VideoFrame::getPlanes. Planes are packed one after the other without line padding, 
+    * except for external pictures with their own stride, see setExternalBuffer.
+    */
+    unsigned getPlanes(unsigned char* data[], int linesize[]);
+    
+    /**
+    * See VideoFrame::swapBuffer
+    */
+    bool swapBuffer(VideoFrame* other);
+    
+    /**
+    * Points a raw frame to a packed picture it does not own, so it is passed on without copying it. 
+    * The owner reference keeps the picture alive until the buffer is fitted again or released, then
+    * the frame goes back to its own buffer.
+    * @param width horizontal number of pixels
+    * @param height vertical number of pixels
+    * @param pixelFormat PixType of the picture, not a planar one
+    * @param data picture start, planes one after the other without line padding
+    * @param owner reference that keeps the picture alive
+    * @param stride bytes between lines (i.e. a region of a wider picture), 0 for packed lines. 
+    * Only single plane formats can have it, and then getDataBuf data is not packed.
+    * @return false if the frame is not raw or the format is planar, the frame is not modified then
+    */
+    bool setExternalBuffer(int width, int height, PixType pixelFormat, unsigned char* data, 
+                           std::shared_ptr<void> owner, int stride = 0);
+    
+    /**
+    * @return bytes between lines of an external picture with its own stride, 0 if lines are packed
+    */
+    int getExternalStride() const {return externalStride;};
+    
+    /**
+    * Drops the reference to the external picture, if any, see setExternalBuffer
+    */
+    void releaseBuffer();
+    
+    /**
+    * @return true if the picture is owned by someone else, see setExternalBuffer
+    */
+    bool hasExternalBuffer() const {return owner != nullptr;};
 
 protected:
     InterleavedVideoFrame(VCodecType codec, unsigned int maxLength);
     InterleavedVideoFrame(VCodecType codec, int width, int height, PixType pixelFormat);
 
 private:
+    void resizeBuffer(unsigned int length);
+    
     unsigned char *frameBuff;
+    unsigned char *externalBuff;
+    int externalStride;
     unsigned int bufferLen;
     unsigned int bufferMaxLen;
+    std::shared_ptr<void> owner;
+};
+
+/*! Raw video frame keeping each picture plane apart, with lines padded to FRAME_ALIGNMENT bytes.
+    Libav decoders, encoders and scalers can use its planes in place, without packing them. It can 
+    also point to planes owned by someone else (i.e. a picture decoded in place), see setExternalPlanes.
+*/
+class PlanarVideoFrame : public VideoFrame {
+    
+public:
+    static PlanarVideoFrame* createNew(VCodecType codec, int width, int height, PixType pixelFormat);
+    ~PlanarVideoFrame();
+
+    unsigned char *getDataBuf() {return NULL;};
+    unsigned char **getPlanarDataBuf();
+    unsigned int getLength() {return bufferLen;};
+    unsigned int getMaxLength() {return bufferMaxLen;};
+    void setLength(unsigned int length) {bufferLen = length;};
+    bool isPlanar() {return true;};
+    
+    /**
+    * @return the bytes between lines of each plane
+    */
+    int* getLinesize();
+    
+    /**
+    * See VideoFrame::fitBuffer. The buffer grows or shrinks (see setShrinkRatio) to the needed 
+    * size, which accounts for the line padding. The frame length is set to the size of the planes.
+    */
+    void fitBuffer(int width, int height, PixType pixelFormat);
+    
+    /**
+    * See VideoFrame::getPlanes
+    */
+    unsigned getPlanes(unsigned char* data[], int linesize[]);
+    
+    /**
+    * See VideoFrame::swapBuffer
+    */
+    bool swapBuffer(VideoFrame* other);
+    
+    /**
+    * Points the frame to planes it does not own, so a picture is passed on without copying it. The 
+    * owner reference keeps the planes alive until the buffer is fitted again or the planes are 
+    * released, then the frame goes back to its own buffer.
+    * @param width horizontal number of pixels
+    * @param height vertical number of pixels
+    * @param pixelFormat planar PixType of the picture, see isPlanarFormat
+    * @param data start of each plane, aligned to FRAME_ALIGNMENT
+    * @param linesize bytes between lines of each plane, multiples of FRAME_ALIGNMENT
+    * @param owner reference that keeps the planes alive
+    * @return false if the format is not planar or the planes are not aligned, the frame is not modified then
+    */
+    bool setExternalPlanes(int width, int height, PixType pixelFormat, unsigned char* data[], 
+                           int linesize[], std::shared_ptr<void> owner);
+    
+    /**
+    * Drops the reference to the external planes, if any, see setExternalPlanes
+    */
+    void releasePlanes();
+    
+    /**
+    * @return true if the planes are owned by someone else, see setExternalPlanes
+    */
+    bool hasExternalPlanes() const {return owner != nullptr;};
+
+private:
+    PlanarVideoFrame(VCodecType codec, int width, int height, PixType pixelFormat);
+    unsigned layoutPlanes(bool assign);
+    void setupPlanes();
+    
+    unsigned char *frameBuff;
+    unsigned char *planes[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int planesWidth, planesHeight;
+    PixType planesFormat;
+    unsigned int bufferLen;
+    unsigned int bufferMaxLen;
+    std::shared_ptr<void> owner;
 };
 
 class Slice {
@@ -122,6 +347,7 @@ public:
     unsigned int getMaxLength() {return 0;};
     void setLength(unsigned int length) {};
     bool isPlanar() {return false;};
+    unsigned getPlanes(unsigned char* data[], int linesize[]);
 
 private:
     SlicedVideoFrame(VCodecType codec);
@@ -131,6 +357,73 @@ private:
     int pointedSliceNum;
 };
 
+/*! Reference counted buffer holding the NAL units of a coded picture one after the other. 
+    It is shared by the SliceRefVideoFrame entries pointing into it and it can be refilled 
+    once none of them references it.
+*/
+class SliceStore {
+
+public:
+    SliceStore();
+    ~SliceStore();
+    
+    /**
+    * Copies the slices into the store, growing it if needed. Slices that are contiguous in memory,
+    * as encoders usually output them, are copied with a single memcpy.
+    * @param slices array of slices to copy
+    * @param sliceNum number of slices
+    * @return false if the store could not be allocated
+    */
+    bool fill(Slice* slices, int sliceNum);
+    
+    unsigned char* getData() {return buffer;};
+    unsigned getLength() {return length;};
+    unsigned getMaxLength() {return maxLength;};
+
+private:
+    unsigned char *buffer;
+    unsigned length;
+    unsigned maxLength;
+};
+
+/*! Coded video frame without its own buffer, its data is a NAL unit stored in a SliceStore. The 
+    frame keeps a reference to the store, so the data is valid until the frame is pointed elsewhere.
+*/
+class SliceRefVideoFrame : public VideoFrame {
+
+public:
+    static SliceRefVideoFrame* createNew(VCodecType codec);
+    ~SliceRefVideoFrame();
+    
+    /**
+    * Points the frame to a NAL unit of a store
+    * @param store store holding the data
+    * @param offset position of the NAL unit in the store
+    * @param size NAL unit size in bytes
+    */
+    void setSlice(std::shared_ptr<SliceStore> store, unsigned offset, unsigned size);
+    
+    /**
+    * Drops the store reference
+    */
+    void releaseSlice();
+    
+    unsigned char *getDataBuf();
+    unsigned char **getPlanarDataBuf() {return NULL;};
+    unsigned int getLength() {return sliceLen;};
+    unsigned int getMaxLength() {return sliceLen;};
+    void setLength(unsigned int length);
+    bool isPlanar() {return false;};
+    unsigned getPlanes(unsigned char* data[], int linesize[]);
+
+private:
+    SliceRefVideoFrame(VCodecType codec);
+    
+    std::shared_ptr<SliceStore> store;
+    unsigned sliceOffset;
+    unsigned sliceLen;
+};
+
 
 
 
@@ -20,30 +20,94 @@
  */
 
 #include <chrono>
+#include <algorithm>
 
 #include "WorkersPool.hh"
 #include "Utils.hh"
 
 #define HW_CONC_FACTOR 2
 
+static thread_local WorkersPool* currentPool = NULL;
+
 TaskQueue::TaskQueue(){
     iter = queue.begin();
 }
 
-void TaskQueue::pushBack(Runnable *run){
-    if (sQueue.find(run) == sQueue.end()){
-        sQueue.insert(run);
+bool TaskQueue::pushBack(Runnable *run){
+    if (sQueue.find(run) != sQueue.end()){
+        return false;
+    }
+    
+    sQueue.insert(run);
+    //NOTE: the time point of a running job is not settled until it finishes
+    if (run->isRunning() || run->ready()){
         queue.push_back(run);
-        resetIterator();
+    } else {
+        timers.push_back(run);
+        std::push_heap(timers.begin(), timers.end(), RunnableLater());
     }
+    resetIterator();
+    return true;
 }
 
 void TaskQueue::pop(){
-    if (!queue.empty()){
-        sQueue.erase(queue.front());
-        queue.pop_front();
-        resetIterator();
+    if (iter != queue.end()){
+        sQueue.erase(*iter);
+        queue.erase(iter);
+    }
+    resetIterator();
+}
+
+void TaskQueue::defer(){
+    if (iter != queue.end()){
+        timers.push_back(*iter);
+        std::push_heap(timers.begin(), timers.end(), RunnableLater());
+        queue.erase(iter);
+    }
+    resetIterator();
+}
+
+void TaskQueue::expireTimers(){
+    while (!timers.empty() && timers.front()->ready()){
+        std::pop_heap(timers.begin(), timers.end(), RunnableLater());
+        queue.push_back(timers.back());
+        timers.pop_back();
     }
+    resetIterator();
+}
+
+bool TaskQueue::nextDeadline(std::chrono::system_clock::time_point &deadline) const {
+    if (timers.empty()){
+        return false;
+    }
+    
+    deadline = timers.front()->getTime();
+    return true;
+}
+
+bool TaskQueue::remove(Runnable *run){
+    if (sQueue.erase(run) == 0){
+        return false;
+    }
+    
+    queue.erase(std::remove(queue.begin(), queue.end(), run), queue.end());
+    
+    std::vector<Runnable*>::iterator it = std::remove(timers.begin(), timers.end(), run);
+    if (it != timers.end()){
+        timers.erase(it, timers.end());
+        std::make_heap(timers.begin(), timers.end(), RunnableLater());
+    }
+    resetIterator();
+    return true;
+}
+
+bool TaskQueue::hasReady(){
+    for (auto run : queue){
+        if (!run->isRunning() && run->ready()){
+            return true;
+        }
+    }
+    return false;
 }
 
 void TaskQueue::resetIterator(){
@@ -53,6 +117,8 @@ void TaskQueue::resetIterator(){
 void TaskQueue::clear(){
     queue.clear();
     sQueue.clear();
+    timers.clear();
+    resetIterator();
 }
 
 Runnable* TaskQueue::current(){
@@ -69,78 +135,869 @@ void TaskQueue::next(){
 }
 
 
-WorkersPool::WorkersPool(size_t threads) : run(true)
+WorkersPool::WorkersPool(size_t threads, SchedulingMode mode_) : mtx(POOL_LOCK), run(true), mode(mode_), nextWorker(0), pinned(false), reserved(0),
+    handOff(false), handOffs(0), cpus(utils::getCurrentThreadAffinity()), activeWorkers(0), busyWorkers(0), busyTime(0), totalBusyTime(0),
+    statsStart(std::chrono::system_clock::now())
 {
     if (threads == 0 || 
         threads > std::thread::hardware_concurrency()*HW_CONC_FACTOR){
         threads = std::thread::hardware_concurrency()*HW_CONC_FACTOR;
     }
     
+    if (threads == 0){
+        threads = 1;
+    }
+    
     utils::infoMsg("starting "  + std::to_string(threads) + " threads");
     
+    minWorkers = threads;
+    maxWorkers = threads;
+    activeWorkers = threads;
+    alive = std::vector<bool>(threads, true);
+    
+    workersNode = std::vector<std::atomic<int>>(threads);
+    for (auto &node : workersNode){
+        node = -1;
+    }
+    
+    if (mode == WORK_STEALING){
+        for (unsigned int i = 0; i < threads; i++){
+            stealingWorkers.push_back(std::unique_ptr<StealingWorker>(new StealingWorker()));
+        }
+        
+        for (unsigned int i = 0; i < threads; i++){
+            workers.push_back(std::thread(&WorkersPool::workStealingLoop, this, i));
+        }
+        return;
+    }
+    
     for (unsigned int i = 0; i < threads; i++){
-        workers.push_back(
-            std::thread([this](unsigned int j){
-                Runnable* job = NULL;
-                std::vector<int> enabledJobs;
-                bool added = false;
+        workers.push_back(std::thread(&WorkersPool::sharedQueueLoop, this, i));
+    }
+}
+
+bool WorkersPool::pinWorkers(bool pin)
+{
+    bool success = true;
+    
+    if (cpus.empty()){
+        utils::errorMsg("Could not retrieve the available cpus");
+        return false;
+    }
+    
+    std::lock_guard<ProfiledMutex> guard(mtx);
+    
+    for (unsigned i = 0; i < workers.size(); i++){
+        if (alive[i]){
+            success &= pinWorker(i, pin);
+        }
+    }
+    
+    pinned = pin;
+    
+    if (!success){
+        utils::warningMsg("Some workers could not be pinned");
+    }
+    
+    return success;
+}
+
+bool WorkersPool::pinWorker(unsigned wId, bool pin)
+{
+    if (!pin){
+        workersNode[wId] = -1;
+        return utils::setThreadAffinity(workers[wId], cpus);
+    }
+    
+    unsigned cpu = cpus[wId % cpus.size()];
+    workersNode[wId] = utils::getNumaNodeOfCpu(cpu);
+    return utils::setThreadAffinity(workers[wId], std::vector<unsigned>(1, cpu));
+}
+
+bool WorkersPool::setElastic(size_t minThreads, size_t maxThreads)
+{
+    if (mode != SHARED_QUEUE){
+        utils::errorMsg("Elastic pool is only supported by the shared queue mode");
+        return false;
+    }
+    
+    std::unique_lock<std::mutex> guard = mtx.uniqueLock();
+    
+    if (!run || minThreads <= reserved || minThreads > maxThreads){
+        utils::errorMsg("Invalid elastic pool bounds");
+        return false;
+    }
+    
+    //NOTE: node slots are only read under the pool mutex in the shared queue mode
+    std::vector<std::atomic<int>> nodes(std::max(maxThreads, workers.size()));
+    for (unsigned i = 0; i < nodes.size(); i++){
+        nodes[i] = i < workersNode.size() ? workersNode[i].load() : -1;
+    }
+    workersNode.swap(nodes);
+    
+    minWorkers = minThreads;
+    maxWorkers = maxThreads;
+    
+    while (activeWorkers < minWorkers){
+        spawnWorker();
+    }
+    
+    guard.unlock();
+    qCheck.notify_all();
+    return true;
+}
+
+void WorkersPool::spawnWorker()
+{
+    unsigned id = 0;
+    
+    while (id < alive.size() && alive[id]){
+        id++;
+    }
+    
+    if (id == alive.size()){
+        alive.push_back(false);
+        workers.push_back(std::thread());
+    }
+    
+    //NOTE: a retired worker releases the slot just before leaving its loop
+    if (workers[id].joinable()){
+        workers[id].join();
+    }
+    
+    alive[id] = true;
+    activeWorkers++;
+    workers[id] = std::thread(&WorkersPool::sharedQueueLoop, this, id);
+    
+    if (pinned){
+        pinWorker(id, true);
+    }
+    
+    utils::infoMsg("worker " + std::to_string(id) + " started, " + 
+        std::to_string(activeWorkers) + " active workers");
+}
+
+bool WorkersPool::mustGrow()
+{
+    std::chrono::system_clock::time_point now = Clock::now();
+    
+    if (activeWorkers >= maxWorkers || busyWorkers < activeWorkers || 
+        now - lastGrowth < std::chrono::milliseconds(ELASTIC_STEP)){
+        return false;
+    }
+    
+    if (!hQueue.hasReady() && !queue.hasReady()){
+        return false;
+    }
+    
+    lastGrowth = now;
+    return true;
+}
+
+bool WorkersPool::retireWorker(unsigned id, std::chrono::system_clock::time_point lastJob)
+{
+    if (id < reserved || activeWorkers <= minWorkers){
+        return false;
+    }
+    
+    if (activeWorkers <= maxWorkers && 
+        Clock::now() - lastJob < std::chrono::milliseconds(ELASTIC_IDLE)){
+        return false;
+    }
+    
+    alive[id] = false;
+    activeWorkers--;
+    
+    utils::infoMsg("worker " + std::to_string(id) + " retired, " + 
+        std::to_string(activeWorkers) + " active workers");
+    return true;
+}
+
+void WorkersPool::addBusyTime(std::chrono::system_clock::time_point start)
+{
+    int64_t busy = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now() - start).count();
+    
+    busyTime += busy;
+    totalBusyTime += busy;
+}
+
+float WorkersPool::getUtilisation()
+{
+    std::lock_guard<ProfiledMutex> guard(mtx);
+    std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - statsStart).count();
+    float utilisation = 0;
+    
+    if (elapsed > 0 && activeWorkers > 0){
+        utilisation = (float) busyTime.exchange(0) / (elapsed * activeWorkers);
+    }
+    
+    statsStart = now;
+    return std::min(utilisation, 1.0f);
+}
+
+bool WorkersPool::canRun(unsigned wId, const Runnable *job) const
+{
+    int node = job->getAffinity();
+    
+    if (!pinned || node < 0 || workersNode[wId] == node){
+        return true;
+    }
+    
+    //NOTE: the affinity hint is ignored if there is no worker in the requested node
+    for (auto &wNode : workersNode){
+        if (wNode == node){
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+bool WorkersPool::eligible(unsigned wId, const Runnable *job) const
+{
+    return canRun(wId, job) && (wId >= reserved || job->getPriority() == HIGH_PRIORITY);
+}
+
+int WorkersPool::pickWorker(unsigned wId, const Runnable *job)
+{
+    unsigned w;
+    
+    if (eligible(wId, job)){
+        return wId;
+    }
+    
+    for (unsigned i = 0; i < workersNode.size(); i++){
+        w = (nextWorker + i) % workersNode.size();
+        if (eligible(w, job)){
+            nextWorker = w + 1;
+            return w;
+        }
+    }
+    
+    //NOTE: the affinity hint is ignored if all the workers of the node are reserved
+    return wId >= reserved ? wId : reserved.load();
+}
+
+bool WorkersPool::reserveWorkers(unsigned n)
+{
+    {
+        std::lock_guard<ProfiledMutex> guard(mtx);
+        if (n >= minWorkers){
+            utils::errorMsg("At least one worker must be left for normal priority runnables");
+            return false;
+        }
+        reserved = n;
+    }
+    
+    qCheck.notify_all();
+    return true;
+}
+
+TaskQueue& WorkersPool::queueOf(const Runnable *job)
+{
+    return job->getPriority() == HIGH_PRIORITY ? hQueue : queue;
+}
+
+Runnable* WorkersPool::nextJob(TaskQueue &q, unsigned id)
+{
+    Runnable* job = NULL;
+    
+    while ((job = q.current())){
+        if (!canRun(id, job) || job->isRunning()){
+            q.next();
+        } else if (!job->ready()){
+            q.defer();
+        } else {
+            q.pop();
+            return job;
+        }
+    }
+    
+    return NULL;
+}
+
+Runnable* WorkersPool::handOffJob(int jId, unsigned id)
+{
+    Runnable* job;
+    
+    if (jId < 0 || runnables.count(jId) == 0){
+        return NULL;
+    }
+    
+    job = runnables[jId];
+    
+    //NOTE: it is only taken while still queued, another worker may have taken it already
+    if (!eligible(id, job) || job->isRunning() || !job->ready() ||
+        (job->getPriority() != HIGH_PRIORITY && hQueue.hasReady()) || !queueOf(job).remove(job)){
+        //NOTE: no worker was woken for it when it was handed off
+        qCheck.notify_one();
+        return NULL;
+    }
+    
+    handOffs++;
+    return job;
+}
+
+void WorkersPool::sharedQueueLoop(unsigned id)
+{
+    Runnable* job = NULL;
+    ForkJoinGroup* group = NULL;
+    std::vector<int> enabledJobs;
+    std::chrono::system_clock::time_point deadline;
+    std::chrono::system_clock::time_point nDeadline;
+    std::chrono::system_clock::time_point lastJob = Clock::now();
+    std::chrono::system_clock::time_point start;
+    bool timed = false;
+    bool added = false;
+    bool broadcast = false;
+    int next = -1;
+    
+    currentPool = this;
+    
+    while(true) {
+        std::unique_lock<std::mutex> guard = mtx.uniqueLock();
+        hQueue.expireTimers();
+        queue.expireTimers();
+        while (run) {
+            group = pendingGroup();
+            if (group){
+                //NOTE: helping a running job comes first, it is already on the critical path
+                group->helpers++;
+                guard.unlock();
+                start = std::chrono::system_clock::now();
+                runItems(group);
+                addBusyTime(start);
+                group->helpers--;
+                guard.lock();
+                continue;
+            }
+            
+            job = handOffJob(next, id);
+            next = -1;
+            
+            if (!job){
+                job = nextJob(hQueue, id);
+            }
+            if (!job && id >= reserved){
+                job = nextJob(queue, id);
+            }
+            
+            if (job){
+                break;
+            }
+            
+            timed = hQueue.nextDeadline(deadline);
+            if (id >= reserved && queue.nextDeadline(nDeadline) && (!timed || nDeadline < deadline)){
+                deadline = nDeadline;
+                timed = true;
+            }
+            
+            nDeadline = lastJob + std::chrono::milliseconds(ELASTIC_IDLE);
+            if (activeWorkers > minWorkers && (!timed || nDeadline < deadline)){
+                deadline = nDeadline;
+                timed = true;
+            }
+            
+            if (timed){
+                qCheck.wait_until(guard, Clock::waitDeadline(deadline));
+            } else {
+                qCheck.wait(guard);
+            }
+            
+            if (retireWorker(id, lastJob)){
+                return;
+            }
+            
+            hQueue.expireTimers();
+            queue.expireTimers();
+        }
+
+        if(!run){
+            break;
+        }
+        
+        added = false;
+        //NOTE: the notified worker might skip jobs due to their affinity or priority
+        broadcast = reserved > 0;
+        
+        busyWorkers++;
+        if (mustGrow()){
+            spawnWorker();
+        }
+        
+        job->setRunning();
+        guard.unlock();
+        
+        if (broadcast){
+            qCheck.notify_all();
+        } else {
+            qCheck.notify_one();
+        }
+        
+        start = std::chrono::system_clock::now();
+        enabledJobs.clear();
+        job->runProcessFrame(enabledJobs);
+        addBusyTime(start);
+        
+        guard.lock();
+        job->unsetRunning();
+        busyWorkers--;
+        lastJob = Clock::now();
+        
+        if (job->pendingJobs()){
+            enabledJobs.push_back(job->getId());
+        }
+        
+        for(auto jId : enabledJobs){
+            if (runnables.count(jId) > 0){
+                //NOTE: the first job enabled by another one is handed off, no other worker is woken for it
+                if (queueOf(runnables[jId]).pushBack(runnables[jId]) && handOff && next < 0 && 
+                    jId != job->getId() && eligible(id, runnables[jId])){
+                    next = jId;
+                    continue;
+                }
+                broadcast |= pinned && runnables[jId]->getAffinity() >= 0;
+            } else {
+                notifyDedicated(jId);
+            }
+            added = true;
+        }
+        
+        guard.unlock();
+        if (added && broadcast){
+            qCheck.notify_all();
+        } else if (added){
+            qCheck.notify_one();
+        }
+    }
+}
+
+void WorkersPool::workStealingLoop(unsigned id)
+{
+    StealingWorker *self = stealingWorkers[id].get();
+    StealingTask *task = NULL;
+    std::vector<int> enabledJobs;
+    std::chrono::system_clock::time_point start;
+    unsigned wakeups;
+    
+    currentPool = this;
+    
+    while (run) {
+        task = popLocal(id);
+        
+        if (!task){
+            {
+                std::lock_guard<ProfiledMutex> guard(self->mtx);
+                wakeups = self->wakeups;
+                self->sleeping = true;
+            }
+            
+            task = steal(id);
+        }
+        
+        if (!task){
+            std::unique_lock<std::mutex> guard = self->mtx.uniqueLock();
+            std::chrono::system_clock::time_point deadline = 
+                Clock::now() + std::chrono::milliseconds(IDLE);
+            
+            if (!self->delayed.empty() && self->delayed.begin()->first < deadline){
+                deadline = self->delayed.begin()->first;
+            }
+            
+            self->cv.wait_until(guard, Clock::waitDeadline(deadline), [this, self, wakeups]{
+                return !run || self->wakeups != wakeups || self->next || !self->jobs.empty() || !self->urgentJobs.empty();
+            });
+            self->sleeping = false;
+            continue;
+        }
+        
+        self->sleeping = false;
+        
+        task->job->setRunning();
+        start = std::chrono::system_clock::now();
+        enabledJobs.clear();
+        task->job->runProcessFrame(enabledJobs);
+        addBusyTime(start);
+        task->job->unsetRunning();
+        
+        if (task->job->pendingJobs()){
+            enabledJobs.push_back(task->job->getId());
+        }
+        
+        finishTask(task, enabledJobs, id);
+    }
+}
+
+StealingTask* WorkersPool::popLocal(unsigned id)
+{
+    StealingWorker *self = stealingWorkers[id].get();
+    StealingTask *task = NULL;
+    int queued;
+    
+    std::lock_guard<ProfiledMutex> guard(self->mtx);
+    
+    while (!self->delayed.empty() && self->delayed.begin()->second->job->ready()){
+        task = self->delayed.begin()->second;
+        self->jobsOf(task).push_back(task);
+        self->delayed.erase(self->delayed.begin());
+    }
+    
+    if (self->next && (self->urgentJobs.empty() || self->next->job->getPriority() == HIGH_PRIORITY)){
+        task = self->next;
+        self->next = NULL;
+        queued = StealingTask::QUEUED;
+        
+        if (!task->job->ready()){
+            self->delayed.insert(std::make_pair(task->job->getTime(), task));
+        } else if (task->state.compare_exchange_strong(queued, StealingTask::RUNNING)){
+            handOffs++;
+            return task;
+        }
+    }
+    
+    for (std::deque<StealingTask*> *jobs : {&self->urgentJobs, &self->jobs}){
+        while (!jobs->empty()){
+            task = jobs->back();
+            jobs->pop_back();
+            
+            if (!task->job->ready()){
+                self->delayed.insert(std::make_pair(task->job->getTime(), task));
+                continue;
+            }
+            
+            queued = StealingTask::QUEUED;
+            if (task->state.compare_exchange_strong(queued, StealingTask::RUNNING)){
+                return task;
+            }
+        }
+    }
+    
+    return NULL;
+}
+
+StealingTask* WorkersPool::steal(unsigned id)
+{
+    StealingTask *task = NULL;
+    int queued;
+    
+    //NOTE: high priority tasks of every victim are stolen before any normal one
+    for (unsigned pass = 0; pass < 2; pass++){
+        for (unsigned i = 1; i < stealingWorkers.size() && run; i++){
+            StealingWorker *victim = stealingWorkers[(id + i) % stealingWorkers.size()].get();
+            std::lock_guard<ProfiledMutex> guard(victim->mtx);
+            std::deque<StealingTask*> &jobs = pass == 0 ? victim->urgentJobs : victim->jobs;
+            
+            //NOTE: the next slot is only stolen once the deques of the victim are empty, e.g. it is busy
+            if (pass == 1 && jobs.empty() && victim->next && victim->next->job->ready() && 
+                eligible(id, victim->next->job)){
+                task = victim->next;
+                victim->next = NULL;
+                queued = StealingTask::QUEUED;
+                if (task->state.compare_exchange_strong(queued, StealingTask::RUNNING)){
+                    return task;
+                }
+                continue;
+            }
+            
+            for (std::deque<StealingTask*>::iterator it = jobs.begin(); it != jobs.end(); ++it){
+                task = *it;
+                if (!task->job->ready() || !eligible(id, task->job)){
+                    continue;
+                }
                 
-                while(true) {
-                    std::unique_lock<std::mutex> guard(mtx);
-                    queue.resetIterator();
-                    while (run) {
-                        job = queue.current();
-                        if (!job){
-                            qCheck.wait_for(guard, std::chrono::milliseconds(IDLE));
-                        } else if (!job->isRunning() && !job->ready()) {
-                            qCheck.wait_until(guard, job->getTime());
-                        } else if (!job->isRunning() && job->ready()){
-                            queue.pop();
-                            break;
-                        } else {
-                            queue.next();
-                            continue;
-                        }
-                        queue.resetIterator();
-                    }
+                jobs.erase(it);
+                queued = StealingTask::QUEUED;
+                if (task->state.compare_exchange_strong(queued, StealingTask::RUNNING)){
+                    return task;
+                }
+                break;
+            }
+        }
+    }
+    
+    return NULL;
+}
 
-                    if(!run){
-                        break;
-                    }
-                    
-                    added = false;
-                    
-                    job->setRunning();
-                    guard.unlock();
-                    
-                    qCheck.notify_one();
-                    
-                    enabledJobs = job->runProcessFrame();
-                    
-                    guard.lock();
-                    job->unsetRunning();
-                    
-                    if (job->pendingJobs()){
-                        enabledJobs.push_back(job->getId());
-                    }
+int WorkersPool::scheduleTask(StealingTask *task, unsigned wId, bool next)
+{
+    int state = task->state.load();
+    int target = pickWorker(wId, task->job);
+    
+    while (true){
+        switch (state){
+            case StealingTask::IDLE_TASK:
+                if (task->state.compare_exchange_weak(state, StealingTask::QUEUED)){
+                    StealingWorker *worker = stealingWorkers[target].get();
+                    std::lock_guard<ProfiledMutex> guard(worker->mtx);
                     
-                    for(auto id : enabledJobs){
-                        if (runnables.count(id) > 0){
-                            queue.pushBack(runnables[id]);
-                        }
-                        added = true;
+                    if (!next || target != (int) wId){
+                        worker->jobsOf(task).push_back(task);
+                        return target;
                     }
                     
-                    guard.unlock();
-                    if (added){
-                        qCheck.notify_one();
+                    //NOTE: a previous hand-off not taken yet goes back to the deque
+                    if (worker->next){
+                        worker->jobsOf(worker->next).push_back(worker->next);
                     }
+                    worker->next = task;
+                    return target;
+                }
+                break;
+            case StealingTask::RUNNING:
+                if (task->state.compare_exchange_weak(state, StealingTask::RERUN)){
+                    return -1;
                 }
-            }, i)
-        );
+                break;
+            default:
+                return -1;
+        }
+    }
+}
+
+void WorkersPool::finishTask(StealingTask *task, std::vector<int> &enabledJobs, unsigned wId)
+{
+    StealingWorker *self = stealingWorkers[wId].get();
+    bool rerun = false;
+    unsigned pushed = 0;
+    bool urgent = false;
+    int running = StealingTask::RUNNING;
+    int target;
+    bool next = handOff;
+    
+    std::lock_guard<ProfiledMutex> guard(mtx);
+    
+    for (auto id : enabledJobs){
+        if (id == task->job->getId()){
+            rerun = true;
+            continue;
+        }
+        
+        if (stealingTasks.count(id) == 0){
+            notifyDedicated(id);
+            continue;
+        }
+        
+        target = scheduleTask(stealingTasks[id], wId, next);
+        if (next && target == (int) wId){
+            //NOTE: the hand-off is run by this worker, no other one is woken for it
+            next = false;
+        } else if (target == (int) wId){
+            urgent |= stealingTasks[id]->job->getPriority() == HIGH_PRIORITY;
+            pushed++;
+        } else if (target >= 0){
+            std::lock_guard<ProfiledMutex> wGuard(stealingWorkers[target]->mtx);
+            stealingWorkers[target]->wakeups++;
+            stealingWorkers[target]->cv.notify_one();
+        }
+    }
+    
+    if (task->removed){
+        task->state = StealingTask::IDLE_TASK;
+        return;
+    }
+    
+    if (rerun || !task->state.compare_exchange_strong(running, StealingTask::IDLE_TASK)){
+        task->state = StealingTask::QUEUED;
+        target = pickWorker(wId, task->job);
+        StealingWorker *owner = stealingWorkers[target].get();
+        std::lock_guard<ProfiledMutex> wGuard(owner->mtx);
+        if (task->job->ready()){
+            owner->jobsOf(task).push_front(task);
+        } else {
+            owner->delayed.insert(std::make_pair(task->job->getTime(), task));
+        }
+        
+        if (owner != self){
+            owner->wakeups++;
+            owner->cv.notify_one();
+        } else if (task->job->ready()){
+            pushed++;
+        }
+    }
+    
+    if (urgent && reserved > 0){
+        wakeIdleWorker(wId, true);
+    }
+    
+    if (pushed > 1){
+        wakeIdleWorker(wId, false);
+    }
+}
+
+void WorkersPool::wakeIdleWorker(unsigned wId, bool reservedOnes)
+{
+    unsigned w;
+    
+    for (unsigned i = 1; i < stealingWorkers.size(); i++){
+        w = (wId + i) % stealingWorkers.size();
+        StealingWorker *worker = stealingWorkers[w].get();
+        if (worker->sleeping && (w < reserved) == reservedOnes){
+            std::lock_guard<ProfiledMutex> guard(worker->mtx);
+            worker->wakeups++;
+            worker->cv.notify_one();
+            return;
+        }
+    }
+}
+
+void WorkersPool::dedicatedLoop(DedicatedWorker *worker)
+{
+    Runnable *job = worker->job;
+    std::vector<int> enabledJobs;
+    bool pending = true;
+    
+    currentPool = this;
+    
+    while (true){
+        std::unique_lock<std::mutex> guard(worker->mtx);
+        if (!pending){
+            worker->cv.wait(guard, [this, worker]{
+                return !run || worker->removed || worker->wakeups > 0;
+            });
+        }
+        
+        //NOTE: a simulated clock deadline may be reached after the real one, so it is checked again
+        while (run && !worker->removed && !job->ready()){
+            worker->cv.wait_until(guard, Clock::waitDeadline(job->getTime()));
+        }
+        
+        if (!run || worker->removed){
+            break;
+        }
+        
+        worker->wakeups = 0;
+        guard.unlock();
+        
+        job->setRunning();
+        enabledJobs.clear();
+        job->runProcessFrame(enabledJobs);
+        job->unsetRunning();
+        
+        pending = job->pendingJobs();
+        dispatchJobs(enabledJobs);
     }
 }
 
+bool WorkersPool::notifyDedicated(int id)
+{
+    if (dedicatedWorkers.count(id) == 0){
+        return false;
+    }
+    
+    DedicatedWorker *worker = dedicatedWorkers[id].get();
+    std::lock_guard<std::mutex> guard(worker->mtx);
+    worker->wakeups++;
+    worker->cv.notify_one();
+    return true;
+}
+
+void WorkersPool::dispatchJobs(std::vector<int> &enabledJobs)
+{
+    bool added = false;
+    int target;
+    
+    std::unique_lock<std::mutex> guard = mtx.uniqueLock();
+    
+    for (auto id : enabledJobs){
+        if (notifyDedicated(id)){
+            continue;
+        }
+        
+        if (mode == WORK_STEALING && stealingTasks.count(id) > 0){
+            target = scheduleTask(stealingTasks[id], nextWorker++ % stealingWorkers.size());
+            if (target >= 0){
+                std::lock_guard<ProfiledMutex> wGuard(stealingWorkers[target]->mtx);
+                stealingWorkers[target]->wakeups++;
+                stealingWorkers[target]->cv.notify_one();
+            }
+        } else if (mode != WORK_STEALING && runnables.count(id) > 0){
+            queueOf(runnables[id]).pushBack(runnables[id]);
+            added = true;
+        }
+    }
+    
+    guard.unlock();
+    //NOTE: the notified worker might skip jobs due to their affinity or priority
+    if (added){
+        qCheck.notify_all();
+    }
+}
+
+void WorkersPool::wakeUp(int id)
+{
+    std::vector<int> jobs(1, id);
+    
+    dispatchJobs(jobs);
+}
+
+bool WorkersPool::setDedicated(Runnable* const runnable, bool dedicated)
+{
+    bool managed;
+    
+    if (runnable->isDedicated() == dedicated){
+        return true;
+    }
+    
+    managed = removeTask(runnable->getId());
+    runnable->setDedicated(dedicated);
+    
+    return !managed || addTask(runnable);
+}
+
+void WorkersPool::parallelFor(unsigned items, const std::function<void(unsigned)> &fn)
+{
+    ForkJoinGroup group(items, fn);
+    
+    if (items <= 1 || mode != SHARED_QUEUE || !run){
+        runItems(&group);
+        return;
+    }
+    
+    {
+        std::lock_guard<ProfiledMutex> guard(mtx);
+        forkJoins.push_back(&group);
+    }
+    qCheck.notify_all();
+    
+    runItems(&group);
+    
+    {
+        std::lock_guard<ProfiledMutex> guard(mtx);
+        forkJoins.erase(std::find(forkJoins.begin(), forkJoins.end(), &group));
+    }
+    
+    //NOTE: once removed no worker can join, wait for the ones still executing items
+    while (group.helpers > 0){
+        std::this_thread::yield();
+    }
+}
+
+WorkersPool* WorkersPool::current()
+{
+    return currentPool;
+}
+
+ForkJoinGroup* WorkersPool::pendingGroup()
+{
+    for (auto group : forkJoins){
+        if (group->next < group->items){
+            return group;
+        }
+    }
+    
+    return NULL;
+}
+
+void WorkersPool::runItems(ForkJoinGroup *group)
+{
+    unsigned item;
+    
+    while ((item = group->next++) < group->items){
+        group->fn(item);
+    }
+}
 
 WorkersPool::~WorkersPool()
 {
@@ -149,14 +1006,44 @@ WorkersPool::~WorkersPool()
 
 void WorkersPool::stop()
 {
-    run = false;
+    std::map<int, std::unique_ptr<DedicatedWorker>> dWorkers;
+    
+    {
+        std::lock_guard<ProfiledMutex> guard(mtx);
+        run = false;
+        dWorkers.swap(dedicatedWorkers);
+    }
+    for (auto &it : dWorkers){
+        {
+            std::lock_guard<std::mutex> guard(it.second->mtx);
+        }
+        it.second->cv.notify_all();
+        if (it.second->thread.joinable()){
+            it.second->thread.join();
+        }
+    }
     qCheck.notify_all();
+    for (auto &worker : stealingWorkers){
+        std::lock_guard<ProfiledMutex> guard(worker->mtx);
+        worker->cv.notify_all();
+    }
     for (std::thread &worker : workers){
         if (worker.joinable()){
             worker.join();
         }
     }
     queue.clear();
+    hQueue.clear();
+    
+    for (auto &worker : stealingWorkers){
+        worker->urgentJobs.clear();
+        worker->jobs.clear();
+        worker->delayed.clear();
+    }
+    for (auto it : stealingTasks){
+        delete it.second;
+    }
+    stealingTasks.clear();
 }
 
 bool WorkersPool::addTask(Runnable* const task)
@@ -165,22 +1052,103 @@ bool WorkersPool::addTask(Runnable* const task)
     if (id < 0){
         return false;
     }
-    std::unique_lock<std::mutex> guard(mtx);
-    if (runnables.count(id) == 0){
-        runnables[id] = task;
-        queue.pushBack(task);
-        guard.unlock();
-        qCheck.notify_one();
+    std::unique_lock<std::mutex> guard = mtx.uniqueLock();
+    if (dedicatedWorkers.count(id) > 0 || runnables.count(id) > 0 || stealingTasks.count(id) > 0){
+        return false;
+    }
+    
+    if (task->isDedicated()){
+        DedicatedWorker *worker = new DedicatedWorker(task);
+        dedicatedWorkers[id] = std::unique_ptr<DedicatedWorker>(worker);
+        worker->thread = std::thread(&WorkersPool::dedicatedLoop, this, worker);
         return true;
     }
-    return false;
+    
+    if (mode == WORK_STEALING){
+        stealingTasks[id] = new StealingTask(task);
+        int wId = scheduleTask(stealingTasks[id], nextWorker++ % stealingWorkers.size());
+        
+        std::lock_guard<ProfiledMutex> wGuard(stealingWorkers[wId]->mtx);
+        stealingWorkers[wId]->wakeups++;
+        stealingWorkers[wId]->cv.notify_one();
+        return true;
+    }
+    
+    runnables[id] = task;
+    queueOf(task).pushBack(task);
+    guard.unlock();
+    qCheck.notify_one();
+    return true;
 }
 
 bool WorkersPool::removeTask(const int id)
 {
-    std::unique_lock<std::mutex> guard(mtx);
+    std::unique_lock<std::mutex> guard = mtx.uniqueLock();
+    if (dedicatedWorkers.count(id) > 0){
+        std::unique_ptr<DedicatedWorker> worker = std::move(dedicatedWorkers[id]);
+        dedicatedWorkers.erase(id);
+        guard.unlock();
+        
+        {
+            std::lock_guard<std::mutex> wGuard(worker->mtx);
+            worker->removed = true;
+        }
+        worker->cv.notify_all();
+        
+        if (worker->thread.joinable()){
+            worker->thread.join();
+        }
+        return true;
+    }
+    
+    if (mode == WORK_STEALING){
+        if (stealingTasks.count(id) == 0){
+            return false;
+        }
+        
+        StealingTask *task = stealingTasks[id];
+        stealingTasks.erase(id);
+        task->removed = true;
+        
+        for (auto &worker : stealingWorkers){
+            std::lock_guard<ProfiledMutex> wGuard(worker->mtx);
+            worker->urgentJobs.erase(std::remove(worker->urgentJobs.begin(), worker->urgentJobs.end(), task), worker->urgentJobs.end());
+            worker->jobs.erase(std::remove(worker->jobs.begin(), worker->jobs.end(), task), worker->jobs.end());
+            if (worker->next == task){
+                worker->next = NULL;
+            }
+            for (auto it = worker->delayed.begin(); it != worker->delayed.end(); ){
+                if (it->second == task){
+                    it = worker->delayed.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        guard.unlock();
+        
+        //NOTE: the task cannot be released while a worker is still processing it
+        while (task->state == StealingTask::RUNNING || task->state == StealingTask::RERUN){
+            std::this_thread::sleep_for(std::chrono::microseconds(IDLE));
+        }
+        
+        delete task;
+        return true;
+    }
+    
     if (runnables.count(id) > 0){
+        Runnable *job = runnables[id];
+        //NOTE: the priority might have changed while queued
+        queue.remove(job);
+        hQueue.remove(job);
         runnables.erase(id);
+        
+        //NOTE: the runnable cannot be released while a worker is still processing it
+        while (job->isRunning()){
+            guard.unlock();
+            std::this_thread::sleep_for(std::chrono::microseconds(IDLE));
+            guard.lock();
+        }
         guard.unlock();
         qCheck.notify_one();
         return true;
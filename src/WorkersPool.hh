@@ -29,19 +29,66 @@
 #include <map>
 #include <set>
 #include <deque>
+#include <memory>
+#include <atomic>
+#include <functional>
 
 #include "Runnable.hh"
 
 #define IDLE 10
+#define ELASTIC_IDLE 1000 //ms without jobs before an elastic worker is retired
+#define ELASTIC_STEP 10 //ms between consecutive growths of an elastic pool
 
+/*! Scheduling strategies supported by WorkersPool */
+enum SchedulingMode {SM_NONE = -1, SHARED_QUEUE, WORK_STEALING};
+
+/*! Queue of the runnables pending to be executed. Runnables that are not ready
+    yet are kept in a min-heap of timers keyed on Runnable::getTime. A runnable
+    is present at most once, either in the queue or in the timers heap.
+*/
 class TaskQueue {
 public:
     TaskQueue();
     
-    void pushBack(Runnable *run);
+    /**
+     * Adds the runnable to the queue, or to the timers heap if it is not ready
+     * @return true if the runnable was not already queued
+     */
+    bool pushBack(Runnable *run);
     
+    /**
+     * Removes the current runnable from the queue
+     */
     void pop();
     
+    /**
+     * Moves the current runnable from the queue to the timers heap
+     */
+    void defer();
+    
+    /**
+     * Moves the runnables whose time point has expired from the timers heap to the queue
+     */
+    void expireTimers();
+    
+    /**
+     * Gets the earliest time point of the timers heap
+     * @param deadline it is filled with the earliest time point
+     * @return false if there are no timers
+     */
+    bool nextDeadline(std::chrono::system_clock::time_point &deadline) const;
+    
+    /**
+     * Removes the runnable either from the queue or the timers heap
+     * @return false if the runnable was not queued
+     */
+    bool remove(Runnable *run);
+    
+    /**
+     * @return true if there is a queued runnable ready to be executed
+     */
+    bool hasReady();
+    
     void resetIterator();
     
     void clear();
@@ -54,28 +101,269 @@ private:
     std::set<Runnable*, RunnableLess>   sQueue;
     std::deque<Runnable*>             queue;
     std::deque<Runnable*>::iterator    iter;
+    std::vector<Runnable*>            timers;
+};
+
+/*! Scheduling state of a Runnable inside a work-stealing pool. A task is
+    referenced by at most one worker deque at a time. */
+struct StealingTask {
+    enum State {IDLE_TASK, QUEUED, RUNNING, RERUN};
+
+    StealingTask(Runnable *r) : job(r), state(IDLE_TASK), removed(false) {};
+
+    Runnable* const     job;
+    std::atomic<int>    state;
+    bool                removed;
+};
+
+/*! Per worker data of the work-stealing mode. The owner pushes and pops
+    from the back of the deques, thieves take from the front. High priority
+    tasks are kept in their own deque, which is always served first. The next
+    slot holds the task handed off by the last one the worker finished, it is
+    served before the deques of the same priority. */
+struct StealingWorker {
+    StealingWorker() : next(NULL), mtx(WORKER_LOCK), sleeping(false), wakeups(0) {};
+    
+    std::deque<StealingTask*>& jobsOf(const StealingTask *task) {
+        return task->job->getPriority() == HIGH_PRIORITY ? urgentJobs : jobs;
+    };
+
+    std::deque<StealingTask*>                                           urgentJobs;
+    std::deque<StealingTask*>                                           jobs;
+    StealingTask*                                                       next;
+    std::multimap<std::chrono::system_clock::time_point, StealingTask*> delayed;
+    ProfiledMutex                                                       mtx;
+    std::condition_variable                                             cv;
+    std::atomic<bool>                                                   sleeping;
+    unsigned                                                            wakeups;
+};
+
+/*! Long-lived thread executing a single dedicated runnable. It is woken by the
+    same notifications that enable the jobs of the shared workers. */
+struct DedicatedWorker {
+    DedicatedWorker(Runnable *r) : job(r), wakeups(0), removed(false) {};
+    
+    Runnable* const             job;
+    std::thread                 thread;
+    std::mutex                  mtx;
+    std::condition_variable     cv;
+    unsigned                    wakeups;
+    bool                        removed;
+};
+
+/*! Set of independent items split from a running job by WorkersPool::parallelFor.
+    Items are claimed through the next counter, so the calling job and the helping
+    workers never execute the same item twice. */
+struct ForkJoinGroup {
+    ForkJoinGroup(unsigned n, const std::function<void(unsigned)> &f) : 
+        fn(f), items(n), next(0), helpers(0) {};
+    
+    const std::function<void(unsigned)>     &fn;
+    const unsigned                          items;
+    std::atomic<unsigned>                   next;
+    std::atomic<unsigned>                   helpers;
 };
 
 class WorkersPool
 {
 public:
-    WorkersPool(size_t threads = 0);
+    /**
+     * Creates and starts the pool
+     * @param threads number of worker threads, 0 means hardware concurrency based
+     * @param mode scheduling strategy, see SchedulingMode
+     */
+    WorkersPool(size_t threads = 0, SchedulingMode mode = SHARED_QUEUE);
     ~WorkersPool();
         
     bool addTask(Runnable* const runnable);
     bool removeTask(const int id);
     void stop();
     
+    /**
+     * Gets the scheduling mode of the pool
+     * @return the SchedulingMode set at construction
+     */
+    SchedulingMode getMode() const {return mode;};
+    
+    /**
+     * Pins each worker to a single core, round robin over the online cores, or
+     * releases them. While pinned, runnables with a NUMA affinity hint are only 
+     * executed by workers of that node, if there is any.
+     * @param pin true to pin the workers, false to release them
+     * @return false if some worker could not be pinned
+     */
+    bool pinWorkers(bool pin);
+    
+    /**
+     * @return true if workers are pinned to cores
+     */
+    bool isPinned() const {return pinned;};
+    
+    /**
+     * Reserves some workers for high priority runnables. Reserved workers never 
+     * execute normal priority runnables, at least one worker is left for them.
+     * @param n number of reserved workers
+     * @return false if n is not lower than the minimum number of workers
+     */
+    bool reserveWorkers(unsigned n);
+    
+    /**
+     * @return the number of workers reserved for high priority runnables
+     */
+    unsigned getReservedWorkers() const {return reserved;};
+    
+    /**
+     * Sets the execution mode of the runnable, moving it from the shared workers 
+     * to its own thread or back if it is already managed by the pool
+     * @param runnable the runnable to configure
+     * @param dedicated true to execute it in a dedicated thread
+     * @return false if the runnable could not be added back to the pool
+     */
+    bool setDedicated(Runnable* const runnable, bool dedicated);
+    
+    /**
+     * Makes the pool elastic. A worker is added when all of them are busy and there
+     * are ready jobs waiting, and workers are retired after ELASTIC_IDLE ms without jobs.
+     * Only supported by the SHARED_QUEUE mode, other modes keep a fixed number of workers.
+     * @param minThreads minimum number of workers, it must be higher than the reserved ones
+     * @param maxThreads maximum number of workers, it can exceed the default pool size
+     * @return false if the bounds are not valid or the mode is not supported
+     */
+    bool setElastic(size_t minThreads, size_t maxThreads);
+    
+    /**
+     * @return the minimum number of workers of the pool
+     */
+    size_t getMinWorkers() const {return minWorkers;};
+    
+    /**
+     * @return the maximum number of workers of the pool
+     */
+    size_t getMaxWorkers() const {return maxWorkers;};
+    
+    /**
+     * @return the current number of workers of the pool
+     */
+    size_t getActiveWorkers() const {return activeWorkers;};
+    
+    /**
+     * Gets the fraction of time the workers spent processing jobs since the 
+     * previous call (or the pool creation)
+     * @return utilisation between 0 and 1
+     */
+    float getUtilisation();
+    
+    /**
+     * Gets the time the workers spent processing jobs since the pool creation, so each
+     * consumer can measure the utilisation of its own period without resetting getUtilisation
+     * @return busy time in microseconds
+     */
+    int64_t getBusyTime() const {return totalBusyTime;};
+    
+    /**
+     * Executes fn(0) ... fn(items - 1) and returns once all of them are done. The
+     * caller executes items too, so it never waits for a free worker, and idle shared
+     * workers help with the pending ones. Other modes run all the items in the caller.
+     * @param items number of items to execute
+     * @param fn function executing an item, it must be safe to run items concurrently
+     */
+    void parallelFor(unsigned items, const std::function<void(unsigned)> &fn);
+    
+    /**
+     * Sets the hand-off scheduling. A worker that finishes a job then runs the first job it enabled
+     * (the first reader of the frames it wrote) right away, instead of queueing it for any worker, 
+     * so the frames are consumed while they are still in its cache. The other enabled jobs are 
+     * queued as usual, and waiting high priority jobs still go first
+     * @param handOff_ true to enable it
+     */
+    void setHandOff(bool handOff_) {handOff = handOff_;};
+    
+    /**
+     * @return true if the hand-off scheduling is enabled
+     */
+    bool getHandOff() const {return handOff;};
+    
+    /**
+     * @return number of jobs run through a hand-off since the pool creation
+     */
+    uint64_t getHandOffs() const {return handOffs;};
+    
+    /**
+     * Schedules a runnable from a thread out of the pool, e.g. when it has output produced
+     * by its own helper thread. It is not queued again if it is already waiting
+     * @param id id of the runnable
+     */
+    void wakeUp(int id);
+    
+    /**
+     * @return the pool of the calling worker thread, NULL if it is not a pool worker
+     */
+    static WorkersPool* current();
+    
 private:
     bool addJob(int id);
+    bool canRun(unsigned wId, const Runnable *job) const;
+    bool eligible(unsigned wId, const Runnable *job) const;
+    int pickWorker(unsigned wId, const Runnable *job);
+    
+    bool pinWorker(unsigned wId, bool pin);
+    void spawnWorker();
+    bool mustGrow();
+    bool retireWorker(unsigned id, std::chrono::system_clock::time_point lastJob);
+    void addBusyTime(std::chrono::system_clock::time_point start);
+    
+    void sharedQueueLoop(unsigned id);
+    Runnable* nextJob(TaskQueue &q, unsigned id);
+    Runnable* handOffJob(int jId, unsigned id);
+    TaskQueue& queueOf(const Runnable *job);
+    
+    void workStealingLoop(unsigned id);
+    StealingTask* popLocal(unsigned id);
+    StealingTask* steal(unsigned id);
+    int scheduleTask(StealingTask *task, unsigned wId, bool next = false);
+    void finishTask(StealingTask *task, std::vector<int> &enabledJobs, unsigned wId);
+    void wakeIdleWorker(unsigned wId, bool reservedOnes);
+    
+    void dedicatedLoop(DedicatedWorker *worker);
+    bool notifyDedicated(int id);
+    void dispatchJobs(std::vector<int> &enabledJobs);
+    
+    ForkJoinGroup* pendingGroup();
+    static void runItems(ForkJoinGroup *group);
 
 private:
     std::vector<std::thread>    workers;
-    std::mutex                  mtx;
+    ProfiledMutex               mtx;
     std::condition_variable     qCheck;
     std::map<int, Runnable*>    runnables;
     TaskQueue                   queue;
-    bool                        run;
+    TaskQueue                   hQueue;
+    std::atomic<bool>           run;
+    const SchedulingMode        mode;
+    
+    std::vector<std::unique_ptr<StealingWorker>>    stealingWorkers;
+    std::map<int, StealingTask*>                    stealingTasks;
+    unsigned                                        nextWorker;
+    
+    std::vector<std::atomic<int>>                   workersNode;
+    std::atomic<bool>                               pinned;
+    std::atomic<unsigned>                           reserved;
+    std::atomic<bool>                               handOff;
+    std::atomic<uint64_t>                           handOffs;
+    
+    std::map<int, std::unique_ptr<DedicatedWorker>> dedicatedWorkers;
+    std::deque<ForkJoinGroup*>                      forkJoins;
+    
+    const std::vector<unsigned>                     cpus;
+    std::vector<bool>                               alive;
+    std::atomic<size_t>                             activeWorkers;
+    std::atomic<size_t>                             minWorkers;
+    std::atomic<size_t>                             maxWorkers;
+    unsigned                                        busyWorkers;
+    std::atomic<int64_t>                            busyTime;
+    std::atomic<int64_t>                            totalBusyTime;
+    std::chrono::system_clock::time_point           statsStart;
+    std::chrono::system_clock::time_point           lastGrowth;
 };
 
 #endif
\ No newline at end of file
@@ -23,9 +23,12 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <errno.h>
 #include "V4LCapture.hh"
 #include "../../AVFramedQueue.hh"
@@ -38,15 +41,20 @@ static VCodecType codecType(unsigned pixelFormat);
 static unsigned getFormatFromString(std::string format);
 static std::string getStatusAsString(DeviceStatus status);
 
-V4LCapture::V4LCapture() : HeadFilter(1, REGULAR, true), status(CLOSE), forceFormat(true), 
-    frameCount(0), durationCount(std::chrono::microseconds(0))
+V4LCapture::V4LCapture() : HeadFilter(V4L_MAX_DEVICES, REGULAR, false), pool(NULL), zeroCopy(V4L_DEFAULT_ZERO_COPY)
 {
-    oStreamInfo = new StreamInfo (VIDEO);
-    oStreamInfo->video.codec = RAW;
-    oStreamInfo->video.pixelFormat = P_NONE;
+    struct epoll_event event;
     
-    currentTime = std::chrono::high_resolution_clock::now();
-    lastTime = currentTime;
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    
+    CLEAR(event);
+    event.events = EPOLLIN;
+    event.data.u32 = V4L_STOP_EVENT;
+    
+    if (epollFd < 0 || stopFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &event) < 0){
+        utils::errorMsg("Failed creating the capture descriptors");
+    }
     
     fType = V4L_CAPTURE;
     
@@ -55,64 +63,158 @@ V4LCapture::V4LCapture() : HeadFilter(1, REGULAR, true), status(CLOSE), forceFor
 
 V4LCapture::~V4LCapture()
 {
+    uint64_t stop = 1;
+    
+    if (captureThread.joinable()){
+        if (write(stopFd, &stop, sizeof(stop)) < 0){
+            utils::errorMsg("Failed stopping the capture thread");
+        }
+        captureThread.join();
+    }
+    
     releaseDevice();
+    
+    for (auto it : devices){
+        delete it.second;
+    }
+    
+    close(epollFd);
+    close(stopFd);
+}
+
+DriverBuffers::~DriverBuffers()
+{
+    for (auto mapped : buffers){
+        if (munmap(mapped.data, mapped.size) < 0){
+            utils::errorMsg("Failed unmapping buffers!");
+        }
+    }
+}
+
+CaptureDevice::CaptureDevice() : fd(-1), status(CLOSE), forceFormat(true), deviceClock(false), 
+    frameCount(0), frameDuration(std::chrono::microseconds(0)), durationCount(std::chrono::microseconds(0)), 
+    lastPts(std::chrono::microseconds(0)), lentFrames(0), copiedFrames(0), droppedFrames(0)
+{
+    CLEAR(fmt);
+    
+    streamInfo = new StreamInfo(VIDEO);
+    streamInfo->video.codec = RAW;
+    streamInfo->video.pixelFormat = P_NONE;
+}
+
+CaptureDevice::~CaptureDevice()
+{
+    delete streamInfo;
 }
 
 bool V4LCapture::configure(std::string device, unsigned width, unsigned height, unsigned fps, std::string format, bool fFormat)
 {
-    forceFormat = fFormat;
-    switch (status) {
-        case CLOSE:
-            if (!openDevice(device)){
-                return false;
-            }
-        case OPEN:
-            if (!initDevice(width, height, fps, format)){
-                releaseDevice();
-                return false;
-            }
-        case INIT:
-            if (!startCapturing()){
-                releaseDevice();
-                return false;
-            }
-            break;
-        case CAPTURE:
-            if (stopCapturing() && uninitDevice()){
-                return configure(device, width, height, fFormat);
-            }
-            break;
+    return configure(DEFAULT_ID, device, width, height, fps, format, fFormat);
+}
+
+bool V4LCapture::configure(int writerId, std::string device, unsigned width, unsigned height, unsigned fps, 
+                           std::string format, bool fFormat)
+{
+    CaptureDevice* dev;
+    struct epoll_event event;
+    
+    if (writerId < 0 || fps == 0){
+        utils::errorMsg("Invalid writer or frame rate");
+        return false;
     }
     
-    frameDuration = std::chrono::microseconds((int)(std::micro::den/fps));
+    std::lock_guard<std::mutex> guard(devicesMtx);
     
-    return true;
+    if (devices.count(writerId) == 0){
+        if (devices.size() >= V4L_MAX_DEVICES){
+            utils::errorMsg("Maximum number of capture devices reached");
+            return false;
+        }
+        devices[writerId] = new CaptureDevice();
+    }
+    
+    dev = devices[writerId];
+    
+    //NOTE: the driver does not allow changing the format with requested buffers, the device is opened again
+    if (!releaseDevice(dev)){
+        return false;
+    }
+    
+    dev->forceFormat = fFormat;
+    if (!openDevice(dev, device) || !initDevice(dev, width, height, fps, format) || !startCapturing(dev)){
+        releaseDevice(dev);
+        return false;
+    }
+    
+    CLEAR(event);
+    event.events = EPOLLIN;
+    event.data.u32 = writerId;
+    
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, dev->fd, &event) < 0){
+        utils::errorMsg("Failed waiting for " + device);
+        releaseDevice(dev);
+        return false;
+    }
+    
+    dev->frameDuration = std::chrono::microseconds((int)(std::micro::den/fps));
+    dev->frameCount = 0;
+    dev->durationCount = std::chrono::microseconds(0);
+    dev->lastPts = std::chrono::microseconds(0);
+    
+    return startCaptureThread();
 }
 
-bool V4LCapture::specificWriterConfig(int /*writerID*/) 
+bool V4LCapture::specificWriterConfig(int writerID) 
 {
-    if (status == CAPTURE){
+    std::lock_guard<std::mutex> guard(devicesMtx);
+    
+    if (devices.count(writerID) > 0 && devices[writerID]->status == CAPTURE){
         return true;
     }
     
-    utils::warningMsg("The device is not capturing yet! No possible connection");
+    utils::warningMsg("The device of the writer is not capturing yet! No possible connection");
     
     return false;
 };
 
 bool V4LCapture::releaseDevice()
 {
-    switch (status) {
+    bool success = true;
+    
+    std::lock_guard<std::mutex> guard(devicesMtx);
+    
+    for (auto it : devices){
+        success &= releaseDevice(it.second);
+    }
+    
+    return success;
+}
+
+bool V4LCapture::releaseDevice(int writerId)
+{
+    std::lock_guard<std::mutex> guard(devicesMtx);
+    
+    if (devices.count(writerId) == 0){
+        utils::errorMsg("There is no device for writer " + std::to_string(writerId));
+        return false;
+    }
+    
+    return releaseDevice(devices[writerId]);
+}
+
+bool V4LCapture::releaseDevice(CaptureDevice* dev)
+{
+    switch (dev->status) {
         case CAPTURE:
-            if (!stopCapturing()){
+            if (!stopCapturing(dev)){
                 return false;
             }
         case INIT:
-            if (!uninitDevice()){
+            if (!uninitDevice(dev)){
                 return false;
             }
         case OPEN:
-            closeDevice();
+            closeDevice(dev);
         case CLOSE:
             return true;
     }
@@ -120,125 +222,434 @@ bool V4LCapture::releaseDevice()
     return true;
 }
 
-bool V4LCapture::doProcessFrame(std::map<int, Frame*> &dstFrames, int& ret)
-{   
-    VideoFrame* frame = dynamic_cast<VideoFrame*> (dstFrames.begin()->second);
+bool V4LCapture::startCaptureThread()
+{
+    if (captureThread.joinable()){
+        return true;
+    }
     
-    if (!frame || status != CAPTURE){
-        ret = WAIT;
+    if (epollFd < 0 || stopFd < 0){
+        utils::errorMsg("No capture descriptors, the capture thread cannot start");
         return false;
     }
     
-    std::chrono::microseconds diff = std::chrono::duration_cast<std::chrono::microseconds>
-        (std::chrono::high_resolution_clock::now() - wallclock);
+    captureThread = std::thread(&V4LCapture::captureLoop, this);
+    return true;
+}
+
+void V4LCapture::captureLoop()
+{
+    struct epoll_event events[V4L_MAX_DEVICES + 1];
+    CaptureDevice* dev;
+    WorkersPool* wPool;
+    unsigned dequeued;
+    bool run = true;
+    int ready;
+    
+    while (run) {
+        ready = epoll_wait(epollFd, events, V4L_MAX_DEVICES + 1, -1);
+        
+        if (ready < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            utils::errorMsg("Capture wait error, capture stopped");
+            break;
+        }
+        
+        dequeued = 0;
         
-    if (std::abs(diff.count()) > frameDuration.count()/TOLERANCE_FACTOR){
-        utils::warningMsg("Resetting wallclock");
-        wallclock = std::chrono::high_resolution_clock::now();
+        {
+            std::lock_guard<std::mutex> guard(devicesMtx);
+            for (int i = 0; i < ready; i++){
+                if (events[i].data.u32 == V4L_STOP_EVENT){
+                    run = false;
+                    continue;
+                }
+                
+                if (devices.count(events[i].data.u32) == 0 || devices[events[i].data.u32]->status != CAPTURE){
+                    continue;
+                }
+                
+                dev = devices[events[i].data.u32];
+                
+                if (events[i].events & (EPOLLERR | EPOLLHUP)){
+                    utils::warningMsg("Device " + dev->name + " failed, it is not captured anymore");
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, dev->fd, NULL);
+                    continue;
+                }
+                
+                dequeued += dequeueBuffers(dev);
+            }
+        }
+        
+        //NOTE: the filter is not periodic, it is processed when there are pictures to pass
+        wPool = pool.load();
+        if (dequeued > 0 && wPool){
+            wPool->wakeUp(getId());
+        }
     }
+}
+
+unsigned V4LCapture::dequeueBuffers(CaptureDevice* dev)
+{
+    struct v4l2_buffer buf;
+    struct timespec now;
+    CapturedBuffer captured;
+    int64_t age;
+    unsigned count = 0;
     
-    wallclock += frameDuration;
-    
-    if (!getFrame(frameDuration, frame)){
-        frame->setConsumed(false);
-    } else {
-        frame->setConsumed(true);
+    while (true) {
+        CLEAR(buf);
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+
+        if (xioctl(dev->fd, VIDIOC_DQBUF, &buf) < 0) {
+            if (errno != EAGAIN){
+                utils::errorMsg("VIDIOC_DQBUF error");
+            }
+            break;
+        }
+        
+        if (buf.flags & V4L2_BUF_FLAG_ERROR){
+            dev->droppedFrames++;
+            queueBuffer(dev, buf.index);
+            continue;
+        }
+        
+        captured.index = buf.index;
+        captured.bytesUsed = buf.bytesused;
+        captured.pts = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now().time_since_epoch());
+        dev->deviceClock = false;
+        
+        //NOTE: the driver monotonic timestamp gives how long ago the picture was captured, which is 
+        // applied to the pipeline clock. Timestamps of other clocks or too old are not trusted.
+        if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC && 
+            clock_gettime(CLOCK_MONOTONIC, &now) == 0){
+            age = ((int64_t) now.tv_sec - buf.timestamp.tv_sec) * std::micro::den + 
+                now.tv_nsec/1000 - buf.timestamp.tv_usec;
+            
+            if (age >= 0 && age < V4L_MAX_BUFFER_AGE){
+                captured.pts -= std::chrono::microseconds(age);
+                dev->deviceClock = true;
+            }
+        }
+        
+        //NOTE: pictures not passed in time go back to the driver, only the latest ones are kept
+        if (dev->captured.size() >= V4L_MAX_CAPTURED){
+            queueBuffer(dev, dev->captured.front().index);
+            dev->captured.pop_front();
+            dev->droppedFrames++;
+        }
+        
+        dev->captured.push_back(captured);
+        count++;
     }
     
+    return count;
+}
+
+bool V4LCapture::pendingJobs()
+{
+    WorkersPool* current = WorkersPool::current();
     
-    currentTime = std::chrono::high_resolution_clock::now();
-    
-    frame->setPresentationTime(std::chrono::duration_cast<std::chrono::microseconds>(
-        currentTime.time_since_epoch()));
-    frame->setDecodeTime(frame->getPresentationTime());
+    //NOTE: it is checked by the worker after each run, so the capture thread knows the pool to wake up
+    if (current){
+        pool = current;
+    }
     
-    ret = (std::chrono::duration_cast<std::chrono::microseconds> (
-            wallclock - currentTime)).count();
-            
-    if (!frame->getConsumed()){
+    if (stalled()){
         return false;
     }
+    
+    std::lock_guard<std::mutex> guard(devicesMtx);
+    for (auto it : devices){
+        if (it.second->status == CAPTURE && !it.second->captured.empty()){
+            return true;
+        }
+    }
+    
+    return false;
+}
 
-    //NOTE: this is due to buggy driver paranoia, we set the frameDuration to the experimented frameDuration
-    int avgFrameTime =
-        getAvgFrameDuration(std::chrono::duration_cast<std::chrono::microseconds>(currentTime - lastTime));
-    if (std::abs(frameDuration.count() - avgFrameTime) > 
-        frameDuration.count()/(TOLERANCE_FACTOR*2)) {
+bool V4LCapture::doProcessFrame(FrameMap &dstFrames, int& ret)
+{
+    VideoFrame* frame;
+    CaptureDevice* dev;
+    bool written = false;
+    
+    std::lock_guard<std::mutex> guard(devicesMtx);
+    
+    for (auto it : dstFrames){
+        frame = dynamic_cast<VideoFrame*> (it.second);
+        if (!frame){
+            continue;
+        }
+        
+        frame->setConsumed(false);
+        
+        if (devices.count(it.first) == 0 || devices[it.first]->status != CAPTURE){
+            continue;
+        }
         
-        utils::warningMsg("Current fps set to " + std::to_string((float) std::micro::den/avgFrameTime));
-        frameDuration = std::chrono::microseconds(avgFrameTime);
+        dev = devices[it.first];
+        requeueBuffers(dev);
+        
+        if (dev->captured.empty() || !passBuffer(dev, frame)){
+            continue;
+        }
+        
+        frame->setConsumed(true);
+        written = true;
     }
-    lastTime = currentTime;
     
-    return true;
+    ret = 0;
+    
+    return written;
 }
 
 FrameQueue* V4LCapture::allocQueue(ConnectionData cData)
 {
-    if (pixelType(fmt.fmt.pix.pixelformat) == P_NONE){
-        return VideoFrameQueue::createNew(cData, oStreamInfo, DEFAULT_VIDEO_FRAMES);
+    std::lock_guard<std::mutex> guard(devicesMtx);
+    CaptureDevice* dev;
+    
+    if (devices.count(cData.writerId) == 0){
+        return NULL;
+    }
+    
+    dev = devices[cData.writerId];
+    
+    //NOTE: MJPEG pictures are all intra, they are queued as raw pictures are
+    if (pixelType(dev->fmt.fmt.pix.pixelformat) == P_NONE && dev->streamInfo->video.codec != MJPEG){
+        return VideoFrameQueue::createNew(cData, dev->streamInfo, DEFAULT_VIDEO_FRAMES);
     } else {
-        return VideoFrameQueue::createNew(cData, oStreamInfo, DEFAULT_RAW_VIDEO_FRAMES);
+        return VideoFrameQueue::createNew(cData, dev->streamInfo, DEFAULT_RAW_VIDEO_FRAMES);
     }
 }
 
-const bool V4LCapture::getFrame(std::chrono::microseconds timeout, VideoFrame *dstFrame)
+bool V4LCapture::passBuffer(CaptureDevice* dev, VideoFrame* dstFrame)
 {
-    fd_set fds;
-    struct timeval tv;
-    int ret;
-
-    FD_ZERO(&fds);
-    FD_SET(fd, &fds);
+    CapturedBuffer captured = dev->captured.front();
+    unsigned char *src = (unsigned char*) dev->driverBuffers->buffers[captured.index].data;
+    int avgFrameTime;
+    
+    dev->captured.pop_front();
+    
+    if (dev->streamInfo->video.codec != RAW) {
+        if (!copyCoded(dev, dstFrame, src, captured.bytesUsed)) {
+            dev->droppedFrames++;
+            queueBuffer(dev, captured.index);
+            return false;
+        }
+        
+        dev->copiedFrames++;
+        
+        if (!queueBuffer(dev, captured.index)){
+            return false;
+        }
+    //NOTE: a lent buffer is queued again once its frame is released, see requeueBuffers
+    } else if (zeroCopy && lendBuffer(dev, dstFrame, captured.index)) {
+        dev->lentFrames++;
+    } else {
+        copyBuffer(dev, dstFrame, src);
+        dev->copiedFrames++;
+        
+        if (!queueBuffer(dev, captured.index)){
+            return false;
+        }
+    }
+    
+    dstFrame->setPresentationTime(captured.pts);
+    dstFrame->setDecodeTime(captured.pts);
+    
+    //NOTE: this is due to buggy driver paranoia, we set the frameDuration to the experimented frameDuration
+    if (dev->lastPts.count() > 0){
+        avgFrameTime = getAvgFrameDuration(dev, captured.pts - dev->lastPts);
+        if (std::abs(dev->frameDuration.count() - avgFrameTime) > 
+            dev->frameDuration.count()/(TOLERANCE_FACTOR*2)) {
+            
+            utils::warningMsg("Current fps of " + dev->name + " set to " + std::to_string((float) std::micro::den/avgFrameTime));
+            dev->frameDuration = std::chrono::microseconds(avgFrameTime);
+        }
+    }
+    dev->lastPts = captured.pts;
+    
+    return true;
+}
 
-    tv.tv_sec = timeout.count()/std::micro::den;
-    tv.tv_usec = timeout.count()%std::micro::den;
+//NOTE: device planes are contiguous, chroma lines are as wide as the luma ones scaled by the subsampling
+void V4LCapture::copyPlanes(CaptureDevice* dev, VideoFrame *dstFrame, unsigned char *src)
+{
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int lineBytes, rows, lumaBytes = 0;
+    unsigned srcLine;
+    
+    dstFrame->getPlanes(data, linesize);
+    
+    for (unsigned p = 0; VideoFrame::planeSize(dstFrame->getPixelFormat(), dstFrame->getWidth(), 
+            dstFrame->getHeight(), p, lineBytes, rows); p++) {
+        if (p == 0) {
+            lumaBytes = lineBytes;
+        }
+        srcLine = dev->fmt.fmt.pix.bytesperline * lineBytes / lumaBytes;
+        
+        for (int r = 0; r < rows; r++) {
+            memcpy(data[p] + r*linesize[p], src, lineBytes);
+            src += srcLine;
+        }
+    }
+}
 
-    ret = select(fd + 1, &fds, NULL, NULL, &tv);
+void V4LCapture::copyBuffer(CaptureDevice* dev, VideoFrame *dstFrame, unsigned char *src)
+{
+    dstFrame->fitBuffer(dev->fmt.fmt.pix.width, dev->fmt.fmt.pix.height, dev->streamInfo->video.pixelFormat);
+    
+    if (dstFrame->isPlanar()) {
+        copyPlanes(dev, dstFrame, src);
+    } else {
+        memcpy(dstFrame->getDataBuf(), src, dev->fmt.fmt.pix.height * dev->fmt.fmt.pix.bytesperline);
+    }
+}
 
-    if (ret < 0) {
-        utils::errorMsg("Select error");
+//NOTE: the driver gives the length of each coded picture, the frame is as long as it
+bool V4LCapture::copyCoded(CaptureDevice* dev, VideoFrame *dstFrame, unsigned char *src, unsigned length)
+{
+    if (length == 0 || length > dstFrame->getMaxLength()) {
+        utils::warningMsg("Coded picture of " + dev->name + " does not fit the frame, discarded");
         return false;
     }
+    
+    memcpy(dstFrame->getDataBuf(), src, length);
+    dstFrame->setLength(length);
+    dstFrame->setSize(dev->fmt.fmt.pix.width, dev->fmt.fmt.pix.height);
+    
+    return true;
+}
 
-    if (ret == 0) {
-        utils::warningMsg("Select timeout");
+bool V4LCapture::lendBuffer(CaptureDevice* dev, VideoFrame *dstFrame, unsigned index)
+{
+    std::shared_ptr<DriverBuffers> shared = dev->driverBuffers;
+    std::shared_ptr<void> owner;
+    PlanarVideoFrame *planarFrame = dynamic_cast<PlanarVideoFrame*>(dstFrame);
+    InterleavedVideoFrame *interleavedFrame = dynamic_cast<InterleavedVideoFrame*>(dstFrame);
+    PixType pixFmt = dev->streamInfo->video.pixelFormat;
+    unsigned width = dev->fmt.fmt.pix.width;
+    unsigned height = dev->fmt.fmt.pix.height;
+    unsigned char *start = (unsigned char*) shared->buffers[index].data;
+    unsigned char *src = start;
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int lineBytes, rows, lumaBytes = 0;
+    bool planar = VideoFrame::isPlanarFormat(pixFmt);
+    
+    if (pixFmt == P_NONE || (planar && !planarFrame) || (!planar && !interleavedFrame)) {
         return false;
     }
-
-    return readFrame(dstFrame);
+    
+    for (unsigned p = 0; p < MAX_PLANES; p++) {
+        data[p] = NULL;
+        linesize[p] = 0;
+    }
+    
+    //NOTE: the device layout has to be the frame one, aligned planes or packed lines
+    for (unsigned p = 0; VideoFrame::planeSize(pixFmt, width, height, p, lineBytes, rows); p++) {
+        if (p == 0) {
+            lumaBytes = lineBytes;
+        }
+        data[p] = src;
+        linesize[p] = dev->fmt.fmt.pix.bytesperline * lineBytes / lumaBytes;
+        src += linesize[p] * rows;
+        
+        if (planar && (linesize[p] < lineBytes || linesize[p] % FRAME_ALIGNMENT != 0 || 
+            ((uintptr_t) data[p]) % FRAME_ALIGNMENT != 0)) {
+            return false;
+        }
+        
+        if (!planar && linesize[p] != lineBytes) {
+            return false;
+        }
+    }
+    
+    if (src > start + shared->buffers[index].size) {
+        return false;
+    }
+    
+    {
+        std::lock_guard<std::mutex> guard(shared->mtx);
+        if (shared->lent + V4L_DRIVER_BUFFERS >= shared->buffers.size()) {
+            return false;
+        }
+        shared->lent++;
+    }
+    
+    //NOTE: frames may be released from any thread, the buffer is only queued again by the filter
+    owner = std::shared_ptr<void>(start, [shared, index](void*) {
+        std::lock_guard<std::mutex> guard(shared->mtx);
+        shared->released.push_back(index);
+    });
+    
+    if (planar && planarFrame->setExternalPlanes(width, height, pixFmt, data, linesize, owner)) {
+        return true;
+    }
+    
+    if (!planar && interleavedFrame->setExternalBuffer(width, height, pixFmt, start, owner)) {
+        return true;
+    }
+    
+    //NOTE: the buffer goes back to the driver once the owner is dropped
+    copyBuffer(dev, dstFrame, start);
+    return true;
 }
 
-bool V4LCapture::readFrame(VideoFrame *dstFrame)
+bool V4LCapture::queueBuffer(CaptureDevice* dev, unsigned index)
 {
-
     struct v4l2_buffer buf;
-
+    
     CLEAR(buf);
-
     buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     buf.memory = V4L2_MEMORY_MMAP;
-
-    if (xioctl(fd, VIDIOC_DQBUF, &buf) < 0) {
+    buf.index = index;
+    
+    if (xioctl(dev->fd, VIDIOC_QBUF, &buf) < 0){
+        utils::errorMsg("VIDIOC_QBUF error");
         return false;
     }
     
-    memcpy(dstFrame->getDataBuf(), buffers[buf.index].data, 
-               fmt.fmt.pix.height * fmt.fmt.pix.bytesperline);
-    dstFrame->setSize(fmt.fmt.pix.width, fmt.fmt.pix.height);
-    dstFrame->setPixelFormat(oStreamInfo->video.pixelFormat);
+    return true;
+}
+
+bool V4LCapture::requeueBuffers(CaptureDevice* dev)
+{
+    std::vector<unsigned> released;
+    bool success = true;
     
-    if (xioctl(fd, VIDIOC_QBUF, &buf) < 0){
+    if (!dev->driverBuffers) {
         return false;
     }
-
-    return true;
+    
+    {
+        std::lock_guard<std::mutex> guard(dev->driverBuffers->mtx);
+        released.swap(dev->driverBuffers->released);
+    }
+    
+    for (auto index : released) {
+        success &= queueBuffer(dev, index);
+    }
+    
+    {
+        std::lock_guard<std::mutex> guard(dev->driverBuffers->mtx);
+        dev->driverBuffers->lent -= released.size();
+    }
+    
+    return success;
 }
 
-bool V4LCapture::openDevice(std::string device)
+bool V4LCapture::openDevice(CaptureDevice* dev, std::string device)
 {
       struct stat st;
-      if (status != CLOSE){
+      if (dev->status != CLOSE){
           return false;
       }
 
@@ -252,95 +663,97 @@ bool V4LCapture::openDevice(std::string device)
             return false;
       }
 
-      fd = open(device.c_str(), O_RDWR | O_NONBLOCK, 0);
+      dev->fd = open(device.c_str(), O_RDWR | O_NONBLOCK, 0);
 
-      if (fd < 0) {
+      if (dev->fd < 0) {
             utils::errorMsg("Cannot open " + device);
             return false;
       }
       
-      status = OPEN;
+      dev->name = device;
+      dev->status = OPEN;
       return true;
 }
 
-bool V4LCapture::init_mmap(void)
+bool V4LCapture::init_mmap(CaptureDevice* dev)
 {
       struct v4l2_requestbuffers req;
 
       CLEAR(req);
 
-      req.count = 4;
+      //NOTE: lent buffers may wait in the output queue, there are buffers enough for all its frames. Coded pictures are never lent
+      req.count = zeroCopy && dev->streamInfo->video.codec == RAW ? V4L_ZERO_COPY_BUFFERS : V4L_BUFFERS;
       req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
       req.memory = V4L2_MEMORY_MMAP;
 
-      if (xioctl(fd, VIDIOC_REQBUFS, &req) < 0) {
+      if (xioctl(dev->fd, VIDIOC_REQBUFS, &req) < 0) {
           utils::errorMsg("Failed requesting v4l buffers");
           return false;
       }
 
       if (req.count < 2) {
-          utils::errorMsg("Insuficient memory on ");
+          utils::errorMsg("Insuficient memory on " + dev->name);
           return false;
       }
 
-      buffers = (buffer*) calloc(req.count, sizeof(*buffers));
-
-      if (!buffers) {
-          utils::errorMsg("Out of memory");
-          return false;
-      }
+      dev->driverBuffers = std::make_shared<DriverBuffers>();
+      dev->driverBuffers->lent = 0;
 
-      for (n_buffers = 0; n_buffers < req.count; ++n_buffers) {
+      for (unsigned i = 0; i < req.count; ++i) {
             struct v4l2_buffer buf;
+            struct buffer mapped;
 
             CLEAR(buf);
 
             buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
             buf.memory      = V4L2_MEMORY_MMAP;
-            buf.index       = n_buffers;
+            buf.index       = i;
 
-            if (xioctl(fd, VIDIOC_QUERYBUF, &buf) < 0){
+            if (xioctl(dev->fd, VIDIOC_QUERYBUF, &buf) < 0){
                 utils::errorMsg("Failed requesting v4l buffers");
                 return false;
             }
 
-            buffers[n_buffers].size = buf.length;
-            buffers[n_buffers].data =
+            mapped.size = buf.length;
+            mapped.data =
                   mmap(NULL,
                         buf.length,
                         PROT_READ | PROT_WRITE,
                         MAP_SHARED,
-                        fd, buf.m.offset);
+                        dev->fd, buf.m.offset);
 
-            if (MAP_FAILED == buffers[n_buffers].data){
+            if (MAP_FAILED == mapped.data){
                   utils::errorMsg("Mmap failed");
                   return false;
             }
+
+            dev->driverBuffers->buffers.push_back(mapped);
       }
       
       return true;
 }
 
-void V4LCapture::closeDevice(void)
+void V4LCapture::closeDevice(CaptureDevice* dev)
 {
-    if (status != OPEN){
+    if (dev->status != OPEN){
         return;
     }
-    if (close(fd) < 0){
+    if (close(dev->fd) < 0){
         utils::errorMsg("Failed closing file descriptor");
     }
-    fd = -1;
-    status = CLOSE;
+    dev->fd = -1;
+    dev->status = CLOSE;
 }
 
-bool V4LCapture::initDevice(unsigned& xres, unsigned& yres, unsigned& den, std::string &format)
+bool V4LCapture::initDevice(CaptureDevice* dev, unsigned& xres, unsigned& yres, unsigned& den, std::string &format)
 {
     struct v4l2_capability cap;
     struct v4l2_cropcap cropcap;
     struct v4l2_crop crop;
     struct v4l2_streamparm fps;
+    int fd = dev->fd;
     
-    if (status != OPEN){
+    if (dev->status != OPEN){
         return false;
     }
     
@@ -370,52 +783,54 @@ bool V4LCapture::initDevice(unsigned& xres, unsigned& yres, unsigned& den, std::
         xioctl(fd, VIDIOC_S_CROP, &crop);
     }
     
-    CLEAR(fmt);
+    CLEAR(dev->fmt);
 
-    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    dev->fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     
-    if (forceFormat) {
-        fmt.fmt.pix.width       = xres;
-        fmt.fmt.pix.height      = yres;
-        fmt.fmt.pix.pixelformat = getFormatFromString(format);
-        fmt.fmt.pix.field       = V4L2_FIELD_INTERLACED;
+    if (dev->forceFormat) {
+        dev->fmt.fmt.pix.width       = xres;
+        dev->fmt.fmt.pix.height      = yres;
+        dev->fmt.fmt.pix.pixelformat = getFormatFromString(format);
+        dev->fmt.fmt.pix.field       = V4L2_FIELD_INTERLACED;
         
-        if (xioctl(fd, VIDIOC_S_FMT, &fmt) < 0){
+        if (xioctl(fd, VIDIOC_S_FMT, &dev->fmt) < 0){
             utils::errorMsg("Error setting format");
             return false;
         }
 
-        if (fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV){
+        if (dev->fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV){
             utils::warningMsg("Webcam does not support YUYV format!");
         }
 
-        if (fmt.fmt.pix.width != xres || fmt.fmt.pix.height != yres){
+        if (dev->fmt.fmt.pix.width != xres || dev->fmt.fmt.pix.height != yres){
             utils::warningMsg("Requested resolution could not be set, is set to: \n\t\t" 
-                + std::to_string(fmt.fmt.pix.width) + " xres\n\t\t"
-                + std::to_string(fmt.fmt.pix.height) + " yres");
-            xres = fmt.fmt.pix.width;
-            yres = fmt.fmt.pix.height;
+                + std::to_string(dev->fmt.fmt.pix.width) + " xres\n\t\t"
+                + std::to_string(dev->fmt.fmt.pix.height) + " yres");
+            xres = dev->fmt.fmt.pix.width;
+            yres = dev->fmt.fmt.pix.height;
         }
         
-        if (fmt.fmt.pix.pixelformat != getFormatFromString(format)){
-            if (pixelType(fmt.fmt.pix.pixelformat) != P_NONE){
-                format = utils::getPixTypeAsString(pixelType(fmt.fmt.pix.pixelformat));
+        if (dev->fmt.fmt.pix.pixelformat != getFormatFromString(format)){
+            if (pixelType(dev->fmt.fmt.pix.pixelformat) != P_NONE){
+                format = utils::getPixTypeAsString(pixelType(dev->fmt.fmt.pix.pixelformat));
             } else {
-                format = utils::getVideoCodecAsString(codecType(fmt.fmt.pix.pixelformat));
+                format = utils::getVideoCodecAsString(codecType(dev->fmt.fmt.pix.pixelformat));
             }
             utils::warningMsg("Could not set pixel format, set to " + format);
         }
         
     } else {    
-        if (xioctl(fd, VIDIOC_G_FMT, &fmt) < 0){
+        if (xioctl(fd, VIDIOC_G_FMT, &dev->fmt) < 0){
             utils::errorMsg("Error setting format");
             return false;
         }
     }
     
-    oStreamInfo->video.pixelFormat = pixelType(fmt.fmt.pix.pixelformat);
-    if (oStreamInfo->video.pixelFormat == P_NONE){
-        oStreamInfo->video.codec = codecType(fmt.fmt.pix.pixelformat);
+    dev->streamInfo->video.pixelFormat = pixelType(dev->fmt.fmt.pix.pixelformat);
+    if (dev->streamInfo->video.pixelFormat == P_NONE){
+        dev->streamInfo->video.codec = codecType(dev->fmt.fmt.pix.pixelformat);
+    } else {
+        dev->streamInfo->video.codec = RAW;
     }
     
     CLEAR(fps);
@@ -434,119 +849,141 @@ bool V4LCapture::initDevice(unsigned& xres, unsigned& yres, unsigned& den, std::
             + std::to_string(fps.parm.capture.timeperframe.denominator));
         den = fps.parm.capture.timeperframe.denominator;
     }
+    
+    if (den == 0){
+        utils::errorMsg("Invalid frame rate set by the device");
+        return false;
+    }
 
-    if (!init_mmap()){
+    if (!init_mmap(dev)){
         return false;
     }
     
-    status = INIT;
+    dev->status = INIT;
     
     return true;
 }
 
-bool V4LCapture::uninitDevice(void)
+bool V4LCapture::uninitDevice(CaptureDevice* dev)
 {
-    if (status != INIT){
+    if (dev->status != INIT){
         return false;
     }
 
-    for (unsigned i = 0; i < n_buffers; ++i){
-        if (munmap(buffers[i].data, buffers[i].size) < 0){
-            utils::errorMsg("Failed unmapping buffers!");
-            return false;
-        }
-    }
+    //NOTE: buffers still lent to frames are unmapped once the pipeline releases them
+    dev->driverBuffers.reset();
 
-    CLEAR(fmt);
-    free(buffers);
-    status = OPEN;
+    CLEAR(dev->fmt);
+    dev->status = OPEN;
     return true;
 }
 
-bool V4LCapture::startCapturing(void)
+bool V4LCapture::startCapturing(CaptureDevice* dev)
 {
     enum v4l2_buf_type type;
     
-    if (status != INIT){
+    if (dev->status != INIT){
         return false;
     }
 
-    for (unsigned i = 0; i < n_buffers; ++i) {
-        struct v4l2_buffer buf;
-
-        CLEAR(buf);
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
-
-        if (xioctl(fd, VIDIOC_QBUF, &buf) < 0){
-            utils::errorMsg("VIDIOC_QBUF error");
+    for (unsigned i = 0; i < dev->driverBuffers->buffers.size(); ++i) {
+        if (!queueBuffer(dev, i)){
             return false;
         }
     }
     
     type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (xioctl(fd, VIDIOC_STREAMON, &type) < 0){
+    if (xioctl(dev->fd, VIDIOC_STREAMON, &type) < 0){
         utils::errorMsg("VIDIOC_STREAMON error");
         return false;
     }
     
-    status = CAPTURE;
+    dev->status = CAPTURE;
     
     return true;
 }
 
-bool V4LCapture::stopCapturing(void)
+bool V4LCapture::stopCapturing(CaptureDevice* dev)
 {
     enum v4l2_buf_type type;
     
-    if (status != CAPTURE){
+    if (dev->status != CAPTURE){
         return false;
     }
+    
+    //NOTE: it may be already removed if the device failed
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, dev->fd, NULL);
 
     type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (xioctl(fd, VIDIOC_STREAMOFF, &type) < 0){
+    if (xioctl(dev->fd, VIDIOC_STREAMOFF, &type) < 0){
         utils::errorMsg("VIDIOC_STREAMOFF");
         return false;
     }
     
-    status = INIT;
+    //NOTE: streaming off takes back all the buffers from the driver
+    dev->captured.clear();
+    dev->status = INIT;
     
     return true;
 }
 
-int V4LCapture::getAvgFrameDuration(std::chrono::microseconds duration)
+int V4LCapture::getAvgFrameDuration(CaptureDevice* dev, std::chrono::microseconds duration)
 {
-    if (frameCount <= FRAME_AVG_COUNT){
-        if (frameCount > 0){
-            durationCount += duration;
+    if (dev->frameCount <= FRAME_AVG_COUNT){
+        if (dev->frameCount > 0){
+            dev->durationCount += duration;
         }
-        frameCount++;
-        return frameDuration.count();
+        dev->frameCount++;
+        return dev->frameDuration.count();
     }
     
-    durationCount -= durationCount/FRAME_AVG_COUNT;
-    durationCount += duration;
-    return (durationCount/FRAME_AVG_COUNT).count();
+    dev->durationCount -= dev->durationCount/FRAME_AVG_COUNT;
+    dev->durationCount += duration;
+    return (dev->durationCount/FRAME_AVG_COUNT).count();
 }
 
 void V4LCapture::doGetState(Jzon::Object &filterNode)
 {
-    filterNode.Add("status", getStatusAsString(status));
+    Jzon::Array devList;
+    CaptureDevice* dev;
     
-    if (status == CAPTURE){
-        filterNode.Add("device", device);
-        filterNode.Add("width", (int) fmt.fmt.pix.width);
-        filterNode.Add("height", (int) fmt.fmt.pix.height);
-        filterNode.Add("fps", (int) (std::micro::den/frameDuration.count()));
-        if (pixelType(fmt.fmt.pix.pixelformat) != P_NONE){
-            filterNode.Add("format", utils::getPixTypeAsString(pixelType(fmt.fmt.pix.pixelformat)));
-        } else if (codecType(fmt.fmt.pix.pixelformat) != VC_NONE){
-            filterNode.Add("format", utils::getVideoCodecAsString(codecType(fmt.fmt.pix.pixelformat)));
-        } else {
-            filterNode.Add("format","unknown format");
+    std::lock_guard<std::mutex> guard(devicesMtx);
+    
+    for (auto it : devices){
+        Jzon::Object devNode;
+        dev = it.second;
+        
+        devNode.Add("writer", it.first);
+        devNode.Add("status", getStatusAsString(dev->status));
+        
+        if (dev->status == CAPTURE){
+            devNode.Add("device", dev->name);
+            devNode.Add("width", (int) dev->fmt.fmt.pix.width);
+            devNode.Add("height", (int) dev->fmt.fmt.pix.height);
+            devNode.Add("fps", (int) (std::micro::den/dev->frameDuration.count()));
+            if (pixelType(dev->fmt.fmt.pix.pixelformat) != P_NONE){
+                devNode.Add("format", utils::getPixTypeAsString(pixelType(dev->fmt.fmt.pix.pixelformat)));
+            } else if (codecType(dev->fmt.fmt.pix.pixelformat) != VC_NONE){
+                devNode.Add("format", utils::getVideoCodecAsString(codecType(dev->fmt.fmt.pix.pixelformat)));
+            } else {
+                devNode.Add("format","unknown format");
+            }
+            devNode.Add("deviceClock", dev->deviceClock);
         }
+        
+        devNode.Add("lentFrames", (int) dev->lentFrames);
+        devNode.Add("copiedFrames", (int) dev->copiedFrames);
+        devNode.Add("droppedFrames", (int) dev->droppedFrames);
+        if (dev->driverBuffers){
+            std::lock_guard<std::mutex> bGuard(dev->driverBuffers->mtx);
+            devNode.Add("lentBuffers", (int) dev->driverBuffers->lent);
+        }
+        
+        devList.Add(devNode);
     }
+    
+    filterNode.Add("devices", devList);
+    filterNode.Add("zeroCopy", zeroCopy);
 }
 
 bool V4LCapture::configureEvent(Jzon::Node* params)
@@ -560,11 +997,18 @@ bool V4LCapture::configureEvent(Jzon::Node* params)
     if (!params->Get("width").IsNumber() || 
         !params->Get("height").IsNumber() ||
         !params->Get("fps").IsNumber() ||
-        (params->Has("forceformat") && !params->Get("forceformat").IsBool())) {
+        (params->Has("writer") && !params->Get("writer").IsNumber()) ||
+        (params->Has("forceformat") && !params->Get("forceformat").IsBool()) ||
+        (params->Has("zerocopy") && !params->Get("zerocopy").IsBool())) {
         return false;
     }
     
-    return configure(params->Get("device").ToString(), 
+    if (params->Has("zerocopy")) {
+        setZeroCopy(params->Get("zerocopy").ToBool());
+    }
+    
+    return configure(params->Has("writer") ? params->Get("writer").ToInt() : DEFAULT_ID,
+              params->Get("device").ToString(), 
               params->Get("width").ToInt(), 
               params->Get("height").ToInt(),
               params->Get("fps").ToInt(), 
@@ -572,9 +1016,19 @@ bool V4LCapture::configureEvent(Jzon::Node* params)
               params->Has("forceformat") ? params->Get("forceformat").ToBool() : true);    
 }
 
+bool V4LCapture::releaseEvent(Jzon::Node* params)
+{
+    if (!params->Has("writer") || !params->Get("writer").IsNumber()) {
+        return false;
+    }
+    
+    return releaseDevice(params->Get("writer").ToInt());
+}
+
 void V4LCapture::initializeEventMap()
 {
     eventMap["configure"] = std::bind(&V4LCapture::configureEvent, this, std::placeholders::_1);
+    eventMap["release"] = std::bind(&V4LCapture::releaseEvent, this, std::placeholders::_1);
 }
 
 static int xioctl(int fh, unsigned long int request, void *arg)
@@ -26,81 +26,185 @@
 
 #include <string>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <vector>
 #include <linux/videodev2.h>
 
 #include "../../Utils.hh"
 #include "../../VideoFrame.hh"
 #include "../../StreamInfo.hh"
 #include "../../Filter.hh"
+#include "../../WorkersPool.hh"
 
 #define TOLERANCE_FACTOR 64
 #define FRAME_AVG_COUNT 128
+#define V4L_BUFFERS 4                                       //!< Driver buffers when frames are copied
+#define V4L_ZERO_COPY_BUFFERS (DEFAULT_RAW_VIDEO_FRAMES + 4)  //!< Driver buffers when they are lent to the frames
+#define V4L_DRIVER_BUFFERS 2                                //!< Buffers always left to the driver, frames are copied instead
+#define V4L_DEFAULT_ZERO_COPY true
+#define V4L_MAX_DEVICES 8                                   //!< Devices captured by a filter, one per writer
+#define V4L_MAX_CAPTURED 2                                  //!< Captured buffers waiting for the filter, older ones go back to the driver
+#define V4L_MAX_BUFFER_AGE 1000000                          //!< Older buffer timestamps in usec are not trusted, the dequeue time is used
+#define V4L_STOP_EVENT 0xFFFFFFFF                           //!< Event data of the descriptor stopping the capture thread
 
 struct buffer {
       void   *data;
       size_t  size;
 };
 
+/*! Mapped driver buffers, shared with the frames they are lent to. A frame gives its buffer back
+    when its picture is released, the capture queues it again to the driver afterwards. The mappings
+    are kept until the last frame using them is done, even if the device is closed meanwhile.
+*/
+struct DriverBuffers {
+    ~DriverBuffers();
+
+    std::vector<buffer> buffers;
+    std::vector<unsigned> released;         //!< Buffers given back by the frames, to be queued again
+    unsigned lent;                          //!< Buffers not yet queued again to the driver
+    std::mutex mtx;
+};
+
+/*! Driver buffer dequeued by the capture thread, waiting to be passed on by the filter */
+struct CapturedBuffer {
+    unsigned index;
+    unsigned bytesUsed;                     //!< Picture bytes, the length of coded pictures
+    std::chrono::microseconds pts;          //!< Capture instant in the pipeline clock
+};
+
 enum DeviceStatus {OPEN, INIT, CAPTURE, CLOSE};
 
+/*! A capture device, its frames are written by the filter writer with the same ID */
+struct CaptureDevice {
+    CaptureDevice();
+    ~CaptureDevice();
+
+    std::string name;
+    int fd;
+    DeviceStatus status;
+    bool forceFormat;
+    struct v4l2_format fmt;
+    StreamInfo* streamInfo;
+    std::shared_ptr<DriverBuffers> driverBuffers;
+    std::deque<CapturedBuffer> captured;
+    bool deviceClock;                       //!< Buffers are timestamped by the driver monotonic clock
+
+    unsigned frameCount;
+    std::chrono::microseconds frameDuration;
+    std::chrono::microseconds durationCount;
+    std::chrono::microseconds lastPts;
+
+    size_t lentFrames;
+    size_t copiedFrames;
+    size_t droppedFrames;
+};
+
+/*! HeadFilter capturing from V4L2 devices through mapped driver buffers, each device has its own writer.
+    A single capture thread waits for all the devices with epoll and dequeues their buffers, waking the
+    filter up, so pool workers never wait for a device. Frames are timestamped with the capture instant
+    given by the driver monotonic clock, mapped to the pipeline clock, so cameras capturing at the same
+    time get the same timestamps whatever the scheduling delays are.
+    Coded pictures (e.g. MJPEG of high frame rate USB cameras) are copied as they are, one picture per frame,
+    to be decoded downstream (see VideoDecoderLibav, which decodes them in hardware when configured so).
+    Raw pictures are passed on in the driver buffers themselves (see PlanarVideoFrame::setExternalPlanes
+    and InterleavedVideoFrame::setExternalBuffer), which are queued again to the driver once the pipeline
+    releases their frames. Frames are copied when the layout of the device does not allow it, when zero
+    copy is disabled or when only V4L_DRIVER_BUFFERS buffers are left to the driver.
+*/
 class V4LCapture : public HeadFilter {
 
 public:
     V4LCapture();
     ~V4LCapture();
     
+    /**
+    * Configures the device of the default writer, see configure
+    */
     bool configure(std::string device, unsigned width, unsigned height, unsigned fps, std::string format = "YUYV", bool fFormat = true);
+    
+    /**
+    * Opens a device and starts capturing from it, a device already captured by the writer is configured again
+    * @param writerId writer outputting the frames of the device
+    * @param device device path, i.e. /dev/video0
+    * @param width requested horizontal resolution
+    * @param height requested vertical resolution
+    * @param fps requested frame rate
+    * @param format requested pixel format or codec
+    * @param fFormat false to keep the current device format
+    * @return false if the device cannot be opened or configured
+    */
+    bool configure(int writerId, std::string device, unsigned width, unsigned height, unsigned fps, 
+                   std::string format = "YUYV", bool fFormat = true);
+    
+    /**
+    * Stops capturing from all the devices and closes them
+    */
     bool releaseDevice();
+    
+    /**
+    * Stops capturing from the device of a writer and closes it
+    * @param writerId writer of the device
+    */
+    bool releaseDevice(int writerId);
+    
+    /**
+    * Enables or disables passing the captured pictures in the driver buffers, it applies to the next
+    * configured capture
+    * @param zeroCopy false to copy each picture to the frame
+    */
+    void setZeroCopy(bool zeroCopy_) {zeroCopy = zeroCopy_;};
 
 private:
-    bool doProcessFrame(std::map<int, Frame*> &dstFrames, int& ret);
+    bool doProcessFrame(FrameMap &dstFrames, int& ret);
     FrameQueue *allocQueue(ConnectionData cData);
-    
+    bool pendingJobs();
+
     void doGetState(Jzon::Object &filterNode);
     void initializeEventMap();
     bool configureEvent(Jzon::Node* params);
+    bool releaseEvent(Jzon::Node* params);
 
-    bool specificWriterConfig(int /*writerID*/);
+    bool specificWriterConfig(int writerID);
     bool specificWriterDelete(int /*writerID*/) {return true;};
     
-    const bool getFrame(std::chrono::microseconds timeout, VideoFrame *dstFrame);
+    bool init_mmap(CaptureDevice* dev);
+
+    bool openDevice(CaptureDevice* dev, std::string device);
+    void closeDevice(CaptureDevice* dev);
+
+    bool initDevice(CaptureDevice* dev, unsigned& xres, unsigned& yres, unsigned &den, std::string &format);
+    bool uninitDevice(CaptureDevice* dev);
+
+    bool startCapturing(CaptureDevice* dev);
+    bool stopCapturing(CaptureDevice* dev);
+    bool releaseDevice(CaptureDevice* dev);
+
+    void captureLoop();
+    bool startCaptureThread();
+    unsigned dequeueBuffers(CaptureDevice* dev);
+    bool passBuffer(CaptureDevice* dev, VideoFrame* dstFrame);
+    void copyBuffer(CaptureDevice* dev, VideoFrame *dstFrame, unsigned char *src);
+    bool copyCoded(CaptureDevice* dev, VideoFrame *dstFrame, unsigned char *src, unsigned length);
+    void copyPlanes(CaptureDevice* dev, VideoFrame *dstFrame, unsigned char *src);
+    bool lendBuffer(CaptureDevice* dev, VideoFrame *dstFrame, unsigned index);
+    bool queueBuffer(CaptureDevice* dev, unsigned index);
+    bool requeueBuffers(CaptureDevice* dev);
     
-    bool init_mmap();
-
-    bool openDevice(std::string device);
-    void closeDevice();
-
-    bool initDevice(unsigned& xres, unsigned& yres, unsigned &den, std::string &format);
-    bool uninitDevice();
-
-    bool startCapturing();
-    bool stopCapturing();
+    int getAvgFrameDuration(CaptureDevice* dev, std::chrono::microseconds duration);
 
-    bool readFrame(VideoFrame* dstFrame);
+    std::map<int, CaptureDevice*> devices;
+    std::mutex devicesMtx;                  //!< Guards the devices, also against the capture thread
     
-    int getAvgFrameDuration(std::chrono::microseconds duration);
+    int epollFd;
+    int stopFd;
+    std::thread captureThread;
+    std::atomic<WorkersPool*> pool;
 
-    StreamInfo* oStreamInfo;
-    
-    std::string device;
-    
-    struct v4l2_format fmt;
-    DeviceStatus status;
-    
-    int fd;
-
-    struct buffer   *buffers;
-    unsigned        n_buffers;
-
-    bool forceFormat;
-    
-    unsigned frameCount;
-    
-    std::chrono::microseconds frameDuration;
-    std::chrono::microseconds durationCount;
-    std::chrono::high_resolution_clock::time_point wallclock;
-    std::chrono::high_resolution_clock::time_point currentTime;
-    std::chrono::high_resolution_clock::time_point lastTime;
+    bool zeroCopy;
 };
 
 #endif
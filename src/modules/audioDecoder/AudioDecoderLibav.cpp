@@ -22,7 +22,9 @@
 
 #include "AudioDecoderLibav.hh"
 #include "../../AudioCircularBuffer.hh"
+#include "../../SampleConverter.hh"
 #include "../../Utils.hh"
+#include "../../AsyncLog.hh"
 #include <functional>
 #include <fstream>
 
@@ -48,7 +50,7 @@ AVSampleFormat getAVSampleFormatFromtIntCode(int id)
 }
 
 AudioDecoderLibav::AudioDecoderLibav()
-: OneToOneFilter()
+: OneToOneFilterT()
 {
     avcodec_register_all();
 
@@ -65,6 +67,11 @@ AudioDecoderLibav::AudioDecoderLibav()
     inSampleRate = 0;
     inFrame = av_frame_alloc();
     inLibavSampleFmt = AV_SAMPLE_FMT_NONE;
+    inSampleFmt = S_NONE;
+    
+    resampleDirty = false;
+    conversionTime = std::chrono::nanoseconds(0);
+    conversions = 0;
 
     initializeEventMap();
 
@@ -86,15 +93,13 @@ FrameQueue* AudioDecoderLibav::allocQueue(ConnectionData cData)
                                             outSampleFmt);
 }
 
-bool AudioDecoderLibav::doProcessFrame(Frame *org, Frame *dst)
+bool AudioDecoderLibav::doProcessFrame(AudioFrame *org, AudioFrame *dst)
 {
     int len, gotFrame;
+    std::chrono::steady_clock::time_point start;
 
-    AudioFrame* aCodedFrame = dynamic_cast<AudioFrame*>(org);
-    AudioFrame* aDecodedFrame = dynamic_cast<AudioFrame*>(dst);
-
-    if (!reconfigureDecoder(aCodedFrame)) {
-        utils::errorMsg("Error reconfiguring decoder: check input frame params");
+    if (!reconfigureDecoder(org)) {
+        ERROR_MSG("Error reconfiguring decoder: check input frame params");
         return false;
     }
 
@@ -102,7 +107,7 @@ bool AudioDecoderLibav::doProcessFrame(Frame *org, Frame *dst)
     pkt.data = org->getDataBuf();
 
     if (pkt.size <= 0) {
-        utils::errorMsg("Error decoding audio frame: pkt.size <= 0");
+        ERROR_MSG("Error decoding audio frame: pkt.size <= 0");
         return false;
     }   
 
@@ -110,7 +115,7 @@ bool AudioDecoderLibav::doProcessFrame(Frame *org, Frame *dst)
         len = avcodec_decode_audio4(codecCtx, inFrame, &gotFrame, &pkt);
 
         if(len < 0) {
-            utils::errorMsg("Error decoding audio frame");
+            ERROR_MSG("Error decoding audio frame");
             return false;
         }
 
@@ -125,11 +130,20 @@ bool AudioDecoderLibav::doProcessFrame(Frame *org, Frame *dst)
         }
 
         checkSampleFormat(inFrame->format);
+        
+        if (resampleDirty && !resamplingConfig()) {
+            return false;
+        }
 
-        if (!resample(inFrame, aDecodedFrame)) {
-            utils::errorMsg("Error resampling audio frame");
+        start = std::chrono::steady_clock::now();
+        
+        if (!resample(inFrame, dst)) {
+            ERROR_MSG("Error resampling audio frame");
             return false;
         }
+        
+        conversionTime += std::chrono::steady_clock::now() - start;
+        conversions++;
 
         break;
     }
@@ -145,6 +159,11 @@ bool AudioDecoderLibav::doProcessFrame(Frame *org, Frame *dst)
 
 bool AudioDecoderLibav::configure0(SampleFmt sampleFormat, int channels, int sampleRate)
 {
+    if (channels <= 0 || channels > MAX_CHANNELS) {
+        utils::errorMsg("[AudioDecoderLibav] Up to " + std::to_string(MAX_CHANNELS) + " channels are supported");
+        return false;
+    }
+
     outSampleFmt = sampleFormat;
     outChannels = channels;
     outSampleRate = sampleRate;
@@ -180,12 +199,20 @@ bool AudioDecoderLibav::configure0(SampleFmt sampleFormat, int channels, int sam
         break;
     }
 
-    return outputConfig();
-
+    resampleDirty = true;
+    return true;
 }
 
-bool AudioDecoderLibav::inputConfig()
+//NOTE: the context is only set up again when the input or output configuration changes, and not at all 
+//      while the sample rate and channels match since the samples are converted without it
+bool AudioDecoderLibav::resamplingConfig()
 {
+    resampleDirty = false;
+    
+    if (inSampleRate == outSampleRate && inChannels == outChannels && inSampleFmt != S_NONE) {
+        return true;
+    }
+    
     resampleCtx = swr_alloc_set_opts
                   (
                     resampleCtx,
@@ -204,53 +231,42 @@ bool AudioDecoderLibav::inputConfig()
         return false;
     }
 
-    if (swr_is_initialized(resampleCtx) == 0) {
-        if (swr_init(resampleCtx) < 0) {
-            utils::errorMsg("Init context failure!");
-            return false;
-        }
+    //NOTE: an initialized context keeps its previous configuration until it is initialized again
+    if (swr_init(resampleCtx) < 0) {
+        utils::errorMsg("Init context failure!");
+        return false;
     }
 
     return true;
 }
 
-bool AudioDecoderLibav::outputConfig()
+bool AudioDecoderLibav::resample(AVFrame* src, AudioFrame* dst)
 {
-    if (inChannels == 0 && inSampleRate == 0) {
-        return true;
-    }
+    int samples;
 
-    resampleCtx = swr_alloc_set_opts
-                  (
-                    resampleCtx,
-                    av_get_default_channel_layout(outChannels),
-                    outLibavSampleFmt,
-                    outSampleRate,
-                    av_get_default_channel_layout(inChannels),
-                    inLibavSampleFmt,
-                    inSampleRate,
-                    0,
-                    NULL
-                  );
+    //NOTE: when only the sample format or layout changes there is no need to go through swresample
+    if (inSampleRate == outSampleRate && inChannels == outChannels && inSampleFmt != S_NONE &&
+        src->nb_samples <= (int)dst->getMaxSamples()) {
 
-    if (resampleCtx == NULL) {
-        utils::errorMsg("[AudioDecoder::outpuConfig()] Error creating resample context");
-        return false;
-    }
+        auxBuff[0] = dst->getDataBuf();
 
-    if (swr_is_initialized(resampleCtx) == 0) {
-        if (swr_init(resampleCtx) < 0) {
-            utils::errorMsg("Init context failure!");
+        if (!SampleConverter::convert((unsigned char const* const*)src->data, inSampleFmt,
+                                      dst->isPlanar() ? dst->getPlanarDataBuf() : auxBuff,
+                                      outSampleFmt, outChannels, src->nb_samples)) {
             return false;
         }
-    }
 
-    return true;
-}
+        samples = src->nb_samples;
 
-bool AudioDecoderLibav::resample(AVFrame* src, AudioFrame* dst)
-{
-    int samples;
+        if (dst->isPlanar()) {
+            dst->setLength(samples*bytesPerSample);
+        } else {
+            dst->setLength(outChannels*samples*bytesPerSample);
+        }
+
+        dst->setSamples(samples);
+        return true;
+    }
 
     if (dst->isPlanar()) {
         samples = swr_convert(
@@ -325,7 +341,7 @@ void AudioDecoderLibav::checkSampleFormat(int sampleFormatCode)
             break;
     }
 
-    inputConfig();
+    resampleDirty = true;
 }
 
 bool AudioDecoderLibav::configEvent(Jzon::Node* params)
@@ -377,7 +393,10 @@ void AudioDecoderLibav::doGetState(Jzon::Object &filterNode)
     filterNode.Add("codec", utils::getAudioCodecAsString(fCodec));
     filterNode.Add("sampleRate", (int)outSampleRate);
     filterNode.Add("channels", (int)outChannels);
+    filterNode.Add("channelLayout", utils::getChannelLayoutAsString(utils::getDefaultChannelLayout(outChannels)));
     filterNode.Add("sampleFormat", utils::getSampleFormatAsString(outSampleFmt));
+    filterNode.Add("avgConversionTime", conversions > 0 ? 
+                   std::chrono::duration<double, std::micro>(conversionTime).count()/conversions : 0.0);
 }
 
 bool AudioDecoderLibav::reconfigureDecoder(AudioFrame* frame)
@@ -396,6 +415,7 @@ bool AudioDecoderLibav::reconfigureDecoder(AudioFrame* frame)
     fCodec = frame->getCodec();
     inChannels = frame->getChannels();
     inSampleRate = frame->getSampleRate();
+    resampleDirty = true;
 
     switch(fCodec) {
         case PCMU:
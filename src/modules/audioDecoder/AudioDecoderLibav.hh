@@ -33,7 +33,7 @@ extern "C" {
 #include "../../Filter.hh"
 
 
-class AudioDecoderLibav : public OneToOneFilter {
+class AudioDecoderLibav : public OneToOneFilterT<AudioFrame, AudioFrame> {
 
 public:
     AudioDecoderLibav();
@@ -41,7 +41,7 @@ public:
     bool configure(SampleFmt sampleFormat, int channels, int sampleRate);
     
 protected:
-    bool doProcessFrame(Frame *org, Frame *dst);
+    bool doProcessFrame(AudioFrame *org, AudioFrame *dst);
     FrameQueue* allocQueue(ConnectionData cData);
     bool configure0(SampleFmt sampleFormat, int channels, int sampleRate);
 
@@ -49,8 +49,7 @@ private:
     void initializeEventMap();
     bool resample(AVFrame* src, AudioFrame* dst);
     void checkSampleFormat(int sampleFormat);
-    bool inputConfig();
-    bool outputConfig();
+    bool resamplingConfig();
     bool reconfigureDecoder(AudioFrame* frame);
     bool configEvent(Jzon::Node* params);
     void doGetState(Jzon::Object &filterNode);
@@ -81,6 +80,10 @@ private:
     unsigned outSampleRate;
     unsigned bytesPerSample;
     unsigned char *auxBuff[1];
+    
+    bool resampleDirty;
+    std::chrono::nanoseconds conversionTime;
+    size_t conversions;
 
 };
 
@@ -23,15 +23,23 @@
 #include "AudioEncoderLibav.hh"
 #include "../../AVFramedQueue.hh"
 #include "../../AudioCircularBuffer.hh"
+#include "../../SampleConverter.hh"
 #include "../../Utils.hh"
 
+#include <algorithm>
+#include <iterator>
+
 bool checkSampleFormat(AVCodec *codec, enum AVSampleFormat sampleFmt);
 bool checkSampleRateSupport(AVCodec *codec, int sampleRate);
 bool checkChannelLayoutSupport(AVCodec *codec, uint64_t channelLayout);
 
-AudioEncoderLibav::AudioEncoderLibav() : OneToOneFilter(),
+//NOTE: sampling frequency indexes of the MPEG-4 AudioSpecificConfig
+static const int aacSampleRates[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000,
+                                     22050, 16000, 12000, 11025, 8000, 7350};
+
+AudioEncoderLibav::AudioEncoderLibav() : OneToOneFilterT(),
         samplesPerFrame(0), internalLibavSampleFmt(AV_SAMPLE_FMT_NONE),
-        outputBitrate(0), inputChannels(0), inputSampleRate(0), inputSampleFmt(S_NONE),
+        outputBitrate(0), frameTime(0), lowDelay(false), inputChannels(0), inputSampleRate(0), inputSampleFmt(S_NONE),
         inputLibavSampleFmt(AV_SAMPLE_FMT_NONE)
 {
     avcodec_register_all();
@@ -52,6 +60,12 @@ AudioEncoderLibav::AudioEncoderLibav() : OneToOneFilter(),
     outputStreamInfo->audio.sampleFormat = S_NONE;
 
     framerateMod = 1;
+    
+    resampleDirty = false;
+    batchSamples = 0;
+    batchSeqNum = 0;
+    conversionTime = std::chrono::nanoseconds(0);
+    conversions = 0;
 
     currentTime = std::chrono::microseconds(0);
 
@@ -72,36 +86,55 @@ FrameQueue* AudioEncoderLibav::allocQueue(ConnectionData cData)
     return AudioFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_AUDIO_FRAMES);
 }
 
-bool AudioEncoderLibav::doProcessFrame(Frame *org, Frame *dst)
+bool AudioEncoderLibav::doProcessFrame(AudioFrame *org, AudioFrame *dst)
 {     
     int ret, gotFrame, samples;
-    AudioFrame* rawFrame;
-    AudioFrame* codedFrame;
+    std::chrono::steady_clock::time_point start;
 
-    rawFrame = dynamic_cast<AudioFrame*>(org);
-    codedFrame = dynamic_cast<AudioFrame*>(dst);
-
-    if (!rawFrame || !codedFrame) {
-        utils::errorMsg("Error encoding audio frame: org or dst frames are not valid");
+    if(!reconfigure(org)) {
+        utils::errorMsg("Error reconfiguring audio encoder");
         return false;
     }
 
-    if(!reconfigure(rawFrame)) {
-        utils::errorMsg("Error reconfiguring audio encoder");
+    if (resampleDirty && !resamplingConfig()) {
         return false;
     }
+    
+    //NOTE: samples buffered by swresample belong to previous frames
+    if (batchSamples == 0) {
+        batchPts = org->getPresentationTime();
+        if (inputSampleRate != outputStreamInfo->audio.sampleRate && swr_is_initialized(resampleCtx)) {
+            batchPts -= std::chrono::microseconds(swr_get_delay(resampleCtx, std::micro::den));
+        }
+        batchOrigin = org->getOriginTime();
+        batchSeqNum = org->getSequenceNumber();
+    }
 
-    //set up buffer and buffer length pointers
-    pkt.data = codedFrame->getDataBuf();
-    pkt.size = codedFrame->getMaxLength();
-
+    start = std::chrono::steady_clock::now();
+    
     //resample in order to adapt to encoder constraints
-    samples = resample(rawFrame, libavFrame);
+    samples = resample(org, libavFrame, batchSamples);
+    
+    conversionTime += std::chrono::steady_clock::now() - start;
+    conversions++;
 
-    if (samples <= 0) {
+    if (samples < 0) {
         utils::errorMsg("Error encoding audio frame: resampling error");
         return false;
     }
+    
+    batchSamples += samples;
+    
+    if (batchSamples < (unsigned) libavFrame->nb_samples) {
+        return false;
+    }
+    
+    batchSamples = 0;
+    samples = libavFrame->nb_samples;
+
+    //set up buffer and buffer length pointers
+    pkt.data = dst->getDataBuf();
+    pkt.size = dst->getMaxLength();
 
     ret = avcodec_encode_audio2(codecCtx, &pkt, libavFrame, &gotFrame);
 
@@ -115,14 +148,14 @@ bool AudioEncoderLibav::doProcessFrame(Frame *org, Frame *dst)
         return false;
     }
 
-    codedFrame->setLength(pkt.size);
-    codedFrame->setSamples(samples);
+    dst->setLength(pkt.size);
+    dst->setSamples(samples);
 
     dst->setConsumed(true);
-    dst->setPresentationTime(org->getPresentationTime());
+    dst->setPresentationTime(batchPts);
     dst->setDecodeTime(NO_DTS);
-    dst->setOriginTime(org->getOriginTime());
-    dst->setSequenceNumber(org->getSequenceNumber());
+    dst->setOriginTime(batchOrigin);
+    dst->setSequenceNumber(batchSeqNum);
     
     return true;
 }
@@ -149,18 +182,39 @@ bool AudioEncoderLibav::specificReaderConfig(int /*readerID*/, FrameQueue* queue
     return true;
 }
 
-bool AudioEncoderLibav::configure0(ACodecType codec, int codedAudioChannels, int codedAudioSampleRate, int bitrate)
+bool AudioEncoderLibav::configure0(ACodecType codec, int codedAudioChannels, int codedAudioSampleRate, int bitrate,
+                                   int frameTime_, bool lowDelay_)
 {
     AVCodecID codecId;
+    static const int opusFrameTimes[] = {2500, 5000, 10000, 20000, 40000, 60000};
 
     if (getCodec() != AC_NONE) {
         utils::errorMsg("Audio encoder is already configured");
         return false;
     }
 
+    if (codedAudioChannels <= 0 || codedAudioChannels > MAX_CHANNELS) {
+        utils::errorMsg("Audio encoder supports up to " + std::to_string(MAX_CHANNELS) + " channels");
+        return false;
+    }
+
+    if (frameTime_ < 0 || frameTime_ > MAX_FRAME_TIME*1000) {
+        utils::errorMsg("Audio encoder frame time must be up to " + std::to_string(MAX_FRAME_TIME) + " ms");
+        return false;
+    }
+
+    if (codec == OPUS && frameTime_ > 0 && 
+        std::find(std::begin(opusFrameTimes), std::end(opusFrameTimes), frameTime_) == std::end(opusFrameTimes)) {
+        utils::errorMsg("Opus frame time must be 2500, 5000, 10000, 20000, 40000 or 60000 us");
+        return false;
+    }
+
+    frameTime = frameTime_;
+    lowDelay = lowDelay_;
     outputStreamInfo->audio.codec = codec;
     outputStreamInfo->setCodecDefaults();
     outputStreamInfo->audio.channels = codedAudioChannels;
+    outputStreamInfo->audio.channelLayout = utils::getDefaultChannelLayout(codedAudioChannels);
     outputStreamInfo->audio.sampleRate = codedAudioSampleRate;
     outputBitrate = bitrate;
 
@@ -200,6 +254,9 @@ bool AudioEncoderLibav::configure0(ACodecType codec, int codedAudioChannels, int
 
 bool AudioEncoderLibav::codingConfig(AVCodecID codecId) 
 {
+    AVDictionary *opts = NULL;
+    int ret;
+
     codec = avcodec_find_encoder(codecId);
     if (!codec) {
         utils::errorMsg("Error finding encoder");
@@ -235,13 +292,31 @@ bool AudioEncoderLibav::codingConfig(AVCodecID codecId)
     codecCtx->sample_fmt = internalLibavSampleFmt;
     codecCtx->bit_rate = outputBitrate;
 
-    if (avcodec_open2(codecCtx, codec, NULL) < 0) {
+    //NOTE: Opus frame duration option is in ms
+    if (getCodec() == OPUS) {
+        if (frameTime > 0) {
+            av_dict_set(&opts, "frame_duration", std::to_string(frameTime/1000.0).c_str(), 0);
+        }
+
+        if (lowDelay) {
+            av_dict_set(&opts, "application", "lowdelay", 0);
+        }
+    }
+
+    ret = avcodec_open2(codecCtx, codec, &opts);
+    av_dict_free(&opts);
+
+    if (ret < 0) {
         utils::errorMsg("Could not open codec context");
         return false;
     }
 
+    publishExtraData();
+
     if (codecCtx->frame_size != 0) {
         libavFrame->nb_samples = codecCtx->frame_size;
+    } else if (frameTime > 0) {
+        libavFrame->nb_samples = ((long long) frameTime*inputSampleRate)/1000000;
     } else {
         libavFrame->nb_samples = AudioFrame::getDefaultSamples(inputSampleRate);
     }
@@ -260,8 +335,57 @@ bool AudioEncoderLibav::codingConfig(AVCodecID codecId)
     return true;
 }
 
+//NOTE: AAC is coded with ADTS headers, so libav gives no AudioSpecificConfig and it is built from the
+//      coding params. The RTSP subsessions describe the stream from it without waiting for frames
+void AudioEncoderLibav::publishExtraData()
+{
+    uint8_t config[2];
+    int objectType;
+    int index = -1;
+    int channels = codecCtx->channels == 8 ? 7 : codecCtx->channels;
+
+    if (codecCtx->extradata && codecCtx->extradata_size > 0) {
+        outputStreamInfo->setExtraData(codecCtx->extradata, codecCtx->extradata_size);
+        return;
+    }
+
+    for (unsigned i = 0; i < sizeof(aacSampleRates)/sizeof(aacSampleRates[0]); i++) {
+        if (aacSampleRates[i] == codecCtx->sample_rate) {
+            index = i;
+        }
+    }
+
+    if (getCodec() != AAC || index < 0 || channels <= 0 || channels > 7) {
+        return;
+    }
+
+    objectType = (codecCtx->profile == FF_PROFILE_UNKNOWN ? FF_PROFILE_AAC_LOW : codecCtx->profile) + 1;
+    config[0] = (objectType << 3) | (index >> 1);
+    config[1] = ((index & 0x01) << 7) | (channels << 3);
+
+    outputStreamInfo->setExtraData(config, sizeof(config));
+}
+
+//NOTE: the context is only set up again when the input configuration changes, and not at all while the
+//      sample rate and channels match since the samples are converted without it
 bool AudioEncoderLibav::resamplingConfig()
 {
+    AudioCircularBuffer *queue;
+    std::shared_ptr<Reader> reader = getReader(DEFAULT_ID);
+    
+    resampleDirty = false;
+    batchSamples = 0;
+    
+    //NOTE: input frames last as the encoder frame, this way each one completes about one encoder frame
+    queue = reader ? dynamic_cast<AudioCircularBuffer*>(reader->getQueue()) : NULL;
+    if (queue && inputSampleRate > 0 && outputStreamInfo->audio.sampleRate > 0) {
+        queue->setOutputFrameSamples(av_rescale(samplesPerFrame, inputSampleRate, outputStreamInfo->audio.sampleRate));
+    }
+    
+    if (inputSampleRate == outputStreamInfo->audio.sampleRate && inputChannels == outputStreamInfo->audio.channels) {
+        return true;
+    }
+    
     resampleCtx = swr_alloc_set_opts
                   (
                     resampleCtx,
@@ -280,11 +404,10 @@ bool AudioEncoderLibav::resamplingConfig()
         return false;
     }
 
-    if (swr_is_initialized(resampleCtx) == 0) {
-        if (swr_init(resampleCtx) < 0) {
-            utils::errorMsg("Error initializing encoder resample context");
-            return false;
-        }
+    //NOTE: an initialized context keeps its previous configuration until it is initialized again
+    if (swr_init(resampleCtx) < 0) {
+        utils::errorMsg("Error initializing encoder resample context");
+        return false;
     }
 
     return true;
@@ -324,22 +447,50 @@ bool AudioEncoderLibav::reconfigure(AudioFrame* frame)
                 break;
         }
 
-        return resamplingConfig();
+        resampleDirty = true;
     }
 
     return true;
 }
 
-int AudioEncoderLibav::resample(AudioFrame* src, AVFrame* dst)
+//NOTE: samples are written after the offset ones, swresample keeps the ones that do not fit for the next frame
+int AudioEncoderLibav::resample(AudioFrame* src, AVFrame* dst, unsigned offset)
 {
     int samples;
     unsigned char *auxBuff;
+    uint8_t *outPlanes[MAX_CHANNELS];
+    int bytesPerSample = av_get_bytes_per_sample(internalLibavSampleFmt);
+    bool planar = av_sample_fmt_is_planar(internalLibavSampleFmt);
+    
+    for (unsigned i = 0; i < outputStreamInfo->audio.channels && i < MAX_CHANNELS; i++) {
+        outPlanes[i] = planar ? dst->data[i] + offset*bytesPerSample : 
+                                i == 0 ? dst->data[0] + offset*bytesPerSample*outputStreamInfo->audio.channels : NULL;
+    }
+
+    //NOTE: when only the sample format or layout changes there is no need to go through swresample
+    if (inputSampleRate == outputStreamInfo->audio.sampleRate && 
+        inputChannels == outputStreamInfo->audio.channels) {
+        
+        if ((int) (offset + src->getSamples()) > dst->nb_samples) {
+            return -1;
+        }
+
+        auxBuff = src->getDataBuf();
+
+        if (!SampleConverter::convert(src->isPlanar() ? src->getPlanarDataBuf() : &auxBuff, inputSampleFmt,
+                                      outPlanes, outputStreamInfo->audio.sampleFormat, 
+                                      inputChannels, src->getSamples())) {
+            return -1;
+        }
+
+        return src->getSamples();
+    }
 
     if (src->isPlanar()) {
         samples = swr_convert(
                     resampleCtx,
-                    dst->data,
-                    dst->nb_samples,
+                    outPlanes,
+                    dst->nb_samples - offset,
                     (const uint8_t**)src->getPlanarDataBuf(),
                     src->getSamples()
                   );
@@ -349,9 +500,9 @@ int AudioEncoderLibav::resample(AudioFrame* src, AVFrame* dst)
 
         samples = swr_convert(
                     resampleCtx,
-                    dst->data,
-                    dst->nb_samples,
-                    (const uint8_t**)auxBuff,
+                    outPlanes,
+                    dst->nb_samples - offset,
+                    (const uint8_t**)&auxBuff,
                     src->getSamples()
                   );
 
@@ -365,6 +516,11 @@ void AudioEncoderLibav::doGetState(Jzon::Object &filterNode)
     filterNode.Add("codec", utils::getAudioCodecAsString(getCodec()));
     filterNode.Add("sampleRate", (int)outputStreamInfo->audio.sampleRate);
     filterNode.Add("channels", (int)outputStreamInfo->audio.channels);
+    filterNode.Add("channelLayout", utils::getChannelLayoutAsString(outputStreamInfo->audio.channelLayout));
+    filterNode.Add("frameTime", frameTime);
+    filterNode.Add("lowDelay", lowDelay);
+    filterNode.Add("avgConversionTime", conversions > 0 ? 
+                   std::chrono::duration<double, std::micro>(conversionTime).count()/conversions : 0.0);
 }
 
 bool checkSampleFormat(AVCodec *codec, enum AVSampleFormat sampleFmt)
@@ -424,6 +580,8 @@ bool AudioEncoderLibav::configEvent(Jzon::Node* params)
     int codedAudioChannels;
     int codedAudioSampleRate;
     int bitrate;
+    int frameTime_;
+    bool lowDelay_;
 
     if (!params) {
         return false;
@@ -433,6 +591,8 @@ bool AudioEncoderLibav::configEvent(Jzon::Node* params)
     codedAudioChannels = outputStreamInfo->audio.channels;
     codedAudioSampleRate = outputStreamInfo->audio.sampleRate;
     bitrate = outputBitrate;
+    frameTime_ = frameTime;
+    lowDelay_ = lowDelay;
 
     if (params->Has("codec")) {
         codec = utils::getAudioCodecFromString(params->Get("codec").ToString());
@@ -450,7 +610,15 @@ bool AudioEncoderLibav::configEvent(Jzon::Node* params)
         bitrate = params->Get("bitrate").ToInt();
     }
 
-    return configure0(codec, codedAudioChannels, codedAudioSampleRate, bitrate);
+    if (params->Has("frameTime")) {
+        frameTime_ = params->Get("frameTime").ToInt();
+    }
+
+    if (params->Has("lowDelay")) {
+        lowDelay_ = params->Get("lowDelay").ToBool();
+    }
+
+    return configure0(codec, codedAudioChannels, codedAudioSampleRate, bitrate, frameTime_, lowDelay_);
 }
 
 void AudioEncoderLibav::initializeEventMap()
@@ -458,7 +626,8 @@ void AudioEncoderLibav::initializeEventMap()
     eventMap["configure"] = std::bind(&AudioEncoderLibav::configEvent, this, std::placeholders::_1);
 }
 
-bool AudioEncoderLibav::configure(ACodecType codec, int codedAudioChannels, int codedAudioSampleRate, int bitrate)
+bool AudioEncoderLibav::configure(ACodecType codec, int codedAudioChannels, int codedAudioSampleRate, int bitrate,
+                                  int frameTime, bool lowDelay)
 {
     Jzon::Object root, params;
     root.Add("action", "configure");
@@ -466,6 +635,8 @@ bool AudioEncoderLibav::configure(ACodecType codec, int codedAudioChannels, int
     params.Add("channels", codedAudioChannels);
     params.Add("sampleRate", codedAudioSampleRate);
     params.Add("bitrate", bitrate);
+    params.Add("frameTime", frameTime);
+    params.Add("lowDelay", lowDelay);
     root.Add("params", params);
 
     Event e(root, std::chrono::system_clock::now(), 0);
@@ -36,29 +36,46 @@ extern "C" {
 #include "../../Utils.hh"
 #include "../../StreamInfo.hh"
 
-class AudioEncoderLibav : public OneToOneFilter {
+/*! Libav audio encoder. Input samples are converted straight into the encoder frame, which is only encoded
+*   once it is complete, so the encoded frames have the encoder frame size whatever the input sample rate is.
+*/
+class AudioEncoderLibav : public OneToOneFilterT<AudioFrame, AudioFrame> {
 
 public:
     AudioEncoderLibav();
     ~AudioEncoderLibav();
 
-    bool configure(ACodecType codec, int codedAudioChannels, int codedAudioSampleRate, int bitrate);
+    /**
+    * Configures the encoder, it can only be configured once
+    * @param codec output audio codec
+    * @param codedAudioChannels output channels
+    * @param codedAudioSampleRate output sample rate
+    * @param bitrate output bitrate in bps
+    * @param frameTime encoded frame duration in us, 0 keeps the codec default. Opus accepts
+    * 2500, 5000, 10000, 20000, 40000 and 60000 us, codecs without a fixed frame size use any
+    * @param lowDelay if true Opus uses its restricted low delay mode, shortening the algorithmic delay
+    * @return always true
+    */
+    bool configure(ACodecType codec, int codedAudioChannels, int codedAudioSampleRate, int bitrate,
+                   int frameTime = 0, bool lowDelay = false);
     unsigned getSamplesPerFrame(){ return samplesPerFrame;};
     ACodecType getCodec() {return outputStreamInfo->audio.codec;};
     
 protected:
     FrameQueue* allocQueue(ConnectionData cData);
-    bool doProcessFrame(Frame *org, Frame *dst);
+    bool doProcessFrame(AudioFrame *org, AudioFrame *dst);
     bool specificReaderConfig(int /*readerID*/, FrameQueue* queue);
     bool specificReaderDelete(int /*readerID*/) {return true;};
 
 private:
-    bool configure0(ACodecType codec, int codedAudioChannels, int codedAudioSampleRate, int bitrate);
+    bool configure0(ACodecType codec, int codedAudioChannels, int codedAudioSampleRate, int bitrate,
+                    int frameTime_, bool lowDelay_);
     void initializeEventMap();
-    int resample(AudioFrame* src, AVFrame* dst);
+    int resample(AudioFrame* src, AVFrame* dst, unsigned offset);
     bool reconfigure(AudioFrame* frame);
     bool resamplingConfig();
     bool codingConfig(AVCodecID codecId); 
+    void publishExtraData();
 
     bool configEvent(Jzon::Node* params);
     void doGetState(Jzon::Object &filterNode);
@@ -80,6 +97,8 @@ private:
 
     AVSampleFormat      internalLibavSampleFmt;
     int                 outputBitrate;
+    int                 frameTime;          //!< Encoded frame duration in us, 0 is the codec default
+    bool                lowDelay;
 
     unsigned            inputChannels;
     unsigned            inputSampleRate;
@@ -92,6 +111,15 @@ private:
     std::chrono::microseconds lastDiffTime;
 
     float framerateMod;
+    
+    bool                resampleDirty;
+    unsigned            batchSamples;
+    std::chrono::microseconds batchPts;
+    std::chrono::system_clock::time_point batchOrigin;
+    size_t              batchSeqNum;
+    
+    std::chrono::nanoseconds conversionTime;
+    size_t              conversions;
 };
 
 #endif
@@ -0,0 +1,673 @@
+/*
+ *  AudioMultiEncoderLibav - Libav audio encoder producing several codecs of one input
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *            David Cassany <david.cassany@i2cat.net>
+ */
+
+#include "AudioMultiEncoderLibav.hh"
+#include "../../AVFramedQueue.hh"
+#include "../../AudioCircularBuffer.hh"
+#include "../../Utils.hh"
+
+bool checkSampleFormat(AVCodec *codec, enum AVSampleFormat sampleFmt);
+bool checkSampleRateSupport(AVCodec *codec, int sampleRate);
+bool checkChannelLayoutSupport(AVCodec *codec, uint64_t channelLayout);
+
+static bool getCodecFormat(ACodecType codec, AVCodecID &codecId, AVSampleFormat &libavFmt, SampleFmt &fmt)
+{
+    switch(codec) {
+        case PCM:
+            codecId = AV_CODEC_ID_PCM_S16BE;
+            libavFmt = AV_SAMPLE_FMT_S16;
+            fmt = S16;
+            break;
+        case PCMU:
+            codecId = AV_CODEC_ID_PCM_MULAW;
+            libavFmt = AV_SAMPLE_FMT_S16;
+            fmt = S16;
+            break;
+        case OPUS:
+            codecId = AV_CODEC_ID_OPUS;
+            libavFmt = AV_SAMPLE_FMT_S16;
+            fmt = S16;
+            break;
+        case AAC:
+            codecId = AV_CODEC_ID_AAC;
+            libavFmt = AV_SAMPLE_FMT_S16;
+            fmt = S16;
+            break;
+        case MP3:
+            codecId = AV_CODEC_ID_MP3;
+            libavFmt = AV_SAMPLE_FMT_S16P;
+            fmt = S16P;
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+static AVSampleFormat getLibavSampleFmt(SampleFmt fmt)
+{
+    switch(fmt) {
+        case U8:
+            return AV_SAMPLE_FMT_U8;
+        case S16:
+            return AV_SAMPLE_FMT_S16;
+        case FLT:
+            return AV_SAMPLE_FMT_FLT;
+        case U8P:
+            return AV_SAMPLE_FMT_U8P;
+        case S16P:
+            return AV_SAMPLE_FMT_S16P;
+        case FLTP:
+            return AV_SAMPLE_FMT_FLTP;
+        default:
+            return AV_SAMPLE_FMT_NONE;
+    }
+}
+
+static ConversionKey getConversionKey(CodecOutput *output)
+{
+    return ConversionKey(output->sampleRate, output->channels, output->sampleFmt);
+}
+
+///////////////////////////////////////////////////
+//          SharedConversion Struct              //
+///////////////////////////////////////////////////
+
+SharedConversion::SharedConversion() : ctx(NULL), samples(0), pts(0), needsConfig(true)
+{
+    converted = av_frame_alloc();
+}
+
+SharedConversion::~SharedConversion()
+{
+    swr_free(&ctx);
+    av_frame_free(&converted);
+}
+
+///////////////////////////////////////////////////
+//          CodecOutput Struct                   //
+///////////////////////////////////////////////////
+
+CodecOutput::CodecOutput() : codec(AC_NONE), channels(0), sampleRate(0), bitrate(0),
+    sampleFmt(AV_SAMPLE_FMT_NONE), codecCtx(NULL), fifo(NULL), nextPts(0), needsConfig(true)
+{
+    frame = av_frame_alloc();
+}
+
+CodecOutput::~CodecOutput()
+{
+    avcodec_free_context(&codecCtx);
+    av_frame_free(&frame);
+
+    if (fifo) {
+        av_audio_fifo_free(fifo);
+    }
+}
+
+///////////////////////////////////////////////////
+//          AudioMultiEncoderLibav Class         //
+///////////////////////////////////////////////////
+
+AudioMultiEncoderLibav::AudioMultiEncoderLibav() : OneToManyFilterT(MULTI_ENCODER_MAX_OUTPUTS),
+    inputChannels(0), inputSampleRate(0), inputSampleFmt(S_NONE), inputLibavSampleFmt(AV_SAMPLE_FMT_NONE),
+    conversionTime(0), conversionsDone(0)
+{
+    avcodec_register_all();
+
+    fType = AUDIO_MULTI_ENCODER;
+
+    initializeEventMap();
+}
+
+AudioMultiEncoderLibav::~AudioMultiEncoderLibav()
+{
+    for (auto it : outputs) {
+        delete it.second;
+    }
+
+    for (auto it : conversions) {
+        delete it.second;
+    }
+
+    for (auto it : outputStreamInfos) {
+        delete it.second;
+    }
+}
+
+FrameQueue* AudioMultiEncoderLibav::allocQueue(ConnectionData cData)
+{
+    return AudioFrameQueue::createNew(cData, outputStreamInfos[cData.writerId], DEFAULT_AUDIO_FRAMES);
+}
+
+bool AudioMultiEncoderLibav::doProcessFrame(AudioFrame *rawFrame, FrameMap &dstFrames)
+{
+    std::map<ConversionKey, SharedConversion*> active;
+    std::chrono::steady_clock::time_point start;
+    bool processed = false;
+
+    if (!reconfigure(rawFrame)) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Error reconfiguring audio encoder");
+        return false;
+    }
+
+    for (auto it : dstFrames) {
+        if (outputs.count(it.first) == 0) {
+            continue;
+        }
+
+        if (outputs[it.first]->needsConfig && !openOutput(it.first, outputs[it.first])) {
+            continue;
+        }
+
+        active[getConversionKey(outputs[it.first])] = NULL;
+    }
+
+    //NOTE: each conversion is done once, whatever the number of outputs sharing it
+    start = std::chrono::steady_clock::now();
+
+    for (auto &it : active) {
+        if (conversions.count(it.first) == 0) {
+            conversions[it.first] = new SharedConversion();
+        }
+
+        if (convert(rawFrame, it.first, conversions[it.first])) {
+            it.second = conversions[it.first];
+        }
+    }
+
+    conversionTime += std::chrono::steady_clock::now() - start;
+    conversionsDone++;
+
+    for (auto it : dstFrames) {
+        AudioFrame *codedFrame = static_cast<AudioFrame*>(it.second);
+        CodecOutput *output = outputs.count(it.first) > 0 ? outputs[it.first] : NULL;
+
+        it.second->setConsumed(false);
+
+        if (!output || output->needsConfig || !codedFrame || !active[getConversionKey(output)]) {
+            continue;
+        }
+
+        if (!encodeOutput(output, active[getConversionKey(output)], codedFrame)) {
+            continue;
+        }
+
+        codedFrame->setDecodeTime(NO_DTS);
+        codedFrame->setOriginTime(rawFrame->getOriginTime());
+        codedFrame->setSequenceNumber(rawFrame->getSequenceNumber());
+        processed = true;
+    }
+
+    return processed;
+}
+
+bool AudioMultiEncoderLibav::convert(AudioFrame* frame, ConversionKey key, SharedConversion *conversion)
+{
+    unsigned char *auxBuff;
+    int maxSamples;
+
+    if (conversion->needsConfig) {
+        conversion->ctx = swr_alloc_set_opts
+                          (
+                            conversion->ctx,
+                            av_get_default_channel_layout(std::get<1>(key)),
+                            (AVSampleFormat) std::get<2>(key),
+                            std::get<0>(key),
+                            av_get_default_channel_layout(inputChannels),
+                            inputLibavSampleFmt,
+                            inputSampleRate,
+                            0,
+                            NULL
+                          );
+
+        if (!conversion->ctx || swr_init(conversion->ctx) < 0) {
+            utils::errorMsg("[AudioMultiEncoderLibav] Error initializing resample context");
+            return false;
+        }
+
+        conversion->needsConfig = false;
+    }
+
+    maxSamples = swr_get_out_samples(conversion->ctx, frame->getSamples());
+
+    if (conversion->converted->nb_samples < maxSamples) {
+        av_frame_unref(conversion->converted);
+        conversion->converted->nb_samples = maxSamples;
+        conversion->converted->format = std::get<2>(key);
+        conversion->converted->channel_layout = av_get_default_channel_layout(std::get<1>(key));
+        conversion->converted->channels = std::get<1>(key);
+
+        if (av_frame_get_buffer(conversion->converted, 0) < 0) {
+            utils::errorMsg("[AudioMultiEncoderLibav] Could not allocate the converted samples");
+            conversion->converted->nb_samples = 0;
+            return false;
+        }
+    }
+
+    //NOTE: samples buffered by swresample belong to previous frames
+    conversion->pts = frame->getPresentationTime() -
+                      std::chrono::microseconds(swr_get_delay(conversion->ctx, std::micro::den));
+
+    auxBuff = frame->getDataBuf();
+
+    conversion->samples = swr_convert(
+                            conversion->ctx,
+                            conversion->converted->data,
+                            conversion->converted->nb_samples,
+                            frame->isPlanar() ? (const uint8_t**)frame->getPlanarDataBuf() : (const uint8_t**)&auxBuff,
+                            frame->getSamples()
+                          );
+
+    if (conversion->samples < 0) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Resampling error");
+        return false;
+    }
+
+    return true;
+}
+
+bool AudioMultiEncoderLibav::encodeOutput(CodecOutput *output, SharedConversion *conversion, AudioFrame *codedFrame)
+{
+    AVPacket pkt;
+    int ret, gotFrame;
+
+    if (av_audio_fifo_size(output->fifo) == 0) {
+        output->nextPts = conversion->pts;
+    }
+
+    if (av_audio_fifo_write(output->fifo, (void**)conversion->converted->data, conversion->samples) < conversion->samples) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Could not queue converted samples");
+        return false;
+    }
+
+    if (av_audio_fifo_size(output->fifo) < output->frame->nb_samples) {
+        return false;
+    }
+
+    if (av_frame_make_writable(output->frame) < 0 ||
+        av_audio_fifo_read(output->fifo, (void**)output->frame->data, output->frame->nb_samples) < output->frame->nb_samples) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Could not read queued samples");
+        return false;
+    }
+
+    av_init_packet(&pkt);
+    pkt.data = codedFrame->getDataBuf();
+    pkt.size = codedFrame->getMaxLength();
+
+    ret = avcodec_encode_audio2(output->codecCtx, &pkt, output->frame, &gotFrame);
+
+    if (ret < 0) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Error encoding audio frame");
+        return false;
+    }
+
+    codedFrame->setPresentationTime(output->nextPts);
+    output->nextPts += std::chrono::microseconds(av_rescale(output->frame->nb_samples, std::micro::den, output->sampleRate));
+
+    if (!gotFrame) {
+        return false;
+    }
+
+    codedFrame->setLength(pkt.size);
+    codedFrame->setSamples(output->frame->nb_samples);
+    codedFrame->setConsumed(true);
+
+    return true;
+}
+
+bool AudioMultiEncoderLibav::openOutput(int writerId, CodecOutput *output)
+{
+    AVCodec *codec;
+    AVCodecID codecId;
+    AVSampleFormat libavFmt;
+    SampleFmt fmt;
+
+    if (!getCodecFormat(output->codec, codecId, libavFmt, fmt)) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Codec not supported");
+        return false;
+    }
+
+    codec = avcodec_find_encoder(codecId);
+    if (!codec) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Error finding encoder");
+        return false;
+    }
+
+    if (output->codec != PCMU && output->codec != PCM) {
+        if (!checkSampleFormat(codec, libavFmt) ||
+            !checkSampleRateSupport(codec, output->sampleRate) ||
+            !checkChannelLayoutSupport(codec, av_get_default_channel_layout(output->channels))) {
+            utils::errorMsg("[AudioMultiEncoderLibav] Encoder does not support the output configuration of writer " +
+                            std::to_string(writerId));
+            return false;
+        }
+    }
+
+    avcodec_free_context(&output->codecCtx);
+    output->codecCtx = avcodec_alloc_context3(codec);
+    if (!output->codecCtx) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Error allocating codec context");
+        return false;
+    }
+
+    output->codecCtx->channels = output->channels;
+    output->codecCtx->channel_layout = av_get_default_channel_layout(output->channels);
+    output->codecCtx->sample_rate = output->sampleRate;
+    output->codecCtx->sample_fmt = libavFmt;
+    output->codecCtx->bit_rate = output->bitrate;
+
+    if (avcodec_open2(output->codecCtx, codec, NULL) < 0) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Could not open codec context");
+        avcodec_free_context(&output->codecCtx);
+        return false;
+    }
+
+    av_frame_unref(output->frame);
+    output->frame->nb_samples = output->codecCtx->frame_size != 0 ?
+                                output->codecCtx->frame_size : AudioFrame::getDefaultSamples(output->sampleRate);
+    output->frame->format = libavFmt;
+    output->frame->channel_layout = output->codecCtx->channel_layout;
+    output->frame->channels = output->channels;
+
+    if (av_frame_get_buffer(output->frame, 0) < 0) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Could not setup audio frame");
+        return false;
+    }
+
+    if (output->fifo) {
+        av_audio_fifo_free(output->fifo);
+    }
+
+    output->fifo = av_audio_fifo_alloc(libavFmt, output->channels, output->frame->nb_samples*2);
+    if (!output->fifo) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Could not allocate sample FIFO");
+        return false;
+    }
+
+    output->sampleFmt = libavFmt;
+    outputStreamInfos[writerId]->audio.sampleFormat = fmt;
+    output->needsConfig = false;
+
+    updateInputFrameSamples();
+
+    return true;
+}
+
+bool AudioMultiEncoderLibav::reconfigure(AudioFrame* frame)
+{
+    if (inputSampleFmt == frame->getSampleFmt() &&
+        inputChannels == frame->getChannels() &&
+        inputSampleRate == frame->getSampleRate())
+    {
+        return true;
+    }
+
+    inputSampleFmt = frame->getSampleFmt();
+    inputChannels = frame->getChannels();
+    inputSampleRate = frame->getSampleRate();
+    inputLibavSampleFmt = getLibavSampleFmt(inputSampleFmt);
+
+    if (inputLibavSampleFmt == AV_SAMPLE_FMT_NONE) {
+        return false;
+    }
+
+    for (auto it : conversions) {
+        it.second->needsConfig = true;
+    }
+
+    //NOTE: queued samples were converted from the previous input
+    for (auto it : outputs) {
+        if (it.second->fifo) {
+            av_audio_fifo_reset(it.second->fifo);
+        }
+    }
+
+    updateInputFrameSamples();
+
+    return true;
+}
+
+//NOTE: input frames last as the shortest codec frame, this way each one completes about one frame of every codec
+void AudioMultiEncoderLibav::updateInputFrameSamples()
+{
+    AudioCircularBuffer *queue;
+    std::shared_ptr<Reader> reader = getReader(DEFAULT_ID);
+    int64_t samples = 0;
+
+    queue = reader ? dynamic_cast<AudioCircularBuffer*>(reader->getQueue()) : NULL;
+    if (!queue || inputSampleRate == 0) {
+        return;
+    }
+
+    for (auto it : outputs) {
+        if (it.second->needsConfig) {
+            continue;
+        }
+
+        int64_t outputSamples = av_rescale(it.second->frame->nb_samples, inputSampleRate, it.second->sampleRate);
+        if (samples == 0 || outputSamples < samples) {
+            samples = outputSamples;
+        }
+    }
+
+    if (samples > 0) {
+        queue->setOutputFrameSamples(samples);
+    }
+}
+
+void AudioMultiEncoderLibav::pruneConversions()
+{
+    for (auto it = conversions.begin(); it != conversions.end();) {
+        bool used = false;
+
+        for (auto out : outputs) {
+            used |= getConversionKey(out.second) == it->first;
+        }
+
+        if (used) {
+            it++;
+            continue;
+        }
+
+        delete it->second;
+        it = conversions.erase(it);
+    }
+}
+
+bool AudioMultiEncoderLibav::specificReaderConfig(int /*readerID*/, FrameQueue* queue)
+{
+    if (!dynamic_cast<AudioCircularBuffer*>(queue)) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Input queue must be an AudioCircularBuffer");
+        return false;
+    }
+
+    return true;
+}
+
+bool AudioMultiEncoderLibav::configCodec0(int writerId, ACodecType codec, unsigned channels, unsigned sampleRate, int bitrate)
+{
+    AVCodecID codecId;
+    AVSampleFormat libavFmt;
+    SampleFmt fmt;
+    CodecOutput *output;
+
+    if (channels == 0 || channels > MAX_CHANNELS || sampleRate == 0 || bitrate <= 0) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Codec configuration is not valid");
+        return false;
+    }
+
+    if (!getCodecFormat(codec, codecId, libavFmt, fmt)) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Codec not supported");
+        return false;
+    }
+
+    if (outputs.count(writerId) == 0) {
+        if (outputs.size() >= MULTI_ENCODER_MAX_OUTPUTS) {
+            utils::errorMsg("[AudioMultiEncoderLibav] Up to " + std::to_string(MULTI_ENCODER_MAX_OUTPUTS) + " outputs are supported");
+            return false;
+        }
+
+        outputs[writerId] = new CodecOutput();
+    }
+
+    output = outputs[writerId];
+
+    //NOTE: the queue of a connected writer is allocated for its stream, only the bitrate may change
+    if (isWConnected(writerId) && (output->codec != codec || output->channels != channels || output->sampleRate != sampleRate)) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Only the bitrate of a connected writer can be changed");
+        return false;
+    }
+
+    if (outputStreamInfos.count(writerId) == 0) {
+        outputStreamInfos[writerId] = new StreamInfo(AUDIO);
+    }
+
+    outputStreamInfos[writerId]->audio.codec = codec;
+    outputStreamInfos[writerId]->setCodecDefaults();
+    outputStreamInfos[writerId]->audio.channels = channels;
+    outputStreamInfos[writerId]->audio.channelLayout = utils::getDefaultChannelLayout(channels);
+    outputStreamInfos[writerId]->audio.sampleRate = sampleRate;
+    outputStreamInfos[writerId]->audio.sampleFormat = fmt;
+
+    output->codec = codec;
+    output->channels = channels;
+    output->sampleRate = sampleRate;
+    output->bitrate = bitrate;
+    output->sampleFmt = libavFmt;
+    output->needsConfig = true;
+
+    pruneConversions();
+
+    return true;
+}
+
+bool AudioMultiEncoderLibav::specificWriterConfig(int writerID)
+{
+    //NOTE: a writer without a configured codec gets the default one
+    if (outputs.count(writerID) > 0) {
+        return true;
+    }
+
+    return configCodec0(writerID, DEFAULT_MULTI_ENCODER_CODEC, DEFAULT_CHANNELS, DEFAULT_SAMPLE_RATE, DEFAULT_AUDIO_BITRATE);
+}
+
+bool AudioMultiEncoderLibav::specificWriterDelete(int writerID)
+{
+    if (outputs.count(writerID) == 0) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Error deleting writer. This writerId doesn't exist " + std::to_string(writerID));
+        return false;
+    }
+
+    delete outputs[writerID];
+    outputs.erase(writerID);
+    pruneConversions();
+    updateInputFrameSamples();
+
+    return true;
+}
+
+bool AudioMultiEncoderLibav::configCodecEvent(Jzon::Node* params)
+{
+    int id, channels, sampleRate, bitrate;
+    ACodecType codec;
+
+    if (!params) {
+        return false;
+    }
+
+    if (!params->Has("id") || !params->Get("id").IsNumber()) {
+        utils::errorMsg("[AudioMultiEncoderLibav::configCodecEvent] Params node not complete");
+        return false;
+    }
+
+    id = params->Get("id").ToInt();
+    codec = outputs.count(id) > 0 ? outputs[id]->codec : DEFAULT_MULTI_ENCODER_CODEC;
+    channels = outputs.count(id) > 0 ? outputs[id]->channels : DEFAULT_CHANNELS;
+    sampleRate = outputs.count(id) > 0 ? outputs[id]->sampleRate : DEFAULT_SAMPLE_RATE;
+    bitrate = outputs.count(id) > 0 ? outputs[id]->bitrate : DEFAULT_AUDIO_BITRATE;
+
+    if (params->Has("codec")) {
+        codec = utils::getAudioCodecFromString(params->Get("codec").ToString());
+    }
+
+    if (params->Has("channels") && params->Get("channels").IsNumber()) {
+        channels = params->Get("channels").ToInt();
+    }
+
+    if (params->Has("sampleRate") && params->Get("sampleRate").IsNumber()) {
+        sampleRate = params->Get("sampleRate").ToInt();
+    }
+
+    if (params->Has("bitrate") && params->Get("bitrate").IsNumber()) {
+        bitrate = params->Get("bitrate").ToInt();
+    }
+
+    if (channels <= 0 || sampleRate <= 0) {
+        utils::errorMsg("[AudioMultiEncoderLibav] Channels and sample rate must be positive");
+        return false;
+    }
+
+    return configCodec0(id, codec, channels, sampleRate, bitrate);
+}
+
+void AudioMultiEncoderLibav::initializeEventMap()
+{
+    eventMap["configCodec"] = std::bind(&AudioMultiEncoderLibav::configCodecEvent, this, std::placeholders::_1);
+}
+
+void AudioMultiEncoderLibav::doGetState(Jzon::Object &filterNode)
+{
+    Jzon::Array jsonOutputs;
+
+    for (auto it : outputs) {
+        Jzon::Object output;
+        output.Add("id", it.first);
+        output.Add("codec", utils::getAudioCodecAsString(it.second->codec));
+        output.Add("channels", (int) it.second->channels);
+        output.Add("sampleRate", (int) it.second->sampleRate);
+        output.Add("bitrate", it.second->bitrate);
+        jsonOutputs.Add(output);
+    }
+
+    filterNode.Add("outputs", jsonOutputs);
+    filterNode.Add("conversions", (int) conversions.size());
+    filterNode.Add("avgConversionTime", conversionsDone > 0 ?
+                   std::chrono::duration<double, std::micro>(conversionTime).count()/conversionsDone : 0.0);
+}
+
+bool AudioMultiEncoderLibav::configCodec(int writerId, ACodecType codec, int channels, int sampleRate, int bitrate)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configCodec");
+    params.Add("id", writerId);
+    params.Add("codec", utils::getAudioCodecAsString(codec));
+    params.Add("channels", channels);
+    params.Add("sampleRate", sampleRate);
+    params.Add("bitrate", bitrate);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
@@ -0,0 +1,138 @@
+/*
+ *  AudioMultiEncoderLibav - Libav audio encoder producing several codecs of one input
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *            David Cassany <david.cassany@i2cat.net>
+ */
+
+#ifndef _AUDIO_MULTI_ENCODER_LIBAV_HH
+#define _AUDIO_MULTI_ENCODER_LIBAV_HH
+
+#include <chrono>
+#include <tuple>
+
+extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/audio_fifo.h>
+    #include <libswresample/swresample.h>
+}
+
+#include "../../AudioFrame.hh"
+#include "../../FrameQueue.hh"
+#include "../../Filter.hh"
+#include "../../Utils.hh"
+#include "../../StreamInfo.hh"
+
+#define MULTI_ENCODER_MAX_OUTPUTS 8         //!< Maximum number of codec outputs, one per writer
+#define DEFAULT_MULTI_ENCODER_CODEC AAC     //!< Codec of the writers connected without configuration
+#define DEFAULT_AUDIO_BITRATE 128000        //!< In bps
+
+//! Sample rate, channels and libav sample format of a conversion
+typedef std::tuple<unsigned, unsigned, int> ConversionKey;
+
+/*! Input conversion shared by all the outputs with the same sample rate, channels and sample format.
+*   It is done once per input frame whatever the number of outputs reading it.
+*/
+struct SharedConversion {
+    SharedConversion();
+    ~SharedConversion();
+
+    SwrContext *ctx;
+    AVFrame *converted;             //!< Samples of the last input frame after the conversion
+    int samples;
+    std::chrono::microseconds pts;  //!< Presentation time of the first converted sample
+    bool needsConfig;
+};
+
+/*! Codec output of a writer. Converted samples are queued in its FIFO until a codec frame is complete,
+*   so each coded frame has the frame size of its codec.
+*/
+struct CodecOutput {
+    CodecOutput();
+    ~CodecOutput();
+
+    ACodecType codec;
+    unsigned channels;
+    unsigned sampleRate;
+    int bitrate;                    //!< In bps
+    AVSampleFormat sampleFmt;
+    AVCodecContext *codecCtx;
+    AVFrame *frame;
+    AVAudioFifo *fifo;
+    std::chrono::microseconds nextPts;  //!< Presentation time of the first queued sample
+    bool needsConfig;
+};
+
+/*! Libav audio encoder producing one codec per writer (e.g. AAC and Opus) from the same input.
+*   Sample format, channels and rate conversion is done once per distinct output configuration
+*   and shared by every output using it, then each codec gets its own context and StreamInfo.
+*   Input frames last as the shortest codec frame, so each one completes about one frame of every codec.
+*/
+class AudioMultiEncoderLibav : public OneToManyFilterT<AudioFrame, AudioFrame> {
+
+public:
+    AudioMultiEncoderLibav();
+    ~AudioMultiEncoderLibav();
+
+    /**
+    * Configures the codec of a writer, it can be done before connecting it. Once connected
+    * only the bitrate can be changed
+    * @param writerId id of the writer
+    * @param codec output codec
+    * @param channels output channels
+    * @param sampleRate output sample rate
+    * @param bitrate target bitrate in bps
+    */
+    bool configCodec(int writerId, ACodecType codec, int channels, int sampleRate, int bitrate);
+
+private:
+    bool doProcessFrame(AudioFrame *rawFrame, FrameMap &dstFrames);
+    FrameQueue* allocQueue(ConnectionData cData);
+    void initializeEventMap();
+    bool configCodecEvent(Jzon::Node* params);
+    void doGetState(Jzon::Object &filterNode);
+    bool configCodec0(int writerId, ACodecType codec, unsigned channels, unsigned sampleRate, int bitrate);
+    bool openOutput(int writerId, CodecOutput *output);
+    bool reconfigure(AudioFrame* frame);
+    bool convert(AudioFrame* frame, ConversionKey key, SharedConversion *conversion);
+    bool encodeOutput(CodecOutput *output, SharedConversion *conversion, AudioFrame *codedFrame);
+    void updateInputFrameSamples();
+    void pruneConversions();
+
+    bool specificReaderConfig(int /*readerID*/, FrameQueue* queue);
+    bool specificReaderDelete(int /*readerID*/) {return true;};
+
+    bool specificWriterConfig(int writerID);
+    bool specificWriterDelete(int writerID);
+
+    std::map<int, CodecOutput*> outputs;
+    std::map<ConversionKey, SharedConversion*> conversions;
+    //NOTE: a removed output keeps its stream info, its AudioFrameQueue points to it until the reader disconnects
+    std::map<int, StreamInfo*> outputStreamInfos;
+
+    unsigned            inputChannels;
+    unsigned            inputSampleRate;
+    SampleFmt           inputSampleFmt;
+    AVSampleFormat      inputLibavSampleFmt;
+
+    std::chrono::nanoseconds conversionTime;
+    size_t              conversionsDone;
+};
+
+#endif
@@ -24,35 +24,139 @@
 
 #include "AudioMixer.hh"
 #include "../../AudioCircularBuffer.hh"
+#include "../../SampleConverter.hh"
 #include "../../Utils.hh"
+#include "../../AsyncLog.hh"
+#include "../../WorkersPool.hh"
+#include "../../SpeakerActivity.hh"
 #include <iostream>
 #include <utility>
 #include <cmath>
 #include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+/**
+* Soft clipping of the compression algorithm without branches. Beyond the threshold the excess is 
+* scaled by the slope, which gives the same curve than the reference implementation (see mixSamplesScalar).
+*/
+static SIMD_INLINE float softClip(float x, float th, float slopeMinusOne)
+{
+    return x + slopeMinusOne*(x - simdMin(simdMax(x, -th), th));
+}
+
+SIMD_KERNEL
+static void mixFloatSpan(float* __restrict__ mixBuff, float const* __restrict__ in, unsigned n, float gain, float th)
+{
+    float slopeMinusOne = (1-th)/(2-th) - 1;
+    
+    for (size_t i = 0; i < n; i++) {
+        mixBuff[i] = softClip(mixBuff[i] + in[i]*gain, th, slopeMinusOne);
+    }
+}
+
+SIMD_KERNEL
+static void mixS16Span(float* __restrict__ mixBuff, unsigned char const* __restrict__ in, unsigned n, float gain, float th)
+{
+    float slopeMinusOne = (1-th)/(2-th) - 1;
+    //NOTE: scaling by a power of two is exact, so it can be folded into the gain
+    float s16Gain = gain/32768.0f;
+    int16_t value;
+    
+    for (size_t i = 0; i < n; i++) {
+        //NOTE: samples are little endian whatever the host order is, like in bytesToFloat
+        value = (int16_t)(in[2*i] | in[2*i + 1] << 8);
+        mixBuff[i] = softClip(mixBuff[i] + value*s16Gain, th, slopeMinusOne);
+    }
+}
+
+SIMD_KERNEL
+static void accumulateSpan(float* __restrict__ mixBuff, float* __restrict__ contribution, 
+                           float const* __restrict__ in, unsigned n, float gain)
+{
+    float value;
+
+    if (!contribution) {
+        for (size_t i = 0; i < n; i++) {
+            mixBuff[i] += in[i]*gain;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        value = in[i]*gain;
+        contribution[i] += value;
+        mixBuff[i] += value;
+    }
+}
+
+SIMD_KERNEL
+static void reduceSpan(float* __restrict__ mixBuff, float* __restrict__ partial, unsigned n)
+{
+    for (size_t i = 0; i < n; i++) {
+        mixBuff[i] += partial[i];
+        partial[i] = 0;
+    }
+}
+
+SIMD_KERNEL
+static void clipSpan(float* __restrict__ dst, float const* __restrict__ mixBuff, 
+                     float const* __restrict__ contribution, unsigned n, float th)
+{
+    float slopeMinusOne = (1-th)/(2-th) - 1;
+
+    if (!contribution) {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = softClip(mixBuff[i], th, slopeMinusOne);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = softClip(mixBuff[i] - contribution[i], th, slopeMinusOne);
+    }
+}
+
+SIMD_REDUCTION_KERNEL
+static void measureSpan(float const* __restrict__ in, unsigned n, float &peak, float &sumSquares)
+{
+    float p = peak;
+    float s = sumSquares;
+
+    for (size_t i = 0; i < n; i++) {
+        p = simdMax(p, simdAbs(in[i]));
+        s += in[i]*in[i];
+    }
+
+    peak = p;
+    sumSquares = s;
+}
 
 AudioMixer::AudioMixer(int inputChannels) : 
-ManyToOneFilter(inputChannels), channels(DEFAULT_CHANNELS),
+ManyToManyFilter(inputChannels, inputChannels + 1), channels(DEFAULT_CHANNELS),
 sampleRate(DEFAULT_SAMPLE_RATE), sampleFormat(FLTP), maxMixingChannels(inputChannels),
 front(0), rear(0), masterGain(DEFAULT_MASTER_GAIN), th(COMPRESSION_THRESHOLD),
-syncTs(std::chrono::microseconds(-1))
+syncTs(std::chrono::microseconds(-1)), mixMinus(false), mixingGroups(1), bufferedFrames(AMIXER_BUFFERED_FRAMES),
+driftTarget(0)
 {
     fType = AUDIO_MIXER;
     inputFrameSamples = AudioFrame::getDefaultSamples(sampleRate);
-    outputSamples = inputFrameSamples;
-    mixBufferMaxSamples = inputFrameSamples*5;
-    mixingThreshold = inputFrameSamples*3;
+    fromFloat = SampleConverter::getFromFloatKernel(sampleFormat);
 
     for (int i = 0; i < MAX_CHANNELS; i++) {
-        mixBuffers[i] = new float[mixBufferMaxSamples]();
+        mixBuffers[i] = NULL;
     }
 
+    allocMixBuffers();
     initializeEventMap();
 }
 
 AudioMixer::~AudioMixer() 
 {
+    SpeakerActivity::getInstance()->remove(getId());
+
     for (int i = 0; i < MAX_CHANNELS; i++) {
-        delete mixBuffers[i];
+        delete[] mixBuffers[i];
     }
 }
 
@@ -62,62 +166,100 @@ FrameQueue *AudioMixer::allocQueue(ConnectionData cData)
                                             sampleFormat);
 }
 
-bool AudioMixer::doProcessFrame(std::map<int, Frame*> &orgFrames, Frame *dst, std::vector<int> newFrames) 
+bool AudioMixer::doProcessFrame(FrameMap &orgFrames, FrameMap &dstFrames, std::vector<int> &newFrames) 
 {
     AudioFrame* aFrame;
     AudioFrame* aDstFrame;
+    float const* contribution;
+    std::vector<std::pair<int, AudioFrame*>> frames;
 
     for (auto id : newFrames) {
         aFrame = dynamic_cast<AudioFrame*>(orgFrames[id]);
 
         if (!aFrame) {
-            utils::errorMsg("[AudioMixer] Input frames must be AudioFrames");
+            ERROR_MSG("[AudioMixer] Input frames must be AudioFrames");
             continue;
         }
 
+        if (mixingGroups > 1) {
+            frames.push_back(std::make_pair(id, aFrame));
+            continue;
+        }
 
         if (!pushToBuffer(id, aFrame)) {
-            utils::errorMsg("[AudioMixer] Error pushing samples to the internal buffer");
+            ERROR_MSG("[AudioMixer] Error pushing samples to the internal buffer");
             continue;
         }
     }
 
-    aDstFrame = dynamic_cast<AudioFrame*>(dst);
+    if (!frames.empty()) {
+        mixInGroups(frames);
+    }
 
-    if (!aDstFrame) {
-        utils::errorMsg("[AudioMixer] Output frame must be an AudioFrame");
-        return false;
+    //NOTE: levels are published as soon as they are measured, before the mix is complete
+    if (!newFrames.empty()) {
+        SpeakerActivity::getInstance()->publish(getId(), levels);
     }
 
-    if (!extractMixedFrame(aDstFrame)) {
+    if (rear - front < mixingThreshold) {
         return false;
     }
 
-    dst->setConsumed(true);
+    //NOTE: the full mix is built once, each mix-minus output only subtracts a contribution from it
+    for (auto it : dstFrames) {
+        aDstFrame = dynamic_cast<AudioFrame*>(it.second);
+
+        if (!aDstFrame) {
+            ERROR_MSG("[AudioMixer] Output frame must be an AudioFrame");
+            return false;
+        }
+
+        contribution = NULL;
+
+        if (mixMinus && contributions.count(it.first) > 0) {
+            contribution = contributions[it.first].data();
+        }
+
+        if (!extractMixedFrame(aDstFrame, contribution)) {
+            return false;
+        }
+
+        it.second->setConsumed(true);
+    }
+
+    releaseMixedSamples();
 
     return true;
 }
 
 bool AudioMixer::pushToBuffer(int mixChId, AudioFrame* frame) 
 {
-    unsigned char* b;
-    float* mixBuff;
-    float fSample;
-    SampleFmt fmt;
+    MixingInput input;
+
+    if (!placeFrame(mixChId, frame, input)) {
+        return false;
+    }
+
+    if (!mixFrame(input, mixBuffers)) {
+        return false;
+    }
+
+    levels[mixChId] = std::max(input.rms, levels[mixChId]*(float) LEVEL_DECAY);
+    return true;
+}
+
+bool AudioMixer::placeFrame(int mixChId, AudioFrame* frame, MixingInput &input)
+{
     unsigned nOfSamples;
-    int bytesPerSample;
     unsigned absolutePosition;
-    unsigned bufferIdx;
     unsigned freeSpaceInMixBuffer;
 
-    bytesPerSample = utils::getBytesPerSampleFromFormat(sampleFormat);
-    fmt = frame->getSampleFmt();
     nOfSamples = frame->getSamples();
 
     freeSpaceInMixBuffer = mixBufferMaxSamples - (rear - front);
 
     if (freeSpaceInMixBuffer < nOfSamples) {
-        utils::errorMsg("[AudioMixer] No free space in mixing buffer, discarding frame from channel " + std::to_string(mixChId));
+        ERROR_MSG("[AudioMixer] No free space in mixing buffer, discarding frame from channel %d", mixChId);
         return false;
     }
 
@@ -128,89 +270,398 @@ bool AudioMixer::pushToBuffer(int mixChId, AudioFrame* frame)
     absolutePosition = (frame->getPresentationTime() - syncTs).count()*sampleRate/std::micro::den;
 
     if (absolutePosition < front) {
-        utils::errorMsg("[AudioMixer] Samples from the past ignored");
+        ERROR_MSG("[AudioMixer] Samples from the past ignored");
         return false;
     }
 
     if (absolutePosition > front + mixBufferMaxSamples - nOfSamples) {
-        utils::errorMsg("[AudioMixer] Received frame exceeds buffer scope. Resyncing!");
+        ERROR_MSG("[AudioMixer] Received frame exceeds buffer scope. Resyncing!");
         front = 0;
         rear = 0;
         syncTs = frame->getPresentationTime();
         absolutePosition = front;
     }
 
+    if (mixMinus && contributions.count(mixChId) == 0) {
+        ERROR_MSG("[AudioMixer] No contribution buffer for channel %d", mixChId);
+        return false;
+    }
+
+    input.frame = frame;
+    input.position = absolutePosition;
+    input.gain = gains[mixChId]*masterGain;
+    input.contribution = mixMinus ? contributions[mixChId].data() : NULL;
+    input.rms = 0;
+    input.toFloat = toFloatKernels[mixChId];
+
+    //NOTE: silent or muted inputs only move the mixing window forward as well
+    if (absolutePosition + nOfSamples > rear) {
+        rear = absolutePosition + nOfSamples;
+    }
+
+    return true;
+}
+
+bool AudioMixer::mixFrame(MixingInput &input, float* const* dstBuffers)
+{
+    AudioFrame* frame = input.frame;
+    unsigned char* b;
+    float* mixBuff;
+    float* contribution;
+    SampleFmt fmt;
+    unsigned nOfSamples;
+    int bytesPerSample;
+    unsigned bufferIdx;
+    unsigned firstSpan;
+    unsigned stride;
+    float peak;
+
+    fmt = frame->getSampleFmt();
+    bytesPerSample = utils::getBytesPerSampleFromFormat(fmt);
+    nOfSamples = frame->getSamples();
+    bufferIdx = input.position % mixBufferMaxSamples;
+
+    if (!measureFrame(frame, peak, input.rms, input.toFloat)) {
+        ERROR_MSG("[AudioMixer] Error measuring samples level");
+        return false;
+    }
+
+    if (peak*input.gain < SILENCE_THRESHOLD) {
+        return true;
+    }
+    
+    //NOTE: the span is split once at most, where the mixing ring wraps
+    firstSpan = std::min(nOfSamples, mixBufferMaxSamples - bufferIdx);
+
+    stride = frame->isPlanar() ? 1 : channels;
+
     for (int i = 0; i < channels; i++) {
 
-        b = frame->getPlanarDataBuf()[i];
-        bufferIdx = absolutePosition % mixBufferMaxSamples;
-        mixBuff = mixBuffers[i];
+        b = frame->isPlanar() ? frame->getPlanarDataBuf()[i] : frame->getDataBuf() + i*bytesPerSample;
+        mixBuff = dstBuffers[i];
 
-        for (unsigned j = 0; j < nOfSamples; j++) {
+        if (linearMixing()) {
+            contribution = input.contribution ? input.contribution + i*mixBufferMaxSamples : NULL;
 
-            if (!bytesToFloat(b + j*bytesPerSample, fSample, fmt)) {
-                utils::errorMsg("[AudioMixer] Error converting samples from bytes to float");
+            if (!accumulateSamples(mixBuff + bufferIdx, contribution ? contribution + bufferIdx : NULL, b, firstSpan, 
+                                   fmt, input.gain, stride, input.toFloat) ||
+                !accumulateSamples(mixBuff, contribution, b + firstSpan*stride*bytesPerSample, 
+                                   nOfSamples - firstSpan, fmt, input.gain, stride, input.toFloat)) {
+                ERROR_MSG("[AudioMixer] Error converting samples from bytes to float");
                 return false;
             }
 
-            mixSample(fSample, mixBuff, bufferIdx, gains[mixChId]);
-            bufferIdx = (bufferIdx + 1) % mixBufferMaxSamples;
+            continue;
+        }
+
+        if (!mixSamples(mixBuff + bufferIdx, b, firstSpan, fmt, input.gain, th, stride, input.toFloat) ||
+            !mixSamples(mixBuff, b + firstSpan*stride*bytesPerSample, nOfSamples - firstSpan, 
+                        fmt, input.gain, th, stride, input.toFloat)) {
+            ERROR_MSG("[AudioMixer] Error converting samples from bytes to float");
+            return false;
         }
     }
 
-    if (absolutePosition + nOfSamples > rear) {
-        rear = absolutePosition + nOfSamples;
+    return true;
+}
+
+void AudioMixer::mixInGroups(std::vector<std::pair<int, AudioFrame*>> &frames)
+{
+    std::vector<MixingInput> inputs;
+    std::vector<int> ids;
+    std::vector<unsigned> windowStart(mixingGroups);
+    std::vector<unsigned> windowEnd(mixingGroups);
+    WorkersPool* pool;
+    MixingInput input;
+    unsigned groups;
+    unsigned pos;
+    unsigned len;
+    unsigned firstSpan;
+    float* partial;
+
+    //NOTE: groups mix linearly, see setMixingGroups for how it differs from the serial mix over the threshold
+    //      placing the frames moves the mixing window, so it is done before splitting them
+    for (auto f : frames) {
+        if (!placeFrame(f.first, f.second, input)) {
+            ERROR_MSG("[AudioMixer] Error pushing samples to the internal buffer");
+            continue;
+        }
+
+        inputs.push_back(input);
+        ids.push_back(f.first);
+    }
+
+    if (inputs.empty()) {
+        return;
+    }
+
+    groups = std::min(mixingGroups, (unsigned) inputs.size());
+
+    for (unsigned k = 0; k < inputs.size(); k++) {
+        if (k < groups) {
+            windowStart[k] = inputs[k].position;
+            windowEnd[k] = inputs[k].position;
+        }
+
+        windowStart[k % groups] = std::min(windowStart[k % groups], inputs[k].position);
+        windowEnd[k % groups] = std::max(windowEnd[k % groups], inputs[k].position + inputs[k].frame->getSamples());
+    }
+
+    auto mixGroup = [&](unsigned g) {
+        float* dstBuffers[MAX_CHANNELS];
+
+        for (int i = 0; i < channels; i++) {
+            dstBuffers[i] = g == 0 ? mixBuffers[i] : partialBuffers[g - 1].data() + i*mixBufferMaxSamples;
+        }
+
+        //NOTE: mixFrame reports its own errors, a failed input does not stop its group
+        for (unsigned k = g; k < inputs.size(); k += groups) {
+            mixFrame(inputs[k], dstBuffers);
+        }
+    };
+
+    pool = WorkersPool::current();
+
+    if (pool) {
+        pool->parallelFor(groups, mixGroup);
+    } else {
+        for (unsigned g = 0; g < groups; g++) {
+            mixGroup(g);
+        }
+    }
+
+    //NOTE: partial buffers are added only over the samples their group wrote, and zeroed afterwards
+    for (unsigned g = 1; g < groups; g++) {
+        len = std::min(windowEnd[g] - windowStart[g], mixBufferMaxSamples);
+        pos = windowStart[g] % mixBufferMaxSamples;
+        firstSpan = std::min(len, mixBufferMaxSamples - pos);
+
+        for (int i = 0; i < channels; i++) {
+            partial = partialBuffers[g - 1].data() + i*mixBufferMaxSamples;
+            reduceSpan(mixBuffers[i] + pos, partial + pos, firstSpan);
+            reduceSpan(mixBuffers[i], partial, len - firstSpan);
+        }
+    }
+
+    for (unsigned k = 0; k < inputs.size(); k++) {
+        levels[ids[k]] = std::max(inputs[k].rms, levels[ids[k]]*(float) LEVEL_DECAY);
+    }
+}
+
+bool AudioMixer::mixSamples(float* mixBuff, unsigned char const* samples, unsigned nOfSamples, 
+                            SampleFmt fmt, float gain, float th, unsigned stride, 
+                            SampleConverter::ToFloatKernel toFloat)
+{
+    float block[CONVERSION_BLOCK];
+    int bytesPerSample;
+    unsigned len;
+
+    if (stride == 1 && (fmt == FLTP || fmt == FLT)) {
+        mixFloatSpan(mixBuff, (float const*) samples, nOfSamples, gain, th);
+        return true;
+    }
+
+    if (stride == 1 && (fmt == S16P || fmt == S16)) {
+        mixS16Span(mixBuff, samples, nOfSamples, gain, th);
+        return true;
+    }
+
+    //NOTE: other formats and interleaved channels are converted to float by blocks first
+    if (!toFloat && !(toFloat = SampleConverter::getToFloatKernel(fmt, stride))) {
+        return false;
+    }
+
+    bytesPerSample = utils::getBytesPerSampleFromFormat(fmt);
+
+    for (unsigned done = 0; done < nOfSamples; done += len) {
+        len = std::min(nOfSamples - done, (unsigned) CONVERSION_BLOCK);
+
+        toFloat(samples + done*stride*bytesPerSample, block, len, stride);
+
+        mixFloatSpan(mixBuff + done, block, len, gain, th);
     }
 
     return true;
 }
 
-void AudioMixer::mixSample(float sample, float* mixBuff, int bufferIdx, float gain)
+bool AudioMixer::mixSamplesScalar(float* mixBuff, unsigned char const* samples, unsigned nOfSamples, 
+                                  SampleFmt fmt, float gain, float th, unsigned stride)
 {
-    mixBuff[bufferIdx] += sample*gain*masterGain;
+    int bytesPerSample = utils::getBytesPerSampleFromFormat(fmt);
+    float sample;
+
+    for (unsigned j = 0; j < nOfSamples; j++) {
+
+        if (!bytesToFloat(samples + j*stride*bytesPerSample, sample, fmt)) {
+            return false;
+        }
+
+        mixBuff[j] += sample*gain;
+
+        if (mixBuff[j] > th) {
+            mixBuff[j] = ((1-th)/(2-th))*mixBuff[j] + th/(2-th);
+        } else if (mixBuff[j] < -th) {
+            mixBuff[j] = ((1-th)/(2-th))*mixBuff[j] - th/(2-th);
+        } 
+    }
 
-    if (mixBuff[bufferIdx] > th) {
-        mixBuff[bufferIdx] = ((1-th)/(2-th))*mixBuff[bufferIdx] + th/(2-th);
-    } else if (mixBuff[bufferIdx] < -th) {
-        mixBuff[bufferIdx] = ((1-th)/(2-th))*mixBuff[bufferIdx] - th/(2-th);
-    } 
+    return true;
+}
+
+bool AudioMixer::measureFrame(AudioFrame* frame, float &peak, float &rms, SampleConverter::ToFloatKernel toFloat)
+{
+    SampleFmt fmt = frame->getSampleFmt();
+    unsigned stride = frame->isPlanar() ? 1 : frame->getChannels();
+    int bytesPerSample = utils::getBytesPerSampleFromFormat(fmt);
+    unsigned char* b;
+    float sumSquares = 0;
+
+    peak = 0;
+    rms = 0;
+
+    if (frame->getSamples() == 0 || frame->getChannels() == 0) {
+        return true;
+    }
+
+    for (unsigned i = 0; i < frame->getChannels(); i++) {
+        b = frame->isPlanar() ? frame->getPlanarDataBuf()[i] : frame->getDataBuf() + i*bytesPerSample;
+
+        if (!measureSamples(b, frame->getSamples(), fmt, peak, sumSquares, stride, toFloat)) {
+            return false;
+        }
+    }
+
+    rms = std::sqrt(sumSquares/(frame->getSamples()*frame->getChannels()));
+    return true;
+}
+
+bool AudioMixer::measureSamples(unsigned char const* samples, unsigned nOfSamples, SampleFmt fmt, 
+                                float &peak, float &sumSquares, unsigned stride, 
+                                SampleConverter::ToFloatKernel toFloat)
+{
+    float block[CONVERSION_BLOCK];
+    int bytesPerSample;
+    unsigned len;
+
+    if (stride == 1 && (fmt == FLTP || fmt == FLT)) {
+        measureSpan((float const*) samples, nOfSamples, peak, sumSquares);
+        return true;
+    }
+
+    if (!toFloat && !(toFloat = SampleConverter::getToFloatKernel(fmt, stride))) {
+        return false;
+    }
+
+    bytesPerSample = utils::getBytesPerSampleFromFormat(fmt);
+
+    for (unsigned done = 0; done < nOfSamples; done += len) {
+        len = std::min(nOfSamples - done, (unsigned) CONVERSION_BLOCK);
+
+        toFloat(samples + done*stride*bytesPerSample, block, len, stride);
+
+        measureSpan(block, len, peak, sumSquares);
+    }
+
+    return true;
 }
 
-bool AudioMixer::extractMixedFrame(AudioFrame* frame)
+bool AudioMixer::accumulateSamples(float* mixBuff, float* contribution, unsigned char const* samples, 
+                                   unsigned nOfSamples, SampleFmt fmt, float gain, unsigned stride, 
+                                   SampleConverter::ToFloatKernel toFloat)
+{
+    float block[CONVERSION_BLOCK];
+    int bytesPerSample;
+    unsigned len;
+
+    if (stride == 1 && (fmt == FLTP || fmt == FLT)) {
+        accumulateSpan(mixBuff, contribution, (float const*) samples, nOfSamples, gain);
+        return true;
+    }
+
+    if (!toFloat && !(toFloat = SampleConverter::getToFloatKernel(fmt, stride))) {
+        return false;
+    }
+
+    bytesPerSample = utils::getBytesPerSampleFromFormat(fmt);
+
+    for (unsigned done = 0; done < nOfSamples; done += len) {
+        len = std::min(nOfSamples - done, (unsigned) CONVERSION_BLOCK);
+
+        toFloat(samples + done*stride*bytesPerSample, block, len, stride);
+
+        accumulateSpan(mixBuff + done, contribution + done, block, len, gain);
+    }
+
+    return true;
+}
+
+bool AudioMixer::mixMinusSamples(float const* mixBuff, float const* contribution, unsigned char* dst, 
+                                 unsigned nOfSamples, SampleFmt fmt, float th, 
+                                 SampleConverter::FromFloatKernel fromFloat)
+{
+    float block[CONVERSION_BLOCK];
+    int bytesPerSample;
+    unsigned len;
+
+    if (!fromFloat && !(fromFloat = SampleConverter::getFromFloatKernel(fmt))) {
+        return false;
+    }
+
+    bytesPerSample = utils::getBytesPerSampleFromFormat(fmt);
+
+    for (unsigned done = 0; done < nOfSamples; done += len) {
+        len = std::min(nOfSamples - done, (unsigned) CONVERSION_BLOCK);
+
+        clipSpan(block, mixBuff + done, contribution ? contribution + done : NULL, len, th);
+
+        fromFloat(block, dst + done*bytesPerSample, len, 1);
+    }
+
+    return true;
+}
+
+bool AudioMixer::extractMixedFrame(AudioFrame* frame, float const* contribution)
 {
-    unsigned mixedElements = rear - front;
     unsigned pos;
+    unsigned firstSpan;
     unsigned char* b;
     float *mixB;
+    float const* contrib;
     std::chrono::microseconds ts;
     unsigned bytesPerSample;
 
-    if (mixedElements < mixingThreshold) {
-        return false;
-    }
-
     bytesPerSample = utils::getBytesPerSampleFromFormat(sampleFormat);
 
-    if (bytesPerSample <= 0) {
-        utils::errorMsg("[AudioMixer] Only S16P and FLTP sample formats are supported");
+    if (bytesPerSample <= 0 || !fromFloat || !frame->isPlanar()) {
+        utils::errorMsg("[AudioMixer] Only planar sample formats are supported");
         return false;
     }
 
+    pos = front % mixBufferMaxSamples;
+    firstSpan = std::min(outputSamples, mixBufferMaxSamples - pos);
+
     for (int i = 0; i < channels; i++) {
 
         b = frame->getPlanarDataBuf()[i];
-        pos = front % mixBufferMaxSamples;
         mixB = mixBuffers[i];
 
-        for (unsigned j = 0; j < outputSamples; j++) {
+        //NOTE: with linear mixing the buffer is not compressed yet, it is done when extracting each output
+        if (linearMixing()) {
+            contrib = contribution ? contribution + i*mixBufferMaxSamples : NULL;
 
-            if (!floatToBytes(b + j*bytesPerSample, mixB[(pos+j)%mixBufferMaxSamples], sampleFormat)) {
-                utils::errorMsg("[AudioMixer] Error converting samples from bytes to float");
+            if (!mixMinusSamples(mixB + pos, contrib ? contrib + pos : NULL, b, firstSpan, sampleFormat, th, fromFloat) ||
+                !mixMinusSamples(mixB, contrib, b + firstSpan*bytesPerSample, outputSamples - firstSpan, 
+                                 sampleFormat, th, fromFloat)) {
+                ERROR_MSG("[AudioMixer] Error converting samples from float to bytes");
                 return false;
             }
 
-            mixB[(pos+j)%mixBufferMaxSamples] = 0;
+            continue;
         }
+
+        //NOTE: as when mixing, the span is split once at most where the ring wraps
+        fromFloat(mixB + pos, b, firstSpan, 1);
+        fromFloat(mixB, b + firstSpan*bytesPerSample, outputSamples - firstSpan, 1);
     }
 
     ts = std::chrono::microseconds(front * std::micro::den/sampleRate) + syncTs;
@@ -221,52 +672,47 @@ bool AudioMixer::extractMixedFrame(AudioFrame* frame)
     frame->setChannels(channels);
     frame->setSampleRate(sampleRate);
 
-    front += outputSamples;
     return true;
 }
 
-bool AudioMixer::bytesToFloat(unsigned char const* origin, float &dst, SampleFmt fmt) 
+void AudioMixer::releaseMixedSamples()
 {
-    short value;
-
-    switch(fmt) {
-        case S16P:
-            value = (short)(*origin | *(origin+1) << 8);
-            dst = value / 32768.0f;
-            break;
-        case FLTP:
-            dst = *(float*)(origin);
-             break;
-        default:
-            return false;
+    unsigned pos;
+    unsigned firstSpan;
+    float* contribution;
+
+    pos = front % mixBufferMaxSamples;
+    firstSpan = std::min(outputSamples, mixBufferMaxSamples - pos);
+
+    for (int i = 0; i < channels; i++) {
+        memset(mixBuffers[i] + pos, 0, firstSpan*sizeof(float));
+        memset(mixBuffers[i], 0, (outputSamples - firstSpan)*sizeof(float));
+
+        for (auto& it : contributions) {
+            contribution = it.second.data() + i*mixBufferMaxSamples;
+            memset(contribution + pos, 0, firstSpan*sizeof(float));
+            memset(contribution, 0, (outputSamples - firstSpan)*sizeof(float));
+        }
     }
 
-    return true;
+    front += outputSamples;
 }
 
-bool AudioMixer::floatToBytes(unsigned char* dst, float const origin, SampleFmt fmt) 
+bool AudioMixer::bytesToFloat(unsigned char const* origin, float &dst, SampleFmt fmt) 
 {
-    short value;
-
-    switch(fmt) {
-        case S16P:
-            value = origin * 32768.0;
-            *dst = value & 0xFF; 
-            *(dst+1) = (value >> 8) & 0xFF;
-            break;
-        case FLTP:
-            memcpy(dst, &origin, utils::getBytesPerSampleFromFormat(fmt));
-            break;
-        default:
-            return false;
-    }
+    return SampleConverter::toFloat(origin, fmt, &dst, 1);
+}
 
-    return true;
+bool AudioMixer::floatToBytes(unsigned char* dst, float const origin, SampleFmt fmt) 
+{
+    return SampleConverter::fromFloat(&origin, dst, fmt, 1);
 }
 
 bool AudioMixer::specificReaderConfig(int readerID, FrameQueue* queue)
 {
     AudioCircularBuffer* inBuffer;
+    const StreamInfo* si;
+    SampleConverter::ToFloatKernel toFloat;
 
     inBuffer = dynamic_cast<AudioCircularBuffer*>(queue);
 
@@ -275,15 +721,37 @@ bool AudioMixer::specificReaderConfig(int readerID, FrameQueue* queue)
         return NULL;
     }
 
+    //NOTE: the buffer delivers frames of its own format, so the kernel reading them is fixed for the channel
+    si = inBuffer->getStreamInfo();
+    toFloat = SampleConverter::getToFloatKernel(si->audio.sampleFormat, 
+                                                SampleConverter::isPlanar(si->audio.sampleFormat) ? 1 : si->audio.channels);
+
+    if (!toFloat) {
+        utils::errorMsg("[AudioMixer] Error setting reader: sample format not supported");
+        return false;
+    }
+
+    toFloatKernels[readerID] = toFloat;
+
     inBuffer->setOutputFrameSamples(inputFrameSamples);
+    inBuffer->setDriftCompensation(driftTarget);
 
     gains[readerID] = DEFAULT_CHANNEL_GAIN;
+    levels[readerID] = 0;
+
+    if (mixMinus) {
+        contributions[readerID].assign(channels*mixBufferMaxSamples, 0);
+    }
 
     return true;
 }
 
 bool AudioMixer::specificReaderDelete(int readerID)
 {
+    contributions.erase(readerID);
+    levels.erase(readerID);
+    toFloatKernels.erase(readerID);
+
     if (gains.count(readerID) > 0){
         gains.erase(readerID);
         return true;
@@ -291,6 +759,30 @@ bool AudioMixer::specificReaderDelete(int readerID)
     return false;
 }
 
+float AudioMixer::getChannelLevel(int id)
+{
+    if (levels.count(id) <= 0) {
+        return 0;
+    }
+
+    return levels[id];
+}
+
+int AudioMixer::getActiveSpeaker()
+{
+    int speaker = -1;
+    float level = SILENCE_THRESHOLD;
+
+    for (auto it : levels) {
+        if (it.second >= level) {
+            speaker = it.first;
+            level = it.second;
+        }
+    }
+
+    return speaker;
+}
+
 bool AudioMixer::setChannelGain(int id, float value)
 {
     if (gains.count(id) <= 0) {
@@ -395,6 +887,188 @@ bool AudioMixer::muteMasterEvent(Jzon::Node* params)
     return true;
 }
 
+bool AudioMixer::mixMinusEvent(Jzon::Node* params)
+{
+    bool enable;
+
+    if (!params) {
+        return false;
+    }
+
+    if (!params->Has("enable") || !params->Get("enable").IsBool()) {
+        return false;
+    }
+
+    enable = params->Get("enable").ToBool();
+
+    if (enable == mixMinus) {
+        return true;
+    }
+
+    //NOTE: samples already in the mixing buffer were mixed in the previous mode, 
+    //      which only affects the current mixing window
+    contributions.clear();
+
+    if (enable) {
+        for (auto it : gains) {
+            contributions[it.first].assign(channels*mixBufferMaxSamples, 0);
+        }
+    }
+
+    mixMinus = enable;
+    return true;
+}
+
+bool AudioMixer::configEvent(Jzon::Node* params)
+{
+    int newChannels;
+
+    if (!params) {
+        return false;
+    }
+
+    if (!params->Has("channels") || !params->Get("channels").IsNumber()) {
+        return false;
+    }
+
+    newChannels = params->Get("channels").ToInt();
+
+    if (newChannels <= 0 || newChannels > MAX_CHANNELS) {
+        utils::errorMsg("[AudioMixer] Up to " + std::to_string(MAX_CHANNELS) + " channels are supported");
+        return false;
+    }
+
+    //NOTE: input queues are created with the mixing channels, so they cannot change afterwards
+    if (!gains.empty()) {
+        utils::errorMsg("[AudioMixer] Channels cannot be changed with connected mixing channels");
+        return false;
+    }
+
+    channels = newChannels;
+    allocPartialBuffers();
+    return true;
+}
+
+bool AudioMixer::configFramingEvent(Jzon::Node* params)
+{
+    int frameTime;
+    int frames = bufferedFrames;
+
+    if (!params) {
+        return false;
+    }
+
+    if (!params->Has("frameTime") || !params->Get("frameTime").IsNumber()) {
+        return false;
+    }
+
+    frameTime = params->Get("frameTime").ToInt();
+
+    if (params->Has("bufferedFrames") && params->Get("bufferedFrames").IsNumber()) {
+        frames = params->Get("bufferedFrames").ToInt();
+    }
+
+    if (frameTime < MIN_FRAME_TIME || frameTime > MAX_FRAME_TIME*1000 || 
+        frames < 1 || frames > AMIXER_MAX_BUFFERED_FRAMES) {
+        utils::errorMsg("[AudioMixer] Invalid framing, frame time or buffered frames out of range");
+        return false;
+    }
+
+    //NOTE: input buffers are created requesting the mixer frames, so they cannot change afterwards
+    if (!gains.empty()) {
+        utils::errorMsg("[AudioMixer] Framing cannot be changed with connected mixing channels");
+        return false;
+    }
+
+    inputFrameSamples = ((long long) frameTime*sampleRate)/1000000;
+    bufferedFrames = frames;
+    allocMixBuffers();
+    return true;
+}
+
+bool AudioMixer::mixingGroupsEvent(Jzon::Node* params)
+{
+    int groups;
+
+    if (!params) {
+        return false;
+    }
+
+    if (!params->Has("groups") || !params->Get("groups").IsNumber()) {
+        return false;
+    }
+
+    groups = params->Get("groups").ToInt();
+
+    if (groups <= 0 || groups > AMIXER_MAX_GROUPS) {
+        utils::errorMsg("[AudioMixer] Up to " + std::to_string(AMIXER_MAX_GROUPS) + " mixing groups are supported");
+        return false;
+    }
+
+    //NOTE: as with mix-minus, samples already in the mixing buffer were mixed in the previous mode
+    mixingGroups = groups;
+    allocPartialBuffers();
+    return true;
+}
+
+bool AudioMixer::driftCompensationEvent(Jzon::Node* params)
+{
+    std::shared_ptr<Reader> reader;
+    AudioCircularBuffer* inBuffer;
+    int target;
+
+    if (!params) {
+        return false;
+    }
+
+    if (!params->Has("target") || !params->Get("target").IsNumber()) {
+        return false;
+    }
+
+    target = params->Get("target").ToInt();
+
+    if (target < 0) {
+        utils::errorMsg("[AudioMixer] Drift compensation target cannot be negative");
+        return false;
+    }
+
+    driftTarget = target*sampleRate/1000;
+
+    //NOTE: events are processed by the mixer, the reader of these buffers
+    for (auto it : gains) {
+        reader = getReader(it.first);
+        inBuffer = reader ? dynamic_cast<AudioCircularBuffer*>(reader->getQueue()) : NULL;
+
+        if (inBuffer) {
+            inBuffer->setDriftCompensation(driftTarget);
+        }
+    }
+
+    return true;
+}
+
+//NOTE: the mixing buffer keeps two frames more than the buffered ones, so late inputs still fit in
+void AudioMixer::allocMixBuffers()
+{
+    outputSamples = inputFrameSamples;
+    mixBufferMaxSamples = inputFrameSamples*(bufferedFrames + 2);
+    mixingThreshold = inputFrameSamples*bufferedFrames;
+    front = 0;
+    rear = 0;
+
+    for (int i = 0; i < MAX_CHANNELS; i++) {
+        delete[] mixBuffers[i];
+        mixBuffers[i] = new float[mixBufferMaxSamples]();
+    }
+
+    allocPartialBuffers();
+}
+
+void AudioMixer::allocPartialBuffers()
+{
+    partialBuffers.assign(mixingGroups - 1, std::vector<float>(channels*mixBufferMaxSamples, 0));
+}
+
 bool AudioMixer::changeChannelGain(int id, float value)
 {
     Jzon::Object root, params;
@@ -454,6 +1128,67 @@ bool AudioMixer::muteMaster()
     return true;
 }
 
+bool AudioMixer::configure(int channels)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configure");
+    params.Add("channels", channels);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool AudioMixer::configFraming(unsigned frameTime, unsigned bufferedFrames)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configFraming");
+    params.Add("frameTime", (int) frameTime);
+    params.Add("bufferedFrames", (int) bufferedFrames);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool AudioMixer::setMixMinus(bool enable)
+{
+    Jzon::Object root, params;
+    root.Add("action", "mixMinus");
+    params.Add("enable", enable);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool AudioMixer::setDriftCompensation(unsigned targetMs)
+{
+    Jzon::Object root, params;
+    root.Add("action", "driftCompensation");
+    params.Add("target", (int) targetMs);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool AudioMixer::setMixingGroups(unsigned groups)
+{
+    Jzon::Object root, params;
+    root.Add("action", "mixingGroups");
+    params.Add("groups", (int) groups);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
 void AudioMixer::initializeEventMap()
 {
     eventMap["changeChannelGain"] = std::bind(&AudioMixer::changeChannelVolumeEvent,
@@ -470,24 +1205,54 @@ void AudioMixer::initializeEventMap()
 
     eventMap["muteMaster"] = std::bind(&AudioMixer::muteMasterEvent, this,
                                         std::placeholders::_1);
+
+    eventMap["mixMinus"] = std::bind(&AudioMixer::mixMinusEvent, this,
+                                      std::placeholders::_1);
+
+    eventMap["configure"] = std::bind(&AudioMixer::configEvent, this,
+                                       std::placeholders::_1);
+
+    eventMap["mixingGroups"] = std::bind(&AudioMixer::mixingGroupsEvent, this,
+                                          std::placeholders::_1);
+
+    eventMap["driftCompensation"] = std::bind(&AudioMixer::driftCompensationEvent, this,
+                                               std::placeholders::_1);
+
+    eventMap["configFraming"] = std::bind(&AudioMixer::configFramingEvent, this,
+                                           std::placeholders::_1);
 }
 
 void AudioMixer::doGetState(Jzon::Object &filterNode)
 {
     Jzon::Array jsonGains;
+    std::shared_ptr<Reader> reader;
+    AudioCircularBuffer* inBuffer;
 
     filterNode.Add("channels", channels);
+    filterNode.Add("channelLayout", utils::getChannelLayoutAsString(utils::getDefaultChannelLayout(channels)));
     filterNode.Add("sampleRate", sampleRate);
     filterNode.Add("sampleFormat", utils::getSampleFormatAsString(sampleFormat));
     filterNode.Add("maxChannels", maxMixingChannels);
     filterNode.Add("masterGain", masterGain);
+    filterNode.Add("mixMinus", mixMinus);
+    filterNode.Add("mixingGroups", (int) mixingGroups);
+    filterNode.Add("driftCompensation", (int) (driftTarget*1000/sampleRate));
+    filterNode.Add("frameTime", (int) (((long long) inputFrameSamples*1000000)/sampleRate));
+    filterNode.Add("bufferedFrames", (int) bufferedFrames);
 
     for (auto it : gains) {
         Jzon::Object gain;
         gain.Add("id", it.first);
         gain.Add("gain", it.second);
+        gain.Add("level", getChannelLevel(it.first));
+        gain.Add("active", getChannelLevel(it.first) >= SILENCE_THRESHOLD);
+
+        reader = getReader(it.first);
+        inBuffer = reader ? dynamic_cast<AudioCircularBuffer*>(reader->getQueue()) : NULL;
+        gain.Add("driftPpm", inBuffer ? (inBuffer->getDriftRatio() - 1)*1e6 : 0);
         jsonGains.Add(gain);
     }
 
     filterNode.Add("gains", jsonGains);
+    filterNode.Add("activeSpeaker", getActiveSpeaker());
 }
\ No newline at end of file
@@ -26,22 +26,49 @@
 #include "../../Frame.hh"
 #include "../../Filter.hh"
 #include "../../AudioFrame.hh"
+#include "../../SampleConverter.hh"
 
 #define COMPRESSION_THRESHOLD 0.6
 #define DEFAULT_MASTER_GAIN 0.6
 #define DEFAULT_CHANNEL_GAIN 1.0
 #define AMIXER_MAX_CHANNELS 16
+#define SILENCE_THRESHOLD 0.001     //!< Peak under which an input frame is not mixed, around -60 dBFS
+#define LEVEL_DECAY 0.8             //!< Per frame decay of the channel levels, it avoids activity flickering in speech pauses
+#define AMIXER_MAX_GROUPS 16        //!< Maximum number of input groups mixed in parallel
+#define AMIXER_BUFFERED_FRAMES 3    //!< Input frames buffered before the first frame is mixed
+#define AMIXER_MAX_BUFFERED_FRAMES 8
 
 /*! Filter that mixes different audio frames in one frame. Each mixing channel is 
 *   identified by and Id which coincides with the reader associated to it. 
+*   In mix-minus mode the writers whose Id coincides with a mixing channel get the mix 
+*   without that channel (N-1), obtained subtracting its contribution from the full mix. 
+*   The rest of the writers get the full mix.
+*   Inputs can be split in groups which are mixed in parallel by the pool workers, each one in its
+*   own partial buffer, and then added up. With groups or mix-minus the inputs are added linearly 
+*   and the compression is applied once, when extracting the mixed frames.
+*   The channel levels are published on every processed frame, see SpeakerActivity, so video mixers
+*   follow the active speaker without polling the mixer state.
+*   With drift compensation the input buffers resample the inputs to the mixer clock, keeping them at
+*   a fixed depth, see AudioCircularBuffer::setDriftCompensation. It is meant for periodic mixers, which
+*   read their inputs at their own pace.
 */
 
-class AudioMixer : public ManyToOneFilter {
+/*! Input frame placed in the mixing buffer, pending to be mixed */
+struct MixingInput {
+    AudioFrame* frame;
+    unsigned position;      //!< Absolute position in the mixing buffer of the first sample
+    float gain;             //!< Channel gain already multiplied by the master gain
+    float* contribution;    //!< Contribution buffer of the mixing channel, NULL if not in mix-minus mode
+    float rms;              //!< Level of the frame, set when mixing it
+    SampleConverter::ToFloatKernel toFloat;     //!< Kernel of the mixing channel format, selected when configuring it
+};
+
+class AudioMixer : public ManyToManyFilter {
 
 public:
     /**
     * Class constructor
-    * @param inputChannels Max mixing channels
+    * @param inputChannels Max mixing channels, there can be as many writers plus one for the full mix
     */
     AudioMixer(int inputChannels = AMIXER_MAX_CHANNELS);
 
@@ -54,7 +81,7 @@ public:
     * It converts a sample from its bytes representation to its float representation
     * @param origin (in) Pointer to sample bytes
     * @param dst (out) Float value
-    * @param fmt (in) Sample format (only S16P and FLTP are supported)
+    * @param fmt (in) Sample format, see SampleConverter
     * @return true on success and false if not
     */
     static bool bytesToFloat(unsigned char const* origin, float &dst, SampleFmt fmt);
@@ -63,11 +90,82 @@ public:
     * It converts a sample from its float reapresentation to its bytes representation
     * @param dst (out) Pointer to the sample buffer
     * @param origin (in) Float sample value
-    * @param fmt (in) Sample format (only S16P and FLTP are supported)
+    * @param fmt (in) Sample format, see SampleConverter
     * @return true on success and false if not
     */ 
     static bool floatToBytes(unsigned char* dst, float const origin, SampleFmt fmt);
 
+    /**
+    * It mixes a contiguous span of samples into a mixing buffer, applying the gain and the soft clipping 
+    * of the compression algorithm. Spans are processed in blocks the compiler vectorises (AVX2 or SSE4 
+    * chosen at runtime on x86, NEON on ARM).
+    * @param mixBuff (in/out) Mixing buffer position of the first sample
+    * @param samples (in) Pointer to the first sample bytes
+    * @param nOfSamples (in) Number of samples of the span
+    * @param fmt (in) Sample format, see SampleConverter
+    * @param gain (in) Channel gain already multiplied by the master gain
+    * @param th (in) Compression threshold
+    * @param stride (in) Distance in samples between two samples of the span, the channels of interleaved formats
+    * @param toFloat (in) Kernel for the format and stride, selected from them if NULL
+    * @return true on success and false if not
+    */
+    static bool mixSamples(float* mixBuff, unsigned char const* samples, unsigned nOfSamples, 
+                           SampleFmt fmt, float gain, float th, unsigned stride = 1, 
+                           SampleConverter::ToFloatKernel toFloat = NULL);
+
+    /**
+    * Sample by sample implementation of mixSamples, kept as its reference
+    */
+    static bool mixSamplesScalar(float* mixBuff, unsigned char const* samples, unsigned nOfSamples, 
+                                 SampleFmt fmt, float gain, float th, unsigned stride = 1);
+
+    /**
+    * It adds a contiguous span of samples to a mixing buffer without compression, keeping 
+    * the gained samples in the contribution buffer of the mixing channel if any.
+    * @param mixBuff (in/out) Mixing buffer position of the first sample
+    * @param contribution (in/out) Contribution buffer position of the first sample or NULL
+    * @param samples (in) Pointer to the first sample bytes
+    * @param nOfSamples (in) Number of samples of the span
+    * @param fmt (in) Sample format, see SampleConverter
+    * @param gain (in) Channel gain already multiplied by the master gain
+    * @param stride (in) Distance in samples between two samples of the span
+    * @param toFloat (in) Kernel for the format and stride, selected from them if NULL
+    * @return true on success and false if not
+    */
+    static bool accumulateSamples(float* mixBuff, float* contribution, unsigned char const* samples, 
+                                  unsigned nOfSamples, SampleFmt fmt, float gain, unsigned stride = 1, 
+                                  SampleConverter::ToFloatKernel toFloat = NULL);
+
+    /**
+    * It compresses a span of the mixing buffer, subtracting a contribution if any, and converts it to bytes
+    * @param mixBuff (in) Mixing buffer position of the first sample
+    * @param contribution (in) Contribution buffer position of the first sample or NULL for the full mix
+    * @param dst (out) Pointer to the first sample bytes
+    * @param nOfSamples (in) Number of samples of the span
+    * @param fmt (in) Sample format, see SampleConverter
+    * @param th (in) Compression threshold
+    * @param fromFloat (in) Kernel for the format, selected from it if NULL
+    * @return true on success and false if not
+    */
+    static bool mixMinusSamples(float const* mixBuff, float const* contribution, unsigned char* dst, 
+                                unsigned nOfSamples, SampleFmt fmt, float th, 
+                                SampleConverter::FromFloatKernel fromFloat = NULL);
+
+    /**
+    * It measures the peak and the energy of a span of samples
+    * @param samples (in) Pointer to the first sample bytes
+    * @param nOfSamples (in) Number of samples of the span
+    * @param fmt (in) Sample format, see SampleConverter
+    * @param peak (in/out) Maximum absolute sample value, updated with the span ones
+    * @param sumSquares (in/out) Sum of the squared sample values, the span ones are added
+    * @param stride (in) Distance in samples between two samples of the span
+    * @param toFloat (in) Kernel for the format and stride, selected from them if NULL
+    * @return true on success and false if not
+    */
+    static bool measureSamples(unsigned char const* samples, unsigned nOfSamples, SampleFmt fmt, 
+                               float &peak, float &sumSquares, unsigned stride = 1, 
+                               SampleConverter::ToFloatKernel toFloat = NULL);
+
     /**
     * @return mixing buffering in samples
     */ 
@@ -113,28 +211,109 @@ public:
     */ 
     bool muteMaster();
 
+    /**
+    * Enables or disables the mix-minus mode
+    * @param enable true to send to each mixing channel writer the mix without that channel
+    * @return always true
+    */ 
+    bool setMixMinus(bool enable);
+
+    /**
+    * @return true if the mix-minus mode is enabled
+    */ 
+    bool isMixMinus() {return mixMinus;};
+
+    /**
+    * Sets the number of channels of the mix, up to MAX_CHANNELS (7.1). 
+    * It can only be changed before connecting any mixing channel.
+    * @param channels number of audio channels
+    * @return always true
+    */ 
+    bool configure(int channels);
+
+    /**
+    * @return number of audio channels of the mix
+    */ 
+    int getChannels() {return channels;};
+
+    /**
+    * Sets the frames the mixer requests to each mixing channel and how many of them are buffered before
+    * mixing, which is the mixing latency. Short frames (e.g. 5 ms and 2 frames buffered) keep it under
+    * 20 ms for talkback feeds. It can only be changed before connecting any mixing channel.
+    * @param frameTime duration of the mixed frames in us, see AudioFrame::setDefaultFrameTime
+    * @param bufferedFrames input frames buffered, from 1 to AMIXER_MAX_BUFFERED_FRAMES
+    * @return always true
+    */ 
+    bool configFraming(unsigned frameTime, unsigned bufferedFrames = AMIXER_BUFFERED_FRAMES);
+
+    /**
+    * @param id channel id
+    * @return RMS level of the channel input, decaying with LEVEL_DECAY, or 0 if the channel does not exist
+    */ 
+    float getChannelLevel(int id);
+
+    /**
+    * Splits the mixing channels in groups mixed in parallel, see WorkersPool::parallelFor. 
+    * It only pays off with many mixing channels, 1 mixes all of them in the calling worker.
+    * Groups add their inputs linearly and the sum is compressed once when extracting, as with mix-minus,
+    * while a single group compresses the mix after each input. Both match while the sum stays under 
+    * COMPRESSION_THRESHOLD. Over it, with inputs of the same sign, the serial mix lies between the
+    * threshold and the grouped one, as the inputs added last are compressed again.
+    * @param groups number of groups, up to AMIXER_MAX_GROUPS
+    * @return always true
+    */ 
+    bool setMixingGroups(unsigned groups);
+
+    /**
+    * @return number of groups the mixing channels are split in
+    */ 
+    unsigned getMixingGroups() {return mixingGroups;};
+
+    /**
+    * @return id of the loudest channel over SILENCE_THRESHOLD or -1 if all of them are silent
+    */ 
+    int getActiveSpeaker();
+
+    /**
+    * Enables the clock drift compensation of the mixing channels, the current and the new ones
+    * @param targetMs depth in ms the input buffers are kept at, 0 to disable it
+    * @return always true
+    */ 
+    bool setDriftCompensation(unsigned targetMs);
+
 protected:
     
     void doGetState(Jzon::Object &filterNode);
     FrameQueue *allocQueue(ConnectionData cData);
-    bool doProcessFrame(std::map<int, Frame*> &orgFrames, Frame *dst, std::vector<int> newFrames);
+    bool doProcessFrame(FrameMap &orgFrames, FrameMap &dstFrames, std::vector<int> &newFrames);
+    bool specificReaderConfig(int readerID, FrameQueue* queue);
+    bool specificReaderDelete(int readerID);
 
 private:
     void initializeEventMap();
     bool pushToBuffer(int mixChId, AudioFrame* frame);
+    bool placeFrame(int mixChId, AudioFrame* frame, MixingInput &input);
+    bool mixFrame(MixingInput &input, float* const* dstBuffers);
+    void mixInGroups(std::vector<std::pair<int, AudioFrame*>> &frames);
+    void allocPartialBuffers();
+    bool linearMixing() {return mixMinus || mixingGroups > 1;};
     bool fillChannel(std::queue<float> &buffer, int nOfSamples, unsigned char* data, SampleFmt fmt); 
-    bool extractMixedFrame(AudioFrame* frame);
-    void mixSample(float sample, float* mixBuff, int bufferIdx, float gain);
+    bool measureFrame(AudioFrame* frame, float &peak, float &rms, SampleConverter::ToFloatKernel toFloat);
+    bool extractMixedFrame(AudioFrame* frame, float const* contribution);
+    void releaseMixedSamples();
     bool setChannelGain(int id, float value);
     
-    bool specificReaderConfig(int readerID, FrameQueue* queue);
-    bool specificReaderDelete(int readerID);
-
     bool changeChannelVolumeEvent(Jzon::Node* params);
     bool muteChannelEvent(Jzon::Node* params);
     bool soloChannelEvent(Jzon::Node* params);
     bool changeMasterVolumeEvent(Jzon::Node* params);
     bool muteMasterEvent(Jzon::Node* params);
+    bool mixMinusEvent(Jzon::Node* params);
+    bool configEvent(Jzon::Node* params);
+    bool mixingGroupsEvent(Jzon::Node* params);
+    bool driftCompensationEvent(Jzon::Node* params);
+    bool configFramingEvent(Jzon::Node* params);
+    void allocMixBuffers();
     
     //NOTE: There is no need of specific writer configuration
     bool specificWriterConfig(int /*writerID*/) {return true;};
@@ -152,12 +331,26 @@ private:
     float th;  //Dynamic Range Compression algorithm threshold
 
     std::map<int, float> gains;
+    std::map<int, float> levels;
+    //NOTE: conversion kernels are selected once per mixing channel and for the output, not per span
+    std::map<int, SampleConverter::ToFloatKernel> toFloatKernels;
+    SampleConverter::FromFloatKernel fromFloat;
     std::chrono::microseconds syncTs;
     float* mixBuffers[MAX_CHANNELS];
 
+    bool mixMinus;
+    //NOTE: gained samples of each mixing channel, one mixing buffer length per channel
+    std::map<int, std::vector<float>> contributions;
+
+    unsigned mixingGroups;
+    //NOTE: one buffer per group except the first one, which mixes directly into mixBuffers
+    std::vector<std::vector<float>> partialBuffers;
+
     unsigned mixBufferMaxSamples;
     unsigned outputSamples;
     unsigned mixingThreshold;
+    unsigned bufferedFrames;
+    unsigned driftTarget;       //!< Input buffers depth in samples kept by the drift compensation, 0 if disabled
 
 
 };
@@ -82,6 +82,16 @@ bool DashAudioSegmenter::setup(unsigned int channels, unsigned int sampleRate, u
     }
 
     set_segment_duration(segDurInTimeBaseUnits, &dashContext);
+    set_chunk_samples(chunkFrames, &dashContext);
+
+    if (!setupEncryption()) {
+        return false;
+    }
+
+    if (reserve_segment_data(getEstimatedSegmentSize(), &dashContext) != I2OK) {
+        return false;
+    }
+
     return true;
 }
 
@@ -98,7 +108,7 @@ bool DashAudioSegmenter::generateInitSegment(DashSegment* segment)
     data = reinterpret_cast<unsigned char*> (&extradata[0]);
     dataLength = extradata.size();
 
-    if (!data) {
+    if (!data || !segment->reserve(dataLength + DASH_INIT_SEGMENT_OVERHEAD + get_init_encryption_size(dashContext))) {
         return false;
     }
 
@@ -127,6 +137,11 @@ unsigned DashAudioSegmenter::customGenerateSegment(unsigned char *segBuffer, std
     return segSize;
 }
 
+unsigned DashAudioSegmenter::customGenerateChunk(unsigned char *chunkBuffer, uint64_t &segTimestamp, uint32_t &chunkDur)
+{
+    return generate_audio_chunk(chunkBuffer, &dashContext, &segTimestamp, &chunkDur);
+}
+
 bool DashAudioSegmenter::appendFrameToDashSegment(Frame* frame)
 {
     unsigned char* dataWithoutADTS;
@@ -76,6 +76,7 @@ private:
     bool updateExtradata(AudioFrame* aFrame);
     unsigned customGenerateSegment(unsigned char *segBuffer, std::chrono::microseconds nextFrameTs, 
                                     uint64_t &segTimestamp, uint32_t &segDuration, bool force);
+    unsigned customGenerateChunk(unsigned char *chunkBuffer, uint64_t &segTimestamp, uint32_t &chunkDur);
 
 
     bool setup(unsigned int channels, unsigned int sampleRate, unsigned int samples, unsigned int bitsPerSample);
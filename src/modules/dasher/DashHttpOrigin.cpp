@@ -0,0 +1,734 @@
+/*
+ *  DashHttpOrigin - Embedded HTTP origin serving DASH content from memory
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "DashHttpOrigin.hh"
+#include "../../Utils.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+static std::string getStatusText(int status)
+{
+    switch (status) {
+        case 200:
+            return "OK";
+        case 400:
+            return "Bad Request";
+        case 404:
+            return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 431:
+            return "Request Header Fields Too Large";
+        case 505:
+            return "HTTP Version Not Supported";
+        default:
+            return "Internal Server Error";
+    }
+}
+
+static std::string getContentType(std::string name)
+{
+    std::string ext = name.substr(name.find_last_of('.') + 1);
+
+    if (ext == "mpd") {
+        return "application/dash+xml";
+    } else if (ext == "m4v") {
+        return "video/mp4";
+    } else if (ext == "m4a") {
+        return "audio/mp4";
+    } else if (ext == "m3u8") {
+        return "application/vnd.apple.mpegurl";
+    } else if (ext == "jpg") {
+        return "image/jpeg";
+    } else if (name == "metrics") {
+        return "text/plain; version=0.0.4; charset=utf-8";
+    }
+
+    return "application/octet-stream";
+}
+
+//NOTE: header names are case insensitive, values are compared as they come
+static bool hasHeaderToken(std::string head, std::string header, std::string token)
+{
+    size_t pos = 0;
+    size_t end;
+    std::string line;
+
+    while ((pos = head.find("\r\n", pos)) != std::string::npos) {
+        pos += 2;
+        end = head.find("\r\n", pos);
+        line = head.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+
+        if (line.size() > header.size() && line[header.size()] == ':' &&
+            strncasecmp(line.c_str(), header.c_str(), header.size()) == 0 &&
+            strcasestr(line.c_str() + header.size(), token.c_str()) != NULL) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static std::string toHex(size_t value)
+{
+    char hex[2*sizeof(size_t) + 1];
+
+    snprintf(hex, sizeof(hex), "%zx", value);
+    return std::string(hex);
+}
+
+static bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+DashHttpOrigin::DashHttpOrigin() : stopLoop(false), running(false), listenFd(-1), epollFd(-1), wakeFd(-1), port(0),
+    idleTimeout(ORIGIN_IDLE_TIMEOUT), requests(0), notFound(0), bytesSent(0), openConnections(0)
+{
+}
+
+DashHttpOrigin::~DashHttpOrigin()
+{
+    stop();
+}
+
+bool DashHttpOrigin::start(unsigned port_)
+{
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    struct epoll_event ev;
+    int yes = 1;
+
+    if (running) {
+        utils::errorMsg("[DashHttpOrigin] Origin is already running");
+        return false;
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (listenFd < 0) {
+        utils::errorMsg("[DashHttpOrigin] Opening socket");
+        return false;
+    }
+
+    if (setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
+        utils::errorMsg("[DashHttpOrigin] Setting socket options");
+        stop();
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port_);
+
+    if (bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listenFd, SOMAXCONN) < 0 ||
+        getsockname(listenFd, (struct sockaddr *) &addr, &addrLen) < 0 || !setNonBlocking(listenFd)) {
+        utils::errorMsg("[DashHttpOrigin] Could not listen on port " + std::to_string(port_));
+        stop();
+        return false;
+    }
+
+    epollFd = epoll_create1(0);
+    wakeFd = eventfd(0, EFD_NONBLOCK);
+
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd;
+
+    if (epollFd < 0 || wakeFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) < 0) {
+        utils::errorMsg("[DashHttpOrigin] Could not set up epoll");
+        stop();
+        return false;
+    }
+
+    ev.data.fd = wakeFd;
+
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) < 0) {
+        utils::errorMsg("[DashHttpOrigin] Could not set up epoll");
+        stop();
+        return false;
+    }
+
+    port = ntohs(addr.sin_port);
+    stopLoop = false;
+    running = true;
+    loopThread = std::thread(&DashHttpOrigin::eventLoop, this);
+
+    return true;
+}
+
+void DashHttpOrigin::stop()
+{
+    stopLoop = true;
+
+    if (loopThread.joinable()) {
+        loopThread.join();
+    }
+
+    for (auto it : connections) {
+        close(it.first);
+        delete it.second;
+    }
+
+    connections.clear();
+    openConnections = 0;
+
+    if (epollFd >= 0) {
+        close(epollFd);
+        epollFd = -1;
+    }
+
+    if (wakeFd >= 0) {
+        close(wakeFd);
+        wakeFd = -1;
+    }
+
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+    }
+
+    running = false;
+    port = 0;
+}
+
+void DashHttpOrigin::publish(std::string name, const unsigned char* data, size_t length)
+{
+    setContent(name, std::shared_ptr<const std::string>(new std::string((const char*) data, length)));
+}
+
+void DashHttpOrigin::publish(std::string name, std::string data)
+{
+    setContent(name, std::shared_ptr<const std::string>(new std::string(std::move(data))));
+}
+
+void DashHttpOrigin::publishChunk(std::string name, const unsigned char* data, size_t length)
+{
+    std::shared_ptr<const std::string> chunk(new std::string((const char*) data, length));
+    std::lock_guard<std::mutex> guard(mtx);
+    std::shared_ptr<Stream> &stream = streams[name];
+
+    if (!stream) {
+        stream = std::make_shared<Stream>();
+        stream->complete = false;
+    }
+
+    stream->chunks.push_back(chunk);
+    wakeUp();
+}
+
+void DashHttpOrigin::finish(std::string name)
+{
+    std::shared_ptr<std::string> content(new std::string());
+    std::lock_guard<std::mutex> guard(mtx);
+    auto it = streams.find(name);
+
+    if (it == streams.end()) {
+        return;
+    }
+
+    for (auto chunk : it->second->chunks) {
+        content->append(*chunk);
+    }
+
+    it->second->complete = true;
+    contents[name] = content;
+    streams.erase(it);
+    wakeUp();
+}
+
+void DashHttpOrigin::setContent(std::string name, std::shared_ptr<const std::string> content)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    auto it = streams.find(name);
+
+    //NOTE: a content in progress replaced as a whole ends the responses streaming it
+    if (it != streams.end()) {
+        it->second->complete = true;
+        streams.erase(it);
+        wakeUp();
+    }
+
+    contents[name] = content;
+}
+
+void DashHttpOrigin::remove(std::string name)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    auto it = streams.find(name);
+
+    if (it != streams.end()) {
+        it->second->complete = true;
+        streams.erase(it);
+        wakeUp();
+    }
+
+    contents.erase(name);
+}
+
+size_t DashHttpOrigin::getContents()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return contents.size() + streams.size();
+}
+
+std::shared_ptr<const std::string> DashHttpOrigin::getContent(std::string name)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    auto it = contents.find(name);
+
+    if (it == contents.end()) {
+        return NULL;
+    }
+
+    return it->second;
+}
+
+std::shared_ptr<DashHttpOrigin::Stream> DashHttpOrigin::getStream(std::string name)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    auto it = streams.find(name);
+
+    if (it == streams.end()) {
+        return NULL;
+    }
+
+    return it->second;
+}
+
+void DashHttpOrigin::getState(Jzon::Object &node)
+{
+    std::unique_lock<std::mutex> guard(mtx);
+    size_t inProgress = streams.size();
+
+    guard.unlock();
+
+    node.Add("port", (int) port);
+    node.Add("contents", (int) getContents());
+    node.Add("contentsInProgress", (int) inProgress);
+    node.Add("connections", (int) openConnections);
+    node.Add("requests", (int) requests);
+    node.Add("notFound", (int) notFound);
+    node.Add("sentInMB", bytesSent/1000000.0);
+}
+
+void DashHttpOrigin::eventLoop()
+{
+    struct epoll_event events[ORIGIN_MAX_EVENTS];
+    Connection *conn;
+    int n;
+
+    while (!stopLoop) {
+        n = epoll_wait(epollFd, events, ORIGIN_MAX_EVENTS, ORIGIN_POLL_TIMEOUT);
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == listenFd) {
+                acceptConnections();
+                continue;
+            }
+
+            if (events[i].data.fd == wakeFd) {
+                writeStreams();
+                continue;
+            }
+
+            if (connections.count(events[i].data.fd) == 0) {
+                continue;
+            }
+
+            conn = connections[events[i].data.fd];
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(conn);
+                continue;
+            }
+
+            if (events[i].events & EPOLLOUT) {
+                if (writeConnection(conn)) {
+                    processRequests(conn);
+                }
+                continue;
+            }
+
+            if (events[i].events & EPOLLIN) {
+                readConnection(conn);
+            }
+        }
+
+        closeIdle();
+    }
+}
+
+void DashHttpOrigin::acceptConnections()
+{
+    struct epoll_event ev;
+    Connection *conn;
+    int fd;
+
+    while ((fd = accept(listenFd, NULL, NULL)) >= 0) {
+        if (connections.size() >= ORIGIN_MAX_CONNECTIONS || !setNonBlocking(fd)) {
+            close(fd);
+            continue;
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+
+        conn = new Connection();
+        conn->fd = fd;
+        conn->chunk = 0;
+        conn->sent = 0;
+        conn->responding = false;
+        conn->closeAfter = false;
+        conn->chunked = false;
+        conn->lastActivity = std::chrono::steady_clock::now();
+        connections[fd] = conn;
+        openConnections = connections.size();
+    }
+}
+
+void DashHttpOrigin::readConnection(Connection *conn)
+{
+    char buffer[ORIGIN_MAX_REQUEST];
+    ssize_t len;
+
+    //NOTE: epoll is level triggered, data left unread is notified again
+    while (conn->in.size() <= ORIGIN_MAX_REQUEST && (len = recv(conn->fd, buffer, sizeof(buffer), 0)) > 0) {
+        conn->in.append(buffer, len);
+        conn->lastActivity = std::chrono::steady_clock::now();
+    }
+
+    if (conn->in.size() > ORIGIN_MAX_REQUEST) {
+        len = 1;
+    }
+
+    if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        closeConnection(conn);
+        return;
+    }
+
+    processRequests(conn);
+}
+
+//NOTE: pipelined requests are answered one after the other, the next one is parsed once the previous response is sent
+void DashHttpOrigin::processRequests(Connection *conn)
+{
+    size_t headEnd;
+    std::string head, method, target, version;
+    size_t first, second, lineEnd;
+    bool alive;
+
+    while (!conn->responding) {
+        headEnd = conn->in.find("\r\n\r\n");
+
+        if (headEnd == std::string::npos) {
+            if (conn->in.size() > ORIGIN_MAX_REQUEST) {
+                conn->closeAfter = true;
+                respond(conn, 431, "", false);
+            }
+            return;
+        }
+
+        head = conn->in.substr(0, headEnd + 2);
+        conn->in.erase(0, headEnd + 4);
+        requests++;
+
+        lineEnd = head.find("\r\n");
+        first = head.find(' ');
+        second = first == std::string::npos ? std::string::npos : head.find(' ', first + 1);
+
+        if (second == std::string::npos || second > lineEnd) {
+            conn->closeAfter = true;
+            respond(conn, 400, "", false);
+            return;
+        }
+
+        method = head.substr(0, first);
+        target = head.substr(first + 1, second - first - 1);
+        version = head.substr(second + 1, lineEnd - second - 1);
+
+        if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+            conn->closeAfter = true;
+            respond(conn, 505, "", false);
+            return;
+        }
+
+        //NOTE: HTTP/1.0 clients have to ask explicitly for persistent connections
+        conn->closeAfter = hasHeaderToken(head, "Connection", "close") ||
+                           (version == "HTTP/1.0" && !hasHeaderToken(head, "Connection", "keep-alive"));
+        conn->chunked = version == "HTTP/1.1";
+
+        //NOTE: requests with a body are not expected, the connection is closed instead of skipping it
+        if (hasHeaderToken(head, "Transfer-Encoding", "") ||
+            (hasHeaderToken(head, "Content-Length", "") && !hasHeaderToken(head, "Content-Length", " 0"))) {
+            conn->closeAfter = true;
+            respond(conn, 400, "", false);
+            return;
+        }
+
+        target = target.substr(0, target.find('?'));
+
+        if (method != "GET" && method != "HEAD") {
+            alive = respond(conn, 405, "", false);
+        } else if (target.empty() || target[0] != '/') {
+            alive = respond(conn, 400, "", false);
+        } else {
+            alive = respond(conn, 200, target.substr(1), method == "GET");
+        }
+
+        if (!alive) {
+            return;
+        }
+    }
+}
+
+bool DashHttpOrigin::respond(Connection *conn, int status, std::string name, bool sendBody)
+{
+    std::shared_ptr<const std::string> content;
+    std::shared_ptr<Stream> stream;
+    size_t length = 0;
+
+    if (status == 200) {
+        content = getContent(name);
+
+        if (!content) {
+            stream = getStream(name);
+        }
+
+        if (content) {
+            length = content->size();
+        } else if (!stream) {
+            status = 404;
+            notFound++;
+        }
+    }
+
+    conn->head = "HTTP/1.1 " + std::to_string(status) + " " + getStatusText(status) + "\r\n";
+
+    //NOTE: HTTP/1.0 clients get the content in progress until it is finished, then the connection is closed
+    if (stream && conn->chunked) {
+        conn->head += "Transfer-Encoding: chunked\r\n";
+    } else if (stream) {
+        conn->closeAfter = true;
+    } else {
+        conn->head += "Content-Length: " + std::to_string(length) + "\r\n";
+    }
+
+    conn->head += "Access-Control-Allow-Origin: *\r\n";
+
+    if (status == 200) {
+        conn->head += "Content-Type: " + getContentType(name) + "\r\n";
+
+        //NOTE: the MPD, the playlists and the metrics change over time, segments never change once published
+        if (getContentType(name) == "application/dash+xml" || getContentType(name) == "application/vnd.apple.mpegurl" ||
+            name == "metrics") {
+            conn->head += "Cache-Control: no-cache\r\n";
+        } else {
+            conn->head += "Cache-Control: max-age=" + std::to_string(ORIGIN_SEGMENT_MAX_AGE) + "\r\n";
+        }
+    }
+
+    if (status == 405) {
+        conn->head += "Allow: GET, HEAD\r\n";
+    }
+
+    if (conn->closeAfter) {
+        conn->head += "Connection: close\r\n";
+    }
+
+    conn->head += "\r\n";
+    conn->body = sendBody ? content : NULL;
+    conn->stream = sendBody ? stream : NULL;
+    conn->chunk = 0;
+    conn->sent = 0;
+    conn->responding = true;
+
+    return writeConnection(conn);
+}
+
+//NOTE: false is returned if the connection has been closed
+bool DashHttpOrigin::writeConnection(Connection *conn)
+{
+    size_t bodyLength, total;
+    ssize_t len;
+
+    do {
+        bodyLength = conn->body ? conn->body->size() : 0;
+        total = conn->head.size() + bodyLength;
+
+        while (conn->sent < total) {
+            if (conn->sent < conn->head.size()) {
+                len = send(conn->fd, conn->head.data() + conn->sent, conn->head.size() - conn->sent, MSG_NOSIGNAL | (bodyLength > 0 ? MSG_MORE : 0));
+            } else {
+                len = send(conn->fd, conn->body->data() + conn->sent - conn->head.size(), total - conn->sent, MSG_NOSIGNAL);
+            }
+
+            if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                watchOutput(conn, true);
+                return true;
+            }
+
+            if (len <= 0) {
+                closeConnection(conn);
+                return false;
+            }
+
+            conn->sent += len;
+            bytesSent += len;
+            conn->lastActivity = std::chrono::steady_clock::now();
+        }
+    } while (conn->stream && nextChunk(conn));
+
+    watchOutput(conn, false);
+
+    //NOTE: the response goes on when the next chunk is published
+    if (conn->stream) {
+        return true;
+    }
+
+    conn->responding = false;
+    conn->body = NULL;
+
+    if (conn->closeAfter) {
+        closeConnection(conn);
+        return false;
+    }
+
+    return true;
+}
+
+//NOTE: each chunk framing carries the end of the previous one, false is returned if there is nothing to send yet
+bool DashHttpOrigin::nextChunk(Connection *conn)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    std::string framing = conn->chunked && conn->chunk > 0 ? "\r\n" : "";
+
+    if (conn->chunk < conn->stream->chunks.size()) {
+        conn->body = conn->stream->chunks[conn->chunk++];
+        conn->head = conn->chunked ? framing + toHex(conn->body->size()) + "\r\n" : "";
+        conn->sent = 0;
+        return true;
+    }
+
+    if (!conn->stream->complete) {
+        return false;
+    }
+
+    conn->head = conn->chunked ? framing + "0\r\n\r\n" : "";
+    conn->body = NULL;
+    conn->stream = NULL;
+    conn->sent = 0;
+
+    return true;
+}
+
+void DashHttpOrigin::writeStreams()
+{
+    std::vector<Connection*> waiting;
+    uint64_t count;
+
+    if (read(wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        utils::warningMsg("[DashHttpOrigin] Error reading wake up event");
+    }
+
+    for (auto it : connections) {
+        if (it.second->stream) {
+            waiting.push_back(it.second);
+        }
+    }
+
+    for (auto conn : waiting) {
+        if (writeConnection(conn)) {
+            processRequests(conn);
+        }
+    }
+}
+
+void DashHttpOrigin::wakeUp()
+{
+    uint64_t one = 1;
+
+    if (wakeFd >= 0 && write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        utils::warningMsg("[DashHttpOrigin] Error waking up the event loop");
+    }
+}
+
+void DashHttpOrigin::watchOutput(Connection *conn, bool enable)
+{
+    struct epoll_event ev;
+
+    ev.events = enable ? EPOLLOUT : EPOLLIN;
+    ev.data.fd = conn->fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+//NOTE: checked on every loop round, at least each ORIGIN_POLL_TIMEOUT. A connection whose response 
+//      has been sent up to the last published chunk waits for the publisher, not for the client
+void DashHttpOrigin::closeIdle()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::vector<Connection*> idle;
+    Connection *conn;
+
+    if (idleTimeout == 0) {
+        return;
+    }
+
+    for (auto it : connections) {
+        conn = it.second;
+
+        if (conn->stream && conn->sent >= conn->head.size() + (conn->body ? conn->body->size() : 0)) {
+            conn->lastActivity = now;
+            continue;
+        }
+
+        if (now - conn->lastActivity > std::chrono::seconds(idleTimeout)) {
+            idle.push_back(conn);
+        }
+    }
+
+    for (auto c : idle) {
+        closeConnection(c);
+    }
+}
+
+void DashHttpOrigin::closeConnection(Connection *conn)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    connections.erase(conn->fd);
+    openConnections = connections.size();
+    delete conn;
+}
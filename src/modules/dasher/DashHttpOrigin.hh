@@ -0,0 +1,192 @@
+/*
+ *  DashHttpOrigin - Embedded HTTP origin serving DASH content from memory
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _DASH_HTTP_ORIGIN_HH
+#define _DASH_HTTP_ORIGIN_HH
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../Jzon.h"
+
+#define ORIGIN_MAX_CONNECTIONS  256         //!< Further connections are refused
+#define ORIGIN_MAX_EVENTS       64          //!< Events handled per epoll_wait call
+#define ORIGIN_MAX_REQUEST      8192        //!< Maximum request head length in bytes
+#define ORIGIN_POLL_TIMEOUT     100         //!< epoll_wait timeout in ms, the stop flag is checked in between
+#define ORIGIN_SEGMENT_MAX_AGE  60          //!< Cache-Control max-age of segments in seconds
+#define ORIGIN_IDLE_TIMEOUT     30          //!< Connections without traffic for longer are closed, in seconds
+
+/*! HTTP/1.1 origin serving the MPD and the segments of a Dasher from memory, on an epoll event loop
+*   run by its own thread. Content is published by name and served at "/name", with persistent
+*   connections and pipelining. Only GET and HEAD are supported. Published contents are immutable,
+*   they are replaced as a whole, so responses in flight keep the version they started with.
+*   Contents can also be published progressively, as a sequence of chunks, which are sent with chunked
+*   transfer encoding as they arrive until the content is finished.
+*/
+class DashHttpOrigin {
+
+public:
+    /**
+    * Class constructor
+    */
+    DashHttpOrigin();
+
+    /**
+    * Class destructor, the server is stopped
+    */
+    ~DashHttpOrigin();
+
+    /**
+    * Starts listening and the event loop thread
+    * @param port TCP port, 0 picks a free one
+    * @return true if succeeded and false if not
+    */
+    bool start(unsigned port);
+
+    /**
+    * Stops the event loop and closes all the connections
+    */
+    void stop();
+
+    /**
+    * @return true if the event loop is running
+    */
+    bool isRunning() {return running;};
+
+    /**
+    * @return listening port, 0 if not started
+    */
+    unsigned getPort() {return port;};
+
+    /**
+    * Publishes or replaces a content
+    * @param name resource name, served at "/name"
+    * @param data content data, it is copied
+    * @param length data length in bytes
+    */
+    void publish(std::string name, const unsigned char* data, size_t length);
+
+    /**
+    * @see publish
+    */
+    void publish(std::string name, std::string data);
+
+    /**
+    * Appends a chunk to a content in progress, the first chunk creates it. Requests for it are answered
+    * with chunked transfer encoding, so clients get each chunk right after it is published
+    * @param name resource name, served at "/name"
+    * @param data chunk data, it is copied
+    * @param length data length in bytes
+    */
+    void publishChunk(std::string name, const unsigned char* data, size_t length);
+
+    /**
+    * Finishes a content in progress, responses in flight are ended and further requests get it as a whole
+    * @param name resource name
+    */
+    void finish(std::string name);
+
+    /**
+    * Removes a content, further requests get a 404
+    * @param name resource name
+    */
+    void remove(std::string name);
+
+    /**
+    * @return published contents
+    */
+    size_t getContents();
+
+    /**
+    * Sets how long a connection may go without traffic before it is closed. Connections waiting for
+    * the next chunk of a content in progress are not idle
+    * @param seconds idle time, 0 keeps connections open
+    */
+    void setIdleTimeout(unsigned seconds) {idleTimeout = seconds;};
+
+    /**
+    * Fills the server metrics
+    * @param node where the metrics are added
+    */
+    void getState(Jzon::Object &node);
+
+private:
+    struct Stream {
+        std::vector<std::shared_ptr<const std::string>> chunks;
+        bool complete;
+    };
+
+    struct Connection {
+        int fd;
+        std::string in;
+        std::string head;                           //!< Response status line and headers, or chunk framing
+        std::shared_ptr<const std::string> body;    //!< NULL for HEAD requests and errors
+        std::shared_ptr<Stream> stream;             //!< Content in progress being sent, NULL otherwise
+        size_t chunk;                               //!< Next stream chunk to send
+        size_t sent;
+        bool responding;
+        bool closeAfter;
+        bool chunked;                               //!< The client accepts chunked transfer encoding
+        std::chrono::steady_clock::time_point lastActivity;    //!< Last time data was received or sent
+    };
+
+    void eventLoop();
+    void acceptConnections();
+    void readConnection(Connection *conn);
+    void processRequests(Connection *conn);
+    bool respond(Connection *conn, int status, std::string name, bool sendBody);
+    bool writeConnection(Connection *conn);
+    bool nextChunk(Connection *conn);
+    void writeStreams();
+    void closeConnection(Connection *conn);
+    void closeIdle();
+    void watchOutput(Connection *conn, bool enable);
+    void wakeUp();
+    void setContent(std::string name, std::shared_ptr<const std::string> content);
+    std::shared_ptr<const std::string> getContent(std::string name);
+    std::shared_ptr<Stream> getStream(std::string name);
+
+    std::map<std::string, std::shared_ptr<const std::string>> contents;
+    std::map<std::string, std::shared_ptr<Stream>> streams;
+    std::mutex mtx;
+
+    std::map<int, Connection*> connections;
+    std::thread loopThread;
+    std::atomic<bool> stopLoop;
+    bool running;
+    int listenFd;
+    int epollFd;
+    int wakeFd;
+    unsigned port;
+    std::atomic<unsigned> idleTimeout;
+
+    std::atomic<size_t> requests;
+    std::atomic<size_t> notFound;
+    std::atomic<size_t> bytesSent;
+    std::atomic<size_t> openConnections;
+};
+
+#endif
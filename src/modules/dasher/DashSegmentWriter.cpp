@@ -0,0 +1,331 @@
+/*
+ *  DashSegmentWriter - Background writer of DASH segments and MPD files
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "DashSegmentWriter.hh"
+#include "../../Utils.hh"
+
+#include <fstream>
+#include <cstdio>
+
+static std::string getFileName(std::string path)
+{
+    return path.substr(path.find_last_of('/') + 1);
+}
+
+DashSegmentWriter::DashSegmentWriter(size_t maxJobs_) :
+    maxJobs(maxJobs_ > 0 ? maxJobs_ : 1), stop(false), diskOutput(true), uploader(NULL), writtenJobs(0),
+    failedWrites(0), blockedPushes(0), lastWriteTime(0), maxWriteTime(0), totalWriteTime(0)
+{
+    writingThread = std::thread(&DashSegmentWriter::writingLoop, this);
+}
+
+DashSegmentWriter::~DashSegmentWriter()
+{
+    std::unique_lock<std::mutex> guard(mtx);
+    stop = true;
+    jobCheck.notify_all();
+    guard.unlock();
+
+    writingThread.join();
+    delete uploader;
+
+    for (auto seg : freeSegments) {
+        delete seg;
+    }
+}
+
+bool DashSegmentWriter::push(DashWriterJob *job)
+{
+    std::unique_lock<std::mutex> guard(mtx);
+
+    if (!job) {
+        return false;
+    }
+
+    //NOTE: the Dasher only waits when the storage can not keep up, memory stays bounded
+    if (jobs.size() >= maxJobs) {
+        blockedPushes++;
+        utils::warningMsg("[DashSegmentWriter] Storage is too slow, waiting for pending writes");
+        jobCheck.wait(guard, [&]{return jobs.size() < maxJobs;});
+    }
+
+    jobs.push_back(job);
+    jobCheck.notify_all();
+
+    return true;
+}
+
+void DashSegmentWriter::flush()
+{
+    std::unique_lock<std::mutex> guard(mtx);
+    jobCheck.wait(guard, [&]{return jobs.empty();});
+}
+
+DashSegment* DashSegmentWriter::getSegment()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    DashSegment *seg;
+
+    if (freeSegments.empty()) {
+        return new DashSegment();
+    }
+
+    seg = freeSegments.back();
+    freeSegments.pop_back();
+
+    return seg;
+}
+
+void DashSegmentWriter::setDiskOutput(bool enabled)
+{
+    std::unique_lock<std::mutex> guard(mtx);
+
+    jobCheck.wait(guard, [&]{return jobs.empty();});
+    diskOutput = enabled;
+}
+
+void DashSegmentWriter::setUploader(DashUploader* uploader_)
+{
+    std::unique_lock<std::mutex> guard(mtx);
+    DashUploader* previous;
+
+    //NOTE: the writing thread only uses the uploader while there are jobs
+    jobCheck.wait(guard, [&]{return jobs.empty();});
+    previous = uploader;
+    uploader = uploader_;
+    guard.unlock();
+
+    delete previous;
+}
+
+bool DashSegmentWriter::hasOutput()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return diskOutput || uploader;
+}
+
+bool DashSegmentWriter::isUploading()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return uploader != NULL;
+}
+
+size_t DashSegmentWriter::getPendingJobs()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return jobs.size();
+}
+
+size_t DashSegmentWriter::getFailedWrites()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return failedWrites;
+}
+
+void DashSegmentWriter::getState(Jzon::Object &node)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    node.Add("pendingJobs", (int) jobs.size());
+    node.Add("writtenJobs", (int) writtenJobs);
+    node.Add("failedWrites", (int) failedWrites);
+    node.Add("blockedPushes", (int) blockedPushes);
+    node.Add("lastWriteTimeInMs", lastWriteTime.count()/1000.0);
+    node.Add("maxWriteTimeInMs", maxWriteTime.count()/1000.0);
+    node.Add("avgWriteTimeInMs", writtenJobs > 0 ? totalWriteTime.count()/1000.0/writtenJobs : 0.0);
+    node.Add("diskOutput", diskOutput);
+
+    if (uploader) {
+        Jzon::Object uploadNode;
+        uploader->getState(uploadNode);
+        node.Add("upload", uploadNode);
+    }
+}
+
+void DashSegmentWriter::writingLoop()
+{
+    std::unique_lock<std::mutex> guard(mtx);
+    DashWriterJob *job;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::microseconds writeTime;
+
+    while (true) {
+        jobCheck.wait(guard, [&]{return stop || !jobs.empty();});
+
+        if (jobs.empty()) {
+            break;
+        }
+
+        //NOTE: the job stays queued while written, so flush also waits for it
+        job = jobs.front();
+        guard.unlock();
+
+        start = std::chrono::steady_clock::now();
+        doJob(job);
+        writeTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+        guard.lock();
+        for (auto seg : job->segments) {
+            seg.second->clear();
+            seg.second->setSeqNumber(0);
+            freeSegments.push_back(seg.second);
+        }
+
+        delete job;
+        jobs.pop_front();
+
+        writtenJobs++;
+        lastWriteTime = writeTime;
+        maxWriteTime = std::max(maxWriteTime, writeTime);
+        totalWriteTime += writeTime;
+
+        jobCheck.notify_all();
+    }
+}
+
+void DashSegmentWriter::doJob(DashWriterJob *job)
+{
+    size_t failed = 0;
+
+    //NOTE: uploads go first, the origin is further away than the disk
+    if (uploader) {
+        uploadJob(job, failed);
+    }
+
+    if (diskOutput) {
+        writeJob(job, failed);
+    }
+
+    if (failed > 0) {
+        std::lock_guard<std::mutex> guard(mtx);
+        failedWrites += failed;
+    }
+}
+
+void DashSegmentWriter::writeJob(DashWriterJob *job, size_t &failed)
+{
+    for (auto &chunk : job->chunks) {
+        if (!appendFile(chunk.path, chunk.data, chunk.first)) {
+            utils::errorMsg("[DashSegmentWriter] Error appending DASH chunk to " + chunk.path);
+            failed++;
+        }
+    }
+
+    for (auto seg : job->segments) {
+        if (!writeFile(seg.first, (char*) seg.second->getDataBuffer(), seg.second->getDataLength())) {
+            utils::errorMsg("[DashSegmentWriter] Error writing DASH segment " + seg.first);
+            failed++;
+        }
+    }
+
+    if (!job->mpdPath.empty() && !writeFile(job->mpdPath, job->mpd.c_str(), job->mpd.size())) {
+        utils::errorMsg("[DashSegmentWriter] Error writing MPD " + job->mpdPath);
+        failed++;
+    }
+
+    for (auto &playlist : job->playlists) {
+        if (!writeFile(playlist.first, playlist.second.c_str(), playlist.second.size())) {
+            utils::errorMsg("[DashSegmentWriter] Error writing HLS playlist " + playlist.first);
+            failed++;
+        }
+    }
+
+    for (auto path : job->removals) {
+        if (std::remove(path.c_str()) != 0) {
+            utils::warningMsg("[DashSegmentWriter] Error cleaning dash segment: " + path);
+            failed++;
+        }
+    }
+}
+
+//NOTE: files are uploaded by their name, they are all in the same folder. Each step waits for the previous
+//      one, so players never get an MPD referencing segments which are not uploaded yet
+void DashSegmentWriter::uploadJob(DashWriterJob *job, size_t &failed)
+{
+    for (auto &chunk : job->chunks) {
+        uploader->appendChunk(getFileName(chunk.path), chunk.data, chunk.first);
+    }
+
+    for (auto path : job->finished) {
+        uploader->finishStream(getFileName(path));
+    }
+
+    for (auto seg : job->segments) {
+        uploader->upload(getFileName(seg.first), (char*) seg.second->getDataBuffer(), seg.second->getDataLength());
+    }
+
+    failed += uploader->wait();
+
+    if (!job->mpdPath.empty()) {
+        uploader->upload(getFileName(job->mpdPath), job->mpd.c_str(), job->mpd.size());
+    }
+
+    for (auto &playlist : job->playlists) {
+        uploader->upload(getFileName(playlist.first), playlist.second.c_str(), playlist.second.size());
+    }
+
+    failed += uploader->wait();
+
+    for (auto path : job->removals) {
+        uploader->remove(getFileName(path));
+    }
+
+    failed += uploader->wait();
+}
+
+bool DashSegmentWriter::writeFile(std::string path, const char* data, size_t length)
+{
+    std::string tmpPath = path + DASH_TMP_EXT;
+    std::ofstream file(tmpPath.c_str(), std::ofstream::binary);
+
+    if (!file) {
+        return false;
+    }
+
+    file.write(data, length);
+    file.close();
+
+    if (!file) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+
+    //NOTE: rename replaces the previous file atomically within the same file system
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool DashSegmentWriter::appendFile(std::string path, const std::string &data, bool truncate)
+{
+    std::ofstream file(path.c_str(), std::ofstream::binary | (truncate ? std::ofstream::trunc : std::ofstream::app));
+
+    if (!file) {
+        return false;
+    }
+
+    file.write(data.data(), data.size());
+    file.close();
+
+    return !file.fail();
+}
@@ -0,0 +1,160 @@
+/*
+ *  DashSegmentWriter - Background writer of DASH segments and MPD files
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _DASH_SEGMENT_WRITER_HH
+#define _DASH_SEGMENT_WRITER_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+#include "Dasher.hh"
+#include "DashUploader.hh"
+
+#define DASH_WRITER_MAX_JOBS    8           //!< Pending jobs before the Dasher waits for the writer
+#define DASH_TMP_EXT            ".tmp"      //!< Files are written with this extension and renamed once complete
+
+/*! Low latency segment data, appended to the segment file as it is generated */
+struct DashChunk {
+    std::string path;
+    std::string data;
+    bool first;                     //!< The file is truncated, it starts a new segment
+};
+
+/*! Output operations of one Dasher step. They are done in order: chunks are appended, segments are written
+*   and renamed, then the MPD and the HLS playlists are updated and finally the segments out of the timeline are removed.
+*   Segments are owned by the job, they go back to the writer free list once written.
+*/
+struct DashWriterJob {
+    std::vector<DashChunk> chunks;
+    std::vector<std::string> finished;                             //!< Paths of the chunked segments completed by the chunks
+    std::vector<std::pair<std::string, DashSegment*>> segments;    //!< Final path and segment
+    std::string mpdPath;                                           //!< Empty if the MPD is not updated
+    std::string mpd;
+    std::vector<std::pair<std::string, std::string>> playlists;    //!< HLS playlists path and content
+    std::vector<std::string> removals;
+};
+
+/*! Writes the DASH segments and the MPD from its own thread, so slow storage does not stall the Dasher.
+*   Files are written with a temporary name and renamed, this way clients never read a partial file.
+*   Segments are handed off without copying their data, the Dasher takes a recycled one to go on.
+*   Chunks are the exception, they are appended in place so segments in progress can be read.
+*   Files can also be uploaded by a DashUploader, with or without writing them to disk. Uploads of each step
+*   run in parallel, but the MPD is only uploaded once the segments are, and removals come last.
+*/
+class DashSegmentWriter {
+
+public:
+    /**
+    * Class constructor, the writing thread is started
+    * @param maxJobs pending jobs limit, push waits if it is reached
+    */
+    DashSegmentWriter(size_t maxJobs = DASH_WRITER_MAX_JOBS);
+
+    /**
+    * Class destructor, pending jobs are written before stopping the thread
+    */
+    ~DashSegmentWriter();
+
+    /**
+    * Queues a job, the writer takes its ownership. It waits while the pending jobs limit is reached
+    * @param job disk operations to do
+    * @return false if the job is not valid
+    */
+    bool push(DashWriterJob *job);
+
+    /**
+    * Waits until all the pending jobs are done
+    */
+    void flush();
+
+    /**
+    * @return an empty segment, recycled from written jobs if possible
+    */
+    DashSegment* getSegment();
+
+    /**
+    * Enables or disables writing to disk, once the pending jobs are done
+    */
+    void setDiskOutput(bool enabled);
+
+    /**
+    * Sets the uploader of the files, once the pending jobs are done. The writer takes its ownership
+    * @param uploader started uploader, NULL disables the uploads
+    */
+    void setUploader(DashUploader* uploader);
+
+    /**
+    * @return true if files are written to disk or uploaded, otherwise jobs are pointless
+    */
+    bool hasOutput();
+
+    /**
+    * @return true if files are uploaded
+    */
+    bool isUploading();
+
+    /**
+    * @return jobs waiting to be written, including the running one
+    */
+    size_t getPendingJobs();
+
+    /**
+    * @return files that could not be written, renamed or removed
+    */
+    size_t getFailedWrites();
+
+    /**
+    * Fills the write latency metrics
+    * @param node where the metrics are added
+    */
+    void getState(Jzon::Object &node);
+
+private:
+    void writingLoop();
+    bool writeFile(std::string path, const char* data, size_t length);
+    bool appendFile(std::string path, const std::string &data, bool truncate);
+    void doJob(DashWriterJob *job);
+    void writeJob(DashWriterJob *job, size_t &failed);
+    void uploadJob(DashWriterJob *job, size_t &failed);
+
+    std::thread writingThread;
+    std::mutex mtx;
+    std::condition_variable jobCheck;
+    std::deque<DashWriterJob*> jobs;
+    std::vector<DashSegment*> freeSegments;
+    size_t maxJobs;
+    bool stop;
+    bool diskOutput;
+    DashUploader* uploader;
+
+    size_t writtenJobs;
+    size_t failedWrites;
+    size_t blockedPushes;                   //!< Pushes that had to wait for the writer
+    std::chrono::microseconds lastWriteTime;
+    std::chrono::microseconds maxWriteTime;
+    std::chrono::microseconds totalWriteTime;
+};
+
+#endif
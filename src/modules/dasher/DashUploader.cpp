@@ -0,0 +1,1096 @@
+/*
+ *  DashUploader - Uploader of DASH segments and MPD files to HTTP and S3 origins
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "DashUploader.hh"
+#include "DashHttpOrigin.hh"
+#include "../../Utils.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <csignal>
+#include <climits>
+#include <algorithm>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/x509v3.h>
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+
+#define UPLOAD_MAX_BODY         1024*1024           //!< Larger response bodies are not read
+#define UPLOAD_ATTEMPTS         2
+#define UNSIGNED_PAYLOAD        "UNSIGNED-PAYLOAD"
+
+static std::string getContentType(std::string name)
+{
+    std::string ext = name.substr(name.find_last_of('.') + 1);
+
+    if (ext == "mpd") {
+        return "application/dash+xml";
+    } else if (ext == "m4v") {
+        return "video/mp4";
+    } else if (ext == "m4a") {
+        return "audio/mp4";
+    } else if (ext == "m3u8") {
+        return "application/vnd.apple.mpegurl";
+    }
+
+    return "application/octet-stream";
+}
+
+static std::string toLower(std::string value)
+{
+    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+    return value;
+}
+
+static std::string toHex(const unsigned char* data, size_t length)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+
+    for (size_t i = 0; i < length; i++) {
+        hex.push_back(digits[data[i] >> 4]);
+        hex.push_back(digits[data[i] & 0x0F]);
+    }
+
+    return hex;
+}
+
+static std::string hmacSha256(std::string key, std::string data)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned length = 0;
+
+    HMAC(EVP_sha256(), key.data(), key.size(), (const unsigned char*) data.data(), data.size(), digest, &length);
+    return std::string((char*) digest, length);
+}
+
+static std::string getAmzDate()
+{
+    time_t now = time(NULL);
+    struct tm date;
+    char buffer[32];
+
+    gmtime_r(&now, &date);
+    strftime(buffer, sizeof(buffer), "%Y%m%dT%H%M%SZ", &date);
+    return buffer;
+}
+
+//NOTE: a write to a connection the origin closed raises SIGPIPE in the writing thread, OpenSSL can not avoid it
+static void blockSigpipe()
+{
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+///////////////////////////////////////////////////
+//             DashUploadTarget Class            //
+///////////////////////////////////////////////////
+
+bool DashUploadTarget::parse(std::string url)
+{
+    std::string authority;
+    std::string portStr;
+    size_t start, slash, bracket, colon;
+
+    if (url.compare(0, 7, "http://") == 0) {
+        tls = false;
+        port = 80;
+        start = 7;
+    } else if (url.compare(0, 8, "https://") == 0) {
+        tls = true;
+        port = 443;
+        start = 8;
+    } else {
+        return false;
+    }
+
+    slash = url.find('/', start);
+    authority = url.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+    path = slash == std::string::npos ? "" : url.substr(slash);
+
+    while (!path.empty() && path.back() == '/') {
+        path.pop_back();
+    }
+
+    //NOTE: IPv6 literals are bracketed, their colons are not the port separator
+    bracket = authority.find(']');
+    colon = authority.find(':', bracket == std::string::npos ? 0 : bracket);
+    host = authority.substr(0, colon);
+
+    if (colon != std::string::npos) {
+        portStr = authority.substr(colon + 1);
+
+        if (portStr.empty() || portStr.size() > 5 || portStr.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+
+        port = std::stoi(portStr);
+    }
+
+    return !host.empty() && port > 0 && port <= 65535;
+}
+
+std::string DashUploadTarget::getOrigin() const
+{
+    return (tls ? "https://" : "http://") + host + ":" + std::to_string(port);
+}
+
+std::string DashUploadTarget::getHostHeader() const
+{
+    if ((tls && port == 443) || (!tls && port == 80)) {
+        return host;
+    }
+
+    return host + ":" + std::to_string(port);
+}
+
+///////////////////////////////////////////////////
+//           DashUploadConnection Class          //
+///////////////////////////////////////////////////
+
+bool DashUploadConnection::send(const char* data, size_t length)
+{
+    ssize_t len;
+
+    while (length > 0) {
+        if (ssl) {
+            len = SSL_write(ssl, data, std::min(length, (size_t) INT_MAX));
+        } else {
+            len = ::send(fd, data, length, MSG_NOSIGNAL);
+        }
+
+        if (len < 0 && !ssl && errno == EINTR) {
+            continue;
+        }
+
+        if (len <= 0) {
+            return false;
+        }
+
+        data += len;
+        length -= len;
+    }
+
+    return true;
+}
+
+ssize_t DashUploadConnection::receive(char* buffer, size_t length)
+{
+    ssize_t len;
+
+    if (ssl) {
+        len = SSL_read(ssl, buffer, std::min(length, (size_t) INT_MAX));
+        return len > 0 ? len : (SSL_get_error(ssl, len) == SSL_ERROR_ZERO_RETURN ? 0 : -1);
+    }
+
+    do {
+        len = recv(fd, buffer, length, 0);
+    } while (len < 0 && errno == EINTR);
+
+    return len;
+}
+
+///////////////////////////////////////////////////
+//            DashConnectionPool Class           //
+///////////////////////////////////////////////////
+
+DashConnectionPool& DashConnectionPool::getInstance()
+{
+    static DashConnectionPool instance;
+    return instance;
+}
+
+DashConnectionPool::DashConnectionPool() : sslCtx(NULL), opened(0), reused(0)
+{
+    sslCtx = SSL_CTX_new(TLS_client_method());
+
+    if (sslCtx) {
+        SSL_CTX_set_min_proto_version(sslCtx, TLS1_2_VERSION);
+        SSL_CTX_set_default_verify_paths(sslCtx);
+        SSL_CTX_set_verify(sslCtx, SSL_VERIFY_PEER, NULL);
+    }
+}
+
+DashConnectionPool::~DashConnectionPool()
+{
+    for (auto &origin : idle) {
+        for (auto conn : origin.second) {
+            close(conn);
+        }
+    }
+
+    if (sslCtx) {
+        SSL_CTX_free(sslCtx);
+    }
+}
+
+DashUploadConnection* DashConnectionPool::take(const DashUploadTarget &target)
+{
+    std::string origin = target.getOrigin();
+    std::vector<DashUploadConnection*> stale;
+    DashUploadConnection* conn = NULL;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        std::vector<DashUploadConnection*> &conns = idle[origin];
+
+        //NOTE: the most recently used connection is the least likely to be closed by the origin
+        while (!conns.empty() && !conn) {
+            conn = conns.back();
+            conns.pop_back();
+
+            if (now - conn->lastUse > std::chrono::seconds(UPLOAD_IDLE_TIMEOUT) || !isAlive(conn)) {
+                stale.push_back(conn);
+                conn = NULL;
+            }
+        }
+    }
+
+    for (auto s : stale) {
+        close(s);
+    }
+
+    if (conn) {
+        conn->reused = true;
+        reused++;
+        return conn;
+    }
+
+    return open(target);
+}
+
+void DashConnectionPool::release(DashUploadConnection* conn, bool reusable)
+{
+    if (!conn) {
+        return;
+    }
+
+    if (!reusable) {
+        close(conn);
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(mtx);
+    conn->lastUse = std::chrono::steady_clock::now();
+    conn->reused = false;
+    idle[conn->origin].push_back(conn);
+}
+
+DashUploadConnection* DashConnectionPool::open(const DashUploadTarget &target)
+{
+    struct addrinfo hints;
+    struct addrinfo *addrs, *addr;
+    struct timeval timeout = {UPLOAD_TIMEOUT, 0};
+    std::string host = target.host;
+    DashUploadConnection* conn;
+    int fd = -1;
+    int yes = 1;
+
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host.c_str(), std::to_string(target.port).c_str(), &hints, &addrs) != 0) {
+        utils::errorMsg("[DashConnectionPool] Could not resolve " + target.host);
+        return NULL;
+    }
+
+    //NOTE: the send timeout also bounds connect
+    for (addr = addrs; addr; addr = addr->ai_next) {
+        fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+
+        if (fd < 0) {
+            continue;
+        }
+
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        if (connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+            break;
+        }
+
+        ::close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(addrs);
+
+    if (fd < 0) {
+        utils::errorMsg("[DashConnectionPool] Could not connect to " + target.getOrigin());
+        return NULL;
+    }
+
+    //NOTE: chunks are small and latency sensitive, they are not delayed waiting for the previous ACK
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    conn = new DashUploadConnection();
+    conn->fd = fd;
+    conn->ssl = NULL;
+    conn->origin = target.getOrigin();
+    conn->lastUse = std::chrono::steady_clock::now();
+    conn->reused = false;
+
+    if (target.tls) {
+        conn->ssl = sslCtx ? SSL_new(sslCtx) : NULL;
+
+        if (!conn->ssl) {
+            utils::errorMsg("[DashConnectionPool] TLS is not available");
+            close(conn);
+            return NULL;
+        }
+
+        SSL_set_fd(conn->ssl, fd);
+
+        //NOTE: IP literals are checked against the certificate addresses and get no SNI
+        if (X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(conn->ssl), host.c_str()) != 1) {
+            SSL_set_tlsext_host_name(conn->ssl, host.c_str());
+            SSL_set1_host(conn->ssl, host.c_str());
+        }
+
+        if (SSL_connect(conn->ssl) != 1) {
+            utils::errorMsg("[DashConnectionPool] TLS handshake with " + target.getOrigin() + " failed");
+            close(conn);
+            return NULL;
+        }
+    }
+
+    opened++;
+    return conn;
+}
+
+void DashConnectionPool::close(DashUploadConnection* conn)
+{
+    if (conn->ssl) {
+        SSL_free(conn->ssl);
+    }
+
+    ::close(conn->fd);
+    delete conn;
+}
+
+bool DashConnectionPool::isAlive(DashUploadConnection* conn)
+{
+    char c;
+
+    //NOTE: an idle connection has nothing to read, data or EOF means the origin is closing it
+    return recv(conn->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+///////////////////////////////////////////////////
+//               DashUploader Class              //
+///////////////////////////////////////////////////
+
+DashUploader::DashUploader() : protocol(UPLOAD_HTTP), running(0), failed(0), stop(false), uploads(0), removals(0),
+    failedRequests(0), retries(0), uploadedBytes(0), streamedFiles(0), streamFallbacks(0)
+{
+    target.tls = false;
+    target.port = 0;
+}
+
+DashUploader::~DashUploader()
+{
+    std::unique_lock<std::mutex> guard(mtx);
+
+    for (auto &stream : streams) {
+        stream.second->finished = true;
+        finishing.push_back(stream.second);
+    }
+
+    streams.clear();
+    streamCheck.notify_all();
+
+    stop = true;
+    requestCheck.notify_all();
+    guard.unlock();
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    for (auto stream : finishing) {
+        stream->thread.join();
+        delete stream;
+    }
+}
+
+void DashUploader::setCredentials(std::string region_, std::string accessKey_, std::string secretKey_)
+{
+    region = region_;
+    accessKey = accessKey_;
+    secretKey = secretKey_;
+}
+
+bool DashUploader::start(std::string url_, DashUploadProtocol protocol_, unsigned parallelUploads)
+{
+    if (!workers.empty()) {
+        utils::errorMsg("[DashUploader] Already started");
+        return false;
+    }
+
+    if (!target.parse(url_)) {
+        utils::errorMsg("[DashUploader] Invalid upload URL: " + url_);
+        return false;
+    }
+
+    if (protocol_ == UPLOAD_S3 && !accessKey.empty() && (region.empty() || secretKey.empty())) {
+        utils::errorMsg("[DashUploader] S3 credentials need a region and a secret key");
+        return false;
+    }
+
+    url = url_;
+    protocol = protocol_;
+
+    for (unsigned i = 0; i < std::max(parallelUploads, 1U); i++) {
+        workers.push_back(std::thread(&DashUploader::workerLoop, this));
+    }
+
+    return true;
+}
+
+void DashUploader::upload(std::string name, const char* data, size_t length)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    requests.push_back(Request{"PUT", name, "", data, length});
+    requestCheck.notify_all();
+}
+
+void DashUploader::remove(std::string name)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    requests.push_back(Request{"DELETE", name, "", NULL, 0});
+    requestCheck.notify_all();
+}
+
+size_t DashUploader::wait()
+{
+    std::unique_lock<std::mutex> guard(mtx);
+    size_t count;
+
+    requestCheck.wait(guard, [&]{return workers.empty() || (requests.empty() && running == 0);});
+    reapStreams();
+
+    count = failed;
+    failed = 0;
+    return count;
+}
+
+void DashUploader::appendChunk(std::string name, const std::string &data, bool first)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    Stream* stream = NULL;
+
+    if (workers.empty()) {
+        return;
+    }
+
+    reapStreams();
+
+    if (streams.count(name) > 0 && first) {
+        streams[name]->aborted = true;
+        streams[name]->finished = true;
+        finishing.push_back(streams[name]);
+        streams.erase(name);
+        streamCheck.notify_all();
+    }
+
+    if (streams.count(name) > 0) {
+        stream = streams[name];
+    } else if (first) {
+        stream = new Stream();
+        stream->name = name;
+        stream->sent = 0;
+        stream->finished = false;
+        stream->aborted = false;
+        stream->done = false;
+        streams[name] = stream;
+        stream->thread = std::thread(&DashUploader::streamLoop, this, stream);
+    } else {
+        //NOTE: the beginning of the file is missing, it can not be uploaded
+        return;
+    }
+
+    stream->data.append(data);
+    streamCheck.notify_all();
+}
+
+void DashUploader::finishStream(std::string name)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    if (streams.count(name) == 0) {
+        return;
+    }
+
+    streams[name]->finished = true;
+    finishing.push_back(streams[name]);
+    streams.erase(name);
+    streamCheck.notify_all();
+}
+
+void DashUploader::getState(Jzon::Object &node)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    node.Add("url", url);
+    node.Add("protocol", protocol == UPLOAD_S3 ? "s3" : "http");
+    node.Add("parallelUploads", (int) workers.size());
+    node.Add("pendingRequests", (int) (requests.size() + running));
+    node.Add("activeStreams", (int) (streams.size() + finishing.size()));
+    node.Add("uploads", (int) uploads);
+    node.Add("removals", (int) removals);
+    node.Add("streamedFiles", (int) streamedFiles);
+    node.Add("streamFallbacks", (int) streamFallbacks);
+    node.Add("failedRequests", (int) failedRequests);
+    node.Add("retries", (int) retries);
+    node.Add("uploadedBytes", std::to_string(uploadedBytes));
+    node.Add("openedConnections", (int) DashConnectionPool::getInstance().getOpenedConnections());
+    node.Add("reusedConnections", (int) DashConnectionPool::getInstance().getReusedConnections());
+}
+
+void DashUploader::workerLoop()
+{
+    std::unique_lock<std::mutex> guard(mtx);
+    Request req;
+    Response res;
+    bool ok;
+
+    blockSigpipe();
+
+    while (true) {
+        requestCheck.wait(guard, [&]{return stop || !requests.empty();});
+
+        if (requests.empty()) {
+            break;
+        }
+
+        req = requests.front();
+        requests.pop_front();
+        running++;
+        guard.unlock();
+
+        ok = execute(req, res);
+
+        if (ok && req.method == "PUT") {
+            uploads++;
+        } else if (ok) {
+            removals++;
+        }
+
+        guard.lock();
+        running--;
+
+        if (!ok) {
+            failed++;
+        }
+
+        requestCheck.notify_all();
+    }
+}
+
+//NOTE: called with the lock held, finished streams are done with it once they have set the done flag
+void DashUploader::reapStreams()
+{
+    std::vector<Stream*>::iterator it = finishing.begin();
+
+    while (it != finishing.end()) {
+        if (!(*it)->done) {
+            ++it;
+            continue;
+        }
+
+        (*it)->thread.join();
+        delete *it;
+        it = finishing.erase(it);
+    }
+}
+
+void DashUploader::streamLoop(Stream* stream)
+{
+    std::unique_lock<std::mutex> guard(mtx);
+    Response res;
+    bool ok;
+
+    blockSigpipe();
+
+    ok = protocol == UPLOAD_S3 ? streamParts(stream, guard) : streamChunked(stream, guard);
+
+    //NOTE: the whole file is kept, so a failed stream is uploaded again with a single request.
+    //      It does not change once finished, it can be read without the lock
+    if (!ok && !stream->aborted) {
+        streamFallbacks++;
+        guard.unlock();
+        ok = execute(Request{"PUT", stream->name, "", stream->data.data(), stream->data.size()}, res);
+        guard.lock();
+    }
+
+    if (ok && !stream->aborted) {
+        streamedFiles++;
+    }
+
+    stream->done = true;
+}
+
+bool DashUploader::streamChunked(Stream* stream, std::unique_lock<std::mutex> &guard)
+{
+    DashConnectionPool &pool = DashConnectionPool::getInstance();
+    Request req = Request{"PUT", stream->name, "", NULL, 0};
+    DashUploadConnection* conn = NULL;
+    std::string pending;
+    char size[32];
+    Response res;
+    bool reusable = false;
+    bool finished;
+    bool ok = true;
+
+    while (true) {
+        streamCheck.wait(guard, [&]{return stream->finished || stream->data.size() > stream->sent;});
+
+        if (stream->aborted) {
+            ok = false;
+            break;
+        }
+
+        pending = stream->data.substr(stream->sent);
+        stream->sent = stream->data.size();
+        finished = stream->finished;
+        guard.unlock();
+
+        if (ok && !conn) {
+            conn = pool.take(target);
+            ok = conn && sendRequest(conn, req, true);
+        }
+
+        if (ok && !pending.empty()) {
+            snprintf(size, sizeof(size), "%zx\r\n", pending.size());
+            ok = conn->send(size, strlen(size)) && conn->send(pending.data(), pending.size()) &&
+                 conn->send("\r\n", 2);
+        }
+
+        if (ok && finished) {
+            ok = conn->send("0\r\n\r\n", 5) && readResponse(conn, res, reusable);
+
+            if (ok && res.status / 100 != 2) {
+                utils::errorMsg("[DashUploader] Streamed upload of " + stream->name + " got status " +
+                                std::to_string(res.status));
+                ok = false;
+            }
+        }
+
+        guard.lock();
+
+        if (finished) {
+            break;
+        }
+    }
+
+    pool.release(conn, ok && reusable);
+
+    if (ok) {
+        uploadedBytes += stream->data.size();
+    }
+
+    return ok;
+}
+
+//NOTE: S3 does not take chunked bodies, segments are sent in parts once they are large enough for one
+bool DashUploader::streamParts(Stream* stream, std::unique_lock<std::mutex> &guard)
+{
+    std::vector<std::string> etags;
+    std::string uploadId;
+    std::string part;
+    std::string complete;
+    Response res;
+    size_t begin, end;
+    bool finished;
+    bool ok = true;
+
+    while (true) {
+        streamCheck.wait(guard, [&]{return stream->finished ||
+                                           stream->data.size() - stream->sent >= UPLOAD_S3_PART_SIZE;});
+
+        if (stream->aborted) {
+            break;
+        }
+
+        finished = stream->finished;
+
+        if (finished && uploadId.empty()) {
+            guard.unlock();
+            ok = ok && execute(Request{"PUT", stream->name, "", stream->data.data(), stream->data.size()}, res);
+            guard.lock();
+            break;
+        }
+
+        part = stream->data.substr(stream->sent);
+        stream->sent = stream->data.size();
+        guard.unlock();
+
+        if (ok && uploadId.empty()) {
+            ok = execute(Request{"POST", stream->name, "uploads=", NULL, 0}, res);
+            begin = res.body.find("<UploadId>");
+            end = res.body.find("</UploadId>");
+            ok = ok && begin != std::string::npos && end != std::string::npos;
+            uploadId = ok ? res.body.substr(begin + 10, end - begin - 10) : "";
+        }
+
+        if (ok && !part.empty()) {
+            ok = execute(Request{"PUT", stream->name, "partNumber=" + std::to_string(etags.size() + 1) +
+                                 "&uploadId=" + uriEncode(uploadId, false), part.data(), part.size()}, res) &&
+                 res.headers.count("etag") > 0;
+            etags.push_back(ok ? res.headers["etag"] : "");
+        }
+
+        //NOTE: a complete request can fail after its 200 status, the error comes in the body
+        if (ok && finished) {
+            complete = "<CompleteMultipartUpload>";
+            for (size_t i = 0; i < etags.size(); i++) {
+                complete += "<Part><PartNumber>" + std::to_string(i + 1) + "</PartNumber><ETag>" + etags[i] +
+                            "</ETag></Part>";
+            }
+            complete += "</CompleteMultipartUpload>";
+
+            ok = execute(Request{"POST", stream->name, "uploadId=" + uriEncode(uploadId, false),
+                                 complete.data(), complete.size()}, res) &&
+                 res.body.find("<Error>") == std::string::npos;
+        }
+
+        guard.lock();
+
+        if (finished) {
+            break;
+        }
+    }
+
+    if ((!ok || stream->aborted) && !uploadId.empty()) {
+        guard.unlock();
+        execute(Request{"DELETE", stream->name, "uploadId=" + uriEncode(uploadId, false), NULL, 0}, res);
+        guard.lock();
+    }
+
+    return ok && !stream->aborted;
+}
+
+//NOTE: an origin can close a pooled connection right when it is reused and S3 asks to retry its 5xx errors,
+//      requests failed this way are retried once on a new connection. Uploads are idempotent
+bool DashUploader::execute(const Request &req, Response &res)
+{
+    DashConnectionPool &pool = DashConnectionPool::getInstance();
+    DashUploadConnection* conn;
+    bool reusable;
+    bool retry = false;
+
+    for (unsigned attempt = 0; attempt < UPLOAD_ATTEMPTS; attempt++) {
+        if (attempt > 0) {
+            retries++;
+        }
+
+        conn = pool.take(target);
+
+        if (!conn) {
+            break;
+        }
+
+        reusable = false;
+        if (!sendRequest(conn, req, false) || !readResponse(conn, res, reusable)) {
+            retry = conn->reused;
+            pool.release(conn, false);
+
+            if (retry) {
+                continue;
+            }
+
+            break;
+        }
+
+        pool.release(conn, reusable);
+
+        //NOTE: removing a file which is not there is not an error
+        if (res.status / 100 == 2 || (req.method == "DELETE" && res.status == 404)) {
+            uploadedBytes += req.length;
+            return true;
+        }
+
+        utils::errorMsg("[DashUploader] " + req.method + " " + req.name + " got status " + std::to_string(res.status));
+
+        if (res.status < 500) {
+            break;
+        }
+    }
+
+    failedRequests++;
+    utils::errorMsg("[DashUploader] Error requesting " + req.method + " " + req.name + " to " + target.getOrigin());
+    return false;
+}
+
+bool DashUploader::sendRequest(DashUploadConnection* conn, const Request &req, bool chunked)
+{
+    std::string head = buildHead(req, chunked);
+
+    return conn->send(head.data(), head.size()) && (req.length == 0 || conn->send(req.data, req.length));
+}
+
+std::string DashUploader::buildHead(const Request &req, bool chunked)
+{
+    std::map<std::string, std::string> signedHeaders;
+    std::string path = getObjectPath(req.name);
+    std::string head;
+    bool creates = (req.method == "PUT" && req.query.empty()) || (req.method == "POST" && req.query == "uploads=");
+
+    head = req.method + " " + path + (req.query.empty() ? "" : "?" + req.query) + " HTTP/1.1\r\n";
+    head += "Host: " + target.getHostHeader() + "\r\n";
+
+    if (chunked) {
+        head += "Transfer-Encoding: chunked\r\n";
+    } else if (req.method != "DELETE") {
+        head += "Content-Length: " + std::to_string(req.length) + "\r\n";
+    }
+
+    //NOTE: as the embedded origin does, the MPD and the playlists change over time, segments never change
+    if (creates) {
+        head += "Content-Type: " + getContentType(req.name) + "\r\n";
+
+        if (getContentType(req.name) == "application/dash+xml" ||
+            getContentType(req.name) == "application/vnd.apple.mpegurl") {
+            head += "Cache-Control: no-cache\r\n";
+        } else {
+            head += "Cache-Control: max-age=" + std::to_string(ORIGIN_SEGMENT_MAX_AGE) + "\r\n";
+        }
+    }
+
+    if (protocol == UPLOAD_S3) {
+        signedHeaders["host"] = target.getHostHeader();
+        signedHeaders["x-amz-content-sha256"] = UNSIGNED_PAYLOAD;
+        signedHeaders["x-amz-date"] = getAmzDate();
+
+        head += "x-amz-content-sha256: " + signedHeaders["x-amz-content-sha256"] + "\r\n";
+        head += "x-amz-date: " + signedHeaders["x-amz-date"] + "\r\n";
+
+        if (!accessKey.empty()) {
+            head += "Authorization: " + signV4(req.method, path, req.query, signedHeaders, UNSIGNED_PAYLOAD,
+                                               region, accessKey, secretKey) + "\r\n";
+        }
+    }
+
+    head += "\r\n";
+    return head;
+}
+
+bool DashUploader::readResponse(DashUploadConnection* conn, Response &res, bool &reusable)
+{
+    char buffer[16384];
+    std::string in;
+    std::string line;
+    size_t headEnd, lineEnd, pos, colon, value;
+    size_t length;
+    ssize_t len;
+    bool http11;
+    bool untilClose = false;
+
+    auto fill = [&]() {
+        len = conn->receive(buffer, sizeof(buffer));
+
+        if (len > 0) {
+            in.append(buffer, len);
+        }
+
+        return len > 0;
+    };
+
+    //NOTE: interim 1xx responses are skipped
+    do {
+        while ((headEnd = in.find("\r\n\r\n")) == std::string::npos) {
+            if (in.size() > UPLOAD_MAX_HEAD || !fill()) {
+                return false;
+            }
+        }
+
+        if (in.compare(0, 5, "HTTP/") != 0 || headEnd < 12) {
+            return false;
+        }
+
+        http11 = in.compare(0, 8, "HTTP/1.1") == 0;
+        res.status = atoi(in.c_str() + 9);
+        res.headers.clear();
+        res.body.clear();
+
+        pos = in.find("\r\n") + 2;
+        while (pos < headEnd) {
+            lineEnd = in.find("\r\n", pos);
+            line = in.substr(pos, lineEnd - pos);
+            colon = line.find(':');
+
+            if (colon != std::string::npos) {
+                value = line.find_first_not_of(" \t", colon + 1);
+                res.headers[toLower(line.substr(0, colon))] = value == std::string::npos ? "" : line.substr(value);
+            }
+
+            pos = lineEnd + 2;
+        }
+
+        in.erase(0, headEnd + 4);
+    } while (res.status / 100 == 1);
+
+    reusable = http11 && toLower(res.headers["connection"]) != "close";
+
+    if (res.status == 204 || res.status == 304) {
+        return true;
+    }
+
+    if (toLower(res.headers["transfer-encoding"]).find("chunked") != std::string::npos) {
+        while (true) {
+            while ((lineEnd = in.find("\r\n")) == std::string::npos) {
+                if (!fill()) {
+                    return false;
+                }
+            }
+
+            length = strtoul(in.c_str(), NULL, 16);
+            in.erase(0, lineEnd + 2);
+
+            if (length == 0) {
+                //NOTE: trailers, if any, end with an empty line
+                while (in.compare(0, 2, "\r\n") != 0 && in.find("\r\n\r\n") == std::string::npos) {
+                    if (!fill()) {
+                        return false;
+                    }
+                }
+                break;
+            }
+
+            if (res.body.size() + length > UPLOAD_MAX_BODY) {
+                return false;
+            }
+
+            while (in.size() < length + 2) {
+                if (!fill()) {
+                    return false;
+                }
+            }
+
+            res.body.append(in, 0, length);
+            in.erase(0, length + 2);
+        }
+    } else if (res.headers.count("content-length") > 0) {
+        length = strtoul(res.headers["content-length"].c_str(), NULL, 10);
+
+        if (length > UPLOAD_MAX_BODY) {
+            return false;
+        }
+
+        while (in.size() < length) {
+            if (!fill()) {
+                return false;
+            }
+        }
+
+        res.body = in.substr(0, length);
+    } else {
+        untilClose = true;
+
+        while (fill()) {
+            if (in.size() > UPLOAD_MAX_BODY) {
+                return false;
+            }
+        }
+
+        res.body = in;
+    }
+
+    //NOTE: a body delimited by the end of the connection leaves nothing to reuse
+    if (untilClose) {
+        reusable = false;
+    }
+
+    return true;
+}
+
+std::string DashUploader::getObjectPath(std::string name)
+{
+    return target.path + "/" + uriEncode(name, true);
+}
+
+std::string DashUploader::uriEncode(std::string value, bool path)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    std::string encoded;
+
+    for (unsigned char c : value) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || (path && c == '/')) {
+            encoded.push_back(c);
+        } else {
+            encoded.push_back('%');
+            encoded.push_back(digits[c >> 4]);
+            encoded.push_back(digits[c & 0x0F]);
+        }
+    }
+
+    return encoded;
+}
+
+std::string DashUploader::signV4(std::string method, std::string uri, std::string query,
+                                 const std::map<std::string, std::string> &headers, std::string payloadHash,
+                                 std::string region, std::string accessKey, std::string secretKey)
+{
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    std::string canonical;
+    std::string signedNames;
+    std::string amzDate;
+    std::string scope;
+    std::string stringToSign;
+    std::string key;
+
+    amzDate = headers.count("x-amz-date") > 0 ? headers.at("x-amz-date") : "";
+    scope = amzDate.substr(0, 8) + "/" + region + "/s3/aws4_request";
+
+    canonical = method + "\n" + uri + "\n" + query + "\n";
+    for (auto &header : headers) {
+        canonical += header.first + ":" + header.second + "\n";
+        signedNames += (signedNames.empty() ? "" : ";") + header.first;
+    }
+    canonical += "\n" + signedNames + "\n" + payloadHash;
+
+    SHA256((const unsigned char*) canonical.data(), canonical.size(), digest);
+    stringToSign = "AWS4-HMAC-SHA256\n" + amzDate + "\n" + scope + "\n" + toHex(digest, sizeof(digest));
+
+    key = hmacSha256("AWS4" + secretKey, amzDate.substr(0, 8));
+    key = hmacSha256(key, region);
+    key = hmacSha256(key, "s3");
+    key = hmacSha256(key, "aws4_request");
+    key = hmacSha256(key, stringToSign);
+
+    return "AWS4-HMAC-SHA256 Credential=" + accessKey + "/" + scope + ", SignedHeaders=" + signedNames +
+           ", Signature=" + toHex((const unsigned char*) key.data(), key.size());
+}
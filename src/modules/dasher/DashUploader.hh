@@ -0,0 +1,270 @@
+/*
+ *  DashUploader - Uploader of DASH segments and MPD files to HTTP and S3 origins
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _DASH_UPLOADER_HH
+#define _DASH_UPLOADER_HH
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+#include <openssl/ssl.h>
+
+#include "../../Jzon.h"
+
+#define UPLOAD_PARALLEL         4                   //!< Default simultaneous requests
+#define UPLOAD_TIMEOUT          10                  //!< Connect, send and receive timeout in seconds
+#define UPLOAD_IDLE_TIMEOUT     15                  //!< Pooled connections idle for longer are closed, not reused
+#define UPLOAD_MAX_HEAD         16384               //!< Maximum response head length in bytes
+#define UPLOAD_S3_PART_SIZE     5*1024*1024         //!< Smallest S3 multipart part but the last one
+
+enum DashUploadProtocol {UPLOAD_HTTP, UPLOAD_S3};
+
+/*! Origin and path of an upload URL, http://host[:port]/path or https://host[:port]/path */
+struct DashUploadTarget {
+    bool tls;
+    std::string host;
+    unsigned port;
+    std::string path;               //!< Without the trailing slash, objects are uploaded to path/name
+
+    std::string getOrigin() const;
+    std::string getHostHeader() const;
+
+    /**
+    * @param url upload URL
+    * @return false if it is not a valid http or https URL
+    */
+    bool parse(std::string url);
+};
+
+/*! Persistent connection to an upload origin */
+struct DashUploadConnection {
+    int fd;
+    SSL* ssl;                       //!< NULL for plain HTTP
+    std::string origin;
+    std::chrono::steady_clock::time_point lastUse;
+    bool reused;                    //!< Taken from the pool, so the origin may have closed it meanwhile
+
+    bool send(const char* data, size_t length);
+    ssize_t receive(char* buffer, size_t length);
+};
+
+/*! Keep-alive connections shared by all the uploaders, pooled per origin. Connections are taken for
+*   a whole request and given back once its response is read, unless the origin asked to close them.
+*/
+class DashConnectionPool {
+
+public:
+    static DashConnectionPool& getInstance();
+
+    /**
+    * @return an idle connection to the target origin or a new one, NULL if it can not be opened
+    */
+    DashUploadConnection* take(const DashUploadTarget &target);
+
+    /**
+    * Gives a connection back
+    * @param reusable if false the connection is closed
+    */
+    void release(DashUploadConnection* conn, bool reusable);
+
+    size_t getOpenedConnections() {return opened;};
+    size_t getReusedConnections() {return reused;};
+
+private:
+    DashConnectionPool();
+    ~DashConnectionPool();
+    DashConnectionPool(DashConnectionPool const&) = delete;
+    void operator=(DashConnectionPool const&) = delete;
+
+    DashUploadConnection* open(const DashUploadTarget &target);
+    void close(DashUploadConnection* conn);
+    bool isAlive(DashUploadConnection* conn);
+
+    std::map<std::string, std::vector<DashUploadConnection*>> idle;
+    std::mutex mtx;
+    SSL_CTX* sslCtx;
+    std::atomic<size_t> opened;
+    std::atomic<size_t> reused;
+};
+
+/*! Uploads the DASH files straight from memory to an HTTP origin with PUT and DELETE requests, or to an S3
+*   bucket with signed (AWS SigV4) PutObject and DeleteObject requests and multipart uploads. Requests are
+*   run in parallel by a set of workers over the pooled keep-alive connections. Segments generated as CMAF
+*   chunks are streamed while they are generated: each one is a single PUT with chunked transfer encoding
+*   for HTTP origins, while S3 gets a multipart upload once the segment reaches the smallest part size.
+*   A stream that fails is uploaded again as a whole when it is finished.
+*/
+class DashUploader {
+
+public:
+    /**
+    * Class constructor
+    */
+    DashUploader();
+
+    /**
+    * Class destructor, streams in progress are finished and pending requests are done before stopping
+    */
+    ~DashUploader();
+
+    /**
+    * Sets the credentials of the S3 requests. Without them S3 requests are not signed
+    * @param region bucket region, e.g. us-east-1
+    */
+    void setCredentials(std::string region, std::string accessKey, std::string secretKey);
+
+    /**
+    * Starts the workers
+    * @param url base URL, files are uploaded to url/name. S3 buckets are addressed in path style, https://host/bucket/prefix
+    * @param protocol HTTP or S3 requests
+    * @param parallelUploads simultaneous requests
+    * @return false if the URL is not valid or the S3 credentials are missing the region
+    */
+    bool start(std::string url, DashUploadProtocol protocol, unsigned parallelUploads = UPLOAD_PARALLEL);
+
+    /**
+    * Queues the upload of a file. The data must be valid until wait returns
+    * @param name file name, relative to the base URL
+    */
+    void upload(std::string name, const char* data, size_t length);
+
+    /**
+    * Queues the removal of a file
+    * @param name file name, relative to the base URL
+    */
+    void remove(std::string name);
+
+    /**
+    * Waits until the queued uploads and removals are done
+    * @return requests that failed since the previous call
+    */
+    size_t wait();
+
+    /**
+    * Appends a chunk to a file upload in progress, which is sent while it is generated
+    * @param name file name, relative to the base URL
+    * @param first the chunk starts the file, an upload in progress with the same name is aborted
+    */
+    void appendChunk(std::string name, const std::string &data, bool first);
+
+    /**
+    * Finishes a file upload in progress, without waiting for it
+    * @param name file name, relative to the base URL
+    */
+    void finishStream(std::string name);
+
+    /**
+    * @return the base URL, empty if not started
+    */
+    std::string getURL() {return url;};
+
+    /**
+    * Fills the upload metrics
+    * @param node where the metrics are added
+    */
+    void getState(Jzon::Object &node);
+
+    /**
+    * Computes the AWS SigV4 Authorization header of a request
+    * @param headers lower case names and values of the signed headers, which must include host and x-amz-date
+    * @param query canonical query string, with sorted and encoded parameters
+    * @param payloadHash hex SHA-256 of the payload or UNSIGNED-PAYLOAD
+    */
+    static std::string signV4(std::string method, std::string uri, std::string query,
+                              const std::map<std::string, std::string> &headers, std::string payloadHash,
+                              std::string region, std::string accessKey, std::string secretKey);
+
+    /**
+    * URI encodes a string as SigV4 requires, slashes are kept if path is true
+    */
+    static std::string uriEncode(std::string value, bool path);
+
+private:
+    struct Request {
+        std::string method;
+        std::string name;
+        std::string query;
+        const char* data;
+        size_t length;
+    };
+
+    struct Response {
+        int status;
+        std::map<std::string, std::string> headers;     //!< Lower case names
+        std::string body;
+    };
+
+    struct Stream {
+        std::string name;
+        std::string data;                               //!< Whole file so far, kept for retries and S3 parts
+        size_t sent;                                    //!< Bytes already streamed or uploaded as parts
+        bool finished;
+        bool aborted;
+        bool done;
+        std::thread thread;
+    };
+
+    void workerLoop();
+    void streamLoop(Stream* stream);
+    bool streamChunked(Stream* stream, std::unique_lock<std::mutex> &guard);
+    bool streamParts(Stream* stream, std::unique_lock<std::mutex> &guard);
+    void reapStreams();
+
+    bool execute(const Request &req, Response &res);
+    bool sendRequest(DashUploadConnection* conn, const Request &req, bool chunked);
+    bool readResponse(DashUploadConnection* conn, Response &res, bool &reusable);
+    std::string buildHead(const Request &req, bool chunked);
+    std::string getObjectPath(std::string name);
+
+    DashUploadTarget target;
+    DashUploadProtocol protocol;
+    std::string url;
+    std::string region;
+    std::string accessKey;
+    std::string secretKey;
+
+    std::vector<std::thread> workers;
+    std::deque<Request> requests;
+    size_t running;
+    size_t failed;
+    bool stop;
+    std::mutex mtx;
+    std::condition_variable requestCheck;
+
+    std::map<std::string, Stream*> streams;
+    std::vector<Stream*> finishing;                     //!< Finished streams still uploading
+    std::condition_variable streamCheck;
+
+    std::atomic<size_t> uploads;
+    std::atomic<size_t> removals;
+    std::atomic<size_t> failedRequests;
+    std::atomic<size_t> retries;
+    std::atomic<size_t> uploadedBytes;
+    std::atomic<size_t> streamedFiles;
+    std::atomic<size_t> streamFallbacks;                //!< Streams uploaded again as a whole
+};
+
+#endif
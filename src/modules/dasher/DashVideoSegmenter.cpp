@@ -27,7 +27,7 @@
 
 DashVideoSegmenter::DashVideoSegmenter(std::chrono::seconds segDur, std::string video_format_, std::chrono::microseconds offset) : 
 DashSegmenter(segDur, DASH_VIDEO_TIME_BASE, offset), 
-currentIntra(false), previousIntra(false), video_format(video_format_)
+currentIntra(false), previousIntra(false), pendingFrameLength(0), video_format(video_format_)
 {
 
 }
@@ -48,6 +48,12 @@ Frame* DashVideoSegmenter::manageFrame(Frame* frame)
         utils::errorMsg("Error managing frame: it MUST be a video frame");
         return NULL;
     }
+
+    //NOTE: the data of a frame which has not been appended is dropped, the next one follows it in the context
+    if (pendingFrameLength > 0) {
+        discard_pending_video_data(pendingFrameLength, &dashContext);
+        pendingFrameLength = 0;
+    }
     
     vFrame = parseNal(nal);
 
@@ -57,6 +63,8 @@ Frame* DashVideoSegmenter::manageFrame(Frame* frame)
         return NULL;
     }
 
+    pendingFrameLength = vFrame->getLength();
+
     if(!setup(vFrame->getWidth(), vFrame->getHeight())) {
         utils::errorMsg("Error during Dash Video Segmenter setup");
         return NULL;
@@ -84,6 +92,16 @@ bool DashVideoSegmenter::setup(unsigned int width, unsigned int height)
     }
 
     set_segment_duration(segDurInTimeBaseUnits, &dashContext);
+    set_chunk_samples(chunkFrames, &dashContext);
+
+    if (!setupEncryption()) {
+        return false;
+    }
+
+    if (reserve_segment_data(getEstimatedSegmentSize(), &dashContext) != I2OK) {
+        return false;
+    }
+
     return true;
 }
 
@@ -100,7 +118,7 @@ bool DashVideoSegmenter::generateInitSegment(DashSegment* segment)
     data = reinterpret_cast<unsigned char*> (&extradata[0]);
     dataLength = extradata.size();
 
-    if (!data) {
+    if (!data || !segment->reserve(dataLength + DASH_INIT_SEGMENT_OVERHEAD + get_init_encryption_size(dashContext))) {
         return false;
     }
 
@@ -125,6 +143,11 @@ unsigned DashVideoSegmenter::customGenerateSegment(unsigned char *segBuffer, std
     return generate_video_segment(isPreviousFrameIntra(), timeBasePts, segBuffer, &dashContext, &segTimestamp, &segDuration);
 }
 
+unsigned DashVideoSegmenter::customGenerateChunk(unsigned char *chunkBuffer, uint64_t &segTimestamp, uint32_t &chunkDur)
+{
+    return generate_video_chunk(chunkBuffer, &dashContext, &segTimestamp, &chunkDur);
+}
+
 bool DashVideoSegmenter::appendFrameToDashSegment(Frame* frame)
 {
     unsigned int addSampleReturn;
@@ -133,7 +156,8 @@ bool DashVideoSegmenter::appendFrameToDashSegment(Frame* frame)
     
     VideoFrame* vFrame = dynamic_cast<VideoFrame*> (frame);
 
-    if (!vFrame || !vFrame->getDataBuf() || vFrame->getLength() <= 0 || !dashContext) {
+    //NOTE: frame data is already in the segmenter context, see appendNalToFrame
+    if (!vFrame || vFrame->getLength() <= 0 || vFrame->getLength() != pendingFrameLength || !dashContext) {
         utils::errorMsg("Error appeding frame to segment: frame not valid");
         return false;
     }
@@ -142,33 +166,33 @@ bool DashVideoSegmenter::appendFrameToDashSegment(Frame* frame)
     timeBaseDts = microsToTimeBase(vFrame->getDecodeTime());
 
     //TODO: test it with bFrames
-    addSampleReturn = add_video_sample(vFrame->getDataBuf(), vFrame->getLength(), timeBasePts, 
-                                        timeBaseDts, sequenceNumber, isPreviousFrameIntra(), &dashContext);
+    addSampleReturn = add_pending_video_sample(pendingFrameLength, timeBasePts, timeBaseDts, 
+                                               sequenceNumber, isPreviousFrameIntra(), &dashContext);
 
     if (addSampleReturn != I2OK) {
         utils::errorMsg("Error adding video sample. Code error: " + std::to_string(addSampleReturn));
         return false;
     }
 
+    pendingFrameLength = 0;
     return true;
 }
 
 bool DashVideoSegmenter::appendNalToFrame(VideoFrame* frame, unsigned char* nalData, unsigned nalDataLength, 
                                            unsigned nalWidth, unsigned nalHeight, std::chrono::microseconds ts, std::chrono::microseconds dts)
 {
-    if (frame->getLength() + nalDataLength + AVCC_HEADER_BYTES_MINUS_ONE + 1 > frame->getMaxLength()) {
-        utils::errorMsg("[DashVideoSegmenter::appendNalToFrame] Nal exceeds frame max length");
+    if (!dashContext && generateContext() != I2OK) {
+        utils::errorMsg("[DashVideoSegmenter::appendNalToFrame] Error generating the segmenter context");
         return false;
     }
 
-    frame->getDataBuf()[frame->getLength()] = (nalDataLength >> 24) & 0xFF;
-    frame->getDataBuf()[frame->getLength()+1] = (nalDataLength >> 16) & 0xFF;
-    frame->getDataBuf()[frame->getLength()+2] = (nalDataLength >> 8) & 0xFF;
-    frame->getDataBuf()[frame->getLength()+3] = nalDataLength & 0xFF;
-    frame->setLength(frame->getLength() + 4);
+    //NOTE: the NAL is written once, in AVCC format, right after the segment data. The frame only keeps its metadata
+    if (append_video_nal(nalData, nalDataLength, &dashContext) != I2OK) {
+        utils::errorMsg("[DashVideoSegmenter::appendNalToFrame] Nal exceeds segment max length");
+        return false;
+    }
 
-    memcpy(frame->getDataBuf() + frame->getLength(), nalData, nalDataLength);
-    frame->setLength(frame->getLength() + nalDataLength);
+    frame->setLength(frame->getLength() + nalDataLength + AVCC_HEADER_BYTES_MINUS_ONE + 1);
     
     frame->setSize(nalWidth, nalHeight);
     frame->setPresentationTime(ts);
@@ -178,20 +202,6 @@ bool DashVideoSegmenter::appendNalToFrame(VideoFrame* frame, unsigned char* nalD
 }
 
 
-int DashVideoSegmenter::detectStartCode(unsigned char const* ptr)
-{
-    u_int32_t bytes = 0|(ptr[0]<<16)|(ptr[1]<<8)|ptr[2];
-    if (bytes == H264or5_NALU_START_CODE) {
-        return SHORT_START_CODE_LENGTH;
-    }
-
-    bytes = (ptr[0]<<24)|(ptr[1]<<16)|(ptr[2]<<8)|ptr[3];
-    if (bytes == H264or5_NALU_START_CODE) {
-        return LONG_START_CODE_LENGTH;
-    }
-    return 0;
-}
-
 unsigned int DashVideoSegmenter::getWidth()
 {
     if (!dashContext || !dashContext->ctxvideo) {
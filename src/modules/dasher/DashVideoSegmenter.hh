@@ -26,14 +26,13 @@
 #define _DASH_VIDEO_SEGMENTER_HH
 
 #include "Dasher.hh"
+#include "../../NalSplitter.hh"
 
-#define H264or5_NALU_START_CODE 0x00000001
 #define AVCC_HEADER_BYTES_MINUS_ONE 0x03
-#define SHORT_START_CODE_LENGTH 3
-#define LONG_START_CODE_LENGTH 4
 
 /*! Virtual class responsible for managing DASH video segments creation. It receives H264or5 NALs, joining them into complete frames
-    and using these frames to create the segments. It also manages Init Segment creation, constructing MP4 metadata from
+    and using these frames to create the segments. NALs are written in AVCC format straight into the segment data, so the frames
+    returned by manageFrame only carry metadata. It also manages Init Segment creation, constructing MP4 metadata from
     SPS and PPS (and VPS) NALUs*/
 
 class DashVideoSegmenter : public DashSegmenter {
@@ -68,10 +67,10 @@ public:
     unsigned int getFramerate(){return 0;};
 
     /**
-    * Return the video format string (i.e.: avc or hevc types)
+    * Return the video format string (i.e.: avc, hevc or av01 types)
     * @return video format as string
     */
-    std::string getVideoFormat() {return video_format;};
+    virtual std::string getVideoFormat() {return video_format;};
 
     /**
     * Processes incoming frames to be appended to current segment
@@ -102,15 +101,16 @@ protected:
     bool appendNalToFrame(VideoFrame* frame, unsigned char* nalData, unsigned nalDataLength, 
                            unsigned nalWidth, unsigned nalHeight, std::chrono::microseconds ts,
                            std::chrono::microseconds dts);
-    int detectStartCode(unsigned char const* ptr);
     bool setup(unsigned int width, unsigned int height);
     unsigned customGenerateSegment(unsigned char *segBuffer, std::chrono::microseconds nextFrameTs, 
                                     uint64_t &segTimestamp, uint32_t &segDuration, bool force);
+    unsigned customGenerateChunk(unsigned char *chunkBuffer, uint64_t &segTimestamp, uint32_t &chunkDur);
 
 
     unsigned int frameRate;
     bool currentIntra;
     bool previousIntra;
+    unsigned int pendingFrameLength;       //!< Frame returned by manageFrame, its data waits in the context to be appended
     const std::string video_format;
 };
 
@@ -0,0 +1,174 @@
+/*
+ *  DashVideoSegmenterAV1.cpp - DASH AV1 video stream segmenter
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <algorithm>
+
+#include "DashVideoSegmenterAV1.hh"
+
+DashVideoSegmenterAV1::DashVideoSegmenterAV1(std::chrono::seconds segDur, std::chrono::microseconds offset) :
+DashVideoSegmenter(segDur, VIDEO_CODEC_AV1, offset), seqHeaderParsed(false), seqHeaderChanged(false)
+{
+    vFrame = InterleavedVideoFrame::createNew(AV1, LENGTH_AV1);
+}
+
+DashVideoSegmenterAV1::~DashVideoSegmenterAV1()
+{
+    delete vFrame;
+}
+
+uint8_t DashVideoSegmenterAV1::generateContext()
+{
+    return generate_context(&dashContext, VIDEO_TYPE_AV1);
+}
+
+void DashVideoSegmenterAV1::updateExtradata()
+{
+    if (!seqHeaderChanged) {
+        return;
+    }
+
+    extradata = seqHeader.configRecord(seqHeaderObu.data(), seqHeaderObu.size());
+    seqHeaderChanged = false;
+}
+
+bool DashVideoSegmenterAV1::flushDashContext()
+{
+    if (!dashContext) {
+        return false;
+    }
+
+    context_refresh(&dashContext, VIDEO_TYPE_AV1);
+    return true;
+}
+
+std::string DashVideoSegmenterAV1::getVideoFormat()
+{
+    if (!seqHeaderParsed) {
+        return video_format;
+    }
+
+    return seqHeader.codecString();
+}
+
+VideoFrame* DashVideoSegmenterAV1::parseNal(VideoFrame* nal)
+{
+    ObuSplitter scanner(nal->getDataBuf(), nal->getLength());
+    ObuSpan obu;
+    ObuSpan seqObu;
+    bool key = false;
+    bool frameFound = false;
+    bool sequenceHeader = false;
+
+    resetFrame();
+
+    while (scanner.next(obu)) {
+        if (obu.type == OBU_SEQUENCE_HEADER) {
+            Av1SequenceHeader header;
+
+            if (!header.parse(obu.data + obu.headerSize, obu.size - obu.headerSize)) {
+                utils::errorMsg("[DashVideoSegmenterAV1::parseNal] Unsupported sequence header");
+                return NULL;
+            }
+
+            if (seqHeaderObu.size() != obu.size || !std::equal(obu.data, obu.data + obu.size, seqHeaderObu.begin())) {
+                seqHeaderObu.assign(obu.data, obu.data + obu.size);
+                seqHeaderChanged = true;
+            }
+
+            seqHeader = header;
+            seqHeaderParsed = true;
+            sequenceHeader = true;
+        }
+
+        if ((obu.type == OBU_FRAME || obu.type == OBU_FRAME_HEADER) && !frameFound && seqHeaderParsed) {
+            key = ObuSplitter::isKeyFrame(obu.data + obu.headerSize, obu.size - obu.headerSize,
+                                          seqHeader.reducedStillPictureHeader);
+            frameFound = true;
+        }
+    }
+
+    if (scanner.isBroken()) {
+        utils::warningMsg("[DashVideoSegmenterAV1::parseNal] Malformed temporal unit, writing its valid OBUs");
+    }
+
+    //NOTE: temporal units before the first sequence header can not be decoded
+    if (!frameFound) {
+        return NULL;
+    }
+
+    //NOTE: sync samples need the sequence header, it is repeated if the encoder only sent it once
+    if (key && !sequenceHeader) {
+        seqObu.data = seqHeaderObu.data();
+        seqObu.size = seqHeaderObu.size();
+        seqObu.headerSize = 0;
+        seqObu.type = OBU_SEQUENCE_HEADER;
+
+        if (!appendObu(seqObu)) {
+            return NULL;
+        }
+    }
+
+    ObuSplitter splitter(nal->getDataBuf(), nal->getLength());
+
+    //NOTE: temporal delimiters are implied by the samples and padding is not needed
+    while (splitter.next(obu)) {
+        if (obu.type == OBU_TEMPORAL_DELIMITER || obu.type == OBU_PADDING) {
+            continue;
+        }
+
+        if (!appendObu(obu)) {
+            return NULL;
+        }
+    }
+
+    //NOTE: there is no frame reordering, each temporal unit is returned right away
+    currentIntra = key;
+    previousIntra = key;
+
+    vFrame->setSize(nal->getWidth() > 0 ? nal->getWidth() : seqHeader.maxWidth,
+                    nal->getHeight() > 0 ? nal->getHeight() : seqHeader.maxHeight);
+    vFrame->setPresentationTime(nal->getPresentationTime());
+    vFrame->setDecodeTime(nal->getDecodeTime());
+
+    return vFrame;
+}
+
+bool DashVideoSegmenterAV1::appendObu(ObuSpan const& obu)
+{
+    if (!dashContext && generateContext() != I2OK) {
+        utils::errorMsg("[DashVideoSegmenterAV1::appendObu] Error generating the segmenter context");
+        return false;
+    }
+
+    if (append_video_data((byte*) obu.data, obu.size, &dashContext) != I2OK) {
+        utils::errorMsg("[DashVideoSegmenterAV1::appendObu] Temporal unit exceeds segment max length");
+        //NOTE: the OBUs already written belong to an incomplete sample
+        if (vFrame->getLength() > 0) {
+            discard_pending_video_data(vFrame->getLength(), &dashContext);
+            resetFrame();
+        }
+        return false;
+    }
+
+    vFrame->setLength(vFrame->getLength() + obu.size);
+    return true;
+}
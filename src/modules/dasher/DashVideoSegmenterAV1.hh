@@ -0,0 +1,76 @@
+/*
+ *  DashVideoSegmenterAV1.hh - DASH AV1 video stream segmenter
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _DASH_VIDEO_SEGMENTER_AV1_HH
+#define _DASH_VIDEO_SEGMENTER_AV1_HH
+
+#include "Dasher.hh"
+#include "DashVideoSegmenter.hh"
+#include "../../ObuSplitter.hh"
+
+/*! Class responsible for managing DASH AV1 video segments creation. It receives whole temporal units, as
+    output by VideoEncoderSvtAv1, and writes their OBUs as samples without temporal delimiters. The Init
+    Segment av01 sample entry carries an av1C box built from the last sequence header, which also gives
+    the codecs string of the representation (e.g. av01.0.08M.08). Encryption is not supported.
+*/
+class DashVideoSegmenterAV1 : public DashVideoSegmenter {
+
+public:
+    /**
+    * Class constructor
+    * @param segDur Segment duration in milliseconds
+    * @param offset of the initial timestamp
+    */
+    DashVideoSegmenterAV1(std::chrono::seconds segDur, std::chrono::microseconds offset);
+
+    /**
+    * Class destructor
+    */
+    ~DashVideoSegmenterAV1();
+
+    /**
+    * Flushes segment context
+    * @return true if success, false otherwise.
+    */
+    bool flushDashContext();
+
+    /**
+    * @return codecs string of the last sequence header, av01 if there is none yet
+    */
+    std::string getVideoFormat();
+
+private:
+    void updateExtradata();
+    uint8_t generateContext();
+    VideoFrame* parseNal(VideoFrame* nal);
+    void resetFrame() {vFrame->setLength(0);};
+    bool appendObu(ObuSpan const& obu);
+
+    InterleavedVideoFrame* vFrame;
+
+    Av1SequenceHeader seqHeader;
+    bool seqHeaderParsed;
+    std::vector<unsigned char> seqHeaderObu;    //!< Last sequence header, the extradata is built from it when it changes
+    bool seqHeaderChanged;
+};
+
+#endif
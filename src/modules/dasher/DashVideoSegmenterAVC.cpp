@@ -71,7 +71,7 @@ VideoFrame* DashVideoSegmenterAVC::parseNal(VideoFrame* nal)
     unsigned char nalType;
     bool newFrame = false;
 
-    startCodeOffset = detectStartCode(nal->getDataBuf());
+    startCodeOffset = NalSplitter::startCodeLength(nal->getDataBuf(), nal->getLength());
     nalData = nal->getDataBuf() + startCodeOffset;
     nalDataLength = nal->getLength() - startCodeOffset;
 
@@ -26,28 +26,98 @@
 #include "DashVideoSegmenter.hh"
 #include "DashVideoSegmenterAVC.hh"
 #include "DashVideoSegmenterHEVC.hh"
+#include "DashVideoSegmenterAV1.hh"
 #include "DashAudioSegmenter.hh"
+#include "DashSegmentWriter.hh"
+#include "DashHttpOrigin.hh"
+#include "../../WorkersPool.hh"
 
 #include <map>
 #include <string>
 #include <chrono>
 #include <fstream>
+#include <cstring>
+#include <new>
+#include <algorithm>
 #include <unistd.h>
 #include <math.h>
 
+//NOTE: key ids are usually written as UUIDs, dashes are skipped
+static bool parseHex(std::string hex, std::vector<unsigned char> &bytes)
+{
+    std::string digits;
+
+    for (char c : hex) {
+        if (c == '-') {
+            continue;
+        }
+
+        if (!isxdigit(c)) {
+            return false;
+        }
+
+        digits += c;
+    }
+
+    if (digits.size() % 2 != 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < digits.size(); i += 2) {
+        bytes.push_back(std::stoi(digits.substr(i, 2), NULL, 16));
+    }
+
+    return true;
+}
+
+static std::string getSchemeName(unsigned scheme)
+{
+    switch (scheme) {
+        case CENC_SCHEME_CENC: return "cenc";
+        case CENC_SCHEME_CBCS: return "cbcs";
+        default: return "none";
+    }
+}
+
+static std::string getKidUUID(const std::vector<unsigned char> &kids)
+{
+    char uuid[37];
+    size_t pos = 0;
+
+    for (size_t i = 0; i < CENC_KEY_SIZE && i < kids.size(); i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            uuid[pos++] = '-';
+        }
+        snprintf(uuid + pos, sizeof(uuid) - pos, "%02x", kids[i]);
+        pos += 2;
+    }
+
+    return std::string(uuid, pos);
+}
+
 Dasher::Dasher(unsigned readersNum) :
-TailFilter(readersNum), mpdMngr(NULL), hasVideo(false), videoStarted(false), timestampOffset(std::chrono::microseconds(0))
+TailFilter(readersNum), mpdMngr(NULL), hlsMngr(NULL), writer(NULL), origin(NULL), diskOutput(true), chunkFrames(0), mpdPending(false), mpdPublications(0), hasVideo(false), videoStarted(false), captions(false), 
+timestampOffset(std::chrono::microseconds(0))
 {
     fType = DASHER;
+    encryption.scheme = CENC_SCHEME_NONE;
+    encryption.rotation = 0;
+    writer = new DashSegmentWriter();
     initializeEventMap();
 }
 
 Dasher::~Dasher()
 {
+    //NOTE: pending segments are written before the MPD manager goes away
+    delete writer;
+    writer = NULL;
+    delete origin;
+
     for (auto seg : segmenters) {
         delete seg.second;
     }
     delete mpdMngr;
+    delete hlsMngr;
 }
 
 bool Dasher::configure(std::string dashFolder, std::string baseName_, unsigned int segDurInSec, unsigned int maxSeg, unsigned int minBuffTime)
@@ -79,15 +149,20 @@ bool Dasher::configure(std::string dashFolder, std::string baseName_, unsigned i
     }
     
     mpdMngr->configure(minBuffTime, maxSeg, segDurInSec);
+
+    if (hlsMngr) {
+        hlsMngr->configure(baseName, mpdMngr->getMaxSeg(), segDurInSec);
+    }
+
     segDur = std::chrono::seconds(segDurInSec);
 
     return true;
 }
 
-bool Dasher::doProcessFrame(std::map<int, Frame*> &orgFrames, std::vector<int> newFrames, int& ret)
+bool Dasher::doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& ret)
 {
     DashSegmenter* segmenter;
-    Frame* frame;
+    std::vector<DashStep> steps;
 
     if (!mpdMngr) {
         utils::errorMsg("Dasher MUST be configured in order to process frames");
@@ -108,25 +183,26 @@ bool Dasher::doProcessFrame(std::map<int, Frame*> &orgFrames, std::vector<int> n
             }
         }
 
-        frame = segmenter->manageFrame(orgFrames[id]);
-
-        if (!frame) {
-            continue;
-        }
-
-        if (!generateInitSegment(id, segmenter)) {
-            utils::errorMsg("[Dasher::doProcessFrame] Error generating init segment");
-            continue;
-        }
+        steps.push_back(DashStep{id, segmenter, vSegments.count(id) > 0 ? vSegments[id] : aSegments[id],
+                                 initSegments[id], orgFrames[id], vSegments.count(id) > 0});
+    }
 
-        if (generateSegment(id, frame, segmenter)) {
-            utils::debugMsg("[Dasher::doProcessFrame] New segment generated");
+    //NOTE: each segmenter only works on its own segments, they run in parallel. Whatever is shared
+    //      (MPD, playlists, writer and origin) is updated afterwards, in the readers order
+    auto segmentStep = [&](unsigned i) {
+        processStep(steps[i]);
+    };
+
+    if (WorkersPool::current() && steps.size() > 1) {
+        WorkersPool::current()->parallelFor(steps.size(), segmentStep);
+    } else {
+        for (unsigned i = 0; i < steps.size(); i++) {
+            segmentStep(i);
         }
+    }
 
-        if (!appendFrameToSegment(id, frame, segmenter)) {
-            utils::errorMsg("[Dasher::doProcessFrame] Error appnding frame to segment");
-            continue;
-        }
+    for (auto &step : steps) {
+        publishStep(step);
     }
 
     if (writeVideoSegments()) {
@@ -136,110 +212,185 @@ bool Dasher::doProcessFrame(std::map<int, Frame*> &orgFrames, std::vector<int> n
     if (writeAudioSegments()) {
         utils::debugMsg("[Dasher::doProcessFrame] Audio segments to disk");
     }
+
+    //NOTE: video and audio timeline updates of the same call are coalesced in a single MPD
+    if (mpdPending && !publishMpd()) {
+        utils::errorMsg("[Dasher::doProcessFrame] Error publishing the MPD");
+    }
     
     ret = 0;
 
     return true;
 }
 
-bool Dasher::appendFrameToSegment(unsigned int id, Frame* frame, DashSegmenter* segmenter)
+//NOTE: it runs concurrently with the steps of other readers, it must not touch anything but the step segmenter and segments
+void Dasher::processStep(DashStep &step)
 {
-    DashVideoSegmenter* vSeg;
-    DashAudioSegmenter* aSeg;
+    step.frame = step.segmenter->manageFrame(step.orgFrame);
 
-    if ((vSeg = dynamic_cast<DashVideoSegmenter*>(segmenter)) != NULL) {
+    if (!step.frame) {
+        return;
+    }
 
-        if (!vSeg->appendFrameToDashSegment(frame)) {
-            utils::errorMsg("Error appending video frame to segment");
-            return false;
-        }
+    step.initGenerated = step.segmenter->generateInitSegment(step.initSegment);
 
-    }   
+    //NOTE: audio segments follow the video ones when there is video, see forceAudioSegmentsGeneration
+    if (step.video || !hasVideo) {
+        step.segmentGenerated = step.segmenter->generateSegment(step.segment, step.frame);
+    }
 
-    if ((aSeg = dynamic_cast<DashAudioSegmenter*>(segmenter)) != NULL) {
+    step.appended = step.segmenter->appendFrameToDashSegment(step.frame);
 
-        if (!aSeg->appendFrameToDashSegment(frame)) {
-            utils::errorMsg("Error appending audio frame to segment");
-            return false;
-        }
+    //NOTE: a complete segment waits for the rest of its adaptation set, its frames are chunked once it is committed
+    if (step.appended && chunkFrames > 0 && !step.segment->isComplete()) {
+        step.chunkGenerated = step.segmenter->generateChunk(step.segment);
+    }
+}
+
+void Dasher::publishStep(DashStep &step)
+{
+    if (!step.frame) {
+        return;
     }
 
-    if (!vSeg && !aSeg) {
-        return false;
+    if (step.initGenerated && !publishInitSegment(step.id, step.video ? V_EXT : A_EXT)) {
+        utils::errorMsg("[Dasher::doProcessFrame] Error generating init segment");
     }
 
-    return true;
+    //NOTE: captions are announced from the first segment of the pictures carrying them
+    if (step.video && step.orgFrame->getSideData().has(SD_CAPTIONS)) {
+        captions = true;
+    }
+
+    if (step.segmentGenerated) {
+        updateRepresentation(step.id, step.segmenter);
+        utils::debugMsg("[Dasher::doProcessFrame] New segment generated");
+    }
+
+    if (step.video) {
+        requestKeyFrame(step);
+    }
+
+    if (!step.appended) {
+        utils::errorMsg("[Dasher::doProcessFrame] Error appnding frame to segment");
+        return;
+    }
+
+    if (step.chunkGenerated && !publishChunks(step.id, step.segmenter)) {
+        utils::errorMsg("[Dasher::doProcessFrame] Error publishing chunk");
+    }
 }
 
-bool Dasher::generateInitSegment(unsigned int id, DashSegmenter* segmenter)
+void Dasher::requestKeyFrame(DashStep &step)
 {
-    DashVideoSegmenter* vSeg;
-    DashAudioSegmenter* aSeg;
+    std::shared_ptr<Reader> reader;
 
-    if ((vSeg = dynamic_cast<DashVideoSegmenter*>(segmenter)) != NULL) {
+    //NOTE: the frame generating a segment starts the next one
+    if (step.segmentGenerated || segmentStarts.count(step.id) == 0) {
+        segmentStarts[step.id] = step.frame->getPresentationTime();
+    }
 
-        if (!vSeg->generateInitSegment(initSegments[id])) {
-            return true;
-        }
+    if ((reader = getReader(step.id)) && reader->getQueue()) {
+        reader->getQueue()->setReaderKeyFrameTime(segmentStarts[step.id] + segDur);
+    }
+}
 
-        if(!initSegments[id]->writeToDisk(getInitSegmentName(basePath, baseName, id, V_EXT))) {
-            utils::errorMsg("Error writing DASH segment to disk: invalid path");
-            return false;
-        }
+bool Dasher::publishChunks(unsigned int id, DashSegmenter* segmenter)
+{
+    std::map<int, DashSegment*>* segments;
+    std::string adSetId;
+    std::string ext;
+    DashSegment* segment;
+    DashWriterJob* job = NULL;
+
+    if (vSegments.count(id) > 0) {
+        segments = &vSegments;
+        adSetId = V_ADAPT_SET_ID;
+        ext = V_EXT;
+    } else if (aSegments.count(id) > 0) {
+        segments = &aSegments;
+        adSetId = A_ADAPT_SET_ID;
+        ext = A_EXT;
+    } else {
+        return false;
     }
 
-    if ((aSeg = dynamic_cast<DashAudioSegmenter*>(segmenter)) != NULL) {
+    segment = (*segments)[id];
 
-        if (!aSeg->generateInitSegment(initSegments[id])) {
-            return true;
-        }
+    if (segment->getPublishedLength() == 0 && !announceSegments(*segments, adSetId, segment->getTimestamp(), segmenter, ext)) {
+        utils::errorMsg("Error announcing DASH segments");
+    }
 
-        if(!initSegments[id]->writeToDisk(getInitSegmentName(basePath, baseName, id, A_EXT))) {
-            utils::errorMsg("Error writing DASH segment to disk: invalid path");
-            return false;
-        }
+    if (writer->hasOutput()) {
+        job = new DashWriterJob();
+    }
+
+    publishChunk(id, segment, ext, job);
+
+    return !job || writer->push(job);
+}
+
+bool Dasher::publishInitSegment(unsigned int id, std::string ext)
+{
+    DashWriterJob* job;
+
+    if (origin) {
+        origin->publish(getInitSegmentName("", baseName, id, ext), initSegments[id]->getDataBuffer(),
+                        initSegments[id]->getDataLength());
+    }
+
+    if (!writer->hasOutput()) {
+        return true;
     }
 
-    if (!vSeg && !aSeg) {
+    //NOTE: the segment is handed off to the writer, which is in charge of writing it in order
+    job = new DashWriterJob();
+    job->segments.push_back(std::make_pair(getInitSegmentName(basePath, baseName, id, ext), initSegments[id]));
+    initSegments[id] = writer->getSegment();
+
+    if (!writer->push(job)) {
+        utils::errorMsg("Error queueing DASH init segment");
         return false;
     }
 
     return true;
 }
 
-bool Dasher::generateSegment(unsigned int id, Frame* frame, DashSegmenter* segmenter)
+void Dasher::updateRepresentation(unsigned int id, DashSegmenter* segmenter)
 {
     DashVideoSegmenter* vSeg;
     DashAudioSegmenter* aSeg;
 
     if ((vSeg = dynamic_cast<DashVideoSegmenter*>(segmenter)) != NULL) {
-
-        if (!vSeg->generateSegment(vSegments[id], frame)) {
-            return false;
+        mpdMngr->updateVideoAdaptationSet(V_ADAPT_SET_ID, segmenter->getTimeBase(), vSegTempl, vInitSegTempl);
+        if (encryption.scheme != CENC_SCHEME_NONE) {
+            mpdMngr->setContentProtection(V_ADAPT_SET_ID, getSchemeName(encryption.scheme), getKidUUID(encryption.kids));
         }
-
-        mpdMngr->updateVideoAdaptationSet(V_ADAPT_SET_ID, segmenters[id]->getTimeBase(), vSegTempl, vInitSegTempl);
+        mpdMngr->setCaptions(V_ADAPT_SET_ID, captions);
         mpdMngr->updateVideoRepresentation(V_ADAPT_SET_ID, std::to_string(id), vSeg->getVideoFormat(), vSeg->getWidth(),
                                             vSeg->getHeight(), vSeg->getBitrate(), vSeg->getFramerate());
 
+        if (hlsMngr) {
+            hlsMngr->updateVideoAdaptationSet(V_ADAPT_SET_ID, segmenter->getTimeBase(), vSegTempl, vInitSegTempl);
+            hlsMngr->updateVideoRepresentation(V_ADAPT_SET_ID, std::to_string(id), vSeg->getVideoFormat(), vSeg->getWidth(),
+                                                vSeg->getHeight(), vSeg->getBitrate(), vSeg->getFramerate());
+        }
     }
 
-    if (!hasVideo && (aSeg = dynamic_cast<DashAudioSegmenter*>(segmenter)) != NULL) {
-        
-        if (!aSeg->generateSegment(aSegments[id], frame)) {
-            return false;
+    if ((aSeg = dynamic_cast<DashAudioSegmenter*>(segmenter)) != NULL) {
+        mpdMngr->updateAudioAdaptationSet(A_ADAPT_SET_ID, segmenter->getTimeBase(), aSegTempl, aInitSegTempl);
+        if (encryption.scheme != CENC_SCHEME_NONE) {
+            mpdMngr->setContentProtection(A_ADAPT_SET_ID, getSchemeName(encryption.scheme), getKidUUID(encryption.kids));
         }
-
-        mpdMngr->updateAudioAdaptationSet(A_ADAPT_SET_ID, segmenters[id]->getTimeBase(), aSegTempl, aInitSegTempl);
         mpdMngr->updateAudioRepresentation(A_ADAPT_SET_ID, std::to_string(id), AUDIO_CODEC, 
                                             aSeg->getSampleRate(), aSeg->getBitrate(), aSeg->getChannels());
-    }
 
-    if (!vSeg && !aSeg) {
-        return false;
+        if (hlsMngr) {
+            hlsMngr->updateAudioAdaptationSet(A_ADAPT_SET_ID, segmenter->getTimeBase(), aSegTempl, aInitSegTempl);
+            hlsMngr->updateAudioRepresentation(A_ADAPT_SET_ID, std::to_string(id), AUDIO_CODEC, 
+                                                aSeg->getSampleRate(), aSeg->getBitrate(), aSeg->getChannels());
+        }
     }
-
-    return true;
 }
 
 bool Dasher::writeVideoSegments()
@@ -271,17 +422,12 @@ bool Dasher::writeVideoSegments()
         }
     }
 
-    if (!writeSegmentsToDisk(vSegments, ts, V_EXT)) {
-        utils::errorMsg("Error writing DASH video segment to disk");
-        return false;
-    }
-
     rmTimestamp = mpdMngr->updateAdaptationSetTimestamp(V_ADAPT_SET_ID, ts, dur);
+    updateHlsTimeline(V_ADAPT_SET_ID, ts, dur, rmTimestamp);
 
-    mpdMngr->writeToDisk(mpdPath.c_str());
-
-    if (rmTimestamp > 0 && !cleanSegments(vSegments, rmTimestamp, V_EXT)) {
-        utils::warningMsg("Error cleaning dash video segments");
+    if (!commitSegments(vSegments, ts, rmTimestamp, V_EXT)) {
+        utils::errorMsg("Error queueing DASH video segments");
+        return false;
     }
 
     return true;
@@ -312,17 +458,12 @@ bool Dasher::writeAudioSegments()
         }
     }
 
-    if (!writeSegmentsToDisk(aSegments, ts, A_EXT)) {
-        utils::errorMsg("Error writing DASH video segment to disk");
-        return false;
-    }
-
     rmTimestamp = mpdMngr->updateAdaptationSetTimestamp(A_ADAPT_SET_ID, ts, dur);
+    updateHlsTimeline(A_ADAPT_SET_ID, ts, dur, rmTimestamp);
 
-    mpdMngr->writeToDisk(mpdPath.c_str());
-
-    if (rmTimestamp > 0 && !cleanSegments(aSegments, rmTimestamp, A_EXT)) {
-        utils::warningMsg("Error cleaning dash video segments");
+    if (!commitSegments(aSegments, ts, rmTimestamp, A_EXT)) {
+        utils::errorMsg("Error queueing DASH audio segments");
+        return false;
     }
 
     return true;
@@ -351,45 +492,202 @@ bool Dasher::forceAudioSegmentsGeneration()
             return false;
         }
 
-        mpdMngr->updateAudioAdaptationSet(A_ADAPT_SET_ID, segmenters[seg.first]->getTimeBase(), aSegTempl, aInitSegTempl);
-        mpdMngr->updateAudioRepresentation(A_ADAPT_SET_ID, std::to_string(seg.first), AUDIO_CODEC, 
-                                            aSeg->getSampleRate(), aSeg->getBitrate(), aSeg->getChannels());
+        updateRepresentation(seg.first, segmenter);
     }
 
     return true;
 }
 
-bool Dasher::writeSegmentsToDisk(std::map<int,DashSegment*> segments, uint64_t timestamp, std::string segExt)
+bool Dasher::commitSegments(std::map<int,DashSegment*> &segments, uint64_t timestamp, uint64_t rmTimestamp, std::string segExt)
 {
-    for (auto seg : segments) {
+    DashWriterJob* job = NULL;
 
-        if(!seg.second->writeToDisk(getSegmentName(basePath, baseName, seg.first, timestamp, segExt))) {
-            utils::errorMsg("Error writing DASH segment to disk: invalid path");
-            return false;
+    if (writer->hasOutput()) {
+        job = new DashWriterJob();
+    }
+
+    //NOTE: chunked segments are already published but their last chunk, which finishes them
+    if (chunkFrames > 0) {
+        for (auto seg : segments) {
+            publishChunk(seg.first, seg.second, segExt, job);
+
+            if (origin) {
+                origin->finish(getSegmentName("", baseName, seg.first, timestamp, segExt));
+            }
+
+            if (job) {
+                job->finished.push_back(getSegmentName(basePath, baseName, seg.first, timestamp, segExt));
+            }
         }
+    } else if (origin) {
+        for (auto seg : segments) {
+            origin->publish(getSegmentName("", baseName, seg.first, timestamp, segExt),
+                            seg.second->getDataBuffer(), seg.second->getDataLength());
+        }
+    }
 
-        seg.second->clear();
-        seg.second->incrSeqNumber();
+    if (!job || chunkFrames > 0) {
+        for (auto seg : segments) {
+            seg.second->clear();
+            seg.second->incrSeqNumber();
+        }
+    } else {
+        queueSegments(segments, timestamp, segExt, job);
     }
 
-    return true;
+    return publishTimeline(segments, rmTimestamp, segExt, job);
+}
+
+//NOTE: the segment in progress is added to the timeline with the nominal duration, it is updated once complete
+bool Dasher::announceSegments(std::map<int,DashSegment*> &segments, std::string adSetId, uint64_t timestamp, 
+                              DashSegmenter* segmenter, std::string segExt)
+{
+    uint64_t rmTimestamp;
+    float availabilityTimeOffset;
+
+    if (announcedTimestamps.count(adSetId) > 0 && announcedTimestamps[adSetId] >= timestamp) {
+        return true;
+    }
+
+    announcedTimestamps[adSetId] = timestamp;
+
+    //NOTE: the first segments are not announced, the adaptation sets are created when they are complete
+    if (!mpdMngr->hasAdaptationSet(adSetId)) {
+        return true;
+    }
+
+    availabilityTimeOffset = segDur.count() - (float) segmenter->getChunkDuration()/segmenter->getTimeBase();
+    mpdMngr->setAvailabilityTimeOffset(adSetId, availabilityTimeOffset);
+
+    rmTimestamp = mpdMngr->updateAdaptationSetTimestamp(adSetId, timestamp, segmenter->getSegDurInTimeBaseUnits());
+
+    //NOTE: HLS playlists only list complete segments, but they must drop the ones removed from the MPD timeline
+    updateHlsTimeline(adSetId, 0, 0, rmTimestamp);
+
+    return publishTimeline(segments, rmTimestamp, segExt, NULL);
+}
+
+//NOTE: segments are served before the MPD referencing them, and removed once they are out of its timeline. 
+//      The MPD itself is published by publishMpd, once per doProcessFrame call
+bool Dasher::publishTimeline(std::map<int,DashSegment*> &segments, uint64_t rmTimestamp, std::string segExt, DashWriterJob *job)
+{
+    if (rmTimestamp > 0) {
+        queueRemovals(segments, rmTimestamp, segExt);
+    }
+
+    mpdPending = true;
+
+    return !job || writer->push(job);
+}
+
+//NOTE: segment data generated since the previous call is sent to the origin and appended to the segment file
+void Dasher::publishChunk(int id, DashSegment* segment, std::string segExt, DashWriterJob *job)
+{
+    unsigned char* data = segment->getDataBuffer() + segment->getPublishedLength();
+    unsigned length = segment->getDataLength() - segment->getPublishedLength();
+
+    if (length == 0) {
+        return;
+    }
+
+    if (origin) {
+        origin->publishChunk(getSegmentName("", baseName, id, segment->getTimestamp(), segExt), data, length);
+    }
+
+    if (job) {
+        job->chunks.push_back(DashChunk{getSegmentName(basePath, baseName, id, segment->getTimestamp(), segExt),
+                                        std::string((char*) data, length), segment->getPublishedLength() == 0});
+    }
+
+    segment->setPublishedLength(segment->getDataLength());
 }
 
-bool Dasher::cleanSegments(std::map<int,DashSegment*> segments, uint64_t timestamp, std::string segExt)
+//NOTE: segments are moved to the job, the segmenters go on with recycled ones
+void Dasher::queueSegments(std::map<int,DashSegment*> &segments, uint64_t timestamp, std::string segExt, DashWriterJob *job)
 {
-    bool success = true;
-    std::string segmentName;
+    DashSegment* next;
 
+    for (auto &seg : segments) {
+        job->segments.push_back(std::make_pair(getSegmentName(basePath, baseName, seg.first, timestamp, segExt), seg.second));
+
+        next = writer->getSegment();
+        next->setSeqNumber(seg.second->getSeqNumber() + 1);
+        seg.second = next;
+    }
+}
+
+void Dasher::queueRemovals(std::map<int,DashSegment*> &segments, uint64_t timestamp, std::string segExt)
+{
     for (auto seg : segments) {
-        segmentName = getSegmentName(basePath, baseName, seg.first, timestamp, segExt);
+        pendingRemovals.push_back(getSegmentName("", baseName, seg.first, timestamp, segExt));
+    }
+}
 
-        if (std::remove(segmentName.c_str()) != 0) {
-            success &= false;
-            utils::warningMsg("Error cleaning dash segment: " + segmentName);
+//NOTE: HLS playlists follow the MPD timeline, segments are never removed while a playlist references them
+void Dasher::updateHlsTimeline(std::string adSetId, uint64_t timestamp, unsigned int duration, uint64_t rmTimestamp)
+{
+    if (!hlsMngr) {
+        return;
+    }
+
+    if (duration > 0) {
+        hlsMngr->updateAdaptationSetTimestamp(adSetId, timestamp, duration);
+    }
+
+    if (rmTimestamp > 0) {
+        hlsMngr->removeTimestamps(adSetId, rmTimestamp);
+    }
+}
+
+bool Dasher::publishMpd()
+{
+    DashWriterJob* job;
+    std::string mpd;
+    std::vector<std::pair<std::string, std::string>> playlists;
+
+    if (!writer || !mpdMngr) {
+        return false;
+    }
+
+    mpd = mpdMngr->toString();
+    mpdPending = false;
+    mpdPublications++;
+
+    if (hlsMngr) {
+        hlsMngr->getPlaylists(playlists);
+    }
+
+    if (origin) {
+        origin->publish(baseName + ".mpd", mpd);
+
+        for (auto &playlist : playlists) {
+            origin->publish(playlist.first, playlist.second);
         }
+
+        for (auto name : pendingRemovals) {
+            origin->remove(name);
+        }
+    }
+
+    if (!writer->hasOutput()) {
+        pendingRemovals.clear();
+        return true;
     }
 
-    return success;
+    job = new DashWriterJob();
+    job->mpdPath = mpdPath;
+    job->mpd = mpd;
+
+    for (auto &playlist : playlists) {
+        job->playlists.push_back(std::make_pair(basePath + playlist.first, playlist.second));
+    }
+
+    for (auto name : pendingRemovals) {
+        job->removals.push_back(basePath + name);
+    }
+
+    pendingRemovals.clear();
+    return writer->push(job);
 }
 
 
@@ -397,11 +695,38 @@ void Dasher::initializeEventMap()
 {
     eventMap["configure"] = std::bind(&Dasher::configureEvent, this, std::placeholders::_1);
     eventMap["setBitrate"] = std::bind(&Dasher::setBitrateEvent, this, std::placeholders::_1);
+    eventMap["configOrigin"] = std::bind(&Dasher::configOriginEvent, this, std::placeholders::_1);
+    eventMap["configUpload"] = std::bind(&Dasher::configUploadEvent, this, std::placeholders::_1);
+    eventMap["configLowLatency"] = std::bind(&Dasher::configLowLatencyEvent, this, std::placeholders::_1);
+    eventMap["configHls"] = std::bind(&Dasher::configHlsEvent, this, std::placeholders::_1);
+    eventMap["configEncryption"] = std::bind(&Dasher::configEncryptionEvent, this, std::placeholders::_1);
+}
+
+//NOTE: segments are recycled and never shrunk, so their capacity is what they hold
+size_t Dasher::getInternalBytes()
+{
+    size_t bytes = 0;
+
+    for (auto it : vSegments) {
+        bytes += it.second->getCapacity();
+    }
+
+    for (auto it : aSegments) {
+        bytes += it.second->getCapacity();
+    }
+
+    for (auto it : initSegments) {
+        bytes += it.second->getCapacity();
+    }
+
+    return bytes;
 }
 
 void Dasher::doGetState(Jzon::Object &filterNode)
 {
     Jzon::Array readersList;
+    Jzon::Object writerNode;
+    Jzon::Object originNode;
 
     filterNode.Add("folder", basePath);
     filterNode.Add("baseName", baseName);
@@ -415,6 +740,21 @@ void Dasher::doGetState(Jzon::Object &filterNode)
     }
 
     filterNode.Add("readers", readersList);
+
+    writer->getState(writerNode);
+    filterNode.Add("writer", writerNode);
+    filterNode.Add("diskOutput", diskOutput);
+    filterNode.Add("chunkFrames", (int) chunkFrames);
+    filterNode.Add("mpdPublications", (int) mpdPublications);
+    filterNode.Add("hls", hlsMngr != NULL);
+    filterNode.Add("encryption", getSchemeName(encryption.scheme));
+    filterNode.Add("keys", (int) (encryption.kids.size() / CENC_KEY_SIZE));
+    filterNode.Add("captions", captions);
+
+    if (origin) {
+        origin->getState(originNode);
+        filterNode.Add("origin", originNode);
+    }
 }
 
 bool Dasher::configureEvent(Jzon::Node* params)
@@ -474,6 +814,296 @@ bool Dasher::setBitrateEvent(Jzon::Node* params)
     return setDashSegmenterBitrate(id, bitrate);
 }
 
+bool Dasher::configOriginEvent(Jzon::Node* params)
+{
+    int port = origin ? origin->getPort() : 0;
+    bool disk = diskOutput;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("port") && params->Get("port").IsNumber()) {
+        port = params->Get("port").ToInt();
+    }
+
+    if (params->Has("diskOutput") && params->Get("diskOutput").IsBool()) {
+        disk = params->Get("diskOutput").ToBool();
+    }
+
+    return configOrigin0(port, disk);
+}
+
+bool Dasher::configOrigin0(int port, bool disk)
+{
+    if (port < 0 || port > 65535) {
+        utils::errorMsg("Error configuring DASH origin: invalid port");
+        return false;
+    }
+
+    if (port == 0 && !disk && !writer->isUploading()) {
+        utils::errorMsg("Error configuring DASH origin: segments must be written to disk, uploaded or served by the origin");
+        return false;
+    }
+
+    if (origin && (int) origin->getPort() != port) {
+        delete origin;
+        origin = NULL;
+    }
+
+    if (port > 0 && !origin) {
+        origin = new DashHttpOrigin();
+
+        if (!origin->start(port)) {
+            utils::errorMsg("Error configuring DASH origin: could not listen on port " + std::to_string(port));
+            delete origin;
+            origin = NULL;
+            return false;
+        }
+    }
+
+    diskOutput = disk;
+    writer->setDiskOutput(disk);
+    return true;
+}
+
+bool Dasher::configUploadEvent(Jzon::Node* params)
+{
+    std::string url;
+    std::string protocol = "http";
+    int parallelUploads = UPLOAD_PARALLEL;
+    std::string region, accessKey, secretKey;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("url") && params->Get("url").IsString()) {
+        url = params->Get("url").ToString();
+    }
+
+    if (params->Has("protocol") && params->Get("protocol").IsString()) {
+        protocol = params->Get("protocol").ToString();
+    }
+
+    if (params->Has("parallelUploads") && params->Get("parallelUploads").IsNumber()) {
+        parallelUploads = params->Get("parallelUploads").ToInt();
+    }
+
+    if (params->Has("region") && params->Get("region").IsString()) {
+        region = params->Get("region").ToString();
+    }
+
+    if (params->Has("accessKey") && params->Get("accessKey").IsString()) {
+        accessKey = params->Get("accessKey").ToString();
+    }
+
+    if (params->Has("secretKey") && params->Get("secretKey").IsString()) {
+        secretKey = params->Get("secretKey").ToString();
+    }
+
+    return configUpload0(url, protocol, parallelUploads, region, accessKey, secretKey);
+}
+
+bool Dasher::configUpload0(std::string url, std::string protocol, int parallelUploads,
+                           std::string region, std::string accessKey, std::string secretKey)
+{
+    DashUploader* uploader;
+
+    if (url.empty()) {
+        if (!diskOutput && !origin) {
+            utils::errorMsg("Error configuring DASH upload: segments must be written to disk, uploaded or served by the origin");
+            return false;
+        }
+
+        writer->setUploader(NULL);
+        return true;
+    }
+
+    if (protocol != "http" && protocol != "s3") {
+        utils::errorMsg("Error configuring DASH upload: protocol must be http or s3");
+        return false;
+    }
+
+    if (parallelUploads <= 0) {
+        utils::errorMsg("Error configuring DASH upload: invalid number of parallel uploads");
+        return false;
+    }
+
+    uploader = new DashUploader();
+    uploader->setCredentials(region, accessKey, secretKey);
+
+    if (!uploader->start(url, protocol == "s3" ? UPLOAD_S3 : UPLOAD_HTTP, parallelUploads)) {
+        utils::errorMsg("Error configuring DASH upload to " + url);
+        delete uploader;
+        return false;
+    }
+
+    writer->setUploader(uploader);
+    return true;
+}
+
+bool Dasher::configLowLatencyEvent(Jzon::Node* params)
+{
+    int frames = chunkFrames;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("chunkFrames") && params->Get("chunkFrames").IsNumber()) {
+        frames = params->Get("chunkFrames").ToInt();
+    }
+
+    return configLowLatency0(frames);
+}
+
+bool Dasher::configLowLatency0(int frames)
+{
+    if (frames < 0) {
+        utils::errorMsg("Error configuring DASH low latency mode: invalid chunk length");
+        return false;
+    }
+
+    //NOTE: segments in progress can not switch between whole and chunked generation
+    if (!segmenters.empty() && (unsigned) frames != chunkFrames) {
+        utils::errorMsg("Error configuring DASH low latency mode: it must be configured before connecting the readers");
+        return false;
+    }
+
+    chunkFrames = frames;
+    return true;
+}
+
+bool Dasher::configHlsEvent(Jzon::Node* params)
+{
+    bool enabled = hlsMngr != NULL;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("enabled") && params->Get("enabled").IsBool()) {
+        enabled = params->Get("enabled").ToBool();
+    }
+
+    return configHls0(enabled);
+}
+
+bool Dasher::configHls0(bool enabled)
+{
+    if (!enabled) {
+        delete hlsMngr;
+        hlsMngr = NULL;
+        return true;
+    }
+
+    //NOTE: playlists are built from the timeline updates, so they must be enabled before the first segment
+    if (!segmenters.empty() && !hlsMngr) {
+        utils::errorMsg("Error configuring HLS output: it must be enabled before connecting the readers");
+        return false;
+    }
+
+    if (!hlsMngr) {
+        hlsMngr = new HlsManager();
+    }
+
+    hlsMngr->configure(baseName, mpdMngr ? mpdMngr->getMaxSeg() : MIN_SEGMENT, segDur.count());
+    return true;
+}
+
+bool Dasher::configEncryptionEvent(Jzon::Node* params)
+{
+    std::string scheme = "cenc";
+    std::vector<std::pair<std::string, std::string>> keys;
+    int rotationSegments = 0;
+    std::string pssh;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("scheme") && params->Get("scheme").IsString()) {
+        scheme = params->Get("scheme").ToString();
+    }
+
+    if (params->Has("keys") && params->Get("keys").IsArray()) {
+        Jzon::Array jsonKeys = params->Get("keys").AsArray();
+
+        for (Jzon::Array::iterator it = jsonKeys.begin(); it != jsonKeys.end(); ++it) {
+            if (!(*it).IsObject() || !(*it).Has("kid") || !(*it).Has("key")) {
+                utils::errorMsg("Error configuring DASH encryption: keys must have a kid and a key");
+                return false;
+            }
+
+            keys.push_back(std::make_pair((*it).Get("kid").ToString(), (*it).Get("key").ToString()));
+        }
+    }
+
+    if (params->Has("rotationSegments") && params->Get("rotationSegments").IsNumber()) {
+        rotationSegments = params->Get("rotationSegments").ToInt();
+    }
+
+    if (params->Has("pssh") && params->Get("pssh").IsString()) {
+        pssh = params->Get("pssh").ToString();
+    }
+
+    return configEncryption0(scheme, keys, rotationSegments, pssh);
+}
+
+bool Dasher::configEncryption0(std::string scheme, std::vector<std::pair<std::string, std::string>> keys,
+                               int rotationSegments, std::string pssh)
+{
+    DashEncryption enc;
+
+    //NOTE: init segments carry the scheme and the key ids, so they can not change once segmenters exist
+    if (!segmenters.empty()) {
+        utils::errorMsg("Error configuring DASH encryption: it must be configured before connecting the readers");
+        return false;
+    }
+
+    enc.rotation = 0;
+
+    if (scheme == "none") {
+        enc.scheme = CENC_SCHEME_NONE;
+        encryption = enc;
+        return true;
+    } else if (scheme == "cenc") {
+        enc.scheme = CENC_SCHEME_CENC;
+    } else if (scheme == "cbcs") {
+        enc.scheme = CENC_SCHEME_CBCS;
+    } else {
+        utils::errorMsg("Error configuring DASH encryption: unknown scheme " + scheme);
+        return false;
+    }
+
+    if (keys.empty() || keys.size() > CENC_MAX_KEYS || rotationSegments < 0) {
+        utils::errorMsg("Error configuring DASH encryption: invalid keys or rotation");
+        return false;
+    }
+
+    for (auto &k : keys) {
+        std::vector<unsigned char> kid, key;
+
+        if (!parseHex(k.first, kid) || !parseHex(k.second, key) || kid.size() != CENC_KEY_SIZE || key.size() != CENC_KEY_SIZE) {
+            utils::errorMsg("Error configuring DASH encryption: key ids and keys must be 16 bytes hex strings");
+            return false;
+        }
+
+        enc.kids.insert(enc.kids.end(), kid.begin(), kid.end());
+        enc.keys.insert(enc.keys.end(), key.begin(), key.end());
+    }
+
+    if (!parseHex(pssh, enc.pssh)) {
+        utils::errorMsg("Error configuring DASH encryption: pssh must be a hex string");
+        return false;
+    }
+
+    enc.rotation = rotationSegments;
+    encryption = enc;
+    return true;
+}
+
 bool Dasher::specificReaderConfig(int readerId, FrameQueue* queue)
 {
     VideoFrameQueue *vQueue;
@@ -492,8 +1122,9 @@ bool Dasher::specificReaderConfig(int readerId, FrameQueue* queue)
 
     if ((vQueue = dynamic_cast<VideoFrameQueue*>(queue)) != NULL) {
 
-        if (vQueue->getStreamInfo()->video.codec != H264 && vQueue->getStreamInfo()->video.codec != H265) {
-            utils::errorMsg("Error setting dasher reader: only H264 & H265 codecs are supported for video");
+        if (vQueue->getStreamInfo()->video.codec != H264 && vQueue->getStreamInfo()->video.codec != H265 &&
+            vQueue->getStreamInfo()->video.codec != AV1) {
+            utils::errorMsg("Error setting dasher reader: only H264, H265 & AV1 codecs are supported for video");
             return false;
         }
 
@@ -501,10 +1132,14 @@ bool Dasher::specificReaderConfig(int readerId, FrameQueue* queue)
             segmenters[readerId] = new DashVideoSegmenterAVC(segDur, timestampOffset);
         } else if (vQueue->getStreamInfo()->video.codec == H265) {
             segmenters[readerId] = new DashVideoSegmenterHEVC(segDur, timestampOffset);
+        } else if (vQueue->getStreamInfo()->video.codec == AV1) {
+            segmenters[readerId] = new DashVideoSegmenterAV1(segDur, timestampOffset);
         } else {
-            utils::errorMsg("Error setting dasher video segmenter: only H264 & H265 codecs are supported for video");
+            utils::errorMsg("Error setting dasher video segmenter: only H264, H265 & AV1 codecs are supported for video");
             return false;
         }
+        segmenters[readerId]->setChunkFrames(chunkFrames);
+        segmenters[readerId]->setEncryption(encryption);
         vSegments[readerId] = new DashSegment();
         initSegments[readerId] = new DashSegment();
         hasVideo = true;
@@ -518,6 +1153,8 @@ bool Dasher::specificReaderConfig(int readerId, FrameQueue* queue)
         }
 
         segmenters[readerId] = new DashAudioSegmenter(segDur, timestampOffset);
+        segmenters[readerId]->setChunkFrames(chunkFrames);
+        segmenters[readerId]->setEncryption(encryption);
         aSegments[readerId] = new DashSegment();
         initSegments[readerId] = new DashSegment();
     }
@@ -535,13 +1172,22 @@ bool Dasher::specificReaderDelete(int readerId)
     if (vSegments.count(readerId) > 0) {
         delete vSegments[readerId];
         vSegments.erase(readerId);
+        segmentStarts.erase(readerId);
         mpdMngr->removeRepresentation(V_ADAPT_SET_ID, std::to_string(readerId));
+
+        if (hlsMngr) {
+            hlsMngr->removeRepresentation(V_ADAPT_SET_ID, std::to_string(readerId));
+        }
     }
 
     if (aSegments.count(readerId) > 0) {
         delete aSegments[readerId];
         aSegments.erase(readerId);
         mpdMngr->removeRepresentation(A_ADAPT_SET_ID, std::to_string(readerId));
+
+        if (hlsMngr) {
+            hlsMngr->removeRepresentation(A_ADAPT_SET_ID, std::to_string(readerId));
+        }
     }
 
     if (initSegments.count(readerId) > 0) {
@@ -555,9 +1201,14 @@ bool Dasher::specificReaderDelete(int readerId)
     if (vSegments.empty()) {
         hasVideo = false;
         videoStarted = false;
+        announcedTimestamps.erase(V_ADAPT_SET_ID);
+    }
+
+    if (aSegments.empty()) {
+        announcedTimestamps.erase(A_ADAPT_SET_ID);
     }
 
-    mpdMngr->writeToDisk(mpdPath.c_str());
+    publishMpd();
     return true;
 }
 
@@ -586,6 +1237,86 @@ DashSegmenter* Dasher::getSegmenter(unsigned int id)
     return segmenters[id];
 }
 
+bool Dasher::configOrigin(unsigned port, bool diskOutput)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configOrigin");
+    params.Add("port", (int) port);
+    params.Add("diskOutput", diskOutput);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
+
+bool Dasher::configUpload(std::string url, std::string protocol, unsigned parallelUploads,
+                          std::string region, std::string accessKey, std::string secretKey)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configUpload");
+    params.Add("url", url);
+    params.Add("protocol", protocol);
+    params.Add("parallelUploads", (int) parallelUploads);
+    params.Add("region", region);
+    params.Add("accessKey", accessKey);
+    params.Add("secretKey", secretKey);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
+
+bool Dasher::configLowLatency(unsigned chunkFrames)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configLowLatency");
+    params.Add("chunkFrames", (int) chunkFrames);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
+
+bool Dasher::configHls(bool enabled)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configHls");
+    params.Add("enabled", enabled);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
+
+bool Dasher::configEncryption(std::string scheme, std::vector<std::pair<std::string, std::string>> keys,
+                              unsigned rotationSegments, std::string pssh)
+{
+    Jzon::Object root, params;
+    Jzon::Array jsonKeys;
+
+    for (auto &k : keys) {
+        Jzon::Object jsonKey;
+        jsonKey.Add("kid", k.first);
+        jsonKey.Add("key", k.second);
+        jsonKeys.Add(jsonKey);
+    }
+
+    root.Add("action", "configEncryption");
+    params.Add("scheme", scheme);
+    params.Add("keys", jsonKeys);
+    params.Add("rotationSegments", (int) rotationSegments);
+    params.Add("pssh", pssh);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
+
 bool Dasher::setDashSegmenterBitrate(int id, unsigned int bps)
 {
     DashSegmenter* segmenter;
@@ -607,21 +1338,35 @@ bool Dasher::setDashSegmenterBitrate(int id, unsigned int bps)
 
 DashSegmenter::DashSegmenter(std::chrono::seconds segmentDuration, unsigned int tBase, std::chrono::microseconds offset) :
 segDur(segmentDuration), dashContext(NULL), timeBase(tBase), frameDuration(0), currentTimestamp(0),
-sequenceNumber(0), bitrateInBitsPerSec(0), tsOffset(offset)
+sequenceNumber(0), bitrateInBitsPerSec(0), chunkFrames(0), chunkDuration(0), tsOffset(offset)
 {
     segDurInTimeBaseUnits = segDur.count()*timeBase;
+    encryption.scheme = CENC_SCHEME_NONE;
+    encryption.rotation = 0;
 }
 
 DashSegmenter::~DashSegmenter()
 {
     if(dashContext){
-        free(dashContext);
+        free_context(&dashContext);
     }
 }
 
+unsigned int DashSegmenter::getEstimatedSegmentSize()
+{
+    uint64_t size = (uint64_t) bitrateInBitsPerSec*segDur.count()/8*DASH_SEGMENT_SIZE_MARGIN;
+
+    if (size > MAX_DAT) {
+        return MAX_DAT;
+    }
+
+    return size;
+}
+
 bool DashSegmenter::generateSegment(DashSegment* segment, Frame* frame, bool force)
 {
     unsigned int segmentSize = 0;
+    unsigned int offset = 0;
     uint64_t segTimestamp;
     uint32_t segDuration;
     std::chrono::microseconds frameTs = std::chrono::microseconds(0);
@@ -634,7 +1379,17 @@ bool DashSegmenter::generateSegment(DashSegment* segment, Frame* frame, bool for
         frameTs = frame->getPresentationTime();
     }
 
-    segmentSize = customGenerateSegment(segment->getDataBuffer(), frameTs, segTimestamp, segDuration, force);
+    //NOTE: chunked segments are closed appending the last chunk
+    if (chunkFrames > 0 && !segment->isComplete()) {
+        offset = segment->getDataLength();
+    }
+
+    if (!segment->reserve(offset + get_fragment_max_size(dashContext))) {
+        utils::errorMsg("[DashSegmenter::generateSegment] Error allocating segment data");
+        return false;
+    }
+
+    segmentSize = customGenerateSegment(segment->getDataBuffer() + offset, frameTs, segTimestamp, segDuration, force);
 
     if (segmentSize <= I2ERROR_MAX) {
         return false;
@@ -642,7 +1397,7 @@ bool DashSegmenter::generateSegment(DashSegment* segment, Frame* frame, bool for
     
     segment->setTimestamp(segTimestamp);
     segment->setDuration(segDuration);
-    segment->setDataLength(segmentSize);
+    segment->setDataLength(offset + segmentSize);
     segment->setComplete(true);
     segment->setSeqNumber(++sequenceNumber);
     
@@ -654,20 +1409,65 @@ bool DashSegmenter::generateSegment(DashSegment* segment, Frame* frame, bool for
     return true;
 }
 
+bool DashSegmenter::generateChunk(DashSegment* segment)
+{
+    unsigned int chunkSize = 0;
+    uint64_t segTimestamp;
+    uint32_t chunkDur;
+
+    if (chunkFrames == 0 || !dashContext || segment->isComplete()) {
+        return false;
+    }
+
+    if (!segment->reserve(segment->getDataLength() + get_fragment_max_size(dashContext))) {
+        utils::errorMsg("[DashSegmenter::generateChunk] Error allocating segment data");
+        return false;
+    }
+
+    chunkSize = customGenerateChunk(segment->getDataBuffer() + segment->getDataLength(), segTimestamp, chunkDur);
+
+    if (chunkSize <= I2ERROR_MAX) {
+        return false;
+    }
+
+    segment->setTimestamp(segTimestamp);
+    segment->setDataLength(segment->getDataLength() + chunkSize);
+    chunkDuration = chunkDur;
+
+    return true;
+}
+
 uint64_t DashSegmenter::microsToTimeBase(std::chrono::microseconds microValue)
 {
     return (microValue-tsOffset).count()*timeBase/std::micro::den;
 }
 
+bool DashSegmenter::setupEncryption()
+{
+    //NOTE: the IVs and the init segment depend on the context keys, they are set once
+    if (encryption.scheme == CENC_SCHEME_NONE || dashContext->ctxcrypto) {
+        return true;
+    }
+
+    if (set_encryption(encryption.scheme, &encryption.kids[0], &encryption.keys[0], encryption.kids.size() / CENC_KEY_SIZE,
+                       encryption.rotation, encryption.pssh.empty() ? NULL : &encryption.pssh[0], encryption.pssh.size(),
+                       &dashContext) != I2OK) {
+        utils::errorMsg("[DashSegmenter] Error setting the segments encryption");
+        return false;
+    }
+
+    return true;
+}
+
 
 /////////////////
 // DashSegment //
 /////////////////
 
-DashSegment::DashSegment(unsigned int maxSize) : 
-dataLength(0), seqNumber(0), timestamp(0), duration(0), complete(false)
+DashSegment::DashSegment(unsigned int size) : 
+capacity(size), dataLength(0), publishedLength(0), seqNumber(0), timestamp(0), duration(0), complete(false)
 {
-    data = new unsigned char[maxSize];
+    data = new unsigned char[capacity];
 }
 
 DashSegment::~DashSegment()
@@ -680,6 +1480,34 @@ void DashSegment::setSeqNumber(unsigned int seqNum)
     seqNumber = seqNum;
 }
 
+bool DashSegment::reserve(unsigned int size)
+{
+    unsigned char* newData;
+    unsigned int newCapacity;
+
+    if (size <= capacity) {
+        return true;
+    }
+
+    if (size > MAX_DAT) {
+        return false;
+    }
+
+    newCapacity = std::max(size, std::min(capacity*2, (unsigned int) MAX_DAT));
+    newData = new (std::nothrow) unsigned char[newCapacity];
+
+    if (!newData) {
+        return false;
+    }
+
+    memcpy(newData, data, dataLength);
+    delete[] data;
+
+    data = newData;
+    capacity = newCapacity;
+    return true;
+}
+
 void DashSegment::setDataLength(unsigned int length)
 {
     dataLength = length;
@@ -714,5 +1542,6 @@ void DashSegment::clear()
     timestamp = 0;
     duration = 0;
     dataLength = 0;
+    publishedLength = 0;
     complete = false;
 }
@@ -29,6 +29,8 @@
 #include "../../VideoFrame.hh"
 #include "../../AudioFrame.hh"
 #include "MpdManager.hh"
+#include "HlsManager.hh"
+#include "DashUploader.hh"
 
 extern "C" {
     #include "i2libdash.h"
@@ -36,20 +38,60 @@ extern "C" {
 
 #include <map>
 #include <string>
+#include <vector>
 
 #define DASH_VIDEO_TIME_BASE    12800
 #define V_ADAPT_SET_ID          "0"
 #define A_ADAPT_SET_ID          "1"
 #define VIDEO_CODEC_AVC         "avc1.42c01e"
 #define VIDEO_CODEC_HEVC        "hev1"
+#define VIDEO_CODEC_AV1         "av01"
 #define AUDIO_CODEC             "mp4a.40.2"
 #define V_EXT                   ".m4v"
 #define A_EXT                   ".m4a"
+#define DASH_SEGMENT_INITIAL_SIZE   64*1024     //!< Initial segment buffer, grown on demand
+#define DASH_INIT_SEGMENT_OVERHEAD  4096        //!< Init segment boxes besides the codec extradata
+#define DASH_SEGMENT_SIZE_MARGIN    1.25        //!< Estimated segment size over bitrate times duration
 
 class DashSegmenter;
 class DashSegment;
+class DashSegmentWriter;
+class DashHttpOrigin;
+struct DashWriterJob;
+
+/*! Common Encryption of the segments, shared by all the segmenters */
+struct DashEncryption {
+    unsigned scheme;                        //!< CENC_SCHEME_NONE, CENC_SCHEME_CENC or CENC_SCHEME_CBCS
+    std::vector<unsigned char> kids;        //!< CENC_KEY_SIZE bytes for each key
+    std::vector<unsigned char> keys;
+    unsigned rotation;                      //!< Segments encrypted with each key, 0 only uses the first one
+    std::vector<unsigned char> pssh;        //!< pssh boxes of the DRM systems, added to the init segments
+};
+
+/*! Work of one reader in a doProcessFrame call. Steps of different readers are segmented in parallel,
+    then their results are published one after the other */
+struct DashStep {
+    int id;
+    DashSegmenter* segmenter;
+    DashSegment* segment;
+    DashSegment* initSegment;
+    Frame* orgFrame;
+    bool video;
+    Frame* frame;                   //!< NULL if the original frame did not complete a frame to segment
+    bool initGenerated;
+    bool segmentGenerated;
+    bool appended;
+    bool chunkGenerated;
+};
 
-/*! Class responsible for managing DASH segmenters. */
+/*! Class responsible for managing DASH segmenters. Segments and the MPD are written by a DashSegmentWriter
+    from its own thread, so slow storage does not stall the filter. They can also be served from memory
+    by an embedded DashHttpOrigin or uploaded to a remote origin, with or without writing them to disk. In low latency mode segments are
+    made of CMAF chunks, which are served and appended to disk as they are generated. Readers are segmented
+    in parallel on the pool, only the MPD updates and the publication of the segments are serialized. The same segments can be
+    described by HLS playlists too, which are published together with the MPD. Video readers publish the
+    presentation time of the next segment boundary to their writer (see FrameQueue::setReaderKeyFrameTime),
+    so an encoder connected to the Dasher forces an IDR there and can use long GOPs elsewhere. */
 
 class Dasher : public TailFilter {
 
@@ -94,23 +136,94 @@ public:
 
     bool setDashSegmenterBitrate(int id, unsigned int kbps);
 
+    /**
+    * Configures the embedded HTTP origin, which serves the MPD and the segments in its timeline from memory
+    * at http://host:port/baseName.mpd. It must be configured before connecting the readers, so it gets the init segments
+    * @param port TCP port of the origin, 0 disables it
+    * @param diskOutput if false segments and MPD are not written to disk, the origin or the upload must be enabled
+    */
+    bool configOrigin(unsigned port, bool diskOutput);
+
+    /**
+    * Configures the upload of the MPD and the segments to an HTTP origin (PUT and DELETE requests) or an S3 bucket,
+    * straight from memory and over persistent connections. In low latency mode segments are uploaded while they are
+    * generated. It must be configured before connecting the readers, so it gets the init segments
+    * @param url base URL, files are uploaded to url/name. S3 buckets are addressed in path style, https://host/bucket/prefix
+    * @param protocol "http" or "s3"
+    * @param parallelUploads simultaneous requests
+    * @param region S3 bucket region
+    * @param accessKey S3 access key, S3 requests are not signed without it
+    * @param secretKey S3 secret key
+    */
+    bool configUpload(std::string url, std::string protocol = "http", unsigned parallelUploads = UPLOAD_PARALLEL,
+                      std::string region = "", std::string accessKey = "", std::string secretKey = "");
+
+    /**
+    * Configures the low latency mode: segments are generated as a sequence of CMAF chunks (moof and mdat pairs), which are
+    * published as soon as they are ready. Segments are announced in the MPD when their first chunk is ready, together with
+    * the availabilityTimeOffset that lets players request them in advance. It must be configured before connecting the readers
+    * @param chunkFrames frames of each chunk, 0 disables the low latency mode
+    */
+    bool configLowLatency(unsigned chunkFrames);
+
+    /**
+    * Enables the HLS output: a master playlist baseName.m3u8 and a media playlist for each representation, referencing
+    * the same fMP4 segments as the MPD. Playlists are written and served as the MPD is.
+    * @param enabled if false the playlists are no longer updated
+    */
+    bool configHls(bool enabled);
+
+    /**
+    * Configures the Common Encryption of the segments, which are encrypted while they are generated. Video samples use
+    * subsample encryption, so NAL headers stay clear. The init segments signal the scheme and list the key ids in a common
+    * pssh box, the MPD adds the ContentProtection descriptors. It must be configured before connecting the readers
+    * @param scheme "cenc" (AES-CTR), "cbcs" (AES-CBC with a 1:9 pattern for video) or "none"
+    * @param keys key id and key pairs, as 32 hex digits each (dashes are ignored)
+    * @param rotationSegments segments encrypted with each key before moving to the next one, 0 disables the rotation
+    * @param pssh hex pssh boxes of the DRM systems, added to the init segments
+    */
+    bool configEncryption(std::string scheme, std::vector<std::pair<std::string, std::string>> keys,
+                          unsigned rotationSegments = 0, std::string pssh = "");
+
 private:
-    bool doProcessFrame(std::map<int, Frame*> &orgFrames, std::vector<int> newFrames, int& ret);
+    bool doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& ret);
     void doGetState(Jzon::Object &filterNode);
+    size_t getInternalBytes();
     void initializeEventMap();
-    bool generateInitSegment(unsigned int id, DashSegmenter* segmenter);
-    bool generateSegment(unsigned int id, Frame* frame, DashSegmenter* segmenter);
-    bool appendFrameToSegment(unsigned int id, Frame* frame, DashSegmenter* segmenter);
+    void processStep(DashStep &step);
+    void publishStep(DashStep &step);
+    void requestKeyFrame(DashStep &step);
+    bool publishInitSegment(unsigned int id, std::string ext);
+    void updateRepresentation(unsigned int id, DashSegmenter* segmenter);
+    bool publishChunks(unsigned int id, DashSegmenter* segmenter);
     DashSegmenter* getSegmenter(unsigned int id);
     bool forceAudioSegmentsGeneration();
     bool writeVideoSegments();
     bool writeAudioSegments();
 
-    bool writeSegmentsToDisk(std::map<int,DashSegment*> segments, uint64_t timestamp, std::string segExt);
-    bool cleanSegments(std::map<int,DashSegment*> segments, uint64_t timestamp, std::string segExt);
+    void queueSegments(std::map<int,DashSegment*> &segments, uint64_t timestamp, std::string segExt, DashWriterJob *job);
+    void queueRemovals(std::map<int,DashSegment*> &segments, uint64_t timestamp, std::string segExt);
+    bool commitSegments(std::map<int,DashSegment*> &segments, uint64_t timestamp, uint64_t rmTimestamp, std::string segExt);
+    bool announceSegments(std::map<int,DashSegment*> &segments, std::string adSetId, uint64_t timestamp, DashSegmenter* segmenter, std::string segExt);
+    bool publishTimeline(std::map<int,DashSegment*> &segments, uint64_t rmTimestamp, std::string segExt, DashWriterJob *job);
+    void publishChunk(int id, DashSegment* segment, std::string segExt, DashWriterJob *job);
+    void updateHlsTimeline(std::string adSetId, uint64_t timestamp, unsigned int duration, uint64_t rmTimestamp);
+    bool publishMpd();
     bool configureEvent(Jzon::Node* params);
 
     bool setBitrateEvent(Jzon::Node* params);
+    bool configOriginEvent(Jzon::Node* params);
+    bool configOrigin0(int port, bool disk);
+    bool configUploadEvent(Jzon::Node* params);
+    bool configUpload0(std::string url, std::string protocol, int parallelUploads,
+                       std::string region, std::string accessKey, std::string secretKey);
+    bool configLowLatencyEvent(Jzon::Node* params);
+    bool configLowLatency0(int frames);
+    bool configHlsEvent(Jzon::Node* params);
+    bool configHls0(bool enabled);
+    bool configEncryptionEvent(Jzon::Node* params);
+    bool configEncryption0(std::string scheme, std::vector<std::pair<std::string, std::string>> keys,
+                           int rotationSegments, std::string pssh);
     
     bool specificReaderConfig(int readerID, FrameQueue* queue);
     bool specificReaderDelete(int readerID);
@@ -119,8 +232,19 @@ private:
     std::map<int, DashSegment*> vSegments;
     std::map<int, DashSegment*> aSegments;
     std::map<int, DashSegment*> initSegments;
+    std::map<int, std::chrono::microseconds> segmentStarts;    //!< Presentation time of the current video segments
 
     MpdManager* mpdMngr;
+    HlsManager* hlsMngr;                        //!< NULL if the HLS output is disabled
+    DashSegmentWriter* writer;
+    DashHttpOrigin* origin;
+    bool diskOutput;
+    unsigned chunkFrames;
+    DashEncryption encryption;
+    std::map<std::string, uint64_t> announcedTimestamps;
+    bool mpdPending;                            //!< The MPD changed and is published at the end of doProcessFrame
+    std::vector<std::string> pendingRemovals;   //!< Segments out of the timeline, removed once the MPD is published
+    size_t mpdPublications;
     std::chrono::seconds segDur;
 
     std::string basePath;
@@ -133,6 +257,7 @@ private:
 
     bool hasVideo;
     bool videoStarted;
+    bool captions;                              //!< The video carries closed captions, signalled in the MPD
     
     std::chrono::microseconds timestampOffset;
 };
@@ -168,6 +293,33 @@ public:
 
     virtual bool appendFrameToDashSegment(Frame* frame) = 0;
     bool generateSegment(DashSegment* segment, Frame* frame, bool force = false);
+
+    /**
+    * Appends a CMAF chunk with the frames added since the previous one to the segment data, if there are enough.
+    * The segment is completed by generateSegment, which appends the last chunk
+    * @param segment segment in progress
+    * @return true if a chunk has been appended
+    */
+    bool generateChunk(DashSegment* segment);
+
+    /**
+    * Sets the frames of each CMAF chunk
+    * @param frames chunk length in frames, 0 generates whole segments
+    */
+    void setChunkFrames(unsigned int frames) {chunkFrames = frames;};
+
+    /**
+    * Sets the Common Encryption of the segments, it is applied when the segmenter is set up
+    * @param enc encryption settings, CENC_SCHEME_NONE disables it
+    */
+    void setEncryption(const DashEncryption &enc) {encryption = enc;};
+
+    /**
+    * Returns the duration of the last chunk
+    * @return duration in time base
+    */
+    unsigned int getChunkDuration() {return chunkDuration;};
+
     /**
     * Returns average frame duration
     * @return duration in time base
@@ -203,14 +355,22 @@ public:
     void setBitrate(size_t bps) {bitrateInBitsPerSec = bps;};
     unsigned int getBitrate() {return bitrateInBitsPerSec;};
 
+    /**
+    * Estimates the segment data length from the bitrate and the segment duration
+    * @return length in bytes, 0 if the bitrate is unknown
+    */
+    unsigned int getEstimatedSegmentSize();
+
 protected:
     virtual unsigned customGenerateSegment(unsigned char *segBuffer, std::chrono::microseconds nextFrameTs, 
                                             uint64_t &segTimestamp, uint32_t &segDuration, bool force) = 0;
+    virtual unsigned customGenerateChunk(unsigned char *chunkBuffer, uint64_t &segTimestamp, uint32_t &chunkDur) = 0;
     
     std::string getInitSegmentName();
     std::string getSegmentName();
     uint64_t customTimestamp(std::chrono::system_clock::time_point timestamp);
     uint64_t microsToTimeBase(std::chrono::microseconds microValue);
+    bool setupEncryption();
 
     std::chrono::seconds segDur;
 
@@ -222,21 +382,25 @@ protected:
     unsigned int sequenceNumber;
     std::vector<unsigned char> extradata;
     unsigned int bitrateInBitsPerSec;
+    unsigned int chunkFrames;
+    unsigned int chunkDuration;
+    DashEncryption encryption;
     
     std::chrono::microseconds tsOffset;
 };
 
 /*! It represents a dash segment. It contains a buffer with the segment data (it allocates data) and its length. Moreover, it contains the
-    segment sequence number and the output file name (in order to write the segment to disk) */
+    segment sequence number and the output file name (in order to write the segment to disk). The buffer grows on demand and
+    is not shrunk when cleared, so recycled segments keep the capacity of the largest segment they held */
 
 class DashSegment {
 
 public:
     /**
     * Class constructor
-    * @param maxSize Segment data max length
+    * @param size Initial segment data buffer length
     */
-    DashSegment(unsigned int maxSize = MAX_DAT);
+    DashSegment(unsigned int size = DASH_SEGMENT_INITIAL_SIZE);
 
     /**
     * Class destructor
@@ -253,6 +417,18 @@ public:
     */
     unsigned int getDataLength() {return dataLength;};
 
+    /**
+    * @return Segment data buffer length in bytes
+    */
+    unsigned int getCapacity() {return capacity;};
+
+    /**
+    * Grows the data buffer if needed, keeping its content. Buffer pointers got before are invalidated
+    * @param size Required buffer length in bytes
+    * @return true if succeeded and false if not
+    */
+    bool reserve(unsigned int size);
+
     /**
     * @params Segment data length in bytes
     */
@@ -316,9 +492,21 @@ public:
     bool isComplete() {return complete;};
     void setComplete(bool c) {complete = c;};
 
+    /**
+    * @return Segment data already published as chunks, in bytes
+    */
+    unsigned int getPublishedLength() {return publishedLength;};
+
+    /**
+    * @params length Segment data already published as chunks, in bytes
+    */
+    void setPublishedLength(unsigned int length) {publishedLength = length;};
+
 private:
     unsigned char* data;
+    unsigned int capacity;
     unsigned int dataLength;
+    unsigned int publishedLength;
     unsigned int seqNumber;
     uint64_t timestamp;
     unsigned int duration;
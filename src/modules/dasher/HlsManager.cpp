@@ -0,0 +1,274 @@
+/*
+ *  HlsManager - HLS playlists manager class
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *
+ */
+
+#include <cstdio>
+#include <algorithm>
+
+#include "HlsManager.hh"
+#include "MpdManager.hh"
+#include "../../Utils.hh"
+
+HlsManager::HlsManager() : maxSeg(MIN_SEGMENT), segDur(1)
+{
+}
+
+HlsManager::~HlsManager()
+{
+}
+
+void HlsManager::configure(std::string baseName_, unsigned int maxSegment, unsigned int segDurInSec)
+{
+    baseName = baseName_;
+    maxSeg = std::max(maxSegment, (unsigned int) HLS_MIN_SEGMENTS);
+    segDur = segDurInSec;
+}
+
+void HlsManager::updateVideoAdaptationSet(std::string id, int timescale, std::string segmentTempl, std::string initTempl)
+{
+    updateAdaptationSet(id, true, timescale, segmentTempl, initTempl);
+}
+
+void HlsManager::updateAudioAdaptationSet(std::string id, int timescale, std::string segmentTempl, std::string initTempl)
+{
+    updateAdaptationSet(id, false, timescale, segmentTempl, initTempl);
+}
+
+HlsManager::HlsAdaptationSet* HlsManager::updateAdaptationSet(std::string id, bool video, int timescale,
+                                                              std::string segmentTempl, std::string initTempl)
+{
+    HlsAdaptationSet* adSet;
+
+    adSet = getAdaptationSet(id);
+
+    if (!adSet) {
+        adSet = &adaptationSets[id];
+        adSet->mediaSequence = 0;
+    }
+
+    adSet->video = video;
+    adSet->timescale = timescale;
+    adSet->segTemplate = segmentTempl;
+    adSet->initTemplate = initTempl;
+    return adSet;
+}
+
+void HlsManager::updateVideoRepresentation(std::string adSetId, std::string reprId, std::string codec, int width, int height, int bandwidth, int fps)
+{
+    HlsAdaptationSet* adSet;
+
+    adSet = getAdaptationSet(adSetId);
+
+    if (!adSet) {
+        utils::errorMsg("[HlsManager] Error updating video representation. Adaptation set does not exist.");
+        return;
+    }
+
+    adSet->representations[reprId] = HlsRepresentation{codec, width, height, bandwidth, fps, 0, 0};
+}
+
+void HlsManager::updateAudioRepresentation(std::string adSetId, std::string reprId, std::string codec, int sampleRate, int bandwidth, int channels)
+{
+    HlsAdaptationSet* adSet;
+
+    adSet = getAdaptationSet(adSetId);
+
+    if (!adSet) {
+        utils::errorMsg("[HlsManager] Error updating audio representation. Adaptation set does not exist.");
+        return;
+    }
+
+    adSet->representations[reprId] = HlsRepresentation{codec, 0, 0, bandwidth, 0, sampleRate, channels};
+}
+
+bool HlsManager::removeRepresentation(std::string adSetId, std::string reprId)
+{
+    HlsAdaptationSet* adSet;
+
+    adSet = getAdaptationSet(adSetId);
+
+    if (!adSet) {
+        return false;
+    }
+
+    return adSet->representations.erase(reprId) > 0;
+}
+
+bool HlsManager::updateAdaptationSetTimestamp(std::string id, uint64_t ts, unsigned int duration)
+{
+    HlsAdaptationSet* adSet;
+
+    adSet = getAdaptationSet(id);
+
+    if (!adSet) {
+        return false;
+    }
+
+    if (!adSet->timestamps.empty() && adSet->timestamps.back().first == ts) {
+        adSet->timestamps.back().second = duration;
+        return true;
+    }
+
+    while (adSet->timestamps.size() >= maxSeg) {
+        adSet->timestamps.pop_front();
+        adSet->mediaSequence++;
+    }
+
+    adSet->timestamps.push_back(std::pair<uint64_t, unsigned int>(ts, duration));
+    return true;
+}
+
+bool HlsManager::removeTimestamps(std::string id, uint64_t ts)
+{
+    HlsAdaptationSet* adSet;
+
+    adSet = getAdaptationSet(id);
+
+    if (!adSet) {
+        return false;
+    }
+
+    while (!adSet->timestamps.empty() && adSet->timestamps.front().first <= ts) {
+        adSet->timestamps.pop_front();
+        adSet->mediaSequence++;
+    }
+
+    return true;
+}
+
+size_t HlsManager::getSegments(std::string id)
+{
+    HlsAdaptationSet* adSet;
+
+    adSet = getAdaptationSet(id);
+    return adSet ? adSet->timestamps.size() : 0;
+}
+
+void HlsManager::getPlaylists(std::vector<std::pair<std::string, std::string>> &playlists)
+{
+    playlists.push_back(std::make_pair(getMasterName(), renderMaster()));
+
+    for (auto &ad : adaptationSets) {
+        for (auto &repr : ad.second.representations) {
+            playlists.push_back(std::make_pair(getMediaName(repr.first), renderMedia(&ad.second, repr.first)));
+        }
+    }
+}
+
+//NOTE: video representations are the variants, each one referencing the audio group. Without video, audio
+//      representations are the variants themselves
+std::string HlsManager::renderMaster()
+{
+    std::string m3u8;
+    std::string audioCodec;
+    int audioBandwidth = 0;
+    bool hasVideo = false;
+    bool defaultAudio = true;
+    char frameRate[32];
+
+    m3u8 += "#EXTM3U\n";
+    m3u8 += "#EXT-X-VERSION:" + std::to_string(HLS_VERSION) + "\n";
+    m3u8 += "#EXT-X-INDEPENDENT-SEGMENTS\n";
+
+    for (auto &ad : adaptationSets) {
+        if (ad.second.video) {
+            hasVideo = hasVideo || !ad.second.representations.empty();
+            continue;
+        }
+
+        for (auto &repr : ad.second.representations) {
+            audioBandwidth = std::max(audioBandwidth, repr.second.bandwidth);
+            audioCodec = repr.second.codec;
+        }
+    }
+
+    for (auto &ad : adaptationSets) {
+        for (auto &repr : ad.second.representations) {
+            if (ad.second.video) {
+                snprintf(frameRate, sizeof(frameRate), "%.3f", (double) repr.second.fps);
+                m3u8 += "#EXT-X-STREAM-INF:BANDWIDTH=" + std::to_string(repr.second.bandwidth + audioBandwidth);
+                m3u8 += ",CODECS=\"" + repr.second.codec + (audioCodec.empty() ? "" : "," + audioCodec) + "\"";
+                m3u8 += ",RESOLUTION=" + std::to_string(repr.second.width) + "x" + std::to_string(repr.second.height);
+                m3u8 += std::string(",FRAME-RATE=") + frameRate;
+                m3u8 += audioCodec.empty() ? "\n" : ",AUDIO=\"" HLS_AUDIO_GROUP "\"\n";
+                m3u8 += getMediaName(repr.first) + "\n";
+            } else if (hasVideo) {
+                m3u8 += "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"" HLS_AUDIO_GROUP "\",NAME=\"" + repr.first + "\"";
+                m3u8 += ",LANGUAGE=\"" AUDIO_LANG "\"";
+                m3u8 += std::string(",DEFAULT=") + (defaultAudio ? "YES" : "NO") + ",AUTOSELECT=YES";
+                m3u8 += ",CHANNELS=\"" + std::to_string(repr.second.channels) + "\"";
+                m3u8 += ",URI=\"" + getMediaName(repr.first) + "\"\n";
+                defaultAudio = false;
+            } else {
+                m3u8 += "#EXT-X-STREAM-INF:BANDWIDTH=" + std::to_string(repr.second.bandwidth);
+                m3u8 += ",CODECS=\"" + repr.second.codec + "\"\n";
+                m3u8 += getMediaName(repr.first) + "\n";
+            }
+        }
+    }
+
+    return m3u8;
+}
+
+std::string HlsManager::renderMedia(HlsAdaptationSet* adSet, std::string reprId)
+{
+    std::string m3u8;
+    std::string segments;
+    unsigned int targetDuration = segDur;
+    char duration[32];
+
+    for (auto ts : adSet->timestamps) {
+        snprintf(duration, sizeof(duration), "%.3f", (double) ts.second/adSet->timescale);
+        segments += std::string("#EXTINF:") + duration + ",\n";
+        segments += resolveTemplate(adSet->segTemplate, reprId, ts.first) + "\n";
+
+        //NOTE: EXTINF durations rounded to the nearest integer must not exceed the target duration
+        targetDuration = std::max(targetDuration, (unsigned int) ((ts.second + adSet->timescale/2)/adSet->timescale));
+    }
+
+    m3u8 += "#EXTM3U\n";
+    m3u8 += "#EXT-X-VERSION:" + std::to_string(HLS_VERSION) + "\n";
+    m3u8 += "#EXT-X-TARGETDURATION:" + std::to_string(targetDuration) + "\n";
+    m3u8 += "#EXT-X-MEDIA-SEQUENCE:" + std::to_string(adSet->mediaSequence) + "\n";
+    m3u8 += "#EXT-X-MAP:URI=\"" + resolveTemplate(adSet->initTemplate, reprId, 0) + "\"\n";
+    m3u8 += segments;
+
+    return m3u8;
+}
+
+std::string HlsManager::resolveTemplate(std::string templ, std::string reprId, uint64_t ts)
+{
+    size_t pos;
+
+    while ((pos = templ.find("$RepresentationID$")) != std::string::npos) {
+        templ.replace(pos, 18, reprId);
+    }
+
+    while ((pos = templ.find("$Time$")) != std::string::npos) {
+        templ.replace(pos, 6, std::to_string(ts));
+    }
+
+    return templ;
+}
+
+HlsManager::HlsAdaptationSet* HlsManager::getAdaptationSet(std::string id)
+{
+    return adaptationSets.count(id) <= 0 ? NULL : &adaptationSets[id];
+}
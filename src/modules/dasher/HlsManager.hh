@@ -0,0 +1,167 @@
+/*
+ *  HlsManager - HLS playlists manager class
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *
+ */
+
+#ifndef _HLS_MANAGER_HH_
+#define _HLS_MANAGER_HH_
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#define HLS_VERSION             7               //!< EXT-X-MAP in media playlists without I-frames requires version 6 or higher
+#define HLS_EXT                 ".m3u8"
+#define HLS_AUDIO_GROUP         "audio"
+#define HLS_MIN_SEGMENTS        3               //!< Live playlists should not be shorter than three target durations
+
+/*! It is used to manage the HLS playlists of the same fMP4 segments described by the MPD. It is fed with the
+    same adaptation set, representation and timestamp updates MpdManager gets, so one set of segments serves both
+    DASH and HLS. There is a media playlist for each representation and a master playlist referencing them,
+    video representations are the variants and audio ones are renditions of a single EXT-X-MEDIA group. */
+
+class HlsManager
+{
+public:
+    /**
+    * Class constructor
+    */
+    HlsManager();
+
+    /**
+    * Class destructor
+    */
+    virtual ~HlsManager();
+
+    /**
+    * Configures the playlists names and window
+    * @param baseName master playlist is baseName.m3u8 and media playlists baseName_<reprId>.m3u8
+    * @param maxSegment segments kept in the media playlists
+    * @param segDurInSec nominal segment duration, the minimum EXT-X-TARGETDURATION
+    */
+    void configure(std::string baseName, unsigned int maxSegment, unsigned int segDurInSec);
+
+    /**
+    * Updates an existing video adaptation set. If it does not exists, it creates a new one
+    * @see MpdManager::updateVideoAdaptationSet
+    */
+    void updateVideoAdaptationSet(std::string id, int timescale, std::string segmentTempl, std::string initTempl);
+
+    /**
+    * @see updateVideoAdaptationSet
+    */
+    void updateAudioAdaptationSet(std::string id, int timescale, std::string segmentTempl, std::string initTempl);
+
+    /**
+    * Updates an existing video representation. If it does not exists, it creates a new one
+    * @see MpdManager::updateVideoRepresentation
+    */
+    void updateVideoRepresentation(std::string adSetId, std::string reprId, std::string codec, int width, int height, int bandwidth, int fps);
+
+    /**
+    * Updates an existing audio representation. If it does not exists, it creates a new one
+    * @see MpdManager::updateAudioRepresentation
+    */
+    void updateAudioRepresentation(std::string adSetId, std::string reprId, std::string codec, int sampleRate, int bandwidth, int channels);
+
+    /**
+    * Removes an existing audio/video representation, its media playlist is no longer generated
+    * @param adSetId Adaptation set Id
+    * @param reprId Representation Id
+    * @return true on success and false on fail
+    */
+    bool removeRepresentation(std::string adSetId, std::string reprId);
+
+    /**
+    * Adds a complete segment to the media playlists of an adaptation set. If the timestamp is the last one,
+    * only its duration is updated. The oldest segment is dropped once the window is full
+    * @param id Adaptation set Id. Must exist.
+    * @param ts Timestamp of the segment in timescale base
+    * @param duration Duration of the segment in timescale base
+    * @return true if succeeded and false if not
+    */
+    bool updateAdaptationSetTimestamp(std::string id, uint64_t ts, unsigned int duration);
+
+    /**
+    * Drops the segments removed from the MPD timeline, so the playlists never reference a removed segment
+    * @param id Adaptation set Id
+    * @param ts Timestamp of the last removed segment, older segments are dropped too
+    * @return true if succeeded and false if not
+    */
+    bool removeTimestamps(std::string id, uint64_t ts);
+
+    /**
+    * Renders the master playlist and the media playlists
+    * @param playlists where each playlist name and content is added
+    */
+    void getPlaylists(std::vector<std::pair<std::string, std::string>> &playlists);
+
+    /**
+    * @return master playlist name
+    */
+    std::string getMasterName() {return baseName + HLS_EXT;};
+
+    /**
+    * @param reprId Representation Id
+    * @return media playlist name of the representation
+    */
+    std::string getMediaName(std::string reprId) {return baseName + "_" + reprId + HLS_EXT;};
+
+    /**
+    * @param id Adaptation set Id
+    * @return segments in the media playlists of the adaptation set
+    */
+    size_t getSegments(std::string id);
+
+private:
+    struct HlsRepresentation {
+        std::string codec;
+        int width;
+        int height;
+        int bandwidth;
+        int fps;
+        int sampleRate;
+        int channels;
+    };
+
+    struct HlsAdaptationSet {
+        bool video;
+        int timescale;
+        std::string segTemplate;
+        std::string initTemplate;
+        std::map<std::string, HlsRepresentation> representations;
+        std::deque<std::pair<uint64_t, unsigned int>> timestamps;
+        uint64_t mediaSequence;             //!< Segments dropped since the first one
+    };
+
+    HlsAdaptationSet* updateAdaptationSet(std::string id, bool video, int timescale, std::string segmentTempl, std::string initTempl);
+    HlsAdaptationSet* getAdaptationSet(std::string id);
+    std::string renderMaster();
+    std::string renderMedia(HlsAdaptationSet* adSet, std::string reprId);
+    static std::string resolveTemplate(std::string templ, std::string reprId, uint64_t ts);
+
+    std::map<std::string, HlsAdaptationSet> adaptationSets;
+    std::string baseName;
+    unsigned int maxSeg;
+    unsigned int segDur;
+};
+
+#endif
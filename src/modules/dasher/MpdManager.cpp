@@ -23,12 +23,49 @@
 #include <iostream>
 #include <ctime>
 #include <chrono> 
+#include <cstdio>
 
 #include "MpdManager.hh"
 
+//NOTE: values are escaped as XML attributes require
+static void appendAttribute(std::string& xml, const char* name, std::string value)
+{
+    xml += ' ';
+    xml += name;
+    xml += "=\"";
+
+    for (char c : value) {
+        switch (c) {
+            case '&': xml += "&amp;"; break;
+            case '<': xml += "&lt;"; break;
+            case '>': xml += "&gt;"; break;
+            case '"': xml += "&quot;"; break;
+            default: xml += c; break;
+        }
+    }
+
+    xml += '"';
+}
+
+static void appendAttribute(std::string& xml, const char* name, const char* value)
+{
+    appendAttribute(xml, name, std::string(value));
+}
+
+static void appendAttribute(std::string& xml, const char* name, int value)
+{
+    appendAttribute(xml, name, std::to_string(value));
+}
+
+static void appendAttribute(std::string& xml, const char* name, bool value)
+{
+    appendAttribute(xml, name, std::string(value ? "true" : "false"));
+}
+
 MpdManager::MpdManager()
 {
     started = false;
+    headModified = true;
     maxSeg = MIN_SEGMENT;
     
     //NOTE: Assuming MIN_SEGMENT and the minimum segment duration 1 second
@@ -60,57 +97,77 @@ void MpdManager::configure(unsigned int minBuffTime, unsigned int maxSegment, un
     
     timeShiftBufferDepth = "PT" + std::to_string(maxSeg*segDurInSec) + ".0S";
     minimumUpdatePeriod = "PT" + std::to_string(segDurInSec) + ".0S";
+    headModified = true;
 }
 
 void MpdManager::writeToDisk(const char* fileName)
 {
-    tinyxml2::XMLDocument doc;
-    tinyxml2::XMLElement* root;
-    tinyxml2::XMLElement* period;
-    tinyxml2::XMLElement* el;
-    tinyxml2::XMLElement* title;
-    tinyxml2::XMLText* text;
-    
+    const std::string& doc = toString();
+    std::ofstream file(fileName, std::ofstream::binary);
+
+    file.write(doc.data(), doc.size());
+}
+
+const std::string& MpdManager::toString()
+{
     if (!started){
         std::time_t tt = std::chrono::system_clock::to_time_t (std::chrono::system_clock::now());
         struct std::tm *ptm = std::gmtime(&tt);
         std::strftime(availabilityStartTime, AVAILABILITY_START_TIME, "%FT%T", ptm);
         started = true;
+        headModified = true;
     }
 
-    root = doc.NewElement("MPD");
-    root->SetAttribute("xmlns:xsi", XMLNS_XSI);
-    root->SetAttribute("xmlns", XMLNS);
-    root->SetAttribute("xmlns:xlink", XMLNS_XLINK);
-    root->SetAttribute("xsi:schemaLocation", XSI_SCHEMA_LOCATION);
-    root->SetAttribute("profiles", PROFILES);
-    root->SetAttribute("type", TYPE_DYNAMIC);
-    root->SetAttribute("minimumUpdatePeriod", minimumUpdatePeriod.c_str());
-    root->SetAttribute("timeShiftBufferDepth", timeShiftBufferDepth.c_str());
-    root->SetAttribute("minBufferTime", ("PT" + std::to_string(minBufferTime) + ".0S").c_str());
-    root->SetAttribute("availabilityStartTime", availabilityStartTime);
-    doc.InsertFirstChild(root);
-
-    el = doc.NewElement("ProgramInformation");
-    title = doc.NewElement("Title");
-    text = doc.NewText("Demo DASH");
-    title->InsertFirstChild(text);
-    el->InsertFirstChild(title);
-    root->InsertEndChild(el);
-
-    period = doc.NewElement("Period");
-    period->SetAttribute("id", PERIOD_ID);
-    period->SetAttribute("start", PERIOD_START);
+    if (headModified) {
+        renderHead();
+    }
+
+    //NOTE: clearing keeps the buffer capacity, so the document is serialized without allocations
+    mpd.clear();
+    mpd += head;
 
     for (auto ad : adaptationSets) {
-        el = doc.NewElement("AdaptationSet");
-        el->SetAttribute("id", ad.first.c_str());
-        ad.second->toMpd(doc, el);
-        period->InsertEndChild(el);
+        ad.second->toMpd(mpd, ad.first);
     }
 
-    root->InsertEndChild(period);
-    doc.SaveFile(fileName);
+    mpd += "    </Period>\n</MPD>\n";
+    return mpd;
+}
+
+void MpdManager::renderHead()
+{
+    head.clear();
+    head += "<MPD";
+    appendAttribute(head, "xmlns:xsi", XMLNS_XSI);
+    appendAttribute(head, "xmlns", XMLNS);
+    appendAttribute(head, "xmlns:xlink", XMLNS_XLINK);
+
+    for (auto& ad : adaptationSets) {
+        if (ad.second->isProtected()) {
+            appendAttribute(head, "xmlns:cenc", XMLNS_CENC);
+            break;
+        }
+    }
+
+    appendAttribute(head, "xsi:schemaLocation", XSI_SCHEMA_LOCATION);
+    appendAttribute(head, "profiles", PROFILES);
+    appendAttribute(head, "type", TYPE_DYNAMIC);
+    appendAttribute(head, "minimumUpdatePeriod", minimumUpdatePeriod);
+    appendAttribute(head, "timeShiftBufferDepth", timeShiftBufferDepth);
+    appendAttribute(head, "minBufferTime", "PT" + std::to_string(minBufferTime) + ".0S");
+    appendAttribute(head, "availabilityStartTime", availabilityStartTime);
+    head += ">\n";
+
+    head += "    <ProgramInformation>\n";
+    head += "        <Title>Demo DASH</Title>\n";
+    head += "    </ProgramInformation>\n";
+
+    head += "    <Period";
+    appendAttribute(head, "id", PERIOD_ID);
+    appendAttribute(head, "start", PERIOD_START);
+    head += ">\n";
+
+    headModified = false;
 }
 
 uint64_t MpdManager::updateAdaptationSetTimestamp(std::string id, uint64_t ts, unsigned int duration)
@@ -142,6 +199,53 @@ bool MpdManager::flushAdaptationSetTimestamps(std::string id)
     return true;
 }
 
+bool MpdManager::setAvailabilityTimeOffset(std::string id, float offset)
+{
+    AdaptationSet* adSet;
+
+    adSet = getAdaptationSet(id);
+
+    if (!adSet) {
+        return false;
+    }
+
+    adSet->setAvailabilityTimeOffset(offset);
+    return true;
+}
+
+bool MpdManager::setContentProtection(std::string id, std::string scheme, std::string defaultKid)
+{
+    AdaptationSet* adSet;
+
+    adSet = getAdaptationSet(id);
+
+    if (!adSet) {
+        return false;
+    }
+
+    //NOTE: the cenc namespace is declared in the MPD element
+    if (adSet->isProtected() != !scheme.empty()) {
+        headModified = true;
+    }
+
+    adSet->setContentProtection(scheme, defaultKid);
+    return true;
+}
+
+bool MpdManager::setCaptions(std::string id, bool captions)
+{
+    AdaptationSet* adSet;
+
+    adSet = getAdaptationSet(id);
+
+    if (!adSet) {
+        return false;
+    }
+
+    adSet->setCaptions(captions);
+    return true;
+}
+
 void MpdManager::updateVideoAdaptationSet(std::string id, int timescale, std::string segmentTempl, std::string initTempl)
 {
     AdaptationSet* adSet;
@@ -232,6 +336,9 @@ AdaptationSet::AdaptationSet(int segTimescale, std::string segTempl, std::string
     startWithSAP = START_WITH_SAP;
     subsegmentAlignment = SUBSEGMENT_ALIGNMENT;
     subsegmentStartsWithSAP = SUBSEGMENT_STARTS_WITH_SAP;
+    availabilityTimeOffset = 0;
+    captions = false;
+    modified = true;
 }
 
 AdaptationSet::~AdaptationSet()
@@ -242,22 +349,138 @@ uint64_t AdaptationSet::updateTimestamp(uint64_t ts, unsigned int duration, unsi
 {
     uint64_t removedTimestamp= 0;
 
+    if (!timestamps.empty() && timestamps.back().first == ts) {
+        timestamps.back().second = duration;
+        timeline.back() = renderTimestamp(ts, duration);
+        return removedTimestamp;
+    }
+
     while (timestamps.size() >= maxSeg) {
         removedTimestamp = timestamps.front().first;
         timestamps.pop_front();
+        timeline.pop_front();
     }
 
     timestamps.push_back(std::pair<uint64_t,uint64_t>(ts, duration));
+    timeline.push_back(renderTimestamp(ts, duration));
     return removedTimestamp;
 }
 
 void AdaptationSet::flushTimestamps()
 {
     timestamps.clear();
+    timeline.clear();
+}
+
+void AdaptationSet::setAvailabilityTimeOffset(float offset)
+{
+    if (availabilityTimeOffset != offset) {
+        availabilityTimeOffset = offset;
+        modified = true;
+    }
+}
+
+void AdaptationSet::setContentProtection(std::string scheme, std::string kid)
+{
+    if (protectionScheme != scheme || defaultKid != kid) {
+        protectionScheme = scheme;
+        defaultKid = kid;
+        modified = true;
+    }
+}
+
+void AdaptationSet::renderContentProtection(std::string& xml)
+{
+    if (protectionScheme.empty()) {
+        return;
+    }
+
+    xml += "            <ContentProtection";
+    appendAttribute(xml, "schemeIdUri", CENC_SCHEME_ID_URI);
+    appendAttribute(xml, "value", protectionScheme);
+    appendAttribute(xml, "cenc:default_KID", defaultKid);
+    xml += "/>\n";
+
+    xml += "            <ContentProtection";
+    appendAttribute(xml, "schemeIdUri", COMMON_PSSH_SCHEME_ID_URI);
+    xml += "/>\n";
+}
+
+void AdaptationSet::setCaptions(bool captions_)
+{
+    if (captions != captions_) {
+        captions = captions_;
+        modified = true;
+    }
+}
+
+void AdaptationSet::renderAccessibility(std::string& xml)
+{
+    if (!captions) {
+        return;
+    }
+
+    xml += "            <Accessibility";
+    appendAttribute(xml, "schemeIdUri", CEA608_SCHEME_ID_URI);
+    appendAttribute(xml, "value", CEA608_CHANNELS);
+    xml += "/>\n";
+}
+
+std::string AdaptationSet::renderTimestamp(uint64_t ts, uint64_t duration)
+{
+    return "                    <S t=\"" + std::to_string(ts) + "\" d=\"" + std::to_string(duration) + "\"/>\n";
+}
+
+void AdaptationSet::toMpd(std::string& mpd, std::string id)
+{
+    char offset[32];
+
+    if (modified) {
+        head.clear();
+        head += "        <AdaptationSet";
+        appendAttribute(head, "id", id);
+        renderHead(head);
+
+        head += "            <SegmentTemplate";
+        appendAttribute(head, "timescale", timescale);
+        appendAttribute(head, "media", segTemplate);
+        appendAttribute(head, "initialization", initTemplate);
+
+        //NOTE: segments are not complete when they become available, players must not expect them to be served at once
+        if (availabilityTimeOffset > 0) {
+            snprintf(offset, sizeof(offset), "%.3f", availabilityTimeOffset);
+            appendAttribute(head, "availabilityTimeOffset", offset);
+            appendAttribute(head, "availabilityTimeComplete", false);
+        }
+
+        head += ">\n";
+        head += "                <SegmentTimeline>\n";
+
+        tail.clear();
+        tail += "                </SegmentTimeline>\n";
+        tail += "            </SegmentTemplate>\n";
+        renderRepresentations(tail);
+        tail += "        </AdaptationSet>\n";
+
+        modified = false;
+    }
+
+    mpd += head;
+
+    for (auto& s : timeline) {
+        mpd += s;
+    }
+
+    mpd += tail;
 }
 
 void AdaptationSet::update(int segTimescale, std::string segTempl, std::string initTempl)
 {
+    if (timescale == segTimescale && segTemplate == segTempl && initTemplate == initTempl) {
+        return;
+    }
+
+    modified = true;
     timescale = segTimescale;
     segTemplate = segTempl;
     initTemplate = initTempl;
@@ -287,6 +510,7 @@ bool VideoAdaptationSet::removeRepresentation(std::string id)
 
     delete representations[id];
     representations.erase(id);
+    modified = true;
     return true;
 }
 
@@ -305,19 +529,25 @@ void VideoAdaptationSet::updateVideoRepresentation(std::string id, std::string c
     if (!vRepr) {
         vRepr = new VideoRepresentation(codec, width, height, bandwidth);
         addRepresentation(id, vRepr);
-    } else {
-        vRepr->update(codec, width, height, bandwidth);
+        modified = true;
+    } else if (vRepr->update(codec, width, height, bandwidth)) {
+        modified = true;
     }
 
     if (maxWidth < width) {
         maxWidth = width;
+        modified = true;
     }
 
     if (maxHeight < height) {
         maxHeight = height;
+        modified = true;
     }
 
-    frameRate = fps;
+    if (frameRate != fps) {
+        frameRate = fps;
+        modified = true;
+    }
 }
 
 bool VideoAdaptationSet::addRepresentation(std::string id, VideoRepresentation* repr)
@@ -330,48 +560,32 @@ bool VideoAdaptationSet::addRepresentation(std::string id, VideoRepresentation*
     return true;
 }
 
-void VideoAdaptationSet::toMpd(tinyxml2::XMLDocument& doc, tinyxml2::XMLElement*& adaptSet)
+void VideoAdaptationSet::renderHead(std::string& xml)
 {
-    tinyxml2::XMLElement* segmentTemplate;
-    tinyxml2::XMLElement* segmentTimeline;
-    tinyxml2::XMLElement* s;
-    tinyxml2::XMLElement* repr;
-
-    adaptSet->SetAttribute("mimeType", mimeType.c_str());
-    adaptSet->SetAttribute("maxWidth", maxWidth);
-    adaptSet->SetAttribute("maxHeight", maxHeight);
-    adaptSet->SetAttribute("frameRate", frameRate);
-    adaptSet->SetAttribute("segmentAlignment", segmentAlignment);
-    adaptSet->SetAttribute("startWithSAP", startWithSAP);
-    adaptSet->SetAttribute("subsegmentAlignment", subsegmentAlignment);
-    adaptSet->SetAttribute("subsegmentStartsWithSAP", subsegmentStartsWithSAP);
-
-    segmentTemplate = doc.NewElement("SegmentTemplate");
-    segmentTemplate->SetAttribute("timescale", timescale);
-    segmentTemplate->SetAttribute("media", segTemplate.c_str());
-    segmentTemplate->SetAttribute("initialization", initTemplate.c_str());
-
-    segmentTimeline = doc.NewElement("SegmentTimeline");
-
-    for (auto ts : timestamps) {
-        s = doc.NewElement("S");
-        s->SetAttribute("t", std::to_string(ts.first).c_str());
-        s->SetAttribute("d", std::to_string(ts.second).c_str());
-        segmentTimeline->InsertEndChild(s);
-    }
-
-    segmentTemplate->InsertEndChild(segmentTimeline);
-    adaptSet->InsertEndChild(segmentTemplate);
+    appendAttribute(xml, "mimeType", mimeType);
+    appendAttribute(xml, "maxWidth", maxWidth);
+    appendAttribute(xml, "maxHeight", maxHeight);
+    appendAttribute(xml, "frameRate", frameRate);
+    appendAttribute(xml, "segmentAlignment", segmentAlignment);
+    appendAttribute(xml, "startWithSAP", startWithSAP);
+    appendAttribute(xml, "subsegmentAlignment", subsegmentAlignment);
+    appendAttribute(xml, "subsegmentStartsWithSAP", subsegmentStartsWithSAP);
+    xml += ">\n";
+    renderContentProtection(xml);
+    renderAccessibility(xml);
+}
 
+void VideoAdaptationSet::renderRepresentations(std::string& xml)
+{
     for (auto r : representations) {
-        repr = doc.NewElement("Representation");
-        repr->SetAttribute("id", r.first.c_str());
-        repr->SetAttribute("codecs", r.second->getCodec().c_str());
-        repr->SetAttribute("width", r.second->getWidth());
-        repr->SetAttribute("height", r.second->getHeight());
-        repr->SetAttribute("sar", r.second->getSAR().c_str());
-        repr->SetAttribute("bandwidth", r.second->getBandwidth());
-        adaptSet->InsertEndChild(repr);
+        xml += "            <Representation";
+        appendAttribute(xml, "id", r.first);
+        appendAttribute(xml, "codecs", r.second->getCodec());
+        appendAttribute(xml, "width", r.second->getWidth());
+        appendAttribute(xml, "height", r.second->getHeight());
+        appendAttribute(xml, "sar", r.second->getSAR());
+        appendAttribute(xml, "bandwidth", r.second->getBandwidth());
+        xml += "/>\n";
     }
 }
 
@@ -399,6 +613,7 @@ bool AudioAdaptationSet::removeRepresentation(std::string id)
 
     delete representations[id];
     representations.erase(id);
+    modified = true;
     return true;
 }
 
@@ -416,10 +631,13 @@ void AudioAdaptationSet::updateAudioRepresentation(std::string id, std::string c
     if (!repr) {
         repr = new AudioRepresentation(codec, sampleRate, bandwidth, channels);
         addRepresentation(id, repr);
+        modified = true;
         return;
     }
 
-    repr->update(codec, sampleRate, bandwidth, channels);
+    if (repr->update(codec, sampleRate, bandwidth, channels)) {
+        modified = true;
+    }
 }
 
 bool AudioAdaptationSet::addRepresentation(std::string id, AudioRepresentation* repr)
@@ -432,57 +650,39 @@ bool AudioAdaptationSet::addRepresentation(std::string id, AudioRepresentation*
     return true;
 }
 
-void AudioAdaptationSet::toMpd(tinyxml2::XMLDocument& doc, tinyxml2::XMLElement*& adaptSet)
+void AudioAdaptationSet::renderHead(std::string& xml)
 {
-    tinyxml2::XMLElement* segmentTemplate;
-    tinyxml2::XMLElement* segmentTimeline;
-    tinyxml2::XMLElement* role;
-    tinyxml2::XMLElement* audioChannelConfiguration;
-    tinyxml2::XMLElement* s;
-    tinyxml2::XMLElement* repr;
-
-    adaptSet->SetAttribute("mimeType", mimeType.c_str());
-    adaptSet->SetAttribute("lang", lang.c_str());
-    adaptSet->SetAttribute("segmentAlignment", segmentAlignment);
-    adaptSet->SetAttribute("startWithSAP", startWithSAP);
-    adaptSet->SetAttribute("subsegmentAlignment", subsegmentAlignment);
-    adaptSet->SetAttribute("subsegmentStartsWithSAP", subsegmentStartsWithSAP);
+    appendAttribute(xml, "mimeType", mimeType);
+    appendAttribute(xml, "lang", lang);
+    appendAttribute(xml, "segmentAlignment", segmentAlignment);
+    appendAttribute(xml, "startWithSAP", startWithSAP);
+    appendAttribute(xml, "subsegmentAlignment", subsegmentAlignment);
+    appendAttribute(xml, "subsegmentStartsWithSAP", subsegmentStartsWithSAP);
+    xml += ">\n";
+    renderContentProtection(xml);
 
-    role = doc.NewElement("Role");
-    role->SetAttribute("schemeIdUri", roleSchemeIdUri.c_str());
-    role->SetAttribute("value", roleValue.c_str());
-    adaptSet->InsertEndChild(role);
-
-    segmentTemplate = doc.NewElement("SegmentTemplate");
-    segmentTemplate->SetAttribute("timescale", timescale);
-    segmentTemplate->SetAttribute("media", segTemplate.c_str());
-    segmentTemplate->SetAttribute("initialization", initTemplate.c_str());
-
-    segmentTimeline = doc.NewElement("SegmentTimeline");
-
-    for (auto ts : timestamps) {
-        s = doc.NewElement("S");
-        s->SetAttribute("t", std::to_string(ts.first).c_str());
-        s->SetAttribute("d", std::to_string(ts.second).c_str());
-        segmentTimeline->InsertEndChild(s);
-    }
-
-    segmentTemplate->InsertEndChild(segmentTimeline);
-    adaptSet->InsertEndChild(segmentTemplate);
+    xml += "            <Role";
+    appendAttribute(xml, "schemeIdUri", roleSchemeIdUri);
+    appendAttribute(xml, "value", roleValue);
+    xml += "/>\n";
+}
 
+void AudioAdaptationSet::renderRepresentations(std::string& xml)
+{
     for (auto r : representations) {
-        repr = doc.NewElement("Representation");
-        repr->SetAttribute("id", r.first.c_str());
-        repr->SetAttribute("codecs", r.second->getCodec().c_str());
-        repr->SetAttribute("audioSamplingRate", r.second->getSampleRate());
-        repr->SetAttribute("bandwidth", r.second->getBandwidth());
-
-        audioChannelConfiguration = doc.NewElement("AudioChannelConfiguration");
-        audioChannelConfiguration->SetAttribute("schemeIdUri", r.second->getAudioChannelConfigSchemeIdUri().c_str());
-        audioChannelConfiguration->SetAttribute("value", r.second->getAudioChannelConfigValue());
-        repr->InsertEndChild(audioChannelConfiguration);
-
-        adaptSet->InsertEndChild(repr);
+        xml += "            <Representation";
+        appendAttribute(xml, "id", r.first);
+        appendAttribute(xml, "codecs", r.second->getCodec());
+        appendAttribute(xml, "audioSamplingRate", r.second->getSampleRate());
+        appendAttribute(xml, "bandwidth", r.second->getBandwidth());
+        xml += ">\n";
+
+        xml += "                <AudioChannelConfiguration";
+        appendAttribute(xml, "schemeIdUri", r.second->getAudioChannelConfigSchemeIdUri());
+        appendAttribute(xml, "value", r.second->getAudioChannelConfigValue());
+        xml += "/>\n";
+
+        xml += "            </Representation>\n";
     }
 }
 
@@ -499,12 +699,17 @@ VideoRepresentation::~VideoRepresentation()
 {
 }
 
-void VideoRepresentation::update(std::string vCodec, int vWidth, int vHeight, int vBandwidth)
+bool VideoRepresentation::update(std::string vCodec, int vWidth, int vHeight, int vBandwidth)
 {
+    if (codec == vCodec && width == vWidth && height == vHeight && bandwidth == vBandwidth) {
+        return false;
+    }
+
     codec = vCodec;
     width = vWidth;
     height = vHeight;
     bandwidth = vBandwidth;
+    return true;
 }
 
 AudioRepresentation::AudioRepresentation(std::string aCodec, int aSampleRate, int aBandwidth, int channels)
@@ -520,11 +725,16 @@ AudioRepresentation::~AudioRepresentation()
 {
 }
 
-void AudioRepresentation::update(std::string aCodec, int aSampleRate, int aBandwidth, int channels)
+bool AudioRepresentation::update(std::string aCodec, int aSampleRate, int aBandwidth, int channels)
 {
+    if (codec == aCodec && sampleRate == aSampleRate && bandwidth == aBandwidth && audioChannelConfigValue == channels) {
+        return false;
+    }
+
     codec = aCodec;
     sampleRate = aSampleRate;
     bandwidth = aBandwidth;
     audioChannelConfigValue = channels;
+    return true;
 }
 
@@ -24,7 +24,8 @@
 
 #include <map>
 #include <deque>
-#include <tinyxml2.h>
+#include <string>
+#include <cstdint>
 
 #define MIN_SEGMENT 2
 #define XMLNS_XSI "http://www.w3.org/2001/XMLSchema-instance"
@@ -47,6 +48,11 @@
 #define AUDIO_ROLE_VALUE "main"
 #define SAR "1:1"
 #define AUDIO_CHANNEL_CONFIG_SCHEME_ID_URI "urn:mpeg:dash:23003:3:audio_channel_configuration:2011"
+#define XMLNS_CENC "urn:mpeg:cenc:2013"
+#define CENC_SCHEME_ID_URI "urn:mpeg:dash:mp4protection:2011"
+#define COMMON_PSSH_SCHEME_ID_URI "urn:uuid:1077efec-c0b2-4d02-ace3-3c1e52e2fb4b"
+#define CEA608_SCHEME_ID_URI "urn:scte:dash:cc:cea-608:2015"
+#define CEA608_CHANNELS "CC1"
 
 class AdaptationSet;
 class VideoAdaptationSet;
@@ -55,7 +61,8 @@ class VideoRepresentation;
 class AudioRepresentation;
 
 /*! It is used to manage the MPD File. Use the different setters to fill values and write the file 
-    to disk in .mpd format using writeToDisk method */ 
+    to disk in .mpd format using writeToDisk method. The MPD is kept rendered: each adaptation set caches
+    its XML, and a timestamp update only renders its <S> entry, so serializing it does not rebuild the document */ 
 
 class MpdManager
 {
@@ -75,6 +82,12 @@ public:
     * @param fileName File name (can be an absolute or relative path)
     */
     void writeToDisk(const char* fileName);
+
+    /**
+    * Serializes the .mpd file with the current data stored in the class, as writeToDisk does
+    * @return MPD document, valid until the next call
+    */
+    const std::string& toString();
     
     //TODO: add documentation
     unsigned int getMaxSeg() {return maxSeg;};
@@ -101,7 +114,8 @@ public:
     /**
     * Updates an adaptation set timestamp, represented in the MPD file with the tag <S>, child of <SegmentTimeline>. If the
     * number of Timestamps exceeds maxSeg attribute it replaces the oldest one by the current. If the limit has still not
-    * been reached, it adds the current one to the list.
+    * been reached, it adds the current one to the list. If the timestamp is the last one, only its duration is updated,
+    * this is how segments announced in progress are completed.
     * @param id Adaptation set Id. Must exist.
     * @param ts Timestamp of the current segment in timescale base.
     * @param duration Duration of the current segment in timescale base.
@@ -149,8 +163,40 @@ public:
     */
     bool flushAdaptationSetTimestamps(std::string id);
 
+    /**
+    * Sets the availabilityTimeOffset of an adaptation set, which lets players request its segments in progress
+    * @param id Adaptation set Id
+    * @param offset Seconds before its end a segment starts being available, 0 removes the attribute
+    * @return true on success and false on fail
+    */
+    bool setAvailabilityTimeOffset(std::string id, float offset);
+
+    /**
+    * Signals the Common Encryption of an adaptation set with ContentProtection descriptors: the scheme with the
+    * default key id and the common pssh system, whose pssh box in the init segment lists the key ids
+    * @param id Adaptation set Id
+    * @param scheme "cenc" or "cbcs", empty removes the descriptors
+    * @param defaultKid key id as an UUID
+    * @return true on success and false on fail
+    */
+    bool setContentProtection(std::string id, std::string scheme, std::string defaultKid);
+
+    /**
+    * Signals the closed captions embedded in the video of an adaptation set with an Accessibility descriptor
+    * @param id Adaptation set Id
+    * @param captions true if its pictures carry CEA-608/708 captions
+    * @return true on success and false on fail
+    */
+    bool setCaptions(std::string id, bool captions);
+
+    /**
+    * @param id Adaptation set Id
+    * @return true if the adaptation set exists
+    */
+    bool hasAdaptationSet(std::string id) {return adaptationSets.count(id) > 0;};
 
 private:
+    void renderHead();
     bool addAdaptationSet(std::string id, AdaptationSet* adaptationSet);
     AdaptationSet* getAdaptationSet(std::string id);
 
@@ -164,6 +210,10 @@ private:
     bool started;
     
     std::map<std::string, AdaptationSet*> adaptationSets;
+
+    std::string head;
+    bool headModified;
+    std::string mpd;
 };
 
 /*! It is used to enapsulate all the data of one <AdaptationSet> tag and its childs. It is the parent class of 
@@ -185,12 +235,12 @@ public:
     virtual ~AdaptationSet();
 
     /**
-    * It dumps the adaptation set data to the tinyxml2 classes, used to construct the MPD file (which is indeed a XML file).
-    * It is a pure virtual method implemented by Video and Audio adaptation sets.
-    * @param doc tinyxml2::XMLDocument which represents the whole MPD file
-    * @param adaptSet tinyxml2:XMLElement which represents the <AdaptationSet> node.
+    * Appends the <AdaptationSet> node to the MPD. The node is cached, only the parts changed since the previous call
+    * are rendered again.
+    * @param mpd MPD document being serialized
+    * @param id Adaptation set Id, <AdaptationSet> tag "id" attribute
     */
-    virtual void toMpd(tinyxml2::XMLDocument& doc, tinyxml2::XMLElement*& adaptSet) = 0;
+    void toMpd(std::string& mpd, std::string id);
 
     /**
     * @see MpdManager::updateVideoRepresentation 
@@ -222,8 +272,43 @@ public:
     virtual bool removeRepresentation(std::string id) = 0;
 
     void flushTimestamps();
+
+    void setAvailabilityTimeOffset(float offset);
+
+    void setContentProtection(std::string scheme, std::string defaultKid);
+
+    bool isProtected() {return !protectionScheme.empty();};
+
+    void setCaptions(bool captions);
     
 protected:
+    /**
+    * Renders the <AdaptationSet> attributes but the id and the children before <SegmentTemplate>.
+    * It is a pure virtual method implemented by Video and Audio adaptation sets.
+    * @param xml where the rendered XML is appended
+    */
+    virtual void renderHead(std::string& xml) = 0;
+
+    /**
+    * Renders the <Representation> nodes.
+    * It is a pure virtual method implemented by Video and Audio adaptation sets.
+    * @param xml where the rendered XML is appended
+    */
+    virtual void renderRepresentations(std::string& xml) = 0;
+
+    /**
+    * Renders the <ContentProtection> nodes, if the adaptation set is encrypted
+    * @param xml where the rendered XML is appended
+    */
+    void renderContentProtection(std::string& xml);
+
+    /**
+    * Renders the <Accessibility> node, if the representations carry captions
+    * @param xml where the rendered XML is appended
+    */
+    void renderAccessibility(std::string& xml);
+
+    std::string renderTimestamp(uint64_t ts, uint64_t duration);
 
     bool segmentAlignment;
     int startWithSAP;
@@ -234,6 +319,16 @@ protected:
     std::string segTemplate;
     std::string initTemplate;
     std::deque<std::pair<uint64_t,uint64_t>> timestamps;
+    float availabilityTimeOffset;
+    std::string protectionScheme;           //!< Empty if the segments are not encrypted
+    std::string defaultKid;
+    bool captions;                          //!< The pictures carry embedded closed captions
+    bool modified;                          //!< The cached head and tail must be rendered again
+
+private:
+    std::string head;                       //!< From <AdaptationSet> to <SegmentTimeline>
+    std::deque<std::string> timeline;       //!< One rendered <S> for each timestamp
+    std::string tail;                       //!< From </SegmentTimeline> to </AdaptationSet>
 };
 
 /*! It is used to encapsulate all the data of a video AdaptationSet. It adds specific video data to the common data
@@ -253,17 +348,14 @@ public:
     */
     virtual ~VideoAdaptationSet();
 
-    /**
-    * @see AdaptationSet::toMpd
-    */
-    void toMpd(tinyxml2::XMLDocument& doc, tinyxml2::XMLElement*& adaptSet);
-
     /**
     * @see AdaptationSet::updateVideoRepresentation
     **/
     void updateVideoRepresentation(std::string id, std::string codec, int width, int height, int bandwidth, int fps);
 
 private:
+    void renderHead(std::string& xml);
+    void renderRepresentations(std::string& xml);
     VideoRepresentation* getRepresentation(std::string id);
     bool addRepresentation(std::string id, VideoRepresentation* repr);
     bool removeRepresentation(std::string id);
@@ -291,17 +383,14 @@ public:
     */
     virtual ~AudioAdaptationSet();
 
-    /**
-    * @see AdaptationSet::toMpd
-    */
-    void toMpd(tinyxml2::XMLDocument& doc, tinyxml2::XMLElement*& adaptSet);
-
     /**
     * @see AdaptationSet::updateAudioRepresentation
     **/
     void updateAudioRepresentation(std::string id, std::string codec, int sampleRate, int bandwidth, int channels);
 
 private:
+    void renderHead(std::string& xml);
+    void renderRepresentations(std::string& xml);
     AudioRepresentation* getRepresentation(std::string id);
     bool addRepresentation(std::string id, AudioRepresentation* repr);
     bool removeRepresentation(std::string id);
@@ -331,8 +420,9 @@ public:
     /**
     * Sets codec, width, height and bandwidth
     * @see MpdManager::updateVideoRepresentation 
+    * @return true if any value changed
     */
-    void update(std::string vCodec, int vWidth, int vHeight, int vBandwidth);
+    bool update(std::string vCodec, int vWidth, int vHeight, int vBandwidth);
 
     /**
     * Get codec as a string
@@ -387,8 +477,9 @@ public:
     /**
     * Sets codec, sample rate, bandwdith and channels
     * @see MpdManager::updateAudioRepresentation 
+    * @return true if any value changed
     */
-    void update(std::string aCodec, int aSampleRate, int aBandwidth, int channels);
+    bool update(std::string aCodec, int aSampleRate, int aBandwidth, int channels);
 
     std::string getCodec() {return codec;};
     int getSampleRate() {return sampleRate;};
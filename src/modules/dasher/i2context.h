@@ -30,10 +30,17 @@ typedef unsigned char byte;
 #define VIDEO_TYPE_AVC 1            //AVC1_VIDEO_TYPE  &   HEV1_VIDEO_TYPE
 #define VIDEO_TYPE_HEVC 2            //AVC1_VIDEO_TYPE  &   HEV1_VIDEO_TYPE
 #define AUDIO_TYPE 3
+#define VIDEO_TYPE_AV1 4            //AV01_VIDEO_TYPE
+#define IS_VIDEO_TYPE(type) ((type) == VIDEO_TYPE_AVC || (type) == VIDEO_TYPE_HEVC || (type) == VIDEO_TYPE_AV1)
 #define MAX_MDAT_SAMPLE 65536   //H265 -> 119296
-#define MAX_DAT 10*1024*1024 
+#define INITIAL_MDAT_SAMPLE 256 //sample table entries allocated with the context, grown up to MAX_MDAT_SAMPLE
+#define MAX_DAT 256*1024*1024   //segment data limit, buffers are grown up to it
+#define INITIAL_DAT 512*1024    //segment data allocated with the context unless a larger size is reserved
+#define MAX_TRUN_SAMPLE_SIZE 16 //trun bytes per sample
+#define MAX_FRAGMENT_HEADER 1024 //styp, moof and mdat bytes besides the trun samples
 //TODO: error negative values
 #define I2ERROR_MAX 10
+#define I2ERROR_MEMORY 10
 #define I2ERROR_SPS_PPS 9
 #define I2ERROR_IS_INTRA 8
 #define I2ERROR_DURATION_ZERO 7
@@ -47,6 +54,11 @@ typedef unsigned char byte;
 #define TRUE    1
 #define FALSE   0
 #define FRAMERATE_PER_CENT 10
+#define CENC_SCHEME_NONE 0
+#define CENC_SCHEME_CENC 1      //AES-CTR, full sample or subsample encryption
+#define CENC_SCHEME_CBCS 2      //AES-CBC with a constant IV and a 1:9 pattern for video
+#define CENC_KEY_SIZE 16
+#define CENC_MAX_KEYS 16
 
 #include <netinet/in.h>
 
@@ -61,19 +73,26 @@ typedef struct {
 
 typedef struct {
     uint32_t        box_flags;
-    mdat_sample     mdat[MAX_MDAT_SAMPLE];
+    mdat_sample     *mdat;
+    uint32_t        mdat_capacity;
     uint32_t        mdat_sample_length;
     uint32_t        mdat_total_size;
     uint32_t        moof_pos;
     uint32_t        trun_pos;
+    uint32_t        fragment_first;     //first sample of the next moof, previous ones are already chunked
+    uint32_t        fragment_length;    //samples of the moof being written
+    uint32_t        fragment_offset;    //segment_data bytes already chunked
+    uint32_t        fragment_duration;  //duration of the samples already chunked
 } i2ctx_sample;
 
 //CONTEXT
 typedef struct {
     byte            *pps_sps_data;
     uint32_t        pps_sps_data_length;
-    byte            segment_data[MAX_DAT];
+    byte            *segment_data;
     uint32_t        segment_data_size;
+    uint32_t        segment_data_capacity;
+    uint32_t        pending_data_size;      //data of the frame in progress, it follows the segment data
     uint32_t        time_base;
     uint32_t        sample_duration;
     uint16_t        width;
@@ -89,8 +108,9 @@ typedef struct {
 typedef struct {
     byte            *aac_data;
     uint32_t        aac_data_length;
-    byte            segment_data[MAX_DAT];
+    byte            *segment_data;
     uint32_t        segment_data_size;
+    uint32_t        segment_data_capacity;
     uint32_t        time_base;
     uint32_t        sample_duration;
     uint16_t        channels;
@@ -102,6 +122,22 @@ typedef struct {
     i2ctx_sample    *ctxsample;
 } i2ctx_audio;
 
+typedef struct {
+    byte            kid[CENC_KEY_SIZE];
+    byte            key[CENC_KEY_SIZE];
+} i2ctx_key;
+
+typedef struct {
+    uint32_t        scheme;
+    i2ctx_key       keys[CENC_MAX_KEYS];
+    uint32_t        keys_length;
+    uint32_t        rotation;               //segments encrypted with each key, 0 only uses the first one
+    uint64_t        iv;                     //cenc IV of the next sample, it is incremented for each one
+    byte            constant_iv[CENC_KEY_SIZE];//cbcs IV of every subsample
+    byte            *pssh_data;             //pssh boxes added to the moov besides the common one
+    uint32_t        pssh_data_length;
+} i2ctx_crypto;
+
 typedef struct {
     i2ctx_audio     *ctxaudio;
     i2ctx_video     *ctxvideo;
@@ -109,6 +145,8 @@ typedef struct {
     uint32_t        threshold;
     uint32_t        reference_size;//TODO: refactor
     uint8_t         audio_segment_flag;
+    uint32_t        chunk_samples;//CMAF chunk length in samples, 0 writes whole segments
+    i2ctx_crypto    *ctxcrypto;//NULL if the segments are not encrypted
 } i2ctx;
 
 #endif
@@ -0,0 +1,585 @@
+/*
+ *  Libi2dash - is an ANSI C DASH library in development of ISO/IEC 23009-1
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of libi2dash.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:		Martin German <martin.german@i2cat.net>
+			Nadim El Taha <nadim.el.taha@i2cat.net>
+
+ */
+
+#include "i2libcenc.h"
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#define BOX_TYPE_SIZE 4
+#define AES_BLOCK_SIZE 16
+#define SEIG_GROUP_INDEX 0x10001    //first sample group description of the fragment
+
+// W3C common PSSH system id, its pssh lists the key ids
+static const byte common_system_id[16] = {0x10, 0x77, 0xef, 0xec, 0xc0, 0xb2, 0x4d, 0x02,
+                                          0xac, 0xe3, 0x3c, 0x1e, 0x52, 0xe2, 0xfb, 0x4b};
+
+// Subsample walk of a length prefixed video sample
+typedef struct {
+    uint32_t pos;
+    uint32_t clear;     //clear bytes not emitted yet
+    uint32_t protect;   //protected bytes that follow them
+} cenc_walk;
+
+static uint32_t put_32(byte *data, uint32_t value) {
+    uint32_t hton_value = htonl(value);
+    memcpy(data, &hton_value, 4);
+    return 4;
+}
+
+static uint32_t put_16(byte *data, uint16_t value) {
+    uint16_t hton_value = htons(value);
+    memcpy(data, &hton_value, 2);
+    return 2;
+}
+
+static uint32_t put_64(byte *data, uint64_t value) {
+    put_32(data, value >> 32);
+    put_32(data + 4, value & 0xFFFFFFFF);
+    return 8;
+}
+
+static uint32_t get_32(byte *data) {
+    uint32_t value;
+    memcpy(&value, data, 4);
+    return ntohl(value);
+}
+
+static uint32_t is_video(uint32_t media_type) {
+    return (media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC);
+}
+
+static uint32_t is_rotated(i2ctx_crypto *crypto) {
+    return crypto->rotation > 0 && crypto->keys_length > 1;
+}
+
+static i2ctx_key *get_key(i2ctx_crypto *crypto, uint32_t seq_number) {
+    if (!is_rotated(crypto)) {
+        return &crypto->keys[0];
+    }
+    return &crypto->keys[(seq_number / crypto->rotation) % crypto->keys_length];
+}
+
+static uint32_t get_iv_size(i2ctx_crypto *crypto) {
+    return crypto->scheme == CENC_SCHEME_CENC ? CENC_IV_SIZE : 0;
+}
+
+static byte get_pattern(uint32_t media_type, i2ctx_crypto *crypto) {
+    // cbcs audio encrypts every block
+    if (crypto->scheme != CENC_SCHEME_CBCS || !is_video(media_type)) {
+        return 0;
+    }
+    return (CBCS_CRYPT_BLOCKS << 4) | CBCS_SKIP_BLOCKS;
+}
+
+// Clear bytes of a NAL after its length prefix, the protected ones are whole AES blocks for cenc
+static uint32_t nal_clear_size(byte *nal, uint32_t nal_size, uint32_t media_type, uint32_t scheme) {
+    uint32_t header, type, vcl, clear;
+
+    if (media_type == VIDEO_TYPE_AVC) {
+        header = 1;
+        type = nal[0] & 0x1F;
+        vcl = type >= 1 && type <= 5;
+    } else {
+        header = 2;
+        type = (nal[0] >> 1) & 0x3F;
+        vcl = type <= 31;
+    }
+
+    if (!vcl || nal_size <= header) {
+        return nal_size;
+    }
+
+    if (scheme == CENC_SCHEME_CBCS) {
+        clear = nal_size > CBCS_CLEAR_NAL ? CBCS_CLEAR_NAL : nal_size;
+    } else {
+        clear = header + (nal_size - header) % AES_BLOCK_SIZE;
+    }
+
+    if (nal_size - clear < AES_BLOCK_SIZE) {
+        return nal_size;
+    }
+
+    return clear;
+}
+
+// Gets the next subsample of a sample, consecutive clear NALs are merged. Returns FALSE at the end of the sample
+static uint8_t next_subsample(byte *sample, uint32_t size, uint32_t media_type, uint32_t scheme,
+                              cenc_walk *walk, uint32_t *clear, uint32_t *protect) {
+    uint32_t nal_size, nal_clear;
+
+    while (walk->protect == 0 && walk->clear <= CENC_CLEAR_SUBSAMPLE && walk->pos < size) {
+        if (size - walk->pos <= 4) {
+            walk->clear+= size - walk->pos;
+            walk->pos = size;
+            break;
+        }
+
+        // A malformed length leaves the rest of the sample clear
+        nal_size = get_32(sample + walk->pos);
+        if (nal_size > size - walk->pos - 4) {
+            walk->clear+= size - walk->pos;
+            walk->pos = size;
+            break;
+        }
+
+        nal_clear = nal_clear_size(sample + walk->pos + 4, nal_size, media_type, scheme);
+        walk->clear+= 4 + nal_clear;
+        walk->protect = nal_size - nal_clear;
+        walk->pos+= 4 + nal_size;
+    }
+
+    if (walk->clear > CENC_CLEAR_SUBSAMPLE) {
+        *clear = CENC_CLEAR_SUBSAMPLE;
+        *protect = 0;
+        walk->clear-= CENC_CLEAR_SUBSAMPLE;
+        return TRUE;
+    }
+
+    if (walk->clear == 0 && walk->protect == 0) {
+        return FALSE;
+    }
+
+    *clear = walk->clear;
+    *protect = walk->protect;
+    walk->clear = 0;
+    walk->protect = 0;
+    return TRUE;
+}
+
+static uint32_t count_subsamples(byte *sample, uint32_t size, uint32_t media_type, uint32_t scheme) {
+    cenc_walk walk = {0, 0, 0};
+    uint32_t clear, protect, count;
+
+    count = 0;
+    while (next_subsample(sample, size, media_type, scheme, &walk, &clear, &protect)) {
+        count++;
+    }
+
+    return count;
+}
+
+uint8_t cenc_set_keys(i2ctx_crypto **crypto, uint32_t scheme, byte *kids, byte *keys, uint32_t keys_length,
+                      uint32_t rotation, byte *pssh_data, uint32_t pssh_data_length) {
+    uint32_t i, pos, box_size;
+    byte iv[8];
+
+    if (scheme != CENC_SCHEME_CENC && scheme != CENC_SCHEME_CBCS) {
+        return I2ERROR_MEDIA_TYPE;
+    }
+    if (kids == NULL || keys == NULL) {
+        return I2ERROR_SOURCE_NULL;
+    }
+    if (keys_length < 1 || keys_length > CENC_MAX_KEYS) {
+        return I2ERROR_SIZE_ZERO;
+    }
+
+    // pssh data must be a sequence of complete pssh boxes
+    pos = 0;
+    while (pssh_data != NULL && pos < pssh_data_length) {
+        if (pssh_data_length - pos < 8) {
+            return I2ERROR_ISOFF;
+        }
+        box_size = get_32(pssh_data + pos);
+        if (box_size < 8 || box_size > pssh_data_length - pos || memcmp(pssh_data + pos + 4, "pssh", BOX_TYPE_SIZE) != 0) {
+            return I2ERROR_ISOFF;
+        }
+        pos+= box_size;
+    }
+
+    cenc_free(crypto);
+    (*crypto) = (i2ctx_crypto *) malloc(sizeof(i2ctx_crypto));
+    if ((*crypto) == NULL) {
+        return I2ERROR_MEMORY;
+    }
+
+    (*crypto)->pssh_data = NULL;
+    (*crypto)->pssh_data_length = 0;
+    (*crypto)->scheme = scheme;
+    (*crypto)->keys_length = keys_length;
+    (*crypto)->rotation = rotation;
+    for (i = 0; i < keys_length; i++) {
+        memcpy((*crypto)->keys[i].kid, kids + i * CENC_KEY_SIZE, CENC_KEY_SIZE);
+        memcpy((*crypto)->keys[i].key, keys + i * CENC_KEY_SIZE, CENC_KEY_SIZE);
+    }
+
+    // IVs must not repeat with the same key, the cenc counter starts at a random value
+    if (RAND_bytes(iv, sizeof(iv)) != 1 || RAND_bytes((*crypto)->constant_iv, CENC_KEY_SIZE) != 1) {
+        cenc_free(crypto);
+        return I2ERROR_ISOFF;
+    }
+    (*crypto)->iv = 0;
+    for (i = 0; i < sizeof(iv); i++) {
+        (*crypto)->iv = ((*crypto)->iv << 8) | iv[i];
+    }
+
+    if (pssh_data != NULL && pssh_data_length > 0) {
+        (*crypto)->pssh_data = (byte *) malloc(pssh_data_length);
+        if ((*crypto)->pssh_data == NULL) {
+            cenc_free(crypto);
+            return I2ERROR_MEMORY;
+        }
+        memcpy((*crypto)->pssh_data, pssh_data, pssh_data_length);
+        (*crypto)->pssh_data_length = pssh_data_length;
+    }
+
+    return I2OK;
+}
+
+void cenc_free(i2ctx_crypto **crypto) {
+    if ((*crypto) == NULL) {
+        return;
+    }
+
+    free((*crypto)->pssh_data);
+    OPENSSL_cleanse((*crypto)->keys, sizeof((*crypto)->keys));
+    free(*crypto);
+    (*crypto) = NULL;
+}
+
+uint32_t cenc_init_max_size(i2ctx_crypto *crypto) {
+    if (crypto == NULL) {
+        return 0;
+    }
+
+    // sinf with the largest tenc (cbcs) and the common pssh
+    return 8 + 12 + 20 + 8 + 49 + 36 + crypto->keys_length * CENC_KEY_SIZE + crypto->pssh_data_length;
+}
+
+uint32_t cenc_fragment_max_size(byte *source_data, uint32_t media_type, i2ctx_sample *samples,
+                                uint32_t sample_first, uint32_t sample_end, i2ctx_crypto *crypto) {
+    uint32_t i, size, pos;
+
+    if (crypto == NULL) {
+        return 0;
+    }
+
+    size = CENC_FRAGMENT_BOXES;
+    pos = 0;
+    for (i = sample_first; i < sample_end; i++) {
+        // IV, subsample count and saiz entry
+        size+= CENC_IV_SIZE + 2 + 1;
+        if (is_video(media_type)) {
+            size+= 6 * count_subsamples(source_data + pos, samples->mdat[i].size, media_type, crypto->scheme);
+        }
+        pos+= samples->mdat[i].size;
+    }
+
+    return size;
+}
+
+uint32_t write_sinf(byte *data, uint32_t entry_size, uint32_t media_type, i2ctx_crypto *crypto) {
+    uint32_t count, sinf_pos, schi_pos, tenc_pos;
+    byte format[BOX_TYPE_SIZE];
+
+    memcpy(format, data + 4, BOX_TYPE_SIZE);
+    memcpy(data + 4, is_video(media_type) ? "encv" : "enca", BOX_TYPE_SIZE);
+
+    count = entry_size;
+    sinf_pos = count;
+    count+= 4;
+    memcpy(data + count, "sinf", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+
+    // frma, original sample entry type
+    count+= put_32(data + count, 12);
+    memcpy(data + count, "frma", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+    memcpy(data + count, format, BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+
+    // schm, scheme type and version 1.0
+    count+= put_32(data + count, 20);
+    memcpy(data + count, "schm", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+    count+= put_32(data + count, 0);
+    memcpy(data + count, crypto->scheme == CENC_SCHEME_CBCS ? "cbcs" : "cenc", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+    count+= put_32(data + count, 0x00010000);
+
+    schi_pos = count;
+    count+= 4;
+    memcpy(data + count, "schi", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+
+    // tenc, version 1 carries the pattern
+    tenc_pos = count;
+    count+= 4;
+    memcpy(data + count, "tenc", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+    count+= put_32(data + count, crypto->scheme == CENC_SCHEME_CBCS ? 0x01000000 : 0);
+    data[count++] = 0;
+    data[count++] = get_pattern(media_type, crypto);
+    data[count++] = 1;
+    data[count++] = get_iv_size(crypto);
+    memcpy(data + count, crypto->keys[0].kid, CENC_KEY_SIZE);
+    count+= CENC_KEY_SIZE;
+    if (crypto->scheme == CENC_SCHEME_CBCS) {
+        data[count++] = CENC_KEY_SIZE;
+        memcpy(data + count, crypto->constant_iv, CENC_KEY_SIZE);
+        count+= CENC_KEY_SIZE;
+    }
+
+    put_32(data + tenc_pos, count - tenc_pos);
+    put_32(data + schi_pos, count - schi_pos);
+    put_32(data + sinf_pos, count - sinf_pos);
+    put_32(data, count);
+    return count;
+}
+
+uint32_t write_pssh(byte *data, i2ctx_crypto *crypto) {
+    uint32_t count, i;
+
+    count = 4;
+    memcpy(data + count, "pssh", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+
+    // version 1 lists the key ids
+    count+= put_32(data + count, 0x01000000);
+    memcpy(data + count, common_system_id, sizeof(common_system_id));
+    count+= sizeof(common_system_id);
+    count+= put_32(data + count, crypto->keys_length);
+    for (i = 0; i < crypto->keys_length; i++) {
+        memcpy(data + count, crypto->keys[i].kid, CENC_KEY_SIZE);
+        count+= CENC_KEY_SIZE;
+    }
+    count+= put_32(data + count, 0);
+    put_32(data, count);
+
+    if (crypto->pssh_data_length > 0) {
+        memcpy(data + count, crypto->pssh_data, crypto->pssh_data_length);
+        count+= crypto->pssh_data_length;
+    }
+
+    return count;
+}
+
+static uint32_t write_seig_boxes(byte *data, uint32_t media_type, uint32_t seq_number, i2ctx_sample *samples, i2ctx_crypto *crypto) {
+    uint32_t count, entry_size;
+
+    count = 0;
+    entry_size = 20 + (crypto->scheme == CENC_SCHEME_CBCS ? 1 + CENC_KEY_SIZE : 0);
+
+    // sbgp, every sample of the fragment belongs to its seig group
+    count+= put_32(data + count, 28);
+    memcpy(data + count, "sbgp", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+    count+= put_32(data + count, 0);
+    memcpy(data + count, "seig", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+    count+= put_32(data + count, 1);
+    count+= put_32(data + count, samples->fragment_length);
+    count+= put_32(data + count, SEIG_GROUP_INDEX);
+
+    // sgpd, the key of the fragment
+    count+= put_32(data + count, 24 + entry_size);
+    memcpy(data + count, "sgpd", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+    count+= put_32(data + count, 0x01000000);
+    memcpy(data + count, "seig", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+    count+= put_32(data + count, entry_size);
+    count+= put_32(data + count, 1);
+    data[count++] = 0;
+    data[count++] = get_pattern(media_type, crypto);
+    data[count++] = 1;
+    data[count++] = get_iv_size(crypto);
+    memcpy(data + count, get_key(crypto, seq_number)->kid, CENC_KEY_SIZE);
+    count+= CENC_KEY_SIZE;
+    if (crypto->scheme == CENC_SCHEME_CBCS) {
+        data[count++] = CENC_KEY_SIZE;
+        memcpy(data + count, crypto->constant_iv, CENC_KEY_SIZE);
+        count+= CENC_KEY_SIZE;
+    }
+
+    return count;
+}
+
+uint32_t write_cenc_boxes(byte *data, uint32_t traf_pos, byte *source_data, uint32_t media_type,
+                          uint32_t seq_number, i2ctx_sample *samples, i2ctx_crypto *crypto) {
+    uint32_t count, i, pos, info_size, info_total, clear, protect, subsamples_pos;
+    uint16_t subsamples;
+    uint64_t iv;
+    cenc_walk walk;
+    byte *sizes;
+
+    count = 0;
+    info_total = 0;
+    sizes = (byte *) malloc(samples->fragment_length > 0 ? samples->fragment_length : 1);
+    if (sizes == NULL) {
+        return I2ERROR_ISOFF;
+    }
+
+    // senc, the auxiliary information of each sample
+    count+= 4;
+    memcpy(data + count, "senc", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+    count+= put_32(data + count, is_video(media_type) ? 0x2 : 0);
+    count+= put_32(data + count, samples->fragment_length);
+
+    iv = crypto->iv;
+    pos = 0;
+    for (i = 0; i < samples->fragment_length; i++) {
+        info_size = count;
+
+        if (crypto->scheme == CENC_SCHEME_CENC) {
+            count+= put_64(data + count, iv++);
+        }
+
+        if (is_video(media_type)) {
+            subsamples_pos = count;
+            count+= 2;
+            subsamples = 0;
+            walk.pos = walk.clear = walk.protect = 0;
+            while (next_subsample(source_data + pos, samples->mdat[samples->fragment_first + i].size,
+                                  media_type, crypto->scheme, &walk, &clear, &protect)) {
+                count+= put_16(data + count, clear);
+                count+= put_32(data + count, protect);
+                subsamples++;
+            }
+            put_16(data + subsamples_pos, subsamples);
+        }
+
+        // saiz entries are a byte long
+        info_size = count - info_size;
+        if (info_size > 0xFF) {
+            free(sizes);
+            return I2ERROR_ISOFF;
+        }
+        sizes[i] = info_size;
+        info_total+= info_size;
+        pos+= samples->mdat[samples->fragment_first + i].size;
+    }
+
+    // cbcs audio has no auxiliary information but the constant IV of tenc
+    if (info_total == 0) {
+        free(sizes);
+        return is_rotated(crypto) ? write_seig_boxes(data, media_type, seq_number, samples, crypto) : 0;
+    }
+
+    put_32(data, count);
+
+    // saiz, sizes of the senc entries
+    count+= put_32(data + count, 17 + (is_video(media_type) ? samples->fragment_length : 0));
+    memcpy(data + count, "saiz", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+    count+= put_32(data + count, 0);
+    data[count++] = is_video(media_type) ? 0 : sizes[0];
+    count+= put_32(data + count, samples->fragment_length);
+    if (is_video(media_type)) {
+        memcpy(data + count, sizes, samples->fragment_length);
+        count+= samples->fragment_length;
+    }
+    free(sizes);
+
+    // saio, offset of the first senc entry from the moof
+    count+= put_32(data + count, 20);
+    memcpy(data + count, "saio", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+    count+= put_32(data + count, 0);
+    count+= put_32(data + count, 1);
+    count+= put_32(data + count, traf_pos + 16);
+
+    if (is_rotated(crypto)) {
+        count+= write_seig_boxes(data + count, media_type, seq_number, samples, crypto);
+    }
+
+    return count;
+}
+
+static uint8_t encrypt_range(EVP_CIPHER_CTX *cipher, i2ctx_crypto *crypto, byte *data, uint32_t size, byte pattern) {
+    uint32_t blocks, block;
+    int length;
+
+    if (size == 0) {
+        return TRUE;
+    }
+
+    // cenc keystream goes on through the protected ranges of a sample
+    if (crypto->scheme == CENC_SCHEME_CENC) {
+        return EVP_EncryptUpdate(cipher, data, &length, data, size) == 1;
+    }
+
+    // cbcs restarts the chain at each range and leaves its last partial block clear
+    if (EVP_EncryptInit_ex(cipher, NULL, NULL, NULL, crypto->constant_iv) != 1) {
+        return FALSE;
+    }
+
+    blocks = size / AES_BLOCK_SIZE;
+    if (pattern == 0) {
+        return blocks == 0 || EVP_EncryptUpdate(cipher, data, &length, data, blocks * AES_BLOCK_SIZE) == 1;
+    }
+
+    for (block = 0; block + CBCS_CRYPT_BLOCKS <= blocks; block+= CBCS_CRYPT_BLOCKS + CBCS_SKIP_BLOCKS) {
+        if (EVP_EncryptUpdate(cipher, data + block * AES_BLOCK_SIZE, &length, data + block * AES_BLOCK_SIZE,
+                              CBCS_CRYPT_BLOCKS * AES_BLOCK_SIZE) != 1) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+uint8_t cenc_encrypt_fragment(byte *data, uint32_t media_type, uint32_t seq_number, i2ctx_sample *samples, i2ctx_crypto *crypto) {
+    EVP_CIPHER_CTX *cipher;
+    uint32_t i, pos, size, offset, clear, protect;
+    byte iv[AES_BLOCK_SIZE], pattern;
+    cenc_walk walk;
+    uint8_t ok;
+
+    cipher = EVP_CIPHER_CTX_new();
+    ok = cipher != NULL && EVP_EncryptInit_ex(cipher, crypto->scheme == CENC_SCHEME_CBCS ? EVP_aes_128_cbc() : EVP_aes_128_ctr(),
+                                              NULL, get_key(crypto, seq_number)->key, NULL) == 1;
+    if (ok) {
+        EVP_CIPHER_CTX_set_padding(cipher, 0);
+    }
+
+    pattern = get_pattern(media_type, crypto);
+    memset(iv, 0, sizeof(iv));
+    pos = 0;
+
+    for (i = samples->fragment_first; ok && i < samples->fragment_first + samples->fragment_length; i++) {
+        size = samples->mdat[i].size;
+
+        if (crypto->scheme == CENC_SCHEME_CENC) {
+            put_64(iv, crypto->iv++);
+            ok = EVP_EncryptInit_ex(cipher, NULL, NULL, NULL, iv) == 1;
+        }
+
+        if (ok && is_video(media_type)) {
+            offset = 0;
+            walk.pos = walk.clear = walk.protect = 0;
+            while (ok && next_subsample(data + pos, size, media_type, crypto->scheme, &walk, &clear, &protect)) {
+                ok = encrypt_range(cipher, crypto, data + pos + offset + clear, protect, pattern);
+                offset+= clear + protect;
+            }
+        } else if (ok) {
+            ok = encrypt_range(cipher, crypto, data + pos, size, pattern);
+        }
+
+        pos+= size;
+    }
+
+    EVP_CIPHER_CTX_free(cipher);
+    return ok ? I2OK : I2ERROR_ISOFF;
+}
@@ -0,0 +1,73 @@
+/*
+ *  Libi2dash - is an ANSI C DASH library in development of ISO/IEC 23009-1
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of libi2dash.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:		Martin German <martin.german@i2cat.net>
+			Nadim El Taha <nadim.el.taha@i2cat.net>
+
+ */
+
+#ifndef __CENC_LIB__
+#define __CENC_LIB__
+
+#include "i2context.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Common Encryption (ISO/IEC 23001-7) of the fragments. Samples are encrypted with AES-128 through OpenSSL,
+// which uses the AES-NI or ARMv8 crypto instructions when the CPU has them. Video samples use subsample
+// encryption: NAL lengths and headers and the non VCL NALs are left clear, cbcs also leaves the slice headers clear.
+
+#define CENC_IV_SIZE 8              //cenc per sample IV, cbcs uses a constant IV instead
+#define CENC_CLEAR_SUBSAMPLE 0xFFFF //maximum clear bytes of a subsample entry
+#define CBCS_CLEAR_NAL 32           //clear leading bytes of cbcs VCL NALs, they cover the NAL and slice headers
+#define CBCS_CRYPT_BLOCKS 1         //cbcs video pattern, 1 encrypted block every 10
+#define CBCS_SKIP_BLOCKS 9
+#define CENC_FRAGMENT_BOXES 256     //senc, saiz, saio, sbgp and sgpd bytes besides the sample entries
+
+// Sets the keys of a context crypto, kids and keys are keys_length values of CENC_KEY_SIZE bytes
+// pssh_data are complete pssh boxes added to the init segment, it can be NULL
+uint8_t cenc_set_keys(i2ctx_crypto **crypto, uint32_t scheme, byte *kids, byte *keys, uint32_t keys_length,
+                      uint32_t rotation, byte *pssh_data, uint32_t pssh_data_length);
+
+void cenc_free(i2ctx_crypto **crypto);
+
+// Maximum bytes added to the init segment: sinf and pssh boxes
+uint32_t cenc_init_max_size(i2ctx_crypto *crypto);
+
+// Maximum bytes added to the moof of the samples from sample_first to sample_end, source_data is the first one
+uint32_t cenc_fragment_max_size(byte *source_data, uint32_t media_type, i2ctx_sample *samples,
+                                uint32_t sample_first, uint32_t sample_end, i2ctx_crypto *crypto);
+
+// Renames the sample entry written at data to encv or enca and appends its sinf box
+// Returns the new sample entry size
+uint32_t write_sinf(byte *data, uint32_t entry_size, uint32_t media_type, i2ctx_crypto *crypto);
+
+// Writes the common pssh box listing the key ids and the configured pssh boxes
+uint32_t write_pssh(byte *data, i2ctx_crypto *crypto);
+
+// Writes senc, saiz and saio boxes of the fragment samples, and sbgp and sgpd boxes if keys are rotated
+// traf_pos is the position of data relative to the moof, source_data is the first sample of the fragment
+uint32_t write_cenc_boxes(byte *data, uint32_t traf_pos, byte *source_data, uint32_t media_type,
+                          uint32_t seq_number, i2ctx_sample *samples, i2ctx_crypto *crypto);
+
+// Encrypts in place the fragment samples written to an mdat, as write_cenc_boxes describes them
+uint8_t cenc_encrypt_fragment(byte *data, uint32_t media_type, uint32_t seq_number, i2ctx_sample *samples, i2ctx_crypto *crypto);
+
+#endif
@@ -23,6 +23,7 @@
  */
 
 #include "i2libdash.h"
+#include "i2libcenc.h"
 
 // PRIVATE FUNCTIONS DECLARATION
 void audio_context_initializer(i2ctx **context);
@@ -35,6 +36,18 @@ void video_sample_context_initializer(i2ctx_video **ctxVideo);
 
 uint8_t is_key_frame(byte *input_data, uint32_t size_input);
 
+uint32_t fragment_generator(byte *source_data, uint32_t size_source_data, byte *output_data, uint32_t media_type, i2ctx **context);
+
+uint32_t chunk_generator(byte *output_data, uint32_t media_type, i2ctx **context, uint64_t* segmentTimestamp, uint32_t* chunkDuration);
+
+void *grow_buffer(void *buffer, uint32_t *capacity, uint32_t required, uint32_t max_capacity, size_t element_size);
+
+uint8_t reserve_samples(uint32_t samples, i2ctx_sample **ctxSample);
+
+uint32_t check_video_sample(uint8_t is_intra, i2ctx **context);
+
+void register_video_sample(uint32_t sample_length, uint64_t pts, uint64_t dts, uint32_t seqNumber, uint8_t is_intra, i2ctx **context);
+
 void set_segment_duration(uint32_t segment_duration, i2ctx **context)
 {
     (*context)->duration = segment_duration;
@@ -44,11 +57,19 @@ uint32_t get_segment_duration(i2ctx *context){
     return context->duration;
 }
 
+void set_chunk_samples(uint32_t chunk_samples, i2ctx **context)
+{
+    (*context)->chunk_samples = chunk_samples;
+}
+
 void audio_context_initializer(i2ctx **context) {
     (*context)->ctxaudio = (i2ctx_audio *) malloc(sizeof(i2ctx_audio));
     i2ctx_audio *ctxAudio = (*context)->ctxaudio;
 
+    ctxAudio->aac_data = NULL;
     ctxAudio->aac_data_length = 0;
+    ctxAudio->segment_data = (byte *) malloc(INITIAL_DAT);
+    ctxAudio->segment_data_capacity = INITIAL_DAT;
     ctxAudio->segment_data_size = 0;
     ctxAudio->channels = 0;
     ctxAudio->sample_rate = 0;
@@ -66,18 +87,28 @@ void audio_sample_context_initializer(i2ctx_audio **ctxAudio) {
     i2ctx_sample *ctxASample = (*ctxAudio)->ctxsample;
 
     ctxASample->box_flags = 769;
+    ctxASample->mdat = (mdat_sample *) malloc(INITIAL_MDAT_SAMPLE * sizeof(mdat_sample));
+    ctxASample->mdat_capacity = INITIAL_MDAT_SAMPLE;
     ctxASample->mdat_sample_length = 0;
     ctxASample->mdat_total_size = 0;
     ctxASample->moof_pos = 0;
     ctxASample->trun_pos = 0;
+    ctxASample->fragment_first = 0;
+    ctxASample->fragment_length = 0;
+    ctxASample->fragment_offset = 0;
+    ctxASample->fragment_duration = 0;
 }
 
 void video_context_initializer(i2ctx **context, uint32_t media_type) {
     (*context)->ctxvideo = (i2ctx_video *) malloc(sizeof(i2ctx_video));
     i2ctx_video *ctxVideo = (*context)->ctxvideo;
 
+    ctxVideo->pps_sps_data = NULL;
     ctxVideo->pps_sps_data_length = 0;
+    ctxVideo->segment_data = (byte *) malloc(INITIAL_DAT);
+    ctxVideo->segment_data_capacity = INITIAL_DAT;
     ctxVideo->segment_data_size = 0;
+    ctxVideo->pending_data_size = 0;
     ctxVideo->width = 0;
     ctxVideo->height = 0;
     ctxVideo->time_base = 0;
@@ -90,15 +121,22 @@ void video_context_initializer(i2ctx **context, uint32_t media_type) {
 }
 
 void context_refresh(i2ctx **context, uint32_t media_type) {
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         (*context)->ctxvideo->earliest_presentation_time = 0;
         (*context)->ctxvideo->sequence_number = 0;
         (*context)->ctxvideo->current_video_duration = 0;
+        // The frame in progress goes on at the beginning of the next segment
+        memmove((*context)->ctxvideo->segment_data, (*context)->ctxvideo->segment_data + (*context)->ctxvideo->segment_data_size, 
+                (*context)->ctxvideo->pending_data_size);
         (*context)->ctxvideo->segment_data_size = 0;
         (*context)->ctxvideo->ctxsample->mdat_sample_length = 0;
         (*context)->ctxvideo->ctxsample->mdat_total_size = 0;
         (*context)->ctxvideo->ctxsample->moof_pos = 0;
         (*context)->ctxvideo->ctxsample->trun_pos = 0;
+        (*context)->ctxvideo->ctxsample->fragment_first = 0;
+        (*context)->ctxvideo->ctxsample->fragment_length = 0;
+        (*context)->ctxvideo->ctxsample->fragment_offset = 0;
+        (*context)->ctxvideo->ctxsample->fragment_duration = 0;
     }
     if (media_type == AUDIO_TYPE) {
         (*context)->ctxaudio->earliest_presentation_time = 0;
@@ -109,6 +147,10 @@ void context_refresh(i2ctx **context, uint32_t media_type) {
         (*context)->ctxaudio->ctxsample->mdat_total_size = 0;
         (*context)->ctxaudio->ctxsample->moof_pos = 0;
         (*context)->ctxaudio->ctxsample->trun_pos = 0;
+        (*context)->ctxaudio->ctxsample->fragment_first = 0;
+        (*context)->ctxaudio->ctxsample->fragment_length = 0;
+        (*context)->ctxaudio->ctxsample->fragment_offset = 0;
+        (*context)->ctxaudio->ctxsample->fragment_duration = 0;
     }
 }
 
@@ -117,23 +159,31 @@ void video_sample_context_initializer(i2ctx_video **ctxVideo) {
     i2ctx_sample *ctxVSample = (*ctxVideo)->ctxsample;
 
     ctxVSample->box_flags = 3841;
+    ctxVSample->mdat = (mdat_sample *) malloc(INITIAL_MDAT_SAMPLE * sizeof(mdat_sample));
+    ctxVSample->mdat_capacity = INITIAL_MDAT_SAMPLE;
     ctxVSample->mdat_sample_length = 0;
     ctxVSample->mdat_total_size = 0;
     ctxVSample->moof_pos = 0;
     ctxVSample->trun_pos = 0;
+    ctxVSample->fragment_first = 0;
+    ctxVSample->fragment_length = 0;
+    ctxVSample->fragment_offset = 0;
+    ctxVSample->fragment_duration = 0;
 }
 
 uint8_t generate_context(i2ctx **context, uint32_t media_type) 
 {
-    if ((media_type != VIDEO_TYPE_AVC) && (media_type != VIDEO_TYPE_HEVC) && (media_type != AUDIO_TYPE)) {
+    if (!IS_VIDEO_TYPE(media_type) && (media_type != AUDIO_TYPE)) {
         (*context) = NULL;
         return I2ERROR_MEDIA_TYPE;
     }
 
     *context = (i2ctx *) malloc(sizeof(i2ctx));
     (*context)->reference_size = 0;
+    (*context)->chunk_samples = 0;
+    (*context)->ctxcrypto = NULL;
 
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         video_context_initializer(context, media_type);
     } else {
         (*context)->ctxvideo = NULL;
@@ -148,6 +198,167 @@ uint8_t generate_context(i2ctx **context, uint32_t media_type)
     return I2OK;
 }
 
+void free_context(i2ctx **context)
+{
+    if ((*context) == NULL) {
+        return;
+    }
+
+    if ((*context)->ctxvideo != NULL) {
+        free((*context)->ctxvideo->ctxsample->mdat);
+        free((*context)->ctxvideo->ctxsample);
+        free((*context)->ctxvideo->segment_data);
+        free((*context)->ctxvideo->pps_sps_data);
+        free((*context)->ctxvideo);
+    }
+
+    if ((*context)->ctxaudio != NULL) {
+        free((*context)->ctxaudio->ctxsample->mdat);
+        free((*context)->ctxaudio->ctxsample);
+        free((*context)->ctxaudio->segment_data);
+        free((*context)->ctxaudio->aac_data);
+        free((*context)->ctxaudio);
+    }
+
+    cenc_free(&((*context)->ctxcrypto));
+    free(*context);
+    (*context) = NULL;
+}
+
+void *grow_buffer(void *buffer, uint32_t *capacity, uint32_t required, uint32_t max_capacity, size_t element_size)
+{
+    uint32_t new_capacity;
+    void *new_buffer;
+
+    if (required <= (*capacity)) {
+        return buffer;
+    }
+
+    if (required > max_capacity) {
+        return NULL;
+    }
+
+    // Capacity is doubled, so appending samples one by one costs amortized constant time
+    new_capacity = (*capacity) > 0 ? (*capacity) : 1;
+
+    while (new_capacity < required) {
+        new_capacity = new_capacity > max_capacity / 2 ? max_capacity : new_capacity * 2;
+    }
+
+    new_buffer = realloc(buffer, (size_t) new_capacity * element_size);
+
+    if (new_buffer == NULL) {
+        return NULL;
+    }
+
+    (*capacity) = new_capacity;
+    return new_buffer;
+}
+
+uint8_t reserve_samples(uint32_t samples, i2ctx_sample **ctxSample)
+{
+    mdat_sample *mdat;
+
+    mdat = (mdat_sample *) grow_buffer((*ctxSample)->mdat, &(*ctxSample)->mdat_capacity, samples, MAX_MDAT_SAMPLE, sizeof(mdat_sample));
+
+    if (mdat == NULL) {
+        return I2ERROR_MEMORY;
+    }
+
+    (*ctxSample)->mdat = mdat;
+    return I2OK;
+}
+
+uint8_t reserve_segment_data(uint32_t size, i2ctx **context)
+{
+    byte *data;
+
+    if ((*context) == NULL) {
+        return I2ERROR_CONTEXT_NULL;
+    }
+
+    if ((*context)->ctxvideo != NULL) {
+        data = (byte *) grow_buffer((*context)->ctxvideo->segment_data, &(*context)->ctxvideo->segment_data_capacity, size, MAX_DAT, sizeof(byte));
+
+        if (data == NULL) {
+            return I2ERROR_MEMORY;
+        }
+
+        (*context)->ctxvideo->segment_data = data;
+    }
+
+    if ((*context)->ctxaudio != NULL) {
+        data = (byte *) grow_buffer((*context)->ctxaudio->segment_data, &(*context)->ctxaudio->segment_data_capacity, size, MAX_DAT, sizeof(byte));
+
+        if (data == NULL) {
+            return I2ERROR_MEMORY;
+        }
+
+        (*context)->ctxaudio->segment_data = data;
+    }
+
+    return I2OK;
+}
+
+uint32_t get_fragment_max_size(i2ctx *context)
+{
+    i2ctx_sample *ctxSample;
+    uint32_t dataSize, mediaType;
+    byte *segmentData;
+
+    if (context == NULL) {
+        return 0;
+    }
+
+    if (context->ctxvideo != NULL) {
+        ctxSample = context->ctxvideo->ctxsample;
+        dataSize = context->ctxvideo->segment_data_size;
+        segmentData = context->ctxvideo->segment_data;
+        mediaType = context->ctxvideo->video_type;
+    } else if (context->ctxaudio != NULL) {
+        ctxSample = context->ctxaudio->ctxsample;
+        dataSize = context->ctxaudio->segment_data_size;
+        segmentData = context->ctxaudio->segment_data;
+        mediaType = AUDIO_TYPE;
+    } else {
+        return 0;
+    }
+
+    return dataSize - ctxSample->fragment_offset + 
+           (ctxSample->mdat_sample_length - ctxSample->fragment_first) * MAX_TRUN_SAMPLE_SIZE + MAX_FRAGMENT_HEADER +
+           cenc_fragment_max_size(segmentData + ctxSample->fragment_offset, mediaType, ctxSample,
+                                  ctxSample->fragment_first, ctxSample->mdat_sample_length, context->ctxcrypto);
+}
+
+uint8_t set_encryption(uint32_t scheme, byte *kids, byte *keys, uint32_t keys_length, uint32_t rotation,
+                       byte *pssh_data, uint32_t pssh_data_length, i2ctx **context)
+{
+    if ((*context) == NULL) {
+        return I2ERROR_CONTEXT_NULL;
+    }
+
+    if (scheme == CENC_SCHEME_NONE) {
+        cenc_free(&((*context)->ctxcrypto));
+        return I2OK;
+    }
+
+    // AV1 subsamples are protected per OBU, which is not implemented
+    if ((*context)->ctxvideo != NULL && (*context)->ctxvideo->video_type == VIDEO_TYPE_AV1) {
+        return I2ERROR_MEDIA_TYPE;
+    }
+
+    return cenc_set_keys(&((*context)->ctxcrypto), scheme, kids, keys, keys_length, rotation, pssh_data, pssh_data_length);
+}
+
+uint32_t get_init_encryption_size(i2ctx *context)
+{
+    if (context == NULL) {
+        return 0;
+    }
+
+    return cenc_init_max_size(context->ctxcrypto);
+}
+
 uint8_t fill_video_context(i2ctx **context, uint32_t width, uint32_t height, uint32_t t_base) 
 {
     if ((*context) == NULL) {
@@ -317,7 +528,7 @@ uint32_t generate_video_segment(uint8_t nextFrameIsIntra, uint32_t nextFramePts,
         return I2ERROR_IS_INTRA;
     }
 
-    if (((*context)->ctxvideo->video_type != VIDEO_TYPE_AVC) && ((*context)->ctxvideo->video_type != VIDEO_TYPE_HEVC)) {
+    if (!IS_VIDEO_TYPE((*context)->ctxvideo->video_type)) {
         return I2ERROR_MEDIA_TYPE;
     }
         
@@ -333,9 +544,9 @@ uint32_t generate_video_segment(uint8_t nextFrameIsIntra, uint32_t nextFramePts,
         (*context)->ctxvideo->ctxsample->mdat[sampleIdx].duration = lastSampleDuration;
         (*context)->ctxvideo->current_video_duration += lastSampleDuration;
 
-        segDataLength = segmentGenerator((*context)->ctxvideo->segment_data, 
-                                         (*context)->ctxvideo->segment_data_size, output_data, 
-                                         (*context)->ctxvideo->video_type, context);
+        segDataLength = fragment_generator((*context)->ctxvideo->segment_data, 
+                                           (*context)->ctxvideo->segment_data_size, output_data, 
+                                           (*context)->ctxvideo->video_type, context);
 
         if (segDataLength <= I2ERROR_MAX) {
             return segDataLength;
@@ -365,7 +576,7 @@ uint32_t generate_audio_segment(byte *output_data, i2ctx **context, uint64_t* se
 
     if ((*context)->duration <= (*context)->ctxaudio->current_audio_duration) { 
 
-        segDataLength = segmentGenerator((*context)->ctxaudio->segment_data, (*context)->ctxaudio->segment_data_size, output_data, AUDIO_TYPE, context);
+        segDataLength = fragment_generator((*context)->ctxaudio->segment_data, (*context)->ctxaudio->segment_data_size, output_data, AUDIO_TYPE, context);
 
         if (segDataLength <= I2ERROR_MAX) {
             return segDataLength;
@@ -393,7 +604,7 @@ uint32_t force_generate_audio_segment(byte *output_data, i2ctx **context, uint64
         return I2ERROR_DESTINATION_NULL;
     }
 
-    segDataLength = segmentGenerator((*context)->ctxaudio->segment_data, (*context)->ctxaudio->segment_data_size, output_data, AUDIO_TYPE, context);
+    segDataLength = fragment_generator((*context)->ctxaudio->segment_data, (*context)->ctxaudio->segment_data_size, output_data, AUDIO_TYPE, context);
 
     if (segDataLength <= I2ERROR_MAX) {
         return segDataLength;
@@ -406,11 +617,97 @@ uint32_t force_generate_audio_segment(byte *output_data, i2ctx **context, uint64
     return segDataLength;
 }
 
+uint32_t generate_video_chunk(byte *output_data, i2ctx **context, uint64_t* segmentTimestamp, uint32_t* chunkDuration)
+{
+    if ((*context) == NULL) {
+        return I2ERROR_CONTEXT_NULL;
+    }
+
+    if ((*context)->ctxvideo == NULL) {
+        return I2ERROR_MEDIA_TYPE;
+    }
+
+    return chunk_generator(output_data, (*context)->ctxvideo->video_type, context, segmentTimestamp, chunkDuration);
+}
+
+uint32_t generate_audio_chunk(byte *output_data, i2ctx **context, uint64_t* segmentTimestamp, uint32_t* chunkDuration)
+{
+    if ((*context) == NULL) {
+        return I2ERROR_CONTEXT_NULL;
+    }
+
+    if ((*context)->ctxaudio == NULL) {
+        return I2ERROR_MEDIA_TYPE;
+    }
+
+    return chunk_generator(output_data, AUDIO_TYPE, context, segmentTimestamp, chunkDuration);
+}
+
+uint32_t chunk_generator(byte *output_data, uint32_t media_type, i2ctx **context, uint64_t* segmentTimestamp, uint32_t* chunkDuration)
+{
+    uint32_t chunkDataLength;
+    uint32_t previousDuration;
+    i2ctx_sample *ctxSample;
+    uint64_t earliestPresentationTime;
+    byte *segmentData;
+
+    if (output_data == NULL) {
+        return I2ERROR_DESTINATION_NULL;
+    }
+
+    if (media_type == AUDIO_TYPE) {
+        ctxSample = (*context)->ctxaudio->ctxsample;
+        segmentData = (*context)->ctxaudio->segment_data;
+        earliestPresentationTime = (*context)->ctxaudio->earliest_presentation_time;
+    } else {
+        ctxSample = (*context)->ctxvideo->ctxsample;
+        segmentData = (*context)->ctxvideo->segment_data;
+        earliestPresentationTime = (*context)->ctxvideo->earliest_presentation_time;
+    }
+
+    // The last sample is kept: its video duration is not known yet and the segment must be closed with it
+    if ((*context)->chunk_samples == 0 || 
+        ctxSample->mdat_sample_length < ctxSample->fragment_first + (*context)->chunk_samples + 1) {
+        return I2OK;
+    }
+
+    // Audio segments are about to be closed, the remaining samples go to the last chunk
+    if (media_type == AUDIO_TYPE && (*context)->duration <= (*context)->ctxaudio->current_audio_duration) {
+        return I2OK;
+    }
+
+    previousDuration = ctxSample->fragment_duration;
+    chunkDataLength = chunkGenerator(segmentData, output_data, media_type, ctxSample->mdat_sample_length - 1, context);
+
+    if (chunkDataLength <= I2ERROR_MAX) {
+        return chunkDataLength;
+    }
+
+    *segmentTimestamp = earliestPresentationTime;
+    *chunkDuration = ctxSample->fragment_duration - previousDuration;
+
+    return chunkDataLength;
+}
+
+uint32_t fragment_generator(byte *source_data, uint32_t size_source_data, byte *output_data, uint32_t media_type, i2ctx **context)
+{
+    i2ctx_sample *ctxSample;
+
+    if ((*context)->chunk_samples == 0) {
+        return segmentGenerator(source_data, size_source_data, output_data, media_type, context);
+    }
+
+    ctxSample = media_type == AUDIO_TYPE ? (*context)->ctxaudio->ctxsample : (*context)->ctxvideo->ctxsample;
+
+    // Chunked segments are closed with the samples not sent yet
+    return chunkGenerator(source_data, output_data, media_type, ctxSample->mdat_sample_length, context);
+}
+
 uint32_t add_video_sample(byte *input_data, uint32_t input_data_length, uint64_t pts, 
                            uint64_t dts, uint32_t seqNumber, uint8_t is_intra, i2ctx **context)
 {
-    uint32_t samp_len;
-    uint32_t sample_duration;
+    i2ctx_video *ctxVideo;
+    uint32_t error;
 
     if ((*context) == NULL) {
         return I2ERROR_CONTEXT_NULL;
@@ -424,24 +721,183 @@ uint32_t add_video_sample(byte *input_data, uint32_t input_data_length, uint64_t
         return I2ERROR_SIZE_ZERO;
     }
 
-    if ((is_intra != TRUE) && (is_intra != FALSE)) {
-        return I2ERROR_IS_INTRA;
+    ctxVideo = (*context)->ctxvideo;
+
+    error = check_video_sample(is_intra, context);
+
+    if (error != I2OK) {
+        return error;
+    }
+
+    if (input_data_length > MAX_DAT - ctxVideo->segment_data_size - ctxVideo->pending_data_size) {
+        return I2ERROR_MEMORY;
+    }
+
+    if (reserve_segment_data(ctxVideo->segment_data_size + ctxVideo->pending_data_size + input_data_length, context) != I2OK) {
+        return I2ERROR_MEMORY;
     }
 
+    // Add segment data, before the pending one
+    memmove(ctxVideo->segment_data + ctxVideo->segment_data_size + input_data_length, 
+            ctxVideo->segment_data + ctxVideo->segment_data_size, ctxVideo->pending_data_size);
+    memcpy(ctxVideo->segment_data + ctxVideo->segment_data_size, input_data, input_data_length);
+    ctxVideo->pending_data_size += input_data_length;
+
+    register_video_sample(input_data_length, pts, dts, seqNumber, is_intra, context);
+    return I2OK;
+}
 
+uint32_t append_video_nal(byte *nal_data, uint32_t nal_data_length, i2ctx **context)
+{
+    i2ctx_video *ctxVideo;
+    byte *data;
+
+    if ((*context) == NULL || (*context)->ctxvideo == NULL) {
+        return I2ERROR_CONTEXT_NULL;
+    }
+
+    if (nal_data == NULL) {
+        return I2ERROR_SOURCE_NULL;
+    }
+
+    if (nal_data_length < 1) {
+        return I2ERROR_SIZE_ZERO;
+    }
+
+    ctxVideo = (*context)->ctxvideo;
+
+    if (nal_data_length + 4 > MAX_DAT - ctxVideo->segment_data_size - ctxVideo->pending_data_size) {
+        return I2ERROR_MEMORY;
+    }
+
+    if (reserve_segment_data(ctxVideo->segment_data_size + ctxVideo->pending_data_size + nal_data_length + 4, context) != I2OK) {
+        return I2ERROR_MEMORY;
+    }
+
+    data = ctxVideo->segment_data + ctxVideo->segment_data_size + ctxVideo->pending_data_size;
+    data[0] = (nal_data_length >> 24) & 0xFF;
+    data[1] = (nal_data_length >> 16) & 0xFF;
+    data[2] = (nal_data_length >> 8) & 0xFF;
+    data[3] = nal_data_length & 0xFF;
+    memcpy(data + 4, nal_data, nal_data_length);
+    ctxVideo->pending_data_size += nal_data_length + 4;
+
+    return I2OK;
+}
+
+uint32_t append_video_data(byte *input_data, uint32_t input_data_length, i2ctx **context)
+{
+    i2ctx_video *ctxVideo;
+
+    if ((*context) == NULL || (*context)->ctxvideo == NULL) {
+        return I2ERROR_CONTEXT_NULL;
+    }
+
+    if (input_data == NULL) {
+        return I2ERROR_SOURCE_NULL;
+    }
+
+    if (input_data_length < 1) {
+        return I2ERROR_SIZE_ZERO;
+    }
+
+    ctxVideo = (*context)->ctxvideo;
+
+    if (input_data_length > MAX_DAT - ctxVideo->segment_data_size - ctxVideo->pending_data_size) {
+        return I2ERROR_MEMORY;
+    }
+
+    if (reserve_segment_data(ctxVideo->segment_data_size + ctxVideo->pending_data_size + input_data_length, context) != I2OK) {
+        return I2ERROR_MEMORY;
+    }
+
+    memcpy(ctxVideo->segment_data + ctxVideo->segment_data_size + ctxVideo->pending_data_size, input_data, input_data_length);
+    ctxVideo->pending_data_size += input_data_length;
+
+    return I2OK;
+}
+
+uint32_t discard_pending_video_data(uint32_t length, i2ctx **context)
+{
+    i2ctx_video *ctxVideo;
+
+    if ((*context) == NULL || (*context)->ctxvideo == NULL) {
+        return I2ERROR_CONTEXT_NULL;
+    }
+
+    ctxVideo = (*context)->ctxvideo;
+
+    if (length > ctxVideo->pending_data_size) {
+        return I2ERROR_SIZE_ZERO;
+    }
+
+    memmove(ctxVideo->segment_data + ctxVideo->segment_data_size, 
+            ctxVideo->segment_data + ctxVideo->segment_data_size + length, ctxVideo->pending_data_size - length);
+    ctxVideo->pending_data_size -= length;
+
+    return I2OK;
+}
+
+uint32_t add_pending_video_sample(uint32_t sample_length, uint64_t pts, 
+                                  uint64_t dts, uint32_t seqNumber, uint8_t is_intra, i2ctx **context)
+{
+    uint32_t error;
+
+    if ((*context) == NULL || (*context)->ctxvideo == NULL) {
+        return I2ERROR_CONTEXT_NULL;
+    }
+
+    if (sample_length < 1) {
+        return I2ERROR_SIZE_ZERO;
+    }
+
+    if (sample_length > (*context)->ctxvideo->pending_data_size) {
+        return I2ERROR_SOURCE_NULL;
+    }
+
+    error = check_video_sample(is_intra, context);
+
+    if (error != I2OK) {
+        return error;
+    }
+
+    register_video_sample(sample_length, pts, dts, seqNumber, is_intra, context);
+    return I2OK;
+}
+
+// Validates a new sample and makes room for its metadata
+uint32_t check_video_sample(uint8_t is_intra, i2ctx **context)
+{
     i2ctx_sample *ctxSample = (*context)->ctxvideo->ctxsample;
+
+    if ((is_intra != TRUE) && (is_intra != FALSE)) {
+        return I2ERROR_IS_INTRA;
+    }
     
     if (ctxSample->mdat_sample_length == 0 && is_intra != TRUE) {
         return I2ERROR_IS_INTRA;
     }
 
-    // Add segment data
-    memcpy((*context)->ctxvideo->segment_data + (*context)->ctxvideo->segment_data_size, input_data, input_data_length);
-    (*context)->ctxvideo->segment_data_size += input_data_length;
+    if (reserve_samples(ctxSample->mdat_sample_length + 1, &(*context)->ctxvideo->ctxsample) != I2OK) {
+        return I2ERROR_MEMORY;
+    }
+
+    return I2OK;
+}
+
+void register_video_sample(uint32_t sample_length, uint64_t pts, uint64_t dts, uint32_t seqNumber, uint8_t is_intra, i2ctx **context)
+{
+    uint32_t samp_len;
+    uint32_t sample_duration;
+    i2ctx_sample *ctxSample = (*context)->ctxvideo->ctxsample;
+
+    // The sample data is already in place, it stops being pending
+    (*context)->ctxvideo->segment_data_size += sample_length;
+    (*context)->ctxvideo->pending_data_size -= sample_length;
 
     // Add metadata
     samp_len = ctxSample->mdat_sample_length;
-    ctxSample->mdat[samp_len].size = input_data_length;
+    ctxSample->mdat[samp_len].size = sample_length;
     ctxSample->mdat[samp_len].presentation_timestamp = pts;
     ctxSample->mdat[samp_len].decode_timestamp = dts;
     ctxSample->mdat[samp_len].key = is_intra;
@@ -457,8 +913,6 @@ uint32_t add_video_sample(byte *input_data, uint32_t input_data_length, uint64_t
     }
 
     ctxSample->mdat_sample_length++;
-
-    return I2OK;
 }
 
 uint32_t add_audio_sample(byte *input_data, uint32_t input_data_length, uint32_t sample_duration, 
@@ -481,6 +935,18 @@ uint32_t add_audio_sample(byte *input_data, uint32_t input_data_length, uint32_t
 
     // Add sample or Init new segmentation
     i2ctx_sample *ctxSample = (*context)->ctxaudio->ctxsample;
+
+    if (input_data_length > MAX_DAT - (*context)->ctxaudio->segment_data_size) {
+        return I2ERROR_MEMORY;
+    }
+
+    if (reserve_segment_data((*context)->ctxaudio->segment_data_size + input_data_length, context) != I2OK) {
+        return I2ERROR_MEMORY;
+    }
+
+    if (reserve_samples(ctxSample->mdat_sample_length + 1, &ctxSample) != I2OK) {
+        return I2ERROR_MEMORY;
+    }
     
     // Add segment data
     memcpy((*context)->ctxaudio->segment_data + (*context)->ctxaudio->segment_data_size, input_data, input_data_length);
@@ -515,20 +981,20 @@ uint32_t finish_segment(uint32_t media_type, byte *output_data, i2ctx **context)
     if (output_data == NULL) {
         return I2ERROR_DESTINATION_NULL;
     }
-    if ((media_type != VIDEO_TYPE_AVC) && (media_type != VIDEO_TYPE_HEVC) && (media_type != AUDIO_TYPE)) {
+    if (!IS_VIDEO_TYPE(media_type) && (media_type != AUDIO_TYPE)) {
         return I2ERROR_MEDIA_TYPE;
     }
     
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         seg_gen = I2OK;
         
-        seg_gen = segmentGenerator((*context)->ctxvideo->segment_data, (*context)->ctxvideo->segment_data_size, output_data, media_type, context);
+        seg_gen = fragment_generator((*context)->ctxvideo->segment_data, (*context)->ctxvideo->segment_data_size, output_data, media_type, context);
         if ((seg_gen == I2OK) || (seg_gen > I2ERROR_MAX))
             context_refresh(context, media_type);
     } else if(media_type == AUDIO_TYPE) {
         seg_gen = I2OK;
         
-        seg_gen = segmentGenerator((*context)->ctxaudio->segment_data, (*context)->ctxaudio->segment_data_size, output_data, AUDIO_TYPE, context);
+        seg_gen = fragment_generator((*context)->ctxaudio->segment_data, (*context)->ctxaudio->segment_data_size, output_data, AUDIO_TYPE, context);
         if ((seg_gen == I2OK) || (seg_gen > I2ERROR_MAX))
             context_refresh(context, AUDIO_TYPE);
     }
@@ -35,6 +35,20 @@
 
 uint8_t generate_context(i2ctx **context, uint32_t media_type); 
 
+void free_context(i2ctx **context);
+
+uint8_t reserve_segment_data(uint32_t size, i2ctx **context);
+
+uint32_t get_fragment_max_size(i2ctx *context);
+
+// Encrypts the segments with Common Encryption, kids and keys are keys_length values of CENC_KEY_SIZE bytes.
+// Keys are rotated every rotation segments, pssh_data are pssh boxes added to the init segment. CENC_SCHEME_NONE disables it
+uint8_t set_encryption(uint32_t scheme, byte *kids, byte *keys, uint32_t keys_length, uint32_t rotation,
+                       byte *pssh_data, uint32_t pssh_data_length, i2ctx **context);
+
+// Bytes the encryption adds to the init segment
+uint32_t get_init_encryption_size(i2ctx *context);
+
 uint8_t fill_video_context(i2ctx **context, uint32_t width, uint32_t height, uint32_t t_base);
 
 uint8_t fill_audio_context(i2ctx **context, uint32_t channels, uint32_t sample_rate, uint32_t sample_size, uint32_t t_base, uint32_t sample_duration); 
@@ -55,6 +69,8 @@ void set_segment_duration(uint32_t segment_duration, i2ctx **context);
 
 uint32_t get_segment_duration(i2ctx *context);
 
+void set_chunk_samples(uint32_t chunk_samples, i2ctx **context);
+
 void set_sample_rate(uint32_t sample_rate, i2ctx **context);
 
 uint32_t get_sample_rate(i2ctx *context);
@@ -66,9 +82,26 @@ uint32_t generate_audio_segment(byte *output_data, i2ctx **context, uint64_t* se
 
 uint32_t force_generate_audio_segment(byte *output_data, i2ctx **context, uint64_t* segmentTimestamp, uint32_t* segmentDuration);
 
+uint32_t generate_video_chunk(byte *output_data, i2ctx **context, uint64_t* segmentTimestamp, uint32_t* chunkDuration);
+
+uint32_t generate_audio_chunk(byte *output_data, i2ctx **context, uint64_t* segmentTimestamp, uint32_t* chunkDuration);
+
 uint32_t add_video_sample(byte *input_data, uint32_t input_data_length, uint64_t pts, 
                            uint64_t dts, uint32_t seqNumber, uint8_t is_intra, i2ctx **context);
 
+// Writes a NAL with its 4 bytes length prefix after the segment data, it is added as part of a sample by add_pending_video_sample
+uint32_t append_video_nal(byte *nal_data, uint32_t nal_data_length, i2ctx **context);
+
+// Writes data as it is after the segment data, e.g. AV1 OBUs which carry their own size field
+uint32_t append_video_data(byte *input_data, uint32_t input_data_length, i2ctx **context);
+
+// Adds the first sample_length pending bytes as a sample, without copying them
+uint32_t add_pending_video_sample(uint32_t sample_length, uint64_t pts, 
+                                  uint64_t dts, uint32_t seqNumber, uint8_t is_intra, i2ctx **context);
+
+// Drops the first length pending bytes, e.g. of a frame that is not added
+uint32_t discard_pending_video_data(uint32_t length, i2ctx **context);
+
 uint32_t add_audio_sample(byte *input_data, uint32_t input_data_length, uint32_t sample_duration, 
                           uint64_t pts, uint64_t dts, uint32_t seqNumber, i2ctx **context);
 
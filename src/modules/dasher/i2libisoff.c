@@ -23,6 +23,7 @@
  */
 
 #include "i2libisoff.h"
+#include "i2libcenc.h"
 
 #define INIT_TIMESCALE 1000 //ms
 #define BOX_TYPE_SIZE 4
@@ -79,6 +80,9 @@ uint32_t write_avc1(byte *data, i2ctx_video *ctxVideo);
 // only video
 uint32_t write_hev1(byte *data, i2ctx_video *ctxVideo);
 
+// only video
+uint32_t write_av01(byte *data, i2ctx_video *ctxVideo);
+
 // only video
 uint32_t write_avc3(byte *data, i2ctx_video *ctxVideo);
 
@@ -88,6 +92,9 @@ uint32_t write_avcc(byte *data, i2ctx_video *ctxVideo);
 // only video
 uint32_t write_hvcc(byte *data, i2ctx_video *ctxVideo);
 
+// only video
+uint32_t write_av1c(byte *data, i2ctx_video *ctxVideo);
+
 // only audio
 uint32_t write_mp4a(byte *data, i2ctx_audio *ctxAudio);
 
@@ -111,12 +118,12 @@ uint32_t write_styp(byte *data, uint32_t media_type, i2ctx *context);
 
 uint32_t write_sidx(byte *data, uint32_t media_type, i2ctx *context);
 
-uint32_t write_moof(byte *data, uint32_t media_type, i2ctx **context);
+uint32_t write_moof(byte *data, byte *fragment_data, uint32_t media_type, i2ctx **context);
 
 // mfhd for audio and video files is the same
 uint32_t write_mfhd(byte *data, uint32_t media_type, i2ctx *context);
 
-uint32_t write_traf(byte *data, uint32_t media_type, i2ctx **context);
+uint32_t write_traf(byte *data, byte *fragment_data, uint32_t media_type, i2ctx **context);
 
 // tfhd for audio and video files is the same
 uint32_t write_tfhd(byte *data, uint32_t media_type, i2ctx *context);
@@ -147,10 +154,11 @@ uint32_t initVideoGenerator(byte *source_data, uint32_t size_source_data, byte *
     if (size_source_data < 1) {
         return I2ERROR_SIZE_ZERO;
     }
-    if (((*context)->ctxvideo->video_type != VIDEO_TYPE_AVC) && ((*context)->ctxvideo->video_type != VIDEO_TYPE_HEVC)) {
+    if (!IS_VIDEO_TYPE((*context)->ctxvideo->video_type)) {
         return I2ERROR_MEDIA_TYPE;
     }
     count = 0;
+    free((*context)->ctxvideo->pps_sps_data);
     (*context)->ctxvideo->pps_sps_data = (byte*) malloc (size_source_data);
     memcpy((*context)->ctxvideo->pps_sps_data, source_data, size_source_data);
     (*context)->ctxvideo->pps_sps_data_length = size_source_data;
@@ -187,6 +195,7 @@ uint32_t initAudioGenerator(byte *source_data, uint32_t size_source_data, byte *
     }
 
     count = 0;
+    free((*context)->ctxaudio->aac_data);
     (*context)->ctxaudio->aac_data = (byte*) malloc(size_source_data);
     memcpy((*context)->ctxaudio->aac_data, source_data, size_source_data);
     (*context)->ctxaudio->aac_data_length = size_source_data;
@@ -221,10 +230,19 @@ uint32_t segmentGenerator(byte *source_data, uint32_t size_source_data, byte *de
         return I2ERROR_SIZE_ZERO;
     }
 
-    if ((media_type != AUDIO_TYPE) && (media_type != VIDEO_TYPE_AVC) && (media_type != VIDEO_TYPE_HEVC)) {
+    if ((media_type != AUDIO_TYPE) && !IS_VIDEO_TYPE(media_type)) {
         return I2ERROR_MEDIA_TYPE;
     }
     
+    if (IS_VIDEO_TYPE(media_type)) {
+        (*context)->ctxvideo->ctxsample->fragment_first = 0;
+        (*context)->ctxvideo->ctxsample->fragment_length = (*context)->ctxvideo->ctxsample->mdat_sample_length;
+    }
+    if (media_type == AUDIO_TYPE) {
+        (*context)->ctxaudio->ctxsample->fragment_first = 0;
+        (*context)->ctxaudio->ctxsample->fragment_length = (*context)->ctxaudio->ctxsample->mdat_sample_length;
+    }
+
     count = 0;
     size_styp = write_styp(destination_data + count, media_type, (*context));
     
@@ -234,7 +252,7 @@ uint32_t segmentGenerator(byte *source_data, uint32_t size_source_data, byte *de
     count+= size_styp;
     
     size_sidx = write_sidx(destination_data + count, media_type, (*context));
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         (*context)->ctxvideo->ctxsample->trun_pos+= count + size_sidx;
         (*context)->ctxvideo->ctxsample->moof_pos+= count + size_sidx;
     }
@@ -243,7 +261,7 @@ uint32_t segmentGenerator(byte *source_data, uint32_t size_source_data, byte *de
         (*context)->ctxaudio->ctxsample->moof_pos+= count + size_sidx;
     }
     
-    size_moof = write_moof(destination_data + count + size_sidx, media_type, context);
+    size_moof = write_moof(destination_data + count + size_sidx, source_data, media_type, context);
     if (size_moof < 8)
         return I2ERROR_ISOFF;
 
@@ -263,6 +281,71 @@ uint32_t segmentGenerator(byte *source_data, uint32_t size_source_data, byte *de
     return count;
 }
 
+uint32_t chunkGenerator(byte *source_data, byte *destination_data, uint32_t media_type, uint32_t sample_end, i2ctx **context) {
+    uint32_t count, size_styp, size_moof, size_mdat, size_chunk, i;
+    i2ctx_sample *samples;
+
+    if ((*context) == NULL) {
+        return I2ERROR_CONTEXT_NULL;
+    }
+    if (destination_data == NULL) {
+        return I2ERROR_DESTINATION_NULL;
+    }
+    if (source_data == NULL) {
+        return I2ERROR_SOURCE_NULL;
+    }
+
+    if (IS_VIDEO_TYPE(media_type)) {
+        samples = (*context)->ctxvideo->ctxsample;
+    } else if (media_type == AUDIO_TYPE) {
+        samples = (*context)->ctxaudio->ctxsample;
+    } else {
+        return I2ERROR_MEDIA_TYPE;
+    }
+
+    if (sample_end <= samples->fragment_first || sample_end > samples->mdat_sample_length) {
+        return I2ERROR_SIZE_ZERO;
+    }
+
+    size_chunk = 0;
+    for (i = samples->fragment_first; i < sample_end; i++) {
+        size_chunk+= samples->mdat[i].size;
+    }
+
+    count = 0;
+
+    // The first chunk starts the segment, sidx is not written as the segment size is not known yet
+    if (samples->fragment_first == 0) {
+        size_styp = write_styp(destination_data + count, media_type, (*context));
+        if (size_styp < 8)
+            return I2ERROR_ISOFF;
+        count+= size_styp;
+    }
+
+    samples->fragment_length = sample_end - samples->fragment_first;
+    samples->moof_pos = 0;
+    samples->trun_pos = 0;
+
+    size_moof = write_moof(destination_data + count, source_data + samples->fragment_offset, media_type, context);
+    if (size_moof < 8)
+        return I2ERROR_ISOFF;
+    count+= size_moof;
+
+    size_mdat = write_mdat(source_data + samples->fragment_offset, size_chunk, destination_data + count, media_type, (*context));
+    if (size_mdat < 8)
+        return I2ERROR_ISOFF;
+    count+= size_mdat;
+
+    for (i = samples->fragment_first; i < sample_end; i++) {
+        samples->fragment_duration+= samples->mdat[i].duration;
+    }
+
+    samples->fragment_offset+= size_chunk;
+    samples->fragment_first = sample_end;
+
+    return count;
+}
+
 uint32_t write_ftyp(byte *data, uint32_t media_type, i2ctx *context) {
     uint32_t count, size, hton_size, version, hton_version;
     
@@ -322,6 +405,11 @@ uint32_t write_moov(byte *data, uint32_t media_type, i2ctx *context) {
 
     count+= size_trak;
 
+    // Common Encryption key ids and DRM systems
+    if (context->ctxcrypto != NULL) {
+        count+= write_pssh(data + count, context->ctxcrypto);
+    }
+
     // Box size
     size = count;
     hton_size = htonl(size);
@@ -440,7 +528,7 @@ uint32_t write_mvex(byte *data, uint32_t media_type, i2ctx *context) {
 uint32_t write_trex(byte *data, uint32_t media_type, i2ctx *context) {
     uint32_t count, size, hton_size, flag32, hton_flag32, sample_duration;
 
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         sample_duration = context->ctxvideo->sample_duration;
     } else if (media_type == AUDIO_TYPE) {
         sample_duration = context->ctxaudio->sample_duration;
@@ -583,7 +671,7 @@ uint32_t write_tkhd(byte *data, uint32_t media_type, i2ctx *context) {
     count+= 4;
 
     // Reserved
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC))
+    if (IS_VIDEO_TYPE(media_type))
         flag16 = 0;
     else
         flag16 = 0x0100;
@@ -599,7 +687,7 @@ uint32_t write_tkhd(byte *data, uint32_t media_type, i2ctx *context) {
     size_matrix = write_matrix(data + count, 1, 0, 0, 1, 0, 0);
     count+= size_matrix;
 
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         flag32 = 0;
         flag32 = context->ctxvideo->width << 16;
         hton_flag32 = htonl(flag32);
@@ -664,7 +752,7 @@ uint32_t write_mdhd(byte *data, uint32_t media_type, i2ctx *context) {
     if (media_type == NO_TYPE)
         return I2ERROR_ISOFF;
 
-     if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+     if (IS_VIDEO_TYPE(media_type)) {
         time_scale = context->ctxvideo->time_base;
     } else if (media_type == AUDIO_TYPE) {
         time_scale = context->ctxaudio->time_base;
@@ -741,7 +829,7 @@ uint32_t write_hdlr(byte *data, uint32_t media_type, i2ctx *context) {
     memcpy(data + count, &flag32, 4);
     count+= 4;
 
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         memcpy(data + count, "vide", BOX_TYPE_SIZE);
         count+= 4;
     } else {
@@ -758,7 +846,7 @@ uint32_t write_hdlr(byte *data, uint32_t media_type, i2ctx *context) {
     memcpy(data + count, &flag32, 4);
     count+= 4;
 
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         // Video handler string, NULL-terminated
         memcpy(data + count, "VideoHandler", sizeof("VideoHandler"));
         count+= sizeof("VideoHandler");
@@ -783,7 +871,7 @@ uint32_t write_minf(byte *data, uint32_t media_type, i2ctx *context) {
     // Box type
     memcpy(data + count, "minf", BOX_TYPE_SIZE);
     count+= BOX_TYPE_SIZE;
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         size_vmhd = write_vmhd(data + count);
         if (size_vmhd < 8)
             return I2ERROR_ISOFF;
@@ -1013,10 +1101,20 @@ uint32_t write_stsd(byte *data, uint32_t media_type, i2ctx *context) {
         size_vc = write_avc1(data + count, ctxvideo);
         if (size_vc < 8)
             return I2ERROR_ISOFF;
+        if (context->ctxcrypto != NULL)
+            size_vc = write_sinf(data + count, size_vc, media_type, context->ctxcrypto);
         count+= size_vc;
     } else if(media_type == VIDEO_TYPE_HEVC) {
         // write hevc
         size_vc = write_hev1(data + count, ctxvideo);
+        if (size_vc < 8)
+            return I2ERROR_ISOFF;
+        if (context->ctxcrypto != NULL)
+            size_vc = write_sinf(data + count, size_vc, media_type, context->ctxcrypto);
+        count+= size_vc;
+    } else if(media_type == VIDEO_TYPE_AV1) {
+        // write av01, AV1 segments are not encrypted
+        size_vc = write_av01(data + count, ctxvideo);
         if (size_vc < 8)
             return I2ERROR_ISOFF;
         count+= size_vc;
@@ -1025,6 +1123,8 @@ uint32_t write_stsd(byte *data, uint32_t media_type, i2ctx *context) {
         size_mp4a = write_mp4a(data + count, ctxaudio);
         if (size_mp4a < 8)
             return I2ERROR_ISOFF;
+        if (context->ctxcrypto != NULL)
+            size_mp4a = write_sinf(data + count, size_mp4a, media_type, context->ctxcrypto);
         count+= size_mp4a;
     } else {
         return I2ERROR_ISOFF;
@@ -1230,6 +1330,102 @@ uint32_t write_hev1(byte *data, i2ctx_video *ctxVideo){
     return count;
 }
 
+uint32_t write_av01(byte *data, i2ctx_video *ctxVideo) {
+    uint32_t count, size, hton_size, zero_32, hv_resolution, hton_hv_resolution, size_av1c;
+    uint64_t zero_64;
+    uint16_t zero_16, width, height, flag_one, flag16, hton_flag16, hton_flag_one, hton_width, hton_height;
+
+    count = 4;
+    zero_16 = 0;
+    zero_32 = 0;
+    zero_64 = 0;
+    flag_one = 1;
+    flag16 = 0;
+    hv_resolution = 0x00480000;
+    width = ctxVideo->width;
+    height = ctxVideo->height;
+
+    // box type
+    memcpy(data + count, "av01", BOX_TYPE_SIZE);
+    count+= BOX_TYPE_SIZE;
+
+    // reserved
+    memcpy(data + count, &zero_32, 4);
+    count+= 4;
+    memcpy(data + count, &zero_16, 2);
+    count+= 2;
+
+    // data reference index
+    hton_flag_one = htons(flag_one);
+    memcpy(data + count, &hton_flag_one, 2);
+    count+= 2;
+
+    // codec stream version + revision + reserved
+    memcpy(data + count, &zero_64, 8);
+    count+= 8;
+    memcpy(data + count, &zero_64, 8);
+    count+= 8;
+
+    // width
+    hton_width = htons(width);
+    memcpy(data + count, &hton_width, 2);
+    count+= 2;
+
+    // height
+    hton_height = htons(height);
+    memcpy(data + count, &hton_height, 2);
+    count+= 2;
+
+    // horitzonal and vertical resolution 72dpi
+    hton_hv_resolution = htonl(hv_resolution);
+    memcpy(data + count, &hton_hv_resolution, 4);
+    count+= 4;
+    memcpy(data + count, &hton_hv_resolution, 4);
+    count+= 4;
+
+    // data size
+    memcpy(data + count, &zero_32, 4);
+    count+= 4;
+
+    // frame count
+    memcpy(data + count, &hton_flag_one, 2);
+    count+= 2;
+
+    // compressor name
+    memcpy(data + count, &zero_64, 8);
+    count+= 8;
+    memcpy(data + count, &zero_32, 4);
+    count+= 4;
+
+    // reserved
+    memcpy(data + count, &zero_64, 8);
+    count+= 8;
+    memcpy(data + count, &zero_64, 8);
+    count+= 8;
+    memcpy(data + count, &zero_32, 4);
+    count+= 4;
+    flag16 = 0x18;
+    hton_flag16 = htons(flag16);
+    memcpy(data + count, &hton_flag16, 2);
+    count+= 2;
+    flag16 = 0xffff;
+    hton_flag16 = htons(flag16);
+    memcpy(data + count, &hton_flag16, 2);
+    count+= 2;
+
+    // write av1C
+    size_av1c = write_av1c(data + count, ctxVideo);
+    if (size_av1c < 8)
+        return I2ERROR_ISOFF;
+    count+= size_av1c;
+    
+    // box size
+    size = count;
+    hton_size = htonl(size);
+    memcpy(data, &hton_size, 4);
+    return count;
+}
+
 uint32_t write_avcc(byte *data, i2ctx_video *ctxVideo) {
     uint32_t count, size, hton_size;
     
@@ -1620,7 +1816,7 @@ uint32_t write_sidx(byte *data, uint32_t media_type, i2ctx *context) {
     i2ctx_audio *ctxAudio = context->ctxaudio;
     earliest_presentation_time = 0;
 
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         earliest_presentation_time = ctxVideo->earliest_presentation_time;
         duration = ctxVideo->current_video_duration;
         time_base = ctxVideo->time_base;
@@ -1705,7 +1901,7 @@ uint32_t write_sidx(byte *data, uint32_t media_type, i2ctx *context) {
     return count;
 }
 
-uint32_t write_moof(byte *data, uint32_t media_type, i2ctx **context) {
+uint32_t write_moof(byte *data, byte *fragment_data, uint32_t media_type, i2ctx **context) {
     uint32_t count, size, hton_size, size_traf, size_mfhd; 
 
     count = 4;
@@ -1722,14 +1918,14 @@ uint32_t write_moof(byte *data, uint32_t media_type, i2ctx **context) {
     count+=size_mfhd;
 
     // write traf
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         (*context)->ctxvideo->ctxsample->trun_pos+= count;
     }
     if (media_type == AUDIO_TYPE) {
         (*context)->ctxaudio->ctxsample->trun_pos+= count;
     }
 
-    size_traf = write_traf(data + count, media_type, context);
+    size_traf = write_traf(data + count, fragment_data, media_type, context);
     if (size_traf < 8) {
         return I2ERROR_ISOFF;
     }
@@ -1748,7 +1944,7 @@ uint32_t write_mfhd(byte *data, uint32_t media_type, i2ctx *context) {
     i2ctx_video *ctxVideo = context->ctxvideo;
     i2ctx_audio *ctxAudio = context->ctxaudio;
     
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         seqnum = ctxVideo->sequence_number;
     } else if (media_type == AUDIO_TYPE) {
         seqnum = ctxAudio->sequence_number;
@@ -1778,8 +1974,9 @@ uint32_t write_mfhd(byte *data, uint32_t media_type, i2ctx *context) {
     return count;
 }
 
-uint32_t write_traf(byte *data, uint32_t media_type, i2ctx **context) {
-    uint32_t count, size_tfhd, size_tfdt, size_trun, size, hton_size;
+uint32_t write_traf(byte *data, byte *fragment_data, uint32_t media_type, i2ctx **context) {
+    uint32_t count, size_tfhd, size_tfdt, size_trun, size_cenc, size, hton_size, offset, hton_offset, seqnum;
+    i2ctx_sample *samples;
 
     count = 4;
 
@@ -1799,7 +1996,7 @@ uint32_t write_traf(byte *data, uint32_t media_type, i2ctx **context) {
         return I2ERROR_ISOFF;
     count+= size_tfdt;
 
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         (*context)->ctxvideo->ctxsample->trun_pos+= count;
     }
     if (media_type == AUDIO_TYPE) {
@@ -1812,6 +2009,28 @@ uint32_t write_traf(byte *data, uint32_t media_type, i2ctx **context) {
         return I2ERROR_ISOFF;
     count+= size_trun;
 
+    // write the sample encryption boxes, the mdat moves after them
+    if ((*context)->ctxcrypto != NULL) {
+        if (IS_VIDEO_TYPE(media_type)) {
+            samples = (*context)->ctxvideo->ctxsample;
+            seqnum = (*context)->ctxvideo->sequence_number;
+        } else {
+            samples = (*context)->ctxaudio->ctxsample;
+            seqnum = (*context)->ctxaudio->sequence_number;
+        }
+
+        size_cenc = write_cenc_boxes(data + count, samples->trun_pos - samples->moof_pos + size_trun, fragment_data,
+                                     media_type, seqnum, samples, (*context)->ctxcrypto);
+        if (size_cenc > 0 && size_cenc < 8)
+            return I2ERROR_ISOFF;
+
+        memcpy(&hton_offset, data + count - size_trun + 16, 4);
+        offset = ntohl(hton_offset) + size_cenc;
+        hton_offset = htonl(offset);
+        memcpy(data + count - size_trun + 16, &hton_offset, 4);
+        count+= size_cenc;
+    }
+
     // box size
     size = count;
     hton_size = htonl(size);
@@ -1857,11 +2076,11 @@ uint32_t write_tfdt(byte *data, uint32_t media_type, i2ctx *context) {
     i2ctx_audio *ctxAudio = context->ctxaudio;
     earliest_presentation_time = 0;
 
-    if ((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
-        earliest_presentation_time = ctxVideo->earliest_presentation_time;
+    if (IS_VIDEO_TYPE(media_type)) {
+        earliest_presentation_time = ctxVideo->earliest_presentation_time + ctxVideo->ctxsample->fragment_duration;
     }
     else if (media_type == AUDIO_TYPE) {
-        earliest_presentation_time = ctxAudio->earliest_presentation_time;
+        earliest_presentation_time = ctxAudio->earliest_presentation_time + ctxAudio->ctxsample->fragment_duration;
     }
 
     count = 0;
@@ -1901,7 +2120,7 @@ uint32_t write_trun(byte *data, uint32_t media_type, i2ctx *context) {
     nitems = 0;
     samples = NULL;
 
-    if((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+    if (IS_VIDEO_TYPE(media_type)) {
         samples = context->ctxvideo->ctxsample;
         nitems = 4;
     } else if (media_type == AUDIO_TYPE) {
@@ -1910,7 +2129,7 @@ uint32_t write_trun(byte *data, uint32_t media_type, i2ctx *context) {
     }
 
     flags = samples->box_flags;
-    sample_num = samples->mdat_sample_length;
+    sample_num = samples->fragment_length;
     moof_pos = samples->moof_pos;
     trun_pos = samples->trun_pos;
 
@@ -1934,7 +2153,7 @@ uint32_t write_trun(byte *data, uint32_t media_type, i2ctx *context) {
     memcpy(data + count, &hton_offset, 4);
     count+= 4;
 
-    for (i = 0; i < sample_num; i++)
+    for (i = samples->fragment_first; i < samples->fragment_first + sample_num; i++)
     {
         // sample duration
         hton_sample_duration = htonl(samples->mdat[i].duration);
@@ -1947,7 +2166,7 @@ uint32_t write_trun(byte *data, uint32_t media_type, i2ctx *context) {
         count+= 4;
 
         // video exclusive
-        if((media_type == VIDEO_TYPE_AVC) || (media_type == VIDEO_TYPE_HEVC)) {
+        if (IS_VIDEO_TYPE(media_type)) {
             // sample flags
             flags = samples->mdat[i].key ? 0x00000000 : 0x00010000;
             hton_flags = htonl(flags);
@@ -1970,6 +2189,7 @@ uint32_t write_trun(byte *data, uint32_t media_type, i2ctx *context) {
 
 uint32_t write_mdat(byte* source_data, uint32_t size_source_data, byte *data, uint32_t media_type, i2ctx *context) {
     uint32_t count, mdat_size, hton_mdat_size;
+    uint8_t i2error;
 
     count = 0;
     mdat_size = size_source_data + 8;
@@ -1979,6 +2199,19 @@ uint32_t write_mdat(byte* source_data, uint32_t size_source_data, byte *data, ui
     memcpy(data + count, "mdat", BOX_TYPE_SIZE);
     count+= BOX_TYPE_SIZE;
     memcpy(data + count, source_data, size_source_data);
+
+    if (context->ctxcrypto != NULL) {
+        if (IS_VIDEO_TYPE(media_type)) {
+            i2error = cenc_encrypt_fragment(data + count, media_type, context->ctxvideo->sequence_number,
+                                            context->ctxvideo->ctxsample, context->ctxcrypto);
+        } else {
+            i2error = cenc_encrypt_fragment(data + count, media_type, context->ctxaudio->sequence_number,
+                                            context->ctxaudio->ctxsample, context->ctxcrypto);
+        }
+        if (i2error != I2OK)
+            return I2ERROR_ISOFF;
+    }
+
     count+= size_source_data;
 
     return count;
@@ -38,4 +38,6 @@ uint32_t initAudioGenerator(byte *source_data, uint32_t size_source_data, byte *
 
 uint32_t segmentGenerator(byte *source_data, uint32_t size_source_data, byte *destination_data, uint32_t media_type, i2ctx **context);
 
+uint32_t chunkGenerator(byte *source_data, byte *destination_data, uint32_t media_type, uint32_t sample_end, i2ctx **context);
+
 #endif
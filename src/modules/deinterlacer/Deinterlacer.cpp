@@ -0,0 +1,431 @@
+/*
+ *  Deinterlacer.cpp - Motion adaptive deinterlacer
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "Deinterlacer.hh"
+#include "../../AVFramedQueue.hh"
+#include "../../FramePool.hh"
+#include "../../WorkersPool.hh"
+#include "../../SampleConverter.hh"
+#include "../../Utils.hh"
+
+#include <cstring>
+#include <algorithm>
+
+static SIMD_INLINE int iAbs(int a) {return a < 0 ? -a : a;}
+static SIMD_INLINE int iMin(int a, int b) {return a < b ? a : b;}
+static SIMD_INLINE int iMax(int a, int b) {return a > b ? a : b;}
+
+//NOTE: the spatial prediction is kept within the temporal one plus the motion found around the pixel,
+//      c and e are the lines above and below it, b and f the ones two lines away of the fields average
+static SIMD_INLINE int clampPrediction(int spatial, int c, int e, int p, int n, int pUp, int pDown,
+                                       int nUp, int nDown, int b, int f, int check)
+{
+    int d = (p + n) >> 1;
+    int diff = iMax(iAbs(p - n) >> 1, iMax((iAbs(pUp - c) + iAbs(pDown - e)) >> 1,
+                                           (iAbs(nUp - c) + iAbs(nDown - e)) >> 1));
+    int hi = iMax(iMax(d - e, d - c), iMin(b - c, f - e));
+    int lo = iMin(iMin(d - e, d - c), iMax(b - c, f - e));
+
+    diff = check ? iMax(diff, iMax(lo, -hi)) : diff;
+
+    return iMin(iMax(spatial, d - diff), d + diff);
+}
+
+//NOTE: the edge direction checks select with masks instead of branches, gcc does not vectorise the loop
+//      with that many conditional moves. Directions two pixels away are only taken if the next ones already
+//      improved, as yadif does
+SIMD_KERNEL
+static void yadifLine(unsigned char* __restrict__ dst, unsigned char const* pMid, unsigned char const* cMid,
+                      unsigned char const* pUp, unsigned char const* pDown, unsigned char const* cUp,
+                      unsigned char const* cDown, unsigned char const* nUp, unsigned char const* nDown,
+                      unsigned char const* pUp2, unsigned char const* pDown2, unsigned char const* cUp2,
+                      unsigned char const* cDown2, int start, int end, int check)
+{
+    for (int x = start; x < end; x++) {
+        int c = cUp[x];
+        int e = cDown[x];
+        int pred = (c + e) >> 1;
+        int score = iAbs(cUp[x - 1] - cDown[x - 1]) + iAbs(c - e) + iAbs(cUp[x + 1] - cDown[x + 1]) - 1;
+        int s, better;
+
+        s = iAbs(cUp[x - 2] - cDown[x]) + iAbs(cUp[x - 1] - cDown[x + 1]) + iAbs(cUp[x] - cDown[x + 2]);
+        better = s < score;
+        pred += (((cUp[x - 1] + cDown[x + 1]) >> 1) - pred) & -better;
+        score += (s - score) & -better;
+        s = iAbs(cUp[x - 3] - cDown[x + 1]) + iAbs(cUp[x - 2] - cDown[x + 2]) + iAbs(cUp[x - 1] - cDown[x + 3]);
+        better &= s < score;
+        pred += (((cUp[x - 2] + cDown[x + 2]) >> 1) - pred) & -better;
+        score += (s - score) & -better;
+
+        s = iAbs(cUp[x] - cDown[x - 2]) + iAbs(cUp[x + 1] - cDown[x - 1]) + iAbs(cUp[x + 2] - cDown[x]);
+        better = s < score;
+        pred += (((cUp[x + 1] + cDown[x - 1]) >> 1) - pred) & -better;
+        score += (s - score) & -better;
+        s = iAbs(cUp[x + 1] - cDown[x - 3]) + iAbs(cUp[x + 2] - cDown[x - 2]) + iAbs(cUp[x + 3] - cDown[x - 1]);
+        better &= s < score;
+        pred += (((cUp[x + 2] + cDown[x - 2]) >> 1) - pred) & -better;
+
+        dst[x] = (unsigned char) clampPrediction(pred, c, e, pMid[x], cMid[x], pUp[x], pDown[x], nUp[x], nDown[x],
+                                                 (pUp2[x] + cUp2[x]) >> 1, (pDown2[x] + cDown2[x]) >> 1, check);
+    }
+}
+
+//NOTE: pixels closer than 3 to the picture edges have no room for the direction checks
+static void yadifEdge(unsigned char* dst, unsigned char const* pMid, unsigned char const* cMid,
+                      unsigned char const* pUp, unsigned char const* pDown, unsigned char const* cUp,
+                      unsigned char const* cDown, unsigned char const* nUp, unsigned char const* nDown,
+                      unsigned char const* pUp2, unsigned char const* pDown2, unsigned char const* cUp2,
+                      unsigned char const* cDown2, int start, int end, int check)
+{
+    for (int x = start; x < end; x++) {
+        dst[x] = (unsigned char) clampPrediction((cUp[x] + cDown[x]) >> 1, cUp[x], cDown[x], pMid[x], cMid[x],
+                                                 pUp[x], pDown[x], nUp[x], nDown[x], (pUp2[x] + cUp2[x]) >> 1,
+                                                 (pDown2[x] + cDown2[x]) >> 1, check);
+    }
+}
+
+//NOTE: the second field lines are rebuilt at the time of the first field of the current picture, so their
+//      temporal neighbours are the second fields of the previous and the current pictures
+void Deinterlacer::filterPlane(unsigned char* dst, unsigned char const* prev, unsigned char const* cur,
+                               unsigned char const* next, int const linesize[4], int width, int height,
+                               bool topFirst, int first, int last)
+{
+    int kept = topFirst ? 0 : 1;
+    int left = std::min(3, width);
+    int right = std::max(left, width - 3);
+
+    auto line = [&](unsigned char const* plane, int l, int y) {
+        return plane + std::min(std::max(y, 0), height - 1)*linesize[l];
+    };
+
+    for (int y = first; y < last; y++) {
+        unsigned char* out = dst + y*linesize[0];
+
+        if ((y & 1) == kept || height < 2) {
+            memcpy(out, cur + y*linesize[2], width);
+            continue;
+        }
+
+        //NOTE: lines out of the picture are mirrored to the other neighbour of the same field, which also
+        //      disables the check of the lines two away, as yadif does at the picture borders
+        int up = y > 0 ? y - 1 : y + 1;
+        int down = y + 1 < height ? y + 1 : y - 1;
+        int check = y >= 2 && y + 2 < height;
+
+        unsigned char const* rows[12] = {
+            line(prev, 1, y), line(cur, 2, y), line(prev, 1, up), line(prev, 1, down), line(cur, 2, up),
+            line(cur, 2, down), line(next, 3, up), line(next, 3, down), line(prev, 1, y - 2), line(prev, 1, y + 2),
+            line(cur, 2, y - 2), line(cur, 2, y + 2)
+        };
+
+        yadifEdge(out, rows[0], rows[1], rows[2], rows[3], rows[4], rows[5], rows[6], rows[7], rows[8], rows[9],
+                  rows[10], rows[11], 0, left, check);
+        yadifLine(out, rows[0], rows[1], rows[2], rows[3], rows[4], rows[5], rows[6], rows[7], rows[8], rows[9],
+                  rows[10], rows[11], left, right, check);
+        yadifEdge(out, rows[0], rows[1], rows[2], rows[3], rows[4], rows[5], rows[6], rows[7], rows[8], rows[9],
+                  rows[10], rows[11], right, width, check);
+    }
+}
+
+Deinterlacer::Deinterlacer() : OneToOneFilterT(), prev(NULL), cur(NULL), force(false), threads(1),
+    writtenWidth(0), writtenHeight(0), writtenPixFmt(P_NONE), deinterlaced(0), passed(0)
+{
+    fType = DEINTERLACER;
+
+    outputStreamInfo = new StreamInfo(VIDEO);
+    outputStreamInfo->video.codec = RAW;
+    outputStreamInfo->video.pixelFormat = YUV420P;
+
+    initializeEventMap();
+}
+
+Deinterlacer::~Deinterlacer()
+{
+    release(prev);
+    release(cur);
+
+    delete outputStreamInfo;
+}
+
+FrameQueue* Deinterlacer::allocQueue(ConnectionData cData)
+{
+    return VideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_RAW_VIDEO_FRAMES);
+}
+
+//NOTE: the output keeps the input pixel format, the queue frames are fitted to the pictures anyway
+bool Deinterlacer::specificReaderConfig(int /*readerID*/, FrameQueue* queue)
+{
+    const StreamInfo* si = queue->getStreamInfo();
+
+    if (si && si->video.codec == RAW && VideoFrame::isPlanarFormat(si->video.pixelFormat)) {
+        outputStreamInfo->video.pixelFormat = si->video.pixelFormat;
+    }
+
+    return true;
+}
+
+FieldOrder Deinterlacer::fieldOrder(VideoFrame* frame)
+{
+    if (frame->getFieldOrder() == FO_PROGRESSIVE && force) {
+        return FO_TOP_FIRST;
+    }
+
+    return frame->getFieldOrder();
+}
+
+void Deinterlacer::release(VideoFrame* &frame)
+{
+    if (frame) {
+        FramePool::getInstance()->releaseFrame(frame);
+        frame = NULL;
+    }
+}
+
+//NOTE: the output frame points to the planes of a pooled one, which is retained until the output frame
+//      is fitted again. Other pictures are copied
+bool Deinterlacer::passFrame(VideoFrame* orgFrame, VideoFrame* dstFrame)
+{
+    PlanarVideoFrame* planarDst = dynamic_cast<PlanarVideoFrame*>(dstFrame);
+    unsigned char* srcData[MAX_PLANES];
+    unsigned char* dstData[MAX_PLANES];
+    int srcLinesize[MAX_PLANES];
+    int dstLinesize[MAX_PLANES];
+    std::shared_ptr<void> owner;
+    int lineBytes, rows;
+
+    if (orgFrame->getPlanes(srcData, srcLinesize) == 0) {
+        return false;
+    }
+
+    if (planarDst && FramePool::getInstance()->isPooled(orgFrame)) {
+        orgFrame->retain();
+        owner = std::shared_ptr<void>(orgFrame, [](void* f) {
+            FramePool::getInstance()->releaseFrame(static_cast<Frame*>(f));
+        });
+
+        if (planarDst->setExternalPlanes(orgFrame->getWidth(), orgFrame->getHeight(), orgFrame->getPixelFormat(),
+                                         srcData, srcLinesize, owner)) {
+            passed++;
+            return true;
+        }
+    }
+
+    dstFrame->fitBuffer(orgFrame->getWidth(), orgFrame->getHeight(), orgFrame->getPixelFormat());
+
+    if (dstFrame->getPlanes(dstData, dstLinesize) == 0) {
+        return false;
+    }
+
+    for (unsigned p = 0; VideoFrame::planeSize(orgFrame->getPixelFormat(), orgFrame->getWidth(),
+         orgFrame->getHeight(), p, lineBytes, rows); p++) {
+        for (int r = 0; r < rows; r++) {
+            memcpy(dstData[p] + r*dstLinesize[p], srcData[p] + r*srcLinesize[p], lineBytes);
+        }
+    }
+
+    passed++;
+    return true;
+}
+
+//NOTE: each band filters its share of the lines of every plane, as VideoResampler::convertFrame does
+bool Deinterlacer::deinterlace(VideoFrame* prevFrame, VideoFrame* curFrame, VideoFrame* nextFrame, VideoFrame* dstFrame)
+{
+    unsigned char* data[4][MAX_PLANES];
+    int linesize[4][MAX_PLANES];
+    int width = curFrame->getWidth();
+    int height = curFrame->getHeight();
+    PixType pixel = curFrame->getPixelFormat();
+    bool topFirst = fieldOrder(curFrame) != FO_BOTTOM_FIRST;
+    int bands = std::max(1, std::min(threads, height/2));
+
+    dstFrame->fitBuffer(width, height, pixel);
+
+    if (dstFrame->getPlanes(data[0], linesize[0]) == 0 || prevFrame->getPlanes(data[1], linesize[1]) == 0 ||
+        curFrame->getPlanes(data[2], linesize[2]) == 0 || nextFrame->getPlanes(data[3], linesize[3]) == 0) {
+        utils::errorMsg("[Deinterlacer] Could not get the picture planes");
+        return false;
+    }
+
+    auto filterBand = [&](unsigned b) {
+        int lineBytes, rows;
+
+        for (unsigned p = 0; VideoFrame::planeSize(pixel, width, height, p, lineBytes, rows); p++) {
+            int lines[4] = {linesize[0][p], linesize[1][p], linesize[2][p], linesize[3][p]};
+
+            filterPlane(data[0][p], data[1][p], data[2][p], data[3][p], lines, lineBytes, rows, topFirst,
+                        rows*b/bands, rows*(b + 1)/bands);
+        }
+    };
+
+    if (bands > 1 && WorkersPool::current()) {
+        WorkersPool::current()->parallelFor(bands, filterBand);
+    } else {
+        for (int b = 0; b < bands; b++) {
+            filterBand(b);
+        }
+    }
+
+    deinterlaced++;
+    return true;
+}
+
+//NOTE: the current picture is output with the next input, which is held in its place. A picture of
+//      another size or format is a new stream, the last one of the previous stream is its own next picture
+bool Deinterlacer::doProcessFrame(VideoFrame *orgFrame, VideoFrame *dstFrame)
+{
+    VideoFrame *held, *next;
+    bool boundary, success;
+
+    if (orgFrame->getCodec() != RAW || !VideoFrame::isPlanarFormat(orgFrame->getPixelFormat())) {
+        utils::errorMsg("[Deinterlacer] Only planar raw pictures can be deinterlaced");
+        return false;
+    }
+
+    if (!cur && fieldOrder(orgFrame) == FO_PROGRESSIVE) {
+        if (!passFrame(orgFrame, dstFrame)) {
+            return false;
+        }
+
+        dstFrame->setConsumed(true);
+        dstFrame->setPresentationTime(orgFrame->getPresentationTime());
+        dstFrame->setDecodeTime(orgFrame->getDecodeTime());
+        dstFrame->setOriginTime(orgFrame->getOriginTime());
+        dstFrame->setSequenceNumber(orgFrame->getSequenceNumber());
+        dstFrame->setFieldOrder(FO_PROGRESSIVE);
+        dstFrame->getSideData() = orgFrame->getSideData();
+        stampFormat(dstFrame);
+        return true;
+    }
+
+    if (!(held = dynamic_cast<VideoFrame*>(FramePool::getInstance()->hold(orgFrame)))) {
+        utils::errorMsg("[Deinterlacer] Could not hold the picture, it is discarded");
+        return false;
+    }
+
+    if (!cur) {
+        cur = held;
+        return false;
+    }
+
+    boundary = held->getWidth() != cur->getWidth() || held->getHeight() != cur->getHeight() ||
+               held->getPixelFormat() != cur->getPixelFormat() || held->getFormatVersion() != cur->getFormatVersion();
+    next = boundary ? cur : held;
+
+    if (fieldOrder(cur) == FO_PROGRESSIVE) {
+        success = passFrame(cur, dstFrame);
+    } else {
+        success = deinterlace(prev ? prev : cur, cur, next, dstFrame);
+    }
+
+    if (success) {
+        dstFrame->setConsumed(true);
+        dstFrame->setPresentationTime(cur->getPresentationTime());
+        dstFrame->setDecodeTime(cur->getDecodeTime());
+        dstFrame->setOriginTime(cur->getOriginTime());
+        dstFrame->setSequenceNumber(cur->getSequenceNumber());
+        dstFrame->setFieldOrder(FO_PROGRESSIVE);
+        dstFrame->getSideData() = cur->getSideData();
+        stampFormat(dstFrame);
+    }
+
+    release(prev);
+
+    if (boundary) {
+        release(cur);
+    } else {
+        prev = cur;
+    }
+
+    cur = held;
+    return success;
+}
+
+void Deinterlacer::stampFormat(VideoFrame *dstFrame)
+{
+    if (writtenWidth > 0 && (dstFrame->getWidth() != writtenWidth ||
+        dstFrame->getHeight() != writtenHeight || dstFrame->getPixelFormat() != writtenPixFmt)) {
+        outputStreamInfo->changeFormat();
+    }
+
+    writtenWidth = dstFrame->getWidth();
+    writtenHeight = dstFrame->getHeight();
+    writtenPixFmt = dstFrame->getPixelFormat();
+    dstFrame->setFormatVersion(outputStreamInfo->getFormatVersion());
+}
+
+bool Deinterlacer::configure0(bool force_, int threads_)
+{
+    if (threads_ < 1 || threads_ > DEINTERLACER_MAX_THREADS) {
+        utils::errorMsg("[Deinterlacer] Threads must be in [1, " + std::to_string(DEINTERLACER_MAX_THREADS) + "]");
+        return false;
+    }
+
+    force = force_;
+    threads = threads_;
+    return true;
+}
+
+bool Deinterlacer::configEvent(Jzon::Node* params)
+{
+    bool newForce = force;
+    int newThreads = threads;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("force") && params->Get("force").IsBool()) {
+        newForce = params->Get("force").ToBool();
+    }
+
+    if (params->Has("threads") && params->Get("threads").IsNumber()) {
+        newThreads = params->Get("threads").ToInt();
+    }
+
+    return configure0(newForce, newThreads);
+}
+
+void Deinterlacer::initializeEventMap()
+{
+    eventMap["configure"] = std::bind(&Deinterlacer::configEvent, this, std::placeholders::_1);
+}
+
+void Deinterlacer::doGetState(Jzon::Object &filterNode)
+{
+    filterNode.Add("force", force);
+    filterNode.Add("threads", threads);
+    filterNode.Add("deinterlacedFrames", (int) deinterlaced);
+    filterNode.Add("passedFrames", (int) passed);
+}
+
+bool Deinterlacer::configure(bool force, int threads)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configure");
+    params.Add("force", force);
+    params.Add("threads", threads);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
@@ -0,0 +1,113 @@
+/*
+ *  Deinterlacer.hh - Motion adaptive deinterlacer
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _DEINTERLACER_HH
+#define _DEINTERLACER_HH
+
+#include "../../VideoFrame.hh"
+#include "../../FrameQueue.hh"
+#include "../../Filter.hh"
+#include "../../StreamInfo.hh"
+
+#define DEINTERLACER_MAX_THREADS 16     //!< Maximum number of horizontal bands filtered in parallel
+
+/*! Motion adaptive deinterlacer of planar raw video, the yadif algorithm outputting one frame per frame.
+*   The first field of each picture is kept and the lines of the second one are rebuilt, from the
+*   fields before and after them where there is no motion and from the neighbour lines, along the
+*   best matching edge direction, where there is. Rebuilding a picture needs the next one, so
+*   interlaced streams are delayed one frame. Pictures are held without copying them when they come
+*   from pooled queue frames (see Frame::retain). Progressive pictures are passed through without
+*   copying them, before any interlaced one without delay, so the filter can stay in front of the
+*   VideoResampler of any input. The field structure comes from the frames (see VideoFrame::setFieldOrder),
+*   in forced mode unflagged pictures are deinterlaced as top field first. Output frames are progressive.
+*/
+class Deinterlacer : public OneToOneFilterT<VideoFrame, VideoFrame> {
+
+public:
+    Deinterlacer();
+    ~Deinterlacer();
+
+    /**
+    * Configures the deinterlacing
+    * @param force true to deinterlace the pictures not flagged as interlaced too, as top field first
+    * @param threads number of bands filtered in parallel [1, DEINTERLACER_MAX_THREADS]
+    * @return true if the event has been pushed
+    */
+    bool configure(bool force, int threads = 1);
+
+    /**
+    * Rebuilds the second field lines of a plane, see the class description
+    * @param dst plane written, the first field lines are copied from cur
+    * @param prev plane of the previous picture
+    * @param cur plane of the deinterlaced picture
+    * @param next plane of the next picture
+    * @param linesize bytes between lines of each plane: dst, prev, cur and next
+    * @param width bytes of a line
+    * @param height lines of the plane
+    * @param topFirst true if the first field is the top one (even lines)
+    * @param first first line written
+    * @param last line after the last one written
+    */
+    static void filterPlane(unsigned char* dst, unsigned char const* prev, unsigned char const* cur,
+                            unsigned char const* next, int const linesize[4], int width, int height,
+                            bool topFirst, int first, int last);
+
+    size_t getDeinterlaced() const {return deinterlaced;};
+    size_t getPassed() const {return passed;};
+
+protected:
+    //Protected for testing purposes
+    bool doProcessFrame(VideoFrame *orgFrame, VideoFrame *dstFrame);
+    bool configure0(bool force, int threads);
+
+private:
+    FrameQueue* allocQueue(ConnectionData cData);
+    void initializeEventMap();
+    bool configEvent(Jzon::Node* params);
+    void doGetState(Jzon::Object &filterNode);
+
+    bool specificReaderConfig(int readerID, FrameQueue* queue);
+    bool specificReaderDelete(int /*readerID*/) {return true;};
+    bool specificWriterConfig(int /*writerID*/) {return true;};
+    bool specificWriterDelete(int /*writerID*/) {return true;};
+
+    FieldOrder fieldOrder(VideoFrame* frame);
+    void release(VideoFrame* &frame);
+    bool passFrame(VideoFrame* orgFrame, VideoFrame* dstFrame);
+    bool deinterlace(VideoFrame* prevFrame, VideoFrame* curFrame, VideoFrame* nextFrame, VideoFrame* dstFrame);
+    void stampFormat(VideoFrame *dstFrame);
+
+    StreamInfo          *outputStreamInfo;
+
+    VideoFrame          *prev;          //!< Held pictures, see hold, the current one is output with the next input
+    VideoFrame          *cur;
+
+    bool                force;
+    int                 threads;
+    int                 writtenWidth;   //!< Picture size and format of the last written frame
+    int                 writtenHeight;
+    PixType             writtenPixFmt;
+    size_t              deinterlaced;
+    size_t              passed;
+};
+
+#endif
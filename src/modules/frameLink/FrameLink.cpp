@@ -0,0 +1,232 @@
+/*
+ *  FrameLink - Framed socket transport of streams between processes and nodes
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "FrameLink.hh"
+
+#define LINK_ANNEXB         0x1
+#define LINK_FRAMED         0x2
+#define LINK_FRAME_TYPES    0x4
+
+static void put16(uint8_t* p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    put16(p, v >> 16);
+    put16(p + 2, v);
+}
+
+static void put64(uint8_t* p, uint64_t v)
+{
+    put32(p, v >> 32);
+    put32(p + 4, v);
+}
+
+static uint16_t get16(const uint8_t* p)
+{
+    return (uint16_t) (p[0] << 8 | p[1]);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return (uint32_t) get16(p) << 16 | get16(p + 2);
+}
+
+static uint64_t get64(const uint8_t* p)
+{
+    return (uint64_t) get32(p) << 32 | get32(p + 4);
+}
+
+bool FrameLink::isLinkable(const StreamInfo* si)
+{
+    if (!si) {
+        return false;
+    }
+
+    if (si->type == VIDEO) {
+        return si->video.codec != VC_NONE && (si->video.codec != RAW || si->video.pixelFormat != P_NONE);
+    }
+
+    if (si->type == AUDIO) {
+        return si->audio.codec != AC_NONE && (si->audio.codec != PCM || si->audio.sampleFormat != S_NONE);
+    }
+
+    return false;
+}
+
+void FrameLink::writeHeader(uint8_t* buffer, const LinkHeader& header)
+{
+    put32(buffer, header.magic);
+    put16(buffer + 4, header.version);
+    put16(buffer + 6, header.type);
+    put32(buffer + 8, header.length);
+    put32(buffer + 12, header.flags);
+    put64(buffer + 16, header.pts);
+    put64(buffer + 24, header.dts);
+    put32(buffer + 32, header.seqNum);
+    put32(buffer + 36, header.samples);
+}
+
+bool FrameLink::readHeader(const uint8_t* buffer, LinkHeader& header)
+{
+    header.magic = get32(buffer);
+    header.version = get16(buffer + 4);
+    header.type = get16(buffer + 6);
+    header.length = get32(buffer + 8);
+    header.flags = get32(buffer + 12);
+    header.pts = get64(buffer + 16);
+    header.dts = get64(buffer + 24);
+    header.seqNum = get32(buffer + 32);
+    header.samples = get32(buffer + 36);
+
+    return header.magic == LINK_MAGIC && header.version == LINK_VERSION &&
+           (header.type == LINK_STREAM || header.type == LINK_FRAME) && header.length <= LINK_MAX_PAYLOAD;
+}
+
+void FrameLink::writeStream(uint8_t* buffer, const StreamInfo* si)
+{
+    uint16_t flags = 0;
+
+    put16(buffer, si->type);
+    put32(buffer + 4, si->bitrate);
+
+    if (si->type == VIDEO) {
+        flags |= si->video.frameTypes ? LINK_FRAME_TYPES : 0;
+
+        if (si->video.codec == H264 || si->video.codec == H265) {
+            flags |= si->video.h264or5.annexb ? LINK_ANNEXB : 0;
+            flags |= si->video.h264or5.framed ? LINK_FRAMED : 0;
+        }
+
+        put16(buffer + 2, si->video.codec);
+        put32(buffer + 8, 0);
+        put16(buffer + 12, 0);
+        put16(buffer + 14, CL_NONE);
+        put16(buffer + 16, si->video.pixelFormat);
+    } else {
+        put16(buffer + 2, si->audio.codec);
+        put32(buffer + 8, si->audio.sampleRate);
+        put16(buffer + 12, si->audio.channels);
+        put16(buffer + 14, si->audio.channelLayout);
+        put16(buffer + 16, si->audio.sampleFormat);
+    }
+
+    put16(buffer + 18, flags);
+}
+
+bool FrameLink::readStream(const uint8_t* payload, size_t length, StreamInfo* si)
+{
+    uint16_t flags;
+
+    if (length < LINK_STREAM_SIZE) {
+        return false;
+    }
+
+    //NOTE: enumerations are sent as 16 bit two's complement, so their -1 values survive the trip
+    si->type = (StreamType) (int16_t) get16(payload);
+    si->bitrate = get32(payload + 4);
+    flags = get16(payload + 18);
+
+    if (si->type == VIDEO) {
+        si->video.codec = (VCodecType) (int16_t) get16(payload + 2);
+        si->video.pixelFormat = (PixType) (int16_t) get16(payload + 16);
+        si->video.frameTypes = flags & LINK_FRAME_TYPES;
+        si->video.h264or5.annexb = flags & LINK_ANNEXB;
+        si->video.h264or5.framed = flags & LINK_FRAMED;
+    } else if (si->type == AUDIO) {
+        si->audio.codec = (ACodecType) (int16_t) get16(payload + 2);
+        si->audio.sampleRate = get32(payload + 8);
+        si->audio.channels = get16(payload + 12);
+        si->audio.channelLayout = (ChannelLayout) (int16_t) get16(payload + 14);
+        si->audio.sampleFormat = (SampleFmt) (int16_t) get16(payload + 16);
+    } else {
+        return false;
+    }
+
+    si->setExtraData(length > LINK_STREAM_SIZE ? payload + LINK_STREAM_SIZE : NULL, length - LINK_STREAM_SIZE);
+
+    return true;
+}
+
+void FrameLink::writePicture(uint8_t* buffer, const LinkPicture& picture)
+{
+    put32(buffer, picture.width);
+    put32(buffer + 4, picture.height);
+    put16(buffer + 8, picture.pixelFormat);
+    put16(buffer + 10, picture.planes);
+
+    for (unsigned i = 0; i < MAX_PLANES; i++) {
+        put32(buffer + 12 + 4*i, picture.stride[i]);
+    }
+}
+
+bool FrameLink::readPicture(const uint8_t* payload, size_t length, LinkPicture& picture)
+{
+    size_t planesLength = LINK_PICTURE_SIZE;
+    unsigned planes = 0;
+    int lineBytes, rows;
+
+    if (length < LINK_PICTURE_SIZE) {
+        return false;
+    }
+
+    picture.width = get32(payload);
+    picture.height = get32(payload + 4);
+    picture.pixelFormat = get16(payload + 8);
+    picture.planes = get16(payload + 10);
+
+    for (unsigned i = 0; i < MAX_PLANES; i++) {
+        picture.stride[i] = get32(payload + 12 + 4*i);
+    }
+
+    if (picture.width == 0 || picture.height == 0 || picture.width > 0xFFFF || picture.height > 0xFFFF) {
+        return false;
+    }
+
+    //NOTE: the planes are checked against the payload before any frame buffer is fitted to them
+    for (; planes < MAX_PLANES && VideoFrame::planeSize((PixType) (int16_t) picture.pixelFormat,
+            picture.width, picture.height, planes, lineBytes, rows); planes++) {
+        if (rows <= 0 || picture.stride[planes] < (uint32_t) lineBytes) {
+            return false;
+        }
+        planesLength += (size_t) picture.stride[planes]*(rows - 1) + lineBytes;
+    }
+
+    return planes > 0 && planes == picture.planes && planesLength <= length;
+}
+
+bool FrameLink::sameStream(const StreamInfo* a, const StreamInfo* b)
+{
+    if (a->type != b->type) {
+        return false;
+    }
+
+    if (a->type == VIDEO) {
+        return a->video.codec == b->video.codec && (a->video.codec != RAW || a->video.pixelFormat == b->video.pixelFormat);
+    }
+
+    return a->audio.codec == b->audio.codec && a->audio.sampleRate == b->audio.sampleRate &&
+           a->audio.channels == b->audio.channels && a->audio.sampleFormat == b->audio.sampleFormat;
+}
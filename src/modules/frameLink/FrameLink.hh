@@ -0,0 +1,130 @@
+/*
+ *  FrameLink - Framed socket transport of streams between processes and nodes
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _FRAME_LINK_HH
+#define _FRAME_LINK_HH
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../../StreamInfo.hh"
+#include "../../VideoFrame.hh"
+
+#define LINK_MAGIC          0x4B4E4C4C      //!< "LLNK" on the wire
+#define LINK_VERSION        1
+#define LINK_HEADER_SIZE    40
+#define LINK_STREAM_SIZE    20              //!< Stream description bytes, its extradata follows them
+#define LINK_PICTURE_SIZE   (12 + 4*MAX_PLANES) //!< Raw picture description bytes, its planes follow them
+#define LINK_MAX_PAYLOAD    (64*1024*1024)  //!< A 4K picture of 32 bit pixels with padded lines fits
+
+#define LINK_KEY_FRAME      0x1
+#define LINK_REFERENCE      0x2
+
+enum LinkMessageType {LINK_STREAM = 1, LINK_FRAME = 2};
+
+/*! Header of every link message, it is followed by length payload bytes. A LINK_STREAM message
+    describes the stream and it is sent on connection and whenever its extradata changes, each
+    LINK_FRAME message carries a whole frame. Fields are sent in network byte order. Raw pictures
+    begin with their LinkPicture and planar samples are sent one channel after the other.
+*/
+struct LinkHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    uint32_t length;
+    uint32_t flags;             //!< LINK_KEY_FRAME and LINK_REFERENCE of frames with types
+    int64_t pts;                //!< Presentation time in usec
+    int64_t dts;                //!< Decode time in usec
+    uint32_t seqNum;
+    uint32_t samples;           //!< Samples of audio frames, 0 for video
+};
+
+/*! Picture description of raw video frames. Planes are sent as they are laid out in the frame, each
+    one spanning stride bytes per line up to the end of its last line, so padded lines need no packing.
+*/
+struct LinkPicture {
+    uint32_t width;
+    uint32_t height;
+    uint16_t pixelFormat;
+    uint16_t planes;
+    uint32_t stride[MAX_PLANES];
+};
+
+/*! Wire format helpers shared by FrameLinkSender and FrameLinkReceiver. Coded and raw video and
+    audio streams are linked, raw ones are best kept inside a host (i.e. over Unix sockets) since
+    they take far more bandwidth.
+*/
+class FrameLink {
+
+public:
+    /**
+    * @param si stream description
+    * @return false if the stream cannot be linked
+    */
+    static bool isLinkable(const StreamInfo* si);
+
+    /**
+    * Writes a header in LINK_HEADER_SIZE bytes
+    */
+    static void writeHeader(uint8_t* buffer, const LinkHeader& header);
+
+    /**
+    * Reads a header from LINK_HEADER_SIZE bytes
+    * @return false if the magic, the version or the length are not valid
+    */
+    static bool readHeader(const uint8_t* buffer, LinkHeader& header);
+
+    /**
+    * Writes the description of a stream, without its extradata, in LINK_STREAM_SIZE bytes
+    */
+    static void writeStream(uint8_t* buffer, const StreamInfo* si);
+
+    /**
+    * Reads a LINK_STREAM payload
+    * @param payload stream description followed by the extradata
+    * @param length payload bytes
+    * @param si filled with the description and the extradata
+    * @return false if the payload is too short
+    */
+    static bool readStream(const uint8_t* payload, size_t length, StreamInfo* si);
+
+    /**
+    * Writes a picture description in LINK_PICTURE_SIZE bytes
+    */
+    static void writePicture(uint8_t* buffer, const LinkPicture& picture);
+
+    /**
+    * Reads a picture description and checks that its planes fit the payload
+    * @param payload LINK_FRAME payload of a raw video frame
+    * @param length payload bytes
+    * @param picture filled with the description
+    * @return false if the description is not valid for the payload
+    */
+    static bool readPicture(const uint8_t* payload, size_t length, LinkPicture& picture);
+
+    /**
+    * @return true if frames of one stream can be written to queues of the other one
+    */
+    static bool sameStream(const StreamInfo* a, const StreamInfo* b);
+};
+
+#endif
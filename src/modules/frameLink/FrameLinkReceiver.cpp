@@ -0,0 +1,500 @@
+/*
+ *  FrameLinkReceiver - Head filter receiving a stream from another process or node
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "FrameLinkReceiver.hh"
+#include "../../AVFramedQueue.hh"
+#include "../../AudioFrame.hh"
+#include "../../VideoFrame.hh"
+#include "../../Utils.hh"
+
+FrameLinkReceiver* FrameLinkReceiver::createNew(const StreamInfo& si)
+{
+    if (!FrameLink::isLinkable(&si)) {
+        utils::errorMsg("FrameLinkReceiver::error - the stream cannot be linked");
+        return NULL;
+    }
+
+    return new FrameLinkReceiver(si);
+}
+
+FrameLinkReceiver::FrameLinkReceiver(const StreamInfo& si) : HeadFilter(1, REGULAR, true), port(0),
+    listenFd(-1), peerFd(-1), inOffset(0), inLength(0), sameStream(true), frames(0), bytes(0), dropped(0), peers(0)
+{
+    oStreamInfo = new StreamInfo(si.type);
+    oStreamInfo->bitrate = si.bitrate;
+
+    if (si.type == VIDEO) {
+        oStreamInfo->video = si.video;
+    } else {
+        oStreamInfo->audio = si.audio;
+    }
+
+    fType = FRAME_LINK_RECEIVER;
+
+    initializeEventMap();
+}
+
+FrameLinkReceiver::~FrameLinkReceiver()
+{
+    closePeer();
+    closeListen();
+
+    delete oStreamInfo;
+}
+
+bool FrameLinkReceiver::listenPort(unsigned port_)
+{
+    struct sockaddr_in6 address;
+    int reuse = 1;
+    int fd;
+
+    if (port_ == 0 || port_ > 65535) {
+        utils::errorMsg("FrameLinkReceiver::listen error - invalid port");
+        return false;
+    }
+
+    if ((fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        utils::errorMsg("FrameLinkReceiver::listen error - could not create socket");
+        return false;
+    }
+
+    //NOTE: dual stack socket, IPv4 senders are accepted as mapped addresses
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    memset(&address, 0, sizeof(address));
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_any;
+    address.sin6_port = htons(port_);
+
+    if (!listenOn(fd, (struct sockaddr*) &address, sizeof(address), "port " + std::to_string(port_))) {
+        return false;
+    }
+
+    port = port_;
+
+    return true;
+}
+
+bool FrameLinkReceiver::listenPath(std::string path_)
+{
+    struct sockaddr_un address;
+    struct stat info;
+    int fd;
+
+    if (path_.empty() || path_.size() >= sizeof(address.sun_path)) {
+        utils::errorMsg("FrameLinkReceiver::listen error - invalid socket path");
+        return false;
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        utils::errorMsg("FrameLinkReceiver::listen error - could not create socket");
+        return false;
+    }
+
+    //NOTE: listening again on the same path replaces the socket, there is no way to keep both
+    if (path_ == path) {
+        closePeer();
+        closeListen();
+    }
+
+    //NOTE: a socket left by a previous process would refuse the bind, other files are kept
+    if (stat(path_.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path_.c_str());
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path_.c_str(), path_.size());
+
+    if (!listenOn(fd, (struct sockaddr*) &address, sizeof(address), path_)) {
+        return false;
+    }
+
+    path = path_;
+
+    return true;
+}
+
+bool FrameLinkReceiver::listenOn(int fd, struct sockaddr* address, socklen_t length, std::string name)
+{
+    if (bind(fd, address, length) < 0 || listen(fd, 1) < 0) {
+        utils::errorMsg("FrameLinkReceiver::listen error - could not bind " + name + " (" + strerror(errno) + ")");
+        close(fd);
+        return false;
+    }
+
+    closePeer();
+    closeListen();
+
+    listenFd = fd;
+
+    return true;
+}
+
+void FrameLinkReceiver::closeListen()
+{
+    if (listenFd >= 0) {
+        close(listenFd);
+    }
+
+    if (!path.empty()) {
+        unlink(path.c_str());
+    }
+
+    listenFd = -1;
+    port = 0;
+    path.clear();
+}
+
+void FrameLinkReceiver::acceptPeer()
+{
+    int noDelay = 1;
+    int fd;
+
+    //NOTE: a reconnecting sender replaces the stale connection
+    while ((fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        closePeer();
+        if (path.empty()) {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        }
+        peerFd = fd;
+        peers++;
+    }
+}
+
+void FrameLinkReceiver::closePeer()
+{
+    if (peerFd >= 0) {
+        close(peerFd);
+    }
+
+    peerFd = -1;
+    inOffset = 0;
+    inLength = 0;
+}
+
+bool FrameLinkReceiver::readPeer(int timeout)
+{
+    struct pollfd pfds[2] = {{listenFd, POLLIN, 0}, {peerFd, POLLIN, 0}};
+    ssize_t received;
+    size_t total = 0;
+
+    if (poll(pfds, peerFd >= 0 ? 2 : 1, timeout) <= 0) {
+        return false;
+    }
+
+    if (pfds[0].revents & POLLIN) {
+        acceptPeer();
+    }
+
+    if (peerFd < 0) {
+        return false;
+    }
+
+    //NOTE: pending bytes are moved to the buffer start, so a whole message always fits after them
+    if (inOffset > 0) {
+        memmove(in.data(), in.data() + inOffset, inLength - inOffset);
+        inLength -= inOffset;
+        inOffset = 0;
+    }
+
+    //NOTE: large messages (i.e. raw pictures) are read at once while the socket has their bytes
+    do {
+        if (in.size() - inLength < LINK_READ_CHUNK) {
+            in.resize(inLength + LINK_READ_CHUNK);
+        }
+
+        received = recv(peerFd, in.data() + inLength, in.size() - inLength, MSG_DONTWAIT);
+
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            utils::warningMsg("FrameLinkReceiver: sender on " + getName() + " disconnected");
+            closePeer();
+            return total > 0;
+        }
+
+        if (received > 0) {
+            inLength += received;
+            bytes += received;
+            total += received;
+        }
+    } while (received > 0 && !messageReady());
+
+    return total > 0;
+}
+
+bool FrameLinkReceiver::messageReady()
+{
+    LinkHeader header;
+
+    if (inLength - inOffset < LINK_HEADER_SIZE) {
+        return false;
+    }
+
+    //NOTE: an invalid header is ready too, nextFrame closes the link then
+    return !FrameLink::readHeader(in.data() + inOffset, header) ||
+           inLength - inOffset >= LINK_HEADER_SIZE + header.length;
+}
+
+bool FrameLinkReceiver::nextFrame(Frame* frame)
+{
+    LinkHeader header;
+    const uint8_t* message;
+
+    while (inLength - inOffset >= LINK_HEADER_SIZE) {
+        message = in.data() + inOffset;
+
+        if (!FrameLink::readHeader(message, header)) {
+            utils::warningMsg("FrameLinkReceiver: invalid message on " + getName() + ", closing the link");
+            closePeer();
+            return false;
+        }
+
+        if (inLength - inOffset < LINK_HEADER_SIZE + header.length) {
+            return false;
+        }
+
+        inOffset += LINK_HEADER_SIZE + header.length;
+
+        if (header.type == LINK_STREAM) {
+            updateStream(message + LINK_HEADER_SIZE, header.length);
+            continue;
+        }
+
+        if (copyFrame(header, message + LINK_HEADER_SIZE, frame)) {
+            frames++;
+            return true;
+        }
+
+        dropped++;
+    }
+
+    return false;
+}
+
+void FrameLinkReceiver::updateStream(const uint8_t* payload, size_t length)
+{
+    StreamInfo si;
+    std::shared_ptr<const ExtraData> current, announced;
+
+    if (!FrameLink::readStream(payload, length, &si) || !FrameLink::sameStream(&si, oStreamInfo)) {
+        utils::warningMsg("FrameLinkReceiver: the sender on " + getName() +
+                          " announces a different stream, its frames are dropped");
+        sameStream = false;
+        return;
+    }
+
+    sameStream = true;
+
+    current = oStreamInfo->getExtraData();
+    announced = si.getExtraData();
+    oStreamInfo->bitrate = si.bitrate;
+
+    //NOTE: readers only pick up a new extradata version if it actually changes
+    if ((!current && !announced) || (current && announced && *current == *announced)) {
+        return;
+    }
+
+    oStreamInfo->setExtraData(announced ? announced->data() : NULL, announced ? announced->size() : 0);
+}
+
+bool FrameLinkReceiver::copyFrame(const LinkHeader& header, const uint8_t* payload, Frame* frame)
+{
+    VideoFrame* vFrame;
+    AudioFrame* aFrame;
+
+    if (!sameStream) {
+        return false;
+    }
+
+    if ((vFrame = dynamic_cast<VideoFrame*>(frame)) && oStreamInfo->video.codec == RAW) {
+        if (!copyPicture(payload, header.length, vFrame)) {
+            return false;
+        }
+    } else if (frame->isPlanar()) {
+        if (!copySamples(payload, header.length, frame)) {
+            return false;
+        }
+    } else if (header.length > frame->getMaxLength()) {
+        utils::warningMsg("FrameLinkReceiver - frame larger than the frame buffer, dropping it");
+        return false;
+    } else {
+        memcpy(frame->getDataBuf(), payload, header.length);
+        frame->setLength(header.length);
+    }
+
+    frame->setPresentationTime(std::chrono::microseconds(header.pts));
+    frame->setDecodeTime(std::chrono::microseconds(header.dts));
+
+    if (vFrame && oStreamInfo->video.frameTypes) {
+        vFrame->setFrameType(header.flags & LINK_KEY_FRAME, header.flags & LINK_REFERENCE);
+    } else if ((aFrame = dynamic_cast<AudioFrame*>(frame))) {
+        aFrame->setSamples(header.samples);
+    }
+
+    return true;
+}
+
+bool FrameLinkReceiver::copyPicture(const uint8_t* payload, size_t length, VideoFrame* frame)
+{
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int lineBytes, rows;
+    size_t offset = LINK_PICTURE_SIZE;
+    LinkPicture picture;
+    PixType pixelFormat;
+
+    if (!FrameLink::readPicture(payload, length, picture) ||
+        (pixelFormat = (PixType) (int16_t) picture.pixelFormat) != oStreamInfo->video.pixelFormat) {
+        utils::warningMsg("FrameLinkReceiver - invalid picture, dropping it");
+        return false;
+    }
+
+    frame->fitBuffer(picture.width, picture.height, pixelFormat);
+
+    if (frame->getPlanes(data, linesize) == 0) {
+        return false;
+    }
+
+    //NOTE: lines are copied one by one only if the sender and the frame pad them differently
+    for (unsigned i = 0; i < picture.planes; i++) {
+        VideoFrame::planeSize(pixelFormat, picture.width, picture.height, i, lineBytes, rows);
+
+        if ((int) picture.stride[i] == linesize[i]) {
+            memcpy(data[i], payload + offset, (size_t) linesize[i]*(rows - 1) + lineBytes);
+        } else {
+            for (int r = 0; r < rows; r++) {
+                memcpy(data[i] + (size_t) r*linesize[i], payload + offset + (size_t) r*picture.stride[i], lineBytes);
+            }
+        }
+
+        offset += (size_t) picture.stride[i]*(rows - 1) + lineBytes;
+    }
+
+    return true;
+}
+
+bool FrameLinkReceiver::copySamples(const uint8_t* payload, size_t length, Frame* frame)
+{
+    AudioFrame* aFrame = dynamic_cast<AudioFrame*>(frame);
+    size_t channelLength;
+
+    if (!aFrame || aFrame->getChannels() == 0 || length % aFrame->getChannels() != 0 ||
+        (channelLength = length / aFrame->getChannels()) > frame->getMaxLength()) {
+        utils::warningMsg("FrameLinkReceiver - invalid planar samples, dropping them");
+        return false;
+    }
+
+    for (unsigned i = 0; i < aFrame->getChannels(); i++) {
+        memcpy(frame->getPlanarDataBuf()[i], payload + i*channelLength, channelLength);
+    }
+
+    frame->setLength(channelLength);
+
+    return true;
+}
+
+bool FrameLinkReceiver::doProcessFrame(FrameMap &dstFrames, int& ret)
+{
+    Frame* frame = dstFrames.begin()->second;
+
+    frame->setConsumed(false);
+    ret = 0;
+
+    if (listenFd < 0) {
+        ret = LINK_IDLE_RETRY;
+        return false;
+    }
+
+    //NOTE: frames already buffered are delivered before reading again
+    if (!nextFrame(frame) && (!readPeer(peerFd >= 0 ? LINK_WAIT : 0) || !nextFrame(frame))) {
+        ret = peerFd >= 0 ? 0 : LINK_IDLE_RETRY;
+        return false;
+    }
+
+    frame->setConsumed(true);
+
+    return true;
+}
+
+FrameQueue* FrameLinkReceiver::allocQueue(ConnectionData cData)
+{
+    if (oStreamInfo->type == VIDEO) {
+        return VideoFrameQueue::createNew(cData, oStreamInfo, DEFAULT_VIDEO_FRAMES);
+    }
+
+    return AudioFrameQueue::createNew(cData, oStreamInfo, DEFAULT_AUDIO_FRAMES);
+}
+
+size_t FrameLinkReceiver::getInternalBytes()
+{
+    return in.capacity();
+}
+
+void FrameLinkReceiver::initializeEventMap()
+{
+    eventMap["listen"] = std::bind(&FrameLinkReceiver::listenEvent, this, std::placeholders::_1);
+}
+
+bool FrameLinkReceiver::listenEvent(Jzon::Node* params)
+{
+    if (params && params->Has("path")) {
+        return listenPath(params->Get("path").ToString());
+    }
+
+    if (!params || !params->Has("port") || !params->Get("port").IsNumber()) {
+        return false;
+    }
+
+    return listenPort(params->Get("port").ToInt());
+}
+
+void FrameLinkReceiver::doGetState(Jzon::Object &filterNode)
+{
+    if (path.empty()) {
+        filterNode.Add("port", (int) port);
+    } else {
+        filterNode.Add("path", path);
+    }
+
+    filterNode.Add("connected", peerFd >= 0);
+    filterNode.Add("peers", (int) peers);
+    filterNode.Add("frames", (int) frames);
+    filterNode.Add("bytes", (double) bytes);
+    filterNode.Add("dropped", (int) dropped);
+    filterNode.Add("sameStream", sameStream);
+
+    if (oStreamInfo->type == VIDEO) {
+        filterNode.Add("codec", utils::getVideoCodecAsString(oStreamInfo->video.codec));
+    } else {
+        filterNode.Add("codec", utils::getAudioCodecAsString(oStreamInfo->audio.codec));
+    }
+}
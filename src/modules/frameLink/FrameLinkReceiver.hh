@@ -0,0 +1,115 @@
+/*
+ *  FrameLinkReceiver - Head filter receiving a stream from another process or node
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _FRAME_LINK_RECEIVER_HH
+#define _FRAME_LINK_RECEIVER_HH
+
+#include <string>
+#include <vector>
+
+#include "../../Filter.hh"
+#include "../../VideoFrame.hh"
+#include "FrameLink.hh"
+
+#define LINK_WAIT           10              //!< Longest wait for a frame in msec, the worker is blocked meanwhile
+#define LINK_IDLE_RETRY     100000          //!< Wait in usec before checking again a link with no peer
+#define LINK_READ_CHUNK     (256*1024)      //!< Bytes read at once from the connection
+
+/*! HeadFilter injecting into the pipeline the frames a FrameLinkSender of another process or node sends.
+    It listens on a TCP port or a Unix socket path and serves a single peer, a new connection replaces
+    the previous one, so a sender
+    reconnecting after a network failure is taken back at once. The output stream is declared when the
+    filter is created, since queues are created before any peer connects, and the stream descriptions
+    the senders announce only update its extradata. Frames of a different stream are dropped.
+*/
+class FrameLinkReceiver : public HeadFilter {
+
+public:
+    /**
+    * Creates a new receiver, not listening yet
+    * @param si description of the output stream, see FrameLink::isLinkable. It is copied
+    * @return FrameLinkReceiver object or NULL if the stream cannot be linked
+    */
+    static FrameLinkReceiver* createNew(const StreamInfo& si);
+
+    ~FrameLinkReceiver();
+
+    /**
+    * Listens for the sender on a TCP port, any previous port and peer are closed
+    * @param port TCP port
+    * @return false if the port cannot be bound
+    */
+    bool listenPort(unsigned port);
+
+    /**
+    * Listens for a sender of the same host on a Unix socket, any previous port and peer are closed
+    * @param path socket path, a stale socket left there is replaced
+    * @return false if the path cannot be bound
+    */
+    bool listenPath(std::string path);
+
+protected:
+    FrameLinkReceiver(const StreamInfo& si);
+
+private:
+    bool doProcessFrame(FrameMap &dstFrames, int& ret);
+    FrameQueue *allocQueue(ConnectionData cData);
+
+    void doGetState(Jzon::Object &filterNode);
+    size_t getInternalBytes();
+    void initializeEventMap();
+    bool listenEvent(Jzon::Node* params);
+
+    //NOTE: There is no need of specific writer configuration
+    bool specificWriterConfig(int /*writerID*/) {return true;};
+    bool specificWriterDelete(int /*writerID*/) {return true;};
+
+    bool listenOn(int fd, struct sockaddr* address, socklen_t length, std::string name);
+    void closeListen();
+    std::string getName() const {return path.empty() ? "port " + std::to_string(port) : path;};
+    void acceptPeer();
+    void closePeer();
+    bool readPeer(int timeout);
+    bool messageReady();
+    bool nextFrame(Frame* frame);
+    void updateStream(const uint8_t* payload, size_t length);
+    bool copyFrame(const LinkHeader& header, const uint8_t* payload, Frame* frame);
+    bool copyPicture(const uint8_t* payload, size_t length, VideoFrame* frame);
+    bool copySamples(const uint8_t* payload, size_t length, Frame* frame);
+
+    StreamInfo* oStreamInfo;
+    unsigned port;
+    std::string path;
+    int listenFd;
+    int peerFd;
+    std::vector<uint8_t> in;
+    size_t inOffset;
+    size_t inLength;
+    bool sameStream;                        //!< The sender announces the declared stream
+
+    size_t frames;
+    size_t bytes;
+    size_t dropped;
+    size_t peers;
+};
+
+#endif
@@ -0,0 +1,665 @@
+/*
+ *  FrameLinkSender - Tail filter sending a stream to another process or node
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+
+#include "FrameLinkSender.hh"
+#include "../../VideoFrame.hh"
+#include "../../Utils.hh"
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define LINK_ZEROCOPY
+#endif
+
+FrameLinkSender::FrameLinkSender() : TailFilter(1), streamInfo(NULL), extradataVersion(0), port(0),
+    addressLength(0), fd(-1), connecting(false), streamSent(false), waitKey(false), backpressure(false),
+    zeroCopy(false), zeroCopySocket(false), pendingOffset(0), messageIov(0), messageLength(0), held(false),
+    heldOffset(0), zeroCopySent(0), zeroCopyDone(0), frames(0), bytes(0), dropped(0), connections(0),
+    heldFrames(0), zeroCopyFrames(0), zeroCopyCopied(0)
+{
+    fType = FRAME_LINK_SENDER;
+    initializeEventMap();
+}
+
+FrameLinkSender::~FrameLinkSender()
+{
+    disconnect();
+}
+
+bool FrameLinkSender::configure(std::string host_, unsigned port_)
+{
+    struct addrinfo hints, *result;
+
+    if (port_ == 0 || port_ > 65535) {
+        utils::errorMsg("Error configuring FrameLinkSender: invalid port");
+        return false;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &result) != 0 || !result) {
+        utils::errorMsg("Error configuring FrameLinkSender: could not resolve " + host_);
+        return false;
+    }
+
+    memcpy(&address, result->ai_addr, result->ai_addrlen);
+    addressLength = result->ai_addrlen;
+    freeaddrinfo(result);
+
+    disconnect();
+    host = host_;
+    port = port_;
+    path.clear();
+
+    //NOTE: the new peer is connected right away
+    lastAttempt = std::chrono::steady_clock::time_point();
+
+    return true;
+}
+
+bool FrameLinkSender::configurePath(std::string path_)
+{
+    struct sockaddr_un* unixAddress = (struct sockaddr_un*) &address;
+
+    if (path_.empty() || path_.size() >= sizeof(unixAddress->sun_path)) {
+        utils::errorMsg("Error configuring FrameLinkSender: invalid socket path");
+        return false;
+    }
+
+    disconnect();
+
+    memset(&address, 0, sizeof(address));
+    unixAddress->sun_family = AF_UNIX;
+    memcpy(unixAddress->sun_path, path_.c_str(), path_.size());
+    addressLength = sizeof(struct sockaddr_un);
+
+    host.clear();
+    port = 0;
+    path = path_;
+    lastAttempt = std::chrono::steady_clock::time_point();
+
+    return true;
+}
+
+bool FrameLinkSender::setZeroCopy(bool enabled)
+{
+#ifndef LINK_ZEROCOPY
+    if (enabled) {
+        utils::errorMsg("Error configuring FrameLinkSender: MSG_ZEROCOPY is not supported");
+        return false;
+    }
+#endif
+
+    //NOTE: it applies from the next connection, the current one may have frames in flight
+    zeroCopy = enabled;
+    return true;
+}
+
+bool FrameLinkSender::connectPeer()
+{
+    int error = 0;
+    int enable = 1;
+    socklen_t length = sizeof(error);
+    std::chrono::steady_clock::time_point now;
+
+    if (fd >= 0 && !connecting) {
+        return true;
+    }
+
+    if (fd >= 0) {
+        struct pollfd pfd = {fd, POLLOUT, 0};
+
+        if (poll(&pfd, 1, 0) <= 0) {
+            return false;
+        }
+
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+            disconnect();
+            return false;
+        }
+
+        connecting = false;
+        connections++;
+        return true;
+    }
+
+    now = std::chrono::steady_clock::now();
+
+    if (addressLength == 0 || now - lastAttempt < std::chrono::milliseconds(LINK_RETRY)) {
+        return false;
+    }
+
+    lastAttempt = now;
+
+    if ((fd = socket(address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        utils::errorMsg("FrameLinkSender: could not create socket");
+        return false;
+    }
+
+    if (address.ss_family != AF_UNIX) {
+        //NOTE: frames are written whole, so small ones are not worth delaying
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+#ifdef LINK_ZEROCOPY
+        if (zeroCopy && !(zeroCopySocket = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0)) {
+            utils::warningMsg("FrameLinkSender: MSG_ZEROCOPY not available, frames are copied");
+        }
+#endif
+    }
+
+    if (::connect(fd, (struct sockaddr*) &address, addressLength) == 0) {
+        connections++;
+        return true;
+    }
+
+    if (errno != EINPROGRESS) {
+        disconnect();
+        return false;
+    }
+
+    connecting = true;
+    return false;
+}
+
+void FrameLinkSender::disconnect()
+{
+    //NOTE: pages still in flight stay pinned by the kernel, so held frames can be released
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    fd = -1;
+    connecting = false;
+    streamSent = false;
+    zeroCopySocket = false;
+    zeroCopySent = 0;
+    zeroCopyDone = 0;
+    pending.clear();
+    pendingOffset = 0;
+
+    //NOTE: the receiver gets a new stream, which has to begin at a keyframe
+    waitKey = streamInfo && streamInfo->type == VIDEO && streamInfo->video.frameTypes;
+}
+
+bool FrameLinkSender::flush()
+{
+    ssize_t written;
+
+    while (pendingOffset < pending.size()) {
+        written = ::send(fd, pending.data() + pendingOffset, pending.size() - pendingOffset, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return false;
+        }
+
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (written <= 0) {
+            utils::warningMsg("FrameLinkSender: connection to " + (path.empty() ? host : path) + " lost");
+            disconnect();
+            return false;
+        }
+
+        pendingOffset += written;
+    }
+
+    pending.clear();
+    pendingOffset = 0;
+
+    return true;
+}
+
+ssize_t FrameLinkSender::writeMessage(size_t offset, int flags)
+{
+    struct iovec iov[LINK_MAX_IOV];
+    struct msghdr msg;
+    ssize_t written;
+    int count = 0;
+
+    for (int i = 0; i < messageIov; i++) {
+        if (offset >= message[i].iov_len) {
+            offset -= message[i].iov_len;
+            continue;
+        }
+
+        iov[count].iov_base = (uint8_t*) message[i].iov_base + offset;
+        iov[count++].iov_len = message[i].iov_len - offset;
+        offset = 0;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    do {
+        written = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL | flags);
+    } while (written < 0 && errno == EINTR);
+
+    //NOTE: ENOBUFS means that too many zero copy pages are pinned, they are freed as the peer acks
+    if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+        return 0;
+    }
+
+    if (written < 0) {
+        utils::warningMsg("FrameLinkSender: connection to " + (path.empty() ? host : path) + " lost");
+        disconnect();
+        return -1;
+    }
+
+    if (flags != 0) {
+        zeroCopySent++;
+    }
+
+    return written;
+}
+
+void FrameLinkSender::queueRemainder(size_t written)
+{
+    const uint8_t* base;
+
+    //NOTE: only the bytes the socket did not take are copied
+    for (int i = 0; i < messageIov; i++) {
+        if (written >= message[i].iov_len) {
+            written -= message[i].iov_len;
+            continue;
+        }
+
+        base = (const uint8_t*) message[i].iov_base;
+        pending.insert(pending.end(), base + written, base + message[i].iov_len);
+        written = 0;
+    }
+}
+
+void FrameLinkSender::readCompletions()
+{
+#ifdef LINK_ZEROCOPY
+    uint8_t control[128];
+    struct msghdr msg;
+    struct cmsghdr* cmsg;
+    struct sock_extended_err* err;
+
+    while (fd >= 0 && zeroCopyDone != zeroCopySent) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+
+            err = (struct sock_extended_err*) CMSG_DATA(cmsg);
+
+            if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY || err->ee_errno != 0) {
+                continue;
+            }
+
+            //NOTE: each notification covers the range of sendmsg calls from ee_info to ee_data
+            zeroCopyDone += err->ee_data - err->ee_info + 1;
+
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                zeroCopyCopied += err->ee_data - err->ee_info + 1;
+            }
+        }
+    }
+#endif
+}
+
+void FrameLinkSender::sendStream()
+{
+    std::vector<uint8_t> payload(LINK_STREAM_SIZE);
+    std::shared_ptr<const ExtraData> extradata;
+    LinkHeader h = {LINK_MAGIC, LINK_VERSION, LINK_STREAM, 0, 0, 0, 0, 0, 0};
+    ssize_t written = 0;
+
+    //NOTE: the version is taken first, so a change meanwhile is sent again with the next frame
+    extradataVersion = streamInfo->getExtraDataVersion();
+    extradata = streamInfo->getExtraData();
+    FrameLink::writeStream(payload.data(), streamInfo);
+
+    if (extradata) {
+        payload.insert(payload.end(), extradata->begin(), extradata->end());
+    }
+
+    h.length = payload.size();
+    FrameLink::writeHeader(header, h);
+
+    message[0].iov_base = header;
+    message[0].iov_len = LINK_HEADER_SIZE;
+    message[1].iov_base = payload.data();
+    message[1].iov_len = payload.size();
+    messageIov = 2;
+    messageLength = LINK_HEADER_SIZE + payload.size();
+
+    if (pending.empty() && (written = writeMessage(0, 0)) < 0) {
+        return;
+    }
+
+    if ((size_t) written < messageLength) {
+        queueRemainder(written);
+    }
+
+    streamSent = true;
+}
+
+bool FrameLinkSender::buildFrame(Frame* frame)
+{
+    LinkHeader h = {LINK_MAGIC, LINK_VERSION, LINK_FRAME, 0, 0,
+                    frame->getPresentationTime().count(), frame->getDecodeTime().count(),
+                    (uint32_t) frame->getSequenceNumber(), 0};
+    VideoFrame* vFrame = dynamic_cast<VideoFrame*>(frame);
+    AudioFrame* aFrame = dynamic_cast<AudioFrame*>(frame);
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int lineBytes, rows;
+    LinkPicture p;
+
+    messageIov = 1;
+    messageLength = 0;
+
+    //NOTE: planes are sent from where they are, padded lines included
+    if (vFrame && streamInfo->video.codec == RAW) {
+        if (vFrame->getPlanes(data, linesize) == 0) {
+            return false;
+        }
+
+        memset(&p, 0, sizeof(p));
+        p.width = vFrame->getWidth();
+        p.height = vFrame->getHeight();
+        p.pixelFormat = vFrame->getPixelFormat();
+
+        message[messageIov].iov_base = picture;
+        message[messageIov++].iov_len = LINK_PICTURE_SIZE;
+
+        for (unsigned i = 0; i < MAX_PLANES && data[i] &&
+                VideoFrame::planeSize(vFrame->getPixelFormat(), p.width, p.height, i, lineBytes, rows); i++) {
+            p.stride[i] = linesize[i];
+            p.planes++;
+            message[messageIov].iov_base = data[i];
+            message[messageIov++].iov_len = (size_t) linesize[i]*(rows - 1) + lineBytes;
+        }
+
+        FrameLink::writePicture(picture, p);
+    } else if (aFrame && frame->isPlanar()) {
+        for (unsigned i = 0; i < aFrame->getChannels() && i < MAX_CHANNELS; i++) {
+            message[messageIov].iov_base = frame->getPlanarDataBuf()[i];
+            message[messageIov++].iov_len = frame->getLength();
+        }
+        h.samples = aFrame->getSamples();
+    } else {
+        message[messageIov].iov_base = frame->getDataBuf();
+        message[messageIov++].iov_len = frame->getLength();
+
+        if (vFrame && streamInfo->video.frameTypes) {
+            h.flags = (vFrame->isKeyFrame() ? LINK_KEY_FRAME : 0) | (vFrame->isReference() ? LINK_REFERENCE : 0);
+        } else if (aFrame) {
+            h.samples = aFrame->getSamples();
+        }
+    }
+
+    for (int i = 1; i < messageIov; i++) {
+        messageLength += message[i].iov_len;
+    }
+
+    if (messageLength > LINK_MAX_PAYLOAD) {
+        return false;
+    }
+
+    h.length = messageLength;
+    FrameLink::writeHeader(header, h);
+
+    message[0].iov_base = header;
+    message[0].iov_len = LINK_HEADER_SIZE;
+    messageLength += LINK_HEADER_SIZE;
+
+    return true;
+}
+
+bool FrameLinkSender::sendFrame(Frame* frame, int& ret)
+{
+    VideoFrame* vFrame = dynamic_cast<VideoFrame*>(frame);
+    bool frameTypes = streamInfo->type == VIDEO && streamInfo->video.frameTypes;
+
+    if (waitKey && !(vFrame && frameTypes && vFrame->isKeyFrame())) {
+        dropped++;
+        return true;
+    }
+
+    if (!buildFrame(frame)) {
+        dropped++;
+        return true;
+    }
+
+    if (!backpressure && pending.size() - pendingOffset >= LINK_MAX_PENDING) {
+        waitKey = frameTypes;
+        dropped++;
+        return true;
+    }
+
+    waitKey = false;
+    heldOffset = 0;
+
+    if (!backpressure && !pending.empty()) {
+        queueRemainder(0);
+        frames++;
+        bytes += messageLength;
+        return true;
+    }
+
+    held = true;
+    return sendHeld(ret);
+}
+
+bool FrameLinkSender::sendHeld(int& ret)
+{
+    bool zc = zeroCopySocket && messageLength >= LINK_ZEROCOPY_MIN;
+    ssize_t written;
+
+    //NOTE: a lost connection drops the frame, the next one starts a new stream
+    if (fd < 0) {
+        held = false;
+        dropped++;
+        return true;
+    }
+
+    if (heldOffset < messageLength) {
+        if (!flush() || (written = writeMessage(heldOffset, zc ? MSG_ZEROCOPY : 0)) < 0) {
+            if (fd < 0) {
+                held = false;
+                dropped++;
+                return true;
+            }
+            written = 0;
+        }
+
+        heldOffset += written;
+
+        //NOTE: copied frames do not need to be held, the socket takes their rest later
+        if (heldOffset < messageLength && !backpressure && !zc) {
+            queueRemainder(heldOffset);
+            heldOffset = messageLength;
+        }
+
+        if (heldOffset == messageLength) {
+            frames++;
+            bytes += messageLength;
+            zeroCopyFrames += zc ? 1 : 0;
+        }
+    }
+
+    readCompletions();
+
+    if (heldOffset < messageLength || zeroCopyDone != zeroCopySent) {
+        ret = LINK_HOLD_RETRY;
+        return false;
+    }
+
+    held = false;
+    return true;
+}
+
+bool FrameLinkSender::doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& ret)
+{
+    int readerId;
+
+    if (!streamInfo || orgFrames.empty()) {
+        return true;
+    }
+
+    readerId = orgFrames.begin()->first;
+
+    //NOTE: a held frame stays at the front of its queue, so it is only removed once it is sent
+    if (held) {
+        if (!sendHeld(ret)) {
+            newFrames.clear();
+        } else if (std::find(newFrames.begin(), newFrames.end(), readerId) == newFrames.end()) {
+            newFrames.push_back(readerId);
+        }
+        return true;
+    }
+
+    if (newFrames.empty()) {
+        return true;
+    }
+
+    //NOTE: frames are dropped while there is no connection, the receiver starts from the current ones
+    if (!connectPeer()) {
+        dropped++;
+        return true;
+    }
+
+    if (!flush() && fd < 0) {
+        dropped++;
+        return true;
+    }
+
+    if (!streamSent || extradataVersion != streamInfo->getExtraDataVersion()) {
+        sendStream();
+    }
+
+    if (fd >= 0 && !sendFrame(orgFrames[readerId], ret)) {
+        heldFrames++;
+        newFrames.clear();
+    }
+
+    return true;
+}
+
+bool FrameLinkSender::specificReaderConfig(int /*readerId*/, FrameQueue* queue)
+{
+    if (!FrameLink::isLinkable(queue->getStreamInfo())) {
+        utils::errorMsg("Error setting FrameLinkSender reader: the stream cannot be linked");
+        return false;
+    }
+
+    streamInfo = queue->getStreamInfo();
+    held = false;
+    disconnect();
+
+    return true;
+}
+
+bool FrameLinkSender::specificReaderDelete(int /*readerId*/)
+{
+    disconnect();
+    held = false;
+    streamInfo = NULL;
+    return true;
+}
+
+size_t FrameLinkSender::getInternalBytes()
+{
+    return pending.capacity();
+}
+
+void FrameLinkSender::initializeEventMap()
+{
+    eventMap["configure"] = std::bind(&FrameLinkSender::configureEvent, this, std::placeholders::_1);
+}
+
+bool FrameLinkSender::configureEvent(Jzon::Node* params)
+{
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("backpressure") && params->Get("backpressure").IsBool()) {
+        setBackpressure(params->Get("backpressure").ToBool());
+    }
+
+    if (params->Has("zeroCopy") && params->Get("zeroCopy").IsBool() &&
+        !setZeroCopy(params->Get("zeroCopy").ToBool())) {
+        return false;
+    }
+
+    if (params->Has("path")) {
+        return configurePath(params->Get("path").ToString());
+    }
+
+    if (params->Has("host") && params->Has("port") && params->Get("port").IsNumber()) {
+        return configure(params->Get("host").ToString(), params->Get("port").ToInt());
+    }
+
+    return true;
+}
+
+void FrameLinkSender::doGetState(Jzon::Object &filterNode)
+{
+    if (path.empty()) {
+        filterNode.Add("host", host);
+        filterNode.Add("port", (int) port);
+    } else {
+        filterNode.Add("path", path);
+    }
+
+    filterNode.Add("connected", fd >= 0 && !connecting);
+    filterNode.Add("connections", (int) connections);
+    filterNode.Add("backpressure", backpressure);
+    filterNode.Add("zeroCopy", zeroCopySocket);
+    filterNode.Add("frames", (int) frames);
+    filterNode.Add("bytes", (double) bytes);
+    filterNode.Add("dropped", (int) dropped);
+    filterNode.Add("held", held);
+    filterNode.Add("heldFrames", (int) heldFrames);
+    filterNode.Add("zeroCopyFrames", (int) zeroCopyFrames);
+    filterNode.Add("zeroCopyCopied", (int) zeroCopyCopied);
+    filterNode.Add("pendingBytes", (int) (pending.size() - pendingOffset));
+}
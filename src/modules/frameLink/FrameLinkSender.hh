@@ -0,0 +1,144 @@
+/*
+ *  FrameLinkSender - Tail filter sending a coded stream to another node
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _FRAME_LINK_SENDER_HH
+#define _FRAME_LINK_SENDER_HH
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#include "../../Filter.hh"
+#include "../../AudioFrame.hh"
+#include "FrameLink.hh"
+
+#define LINK_MAX_PENDING    (8*1024*1024)   //!< Unsent bytes from which frames are dropped
+#define LINK_RETRY          500             //!< Milliseconds between connection attempts
+#define LINK_HOLD_RETRY     1000            //!< Wait in usec before sending again a held frame
+#define LINK_ZEROCOPY_MIN   (64*1024)       //!< Smaller frames are copied, pinning their pages costs more
+#define LINK_MAX_IOV        (2 + MAX_CHANNELS)
+
+/*! TailFilter sending the frames of its single reader to a FrameLinkReceiver of another process or
+    node, through a TCP or Unix socket connection carrying FrameLink messages. Coded frames, raw
+    pictures and planar samples are written straight from the queue, header and planes gathered in a
+    single sendmsg call. If the socket does not take the whole frame, only its unsent bytes are copied,
+    and once LINK_MAX_PENDING bytes are waiting frames are dropped and, for streams with frame types,
+    sending starts again at the next keyframe. With backpressure the frame is held at the front of
+    its queue instead, until the socket takes it, so a slow peer fills the queue and stalls the
+    filters feeding it. With zero copy the frames of TCP links from LINK_ZEROCOPY_MIN bytes on are
+    sent with MSG_ZEROCOPY and held until the kernel is done with their pages. Lost connections are
+    opened again every LINK_RETRY, the stream description goes first, frames are dropped meanwhile.
+*/
+class FrameLinkSender : public TailFilter {
+
+public:
+    FrameLinkSender();
+    ~FrameLinkSender();
+
+    /**
+    * Sets the receiver address, the connection is opened with the first frame
+    * @param host receiver host name or address
+    * @param port receiver TCP port
+    * @return false if the address is not valid
+    */
+    bool configure(std::string host, unsigned port);
+
+    /**
+    * Sets the receiver Unix socket, for receivers of the same host
+    * @param path socket path the receiver listens on
+    * @return false if the path is not valid
+    */
+    bool configurePath(std::string path);
+
+    /**
+    * @param enabled frames are held in their queue while the peer does not take them, instead of
+    * being dropped
+    */
+    void setBackpressure(bool enabled) {backpressure = enabled;};
+
+    /**
+    * @param enabled large frames are sent with MSG_ZEROCOPY, see LINK_ZEROCOPY_MIN
+    * @return false if the system does not support it
+    */
+    bool setZeroCopy(bool enabled);
+
+private:
+    bool doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& ret);
+    bool hasPendingOutput() {return held;};
+    void doGetState(Jzon::Object &filterNode);
+    size_t getInternalBytes();
+    bool specificReaderConfig(int readerId, FrameQueue* queue);
+    bool specificReaderDelete(int readerId);
+    void initializeEventMap();
+    bool configureEvent(Jzon::Node* params);
+
+    bool connectPeer();
+    void disconnect();
+    bool flush();
+    void sendStream();
+    bool buildFrame(Frame* frame);
+    bool sendFrame(Frame* frame, int& ret);
+    bool sendHeld(int& ret);
+    ssize_t writeMessage(size_t offset, int flags);
+    void queueRemainder(size_t written);
+    void readCompletions();
+
+    const StreamInfo* streamInfo;
+    unsigned extradataVersion;
+    std::string host;
+    unsigned port;
+    std::string path;
+    struct sockaddr_storage address;
+    socklen_t addressLength;
+    int fd;
+    bool connecting;
+    bool streamSent;
+    bool waitKey;
+    bool backpressure;
+    bool zeroCopy;
+    bool zeroCopySocket;
+    std::chrono::steady_clock::time_point lastAttempt;
+    std::vector<uint8_t> pending;
+    size_t pendingOffset;
+
+    uint8_t header[LINK_HEADER_SIZE];
+    uint8_t picture[LINK_PICTURE_SIZE];
+    struct iovec message[LINK_MAX_IOV];     //!< Message being sent, its payload points to the frame
+    int messageIov;
+    size_t messageLength;
+    bool held;                              //!< The frame is kept in the queue until it is sent
+    size_t heldOffset;
+    uint32_t zeroCopySent;
+    uint32_t zeroCopyDone;
+
+    size_t frames;
+    size_t bytes;
+    size_t dropped;
+    size_t connections;
+    size_t heldFrames;
+    size_t zeroCopyFrames;
+    size_t zeroCopyCopied;
+};
+
+#endif
@@ -23,6 +23,7 @@
 
 #include "HeadDemuxerLibav.hh"
 #include "../../AVFramedQueue.hh"
+#include "../../NalSplitter.hh"
 
 HeadDemuxerLibav::HeadDemuxerLibav() : HeadFilter ()
 {
@@ -31,10 +32,25 @@ HeadDemuxerLibav::HeadDemuxerLibav() : HeadFilter ()
     avformat_network_init();
 
     av_ctx = NULL;
-    av_filter_annexb = NULL;
 
     av_pkt.data = NULL;
-    buffer = NULL;
+    bufferOffset = 0;
+    parameterSet = -1;
+    packetSideData = false;
+
+    stopReading = true;
+    readAhead = DEMUX_READ_AHEAD_PACKETS;
+    endOfStream = false;
+    readPackets = 0;
+    readStalls = 0;
+
+    program = DEMUX_ALL_PROGRAMS;
+    discardChanged = false;
+
+    mappedIO = DEMUX_MAPPED_IO;
+    avio = NULL;
+
+    rate = 0;
 
     fType = DEMUXER;
 
@@ -55,24 +71,29 @@ HeadDemuxerLibav::~HeadDemuxerLibav()
 
 void HeadDemuxerLibav::reset()
 {
+    // The read-ahead thread uses the context, stop it first
+    stopReadAhead();
+    connectedStreams.clear();
+    discardChanged = false;
+
     if (av_ctx) {
         avformat_close_input (&av_ctx);
     }
     av_ctx = NULL;
 
-    if (av_filter_annexb) {
-        av_bitstream_filter_close(av_filter_annexb);
-    }
-    av_filter_annexb = NULL;
-
-    if (buffer && buffer != av_pkt.data) {
-        free(buffer);
+    //NOTE: libav does not free custom I/O contexts
+    if (avio) {
+        av_freep(&avio->buffer);
+        av_freep(&avio);
     }
-    buffer = NULL;
+    mappedFile.close();
 
     if (av_pkt.data) {
         av_packet_unref(&av_pkt);
     }
+    parameterSet = -1;
+    packetSideData = false;
+    paceOrigin = -1;
 
     // Free stream infos
     for (auto sinfo : outputStreamInfos) {
@@ -87,34 +108,235 @@ void HeadDemuxerLibav::reset()
     privateStreamInfos.clear();
 }
 
-static int findStartCode(uint8_t *buffer, int offs, int buffer_length)
+int HeadDemuxerLibav::interruptCallback(void *opaque)
+{
+    return ((HeadDemuxerLibav*) opaque)->stopReading ? 1 : 0;
+}
+
+bool HeadDemuxerLibav::openMappedIO()
 {
-    while (offs < buffer_length - 3) {
-        if (buffer[offs + 0] == 0 && buffer[offs + 1] == 0) {
-            if (buffer[offs + 2] == 1) {
-                return offs;
+    uint8_t *buffer;
+
+    if (!mappedIO || !mappedFile.open(uri)) {
+        return false;
+    }
+
+    if (!(buffer = (uint8_t*) av_malloc(DEMUX_MAPPED_IO_BUFFER))) {
+        mappedFile.close();
+        return false;
+    }
+
+    avio = avio_alloc_context(buffer, DEMUX_MAPPED_IO_BUFFER, 0, &mappedFile, mappedRead, NULL, mappedSeek);
+    if (!avio) {
+        av_free(buffer);
+        mappedFile.close();
+        return false;
+    }
+
+    av_ctx->pb = avio;
+    av_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    return true;
+}
+
+int HeadDemuxerLibav::mappedRead(void *opaque, uint8_t *buf, int size)
+{
+    size_t bytes = ((MappedFile*) opaque)->read(buf, size);
+
+    return bytes > 0 ? (int) bytes : AVERROR_EOF;
+}
+
+int64_t HeadDemuxerLibav::mappedSeek(void *opaque, int64_t offset, int whence)
+{
+    MappedFile *file = (MappedFile*) opaque;
+
+    if (whence & AVSEEK_SIZE) {
+        return file->getSize();
+    }
+
+    return file->seek(offset, whence & ~AVSEEK_FORCE);
+}
+
+void HeadDemuxerLibav::readLoop()
+{
+    AVPacket pkt;
+    int res;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(packetsMtx);
+            packetsCv.wait(lock, [this]{return stopReading || packets.size() < readAhead;});
+            if (stopReading) {
+                return;
+            }
+            if (discardChanged) {
+                applyDiscard();
+            }
+        }
+
+        av_init_packet (&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+
+        // This is the only call which may block on network inputs, it is aborted
+        // through the interrupt callback
+        res = av_read_frame (av_ctx, &pkt);
+
+        if (res == AVERROR(EAGAIN)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(DEMUX_READ_RETRY));
+            continue;
+        }
+
+        std::lock_guard<std::mutex> guard(packetsMtx);
+
+        if (res < 0) {
+            if (!stopReading) {
+                char err[1024];
+                av_make_error_string(err, sizeof(err), res);
+                utils::infoMsg("HeadDemuxerLibav - end of input (" + uri + "): " + err);
             }
-            if (buffer[offs + 2] == 0 && buffer[offs + 3] == 1) {
-                return offs;
+            endOfStream = true;
+            return;
+        }
+
+        // The queue takes the packet references
+        packets.push_back(pkt);
+        readPackets++;
+    }
+}
+
+void HeadDemuxerLibav::stopReadAhead()
+{
+    {
+        std::lock_guard<std::mutex> guard(packetsMtx);
+        stopReading = true;
+    }
+    packetsCv.notify_all();
+
+    if (readThread.joinable()) {
+        readThread.join();
+    }
+
+    for (auto &pkt : packets) {
+        av_packet_unref(&pkt);
+    }
+    packets.clear();
+    endOfStream = false;
+}
+
+bool HeadDemuxerLibav::isSelected(unsigned index)
+{
+    AVProgram *prog;
+
+    if (!pids.empty() && pids.count(av_ctx->streams[index]->id) == 0) {
+        return false;
+    }
+
+    if (program == DEMUX_ALL_PROGRAMS) {
+        return true;
+    }
+
+    for (unsigned p = 0; p < av_ctx->nb_programs; p++) {
+        prog = av_ctx->programs[p];
+        if (prog->id != program) {
+            continue;
+        }
+        for (unsigned i = 0; i < prog->nb_stream_indexes; i++) {
+            if (prog->stream_index[i] == index) {
+                return true;
             }
         }
-        offs++;
     }
-    return -1;
+
+    return false;
 }
 
-bool HeadDemuxerLibav::doProcessFrame(std::map<int, Frame*> &dstFrames, int& ret)
+void HeadDemuxerLibav::updateConnectedStreams(FrameMap &dstFrames)
+{
+    bool changed;
+
+    //NOTE: until some writer is connected every selected stream is read, otherwise
+    //a local file would be read to its end before connecting the outputs
+    if (dstFrames.empty()) {
+        return;
+    }
+
+    // Only this thread modifies the set, it can be compared without locking
+    changed = dstFrames.size() != connectedStreams.size();
+    auto frame = dstFrames.begin();
+    for (auto it = connectedStreams.begin(); !changed && it != connectedStreams.end(); it++, frame++) {
+        changed = frame->first != *it;
+    }
+
+    if (!changed) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(packetsMtx);
+    connectedStreams.clear();
+    for (auto &f : dstFrames) {
+        connectedStreams.insert(f.first);
+    }
+    discardChanged = true;
+}
+
+void HeadDemuxerLibav::applyDiscard()
+{
+    unsigned discarded = 0;
+
+    for (unsigned i = 0; i < av_ctx->nb_streams; i++) {
+        if (privateStreamInfos.count(i) > 0 && (connectedStreams.empty() || connectedStreams.count(i) > 0)) {
+            av_ctx->streams[i]->discard = AVDISCARD_DEFAULT;
+        } else {
+            av_ctx->streams[i]->discard = AVDISCARD_ALL;
+            discarded++;
+        }
+    }
+
+    utils::debugMsg("HeadDemuxerLibav - discarding " + std::to_string(discarded) + " of " +
+        std::to_string(av_ctx->nb_streams) + " streams");
+    discardChanged = false;
+}
+
+bool HeadDemuxerLibav::popPacket(AVPacket &pkt)
+{
+    std::lock_guard<std::mutex> guard(packetsMtx);
+
+    if (packets.empty()) {
+        if (!endOfStream) {
+            readStalls++;
+        }
+        return false;
+    }
+
+    pkt = packets.front();
+    packets.pop_front();
+    packetsCv.notify_one();
+
+    return true;
+}
+
+bool HeadDemuxerLibav::inputEnded()
+{
+    std::lock_guard<std::mutex> guard(packetsMtx);
+
+    return av_ctx && endOfStream && packets.empty() && !av_pkt.data;
+}
+
+bool HeadDemuxerLibav::doProcessFrame(FrameMap &dstFrames, int& ret)
 {
     PrivateStreamInfo *psi;
+    Frame *f;
+    int dst_size;
 
     if (!av_ctx) return false;
 
+    updateConnectedStreams(dstFrames);
+
     if (!av_pkt.data) {
-        // Ask libav for a new data packet
-        av_init_packet (&av_pkt);
-        av_pkt.data = NULL;
-        av_pkt.size = 0;
-        if (av_read_frame (av_ctx, &av_pkt) < 0) {
+        // Take a packet from the read-ahead queue, the worker never waits for the input
+        if (!popPacket(av_pkt)) {
+            ret = DEMUX_READ_AHEAD_WAIT;
             return false;
         }
         if (privateStreamInfos.count(av_pkt.stream_index) == 0) {
@@ -122,34 +344,26 @@ bool HeadDemuxerLibav::doProcessFrame(std::map<int, Frame*> &dstFrames, int& ret
             av_packet_unref(&av_pkt);
             return false;
         }
+        if (dstFrames.count(av_pkt.stream_index) == 0) {
+            // Packets read before libav discards the stream are dropped before framing them
+            av_packet_unref(&av_pkt);
+            return false;
+        }
         bufferOffset = 0;
+        parameterSet = -1;
+        packetSideData = av_pkt.side_data_elems > 0;
         psi = privateStreamInfos[av_pkt.stream_index];
         if (av_pkt.pts != AV_NOPTS_VALUE){
             psi->lastPTS = av_pkt.pts;
             psi->lastDTS = av_pkt.dts;
         }
-        if (psi->needsFraming && !psi->isAnnexB) {
-            // Convert to Annex B (adding startcodes) using temp buffer
-            int res;
-            res = av_bitstream_filter_filter (av_filter_annexb,
-                    av_ctx->streams[av_pkt.stream_index]->codec,
-                    NULL, &buffer, &bufferSize, av_pkt.data,
-                    av_pkt.size, av_pkt.flags & AV_PKT_FLAG_KEY);
-            if (res < 0) {
-                av_packet_unref(&av_pkt);
-                buffer = 0;
-                return false;
-            }
-            if (res == 0 && buffer != av_pkt.data) {
-                // No buffer has been allocated, take some precautions so we do not
-                // try to free it later on
-                bufferOffset = buffer - av_pkt.data;
-                buffer = av_pkt.data;
-            }
-        } else {
-            // Processing the packet directly
-            buffer = av_pkt.data;
-            bufferSize = av_pkt.size;
+        if (rate > 0) {
+            pacePacket(psi);
+        }
+        // AVCC key frames get the extradata parameter sets, unless they already carry them
+        if (psi->needsFraming && psi->nalLengthSize > 0 && (av_pkt.flags & AV_PKT_FLAG_KEY) &&
+                !psi->parameterSets.empty() && !avccHasSps(psi)) {
+            parameterSet = 0;
         }
     } else {
         psi = privateStreamInfos[av_pkt.stream_index];
@@ -157,49 +371,46 @@ bool HeadDemuxerLibav::doProcessFrame(std::map<int, Frame*> &dstFrames, int& ret
 
     if (dstFrames.count(av_pkt.stream_index) == 0) {
         // Discard packet if output corresponding to this stream is not connected
-        if (buffer != av_pkt.data) {
-            free(buffer);
-        }
-        buffer = NULL;
         av_packet_unref(&av_pkt);
+        parameterSet = -1;
+        return false;
+    }
+
+    // Paced packets wait for their time, the filter is scheduled again then
+    if (rate > 0 && std::chrono::steady_clock::now() < packetDue) {
+        ret = std::chrono::duration_cast<std::chrono::microseconds>(packetDue - std::chrono::steady_clock::now()).count();
         return false;
     }
 
     // Find corresponding output frame
-    Frame *f = dstFrames[av_pkt.stream_index];
+    f = dstFrames[av_pkt.stream_index];
 
-    // Copy to destination frame, framing if necessary
-    uint8_t *dst_data = f->getDataBuf();
-    int dst_size = bufferSize;
+    // Packets are written straight to the destination frame, framing if necessary
     if (psi->needsFraming) {
-        // Split on startcode boundaries
-        int start = findStartCode(buffer, bufferOffset, bufferSize);
-        if (start == -1) {
-            utils::errorMsg("Malformed Annex B stream (could not find start code)");
-        }
-
-        int end = findStartCode(buffer, bufferOffset + 4, bufferSize - 4);
-        bufferOffset = end;
-        if (end == -1) {
-            end = bufferSize;
-        }
-        dst_size = end - start;
-
-        // LMS does not like short startcodes, so detect them and turn into long startcodes
-        if (buffer[start + 2] == 1) {
-            dst_data[0] = 0;
-            dst_data++;
+        dst_size = writeNal(psi, f);
+        if (dst_size == 0) {
+            av_packet_unref(&av_pkt);
+            parameterSet = -1;
+            return false;
         }
-        memcpy(dst_data, buffer + start, dst_size);
-        if (buffer[start + 2] == 1) dst_size++;
-
     } else {
-        // No conversion needed, just copy
-        memcpy (dst_data, buffer, bufferSize);
+        if (av_pkt.size > (int) f->getMaxLength()) {
+            utils::warningMsg("HeadDemuxerLibav - packet larger than the frame buffer, dropping it");
+            av_packet_unref(&av_pkt);
+            return false;
+        }
+        memcpy (f->getDataBuf(), av_pkt.data, av_pkt.size);
+        dst_size = av_pkt.size;
         bufferOffset = -1;
     }
     f->setConsumed(true);
     f->setLength(dst_size);
+
+    // Packet metadata goes with the first frame written from it
+    if (packetSideData) {
+        copySideData(f);
+        packetSideData = false;
+    }
         
     if (av_pkt.pts == AV_NOPTS_VALUE) {
         f->setPresentationTime(
@@ -215,21 +426,180 @@ bool HeadDemuxerLibav::doProcessFrame(std::map<int, Frame*> &dstFrames, int& ret
                 (int64_t)(av_pkt.dts * psi->streamTimeBase * std::micro::den) + av_ctx->start_time_realtime));
     }
 
-    if (bufferOffset == -1) {
-        if (buffer != av_pkt.data) {
-            free(buffer);
-        }
-        buffer = NULL;
+    if (bufferOffset == -1 && parameterSet == -1) {
         av_packet_unref(&av_pkt);
     }
 
     return true;
 }
 
+void HeadDemuxerLibav::copySideData(Frame *f)
+{
+    for (int i = 0; i < av_pkt.side_data_elems; i++) {
+        AVPacketSideData &sd = av_pkt.side_data[i];
+
+        if (sd.type == AV_PKT_DATA_A53_CC) {
+            f->getSideData().add(SD_CAPTIONS, sd.data, sd.size);
+        }
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 134, 100)
+        if (sd.type == AV_PKT_DATA_S12M_TIMECODE) {
+            f->getSideData().add(SD_TIMECODE, sd.data, sd.size);
+        }
+#endif
+    }
+}
+
+void HeadDemuxerLibav::pacePacket(PrivateStreamInfo *psi)
+{
+    int64_t decodeTime = (int64_t)(psi->lastDTS * psi->streamTimeBase * std::micro::den);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    if (paceOrigin < 0 || decodeTime < paceOrigin) {
+        paceOrigin = decodeTime;
+        paceStart = now;
+    }
+
+    packetDue = paceStart + std::chrono::microseconds((int64_t)((decodeTime - paceOrigin) / rate));
+}
+
+int HeadDemuxerLibav::writeNal(PrivateStreamInfo *psi, Frame *f)
+{
+    uint8_t *dst_data = f->getDataBuf();
+    unsigned maxLength = f->getMaxLength();
+    uint8_t const* pktEnd = av_pkt.data + av_pkt.size;
+    uint8_t const* nal;
+    int nalSize;
+
+    if (parameterSet >= 0) {
+        const std::vector<uint8_t> &ps = psi->parameterSets[parameterSet];
+        if (++parameterSet == (int) psi->parameterSets.size()) {
+            parameterSet = -1;
+        }
+        if (ps.size() > maxLength) {
+            return 0;
+        }
+        memcpy(dst_data, ps.data(), ps.size());
+        return ps.size();
+    }
+
+    if (psi->nalLengthSize > 0) {
+        // AVCC, the length prefix is replaced by a start code while copying
+        nalSize = 0;
+        for (int i = 0; i < psi->nalLengthSize && bufferOffset + i < av_pkt.size; i++) {
+            nalSize = (nalSize << 8) | av_pkt.data[bufferOffset + i];
+        }
+        nal = av_pkt.data + bufferOffset + psi->nalLengthSize;
+        if (nalSize <= 0 || nal + nalSize > pktEnd) {
+            utils::errorMsg("Malformed AVCC stream (invalid NALU length)");
+            return 0;
+        }
+        bufferOffset += psi->nalLengthSize + nalSize;
+        if (bufferOffset >= av_pkt.size) {
+            bufferOffset = -1;
+        }
+    } else {
+        // Split on startcode boundaries
+        unsigned startLength, endLength;
+        uint8_t const* start = NalSplitter::findStartCode(av_pkt.data + bufferOffset, pktEnd, startLength);
+        if (!start) {
+            utils::errorMsg("Malformed Annex B stream (could not find start code)");
+            return 0;
+        }
+
+        uint8_t const* end = NalSplitter::findStartCode(start + startLength, pktEnd, endLength);
+        bufferOffset = end ? end - av_pkt.data : -1;
+        if (!end) {
+            end = pktEnd;
+        }
+        nal = start + startLength;
+        nalSize = end - nal;
+    }
+
+    if (nalSize + LONG_START_CODE_LENGTH > (int) maxLength) {
+        utils::warningMsg("HeadDemuxerLibav - NALU larger than the frame buffer, dropping the packet");
+        return 0;
+    }
+
+    // LMS does not like short startcodes, so every NALU gets a long one
+    dst_data[0] = 0;
+    dst_data[1] = 0;
+    dst_data[2] = 0;
+    dst_data[3] = 1;
+    memcpy(dst_data + LONG_START_CODE_LENGTH, nal, nalSize);
+
+    return nalSize + LONG_START_CODE_LENGTH;
+}
+
+bool HeadDemuxerLibav::avccHasSps(PrivateStreamInfo *psi)
+{
+    int offset = 0;
+    int nalSize;
+
+    while (offset + psi->nalLengthSize < av_pkt.size) {
+        nalSize = 0;
+        for (int i = 0; i < psi->nalLengthSize; i++) {
+            nalSize = (nalSize << 8) | av_pkt.data[offset + i];
+        }
+        offset += psi->nalLengthSize;
+        if (nalSize <= 0 || offset + nalSize > av_pkt.size) {
+            return false;
+        }
+        if ((av_pkt.data[offset] & 0x1F) == 7) {
+            return true;
+        }
+        offset += nalSize;
+    }
+
+    return false;
+}
+
+bool HeadDemuxerLibav::parseAvcc(const uint8_t *data, int size, PrivateStreamInfo *psi)
+{
+    int offset = 5;
+    int count, length;
+
+    // AVCDecoderConfigurationRecord: version, profile, compatibility, level, length size
+    if (size < 7 || data[0] != 1) {
+        return false;
+    }
+    psi->nalLengthSize = (data[4] & 0x03) + 1;
+    psi->parameterSets.clear();
+
+    // SPS count and SPS, then PPS count and PPS
+    for (int set = 0; set < 2; set++) {
+        if (offset >= size) {
+            return false;
+        }
+        count = set == 0 ? data[offset] & 0x1F : data[offset];
+        offset++;
+        for (int i = 0; i < count; i++) {
+            if (offset + 2 > size) {
+                return false;
+            }
+            length = (data[offset] << 8) | data[offset + 1];
+            offset += 2;
+            if (offset + length > size) {
+                return false;
+            }
+            std::vector<uint8_t> nal = {0, 0, 0, 1};
+            nal.insert(nal.end(), data + offset, data + offset + length);
+            psi->parameterSets.push_back(nal);
+            offset += length;
+        }
+    }
+
+    return true;
+}
+
 FrameQueue *HeadDemuxerLibav::allocQueue(ConnectionData cData)
 {
     // Create output queue for the kind of stream associated with this wId
-    const StreamInfo *si = outputStreamInfos[cData.writerId];
+    auto it = outputStreamInfos.find(cData.writerId);
+    if (it == outputStreamInfos.end()) {
+        // Not selected, or not a stream of the input
+        return NULL;
+    }
+    const StreamInfo *si = it->second;
     switch (si->type) {
         case AUDIO:
             return AudioFrameQueue::createNew(cData, si, DEFAULT_AUDIO_FRAMES);
@@ -244,10 +614,27 @@ FrameQueue *HeadDemuxerLibav::allocQueue(ConnectionData cData)
 void HeadDemuxerLibav::doGetState(Jzon::Object &filterNode)
 {
     filterNode.Add("uri", uri);
+    {
+        std::lock_guard<std::mutex> guard(packetsMtx);
+        filterNode.Add("readAhead", (int)readAhead);
+        filterNode.Add("queuedPackets", (int)packets.size());
+        filterNode.Add("readPackets", (int)readPackets);
+        filterNode.Add("endOfStream", endOfStream);
+    }
+    filterNode.Add("readStalls", (int)readStalls);
+    filterNode.Add("mappedIO", avio != NULL);
+    filterNode.Add("rate", rate);
+    filterNode.Add("program", program);
+    Jzon::Array jpids;
+    for (int pid : pids) {
+        jpids.Add(pid);
+    }
+    filterNode.Add("pids", jpids);
     Jzon::Array jstreams;
     for (auto it : outputStreamInfos) {
         Jzon::Object s;
         s.Add("wId", it.first);
+        s.Add("pid", av_ctx->streams[it.first]->id);
         s.Add("type", it.second->type);
         switch (it.second->type) {
             case AUDIO:
@@ -276,6 +663,19 @@ bool HeadDemuxerLibav::setURI(const std::string URI)
 
     int res;
 
+    // Blocking calls on this context are aborted when the read-ahead stops
+    stopReading = false;
+    readPackets = 0;
+    readStalls = 0;
+    av_ctx = avformat_alloc_context();
+    av_ctx->interrupt_callback.callback = interruptCallback;
+    av_ctx->interrupt_callback.opaque = this;
+
+    // Local files are read from a memory mapping, any other URI through its libav protocol
+    if (openMappedIO()) {
+        utils::infoMsg("HeadDemuxerLibav - reading " + URI + " through a memory mapping");
+    }
+
     // Try to open the URI
     res = avformat_open_input(&av_ctx, uri.c_str(), NULL, NULL);
     if (res < 0) {
@@ -294,13 +694,23 @@ bool HeadDemuxerLibav::setURI(const std::string URI)
         return false;
     }
 
+    // Streams out of the selected program and PIDs are discarded by libav without parsing them
+    for (unsigned p = 0; p < av_ctx->nb_programs; p++) {
+        if (program != DEMUX_ALL_PROGRAMS && av_ctx->programs[p]->id != program) {
+            av_ctx->programs[p]->discard = AVDISCARD_ALL;
+        }
+    }
+
     // Build StreamInfos and map them through wId
     for (unsigned int i=0; i<av_ctx->nb_streams; i++) {
+        if (!isSelected(i)) {
+            av_ctx->streams[i]->discard = AVDISCARD_ALL;
+            continue;
+        }
         const AVCodecDescriptor* cdesc =
                 avcodec_descriptor_get(av_ctx->streams[i]->codec->codec_id);
         StreamInfo *si = new StreamInfo();
         PrivateStreamInfo *psi = new PrivateStreamInfo();
-        memset(psi, 0, sizeof(PrivateStreamInfo));
         psi->lastPTS = 0;
         psi->lastDTS = 0;
         if (cdesc) {
@@ -310,6 +720,7 @@ bool HeadDemuxerLibav::setURI(const std::string URI)
                     si->audio.codec = utils::getAudioCodecFromLibavString(cdesc->name);
                     si->audio.sampleRate = av_ctx->streams[i]->codec->sample_rate;
                     si->audio.channels = av_ctx->streams[i]->codec->channels;
+                    si->audio.channelLayout = utils::getDefaultChannelLayout(si->audio.channels);
                     si->audio.sampleFormat = getSampleFormatFromLibav (
                             av_ctx->streams[i]->codec->sample_fmt);
                     // Overwrite libav values with our per-codec defaults
@@ -340,14 +751,10 @@ bool HeadDemuxerLibav::setURI(const std::string URI)
                     // First byte of AVCC extradata is always 1 (version)
                     // AnnexB extradata starts with either 0x000001 or 0x00000001
                     psi->isAnnexB = (data[0] == 0);
-                    if (!psi->isAnnexB) {
-                        // This is AVCC, we need conversion
-                        av_filter_annexb = av_bitstream_filter_init ("h264_mp4toannexb");
-                        if (av_filter_annexb == NULL) {
-                            utils::warningMsg("Could not find suitable libav filter to convert stream to Annexb");
-                            // We actually need framing, but we have no filter
-                            psi->needsFraming = false;
-                        }
+                    if (!psi->isAnnexB && !parseAvcc(data, av_ctx->streams[i]->codec->extradata_size, psi)) {
+                        // This is AVCC, we need conversion but the extradata cannot be parsed
+                        utils::warningMsg("Could not parse AVCC extradata to convert stream to Annexb");
+                        psi->needsFraming = false;
                     }
                     // Always report AnnexB, framed format, since we do all conversions
                     si->video.h264or5.annexb = true;
@@ -363,6 +770,43 @@ bool HeadDemuxerLibav::setURI(const std::string URI)
         privateStreamInfos[i] = psi;
     }
 
+    if (outputStreamInfos.empty()) {
+        utils::errorMsg("HeadDemuxerLibav - no stream of " + URI + " matches the program and PIDs selected");
+        return false;
+    }
+
+    readThread = std::thread(&HeadDemuxerLibav::readLoop, this);
+
+    return true;
+}
+
+bool HeadDemuxerLibav::setRate(double rate_)
+{
+    if (rate_ < 0) {
+        return false;
+    }
+
+    rate = rate_;
+    paceOrigin = -1;
+
+    return true;
+}
+
+bool HeadDemuxerLibav::selectStreams(int program_, std::vector<int> pids_)
+{
+    if (program_ < 0 && program_ != DEMUX_ALL_PROGRAMS) {
+        return false;
+    }
+
+    for (int pid : pids_) {
+        if (pid < 0) {
+            return false;
+        }
+    }
+
+    program = program_;
+    pids = std::set<int>(pids_.begin(), pids_.end());
+
     return true;
 }
 
@@ -390,6 +834,42 @@ bool HeadDemuxerLibav::configureEvent(Jzon::Node* params)
         return false;
     }
 
+    //NOTE: it applies to the next URI
+    if (params->Has("mappedIO") && params->Get("mappedIO").IsBool()) {
+        mappedIO = params->Get("mappedIO").ToBool();
+    }
+
+    if (params->Has("rate") && !setRate(params->Get("rate").ToDouble())) {
+        return false;
+    }
+
+    //NOTE: it applies to the next URI as well, missing values keep the current selection
+    if (params->Has("program") || params->Has("pids")) {
+        int prog = params->Has("program") ? params->Get("program").ToInt() : program;
+        std::vector<int> ids(pids.begin(), pids.end());
+
+        if (params->Has("pids")) {
+            if (!params->Get("pids").IsArray()) {
+                return false;
+            }
+            Jzon::Array jsonPids = params->Get("pids").AsArray();
+            ids.clear();
+            for (Jzon::Array::iterator it = jsonPids.begin(); it != jsonPids.end(); ++it) {
+                ids.push_back((*it).ToInt());
+            }
+        }
+
+        if (!selectStreams(prog, ids)) {
+            return false;
+        }
+    }
+
+    if (params->Has("readAhead") && params->Get("readAhead").ToInt() > 0) {
+        std::lock_guard<std::mutex> guard(packetsMtx);
+        readAhead = params->Get("readAhead").ToInt();
+        packetsCv.notify_all();
+    }
+
     if (params->Has("uri")) {
         if(setURI(params->Get("uri").ToString())){
             return true;
@@ -397,6 +877,7 @@ bool HeadDemuxerLibav::configureEvent(Jzon::Node* params)
             return false;
         }
     } else {
-        return false;
+        return params->Has("readAhead") || params->Has("mappedIO") || params->Has("rate") ||
+            params->Has("program") || params->Has("pids");
     }
 }
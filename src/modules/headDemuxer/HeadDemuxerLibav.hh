@@ -29,15 +29,38 @@ extern "C" {
 #include <libavutil/avutil.h>
 }
 
+#include <deque>
+#include <chrono>
+#include <vector>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 #include "../../Filter.hh"
 #include "../../StreamInfo.hh"
+#include "MappedFile.hh"
+
+#define DEMUX_READ_AHEAD_PACKETS    128     //!< Default packets read in advance by the read-ahead thread
+#define DEMUX_READ_AHEAD_WAIT       2000    //!< Wait in usec before asking again for a packet when none has been read yet
+#define DEMUX_READ_RETRY            10      //!< Wait in msec before reading again when the input asks for it
+#define DEMUX_MAPPED_IO             true    //!< Local files are read through a memory mapping by default
+#define DEMUX_MAPPED_IO_BUFFER      (256*1024)  //!< Bytes of the libav I/O buffer of mapped files
+#define DEMUX_ALL_PROGRAMS          -1      //!< Default program selection, streams of every program are demuxed
+
 /** Source + Demuxer filter based on libav.
   * Its only configuration is an input URI, which instantiates the adecuate
   * source (file or network) and demuxer.
   * It produces one writer for each stream contained in the muxed file.
   * Use #BaseFilter::getState() to retrieve the description of the streams and their
   * writerId so you can connect further filters (typically, decoders).
+  * Packets are read by a read-ahead thread into a bounded queue, so a stalled
+  * network read never blocks a pool worker. Local files are read through a
+  * memory mapping instead of the libav file protocol, see MappedFile.
+  * A program and a set of PIDs can be selected, i.e. for multi-program TS inputs,
+  * and only the selected streams get writers. Once writers are connected, libav
+  * discards the packets of unconnected streams without parsing them.
   */
 class HeadDemuxerLibav : public HeadFilter {
 
@@ -50,8 +73,21 @@ class HeadDemuxerLibav : public HeadFilter {
          */
         bool setURI(const std::string URI);
 
+        /** Paces the input by the packets decode times, i.e. to replay recorded files
+         * @param rate playback speed, 1 is real time and 0 reads as fast as possible
+         * @returns FALSE if the rate is negative
+         */
+        bool setRate(double rate);
+
+        /** Selects the streams of the next URI, the others are discarded and get no writer
+         * @param program program number, i.e. MPEG-TS program_number, or DEMUX_ALL_PROGRAMS
+         * @param pids stream ids, i.e. MPEG-TS PIDs, empty selects every stream of the program
+         * @returns FALSE if the program or a PID is negative
+         */
+        bool selectStreams(int program, std::vector<int> pids);
+
     protected:
-        virtual bool doProcessFrame(std::map<int, Frame*> &dstFrames, int& ret);
+        virtual bool doProcessFrame(FrameMap &dstFrames, int& ret);
         virtual FrameQueue *allocQueue(ConnectionData cData);
         virtual void doGetState(Jzon::Object &filterNode);
 
@@ -68,6 +104,10 @@ class HeadDemuxerLibav : public HeadFilter {
             bool needsFraming;
             /* Whether the input is H264 in AVCC or Annex B format */
             bool isAnnexB;
+            /* Bytes of the AVCC NALU length fields, zero for Annex B input */
+            int nalLengthSize;
+            /* SPS and PPS from the AVCC extradata, with start codes, sent before key frames */
+            std::vector<std::vector<uint8_t>> parameterSets;
             /* Initialized to zero, it keeps the last valid pts, in order to be used 
              * in case an AV_NOPTS_VALUE is found in av_pkt*/
             int64_t lastPTS;
@@ -92,25 +132,103 @@ class HeadDemuxerLibav : public HeadFilter {
         /** Libav media context. Created on #setURI(), destroyed on filter destruction
          * or subsequent #setURI(). */
         AVFormatContext *av_ctx;
-        /** Libav filter required to convert H264 AVCC to AnnexB */
-        AVBitStreamFilterContext *av_filter_annexb;
         /** Packet being processed, in case it contains more than one NALU and it needs
          * to be persisted among multiple calls to doProcessFrame. */
         AVPacket av_pkt;
 
-        /** Working buffer. It might point inside av_pkt, or to a temp buffer needed
-         * when converting H264 from AVCC to AnnexB */
-        uint8_t *buffer;
-        int bufferSize;
+        /** Offset of the next NALU inside av_pkt */
         int bufferOffset;
+        /** Next parameter set to send before the NALUs of av_pkt, -1 if none */
+        int parameterSet;
+        /** Whether the side data of av_pkt still has to be attached to a frame */
+        bool packetSideData;
+
+        /** Packets read in advance, guarded by #packetsMtx */
+        std::deque<AVPacket> packets;
+        std::mutex packetsMtx;
+        std::condition_variable packetsCv;
+        std::thread readThread;
+        /** Also checked by the libav interrupt callback, it aborts blocking reads */
+        std::atomic<bool> stopReading;
+        unsigned readAhead;
+        bool endOfStream;
+        size_t readPackets;
+        size_t readStalls;
+
+        /** Stream selection of the next URI, see #selectStreams */
+        int program;
+        std::set<int> pids;
+        /** Writers connected the last time a frame was processed, guarded by #packetsMtx.
+         * The read-ahead thread sets AVDISCARD_ALL on the other streams when it changes */
+        std::set<int> connectedStreams;
+        bool discardChanged;
+
+        /** Read local files through #mappedFile instead of the libav file protocol */
+        bool mappedIO;
+        MappedFile mappedFile;
+        /** Custom I/O context reading from #mappedFile, NULL if it is not used */
+        AVIOContext *avio;
+
+        /** Playback speed, 0 if packets are not paced */
+        double rate;
+        /** Decode time in usec of the first paced packet, -1 until it is read */
+        int64_t paceOrigin;
+        std::chrono::steady_clock::time_point paceStart;
+        /** When the packet being processed is due, see #setRate */
+        std::chrono::steady_clock::time_point packetDue;
 
         /** Clear all data, close all files */
         void reset();
 
+        /** Read-ahead thread loop, it fills #packets until it is full or the input ends */
+        void readLoop();
+        /** Copies the captions and timecodes of av_pkt to the frame side data */
+        void copySideData(Frame *f);
+        /** Stops and joins the read-ahead thread and frees the queued packets */
+        void stopReadAhead();
+        /** @return true if the stream belongs to the selected program and PIDs */
+        bool isSelected(unsigned index);
+        /** Updates #connectedStreams with the connected writers, the worker does it before
+         * taking a packet so discarded streams are never framed */
+        void updateConnectedStreams(FrameMap &dstFrames);
+        /** Sets the discard level of the streams, only called from the read-ahead thread
+         * once the demuxer is open, see #connectedStreams */
+        void applyDiscard();
+        /** Takes the next packet read in advance without waiting
+         * @return false if there is none */
+        bool popPacket(AVPacket &pkt);
+        /** In throughput mode the pipeline is drained once the input and the read-ahead
+         * packets are exhausted
+         * @return true if there are no more packets to demux */
+        bool inputEnded();
+        /** Libav interrupt callback, opaque is the demuxer */
+        static int interruptCallback(void *opaque);
+        /** Opens the custom I/O context of local files on #av_ctx
+         * @return false if the URI is not a local file which can be mapped */
+        bool openMappedIO();
+        /** Libav I/O callbacks, opaque is the MappedFile */
+        static int mappedRead(void *opaque, uint8_t *buf, int size);
+        static int64_t mappedSeek(void *opaque, int64_t offset, int whence);
+
+        /** Writes the next NALU of av_pkt, or the next pending parameter set,
+         * to the destination frame with a long start code
+         * @return NALU size, 0 if the packet is malformed */
+        int writeNal(PrivateStreamInfo *psi, Frame *f);
+        /** Parses AVCC extradata into the NALU length size and the parameter sets
+         * @return false if the extradata is not valid */
+        bool parseAvcc(const uint8_t *data, int size, PrivateStreamInfo *psi);
+        /** @return true if the AVCC packet already carries an SPS */
+        bool avccHasSps(PrivateStreamInfo *psi);
+
+        /** Sets when av_pkt is due, its decode time from the first paced packet scaled by #rate.
+         * Decode times going backwards, i.e. a looped input, start the pacing again */
+        void pacePacket(PrivateStreamInfo *psi);
+
         /** Initialize its events */
         void initializeEventMap();
 
-        /** This event sets the demuxer's input URI */
+        /** This event sets the demuxer's input URI, its read-ahead, mapped I/O, playback rate and
+         * the program and PIDs selected */
         bool configureEvent(Jzon::Node* params);
 
         /** Convert from Libav SampleFormat enum to ours */
@@ -0,0 +1,171 @@
+/*
+ *  MappedFile.cpp - Memory mapped reading of local input files
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors: Xavi Artigas <xavier.artigas@i2cat.net>
+ *           David Cassany <david.cassany@i2cat.net>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <algorithm>
+
+#include "MappedFile.hh"
+
+MappedFile::MappedFile() : data(NULL), size(0), position(0), prefetched(0)
+{
+    pageSize = sysconf(_SC_PAGESIZE);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+std::string MappedFile::localPath(std::string uri)
+{
+    if (uri.compare(0, 7, "file://") == 0) {
+        return uri.substr(7);
+    }
+
+    if (uri.compare(0, 5, "file:") == 0) {
+        return uri.substr(5);
+    }
+
+    // Any other protocol is not a local file
+    if (uri.find("://") != std::string::npos) {
+        return "";
+    }
+
+    return uri;
+}
+
+bool MappedFile::open(std::string path)
+{
+    struct stat st;
+    void *map;
+    int fd;
+
+    close();
+
+    path = localPath(path);
+    if (path.empty() || (fd = ::open(path.c_str(), O_RDONLY)) < 0) {
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // The mapping keeps a reference to the file, which can be closed
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    data = (uint8_t*) map;
+    size = st.st_size;
+    position = 0;
+    prefetched = 0;
+
+    madvise(data, size, MADV_SEQUENTIAL);
+    prefetch();
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data) {
+        munmap(data, size);
+    }
+
+    data = NULL;
+    size = 0;
+    position = 0;
+    prefetched = 0;
+}
+
+size_t MappedFile::read(uint8_t *buffer, size_t bytes)
+{
+    if (!data || position >= size) {
+        return 0;
+    }
+
+    bytes = std::min(bytes, size - position);
+    memcpy(buffer, data + position, bytes);
+    position += bytes;
+
+    prefetch();
+
+    return bytes;
+}
+
+int64_t MappedFile::seek(int64_t offset, int whence)
+{
+    int64_t target;
+
+    switch (whence) {
+        case SEEK_SET:
+            target = offset;
+            break;
+        case SEEK_CUR:
+            target = position + offset;
+            break;
+        case SEEK_END:
+            target = size + offset;
+            break;
+        default:
+            return -1;
+    }
+
+    if (!data || target < 0 || target > (int64_t) size) {
+        return -1;
+    }
+
+    // Prefetching starts again from the new position
+    if ((size_t) target < position || (size_t) target > prefetched) {
+        prefetched = target - target % pageSize;
+    }
+
+    position = target;
+    prefetch();
+
+    return position;
+}
+
+void MappedFile::prefetch()
+{
+    size_t length;
+
+    //NOTE: the next window is requested once half of the current one has been read
+    if (prefetched >= size || prefetched > position + MAPPED_FILE_PREFETCH/2) {
+        return;
+    }
+
+    length = std::min((size_t) MAPPED_FILE_PREFETCH, size - prefetched);
+    madvise(data + prefetched, length, MADV_WILLNEED);
+    prefetched += length;
+}
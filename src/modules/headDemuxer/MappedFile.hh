@@ -0,0 +1,85 @@
+/*
+ *  MappedFile.hh - Memory mapped reading of local input files
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors: Xavi Artigas <xavier.artigas@i2cat.net>
+ *           David Cassany <david.cassany@i2cat.net>
+ */
+
+#ifndef _MAPPED_FILE_HH
+#define _MAPPED_FILE_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#define MAPPED_FILE_PREFETCH    (4*1024*1024)   //!< Bytes the kernel is asked to read ahead of the read position
+
+/** Local file mapped in memory and read sequentially through it. The mapping is
+  * advised as sequential and the next MAPPED_FILE_PREFETCH bytes are requested in
+  * advance, so the pages are usually in memory before they are read. Reads are
+  * plain memory copies, with no system call per read as with buffered file reads.
+  */
+class MappedFile {
+
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        /** Maps a regular file
+         * @param path file path, a "file:" prefix is skipped
+         * @return false if the file cannot be opened, is empty or is not a regular file
+         */
+        bool open(std::string path);
+
+        /** Unmaps the file */
+        void close();
+
+        /** Copies the next bytes of the file
+         * @param buffer destination buffer
+         * @param size bytes to copy at most
+         * @return bytes copied, 0 at the end of the file
+         */
+        size_t read(uint8_t *buffer, size_t size);
+
+        /** Moves the read position
+         * @param offset new position relative to whence
+         * @param whence SEEK_SET, SEEK_CUR or SEEK_END
+         * @return the new position, -1 if it is out of the file
+         */
+        int64_t seek(int64_t offset, int whence);
+
+        bool isOpen() const {return data != NULL;};
+        size_t getSize() const {return size;};
+        size_t getPosition() const {return position;};
+
+        /** @return path without the "file:" prefix if it is a local file URI, empty otherwise */
+        static std::string localPath(std::string uri);
+
+    private:
+        /** Requests the pages of the next prefetch window if the read position gets close to it */
+        void prefetch();
+
+        uint8_t *data;
+        size_t size;
+        size_t position;
+        size_t prefetched;
+        size_t pageSize;
+};
+
+#endif
@@ -0,0 +1,290 @@
+/*
+ *  LoudnessNormalizer - EBU R128 loudness normalisation
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "LoudnessNormalizer.hh"
+#include "../../AudioCircularBuffer.hh"
+#include "../../Utils.hh"
+
+#include <cmath>
+#include <algorithm>
+
+/**
+* Applies a gain ramping linearly from gain to gain + step*n
+*/
+SIMD_KERNEL
+static void rampGain(float* __restrict__ samples, size_t n, float gain, float step)
+{
+    for (size_t i = 0; i < n; i++) {
+        samples[i] *= gain + step*i;
+    }
+}
+
+LoudnessNormalizer* LoudnessNormalizer::createNew(unsigned channels, unsigned sampleRate, SampleFmt sampleFormat)
+{
+    if (channels == 0 || channels > MAX_CHANNELS) {
+        utils::errorMsg("[LoudnessNormalizer] Error creating LoudnessNormalizer, up to " +
+                        std::to_string(MAX_CHANNELS) + " channels are supported");
+        return NULL;
+    }
+
+    if (!SampleConverter::getFromFloatKernel(sampleFormat)) {
+        utils::errorMsg("[LoudnessNormalizer] Error creating LoudnessNormalizer, sample format not supported");
+        return NULL;
+    }
+
+    if (sampleRate < 8000) {
+        utils::errorMsg("[LoudnessNormalizer] Error creating LoudnessNormalizer, sample rate not supported");
+        return NULL;
+    }
+
+    return new LoudnessNormalizer(channels, sampleRate, sampleFormat);
+}
+
+LoudnessNormalizer::LoudnessNormalizer(unsigned channels_, unsigned sampleRate_, SampleFmt sampleFormat_) :
+    OneToOneFilterT(), channels(channels_), sampleRate(sampleRate_), sampleFormat(sampleFormat_), toFloat(NULL),
+    inputFormat(S_NONE), target(LNORM_DEFAULT_TARGET), maxGain(LNORM_DEFAULT_MAX_GAIN),
+    smoothing(LNORM_DEFAULT_SMOOTHING), normalize(true), gainDb(0), gain(1.0)
+{
+    fromFloat = SampleConverter::getFromFloatKernel(sampleFormat, SampleConverter::isPlanar(sampleFormat) ? 1 : channels);
+    meter.configure(channels, sampleRate);
+    planes.resize(channels, std::vector<float>(AudioFrame::getMaxSamples(sampleRate)));
+
+    fType = LOUDNESS_NORMALIZER;
+    initializeEventMap();
+}
+
+LoudnessNormalizer::~LoudnessNormalizer()
+{
+}
+
+FrameQueue* LoudnessNormalizer::allocQueue(ConnectionData cData)
+{
+    return AudioCircularBuffer::createNew(cData, channels, sampleRate, DEFAULT_BUFFER_SIZE, sampleFormat);
+}
+
+bool LoudnessNormalizer::specificReaderConfig(int /*readerID*/, FrameQueue* queue)
+{
+    const StreamInfo* si = queue->getStreamInfo();
+
+    if (si->audio.channels != channels || si->audio.sampleRate != sampleRate) {
+        utils::errorMsg("[LoudnessNormalizer] Input must have " + std::to_string(channels) + " channels at " +
+                        std::to_string(sampleRate) + " Hz");
+        return false;
+    }
+
+    //NOTE: the input queue delivers frames of its own format, so the kernel reading them is fixed
+    toFloat = SampleConverter::getToFloatKernel(si->audio.sampleFormat,
+                                                SampleConverter::isPlanar(si->audio.sampleFormat) ? 1 : channels);
+
+    if (!toFloat) {
+        utils::errorMsg("[LoudnessNormalizer] Input sample format not supported");
+        return false;
+    }
+
+    inputFormat = si->audio.sampleFormat;
+
+    return true;
+}
+
+bool LoudnessNormalizer::doProcessFrame(AudioFrame *org, AudioFrame *dst)
+{
+    unsigned samples = org->getSamples();
+    unsigned inBytes = utils::getBytesPerSampleFromFormat(org->getSampleFmt());
+    unsigned outBytes = utils::getBytesPerSampleFromFormat(sampleFormat);
+    float const* pointers[MAX_CHANNELS];
+    unsigned char const* src;
+    unsigned char* out;
+    float start, step;
+
+    if (!toFloat || org->getSampleFmt() != inputFormat || org->getChannels() != channels) {
+        utils::errorMsg("[LoudnessNormalizer] Input frame format does not match the reader one");
+        return false;
+    }
+
+    if (samples == 0 || samples > dst->getMaxSamples()) {
+        return false;
+    }
+
+    for (unsigned c = 0; c < channels; c++) {
+        if (planes[c].size() < samples) {
+            planes[c].resize(samples);
+        }
+
+        src = org->isPlanar() ? org->getPlanarDataBuf()[c] : org->getDataBuf() + c*inBytes;
+        toFloat(src, planes[c].data(), samples, SampleConverter::isPlanar(inputFormat) ? 1 : channels);
+        pointers[c] = planes[c].data();
+    }
+
+    meter.process(pointers, samples);
+
+    start = gain;
+    gain = updateGain(samples);
+    step = (gain - start)/samples;
+
+    for (unsigned c = 0; c < channels; c++) {
+        out = dst->isPlanar() ? dst->getPlanarDataBuf()[c] : dst->getDataBuf() + c*outBytes;
+
+        //NOTE: a steady unity gain is not applied at all
+        if (start != 1.0 || step != 0) {
+            rampGain(planes[c].data(), samples, start, step);
+        }
+
+        fromFloat(planes[c].data(), out, samples, dst->isPlanar() ? 1 : channels);
+    }
+
+    dst->setSamples(samples);
+    dst->setLength(dst->isPlanar() ? samples*outBytes : channels*samples*outBytes);
+    dst->setConsumed(true);
+    dst->setPresentationTime(org->getPresentationTime());
+    dst->setDecodeTime(NO_DTS);
+    dst->setOriginTime(org->getOriginTime());
+    dst->setSequenceNumber(org->getSequenceNumber());
+
+    return true;
+}
+
+float LoudnessNormalizer::updateGain(unsigned samples)
+{
+    double measured = meter.getShortTerm();
+    double gate = std::max(LOUDNESS_ABSOLUTE_GATE, meter.getIntegrated() + LOUDNESS_RELATIVE_GATE);
+    double desired = 0;
+    double alpha = std::min(1.0, 1000.0*samples/sampleRate/smoothing);
+
+    //NOTE: quiet passages keep the gain, otherwise pauses would be raised to the target
+    if (normalize && measured <= gate) {
+        return gain;
+    }
+
+    if (normalize) {
+        desired = std::min(maxGain, std::max(LNORM_MIN_GAIN, target - measured));
+    }
+
+    gainDb += (desired - gainDb)*alpha;
+
+    return pow(10.0, gainDb/20.0);
+}
+
+bool LoudnessNormalizer::configure0(double target_, double maxGain_, unsigned smoothing_, bool normalize_)
+{
+    if (target_ < LOUDNESS_ABSOLUTE_GATE || target_ > 0) {
+        utils::errorMsg("[LoudnessNormalizer] Target must be between " + std::to_string((int) LOUDNESS_ABSOLUTE_GATE) +
+                        " and 0 LUFS");
+        return false;
+    }
+
+    if (maxGain_ < 0 || maxGain_ > -LNORM_MIN_GAIN || smoothing_ == 0) {
+        utils::errorMsg("[LoudnessNormalizer] Max gain must be between 0 and " + std::to_string((int) -LNORM_MIN_GAIN) +
+                        " dB and smoothing greater than 0");
+        return false;
+    }
+
+    target = target_;
+    maxGain = maxGain_;
+    smoothing = smoothing_;
+    normalize = normalize_;
+
+    return true;
+}
+
+void LoudnessNormalizer::initializeEventMap()
+{
+    eventMap["configure"] = std::bind(&LoudnessNormalizer::configureEvent, this, std::placeholders::_1);
+    eventMap["resetMeasurement"] = std::bind(&LoudnessNormalizer::resetEvent, this, std::placeholders::_1);
+}
+
+bool LoudnessNormalizer::configureEvent(Jzon::Node* params)
+{
+    double newTarget = target;
+    double newMaxGain = maxGain;
+    unsigned newSmoothing = smoothing;
+    bool newNormalize = normalize;
+
+    if (!params) {
+        utils::errorMsg("[LoudnessNormalizer::configureEvent] Params node not complete");
+        return false;
+    }
+
+    if (params->Has("target") && params->Get("target").IsNumber()) {
+        newTarget = params->Get("target").ToDouble();
+    }
+
+    if (params->Has("maxGain") && params->Get("maxGain").IsNumber()) {
+        newMaxGain = params->Get("maxGain").ToDouble();
+    }
+
+    if (params->Has("smoothing") && params->Get("smoothing").IsNumber() && params->Get("smoothing").ToInt() >= 0) {
+        newSmoothing = params->Get("smoothing").ToInt();
+    }
+
+    if (params->Has("normalize") && params->Get("normalize").IsBool()) {
+        newNormalize = params->Get("normalize").ToBool();
+    }
+
+    return configure0(newTarget, newMaxGain, newSmoothing, newNormalize);
+}
+
+bool LoudnessNormalizer::resetEvent(Jzon::Node* /*params*/)
+{
+    meter.reset();
+    return true;
+}
+
+bool LoudnessNormalizer::configure(double target, double maxGain, unsigned smoothing, bool normalize)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configure");
+    params.Add("target", target);
+    params.Add("maxGain", maxGain);
+    params.Add("smoothing", (int) smoothing);
+    params.Add("normalize", normalize);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
+
+bool LoudnessNormalizer::resetMeasurement()
+{
+    Jzon::Object root;
+    root.Add("action", "resetMeasurement");
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
+
+void LoudnessNormalizer::doGetState(Jzon::Object &filterNode)
+{
+    filterNode.Add("channels", (int) channels);
+    filterNode.Add("sampleRate", (int) sampleRate);
+    filterNode.Add("sampleFormat", utils::getSampleFormatAsString(sampleFormat));
+    filterNode.Add("normalize", normalize);
+    filterNode.Add("target", target);
+    filterNode.Add("maxGain", maxGain);
+    filterNode.Add("smoothing", (int) smoothing);
+    filterNode.Add("gain", gainDb);
+    filterNode.Add("momentary", meter.getMomentary());
+    filterNode.Add("shortTerm", meter.getShortTerm());
+    filterNode.Add("integrated", meter.getIntegrated());
+    filterNode.Add("gatingBlocks", (int) meter.getGatingBlocks());
+}
@@ -0,0 +1,120 @@
+/*
+ *  LoudnessNormalizer - EBU R128 loudness normalisation
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _LOUDNESS_NORMALIZER_HH
+#define _LOUDNESS_NORMALIZER_HH
+
+#include <vector>
+
+#include "../../Filter.hh"
+#include "../../AudioFrame.hh"
+#include "../../LoudnessMeter.hh"
+#include "../../SampleConverter.hh"
+
+#define LNORM_DEFAULT_TARGET -23.0      //!< LUFS, EBU R128 programme level
+#define LNORM_DEFAULT_MAX_GAIN 12.0     //!< dB a quiet input can be raised
+#define LNORM_MIN_GAIN -30.0            //!< dB a loud input can be lowered
+#define LNORM_DEFAULT_SMOOTHING 3000    //!< Time constant of the gain in ms
+
+/*! Measures the loudness of an audio stream (see LoudnessMeter) and, when normalising, brings its
+*   short-term loudness to a target. The gain follows the difference to the target with a time constant
+*   and is ramped sample by sample within each frame, so it does not pump or click. Passages under the
+*   gates of the integrated loudness (pauses, silence) keep the gain instead of being raised. Boosted
+*   peaks over full scale are saturated by the output format conversion. The input can have any sample
+*   format, its channels and sample rate must be the ones of the output.
+*/
+class LoudnessNormalizer : public OneToOneFilterT<AudioFrame, AudioFrame> {
+
+public:
+    /**
+    * Class constructor wrapper used to validate input params
+    * @param channels output channels, the input must have the same ones
+    * @param sampleRate output sample rate, the input must have the same one
+    * @param sampleFormat output sample format
+    * @return Pointer to new object if succeed of NULL if not
+    */
+    static LoudnessNormalizer* createNew(unsigned channels = DEFAULT_CHANNELS, unsigned sampleRate = DEFAULT_SAMPLE_RATE,
+                                         SampleFmt sampleFormat = FLTP);
+
+    /**
+    * Class destructor
+    */
+    ~LoudnessNormalizer();
+
+    /**
+    * Configures the normalisation
+    * @param target loudness in LUFS, from LOUDNESS_ABSOLUTE_GATE to 0
+    * @param maxGain largest gain in dB, from 0 to -LNORM_MIN_GAIN
+    * @param smoothing time constant of the gain in ms
+    * @param normalize false to only measure, the gain goes back to 0 dB
+    * @return true if the event has been pushed
+    */
+    bool configure(double target, double maxGain = LNORM_DEFAULT_MAX_GAIN,
+                   unsigned smoothing = LNORM_DEFAULT_SMOOTHING, bool normalize = true);
+
+    /**
+    * Starts the integrated loudness again, e.g. at the start of a programme
+    * @return true if the event has been pushed
+    */
+    bool resetMeasurement();
+
+    double getGain() const {return gainDb;};
+    const LoudnessMeter& getMeter() const {return meter;};
+
+protected:
+    //Protected for testing purposes
+    LoudnessNormalizer(unsigned channels, unsigned sampleRate, SampleFmt sampleFormat);
+    bool doProcessFrame(AudioFrame *org, AudioFrame *dst);
+    bool specificReaderConfig(int readerID, FrameQueue* queue);
+    bool configure0(double target, double maxGain, unsigned smoothing, bool normalize);
+
+private:
+    FrameQueue *allocQueue(ConnectionData cData);
+    void doGetState(Jzon::Object &filterNode);
+    void initializeEventMap();
+    bool configureEvent(Jzon::Node* params);
+    bool resetEvent(Jzon::Node* params);
+    bool specificReaderDelete(int /*readerID*/) {return true;};
+    bool specificWriterConfig(int /*writerID*/) {return true;};
+    bool specificWriterDelete(int /*writerID*/) {return true;};
+
+    float updateGain(unsigned samples);
+
+    unsigned channels;
+    unsigned sampleRate;
+    SampleFmt sampleFormat;
+    SampleConverter::ToFloatKernel toFloat;     //!< Kernel of the input format, selected when configuring the reader
+    SampleFmt inputFormat;
+    SampleConverter::FromFloatKernel fromFloat;
+
+    LoudnessMeter meter;
+    std::vector<std::vector<float>> planes;
+
+    double target;
+    double maxGain;
+    unsigned smoothing;
+    bool normalize;
+    double gainDb;
+    float gain;                                  //!< Linear gain applied to the last sample
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ *  BatchedReceiveGroupsock.cpp - Groupsock reading its packets in batches with recvmmsg
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <cerrno>
+
+#include "BatchedReceiveGroupsock.hh"
+
+BatchedReceiveGroupsock::BatchedReceiveGroupsock(UsageEnvironment& env, struct in_addr const& groupAddr,
+                                                 Port port, u_int8_t ttl) :
+    Groupsock(env, groupAddr, port, ttl), head(0), received(0), receivedPackets(0), receiveCalls(0),
+    truncatedPackets(0), filteredPackets(0)
+{
+    setup();
+}
+
+BatchedReceiveGroupsock::BatchedReceiveGroupsock(UsageEnvironment& env, struct in_addr const& groupAddr,
+                                                 struct in_addr const& sourceFilterAddr, Port port) :
+    Groupsock(env, groupAddr, sourceFilterAddr, port), head(0), received(0), receivedPackets(0), receiveCalls(0),
+    truncatedPackets(0), filteredPackets(0)
+{
+    setup();
+}
+
+void BatchedReceiveGroupsock::setup()
+{
+    data.resize(RECV_BATCH_PACKETS * RECV_MAX_PACKET_SIZE);
+    msgs.resize(RECV_BATCH_PACKETS);
+    iovs.resize(RECV_BATCH_PACKETS);
+    addresses.resize(RECV_BATCH_PACKETS);
+
+    for (size_t i = 0; i < RECV_BATCH_PACKETS; i++) {
+        iovs[i].iov_base = data.data() + i*RECV_MAX_PACKET_SIZE;
+        iovs[i].iov_len = RECV_MAX_PACKET_SIZE;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &addresses[i];
+    }
+
+    if ((scheduler = dynamic_cast<ReceiveTaskScheduler*>(&env().taskScheduler()))) {
+        scheduler->addGroupsock(this);
+    }
+}
+
+BatchedReceiveGroupsock::~BatchedReceiveGroupsock()
+{
+    if (scheduler) {
+        scheduler->removeGroupsock(this);
+    }
+}
+
+Boolean BatchedReceiveGroupsock::handleRead(unsigned char* buffer, unsigned bufferMaxSize,
+                                            unsigned& bytesRead, struct sockaddr_in& fromAddressAndPort)
+{
+    size_t packet;
+
+    bytesRead = 0;
+
+    if (head == received && !receive()) {
+        return False;
+    }
+
+    if (head == received) {
+        return True;
+    }
+
+    packet = head++;
+
+    //NOTE: as recvfrom would do, the part of the packet which does not fit is lost, so it is dropped
+    if ((msgs[packet].msg_hdr.msg_flags & MSG_TRUNC) || msgs[packet].msg_len > bufferMaxSize) {
+        truncatedPackets++;
+        return True;
+    }
+
+    //NOTE: the kernel filters the sources of the membership, but other sockets bound to the port may have joined the
+    //      group for any source
+    if (isSSM() && addresses[packet].sin_addr.s_addr != sourceFilterAddress().s_addr) {
+        filteredPackets++;
+        return True;
+    }
+
+    bytesRead = msgs[packet].msg_len;
+    memcpy(buffer, iovs[packet].iov_base, bytesRead);
+    fromAddressAndPort = addresses[packet];
+
+    statsIncoming.countPacket(bytesRead);
+    statsGroupIncoming.countPacket(bytesRead);
+
+    return True;
+}
+
+bool BatchedReceiveGroupsock::receive()
+{
+    int ret;
+
+    for (auto& msg : msgs) {
+        msg.msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        msg.msg_hdr.msg_flags = 0;
+        msg.msg_len = 0;
+    }
+
+    head = 0;
+    received = 0;
+
+    ret = recvmmsg(socketNum(), msgs.data(), RECV_BATCH_PACKETS, MSG_DONTWAIT, NULL);
+    receiveCalls++;
+
+    if (ret > 0) {
+        received = ret;
+        receivedPackets += ret;
+        return true;
+    }
+
+    //NOTE: like live555 readSocket, ICMP errors of previous sends are not read errors
+    return ret == 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ||
+           errno == ECONNREFUSED || errno == EHOSTUNREACH;
+}
@@ -0,0 +1,94 @@
+/*
+ *  BatchedReceiveGroupsock.hh - Groupsock reading its packets in batches with recvmmsg
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _BATCHED_RECEIVE_GROUPSOCK_HH
+#define _BATCHED_RECEIVE_GROUPSOCK_HH
+
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <Groupsock.hh>
+
+#include "ReceiveTaskScheduler.hh"
+
+#define RECV_BATCH_PACKETS 64           //!< Packets read by a single system call
+#define RECV_MAX_PACKET_SIZE 9000       //!< Largest packet read, it fits jumbo frames
+
+/*! Groupsock which reads up to RECV_BATCH_PACKETS packets with a single recvmmsg call when live555 asks
+    for one, and hands the rest of them on the following reads. Buffers are allocated once. It is meant
+    for unicast, any source multicast and source-specific multicast RTP sockets, multicast relaying is not
+    done. SSM sockets join the group with an IGMPv3 source membership and, as Groupsock does, also drop the
+    packets of other sources. Without a ReceiveTaskScheduler packets are only handed when the socket gets
+    readable again.
+*/
+class BatchedReceiveGroupsock : public Groupsock {
+
+public:
+    /**
+    * Class constructor, see Groupsock
+    */
+    BatchedReceiveGroupsock(UsageEnvironment& env, struct in_addr const& groupAddr, Port port, u_int8_t ttl);
+
+    /**
+    * Source-specific multicast constructor, see Groupsock
+    */
+    BatchedReceiveGroupsock(UsageEnvironment& env, struct in_addr const& groupAddr,
+                            struct in_addr const& sourceFilterAddr, Port port);
+
+    /**
+    * Class destructor
+    */
+    virtual ~BatchedReceiveGroupsock();
+
+    /**
+    * Hands the next packet of the current batch, it reads a new batch if there is none
+    * @return false if the socket fails
+    */
+    Boolean handleRead(unsigned char* buffer, unsigned bufferMaxSize,
+                       unsigned& bytesRead, struct sockaddr_in& fromAddressAndPort);
+
+    size_t getPendingPackets() const {return received - head;};
+    size_t getReceivedPackets() const {return receivedPackets;};
+    size_t getReceiveCalls() const {return receiveCalls;};
+    size_t getTruncatedPackets() const {return truncatedPackets;};
+    size_t getFilteredPackets() const {return filteredPackets;};
+
+private:
+    void setup();
+    bool receive();
+
+    std::vector<unsigned char> data;
+    std::vector<struct mmsghdr> msgs;
+    std::vector<struct iovec> iovs;
+    std::vector<struct sockaddr_in> addresses;
+    size_t head;                        //!< Next packet of the batch to hand
+    size_t received;                    //!< Packets of the current batch
+
+    ReceiveTaskScheduler* scheduler;
+
+    size_t receivedPackets;
+    size_t receiveCalls;
+    size_t truncatedPackets;
+    size_t filteredPackets;             //!< Packets of SSM sockets sent by other sources
+};
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ *  ClockRecovery.cpp - Recovery of the clock of received streams
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include "ClockRecovery.hh"
+
+ClockRecovery::ClockRecovery(double bandwidth) : fBandwidth(bandwidth), locked(false), rate(1), lastOut(0), 
+    lastPts(0), error(0), resyncs(0)
+{
+}
+
+//NOTE: the offset between clocks is taken once, so the local time keeps being monotonic
+double ClockRecovery::localTime(std::chrono::steady_clock::time_point now)
+{
+    static const std::chrono::microseconds epochOffset = 
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()) -
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch());
+
+    return (std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()) + epochOffset).count();
+}
+
+std::chrono::microseconds ClockRecovery::recover(std::chrono::microseconds pts, std::chrono::steady_clock::time_point now)
+{
+    double arrival = localTime(now);
+    double dt = (pts - lastPts).count();
+    double predicted = lastOut + dt*rate;
+    double omega;
+
+    error = arrival - predicted;
+
+    //NOTE: a sender report remapping the source timeline or a long interruption restarts the loop
+    if (!locked || std::abs(error) > CLOCK_RECOVERY_RESYNC_TIME*1000.0) {
+        resyncs += locked ? 1 : 0;
+        locked = true;
+        rate = 1;
+        error = 0;
+        lastOut = arrival;
+        lastPts = pts;
+        return std::chrono::microseconds((int64_t) lastOut);
+    }
+
+    if (dt <= 0) {
+        return std::chrono::microseconds((int64_t) predicted);
+    }
+
+    //NOTE: second order loop, the coefficients are those of a critically damped one for this frame interval
+    omega = 2*M_PI*fBandwidth*dt/std::micro::den;
+
+    lastOut = predicted + std::sqrt(2.0)*omega*error;
+    rate += omega*omega*error/dt;
+    rate = std::max(1 - CLOCK_RECOVERY_MAX_SKEW, std::min(1 + CLOCK_RECOVERY_MAX_SKEW, rate));
+    lastPts = pts;
+
+    return std::chrono::microseconds((int64_t) lastOut);
+}
@@ -0,0 +1,97 @@
+/*
+ *  ClockRecovery.hh - Recovery of the clock of received streams
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _CLOCK_RECOVERY_HH
+#define _CLOCK_RECOVERY_HH
+
+#include <chrono>
+#include <cstddef>
+
+#define CLOCK_RECOVERY_BANDWIDTH 0.1        //!< Default loop bandwidth in Hz
+#define CLOCK_RECOVERY_RESYNC_TIME 1000     //!< Error in msec which restarts the recovery
+#define CLOCK_RECOVERY_MAX_SKEW 0.01        //!< Largest rate difference between the source and the local clock
+
+/*! Recovers the clock of a received stream with a delay locked loop, which follows the arrival times of 
+    the frames on the local monotonic clock driven by their presentation times. The smoothed arrival time
+    of each frame is its recovered presentation time, so the network jitter and the skew of the source
+    clock do not reach the frame queues, and the streams of different sources share the same timeline.
+    Steps of the source timeline, e.g. a new RTCP sender report mapping, are slewed back to the arrival
+    one, and those larger than CLOCK_RECOVERY_RESYNC_TIME restart the recovery. The loop bandwidth sets
+    its response: the lower it is the better it filters the jitter and the slower it follows a clock
+    change. Recovered times are given in the system clock epoch. Frames with the same presentation time get the same recovered one, and frames
+    reordered before the last one (e.g. B pictures) are mapped without updating the loop.
+*/
+class ClockRecovery {
+
+public:
+    /**
+    * Class constructor
+    * @param bandwidth loop bandwidth in Hz
+    */
+    ClockRecovery(double bandwidth = CLOCK_RECOVERY_BANDWIDTH);
+
+    /**
+    * @param bandwidth loop bandwidth in Hz, it applies from the next frame
+    */
+    void setBandwidth(double bandwidth) {fBandwidth = bandwidth;};
+
+    /**
+    * Updates the loop with a received frame
+    * @param pts presentation time given by the source
+    * @param now arrival time
+    * @return recovered presentation time
+    */
+    std::chrono::microseconds recover(std::chrono::microseconds pts, 
+                                      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    /**
+    * Restarts the recovery, the next frame is taken as it arrives
+    */
+    void reset() {locked = false;};
+
+    double getBandwidth() const {return fBandwidth;};
+    bool isLocked() const {return locked;};
+    
+    /**
+    * @return rate difference between the source clock and the local one in parts per million
+    */
+    double getSkew() const {return (1/rate - 1)*1e6;};
+
+    /**
+    * @return arrival time minus predicted time of the last frame
+    */
+    std::chrono::microseconds getError() const {return std::chrono::microseconds((int64_t) error);};
+    size_t getResyncs() const {return resyncs;};
+
+private:
+    static double localTime(std::chrono::steady_clock::time_point now);
+
+    double fBandwidth;
+    bool locked;
+    double rate;                //!< Local time per source time
+    double lastOut;             //!< Recovered time of the last frame, in usec in the system clock epoch
+    std::chrono::microseconds lastPts;
+    double error;
+    size_t resyncs;
+};
+
+#endif
@@ -40,6 +40,12 @@ public:
 
     StreamClientState *getScs(){return scs;};
 
+    /**
+    * Sets the base URL of the next requests, as the Content-Base of a DESCRIBE response does
+    * @param baseURL base URL
+    */
+    void setContentBase(char const* baseURL) {setBaseURL(baseURL);};
+
 
 protected:
     ExtendedRTSPClient(UsageEnvironment& env, char const* rtspURL, StreamClientState *scs,
@@ -0,0 +1,184 @@
+/*
+ *  GopCache.cpp - Cache of the NAL units since the last random access point
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <algorithm>
+
+#include "GopCache.hh"
+#include "../../NalSplitter.hh"
+
+#define H264_NALU_TYPE_MASK 0x1F
+#define H264_IDR 5
+#define H264_SEI 6
+#define H264_AUD 9
+#define H265_NALU_TYPE_MASK 0x7E
+#define H265_BLA_W_LP 16
+#define H265_IRAP_MAX 23
+#define H265_VCL_MAX 31
+#define H265_VPS 32
+#define H265_AUD 35
+#define H265_PREFIX_SEI 39
+#define FIRST_SLICE_FLAG 0x80
+
+GopCache::GopCache(VCodecType codec, size_t maxSize) : fCodec(codec), maxSize(maxSize), size(0),
+    keyed(false), prefixOpen(false), prefixStart(0), overflows(0)
+{
+}
+
+unsigned char* GopCache::writeBuffer(unsigned size)
+{
+    if (writing.size() < size) {
+        writing.resize(size);
+    }
+
+    return writing.data();
+}
+
+void GopCache::push(unsigned length, std::chrono::microseconds pts)
+{
+    unsigned startCode = NalSplitter::startCodeLength(writing.data(), length);
+    NalClass nalClass;
+    CachedUnit unit;
+
+    if (length <= startCode) {
+        return;
+    }
+
+    nalClass = classify(writing.data() + startCode, length - startCode);
+
+    if (size + length > maxSize) {
+        clear();
+        overflows++;
+    }
+
+    switch (nalClass) {
+        case NAL_PREFIX:
+            if (!prefixOpen) {
+                //NOTE: parameter sets waiting for a random access point are replaced by newer ones
+                if (!keyed) {
+                    dropFront(units.size());
+                }
+                prefixOpen = true;
+                prefixStart = units.size();
+            }
+            break;
+        case NAL_RANDOM_ACCESS:
+            dropFront(prefixOpen ? prefixStart : units.size());
+            keyed = true;
+            prefixOpen = false;
+            break;
+        case NAL_PICTURE:
+            prefixOpen = false;
+            if (!keyed) {
+                dropFront(units.size());
+                return;
+            }
+            break;
+        default:
+            if (!keyed) {
+                return;
+            }
+            break;
+    }
+
+    if (!spare.empty()) {
+        unit.data = std::move(spare.back());
+        spare.pop_back();
+    }
+
+    if (unit.data.size() < length) {
+        unit.data.resize(length);
+    }
+
+    memcpy(unit.data.data(), writing.data(), length);
+    unit.length = length;
+    unit.pts = pts;
+    size += length;
+    units.push_back(std::move(unit));
+}
+
+bool GopCache::pop(unsigned char* buffer, unsigned bufferSize, unsigned& length, std::chrono::microseconds& pts)
+{
+    while (!units.empty()) {
+        if (units.front().length > bufferSize) {
+            dropFront(1);
+            continue;
+        }
+
+        length = units.front().length;
+        pts = units.front().pts;
+        memcpy(buffer, units.front().data.data(), length);
+        dropFront(1);
+        return true;
+    }
+
+    return false;
+}
+
+void GopCache::clear()
+{
+    dropFront(units.size());
+    keyed = false;
+    prefixOpen = false;
+    prefixStart = 0;
+}
+
+GopCache::NalClass GopCache::classify(unsigned char const* nal, unsigned size)
+{
+    unsigned type;
+
+    if (fCodec == H264) {
+        type = nal[0] & H264_NALU_TYPE_MASK;
+
+        if (type >= H264_SEI && type <= H264_AUD) {
+            return NAL_PREFIX;
+        }
+        if (type == H264_IDR) {
+            //NOTE: first_mb_in_slice is 0, its Exp-Golomb code is a single 1 bit
+            return size > 1 && (nal[1] & FIRST_SLICE_FLAG) ? NAL_RANDOM_ACCESS : NAL_PICTURE;
+        }
+        return type > 0 && type < H264_IDR ? NAL_PICTURE : NAL_OTHER;
+    }
+
+    type = (nal[0] & H265_NALU_TYPE_MASK) >> 1;
+
+    if ((type >= H265_VPS && type <= H265_AUD) || type == H265_PREFIX_SEI) {
+        return NAL_PREFIX;
+    }
+    if (type >= H265_BLA_W_LP && type <= H265_IRAP_MAX) {
+        return size > 2 && (nal[2] & FIRST_SLICE_FLAG) ? NAL_RANDOM_ACCESS : NAL_PICTURE;
+    }
+    return type <= H265_VCL_MAX ? NAL_PICTURE : NAL_OTHER;
+}
+
+void GopCache::dropFront(size_t count)
+{
+    count = std::min(count, units.size());
+
+    for (size_t i = 0; i < count; i++) {
+        size -= units.front().length;
+        spare.push_back(std::move(units.front().data));
+        units.pop_front();
+    }
+
+    prefixStart -= std::min(count, prefixStart);
+}
@@ -0,0 +1,110 @@
+/*
+ *  GopCache.hh - Cache of the NAL units since the last random access point
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _GOP_CACHE_HH
+#define _GOP_CACHE_HH
+
+#include <deque>
+#include <vector>
+#include <chrono>
+
+#include "../../Types.hh"
+
+#define GOP_CACHE_MAX_SIZE 1024*1024*8      //!< Bytes held, a larger GOP empties the cache until the next random access point
+
+/*! Holds the H.264 or H.265 NAL units, with their start codes, received since the last random access point
+    (IDR, CRA or BLA picture), so a writer connected to a standby sink can start decoding at once instead of
+    waiting for the next one. The parameter sets, SEI and delimiters preceding the random access picture are
+    kept with it. Picture NAL units are dropped until the first random access point arrives, and the older
+    GOP is dropped when a new one starts. Units are handed out in arrival order and buffers are reused.
+*/
+class GopCache {
+
+public:
+    /**
+    * Class constructor
+    * @param codec H264 or H265
+    * @param maxSize largest size in bytes of the cached units
+    */
+    GopCache(VCodecType codec, size_t maxSize = GOP_CACHE_MAX_SIZE);
+
+    /**
+    * @param size bytes the next NAL unit may take
+    * @return buffer where the next NAL unit has to be written before pushing it
+    */
+    unsigned char* writeBuffer(unsigned size);
+
+    /**
+    * Stores the NAL unit written in the buffer returned by writeBuffer, if it belongs to the current GOP
+    * @param length NAL unit size in bytes, including its start code
+    * @param pts NAL unit presentation time
+    */
+    void push(unsigned length, std::chrono::microseconds pts);
+
+    /**
+    * Copies the oldest NAL unit and removes it, units larger than the buffer are dropped
+    * @param buffer destination buffer
+    * @param bufferSize destination buffer size
+    * @param length NAL unit size
+    * @param pts NAL unit presentation time
+    * @return true if a NAL unit has been copied
+    */
+    bool pop(unsigned char* buffer, unsigned bufferSize, unsigned& length, std::chrono::microseconds& pts);
+
+    /**
+    * Drops all the units, picture ones are dropped again until the next random access point
+    */
+    void clear();
+
+    bool empty() const {return units.empty();};
+    bool isKeyed() const {return keyed;};
+    size_t getUnits() const {return units.size();};
+    size_t getSize() const {return size;};
+    size_t getOverflows() const {return overflows;};
+
+private:
+    enum NalClass {NAL_PREFIX, NAL_RANDOM_ACCESS, NAL_PICTURE, NAL_OTHER};
+
+    struct CachedUnit {
+        std::vector<unsigned char> data;
+        unsigned length;
+        std::chrono::microseconds pts;
+    };
+
+    NalClass classify(unsigned char const* nal, unsigned size);
+    void dropFront(size_t count);
+
+    VCodecType fCodec;
+    size_t maxSize;
+
+    std::deque<CachedUnit> units;
+    std::vector<std::vector<unsigned char>> spare;
+    std::vector<unsigned char> writing;
+    size_t size;
+
+    bool keyed;                 //!< The first cached picture is a random access one
+    bool prefixOpen;            //!< The last cached units precede a picture not received yet
+    size_t prefixStart;         //!< Index of the first of them
+    size_t overflows;
+};
+
+#endif
@@ -24,18 +24,47 @@
 #include "../../Utils.hh"
 
 #include <iostream>
+#include <cstring>
+
+#define H264_NALU_TYPE_MASK 0x1F
+#define H264_SPS 7
+#define H264_PPS 8
+#define H265_NALU_TYPE_MASK 0x7E
+#define H265_VPS 32
+#define H265_SPS 33
+#define H265_PPS 34
 
 static unsigned char const startCode[4] = {0x00, 0x00, 0x00, 0x01};
 
-H264VideoSdpParser* H264VideoSdpParser::createNew(UsageEnvironment& env, FramedSource* inputSource, char const* sPropParameterSetsStr)
+H264VideoSdpParser* H264VideoSdpParser::createNew(UsageEnvironment& env, FramedSource* inputSource,
+                                                  char const* sPropParameterSetsStr, VCodecType codec)
 {
-    return new H264VideoSdpParser(env, inputSource, sPropParameterSetsStr);
+    return new H264VideoSdpParser(env, inputSource, sPropParameterSetsStr, codec);
 }
 
- H264VideoSdpParser::H264VideoSdpParser(UsageEnvironment& env, FramedSource* inputSource, char const* sPropParameterSetsStr)
-  : FramedFilter(env, inputSource), injectedMetadataNALs(0), extradataSize(0)
+H264VideoSdpParser::H264VideoSdpParser(UsageEnvironment& env, FramedSource* inputSource,
+                                       char const* sPropParameterSetsStr, VCodecType codec)
+  : FramedFilter(env, inputSource), fCodec(codec), fromSdp(false), extradataSize(0),
+    capturedSize(0), capturedTypes(0)
 {
+    SPropRecord* sPropRecords;
+    unsigned numSPropRecords = 0;
+
     sPropRecords = parseSPropParameterSets(sPropParameterSetsStr, numSPropRecords);
+
+    for (unsigned i = 0; i < numSPropRecords; i++) {
+        if (extradataSize + sizeof(startCode) + sPropRecords[i].sPropLength > MAX_EXTRADATA_SIZE) {
+            utils::warningMsg("SDP parameter sets do not fit in the extradata buffer");
+            break;
+        }
+
+        memcpy(extradata + extradataSize, startCode, sizeof(startCode));
+        memcpy(extradata + extradataSize + sizeof(startCode), sPropRecords[i].sPropBytes, sPropRecords[i].sPropLength);
+        extradataSize += sizeof(startCode) + sPropRecords[i].sPropLength;
+    }
+
+    fromSdp = extradataSize > 0;
+    delete[] sPropRecords;
 }
 
 H264VideoSdpParser::~H264VideoSdpParser() 
@@ -43,19 +72,21 @@ H264VideoSdpParser::~H264VideoSdpParser()
     
 }
 
+bool H264VideoSdpParser::setExtradata(unsigned char const* data, unsigned size)
+{
+    if (fromSdp || size > MAX_EXTRADATA_SIZE) {
+        return false;
+    }
+
+    memcpy(extradata, data, size);
+    extradataSize = size;
+    return true;
+}
+
 void H264VideoSdpParser::doGetNextFrame() 
 {
-    if (injectedMetadataNALs < numSPropRecords) {
-        memmove(extradata + extradataSize, startCode, sizeof(startCode));
-        memmove(extradata + sizeof(startCode) + extradataSize, sPropRecords[injectedMetadataNALs].sPropBytes, sPropRecords[injectedMetadataNALs].sPropLength);
-        extradataSize += sizeof(startCode) + sPropRecords[injectedMetadataNALs].sPropLength;
-        fNumTruncatedBytes = 0;
-        injectedMetadataNALs++;
-        afterGetting(this);
-    } else {
-        fInputSource->getNextFrame(fTo + sizeof(startCode), fMaxSize - sizeof(startCode), 
-                                    afterGettingFrame, this, FramedSource::handleClosure, this);
-    }  
+    fInputSource->getNextFrame(fTo + sizeof(startCode), fMaxSize - sizeof(startCode), 
+                                afterGettingFrame, this, FramedSource::handleClosure, this);
 }
 
 void H264VideoSdpParser
@@ -82,5 +113,52 @@ void H264VideoSdpParser
         envir() << "H264VideoSdpParser error: Frame buffer too small\n";
     }
 
+    if (!fromSdp && frameSize > 0) {
+        captureParameterSet(fTo + sizeof(startCode), frameSize);
+    }
+
     afterGetting(this);
-}
\ No newline at end of file
+}
+
+void H264VideoSdpParser::captureParameterSet(unsigned char const* nal, unsigned size)
+{
+    unsigned type;
+    unsigned bit;
+    unsigned complete;
+
+    if (fCodec == H265) {
+        type = (nal[0] & H265_NALU_TYPE_MASK) >> 1;
+        if (type < H265_VPS || type > H265_PPS) {
+            return;
+        }
+        bit = 1 << (type - H265_VPS);
+        complete = 0x07;
+    } else {
+        type = nal[0] & H264_NALU_TYPE_MASK;
+        if (type != H264_SPS && type != H264_PPS) {
+            return;
+        }
+        bit = 1 << (type - H264_SPS);
+        complete = 0x03;
+    }
+
+    //NOTE: a repeated type starts a new set, the previous one has been sent again or replaced
+    if ((capturedTypes & bit) || capturedSize + sizeof(startCode) + size > MAX_EXTRADATA_SIZE) {
+        capturedSize = 0;
+        capturedTypes = 0;
+    }
+
+    if (capturedSize + sizeof(startCode) + size > MAX_EXTRADATA_SIZE) {
+        return;
+    }
+
+    memcpy(captured + capturedSize, startCode, sizeof(startCode));
+    memcpy(captured + capturedSize + sizeof(startCode), nal, size);
+    capturedSize += sizeof(startCode) + size;
+    capturedTypes |= bit;
+
+    if (capturedTypes == complete) {
+        memcpy(extradata, captured, capturedSize);
+        extradataSize = capturedSize;
+    }
+}
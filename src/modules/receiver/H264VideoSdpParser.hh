@@ -25,9 +25,15 @@
 
 #include <FramedFilter.hh>
 #include <H264VideoRTPSource.hh> // for "parseSPropParameterSets()"
-#define MAX_EXTRADATA_SIZE 128
 
-/*! An AAC ADTS header parser, which constructs the Audio Specific Config string from extracted information */
+#include "../../Types.hh"
+
+#define MAX_EXTRADATA_SIZE 512          //!< Room for the VPS, SPS and PPS of an H.265 stream with VUI
+
+/*! Prefixes the H.264 and H.265 NAL units with start codes and gathers the parameter sets the decoder needs
+    as extradata. They are taken from the SDP sprop parameters when the session is created, so they are known
+    before the first frame arrives. Otherwise they can be set from a previous session of the same stream or
+    they are captured from the stream as soon as a whole set of them has been received. */
 
 class H264VideoSdpParser : public FramedFilter {
 
@@ -35,10 +41,21 @@ public:
     /**
     * Constructor wrapper
     * @param env Live555 environement
-    * @param inputSource Input source, which contains AAC frames
+    * @param inputSource Input source, which contains H.264 or H.265 NAL units
+    * @param sPropParameterSetsStr comma separated base64 parameter sets of the SDP, it may be NULL
+    * @param codec H264 or H265
     * @return Pointer to the object if succeded and NULL if not
     */
-    static H264VideoSdpParser* createNew(UsageEnvironment& env, FramedSource* inputSource, char const* sPropParameterSetsStr);
+    static H264VideoSdpParser* createNew(UsageEnvironment& env, FramedSource* inputSource,
+                                         char const* sPropParameterSetsStr, VCodecType codec = H264);
+
+    /**
+    * Sets the extradata when the SDP does not carry the parameter sets, the stream ones replace it
+    * @param data parameter sets with start codes
+    * @param size data size in bytes
+    * @return false if the parser already has the SDP parameter sets or the data is too large
+    */
+    bool setExtradata(unsigned char const* data, unsigned size);
     
     /**
     * @return Pointer to the parsed headers from sdp, mainly SPS and PPS
@@ -51,7 +68,8 @@ public:
     unsigned getExtradataSize() {return extradataSize;};
 
 protected:
-    H264VideoSdpParser(UsageEnvironment& env, FramedSource* inputSource, char const* sPropParameterSetsStr);
+    H264VideoSdpParser(UsageEnvironment& env, FramedSource* inputSource, char const* sPropParameterSetsStr,
+                       VCodecType codec);
     virtual ~H264VideoSdpParser();
 
 protected:
@@ -67,12 +85,17 @@ protected:
                             struct timeval presentationTime,
                             unsigned durationInMicroseconds);
 private:
-    SPropRecord* sPropRecords;
-    unsigned numSPropRecords;
-    unsigned injectedMetadataNALs;
-    
+    void captureParameterSet(unsigned char const* nal, unsigned size);
+
+    VCodecType fCodec;
+    bool fromSdp;                                   //!< The extradata comes from the sprop parameters
+
     unsigned char extradata[MAX_EXTRADATA_SIZE];
     unsigned extradataSize;
+
+    unsigned char captured[MAX_EXTRADATA_SIZE];     //!< Parameter sets read from the stream since the last VPS or SPS
+    unsigned capturedSize;
+    unsigned capturedTypes;                         //!< Bit mask of the parameter set types captured
 };
 
 #endif
\ No newline at end of file
@@ -26,8 +26,10 @@
 #include "H264VideoSdpParser.hh"
 #include "SourceManager.hh"
 #include "ExtendedRTSPClient.hh"
+#include "ReceiverMediaSession.hh"
 
 #include <iostream>
+#include <sys/socket.h>
 #include <sstream>
 #include <algorithm>
 
@@ -36,9 +38,38 @@ namespace handlers
     void continueAfterSETUP(RTSPClient* rtspClient, int resultCode, char* resultString);
     void continueAfterPLAY(RTSPClient* rtspClient, int resultCode, char* resultString);
     void setupNextSubsession(RTSPClient* rtspClient);
+    bool describeAgain(RTSPClient* rtspClient)
+    {
+        StreamClientState& scs = *(((ExtendedRTSPClient*)rtspClient)->getScs());
+        MediaSubsessionIterator iter(*scs.session);
+        MediaSubsession* subsession;
+
+        //NOTE: once a subsession is playing from the cached SDP the rest of the session keeps it
+        while ((subsession = iter.next()) != NULL) {
+            if (subsession->sink != NULL) {
+                return false;
+            }
+        }
+
+        utils::warningMsg("The cached SDP of " + scs.url + " is stale, describing it again");
+
+        scs.mngr->evictCache(scs.url);
+        scs.cachedDescription = false;
+        scs.subsession = NULL;
+        delete scs.iter;
+        scs.iter = NULL;
+        Medium::close(scs.session);
+        scs.session = NULL;
+
+        ((ExtendedRTSPClient*)rtspClient)->setContentBase(scs.url.c_str());
+        rtspClient->sendDescribeCommand(continueAfterDESCRIBE);
+        return true;
+    }
+
     void getOptions(RTSPClient* rtspClient, RTSPClient::responseHandler* afterFunc);
     void getParameterCommand(RTSPClient* rtspClient, RTSPClient::responseHandler* afterFunc);
     void shutdownStream(RTSPClient* rtspClient);
+    bool describeAgain(RTSPClient* rtspClient);
     std::string modifySessionName(std::string sdp, std::string sessionName);
     void streamTimerHandler(void* clientData);
     void checkSessionTimeoutBrokenServer(void* clientData);
@@ -58,7 +89,11 @@ namespace handlers
             char* const sdpDescription = resultString;
             env << "Got a SDP description:\n" << sdpDescription << "\n";
 
-            scs.session = MediaSession::createNew(env, modifySessionName(std::string(sdpDescription), scs.getId()).c_str());
+            if (!scs.url.empty()) {
+                scs.mngr->cacheDescription(scs.url, std::string(sdpDescription), std::string(rtspClient->url()));
+            }
+
+            scs.session = ReceiverMediaSession::createNew(env, modifySessionName(std::string(sdpDescription), scs.getId()).c_str());
             delete[] sdpDescription;
             if (scs.session == NULL) {
                 env << "Failed to create a MediaSession object from the SDP description: " << env.getResultMsg() << "\n";
@@ -106,6 +141,10 @@ namespace handlers
 
             if (resultCode != 0) {
                 env << "Failed to set up the subsession: " << resultString << "\n";
+                if (scs.cachedDescription && describeAgain(rtspClient)) {
+                    delete[] resultString;
+                    return;
+                }
                 break;
             }
 
@@ -197,7 +236,7 @@ namespace handlers
             } else {
                 env << "Initiated the subsession (client ports " << scs.subsession->clientPortNum() << "-" << scs.subsession->clientPortNum()+1 << ")\n";
 
-                increaseReceiveBufferTo(env, scs.subsession->rtpSource()->RTPgs()->socketNum(), RTP_RECEIVE_BUFFER_SIZE);
+                increaseReceiveBuffer(env, scs.subsession);
 
                 rtspClient->sendSetupCommand(*scs.subsession, continueAfterSETUP, False, False);
             }
@@ -296,11 +335,20 @@ namespace handlers
         int wId;
         QueueSink *sink;
         H264VideoSdpParser* filter = NULL;
+        std::string sprop;
 
         wId = subsession->clientPortNum();
         
-        if (strcmp(subsession->codecName(), "H264") == 0 || strcmp(subsession->codecName(), "H265") == 0) {
-            filter = H264VideoSdpParser::createNew(env, subsession->readSource(), subsession->fmtp_spropparametersets());
+        if (strcmp(subsession->codecName(), "H264") == 0) {
+            filter = H264VideoSdpParser::createNew(env, subsession->readSource(), subsession->fmtp_spropparametersets(), H264);
+        } else if (strcmp(subsession->codecName(), "H265") == 0) {
+            //NOTE: H.265 SDPs carry each parameter set type in its own attribute
+            for (char const* param : {subsession->fmtp_spropvps(), subsession->fmtp_spropsps(), subsession->fmtp_sproppps()}) {
+                if (param && *param) {
+                    sprop += (sprop.empty() ? "" : ",") + std::string(param);
+                }
+            }
+            filter = H264VideoSdpParser::createNew(env, subsession->readSource(), sprop.c_str(), H265);
         }
         
         sink = QueueSink::createNew(env, wId, filter);
@@ -325,6 +373,26 @@ namespace handlers
         return true;
     }
 
+    //NOTE: SO_RCVBUFFORCE exceeds net.core.rmem_max when the process has CAP_NET_ADMIN, otherwise the kernel caps it.
+    //      Multicast cameras send their bursts at line rate, the socket must hold them while the receive loop is busy
+    void increaseReceiveBuffer(UsageEnvironment& env, MediaSubsession *subsession)
+    {
+        Groupsock* gs;
+        int size;
+
+        if (!subsession->rtpSource() || !(gs = subsession->rtpSource()->RTPgs())) {
+            return;
+        }
+
+        size = IsMulticastAddress(gs->groupAddress().s_addr) ? RTP_MULTICAST_RECEIVE_BUFFER_SIZE : RTP_RECEIVE_BUFFER_SIZE;
+
+        if (setsockopt(gs->socketNum(), SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) == 0) {
+            return;
+        }
+
+        increaseReceiveBufferTo(env, gs->socketNum(), size);
+    }
+
     std::string modifySessionName(std::string sdp, std::string sessionName)
     {
         std::string newSdp;
@@ -35,6 +35,7 @@ namespace handlers
     void subsessionAfterPlaying(void* clientData);
     void subsessionByeHandler(void* clientData);
     bool addSubsessionSink(UsageEnvironment& env, MediaSubsession *subsession);
+    void increaseReceiveBuffer(UsageEnvironment& env, MediaSubsession *subsession);
 };
 
 #endif
@@ -0,0 +1,180 @@
+/*
+ *  JitterBuffer.cpp - Adaptive jitter buffer of the received frames
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <algorithm>
+
+#include "JitterBuffer.hh"
+
+JitterBuffer::JitterBuffer(unsigned maxDelay, unsigned minDelay) : delay(0), synced(false),
+    baseTransit(0), windowTransit(0), dropped(0), late(0)
+{
+    setDelays(maxDelay, minDelay);
+    delay = this->minDelay;
+}
+
+void JitterBuffer::setDelays(unsigned maxDelay, unsigned minDelay)
+{
+    this->maxDelay = std::chrono::milliseconds(maxDelay);
+    this->minDelay = std::chrono::milliseconds(std::min(minDelay, maxDelay));
+
+    delay = std::max(std::min(delay, this->maxDelay), this->minDelay);
+}
+
+void JitterBuffer::setJitter(std::chrono::microseconds jitter, std::chrono::steady_clock::time_point now)
+{
+    std::chrono::microseconds target;
+    std::chrono::microseconds decrease;
+
+    target = std::max(std::min(jitter*JITTER_BUFFER_JITTER_FACTOR, maxDelay), minDelay);
+
+    //NOTE: lowering the delay releases the waiting frames sooner, so it is done gradually
+    if (target >= delay || lastJitter == std::chrono::steady_clock::time_point()) {
+        delay = target;
+    } else {
+        decrease = std::chrono::duration_cast<std::chrono::microseconds>(now - lastJitter)*JITTER_BUFFER_DECAY_RATE/1000;
+        delay = std::max(target, delay - decrease);
+    }
+
+    lastJitter = now;
+}
+
+unsigned char* JitterBuffer::writeBuffer(unsigned size)
+{
+    if (writing.empty() && !spare.empty()) {
+        writing = std::move(spare.back());
+        spare.pop_back();
+    }
+
+    if (writing.size() < size) {
+        writing.resize(size);
+    }
+
+    return writing.data();
+}
+
+void JitterBuffer::push(unsigned length, std::chrono::microseconds pts, std::chrono::steady_clock::time_point now)
+{
+    std::chrono::microseconds transit = transitTime(pts, now);
+    std::chrono::microseconds resync = std::chrono::milliseconds(JITTER_BUFFER_RESYNC_TIME);
+
+    //NOTE: presentation times jump when RTCP synchronization starts, the stored frames are not delayed again
+    if (!synced || transit > baseTransit + resync || transit < baseTransit - resync) {
+        for (auto& frame : frames) {
+            frame.immediate = true;
+        }
+
+        synced = true;
+        baseTransit = transit;
+        windowTransit = transit;
+        windowStart = now;
+    }
+
+    baseTransit = std::min(baseTransit, transit);
+    windowTransit = std::min(windowTransit, transit);
+
+    //NOTE: the shortest transit time follows the clock drift between sender and receiver
+    if (now - windowStart >= std::chrono::milliseconds(JITTER_BUFFER_TRANSIT_WINDOW)) {
+        baseTransit = windowTransit;
+        windowTransit = transit;
+        windowStart = now;
+    }
+
+    if (transit > baseTransit + delay) {
+        late++;
+    }
+
+    if (frames.size() >= JITTER_BUFFER_MAX_FRAMES) {
+        drop();
+    }
+
+    length = std::min(length, (unsigned) writing.size());
+    frames.push_back({std::move(writing), length, pts, false});
+    writing.clear();
+}
+
+bool JitterBuffer::release(unsigned char* buffer, unsigned maxSize, unsigned& length,
+                           std::chrono::microseconds& pts, std::chrono::steady_clock::time_point now)
+{
+    while (!frames.empty() && releaseTime(frames.front()) <= now) {
+        if (frames.front().length > maxSize) {
+            drop();
+            continue;
+        }
+
+        length = frames.front().length;
+        pts = frames.front().pts;
+        memcpy(buffer, frames.front().data.data(), length);
+
+        spare.push_back(std::move(frames.front().data));
+        frames.pop_front();
+        return true;
+    }
+
+    return false;
+}
+
+std::chrono::microseconds JitterBuffer::timeToRelease(std::chrono::steady_clock::time_point now)
+{
+    std::chrono::nanoseconds wait;
+
+    if (frames.empty()) {
+        return std::chrono::microseconds(-1);
+    }
+
+    wait = releaseTime(frames.front()) - now;
+
+    //NOTE: it is rounded up, so a task scheduled with it does not run before the frame can be released
+    return std::chrono::microseconds(std::max((wait.count() + 999)/1000, (std::chrono::nanoseconds::rep) 0));
+}
+
+void JitterBuffer::flush()
+{
+    for (auto& frame : frames) {
+        spare.push_back(std::move(frame.data));
+    }
+
+    frames.clear();
+    synced = false;
+}
+
+std::chrono::microseconds JitterBuffer::transitTime(std::chrono::microseconds pts,
+                                                    std::chrono::steady_clock::time_point now)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()) - pts;
+}
+
+std::chrono::steady_clock::time_point JitterBuffer::releaseTime(const BufferedFrame& frame)
+{
+    if (frame.immediate) {
+        return std::chrono::steady_clock::time_point();
+    }
+
+    return std::chrono::steady_clock::time_point(frame.pts + baseTransit + delay);
+}
+
+void JitterBuffer::drop()
+{
+    dropped++;
+    spare.push_back(std::move(frames.front().data));
+    frames.pop_front();
+}
@@ -0,0 +1,144 @@
+/*
+ *  JitterBuffer.hh - Adaptive jitter buffer of the received frames
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _JITTER_BUFFER_HH
+#define _JITTER_BUFFER_HH
+
+#include <deque>
+#include <vector>
+#include <chrono>
+
+#define JITTER_BUFFER_MAX_DELAY 200         //!< Default largest target delay in msec
+#define JITTER_BUFFER_MIN_DELAY 0           //!< Default smallest target delay in msec
+#define JITTER_BUFFER_MAX_FRAMES 256        //!< Frames held, the oldest one is dropped when it is full
+#define JITTER_BUFFER_JITTER_FACTOR 4       //!< Target delay in measured jitters
+#define JITTER_BUFFER_DECAY_RATE 20         //!< Largest target delay decrease in msec per second
+#define JITTER_BUFFER_TRANSIT_WINDOW 2000   //!< Time in msec the shortest transit time is kept
+#define JITTER_BUFFER_RESYNC_TIME 1000      //!< Transit time change in msec which restarts the timing
+
+/*! Holds the received frames and releases them at their presentation time plus a target delay, so the
+    network jitter does not reach the frame queues. Presentation times are mapped to the local clock with
+    the shortest transit time (arrival time minus presentation time) of the last frames, which is the one
+    of the least delayed frame, and the target delay is the time the rest of them need to arrive. It is
+    set from the measured interarrival jitter: it grows at once and decreases slowly, so a single burst
+    of jitter does not make the delay swing. Frames are released in arrival order and buffers are reused.
+*/
+class JitterBuffer {
+
+public:
+    /**
+    * Class constructor
+    * @param maxDelay largest target delay in msec
+    * @param minDelay smallest target delay in msec
+    */
+    JitterBuffer(unsigned maxDelay = JITTER_BUFFER_MAX_DELAY, unsigned minDelay = JITTER_BUFFER_MIN_DELAY);
+
+    /**
+    * @param maxDelay largest target delay in msec
+    * @param minDelay smallest target delay in msec, it is lowered to maxDelay if it is larger
+    */
+    void setDelays(unsigned maxDelay, unsigned minDelay);
+
+    /**
+    * Updates the target delay
+    * @param jitter measured interarrival jitter
+    * @param now measurement time
+    */
+    void setJitter(std::chrono::microseconds jitter,
+                   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    /**
+    * @param size bytes the next frame may take
+    * @return buffer where the next frame has to be written before pushing it
+    */
+    unsigned char* writeBuffer(unsigned size);
+
+    /**
+    * Stores the frame written in the buffer returned by writeBuffer
+    * @param length frame size in bytes
+    * @param pts frame presentation time
+    * @param now arrival time
+    */
+    void push(unsigned length, std::chrono::microseconds pts,
+              std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    /**
+    * Copies the oldest frame if its release time has come, frames larger than maxSize are dropped
+    * @param buffer destination buffer
+    * @param maxSize destination buffer size
+    * @param length released frame size
+    * @param pts released frame presentation time
+    * @param now release time
+    * @return true if a frame has been copied
+    */
+    bool release(unsigned char* buffer, unsigned maxSize, unsigned& length, std::chrono::microseconds& pts,
+                 std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    /**
+    * @param now current time
+    * @return time until the oldest frame can be released, negative if there are no frames
+    */
+    std::chrono::microseconds timeToRelease(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    /**
+    * Drops all the stored frames and restarts the timing
+    */
+    void flush();
+
+    std::chrono::microseconds getDelay() const {return delay;};
+    unsigned getMaxDelay() const {return std::chrono::duration_cast<std::chrono::milliseconds>(maxDelay).count();};
+    unsigned getMinDelay() const {return std::chrono::duration_cast<std::chrono::milliseconds>(minDelay).count();};
+    size_t getFrames() const {return frames.size();};
+    size_t getDropped() const {return dropped;};
+    size_t getLate() const {return late;};
+
+private:
+    struct BufferedFrame {
+        std::vector<unsigned char> data;
+        unsigned length;
+        std::chrono::microseconds pts;
+        bool immediate;             //!< It was stored before the timing restarted, it is released at once
+    };
+
+    std::chrono::microseconds transitTime(std::chrono::microseconds pts, std::chrono::steady_clock::time_point now);
+    std::chrono::steady_clock::time_point releaseTime(const BufferedFrame& frame);
+    void drop();
+
+    std::deque<BufferedFrame> frames;
+    std::vector<std::vector<unsigned char>> spare;
+    std::vector<unsigned char> writing;
+
+    std::chrono::microseconds maxDelay;
+    std::chrono::microseconds minDelay;
+    std::chrono::microseconds delay;
+    std::chrono::steady_clock::time_point lastJitter;
+
+    bool synced;
+    std::chrono::microseconds baseTransit;          //!< Shortest transit time, it maps pts to the local clock
+    std::chrono::microseconds windowTransit;        //!< Shortest transit time of the current window
+    std::chrono::steady_clock::time_point windowStart;
+
+    size_t dropped;
+    size_t late;
+};
+
+#endif
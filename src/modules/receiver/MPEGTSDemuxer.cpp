@@ -0,0 +1,466 @@
+/*
+ *  MPEGTSDemuxer.cpp - MPEG-TS demuxer splitting a program in elementary stream units
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <algorithm>
+
+#include "MPEGTSDemuxer.hh"
+
+#define TS_HEADER_SIZE 4
+#define PES_HEADER_SIZE 9
+#define PSI_HEADER_SIZE 8
+#define PSI_CRC_SIZE 4
+#define ADTS_HEADER_SIZE 7
+#define PTS_WRAP (TS_PTS_MASK + 1)
+
+static const unsigned adtsSampleRates[] = {96000, 88200, 64000, 48000, 44100, 32000,
+                                           24000, 22050, 16000, 12000, 11025, 8000};
+static const unsigned mp3SampleRates[] = {44100, 48000, 32000};
+
+static bool isVideo(unsigned char streamType)
+{
+    return streamType == TS_STREAM_H264 || streamType == TS_STREAM_H265;
+}
+
+static uint32_t crc32(const unsigned char* data, unsigned size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (unsigned i = 0; i < size; i++) {
+        crc ^= (uint32_t) data[i] << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+static uint64_t readPTS(const unsigned char* p)
+{
+    return ((uint64_t) (p[0] & 0x0E) << 29) | (p[1] << 22) | ((p[2] & 0xFE) << 14) | (p[3] << 7) | (p[4] >> 1);
+}
+
+MPEGTSDemuxer::MPEGTSDemuxer(UnitHandler handler) : fHandler(handler), pmtPid(-1), pmtVersion(-1),
+    ptsStarted(false), lastPts(0), packets(0), discontinuities(0), droppedUnits(0)
+{
+    pidStreams.resize(TS_PID_NUM, -1);
+}
+
+unsigned MPEGTSDemuxer::push(const unsigned char* data, unsigned size)
+{
+    unsigned offset = 0;
+    unsigned read = 0;
+
+    while (offset + TS_PACKET_SIZE <= size) {
+        if (data[offset] != TS_SYNC_BYTE) {
+            offset++;
+            continue;
+        }
+
+        readPacket(data + offset);
+        offset += TS_PACKET_SIZE;
+        packets++;
+        read++;
+    }
+
+    return read;
+}
+
+void MPEGTSDemuxer::flush()
+{
+    for (unsigned i = 0; i < streams.size(); i++) {
+        if (isVideo(streams[i].streamType)) {
+            endUnit(i);
+        }
+    }
+}
+
+void MPEGTSDemuxer::reset()
+{
+    for (auto& state : states) {
+        state.started = false;
+        state.corrupt = false;
+        state.length = 0;
+        state.cc = -1;
+    }
+
+    pmtPid = -1;
+    pmtVersion = -1;
+    ptsStarted = false;
+}
+
+void MPEGTSDemuxer::readPacket(const unsigned char* packet)
+{
+    bool unitStart = packet[1] & 0x40;
+    uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+    unsigned char adaptation = (packet[3] >> 4) & 0x03;
+    int cc = packet[3] & 0x0F;
+    unsigned offset = TS_HEADER_SIZE;
+    bool discontinuity = false;
+    int stream;
+
+    //NOTE: packets with transport errors are handled as lost ones
+    if (packet[1] & 0x80) {
+        return;
+    }
+
+    if (adaptation & 0x02) {
+        discontinuity = packet[4] > 0 && (packet[5] & 0x80);
+        offset += 1 + packet[4];
+    }
+
+    if (!(adaptation & 0x01) || offset >= TS_PACKET_SIZE) {
+        return;
+    }
+
+    if (pid == TS_PAT_PID || (int) pid == pmtPid) {
+        if (unitStart) {
+            readSection(pid, packet + offset, TS_PACKET_SIZE - offset);
+        }
+        return;
+    }
+
+    if ((stream = pidStreams[pid]) < 0) {
+        return;
+    }
+
+    StreamState& state = states[stream];
+
+    if (state.cc >= 0 && !discontinuity) {
+        //NOTE: a packet may be sent twice, the copy is ignored
+        if (cc == state.cc) {
+            return;
+        }
+
+        if (cc != ((state.cc + 1) & 0x0F)) {
+            discontinuities++;
+            state.corrupt = state.started;
+        }
+    }
+
+    state.cc = cc;
+    readPES(stream, packet + offset, TS_PACKET_SIZE - offset, unitStart);
+}
+
+void MPEGTSDemuxer::readSection(uint16_t pid, const unsigned char* payload, unsigned size)
+{
+    unsigned pointer = payload[0];
+    const unsigned char* section = payload + 1 + pointer;
+    unsigned sectionSize;
+
+    if (1 + pointer + 3 > size) {
+        return;
+    }
+
+    size -= 1 + pointer;
+    sectionSize = 3 + (((section[1] & 0x0F) << 8) | section[2]);
+
+    //NOTE: the CRC of a section including its own CRC is 0
+    if (sectionSize > size || sectionSize < PSI_HEADER_SIZE + PSI_CRC_SIZE || crc32(section, sectionSize) != 0) {
+        return;
+    }
+
+    //NOTE: tables which are not applicable yet are ignored
+    if (!(section[5] & 0x01)) {
+        return;
+    }
+
+    if (pid == TS_PAT_PID && section[0] == 0x00) {
+        readPAT(section, sectionSize);
+    } else if ((int) pid == pmtPid && section[0] == 0x02) {
+        readPMT(section, sectionSize);
+    }
+}
+
+void MPEGTSDemuxer::readPAT(const unsigned char* section, unsigned size)
+{
+    uint16_t program;
+    int pid;
+
+    for (unsigned i = PSI_HEADER_SIZE; i + 4 <= size - PSI_CRC_SIZE; i += 4) {
+        program = (section[i] << 8) | section[i + 1];
+        pid = ((section[i + 2] & 0x1F) << 8) | section[i + 3];
+
+        //NOTE: program 0 is the network information table
+        if (program == 0) {
+            continue;
+        }
+
+        if (pid != pmtPid) {
+            pmtPid = pid;
+            pmtVersion = -1;
+        }
+
+        return;
+    }
+}
+
+void MPEGTSDemuxer::readPMT(const unsigned char* section, unsigned size)
+{
+    int version = (section[5] >> 1) & 0x1F;
+    unsigned end = size - PSI_CRC_SIZE;
+    unsigned i;
+    unsigned char streamType;
+    uint16_t pid;
+    TSDemuxedStream stream;
+    StreamState state;
+
+    if (version == pmtVersion || size < PSI_HEADER_SIZE + 4 + PSI_CRC_SIZE) {
+        return;
+    }
+
+    pmtVersion = version;
+    i = PSI_HEADER_SIZE + 4 + (((section[10] & 0x0F) << 8) | section[11]);
+
+    for (; i + 5 <= end; i += 5 + (((section[i + 3] & 0x0F) << 8) | section[i + 4])) {
+        streamType = section[i];
+        pid = ((section[i + 1] & 0x1F) << 8) | section[i + 2];
+
+        if (pidStreams[pid] >= 0 || streams.size() >= TS_MAX_STREAMS) {
+            continue;
+        }
+
+        if (streamType != TS_STREAM_H264 && streamType != TS_STREAM_H265 &&
+            streamType != TS_STREAM_AAC && streamType != TS_STREAM_MP3) {
+            continue;
+        }
+
+        stream.pid = pid;
+        stream.streamType = streamType;
+        stream.sampleRate = 0;
+        stream.channels = 0;
+
+        state.length = 0;
+        state.pts = 0;
+        state.started = false;
+        state.bounded = false;
+        state.remaining = 0;
+        state.corrupt = false;
+        state.cc = -1;
+
+        pidStreams[pid] = streams.size();
+        streams.push_back(stream);
+        states.push_back(state);
+    }
+}
+
+void MPEGTSDemuxer::readPES(unsigned stream, const unsigned char* payload, unsigned size, bool unitStart)
+{
+    StreamState& state = states[stream];
+    bool video = isVideo(streams[stream].streamType);
+    unsigned pesLength;
+    unsigned headerLength;
+    bool hasPts;
+
+    if (!unitStart) {
+        if (state.started) {
+            append(state, payload, state.bounded ? std::min(size, state.remaining) : size);
+        }
+
+        if (state.started && state.bounded && state.remaining == 0) {
+            endUnit(stream);
+        }
+
+        return;
+    }
+
+    if (size < PES_HEADER_SIZE || payload[0] != 0x00 || payload[1] != 0x00 || payload[2] != 0x01) {
+        state.corrupt = state.started;
+        return;
+    }
+
+    pesLength = (payload[4] << 8) | payload[5];
+    headerLength = payload[8];
+    hasPts = (payload[7] & 0x80) && headerLength >= 5;
+
+    if (PES_HEADER_SIZE + headerLength > size || (pesLength != 0 && pesLength < 3 + headerLength)) {
+        state.corrupt = state.started;
+        return;
+    }
+
+    //NOTE: video PES packets without PTS carry the rest of the current access unit
+    if (video && !hasPts && state.started) {
+        append(state, payload + PES_HEADER_SIZE + headerLength, size - PES_HEADER_SIZE - headerLength);
+        return;
+    }
+
+    //NOTE: a bounded PES packet cut by the next one has lost some of its packets
+    if (state.started && state.bounded && state.remaining > 0) {
+        state.corrupt = true;
+    }
+
+    endUnit(stream);
+
+    state.started = true;
+    state.corrupt = false;
+    state.length = 0;
+    state.bounded = !video && pesLength != 0;
+    state.remaining = state.bounded ? pesLength - 3 - headerLength : 0;
+
+    if (hasPts) {
+        state.pts = unwrap(readPTS(payload + PES_HEADER_SIZE));
+    }
+
+    payload += PES_HEADER_SIZE + headerLength;
+    size -= PES_HEADER_SIZE + headerLength;
+
+    append(state, payload, state.bounded ? std::min(size, state.remaining) : size);
+
+    if (state.bounded && state.remaining == 0) {
+        endUnit(stream);
+    }
+}
+
+void MPEGTSDemuxer::append(StreamState& state, const unsigned char* data, unsigned size)
+{
+    if (state.bounded) {
+        state.remaining -= size;
+    }
+
+    if (state.corrupt || size == 0) {
+        return;
+    }
+
+    if (state.length + size > TS_DEMUXER_MAX_UNIT_SIZE) {
+        state.corrupt = true;
+        return;
+    }
+
+    if (state.unit.size() < state.length + size) {
+        state.unit.resize(state.length + size);
+    }
+
+    memcpy(state.unit.data() + state.length, data, size);
+    state.length += size;
+}
+
+void MPEGTSDemuxer::endUnit(unsigned stream)
+{
+    StreamState& state = states[stream];
+
+    if (!state.started) {
+        return;
+    }
+
+    state.started = false;
+
+    if (state.corrupt) {
+        state.corrupt = false;
+        droppedUnits++;
+        return;
+    }
+
+    if (state.length == 0) {
+        return;
+    }
+
+    if (streams[stream].streamType == TS_STREAM_AAC) {
+        deliverADTS(stream, state.unit.data(), state.length, state.pts);
+        return;
+    }
+
+    if (streams[stream].streamType == TS_STREAM_MP3) {
+        readMP3Header(stream, state.unit.data(), state.length);
+    }
+
+    fHandler(stream, state.unit.data(), state.length, state.pts);
+}
+
+void MPEGTSDemuxer::deliverADTS(unsigned stream, const unsigned char* data, unsigned size, uint64_t pts)
+{
+    TSDemuxedStream& s = streams[stream];
+    unsigned frameLength;
+    unsigned rateIndex;
+    unsigned frames = 0;
+
+    while (size >= ADTS_HEADER_SIZE) {
+        frameLength = ((data[3] & 0x03) << 11) | (data[4] << 3) | (data[5] >> 5);
+        rateIndex = (data[2] >> 2) & 0x0F;
+
+        if (data[0] != 0xFF || (data[1] & 0xF6) != 0xF0 || frameLength < ADTS_HEADER_SIZE ||
+            frameLength > size || rateIndex >= sizeof(adtsSampleRates)/sizeof(adtsSampleRates[0])) {
+            droppedUnits++;
+            break;
+        }
+
+        s.sampleRate = adtsSampleRates[rateIndex];
+        s.channels = ((data[2] & 0x01) << 2) | (data[3] >> 6);
+
+        //NOTE: the PES packet PTS is the one of its first frame
+        fHandler(stream, data, frameLength, pts + (uint64_t) frames*TS_AAC_FRAME_SAMPLES*90000/s.sampleRate);
+
+        frames++;
+        data += frameLength;
+        size -= frameLength;
+    }
+
+    //NOTE: PES packets without PTS follow the ones before them
+    if (s.sampleRate > 0) {
+        states[stream].pts = pts + (uint64_t) frames*TS_AAC_FRAME_SAMPLES*90000/s.sampleRate;
+    }
+}
+
+void MPEGTSDemuxer::readMP3Header(unsigned stream, const unsigned char* data, unsigned size)
+{
+    unsigned version;
+    unsigned rateIndex;
+
+    if (size < 4 || data[0] != 0xFF || (data[1] & 0xE0) != 0xE0) {
+        return;
+    }
+
+    version = (data[1] >> 3) & 0x03;
+    rateIndex = (data[2] >> 2) & 0x03;
+
+    if (version == 1 || rateIndex == 3) {
+        return;
+    }
+
+    //NOTE: MPEG-2 halves the MPEG-1 sample rates and MPEG-2.5 quarters them
+    streams[stream].sampleRate = mp3SampleRates[rateIndex] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+    streams[stream].channels = (data[3] >> 6) == 3 ? 1 : 2;
+}
+
+uint64_t MPEGTSDemuxer::unwrap(uint64_t pts)
+{
+    uint64_t unwrapped;
+
+    if (!ptsStarted) {
+        ptsStarted = true;
+        lastPts = pts;
+        return pts;
+    }
+
+    unwrapped = (lastPts & ~TS_PTS_MASK) | pts;
+
+    //NOTE: streams are interleaved close to each other, so a half range difference is a wrap
+    if (unwrapped + PTS_WRAP/2 < lastPts) {
+        unwrapped += PTS_WRAP;
+    } else if (unwrapped > lastPts + PTS_WRAP/2 && unwrapped >= PTS_WRAP) {
+        unwrapped -= PTS_WRAP;
+    }
+
+    lastPts = unwrapped;
+
+    return unwrapped;
+}
@@ -0,0 +1,135 @@
+/*
+ *  MPEGTSDemuxer.hh - MPEG-TS demuxer splitting a program in elementary stream units
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _MPEGTS_DEMUXER_HH
+#define _MPEGTS_DEMUXER_HH
+
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+#include "../transmitter/TSPacketizer.hh"
+
+#define TS_PAT_PID 0x0000
+#define TS_PID_NUM 0x2000
+#define TS_SYNC_BYTE 0x47
+#define TS_DEMUXER_MAX_UNIT_SIZE 1024*1024*2    //!< Largest unit kept, larger ones are dropped
+#define TS_AAC_FRAME_SAMPLES 1024
+
+/*! Elementary stream of the demuxed program */
+struct TSDemuxedStream {
+    uint16_t pid;
+    unsigned char streamType;       //!< PMT stream type, TS_STREAM_H264, TS_STREAM_H265, TS_STREAM_AAC or TS_STREAM_MP3
+    unsigned sampleRate;            //!< Audio sample rate, 0 until the first frame header has been read
+    unsigned channels;              //!< Audio channels, 0 until the first frame header has been read
+};
+
+/*! Demuxes the first program of an MPEG-TS stream. PAT and PMT sections are expected to fit in a single
+    TS packet, as the usual encoders and TSPacketizer write them. The elementary streams of the supported
+    stream types are numbered in the order they first appear in the PMT, and keep their number if the PMT
+    changes. Video units are whole access units, they are delivered when the next PES packet with a PTS of
+    the same stream starts, PES packets without PTS are appended to the current one. Audio PES packets are
+    delivered as soon as they are complete, AAC ones split in ADTS frames. Units whose packets are lost
+    according to the continuity counters are dropped. PTS are unwrapped, so they do not jump back every 26
+    hours. Unit buffers are reused, so nothing is allocated once the first units have been demuxed.
+*/
+class MPEGTSDemuxer {
+
+public:
+    /**
+    * Callback of the demuxed units, the data is only valid during the call
+    * @param stream stream number, index of getStreams
+    * @param data unit data
+    * @param size unit size in bytes
+    * @param pts unwrapped presentation time stamp in 90 kHz units
+    */
+    typedef std::function<void(unsigned stream, const unsigned char* data, unsigned size, uint64_t pts)> UnitHandler;
+
+    /**
+    * Class constructor
+    * @param handler callback of the demuxed units
+    */
+    MPEGTSDemuxer(UnitHandler handler);
+
+    /**
+    * Demuxes TS packets, bytes before a sync byte are skipped and an incomplete last packet is dropped
+    * @param data TS packets
+    * @param size data size in bytes
+    * @return number of TS packets read
+    */
+    unsigned push(const unsigned char* data, unsigned size);
+
+    /**
+    * Delivers the video units waiting for the next PES packet
+    */
+    void flush();
+
+    /**
+    * Forgets the program and the pending units, the stream numbers are kept
+    */
+    void reset();
+
+    const std::vector<TSDemuxedStream>& getStreams() const {return streams;};
+    size_t getPackets() const {return packets;};
+    size_t getDiscontinuities() const {return discontinuities;};
+    size_t getDroppedUnits() const {return droppedUnits;};
+
+private:
+    struct StreamState {
+        std::vector<unsigned char> unit;
+        unsigned length;
+        uint64_t pts;
+        bool started;               //!< A unit is being read
+        bool bounded;               //!< The PES packet length is known, the unit ends with it
+        unsigned remaining;         //!< PES bytes left when it is bounded
+        bool corrupt;
+        int cc;                     //!< Last continuity counter, -1 if there is none
+    };
+
+    void readPacket(const unsigned char* packet);
+    void readSection(uint16_t pid, const unsigned char* payload, unsigned size);
+    void readPAT(const unsigned char* section, unsigned size);
+    void readPMT(const unsigned char* section, unsigned size);
+    void readPES(unsigned stream, const unsigned char* payload, unsigned size, bool unitStart);
+    void append(StreamState& state, const unsigned char* data, unsigned size);
+    void endUnit(unsigned stream);
+    void deliverADTS(unsigned stream, const unsigned char* data, unsigned size, uint64_t pts);
+    void readMP3Header(unsigned stream, const unsigned char* data, unsigned size);
+    uint64_t unwrap(uint64_t pts);
+
+    UnitHandler fHandler;
+    std::vector<TSDemuxedStream> streams;
+    std::vector<StreamState> states;
+    std::vector<int> pidStreams;            //!< Stream number of each PID, -1 if it is not demuxed
+
+    int pmtPid;
+    int pmtVersion;
+
+    bool ptsStarted;
+    uint64_t lastPts;                       //!< Last unwrapped PTS
+
+    size_t packets;
+    size_t discontinuities;
+    size_t droppedUnits;
+};
+
+#endif
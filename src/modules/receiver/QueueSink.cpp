@@ -23,11 +23,23 @@
 
 #include "QueueSink.hh"
 #include "../../Utils.hh"
+#include "../../IOReactor.hh"
 
 #include <sys/time.h>
+#include <cstring>
+
+#define H264_NALU_TYPE_MASK 0x1F
+#define H265_NALU_TYPE_MASK 0x7E
+#define H264_AUD 9
+#define H265_AUD 35
+#define NAL_START_CODE_SIZE 4
 
 QueueSink::QueueSink(UsageEnvironment& env, unsigned port, FramedFilter* filter)
-  : MediaSink(env), fPort(port), nextFrame(true), fFilter(filter)
+  : MediaSink(env), fPort(port), nextFrame(true), filled(false), waiting(false),
+    dummyRead(false), bufferedRead(false), cachedRead(false), fFilter(filter), jitterBuffer(NULL),
+    buffering(false), releaseTask(NULL), gopCache(NULL), standby(false), clockRecovery(NULL), auSource(NULL),
+    auCodec(VC_NONE), auRead(false), auBuffer(NULL), auMaxSize(0), auLength(0), auPts(0), auDiscard(false),
+    carryPts(0), nestedReads(0), awaiter(NULL)
 {
     frame = NULL;
     dummyBuffer = new unsigned char[DUMMY_RECEIVE_BUFFER_SIZE];
@@ -35,7 +47,11 @@ QueueSink::QueueSink(UsageEnvironment& env, unsigned port, FramedFilter* filter)
 
 QueueSink::~QueueSink()
 {
+    envir().taskScheduler().unscheduleDelayedTask(releaseTask);
     delete[] dummyBuffer;
+    delete jitterBuffer;
+    delete gopCache;
+    delete clockRecovery;
 }
 
 QueueSink* QueueSink::createNew(UsageEnvironment& env, unsigned port, FramedFilter* filter)
@@ -50,21 +66,48 @@ Boolean QueueSink::continuePlaying()
         return False;
     }
 
+    if (auSource){
+        readNalUnit();
+        return True;
+    }
+
+    //NOTE: a standby sink keeps reading into the GOP cache until the cached frames have been delivered
+    if (standby && (!frame || !gopCache->empty())){
+        dummyRead = false;
+        cachedRead = true;
+        fSource->getNextFrame(gopCache->writeBuffer(DUMMY_RECEIVE_BUFFER_SIZE), DUMMY_RECEIVE_BUFFER_SIZE,
+                              afterGettingFrame, this,
+                              onSourceClosure, this);
+        return True;
+    }
+
     if (!frame){
         utils::debugMsg("Using dummy buffer, no writer connected yet");
+        dummyRead = true;
         fSource->getNextFrame(dummyBuffer, DUMMY_RECEIVE_BUFFER_SIZE,
                               afterGettingFrame, this,
                               onSourceClosure, this);
         return True;
     }
     
+    //NOTE: the jitter buffer keeps reading while frames wait to be released
+    if (buffering){
+        dummyRead = false;
+        bufferedRead = true;
+        fSource->getNextFrame(jitterBuffer->writeBuffer(frame->getMaxLength()), frame->getMaxLength(),
+                  afterGettingFrame, this,
+                  onSourceClosure, this);
+        return True;
+    }
+
+    //NOTE: live555 keeps buffering the incoming packets meanwhile, setFrame resumes reading
     if (nextFrame){
-        nextTask() = envir().taskScheduler().scheduleDelayedTask(0,
-            (TaskFunc*)QueueSink::staticContinuePlaying, this);
+        waiting = true;
         return True;
     }
 
 
+    dummyRead = false;
     fSource->getNextFrame(frame->getDataBuf(), frame->getMaxLength(),
               afterGettingFrame, this,
               onSourceClosure, this);
@@ -73,11 +116,17 @@ Boolean QueueSink::continuePlaying()
 }
 
 void QueueSink::afterGettingFrame(void* clientData, unsigned frameSize,
-                 unsigned /*numTruncatedBytes*/,
+                 unsigned numTruncatedBytes,
                  struct timeval presentationTime,
                  unsigned /*durationInMicroseconds*/)
 {
   QueueSink* sink = (QueueSink*)clientData;
+
+  if (sink->auRead){
+      sink->afterGettingNalUnit(frameSize, numTruncatedBytes, presentationTime);
+      return;
+  }
+
   sink->afterGettingFrame(frameSize, presentationTime);
 }
 
@@ -85,13 +134,38 @@ void QueueSink::afterGettingFrame(unsigned frameSize, struct timeval presentatio
 {
     std::chrono::microseconds ts = std::chrono::microseconds(presentationTime.tv_sec * std::micro::den + presentationTime.tv_usec);
 
-    if (frame != NULL) {
-        frame->setLength(frameSize);
-        frame->setPresentationTime(ts);
-        frame->setDecodeTime(NO_DTS);
-        frame->setConsumed(true);
+    if (clockRecovery) {
+        ts = clockRecovery->recover(ts);
+    }
+
+    if (cachedRead) {
+        cachedRead = false;
+
+        if (standby) {
+            gopCache->push(frameSize, ts);
+            deliverCachedFrame();
+        }
+    } else if (bufferedRead) {
+        bufferedRead = false;
+
+        //NOTE: a frame read while the jitter buffer is being disabled is dropped
+        if (buffering) {
+            jitterBuffer->push(frameSize, ts);
+            releaseFrames();
+        }
+    } else if (!dummyRead) {
+        //NOTE: a frame set while reading into the dummy buffer is filled by the next read
+        if (frame != NULL) {
+            frame->setLength(frameSize);
+            frame->setPresentationTime(ts);
+            frame->setDecodeTime(NO_DTS);
+            filled = true;
+            frameFilled();
+        }
+
         nextFrame = true;
     }
+
     nextTask() = envir().taskScheduler().scheduleDelayedTask(0,
         (TaskFunc*)QueueSink::staticContinuePlaying, this);
 }
@@ -102,16 +176,359 @@ void QueueSink::staticContinuePlaying(QueueSink *sink)
 }
 
 bool QueueSink::setFrame(Frame *f){
-    if (nextFrame){
-        frame = f;
-        nextFrame = false;
-        return true;
+    if (!nextFrame || filled){
+        return false;
+    }
+
+    frame = f;
+    nextFrame = false;
+
+    if (standby){
+        deliverCachedFrame();
+    }
+
+    if (waiting){
+        waiting = false;
+        continuePlaying();
+    }
+
+    if (buffering){
+        releaseFrames();
     }
-    return false;
+
+    return true;
 }
 
+void QueueSink::frameFilled()
+{
+    if (awaiter){
+        awaiter->resume();
+    }
+}
+
+bool QueueSink::collectFrame(Frame *f)
+{
+    if (!filled || frame != f){
+        return false;
+    }
+
+    filled = false;
+    return true;
+}
 
 void QueueSink::disconnect()
 {
-  frame = NULL;
+    frame = NULL;
+    filled = false;
+    resetAccessUnit();
+
+    //NOTE: the rest of the delivered GOP cannot be decoded by the next writer
+    if (standby){
+        gopCache->clear();
+    }
+
+    if (buffering){
+        envir().taskScheduler().unscheduleDelayedTask(releaseTask);
+        jitterBuffer->flush();
+        nextFrame = true;
+    }
+
+    if (waiting){
+        waiting = false;
+        continuePlaying();
+    }
+}
+
+void QueueSink::setJitterBuffer(unsigned maxDelay, unsigned minDelay)
+{
+    if (maxDelay == 0){
+        if (buffering){
+            envir().taskScheduler().unscheduleDelayedTask(releaseTask);
+            jitterBuffer->flush();
+            buffering = false;
+            resetAccessUnit();
+        }
+        return;
+    }
+
+    if (!jitterBuffer){
+        jitterBuffer = new JitterBuffer(maxDelay, minDelay);
+    }
+
+    jitterBuffer->setDelays(maxDelay, minDelay);
+
+    if (!buffering){
+        buffering = true;
+        resetAccessUnit();
+
+        if (waiting){
+            waiting = false;
+            continuePlaying();
+        }
+    }
+}
+
+void QueueSink::setClockRecovery(double bandwidth)
+{
+    if (bandwidth <= 0) {
+        delete clockRecovery;
+        clockRecovery = NULL;
+        return;
+    }
+
+    if (!clockRecovery) {
+        clockRecovery = new ClockRecovery(bandwidth);
+        return;
+    }
+
+    clockRecovery->setBandwidth(bandwidth);
+}
+
+void QueueSink::setJitter(std::chrono::microseconds jitter)
+{
+    if (buffering){
+        jitterBuffer->setJitter(jitter);
+    }
+}
+
+void QueueSink::staticReleaseFrames(QueueSink *sink)
+{
+    sink->releaseTask = NULL;
+    sink->releaseFrames();
+}
+
+void QueueSink::releaseFrames()
+{
+    unsigned length;
+    std::chrono::microseconds ts;
+    std::chrono::microseconds wait;
+
+    envir().taskScheduler().unscheduleDelayedTask(releaseTask);
+
+    //NOTE: a released frame waits to be collected, the next one is released when a new frame is set
+    if (frame == NULL || nextFrame || filled){
+        return;
+    }
+
+    if (jitterBuffer->release(frame->getDataBuf(), frame->getMaxLength(), length, ts)){
+        frame->setLength(length);
+        frame->setPresentationTime(ts);
+        frame->setDecodeTime(NO_DTS);
+        filled = true;
+        nextFrame = true;
+        frameFilled();
+        return;
+    }
+
+    if ((wait = jitterBuffer->timeToRelease()).count() >= 0){
+        releaseTask = envir().taskScheduler().scheduleDelayedTask(wait.count(),
+            (TaskFunc*)QueueSink::staticReleaseFrames, this);
+    }
+}
+
+void QueueSink::deliverCachedFrame()
+{
+    unsigned length;
+    std::chrono::microseconds ts;
+
+    if (frame == NULL || nextFrame || filled){
+        return;
+    }
+
+    if (gopCache->pop(frame->getDataBuf(), frame->getMaxLength(), length, ts)){
+        frame->setLength(length);
+        frame->setPresentationTime(ts);
+        frame->setDecodeTime(NO_DTS);
+        filled = true;
+        nextFrame = true;
+        frameFilled();
+    }
+}
+
+bool QueueSink::setGopCache(VCodecType codec)
+{
+    //NOTE: the cache is kept once created, a read may be writing into its buffer
+    if (codec == VC_NONE){
+        if (gopCache){
+            gopCache->clear();
+        }
+        standby = false;
+        return true;
+    }
+
+    if ((codec != H264 && codec != H265) || !fFilter || auSource){
+        utils::errorMsg("Only H.264 and H.265 sinks not assembling access units can be kept on standby");
+        return false;
+    }
+
+    if (!gopCache){
+        gopCache = new GopCache(codec);
+    }
+
+    standby = true;
+    return true;
+}
+
+bool QueueSink::setAccessUnits(RTPSource* rtpSource, VCodecType codec)
+{
+    if (rtpSource && ((codec != H264 && codec != H265) || !fFilter)){
+        utils::errorMsg("Access units are only assembled from H.264 and H.265 NAL units with start codes");
+        return false;
+    }
+
+    if (rtpSource){
+        setGopCache(VC_NONE);
+    }
+
+    resetAccessUnit();
+    auSource = rtpSource;
+    auCodec = codec;
+
+    //NOTE: a source stopped while no writer was connected reads into the dummy buffer again
+    if (waiting){
+        waiting = false;
+        continuePlaying();
+    }
+
+    return true;
+}
+
+bool QueueSink::readNalUnit()
+{
+    //NOTE: the source stops receiving while nobody takes the frames, setFrame restarts it
+    if (!frame){
+        waiting = true;
+        fSource->stopGettingFrames();
+        return false;
+    }
+
+    if (!auBuffer){
+        if (!buffering && nextFrame){
+            waiting = true;
+            return false;
+        }
+
+        auMaxSize = frame->getMaxLength();
+        auBuffer = buffering ? jitterBuffer->writeBuffer(auMaxSize) : frame->getDataBuf();
+        auLength = 0;
+
+        if (!carry.empty() && carry.size() <= auMaxSize){
+            memcpy(auBuffer, carry.data(), carry.size());
+            auLength = carry.size();
+            auPts = carryPts;
+        }
+
+        carry.clear();
+    }
+
+    auRead = true;
+    dummyRead = false;
+    bufferedRead = false;
+    fSource->getNextFrame(auBuffer + auLength, auMaxSize - auLength,
+              afterGettingFrame, this,
+              onSourceClosure, this);
+
+    return true;
+}
+
+void QueueSink::afterGettingNalUnit(unsigned frameSize, unsigned numTruncatedBytes, struct timeval presentationTime)
+{
+    std::chrono::microseconds ts = std::chrono::microseconds(presentationTime.tv_sec * std::micro::den + presentationTime.tv_usec);
+
+    if (clockRecovery) {
+        ts = clockRecovery->recover(ts);
+    }
+
+    auRead = false;
+
+    //NOTE: NAL units read while the access unit is reset are dropped, parameter sets injected from
+    //      the SDP come without data
+    if (auSource && auBuffer && frameSize > NAL_START_CODE_SIZE){
+        appendNalUnit(frameSize, numTruncatedBytes, ts);
+    }
+
+    //NOTE: the next NAL unit is read at once, live555 delivers it from this call if it is already received
+    if (nestedReads < QUEUE_SINK_MAX_NESTED_READS){
+        nestedReads++;
+        continuePlaying();
+        nestedReads--;
+    } else {
+        nextTask() = envir().taskScheduler().scheduleDelayedTask(0,
+            (TaskFunc*)QueueSink::staticContinuePlaying, this);
+    }
+}
+
+void QueueSink::appendNalUnit(unsigned size, unsigned numTruncatedBytes, std::chrono::microseconds ts)
+{
+    unsigned char* nal = auBuffer + auLength;
+    unsigned char nalType;
+
+    if (numTruncatedBytes > 0){
+        utils::warningMsg("Access unit larger than the frame, it is dropped");
+        auLength = 0;
+        auPts = ts;
+        auDiscard = true;
+        return;
+    }
+
+    if (auDiscard && ts == auPts){
+        return;
+    }
+
+    auDiscard = false;
+
+    if (auCodec == H264){
+        nalType = nal[NAL_START_CODE_SIZE] & H264_NALU_TYPE_MASK;
+    } else {
+        nalType = (nal[NAL_START_CODE_SIZE] & H265_NALU_TYPE_MASK) >> 1;
+    }
+
+    if (nalType == (auCodec == H264 ? H264_AUD : H265_AUD)){
+        commitAccessUnit();
+        return;
+    }
+
+    //NOTE: the marker bit of the previous access unit was lost, this NAL unit starts the next one
+    if (auLength > 0 && ts != auPts){
+        carry.assign(nal, nal + size);
+        carryPts = ts;
+        commitAccessUnit();
+        return;
+    }
+
+    auLength += size;
+    auPts = ts;
+
+    if (auSource->curPacketMarkerBit()){
+        commitAccessUnit();
+    }
+}
+
+void QueueSink::commitAccessUnit()
+{
+    if (auLength > 0 && buffering){
+        jitterBuffer->push(auLength, auPts);
+    } else if (auLength > 0){
+        frame->setLength(auLength);
+        frame->setPresentationTime(auPts);
+        frame->setDecodeTime(NO_DTS);
+        filled = true;
+        nextFrame = true;
+        frameFilled();
+    }
+
+    auBuffer = NULL;
+    auLength = 0;
+
+    if (buffering){
+        releaseFrames();
+    }
+}
+
+void QueueSink::resetAccessUnit()
+{
+    auBuffer = NULL;
+    auLength = 0;
+    auDiscard = false;
+    carry.clear();
 }
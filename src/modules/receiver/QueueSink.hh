@@ -24,11 +24,18 @@
 #ifndef _QUEUE_SINK_HH
 #define _QUEUE_SINK_HH
 
+#include <vector>
 #include <liveMedia.hh>
 
 #include "../../Frame.hh"
+#include "JitterBuffer.hh"
+#include "GopCache.hh"
+#include "ClockRecovery.hh"
 
 #define DUMMY_RECEIVE_BUFFER_SIZE 200000
+#define QUEUE_SINK_MAX_NESTED_READS 32      //!< NAL units read from the delivery of the previous one
+
+class Awaiter;
 
 class QueueSink: public MediaSink {
 
@@ -54,6 +61,14 @@ public:
      * @return true if successfully updated frame, false if not ready to set next frame.
      */
     bool setFrame(Frame *f);
+
+    /**
+     * Takes the frame once the sink has filled it. The sink does not mark it as consumed itself, it is
+     * filled by the receiver event loop while the frame queue is handled by the filter thread
+     * @param f frame previously set with setFrame
+     * @return true if the frame is complete, then a new frame can be set
+     */
+    bool collectFrame(Frame *f);
     
     /**
     * @return filter pointer of the source.
@@ -65,6 +80,71 @@ public:
      */
     void disconnect();
 
+    /**
+     * Sets the suspension point of the filter collecting the frames, it is resumed every time a frame
+     * is filled so the filter is not polled meanwhile
+     * @param awaiter_ awaiter of the filter, NULL to stop resuming it
+     */
+    void setAwaiter(Awaiter* awaiter_) {awaiter = awaiter_;};
+
+    /**
+     * Enables the jitter buffer, frames are then held until their presentation time plus an adaptive delay
+     * @param maxDelay largest delay in msec, 0 disables the jitter buffer and drops the frames it holds
+     * @param minDelay smallest delay in msec
+     */
+    void setJitterBuffer(unsigned maxDelay, unsigned minDelay = JITTER_BUFFER_MIN_DELAY);
+
+    /**
+     * @param jitter measured interarrival jitter, it sets the jitter buffer delay
+     */
+    void setJitter(std::chrono::microseconds jitter);
+
+    /**
+     * Enables the clock recovery, the presentation times of the frames are then replaced by the recovered
+     * ones before they are buffered, cached or delivered
+     * @param bandwidth loop bandwidth in Hz, 0 disables the clock recovery
+     */
+    void setClockRecovery(double bandwidth);
+
+    /**
+     * @return the clock recovery, NULL if it is disabled
+     */
+    ClockRecovery* getClockRecovery() {return clockRecovery;};
+
+    /**
+     * Enables the access unit mode, the H.264 or H.265 NAL units are then appended to the frame of their
+     * access unit, which is complete on the RTP marker bit, on an access unit delimiter or when the
+     * presentation time changes. Nothing is received while no writer is connected
+     * @param rtpSource RTP source of the NAL units, whose marker bit ends the access units, NULL disables it
+     * @param codec H264 or H265
+     * @return false if the codec is not H.264 nor H.265 or the NAL units do not have start codes
+     */
+    bool setAccessUnits(RTPSource* rtpSource, VCodecType codec);
+
+    /**
+     * @return true if the frames hold whole access units instead of single NAL units
+     */
+    bool getAccessUnits() const {return auSource != NULL;};
+
+    /**
+     * Enables the standby mode of an H.264 or H.265 sink, it then keeps the NAL units since the last random
+     * access point while no writer is connected and delivers them first when one is, one per frame, so
+     * decoding starts at once. It does not apply to the access unit mode, which does not read without writer
+     * @param codec H264 or H265, VC_NONE disables it
+     * @return false if the codec is not H.264 nor H.265 or the access unit mode is enabled
+     */
+    bool setGopCache(VCodecType codec);
+
+    /**
+     * @return the GOP cache of the standby mode, NULL if it is disabled
+     */
+    GopCache* getGopCache() {return standby ? gopCache : NULL;};
+
+    /**
+     * @return the jitter buffer, NULL if it is disabled
+     */
+    JitterBuffer* getJitterBuffer() {return buffering ? jitterBuffer : NULL;};
+
 protected:
     QueueSink(UsageEnvironment& env, unsigned port, FramedFilter* filter);
     ~QueueSink();
@@ -76,6 +156,15 @@ protected:
                 struct timeval presentationTime,
                 unsigned durationInMicroseconds);
     virtual void afterGettingFrame(unsigned frameSize, struct timeval presentationTime);
+    void static staticReleaseFrames(QueueSink *sink);
+    void releaseFrames();
+    void deliverCachedFrame();
+    bool readNalUnit();
+    void afterGettingNalUnit(unsigned frameSize, unsigned numTruncatedBytes, struct timeval presentationTime);
+    void appendNalUnit(unsigned size, unsigned numTruncatedBytes, std::chrono::microseconds ts);
+    void commitAccessUnit();
+    void resetAccessUnit();
+    void frameFilled();
 
 protected:
     unsigned fPort;
@@ -83,7 +172,34 @@ protected:
     
     unsigned char *dummyBuffer;
     bool nextFrame;
+    bool filled;                    //!< The frame is complete and it has not been collected yet
+    bool waiting;                   //!< Reading is stopped until a new frame is set
+    bool dummyRead;                 //!< The frame being read goes to the dummy buffer
+    bool bufferedRead;              //!< The frame being read goes to the jitter buffer
+    bool cachedRead;                //!< The frame being read goes to the GOP cache
     FramedFilter* fFilter;
+
+    JitterBuffer* jitterBuffer;
+    bool buffering;
+    TaskToken releaseTask;
+
+    GopCache* gopCache;
+    bool standby;
+
+    ClockRecovery* clockRecovery;
+
+    RTPSource* auSource;            //!< Source of the access unit mode marker bits, NULL if it is disabled
+    VCodecType auCodec;
+    bool auRead;                    //!< The NAL unit being read goes to the current access unit
+    unsigned char* auBuffer;        //!< Buffer of the current access unit, a frame or a jitter buffer one
+    unsigned auMaxSize;
+    unsigned auLength;
+    std::chrono::microseconds auPts;
+    bool auDiscard;                 //!< The access unit overflowed the frame, its NAL units are dropped
+    std::vector<unsigned char> carry;   //!< First NAL unit of the next access unit, read before the marker
+    std::chrono::microseconds carryPts;
+    unsigned nestedReads;
+    Awaiter* awaiter;
 };
 
 #endif
@@ -0,0 +1,280 @@
+/*
+ *  ReceiveTaskScheduler.cpp - epoll based live555 task scheduler of the receive loops
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "ReceiveTaskScheduler.hh"
+#include "BatchedReceiveGroupsock.hh"
+#include "../../Utils.hh"
+
+ReceiveTaskScheduler* ReceiveTaskScheduler::createNew()
+{
+    ReceiveTaskScheduler* scheduler = new ReceiveTaskScheduler();
+
+    if (scheduler->epollFd < 0 || scheduler->wakeFd < 0) {
+        utils::errorMsg("Could not create the epoll instance of a receive loop");
+        delete scheduler;
+        return NULL;
+    }
+
+    return scheduler;
+}
+
+ReceiveTaskScheduler::ReceiveTaskScheduler() : BasicTaskScheduler0(), events(RECEIVE_MAX_EVENTS)
+{
+    struct epoll_event event;
+
+    for (unsigned i = 0; i < RECEIVE_MAX_TRIGGERS; i++) {
+        triggerHandlers[i] = NULL;
+        triggerClientDatas[i] = NULL;
+        triggered[i] = false;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (epollFd < 0 || wakeFd < 0) {
+        return;
+    }
+
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+}
+
+ReceiveTaskScheduler::~ReceiveTaskScheduler()
+{
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+}
+
+void ReceiveTaskScheduler::addGroupsock(BatchedReceiveGroupsock* groupsock)
+{
+    groupsocks.push_back(groupsock);
+}
+
+void ReceiveTaskScheduler::removeGroupsock(BatchedReceiveGroupsock* groupsock)
+{
+    groupsocks.erase(std::remove(groupsocks.begin(), groupsocks.end(), groupsock), groupsocks.end());
+}
+
+EventTriggerId ReceiveTaskScheduler::createEventTrigger(TaskFunc* eventHandlerProc)
+{
+    for (unsigned i = 0; i < RECEIVE_MAX_TRIGGERS; i++) {
+        if (triggerHandlers[i] == NULL) {
+            triggerHandlers[i] = eventHandlerProc;
+            triggered[i] = false;
+            return 1u << i;
+        }
+    }
+
+    return 0;
+}
+
+void ReceiveTaskScheduler::deleteEventTrigger(EventTriggerId eventTriggerId)
+{
+    for (unsigned i = 0; i < RECEIVE_MAX_TRIGGERS; i++) {
+        if (eventTriggerId & (1u << i)) {
+            triggerHandlers[i] = NULL;
+            triggerClientDatas[i] = NULL;
+            triggered[i] = false;
+        }
+    }
+}
+
+void ReceiveTaskScheduler::triggerEvent(EventTriggerId eventTriggerId, void* clientData)
+{
+    uint64_t wake = 1;
+
+    for (unsigned i = 0; i < RECEIVE_MAX_TRIGGERS; i++) {
+        if (eventTriggerId & (1u << i)) {
+            triggerClientDatas[i] = clientData;
+            triggered[i] = true;
+        }
+    }
+
+    if (write(wakeFd, &wake, sizeof(wake)) < 0) {
+        //NOTE: the counter is only full if the loop is not reading it, the trigger is handled anyway
+    }
+}
+
+void ReceiveTaskScheduler::setBackgroundHandling(int socketNum, int conditionSet,
+                                                 BackgroundHandlerProc* handlerProc, void* clientData)
+{
+    struct epoll_event event;
+    bool known;
+
+    if (socketNum < 0) {
+        return;
+    }
+
+    known = handlers.count(socketNum) > 0;
+
+    if (conditionSet == 0 || handlerProc == NULL) {
+        if (known) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, socketNum, NULL);
+            handlers.erase(socketNum);
+        }
+        return;
+    }
+
+    event.events = 0;
+    event.data.fd = socketNum;
+
+    if (conditionSet & SOCKET_READABLE) {
+        event.events |= EPOLLIN;
+    }
+    if (conditionSet & SOCKET_WRITABLE) {
+        event.events |= EPOLLOUT;
+    }
+    if (conditionSet & SOCKET_EXCEPTION) {
+        event.events |= EPOLLPRI;
+    }
+
+    //NOTE: closed sockets leave the epoll set on their own, so a known socket number may be a new socket
+    if (epoll_ctl(epollFd, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, socketNum, &event) < 0) {
+        epoll_ctl(epollFd, known ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, socketNum, &event);
+    }
+
+    handlers[socketNum] = {conditionSet, handlerProc, clientData};
+}
+
+void ReceiveTaskScheduler::moveSocketHandling(int oldSocketNum, int newSocketNum)
+{
+    SocketHandler handler;
+
+    if (handlers.count(oldSocketNum) <= 0) {
+        return;
+    }
+
+    handler = handlers[oldSocketNum];
+    setBackgroundHandling(oldSocketNum, 0, NULL, NULL);
+    setBackgroundHandling(newSocketNum, handler.conditionSet, handler.handlerProc, handler.clientData);
+}
+
+void ReceiveTaskScheduler::SingleStep(unsigned maxDelayTime)
+{
+    int ready;
+    int conditionSet;
+    uint64_t wake;
+
+    ready = epoll_wait(epollFd, events.data(), events.size(), handlePendingPackets() ? 0 : waitTime(maxDelayTime));
+
+    if (ready < 0 && errno != EINTR) {
+        utils::errorMsg("Receive loop epoll_wait failed");
+    }
+
+    //NOTE: handlers may remove or replace other handlers, so they are looked up again for each event
+    for (int i = 0; i < ready; i++) {
+        if (events[i].data.fd == wakeFd) {
+            while (read(wakeFd, &wake, sizeof(wake)) > 0) {}
+            continue;
+        }
+
+        conditionSet = 0;
+
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            conditionSet |= SOCKET_READABLE;
+        }
+        if (events[i].events & EPOLLOUT) {
+            conditionSet |= SOCKET_WRITABLE;
+        }
+        if (events[i].events & (EPOLLPRI | EPOLLERR)) {
+            conditionSet |= SOCKET_EXCEPTION;
+        }
+
+        runHandler(events[i].data.fd, conditionSet);
+    }
+
+    handleTriggers();
+    fDelayQueue.handleAlarm();
+}
+
+bool ReceiveTaskScheduler::runHandler(int socketNum, int conditionSet)
+{
+    SocketHandler handler;
+
+    if (handlers.count(socketNum) <= 0 || (handlers[socketNum].conditionSet & conditionSet) == 0) {
+        return false;
+    }
+
+    handler = handlers[socketNum];
+    (*handler.handlerProc)(handler.clientData, handler.conditionSet & conditionSet);
+
+    return true;
+}
+
+bool ReceiveTaskScheduler::handlePendingPackets()
+{
+    unsigned handled;
+    bool pending = false;
+
+    //NOTE: handlers may close groupsocks, so they are looked up by index and the list is not cached
+    for (size_t i = 0; i < groupsocks.size(); i++) {
+        handled = 0;
+
+        while (i < groupsocks.size() && groupsocks[i]->getPendingPackets() > 0) {
+            if (handled == RECV_BATCH_PACKETS) {
+                pending = true;
+                break;
+            }
+
+            if (!runHandler(groupsocks[i]->socketNum(), SOCKET_READABLE)) {
+                break;
+            }
+
+            handled++;
+        }
+    }
+
+    return pending;
+}
+
+void ReceiveTaskScheduler::handleTriggers()
+{
+    for (unsigned i = 0; i < RECEIVE_MAX_TRIGGERS; i++) {
+        if (triggered[i].exchange(false) && triggerHandlers[i] != NULL) {
+            (*triggerHandlers[i])(triggerClientDatas[i]);
+        }
+    }
+}
+
+int ReceiveTaskScheduler::waitTime(unsigned maxDelayTime)
+{
+    DelayInterval const& delay = fDelayQueue.timeToNextAlarm();
+    int64_t usecs = (int64_t) delay.seconds()*1000000 + delay.useconds();
+
+    if (maxDelayTime > 0 && usecs > maxDelayTime) {
+        usecs = maxDelayTime;
+    }
+
+    //NOTE: epoll waits msec, rounding up avoids spinning until a task which is less than one msec away
+    return std::min((usecs + 999)/1000, (int64_t) RECEIVE_MAX_WAIT);
+}
@@ -0,0 +1,109 @@
+/*
+ *  ReceiveTaskScheduler.hh - epoll based live555 task scheduler of the receive loops
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _RECEIVE_TASK_SCHEDULER_HH
+#define _RECEIVE_TASK_SCHEDULER_HH
+
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include <sys/epoll.h>
+#include <BasicUsageEnvironment.hh>
+
+#define RECEIVE_MAX_EVENTS 256          //!< Ready sockets handled by a single step
+#define RECEIVE_MAX_TRIGGERS 32         //!< Event triggers, one per EventTriggerId bit
+#define RECEIVE_MAX_WAIT 1000000        //!< Longest wait in msec, when there are no delayed tasks
+
+class BatchedReceiveGroupsock;
+
+/*! Task scheduler of the receiver event loops. live555 BasicTaskScheduler waits with select, which is
+    limited to FD_SETSIZE sockets and scans all of them at every step. This one waits with epoll, so
+    steps only cost the ready sockets, and it handles all of them at each step instead of one. Its event
+    triggers wake a waiting step up, so they can be triggered from other threads. Packets already read by
+    a BatchedReceiveGroupsock batch do not make its socket readable, so each step first runs the read
+    handler of the groupsocks with pending packets until they are consumed.
+*/
+class ReceiveTaskScheduler : public BasicTaskScheduler0 {
+
+public:
+    /**
+    * @return Pointer to the object if succeded and NULL if epoll is not available
+    */
+    static ReceiveTaskScheduler* createNew();
+
+    /**
+    * Class destructor
+    */
+    virtual ~ReceiveTaskScheduler();
+
+    /**
+    * @param groupsock groupsock whose pending packets are handed to its read handler
+    */
+    void addGroupsock(BatchedReceiveGroupsock* groupsock);
+
+    /**
+    * @param groupsock groupsock to forget, it is called by its destructor
+    */
+    void removeGroupsock(BatchedReceiveGroupsock* groupsock);
+
+    /**
+    * @return sockets with a handler
+    */
+    size_t getSocketsNum() const {return handlers.size();};
+
+    EventTriggerId createEventTrigger(TaskFunc* eventHandlerProc);
+    void deleteEventTrigger(EventTriggerId eventTriggerId);
+    void triggerEvent(EventTriggerId eventTriggerId, void* clientData = NULL);
+
+    void setBackgroundHandling(int socketNum, int conditionSet, BackgroundHandlerProc* handlerProc, void* clientData);
+    void moveSocketHandling(int oldSocketNum, int newSocketNum);
+
+protected:
+    ReceiveTaskScheduler();
+
+    void SingleStep(unsigned maxDelayTime);
+
+private:
+    struct SocketHandler {
+        int conditionSet;
+        BackgroundHandlerProc* handlerProc;
+        void* clientData;
+    };
+
+    bool runHandler(int socketNum, int conditionSet);
+    bool handlePendingPackets();
+    void handleTriggers();
+    int waitTime(unsigned maxDelayTime);
+
+    int epollFd;
+    int wakeFd;                                         //!< eventfd written by triggerEvent
+    std::unordered_map<int, SocketHandler> handlers;
+    std::vector<struct epoll_event> events;
+
+    TaskFunc* triggerHandlers[RECEIVE_MAX_TRIGGERS];
+    void* triggerClientDatas[RECEIVE_MAX_TRIGGERS];
+    std::atomic<bool> triggered[RECEIVE_MAX_TRIGGERS];
+
+    std::vector<BatchedReceiveGroupsock*> groupsocks;
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ *  ReceiverMediaSession.cpp - MediaSession whose subsessions receive RTP in batches
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "ReceiverMediaSession.hh"
+#include "BatchedReceiveGroupsock.hh"
+
+ReceiverMediaSession* ReceiverMediaSession::createNew(UsageEnvironment& env, char const* sdpDescription)
+{
+    ReceiverMediaSession* session = new ReceiverMediaSession(env);
+
+    if (!session->initializeWithSDP(sdpDescription)) {
+        delete session;
+        return NULL;
+    }
+
+    return session;
+}
+
+ReceiverMediaSession::ReceiverMediaSession(UsageEnvironment& env) : MediaSession(env)
+{
+
+}
+
+MediaSubsession* ReceiverMediaSession::createNewMediaSubsession()
+{
+    return new ReceiverMediaSubsession(*this);
+}
+
+ReceiverMediaSubsession::ReceiverMediaSubsession(MediaSession& parent) : MediaSubsession(parent)
+{
+
+}
+
+Boolean ReceiverMediaSubsession::createSourceObjects(int useSpecialRTPoffset)
+{
+    struct in_addr groupAddress;
+    struct in_addr sourceAddress;
+    bool ssm;
+    Port port(0);
+
+    //NOTE: the RTP source is not created yet, so nothing refers to the replaced groupsock
+    if (fRTPSocket != NULL) {
+        groupAddress = fRTPSocket->groupAddress();
+        sourceAddress = fRTPSocket->sourceFilterAddress();
+        ssm = fRTPSocket->isSSM();
+        port = fRTPSocket->port();
+
+        delete fRTPSocket;
+        if (ssm) {
+            fRTPSocket = new BatchedReceiveGroupsock(env(), groupAddress, sourceAddress, port);
+        } else {
+            fRTPSocket = new BatchedReceiveGroupsock(env(), groupAddress, port, 255);
+        }
+
+        if (fRTPSocket->socketNum() < 0) {
+            env().setResultMsg("Failed to create the batched RTP socket");
+            return False;
+        }
+    }
+
+    return MediaSubsession::createSourceObjects(useSpecialRTPoffset);
+}
@@ -0,0 +1,60 @@
+/*
+ *  ReceiverMediaSession.hh - MediaSession whose subsessions receive RTP in batches
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _RECEIVER_MEDIA_SESSION_HH
+#define _RECEIVER_MEDIA_SESSION_HH
+
+#include <liveMedia.hh>
+
+/*! MediaSession creating ReceiverMediaSubsession subsessions */
+class ReceiverMediaSession : public MediaSession {
+
+public:
+    /**
+    * Constructor wrapper, see MediaSession
+    * @param env Live555 environement
+    * @param sdpDescription SDP of the session
+    * @return Pointer to the object if succeded and NULL if not
+    */
+    static ReceiverMediaSession* createNew(UsageEnvironment& env, char const* sdpDescription);
+
+protected:
+    ReceiverMediaSession(UsageEnvironment& env);
+
+    MediaSubsession* createNewMediaSubsession();
+};
+
+/*! MediaSubsession whose RTP socket is a BatchedReceiveGroupsock. It replaces the groupsock bound by
+    MediaSubsession::initiate with a batched one on the same address and port, right before the RTP
+    source is created. SSM sockets are replaced by batched SSM ones, which join the group for the same source.
+*/
+class ReceiverMediaSubsession : public MediaSubsession {
+
+protected:
+    ReceiverMediaSubsession(MediaSession& parent);
+
+    Boolean createSourceObjects(int useSpecialRTPoffset);
+
+    friend class ReceiverMediaSession;
+};
+
+#endif
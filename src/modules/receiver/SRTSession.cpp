@@ -0,0 +1,469 @@
+/*
+ *  SRTSession.cpp - MPEG-TS over SRT input session of the SourceManager
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <arpa/inet.h>
+
+#include "SRTSession.hh"
+#include "SourceManager.hh"
+#include "../../Utils.hh"
+
+// Implementation of "SRTStreamSource"
+
+SRTStreamSource* SRTStreamSource::createNew(UsageEnvironment& env)
+{
+    return new SRTStreamSource(env);
+}
+
+SRTStreamSource::SRTStreamSource(UsageEnvironment& env) : FramedSource(env), dropped(0)
+{
+}
+
+void SRTStreamSource::deliver(const unsigned char* data, unsigned size, struct timeval presentationTime)
+{
+    Unit unit;
+
+    if (units.size() >= SRT_SOURCE_MAX_UNITS) {
+        spare.push_back(std::move(units.front().data));
+        units.pop_front();
+        dropped++;
+    }
+
+    if (!spare.empty()) {
+        unit.data = std::move(spare.back());
+        spare.pop_back();
+    }
+
+    if (unit.data.size() < size) {
+        unit.data.resize(size);
+    }
+
+    memcpy(unit.data.data(), data, size);
+    unit.size = size;
+    unit.presentationTime = presentationTime;
+    units.push_back(std::move(unit));
+
+    if (isCurrentlyAwaitingData()) {
+        deliverUnit();
+    }
+}
+
+void SRTStreamSource::doGetNextFrame()
+{
+    if (!units.empty()) {
+        deliverUnit();
+    }
+}
+
+void SRTStreamSource::deliverUnit()
+{
+    Unit& unit = units.front();
+
+    fFrameSize = std::min(unit.size, fMaxSize);
+    fNumTruncatedBytes = unit.size - fFrameSize;
+    fPresentationTime = unit.presentationTime;
+    fDurationInMicroseconds = 0;
+    memcpy(fTo, unit.data.data(), fFrameSize);
+
+    spare.push_back(std::move(unit.data));
+    units.pop_front();
+
+    //NOTE: QueueSink asks for the next frame from a scheduled task, so this does not nest
+    FramedSource::afterGetting(this);
+}
+
+// Implementation of "SRTSession"
+
+SRTSession* SRTSession::createNew(UsageEnvironment& env, std::string id, SourceManager *const mngr,
+                                  std::string ip, unsigned port, SRTMode mode, unsigned latency,
+                                  unsigned basePort)
+{
+    SRTSession* session;
+
+    //NOTE: srt_startup only initializes the library the first time it is called
+    if (srt_startup() < 0) {
+        utils::errorMsg("Could not initialize SRT: " + std::string(srt_getlasterror_str()));
+        return NULL;
+    }
+
+    session = new SRTSession(env, id, mngr, ip, port, mode, latency, basePort);
+
+    if (!session->open()) {
+        delete session;
+        return NULL;
+    }
+
+    return session;
+}
+
+SRTSession::SRTSession(UsageEnvironment& env, std::string id, SourceManager *const mngr, std::string ip,
+                       unsigned port, SRTMode mode, unsigned latency, unsigned basePort) :
+    fEnv(env), fId(id), fMngr(mngr), fIp(ip), fPort(port), fMode(mode), fLatency(latency),
+    fBasePort(basePort), sock(SRT_INVALID_SOCK), peer(SRT_INVALID_SOCK), pollTask(NULL),
+    demuxer(std::bind(&SRTSession::deliverUnit, this, std::placeholders::_1, std::placeholders::_2,
+                      std::placeholders::_3, std::placeholders::_4)),
+    timeMapped(false), timeOffset(0)
+{
+    memset(&address, 0, sizeof(address));
+}
+
+SRTSession::~SRTSession()
+{
+    fEnv.taskScheduler().unscheduleDelayedTask(pollTask);
+
+    for (auto sink : sinks) {
+        if (sink) {
+            Medium::close(sink);
+        }
+    }
+
+    for (auto source : sources) {
+        if (source) {
+            Medium::close(source);
+        }
+    }
+
+    if (peer != SRT_INVALID_SOCK && peer != sock) {
+        srt_close(peer);
+    }
+
+    if (sock != SRT_INVALID_SOCK) {
+        srt_close(sock);
+    }
+}
+
+bool SRTSession::open()
+{
+    address.sin_family = AF_INET;
+    address.sin_port = htons(fPort);
+
+    if (fMode == SRT_LISTENER && fIp.empty()) {
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+    } else if (inet_pton(AF_INET, fIp.c_str(), &address.sin_addr) != 1) {
+        utils::errorMsg("SRT address is not valid: " + fIp);
+        return false;
+    }
+
+    if (fMode == SRT_CALLER) {
+        connect();
+    } else {
+        if ((sock = createSocket()) == SRT_INVALID_SOCK) {
+            return false;
+        }
+
+        if (srt_bind(sock, (struct sockaddr*) &address, sizeof(address)) == SRT_ERROR ||
+            srt_listen(sock, 1) == SRT_ERROR) {
+            utils::errorMsg("SRT listener could not be opened: " + std::string(srt_getlasterror_str()));
+            return false;
+        }
+    }
+
+    pollTask = fEnv.taskScheduler().scheduleDelayedTask(SRT_POLL_INTERVAL, readTask, this);
+
+    return true;
+}
+
+SRTSOCKET SRTSession::createSocket()
+{
+    SRTSOCKET s;
+    int transtype = SRTT_LIVE;
+    int latency = fLatency;
+    int sync = 0;
+
+    if ((s = srt_create_socket()) == SRT_INVALID_SOCK) {
+        utils::errorMsg("SRT socket could not be created: " + std::string(srt_getlasterror_str()));
+        return s;
+    }
+
+    //NOTE: accepted sockets inherit the listener options, so all of them are non blocking
+    srt_setsockflag(s, SRTO_TRANSTYPE, &transtype, sizeof(transtype));
+    srt_setsockflag(s, SRTO_LATENCY, &latency, sizeof(latency));
+    srt_setsockflag(s, SRTO_SNDSYN, &sync, sizeof(sync));
+    srt_setsockflag(s, SRTO_RCVSYN, &sync, sizeof(sync));
+
+    return s;
+}
+
+void SRTSession::connect()
+{
+    lastConnect = std::chrono::steady_clock::now();
+
+    if (sock != SRT_INVALID_SOCK) {
+        srt_close(sock);
+    }
+
+    if ((sock = createSocket()) == SRT_INVALID_SOCK) {
+        return;
+    }
+
+    //NOTE: the socket is non blocking, so the connection is completed in the background
+    if (srt_connect(sock, (struct sockaddr*) &address, sizeof(address)) == SRT_ERROR) {
+        utils::warningMsg("SRT connection to " + fIp + " failed: " + std::string(srt_getlasterror_str()));
+    }
+}
+
+void SRTSession::checkPeer()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    struct sockaddr_storage peerAddress;
+    int addressLength = sizeof(peerAddress);
+    SRTSOCKET accepted;
+    SRT_SOCKSTATUS state;
+
+    if (now - lastCheck < std::chrono::milliseconds(SRT_CHECK_INTERVAL)) {
+        return;
+    }
+
+    lastCheck = now;
+
+    if (peer != SRT_INVALID_SOCK && srt_getsockstate(peer) != SRTS_CONNECTED) {
+        utils::warningMsg("SRT input session " + fId + " disconnected");
+
+        if (peer != sock) {
+            srt_close(peer);
+        }
+
+        peer = SRT_INVALID_SOCK;
+    }
+
+    if (fMode == SRT_LISTENER) {
+        //NOTE: a new sender replaces the current one, it is usually the same one restarting
+        while ((accepted = srt_accept(sock, (struct sockaddr*) &peerAddress, &addressLength)) != SRT_INVALID_SOCK) {
+            if (peer != SRT_INVALID_SOCK) {
+                srt_close(peer);
+            }
+
+            utils::infoMsg("SRT input session " + fId + " connected");
+            peer = accepted;
+            demuxer.reset();
+            timeMapped = false;
+            addressLength = sizeof(peerAddress);
+        }
+
+        return;
+    }
+
+    state = sock != SRT_INVALID_SOCK ? srt_getsockstate(sock) : SRTS_NONEXIST;
+
+    if (state == SRTS_CONNECTED) {
+        if (peer == SRT_INVALID_SOCK) {
+            utils::infoMsg("SRT input session " + fId + " connected to " + fIp);
+            peer = sock;
+            demuxer.reset();
+            timeMapped = false;
+        }
+        return;
+    }
+
+    if (state != SRTS_CONNECTING && now - lastConnect >= std::chrono::milliseconds(SRT_RECONNECT_INTERVAL)) {
+        connect();
+    }
+}
+
+void SRTSession::readTask(void* clientData)
+{
+    SRTSession* session = (SRTSession*) clientData;
+
+    session->read();
+    session->pollTask = session->fEnv.taskScheduler().scheduleDelayedTask(SRT_POLL_INTERVAL, readTask, session);
+}
+
+void SRTSession::read()
+{
+    int size;
+
+    checkPeer();
+
+    if (peer == SRT_INVALID_SOCK) {
+        return;
+    }
+
+    //NOTE: the socket is drained on each poll, it returns an error once there are no messages left
+    while ((size = srt_recvmsg(peer, (char*) buffer, sizeof(buffer))) > 0) {
+        demuxer.push(buffer, size);
+    }
+}
+
+void SRTSession::deliverUnit(unsigned stream, const unsigned char* data, unsigned size, uint64_t pts)
+{
+    std::chrono::microseconds time = std::chrono::microseconds(pts*std::micro::den/90000);
+    std::chrono::microseconds now;
+    struct timeval presentationTime;
+
+    if (stream >= sources.size() || !sources[stream]) {
+        if (!addStream(stream)) {
+            return;
+        }
+    }
+
+    if (!timeMapped) {
+        now = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch());
+        timeOffset = now - time;
+        timeMapped = true;
+    }
+
+    time += timeOffset;
+    presentationTime.tv_sec = time.count()/std::micro::den;
+    presentationTime.tv_usec = time.count()%std::micro::den;
+
+    sources[stream]->deliver(data, size, presentationTime);
+}
+
+bool SRTSession::addStream(unsigned stream)
+{
+    SRTStreamSource* source;
+    QueueSink* sink;
+    unsigned port = fBasePort + stream;
+
+    if (stream >= sources.size()) {
+        sources.resize(stream + 1, NULL);
+        sinks.resize(stream + 1, NULL);
+    }
+
+    //NOTE: a stream whose sink could not be added is not tried again
+    if (sinks[stream]) {
+        return false;
+    }
+
+    source = SRTStreamSource::createNew(fEnv);
+    sink = QueueSink::createNew(fEnv, port, NULL);
+
+    if (!fMngr->addSink(port, sink)) {
+        utils::errorMsg("Failed adding sink of SRT input session " + fId + " in SourceManager");
+        Medium::close(source);
+        sinks[stream] = sink;
+        return false;
+    }
+
+    sources[stream] = source;
+    sinks[stream] = sink;
+    sink->startPlaying(*source, NULL, NULL);
+
+    utils::infoMsg("Initiated SRT input stream at port: " + std::to_string(port));
+
+    return true;
+}
+
+std::vector<unsigned> SRTSession::getPorts()
+{
+    std::vector<unsigned> ports;
+
+    for (unsigned i = 0; i < sources.size(); i++) {
+        if (sources[i]) {
+            ports.push_back(fBasePort + i);
+        }
+    }
+
+    return ports;
+}
+
+const TSDemuxedStream* SRTSession::getStream(unsigned port)
+{
+    unsigned stream = port - fBasePort;
+
+    if (port < fBasePort || stream >= sources.size() || !sources[stream]) {
+        return NULL;
+    }
+
+    return &demuxer.getStreams()[stream];
+}
+
+StreamInfo* SRTSession::createStreamInfo(unsigned port)
+{
+    const TSDemuxedStream* stream = getStream(port);
+    StreamInfo* si;
+
+    if (!stream) {
+        return NULL;
+    }
+
+    switch (stream->streamType) {
+        case TS_STREAM_H264:
+        case TS_STREAM_H265:
+            si = new StreamInfo(VIDEO);
+            si->video.codec = stream->streamType == TS_STREAM_H264 ? H264 : H265;
+            si->setCodecDefaults();
+            //NOTE: frames are whole access units with their parameter sets in band
+            si->video.h264or5.framed = false;
+            break;
+        case TS_STREAM_AAC:
+        case TS_STREAM_MP3:
+            si = new StreamInfo(AUDIO);
+            si->audio.codec = stream->streamType == TS_STREAM_AAC ? AAC : MP3;
+            si->setCodecDefaults();
+            si->audio.sampleRate = stream->sampleRate;
+            si->audio.channels = stream->channels;
+            si->audio.channelLayout = utils::getDefaultChannelLayout(si->audio.channels);
+            break;
+        default:
+            return NULL;
+    }
+
+    return si;
+}
+
+SRTLinkStats SRTSession::getStats()
+{
+    SRTLinkStats stats;
+    SRT_TRACEBSTATS perf;
+    struct sockaddr_in peerAddress;
+    char peerIp[INET_ADDRSTRLEN];
+    int length;
+
+    stats.address = "";
+    stats.connected = peer != SRT_INVALID_SOCK;
+    stats.latency = fLatency;
+    stats.rtt = 0;
+    stats.bandwidth = 0;
+    stats.recvRate = 0;
+    stats.received = 0;
+    stats.lost = 0;
+    stats.retransmitted = 0;
+    stats.dropped = 0;
+
+    if (!stats.connected || srt_bstats(peer, &perf, 0) == SRT_ERROR) {
+        return stats;
+    }
+
+    length = sizeof(peerAddress);
+    if (srt_getpeername(peer, (struct sockaddr*) &peerAddress, &length) != SRT_ERROR &&
+        inet_ntop(AF_INET, &peerAddress.sin_addr, peerIp, sizeof(peerIp))) {
+        stats.address = std::string(peerIp) + ":" + std::to_string(ntohs(peerAddress.sin_port));
+    }
+
+    length = sizeof(stats.latency);
+    if (srt_getsockflag(peer, SRTO_RCVLATENCY, &stats.latency, &length) == SRT_ERROR) {
+        stats.latency = fLatency;
+    }
+
+    stats.rtt = perf.msRTT;
+    stats.bandwidth = perf.mbpsBandwidth;
+    stats.recvRate = perf.mbpsRecvRate;
+    stats.received = perf.pktRecvTotal;
+    stats.lost = perf.pktRcvLossTotal;
+    stats.retransmitted = perf.pktRcvRetrans;
+    stats.dropped = perf.pktRcvDropTotal;
+
+    return stats;
+}
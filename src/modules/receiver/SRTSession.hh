@@ -0,0 +1,198 @@
+/*
+ *  SRTSession.hh - MPEG-TS over SRT input session of the SourceManager
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _SRT_SESSION_HH
+#define _SRT_SESSION_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <netinet/in.h>
+#include <liveMedia.hh>
+#include <srt/srt.h>
+
+#include "../../StreamInfo.hh"
+#include "../transmitter/SRTSink.hh"
+#include "MPEGTSDemuxer.hh"
+#include "QueueSink.hh"
+
+#define SRT_MAX_PAYLOAD_SIZE 1456       //!< Largest SRT live mode payload
+#define SRT_POLL_INTERVAL 1000          //!< Time in usec between socket reads
+#define SRT_SOURCE_MAX_UNITS 64         //!< Units a stream source holds for its sink, the oldest is dropped when it is full
+
+class SourceManager;
+
+/*! Statistics of the link of an SRT input session, see srt_bstats */
+struct SRTLinkStats {
+    std::string address;
+    bool connected;
+    int latency;                        //!< Negotiated latency in msec
+    double rtt;                         //!< Round trip time in msec
+    double bandwidth;                   //!< Estimated link bandwidth in Mbps
+    double recvRate;                    //!< Receiving rate in Mbps
+    int64_t received;                   //!< Received packets
+    int64_t lost;                       //!< Packets detected as lost
+    int64_t retransmitted;              //!< Retransmitted packets received
+    int64_t dropped;                    //!< Packets dropped because they arrived too late to be played
+};
+
+/*! live555 source of the units of one elementary stream of an SRTSession. Units are kept until the sink
+    asks for them, since the session demuxes a whole read of the socket at once, and their buffers reused.
+*/
+class SRTStreamSource : public FramedSource {
+
+public:
+    static SRTStreamSource* createNew(UsageEnvironment& env);
+
+    /**
+    * Hands a unit to the sink, or keeps it until the sink asks for the next one
+    * @param data unit data
+    * @param size unit size in bytes
+    * @param presentationTime unit presentation time
+    */
+    void deliver(const unsigned char* data, unsigned size, struct timeval presentationTime);
+
+    size_t getDropped() const {return dropped;};
+
+protected:
+    SRTStreamSource(UsageEnvironment& env);
+
+    void doGetNextFrame();
+
+private:
+    struct Unit {
+        std::vector<unsigned char> data;
+        unsigned size;
+        struct timeval presentationTime;
+    };
+
+    void deliverUnit();
+
+    std::deque<Unit> units;
+    std::vector<std::vector<unsigned char>> spare;
+    size_t dropped;
+};
+
+/*! Input session receiving an MPEG-TS stream through SRT in live mode. A caller connects to a remote
+    listener and reconnects when the link breaks, a listener accepts a single sender, a new one replaces
+    the previous one. The socket is non blocking and read from a task of the live555 environment of the
+    session shard, so it does not need a thread of its own. The stream is demuxed with MPEGTSDemuxer and
+    each supported elementary stream is fed to a QueueSink, as RTP subsessions are, whose port is the
+    base port plus the stream number. Sinks are added once the first unit of their stream is demuxed, since
+    audio parameters are read from the frame headers. Presentation times are mapped to the local clock
+    at the first unit after connecting, with a common offset for all the streams so they keep in sync.
+*/
+class SRTSession {
+
+public:
+    /**
+    * Creates the session, its socket is connected or listening once created
+    * @param env live555 environment of the session shard
+    * @param id session id
+    * @param mngr SourceManager the sinks are added to
+    * @param ip remote address in caller mode, local address in listener mode (empty for any)
+    * @param port remote port in caller mode, local port in listener mode
+    * @param mode SRT_CALLER or SRT_LISTENER
+    * @param latency receiver buffering in msec
+    * @param basePort port of the first elementary stream sink
+    * @return the session, NULL if the address is not valid or the listener socket cannot be opened
+    */
+    static SRTSession* createNew(UsageEnvironment& env, std::string id, SourceManager *const mngr,
+                                 std::string ip, unsigned port, SRTMode mode, unsigned latency,
+                                 unsigned basePort);
+
+    /**
+    * Class destructor, it closes the sinks, the sources and the socket
+    */
+    ~SRTSession();
+
+    std::string getId() const {return fId;};
+    std::string getIp() const {return fIp;};
+    unsigned getPort() const {return fPort;};
+    SRTMode getMode() const {return fMode;};
+    unsigned getLatency() const {return fLatency;};
+
+    /**
+    * @return ports of the sinks added so far
+    */
+    std::vector<unsigned> getPorts();
+
+    /**
+    * @param port sink port
+    * @return description of the stream of the port, NULL if there is no sink for it
+    */
+    StreamInfo* createStreamInfo(unsigned port);
+
+    /**
+    * @param port sink port
+    * @return demuxed stream of the port, NULL if there is no sink for it
+    */
+    const TSDemuxedStream* getStream(unsigned port);
+
+    /**
+    * @return statistics of the link
+    */
+    SRTLinkStats getStats();
+
+    const MPEGTSDemuxer& getDemuxer() const {return demuxer;};
+
+private:
+    SRTSession(UsageEnvironment& env, std::string id, SourceManager *const mngr, std::string ip,
+               unsigned port, SRTMode mode, unsigned latency, unsigned basePort);
+
+    bool open();
+    SRTSOCKET createSocket();
+    void connect();
+    void checkPeer();
+    void read();
+    void deliverUnit(unsigned stream, const unsigned char* data, unsigned size, uint64_t pts);
+    bool addStream(unsigned stream);
+
+    static void readTask(void* clientData);
+
+    UsageEnvironment& fEnv;
+    std::string fId;
+    SourceManager *const fMngr;
+    std::string fIp;
+    unsigned fPort;
+    SRTMode fMode;
+    unsigned fLatency;
+    unsigned fBasePort;
+    struct sockaddr_in address;
+
+    SRTSOCKET sock;                     //!< Caller or listener socket
+    SRTSOCKET peer;                     //!< Connected socket, the caller one or the accepted one
+    std::chrono::steady_clock::time_point lastCheck;
+    std::chrono::steady_clock::time_point lastConnect;
+    TaskToken pollTask;
+
+    MPEGTSDemuxer demuxer;
+    std::vector<SRTStreamSource*> sources;      //!< Indexed by stream number, NULL until the stream has a sink
+    std::vector<QueueSink*> sinks;
+    bool timeMapped;
+    std::chrono::microseconds timeOffset;       //!< Local time of PTS 0
+
+    unsigned char buffer[SRT_MAX_PAYLOAD_SIZE];
+};
+
+#endif
@@ -23,11 +23,15 @@
 
 #include "SourceManager.hh"
 #include "ExtendedRTSPClient.hh"
+#include "ReceiverMediaSession.hh"
+#include "BatchedReceiveGroupsock.hh"
 #include "../../AVFramedQueue.hh"
 #include "../../Utils.hh"
 #include "H264VideoSdpParser.hh"
 
 #include <sstream>
+#include <algorithm>
+#include <arpa/inet.h>
 
 #define RTSP_CLIENT_VERBOSITY_LEVEL 1
 
@@ -47,6 +51,23 @@ static void fillH264or5ExtraData(const MediaSubsession *mss, StreamInfo *si)
     si->setExtraData(parser->getExtradata(), parser->getExtradataSize());
 }
 
+static std::string subsessionCacheKey(MediaSubsession *mss)
+{
+    return std::string(mss->mediumName()) + "/" + mss->codecName() + "/" +
+        (mss->controlPath() ? mss->controlPath() : "");
+}
+
+static H264VideoSdpParser* subsessionParser(MediaSubsession *mss)
+{
+    QueueSink* sink;
+
+    if ((sink = dynamic_cast<QueueSink*>(mss->sink)) == NULL){
+        return NULL;
+    }
+
+    return dynamic_cast<H264VideoSdpParser*>(sink->getFilter());
+}
+
 static StreamInfo *createStreamInfo(const MediaSubsession *mss)
 {
     StreamInfo *si = NULL;
@@ -77,6 +98,7 @@ static StreamInfo *createStreamInfo(const MediaSubsession *mss)
         si->setCodecDefaults();
         si->audio.sampleRate = mss->rtpTimestampFrequency();
         si->audio.channels = mss->numChannels();
+        si->audio.channelLayout = utils::getDefaultChannelLayout(si->audio.channels);
     } else
     if (strcmp(mss->mediumName(), "video") == 0) {
         si = new StreamInfo(VIDEO);
@@ -88,6 +110,8 @@ static StreamInfo *createStreamInfo(const MediaSubsession *mss)
             fillH264or5ExtraData(mss, si);
         } else if (strcmp(codecName, "VP8") == 0) {
             si->video.codec = VP8;
+        } else if (strcmp(codecName, "VP9") == 0) {
+            si->video.codec = VP9;
         } else if (strcmp(codecName, "MJPEG") == 0) {
             si->video.codec = MJPEG;
         } else {
@@ -96,104 +120,503 @@ static StreamInfo *createStreamInfo(const MediaSubsession *mss)
             return NULL;
         }
         si->setCodecDefaults();
+        if (QueueSink* sink = dynamic_cast<QueueSink*>(mss->sink)) {
+            si->video.h264or5.framed = si->video.h264or5.framed && !sink->getAccessUnits();
+        }
+    }
+    //NOTE: the SDP b=AS bandwidth, if any
+    if (si) {
+        si->bitrate = mss->bandwidth();
     }
     return si;
 }
 
-SourceManager::SourceManager(unsigned writersNum): HeadFilter(writersNum, SERVER)
+SourceManager::SourceManager(unsigned writersNum, unsigned shardsNum): HeadFilter(writersNum, SERVER, false),
+    stopLoop(false), awaiter(this)
 {
     fType = RECEIVER;
 
-    scheduler = BasicTaskScheduler::createNew();
-    env = BasicUsageEnvironment::createNew(*scheduler);
-
     initializeEventMap();
+
+    if (!setShards(shardsNum)) {
+        setShards(RECEIVE_DEFAULT_SHARDS);
+    }
 }
 
 SourceManager::~SourceManager()
 {
+    stopLoop = true;
+
+    for (auto shard : shards) {
+        if (shard->loopThread.joinable()) {
+            shard->loopThread.join();
+        }
+    }
+
     for (auto it : sessionMap) {
         delete it.second;
     }
 
-    delete scheduler;
-    envir()->reclaim();
-    env = NULL;
+    for (auto it : srtSessions) {
+        delete it.second;
+    }
+
+    stopShards();
 
     for (auto it : outputStreamInfos) {
         delete it.second;
     }
 }
 
-bool SourceManager::doProcessFrame(std::map<int, Frame*> &dFrames, int& ret)
+bool SourceManager::setShards(unsigned shardsNum)
 {
-    if (envir() == NULL){
+    ReceiveShard* shard;
+
+    if (shardsNum == 0 || shardsNum > RECEIVE_MAX_SHARDS) {
+        utils::errorMsg("The number of receive shards must be from 1 to " + std::to_string(RECEIVE_MAX_SHARDS));
         return false;
     }
-    
-    for (auto it : dFrames){
-        if (sinks.count(it.first) > 0){
-            sinks[it.first]->setFrame(it.second);
+
+    if (!sessionMap.empty() || !srtSessions.empty()) {
+        utils::errorMsg("Receive shards cannot be changed while there are sessions");
+        return false;
+    }
+
+    stopShards();
+
+    for (unsigned i = 0; i < shardsNum; i++) {
+        shard = new ReceiveShard();
+        shard->envWaiters = 0;
+        shard->statsTask = NULL;
+        shard->nextStatsUSecs = 0;
+
+        //NOTE: live555 select scheduler is kept where epoll is not available, packets are not read in batches then
+        if (!(shard->scheduler = ReceiveTaskScheduler::createNew())) {
+            shard->scheduler = BasicTaskScheduler::createNew();
         }
+
+        shard->env = BasicUsageEnvironment::createNew(*shard->scheduler);
+        shards.push_back(shard);
     }
-    
-    scheduler->SingleStep();
-    
+
+    stopLoop = false;
+
+    for (auto s : shards) {
+        s->loopThread = std::thread(&SourceManager::eventLoop, this, s);
+    }
+
+    return true;
+}
+
+void SourceManager::stopShards()
+{
+    stopLoop = true;
+
+    for (auto shard : shards) {
+        if (shard->loopThread.joinable()) {
+            shard->loopThread.join();
+        }
+
+        if (shard->statsTask) {
+            shard->scheduler->unscheduleDelayedTask(shard->statsTask);
+        }
+
+        delete shard->scheduler;
+        shard->env->reclaim();
+        delete shard;
+    }
+
+    shards.clear();
+}
+
+bool SourceManager::doProcessFrame(FrameMap &dFrames, int& ret)
+{
+    std::map<unsigned, std::vector<int>> shardFrames;
+
+    awaiter.bind();
+    awaiter.consume();
+
+    {
+        std::lock_guard<std::mutex> guard(mngrMtx);
+
+        //NOTE: a missed resume, e.g. before the filter was first scheduled, only delays the frames
+        if (!sinks.empty()){
+            awaiter.awaitTimer(std::chrono::microseconds(RECEIVE_RESUME_TIMEOUT));
+        }
+
+        for (auto it : dFrames){
+            if (sinks.count(it.first) > 0){
+                shardFrames[sinkShards[it.first]].push_back(it.first);
+            }
+        }
+    }
+
+    //NOTE: a sink keeps the frame it is filling until it is collected, other frames are ignored meanwhile
+    for (auto it : shardFrames){
+        std::unique_lock<std::mutex> envGuard = lockEnvironment(shards[it.first]);
+        std::lock_guard<std::mutex> guard(mngrMtx);
+
+        for (auto id : it.second){
+            if (sinks.count(id) <= 0 || sinkShards[id] != it.first){
+                continue;
+            }
+
+            sinks[id]->setFrame(dFrames[id]);
+
+            if (sinks[id]->collectFrame(dFrames[id])){
+                dFrames[id]->setConsumed(true);
+            }
+        }
+    }
+
+    //NOTE: the filter is suspended until a sink fills a frame, a writer frees a slot or a writer is connected
     ret = 0;
 
     return true;
 }
 
-bool SourceManager::addSession(Session* session)
+bool SourceManager::pendingJobs()
+{
+    awaiter.bind();
+    return awaiter.isResumed() || HeadFilter::pendingJobs();
+}
+
+void SourceManager::eventLoop(ReceiveShard* shard)
+{
+    while (!stopLoop) {
+        {
+            std::lock_guard<std::mutex> guard(shard->envMtx);
+            shard->scheduler->SingleStep(RECEIVE_LOOP_MAX_DELAY);
+        }
+
+        //NOTE: std::mutex is not fair, the environment is handed over to the threads waiting for it
+        while (shard->envWaiters > 0 && !stopLoop) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+std::unique_lock<std::mutex> SourceManager::lockEnvironment(ReceiveShard* shard)
+{
+    shard->envWaiters++;
+    std::unique_lock<std::mutex> guard(shard->envMtx);
+    shard->envWaiters--;
+
+    return guard;
+}
+
+unsigned SourceManager::pickShard()
+{
+    std::vector<unsigned> load(shards.size(), 0);
+    unsigned shard = 0;
+
+    for (auto it : sessionShards) {
+        load[it.second]++;
+    }
+
+    for (unsigned i = 1; i < load.size(); i++) {
+        if (load[i] < load[shard]) {
+            shard = i;
+        }
+    }
+
+    return shard;
+}
+
+int SourceManager::getShard(UsageEnvironment& env)
+{
+    for (unsigned i = 0; i < shards.size(); i++) {
+        if (shards[i]->env == &env) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void scheduleStatsSweep(ReceiveShard* shard);
+
+static void periodicStatsSweep(ReceiveShard* shard)
+{
+    struct timeval timeNow;
+
+    gettimeofday(&timeNow, NULL);
+    shard->statsTask = NULL;
+
+    for (auto scs : shard->statsClients) {
+        scs->measureStats(timeNow);
+    }
+
+    scheduleStatsSweep(shard);
+}
+
+static void scheduleStatsSweep(ReceiveShard* shard)
 {
-    if (session == NULL) {
+    struct timeval timeNow;
+    int64_t timeNowUSecs;
+
+    gettimeofday(&timeNow, NULL);
+    timeNowUSecs = (int64_t) timeNow.tv_sec*1000000 + timeNow.tv_usec;
+
+    //NOTE: sweeps keep their period, a late one is not caught up
+    shard->nextStatsUSecs += DEFAULT_STATS_TIME_INTERVAL;
+    if (shard->nextStatsUSecs < timeNowUSecs) {
+        shard->nextStatsUSecs = timeNowUSecs + DEFAULT_STATS_TIME_INTERVAL;
+    }
+
+    shard->statsTask = shard->scheduler->scheduleDelayedTask(
+        shard->nextStatsUSecs - timeNowUSecs, (TaskFunc*)periodicStatsSweep, shard);
+}
+
+bool SourceManager::watchStats(StreamClientState* scs, UsageEnvironment& env)
+{
+    int shard = getShard(env);
+
+    if (shard < 0) {
+        utils::errorMsg("Subsession stats of a session out of the receive shards");
+        return false;
+    }
+
+    if (std::find(shards[shard]->statsClients.begin(), shards[shard]->statsClients.end(), scs) != 
+        shards[shard]->statsClients.end()) {
+        return true;
+    }
+
+    shards[shard]->statsClients.push_back(scs);
+
+    if (!shards[shard]->statsTask) {
+        shards[shard]->nextStatsUSecs = 0;
+        scheduleStatsSweep(shards[shard]);
+    }
+
+    return true;
+}
+
+void SourceManager::unwatchStats(StreamClientState* scs, UsageEnvironment& env)
+{
+    int shard = getShard(env);
+
+    if (shard < 0) {
+        return;
+    }
+
+    std::vector<StreamClientState*>& clients = shards[shard]->statsClients;
+    clients.erase(std::remove(clients.begin(), clients.end(), scs), clients.end());
+
+    if (clients.empty() && shards[shard]->statsTask) {
+        shards[shard]->scheduler->unscheduleDelayedTask(shards[shard]->statsTask);
+    }
+}
+
+bool SourceManager::addSession(Session* session, unsigned shard)
+{
+    std::lock_guard<std::mutex> guard(mngrMtx);
+
+    if (session == NULL || shard >= shards.size()) {
         return false;
     }
 
     sessionMap[session->getId()] = session;
+    sessionShards[session->getId()] = shard;
 
     return true;
 }
 
-bool SourceManager::removeSession(std::string id)
+bool SourceManager::addSRTSession(SRTSession* session, unsigned shard)
 {
-    MediaSubsession *subsession;
-    
-    if (sessionMap.count(id) <= 0) {
+    std::lock_guard<std::mutex> guard(mngrMtx);
+
+    if (session == NULL || shard >= shards.size()) {
         return false;
     }
 
+    if (sessionMap.count(session->getId()) > 0 || srtSessions.count(session->getId()) > 0) {
+        return false;
+    }
+
+    srtSessions[session->getId()] = session;
+    sessionShards[session->getId()] = shard;
+
+    return true;
+}
+
+bool SourceManager::removeSession(std::string id)
+{
+    MediaSubsession *subsession;
+    Session* session;
+    std::vector<int> ports;
+    unsigned shard;
     bool someSubsessionsWereActive = false;
-    
-    sessionMap[id]->getScs()->iter = new MediaSubsessionIterator(*(sessionMap[id]->getScs()->session));
-    subsession = sessionMap[id]->getScs()->iter->next();
-    while (subsession != NULL) {
-        if (sinks.count(subsession->clientPortNum()) > 0){
-            Medium::close(sinks[subsession->clientPortNum()]);
-            sinks.erase(subsession->clientPortNum());
-            disconnectWriter(subsession->clientPortNum());
-            sessionMap[id]->getScs()->removeSubsessionStats(subsession->clientPortNum());
+
+    if (removeSRTSession(id)) {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mngrMtx);
+
+        if (sessionMap.count(id) <= 0) {
+            return false;
         }
-        subsession->sink = NULL;
-        if (subsession->rtcpInstance() != NULL) {
-            subsession->rtcpInstance()->setByeHandler(NULL, NULL);
+
+        shard = sessionShards[id];
+    }
+
+    {
+        std::unique_lock<std::mutex> envGuard = lockEnvironment(shards[shard]);
+        std::unique_lock<std::mutex> guard(mngrMtx);
+
+        session = sessionMap[id];
+        sessionMap.erase(id);
+        sessionShards.erase(id);
+
+        session->getScs()->iter = new MediaSubsessionIterator(*(session->getScs()->session));
+        subsession = session->getScs()->iter->next();
+        while (subsession != NULL) {
+            if (!session->getScs()->url.empty()) {
+                cacheExtradata(session->getScs()->url, subsession);
+            }
+            if (sinks.count(subsession->clientPortNum()) > 0){
+                Medium::close(sinks[subsession->clientPortNum()]);
+                sinks.erase(subsession->clientPortNum());
+                sinkShards.erase(subsession->clientPortNum());
+                ports.push_back(subsession->clientPortNum());
+                session->getScs()->removeSubsessionStats(subsession->clientPortNum());
+            }
+            subsession->sink = NULL;
+            if (subsession->rtcpInstance() != NULL) {
+                subsession->rtcpInstance()->setByeHandler(NULL, NULL);
+            }
+            subsession = session->getScs()->iter->next();
+            someSubsessionsWereActive = true;
+        }
+
+        guard.unlock();
+
+        if (someSubsessionsWereActive) {
+            session->sendTeardown();
         }
-        subsession = sessionMap[id]->getScs()->iter->next();
-        someSubsessionsWereActive = true;
+
+        delete session;
     }
-    
-    if (someSubsessionsWereActive) {
-        sessionMap[id]->sendTeardown();
+
+    //NOTE: deleting a writer takes the environment lock again
+    for (auto port : ports) {
+        disconnectWriter(port);
+    }
+
+    return true;
+}
+
+bool SourceManager::removeSRTSession(std::string id)
+{
+    SRTSession* session;
+    std::vector<unsigned> ports;
+    unsigned shard;
+
+    {
+        std::lock_guard<std::mutex> guard(mngrMtx);
+
+        if (srtSessions.count(id) <= 0) {
+            return false;
+        }
+
+        shard = sessionShards[id];
+    }
+
+    {
+        std::unique_lock<std::mutex> envGuard = lockEnvironment(shards[shard]);
+        std::unique_lock<std::mutex> guard(mngrMtx);
+
+        if (srtSessions.count(id) <= 0) {
+            return false;
+        }
+
+        session = srtSessions[id];
+        srtSessions.erase(id);
+        sessionShards.erase(id);
+
+        //NOTE: the session closes its own sinks
+        ports = session->getPorts();
+        for (auto port : ports) {
+            sinks.erase(port);
+            sinkShards.erase(port);
+        }
+
+        guard.unlock();
+
+        delete session;
     }
 
-    delete sessionMap[id];
-    sessionMap.erase(id);
+    //NOTE: deleting a writer takes the environment lock again
+    for (auto port : ports) {
+        disconnectWriter(port);
+    }
 
     return true;
 }
 
+void SourceManager::cacheDescription(std::string url, std::string sdp, std::string baseURL)
+{
+    std::lock_guard<std::mutex> guard(cacheMtx);
+    sessionCache[url].sdp = sdp;
+    sessionCache[url].baseURL = baseURL;
+}
+
+bool SourceManager::getCachedDescription(std::string url, std::string& sdp, std::string& baseURL)
+{
+    std::lock_guard<std::mutex> guard(cacheMtx);
+
+    if (sessionCache.count(url) <= 0 || sessionCache[url].sdp.empty()) {
+        return false;
+    }
+
+    sdp = sessionCache[url].sdp;
+    baseURL = sessionCache[url].baseURL;
+    return true;
+}
+
+void SourceManager::cacheExtradata(std::string url, MediaSubsession* subsession)
+{
+    H264VideoSdpParser* parser;
+
+    if ((parser = subsessionParser(subsession)) == NULL || parser->getExtradataSize() == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(cacheMtx);
+    sessionCache[url].extradata[subsessionCacheKey(subsession)].assign(parser->getExtradata(),
+        parser->getExtradata() + parser->getExtradataSize());
+}
+
+bool SourceManager::restoreExtradata(std::string url, MediaSubsession* subsession)
+{
+    H264VideoSdpParser* parser;
+    std::string key = subsessionCacheKey(subsession);
+
+    if ((parser = subsessionParser(subsession)) == NULL || parser->getExtradataSize() > 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(cacheMtx);
+
+    if (sessionCache.count(url) <= 0 || sessionCache[url].extradata.count(key) <= 0) {
+        return false;
+    }
+
+    return parser->setExtradata(sessionCache[url].extradata[key].data(), sessionCache[url].extradata[key].size());
+}
+
+void SourceManager::evictCache(std::string url)
+{
+    std::lock_guard<std::mutex> guard(cacheMtx);
+    sessionCache.erase(url);
+}
+
 Session* SourceManager::getSession(std::string id)
 {
+    std::lock_guard<std::mutex> guard(mngrMtx);
+
     if (sessionMap.count(id) <= 0) {
         return NULL;
     }
@@ -203,49 +626,103 @@ Session* SourceManager::getSession(std::string id)
 
 bool SourceManager::addSink(unsigned port, QueueSink *sink)
 {
-    if(sinks.count(port) > 0){
-        utils::warningMsg("sink id must be unique!");
-        return false;
-    }
-    
+    int shard;
+
     if (!sink){
         utils::warningMsg("sink is NULL, it has not been added!");
         return false;
     }
+
+    if ((shard = getShard(sink->envir())) < 0){
+        utils::warningMsg("sink does not belong to any receive shard, it has not been added!");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(mngrMtx);
+
+    if(sinks.count(port) > 0){
+        utils::warningMsg("sink id must be unique!");
+        return false;
+    }
     
     sinks[port] = sink;
+    sinkShards[port] = shard;
+    sink->setAwaiter(&awaiter);
+    awaiter.resume();
 
     return true;
 }
 
 bool SourceManager::specificWriterConfig(int writerID)
 {
+    std::lock_guard<std::mutex> guard(mngrMtx);
+
     if (sinks.count(writerID) != 1){
         return false;
     } 
     
+    //NOTE: the sink of a new writer waits for its first frame
+    awaiter.resume();
     return true;
 }
 
-FrameQueue *SourceManager::allocQueue(ConnectionData cData)
+const StreamInfo* SourceManager::getWriterStreamInfo(int wId)
+{
+    return getOutputStreamInfo(wId);
+}
+
+StreamInfo* SourceManager::getOutputStreamInfo(int writerId)
 {
     MediaSubsession *mSubsession;
     StreamInfo *si = NULL;
+    unsigned shard;
+
+    {
+        std::lock_guard<std::mutex> guard(mngrMtx);
+
+        if (sinkShards.count(writerId) <= 0) {
+            return NULL;
+        }
+
+        shard = sinkShards[writerId];
+    }
+
+    std::unique_lock<std::mutex> envGuard = lockEnvironment(shards[shard]);
+    std::lock_guard<std::mutex> guard(mngrMtx);
 
     // Do we already have a StreamInfo for this writerId?
-    if (outputStreamInfos.count(cData.writerId) > 0) {
-        si = outputStreamInfos[cData.writerId];
-    } else {
-        for (auto it : sessionMap) {
-            mSubsession = it.second->getSubsessionByPort(cData.writerId);
-            if (mSubsession != NULL) {
-                si = createStreamInfo (mSubsession);
-                outputStreamInfos[cData.writerId] = si;
-                break;
-            }
+    if (outputStreamInfos.count(writerId) > 0) {
+        return outputStreamInfos[writerId];
+    }
+
+    for (auto it : sessionMap) {
+        if (sessionShards[it.first] != shard) {
+            continue;
+        }
+        mSubsession = it.second->getSubsessionByPort(writerId);
+        if (mSubsession != NULL) {
+            si = createStreamInfo (mSubsession);
+            outputStreamInfos[writerId] = si;
+            break;
         }
     }
 
+    for (auto it : srtSessions) {
+        if (si || sessionShards[it.first] != shard) {
+            continue;
+        }
+        if ((si = it.second->createStreamInfo(writerId)) != NULL) {
+            outputStreamInfos[writerId] = si;
+        }
+    }
+
+    return si;
+}
+
+FrameQueue *SourceManager::allocQueue(ConnectionData cData)
+{
+    StreamInfo *si = getOutputStreamInfo(cData.writerId);
+
     if (!si) {
         utils::errorMsg ("Unknown port number " + std::to_string(cData.writerId));
         return NULL;
@@ -261,13 +738,27 @@ FrameQueue *SourceManager::allocQueue(ConnectionData cData)
 
 bool SourceManager::specificWriterDelete(int writerID)
 {
-    if (outputStreamInfos.count(writerID) > 0) {
-        sinks[writerID]->disconnect();
-    } else {
+    std::unique_lock<std::mutex> envGuard;
+    std::unique_lock<std::mutex> guard(mngrMtx);
+
+    if (outputStreamInfos.count(writerID) <= 0) {
         utils::errorMsg ("[SourceManager::specificWriterDelete] Unknown port number " + std::to_string(writerID));
         return false;
     }
 
+    //NOTE: the sink is already closed if its session has been removed
+    if (sinks.count(writerID) <= 0) {
+        return true;
+    }
+
+    guard.unlock();
+    envGuard = lockEnvironment(shards[sinkShards[writerID]]);
+    guard.lock();
+
+    if (sinks.count(writerID) > 0) {
+        sinks[writerID]->disconnect();
+    }
+
     return true;
 }
 
@@ -275,6 +766,9 @@ void SourceManager::initializeEventMap()
 {
     eventMap["addSession"] = std::bind(&SourceManager::addSessionEvent, this, std::placeholders::_1);
     eventMap["removeSession"] = std::bind(&SourceManager::removeSessionEvent, this, std::placeholders::_1);
+    eventMap["setShards"] = std::bind(&SourceManager::setShardsEvent, this, std::placeholders::_1);
+    eventMap["setJitterBuffer"] = std::bind(&SourceManager::setJitterBufferEvent, this, std::placeholders::_1);
+    eventMap["setClockRecovery"] = std::bind(&SourceManager::setClockRecoveryEvent, this, std::placeholders::_1);
 }
 
 bool SourceManager::removeSessionEvent(Jzon::Node* params)
@@ -289,13 +783,118 @@ bool SourceManager::removeSessionEvent(Jzon::Node* params)
     return false;
 }
 
+bool SourceManager::setShardsEvent(Jzon::Node* params)
+{
+    if (!params || !params->Has("shards") || !params->Get("shards").IsNumber()) {
+        return false;
+    }
+
+    return setShards(params->Get("shards").ToInt());
+}
+
+bool SourceManager::setJitterBufferEvent(Jzon::Node* params)
+{
+    int port;
+    int maxDelay;
+    int minDelay = JITTER_BUFFER_MIN_DELAY;
+    unsigned shard;
+
+    if (!params || !params->Has("port") || !params->Has("maxDelay")) {
+        return false;
+    }
+
+    port = params->Get("port").ToInt();
+    maxDelay = params->Get("maxDelay").ToInt();
+
+    if (params->Has("minDelay")) {
+        minDelay = params->Get("minDelay").ToInt();
+    }
+
+    if (maxDelay < 0 || minDelay < 0) {
+        utils::errorMsg("Jitter buffer delays cannot be negative");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mngrMtx);
+
+        if (sinkShards.count(port) <= 0) {
+            utils::errorMsg("Unknown port number " + std::to_string(port));
+            return false;
+        }
+
+        shard = sinkShards[port];
+    }
+
+    std::unique_lock<std::mutex> envGuard = lockEnvironment(shards[shard]);
+    std::lock_guard<std::mutex> guard(mngrMtx);
+
+    if (sinks.count(port) <= 0) {
+        return false;
+    }
+
+    sinks[port]->setJitterBuffer(maxDelay, minDelay);
+
+    return true;
+}
+
+bool SourceManager::setClockRecoveryEvent(Jzon::Node* params)
+{
+    int port;
+    double bandwidth = CLOCK_RECOVERY_BANDWIDTH;
+    unsigned shard;
+
+    if (!params || !params->Has("port")) {
+        return false;
+    }
+
+    port = params->Get("port").ToInt();
+
+    if (params->Has("bandwidth")) {
+        bandwidth = params->Get("bandwidth").ToDouble();
+    }
+
+    if (bandwidth < 0) {
+        utils::errorMsg("Clock recovery bandwidth cannot be negative");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mngrMtx);
+
+        if (sinkShards.count(port) <= 0) {
+            utils::errorMsg("Unknown port number " + std::to_string(port));
+            return false;
+        }
+
+        shard = sinkShards[port];
+    }
+
+    std::unique_lock<std::mutex> envGuard = lockEnvironment(shards[shard]);
+    std::lock_guard<std::mutex> guard(mngrMtx);
+
+    if (sinks.count(port) <= 0) {
+        return false;
+    }
+
+    sinks[port]->setClockRecovery(bandwidth);
+
+    return true;
+}
+
 bool SourceManager::addSessionEvent(Jzon::Node* params)
 {
     std::string sessionId = utils::randomIdGenerator(ID_LENGTH);
-    std::string sdp, medium, codec;
+    std::string sdp, medium, codec, group, source;
     int payload, bandwidth, timeStampFrequency, channels, port;
+    int jitterMaxDelay = 0;
+    int jitterMinDelay = JITTER_BUFFER_MIN_DELAY;
     bool keepAlive = true;
+    bool accessUnits = false;
+    bool fastStart = false;
+    bool standby = false;
     Session* session;
+    unsigned shard;
 
     if (!params) {
         return false;
@@ -304,23 +903,61 @@ bool SourceManager::addSessionEvent(Jzon::Node* params)
     if (params->Has("keepAlive") && params->Get("keepAlive").IsBool()){
         keepAlive = params->Get("keepAlive").ToBool();
     }
-    
-    if (params->Has("id") && params->Get("id").IsString()){
-        sessionId = params->Get("id").ToString();
-        if (sessionMap.count(sessionId)> 0){
-            return false;
-        }
-    } else {
-        while (sessionMap.count(sessionId) > 0) {
-            sessionId = utils::randomIdGenerator(ID_LENGTH);
+
+    if (params->Has("accessUnits") && params->Get("accessUnits").IsBool()){
+        accessUnits = params->Get("accessUnits").ToBool();
+    }
+
+    if (params->Has("fastStart") && params->Get("fastStart").IsBool()){
+        fastStart = params->Get("fastStart").ToBool();
+    }
+
+    if (params->Has("standby") && params->Get("standby").IsBool()){
+        standby = params->Get("standby").ToBool();
+    }
+
+    if (params->Has("jitterBufferMaxDelay") && params->Get("jitterBufferMaxDelay").IsNumber()){
+        jitterMaxDelay = params->Get("jitterBufferMaxDelay").ToInt();
+    }
+
+    if (params->Has("jitterBufferMinDelay") && params->Get("jitterBufferMinDelay").IsNumber()){
+        jitterMinDelay = params->Get("jitterBufferMinDelay").ToInt();
+    }
+
+    if (jitterMaxDelay < 0 || jitterMinDelay < 0) {
+        utils::errorMsg("Jitter buffer delays cannot be negative");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mngrMtx);
+
+        if (params->Has("id") && params->Get("id").IsString()){
+            sessionId = params->Get("id").ToString();
+            if (sessionMap.count(sessionId) > 0 || srtSessions.count(sessionId) > 0){
+                return false;
+            }
+        } else {
+            while (sessionMap.count(sessionId) > 0 || srtSessions.count(sessionId) > 0) {
+                sessionId = utils::randomIdGenerator(ID_LENGTH);
+            }
         }
+
+        shard = pickShard();
+    }
+
+    if (params->Has("srt") && params->Get("srt").IsObject()) {
+        return addSRTSessionEvent(params, sessionId, shard);
     }
 
+    std::unique_lock<std::mutex> envGuard = lockEnvironment(shards[shard]);
+    UsageEnvironment& env = *shards[shard]->env;
+
     if (params->Has("uri") && params->Has("progName")) {
         
         std::string progName = params->Get("progName").ToString();
         std::string rtspURL = params->Get("uri").ToString();
-        session = Session::createNewByURL(*env, progName, rtspURL, sessionId, this, keepAlive);
+        session = Session::createNewByURL(env, progName, rtspURL, sessionId, this, keepAlive);
 
     } else if (params->Has("subsessions") && params->Get("subsessions").IsArray()) {
 
@@ -334,6 +971,8 @@ bool SourceManager::addSessionEvent(Jzon::Node* params)
             timeStampFrequency = (*it).Get("timeStampFrequency").ToInt();
             port = (*it).Get("port").ToInt();
             channels = (*it).Get("channels").ToInt();
+            group = (*it).Has("group") ? (*it).Get("group").ToString() : "";
+            source = (*it).Has("source") ? (*it).Get("source").ToString() : "";
 
             payload = utils::getPayloadFromCodec(codec);
 
@@ -341,17 +980,36 @@ bool SourceManager::addSessionEvent(Jzon::Node* params)
                 return false;
             }
 
+            if (!checkMulticastAddresses(group, source)) {
+                utils::errorMsg("Invalid multicast group " + group + " or source " + source);
+                return false;
+            }
+
             sdp += makeSubsessionSDP(medium, PROTOCOL, payload, codec, bandwidth,
-                                                timeStampFrequency, port, channels);
+                                                timeStampFrequency, port, channels, group, source);
         }
 
-        session = Session::createNew(*env, sdp, sessionId, this, keepAlive);
+        session = Session::createNew(env, sdp, sessionId, this, keepAlive);
+
+    } else if (params->Has("sdp") && params->Get("sdp").IsString()) {
+
+        //NOTE: e.g. the SDP file announced by a multicast camera, its source-filter attributes select the SSM source
+        session = Session::createNew(env, params->Get("sdp").ToString(), sessionId, this, keepAlive);
 
     } else {
         return false;
     }
 
-    if (addSession(session)) {
+    //NOTE: sinks are created once the session is initiated, they take the receive options then
+    if (session) {
+        session->getScs()->jitterBufferMaxDelay = jitterMaxDelay;
+        session->getScs()->jitterBufferMinDelay = jitterMinDelay;
+        session->getScs()->accessUnits = accessUnits;
+        session->getScs()->fastStart = fastStart;
+        session->getScs()->standby = standby;
+    }
+
+    if (addSession(session, shard)) {
         if(session->initiateSession()){
             return true; 
         } 
@@ -360,6 +1018,68 @@ bool SourceManager::addSessionEvent(Jzon::Node* params)
     return false;
 }
 
+bool SourceManager::addSRTSessionEvent(Jzon::Node* params, std::string sessionId, unsigned shard)
+{
+    Jzon::Object srt = params->Get("srt").AsObject();
+    std::string ip, mode;
+    int port, basePort;
+    int latency = SRT_DEFAULT_LATENCY;
+    SRTSession* session;
+
+    if (!srt.Has("port") || !srt.Get("port").IsNumber() || !srt.Has("mode")) {
+        utils::errorMsg("SRT input sessions need a port and a mode");
+        return false;
+    }
+
+    port = srt.Get("port").ToInt();
+    mode = srt.Get("mode").ToString();
+    basePort = port;
+
+    if (srt.Has("ip")) {
+        ip = srt.Get("ip").ToString();
+    }
+
+    if (srt.Has("latency") && srt.Get("latency").IsNumber()) {
+        latency = srt.Get("latency").ToInt();
+    }
+
+    //NOTE: the sink ports are the writer ids, they are port, port + 1... by default
+    if (srt.Has("basePort") && srt.Get("basePort").IsNumber()) {
+        basePort = srt.Get("basePort").ToInt();
+    }
+
+    if (port <= 0 || port > 0xFFFF || latency < 0 || basePort <= 0) {
+        utils::errorMsg("SRT input session port or latency are not valid");
+        return false;
+    }
+
+    if (mode != "caller" && mode != "listener") {
+        utils::errorMsg("SRT mode must be caller or listener");
+        return false;
+    }
+
+    if (mode == "caller" && ip.empty()) {
+        utils::errorMsg("SRT callers need the remote ip");
+        return false;
+    }
+
+    std::unique_lock<std::mutex> envGuard = lockEnvironment(shards[shard]);
+
+    session = SRTSession::createNew(*shards[shard]->env, sessionId, this, ip, port,
+                                    mode == "caller" ? SRT_CALLER : SRT_LISTENER, latency, basePort);
+
+    if (!session) {
+        return false;
+    }
+
+    if (!addSRTSession(session, shard)) {
+        delete session;
+        return false;
+    }
+
+    return true;
+}
+
 std::string SourceManager::makeSessionSDP(std::string sessionName, std::string sessionDescription)
 {
     std::stringstream sdp;
@@ -377,12 +1097,25 @@ std::string SourceManager::makeSubsessionSDP(std::string mediumName, std::string
                               std::string codecName, unsigned int bandwidth,
                               unsigned int RTPTimestampFrequency,
                               unsigned int clientPortNum,
-                              unsigned int channels)
+                              unsigned int channels,
+                              std::string group,
+                              std::string source)
 {
     std::stringstream sdp;
     sdp << "m=" << mediumName << " " << clientPortNum;
     sdp << " RTP/AVP " << RTPPayloadFormat << "\n";
-    sdp << "c=IN IP4 127.0.0.1\n";
+
+    //NOTE: live555 joins the group when the subsession is initiated, with an IGMPv3 source membership if it is filtered
+    if (group.empty()) {
+        sdp << "c=IN IP4 127.0.0.1\n";
+    } else {
+        sdp << "c=IN IP4 " << group << "/255\n";
+    }
+
+    if (!group.empty() && !source.empty()) {
+        sdp << "a=source-filter: incl IN IP4 " << group << " " << source << "\n";
+    }
+
     sdp << "b=AS:" << bandwidth << "\n";
 
     if (RTPPayloadFormat < 96) {
@@ -407,10 +1140,35 @@ std::string SourceManager::makeSubsessionSDP(std::string mediumName, std::string
     return sdp.str();
 }
 
+bool SourceManager::checkMulticastAddresses(std::string group, std::string source)
+{
+    struct in_addr addr;
+
+    if (group.empty()) {
+        return source.empty();
+    }
+
+    if (inet_pton(AF_INET, group.c_str(), &addr) != 1 || !IN_MULTICAST(ntohl(addr.s_addr))) {
+        return false;
+    }
+
+    if (source.empty()) {
+        return true;
+    }
+
+    return inet_pton(AF_INET, source.c_str(), &addr) == 1 && addr.s_addr != INADDR_ANY && 
+           !IN_MULTICAST(ntohl(addr.s_addr));
+}
+
 void SourceManager::doGetState(Jzon::Object &filterNode)
 {
     Jzon::Array sessionArray;
     MediaSubsession* subsession;
+    JitterBuffer* jitterBuffer;
+    GopCache* gopCache;
+    ClockRecovery* clockRecovery;
+    Groupsock* gs;
+    BatchedReceiveGroupsock* batched;
     unsigned numPacketsReceived = 0, numPacketsExpected = 0;
     unsigned secsDiff = 0;
     int usecsDiff = 0;
@@ -418,73 +1176,196 @@ void SourceManager::doGetState(Jzon::Object &filterNode)
     double packetLossFraction = 0;
     double totalGapsMS;
 
-    for (auto it : sessionMap) {
-        Jzon::Array subsessionArray;
-        Jzon::Object jsonSession;
+    //NOTE: stats are updated by the receive loops, so sessions are visited shard by shard
+    for (unsigned shard = 0; shard < shards.size(); shard++) {
+        std::unique_lock<std::mutex> envGuard = lockEnvironment(shards[shard]);
+        std::lock_guard<std::mutex> guard(mngrMtx);
 
-        if (!it.second->getScs()->session) {
-            continue;
-        }
+        for (auto it : sessionMap) {
+            Jzon::Array subsessionArray;
+            Jzon::Object jsonSession;
 
-        MediaSubsessionIterator iter(*(it.second->getScs()->session));
+            if (sessionShards[it.first] != shard) {
+                continue;
+            }
 
-        while ((subsession = iter.next()) != NULL) {
-            Jzon::Object jsonSubsession;
+            if (!it.second->getScs()->session) {
+                continue;
+            }
 
-            jsonSubsession.Add("port", subsession->clientPortNum());
-            jsonSubsession.Add("medium", subsession->mediumName());
-            jsonSubsession.Add("codec", subsession->codecName());
+            MediaSubsessionIterator iter(*(it.second->getScs()->session));
+
+            while ((subsession = iter.next()) != NULL) {
+                Jzon::Object jsonSubsession;
+
+                jsonSubsession.Add("port", subsession->clientPortNum());
+                jsonSubsession.Add("medium", subsession->mediumName());
+                jsonSubsession.Add("codec", subsession->codecName());
+
+                // MULTICAST
+                if (subsession->rtpSource() && (gs = subsession->rtpSource()->RTPgs()) != NULL &&
+                    IsMulticastAddress(gs->groupAddress().s_addr)) {
+                    jsonSubsession.Add("group", AddressString(gs->groupAddress()).val());
+                    if (gs->isSSM()) {
+                        jsonSubsession.Add("source", AddressString(gs->sourceFilterAddress()).val());
+                    }
+                    if ((batched = dynamic_cast<BatchedReceiveGroupsock*>(gs)) != NULL) {
+                        jsonSubsession.Add("filteredPackets", (int) batched->getFilteredPackets());
+                    }
+                }
 
-            // SUBSESSION STATISTICS (RTP)
-            if(it.second->getScs()->getSubsessionStats(subsession->clientPortNum()) != NULL){
-                SCSSubsessionStats* scsss = it.second->getScs()->getSubsessionStats(subsession->clientPortNum());
-                numPacketsReceived = scsss->getTotNumPacketsReceived();
-                numPacketsExpected = scsss->getTotNumPacketsExpected();
-                secsDiff  = scsss->getMeasurementEndTime().tv_sec - scsss->getMeasurementStartTime().tv_sec;
-                usecsDiff = scsss->getMeasurementEndTime().tv_usec - scsss->getMeasurementStartTime().tv_usec;
-                measurementTime  = secsDiff + usecsDiff/1000000.0;
-                
-                // BITRATE
-                if ( scsss->getKbitsPerSecondMax() == 0) {
-                    // special case: we didn't receive any data:
-                    jsonSubsession.Add("minBitrateInKbps", 0);
-                    jsonSubsession.Add("maxBitRateInKbps", 0);
-                    jsonSubsession.Add("avgBitRateInKbps", 0);
-
-                } else {
-                    jsonSubsession.Add("minBitrateInKbps", scsss->getKbitsPerSecondMin());
-                    jsonSubsession.Add("maxBitRateInKbps", scsss->getKbitsPerSecondMax());
-                    jsonSubsession.Add("avgBitRateInKbps", (measurementTime == 0.0 ? 0.0 : 8*scsss->getKBytesTotal()/measurementTime));
+                // JITTER BUFFER
+                if (sinks.count(subsession->clientPortNum()) > 0 &&
+                    (jitterBuffer = sinks[subsession->clientPortNum()]->getJitterBuffer()) != NULL) {
+                    jsonSubsession.Add("jitterBufferDelayInMiliseconds", (int)(jitterBuffer->getDelay().count()/1000));
+                    jsonSubsession.Add("jitterBufferMaxDelayInMiliseconds", (int) jitterBuffer->getMaxDelay());
+                    jsonSubsession.Add("jitterBufferMinDelayInMiliseconds", (int) jitterBuffer->getMinDelay());
+                    jsonSubsession.Add("jitterBufferFrames", (int) jitterBuffer->getFrames());
+                    jsonSubsession.Add("jitterBufferDroppedFrames", (int) jitterBuffer->getDropped());
+                    jsonSubsession.Add("jitterBufferLateFrames", (int) jitterBuffer->getLate());
+                }
+
+                // STANDBY
+                if (sinks.count(subsession->clientPortNum()) > 0 &&
+                    (gopCache = sinks[subsession->clientPortNum()]->getGopCache()) != NULL) {
+                    jsonSubsession.Add("standbyKeyed", gopCache->isKeyed());
+                    jsonSubsession.Add("standbyCachedUnits", (int) gopCache->getUnits());
+                    jsonSubsession.Add("standbyCachedBytes", (int) gopCache->getSize());
+                }
+
+                // CLOCK RECOVERY
+                if (sinks.count(subsession->clientPortNum()) > 0 &&
+                    (clockRecovery = sinks[subsession->clientPortNum()]->getClockRecovery()) != NULL) {
+                    jsonSubsession.Add("clockRecoveryBandwidth", clockRecovery->getBandwidth());
+                    jsonSubsession.Add("clockRecoveryLocked", clockRecovery->isLocked());
+                    jsonSubsession.Add("clockRecoverySkewInPpm", clockRecovery->getSkew());
+                    jsonSubsession.Add("clockRecoveryErrorInMicroseconds", (int) clockRecovery->getError().count());
+                    jsonSubsession.Add("clockRecoveryResyncs", (int) clockRecovery->getResyncs());
                 }
+
+                // SUBSESSION STATISTICS (RTP)
+                if(it.second->getScs()->getSubsessionStats(subsession->clientPortNum()) != NULL){
+                    SCSSubsessionStats* scsss = it.second->getScs()->getSubsessionStats(subsession->clientPortNum());
+                    numPacketsReceived = scsss->getTotNumPacketsReceived();
+                    numPacketsExpected = scsss->getTotNumPacketsExpected();
+                    secsDiff  = scsss->getMeasurementEndTime().tv_sec - scsss->getMeasurementStartTime().tv_sec;
+                    usecsDiff = scsss->getMeasurementEndTime().tv_usec - scsss->getMeasurementStartTime().tv_usec;
+                    measurementTime  = secsDiff + usecsDiff/1000000.0;
                 
-                // PACKET LOSS
-                jsonSubsession.Add("minPacketLossPercentage", 100*scsss->getPacketLossFractionMin());
-                packetLossFraction = numPacketsExpected == 0 ? 1.0 : 1.0 - numPacketsReceived/(double)numPacketsExpected;
-                if (packetLossFraction < 0.0) packetLossFraction = 0.0;
-                jsonSubsession.Add("maxPacketLossPercentage", (packetLossFraction == 1.0 ? 100.0 : 100*scsss->getPacketLossFractionMax()));
-                jsonSubsession.Add("avgPacketLossPercentage", 100*packetLossFraction);
-
-                // INTER PACKET GAP
-                jsonSubsession.Add("minInterPacketGapInMiliseconds", (int)(scsss->getMinInterPacketGapUS()/1000.0));
-                jsonSubsession.Add("maxInterPacketGapInMiliseconds", (int)(scsss->getMaxInterPacketGapUS()/1000.0));
-                totalGapsMS = scsss->getTotalGaps().tv_sec*1000.0 + scsss->getTotalGaps().tv_usec/1000.0;
-                jsonSubsession.Add("avgInterPacketGapInMiliseconds", (int)(numPacketsReceived == 0 ? 0.0 : totalGapsMS/numPacketsReceived) );
-
-                // JITTER 
-                jsonSubsession.Add("minJitterInMicroseconds", (int)scsss->getMinJitter());
-                jsonSubsession.Add("maxJitterInMicroseconds", (int)scsss->getMaxJitter());
-                jsonSubsession.Add("curJitterInMicroseconds", (int)scsss->getJitter());
+                    // BITRATE
+                    if ( scsss->getKbitsPerSecondMax() == 0) {
+                        // special case: we didn't receive any data:
+                        jsonSubsession.Add("minBitrateInKbps", 0);
+                        jsonSubsession.Add("maxBitRateInKbps", 0);
+                        jsonSubsession.Add("avgBitRateInKbps", 0);
+
+                    } else {
+                        jsonSubsession.Add("minBitrateInKbps", scsss->getKbitsPerSecondMin());
+                        jsonSubsession.Add("maxBitRateInKbps", scsss->getKbitsPerSecondMax());
+                        jsonSubsession.Add("avgBitRateInKbps", (measurementTime == 0.0 ? 0.0 : 8*scsss->getKBytesTotal()/measurementTime));
+                    }
+                
+                    // PACKET LOSS
+                    jsonSubsession.Add("minPacketLossPercentage", 100*scsss->getPacketLossFractionMin());
+                    packetLossFraction = numPacketsExpected == 0 ? 1.0 : 1.0 - numPacketsReceived/(double)numPacketsExpected;
+                    if (packetLossFraction < 0.0) packetLossFraction = 0.0;
+                    jsonSubsession.Add("maxPacketLossPercentage", (packetLossFraction == 1.0 ? 100.0 : 100*scsss->getPacketLossFractionMax()));
+                    jsonSubsession.Add("avgPacketLossPercentage", 100*packetLossFraction);
+
+                    // INTER PACKET GAP
+                    jsonSubsession.Add("minInterPacketGapInMiliseconds", (int)(scsss->getMinInterPacketGapUS()/1000.0));
+                    jsonSubsession.Add("maxInterPacketGapInMiliseconds", (int)(scsss->getMaxInterPacketGapUS()/1000.0));
+                    totalGapsMS = scsss->getTotalGaps().tv_sec*1000.0 + scsss->getTotalGaps().tv_usec/1000.0;
+                    jsonSubsession.Add("avgInterPacketGapInMiliseconds", (int)(numPacketsReceived == 0 ? 0.0 : totalGapsMS/numPacketsReceived) );
+
+                    // JITTER 
+                    jsonSubsession.Add("minJitterInMicroseconds", (int)scsss->getMinJitter());
+                    jsonSubsession.Add("maxJitterInMicroseconds", (int)scsss->getMaxJitter());
+                    jsonSubsession.Add("curJitterInMicroseconds", (int)scsss->getJitter());
+                }
+
+                subsessionArray.Add(jsonSubsession);
             }
 
-            subsessionArray.Add(jsonSubsession);
+            jsonSession.Add("id", it.first);
+            jsonSession.Add("shard", (int) shard);
+            jsonSession.Add("cachedDescription", it.second->getScs()->cachedDescription);
+            jsonSession.Add("subsessions", subsessionArray);
+
+            sessionArray.Add(jsonSession);
         }
 
-        jsonSession.Add("id", it.first);
-        jsonSession.Add("subsessions", subsessionArray);
+        for (auto it : srtSessions) {
+            Jzon::Array subsessionArray;
+            Jzon::Object jsonSession;
+            Jzon::Object jsonLink;
+            SRTLinkStats link;
+            const TSDemuxedStream* stream;
 
-        sessionArray.Add(jsonSession);
+            if (sessionShards[it.first] != shard) {
+                continue;
+            }
+
+            for (auto port : it.second->getPorts()) {
+                Jzon::Object jsonSubsession;
+
+                if ((stream = it.second->getStream(port)) == NULL) {
+                    continue;
+                }
+
+                jsonSubsession.Add("port", (int) port);
+                jsonSubsession.Add("pid", (int) stream->pid);
+
+                switch (stream->streamType) {
+                    case TS_STREAM_H264:
+                        jsonSubsession.Add("medium", "video");
+                        jsonSubsession.Add("codec", "H264");
+                        break;
+                    case TS_STREAM_H265:
+                        jsonSubsession.Add("medium", "video");
+                        jsonSubsession.Add("codec", "H265");
+                        break;
+                    case TS_STREAM_AAC:
+                        jsonSubsession.Add("medium", "audio");
+                        jsonSubsession.Add("codec", "AAC");
+                        break;
+                    default:
+                        jsonSubsession.Add("medium", "audio");
+                        jsonSubsession.Add("codec", "MP3");
+                        break;
+                }
+
+                subsessionArray.Add(jsonSubsession);
+            }
+
+            // SRT LINK STATISTICS
+            link = it.second->getStats();
+            jsonLink.Add("mode", it.second->getMode() == SRT_CALLER ? "caller" : "listener");
+            jsonLink.Add("ip", it.second->getIp());
+            jsonLink.Add("port", std::to_string(it.second->getPort()));
+            jsonLink.Add("connected", link.connected);
+            jsonLink.Add("address", link.address);
+            jsonLink.Add("latencyMilliseconds", link.latency);
+            jsonLink.Add("roundTripDelayMilliseconds", (float)link.rtt);
+            jsonLink.Add("bandwidthInMbps", (float)link.bandwidth);
+            jsonLink.Add("recvRateInMbps", (float)link.recvRate);
+            jsonLink.Add("receivedPackets", (int)link.received);
+            jsonLink.Add("lostPackets", (int)link.lost);
+            jsonLink.Add("retransmittedPackets", (int)link.retransmitted);
+            jsonLink.Add("droppedPackets", (int)link.dropped);
+            jsonLink.Add("tsDiscontinuities", (int) it.second->getDemuxer().getDiscontinuities());
+            jsonLink.Add("tsDroppedUnits", (int) it.second->getDemuxer().getDroppedUnits());
+
+            jsonSession.Add("id", it.first);
+            jsonSession.Add("shard", (int) shard);
+            jsonSession.Add("srt", jsonLink);
+            jsonSession.Add("subsessions", subsessionArray);
+
+            sessionArray.Add(jsonSession);
+        }
     }
 
+    filterNode.Add("shards", (int) shards.size());
     filterNode.Add("sessions", sessionArray);
 }
 
@@ -501,7 +1382,7 @@ Session* Session::createNew(UsageEnvironment& env, std::string sdp,
                             bool keepAliveMsg)
 {
     Session* newSession = new Session(id, mngr, keepAliveMsg);
-    MediaSession* mSession = MediaSession::createNew(env, sdp.c_str());
+    MediaSession* mSession = ReceiverMediaSession::createNew(env, sdp.c_str());
 
     if (mSession == NULL){
         delete newSession;
@@ -524,6 +1405,7 @@ Session* Session::createNewByURL(UsageEnvironment& env, std::string progName, st
     }
 
     session->client = rtspClient;
+    session->scs->url = rtspURL;
 
     return session;
 }
@@ -532,6 +1414,8 @@ bool Session::initiateSession()
 {
     MediaSubsession* subsession;
     QueueSink *queueSink;
+    std::string sdp;
+    std::string baseURL;
 
     if (scs->session != NULL){
         UsageEnvironment& env = scs->session->envir();
@@ -563,13 +1447,22 @@ bool Session::initiateSession()
                 }
             }
 	   
-            increaseReceiveBufferTo(env, subsession->rtpSource()->RTPgs()->socketNum(), RTP_RECEIVE_BUFFER_SIZE);
+            handlers::increaseReceiveBuffer(env, subsession);
 
            subsession = scs->iter->next();
         }
         return true;
 
     } else if (client != NULL){
+        //NOTE: the DESCRIBE round trip is saved, continueAfterSETUP describes the URL again if the SDP is stale
+        if (scs->fastStart && scs->mngr->getCachedDescription(scs->url, sdp, baseURL)) {
+            utils::infoMsg("Setting up " + scs->url + " from its cached SDP");
+            scs->cachedDescription = true;
+            ((ExtendedRTSPClient*)client)->setContentBase(baseURL.c_str());
+            handlers::continueAfterDESCRIBE(client, 0, strDup(sdp.c_str()));
+            return true;
+        }
+
         unsigned ret = client->sendDescribeCommand(handlers::continueAfterDESCRIBE);
         std::cout << "SEND DESCRIBE COMMAND RETURN: " << ret << std::endl;
         return true;
@@ -606,6 +1499,11 @@ MediaSubsession* Session::getSubsessionByPort(int port)
 {
     MediaSubsession* subsession;
 
+    //NOTE: RTSP sessions have no MediaSession until they are described
+    if (this->scs->session == NULL) {
+        return NULL;
+    }
+
     MediaSubsessionIterator iter(*(this->scs->session));
 
     while ((subsession = iter.next()) != NULL) {
@@ -622,10 +1520,10 @@ MediaSubsession* Session::getSubsessionByPort(int port)
 StreamClientState::StreamClientState(std::string id_, SourceManager *const  manager, bool keepAliveMsg) :
     mngr(manager), iter(NULL), session(NULL), subsession(NULL),
     streamTimerTask(NULL), duration(0.0), 
-    sessionTimeoutBrokenServerTask(NULL), sessionStatsMeasurementTask(NULL),
-    statsMeasurementIntervalMS(DEFAULT_STATS_TIME_INTERVAL), nextStatsMeasurementUSecs(0),
+    sessionTimeoutBrokenServerTask(NULL),
     sendKeepAlivesToBrokenServers(keepAliveMsg), // Send periodic 'keep-alive' requests to keep broken server sessions alive
-    sessionTimeoutParameter(0), id(id_)
+    sessionTimeoutParameter(0), jitterBufferMaxDelay(0), jitterBufferMinDelay(JITTER_BUFFER_MIN_DELAY),
+    accessUnits(false), fastStart(false), cachedDescription(false), standby(false), id(id_)
 {
 }
 
@@ -642,8 +1540,8 @@ StreamClientState::~StreamClientState()
         if (sessionTimeoutBrokenServerTask){
             env.taskScheduler().unscheduleDelayedTask(sessionTimeoutBrokenServerTask);
         }
-        if (sessionStatsMeasurementTask){
-            env.taskScheduler().unscheduleDelayedTask(sessionStatsMeasurementTask);
+        if (!smsStats.empty()) {
+            mngr->unwatchStats(this, env);
         }
         
         Medium::close(session);
@@ -658,6 +1556,44 @@ StreamClientState::~StreamClientState()
 
 bool StreamClientState::addSinkToMngr(unsigned id, QueueSink* sink)
 {
+    MediaSubsession* mSubsession;
+    VCodecType codec;
+
+    if (jitterBufferMaxDelay > 0) {
+        sink->setJitterBuffer(jitterBufferMaxDelay, jitterBufferMinDelay);
+    }
+
+    if (accessUnits && session) {
+        MediaSubsessionIterator iter(*session);
+
+        while ((mSubsession = iter.next()) != NULL) {
+            codec = utils::getVideoCodecFromString(mSubsession->codecName());
+
+            if (mSubsession->clientPortNum() == id && (codec == H264 || codec == H265)) {
+                sink->setAccessUnits(mSubsession->rtpSource(), codec);
+            }
+        }
+    }
+
+    if (session) {
+        MediaSubsessionIterator iter(*session);
+
+        while ((mSubsession = iter.next()) != NULL) {
+            if (mSubsession->clientPortNum() != id) {
+                continue;
+            }
+
+            if (!url.empty() && mngr->restoreExtradata(url, mSubsession)) {
+                utils::infoMsg("Using the cached parameter sets of port " + std::to_string(id));
+            }
+
+            codec = utils::getVideoCodecFromString(mSubsession->codecName());
+            if (standby && !accessUnits && (codec == H264 || codec == H265)) {
+                sink->setGopCache(codec);
+            }
+        }
+    }
+
     return mngr->addSink(id, sink);
 }
 
@@ -669,7 +1605,6 @@ bool StreamClientState::addNewSubsessionStats(size_t port, MediaSubsession* subs
 
     struct timeval startTime;
     gettimeofday(&startTime, NULL);
-    nextStatsMeasurementUSecs = startTime.tv_sec*1000000 + startTime.tv_usec;
 
     if(subsession == NULL) return false;
 
@@ -679,8 +1614,10 @@ bool StreamClientState::addNewSubsessionStats(size_t port, MediaSubsession* subs
 
     smsStats[port] = new SCSSubsessionStats(port, src ,startTime);
 
-    if (sessionStatsMeasurementTask == NULL){
-        scheduleNextStatsMeasurement(this->mngr->envir());
+    if (smsStats.size() == 1 && !mngr->watchStats(this, subsession->parentSession().envir())){
+        delete smsStats[port];
+        smsStats.erase(port);
+        return false;
     }
 
     return true;    
@@ -696,6 +1633,10 @@ bool StreamClientState::removeSubsessionStats(size_t port)
     delete smsStats[port];
     smsStats.erase(port);
 
+    if (smsStats.empty() && session) {
+        mngr->unwatchStats(this, session->envir());
+    }
+
     return true;
 }
 
@@ -709,29 +1650,27 @@ SCSSubsessionStats* StreamClientState::getSubsessionStats(size_t port)
     return smsStats[port];
 }
 
-static void periodicSubsessionStatsMeasurement(StreamClientState* scs) 
+void StreamClientState::measureStats(struct timeval const& timeNow)
 {
-    struct timeval timeNow;
-    gettimeofday(&timeNow, NULL);
-    scs->sessionStatsMeasurementTask = NULL;
+    MediaSubsession* mSubsession;
+    QueueSink* sink;
 
-    for (auto it : scs->getSCSSubsesionStatsMap()) {
+    for (auto it : smsStats) {
         it.second->periodicStatMeasurement(timeNow);
     }
 
-    scs->scheduleNextStatsMeasurement(scs->mngr->envir());
-}
+    MediaSubsessionIterator iter(*session);
 
-void StreamClientState::scheduleNextStatsMeasurement(UsageEnvironment* env) 
-{
-    nextStatsMeasurementUSecs += statsMeasurementIntervalMS;
-    struct timeval timeNow;
-    gettimeofday(&timeNow, NULL);
-    unsigned timeNowUSecs = timeNow.tv_sec*1000000 + timeNow.tv_usec;
-    int usecsToDelay = nextStatsMeasurementUSecs - timeNowUSecs;
+    while ((mSubsession = iter.next()) != NULL) {
+        if (smsStats.count(mSubsession->clientPortNum()) <= 0 || mSubsession->rtpTimestampFrequency() == 0 ||
+            !(sink = dynamic_cast<QueueSink*>(mSubsession->sink))) {
+            continue;
+        }
 
-    sessionStatsMeasurementTask = env->taskScheduler().scheduleDelayedTask(
-        usecsToDelay, (TaskFunc*)periodicSubsessionStatsMeasurement, this);
+        //NOTE: live555 measures the jitter in RTP timestamp units
+        sink->setJitter(std::chrono::microseconds(
+            smsStats[mSubsession->clientPortNum()]->getJitter()*std::micro::den/mSubsession->rtpTimestampFrequency()));
+    }
 }
 
 // Implementation of "SCSSubsessionStats" class:
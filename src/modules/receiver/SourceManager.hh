@@ -27,18 +27,29 @@
 #include "../../StreamInfo.hh"
 #include "Handlers.hh"
 #include "QueueSink.hh"
+#include "SRTSession.hh"
+#include "../../IOReactor.hh"
 
 #include <map>
 #include <list>
+#include <vector>
 #include <functional>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include <liveMedia.hh>
 #include <BasicUsageEnvironment.hh>
 #include <GroupsockHelper.hh>
 
 
 #define PROTOCOL "RTP"
-#define RTP_RECEIVE_BUFFER_SIZE 2000000
+#define RTP_RECEIVE_BUFFER_SIZE 8000000       //!< Requested SO_RCVBUF, the kernel caps it to net.core.rmem_max
+#define RTP_MULTICAST_RECEIVE_BUFFER_SIZE 32000000  //!< Requested SO_RCVBUF of multicast RTP sockets
+#define RECEIVE_LOOP_MAX_DELAY 1000           //!< usec, live555 checks new frames and events at least this often
+#define RECEIVE_DEFAULT_SHARDS 1
+#define RECEIVE_MAX_SHARDS 64
+#define RECEIVE_RESUME_TIMEOUT 100000        //!< usec, the suspended filter is resumed at least this often while it has sinks
 
 class SourceManager;
 class SCSSubsessionStats;
@@ -82,9 +93,11 @@ public:
     SCSSubsessionStats* getSubsessionStats(size_t port);
 
     /**
-    * Schedules next stats measurement
+    * Measures the stats of its subsessions and sets their jitter to the sinks, called by the stats sweep
+    * of its shard (see SourceManager::watchStats)
+    * @param timeNow time of the sweep
     */
-    void scheduleNextStatsMeasurement(UsageEnvironment* env);
+    void measureStats(struct timeval const& timeNow);
 
     /**
     * Returns it SCSSubsessionStats map
@@ -100,11 +113,15 @@ public:
     TaskToken streamTimerTask;
     double duration;
     TaskToken sessionTimeoutBrokenServerTask;
-    TaskToken sessionStatsMeasurementTask;
-    size_t statsMeasurementIntervalMS;
-    size_t nextStatsMeasurementUSecs;
     bool sendKeepAlivesToBrokenServers;
     unsigned sessionTimeoutParameter;
+    unsigned jitterBufferMaxDelay;                  //!< msec, 0 if the sinks do not buffer the frames
+    unsigned jitterBufferMinDelay;
+    bool accessUnits;                               //!< H.264 and H.265 sinks write whole access units
+    std::string url;                                //!< RTSP URL, empty for SDP sessions
+    bool fastStart;                                 //!< The cached SDP of the URL replaces the DESCRIBE
+    bool cachedDescription;                         //!< The session was set up from the cached SDP
+    bool standby;                                   //!< H.264 and H.265 sinks keep the last GOP until a writer connects
 
 private:
     std::string id;
@@ -136,28 +153,155 @@ protected:
     StreamClientState *scs;
 };
 
+/*! SDP and parameter sets of an RTSP URL, kept to start its next sessions without waiting for them */
+struct SessionCacheEntry {
+    std::string sdp;
+    std::string baseURL;                                            //!< Content-Base of the DESCRIBE response
+    std::map<std::string, std::vector<unsigned char>> extradata;    //!< By subsession medium, codec and control path
+};
+
+/*! live555 environment of a group of sessions, run by its own receive loop thread */
+struct ReceiveShard {
+    UsageEnvironment* env;
+    BasicTaskScheduler0* scheduler;
+    std::thread loopThread;
+    std::mutex envMtx;
+    std::atomic<unsigned> envWaiters;
+    TaskToken statsTask;                            //!< Stats sweep of the shard sessions, NULL if there are none
+    int64_t nextStatsUSecs;
+    std::vector<StreamClientState*> statsClients;   //!< Sessions measured by the sweep, guarded by the environment lock
+};
+
+/*! HeadFilter receiving RTP sessions, either described by SDP or set up through RTSP. Sessions are spread
+    over shards, each one with its own live555 environment, epoll scheduler and receive loop thread, so
+    packets are read as soon as they arrive and not only when the filter is scheduled. RTP sockets read their
+    packets in batches with recvmmsg. MPEG-TS streams received through SRT are demuxed by SRTSessions, which
+    are placed in the shards as the RTP sessions are and share their ids. QueueSinks fill the writer frames
+    from the receive loops and the filter collects them. live555 is not thread safe, the environment lock of
+    a shard is held by its receive loop while it runs and must be held by any other thread using that
+    environment. Session, sink and stream maps are shared by the shards and guarded by their own lock, which
+    is always taken after an environment one. The SDP and the parameter sets of the RTSP URLs are cached, so
+    fast start sessions skip the DESCRIBE and their decoders are configured before the first frame. The stats of
+    the subsessions are measured by a single periodic sweep per shard instead of a timer per session. The filter
+    is not periodic, it suspends on an Awaiter between runs and the sinks resume it whenever they fill a frame,
+    so no worker polls for frames that are still being received. */
 class SourceManager : public HeadFilter {
 public:
-    SourceManager(unsigned writersNum = MAX_WRITERS);
+    SourceManager(unsigned writersNum = MAX_WRITERS, unsigned shardsNum = RECEIVE_DEFAULT_SHARDS);
     ~SourceManager();
 
 public:
     static std::string makeSessionSDP(std::string sessionName, std::string sessionDescription);
+    /**
+    * Describes an RTP subsession received by the SourceManager
+    * @param group multicast group the subsession is received from, empty for unicast
+    * @param source only the packets of this source are received from the group (source-specific multicast),
+    *               empty to receive them from any source
+    */
     static std::string makeSubsessionSDP(std::string mediumName, std::string protocolName,
                                   unsigned int RTPPayloadFormat,
                                   std::string codecName, unsigned int bandwidth,
                                   unsigned int RTPTimestampFrequency,
                                   unsigned int clientPortNum = 0,
-                                  unsigned int channels = 0);
+                                  unsigned int channels = 0,
+                                  std::string group = "",
+                                  std::string source = "");
 
-    bool addSession(Session* session);
+    /**
+    * @param group multicast group, empty for unicast
+    * @param source source of the group, empty for any source
+    * @return false if the group is not an IPv4 multicast address or the source is not an IPv4 unicast one
+    */
+    static bool checkMulticastAddresses(std::string group, std::string source);
+
+    /**
+    * Adds a session created in the environment of a shard
+    * @param session session to add
+    * @param shard shard whose environment was used to create the session
+    * @return false if the session is NULL or the shard does not exist
+    */
+    bool addSession(Session* session, unsigned shard = 0);
     bool removeSession(std::string id);
 
     Session* getSession(std::string id);
     std::map<std::string, Session*> getSessions() { return sessionMap; };
+
+    /**
+    * Adds an SRT input session created in the environment of a shard
+    * @param session session to add
+    * @param shard shard whose environment was used to create the session
+    * @return false if the session is NULL, its id is in use or the shard does not exist
+    */
+    bool addSRTSession(SRTSession* session, unsigned shard = 0);
     int getWriterID(unsigned int port);
 
-    UsageEnvironment* envir() {return env;}
+    /**
+    * Gets the stream of a port as soon as its session is known, before the writer is connected
+    * @param wId writer id, i.e. the port of the subsession
+    * @return the stream info, NULL if there is no subsession at the port
+    */
+    const StreamInfo* getWriterStreamInfo(int wId);
+
+    /**
+    * Keeps the SDP of an RTSP URL, sessions of the URL added with fastStart are set up from it
+    * @param url RTSP URL
+    * @param sdp SDP returned by the DESCRIBE
+    * @param baseURL base URL of the SETUP requests after the DESCRIBE
+    */
+    void cacheDescription(std::string url, std::string sdp, std::string baseURL);
+
+    /**
+    * @param url RTSP URL
+    * @param sdp filled with the cached SDP of the URL
+    * @param baseURL filled with the cached base URL of its SETUP requests
+    * @return false if there is no cached SDP for the URL
+    */
+    bool getCachedDescription(std::string url, std::string& sdp, std::string& baseURL);
+
+    /**
+    * Keeps the parameter sets of a subsession, so the next sessions of the URL know them before they arrive
+    * @param url RTSP URL
+    * @param subsession subsession whose sink has an H264VideoSdpParser
+    */
+    void cacheExtradata(std::string url, MediaSubsession* subsession);
+
+    /**
+    * Sets the cached parameter sets of a subsession to its H264VideoSdpParser, if the SDP does not carry them
+    * @param url RTSP URL
+    * @param subsession subsession whose sink has an H264VideoSdpParser
+    * @return true if the parser took the cached parameter sets
+    */
+    bool restoreExtradata(std::string url, MediaSubsession* subsession);
+
+    /**
+    * Forgets the SDP and the parameter sets of an RTSP URL
+    * @param url RTSP URL
+    */
+    void evictCache(std::string url);
+
+    /**
+    * Replaces the receive shards, it fails if there are sessions
+    * @param shardsNum number of shards, from 1 to RECEIVE_MAX_SHARDS
+    * @return true if succeeded
+    */
+    bool setShards(unsigned shardsNum);
+    unsigned getShardsNum() const {return shards.size();};
+
+    /**
+    * Adds a session to the stats sweep of its shard, a single periodic task measuring the stats of all the
+    * shard subsessions every DEFAULT_STATS_TIME_INTERVAL. The environment lock must be held
+    * @param scs session with subsession stats
+    * @param env environment of the session
+    * @return false if the environment is not the one of a shard
+    */
+    bool watchStats(StreamClientState* scs, UsageEnvironment& env);
+
+    /**
+    * Removes a session from the stats sweep of its shard, see watchStats
+    * @param scs session with subsession stats
+    * @param env environment of the session
+    */
+    void unwatchStats(StreamClientState* scs, UsageEnvironment& env);
 
 private:
     void initializeEventMap();
@@ -165,30 +309,52 @@ private:
     
     void doGetState(Jzon::Object &filterNode);
     bool addSessionEvent(Jzon::Node* params);
+    bool addSRTSessionEvent(Jzon::Node* params, std::string sessionId, unsigned shard);
+    bool removeSRTSession(std::string id);
     bool removeSessionEvent(Jzon::Node* params);
+    bool setShardsEvent(Jzon::Node* params);
+    bool setJitterBufferEvent(Jzon::Node* params);
+    bool setClockRecoveryEvent(Jzon::Node* params);
 
     friend bool Session::initiateSession();
     friend bool StreamClientState::addSinkToMngr(unsigned port, QueueSink* sink);
+    friend class SRTSession;
     bool addSink(unsigned port, QueueSink *sink);
 
-    bool doProcessFrame(std::map<int, Frame*> &dFrames, int& ret);
+    bool doProcessFrame(FrameMap &dFrames, int& ret);
+    bool pendingJobs();
     void addConnection(int wId, MediaSubsession* subsession);
 
+    void eventLoop(ReceiveShard* shard);
+    std::unique_lock<std::mutex> lockEnvironment(ReceiveShard* shard);
+    void stopShards();
+    unsigned pickShard();
+    int getShard(UsageEnvironment& env);
+
     static void* startServer(void *args);
     FrameQueue *allocQueue(ConnectionData cData);
+    StreamInfo* getOutputStreamInfo(int writerId);
     
     bool specificWriterConfig(int writerID);
     bool specificWriterDelete(int writerID);
 
     std::map<std::string, Session*> sessionMap;
+    std::map<std::string, SRTSession*> srtSessions;
     std::string deleteSessionId;
 
     /* StreamInfo indexed by writerID */
     std::map<int, StreamInfo *> outputStreamInfos;
     std::map<int, QueueSink*> sinks;
 
-    UsageEnvironment* env;
-    BasicTaskScheduler0 *scheduler;
+    std::vector<ReceiveShard*> shards;
+    std::map<std::string, unsigned> sessionShards;
+    std::map<int, unsigned> sinkShards;
+    std::mutex mngrMtx;
+    std::atomic<bool> stopLoop;
+    Awaiter awaiter;                    //!< Resumed by the sinks filling frames
+
+    std::map<std::string, SessionCacheEntry> sessionCache;    //!< By RTSP URL
+    std::mutex cacheMtx;                                        //!< Guards the session cache, no lock is taken after it
 };
 
 /*! It represents a SourceManager subsession statistics object. It contains the port (id of the subsession) and average, 
@@ -0,0 +1,312 @@
+/*
+ *  RecordWriter - Background writer of recorded files in large aligned blocks
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "RecordWriter.hh"
+#include "../../Utils.hh"
+
+#include <new>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+RecordWriter::RecordWriter(size_t blocks_, size_t blockSize_) :
+    current(NULL), opened(false), stop(false), fd(-1), direct(false),
+    writtenBytes(0), writtenFiles(0), failedWrites(0), blockedWrites(0), directFiles(false)
+{
+    void *data;
+
+    blocksNum = blocks_ > 1 ? blocks_ : 2;
+    blockSize = (std::max(blockSize_, (size_t) 1) + RECORD_BLOCK_ALIGN - 1)/RECORD_BLOCK_ALIGN*RECORD_BLOCK_ALIGN;
+
+    blocks.resize(blocksNum);
+    for (auto &block : blocks) {
+        if (posix_memalign(&data, RECORD_BLOCK_ALIGN, blockSize) != 0) {
+            throw std::bad_alloc();
+        }
+
+        block.data = (unsigned char*) data;
+        block.length = 0;
+        block.last = false;
+        freeBlocks.push_back(&block);
+    }
+
+    current = freeBlocks.back();
+    freeBlocks.pop_back();
+
+    writingThread = std::thread(&RecordWriter::writingLoop, this);
+}
+
+RecordWriter::~RecordWriter()
+{
+    close();
+
+    std::unique_lock<std::mutex> guard(mtx);
+    stop = true;
+    blockCheck.notify_all();
+    guard.unlock();
+
+    writingThread.join();
+
+    for (auto &block : blocks) {
+        free(block.data);
+    }
+}
+
+bool RecordWriter::open(std::string path)
+{
+    if (path.empty()) {
+        return false;
+    }
+
+    if (opened) {
+        current->last = true;
+        queueBlock();
+    }
+
+    current->path = path;
+    opened = true;
+
+    return true;
+}
+
+bool RecordWriter::write(const unsigned char* data, size_t length)
+{
+    size_t chunk;
+
+    if (!opened) {
+        return false;
+    }
+
+    while (length > 0) {
+        chunk = std::min(length, blockSize - current->length);
+        memcpy(current->data + current->length, data, chunk);
+
+        current->length += chunk;
+        data += chunk;
+        length -= chunk;
+
+        if (current->length == blockSize) {
+            queueBlock();
+        }
+    }
+
+    return true;
+}
+
+void RecordWriter::close()
+{
+    if (!opened) {
+        return;
+    }
+
+    current->last = true;
+    queueBlock();
+    opened = false;
+}
+
+void RecordWriter::flush()
+{
+    std::unique_lock<std::mutex> guard(mtx);
+    blockCheck.wait(guard, [&]{return queued.empty();});
+}
+
+size_t RecordWriter::getWrittenBytes()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return writtenBytes;
+}
+
+size_t RecordWriter::getFailedWrites()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return failedWrites;
+}
+
+void RecordWriter::getState(Jzon::Object &node)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    node.Add("pendingBlocks", (int) queued.size());
+    node.Add("blockSize", (int) blockSize);
+    node.Add("writtenBytes", (double) writtenBytes);
+    node.Add("writtenFiles", (int) writtenFiles);
+    node.Add("failedWrites", (int) failedWrites);
+    node.Add("blockedWrites", (int) blockedWrites);
+    node.Add("direct", directFiles);
+}
+
+void RecordWriter::queueBlock()
+{
+    std::unique_lock<std::mutex> guard(mtx);
+
+    queued.push_back(current);
+    blockCheck.notify_all();
+
+    //NOTE: the recorder only waits when the storage can not keep up, memory stays bounded
+    if (freeBlocks.empty()) {
+        blockedWrites++;
+        utils::warningMsg("[RecordWriter] Storage is too slow, waiting for pending writes");
+        blockCheck.wait(guard, [&]{return !freeBlocks.empty();});
+    }
+
+    current = freeBlocks.back();
+    freeBlocks.pop_back();
+
+    current->length = 0;
+    current->path.clear();
+    current->last = false;
+}
+
+void RecordWriter::writingLoop()
+{
+    std::unique_lock<std::mutex> guard(mtx);
+    RecordBlock *block;
+
+    while (true) {
+        blockCheck.wait(guard, [&]{return stop || !queued.empty();});
+
+        if (queued.empty()) {
+            break;
+        }
+
+        //NOTE: the block stays queued while written, so flush also waits for it
+        block = queued.front();
+        guard.unlock();
+
+        writeBlock(block);
+
+        guard.lock();
+        queued.pop_front();
+        freeBlocks.push_back(block);
+        blockCheck.notify_all();
+    }
+
+    guard.unlock();
+    closeFile();
+}
+
+void RecordWriter::writeBlock(RecordBlock *block)
+{
+    size_t failed = 0;
+    size_t written = 0;
+    bool newFile = false;
+    bool newDirect = false;
+
+    if (!block->path.empty()) {
+        closeFile();
+
+        if (openFile(block->path)) {
+            newFile = true;
+            newDirect = direct;
+        } else {
+            utils::errorMsg("[RecordWriter] Error opening " + block->path);
+            failed++;
+        }
+    }
+
+    if (block->length > 0 && fd >= 0) {
+        if (writeData(block->data, block->length)) {
+            written = block->length;
+        } else {
+            utils::errorMsg("[RecordWriter] Error writing recorded data");
+            failed++;
+        }
+    }
+
+    if (block->last) {
+        closeFile();
+    }
+
+    std::lock_guard<std::mutex> guard(mtx);
+    writtenBytes += written;
+    writtenFiles += newFile ? 1 : 0;
+    failedWrites += failed;
+    directFiles = newFile ? newDirect : directFiles;
+}
+
+bool RecordWriter::openFile(std::string path)
+{
+    direct = false;
+
+#ifdef O_DIRECT
+    //NOTE: some file systems (tmpfs, some network ones) refuse O_DIRECT, they get regular buffered writes
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd >= 0) {
+        direct = true;
+        return true;
+    }
+#endif
+
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    return fd >= 0;
+}
+
+void RecordWriter::closeFile()
+{
+    if (fd < 0) {
+        return;
+    }
+
+    ::close(fd);
+    fd = -1;
+    direct = false;
+}
+
+bool RecordWriter::writeData(const unsigned char* data, size_t length)
+{
+    size_t aligned = direct ? length - length % RECORD_BLOCK_ALIGN : length;
+    ssize_t ret;
+
+    while (length > 0) {
+
+        //NOTE: the unaligned tail, only found at the end of a file, is written without O_DIRECT
+        if (direct && aligned == 0) {
+#ifdef O_DIRECT
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+#endif
+            direct = false;
+            aligned = length;
+        }
+
+        ret = ::write(fd, data, aligned);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret < 0 && errno == EINVAL && direct) {
+            aligned = 0;
+            continue;
+        }
+
+        if (ret <= 0) {
+            return false;
+        }
+
+        data += ret;
+        length -= ret;
+        aligned -= std::min(aligned, (size_t) ret);
+    }
+
+    return true;
+}
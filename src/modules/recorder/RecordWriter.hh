@@ -0,0 +1,143 @@
+/*
+ *  RecordWriter - Background writer of recorded files in large aligned blocks
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _RECORD_WRITER_HH
+#define _RECORD_WRITER_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "../../Jzon.h"
+
+#define RECORD_BLOCK_SIZE   (1024*1024)     //!< Bytes written at once, rounded up to RECORD_BLOCK_ALIGN
+#define RECORD_BLOCK_ALIGN  4096            //!< Memory, offset and length alignment required by O_DIRECT
+#define RECORD_BLOCKS       8               //!< Preallocated blocks, write waits for the thread when all are queued
+
+/*! Part of a recorded file. Blocks are full except the last one of each file */
+struct RecordBlock {
+    unsigned char* data;
+    size_t length;
+    std::string path;               //!< Not empty if the block starts a new file
+    bool last;                      //!< The file is closed once the block is written
+};
+
+/*! Writes the recorded files from its own thread, so slow storage does not stall the recorder.
+*   Data is copied into a fixed set of aligned blocks which are written whole, bypassing the page cache
+*   with O_DIRECT when the file system allows it. This way long recordings neither fill the cache nor
+*   generate a system call per frame. Only the tail of each file is written without O_DIRECT.
+*/
+class RecordWriter {
+
+public:
+    /**
+    * Class constructor, the blocks are allocated and the writing thread is started
+    * @param blocks number of blocks
+    * @param blockSize bytes of each block
+    */
+    RecordWriter(size_t blocks = RECORD_BLOCKS, size_t blockSize = RECORD_BLOCK_SIZE);
+
+    /**
+    * Class destructor, the current file is completed before stopping the thread
+    */
+    ~RecordWriter();
+
+    /**
+    * Starts a new file, the previous one is closed once its data is written
+    * @param path file path, it is truncated if it exists
+    * @return false if the path is empty
+    */
+    bool open(std::string path);
+
+    /**
+    * Appends data to the current file. It waits while all the blocks are queued
+    * @param data data to append, it is copied
+    * @param length data bytes
+    * @return false if there is no open file
+    */
+    bool write(const unsigned char* data, size_t length);
+
+    /**
+    * Closes the current file once its data is written
+    */
+    void close();
+
+    /**
+    * Waits until all the queued blocks are written. Data of the block in progress is not
+    */
+    void flush();
+
+    /**
+    * @return true if there is an open file
+    */
+    bool isOpen() {return opened;};
+
+    /**
+    * @return bytes held by the blocks
+    */
+    size_t getAllocatedBytes() {return blocksNum*blockSize;};
+
+    /**
+    * @return bytes written to disk
+    */
+    size_t getWrittenBytes();
+
+    /**
+    * @return blocks or files that could not be written or opened
+    */
+    size_t getFailedWrites();
+
+    void getState(Jzon::Object &node);
+
+private:
+    void queueBlock();
+    void writingLoop();
+    void writeBlock(RecordBlock *block);
+    bool openFile(std::string path);
+    void closeFile();
+    bool writeData(const unsigned char* data, size_t length);
+
+    std::thread writingThread;
+    std::mutex mtx;
+    std::condition_variable blockCheck;
+    std::vector<RecordBlock> blocks;
+    std::deque<RecordBlock*> queued;
+    std::vector<RecordBlock*> freeBlocks;
+    RecordBlock* current;
+    size_t blocksNum;
+    size_t blockSize;
+    bool opened;
+    bool stop;
+
+    //NOTE: only used by the writing thread
+    int fd;
+    bool direct;
+
+    size_t writtenBytes;
+    size_t writtenFiles;
+    size_t failedWrites;
+    size_t blockedWrites;                   //!< Writes that had to wait for a free block
+    bool directFiles;                       //!< The last file was opened with O_DIRECT
+};
+
+#endif
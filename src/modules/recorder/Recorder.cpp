@@ -0,0 +1,417 @@
+/*
+ *  Recorder - Records coded streams into MPEG-TS files
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "Recorder.hh"
+#include "RecordWriter.hh"
+#include "../transmitter/TSPacketizer.hh"
+#include "../../NalSplitter.hh"
+#include "../../AVFramedQueue.hh"
+#include "../../Utils.hh"
+
+#include <cstring>
+#include <unistd.h>
+
+#define NAL_START_SIZE 4
+
+static const unsigned char nalStartCode[NAL_START_SIZE] = {0x00, 0x00, 0x00, 0x01};
+
+static bool isVCL(VCodecType codec, unsigned char nalType)
+{
+    return codec == H264 ? (nalType >= 1 && nalType <= 5) : nalType < 32;
+}
+
+static bool isRandomAccess(VCodecType codec, unsigned char nalType)
+{
+    //NOTE: parameter sets go first, so files start with them
+    return codec == H264 ? (nalType == 5 || nalType == 7) : ((nalType >= 16 && nalType <= 21) || nalType == 32);
+}
+
+static unsigned char nalTypeOf(VCodecType codec, unsigned char header)
+{
+    return codec == H264 ? header & 0x1F : (header & 0x7E) >> 1;
+}
+
+Recorder::Recorder(unsigned readersNum) :
+    TailFilter(readersNum), writer(NULL), packetizer(NULL), fileDuration(0), fileStart(0),
+    fileIndex(0), recording(false), restart(false)
+{
+    fType = RECORDER;
+    writer = new RecordWriter();
+    initializeEventMap();
+}
+
+Recorder::~Recorder()
+{
+    closeFile();
+
+    //NOTE: the writer completes the file before stopping
+    delete writer;
+    delete packetizer;
+}
+
+bool Recorder::configure(std::string folder, std::string baseName_, unsigned fileDuration_)
+{
+    if (access(folder.c_str(), W_OK) != 0) {
+        utils::errorMsg("Error configuring Recorder: provided folder is not writable");
+        return false;
+    }
+
+    if (baseName_.empty()) {
+        utils::errorMsg("Error configuring Recorder: empty base name");
+        return false;
+    }
+
+    if (folder.back() != '/') {
+        folder += "/";
+    }
+
+    //NOTE: files of a new base name are numbered from scratch
+    if (basePath != folder || baseName != baseName_) {
+        fileIndex = 0;
+    }
+
+    basePath = folder;
+    baseName = baseName_;
+    fileDuration = std::chrono::seconds(fileDuration_);
+    restart = recording;
+    recording = true;
+
+    return true;
+}
+
+void Recorder::stopRecording()
+{
+    closeFile();
+    recording = false;
+    restart = false;
+}
+
+bool Recorder::doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& /*ret*/)
+{
+    std::chrono::microseconds ts;
+    Frame* frame;
+
+    if (!recording) {
+        return true;
+    }
+
+    for (auto id : newFrames) {
+        auto it = inputs.find(id);
+
+        if (it == inputs.end()) {
+            continue;
+        }
+
+        RecordInput &input = it->second;
+        frame = orgFrames[id];
+        ts = frame->getPresentationTime();
+
+        if (isStartPoint(input, frame) && (!writer->isOpen() || restart ||
+            (fileDuration.count() > 0 && ts - fileStart >= fileDuration))) {
+            startFile(ts);
+        }
+
+        //NOTE: frames before the first start point can not be decoded on their own
+        if (!writer->isOpen()) {
+            continue;
+        }
+
+        if (input.vCodec == VC_NONE) {
+            packetizer->writeFrame(input.stream, frame->getDataBuf(), frame->getLength(), ts.count()*9/100);
+        } else {
+            addVideoFrame(input, frame, ts.count()*9/100);
+        }
+    }
+
+    drainPackets();
+
+    return true;
+}
+
+bool Recorder::drainFrame()
+{
+    closeFile();
+    return false;
+}
+
+bool Recorder::isStartPoint(RecordInput &input, Frame* frame)
+{
+    unsigned start;
+
+    //NOTE: without video any frame starts a file, otherwise only video random access points do
+    if (input.vCodec == VC_NONE) {
+        for (auto &it : inputs) {
+            if (it.second.vCodec != VC_NONE) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    start = NalSplitter::startCodeLength(frame->getDataBuf(), frame->getLength());
+
+    if (frame->getLength() <= start) {
+        return false;
+    }
+
+    return isRandomAccess(input.vCodec, nalTypeOf(input.vCodec, frame->getDataBuf()[start]));
+}
+
+void Recorder::startFile(std::chrono::microseconds ts)
+{
+    closeFile();
+
+    filePath = basePath + baseName + "_" + std::to_string(fileIndex++) + RECORD_EXT;
+    writer->open(filePath);
+
+    //NOTE: the tables are built once, so each file gets a packetizer with the current streams
+    delete packetizer;
+    packetizer = new TSPacketizer();
+
+    for (auto &it : inputs) {
+        RecordInput &input = it.second;
+
+        if (input.vCodec == H264) {
+            input.stream = packetizer->addStream(TS_STREAM_H264);
+        } else if (input.vCodec == H265) {
+            input.stream = packetizer->addStream(TS_STREAM_H265);
+        } else if (input.aCodec == AAC) {
+            input.stream = packetizer->addStream(TS_STREAM_AAC);
+        } else {
+            input.stream = packetizer->addStream(TS_STREAM_MP3);
+        }
+
+        input.size = 0;
+        input.started = false;
+        input.randomAccess = false;
+    }
+
+    fileStart = ts;
+    restart = false;
+}
+
+void Recorder::closeFile()
+{
+    if (!writer->isOpen()) {
+        return;
+    }
+
+    for (auto &it : inputs) {
+        writeVideo(it.second);
+    }
+
+    drainPackets();
+    writer->close();
+    filePath.clear();
+}
+
+void Recorder::addVideoFrame(RecordInput &input, Frame* frame, uint64_t pts)
+{
+    unsigned char* data = frame->getDataBuf();
+    unsigned length = frame->getLength();
+    unsigned start = NalSplitter::startCodeLength(data, length);
+    unsigned char nalType;
+
+    if (length <= start) {
+        return;
+    }
+
+    //NOTE: staged NAL units of another access unit are written on their own
+    if (input.size > 0 && pts != input.pts) {
+        writeVideo(input);
+    }
+
+    if (input.size + length + NAL_START_SIZE > input.buffer.size()) {
+        input.buffer.resize(input.size + length + NAL_START_SIZE);
+    }
+
+    if (start == 0) {
+        memcpy(input.buffer.data() + input.size, nalStartCode, NAL_START_SIZE);
+        input.size += NAL_START_SIZE;
+    }
+
+    memcpy(input.buffer.data() + input.size, data, length);
+    input.size += length;
+
+    nalType = nalTypeOf(input.vCodec, data[start]);
+    input.pts = pts;
+    input.randomAccess = input.randomAccess || isRandomAccess(input.vCodec, nalType);
+
+    if (isVCL(input.vCodec, nalType)) {
+        writeVideo(input);
+    }
+}
+
+void Recorder::writeVideo(RecordInput &input)
+{
+    if (input.size == 0) {
+        return;
+    }
+
+    packetizer->writeFrame(input.stream, input.buffer.data(), input.size, input.pts,
+                           !input.started || input.pts != input.lastPts, input.randomAccess);
+
+    input.lastPts = input.pts;
+    input.started = true;
+    input.randomAccess = false;
+    input.size = 0;
+}
+
+void Recorder::drainPackets()
+{
+    unsigned packets;
+
+    if (!packetizer) {
+        return;
+    }
+
+    packets = packetizer->getPendingPackets();
+
+    if (packets == 0) {
+        return;
+    }
+
+    if (writer->isOpen()) {
+        writer->write(packetizer->getPackets(), packets*TS_PACKET_SIZE);
+    }
+
+    packetizer->consume(packets);
+}
+
+bool Recorder::specificReaderConfig(int readerId, FrameQueue* queue)
+{
+    VideoFrameQueue *vQueue;
+    AudioFrameQueue *aQueue;
+    RecordInput input = {VC_NONE, AC_NONE, -1, {}, 0, 0, 0, false, false};
+
+    if ((vQueue = dynamic_cast<VideoFrameQueue*>(queue)) != NULL) {
+        input.vCodec = vQueue->getStreamInfo()->video.codec;
+
+        if (input.vCodec != H264 && input.vCodec != H265) {
+            utils::errorMsg("Error setting recorder reader: only H264 & H265 codecs are supported for video");
+            return false;
+        }
+
+        input.buffer.resize(RECORD_VIDEO_BUFFER_SIZE);
+
+    } else if ((aQueue = dynamic_cast<AudioFrameQueue*>(queue)) != NULL) {
+        input.aCodec = aQueue->getStreamInfo()->audio.codec;
+
+        if (input.aCodec != AAC && input.aCodec != MP3) {
+            utils::errorMsg("Error setting recorder reader: only AAC & MP3 codecs are supported for audio");
+            return false;
+        }
+
+    } else {
+        utils::errorMsg("Error setting recorder reader: only video and audio queues are supported");
+        return false;
+    }
+
+    inputs[readerId] = input;
+
+    //NOTE: the new stream is announced by the tables of the next file
+    restart = recording;
+
+    return true;
+}
+
+bool Recorder::specificReaderDelete(int readerId)
+{
+    if (inputs.count(readerId) == 0) {
+        return false;
+    }
+
+    writeVideo(inputs[readerId]);
+    inputs.erase(readerId);
+    restart = recording;
+
+    return true;
+}
+
+void Recorder::initializeEventMap()
+{
+    eventMap["configure"] = std::bind(&Recorder::configureEvent, this, std::placeholders::_1);
+    eventMap["stop"] = std::bind(&Recorder::stopEvent, this, std::placeholders::_1);
+}
+
+size_t Recorder::getInternalBytes()
+{
+    size_t bytes = writer->getAllocatedBytes();
+
+    for (auto &it : inputs) {
+        bytes += it.second.buffer.capacity();
+    }
+
+    return bytes;
+}
+
+void Recorder::doGetState(Jzon::Object &filterNode)
+{
+    Jzon::Array readersList;
+    Jzon::Object writerNode;
+
+    filterNode.Add("folder", basePath);
+    filterNode.Add("baseName", baseName);
+    filterNode.Add("fileDuration", (int) fileDuration.count());
+    filterNode.Add("recording", recording);
+    filterNode.Add("file", filePath);
+    filterNode.Add("files", (int) fileIndex);
+
+    for (auto &it : inputs) {
+        readersList.Add(it.first);
+    }
+
+    filterNode.Add("readers", readersList);
+
+    writer->getState(writerNode);
+    filterNode.Add("writer", writerNode);
+}
+
+bool Recorder::configureEvent(Jzon::Node* params)
+{
+    std::string folder = basePath;
+    std::string bName = baseName;
+    unsigned duration = fileDuration.count();
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("folder") && params->Get("folder").IsString()) {
+        folder = params->Get("folder").ToString();
+    }
+
+    if (params->Has("baseName") && params->Get("baseName").IsString()) {
+        bName = params->Get("baseName").ToString();
+    }
+
+    if (params->Has("fileDuration") && params->Get("fileDuration").IsNumber()) {
+        duration = params->Get("fileDuration").ToInt();
+    }
+
+    return configure(folder, bName, duration);
+}
+
+bool Recorder::stopEvent(Jzon::Node* /*params*/)
+{
+    stopRecording();
+    return true;
+}
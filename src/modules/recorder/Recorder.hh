@@ -0,0 +1,121 @@
+/*
+ *  Recorder - Records coded streams into MPEG-TS files
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _RECORDER_HH
+#define _RECORDER_HH
+
+#include "../../Filter.hh"
+#include "../../VideoFrame.hh"
+#include "../../AudioFrame.hh"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#define RECORD_EXT                  ".ts"
+#define RECORD_VIDEO_BUFFER_SIZE    (1024*1024)     //!< Initial staging buffer of an access unit, grown on demand
+
+class TSPacketizer;
+class RecordWriter;
+
+/*! Stream recorded from a reader */
+struct RecordInput {
+    VCodecType vCodec;                  //!< VC_NONE for audio inputs
+    ACodecType aCodec;
+    int stream;                         //!< Stream of the current file packetizer
+    std::vector<unsigned char> buffer;  //!< NAL units of the access unit in progress, with start codes
+    unsigned size;
+    uint64_t pts;
+    uint64_t lastPts;
+    bool started;
+    bool randomAccess;
+};
+
+/*! Records the coded streams of its readers into MPEG-TS files, muxed from the pipeline frames without
+*   transcoding them. Recordings are split in files of a configured duration, each one starting at a video
+*   random access point so it can be played on its own. Files are written by a RecordWriter thread.
+*/
+class Recorder : public TailFilter {
+
+public:
+    /**
+    * Class constructor
+    * @param readersNum maximum number of recorded streams
+    */
+    Recorder(unsigned readersNum = MAX_READERS);
+
+    /**
+    * Class destructor, the current file is completed
+    */
+    ~Recorder();
+
+    /**
+    * Starts recording, a recording in progress goes on in a new file
+    * @param folder folder where files are written
+    * @param baseName files are named baseName_<index>.ts
+    * @param fileDuration seconds after which a new file is started, 0 to record a single file
+    * @return false if the folder is not writable or the base name is empty
+    */
+    bool configure(std::string folder, std::string baseName, unsigned fileDuration);
+
+    /**
+    * Stops recording, the current file is completed
+    */
+    void stopRecording();
+
+    /**
+    * @return path of the file being written, empty if there is none
+    */
+    std::string getFilePath() {return filePath;};
+
+private:
+    bool doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& ret);
+    bool drainFrame();
+    void doGetState(Jzon::Object &filterNode);
+    size_t getInternalBytes();
+    bool specificReaderConfig(int readerId, FrameQueue* queue);
+    bool specificReaderDelete(int readerId);
+    void initializeEventMap();
+
+    bool configureEvent(Jzon::Node* params);
+    bool stopEvent(Jzon::Node* params);
+
+    bool isStartPoint(RecordInput &input, Frame* frame);
+    void startFile(std::chrono::microseconds ts);
+    void closeFile();
+    void addVideoFrame(RecordInput &input, Frame* frame, uint64_t pts);
+    void writeVideo(RecordInput &input);
+    void drainPackets();
+
+    RecordWriter* writer;
+    TSPacketizer* packetizer;
+    std::map<int, RecordInput> inputs;
+    std::string basePath;
+    std::string baseName;
+    std::string filePath;
+    std::chrono::seconds fileDuration;
+    std::chrono::microseconds fileStart;
+    unsigned fileIndex;
+    bool recording;
+    bool restart;                       //!< A new file is started at the next start point
+};
+
+#endif
@@ -21,14 +21,20 @@
  */
 
 #include <random>
+#include <algorithm>
+#include <cstddef>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "SharedMemory.hh"
 
 static unsigned char const start_code[4] = {0x00, 0x00, 0x00, 0x01};
 
-SharedMemory* SharedMemory::createNew(size_t key_, VCodecType codec)
+SharedMemory* SharedMemory::createNew(size_t key_, VCodecType codec, unsigned slots)
 {
-    SharedMemory *shm = new SharedMemory(key_, codec);
+    SharedMemory *shm = new SharedMemory(key_, codec, slots);
 
     if(shm->isEnabled()){
         return shm;
@@ -36,14 +42,14 @@ SharedMemory* SharedMemory::createNew(size_t key_, VCodecType codec)
     return NULL;
 }
 
-SharedMemory* SharedMemory::createNew(VCodecType codec)
+SharedMemory* SharedMemory::createNew(VCodecType codec, unsigned slots)
 {
     std::default_random_engine generator(
         std::chrono::system_clock::now().time_since_epoch().count());
     std::uniform_int_distribution<unsigned> distribution(1,10000);
     
     unsigned key_ = distribution(generator);
-    SharedMemory *shm = new SharedMemory(key_, codec);
+    SharedMemory *shm = new SharedMemory(key_, codec, slots);
 
     if(shm->isEnabled()){
         return shm;
@@ -51,8 +57,26 @@ SharedMemory* SharedMemory::createNew(VCodecType codec)
     return NULL;
 }
 
-SharedMemory::SharedMemory(size_t key_, VCodecType codec_):
-    OneToOneFilter(), enabled(true), newFrame(false), codec(codec_)
+SharedMemory* SharedMemory::createNew(std::string name, VCodecType codec, ShmBackend backend, unsigned slots)
+{
+    SharedMemory *shm;
+
+    if (backend == SHM_SYSV || name.empty() || slots == 0) {
+        utils::errorMsg("SharedMemory::error - named segments need a name, ring slots and the POSIX or memfd backend");
+        return NULL;
+    }
+
+    shm = new SharedMemory(0, codec, slots, backend, name);
+
+    if(shm->isEnabled()){
+        return shm;
+    }
+    return NULL;
+}
+
+SharedMemory::SharedMemory(size_t key_, VCodecType codec_, unsigned slots_, ShmBackend backend_, std::string name_):
+    OneToOneFilterT(), sharedMemoryId(0), SharedMemoryOrigin(NULL), enabled(true), newFrame(false), codec(codec_),
+    slots(0), ring(NULL), backend(backend_), shmName(name_), shmFd(-1), mappedSize(0), generation(0)
 {
 
     if(!(codec == RAW || codec == H264)){
@@ -63,32 +87,22 @@ SharedMemory::SharedMemory(size_t key_, VCodecType codec_):
         return;
     }
 
-    if ((sharedMemoryId = shmget(key_, SHMSIZE, (IPC_EXCL | IPC_CREAT ) | 0666)) == (size_t)-1) {
-        utils::errorMsg("SharedMemory::shmget error - filter not created - "
-                "might be already created (Key:" + std::to_string(key_) +
-                " Codec: " + utils::getVideoCodecAsString(codec_) + ")");
+    if (slots_ == 1 || slots_ > SHM_RING_MAX_SLOTS) {
+        utils::errorMsg("SharedMemory::error - filter not created - "
+                "ring slots must be from 2 to " + std::to_string(SHM_RING_MAX_SLOTS));
         enabled = false;
         return;
     }
 
-    if ((SharedMemoryOrigin = (uint8_t*) shmat(sharedMemoryId, NULL, 0)) == (uint8_t *) -1) {
-        utils::errorMsg("SharedMemory::shmat error - filter not created");
-        enabled = false;
-        return;
+    if (backend == SHM_POSIX && shmName[0] != '/') {
+        shmName = "/" + shmName;
     }
 
-    if(enabled){
-        utils::infoMsg("VERY IMPORTANT: Share following shared memory ID (from key "+ std::to_string(key_)+") with reader process: \033[1;32m"+ std::to_string(sharedMemoryId) + "\033[0m for \033[1;32m" + utils::getVideoCodecAsString(codec) + "\033[0m codec");
-
-        memset(SharedMemoryOrigin,0,SHMSIZE);
-
-        access = SharedMemoryOrigin;
-        buffer = SharedMemoryOrigin + HEADER_SIZE;
-        sharedMemoryKey = key_;
-
-        //init sync
-        *access = CHAR_WRITING;
+    memset(&pending, 0, sizeof(pending));
+    sharedMemoryKey = key_;
+    enabled = createSegment(key_, slots_);
 
+    if(enabled){
         //TODO get seqNum from incoming frame
         seqNum = 1;
     }
@@ -102,17 +116,179 @@ SharedMemory::SharedMemory(size_t key_, VCodecType codec_):
 
 SharedMemory::~SharedMemory()
 {
+    destroySegment();
+}
+
+bool SharedMemory::createSegment(size_t key_, unsigned slots_)
+{
+    size_t size = slots_ > 0 ? ShmRingWriter::segmentSize(slots_, MAX_SIZE) : SHMSIZE;
+
+    if (backend != SHM_SYSV) {
+        if (backend == SHM_POSIX) {
+            shmFd = shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+        } else {
+            shmFd = memfd_create(shmName.c_str(), MFD_CLOEXEC);
+        }
+
+        if (shmFd < 0) {
+            utils::errorMsg("SharedMemory::open error - filter not created - "
+                    "might be already created (Name: " + shmName + " Error: " + strerror(errno) + ")");
+            return false;
+        }
+
+        //NOTE: the ring is mapped once the first frame tells its size
+        slots = slots_;
+        utils::infoMsg("VERY IMPORTANT: Share following shared memory path with reader process: \033[1;32m" + getSegmentPath() + "\033[0m for \033[1;32m" + utils::getVideoCodecAsString(codec) + "\033[0m codec");
+        return true;
+    }
+
+    if ((sharedMemoryId = shmget(key_, size, (IPC_EXCL | IPC_CREAT ) | 0666)) == (unsigned)-1) {
+        utils::errorMsg("SharedMemory::shmget error - filter not created - "
+                "might be already created (Key:" + std::to_string(key_) +
+                " Codec: " + utils::getVideoCodecAsString(codec) + ")");
+        return false;
+    }
+
+    if ((SharedMemoryOrigin = (uint8_t*) shmat(sharedMemoryId, NULL, 0)) == (uint8_t *) -1) {
+        utils::errorMsg("SharedMemory::shmat error - filter not created");
+        SharedMemoryOrigin = NULL;
+        shmctl(sharedMemoryId, IPC_RMID, 0);
+        return false;
+    }
+
+    utils::infoMsg("VERY IMPORTANT: Share following shared memory ID (from key "+ std::to_string(key_)+") with reader process: \033[1;32m"+ std::to_string(sharedMemoryId) + "\033[0m for \033[1;32m" + utils::getVideoCodecAsString(codec) + "\033[0m codec");
+
+    slots = slots_;
+    access = SharedMemoryOrigin;
+    mappedSize = size;
+
+    if (slots > 0) {
+        //NOTE: shmat returns page aligned addresses, as the ring layout requires
+        ring = new ShmRingWriter(SharedMemoryOrigin, slots, MAX_SIZE);
+        buffer = NULL;
+        return true;
+    }
+
+    memset(SharedMemoryOrigin,0,SHMSIZE);
+    buffer = SharedMemoryOrigin + HEADER_SIZE;
+
+    //init sync
+    *access = CHAR_WRITING;
+
+    return true;
+}
+
+bool SharedMemory::mapRing(unsigned frameSize, bool reformat)
+{
+    unsigned maxFrameSize;
+    size_t size;
+    uint8_t *origin;
+
+    if (ring && !reformat && frameSize <= ring->getMaxFrameSize()) {
+        return true;
+    }
+
+    if (backend == SHM_SYSV) {
+        utils::errorMsg("SharedMemory::error - frame larger than the SysV ring slots, use a named segment");
+        return false;
+    }
+
+    maxFrameSize = std::max(frameSize, ring ? ring->getMaxFrameSize() : 0);
+    maxFrameSize = (maxFrameSize + SHM_RING_FRAME_ROUND - 1) / SHM_RING_FRAME_ROUND * SHM_RING_FRAME_ROUND;
+
+    if (ring) {
+        ring->close();
+        delete ring;
+        ring = NULL;
+    }
+
+    //NOTE: segments only grow, so the mappings of readers reading the closed ring stay valid
+    size = std::max(ShmRingWriter::segmentSize(slots, maxFrameSize), mappedSize);
+
+    if (size > mappedSize && ftruncate(shmFd, size) != 0) {
+        utils::errorMsg("SharedMemory::ftruncate error - could not resize the segment to " + std::to_string(size) + " bytes");
+        return false;
+    }
+
+    if (SharedMemoryOrigin) {
+        munmap(SharedMemoryOrigin, mappedSize);
+        SharedMemoryOrigin = NULL;
+    }
+
+    if ((origin = (uint8_t*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0)) == MAP_FAILED) {
+        utils::errorMsg("SharedMemory::mmap error - could not map the segment");
+        mappedSize = 0;
+        return false;
+    }
+
+    SharedMemoryOrigin = origin;
+    access = SharedMemoryOrigin;
+    mappedSize = size;
+    ring = new ShmRingWriter(SharedMemoryOrigin, slots, maxFrameSize, ++generation);
+
+    return true;
+}
+
+void SharedMemory::destroySegment()
+{
+    if (ring) {
+        ring->close();
+    }
+
+    delete ring;
+    ring = NULL;
+
+    if (backend != SHM_SYSV) {
+        if (SharedMemoryOrigin) {
+            munmap(SharedMemoryOrigin, mappedSize);
+            SharedMemoryOrigin = NULL;
+        }
+        if (shmFd >= 0) {
+            close(shmFd);
+            shmFd = -1;
+        }
+        if (backend == SHM_POSIX && enabled && shm_unlink(shmName.c_str()) != 0) {
+            utils::errorMsg("SharedMemory::shm_unlink error - Could not remove " + shmName);
+        }
+        mappedSize = 0;
+        return;
+    }
+
+    if (!SharedMemoryOrigin) {
+        return;
+    }
+
     if(shmctl (sharedMemoryId , IPC_RMID , 0) != 0){
         utils::errorMsg("SharedMemory::shmctl error - Could not set IPC_RMID flag to shared memory segment ID");
     }
     if(shmdt(SharedMemoryOrigin) != 0){
         utils::errorMsg("SharedMemory::shmdt error - Could not detach memory segment");
     }
+    SharedMemoryOrigin = NULL;
+}
+
+std::string SharedMemory::getSegmentPath()
+{
+    switch (backend) {
+        case SHM_POSIX:
+            return "/dev/shm" + shmName;
+        case SHM_MEMFD:
+            return "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(shmFd);
+        default:
+            return "";
+    }
 }
 
-bool SharedMemory::doProcessFrame(Frame *org, Frame *dst)
+bool SharedMemory::doProcessFrame(VideoFrame *vframe, VideoFrame *dst)
 {
-    InterleavedVideoFrame* vframe = dynamic_cast<InterleavedVideoFrame*>(org);
+    //NOTE: single frame readers expect packed pictures, coded NAL units may point to a slice store.
+    //      Ring slots describe their planes, which are packed when copying planar pictures
+    if (!dynamic_cast<InterleavedVideoFrame*>(dst) ||
+        (vframe->isPlanar() ? slots == 0 || vframe->getCodec() != RAW : !vframe->getDataBuf())) {
+        utils::errorMsg("Only interleaved frames are shareable");
+        return false;
+    }
+    
     copyOrgToDstFrame(vframe,dynamic_cast<InterleavedVideoFrame*>(dst));
 
     if(!isWritable()){
@@ -138,7 +314,7 @@ bool SharedMemory::doProcessFrame(Frame *org, Frame *dst)
             break;
         case RAW:
             writeFramePayload(vframe);
-            writeSharedMemoryRAW(vframe->getDataBuf(), vframe->getLength());
+            writeSharedMemoryRAW(dst->getDataBuf(), dst->getLength());
             break;
         default:
             utils::errorMsg("Only RAW and H264 frames are shareable");
@@ -159,7 +335,45 @@ FrameQueue* SharedMemory::allocQueue(ConnectionData cData)
 
 void SharedMemory::initializeEventMap()
 {
+    eventMap["setRing"] = std::bind(&SharedMemory::setRingEvent, this, std::placeholders::_1);
+}
+
+bool SharedMemory::setRingEvent(Jzon::Node* params)
+{
+    unsigned newSlots;
+
+    if (!params || !params->Has("slots")) {
+        return false;
+    }
+
+    newSlots = params->Get("slots").ToInt();
+
+    if (backend != SHM_SYSV && newSlots == 0) {
+        utils::errorMsg("SharedMemory::error - named segments only hold rings");
+        return false;
+    }
 
+    if (newSlots == 1 || newSlots > SHM_RING_MAX_SLOTS) {
+        utils::errorMsg("SharedMemory::error - ring slots must be 0 or from 2 to " + std::to_string(SHM_RING_MAX_SLOTS));
+        return false;
+    }
+
+    if (newSlots == slots) {
+        return true;
+    }
+
+    if (backend != SHM_SYSV) {
+        slots = newSlots;
+        frameData.clear();
+        return !ring || mapRing(ring->getMaxFrameSize(), true);
+    }
+
+    //NOTE: attached readers keep the removed segment until they detach, new ones get the new memory ID
+    destroySegment();
+    enabled = createSegment(sharedMemoryKey, newSlots);
+    frameData.clear();
+
+    return enabled;
 }
 
 void SharedMemory::doGetState(Jzon::Object &filterNode)
@@ -167,13 +381,27 @@ void SharedMemory::doGetState(Jzon::Object &filterNode)
     filterNode.Add("codec", utils::getVideoCodecAsString(codec));
     filterNode.Add("key", (int) sharedMemoryKey);
     filterNode.Add("memoryId", (int) sharedMemoryId);
+    filterNode.Add("layout", slots > 0 ? "ring" : "single");
+
+    if (backend != SHM_SYSV) {
+        filterNode.Add("backend", backend == SHM_POSIX ? "posix" : "memfd");
+        filterNode.Add("name", shmName);
+        filterNode.Add("path", getSegmentPath());
+        filterNode.Add("size", (int) mappedSize);
+    }
+
+    if (ring) {
+        filterNode.Add("slots", (int) ring->getSlots());
+        filterNode.Add("slotSize", (int) ring->getSlotSize());
+        filterNode.Add("generation", (int) ring->getGeneration());
+        filterNode.Add("published", (int) ring->getPublished());
+        filterNode.Add("wakeups", (int) ring->getWakeups());
+    }
 }
 
-void SharedMemory::copyOrgToDstFrame(InterleavedVideoFrame*org, InterleavedVideoFrame *dst)
+void SharedMemory::copyOrgToDstFrame(VideoFrame *org, InterleavedVideoFrame *dst)
 {
-    dst->setLength(org->getLength());
-    dst->setSize(org->getWidth(), org->getHeight());
-    dst->setPixelFormat(org->getPixelFormat());
+    dst->fitBuffer(org->getWidth(), org->getHeight(), org->getPixelFormat());
     
     dst->setConsumed(true);
     dst->setPresentationTime(org->getPresentationTime());
@@ -181,9 +409,38 @@ void SharedMemory::copyOrgToDstFrame(InterleavedVideoFrame*org, InterleavedVideo
     dst->setOriginTime(org->getOriginTime());
     dst->setSequenceNumber(org->getSequenceNumber());
 
+    InterleavedVideoFrame *interleaved = dynamic_cast<InterleavedVideoFrame*>(org);
+
+    //NOTE: strided external pictures (i.e. splitter crops) are packed as planar ones
+    if (org->isPlanar() || (interleaved && interleaved->getExternalStride() > 0)) {
+        packPlanes(org, dst);
+        return;
+    }
+
+    dst->setLength(org->getLength());
     memcpy(dst->getDataBuf(), org->getDataBuf(),org->getLength());
 }
 
+void SharedMemory::packPlanes(VideoFrame *org, InterleavedVideoFrame *dst)
+{
+    unsigned char *orgPlanes[MAX_PLANES], *dstPlanes[MAX_PLANES];
+    int orgLinesize[MAX_PLANES], dstLinesize[MAX_PLANES];
+    int lineBytes, rows;
+    unsigned length;
+
+    org->getPlanes(orgPlanes, orgLinesize);
+    length = dst->getPlanes(dstPlanes, dstLinesize);
+
+    for (unsigned i = 0; i < MAX_PLANES && orgPlanes[i] && dstPlanes[i]; i++) {
+        VideoFrame::planeSize(org->getPixelFormat(), org->getWidth(), org->getHeight(), i, lineBytes, rows);
+        for (int r = 0; r < rows; r++) {
+            memcpy(dstPlanes[i] + r*dstLinesize[i], orgPlanes[i] + r*orgLinesize[i], lineBytes);
+        }
+    }
+
+    dst->setLength(length);
+}
+
 void SharedMemory::writeSharedMemoryH264()
 {
     uint8_t* data;
@@ -198,6 +455,11 @@ void SharedMemory::writeSharedMemoryH264()
         return;
     }
 
+    if (slots > 0) {
+        writeRingData(data, dataLength);
+        return;
+    }
+
     *access = CHAR_WRITING;
     memcpy(access+20, &length, sizeof(uint32_t));
     memcpy(buffer, data, sizeof(uint8_t) * dataLength);
@@ -211,7 +473,7 @@ bool SharedMemory::parseNal(VideoFrame* nal, bool &newFrame)
     unsigned char* nalData;
     int nalDataLength;
 
-    startCodeOffset = detectStartCode(nal->getDataBuf());
+    startCodeOffset = NalSplitter::startCodeLength(nal->getDataBuf(), nal->getLength());
 
     if(startCodeOffset == 0){
         utils::errorMsg("Error parsing NAL: no start code detected");
@@ -234,20 +496,6 @@ bool SharedMemory::parseNal(VideoFrame* nal, bool &newFrame)
     return true;
 }
 
-int SharedMemory::detectStartCode(unsigned char const* ptr)
-{
-    u_int32_t bytes = 0|(ptr[0]<<16)|(ptr[1]<<8)|ptr[2];
-    if (bytes == H264_NALU_START_CODE) {
-        return SHORT_START_CODE_LENGTH;
-    }
-
-    bytes = (ptr[0]<<24)|(ptr[1]<<16)|(ptr[2]<<8)|ptr[3];
-    if (bytes == H264_NALU_START_CODE) {
-        return LONG_START_CODE_LENGTH;
-    }
-    return 0;
-}
-
 bool SharedMemory::appendNalToFrame(unsigned char* nalData, unsigned nalDataLength, int startCodeOffset, bool &newFrame)
 {
     unsigned char nalType;
@@ -288,6 +536,9 @@ bool SharedMemory::appendNalToFrame(unsigned char* nalData, unsigned nalDataLeng
 
 int SharedMemory::writeSharedMemoryRAW(uint8_t *buf, int buf_size)
 {
+    if (slots > 0) {
+        return writeRingData(buf, buf_size) ? 0 : -1;
+    }
 
     *access = CHAR_WRITING;
     memcpy(buffer, buf, sizeof(uint8_t) * buf_size);
@@ -296,7 +547,7 @@ int SharedMemory::writeSharedMemoryRAW(uint8_t *buf, int buf_size)
     return 0;
 }
 
-void SharedMemory::writeFramePayload(InterleavedVideoFrame *frame) 
+void SharedMemory::writeFramePayload(VideoFrame *frame) 
 {
     uint32_t tv_sec = frame->getPresentationTime().count()/std::micro::den;
     uint32_t tv_usec = frame->getPresentationTime().count()%std::micro::den;
@@ -307,6 +558,31 @@ void SharedMemory::writeFramePayload(InterleavedVideoFrame *frame)
     uint16_t pixFmt = getPixelFormatFromPixType(frame->getPixelFormat());
     uint16_t seqN = frame->getSequenceNumber();
 
+    int lineBytes, rows;
+    uint32_t offset = 0;
+
+    if (slots > 0) {
+        memset(&pending, 0, sizeof(pending));
+        pending.tv_sec = tv_sec;
+        pending.tv_usec = tv_usec;
+        pending.width = width;
+        pending.height = height;
+        pending.length = length;
+        pending.codec = codec;
+        pending.pixFmt = pixFmt;
+        pending.seqNum = seqN;
+
+        //NOTE: ring pictures are the packed ones of the output frame
+        for (unsigned i = 0; frame->getCodec() == RAW && i < SHM_RING_MAX_PLANES &&
+             VideoFrame::planeSize(frame->getPixelFormat(), width, height, i, lineBytes, rows); i++) {
+            pending.offset[i] = offset;
+            pending.stride[i] = lineBytes;
+            pending.planes = i + 1;
+            offset += lineBytes*rows;
+        }
+        return;
+    }
+
     memcpy(access+2, &seqN, sizeof(uint16_t));
     memcpy(access+4, &pixFmt, sizeof(uint16_t));
     memcpy(access+6, &codec, sizeof(uint16_t));
@@ -317,8 +593,29 @@ void SharedMemory::writeFramePayload(InterleavedVideoFrame *frame)
     memcpy(access+20, &length, sizeof(uint32_t));
 }
 
+bool SharedMemory::writeRingData(uint8_t *data, unsigned length)
+{
+    ShmSlotHeader *slot;
+    size_t fields = offsetof(ShmSlotHeader, tv_sec);
+
+    if (!mapRing(length)) {
+        utils::errorMsg("SharedMemory::error - frame does not fit the ring slots, dropping it");
+        return false;
+    }
+
+    slot = ring->beginWrite();
+    memcpy((uint8_t*) slot + fields, (uint8_t*) &pending + fields, sizeof(ShmSlotHeader) - fields);
+    slot->length = length;
+
+    memcpy(ring->getData(), data, length);
+    ring->publish();
+
+    return true;
+}
+
 bool SharedMemory::isWritable() {
-    return *access == CHAR_WRITING;
+    //NOTE: ring writes never wait for the readers
+    return slots > 0 || *access == CHAR_WRITING;
 }
 
 uint16_t SharedMemory::getCodecFromVCodec(VCodecType codec){
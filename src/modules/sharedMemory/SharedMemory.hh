@@ -37,6 +37,8 @@
 #include "../../VideoFrame.hh"
 #include "../../AVFramedQueue.hh"
 #include "../../StreamInfo.hh"
+#include "../../NalSplitter.hh"
+#include "SharedMemoryRing.hh"
 
 #define SHMSIZE         6220824 //1920x1080x3 + 24
 #define HEADER_SIZE	24	//4B * 6 (sync.byte and frame info)
@@ -50,33 +52,54 @@
 #define SPS             7
 #define PPS             8
 #define AUD             9
-#define H264_NALU_START_CODE 0x00000001
-#define SHORT_START_CODE_LENGTH 3
-#define LONG_START_CODE_LENGTH 4
 #define H264_NALU_TYPE_MASK 0x1F
+#define SHM_RING_FRAME_ROUND 65536  //!< Slot data sizes from the stream are rounded up to this many bytes
+
+/*! Kind of segment shared by a SharedMemory filter */
+enum ShmBackend {
+    SHM_SYSV,       //!< SysV segment from a numeric key, its size is fixed
+    SHM_POSIX,      //!< shm_open named segment, sized from the stream
+    SHM_MEMFD       //!< memfd_create anonymous segment, readers open /proc/<pid>/fd/<fd>, sized from the stream
+};
 
 /*! OneToOneFilter sharing memory with another process. This filter uses shm
 library, a POSIX shared memory library to share specific address spaces between
-different processes.
+different processes. SysV segments hold a single frame or, optionally, a ShmRingWriter
+ring of fixed size slots. Named POSIX and memfd segments always hold a ring, which is
+sized from the incoming frames and formatted again when a larger frame arrives, so any
+resolution and several filters per host are supported.
 */
-class SharedMemory : public OneToOneFilter {
+class SharedMemory : public OneToOneFilterT<VideoFrame, VideoFrame> {
 
 public:
     /**
     * Creates new shared memory object
     * @param key_ value for defining the piece of address to share
     * @param VCodecType codec value defined in order to correlate type of shared frames with its shared memory space
+    * @param slots number of frame slots of a ShmRingWriter layout, 0 for the single frame layout
     * @return SharedMemory object or NULL if any error while creating
     * @see OneToOneFilter to check the inherated input params
     */
-    static SharedMemory* createNew(size_t key_, VCodecType codec);
+    static SharedMemory* createNew(size_t key_, VCodecType codec, unsigned slots = 0);
     /**
     * Creates new shared memory object with a random key
     * @param VCodecType codec value defined in order to correlate type of shared frames with its shared memory space
+    * @param slots number of frame slots of a ShmRingWriter layout, 0 for the single frame layout
     * @return SharedMemory object or NULL if any error while creating
     * @see OneToOneFilter to check the inherated input params
     */
-    static SharedMemory* createNew(VCodecType codec = RAW);
+    static SharedMemory* createNew(VCodecType codec = RAW, unsigned slots = 0);
+    /**
+    * Creates new shared memory object with a ring sized from the stream
+    * @param name segment name, a leading slash is added for shm_open if missing
+    * @param VCodecType codec value defined in order to correlate type of shared frames with its shared memory space
+    * @param backend SHM_POSIX or SHM_MEMFD
+    * @param slots number of frame slots of the ring
+    * @return SharedMemory object or NULL if any error while creating
+    * @see OneToOneFilter to check the inherated input params
+    */
+    static SharedMemory* createNew(std::string name, VCodecType codec, ShmBackend backend = SHM_POSIX,
+                                   unsigned slots = SHM_RING_DEFAULT_SLOTS);
     /**
     * Class destructor
     */
@@ -87,15 +110,24 @@ public:
     */
     size_t getSharedMemoryID() { return sharedMemoryId;};
 
+    /**
+    * Codes of the codec and pixel format fields of the shared frame headers
+    */
+    static uint16_t getCodecFromVCodec(VCodecType codec);
+    static uint16_t getPixelFormatFromPixType(PixType pxlFrmt);
+    static PixType getPixTypeFromPixelFormat(uint16_t pixType);
+    static VCodecType getVCodecFromCodecType(uint16_t codecType);
+
 protected:
-    SharedMemory(size_t key_, VCodecType codec_);
+    SharedMemory(size_t key_, VCodecType codec_, unsigned slots_ = 0,
+                 ShmBackend backend_ = SHM_SYSV, std::string name_ = "");
     bool isEnabled() {return enabled;};
     void writeSharedMemoryH264();
     bool appendNalToFrame(unsigned char* nalData, unsigned nalDataLength, int startCodeOffset, bool &newFrame);
     bool parseNal(VideoFrame* nal, bool &newFrame);
-    int detectStartCode(unsigned char const* ptr);
     int writeSharedMemoryRAW(uint8_t *buffer, int buffer_size);
-    void writeFramePayload(InterleavedVideoFrame *frame);
+    void writeFramePayload(VideoFrame *frame);
+    bool writeRingData(uint8_t *data, unsigned length);
     bool isWritable();
     uint16_t getSeqNum() { return seqNum;};
     void setSeqNum(uint16_t seqNum_) { seqNum = seqNum_;};
@@ -103,12 +135,18 @@ protected:
     void setNewFrame(bool newFrame_) { newFrame = newFrame_;};
 
 private:
-    bool doProcessFrame(Frame *org, Frame *dst);
+    bool doProcessFrame(VideoFrame *vframe, VideoFrame *dst);
     void initializeEventMap();
+    bool setRingEvent(Jzon::Node* params);
+    bool createSegment(size_t key_, unsigned slots_);
+    void destroySegment();
+    bool mapRing(unsigned frameSize, bool reformat = false);
+    std::string getSegmentPath();
     void doGetState(Jzon::Object &filterNode);
     FrameQueue* allocQueue(ConnectionData cData);
 
-    void copyOrgToDstFrame(InterleavedVideoFrame *org, InterleavedVideoFrame *dst);
+    void copyOrgToDstFrame(VideoFrame *org, InterleavedVideoFrame *dst);
+    void packPlanes(VideoFrame *org, InterleavedVideoFrame *dst);
     
     //There is no need of specific reader configuration
     bool specificReaderConfig(int readerID, FrameQueue* queue);
@@ -118,11 +156,6 @@ private:
     bool specificWriterConfig(int /*writerID*/) {return true;};
     bool specificWriterDelete(int /*writerID*/) {return true;};
 
-    uint16_t getCodecFromVCodec(VCodecType codec);
-    uint16_t getPixelFormatFromPixType(PixType pxlFrmt);
-    PixType getPixTypeFromPixelFormat(uint16_t pixType);
-    VCodecType getVCodecFromCodecType(uint16_t codecType);
-
     // Cached copy of input stream info, used to configure output queue.
     // It is not ours, hence the 'const' pointer.
     const StreamInfo *streamInfo;
@@ -139,6 +172,14 @@ private:
     std::vector<unsigned char>    frameData;
     VCodecType const              codec;
     uint16_t                      seqNum;
+    unsigned                      slots;        //!< 0 for the single frame layout
+    ShmRingWriter                 *ring;
+    ShmSlotHeader                 pending;      //!< Frame info of the next ring frame
+    ShmBackend const              backend;
+    std::string                   shmName;
+    int                           shmFd;
+    size_t                        mappedSize;
+    uint32_t                      generation;
 };
 
 #endif
@@ -0,0 +1,350 @@
+/*
+ *  SharedMemoryIngest - Frames written by other processes through shm
+ *  Copyright (C) 2013  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:    Gerard Castillo <gerard.castillo@i2cat.net>
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "SharedMemoryIngest.hh"
+#include "SharedMemory.hh"
+#include "../../AVFramedQueue.hh"
+#include "../../Utils.hh"
+
+SharedMemoryIngest* SharedMemoryIngest::createNew(VCodecType codec)
+{
+    if (codec != RAW && codec != H264) {
+        utils::errorMsg("SharedMemoryIngest::error - only RAW and H264 codecs are supported (requested " +
+                utils::getVideoCodecAsString(codec) + ")");
+        return NULL;
+    }
+
+    return new SharedMemoryIngest(codec);
+}
+
+SharedMemoryIngest::SharedMemoryIngest(VCodecType codec_) : HeadFilter(1, REGULAR, true), codec(codec_),
+    fd(-1), shmId(-1), segment(NULL), segmentSize(0), reader(NULL), frames(0), dropped(0), remaps(0)
+{
+    oStreamInfo = new StreamInfo(VIDEO);
+    oStreamInfo->video.codec = codec;
+    oStreamInfo->video.pixelFormat = P_NONE;
+    oStreamInfo->setCodecDefaults();
+
+    //NOTE: ring frames hold whole access units
+    if (codec == H264) {
+        oStreamInfo->video.h264or5.framed = false;
+    }
+
+    fType = SHARED_MEMORY_INGEST;
+
+    initializeEventMap();
+}
+
+SharedMemoryIngest::~SharedMemoryIngest()
+{
+    detach();
+    delete oStreamInfo;
+}
+
+bool SharedMemoryIngest::attach(std::string path_)
+{
+    detach();
+
+    if (path_.size() > 1 && path_[0] == '/' && path_.find('/', 1) == std::string::npos) {
+        fd = shm_open(path_.c_str(), O_RDWR, 0);
+    } else {
+        fd = open(path_.c_str(), O_RDWR);
+    }
+
+    if (fd < 0) {
+        utils::errorMsg("SharedMemoryIngest::open error - could not open " + path_ + " (" + strerror(errno) + ")");
+        return false;
+    }
+
+    path = path_;
+
+    //NOTE: writers sizing the segment from the stream leave it empty until their first frame
+    mapSegment();
+
+    return true;
+}
+
+bool SharedMemoryIngest::attach(int shmId_)
+{
+    struct shmid_ds ds;
+
+    detach();
+
+    if ((segment = (uint8_t*) shmat(shmId_, NULL, 0)) == (uint8_t*) -1) {
+        utils::errorMsg("SharedMemoryIngest::shmat error - could not attach to ID " + std::to_string(shmId_));
+        segment = NULL;
+        return false;
+    }
+
+    shmId = shmId_;
+    segmentSize = shmctl(shmId, IPC_STAT, &ds) == 0 ? ds.shm_segsz : 0;
+    mapSegment();
+
+    return true;
+}
+
+void SharedMemoryIngest::detach()
+{
+    unmapSegment();
+
+    if (shmId >= 0 && segment) {
+        shmdt(segment);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    segment = NULL;
+    segmentSize = 0;
+    fd = -1;
+    shmId = -1;
+    path.clear();
+}
+
+bool SharedMemoryIngest::mapSegment()
+{
+    struct stat st;
+    ShmSlotHeader info;
+
+    if (reader && reader->isValid()) {
+        return true;
+    }
+
+    delete reader;
+    reader = NULL;
+
+    if (fd >= 0) {
+        if (fstat(fd, &st) != 0 || (size_t) st.st_size < SHM_RING_ALIGNMENT) {
+            return false;
+        }
+
+        if (segment && (size_t) st.st_size != segmentSize) {
+            unmapSegment();
+        }
+
+        if (!segment) {
+            if ((segment = (uint8_t*) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+                utils::errorMsg("SharedMemoryIngest::mmap error - could not map " + path);
+                segment = NULL;
+                return false;
+            }
+            segmentSize = st.st_size;
+        }
+    }
+
+    if (!segment) {
+        return false;
+    }
+
+    reader = new ShmRingReader(segment);
+
+    //NOTE: a ring formatted after the segment size was checked may not fit the mapping yet
+    if (!reader->isValid() || SHM_RING_ALIGNMENT + (size_t) reader->getSlots() * reader->getSlotSize() > segmentSize) {
+        delete reader;
+        reader = NULL;
+        return false;
+    }
+
+    remaps++;
+
+    if (codec == RAW && reader->latest(info)) {
+        oStreamInfo->video.pixelFormat = SharedMemory::getPixTypeFromPixelFormat(info.pixFmt);
+    }
+
+    return true;
+}
+
+void SharedMemoryIngest::unmapSegment()
+{
+    delete reader;
+    reader = NULL;
+
+    //NOTE: SysV segments keep their attachment, their size is fixed
+    if (fd >= 0 && segment) {
+        munmap(segment, segmentSize);
+        segment = NULL;
+        segmentSize = 0;
+    }
+}
+
+bool SharedMemoryIngest::doProcessFrame(FrameMap &dstFrames, int& ret)
+{
+    VideoFrame* frame = dynamic_cast<VideoFrame*> (dstFrames.begin()->second);
+    ShmSlotHeader info;
+    const uint8_t* data;
+    std::chrono::microseconds pts;
+
+    if (!frame || !mapSegment()) {
+        ret = SHM_INGEST_RETRY;
+        return false;
+    }
+
+    //NOTE: a closed ring is mapped again at the next call
+    ret = 0;
+    frame->setConsumed(false);
+
+    if (!(data = reader->acquire(info, SHM_INGEST_WAIT))) {
+        return false;
+    }
+
+    if (!copyFrame(data, info, frame) || !reader->release()) {
+        dropped++;
+        return false;
+    }
+
+    pts = std::chrono::microseconds((int64_t) info.tv_sec*std::micro::den + info.tv_usec);
+    if (pts.count() == 0) {
+        pts = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now().time_since_epoch());
+    }
+
+    frame->setPresentationTime(pts);
+    frame->setDecodeTime(pts);
+    frame->setConsumed(true);
+    frames++;
+
+    return true;
+}
+
+bool SharedMemoryIngest::copyFrame(const uint8_t* data, ShmSlotHeader& info, VideoFrame* frame)
+{
+    unsigned char* planes[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int lineBytes, rows;
+    unsigned length;
+    PixType pixFmt;
+
+    if (info.codec != SharedMemory::getCodecFromVCodec(codec)) {
+        return false;
+    }
+
+    if (codec == H264) {
+        if (info.length > frame->getMaxLength()) {
+            utils::warningMsg("SharedMemoryIngest - access unit larger than the frame buffer, dropping it");
+            return false;
+        }
+
+        memcpy(frame->getDataBuf(), data, info.length);
+        frame->setLength(info.length);
+        return true;
+    }
+
+    if ((pixFmt = SharedMemory::getPixTypeFromPixelFormat(info.pixFmt)) == P_NONE) {
+        return false;
+    }
+
+    oStreamInfo->video.pixelFormat = pixFmt;
+    frame->fitBuffer(info.width, info.height, pixFmt);
+
+    if (!(length = frame->getPlanes(planes, linesize))) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < MAX_PLANES && planes[i]; i++) {
+        VideoFrame::planeSize(pixFmt, info.width, info.height, i, lineBytes, rows);
+
+        if (i >= info.planes || (int) info.stride[i] < lineBytes ||
+            info.offset[i] + (size_t) (rows - 1)*info.stride[i] + lineBytes > info.length) {
+            return false;
+        }
+
+        //NOTE: packed planes are copied at once, padded ones line by line
+        if ((int) info.stride[i] == lineBytes && linesize[i] == lineBytes) {
+            memcpy(planes[i], data + info.offset[i], lineBytes*rows);
+            continue;
+        }
+
+        for (int r = 0; r < rows; r++) {
+            memcpy(planes[i] + r*linesize[i], data + info.offset[i] + r*info.stride[i], lineBytes);
+        }
+    }
+
+    if (!frame->isPlanar()) {
+        frame->setLength(length);
+    }
+
+    return true;
+}
+
+FrameQueue* SharedMemoryIngest::allocQueue(ConnectionData cData)
+{
+    if (codec == H264) {
+        return VideoFrameQueue::createNew(cData, oStreamInfo, DEFAULT_VIDEO_FRAMES);
+    }
+
+    mapSegment();
+
+    if (oStreamInfo->video.pixelFormat == P_NONE) {
+        utils::warningMsg("SharedMemoryIngest - no frame shared yet, the pixel format is unknown. No possible connection");
+        return NULL;
+    }
+
+    return VideoFrameQueue::createNew(cData, oStreamInfo, DEFAULT_RAW_VIDEO_FRAMES);
+}
+
+void SharedMemoryIngest::initializeEventMap()
+{
+    eventMap["attach"] = std::bind(&SharedMemoryIngest::attachEvent, this, std::placeholders::_1);
+}
+
+bool SharedMemoryIngest::attachEvent(Jzon::Node* params)
+{
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("name")) {
+        return attach(params->Get("name").ToString());
+    }
+
+    if (params->Has("path")) {
+        return attach(params->Get("path").ToString());
+    }
+
+    if (params->Has("id") && params->Get("id").IsNumber()) {
+        return attach(params->Get("id").ToInt());
+    }
+
+    detach();
+    return true;
+}
+
+void SharedMemoryIngest::doGetState(Jzon::Object &filterNode)
+{
+    filterNode.Add("codec", utils::getVideoCodecAsString(codec));
+    filterNode.Add("path", path);
+    filterNode.Add("memoryId", shmId);
+    filterNode.Add("attached", reader && reader->isValid());
+    filterNode.Add("frames", (int) frames);
+    filterNode.Add("dropped", (int) dropped);
+    filterNode.Add("skipped", reader ? (int) reader->getSkipped() : 0);
+    filterNode.Add("remaps", (int) remaps);
+}
@@ -0,0 +1,110 @@
+/*
+ *  SharedMemoryIngest - Frames written by other processes through shm
+ *  Copyright (C) 2013  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:    Gerard Castillo <gerard.castillo@i2cat.net>
+ */
+
+#ifndef _SHARED_MEMORY_INGEST_HH
+#define _SHARED_MEMORY_INGEST_HH
+
+#include <string>
+
+#include "../../Filter.hh"
+#include "../../VideoFrame.hh"
+#include "../../StreamInfo.hh"
+#include "SharedMemoryRing.hh"
+
+#define SHM_INGEST_WAIT     10          //!< Longest wait for a frame in msec, the worker is blocked meanwhile
+#define SHM_INGEST_RETRY    100000      //!< Wait in usec before attaching again to a missing or closed ring
+
+/*! HeadFilter injecting into the pipeline the frames that another process writes in a ShmRingWriter
+    ring, raw pictures or H.264 access units with start codes. It attaches to a named POSIX segment,
+    to a file path such as /proc/<pid>/fd/<fd> for memfd segments, or to a SysV segment ID, and maps
+    it again when the writer resizes it. Frames are copied once, straight from the ring slot to the
+    output frame, and dropped if the writer overwrites them meanwhile.
+*/
+class SharedMemoryIngest : public HeadFilter {
+
+public:
+    /**
+    * Creates new shared memory ingest filter, not attached to any segment
+    * @param codec RAW or H264, frames of other codecs are dropped
+    * @return SharedMemoryIngest object or NULL if the codec is not supported
+    */
+    static SharedMemoryIngest* createNew(VCodecType codec = RAW);
+
+    /**
+    * Class destructor
+    */
+    ~SharedMemoryIngest();
+
+    /**
+    * Attaches to a POSIX or memfd segment. Empty segments are mapped once the writer sizes them
+    * @param path shm_open name, starting by a slash and with no other one, or a file path
+    * @return false if the segment cannot be opened
+    */
+    bool attach(std::string path);
+
+    /**
+    * Attaches to a SysV segment
+    * @param shmId shared memory ID given by the writer
+    * @return false if the segment cannot be attached
+    */
+    bool attach(int shmId);
+
+    /**
+    * Stops reading from the segment
+    */
+    void detach();
+
+protected:
+    SharedMemoryIngest(VCodecType codec);
+
+private:
+    bool doProcessFrame(FrameMap &dstFrames, int& ret);
+    FrameQueue *allocQueue(ConnectionData cData);
+
+    void doGetState(Jzon::Object &filterNode);
+    void initializeEventMap();
+    bool attachEvent(Jzon::Node* params);
+
+    //NOTE: There is no need of specific writer configuration
+    bool specificWriterConfig(int /*writerID*/) {return true;};
+    bool specificWriterDelete(int /*writerID*/) {return true;};
+
+    bool mapSegment();
+    void unmapSegment();
+    bool copyFrame(const uint8_t* data, ShmSlotHeader& info, VideoFrame* frame);
+
+    VCodecType const codec;
+    StreamInfo* oStreamInfo;
+
+    std::string path;
+    int fd;
+    int shmId;
+    uint8_t* segment;
+    size_t segmentSize;
+    ShmRingReader* reader;
+
+    size_t frames;
+    size_t dropped;
+    size_t remaps;
+};
+
+#endif
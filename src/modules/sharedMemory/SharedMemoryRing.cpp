@@ -0,0 +1,353 @@
+/*
+ *  SharedMemoryRing - Multi-slot frame ring in a shared memory segment
+ *  Copyright (C) 2013  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:    Gerard Castillo <gerard.castillo@i2cat.net>
+ */
+
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <algorithm>
+
+#include "SharedMemoryRing.hh"
+
+#define ALIGN(size) (((size) + SHM_RING_ALIGNMENT - 1) & ~((size_t) SHM_RING_ALIGNMENT - 1))
+
+//NOTE: FUTEX_PRIVATE_FLAG cannot be used, the futex word is shared with other processes
+static long futex(uint32_t* word, int op, uint32_t value, const struct timespec* timeout)
+{
+    return syscall(SYS_futex, word, op, value, timeout, NULL, 0);
+}
+
+///////////////////////////////////////////////////
+//                ShmRingWriter                  //
+///////////////////////////////////////////////////
+
+size_t ShmRingWriter::segmentSize(unsigned slots, unsigned maxFrameSize)
+{
+    return ALIGN(sizeof(ShmRingHeader)) + slots * (SHM_RING_ALIGNMENT + ALIGN(maxFrameSize));
+}
+
+static_assert(sizeof(ShmSlotHeader) <= SHM_RING_ALIGNMENT, "slot header must fit before the frame data");
+
+ShmRingWriter::ShmRingWriter(uint8_t* segment_, unsigned slots, unsigned maxFrameSize_, uint32_t generation) :
+    header((ShmRingHeader*) segment_), segment(segment_), maxFrameSize(maxFrameSize_), writing(NULL), wakeups(0)
+{
+    memset(segment, 0, segmentSize(slots, maxFrameSize));
+
+    header->version = SHM_RING_VERSION;
+    header->slots = slots;
+    header->slotSize = SHM_RING_ALIGNMENT + ALIGN(maxFrameSize);
+    header->generation = generation;
+
+    //NOTE: readers seeing the magic number see the whole layout
+    __atomic_store_n(&header->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+}
+
+ShmSlotHeader* ShmRingWriter::slot(uint64_t frame)
+{
+    return (ShmSlotHeader*) (segment + ALIGN(sizeof(ShmRingHeader)) + ((frame - 1) % header->slots) * header->slotSize);
+}
+
+ShmSlotHeader* ShmRingWriter::beginWrite()
+{
+    uint64_t frame = header->published + 1;
+
+    writing = slot(frame);
+    __atomic_store_n(&writing->sequence, 2*frame - 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return writing;
+}
+
+uint8_t* ShmRingWriter::getData()
+{
+    return writing ? (uint8_t*) writing + SHM_RING_ALIGNMENT : NULL;
+}
+
+void ShmRingWriter::publish()
+{
+    uint64_t frame = header->published + 1;
+
+    if (!writing) {
+        return;
+    }
+
+    __atomic_store_n(&writing->sequence, 2*frame, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->published, frame, __ATOMIC_RELEASE);
+    writing = NULL;
+
+    //NOTE: the futex increment is ordered before the waiters load, as the readers registering
+    //      as waiters are ordered before checking the published frames again
+    __atomic_add_fetch(&header->futex, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&header->waiters, __ATOMIC_SEQ_CST) > 0) {
+        futex(&header->futex, FUTEX_WAKE, INT_MAX, NULL);
+        wakeups++;
+    }
+}
+
+void ShmRingWriter::cancel()
+{
+    uint64_t frame = header->published + 1;
+
+    if (!writing) {
+        return;
+    }
+
+    //NOTE: no data has been written yet, the overwritten frame is still valid
+    __atomic_store_n(&writing->sequence, frame > header->slots ? 2*(frame - header->slots) : 0, __ATOMIC_RELEASE);
+    writing = NULL;
+}
+
+void ShmRingWriter::close()
+{
+    cancel();
+
+    __atomic_store_n(&header->magic, 0, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&header->futex, 1, __ATOMIC_SEQ_CST);
+    futex(&header->futex, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+///////////////////////////////////////////////////
+//                ShmRingReader                  //
+///////////////////////////////////////////////////
+
+ShmRingReader::ShmRingReader(uint8_t* segment_, bool fromStart) :
+    header((ShmRingHeader*) segment_), segment(segment_), valid(false), slots(0), slotSize(0),
+    generation(0), lastRead(0), skipped(0), acquired(NULL), acquiredFrame(0)
+{
+    uint64_t published;
+
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC ||
+        header->version != SHM_RING_VERSION || header->slots == 0) {
+        return;
+    }
+
+    //NOTE: the layout is copied, a reformatted segment may be larger than the mapped one
+    slots = header->slots;
+    slotSize = header->slotSize;
+    generation = header->generation;
+    published = __atomic_load_n(&header->published, __ATOMIC_ACQUIRE);
+
+    valid = checkLayout();
+
+    if (!fromStart) {
+        lastRead = published;
+    } else if (published > slots) {
+        lastRead = published - slots;
+    }
+}
+
+bool ShmRingReader::checkLayout()
+{
+    if (slots == 0) {
+        return false;
+    }
+
+    valid = __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == SHM_RING_MAGIC &&
+        __atomic_load_n(&header->generation, __ATOMIC_ACQUIRE) == generation;
+
+    return valid;
+}
+
+ShmSlotHeader* ShmRingReader::slot(uint64_t frame)
+{
+    return (ShmSlotHeader*) (segment + ALIGN(sizeof(ShmRingHeader)) + ((frame - 1) % slots) * slotSize);
+}
+
+bool ShmRingReader::futexWait(uint32_t futexValue, int timeout)
+{
+    struct timespec ts;
+    long ret;
+
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+
+    ret = futex(&header->futex, FUTEX_WAIT, futexValue, timeout < 0 ? NULL : &ts);
+
+    return ret == 0 || errno != ETIMEDOUT;
+}
+
+bool ShmRingReader::waitFrame(int timeout)
+{
+    std::chrono::steady_clock::time_point deadline;
+    uint32_t futexValue;
+    bool woken;
+
+    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+    while (true) {
+        if (!checkLayout()) {
+            return false;
+        }
+
+        if (__atomic_load_n(&header->published, __ATOMIC_ACQUIRE) > lastRead) {
+            return true;
+        }
+
+        if (remainingTime(deadline, timeout) == 0) {
+            return false;
+        }
+
+        futexValue = __atomic_load_n(&header->futex, __ATOMIC_ACQUIRE);
+        __atomic_add_fetch(&header->waiters, 1, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&header->published, __ATOMIC_SEQ_CST) > lastRead ||
+            __atomic_load_n(&header->magic, __ATOMIC_SEQ_CST) != SHM_RING_MAGIC) {
+            __atomic_sub_fetch(&header->waiters, 1, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        woken = futexWait(futexValue, remainingTime(deadline, timeout));
+
+        //NOTE: a segment formatted again starts with no waiters
+        if (checkLayout()) {
+            __atomic_sub_fetch(&header->waiters, 1, __ATOMIC_SEQ_CST);
+        }
+
+        if (!woken) {
+            return false;
+        }
+    }
+}
+
+int ShmRingReader::remainingTime(std::chrono::steady_clock::time_point deadline, int timeout)
+{
+    if (timeout <= 0) {
+        return timeout;
+    }
+
+    return std::max(0, (int) std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count());
+}
+
+const uint8_t* ShmRingReader::acquire(ShmSlotHeader& info, int timeout)
+{
+    std::chrono::steady_clock::time_point deadline;
+    uint64_t published, next, sequence;
+    ShmSlotHeader* current;
+
+    release();
+    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+    while (waitFrame(remainingTime(deadline, timeout))) {
+        published = __atomic_load_n(&header->published, __ATOMIC_ACQUIRE);
+        next = lastRead + 1;
+
+        if (published - next >= slots) {
+            skipped += published - slots + 1 - next;
+            next = published - slots + 1;
+            lastRead = next - 1;
+        }
+
+        current = slot(next);
+        sequence = __atomic_load_n(&current->sequence, __ATOMIC_ACQUIRE);
+
+        if (sequence == 2*next) {
+            memcpy(&info, current, sizeof(ShmSlotHeader));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(&current->sequence, __ATOMIC_RELAXED) == sequence) {
+                acquired = current;
+                acquiredFrame = next;
+                return (uint8_t*) current + SHM_RING_ALIGNMENT;
+            }
+        }
+
+        //NOTE: the writer is overwriting the slot, the next try skips to an older frame
+        sched_yield();
+    }
+
+    return NULL;
+}
+
+bool ShmRingReader::release()
+{
+    bool intact;
+
+    if (!acquired) {
+        return false;
+    }
+
+    //NOTE: the data read is only valid if the writer has not started overwriting the slot meanwhile
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    intact = __atomic_load_n(&acquired->sequence, __ATOMIC_RELAXED) == 2*acquiredFrame;
+
+    lastRead = acquiredFrame;
+    acquired = NULL;
+
+    if (!intact) {
+        skipped++;
+    }
+
+    //NOTE: a frame read while the segment was formatted again is not valid either
+    return checkLayout() && intact;
+}
+
+bool ShmRingReader::read(uint8_t* buffer, unsigned bufferSize, ShmSlotHeader& info, int timeout)
+{
+    std::chrono::steady_clock::time_point deadline;
+    const uint8_t* data;
+
+    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+    while ((data = acquire(info, remainingTime(deadline, timeout)))) {
+        if (info.length > bufferSize || info.length > slotSize - SHM_RING_ALIGNMENT) {
+            if (release()) {
+                skipped++;
+            }
+            continue;
+        }
+
+        memcpy(buffer, data, info.length);
+
+        if (release()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ShmRingReader::latest(ShmSlotHeader& info)
+{
+    uint64_t published, sequence;
+    ShmSlotHeader* current;
+
+    if (!checkLayout() || (published = __atomic_load_n(&header->published, __ATOMIC_ACQUIRE)) == 0) {
+        return false;
+    }
+
+    current = slot(published);
+    sequence = __atomic_load_n(&current->sequence, __ATOMIC_ACQUIRE);
+
+    if (sequence != 2*published) {
+        return false;
+    }
+
+    memcpy(&info, current, sizeof(ShmSlotHeader));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&current->sequence, __ATOMIC_RELAXED) == sequence;
+}
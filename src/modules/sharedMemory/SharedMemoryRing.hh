@@ -0,0 +1,221 @@
+/*
+ *  SharedMemoryRing - Multi-slot frame ring in a shared memory segment
+ *  Copyright (C) 2013  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:    Gerard Castillo <gerard.castillo@i2cat.net>
+ */
+
+#ifndef _SHARED_MEMORY_RING_HH
+#define _SHARED_MEMORY_RING_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+
+#define SHM_RING_MAGIC          0x524D534C      //!< "LSMR" in memory
+#define SHM_RING_VERSION        2
+#define SHM_RING_DEFAULT_SLOTS  4
+#define SHM_RING_MAX_SLOTS      64
+#define SHM_RING_ALIGNMENT      64              //!< Headers and slots start at cache line boundaries
+#define SHM_RING_MAX_PLANES     4
+
+/*! First bytes of a ring segment. Readers check magic and version and take the layout from it */
+struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slotSize;          //!< Bytes of a slot, its ShmSlotHeader included
+    uint32_t generation;        //!< Changes when the segment is formatted again, readers have to map it again then
+    uint32_t futex;             //!< Incremented on every published frame, readers wait on it
+    uint32_t waiters;           //!< Readers waiting on the futex, the writer only wakes them if there are any
+    uint32_t reserved;
+    uint64_t published;         //!< Published frames, frame n is in slot (n - 1) % slots
+};
+
+/*! Header of a ring slot, the frame data follows it at SHM_RING_ALIGNMENT bytes from the slot start.
+    The frame fields have the meaning and the codes of the single frame layout header. Raw pictures
+    describe their planes, which are stored one after the other without line padding */
+struct ShmSlotHeader {
+    uint64_t sequence;          //!< 2n once frame n is published in the slot, odd while it is being written
+    uint32_t tv_sec;
+    uint32_t tv_usec;
+    uint32_t length;
+    uint16_t width;
+    uint16_t height;
+    uint16_t codec;
+    uint16_t pixFmt;
+    uint16_t seqNum;
+    uint16_t planes;            //!< Picture planes, 0 for coded frames
+    uint32_t offset[SHM_RING_MAX_PLANES];   //!< Plane start from the frame data start
+    uint32_t stride[SHM_RING_MAX_PLANES];   //!< Bytes between lines of each plane
+};
+
+/*! Writer side of a ring of frame slots in a shared memory segment. Each frame goes to the next slot,
+    overwriting the oldest one, so the writer never waits for the readers. Slots are guarded by a sequence
+    number which is odd while the slot is written, so readers detect overwritten frames instead of locking
+    them. Readers are woken through a process shared futex in the ring header, the wake up system call is
+    only made when some reader is waiting. The layout only uses fixed size fields, so readers written in C
+    or in any other language can map it.
+*/
+class ShmRingWriter {
+
+public:
+    /**
+    * @param slots number of slots
+    * @param maxFrameSize largest frame size in bytes
+    * @return bytes of a segment holding the ring
+    */
+    static size_t segmentSize(unsigned slots, unsigned maxFrameSize);
+
+    /**
+    * Formats the ring in a segment
+    * @param segment segment start, aligned to SHM_RING_ALIGNMENT
+    * @param slots number of slots, from 2 to SHM_RING_MAX_SLOTS
+    * @param maxFrameSize largest frame size in bytes
+    * @param generation formatting count of the segment, see close
+    */
+    ShmRingWriter(uint8_t* segment, unsigned slots, unsigned maxFrameSize, uint32_t generation = 0);
+
+    /**
+    * Starts writing the next frame, its slot is marked as being written
+    * @return header of the slot, the frame data goes to getData
+    */
+    ShmSlotHeader* beginWrite();
+
+    /**
+    * @return data buffer of the slot being written, which holds getMaxFrameSize bytes
+    */
+    uint8_t* getData();
+
+    /**
+    * Publishes the frame being written and wakes the waiting readers
+    */
+    void publish();
+
+    /**
+    * Drops the frame being written before any data has been written to its slot
+    */
+    void cancel();
+
+    /**
+    * Invalidates the ring before the segment is resized or formatted again, readers are woken and
+    * stop reading from it
+    */
+    void close();
+
+    unsigned getSlots() const {return header->slots;};
+    unsigned getMaxFrameSize() const {return maxFrameSize;};
+    unsigned getSlotSize() const {return header->slotSize;};
+    uint32_t getGeneration() const {return header->generation;};
+    uint64_t getPublished() const {return header->published;};
+    size_t getWakeups() const {return wakeups;};
+
+private:
+    ShmSlotHeader* slot(uint64_t frame);
+
+    ShmRingHeader* header;
+    uint8_t* segment;
+    unsigned maxFrameSize;
+    ShmSlotHeader* writing;
+    size_t wakeups;
+};
+
+/*! Reader side of a ring written by ShmRingWriter, it can be used by other processes mapping the segment.
+    Frames are read in order. A reader which falls behind more than the ring slots skips to the oldest frame
+    still in the ring, which is counted as skipped, so it never slows down the writer. The layout is taken
+    when the reader is created, once the writer closes the ring the reader is no longer valid and the segment
+    has to be mapped again with its new size.
+*/
+class ShmRingReader {
+
+public:
+    /**
+    * @param segment mapped ring segment
+    * @param fromStart read the frames already in the ring instead of waiting for the next one
+    */
+    ShmRingReader(uint8_t* segment, bool fromStart = false);
+
+    /**
+    * @return false if the segment does not hold a ring of this version or the writer has closed it
+    */
+    bool isValid() const {return valid;};
+
+    /**
+    * Copies the next frame, waiting for it if it has not been published yet
+    * @param buffer destination buffer
+    * @param bufferSize destination buffer size, larger frames are skipped
+    * @param info filled with the slot header of the frame
+    * @param timeout longest wait in msec, negative to wait forever, 0 not to wait
+    * @return true if a frame has been copied, false on timeout or if the ring is no longer valid
+    */
+    bool read(uint8_t* buffer, unsigned bufferSize, ShmSlotHeader& info, int timeout = -1);
+
+    /**
+    * Waits for a frame newer than the last read one
+    * @param timeout longest wait in msec, negative to wait forever, 0 not to wait
+    * @return true if there is a frame to read, false on timeout or if the ring is no longer valid
+    */
+    bool waitFrame(int timeout);
+
+    /**
+    * Gives access to the next frame in place, waiting for it if it has not been published yet.
+    * The frame is consumed by release, which tells if the data accessed meanwhile is valid
+    * @param info filled with the slot header of the frame
+    * @param timeout longest wait in msec, negative to wait forever, 0 not to wait
+    * @return frame data in the segment, NULL on timeout or if the ring is no longer valid
+    */
+    const uint8_t* acquire(ShmSlotHeader& info, int timeout = -1);
+
+    /**
+    * Consumes the frame given by acquire
+    * @return false if the writer has overwritten it meanwhile, the data accessed has to be dropped then
+    */
+    bool release();
+
+    /**
+    * Gets the slot header of the newest published frame without consuming any frame
+    * @param info filled with the slot header
+    * @return false if no frame has been published
+    */
+    bool latest(ShmSlotHeader& info);
+
+    uint64_t getLastRead() const {return lastRead;};
+    uint32_t getGeneration() const {return generation;};
+    unsigned getSlots() const {return slots;};
+    unsigned getSlotSize() const {return slotSize;};
+    size_t getSkipped() const {return skipped;};
+
+private:
+    ShmSlotHeader* slot(uint64_t frame);
+    bool futexWait(uint32_t futexValue, int timeout);
+    int remainingTime(std::chrono::steady_clock::time_point deadline, int timeout);
+    bool checkLayout();
+
+    ShmRingHeader* header;
+    uint8_t* segment;
+    bool valid;
+    unsigned slots;
+    unsigned slotSize;
+    uint32_t generation;
+    uint64_t lastRead;
+    size_t skipped;
+    ShmSlotHeader* acquired;
+    uint64_t acquiredFrame;
+};
+
+#endif
@@ -0,0 +1,408 @@
+/*
+ *  SignalMonitor.cpp - Black, freeze and silence detection
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "SignalMonitor.hh"
+#include "../../SampleConverter.hh"
+#include "../../Utils.hh"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+//NOTE: the sampled row replaces the one of the previous picture in the same pass
+SIMD_KERNEL
+static void rowStats(unsigned char const* __restrict__ row, unsigned char* __restrict__ last, int width, int level,
+                     unsigned &sum, unsigned &dark, unsigned &diff)
+{
+    unsigned s = 0, k = 0, d = 0;
+
+    for (int x = 0; x < width; x++) {
+        int value = row[x];
+        int delta = value - last[x];
+
+        s += value;
+        k += value < level;
+        d += delta < 0 ? -delta : delta;
+        last[x] = row[x];
+    }
+
+    sum += s;
+    dark += k;
+    diff += d;
+}
+
+SIMD_REDUCTION_KERNEL
+static void sampleLevels(float const* __restrict__ samples, size_t n, float &peak, float &energy)
+{
+    float p = 0, e = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        p = simdMax(p, simdAbs(samples[i]));
+        e += samples[i]*samples[i];
+    }
+
+    peak = simdMax(peak, p);
+    energy += e;
+}
+
+static bool hasLumaPlane(PixType format)
+{
+    switch (format) {
+        case YUV420P:
+        case YUV422P:
+        case YUV444P:
+        case YUVJ420P:
+        case YUVJ422P:
+        case NV12:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static float toDb(float level)
+{
+    return level > 0 ? std::max(20*std::log10(level), (float) MONITOR_FLOOR_DB) : MONITOR_FLOOR_DB;
+}
+
+bool SignalAlarm::update(bool condition, std::chrono::microseconds ts, std::chrono::microseconds time)
+{
+    //NOTE: timestamps going back start the count again
+    if (!condition || (holding && ts < since)) {
+        holding = condition;
+        since = ts;
+
+        if (active && !condition) {
+            active = false;
+            return true;
+        }
+
+        return false;
+    }
+
+    if (!holding) {
+        holding = true;
+        since = ts;
+    }
+
+    if (!active && ts - since >= time) {
+        active = true;
+        raised++;
+        return true;
+    }
+
+    return false;
+}
+
+SignalMonitor::SignalMonitor(unsigned readersNum) :
+    TailFilter(readersNum), rows(MONITOR_DEFAULT_ROWS), blackLevel(MONITOR_DEFAULT_BLACK_LEVEL),
+    blackRatio(MONITOR_DEFAULT_BLACK_RATIO), freezeDiff(MONITOR_DEFAULT_FREEZE_DIFF),
+    silenceLevel(MONITOR_DEFAULT_SILENCE_LEVEL), blackTime(std::chrono::milliseconds(MONITOR_DEFAULT_BLACK_TIME)),
+    freezeTime(std::chrono::milliseconds(MONITOR_DEFAULT_FREEZE_TIME)),
+    silenceTime(std::chrono::milliseconds(MONITOR_DEFAULT_SILENCE_TIME))
+{
+    fType = SIGNAL_MONITOR;
+    initializeEventMap();
+}
+
+SignalMonitor::~SignalMonitor()
+{
+}
+
+const MonitorInput* SignalMonitor::getInput(int id) const
+{
+    auto it = inputs.find(id);
+
+    return it == inputs.end() ? NULL : &it->second;
+}
+
+bool SignalMonitor::specificReaderConfig(int readerId, FrameQueue* queue)
+{
+    return setupInput(readerId, queue->getStreamInfo());
+}
+
+bool SignalMonitor::specificReaderDelete(int readerId)
+{
+    inputs.erase(readerId);
+    return true;
+}
+
+bool SignalMonitor::setupInput(int id, const StreamInfo* si)
+{
+    MonitorInput input;
+
+    if (!si || (si->type == VIDEO && si->video.codec != RAW) || (si->type == AUDIO && si->audio.codec != PCM)) {
+        utils::errorMsg("[SignalMonitor] Only raw video and audio can be monitored");
+        return false;
+    }
+
+    if (si->type == VIDEO && !hasLumaPlane(si->video.pixelFormat)) {
+        utils::errorMsg("[SignalMonitor] Only pixel formats with a luma plane can be monitored");
+        return false;
+    }
+
+    input.video = si->type == VIDEO;
+    inputs[id] = input;
+
+    return true;
+}
+
+bool SignalMonitor::doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& /*ret*/)
+{
+    for (auto id : newFrames) {
+        auto it = inputs.find(id);
+        VideoFrame* vFrame;
+        AudioFrame* aFrame;
+
+        if (it == inputs.end()) {
+            continue;
+        }
+
+        if (it->second.video && (vFrame = dynamic_cast<VideoFrame*>(orgFrames[id]))) {
+            analyseVideo(id, it->second, vFrame);
+        } else if (!it->second.video && (aFrame = dynamic_cast<AudioFrame*>(orgFrames[id]))) {
+            analyseAudio(id, it->second, aFrame);
+        }
+    }
+
+    return true;
+}
+
+//NOTE: rows are spread over the whole picture, the same ones of each picture are compared so repeated
+//      pictures have no difference at all, while noise and small motion in the sampled rows are enough
+//      to tell a live picture. Pictures of a new size have nothing to be compared with
+void SignalMonitor::analyseVideo(int id, MonitorInput &input, VideoFrame* frame)
+{
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int width = frame->getWidth();
+    int height = frame->getHeight();
+    int sampled = std::min(rows, height);
+    unsigned sum = 0, dark = 0, diff = 0;
+    bool compare;
+    size_t pixels;
+
+    if (frame->getCodec() != RAW || !hasLumaPlane(frame->getPixelFormat()) || width <= 0 || sampled <= 0 ||
+        frame->getPlanes(data, linesize) == 0) {
+        return;
+    }
+
+    compare = input.width == width && input.height == height && input.rows.size() == (size_t) sampled*width;
+
+    if (!compare) {
+        input.rows.assign((size_t) sampled*width, 0);
+        input.width = width;
+        input.height = height;
+    }
+
+    for (int r = 0; r < sampled; r++) {
+        rowStats(data[0] + ((2*r + 1)*height/(2*sampled))*linesize[0], input.rows.data() + r*width,
+                 width, blackLevel, sum, dark, diff);
+    }
+
+    pixels = (size_t) sampled*width;
+    input.luma = (float) sum/pixels;
+    input.dark = (float) dark/pixels;
+    input.motion = compare ? (float) diff/pixels : -1;
+    input.frames++;
+
+    if (input.black.update(input.dark >= blackRatio, frame->getPresentationTime(), blackTime)) {
+        report(id, "black", input.black);
+    }
+
+    if (input.frozen.update(input.motion >= 0 && input.motion < freezeDiff, frame->getPresentationTime(), freezeTime)) {
+        report(id, "frozen", input.frozen);
+    }
+}
+
+void SignalMonitor::analyseAudio(int id, MonitorInput &input, AudioFrame* frame)
+{
+    unsigned samples = frame->getSamples();
+    unsigned channels = frame->getChannels();
+    SampleFmt format = frame->getSampleFmt();
+    float peak = 0, energy = 0;
+
+    if (samples == 0 || channels == 0) {
+        return;
+    }
+
+    if (input.samples.size() < (size_t) samples*channels) {
+        input.samples.resize((size_t) samples*channels);
+    }
+
+    //NOTE: levels are taken over all the channels, interleaved samples are converted as a single plane
+    if (frame->isPlanar()) {
+        for (unsigned c = 0; c < channels; c++) {
+            if (!SampleConverter::toFloat(frame->getPlanarDataBuf()[c], format, input.samples.data() + c*samples, samples)) {
+                return;
+            }
+        }
+    } else if (!SampleConverter::toFloat(frame->getDataBuf(), format, input.samples.data(), samples*channels)) {
+        return;
+    }
+
+    sampleLevels(input.samples.data(), (size_t) samples*channels, peak, energy);
+
+    input.peakDb = toDb(peak);
+    input.rmsDb = toDb(std::sqrt(energy/(samples*channels)));
+    input.frames++;
+
+    if (input.silent.update(input.peakDb < silenceLevel, frame->getPresentationTime(), silenceTime)) {
+        report(id, "silent", input.silent);
+    }
+}
+
+void SignalMonitor::report(int id, const char* condition, const SignalAlarm &alarm)
+{
+    if (alarm.active) {
+        utils::warningMsg("[SignalMonitor] Input " + std::to_string(id) + " is " + condition);
+    } else {
+        utils::infoMsg("[SignalMonitor] Input " + std::to_string(id) + " is not " + condition + " anymore");
+    }
+}
+
+bool SignalMonitor::configure0(int rows_, int blackLevel_, double blackRatio_, double freezeDiff_,
+                               double silenceLevel_, int blackTime_, int freezeTime_, int silenceTime_)
+{
+    if (rows_ == 0 || blackLevel_ > 255 || blackRatio_ == 0 || blackRatio_ > 1) {
+        utils::errorMsg("[SignalMonitor] Rows must be positive, the black level up to 255 and the ratio in (0, 1]");
+        return false;
+    }
+
+    if (rows_ > 0) {
+        rows = rows_;
+    }
+
+    if (blackLevel_ >= 0) {
+        blackLevel = blackLevel_;
+    }
+
+    if (blackRatio_ > 0) {
+        blackRatio = blackRatio_;
+    }
+
+    if (freezeDiff_ >= 0) {
+        freezeDiff = freezeDiff_;
+    }
+
+    if (silenceLevel_ <= 0) {
+        silenceLevel = silenceLevel_;
+    }
+
+    if (blackTime_ >= 0) {
+        blackTime = std::chrono::milliseconds(blackTime_);
+    }
+
+    if (freezeTime_ >= 0) {
+        freezeTime = std::chrono::milliseconds(freezeTime_);
+    }
+
+    if (silenceTime_ >= 0) {
+        silenceTime = std::chrono::milliseconds(silenceTime_);
+    }
+
+    return true;
+}
+
+void SignalMonitor::initializeEventMap()
+{
+    eventMap["configure"] = std::bind(&SignalMonitor::configureEvent, this, std::placeholders::_1);
+}
+
+bool SignalMonitor::configureEvent(Jzon::Node* params)
+{
+    if (!params) {
+        utils::errorMsg("[SignalMonitor::configureEvent] Params node not complete");
+        return false;
+    }
+
+    return configure0(params->Has("rows") ? params->Get("rows").ToInt() : -1,
+                      params->Has("blackLevel") ? params->Get("blackLevel").ToInt() : -1,
+                      params->Has("blackRatio") ? params->Get("blackRatio").ToDouble() : -1,
+                      params->Has("freezeDiff") ? params->Get("freezeDiff").ToDouble() : -1,
+                      params->Has("silenceLevel") ? params->Get("silenceLevel").ToDouble() : 1,
+                      params->Has("blackTime") ? params->Get("blackTime").ToInt() : -1,
+                      params->Has("freezeTime") ? params->Get("freezeTime").ToInt() : -1,
+                      params->Has("silenceTime") ? params->Get("silenceTime").ToInt() : -1);
+}
+
+void SignalMonitor::doGetState(Jzon::Object &filterNode)
+{
+    Jzon::Array inputsArray;
+    int active = 0;
+
+    for (auto &it : inputs) {
+        Jzon::Object input;
+
+        input.Add("id", it.first);
+        input.Add("frames", (int) it.second.frames);
+
+        if (it.second.video) {
+            input.Add("type", "video");
+            input.Add("luma", it.second.luma);
+            input.Add("darkRatio", it.second.dark);
+            input.Add("motion", it.second.motion);
+            input.Add("black", it.second.black.active);
+            input.Add("frozen", it.second.frozen.active);
+            input.Add("blackAlarms", (int) it.second.black.raised);
+            input.Add("frozenAlarms", (int) it.second.frozen.raised);
+            active += it.second.black.active + it.second.frozen.active;
+        } else {
+            input.Add("type", "audio");
+            input.Add("peakDb", it.second.peakDb);
+            input.Add("rmsDb", it.second.rmsDb);
+            input.Add("silent", it.second.silent.active);
+            input.Add("silentAlarms", (int) it.second.silent.raised);
+            active += it.second.silent.active;
+        }
+
+        inputsArray.Add(input);
+    }
+
+    filterNode.Add("activeAlarms", active);
+    filterNode.Add("rows", rows);
+    filterNode.Add("blackLevel", blackLevel);
+    filterNode.Add("blackRatio", blackRatio);
+    filterNode.Add("freezeDiff", freezeDiff);
+    filterNode.Add("silenceLevel", silenceLevel);
+    filterNode.Add("inputs", inputsArray);
+}
+
+bool SignalMonitor::configure(int rows, int blackLevel, double blackRatio, double freezeDiff,
+                              double silenceLevel, int blackTime, int freezeTime, int silenceTime)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configure");
+    params.Add("rows", rows);
+    params.Add("blackLevel", blackLevel);
+    params.Add("blackRatio", blackRatio);
+    params.Add("freezeDiff", freezeDiff);
+    params.Add("silenceLevel", silenceLevel);
+    params.Add("blackTime", blackTime);
+    params.Add("freezeTime", freezeTime);
+    params.Add("silenceTime", silenceTime);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
@@ -0,0 +1,159 @@
+/*
+ *  SignalMonitor.hh - Black, freeze and silence detection
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _SIGNAL_MONITOR_HH
+#define _SIGNAL_MONITOR_HH
+
+#include <map>
+#include <vector>
+#include <chrono>
+
+#include "../../Filter.hh"
+#include "../../VideoFrame.hh"
+#include "../../AudioFrame.hh"
+#include "../../StreamInfo.hh"
+
+#define MONITOR_DEFAULT_ROWS 16             //!< Luma rows sampled from each picture
+#define MONITOR_DEFAULT_BLACK_LEVEL 32      //!< Luma under which a pixel is dark, limited range black is 16
+#define MONITOR_DEFAULT_BLACK_RATIO 0.98    //!< Dark pixels share of a black picture
+#define MONITOR_DEFAULT_FREEZE_DIFF 0.5     //!< Mean absolute luma difference under which a picture repeats the previous one
+#define MONITOR_DEFAULT_SILENCE_LEVEL -60.0 //!< dBFS peak under which audio is silent
+#define MONITOR_DEFAULT_BLACK_TIME 2000     //!< Milliseconds of black pictures before raising the alarm
+#define MONITOR_DEFAULT_FREEZE_TIME 5000    //!< Milliseconds of repeated pictures before raising the alarm
+#define MONITOR_DEFAULT_SILENCE_TIME 5000   //!< Milliseconds of silence before raising the alarm
+#define MONITOR_FLOOR_DB -120.0             //!< Level reported for digital silence
+
+/*! Condition that raises an alarm once it holds for some time, measured with the frames timestamps */
+struct SignalAlarm {
+    SignalAlarm() : active(false), holding(false), since(0), raised(0) {};
+
+    /**
+    * @param condition true if the frame meets the condition
+    * @param ts presentation time of the frame
+    * @param time the condition must hold before the alarm is raised
+    * @return true if the alarm has been raised or cleared by this frame
+    */
+    bool update(bool condition, std::chrono::microseconds ts, std::chrono::microseconds time);
+
+    bool active;
+    bool holding;
+    std::chrono::microseconds since;        //!< Timestamp of the first frame meeting the condition
+    size_t raised;
+};
+
+/*! Monitoring state of a reader */
+struct MonitorInput {
+    MonitorInput() : video(true), width(0), height(0), luma(0), dark(0), motion(-1),
+        peakDb(MONITOR_FLOOR_DB), rmsDb(MONITOR_FLOOR_DB), frames(0) {};
+
+    bool video;
+    std::vector<unsigned char> rows;        //!< Luma rows sampled from the last picture
+    std::vector<float> samples;             //!< Audio samples converted to float
+    int width;                              //!< Picture size of the sampled rows
+    int height;
+
+    float luma;                             //!< Mean luma of the last picture sampled rows
+    float dark;                             //!< Dark pixels share of the last picture sampled rows
+    float motion;                           //!< Mean absolute luma difference to the previous picture, -1 if unknown
+    float peakDb;                           //!< Peak and RMS level of the last audio frame in dBFS
+    float rmsDb;
+    size_t frames;
+
+    SignalAlarm black;
+    SignalAlarm frozen;
+    SignalAlarm silent;
+};
+
+/*! Detects black and frozen pictures and silent audio on the frames of other filters outputs, so the
+*   monitoring does not decode the outputs a second time. It is connected as an extra reader of raw
+*   video and audio queues. Only a few evenly spaced luma rows of each picture are read (their mean,
+*   dark pixels share and difference to the same rows of the previous picture, computed by SIMD kernels)
+*   and the peak and RMS levels of audio frames. Alarms are raised when a condition holds for some time
+*   of the stream timestamps, they are logged and reported by the state, so the metrics exporter exposes
+*   them as gauges.
+*/
+class SignalMonitor : public TailFilter {
+
+public:
+    /**
+    * Class constructor
+    * @param readersNum maximum number of monitored streams
+    */
+    SignalMonitor(unsigned readersNum = MAX_READERS);
+
+    /**
+    * Class destructor
+    */
+    ~SignalMonitor();
+
+    /**
+    * Configures the detection, negative values keep the current ones (positive ones for the silence level)
+    * @param rows luma rows sampled from each picture
+    * @param blackLevel luma under which a pixel is dark
+    * @param blackRatio dark pixels share of a black picture, in (0, 1]
+    * @param freezeDiff mean absolute luma difference under which a picture repeats the previous one
+    * @param silenceLevel peak in dBFS under which audio is silent
+    * @param blackTime milliseconds of black pictures before raising the alarm
+    * @param freezeTime milliseconds of repeated pictures before raising the alarm
+    * @param silenceTime milliseconds of silence before raising the alarm
+    * @return true if the event has been pushed
+    */
+    bool configure(int rows, int blackLevel = -1, double blackRatio = -1, double freezeDiff = -1,
+                   double silenceLevel = 1, int blackTime = -1, int freezeTime = -1, int silenceTime = -1);
+
+    /**
+    * @param id reader id
+    * @return monitoring state of the reader, NULL if it is not monitored
+    */
+    const MonitorInput* getInput(int id) const;
+
+protected:
+    //Protected for testing purposes
+    bool doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& ret);
+    bool setupInput(int id, const StreamInfo* si);
+    bool configure0(int rows, int blackLevel, double blackRatio, double freezeDiff, double silenceLevel,
+                    int blackTime, int freezeTime, int silenceTime);
+
+private:
+    void doGetState(Jzon::Object &filterNode);
+    bool specificReaderConfig(int readerId, FrameQueue* queue);
+    bool specificReaderDelete(int readerId);
+    void initializeEventMap();
+    bool configureEvent(Jzon::Node* params);
+
+    void analyseVideo(int id, MonitorInput &input, VideoFrame* frame);
+    void analyseAudio(int id, MonitorInput &input, AudioFrame* frame);
+    void report(int id, const char* condition, const SignalAlarm &alarm);
+
+    std::map<int, MonitorInput> inputs;
+
+    int rows;
+    int blackLevel;
+    double blackRatio;
+    double freezeDiff;
+    double silenceLevel;
+    std::chrono::microseconds blackTime;
+    std::chrono::microseconds freezeTime;
+    std::chrono::microseconds silenceTime;
+};
+
+#endif
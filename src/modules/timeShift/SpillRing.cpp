@@ -0,0 +1,107 @@
+/*
+ *  SpillRing.cpp - Memory mapped file written as a circular buffer
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "SpillRing.hh"
+
+SpillRing::SpillRing() : data(NULL), size(0), position(0)
+{
+}
+
+SpillRing::~SpillRing()
+{
+    close();
+}
+
+bool SpillRing::open(std::string path_, size_t size_)
+{
+    void *map;
+    int fd;
+
+    close();
+
+    if (path_.empty() || size_ == 0 ||
+        (fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) < 0) {
+        return false;
+    }
+
+    if (ftruncate(fd, size_) != 0) {
+        ::close(fd);
+        unlink(path_.c_str());
+        return false;
+    }
+
+    // The mapping keeps a reference to the file, which can be closed and removed
+    map = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    unlink(path_.c_str());
+
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    data = (unsigned char*) map;
+    size = size_;
+    position = 0;
+    path = path_;
+
+    return true;
+}
+
+void SpillRing::close()
+{
+    if (data) {
+        munmap(data, size);
+    }
+
+    data = NULL;
+    size = 0;
+    position = 0;
+    path.clear();
+}
+
+int64_t SpillRing::reserve(size_t length)
+{
+    int64_t offset;
+
+    if (!data || length > size) {
+        return -1;
+    }
+
+    if (position + length > size) {
+        position = 0;
+    }
+
+    offset = position;
+    position += length;
+
+    return offset;
+}
+
+bool SpillRing::overlaps(size_t offsetA, size_t lengthA, size_t offsetB, size_t lengthB)
+{
+    return offsetA < offsetB + lengthB && offsetB < offsetA + lengthA;
+}
@@ -0,0 +1,75 @@
+/*
+ *  SpillRing.hh - Memory mapped file written as a circular buffer
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _SPILL_RING_HH
+#define _SPILL_RING_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/** Local file of a fixed size mapped in memory and written as a circular buffer. Blocks are
+  * reserved one after the other and a block that does not fit before the end of the file is
+  * placed at its start, so each block is contiguous. The ring does not track the blocks, its
+  * user drops the ones that a reservation overlaps (see overlaps). The file is removed once it
+  * is mapped, the mapping keeps it until the ring is closed, so nothing is left behind.
+  */
+class SpillRing {
+
+    public:
+        SpillRing();
+        ~SpillRing();
+
+        /** Creates and maps the file, an existing one is truncated
+         * @param path file path
+         * @param size file size in bytes
+         * @return false if the file cannot be created or mapped
+         */
+        bool open(std::string path, size_t size);
+
+        /** Unmaps the file */
+        void close();
+
+        /** Reserves the next block
+         * @param length block size in bytes
+         * @return block offset, -1 if the block is larger than the file
+         */
+        int64_t reserve(size_t length);
+
+        /** @return address of a block, it is valid until the ring is closed */
+        unsigned char* at(size_t offset) {return data + offset;};
+
+        bool isOpen() const {return data != NULL;};
+        size_t getSize() const {return size;};
+        std::string getPath() const {return path;};
+
+        /** @return true if two blocks share any byte */
+        static bool overlaps(size_t offsetA, size_t lengthA, size_t offsetB, size_t lengthB);
+
+    private:
+        unsigned char *data;
+        size_t size;
+        size_t position;
+        std::string path;
+};
+
+#endif
@@ -0,0 +1,431 @@
+/*
+ *  TimeShift - Coded video time shift ring
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "TimeShift.hh"
+#include "../../AVFramedQueue.hh"
+#include "../../SlicedVideoFrameQueue.hh"
+#include "../../FramePool.hh"
+#include "../../Utils.hh"
+
+#include <algorithm>
+#include <cstring>
+
+TimeShift* TimeShift::createNew(VCodecType codec, std::chrono::seconds window, size_t memory,
+                                std::string spillPath, size_t spillSize)
+{
+    TimeShift* shift;
+
+    if (codec != H264 && codec != H265) {
+        utils::errorMsg("[TimeShift] Error creating TimeShift, only H264 and H265 are supported");
+        return NULL;
+    }
+
+    if (window.count() <= 0 || memory == 0) {
+        utils::errorMsg("[TimeShift] Error creating TimeShift, window and memory must be greater than 0");
+        return NULL;
+    }
+
+    shift = new TimeShift(codec, window, memory);
+
+    if (!spillPath.empty() && !shift->openSpill(spillPath, spillSize)) {
+        delete shift;
+        return NULL;
+    }
+
+    return shift;
+}
+
+TimeShift::TimeShift(VCodecType codec, std::chrono::seconds window_, size_t memory) :
+    OneToManyFilter(TSHIFT_MAX_OUTPUTS), window(window_), maxMemory(memory), firstPos(0), memoryPos(0),
+    unitPos(0), unitPts(-1), unitKeyed(false), memoryBytes(0), spilledBytes(0), copies(0), drops(0), restarts(0)
+{
+    outputStreamInfo = new StreamInfo(VIDEO);
+    outputStreamInfo->video.codec = codec;
+    outputStreamInfo->setCodecDefaults();
+    //NOTE: the type of the pictures is read from the NAL units by the output queues
+    outputStreamInfo->video.frameTypes = true;
+
+    fType = TIME_SHIFT;
+    initializeEventMap();
+}
+
+TimeShift::~TimeShift()
+{
+    while (!ring.empty()) {
+        dropFront();
+    }
+
+    delete outputStreamInfo;
+}
+
+bool TimeShift::openSpill(std::string path, size_t size)
+{
+    if (size == 0 || !spill.open(path, size)) {
+        utils::errorMsg("[TimeShift] Could not map spill file " + path);
+        return false;
+    }
+
+    return true;
+}
+
+FrameQueue* TimeShift::allocQueue(ConnectionData cData)
+{
+    return SlicedVideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_VIDEO_FRAMES, MAX_H264_OR_5_NAL_SIZE);
+}
+
+std::chrono::microseconds TimeShift::getSpan() const
+{
+    if (ring.empty()) {
+        return std::chrono::microseconds(0);
+    }
+
+    return unitPts - ring.front().pts;
+}
+
+bool TimeShift::doProcessFrame(Frame *org, FrameMap &dstFrames)
+{
+    VideoFrame* frame = dynamic_cast<VideoFrame*>(org);
+    SlicedVideoFrame* out;
+
+    if (!frame || !frame->getDataBuf() || frame->getLength() == 0) {
+        return true;
+    }
+
+    if (!store(frame)) {
+        return false;
+    }
+
+    for (auto it : dstFrames) {
+        if ((out = dynamic_cast<SlicedVideoFrame*>(it.second)) == NULL) {
+            utils::errorMsg("[TimeShift] Destination frames must be SlicedVideoFrames");
+            return false;
+        }
+
+        write(outputs[it.first], out);
+    }
+
+    return true;
+}
+
+bool TimeShift::store(VideoFrame* frame)
+{
+    ShiftEntry entry;
+
+    //NOTE: timestamps going back mean a new stream, the index would not be ordered anymore
+    if (frame->isKeyFrame() && !keyIndex.empty() && frame->getPresentationTime() <= keyIndex.back().first) {
+        utils::warningMsg("[TimeShift] Timestamps went back, the ring is emptied");
+        restart();
+    }
+
+    if ((entry.frame = FramePool::getInstance()->hold(frame)) == NULL) {
+        utils::errorMsg("[TimeShift] Could not allocate a frame, the input is discarded");
+        return false;
+    }
+
+    if (entry.frame != frame) {
+        copies++;
+    }
+
+    entry.spillOffset = 0;
+    entry.length = frame->getLength();
+    entry.pts = frame->getPresentationTime();
+    entry.dts = frame->getDecodeTime();
+    entry.width = frame->getWidth();
+    entry.height = frame->getHeight();
+
+    //NOTE: the NAL units of an access unit share its presentation time, parameter sets included
+    if (entry.pts != unitPts) {
+        unitPos = firstPos + ring.size();
+        unitPts = entry.pts;
+        unitKeyed = false;
+    }
+
+    if (frame->isKeyFrame() && !unitKeyed) {
+        keyIndex.push_back(std::make_pair(unitPts, unitPos));
+        unitKeyed = true;
+    }
+
+    ring.push_back(entry);
+    memoryBytes += entry.length;
+
+    evict();
+
+    return true;
+}
+
+void TimeShift::evict()
+{
+    while (!ring.empty() && unitPts - ring.front().pts > window) {
+        dropFront();
+    }
+
+    while (memoryBytes > maxMemory && !ring.empty()) {
+        if (spill.isOpen()) {
+            spillEntry();
+            continue;
+        }
+
+        dropFront();
+        drops++;
+    }
+}
+
+void TimeShift::spillEntry()
+{
+    ShiftEntry &entry = ring[memoryPos - firstPos];
+    int64_t offset = spill.reserve(entry.length);
+
+    //NOTE: an entry larger than the file drops every spilled one, which would be followed by a gap
+    if (offset < 0) {
+        while (firstPos <= memoryPos) {
+            dropFront();
+            drops++;
+        }
+        return;
+    }
+
+    //NOTE: spilled entries are overwritten in the order they were written, the oldest one first
+    while (firstPos < memoryPos &&
+           SpillRing::overlaps(ring.front().spillOffset, ring.front().length, offset, entry.length)) {
+        dropFront();
+    }
+
+    memcpy(spill.at(offset), entry.frame->getDataBuf(), entry.length);
+    FramePool::getInstance()->releaseFrame(entry.frame);
+
+    entry.frame = NULL;
+    entry.spillOffset = offset;
+    memoryBytes -= entry.length;
+    spilledBytes += entry.length;
+    memoryPos++;
+}
+
+void TimeShift::dropFront()
+{
+    ShiftEntry &entry = ring.front();
+
+    if (entry.frame) {
+        FramePool::getInstance()->releaseFrame(entry.frame);
+        memoryBytes -= entry.length;
+    } else {
+        spilledBytes -= entry.length;
+    }
+
+    ring.pop_front();
+    firstPos++;
+    memoryPos = std::max(memoryPos, firstPos);
+
+    //NOTE: a random access unit cannot be started at once without its first entries
+    while (!keyIndex.empty() && keyIndex.front().second < firstPos) {
+        keyIndex.pop_front();
+    }
+}
+
+void TimeShift::restart()
+{
+    while (!ring.empty()) {
+        dropFront();
+    }
+
+    keyIndex.clear();
+    unitPts = std::chrono::microseconds(-1);
+    unitKeyed = false;
+    restarts++;
+
+    for (auto &it : outputs) {
+        it.second.seeking = true;
+    }
+}
+
+bool TimeShift::seek(ShiftOutput &output)
+{
+    std::chrono::microseconds target = unitPts - output.delay;
+    std::deque<std::pair<std::chrono::microseconds, uint64_t>>::iterator it;
+
+    if (keyIndex.empty()) {
+        return false;
+    }
+
+    //NOTE: the last random access unit at or before the target, or the oldest one if the ring is shorter
+    it = std::upper_bound(keyIndex.begin(), keyIndex.end(), target,
+        [] (const std::chrono::microseconds &t, const std::pair<std::chrono::microseconds, uint64_t> &key) {
+            return t < key.first;
+        });
+
+    if (it != keyIndex.begin()) {
+        --it;
+    }
+
+    output.next = it->second;
+    output.seeking = false;
+    output.seeks++;
+
+    return true;
+}
+
+void TimeShift::write(ShiftOutput &output, SlicedVideoFrame* dst)
+{
+    unsigned char* data;
+
+    //NOTE: outputs behind the oldest entry are placed again, the ring has been shortened under them
+    if (!output.seeking && output.next < firstPos) {
+        utils::warningMsg("[TimeShift] Output behind the ring, it starts again at its delay");
+        output.seeking = true;
+    }
+
+    if ((output.seeking && !seek(output)) || output.next >= firstPos + ring.size()) {
+        return;
+    }
+
+    ShiftEntry &entry = ring[output.next - firstPos];
+    data = entry.frame ? entry.frame->getDataBuf() : spill.at(entry.spillOffset);
+
+    //NOTE: the data is not modified until the next input frame, the output queue copies it before
+    if (!dst->setSlice(data, entry.length)) {
+        return;
+    }
+
+    dst->setPresentationTime(entry.pts);
+    dst->setDecodeTime(entry.dts);
+    dst->setSize(entry.width, entry.height);
+    dst->setConsumed(true);
+
+    output.next++;
+    output.frames++;
+}
+
+bool TimeShift::specificReaderConfig(int /*readerID*/, FrameQueue* queue)
+{
+    VideoFrameQueue *vQueue;
+    std::shared_ptr<const ExtraData> ed;
+
+    if ((vQueue = dynamic_cast<VideoFrameQueue*>(queue)) == NULL) {
+        utils::errorMsg("[TimeShift] Only video queues can be shifted");
+        return false;
+    }
+
+    if (vQueue->getStreamInfo()->video.codec != outputStreamInfo->video.codec) {
+        utils::errorMsg("[TimeShift] Input codec must be " + utils::getVideoCodecAsString(outputStreamInfo->video.codec));
+        return false;
+    }
+
+    if (!vQueue->getStreamInfo()->video.h264or5.annexb) {
+        utils::errorMsg("[TimeShift] Only Annex B inputs are supported");
+        return false;
+    }
+
+    if ((ed = vQueue->getStreamInfo()->getExtraData())) {
+        outputStreamInfo->setExtraData(ed->data(), ed->size());
+    }
+
+    return true;
+}
+
+bool TimeShift::specificWriterConfig(int writerID)
+{
+    //NOTE: delays can be set before connecting the writer
+    if (outputs.count(writerID) == 0) {
+        outputs[writerID] = ShiftOutput();
+    }
+
+    outputs[writerID].seeking = true;
+
+    return true;
+}
+
+bool TimeShift::specificWriterDelete(int writerID)
+{
+    outputs.erase(writerID);
+    return true;
+}
+
+bool TimeShift::setDelay0(int writer, std::chrono::microseconds delay)
+{
+    if (delay.count() < 0 || delay > window) {
+        utils::errorMsg("[TimeShift] Delay must be between 0 and " + std::to_string(window.count()/1000000) + " seconds");
+        return false;
+    }
+
+    outputs[writer].delay = delay;
+    outputs[writer].seeking = true;
+
+    return true;
+}
+
+void TimeShift::initializeEventMap()
+{
+    eventMap["setDelay"] = std::bind(&TimeShift::setDelayEvent, this, std::placeholders::_1);
+}
+
+bool TimeShift::setDelayEvent(Jzon::Node* params)
+{
+    if (!params || !params->Has("writer") || !params->Get("writer").IsNumber() ||
+        !params->Has("delay") || !params->Get("delay").IsNumber()) {
+        utils::errorMsg("[TimeShift::setDelayEvent] Params node not complete");
+        return false;
+    }
+
+    return setDelay0(params->Get("writer").ToInt(),
+                     std::chrono::milliseconds((int64_t) params->Get("delay").ToDouble()));
+}
+
+bool TimeShift::setDelay(int writer, std::chrono::milliseconds delay)
+{
+    Jzon::Object root, params;
+    root.Add("action", "setDelay");
+    params.Add("writer", writer);
+    params.Add("delay", (double) delay.count());
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
+
+void TimeShift::doGetState(Jzon::Object &filterNode)
+{
+    Jzon::Array jsonOutputs;
+
+    filterNode.Add("codec", utils::getVideoCodecAsString(outputStreamInfo->video.codec));
+    filterNode.Add("window", (int) (window.count()/1000000));
+    filterNode.Add("span", (int) (getSpan().count()/1000));
+    filterNode.Add("frames", (int) ring.size());
+    filterNode.Add("keyFrames", (int) keyIndex.size());
+    filterNode.Add("memory", (double) memoryBytes);
+    filterNode.Add("maxMemory", (double) maxMemory);
+    filterNode.Add("spilled", (double) spilledBytes);
+    filterNode.Add("spillSize", (double) spill.getSize());
+    filterNode.Add("copies", (int) copies);
+    filterNode.Add("drops", (int) drops);
+    filterNode.Add("restarts", (int) restarts);
+
+    for (auto &it : outputs) {
+        Jzon::Object jsonOutput;
+        jsonOutput.Add("id", it.first);
+        jsonOutput.Add("delay", (int) (it.second.delay.count()/1000));
+        jsonOutput.Add("frames", (int) it.second.frames);
+        jsonOutput.Add("seeks", (int) it.second.seeks);
+        jsonOutputs.Add(jsonOutput);
+    }
+
+    filterNode.Add("outputs", jsonOutputs);
+}
@@ -0,0 +1,159 @@
+/*
+ *  TimeShift - Coded video time shift ring
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _TIME_SHIFT_HH
+#define _TIME_SHIFT_HH
+
+#include <map>
+#include <deque>
+#include <chrono>
+#include <string>
+
+#include "../../Filter.hh"
+#include "../../VideoFrame.hh"
+#include "../../StreamInfo.hh"
+#include "SpillRing.hh"
+
+#define TSHIFT_MAX_OUTPUTS 16
+#define TSHIFT_DEFAULT_WINDOW 300                   //!< Seconds kept by default
+#define TSHIFT_DEFAULT_MEMORY 64*1024*1024          //!< Bytes of coded frames held in memory by default
+
+/*! Coded frame kept by the ring */
+struct ShiftEntry {
+    Frame* frame;                           //!< Retained frame, NULL once its data is spilled
+    size_t spillOffset;                     //!< Position of the data in the spill file
+    unsigned length;
+    std::chrono::microseconds pts;
+    std::chrono::microseconds dts;
+    int width;
+    int height;
+};
+
+/*! Reading state of a writer */
+struct ShiftOutput {
+    ShiftOutput() : delay(0), next(0), seeking(true), frames(0), seeks(0) {};
+
+    std::chrono::microseconds delay;        //!< Time behind the live edge
+    uint64_t next;                          //!< Position of the next entry to write
+    bool seeking;                           //!< The writer has to start again at a random access point
+    size_t frames;
+    size_t seeks;
+};
+
+/*! Keeps the last minutes of a coded H264 or H265 stream and writes it to each output with
+*   its own delay, like a DVR. Input frames are retained in the ring instead of copied (only
+*   frames not obtained from the FramePool are copied once), so the memory held is bounded by
+*   the window duration and a byte limit. Once the limit is reached the oldest frames are copied
+*   to a memory mapped spill file, when there is one, or dropped. The random access points are
+*   indexed by presentation time, so an output starting at "live minus delay" is placed with a
+*   binary search at the first NAL unit (parameter sets included) of the closest access unit
+*   at or before that time, and then it writes one entry per input frame, keeping its delay.
+*   Outputs with no delay start at the last random access point.
+*/
+class TimeShift : public OneToManyFilter {
+
+public:
+    /**
+    * Class constructor wrapper used to validate input params
+    * @param codec coded format of the input and the outputs, H264 or H265
+    * @param window longest delay kept
+    * @param memory bytes of coded frames held in memory, older ones are spilled or dropped
+    * @param spillPath file where older frames are spilled, empty to drop them
+    * @param spillSize size of the spill file in bytes
+    * @return Pointer to new object if succeed of NULL if not
+    */
+    static TimeShift* createNew(VCodecType codec = H264,
+                                std::chrono::seconds window = std::chrono::seconds(TSHIFT_DEFAULT_WINDOW),
+                                size_t memory = TSHIFT_DEFAULT_MEMORY,
+                                std::string spillPath = "", size_t spillSize = 0);
+
+    /**
+    * Class destructor
+    */
+    ~TimeShift();
+
+    /**
+    * Sets the delay of an output, which starts again at the random access point closest to it
+    * @param writer writer id, it may not be connected yet
+    * @param delay time behind the live edge, it cannot be longer than the window
+    * @return true if the event has been pushed
+    */
+    bool setDelay(int writer, std::chrono::milliseconds delay);
+
+    size_t getFrames() const {return ring.size();};
+    size_t getKeyFrames() const {return keyIndex.size();};
+    size_t getMemoryBytes() const {return memoryBytes;};
+    size_t getSpilledBytes() const {return spilledBytes;};
+
+    /**
+    * @return time between the oldest and the newest frames of the ring
+    */
+    std::chrono::microseconds getSpan() const;
+
+protected:
+    //Protected for testing purposes
+    TimeShift(VCodecType codec, std::chrono::seconds window, size_t memory);
+    bool doProcessFrame(Frame *org, FrameMap &dstFrames);
+    bool specificReaderConfig(int readerID, FrameQueue* queue);
+    bool specificReaderDelete(int /*readerID*/) {return true;};
+    bool specificWriterConfig(int writerID);
+    bool specificWriterDelete(int writerID);
+    bool setDelay0(int writer, std::chrono::microseconds delay);
+    bool openSpill(std::string path, size_t size);
+
+private:
+    FrameQueue *allocQueue(ConnectionData cData);
+    void doGetState(Jzon::Object &filterNode);
+    void initializeEventMap();
+    bool setDelayEvent(Jzon::Node* params);
+
+    bool store(VideoFrame* frame);
+    void evict();
+    void spillEntry();
+    void dropFront();
+    void restart();
+    bool seek(ShiftOutput &output);
+    void write(ShiftOutput &output, SlicedVideoFrame* dst);
+
+    StreamInfo *outputStreamInfo;
+    std::chrono::microseconds window;
+    size_t maxMemory;
+    SpillRing spill;
+
+    std::deque<ShiftEntry> ring;
+    //NOTE: presentation time and position of the first entry of each random access unit, in order
+    std::deque<std::pair<std::chrono::microseconds, uint64_t>> keyIndex;
+    uint64_t firstPos;                      //!< Position of the oldest entry, positions are not reused
+    uint64_t memoryPos;                     //!< Position of the oldest entry held in memory
+    uint64_t unitPos;                       //!< Position of the first entry of the newest access unit
+    std::chrono::microseconds unitPts;
+    bool unitKeyed;
+    size_t memoryBytes;
+    size_t spilledBytes;
+
+    std::map<int, ShiftOutput> outputs;
+    size_t copies;
+    size_t drops;
+    size_t restarts;
+};
+
+#endif
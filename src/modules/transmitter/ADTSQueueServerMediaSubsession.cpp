@@ -24,19 +24,23 @@
 #include "ADTSQueueServerMediaSubsession.hh"
 #include "CustomMPEG4GenericRTPSink.hh"
 #include "ADTSStreamParser.hh"
+#include "QueueSource.hh"
 
 ADTSQueueServerMediaSubsession*
 ADTSQueueServerMediaSubsession::createNew(Connection* conn, UsageEnvironment& env, StreamReplicator* replica, int readerId, 
-                                          unsigned channels, unsigned sampleRate, Boolean reuseFirstSource)
+                                          unsigned channels, unsigned sampleRate, Boolean reuseFirstSource,
+                                          unsigned ptime)
 {
-    return new ADTSQueueServerMediaSubsession(conn, env, replica, readerId, channels, sampleRate, reuseFirstSource);
+    return new ADTSQueueServerMediaSubsession(conn, env, replica, readerId, channels, sampleRate,
+                                              reuseFirstSource, ptime);
 }
 
 ADTSQueueServerMediaSubsession
 ::ADTSQueueServerMediaSubsession(Connection* conn, UsageEnvironment& env, StreamReplicator* replica, int readerId, 
-                                 unsigned channels, unsigned sampleRate, Boolean reuseFirstSource) :
+                                 unsigned channels, unsigned sampleRate, Boolean reuseFirstSource,
+                                 unsigned ptime) :
 QueueServerMediaSubsession(env, reuseFirstSource), replicator(replica), reader(readerId), fChannels(channels), 
-fSampleRate(sampleRate), fAuxSDPLine(NULL), fDoneFlag(0), fDummyRTPSink(NULL), fConn(conn)
+fSampleRate(sampleRate), fPtime(ptime), fAuxSDPLine(NULL), fAuxSDPVersion(0), fDoneFlag(0), fDummyRTPSink(NULL), fConn(conn)
 {
 
 }
@@ -73,6 +77,7 @@ void ADTSQueueServerMediaSubsession::checkForAuxSDPLine1()
   
     } else if (fDummyRTPSink != NULL && (dasl = fDummyRTPSink->auxSDPLine()) != NULL) {
         fAuxSDPLine = strDup(dasl);
+        fAuxSDPVersion = getStreamInfo() ? getStreamInfo()->getExtraDataVersion() : 0;
         fDummyRTPSink = NULL;
         setDoneFlag();
 
@@ -83,10 +88,66 @@ void ADTSQueueServerMediaSubsession::checkForAuxSDPLine1()
     }
 }
 
+const StreamInfo* ADTSQueueServerMediaSubsession::getStreamInfo()
+{
+    QueueSource* source = dynamic_cast<QueueSource*>(replicator->inputSource());
+
+    return source ? source->getStreamInfo() : NULL;
+}
+
+bool ADTSQueueServerMediaSubsession::extradataAuxSDPLine(RTPSink* rtpSink)
+{
+    CustomMPEG4GenericRTPSink* sink = dynamic_cast<CustomMPEG4GenericRTPSink*>(rtpSink);
+    const StreamInfo* si = getStreamInfo();
+    std::shared_ptr<const ExtraData> ed;
+    std::string config;
+    char const* dasl;
+    char hex[3];
+    unsigned version;
+
+    if (!sink || !si) {
+        return false;
+    }
+
+    //NOTE: the version is read first, an extradata published meanwhile invalidates the line on next call
+    version = si->getExtraDataVersion();
+    ed = si->getExtraData();
+
+    if (!ed || ed->size() < 2) {
+        return false;
+    }
+
+    for (uint8_t byte : *ed) {
+        sprintf(hex, "%02X", byte);
+        config.append(hex);
+    }
+
+    sink->setConfigString(config.c_str());
+
+    if ((dasl = rtpSink->auxSDPLine()) == NULL) {
+        return false;
+    }
+
+    fAuxSDPLine = strDup(dasl);
+    fAuxSDPVersion = version;
+    return true;
+}
+
 char const* ADTSQueueServerMediaSubsession::getAuxSDPLine(RTPSink* rtpSink, FramedSource* inputSource) 
 {
+    const StreamInfo* si = getStreamInfo();
+
+    if (fAuxSDPLine != NULL && si && si->getExtraDataVersion() != fAuxSDPVersion) {
+        delete[] fAuxSDPLine;
+        fAuxSDPLine = NULL;
+    }
+
     if (fAuxSDPLine != NULL) return fAuxSDPLine; 
 
+    if (fDummyRTPSink == NULL && extradataAuxSDPLine(rtpSink)) {
+        return fAuxSDPLine;
+    }
+
     if (fDummyRTPSink == NULL) {
         fDummyRTPSink = rtpSink;
         fDummyRTPSink->startPlaying(*inputSource, afterPlayingDummy, this);
@@ -107,7 +168,7 @@ RTPSink* ADTSQueueServerMediaSubsession::createNewRTPSink(Groupsock* rtpGroupsoc
            unsigned char rtpPayloadTypeIfDynamic, FramedSource* /*inputSource*/) 
 {
       return CustomMPEG4GenericRTPSink::createNew(envir(), rtpGroupsock, rtpPayloadTypeIfDynamic, 
-                                                  fSampleRate, "audio", "AAC-hbr", fChannels);
+                                                  fSampleRate, "audio", "AAC-hbr", fChannels, fPtime);
 }
 
 RTCPInstance* ADTSQueueServerMediaSubsession::createRTCP(Groupsock* RTCPgs, unsigned totSessionBW, /* in kbps */
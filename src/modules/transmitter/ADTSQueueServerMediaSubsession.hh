@@ -26,8 +26,12 @@
 
 #include "QueueServerMediaSubsession.hh"
 #include "Connection.hh"
+#include "../../StreamInfo.hh"
 
-/*! An onDemand RTSP subsession for audio AAC codec (with ADTS headers) */
+/*! An onDemand RTSP subsession for audio AAC codec (with ADTS headers). The AAC config of the SDP is
+    taken from the stream extradata, which the encoder publishes when it is configured, so DESCRIBE is
+    answered at once. The line is kept until a new extradata version is published. Only without
+    extradata it is parsed from the ADTS headers of the first frames, through a dummy sink */
 
 class ADTSQueueServerMediaSubsession : public QueueServerMediaSubsession {
     
@@ -40,11 +44,12 @@ public:
     * @param channels Audio channels
     * @param sampleRate Audio sampling rate
     * @param reuseFirstSource If True, the same source is used for each request to the subssession
+    * @param ptime Audio duration in msec aggregated in each packet, 0 sends one AU per packet
     * @return Pointer to the object if succeded and NULL if not
     */
     static ADTSQueueServerMediaSubsession*
         createNew(Connection* conn, UsageEnvironment& env, StreamReplicator* replica, int readerId, 
-                  unsigned channels, unsigned sampleRate, Boolean reuseFirstSource);
+                  unsigned channels, unsigned sampleRate, Boolean reuseFirstSource, unsigned ptime = 0);
 
     /**
     * It gets extra SDP line from its associated sink (because it must be obtained from sink consumed frames)
@@ -59,11 +64,13 @@ public:
 
 protected:
     ADTSQueueServerMediaSubsession(Connection* conn, UsageEnvironment& env, StreamReplicator* replica, int readerId, 
-                                   unsigned channels, unsigned sampleRate, Boolean reuseFirstSource);
+                                   unsigned channels, unsigned sampleRate, Boolean reuseFirstSource, unsigned ptime);
 
     virtual ~ADTSQueueServerMediaSubsession();
     void setDoneFlag() { fDoneFlag = ~0; }
     char const* getAuxSDPLine(RTPSink* rtpSink, FramedSource* inputSource);
+    const StreamInfo* getStreamInfo();
+    bool extradataAuxSDPLine(RTPSink* rtpSink);
     FramedSource* createNewStreamSource(unsigned clientSessionId, unsigned& estBitrate);
     RTPSink* createNewRTPSink(Groupsock* rtpGroupsock, unsigned char rtpPayloadTypeIfDynamic, FramedSource* inputSource);
     RTCPInstance* createRTCP(Groupsock* RTCPgs, unsigned totSessionBW, /* in kbps */
@@ -73,7 +80,9 @@ private:
     int reader;
     unsigned fChannels;
     unsigned fSampleRate;
+    unsigned fPtime;
     char* fAuxSDPLine;
+    unsigned fAuxSDPVersion;
     char fDoneFlag; 
     RTPSink* fDummyRTPSink;
     Connection* fConn;
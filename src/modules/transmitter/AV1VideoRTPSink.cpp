@@ -0,0 +1,226 @@
+/*
+ *  AV1VideoRTPSink.cpp - RTP sink of AV1 temporal units
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <vector>
+
+#include "AV1VideoRTPSink.hh"
+#include "../../ObuSplitter.hh"
+#include "../../Types.hh"
+#include "../../Utils.hh"
+
+#define AV1_Z_FLAG 0x80     //!< First element continues an OBU of the previous packet
+#define AV1_Y_FLAG 0x40     //!< Last element continues in the next packet
+#define AV1_W_ONE 0x10      //!< One element, without length field
+#define AV1_N_FLAG 0x08     //!< First packet of a coded video sequence
+
+/*! Delivers the OBUs of the temporal units of its source one by one, without their size field */
+class AV1ObuFramer : public FramedFilter {
+
+public:
+    AV1ObuFramer(UsageEnvironment& env, FramedSource* inputSource) :
+        FramedFilter(env, inputSource), fInput(LENGTH_AV1), fNext(0), fKey(false), fLast(false), fStartsSequence(false)
+    {
+    };
+
+    bool endsTemporalUnit() const {return fLast;};
+    bool startsCodedVideoSequence() const {return fStartsSequence;};
+
+private:
+    struct Obu {
+        unsigned offset;
+        unsigned size;
+        unsigned headerSize;
+        unsigned char type;
+    };
+
+    void doGetNextFrame()
+    {
+        if (fNext < fObus.size()) {
+            deliver();
+            return;
+        }
+
+        fInputSource->getNextFrame(fInput.data(), fInput.size(), afterGettingFrame, this,
+                                   FramedSource::handleClosure, this);
+    };
+
+    static void afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
+                                  struct timeval presentationTime, unsigned /*durationInMicroseconds*/)
+    {
+        ((AV1ObuFramer*) clientData)->afterGettingFrame1(frameSize, numTruncatedBytes, presentationTime);
+    };
+
+    void afterGettingFrame1(unsigned frameSize, unsigned numTruncatedBytes, struct timeval presentationTime)
+    {
+        ObuSplitter splitter(fInput.data(), frameSize);
+        ObuSpan span;
+        bool sequenceHeader = false;
+        Obu obu;
+
+        fObus.clear();
+        fNext = 0;
+        fKey = false;
+        fTimestamp = presentationTime;
+
+        if (numTruncatedBytes > 0) {
+            utils::warningMsg("[AV1VideoRTPSink] Temporal unit truncated, discarding it");
+            doGetNextFrame();
+            return;
+        }
+
+        //NOTE: temporal delimiters are implied by the RTP timestamp and padding is not needed
+        while (splitter.next(span)) {
+            if (span.type == OBU_TEMPORAL_DELIMITER || span.type == OBU_PADDING) {
+                continue;
+            }
+
+            if (span.type == OBU_SEQUENCE_HEADER) {
+                sequenceHeader = true;
+            }
+
+            if ((span.type == OBU_FRAME || span.type == OBU_FRAME_HEADER) && sequenceHeader && fObus.size() > 0 &&
+                ObuSplitter::isKeyFrame(span.data + span.headerSize, span.size - span.headerSize, false)) {
+                fKey = true;
+            }
+
+            obu.offset = span.data - fInput.data();
+            obu.size = span.size;
+            obu.headerSize = span.headerSize;
+            obu.type = span.type;
+            fObus.push_back(obu);
+        }
+
+        if (splitter.isBroken()) {
+            utils::warningMsg("[AV1VideoRTPSink] Malformed temporal unit, sending its valid OBUs");
+        }
+
+        doGetNextFrame();
+    };
+
+    void deliver()
+    {
+        Obu &obu = fObus[fNext];
+        unsigned char* data = fInput.data() + obu.offset;
+        unsigned extension = (data[0] & OBU_EXTENSION_FLAG) ? 1 : 0;
+        unsigned payloadSize = obu.size - obu.headerSize;
+        unsigned size = 1 + extension + payloadSize;
+
+        fStartsSequence = fKey && obu.type == OBU_SEQUENCE_HEADER && fNext == 0;
+        fLast = ++fNext == fObus.size();
+
+        if (size > fMaxSize) {
+            fNumTruncatedBytes = size - fMaxSize;
+            size = fMaxSize;
+        } else {
+            fNumTruncatedBytes = 0;
+        }
+
+        fTo[0] = data[0] & ~OBU_HAS_SIZE_FLAG;
+        if (extension && size > 1) {
+            fTo[1] = data[1];
+        }
+
+        if (size > 1 + extension) {
+            memcpy(fTo + 1 + extension, data + obu.headerSize, size - 1 - extension);
+        }
+
+        fFrameSize = size;
+        fPresentationTime = fTimestamp;
+        fDurationInMicroseconds = 0;
+
+        FramedSource::afterGetting(this);
+    };
+
+    std::vector<unsigned char> fInput;
+    std::vector<Obu> fObus;
+    unsigned fNext;
+    struct timeval fTimestamp;
+    bool fKey;
+    bool fLast;
+    bool fStartsSequence;
+};
+
+AV1VideoRTPSink* AV1VideoRTPSink::createNew(UsageEnvironment& env, Groupsock* RTPgs, unsigned char rtpPayloadFormat)
+{
+    return new AV1VideoRTPSink(env, RTPgs, rtpPayloadFormat);
+}
+
+AV1VideoRTPSink::AV1VideoRTPSink(UsageEnvironment& env, Groupsock* RTPgs, unsigned char rtpPayloadFormat) :
+    VideoRTPSink(env, RTPgs, rtpPayloadFormat, 90000, "AV1"), fFramer(NULL)
+{
+}
+
+AV1VideoRTPSink::~AV1VideoRTPSink()
+{
+    //NOTE: the framer is our source, it must be stopped and closed before the base destructor runs
+    fSource = fFramer;
+    stopPlaying();
+    Medium::close(fFramer);
+    fSource = NULL;
+}
+
+Boolean AV1VideoRTPSink::continuePlaying()
+{
+    if (!fFramer) {
+        fFramer = new AV1ObuFramer(envir(), fSource);
+    } else {
+        fFramer->reassignInputSource(fSource);
+    }
+
+    fSource = fFramer;
+    return MultiFramedRTPSink::continuePlaying();
+}
+
+void AV1VideoRTPSink::doSpecialFrameHandling(unsigned fragmentationOffset, unsigned char* /*frameStart*/,
+                                             unsigned /*numBytesInFrame*/, struct timeval framePresentationTime,
+                                             unsigned numRemainingBytes)
+{
+    unsigned char header = AV1_W_ONE;
+
+    if (fragmentationOffset > 0) {
+        header |= AV1_Z_FLAG;
+    }
+
+    if (numRemainingBytes > 0) {
+        header |= AV1_Y_FLAG;
+    }
+
+    if (fragmentationOffset == 0 && fFramer && fFramer->startsCodedVideoSequence()) {
+        header |= AV1_N_FLAG;
+    }
+
+    setSpecialHeaderBytes(&header, AV1_AGGREGATION_HEADER_SIZE);
+
+    if (numRemainingBytes == 0 && fFramer && fFramer->endsTemporalUnit()) {
+        setMarkerBit();
+    }
+
+    setTimestamp(framePresentationTime);
+}
+
+Boolean AV1VideoRTPSink::frameCanAppearAfterPacketStart(unsigned char const* /*frameStart*/,
+                                                        unsigned /*numBytesInFrame*/) const
+{
+    //NOTE: with W=1 a packet only carries one element
+    return False;
+}
@@ -0,0 +1,57 @@
+/*
+ *  AV1VideoRTPSink.hh - RTP sink of AV1 temporal units
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _AV1_VIDEO_RTP_SINK_HH
+#define _AV1_VIDEO_RTP_SINK_HH
+
+#include <liveMedia.hh>
+
+#define AV1_AGGREGATION_HEADER_SIZE 1
+
+class AV1ObuFramer;
+
+/*! RTP sink of AV1 temporal units in low overhead bitstream format, as output by VideoEncoderSvtAv1,
+    following the AOM RTP payload format for AV1. Each packet carries one OBU, or a fragment of it,
+    with W=1 so the element has no length field. Temporal delimiters are dropped and the OBU size
+    fields removed, the marker bit is set on the last packet of each temporal unit and N on the
+    sequence header starting a key frame.
+*/
+class AV1VideoRTPSink : public VideoRTPSink {
+
+public:
+    static AV1VideoRTPSink* createNew(UsageEnvironment& env, Groupsock* RTPgs, unsigned char rtpPayloadFormat);
+
+protected:
+    AV1VideoRTPSink(UsageEnvironment& env, Groupsock* RTPgs, unsigned char rtpPayloadFormat);
+    ~AV1VideoRTPSink();
+
+private:
+    Boolean continuePlaying();
+    void doSpecialFrameHandling(unsigned fragmentationOffset, unsigned char* frameStart, unsigned numBytesInFrame,
+                                struct timeval framePresentationTime, unsigned numRemainingBytes);
+    Boolean frameCanAppearAfterPacketStart(unsigned char const* frameStart, unsigned numBytesInFrame) const;
+    unsigned specialHeaderSize() const {return AV1_AGGREGATION_HEADER_SIZE;};
+
+    AV1ObuFramer* fFramer;
+};
+
+#endif
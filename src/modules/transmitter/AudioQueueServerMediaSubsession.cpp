@@ -23,6 +23,8 @@
 
 #include "AudioQueueServerMediaSubsession.hh"
 #include "QueueSource.hh"
+#include "PCMAudioRTPSink.hh"
+#include "OpusRepacketizer.hh"
 #include "../../AVFramedQueue.hh"
 
 
@@ -31,19 +33,20 @@ AudioQueueServerMediaSubsession::createNew(Connection* conn, UsageEnvironment& e
                           StreamReplicator* replica, int readerId,
                           ACodecType codec, unsigned channels,
                           unsigned sampleRate, SampleFmt sampleFormat,
-                          Boolean reuseFirstSource) {
+                          Boolean reuseFirstSource, unsigned ptime) {
   return new AudioQueueServerMediaSubsession(conn, env, replica, readerId, 
                                              codec, channels, sampleRate,
-                                             sampleFormat, reuseFirstSource);
+                                             sampleFormat, reuseFirstSource, ptime);
 }
 
 AudioQueueServerMediaSubsession::AudioQueueServerMediaSubsession(Connection* conn, UsageEnvironment& env,
                           StreamReplicator* replica, int readerId, 
                           ACodecType codec, unsigned channels,
                           unsigned sampleRate, SampleFmt sampleFormat,
-                          Boolean reuseFirstSource)
+                          Boolean reuseFirstSource, unsigned ptime)
   : QueueServerMediaSubsession(env, reuseFirstSource), replicator(replica), reader(readerId), fCodec(codec),
-                          fChannels(channels), fSampleRate(sampleRate), fSampleFormat(sampleFormat), fConn(conn)
+                          fChannels(channels), fSampleRate(sampleRate), fSampleFormat(sampleFormat),
+                          fPtime(ptime), fConn(conn)
 {
 }
 
@@ -66,6 +69,11 @@ FramedSource* AudioQueueServerMediaSubsession::createNewStreamSource(unsigned /*
     } else {
         estBitrate = 128; // kbps, estimate
     }
+
+    if (fCodec == OPUS && fPtime > 0) {
+        return OpusRepacketizer::createNew(envir(), replicator->createStreamReplica(), fPtime);
+    }
+
     return replicator->createStreamReplica();
 }
 
@@ -97,6 +105,11 @@ RTPSink* AudioQueueServerMediaSubsession
         return MPEG1or2AudioRTPSink::createNew(envir(), rtpGroupsock);
     }
 
+    if (fPtime > 0 && fCodec != OPUS) {
+        return PCMAudioRTPSink::createNew(envir(), rtpGroupsock, payloadType, fCodec, fChannels,
+                                          fSampleRate, fSampleFormat, codecStr.c_str(), fPtime);
+    }
+
     return SimpleRTPSink
     ::createNew(envir(), rtpGroupsock, payloadType,
                 fSampleRate, "audio", 
@@ -38,7 +38,8 @@ public:
             unsigned channels,
             unsigned sampleRate,
             SampleFmt sampleFormat, 
-            Boolean reuseFirstSource);
+            Boolean reuseFirstSource,
+            unsigned ptime = 0);
   
   std::vector<int> getReaderIds();
 
@@ -50,7 +51,8 @@ protected:
                                   unsigned channels,
                                   unsigned sampleRate,
                                   SampleFmt sampleFormat,
-                                  Boolean reuseFirstSource);
+                                  Boolean reuseFirstSource,
+                                  unsigned ptime);
 
   ~AudioQueueServerMediaSubsession();
 
@@ -71,6 +73,7 @@ private:
     unsigned fChannels;
     unsigned fSampleRate;
     SampleFmt fSampleFormat;
+    unsigned fPtime;
 
     Connection* fConn;
 };
@@ -0,0 +1,300 @@
+/*
+ *  BatchedGroupsock.cpp - Groupsock that sends its packets in batches
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/udp.h>
+
+#include "BatchedGroupsock.hh"
+#include "../../Utils.hh"
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103             //!< Linux 4.18 UDP GSO option, older C libraries do not define it
+#endif
+
+BatchedGroupsock::BatchedGroupsock(UsageEnvironment& env, struct in_addr const& groupAddr, Port port, u_int8_t ttl) :
+    Groupsock(env, groupAddr, port, ttl), dataLength(0), head(0), pacing(0), byteRate(0), windowBytes(0),
+    tokens(0), history(NULL), fec(NULL), rids(NULL), lastTtl(0), gso(true), sentPackets(0), sendCalls(0)
+{
+    packets.reserve(BATCH_MAX_PACKETS);
+    windowStart = std::chrono::steady_clock::now();
+    lastRefill = windowStart;
+}
+
+BatchedGroupsock::~BatchedGroupsock()
+{
+    flush();
+}
+
+Boolean BatchedGroupsock::write(netAddressBits address, portNumBits portNum, u_int8_t ttl,
+                                unsigned char* buffer, unsigned bufferSize)
+{
+    u_int8_t ttlValue = ttl;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    unsigned char repair[FEC_MAX_PACKET_SIZE];
+    unsigned char tagged[RID_MAX_PACKET_SIZE];
+    unsigned repairSize;
+    unsigned taggedSize;
+
+    if (ttl != lastTtl) {
+        flush();
+
+        if (setsockopt(socketNum(), IPPROTO_IP, IP_MULTICAST_TTL, &ttlValue, sizeof(ttlValue)) < 0) {
+            return False;
+        }
+
+        lastTtl = ttl;
+    }
+
+    if (rids && (taggedSize = rids->tag(buffer, bufferSize, tagged, sizeof(tagged)))) {
+        buffer = tagged;
+        bufferSize = taggedSize;
+    }
+
+    if (history) {
+        history->store(buffer, bufferSize, now);
+    }
+
+    queue(address, portNum, buffer, bufferSize, now);
+
+    //NOTE: repair packets follow the packet which completes their row or matrix
+    if (fec) {
+        fec->protect(buffer, bufferSize);
+
+        while ((repairSize = fec->getRepair(repair))) {
+            queue(address, portNum, repair, repairSize, now);
+        }
+    }
+
+    if (packets.size() - head >= BATCH_MAX_PACKETS) {
+        flush(false);
+    }
+
+    return True;
+}
+
+void BatchedGroupsock::queue(netAddressBits address, portNumBits portNum, unsigned char* buffer,
+                             unsigned bufferSize, std::chrono::steady_clock::time_point now)
+{
+    BatchedPacket packet;
+
+    if (head == packets.size()) {
+        batchStart = now;
+    }
+
+    measureRate(bufferSize, now);
+
+    //NOTE: the buffer keeps the size of the largest batch, so it does not grow once the stream is running
+    if (dataLength + bufferSize > data.size()) {
+        data.resize(dataLength + bufferSize);
+    }
+
+    memcpy(data.data() + dataLength, buffer, bufferSize);
+
+    memset(&packet.dest, 0, sizeof(packet.dest));
+    packet.dest.sin_family = AF_INET;
+    packet.dest.sin_addr.s_addr = address;
+    packet.dest.sin_port = portNum;
+    packet.offset = dataLength;
+    packet.size = bufferSize;
+
+    packets.push_back(packet);
+    dataLength += bufferSize;
+}
+
+bool BatchedGroupsock::setPacing(float factor)
+{
+    if (factor != 0 && factor < 1) {
+        utils::errorMsg("Pacing factor must be 0 (disabled) or at least 1");
+        return false;
+    }
+
+    pacing = factor;
+    return true;
+}
+
+void BatchedGroupsock::flush(bool force)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    size_t last = packets.size();
+
+    if (head == packets.size()) {
+        return;
+    }
+
+    if (!force && packets.size() - head < BATCH_MAX_PACKETS &&
+        now - batchStart < std::chrono::microseconds(BATCH_MAX_DELAY)) {
+        return;
+    }
+
+    if (!force && pacing > 0 && byteRate > 0) {
+        last = pacedPackets(now);
+    }
+
+    while (head < last) {
+        head = sendMessages(head, last);
+    }
+
+    batchStart = now;
+
+    if (head == packets.size()) {
+        packets.clear();
+        dataLength = 0;
+        head = 0;
+    } else if (head > packets.size()/2) {
+        compact();
+    }
+}
+
+size_t BatchedGroupsock::pacedPackets(std::chrono::steady_clock::time_point now)
+{
+    double rate = pacing * byteRate;
+    double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - lastRefill).count();
+    size_t last = head;
+
+    tokens = std::min(tokens + rate * elapsed / 1000000, rate * PACING_BURST_TIME / 1000000);
+    lastRefill = now;
+
+    //NOTE: the bucket can go into debt by part of a packet, so packets larger than its depth are sent too
+    while (last < packets.size() && tokens > 0) {
+        tokens -= packets[last].size;
+        last++;
+    }
+
+    return last;
+}
+
+void BatchedGroupsock::measureRate(unsigned size, std::chrono::steady_clock::time_point now)
+{
+    std::chrono::microseconds elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - windowStart);
+
+    windowBytes += size;
+
+    if (elapsed >= std::chrono::milliseconds(PACING_RATE_WINDOW)) {
+        byteRate = windowBytes * 1000000.0 / elapsed.count();
+        windowBytes = 0;
+        windowStart = now;
+    }
+}
+
+void BatchedGroupsock::compact()
+{
+    size_t offset = packets[head].offset;
+
+    memmove(data.data(), data.data() + offset, dataLength - offset);
+    dataLength -= offset;
+
+    packets.erase(packets.begin(), packets.begin() + head);
+    head = 0;
+
+    for (auto& packet : packets) {
+        packet.offset -= offset;
+    }
+}
+
+size_t BatchedGroupsock::sendMessages(size_t first, size_t last)
+{
+    struct mmsghdr msgs[BATCH_MAX_PACKETS];
+    struct iovec iovs[BATCH_MAX_PACKETS];
+    union {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } controls[BATCH_MAX_PACKETS];
+    size_t firsts[BATCH_MAX_PACKETS + 1];
+    struct cmsghdr* cmsg;
+    unsigned msgNum = 0;
+    unsigned iovNum = 0;
+    size_t i = first;
+    size_t bytes;
+    int ret;
+
+    memset(msgs, 0, sizeof(msgs));
+    memset(controls, 0, sizeof(controls));
+
+    while (i < last && iovNum < BATCH_MAX_PACKETS) {
+        BatchedPacket& segment = packets[i];
+        struct msghdr& msg = msgs[msgNum].msg_hdr;
+
+        firsts[msgNum] = i;
+        msg.msg_name = &segment.dest;
+        msg.msg_namelen = sizeof(segment.dest);
+        msg.msg_iov = &iovs[iovNum];
+        bytes = 0;
+
+        //NOTE: GSO splits a message in datagrams of the segment size, so only its last packet can be shorter
+        do {
+            iovs[iovNum].iov_base = data.data() + packets[i].offset;
+            iovs[iovNum].iov_len = packets[i].size;
+            bytes += packets[i].size;
+            iovNum++;
+            i++;
+        } while (gso && i < last && iovNum < BATCH_MAX_PACKETS &&
+                 packets[i - 1].size == segment.size && packets[i].size <= segment.size &&
+                 bytes + packets[i].size <= BATCH_MAX_BYTES &&
+                 packets[i].dest.sin_addr.s_addr == segment.dest.sin_addr.s_addr &&
+                 packets[i].dest.sin_port == segment.dest.sin_port);
+
+        msg.msg_iovlen = i - firsts[msgNum];
+
+        if (msg.msg_iovlen > 1) {
+            msg.msg_control = controls[msgNum].buf;
+            msg.msg_controllen = sizeof(controls[msgNum].buf);
+            cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            *((uint16_t*) CMSG_DATA(cmsg)) = segment.size;
+        }
+
+        msgNum++;
+    }
+
+    firsts[msgNum] = i;
+
+    ret = sendmmsg(socketNum(), msgs, msgNum, 0);
+    sendCalls++;
+
+    if (ret > 0) {
+        sentPackets += firsts[ret] - first;
+        return firsts[ret];
+    }
+
+    if (errno == EINTR) {
+        return first;
+    }
+
+    if (msgs[0].msg_hdr.msg_iovlen > 1 && (errno == EIO || errno == EINVAL)) {
+        utils::warningMsg("UDP GSO is not supported, RTP packets are sent one by one");
+        gso = false;
+        return first;
+    }
+
+    //NOTE: as it happens with sendto, a packet the socket does not take is dropped
+    return firsts[1];
+}
@@ -0,0 +1,141 @@
+/*
+ *  BatchedGroupsock.hh - Groupsock that sends its packets in batches
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _BATCHED_GROUPSOCK_HH
+#define _BATCHED_GROUPSOCK_HH
+
+#include <vector>
+#include <chrono>
+#include <netinet/in.h>
+#include <Groupsock.hh>
+
+#include "RetransmissionBuffer.hh"
+#include "FECEncoder.hh"
+#include "RidTagger.hh"
+
+#define BATCH_MAX_PACKETS 64        //!< Packets sent by a single system call, it is also the kernel GSO segments limit
+#define BATCH_MAX_BYTES 65000       //!< Bytes of a GSO send, which are sent as a single UDP datagram to the socket
+#define BATCH_MAX_DELAY 500         //!< Time in usec a packet can wait for its batch to be sent
+#define PACING_RATE_WINDOW 1000     //!< Time in msec over which the stream bitrate is measured
+#define PACING_BURST_TIME 2000      //!< Time in usec worth of paced traffic that can be sent at once
+
+/*! Groupsock which queues the packets written to it instead of sending each one with its own sendto call.
+    Batches are sent with sendmmsg once they are full, once their oldest packet is BATCH_MAX_DELAY old or
+    when they are flushed. Runs of packets of the same size going to the same destination are sent as a
+    single UDP GSO message, which the kernel splits in one datagram per packet. GSO is disabled if the
+    kernel or the network device does not support it. Flushing is up to the event loop which writes to it.
+    Batches can be paced with a token bucket filled at a multiple of the measured stream bitrate, which
+    spreads the packets of large frames, such as IDR ones, instead of sending them in a single burst.
+*/
+class BatchedGroupsock : public Groupsock {
+
+public:
+    /**
+    * Class constructor, see Groupsock
+    */
+    BatchedGroupsock(UsageEnvironment& env, struct in_addr const& groupAddr, Port port, u_int8_t ttl);
+
+    /**
+    * Class destructor. Pending packets are sent before closing the socket
+    */
+    virtual ~BatchedGroupsock();
+
+    /**
+    * Queues a packet, it is called by Groupsock::output for each destination
+    * @return true unless the multicast TTL cannot be set
+    */
+    Boolean write(netAddressBits address, portNumBits portNum, u_int8_t ttl,
+                  unsigned char* buffer, unsigned bufferSize);
+
+    /**
+    * Sends the queued packets
+    * @param force if false packets are only sent if the batch is full or old enough
+    */
+    void flush(bool force = true);
+
+    /**
+    * Configures the pacing of the packets
+    * @param factor rate limit as a multiple of the measured stream bitrate, 0 disables pacing
+    * @return false if the factor is lower than 1, which would never drain the queued packets
+    */
+    bool setPacing(float factor);
+
+    float getPacing() const {return pacing;};
+
+    /**
+    * @param buffer history where the written packets are stored for retransmission, NULL disables it
+    */
+    void setHistory(RetransmissionBuffer* buffer) {history = buffer;};
+
+    /**
+    * @param encoder encoder protecting the written packets, whose repair packets are sent to the same
+    *        destination, NULL disables it
+    */
+    void setFECEncoder(FECEncoder* encoder) {fec = encoder;};
+
+    /**
+    * @param tagger tagger adding the RID of its layer to each written packet before it is stored or
+    *        protected, NULL disables it
+    */
+    void setRidTagger(RidTagger* tagger) {rids = tagger;};
+
+    size_t getSentPackets() const {return sentPackets;};
+    size_t getSendCalls() const {return sendCalls;};
+
+private:
+    struct BatchedPacket {
+        size_t offset;
+        unsigned size;
+        struct sockaddr_in dest;
+    };
+
+    void queue(netAddressBits address, portNumBits portNum, unsigned char* buffer, unsigned bufferSize,
+               std::chrono::steady_clock::time_point now);
+    size_t sendMessages(size_t first, size_t last);
+    size_t pacedPackets(std::chrono::steady_clock::time_point now);
+    void measureRate(unsigned size, std::chrono::steady_clock::time_point now);
+    void compact();
+
+    std::vector<unsigned char> data;
+    size_t dataLength;
+    std::vector<BatchedPacket> packets;
+    size_t head;                                        //!< First packet not sent yet
+    std::chrono::steady_clock::time_point batchStart;
+
+    float pacing;
+    double byteRate;                                    //!< Measured stream bitrate in bytes per second
+    size_t windowBytes;
+    std::chrono::steady_clock::time_point windowStart;
+    double tokens;
+    std::chrono::steady_clock::time_point lastRefill;
+
+    RetransmissionBuffer* history;
+    FECEncoder* fec;
+    RidTagger* rids;
+
+    unsigned lastTtl;
+    bool gso;
+    size_t sentPackets;
+    size_t sendCalls;
+};
+
+#endif
@@ -34,7 +34,11 @@
 #include "ADTSQueueServerMediaSubsession.hh"
 #include "ADTSStreamParser.hh"
 #include "CustomMPEG4GenericRTPSink.hh"
+#include "PCMAudioRTPSink.hh"
+#include "AV1VideoRTPSink.hh"
+#include "OpusRepacketizer.hh"
 #include <GroupsockHelper.hh>
+#include <algorithm>
 
 Connection::Connection(UsageEnvironment* env) : 
                         fEnv(env)
@@ -68,10 +72,11 @@ bool Connection::setup()
 ////////////////////
 
 RTSPConnection::RTSPConnection(UsageEnvironment* env, TxFormat txformat, RTSPServer *server,
-                               std::string name_, std::string info, std::string desc) :
+                               std::string name_, std::string info, std::string desc, bool shared_,
+                               unsigned ptime_) :
                                Connection(env), session(NULL), rtspServer(server), 
                                name(name_), subsession(NULL), format(txformat), 
-                               addedSub(false), started(false)
+                               shared(shared_), ptime(ptime_), addedSub(false), started(false)
                    
 {
     session = ServerMediaSession::createNew(*env, name.c_str(), info.c_str(), desc.c_str());
@@ -80,7 +85,7 @@ RTSPConnection::RTSPConnection(UsageEnvironment* env, TxFormat txformat, RTSPSer
     }
     
     if (format == MPEGTS){
-        subsession = MPEGTSQueueServerMediaSubsession::createNew(this, *env, False);
+        subsession = MPEGTSQueueServerMediaSubsession::createNew(this, *env, shared);
     }
 }
 
@@ -137,13 +142,13 @@ bool RTSPConnection::addRawVideoSubsession(VCodecType codec, StreamReplicator* r
 
     switch(codec){
         case H264:
-            sSession = H264QueueServerMediaSubsession::createNew(this, *fEnv, replicator, readerId, False);
+            sSession = H264QueueServerMediaSubsession::createNew(this, *fEnv, replicator, readerId, shared);
             break;
         case H265:
-            sSession = H265QueueServerMediaSubsession::createNew(this, *fEnv, replicator, readerId, False);
+            sSession = H265QueueServerMediaSubsession::createNew(this, *fEnv, replicator, readerId, shared);
             break;
         case VP8:
-            sSession =  VP8QueueServerMediaSubsession::createNew(this, *fEnv, replicator, readerId, False);
+            sSession =  VP8QueueServerMediaSubsession::createNew(this, *fEnv, replicator, readerId, shared);
             break;
         default:
             break;
@@ -167,12 +172,12 @@ bool RTSPConnection::addRawAudioSubsession(ACodecType codec, StreamReplicator* r
     switch(codec) {
         case AAC:
             sSession = ADTSQueueServerMediaSubsession::createNew(this, *fEnv, replicator, readerId, 
-                                                                 channels, sampleRate, False);
+                                                                 channels, sampleRate, shared, ptime);
             break;
         default:
             sSession = AudioQueueServerMediaSubsession::createNew(this, *fEnv, replicator,
                                                               readerId, codec, channels,
-                                                              sampleRate, sampleFormat, False);
+                                                              sampleRate, sampleFormat, shared, ptime);
             break;
     }
     
@@ -314,7 +319,8 @@ bool RTSPConnection::specificSetup()
 RTPConnection::RTPConnection(UsageEnvironment* env, FramedSource* source,
                              std::string ip, unsigned port) :
                              Connection(env), fIp(ip), fPort(port), 
-                             rtcp(NULL), rtpGroupsock(NULL), rtcpGroupsock(NULL),   
+                             rtcp(NULL), rtpGroupsock(NULL), rtcpGroupsock(NULL), rtx(NULL),
+                             fec(NULL), fecRatio(0),
                              fSource(source), fSink(NULL)
 { 
 
@@ -334,6 +340,9 @@ RTPConnection::~RTPConnection()
     if (rtcpGroupsock) {
         delete rtcpGroupsock;
     }
+
+    delete rtx;
+    delete fec;
 }
 
 bool RTPConnection::startPlaying()
@@ -353,6 +362,114 @@ void RTPConnection::stopPlaying()
     if (fSink){
         fSink->stopPlaying();
     }
+
+    flushPackets(true);
+}
+
+void RTPConnection::flushPackets(bool force)
+{
+    if (rtpGroupsock) {
+        rtpGroupsock->flush(force);
+    }
+}
+
+size_t RTPConnection::getSentPackets() const
+{
+    return rtpGroupsock ? rtpGroupsock->getSentPackets() : 0;
+}
+
+size_t RTPConnection::getSendCalls() const
+{
+    return rtpGroupsock ? rtpGroupsock->getSendCalls() : 0;
+}
+
+bool RTPConnection::setPacing(float factor)
+{
+    if (!rtpGroupsock) {
+        return false;
+    }
+
+    return rtpGroupsock->setPacing(factor);
+}
+
+float RTPConnection::getPacing() const
+{
+    return rtpGroupsock ? rtpGroupsock->getPacing() : 0;
+}
+
+bool RTPConnection::setRetransmission(bool enable)
+{
+    RTPSink* rtpSink = dynamic_cast<RTPSink*>(fSink);
+    u_int32_t ssrc;
+
+    if (!rtpGroupsock || !rtcp || !rtpSink) {
+        return false;
+    }
+
+    if (enable && !rtx) {
+        do {
+            ssrc = our_random32();
+        } while (ssrc == rtpSink->SSRC() || ssrc == getFecSSRC());
+
+        rtx = new RetransmissionBuffer(ssrc, our_random32() & 0xFFFF);
+        rtpGroupsock->setHistory(rtx);
+        rtcp->setNackHandler(std::bind(&RTPConnection::retransmit, this, std::placeholders::_1));
+    } else if (!enable && rtx) {
+        rtcp->setNackHandler(NULL);
+        rtpGroupsock->setHistory(NULL);
+        delete rtx;
+        rtx = NULL;
+    }
+
+    return true;
+}
+
+bool RTPConnection::setFEC(float ratio)
+{
+    RTPSink* rtpSink = dynamic_cast<RTPSink*>(fSink);
+    unsigned columns;
+    unsigned rows;
+    u_int32_t ssrc;
+
+    if (!rtpGroupsock || !rtpSink) {
+        return false;
+    }
+
+    if (ratio != 0 && !FECEncoder::matrixSize(ratio, columns, rows)) {
+        utils::errorMsg("FEC ratio must be 0 (disabled) or between " + std::to_string(FEC_MIN_RATIO) + " and 1");
+        return false;
+    }
+
+    rtpGroupsock->setFECEncoder(NULL);
+    delete fec;
+    fec = NULL;
+    fecRatio = ratio;
+
+    if (ratio == 0) {
+        return true;
+    }
+
+    do {
+        ssrc = our_random32();
+    } while (ssrc == rtpSink->SSRC() || ssrc == getRtxSSRC());
+
+    fec = new FECEncoder(rtpSink->SSRC(), ssrc, our_random32() & 0xFFFF, columns, rows);
+    rtpGroupsock->setFECEncoder(fec);
+
+    return true;
+}
+
+bool RTPConnection::retransmit(uint16_t seq)
+{
+    unsigned char packet[RTX_MAX_PACKET_SIZE];
+    unsigned size;
+
+    if (!rtx || !(size = rtx->retransmission(seq, packet))) {
+        return false;
+    }
+
+    //NOTE: RTX packets are batched and paced with the stream, they are sent to its single destination
+    return rtpGroupsock->write(destinationAddress.s_addr, Port(fPort).num(), TTL, packet, size);
 }
 
 bool RTPConnection::specificSetup() 
@@ -386,8 +503,8 @@ bool RTPConnection::firstStepSetup()
     const Port rtcpPort(fPort+1);
     
     for (;;serverPort+=2){
-        rtpGroupsock = new Groupsock(*fEnv, destinationAddress, Port(serverPort), TTL);
-        rtcpGroupsock = new Groupsock(*fEnv, destinationAddress, Port(serverPort+1), TTL);
+        rtpGroupsock = new BatchedGroupsock(*fEnv, destinationAddress, Port(serverPort), TTL);
+        rtcpGroupsock = new FeedbackGroupsock(*fEnv, destinationAddress, Port(serverPort+1), TTL);
         if (rtpGroupsock->socketNum() < 0 || rtcpGroupsock->socketNum() < 0) {
             delete rtpGroupsock;
             delete rtcpGroupsock;
@@ -422,6 +539,8 @@ bool RTPConnection::finalRTCPSetup()
     rtcp = ConnRTCPInstance::createNew(this, envir(), rtcpGroupsock, 5000, rtpSink);
     rtcp->setId(this->getPort());
     this->addConnectionRTCPInstance(this->getPort(), rtcp);
+    rtcpGroupsock->setFeedbackHandler(std::bind(&ConnRTCPInstance::handleFeedback, rtcp,
+                                                std::placeholders::_1, std::placeholders::_2));
 
     return true;
 }
@@ -451,6 +570,12 @@ bool VideoConnection::additionalSetup()
         case VP8:
             fSink = VP8VideoRTPSink::createNew(*fEnv, rtpGroupsock, 96);
             break;
+        case VP9:
+            fSink = VP9VideoRTPSink::createNew(*fEnv, rtpGroupsock, 96);
+            break;
+        case AV1:
+            fSink = AV1VideoRTPSink::createNew(*fEnv, rtpGroupsock, 96);
+            break;
         default:
             fSink = NULL;
             break;
@@ -473,10 +598,10 @@ std::vector<int> VideoConnection::getReaders()
 AudioConnection::AudioConnection(UsageEnvironment* env, FramedSource *source,
                                  std::string ip, unsigned port, ACodecType codec,
                                  unsigned channels, unsigned sampleRate, 
-                                 SampleFmt sampleFormat, int readerId) :
+                                 SampleFmt sampleFormat, int readerId, unsigned ptime) :
                                  RTPConnection(env, source, ip, port), fCodec(codec),
                                  fChannels(channels), fSampleRate(sampleRate),
-                                 fSampleFormat(sampleFormat), reader(readerId)
+                                 fSampleFormat(sampleFormat), fPtime(ptime), reader(readerId)
 {
     
 }
@@ -507,8 +632,15 @@ bool AudioConnection::additionalSetup()
     } else if (fCodec == AAC) {
         fSource = ADTSStreamParser::createNew(*fEnv, fSource);
         fSink = CustomMPEG4GenericRTPSink::createNew(*fEnv, rtpGroupsock, payloadType, 
-                                                     fSampleRate, "audio", "AAC-hbr", fChannels);
+                                                     fSampleRate, "audio", "AAC-hbr", fChannels, fPtime);
+    } else if (fPtime > 0 && fCodec != OPUS) {
+        fSink = PCMAudioRTPSink::createNew(*fEnv, rtpGroupsock, payloadType, fCodec, fChannels,
+                                           fSampleRate, fSampleFormat, codecStr.c_str(), fPtime);
     } else {
+        if (fCodec == OPUS && fPtime > 0) {
+            fSource = OpusRepacketizer::createNew(*fEnv, fSource, fPtime);
+        }
+
         fSink =  SimpleRTPSink::createNew(*fEnv, rtpGroupsock, payloadType,
                                          fSampleRate, "audio", 
                                          codecStr.c_str(),
@@ -529,6 +661,157 @@ std::vector<int> AudioConnection::getReaders()
     return readers;
 }
 
+//////////////////////////////
+// SIMULCAST RTP CONNECTION //
+//////////////////////////////
+
+SimulcastConnection::SimulcastConnection(UsageEnvironment* env, std::vector<FramedSource*> sources,
+                                         std::vector<H264or5QueueSource*> parameterSets,
+                                         std::vector<const StreamInfo*> infos, std::vector<int> readerIds,
+                                         std::string ip, unsigned port, VCodecType codec, bool forwarding) :
+                                         RTPConnection(env, NULL, ip, port), fCodec(codec),
+                                         fForwarding(forwarding), fSources(sources),
+                                         fParameterSets(parameterSets), fInfos(infos), readers(readerIds),
+                                         selector(NULL)
+{
+
+}
+
+SimulcastConnection::~SimulcastConnection()
+{
+    for (auto sink : layerSinks) {
+        sink->stopPlaying();
+        Medium::close(sink);
+    }
+
+    if (rtpGroupsock) {
+        rtpGroupsock->setRidTagger(NULL);
+    }
+}
+
+MediaSink* SimulcastConnection::createSink(FramedSource* &source)
+{
+    switch(fCodec){
+        case H264:
+            source = H264VideoStreamDiscreteFramer::createNew(*fEnv, source);
+            return H264VideoRTPSink::createNew(*fEnv, rtpGroupsock, 96);
+        case H265:
+            source = H265VideoStreamDiscreteFramer::createNew(*fEnv, source);
+            return H265VideoRTPSink::createNew(*fEnv, rtpGroupsock, 96);
+        default:
+            return NULL;
+    }
+}
+
+bool SimulcastConnection::specificSetup()
+{
+    if (!RTPConnection::specificSetup()) {
+        return false;
+    }
+
+    //NOTE: the RTCP instance is created once the sink exists, the estimate is read for each layer NAL unit
+    if (selector) {
+        selector->setTargetBitrate([this]() {return rtcp->getTargetBitrate();});
+    }
+
+    return true;
+}
+
+bool SimulcastConnection::additionalSetup()
+{
+    FramedSource* source;
+    MediaSink* sink;
+
+    if (fSources.empty()) {
+        utils::errorMsg("Simulcast connections need at least one layer");
+        return false;
+    }
+
+    if (fForwarding) {
+        selector = SimulcastSource::createNew(*fEnv, fCodec, fSources, fParameterSets, fInfos);
+
+        if (!selector) {
+            return false;
+        }
+
+        fSource = selector;
+        fSink = createSink(fSource);
+
+        return fSink != NULL;
+    }
+
+    //NOTE: the first layer is the one of the RTCP instance, its sink is handled by RTPConnection
+    fSource = fSources.front();
+    fSink = createSink(fSource);
+
+    if (!fSink) {
+        return false;
+    }
+
+    tagger.setRid(dynamic_cast<RTPSink*>(fSink)->SSRC(), getRid(0));
+
+    for (unsigned i = 1; i < fSources.size(); i++) {
+        source = fSources[i];
+
+        if (!(sink = createSink(source))) {
+            return false;
+        }
+
+        tagger.setRid(dynamic_cast<RTPSink*>(sink)->SSRC(), getRid(i));
+        layerSources.push_back(source);
+        layerSinks.push_back(sink);
+    }
+
+    rtpGroupsock->setRidTagger(&tagger);
+
+    return true;
+}
+
+bool SimulcastConnection::startPlaying()
+{
+    if (!RTPConnection::startPlaying()) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < layerSinks.size(); i++) {
+        layerSinks[i]->startPlaying(*layerSources[i], &Connection::afterPlaying, layerSinks[i]);
+    }
+
+    return true;
+}
+
+void SimulcastConnection::stopPlaying()
+{
+    for (auto sink : layerSinks) {
+        sink->stopPlaying();
+    }
+
+    RTPConnection::stopPlaying();
+}
+
+std::vector<uint32_t> SimulcastConnection::getLayerSSRCs()
+{
+    std::vector<uint32_t> ssrcs;
+    RTPSink* rtpSink;
+
+    if ((rtpSink = dynamic_cast<RTPSink*>(fSink))) {
+        ssrcs.push_back(rtpSink->SSRC());
+    }
+
+    for (auto sink : layerSinks) {
+        if ((rtpSink = dynamic_cast<RTPSink*>(sink))) {
+            ssrcs.push_back(rtpSink->SSRC());
+        }
+    }
+
+    return ssrcs;
+}
+
+std::vector<int> SimulcastConnection::getReaders()
+{
+    return readers;
+}
+
 ///////////////////////////////
 // ULTRAGRID RTP CONNECTIONS //
 ///////////////////////////////
@@ -611,13 +894,9 @@ std::vector<int> UltraGridAudioConnection::getReaders()
 // MPEG-TS CONNECTION //
 ////////////////////////
 
-MpegTsConnection::MpegTsConnection(UsageEnvironment* env, std::string ip, unsigned port) 
-: RTPConnection(env, NULL, ip, port), audioReader(-1), videoReader(-1)
-{
-    tsFramer = MPEG2TransportStreamFromESSource::createNew(*env);
-}
-
-bool MpegTsConnection::addVideoSource(FramedSource* source, VCodecType codec, int readerId)
+//NOTE: MpegTsConnection and SRTConnection mux their sources the same way
+static bool addTsVideoSource(UsageEnvironment* env, MPEGTSMuxer* tsMuxer,
+                             FramedSource* source, VCodecType codec, int readerId, int &videoReader)
 {
     FramedSource* startCodeInjector;
     
@@ -626,8 +905,8 @@ bool MpegTsConnection::addVideoSource(FramedSource* source, VCodecType codec, in
         return false;
     }
 
-    if (!tsFramer) {
-        utils::errorMsg("Error creating MPEG-TS Connection. MPEG2TransportStreamFromESSource is NULL");
+    if (!tsMuxer) {
+        utils::errorMsg("Error creating MPEG-TS Connection. MPEG-TS muxer is NULL");
         return false;
     }
 
@@ -643,22 +922,20 @@ bool MpegTsConnection::addVideoSource(FramedSource* source, VCodecType codec, in
         return false;
     }
         
-    startCodeInjector = H264or5StartCodeInjector::createNew(*fEnv, source, codec);
-    if (codec == H264) tsFramer->addNewVideoSource(startCodeInjector, 5/*mpegVersion: H.264*/);
-    if (codec == H265) tsFramer->addNewVideoSource(startCodeInjector, 6/*mpegVersion: H.265*/);
-
-    return true;
+    startCodeInjector = H264or5StartCodeInjector::createNew(*env, source, codec);
+    return tsMuxer->addVideoSource(startCodeInjector, codec);
 }
 
-bool MpegTsConnection::addAudioSource(FramedSource* source, ACodecType codec, int readerId)
+static bool addTsAudioSource(MPEGTSMuxer* tsMuxer,
+                             FramedSource* source, ACodecType codec, int readerId, int &audioReader)
 {
     if (codec != AAC && codec != MP3) {
         utils::errorMsg("Error creating MPEG-TS Connection. Only AAC and MP3 audio codecs are valid");
         return false;
     }
 
-    if (!tsFramer) {
-        utils::errorMsg("Error creating MPEG-TS Connection. MPEG2TransportStreamFromESSource is NULL");
+    if (!tsMuxer) {
+        utils::errorMsg("Error creating MPEG-TS Connection. MPEG-TS muxer is NULL");
         return false;
     }
 
@@ -674,20 +951,33 @@ bool MpegTsConnection::addAudioSource(FramedSource* source, ACodecType codec, in
         return false;
     }
 
-    if (codec == AAC) tsFramer->addNewAudioSource(source, 4/*mpegVersion: AAC*/);
-    if (codec == MP3) tsFramer->addNewAudioSource(source, 1/*mpegVersion: MP3*/);
-    
-    return true;
+    return tsMuxer->addAudioSource(source, codec);
+}
+
+MpegTsConnection::MpegTsConnection(UsageEnvironment* env, std::string ip, unsigned port) 
+: RTPConnection(env, NULL, ip, port), audioReader(-1), videoReader(-1)
+{
+    tsMuxer = MPEGTSMuxer::createNew(*env);
+}
+
+bool MpegTsConnection::addVideoSource(FramedSource* source, VCodecType codec, int readerId)
+{
+    return addTsVideoSource(fEnv, tsMuxer, source, codec, readerId, videoReader);
+}
+
+bool MpegTsConnection::addAudioSource(FramedSource* source, ACodecType codec, int readerId)
+{
+    return addTsAudioSource(tsMuxer, source, codec, readerId, audioReader);
 }
     
 bool MpegTsConnection::additionalSetup()
 {
-    if (!tsFramer) {
-        utils::errorMsg("Error creating MPEG-TS Connection. MPEG2TransportStreamFromESSource is NULL");
+    if (!tsMuxer) {
+        utils::errorMsg("Error creating MPEG-TS Connection. MPEG-TS muxer is NULL");
         return false;
     }
     
-    fSource = tsFramer;
+    fSource = tsMuxer;
 
     fSink = SimpleRTPSink::createNew(*fEnv, rtpGroupsock, 33, 90000, "video", 
                                      "MP2T", 1, True, False /*no 'M' bit*/);
@@ -714,6 +1004,249 @@ std::vector<int> MpegTsConnection::getReaders()
     return readers;
 }
 
+////////////////////
+// SRT CONNECTION //
+////////////////////
+
+SRTConnection::SRTConnection(UsageEnvironment* env, std::string ip, unsigned port, SRTMode mode, unsigned latency) :
+Connection(env), fIp(ip), fPort(port), fMode(mode), fLatency(latency), fSink(NULL), audioReader(-1), videoReader(-1)
+{
+    tsMuxer = MPEGTSMuxer::createNew(*env);
+}
+
+SRTConnection::~SRTConnection()
+{
+    stopPlaying();
+    Medium::close(fSink);
+    Medium::close(tsMuxer);
+}
+
+bool SRTConnection::addVideoSource(FramedSource* source, VCodecType codec, int readerId)
+{
+    return addTsVideoSource(fEnv, tsMuxer, source, codec, readerId, videoReader);
+}
+
+bool SRTConnection::addAudioSource(FramedSource* source, ACodecType codec, int readerId)
+{
+    return addTsAudioSource(tsMuxer, source, codec, readerId, audioReader);
+}
+
+bool SRTConnection::specificSetup()
+{
+    if (!tsMuxer) {
+        utils::errorMsg("Error creating SRT Connection. MPEG-TS muxer is NULL");
+        return false;
+    }
+
+    if (audioReader == -1 && videoReader == -1) {
+        utils::errorMsg("Error setting up SRT Connection. It has no sources");
+        return false;
+    }
+
+    fSink = SRTSink::createNew(*fEnv, fIp, fPort, fMode, fLatency);
+
+    if (!fSink) {
+        utils::errorMsg("Error setting up SRT Connection. Sink could not be created");
+        return false;
+    }
+
+    return true;
+}
+
+bool SRTConnection::startPlaying()
+{
+    if (!fSink || !tsMuxer) {
+        utils::errorMsg("Cannot start playing, sink and/or source does not exist.");
+        return false;
+    }
+
+    fSink->startPlaying(*tsMuxer, &Connection::afterPlaying, fSink);
+
+    return true;
+}
+
+void SRTConnection::stopPlaying()
+{
+    if (fSink) {
+        fSink->stopPlaying();
+    }
+}
+
+std::vector<SRTPeerStats> SRTConnection::getStats()
+{
+    if (!fSink) {
+        return std::vector<SRTPeerStats>();
+    }
+
+    return fSink->getStats();
+}
+
+std::vector<int> SRTConnection::getReaders()
+{
+    std::vector<int> readers;
+    if (audioReader != -1){
+        readers.push_back(audioReader);
+    }
+    
+    if (videoReader != -1){
+        readers.push_back(videoReader);
+    }
+    
+    return readers;
+}
+
+///////////////////////
+// WEBRTC CONNECTION //
+///////////////////////
+
+WebRTCConnection::WebRTCConnection(UsageEnvironment* env, WebRTCServer* server, std::string name) :
+Connection(env), fServer(server), fName(name), published(false), videoSource(NULL), audioSource(NULL),
+videoCodec(VC_NONE), fParameterSets(NULL), videoSink(NULL), audioSink(NULL), audioReader(-1), videoReader(-1)
+{
+}
+
+WebRTCConnection::~WebRTCConnection()
+{
+    stopPlaying();
+
+    if (published) {
+        fServer->removeStream(fName);
+    }
+
+    Medium::close(videoSink);
+    Medium::close(audioSink);
+}
+
+bool WebRTCConnection::addVideoSource(FramedSource* source, VCodecType codec, int readerId,
+                                      H264or5QueueSource* parameterSets)
+{
+    if (codec != H264 && codec != VP8) {
+        utils::errorMsg("Error creating WebRTC Connection. Only H264 and VP8 video codecs are valid");
+        return false;
+    }
+
+    if (!source) {
+        utils::errorMsg("Error adding video source to WebRTC Connection. Provided source is NULL");
+        return false;
+    }
+
+    if (videoReader != -1) {
+        utils::errorMsg("Error video reader ID was already set.");
+        return false;
+    }
+
+    videoReader = readerId;
+    videoSource = source;
+    videoCodec = codec;
+    fParameterSets = parameterSets;
+    return true;
+}
+
+bool WebRTCConnection::addAudioSource(FramedSource* source, ACodecType codec, int readerId)
+{
+    if (codec != OPUS) {
+        utils::errorMsg("Error creating WebRTC Connection. Only OPUS audio codec is valid");
+        return false;
+    }
+
+    if (!source) {
+        utils::errorMsg("Error adding audio source to WebRTC Connection. Provided source is NULL");
+        return false;
+    }
+
+    if (audioReader != -1) {
+        utils::errorMsg("Error audio reader ID was already set.");
+        return false;
+    }
+
+    audioReader = readerId;
+    audioSource = source;
+    return true;
+}
+
+bool WebRTCConnection::specificSetup()
+{
+    if (!fServer) {
+        utils::errorMsg("Error setting up WebRTC Connection. WebRTC server is NULL");
+        return false;
+    }
+
+    if (!videoSource && !audioSource) {
+        utils::errorMsg("Error setting up WebRTC Connection. It has no sources");
+        return false;
+    }
+
+    if (videoSource) {
+        videoSink = WebRTCSink::createNew(*fEnv, fServer, fName, videoCodec == H264 ? WEBRTC_H264 : WEBRTC_VP8,
+                                          fParameterSets);
+    }
+
+    if (audioSource) {
+        audioSink = WebRTCSink::createNew(*fEnv, fServer, fName, WEBRTC_OPUS);
+    }
+
+    if ((videoSource && !videoSink) || (audioSource && !audioSink)) {
+        utils::errorMsg("Error setting up WebRTC Connection. Sink could not be created");
+        return false;
+    }
+
+    published = fServer->addStream(fName, videoSink ? videoSink->getPacketizer() : NULL,
+                                   audioSink ? audioSink->getPacketizer() : NULL);
+    return published;
+}
+
+bool WebRTCConnection::startPlaying()
+{
+    if (!videoSink && !audioSink) {
+        utils::errorMsg("Cannot start playing, sink and/or source does not exist.");
+        return false;
+    }
+
+    if (videoSink) {
+        videoSink->startPlaying(*videoSource, &Connection::afterPlaying, videoSink);
+    }
+
+    if (audioSink) {
+        audioSink->startPlaying(*audioSource, &Connection::afterPlaying, audioSink);
+    }
+
+    return true;
+}
+
+void WebRTCConnection::stopPlaying()
+{
+    if (videoSink) {
+        videoSink->stopPlaying();
+    }
+
+    if (audioSink) {
+        audioSink->stopPlaying();
+    }
+}
+
+std::vector<WebRTCViewerStats> WebRTCConnection::getViewers()
+{
+    if (!published) {
+        return std::vector<WebRTCViewerStats>();
+    }
+
+    return fServer->getViewers(fName);
+}
+
+std::vector<int> WebRTCConnection::getReaders()
+{
+    std::vector<int> readers;
+    if (audioReader != -1){
+        readers.push_back(audioReader);
+    }
+
+    if (videoReader != -1){
+        readers.push_back(videoReader);
+    }
+
+    return readers;
+}
+
 // Implementation of "ConnRTCPInstance" class:
 
 ConnRTCPInstance* ConnRTCPInstance::createNew(Connection* conn, UsageEnvironment* env, Groupsock* RTCPgs,
@@ -735,10 +1268,12 @@ ConnRTCPInstance::ConnRTCPInstance(Connection* conn, UsageEnvironment* env, Grou
     packetLossRatio(0), minPacketLossRatio(100), maxPacketLossRatio(0),
     avgBitrate(0), minBitrate(1000000), maxBitrate(0),
     roundTripDelay(0), minRoundTripDelay(1000000), maxRoundTripDelay(0),
-    jitter(0), minJitter(1000000), maxJitter(0)
+    jitter(0), minJitter(1000000), maxJitter(0), nackedPackets(0)
 {
     struct timeval startTime;
     gettimeofday(&startTime, NULL);
+    lastReportTime.tv_sec = 0;
+    lastReportTime.tv_usec = 0;
     nextStatsMeasurementUSecs = startTime.tv_sec*1000000 + startTime.tv_usec;
     scheduleNextConnStatMeasurement();
 }
@@ -775,6 +1310,9 @@ void ConnRTCPInstance::periodicStatMeasurement(struct timeval const& timeNow)
 {
     unsigned currentNumBytes;
     double currentElapsedTime;
+    struct timeval reportTime = lastReportTime;
+    float worstLoss = 0;
+    unsigned worstRtt = 0;
 
     RTPTransmissionStatsDB::Iterator statsIter(fSink->transmissionStatsDB());
 
@@ -798,5 +1336,63 @@ void ConnRTCPInstance::periodicStatMeasurement(struct timeval const& timeNow)
         jitter = stats->jitter();
         if(minJitter > jitter) minJitter = jitter;
         if(maxJitter < jitter) maxJitter = jitter;
+
+        //NOTE: loss is the RTCP fraction lost (1/256 units) and the delay is in 1/65536 seconds units
+        if (timercmp(&stats->lastTimeReceived(), &lastReportTime, >)) {
+            worstLoss = std::max(worstLoss, packetLossRatio/256.0f);
+            worstRtt = std::max(worstRtt, (unsigned) (roundTripDelay*1000/65536));
+            if (timercmp(&stats->lastTimeReceived(), &reportTime, >)) {
+                reportTime = stats->lastTimeReceived();
+            }
+        }
+    }
+
+    //NOTE: the estimate is only updated by new receiver reports, stats are polled more often
+    if (timercmp(&reportTime, &lastReportTime, >)) {
+        lastReportTime = reportTime;
+        controller.update(worstLoss, worstRtt, avgBitrate);
+    }
+}
+
+void ConnRTCPInstance::handleFeedback(unsigned char const* packet, unsigned size)
+{
+    unsigned length;
+    unsigned offset;
+    u_int32_t mediaSSRC;
+    u_int16_t pid;
+    u_int16_t blp;
+
+    //NOTE: each packet of the compound packet is skipped using its length, in 32 bit words minus one
+    while (size >= 4) {
+        length = (((packet[2] << 8) | packet[3]) + 1)*4;
+
+        if ((packet[0] >> 6) != 2 || length > size) {
+            return;
+        }
+
+        mediaSSRC = length >= 12 ? (packet[8] << 24) | (packet[9] << 16) | (packet[10] << 8) | packet[11] : 0;
+
+        if (packet[1] == RTCP_RTPFB && (packet[0] & 0x1F) == RTCP_RTPFB_NACK &&
+            length >= 12 && mediaSSRC == fSink->SSRC()) {
+            //NOTE: each FCI is a lost packet id followed by a bitmask of the 16 next lost packets
+            for (offset = 12; offset + 4 <= length; offset += 4) {
+                pid = (packet[offset] << 8) | packet[offset + 1];
+                blp = (packet[offset + 2] << 8) | packet[offset + 3];
+
+                for (unsigned i = 0; i <= 16; i++) {
+                    if (i > 0 && !(blp & (1 << (i - 1)))) {
+                        continue;
+                    }
+
+                    nackedPackets++;
+                    if (nackHandler) {
+                        nackHandler(pid + i);
+                    }
+                }
+            }
+        }
+
+        packet += length;
+        size -= length;
     }
 }
@@ -33,10 +33,23 @@
 #include <Groupsock.hh>
 
 #include "../../Types.hh"
+#include "../../BitrateController.hh"
 #include "MPEGTSQueueServerMediaSubsession.hh"
+#include "BatchedGroupsock.hh"
+#include "FeedbackGroupsock.hh"
+#include "RetransmissionBuffer.hh"
+#include "FECEncoder.hh"
+#include "SRTSink.hh"
+#include "WebRTCSink.hh"
+#include "SimulcastSource.hh"
+#include "RidTagger.hh"
+#include "MPEGTSMuxer.hh"
 
 #define TTL 255
+#define MAX_AUDIO_PTIME 120             //!< Longest audio duration in msec packed in an RTP packet
 #define INITIAL_SERVER_PORT 6970
+#define RTCP_RTPFB 205                  //!< RTCP transport layer feedback packet type (RFC 4585)
+#define RTCP_RTPFB_NACK 1               //!< Generic NACK feedback message type
 
 class ConnRTCPInstance;
 class ConnectionSubsessionStats;
@@ -106,7 +119,9 @@ protected:
 // RTSP CONNECTION //
 ////////////////////
 
-/*! It represents an RTSP connection, which is defined by a name, format and former readers */
+/*! It represents an RTSP connection, which is defined by a name, format and former readers. Shared connections
+    build the RTP packets of each subsession once and send them to all its unicast clients, otherwise each
+    client gets its own stream replica and RTP packetisation */
 
 class RTSPConnection : public Connection {
 
@@ -116,7 +131,8 @@ public:
     * Class destructor
     */
     RTSPConnection(UsageEnvironment* env, TxFormat txformat, RTSPServer* server,
-                   std::string name_, std::string info = "", std::string desc = "");
+                   std::string name_, std::string info = "", std::string desc = "", bool shared_ = false,
+                   unsigned ptime_ = 0);
     
     /**
     * Class destructor
@@ -155,6 +171,16 @@ public:
     * @return it returns the RTSPConnection name
     */
     std::string getName() const {return name;};
+
+    /**
+    * @return true if the clients of each subsession share its RTP packets
+    */
+    bool isShared() const {return shared;};
+
+    /**
+    * @return audio duration in msec packed in each RTP packet of the audio subsessions, 0 if it is not set
+    */
+    unsigned getPtime() const {return ptime;};
     
     /**
     * It returns the list of associated readers of this connection
@@ -191,6 +217,8 @@ private:
     MPEGTSQueueServerMediaSubsession* subsession;
     
     TxFormat format;
+    bool shared;
+    unsigned ptime;
     bool addedSub;
     bool started;
 };
@@ -216,6 +244,57 @@ public:
     std::string getIP() const {return fIp;};
     unsigned getPort() const {return fPort;};
 
+    /**
+    * Sends the RTP packets batched by the event loop, see BatchedGroupsock
+    * @param force if false packets are only sent if their batch is full or old enough
+    */
+    void flushPackets(bool force = false);
+
+    size_t getSentPackets() const;
+    size_t getSendCalls() const;
+
+    /**
+    * Paces the RTP packets so large frames are spread instead of sent in a burst, see BatchedGroupsock
+    * @param factor rate limit as a multiple of the stream bitrate, 0 disables pacing
+    * @return false if the connection is not set up or the factor is not valid
+    */
+    bool setPacing(float factor);
+    float getPacing() const;
+
+    /**
+    * Retransmits the packets reported as lost by the receivers generic NACKs using RTX (RFC 4588),
+    * which is sent SSRC multiplexed with the payload type RTX_PAYLOAD_TYPE, see RetransmissionBuffer
+    * @param enable true keeps the history of sent packets and answers NACKs, false disables it
+    * @return false if the connection is not set up
+    */
+    bool setRetransmission(bool enable);
+    bool getRetransmission() const {return rtx != NULL;};
+
+    /**
+    * Sends the RTX packet of a sent packet
+    * @param seq sequence number of the lost packet
+    * @return false if retransmission is disabled or the packet cannot be retransmitted
+    */
+    bool retransmit(uint16_t seq);
+
+    uint32_t getRtxSSRC() const {return rtx ? rtx->getSSRC() : 0;};
+    size_t getRetransmittedPackets() const {return rtx ? rtx->getRetransmitted() : 0;};
+    size_t getUnrecoverablePackets() const {return rtx ? rtx->getUnrecoverable() : 0;};
+
+    /**
+    * Protects the RTP packets with FlexFEC (RFC 8627) row and column parity, see FECEncoder. Repair
+    * packets are sent SSRC multiplexed with the payload type FEC_PAYLOAD_TYPE
+    * @param ratio repair packets per protected packet, from FEC_MIN_RATIO to 1, 0 disables FEC
+    * @return false if the connection is not set up or the ratio is not valid
+    */
+    bool setFEC(float ratio);
+    float getFEC() const {return fec ? fecRatio : 0;};
+
+    uint32_t getFecSSRC() const {return fec ? fec->getSSRC() : 0;};
+    unsigned getFecColumns() const {return fec ? fec->getColumns() : 0;};
+    unsigned getFecRows() const {return fec ? fec->getRows() : 0;};
+    size_t getFecPackets() const {return fec ? fec->getRepairPackets() : 0;};
+
 protected:
     RTPConnection(UsageEnvironment* env, FramedSource* source,
                   std::string ip, unsigned port);
@@ -227,8 +306,11 @@ protected:
     unsigned fPort;
     struct in_addr destinationAddress;
     ConnRTCPInstance* rtcp;
-    Groupsock *rtpGroupsock;
-    Groupsock *rtcpGroupsock;
+    BatchedGroupsock *rtpGroupsock;
+    FeedbackGroupsock *rtcpGroupsock;
+    RetransmissionBuffer* rtx;
+    FECEncoder* fec;
+    float fecRatio;
     
     FramedSource* fSource;
     MediaSink* fSink;
@@ -263,9 +345,15 @@ class AudioConnection : public RTPConnection {
 public:
     AudioConnection(UsageEnvironment* env, FramedSource *source,
                     std::string ip, unsigned port, ACodecType codec,
-                    unsigned channels, unsigned sampleRate, SampleFmt sampleFormat, int readerId);
+                    unsigned channels, unsigned sampleRate, SampleFmt sampleFormat, int readerId,
+                    unsigned ptime = 0);
     
     std::vector<int> getReaders();
+
+    /**
+    * @return audio duration in msec packed in each RTP packet, 0 if it is not set
+    */
+    unsigned getPtime() const {return fPtime;};
     
 protected:
     bool additionalSetup();
@@ -275,10 +363,90 @@ private:
     unsigned fChannels;
     unsigned fSampleRate;
     SampleFmt fSampleFormat;
+    unsigned fPtime;
     
     int reader;
 };
 
+//////////////////////////////
+// SIMULCAST RTP CONNECTION //
+//////////////////////////////
+
+/*! It represents the layers of a ladder encoder sent in a single RTP session. By default each layer is
+*   sent with its own SSRC and the RID of its position in the readers list (r0, r1...) in the RFC 8852
+*   header extension RID_EXTENSION_ID; RTCP reports are sent and received for the first layer. In
+*   forwarding mode, a single layer is sent and switched at its IRAP pictures to the one fitting the
+*   bitrate estimated from the RTCP receiver reports, see SimulcastSelector, so each receiver gets the
+*   rendition its path can carry without a transcoding of its own.
+*/
+
+class SimulcastConnection : public RTPConnection {
+public:
+    /**
+    * Class constructor
+    * @param env Live555 UsageEnvironement
+    * @param sources replicas of the layers readers
+    * @param parameterSets sources of the layers readers, see SimulcastSource
+    * @param infos StreamInfo of the layers readers
+    * @param readerIds layers readers
+    * @param ip Destination IP
+    * @param port Destination port
+    * @param codec Video codec of the layers, H264 or H265
+    * @param forwarding true sends a single layer switched from the receiver reports
+    */
+    SimulcastConnection(UsageEnvironment* env, std::vector<FramedSource*> sources,
+                        std::vector<H264or5QueueSource*> parameterSets, std::vector<const StreamInfo*> infos,
+                        std::vector<int> readerIds, std::string ip, unsigned port, VCodecType codec,
+                        bool forwarding);
+
+    /**
+    * Class destructor
+    */
+    ~SimulcastConnection();
+
+    std::vector<int> getReaders();
+    bool startPlaying();
+    void stopPlaying();
+
+    bool isForwarding() const {return fForwarding;};
+
+    /**
+    * @return SSRC of each layer sink, a single one in forwarding mode
+    */
+    std::vector<uint32_t> getLayerSSRCs();
+
+    /**
+    * @return RID of a layer
+    */
+    std::string getRid(unsigned layer) const {return "r" + std::to_string(layer);};
+    unsigned char getRidExtensionId() const {return tagger.getExtensionId();};
+
+    /**
+    * @return index of the forwarded layer, -1 if there is none yet or in simulcast mode
+    */
+    int getForwardedLayer() const {return selector ? selector->getLayer() : -1;};
+    size_t getLayerSwitches() const {return selector ? selector->getSwitches() : 0;};
+
+protected:
+    bool specificSetup();
+    bool additionalSetup();
+
+private:
+    MediaSink* createSink(FramedSource* &source);
+
+    VCodecType fCodec;
+    bool fForwarding;
+    std::vector<FramedSource*> fSources;
+    std::vector<H264or5QueueSource*> fParameterSets;
+    std::vector<const StreamInfo*> fInfos;
+    std::vector<int> readers;
+
+    SimulcastSource* selector;
+    std::vector<FramedSource*> layerSources;    //!< Layers other than the first one, in simulcast mode
+    std::vector<MediaSink*> layerSinks;
+    RidTagger tagger;
+};
+
 ///////////////////////////////
 // ULTRAGRID RTP CONNECTIONS //
 ///////////////////////////////
@@ -363,12 +531,158 @@ protected:
     bool additionalSetup();
 
 private:
-    MPEG2TransportStreamFromESSource* tsFramer;
+    MPEGTSMuxer* tsMuxer;
     
     int audioReader;
     int videoReader;
 };
 
+////////////////////
+// SRT CONNECTION //
+////////////////////
+
+/*! It represents an SRT transmission of an MPEG-TS stream, muxed as MpegTsConnection does, in caller
+*   or listener mode. It is limited to one video stream and/or one audio stream.
+*/
+
+class SRTConnection : public Connection {
+public:
+    /**
+    * Class constructor
+    * @param env Live555 UsageEnvironement
+    * @param ip Destination IP in caller mode, local IP in listener mode (empty for any)
+    * @param port Destination port in caller mode, local port in listener mode
+    * @param mode SRT_CALLER or SRT_LISTENER
+    * @param latency SRT receiver buffering in msec
+    */
+    SRTConnection(UsageEnvironment* env, std::string ip, unsigned port, SRTMode mode,
+                  unsigned latency = SRT_DEFAULT_LATENCY);
+
+    /**
+    * Class destructor, it closes the SRT sockets
+    */
+    ~SRTConnection();
+
+    /**
+    * Adds a video source to the connection, which will be muxed in MPEGTS packets
+    * @param source Stream source, which must be a children of Live555 FramedSource class
+    * @param codec Video stream codec. Only H264 and H265 are supported
+    * @return True if succeeded and false if not
+    */
+    bool addVideoSource(FramedSource* source, VCodecType codec, int readerId);
+
+    /**
+    * Adds an audio source to the connection, which will be muxed in MPEGTS packets
+    * @param source Stream source, which must be a children of Live555 FramedSource class
+    * @param codec Audio stream codec. Only AAC and MP3 are supported
+    * @return True if succeeded and false if not
+    */
+    bool addAudioSource(FramedSource* source, ACodecType codec, int readerId);
+
+    std::vector<int> getReaders();
+    void stopPlaying();
+
+    /**
+    * @return the statistics of each connected SRT peer
+    */
+    std::vector<SRTPeerStats> getStats();
+
+    size_t getDroppedChunks() const {return fSink ? fSink->getDroppedChunks() : 0;};
+
+    std::string getIP() const {return fIp;};
+    unsigned getPort() const {return fPort;};
+    SRTMode getMode() const {return fMode;};
+    unsigned getLatency() const {return fLatency;};
+
+protected:
+    bool startPlaying();
+    bool specificSetup();
+
+private:
+    std::string fIp;
+    unsigned fPort;
+    SRTMode fMode;
+    unsigned fLatency;
+
+    MPEGTSMuxer* tsMuxer;
+    SRTSink* fSink;
+
+    int audioReader;
+    int videoReader;
+};
+
+///////////////////////
+// WEBRTC CONNECTION //
+///////////////////////
+
+/*! It represents a stream published to WebRTC viewers at /whep/<name> of a WebRTCServer. The coded
+*   readers are sent as they are, so it is limited to one H264 or VP8 video stream and/or one Opus
+*   audio stream. Each track is packetized once for all the viewers.
+*/
+
+class WebRTCConnection : public Connection {
+public:
+    /**
+    * Class constructor
+    * @param env Live555 UsageEnvironement
+    * @param server WebRTC server the stream is published at
+    * @param name Stream name, which is part of its WHEP URL
+    */
+    WebRTCConnection(UsageEnvironment* env, WebRTCServer* server, std::string name);
+
+    /**
+    * Class destructor, it closes the viewers of the stream
+    */
+    ~WebRTCConnection();
+
+    /**
+    * Adds the video source of the stream
+    * @param source Stream source, which must be a children of Live555 FramedSource class
+    * @param codec Video stream codec. Only H264 and VP8 are supported
+    * @param parameterSets H264 source whose parameter sets are sent to the viewers which lack them, NULL if none
+    * @return True if succeeded and false if not
+    */
+    bool addVideoSource(FramedSource* source, VCodecType codec, int readerId, H264or5QueueSource* parameterSets = NULL);
+
+    /**
+    * Adds the audio source of the stream
+    * @param source Stream source, which must be a children of Live555 FramedSource class
+    * @param codec Audio stream codec. Only OPUS is supported
+    * @return True if succeeded and false if not
+    */
+    bool addAudioSource(FramedSource* source, ACodecType codec, int readerId);
+
+    std::vector<int> getReaders();
+    void stopPlaying();
+
+    /**
+    * @return the statistics of each viewer of the stream
+    */
+    std::vector<WebRTCViewerStats> getViewers();
+
+    std::string getName() const {return fName;};
+    std::string getPath() const {return "/whep/" + fName;};
+
+protected:
+    bool startPlaying();
+    bool specificSetup();
+
+private:
+    WebRTCServer* fServer;
+    std::string fName;
+    bool published;
+
+    FramedSource* videoSource;
+    FramedSource* audioSource;
+    VCodecType videoCodec;
+    H264or5QueueSource* fParameterSets;
+    WebRTCSink* videoSink;
+    WebRTCSink* audioSink;
+
+    int audioReader;
+    int videoReader;
+};
+
 //////////////////////////////
 // RTCP CONNECTION INSTANCE //
 //////////////////////////////
@@ -466,6 +780,30 @@ public:
     */  
     size_t getMaxJitter() { return maxJitter; };
 
+    /**
+    * Returns the bitrate in kbps the path to the receivers can carry, estimated from their reports
+    * (see BitrateController), 0 if there has been no report yet
+    */
+    unsigned getTargetBitrate() { return controller.getBitrate(); };
+
+    /**
+    * Parses the RTCP feedback messages of a received compound packet, see FeedbackGroupsock
+    * @param packet RTCP compound packet
+    * @param size packet size in bytes
+    */
+    void handleFeedback(unsigned char const* packet, unsigned size);
+
+    /**
+    * @param handler function called with the sequence number of each packet reported as lost by a
+    *        generic NACK of the receivers
+    */
+    void setNackHandler(std::function<void(uint16_t)> handler) { nackHandler = handler; };
+
+    /**
+    * Returns the number of packets reported as lost by generic NACKs
+    */
+    size_t getNackedPackets() { return nackedPackets; };
+
 private:
     ConnRTCPInstance(Connection* conn, UsageEnvironment* env, Groupsock* RTPgs, unsigned totSessionBW,
                         unsigned char const* cname, RTPSink* sink);
@@ -484,6 +822,12 @@ private:
     size_t avgBitrate, minBitrate, maxBitrate;
     size_t roundTripDelay, minRoundTripDelay, maxRoundTripDelay;
     size_t jitter, minJitter, maxJitter;
+
+    BitrateController controller;
+    struct timeval lastReportTime;
+
+    std::function<void(uint16_t)> nackHandler;
+    size_t nackedPackets;
 };
 
 #endif
\ No newline at end of file
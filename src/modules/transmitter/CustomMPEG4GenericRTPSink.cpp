@@ -27,11 +27,62 @@
 #include "Locale.hh"
 #include <ctype.h> 
 #include <iostream> 
+#include <vector>
+
+////////// AACAggregator definition //////////
+
+// Groups consecutive AAC AUs in the payload of a single packet, preceded by their AU headers,
+// so "CustomMPEG4GenericRTPSink" sends every fragment it gets in a packet of its own.
+// AUs larger than a packet are fragmented, each fragment carrying the header of the whole AU.
+// (Note: This class should be used only by "CustomMPEG4GenericRTPSink".)
+
+class AACAggregator: public FramedFilter {
+public:
+    AACAggregator(UsageEnvironment& env, FramedSource* inputSource,
+                  unsigned maxUnits, unsigned maxOutputPacketSize);
+    virtual ~AACAggregator();
+
+    Boolean lastFragmentCompletedFrameUnit() const {return fLastFragmentCompletedFrameUnit;};
+
+private:
+    virtual void doGetNextFrame();
+    static void afterGettingFrame(void* clientData, unsigned frameSize,
+                                  unsigned numTruncatedBytes,
+                                  struct timeval presentationTime,
+                                  unsigned durationInMicroseconds);
+    void afterGettingFrame1(unsigned frameSize,
+                            unsigned numTruncatedBytes,
+                            struct timeval presentationTime,
+                            unsigned durationInMicroseconds);
+    void getNextUnit();
+    void addUnit();
+    void deliverAggregate();
+    void deliverFragment();
+    unsigned maxPayloadSize() const;
+
+    unsigned fMaxUnits;
+    unsigned fMaxOutputPacketSize;
+
+    unsigned char fInputBuffer[AAC_MAX_AU_SIZE];
+    unsigned fInputSize;                //!< Size of the AU waiting in fInputBuffer, 0 if none
+    struct timeval fInputTime;
+    unsigned fInputDuration;
+    unsigned fFragmentOffset;
+    Boolean fFragmenting;
+
+    std::vector<unsigned char> fUnits;
+    std::vector<unsigned> fUnitSizes;
+    struct timeval fUnitsTime;
+    unsigned fUnitsDuration;
+    Boolean fLastFragmentCompletedFrameUnit;
+};
+
+////////// CustomMPEG4GenericRTPSink implementation //////////
 
 CustomMPEG4GenericRTPSink*
 CustomMPEG4GenericRTPSink::createNew(UsageEnvironment& env, Groupsock* RTPgs, u_int8_t rtpPayloadFormat,
                                       u_int32_t rtpTimestampFrequency, char const* sdpMediaTypeString,
-                                       char const* mpeg4Mode, unsigned numChannels) 
+                                       char const* mpeg4Mode, unsigned numChannels, unsigned ptime) 
 {
     if (sdpMediaTypeString == NULL || strcmp(sdpMediaTypeString, "audio") != 0) {
         env << "Only audio is supported for now using CustomMPEG4GenericRTPSink";
@@ -59,22 +110,55 @@ CustomMPEG4GenericRTPSink::createNew(UsageEnvironment& env, Groupsock* RTPgs, u_
     delete[] m;
   
     return new CustomMPEG4GenericRTPSink(env, RTPgs, rtpPayloadFormat, rtpTimestampFrequency,
-                                          sdpMediaTypeString, mpeg4Mode, numChannels);
+                                          sdpMediaTypeString, mpeg4Mode, numChannels, ptime);
 }
 
 CustomMPEG4GenericRTPSink
 ::CustomMPEG4GenericRTPSink(UsageEnvironment& env, Groupsock* RTPgs, u_int8_t rtpPayloadFormat,
                              u_int32_t rtpTimestampFrequency, char const* sdpMediaTypeString,
-                              char const* mpeg4Mode, unsigned numChannels)
+                              char const* mpeg4Mode, unsigned numChannels, unsigned ptime)
 : MultiFramedRTPSink(env, RTPgs, rtpPayloadFormat, rtpTimestampFrequency, "MPEG4-GENERIC", numChannels),
-  fSDPMediaTypeString(strDup(sdpMediaTypeString)), fMPEG4Mode(strDup(mpeg4Mode)), fConfigString(NULL) 
+  fSDPMediaTypeString(strDup(sdpMediaTypeString)), fMPEG4Mode(strDup(mpeg4Mode)), fConfigString(NULL),
+  fPresetConfigString(NULL), fFmtpSDPLine(NULL), fPtime(ptime), fAggregator(NULL)
 {
     
 }
 
 CustomMPEG4GenericRTPSink::~CustomMPEG4GenericRTPSink() 
 {
+    delete[] fPresetConfigString;
+    delete[] fFmtpSDPLine;
+
+    if (!fAggregator) {
+        return;
+    }
 
+    fSource = fAggregator; // in case "fSource" had gotten set to NULL before we were called
+    stopPlaying(); // the base class destructor would call it without the aggregator
+    Medium::close(fAggregator);
+    fSource = NULL;
+}
+
+Boolean CustomMPEG4GenericRTPSink::continuePlaying()
+{
+    unsigned maxUnits;
+
+    if (fPtime == 0) {
+        return MultiFramedRTPSink::continuePlaying();
+    }
+
+    if (fAggregator == NULL) {
+        //NOTE: the number of AUs closest to the ptime, at least one
+        maxUnits = (fPtime*rtpTimestampFrequency() + AAC_FRAME_SAMPLES*500)/(AAC_FRAME_SAMPLES*1000);
+        fAggregator = new AACAggregator(envir(), fSource, maxUnits > 0 ? maxUnits : 1,
+                                        ourMaxPacketSize() - 12/*RTP hdr size*/);
+    } else {
+        fAggregator->reassignInputSource(fSource);
+    }
+
+    fSource = fAggregator;
+
+    return MultiFramedRTPSink::continuePlaying();
 }
 
 Boolean CustomMPEG4GenericRTPSink
@@ -91,6 +175,19 @@ void CustomMPEG4GenericRTPSink
              struct timeval framePresentationTime,
              unsigned numRemainingBytes) 
 {
+  if (fAggregator) {
+      // The aggregator already wrote the AU headers, mark packets ending an AU
+      if (((AACAggregator*) fAggregator)->lastFragmentCompletedFrameUnit()) {
+          setMarkerBit();
+      }
+
+      MultiFramedRTPSink::doSpecialFrameHandling(fragmentationOffset,
+                             frameStart, numBytesInFrame,
+                             framePresentationTime,
+                             numRemainingBytes);
+      return;
+  }
+
   unsigned fullFrameSize = fragmentationOffset + numBytesInFrame + numRemainingBytes;
   unsigned char headers[4];
   headers[0] = 0; headers[1] = 16 /* bits */; // AU-headers-length
@@ -110,6 +207,10 @@ void CustomMPEG4GenericRTPSink
 
 unsigned CustomMPEG4GenericRTPSink::specialHeaderSize() const 
 {
+  if (fPtime > 0) {
+      return 0;
+  }
+
   return 2 + 2;
 }
 
@@ -118,12 +219,27 @@ char const* CustomMPEG4GenericRTPSink::sdpMediaType() const
   return fSDPMediaTypeString;
 }
 
+void CustomMPEG4GenericRTPSink::setConfigString(char const* config)
+{
+    delete[] fPresetConfigString;
+    fPresetConfigString = config ? strDup(config) : NULL;
+}
+
 char const* CustomMPEG4GenericRTPSink::auxSDPLine() 
 {
     ADTSStreamParser* adts;
 
+    if (fPresetConfigString) {
+        fConfigString = fPresetConfigString;
+        return buildFmtpSDPLine();
+    }
+
     adts = dynamic_cast<ADTSStreamParser*>(fSource);
 
+    if (!adts && fAggregator) {
+      adts = dynamic_cast<ADTSStreamParser*>(fAggregator->inputSource());
+    }
+
     if (!adts) {
       utils::errorMsg("Its is not and ADTSStreamParser!");
       return NULL;
@@ -135,6 +251,11 @@ char const* CustomMPEG4GenericRTPSink::auxSDPLine()
         return NULL;
     }
 
+    return buildFmtpSDPLine();
+}
+
+char const* CustomMPEG4GenericRTPSink::buildFmtpSDPLine()
+{
     // Set up the "a=fmtp:" SDP line for this stream:
     char const* fmtpFmt =
         "a=fmtp:%d "
@@ -156,7 +277,177 @@ char const* CustomMPEG4GenericRTPSink::auxSDPLine()
         fMPEG4Mode,
         fConfigString);
   
+    delete[] fFmtpSDPLine;
     fFmtpSDPLine = strDup(fmtp);
     delete[] fmtp;
     return fFmtpSDPLine;
-}
\ No newline at end of file
+}
+
+////////// AACAggregator implementation //////////
+
+AACAggregator::AACAggregator(UsageEnvironment& env, FramedSource* inputSource,
+                             unsigned maxUnits, unsigned maxOutputPacketSize)
+  : FramedFilter(env, inputSource), fMaxUnits(maxUnits), fMaxOutputPacketSize(maxOutputPacketSize),
+    fInputSize(0), fInputDuration(0), fFragmentOffset(0), fFragmenting(False), fUnitsDuration(0),
+    fLastFragmentCompletedFrameUnit(True)
+{
+    fUnits.reserve(maxOutputPacketSize);
+    fUnitSizes.reserve(maxUnits);
+}
+
+AACAggregator::~AACAggregator()
+{
+    detachInputSource(); // so that the subsequent ~FramedFilter() doesn't delete it
+}
+
+unsigned AACAggregator::maxPayloadSize() const
+{
+    return fMaxSize < fMaxOutputPacketSize ? fMaxSize : fMaxOutputPacketSize;
+}
+
+void AACAggregator::doGetNextFrame()
+{
+    if (fFragmenting) {
+        deliverFragment();
+        return;
+    }
+
+    fUnits.clear();
+    fUnitSizes.clear();
+    fUnitsDuration = 0;
+
+    //NOTE: the AU which did not fit in the previous packet starts this one
+    if (fInputSize > 0) {
+        addUnit();
+        return;
+    }
+
+    getNextUnit();
+}
+
+void AACAggregator::getNextUnit()
+{
+    fInputSource->getNextFrame(fInputBuffer, AAC_MAX_AU_SIZE,
+                               afterGettingFrame, this,
+                               FramedSource::handleClosure, this);
+}
+
+void AACAggregator::afterGettingFrame(void* clientData, unsigned frameSize,
+                                      unsigned numTruncatedBytes,
+                                      struct timeval presentationTime,
+                                      unsigned durationInMicroseconds)
+{
+    AACAggregator* aggregator = (AACAggregator*) clientData;
+    aggregator->afterGettingFrame1(frameSize, numTruncatedBytes, presentationTime,
+                                   durationInMicroseconds);
+}
+
+void AACAggregator::afterGettingFrame1(unsigned frameSize,
+                                       unsigned numTruncatedBytes,
+                                       struct timeval presentationTime,
+                                       unsigned durationInMicroseconds)
+{
+    if (numTruncatedBytes > 0) {
+        utils::warningMsg("AAC AU larger than the AU headers can signal, it has been truncated");
+    }
+
+    fInputSize = frameSize;
+    fInputTime = presentationTime;
+    fInputDuration = durationInMicroseconds;
+
+    if (fInputSize == 0) {
+        getNextUnit();
+        return;
+    }
+
+    addUnit();
+}
+
+void AACAggregator::addUnit()
+{
+    unsigned size;
+
+    size = AAC_AU_HEADER_SIZE*(fUnitSizes.size() + 2) + fUnits.size() + fInputSize;
+
+    if (size > maxPayloadSize()) {
+        if (fUnitSizes.empty()) {
+            fFragmentOffset = 0;
+            deliverFragment();
+        } else {
+            deliverAggregate();
+        }
+        return;
+    }
+
+    if (fUnitSizes.empty()) {
+        fUnitsTime = fInputTime;
+    }
+
+    fUnits.insert(fUnits.end(), fInputBuffer, fInputBuffer + fInputSize);
+    fUnitSizes.push_back(fInputSize);
+    fUnitsDuration += fInputDuration;
+    fInputSize = 0;
+
+    if (fUnitSizes.size() >= fMaxUnits) {
+        deliverAggregate();
+        return;
+    }
+
+    getNextUnit();
+}
+
+void AACAggregator::deliverAggregate()
+{
+    unsigned headersLength = AAC_AU_HEADER_SIZE*fUnitSizes.size();
+    unsigned char* header = fTo;
+
+    // AU-headers-length in bits, followed by one AU header per AU with a 0 index delta
+    *header++ = (headersLength*8) >> 8;
+    *header++ = (headersLength*8) & 0xFF;
+
+    for (auto size : fUnitSizes) {
+        *header++ = size >> 5;
+        *header++ = (size & 0x1F) << 3;
+    }
+
+    memcpy(header, fUnits.data(), fUnits.size());
+
+    fFrameSize = AAC_AU_HEADER_SIZE + headersLength + fUnits.size();
+    fNumTruncatedBytes = 0;
+    fPresentationTime = fUnitsTime;
+    fDurationInMicroseconds = fUnitsDuration;
+    fLastFragmentCompletedFrameUnit = True;
+
+    afterGetting(this);
+}
+
+void AACAggregator::deliverFragment()
+{
+    unsigned size = fInputSize - fFragmentOffset;
+
+    if (size + 2*AAC_AU_HEADER_SIZE > maxPayloadSize()) {
+        size = maxPayloadSize() - 2*AAC_AU_HEADER_SIZE;
+    }
+
+    fTo[0] = 0;
+    fTo[1] = AAC_AU_HEADER_SIZE*8;
+    fTo[2] = fInputSize >> 5;
+    fTo[3] = (fInputSize & 0x1F) << 3;
+    memcpy(fTo + 2*AAC_AU_HEADER_SIZE, fInputBuffer + fFragmentOffset, size);
+
+    fFrameSize = 2*AAC_AU_HEADER_SIZE + size;
+    fNumTruncatedBytes = 0;
+    fPresentationTime = fInputTime;
+    fDurationInMicroseconds = 0;
+    fFragmentOffset += size;
+    fLastFragmentCompletedFrameUnit = fFragmentOffset >= fInputSize;
+    fFragmenting = !fLastFragmentCompletedFrameUnit;
+
+    if (fLastFragmentCompletedFrameUnit) {
+        fDurationInMicroseconds = fInputDuration;
+        fInputSize = 0;
+        fFragmentOffset = 0;
+    }
+
+    afterGetting(this);
+}
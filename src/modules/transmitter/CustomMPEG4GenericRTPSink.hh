@@ -26,8 +26,13 @@
 
 #include "MultiFramedRTPSink.hh"
 
+#define AAC_MAX_AU_SIZE 8191            //!< Largest AU the 13 bit sizelength of the AU headers can signal
+#define AAC_AU_HEADER_SIZE 2            //!< 13 bit AU size and 3 bit AU index (delta)
+#define AAC_FRAME_SAMPLES 1024          //!< Samples per AAC access unit
+
 /*! An RTP Sink which consumes AAC ADTS frames. It must be associated to a ADTSStreamParser 
-    in order to construct the specific SDP line */
+    in order to construct the specific SDP line. With a ptime, consecutive AUs are aggregated
+    in the same packet (RFC 3640 multiple AU headers) */
 
 class CustomMPEG4GenericRTPSink: public MultiFramedRTPSink {
 
@@ -41,23 +46,32 @@ public:
     * @param sdpMediaTypeString Only "audio" is supported
     * @param mpeg4Mode Input source, which contains AAC frames
     * @param numChannels Input source, which contains AAC frames
+    * @param ptime Audio duration in msec aggregated in each packet, 0 sends one AU per packet
     * @return Pointer to the object if succeded and NULL if not
     */
     static CustomMPEG4GenericRTPSink* 
     createNew(UsageEnvironment& env, Groupsock* RTPgs,
         u_int8_t rtpPayloadFormat, u_int32_t rtpTimestampFrequency,
-        char const* sdpMediaTypeString, char const* mpeg4Mode, unsigned numChannels);
+        char const* sdpMediaTypeString, char const* mpeg4Mode, unsigned numChannels,
+        unsigned ptime = 0);
+
+    /**
+    * Sets the AAC config described in the SDP, so it is not taken from the ADTS headers of the stream
+    * @param config AudioSpecificConfig as an hex string, NULL to take it from the stream again
+    */
+    void setConfigString(char const* config);
 
 protected:
     CustomMPEG4GenericRTPSink(UsageEnvironment& env, Groupsock* RTPgs,
               u_int8_t rtpPayloadFormat,
               u_int32_t rtpTimestampFrequency,
               char const* sdpMediaTypeString,
-              char const* mpeg4Mode, unsigned numChannels);
+              char const* mpeg4Mode, unsigned numChannels, unsigned ptime);
 
     virtual ~CustomMPEG4GenericRTPSink();
 
 private:
+    Boolean continuePlaying();
     Boolean frameCanAppearAfterPacketStart(unsigned char const* frameStart,
                      unsigned numBytesInFrame) const;
     void doSpecialFrameHandling(unsigned fragmentationOffset,
@@ -68,12 +82,16 @@ private:
     unsigned specialHeaderSize() const;
     char const* sdpMediaType() const;
     char const* auxSDPLine(); 
+    char const* buildFmtpSDPLine();
 
 private:
   char const* fSDPMediaTypeString;
   char const* fMPEG4Mode;
   char const* fConfigString;
+  char* fPresetConfigString;
   char* fFmtpSDPLine;
+  unsigned fPtime;
+  FramedFilter* fAggregator;
 };
 
 #endif
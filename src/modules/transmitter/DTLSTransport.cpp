@@ -0,0 +1,336 @@
+/*
+ *  DTLSTransport.cpp - DTLS-SRTP key agreement of WebRTC sessions
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <cstdio>
+#include <mutex>
+#include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/x509.h>
+#include <openssl/ec.h>
+
+#include "DTLSTransport.hh"
+#include "../../Utils.hh"
+
+#define DTLS_SRTP_LABEL "EXTRACTOR-dtls_srtp"
+#define DTLS_KEYING_SIZE (2*(SRTP_MASTER_KEY_SIZE + SRTP_MASTER_SALT_SIZE))
+
+static std::string sslError()
+{
+    char buffer[256];
+
+    ERR_error_string_n(ERR_get_error(), buffer, sizeof(buffer));
+    return buffer;
+}
+
+//NOTE: the peer certificate is self signed too, it is authenticated by its fingerprint after the handshake
+static int acceptCertificate(int /*preverify*/, X509_STORE_CTX* /*ctx*/)
+{
+    return 1;
+}
+
+///////////////////////////
+// DTLS CERTIFICATE      //
+///////////////////////////
+
+DTLSCertificate* DTLSCertificate::getInstance()
+{
+    static DTLSCertificate instance;
+    return &instance;
+}
+
+DTLSCertificate::DTLSCertificate() : key(NULL), certificate(NULL), ctx(NULL)
+{
+    if (!generate()) {
+        utils::errorMsg("[DTLSCertificate] Certificate could not be generated: " + sslError());
+        SSL_CTX_free(ctx);
+        ctx = NULL;
+    }
+}
+
+DTLSCertificate::~DTLSCertificate()
+{
+    SSL_CTX_free(ctx);
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+}
+
+bool DTLSCertificate::generate()
+{
+    EVP_PKEY_CTX* keyCtx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    X509_NAME* name;
+    unsigned char serial[8];
+    BIGNUM* serialNumber;
+
+    if (!keyCtx || EVP_PKEY_keygen_init(keyCtx) != 1 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyCtx, NID_X9_62_prime256v1) != 1 ||
+        EVP_PKEY_keygen(keyCtx, &key) != 1) {
+        EVP_PKEY_CTX_free(keyCtx);
+        return false;
+    }
+    EVP_PKEY_CTX_free(keyCtx);
+
+    certificate = X509_new();
+    if (!certificate || RAND_bytes(serial, sizeof(serial)) != 1) {
+        return false;
+    }
+
+    serialNumber = BN_bin2bn(serial, sizeof(serial), NULL);
+    BN_to_ASN1_INTEGER(serialNumber, X509_get_serialNumber(certificate));
+    BN_free(serialNumber);
+
+    X509_set_version(certificate, 2);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), DTLS_CERTIFICATE_DAYS*24*3600);
+    X509_set_pubkey(certificate, key);
+
+    name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*) "liveMediaStreamer", -1, -1, 0);
+    X509_set_issuer_name(certificate, name);
+
+    if (X509_sign(certificate, key, EVP_sha256()) == 0) {
+        return false;
+    }
+
+    fingerprint = computeFingerprint(certificate);
+
+    ctx = SSL_CTX_new(DTLS_server_method());
+    if (!ctx || SSL_CTX_use_certificate(ctx, certificate) != 1 || SSL_CTX_use_PrivateKey(ctx, key) != 1 ||
+        SSL_CTX_set_tlsext_use_srtp(ctx, DTLS_SRTP_PROFILE) != 0) {
+        return false;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, DTLS1_2_VERSION);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, acceptCertificate);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_QUERY_MTU);
+    SSL_CTX_set_read_ahead(ctx, 1);
+
+    return true;
+}
+
+std::string DTLSCertificate::computeFingerprint(X509* certificate)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned len = 0;
+    char hex[4];
+    std::string result;
+
+    if (X509_digest(certificate, EVP_sha256(), digest, &len) != 1) {
+        return "";
+    }
+
+    for (unsigned i = 0; i < len; i++) {
+        snprintf(hex, sizeof(hex), i == 0 ? "%02X" : ":%02X", digest[i]);
+        result += hex;
+    }
+
+    return result;
+}
+
+///////////////////////////
+// DTLS TRANSPORT        //
+///////////////////////////
+
+BIO_METHOD* DTLSTransport::outgoingMethod()
+{
+    static BIO_METHOD* method = NULL;
+    static std::once_flag created;
+
+    std::call_once(created, []{
+        method = BIO_meth_new(BIO_TYPE_SOURCE_SINK | BIO_get_new_index(), "webrtc outgoing");
+        BIO_meth_set_write(method, bioWrite);
+        BIO_meth_set_ctrl(method, bioCtrl);
+    });
+
+    return method;
+}
+
+//NOTE: each write is a whole record flight fragment, so it is queued as its own datagram
+int DTLSTransport::bioWrite(BIO* bio, const char* data, int size)
+{
+    DTLSTransport* self = (DTLSTransport*) BIO_get_data(bio);
+
+    self->outgoing.push_back(std::string(data, size));
+    return size;
+}
+
+long DTLSTransport::bioCtrl(BIO* /*bio*/, int cmd, long /*num*/, void* /*ptr*/)
+{
+    switch (cmd) {
+        case BIO_CTRL_FLUSH:
+            return 1;
+        case BIO_CTRL_DGRAM_QUERY_MTU:
+            return DTLS_MTU;
+        case BIO_CTRL_WPENDING:
+        case BIO_CTRL_PENDING:
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+DTLSTransport::DTLSTransport(std::string remoteFingerprint_) :
+    remoteFingerprint(remoteFingerprint_), ssl(NULL), incoming(NULL), connected(false), failed(false)
+{
+    SSL_CTX* ctx = DTLSCertificate::getInstance()->getContext();
+    BIO* out;
+
+    if (!ctx || !(ssl = SSL_new(ctx))) {
+        failed = true;
+        return;
+    }
+
+    incoming = BIO_new(BIO_s_mem());
+    out = BIO_new(outgoingMethod());
+    BIO_set_data(out, this);
+    BIO_set_init(out, 1);
+
+    //NOTE: BIO_s_mem returns -1 when empty with retry set, as a datagram socket would block
+    BIO_set_mem_eof_return(incoming, -1);
+    SSL_set_bio(ssl, incoming, out);
+    SSL_set_mtu(ssl, DTLS_MTU);
+    DTLS_set_link_mtu(ssl, DTLS_MTU);
+    SSL_set_accept_state(ssl);
+}
+
+DTLSTransport::~DTLSTransport()
+{
+    if (ssl) {
+        if (connected) {
+            SSL_shutdown(ssl);
+        }
+        SSL_free(ssl);
+    }
+}
+
+bool DTLSTransport::receive(const unsigned char* data, unsigned size)
+{
+    char buffer[DTLS_MTU];
+    int ret;
+
+    if (failed) {
+        return false;
+    }
+
+    BIO_write(incoming, data, size);
+
+    if (!connected) {
+        return handshake();
+    }
+
+    //NOTE: no application data is expected, reading processes alerts (e.g. close_notify)
+    ret = SSL_read(ssl, buffer, sizeof(buffer));
+    if (ret <= 0 && SSL_get_error(ssl, ret) != SSL_ERROR_WANT_READ) {
+        failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+bool DTLSTransport::handshake()
+{
+    int ret = SSL_do_handshake(ssl);
+
+    if (ret == 1) {
+        connected = exportKeys();
+        failed = !connected;
+        return connected;
+    }
+
+    if (SSL_get_error(ssl, ret) == SSL_ERROR_WANT_READ) {
+        return true;
+    }
+
+    utils::warningMsg("[DTLSTransport] Handshake failed: " + sslError());
+    failed = true;
+    return false;
+}
+
+bool DTLSTransport::exportKeys()
+{
+    unsigned char material[DTLS_KEYING_SIZE];
+    unsigned char key[SRTP_MASTER_KEY_SIZE];
+    unsigned char salt[SRTP_MASTER_SALT_SIZE];
+    SRTP_PROTECTION_PROFILE* profile = SSL_get_selected_srtp_profile(ssl);
+    X509* peer = SSL_get_peer_certificate(ssl);
+    std::string fingerprint;
+    bool ok;
+
+    if (peer) {
+        fingerprint = DTLSCertificate::computeFingerprint(peer);
+        X509_free(peer);
+    }
+
+    if (fingerprint.empty() || strcasecmp(fingerprint.c_str(), remoteFingerprint.c_str()) != 0) {
+        utils::warningMsg("[DTLSTransport] Peer certificate does not match the offer fingerprint");
+        return false;
+    }
+
+    if (!profile || profile->id != SRTP_AES128_CM_SHA1_80) {
+        utils::warningMsg("[DTLSTransport] No supported SRTP profile negotiated");
+        return false;
+    }
+
+    if (SSL_export_keying_material(ssl, material, sizeof(material), DTLS_SRTP_LABEL,
+                                   strlen(DTLS_SRTP_LABEL), NULL, 0, 0) != 1) {
+        utils::warningMsg("[DTLSTransport] SRTP keys could not be exported: " + sslError());
+        return false;
+    }
+
+    //NOTE: client key, server key, client salt, server salt (RFC 5764 4.2), the server sends with its own
+    memcpy(key, material + SRTP_MASTER_KEY_SIZE, SRTP_MASTER_KEY_SIZE);
+    memcpy(salt, material + 2*SRTP_MASTER_KEY_SIZE + SRTP_MASTER_SALT_SIZE, SRTP_MASTER_SALT_SIZE);
+
+    ok = srtp.setKey(key, salt);
+
+    OPENSSL_cleanse(material, sizeof(material));
+    OPENSSL_cleanse(key, sizeof(key));
+    OPENSSL_cleanse(salt, sizeof(salt));
+    return ok;
+}
+
+bool DTLSTransport::handleTimeout()
+{
+    struct timeval timeout;
+
+    if (failed || connected) {
+        return !failed;
+    }
+
+    if (DTLSv1_get_timeout(ssl, &timeout) == 1 && timeout.tv_sec == 0 && timeout.tv_usec == 0) {
+        if (DTLSv1_handle_timeout(ssl) < 0) {
+            failed = true;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::vector<std::string> DTLSTransport::takeOutgoing()
+{
+    std::vector<std::string> datagrams;
+
+    datagrams.swap(outgoing);
+    return datagrams;
+}
@@ -0,0 +1,126 @@
+/*
+ *  DTLSTransport.hh - DTLS-SRTP key agreement of WebRTC sessions
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _DTLS_TRANSPORT_HH
+#define _DTLS_TRANSPORT_HH
+
+#include <string>
+#include <vector>
+#include <openssl/ssl.h>
+
+#include "SRTPContext.hh"
+
+#define DTLS_MTU 1200                   //!< Largest handshake datagram
+#define DTLS_CERTIFICATE_DAYS 30        //!< Validity of the self signed certificate
+#define DTLS_SRTP_PROFILE "SRTP_AES128_CM_SHA1_80"
+
+/*! Self signed ECDSA P-256 certificate shared by all the DTLS transports of the process, its
+    SHA-256 fingerprint is the one announced in the SDP answers
+*/
+class DTLSCertificate {
+
+public:
+    static DTLSCertificate* getInstance();
+
+    /**
+    * @return server context with the certificate and DTLS-SRTP configured, NULL if it failed
+    */
+    SSL_CTX* getContext() {return ctx;};
+
+    /**
+    * @return "XX:XX:..." SHA-256 fingerprint of the certificate
+    */
+    std::string getFingerprint() const {return fingerprint;};
+
+    /**
+    * @return "XX:XX:..." SHA-256 fingerprint of a certificate
+    */
+    static std::string computeFingerprint(X509* certificate);
+
+private:
+    DTLSCertificate();
+    ~DTLSCertificate();
+
+    bool generate();
+
+    EVP_PKEY* key;
+    X509* certificate;
+    SSL_CTX* ctx;
+    std::string fingerprint;
+};
+
+/*! DTLS server side of a WebRTC session (the answer is setup:passive), running on memory BIOs so
+    the datagrams are sent and received by the session socket. Once the handshake is done and the
+    peer certificate matches the fingerprint of its offer, the exported keys protect the media.
+*/
+class DTLSTransport {
+
+public:
+    /**
+    * @param remoteFingerprint SHA-256 fingerprint of the peer certificate, from its SDP
+    */
+    DTLSTransport(std::string remoteFingerprint);
+    ~DTLSTransport();
+
+    /**
+    * Feeds a received DTLS datagram, the datagrams to answer with are queued
+    * @return false if the handshake failed or the peer closed the association
+    */
+    bool receive(const unsigned char* data, unsigned size);
+
+    /**
+    * Retransmits the last flight if its timer expired
+    * @return false if the handshake timed out
+    */
+    bool handleTimeout();
+
+    /**
+    * @return datagrams to send, the queue is emptied
+    */
+    std::vector<std::string> takeOutgoing();
+
+    bool isConnected() const {return connected;};
+    bool hasFailed() const {return failed;};
+
+    /**
+    * @return sender context keyed with the server key, NULL until connected
+    */
+    SRTPContext* getSRTP() {return connected ? &srtp : NULL;};
+
+private:
+    bool handshake();
+    bool exportKeys();
+
+    static int bioWrite(BIO* bio, const char* data, int size);
+    static long bioCtrl(BIO* bio, int cmd, long num, void* ptr);
+    static BIO_METHOD* outgoingMethod();
+
+    std::string remoteFingerprint;
+    SSL* ssl;
+    BIO* incoming;
+    std::vector<std::string> outgoing;
+    SRTPContext srtp;
+    bool connected;
+    bool failed;
+};
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ *  FECEncoder.cpp - FlexFEC row/column parity encoder for RTP streams
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "FECEncoder.hh"
+#include "RetransmissionBuffer.hh"
+#include "../../SampleConverter.hh"
+
+SIMD_KERNEL
+static void xorSpan(unsigned char* __restrict__ parity, unsigned char const* __restrict__ in, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        parity[i] ^= in[i];
+    }
+}
+
+FECEncoder::FECEncoder(uint32_t mediaSSRC, uint32_t ssrc, uint16_t firstSeq, unsigned columns, unsigned rows,
+                       unsigned char payloadType) :
+    fMediaSSRC(mediaSSRC), fecSSRC(ssrc), fecSeq(firstSeq), fColumns(columns ? columns : 1), fRows(rows > 1 ? rows : 0),
+    fPayloadType(payloadType), position(0), nextSeq(0), started(false), repairPackets(0)
+{
+    row.payload.resize(FEC_MAX_MEDIA_SIZE - RTP_HEADER_SIZE);
+    columnParities.resize(fRows ? fColumns : 0, row);
+    reset();
+}
+
+bool FECEncoder::matrixSize(float ratio, unsigned &columns, unsigned &rows)
+{
+    unsigned size;
+
+    if (ratio < FEC_MIN_RATIO || ratio > 1) {
+        return false;
+    }
+
+    //NOTE: a L x L matrix sends 2 repair packets every L protected ones
+    size = std::floor(2/ratio + 0.0001);
+    size = std::max(2u, std::min(size, (unsigned) FEC_MAX_SIZE));
+
+    columns = size;
+    rows = size;
+    return true;
+}
+
+void FECEncoder::protect(const unsigned char* packet, unsigned size)
+{
+    uint16_t seq;
+
+    if (size < RTP_HEADER_SIZE || size > FEC_MAX_MEDIA_SIZE || (packet[0] >> 6) != 2) {
+        return;
+    }
+
+    if ((uint32_t) ((packet[8] << 24) | (packet[9] << 16) | (packet[10] << 8) | packet[11]) != fMediaSSRC) {
+        return;
+    }
+
+    seq = (packet[2] << 8) | packet[3];
+
+    //NOTE: the packet is written once for each destination
+    if (started && seq == (uint16_t) (nextSeq - 1)) {
+        return;
+    }
+
+    if (started && seq != nextSeq) {
+        reset();
+    }
+
+    started = true;
+    nextSeq = seq + 1;
+
+    if (position % fColumns == 0) {
+        row.base = seq;
+    }
+
+    add(row, packet, size);
+
+    if (fRows) {
+        if (position < fColumns) {
+            columnParities[position].base = seq;
+        }
+        add(columnParities[position % fColumns], packet, size);
+    }
+
+    position++;
+
+    //NOTE: D=1 tells a row repair packet is followed by column ones, D=0 that there are none
+    if (position % fColumns == 0) {
+        emit(row, fRows ? 1 : 0);
+    }
+
+    if (position == fColumns * (fRows ? fRows : 1)) {
+        for (auto& column : columnParities) {
+            emit(column, fRows);
+        }
+        position = 0;
+    }
+}
+
+unsigned FECEncoder::getRepair(unsigned char* buffer)
+{
+    unsigned size;
+
+    if (repairs.empty()) {
+        return 0;
+    }
+
+    size = repairs.front().size();
+    memcpy(buffer, repairs.front().data(), size);
+    repairs.pop_front();
+
+    return size;
+}
+
+void FECEncoder::reset()
+{
+    row.size = 0;
+    memset(row.header, 0, sizeof(row.header));
+    memset(row.payload.data(), 0, row.payload.size());
+
+    for (auto& column : columnParities) {
+        column.size = 0;
+        memset(column.header, 0, sizeof(column.header));
+        memset(column.payload.data(), 0, column.payload.size());
+    }
+
+    position = 0;
+}
+
+void FECEncoder::add(Parity& parity, const unsigned char* packet, unsigned size)
+{
+    unsigned length = size - RTP_HEADER_SIZE;
+
+    //NOTE: the recovery fields are the XOR of the P, X, CC, M and PT bits, the length after the
+    //      fixed header and the timestamp of the protected packets
+    parity.header[0] ^= packet[0];
+    parity.header[1] ^= packet[1];
+    parity.header[2] ^= length >> 8;
+    parity.header[3] ^= length & 0xFF;
+    parity.header[4] ^= packet[4];
+    parity.header[5] ^= packet[5];
+    parity.header[6] ^= packet[6];
+    parity.header[7] ^= packet[7];
+
+    xorSpan(parity.payload.data(), packet + RTP_HEADER_SIZE, length);
+
+    parity.size = std::max(parity.size, length);
+    parity.timestamp = (packet[4] << 24) | (packet[5] << 16) | (packet[6] << 8) | packet[7];
+}
+
+void FECEncoder::emit(Parity& parity, unsigned char rows)
+{
+    std::vector<unsigned char> repair(FEC_HEADER_SIZE + parity.size);
+    unsigned char* buffer = repair.data();
+
+    buffer[0] = 0x81;
+    buffer[1] = fPayloadType & 0x7F;
+    buffer[2] = fecSeq >> 8;
+    buffer[3] = fecSeq & 0xFF;
+    buffer[4] = parity.timestamp >> 24;
+    buffer[5] = (parity.timestamp >> 16) & 0xFF;
+    buffer[6] = (parity.timestamp >> 8) & 0xFF;
+    buffer[7] = parity.timestamp & 0xFF;
+    buffer[8] = fecSSRC >> 24;
+    buffer[9] = (fecSSRC >> 16) & 0xFF;
+    buffer[10] = (fecSSRC >> 8) & 0xFF;
+    buffer[11] = fecSSRC & 0xFF;
+    buffer[12] = fMediaSSRC >> 24;
+    buffer[13] = (fMediaSSRC >> 16) & 0xFF;
+    buffer[14] = (fMediaSSRC >> 8) & 0xFF;
+    buffer[15] = fMediaSSRC & 0xFF;
+
+    buffer[16] = 0x40 | (parity.header[0] & 0x3F);
+    memcpy(buffer + 17, parity.header + 1, 7);
+    buffer[24] = parity.base >> 8;
+    buffer[25] = parity.base & 0xFF;
+    buffer[26] = fColumns;
+    buffer[27] = rows;
+
+    memcpy(buffer + FEC_HEADER_SIZE, parity.payload.data(), parity.size);
+
+    repairs.push_back(std::move(repair));
+    fecSeq++;
+    repairPackets++;
+
+    memset(parity.payload.data(), 0, parity.size);
+    memset(parity.header, 0, sizeof(parity.header));
+    parity.size = 0;
+}
@@ -0,0 +1,117 @@
+/*
+ *  FECEncoder.hh - FlexFEC row/column parity encoder for RTP streams
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _FEC_ENCODER_HH
+#define _FEC_ENCODER_HH
+
+#include <deque>
+#include <vector>
+#include <stdint.h>
+
+#define FEC_PAYLOAD_TYPE 100            //!< Dynamic payload type of the FlexFEC streams
+#define FEC_MIN_RATIO 0.1               //!< Lowest protection ratio, it gives the largest matrix
+#define FEC_MAX_SIZE 20                 //!< Largest number of columns and rows of the matrix
+#define FEC_MAX_MEDIA_SIZE 1500         //!< Largest protected RTP packet
+#define FEC_HEADER_SIZE 28              //!< RTP header, protected SSRC (CSRC) and FlexFEC fixed header
+#define FEC_MAX_PACKET_SIZE (FEC_HEADER_SIZE + FEC_MAX_MEDIA_SIZE)
+
+/*! FlexFEC (RFC 8627) encoder with fixed row and column parity (F=1). The protected packets are placed
+    row by row in a matrix of L columns and D rows. Each row is protected by an XOR packet sent as soon
+    as the row is complete, which recovers a single loss in it. Each column is protected by an XOR packet
+    sent once the matrix is complete, which recovers a burst of up to L consecutive losses. Losses that
+    neither can recover alone may be recovered iterating both. Repair packets are SSRC multiplexed with the
+    protected stream, they carry its SSRC as CSRC.
+*/
+class FECEncoder {
+
+public:
+    /**
+    * Class constructor
+    * @param mediaSSRC SSRC of the protected stream, packets of other streams are ignored
+    * @param ssrc SSRC of the repair stream
+    * @param firstSeq sequence number of the first repair packet
+    * @param columns L, number of consecutive packets protected by each row repair packet
+    * @param rows D, number of packets protected by each column repair packet, 0 disables column protection
+    * @param payloadType payload type of the repair packets
+    */
+    FECEncoder(uint32_t mediaSSRC, uint32_t ssrc, uint16_t firstSeq, unsigned columns, unsigned rows,
+               unsigned char payloadType = FEC_PAYLOAD_TYPE);
+
+    /**
+    * Computes the square matrix which gives at least a protection ratio
+    * @param ratio repair packets per protected packet, from FEC_MIN_RATIO to 1
+    * @param columns matrix columns
+    * @param rows matrix rows
+    * @return false if the ratio is out of range
+    */
+    static bool matrixSize(float ratio, unsigned &columns, unsigned &rows);
+
+    /**
+    * Adds a sent RTP packet to the current matrix. A sequence number gap discards the current matrix
+    * @param packet RTP packet
+    * @param size packet size in bytes
+    */
+    void protect(const unsigned char* packet, unsigned size);
+
+    /**
+    * Pops the next repair packet
+    * @param buffer output buffer, it must hold at least FEC_MAX_PACKET_SIZE bytes
+    * @return repair packet size, 0 if there is none pending
+    */
+    unsigned getRepair(unsigned char* buffer);
+
+    uint32_t getSSRC() const {return fecSSRC;};
+    unsigned getColumns() const {return fColumns;};
+    unsigned getRows() const {return fRows;};
+    size_t getRepairPackets() const {return repairPackets;};
+
+private:
+    struct Parity {
+        std::vector<unsigned char> payload;
+        unsigned size;
+        unsigned char header[8];
+        uint16_t base;
+        uint32_t timestamp;
+    };
+
+    void reset();
+    void add(Parity& parity, const unsigned char* packet, unsigned size);
+    void emit(Parity& parity, unsigned char rows);
+
+    uint32_t fMediaSSRC;
+    uint32_t fecSSRC;
+    uint16_t fecSeq;
+    unsigned fColumns;
+    unsigned fRows;
+    unsigned char fPayloadType;
+
+    Parity row;
+    std::vector<Parity> columnParities;
+    unsigned position;                  //!< Index in the matrix of the next protected packet
+    uint16_t nextSeq;
+    bool started;
+
+    std::deque<std::vector<unsigned char>> repairs;
+    size_t repairPackets;
+};
+
+#endif
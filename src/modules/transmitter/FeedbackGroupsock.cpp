@@ -0,0 +1,43 @@
+/*
+ *  FeedbackGroupsock.cpp - Groupsock that hands the packets it receives to a handler
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "FeedbackGroupsock.hh"
+
+FeedbackGroupsock::FeedbackGroupsock(UsageEnvironment& env, struct in_addr const& groupAddr, Port port, u_int8_t ttl) :
+    Groupsock(env, groupAddr, port, ttl)
+{
+
+}
+
+Boolean FeedbackGroupsock::handleRead(unsigned char* buffer, unsigned bufferMaxSize,
+                                      unsigned& bytesRead, struct sockaddr_in& fromAddressAndPort)
+{
+    if (!Groupsock::handleRead(buffer, bufferMaxSize, bytesRead, fromAddressAndPort)) {
+        return False;
+    }
+
+    if (feedbackHandler && bytesRead > 0) {
+        feedbackHandler(buffer, bytesRead);
+    }
+
+    return True;
+}
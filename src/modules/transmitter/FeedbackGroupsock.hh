@@ -0,0 +1,57 @@
+/*
+ *  FeedbackGroupsock.hh - Groupsock that hands the packets it receives to a handler
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _FEEDBACK_GROUPSOCK_HH
+#define _FEEDBACK_GROUPSOCK_HH
+
+#include <functional>
+#include <netinet/in.h>
+#include <Groupsock.hh>
+
+/*! Groupsock used by the RTCP instances of RTP connections. live555 RTCPInstance only parses sender
+    reports, receiver reports and BYE packets, so the packets read by it are also handed to a handler,
+    which parses the RTCP feedback messages (RFC 4585) live555 skips.
+*/
+class FeedbackGroupsock : public Groupsock {
+
+public:
+    /**
+    * Class constructor, see Groupsock
+    */
+    FeedbackGroupsock(UsageEnvironment& env, struct in_addr const& groupAddr, Port port, u_int8_t ttl);
+
+    /**
+    * Reads a packet, it is called by live555 RTCPInstance when the socket is readable
+    */
+    Boolean handleRead(unsigned char* buffer, unsigned bufferMaxSize,
+                       unsigned& bytesRead, struct sockaddr_in& fromAddressAndPort);
+
+    /**
+    * @param handler function called with each packet read, before live555 processes it
+    */
+    void setFeedbackHandler(std::function<void(unsigned char const*, unsigned)> handler) {feedbackHandler = handler;};
+
+private:
+    std::function<void(unsigned char const*, unsigned)> feedbackHandler;
+};
+
+#endif
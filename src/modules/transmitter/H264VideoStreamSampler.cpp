@@ -21,6 +21,7 @@
  */
 
 #include "H264VideoStreamSampler.hh"
+#include "../../NalSplitter.hh"
 extern "C" { 
     #include "SPSparser/h264_stream.h"
 }
@@ -82,7 +83,7 @@ void H264VideoStreamSampler
 
 
 
-    if (frameSize >= 4 && NALstartPtr[0] == 0 && NALstartPtr[1] == 0 && ((NALstartPtr[2] == 0 && NALstartPtr[3] == 1) || NALstartPtr[2] == 1)) {
+    if (NalSplitter::startCodeLength(NALstartPtr, frameSize) > 0) {
         envir() << "H264VideoStreamSampler error: MPEG 'start code' seen in the input\n";
     } else if (isSPS(nal_unit_type)) { // Sequence parameter set (SPS)
         saveCopyOfSPS(NALstartPtr, frameSize);
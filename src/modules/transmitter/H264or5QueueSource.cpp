@@ -24,12 +24,9 @@
 #include "H264or5QueueSource.hh"
 #include "../../VideoFrame.hh"
 #include "../../Utils.hh"
+#include "../../NalSplitter.hh"
 #include <stdio.h>
 
-#define START_CODE 0x00000001
-#define SHORT_START_LENGTH 3
-#define LONG_START_LENGTH 4
-
 #define H264_NALU_TYPE_MASK 0x1F
 #define H265_NALU_TYPE_MASK 0x7E
 
@@ -39,74 +36,60 @@
 #define SPS_AVC 7
 #define PPS_AVC 8
 
-uint8_t startOffset(unsigned char const* ptr) {
-    u_int32_t bytes = 0|(ptr[0]<<16)|(ptr[1]<<8)|ptr[2];
-    if (bytes == START_CODE) {
-        return SHORT_START_LENGTH;
-    }
-    bytes = (ptr[0]<<24)|(ptr[1]<<16)|(ptr[2]<<8)|ptr[3];
-    if (bytes == START_CODE) {
-        return LONG_START_LENGTH;
-    }
-    return 0;
-}
-
 H264or5QueueSource* H264or5QueueSource::createNew(UsageEnvironment& env, const StreamInfo *streamInfo) 
 {
   return new H264or5QueueSource(env, streamInfo);
 }
 
 H264or5QueueSource::H264or5QueueSource(UsageEnvironment& env, const StreamInfo *streamInfo)
-: QueueSource(env, streamInfo), fVPS(NULL), fSPS(NULL), fPPS(NULL), fVPSSize(0), fSPSSize(0), fPPSSize(0) 
+: QueueSource(env, streamInfo), extradataVersion(0), fVPS(NULL), fSPS(NULL), fPPS(NULL), 
+  fVPSSize(0), fSPSSize(0), fPPSSize(0) 
 {    
-    if (si->video.h264or5.annexb && si->extradata_size > 0){
-        parseExtradata();
-    }
+    parseExtradata();
 }
 
 H264or5QueueSource::~H264or5QueueSource()
 {
-    if(fVPS){
-        delete fVPS;
-    }
-    
-    if (fSPS){
-        delete fSPS;
-    }
-    
-    if (fPPS){
-        delete fPPS;
-    }
 }
 
 bool H264or5QueueSource::parseExtradata()
 {
-    int offset = 0;
-    int nalStart = 0;
-    uint8_t *nal;
+    //NOTE: the version is read first, an extradata published meanwhile is parsed on next call
+    unsigned version = si->getExtraDataVersion();
+    std::shared_ptr<const ExtraData> ed;
+    NalSpan span;
+    
+    if (extradata && version == extradataVersion){
+        return hasHeaders();
+    }
+    
+    ed = si->getExtraData();
     
-    if (!si->video.h264or5.annexb || si->extradata_size == 0){
+    if (!si->video.h264or5.annexb || !ed || ed->empty()){
         return false;
     }
     
-    if ((offset = startOffset(si->extradata)) > 0){
-        nalStart = offset;
-        while (offset < si->extradata_size){
-            if (startOffset(si->extradata + offset) > 0){
-                nal = new uint8_t[offset - nalStart];
-                memcpy(nal, si->extradata + nalStart, offset - nalStart);
-                feedHeaders(nal, offset - nalStart, si->video.codec);
-                offset += startOffset(si->extradata + offset);
-                nalStart = offset;
-            } else {
-                offset++;
+    extradataVersion = version;
+    fVPS = fSPS = fPPS = NULL;
+    fVPSSize = fSPSSize = fPPSSize = 0;
+    
+    if (NalSplitter::startCodeLength(ed->data(), ed->size()) > 0){
+        NalSplitter splitter(ed->data(), ed->size());
+        
+        while (splitter.next(span)){
+            if (span.size > 0){
+                feedHeaders(span.data, span.size, si->video.codec);
             }
         }
-        nal = new uint8_t[si->extradata_size - nalStart];
-        memcpy(nal, si->extradata + nalStart, si->extradata_size - nalStart);
-        feedHeaders(nal, si->extradata_size - nalStart, si->video.codec);
     }
     
+    extradata = ed;
+    
+    return hasHeaders();
+}
+
+bool H264or5QueueSource::hasHeaders() const
+{
     if (si->video.codec == H264 && fSPS && fPPS){
         return true;
     }
@@ -118,7 +101,7 @@ bool H264or5QueueSource::parseExtradata()
     return false;
 }
 
-void H264or5QueueSource::feedHeaders(uint8_t *nal, uint8_t nalSize, VCodecType codec)
+void H264or5QueueSource::feedHeaders(uint8_t const* nal, unsigned nalSize, VCodecType codec)
 {
     uint8_t nalType;
     
@@ -151,42 +134,15 @@ void H264or5QueueSource::feedHeaders(uint8_t *nal, uint8_t nalSize, VCodecType c
     }
 }
 
-void H264or5QueueSource::deliverFrame()
+bool H264or5QueueSource::setFrame(Frame *f)
 {
-    if (!isCurrentlyAwaitingData()) {
-        return; 
-    }
-    
-    if (!frame) {
-        return;
-    }
-    
-    unsigned char* buff;
-    unsigned int size;
-    uint8_t offset;
-    
-    size = frame->getLength();
-    buff = frame->getDataBuf();
+    unsigned offset;
 
-    offset = startOffset(buff);
-    
-    buff = frame->getDataBuf() + offset;
-    size = size - offset;
+    if (!f){
+        return false;
+    }
 
-    fPresentationTime.tv_sec = frame->getPresentationTime().count()/std::micro::den;
-    fPresentationTime.tv_usec = frame->getPresentationTime().count()%std::micro::den;
+    offset = NalSplitter::startCodeLength(f->getDataBuf(), f->getLength());
 
-    if (fMaxSize < size){
-        fFrameSize = fMaxSize;
-        fNumTruncatedBytes = size - fMaxSize;
-    } else {
-        fNumTruncatedBytes = 0; 
-        fFrameSize = size;
-    }
-    
-    memcpy(fTo, buff, fFrameSize);
-    processedFrame = true;
-    
-    afterGetting(this);
+    return pushFrame(f, offset);
 }
-
@@ -33,27 +33,40 @@ class H264or5QueueSource: public QueueSource {
 public:
     static H264or5QueueSource* createNew(UsageEnvironment& env, const StreamInfo *streamInfo);
     
+    /**
+    * Takes the parameter sets from the stream extradata. They point to the extradata version the source
+    * holds, which is only replaced when the writer publishes a new one
+    * @return true if the whole set of parameter sets of the codec is known
+    */
     bool parseExtradata();
     
-    uint8_t* getVPS() const {return fVPS;};
-    uint8_t* getSPS() const {return fSPS;};
-    uint8_t* getPPS() const {return fPPS;};
+    uint8_t const* getVPS() const {return fVPS;};
+    uint8_t const* getSPS() const {return fSPS;};
+    uint8_t const* getPPS() const {return fPPS;};
     
     unsigned getVPSSize() const {return fVPSSize;};
     unsigned getSPSSize() const {return fSPSSize;};
     unsigned getPPSSize() const {return fPPSSize;};
 
+    /**
+    * Copies a NAL unit without its start code
+    * @see QueueSource::setFrame
+    */
+    bool setFrame(Frame *f);
+
 protected:
     H264or5QueueSource(UsageEnvironment& env, const StreamInfo *streamInfo);
     ~H264or5QueueSource();
     
-    void feedHeaders(uint8_t *nal, uint8_t nalSize, VCodecType codec);
+    void feedHeaders(uint8_t const* nal, unsigned nalSize, VCodecType codec);
+    bool hasHeaders() const;
     
-    void deliverFrame();
+    std::shared_ptr<const ExtraData> extradata;
+    unsigned extradataVersion;
     
-    uint8_t* fVPS; 
-    uint8_t* fSPS;
-    uint8_t* fPPS;
+    uint8_t const* fVPS; 
+    uint8_t const* fSPS;
+    uint8_t const* fPPS;
     
     unsigned fVPSSize;
     unsigned fSPSSize; 
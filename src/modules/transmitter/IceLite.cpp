@@ -0,0 +1,275 @@
+/*
+ *  IceLite.cpp - STUN binding handling of an ICE-lite agent
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include "IceLite.hh"
+
+#define STUN_MAGIC_COOKIE 0x2112A442
+#define STUN_FINGERPRINT_XOR 0x5354554E
+#define STUN_ATTR_HEADER 4
+#define STUN_INTEGRITY_SIZE 20
+#define STUN_FINGERPRINT_SIZE 4
+
+#define ATTR_USERNAME 0x0006
+#define ATTR_MESSAGE_INTEGRITY 0x0008
+#define ATTR_XOR_MAPPED_ADDRESS 0x0020
+#define ATTR_USE_CANDIDATE 0x0025
+#define ATTR_FINGERPRINT 0x8028
+
+#define ADDRESS_FAMILY_IPV4 0x01
+
+static const char iceChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static uint16_t readU16(const unsigned char* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t readU32(const unsigned char* p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static void writeU16(unsigned char* p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static void writeU32(unsigned char* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+struct Crc32Table {
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (unsigned k = 0; k < 8; k++) {
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            values[i] = c;
+        }
+    };
+
+    uint32_t values[256];
+};
+
+static uint32_t crc32(const unsigned char* data, unsigned size)
+{
+    static const Crc32Table table;
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (unsigned i = 0; i < size; i++) {
+        crc = table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xFFFFFFFF;
+}
+
+//NOTE: calls back each attribute with its offset in the message, stops when the callback returns false
+template <typename F>
+static bool forEachAttribute(const unsigned char* data, unsigned size, F callback)
+{
+    unsigned offset = STUN_HEADER_SIZE;
+    unsigned end = STUN_HEADER_SIZE + readU16(data + 2);
+    uint16_t length;
+
+    if (end > size) {
+        return false;
+    }
+
+    while (offset + STUN_ATTR_HEADER <= end) {
+        length = readU16(data + offset + 2);
+
+        if (offset + STUN_ATTR_HEADER + length > end) {
+            return false;
+        }
+
+        if (!callback(readU16(data + offset), offset, length)) {
+            return true;
+        }
+
+        offset += STUN_ATTR_HEADER + ((length + 3) & ~3);
+    }
+
+    return true;
+}
+
+bool IceLite::isStun(const unsigned char* data, unsigned size)
+{
+    return size >= STUN_HEADER_SIZE && data[0] < 2 && readU32(data + 4) == STUN_MAGIC_COOKIE &&
+           (readU16(data + 2) & 3) == 0;
+}
+
+bool IceLite::parseBindingRequest(const unsigned char* data, unsigned size, StunRequest &request)
+{
+    if (!isStun(data, size) || readU16(data) != STUN_BINDING_REQUEST) {
+        return false;
+    }
+
+    memcpy(request.transaction, data + 8, STUN_TRANSACTION_SIZE);
+    request.username.clear();
+    request.useCandidate = false;
+
+    if (!forEachAttribute(data, size, [data, &request](uint16_t type, unsigned offset, uint16_t length) {
+            if (type == ATTR_USERNAME) {
+                request.username.assign((const char*) data + offset + STUN_ATTR_HEADER, length);
+            } else if (type == ATTR_USE_CANDIDATE) {
+                request.useCandidate = true;
+            }
+            return true;
+        })) {
+        return false;
+    }
+
+    return !request.username.empty();
+}
+
+bool IceLite::checkIntegrity(const unsigned char* data, unsigned size, std::string password)
+{
+    std::vector<unsigned char> copy;
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned digestLen;
+    unsigned integrity = 0;
+    unsigned fingerprint = 0;
+
+    if (!isStun(data, size)) {
+        return false;
+    }
+
+    if (!forEachAttribute(data, size, [&integrity, &fingerprint](uint16_t type, unsigned offset, uint16_t length) {
+            if (type == ATTR_MESSAGE_INTEGRITY && length == STUN_INTEGRITY_SIZE && integrity == 0) {
+                integrity = offset;
+            } else if (type == ATTR_FINGERPRINT && length == STUN_FINGERPRINT_SIZE) {
+                fingerprint = offset;
+                return false;
+            }
+            return true;
+        })) {
+        return false;
+    }
+
+    if (fingerprint > 0 &&
+        (crc32(data, fingerprint) ^ STUN_FINGERPRINT_XOR) != readU32(data + fingerprint + STUN_ATTR_HEADER)) {
+        return false;
+    }
+
+    if (integrity == 0) {
+        return false;
+    }
+
+    //NOTE: the HMAC covers the message up to the attribute, with the length field ending right after it
+    copy.assign(data, data + integrity);
+    writeU16(copy.data() + 2, integrity + STUN_ATTR_HEADER + STUN_INTEGRITY_SIZE - STUN_HEADER_SIZE);
+
+    HMAC(EVP_sha1(), password.data(), password.size(), copy.data(), copy.size(), digest, &digestLen);
+
+    return CRYPTO_memcmp(digest, data + integrity + STUN_ATTR_HEADER, STUN_INTEGRITY_SIZE) == 0;
+}
+
+void IceLite::buildBindingResponse(const StunRequest &request, const struct sockaddr_in &address,
+                                   std::string password, std::vector<unsigned char> &response)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned digestLen;
+    uint16_t port = ntohs(address.sin_port);
+    uint32_t ip = ntohl(address.sin_addr.s_addr);
+    unsigned offset;
+
+    response.assign(STUN_HEADER_SIZE, 0);
+    writeU16(response.data(), STUN_BINDING_RESPONSE);
+    writeU32(response.data() + 4, STUN_MAGIC_COOKIE);
+    memcpy(response.data() + 8, request.transaction, STUN_TRANSACTION_SIZE);
+
+    offset = response.size();
+    response.resize(offset + STUN_ATTR_HEADER + 8);
+    writeU16(response.data() + offset, ATTR_XOR_MAPPED_ADDRESS);
+    writeU16(response.data() + offset + 2, 8);
+    response[offset + 4] = 0;
+    response[offset + 5] = ADDRESS_FAMILY_IPV4;
+    writeU16(response.data() + offset + 6, port ^ (STUN_MAGIC_COOKIE >> 16));
+    writeU32(response.data() + offset + 8, ip ^ STUN_MAGIC_COOKIE);
+
+    offset = response.size();
+    writeU16(response.data() + 2, offset + STUN_ATTR_HEADER + STUN_INTEGRITY_SIZE - STUN_HEADER_SIZE);
+    HMAC(EVP_sha1(), password.data(), password.size(), response.data(), offset, digest, &digestLen);
+    response.resize(offset + STUN_ATTR_HEADER + STUN_INTEGRITY_SIZE);
+    writeU16(response.data() + offset, ATTR_MESSAGE_INTEGRITY);
+    writeU16(response.data() + offset + 2, STUN_INTEGRITY_SIZE);
+    memcpy(response.data() + offset + STUN_ATTR_HEADER, digest, STUN_INTEGRITY_SIZE);
+
+    offset = response.size();
+    writeU16(response.data() + 2, offset + STUN_ATTR_HEADER + STUN_FINGERPRINT_SIZE - STUN_HEADER_SIZE);
+    response.resize(offset + STUN_ATTR_HEADER + STUN_FINGERPRINT_SIZE);
+    writeU16(response.data() + offset, ATTR_FINGERPRINT);
+    writeU16(response.data() + offset + 2, STUN_FINGERPRINT_SIZE);
+    writeU32(response.data() + offset + STUN_ATTR_HEADER, crc32(response.data(), offset) ^ STUN_FINGERPRINT_XOR);
+}
+
+bool IceLite::getMappedAddress(const unsigned char* data, unsigned size, struct sockaddr_in &address)
+{
+    bool found = false;
+
+    if (!isStun(data, size)) {
+        return false;
+    }
+
+    forEachAttribute(data, size, [data, &address, &found](uint16_t type, unsigned offset, uint16_t length) {
+        const unsigned char* value = data + offset + STUN_ATTR_HEADER;
+
+        if (type != ATTR_XOR_MAPPED_ADDRESS || length != 8 || value[1] != ADDRESS_FAMILY_IPV4) {
+            return true;
+        }
+
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(readU16(value + 2) ^ (STUN_MAGIC_COOKIE >> 16));
+        address.sin_addr.s_addr = htonl(readU32(value + 4) ^ STUN_MAGIC_COOKIE);
+        found = true;
+        return false;
+    });
+
+    return found;
+}
+
+std::string IceLite::randomCredential(unsigned length)
+{
+    std::vector<unsigned char> random(length);
+    std::string credential;
+
+    if (RAND_bytes(random.data(), length) != 1) {
+        return "";
+    }
+
+    for (auto r : random) {
+        credential += iceChars[r % (sizeof(iceChars) - 1)];
+    }
+
+    return credential;
+}
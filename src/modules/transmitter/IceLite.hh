@@ -0,0 +1,95 @@
+/*
+ *  IceLite.hh - STUN binding handling of an ICE-lite agent
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _ICE_LITE_HH
+#define _ICE_LITE_HH
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define STUN_HEADER_SIZE 20
+#define STUN_TRANSACTION_SIZE 12
+#define STUN_BINDING_REQUEST 0x0001
+#define STUN_BINDING_RESPONSE 0x0101
+
+/*! Binding request of a connectivity check */
+struct StunRequest {
+    StunRequest() : useCandidate(false) {};
+
+    unsigned char transaction[STUN_TRANSACTION_SIZE];
+    std::string username;               //!< "local ufrag:remote ufrag"
+    bool useCandidate;                  //!< The controlling agent nominates the pair
+};
+
+/*! Connectivity checks of an ICE-lite agent (RFC 8445): it only answers the STUN binding requests
+    of the full agent (i.e. the browser), with short term credentials (RFC 5389). The messages are
+    handled statelessly, the agent using each request is found by its username.
+*/
+class IceLite {
+
+public:
+    /**
+    * @return true if the datagram is a STUN message (RFC 7983 demultiplexing)
+    */
+    static bool isStun(const unsigned char* data, unsigned size);
+
+    /**
+    * Parses a binding request, its integrity is not checked
+    * @param data STUN message
+    * @param size message size
+    * @param request parsed request
+    * @return false if it is not a well formed binding request
+    */
+    static bool parseBindingRequest(const unsigned char* data, unsigned size, StunRequest &request);
+
+    /**
+    * Checks the MESSAGE-INTEGRITY and the FINGERPRINT (if present) of a message
+    * @param password short term password, the ice-pwd of the receiving agent
+    * @return false if an attribute is missing or wrong
+    */
+    static bool checkIntegrity(const unsigned char* data, unsigned size, std::string password);
+
+    /**
+    * Builds the success response of a binding request
+    * @param request the request answered
+    * @param address source address of the request, sent as XOR-MAPPED-ADDRESS
+    * @param password short term password, the ice-pwd of the answering agent
+    * @param response the response message
+    */
+    static void buildBindingResponse(const StunRequest &request, const struct sockaddr_in &address,
+                                     std::string password, std::vector<unsigned char> &response);
+
+    /**
+    * Gets the XOR-MAPPED-ADDRESS of a response
+    * @return false if it has none or it is not IPv4
+    */
+    static bool getMappedAddress(const unsigned char* data, unsigned size, struct sockaddr_in &address);
+
+    /**
+    * @return random ICE credential of the given length, from the ice-char set
+    */
+    static std::string randomCredential(unsigned length);
+};
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ *  MPEGTSMuxer.cpp - live555 source muxing elementary streams in MPEG-TS
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <sys/time.h>
+
+#include "MPEGTSMuxer.hh"
+#include "../../Utils.hh"
+
+#define NAL_START_SIZE 4
+
+static bool isVCL(VCodecType codec, unsigned char nalType)
+{
+    return codec == H264 ? (nalType >= 1 && nalType <= 5) : nalType < 32;
+}
+
+static bool isRandomAccess(VCodecType codec, unsigned char nalType)
+{
+    //NOTE: parameter sets go first, so the tables are repeated before them
+    return codec == H264 ? (nalType == 5 || nalType == 7) : ((nalType >= 16 && nalType <= 21) || nalType == 32);
+}
+
+MPEGTSMuxer* MPEGTSMuxer::createNew(UsageEnvironment& env)
+{
+    return new MPEGTSMuxer(env);
+}
+
+MPEGTSMuxer::MPEGTSMuxer(UsageEnvironment& env) :
+    FramedSource(env), fetching(false), fetchAgain(false)
+{
+
+}
+
+MPEGTSMuxer::~MPEGTSMuxer()
+{
+    for (auto input : inputs) {
+        Medium::close(input->source);
+        delete input;
+    }
+}
+
+bool MPEGTSMuxer::addVideoSource(FramedSource* source, VCodecType codec)
+{
+    int stream;
+
+    if (codec != H264 && codec != H265) {
+        utils::errorMsg("MPEG-TS muxer only supports H264 and H265 video");
+        return false;
+    }
+
+    stream = packetizer.addStream(codec == H264 ? TS_STREAM_H264 : TS_STREAM_H265);
+
+    return addInput(source, stream, codec, TS_VIDEO_BUFFER_SIZE);
+}
+
+bool MPEGTSMuxer::addAudioSource(FramedSource* source, ACodecType codec)
+{
+    int stream;
+
+    if (codec != AAC && codec != MP3) {
+        utils::errorMsg("MPEG-TS muxer only supports AAC and MP3 audio");
+        return false;
+    }
+
+    stream = packetizer.addStream(codec == AAC ? TS_STREAM_AAC : TS_STREAM_MP3);
+
+    return addInput(source, stream, VC_NONE, TS_AUDIO_BUFFER_SIZE);
+}
+
+bool MPEGTSMuxer::addInput(FramedSource* source, int stream, VCodecType codec, unsigned bufferSize)
+{
+    Input* input;
+
+    if (!source || stream < 0) {
+        utils::errorMsg("MPEG-TS muxer input could not be added");
+        return false;
+    }
+
+    input = new Input();
+    input->muxer = this;
+    input->source = source;
+    input->stream = stream;
+    input->codec = codec;
+    input->buffer.resize(bufferSize);
+    input->size = 0;
+    input->pts = 0;
+    input->lastPts = 0;
+    input->started = false;
+    input->randomAccess = false;
+    input->reading = false;
+
+    inputs.push_back(input);
+    return true;
+}
+
+void MPEGTSMuxer::doGetNextFrame()
+{
+    if (packetizer.getPendingPackets() > 0) {
+        deliver();
+    }
+
+    readInputs();
+}
+
+void MPEGTSMuxer::doStopGettingFrames()
+{
+    for (auto input : inputs) {
+        input->source->stopGettingFrames();
+        input->reading = false;
+    }
+}
+
+void MPEGTSMuxer::readInputs()
+{
+    Input* input;
+
+    //NOTE: inputs may deliver from getNextFrame, looping here avoids nesting a call per frame
+    if (fetching) {
+        fetchAgain = true;
+        return;
+    }
+
+    fetching = true;
+
+    do {
+        fetchAgain = false;
+
+        for (size_t i = 0; i < inputs.size(); i++) {
+            input = inputs[i];
+
+            if (input->reading || packetizer.getPendingPackets() >= TS_MAX_PENDING_PACKETS) {
+                continue;
+            }
+
+            //NOTE: a video input without room for another NAL unit writes what it has staged
+            if (input->buffer.size() - input->size < TS_AUDIO_BUFFER_SIZE) {
+                writeVideo(input);
+            }
+
+            input->reading = true;
+            input->source->getNextFrame(input->buffer.data() + input->size, input->buffer.size() - input->size,
+                                        afterGettingFrame, input, onSourceClosure, input);
+        }
+    } while (fetchAgain);
+
+    fetching = false;
+}
+
+void MPEGTSMuxer::deliver()
+{
+    unsigned packets = packetizer.getPendingPackets();
+
+    if (packets > TS_PACKETS_PER_DATAGRAM) {
+        packets = TS_PACKETS_PER_DATAGRAM;
+    }
+
+    if (packets > fMaxSize/TS_PACKET_SIZE) {
+        packets = fMaxSize/TS_PACKET_SIZE;
+    }
+
+    if (packets == 0) {
+        utils::errorMsg("MPEG-TS muxer output buffer is smaller than a TS packet");
+        FramedSource::handleClosure(this);
+        return;
+    }
+
+    memcpy(fTo, packetizer.getPackets(), packets*TS_PACKET_SIZE);
+    packetizer.consume(packets);
+
+    fFrameSize = packets*TS_PACKET_SIZE;
+    fNumTruncatedBytes = 0;
+    gettimeofday(&fPresentationTime, NULL);
+    fDurationInMicroseconds = 0;
+
+    FramedSource::afterGetting(this);
+}
+
+void MPEGTSMuxer::afterGettingFrame(void* clientData, unsigned frameSize,
+                                    unsigned numTruncatedBytes,
+                                    struct timeval presentationTime,
+                                    unsigned /*durationInMicroseconds*/)
+{
+    Input* input = (Input*) clientData;
+    input->muxer->afterGettingFrame1(input, frameSize, numTruncatedBytes, presentationTime);
+}
+
+void MPEGTSMuxer::afterGettingFrame1(Input* input, unsigned frameSize,
+                                     unsigned numTruncatedBytes,
+                                     struct timeval presentationTime)
+{
+    uint64_t pts;
+
+    input->reading = false;
+
+    if (numTruncatedBytes > 0) {
+        utils::warningMsg("MPEG-TS muxer input frame has been truncated");
+    }
+
+    pts = (uint64_t) presentationTime.tv_sec*90000 + (uint64_t) presentationTime.tv_usec*9/100;
+
+    if (input->codec == VC_NONE) {
+        packetizer.writeFrame(input->stream, input->buffer.data(), frameSize, pts);
+    } else if (frameSize > NAL_START_SIZE) {
+        addVideoChunk(input, frameSize, pts);
+    }
+
+    if (isCurrentlyAwaitingData() && packetizer.getPendingPackets() > 0) {
+        deliver();
+    }
+
+    readInputs();
+}
+
+void MPEGTSMuxer::addVideoChunk(Input* input, unsigned chunkSize, uint64_t pts)
+{
+    unsigned char* chunk = input->buffer.data() + input->size;
+    unsigned char nalType;
+
+    //NOTE: staged NAL units of another access unit are written on their own
+    if (input->size > 0 && pts != input->pts) {
+        writeVideo(input);
+        memmove(input->buffer.data(), chunk, chunkSize);
+        chunk = input->buffer.data();
+    }
+
+    if (input->codec == H264) {
+        nalType = chunk[NAL_START_SIZE] & 0x1F;
+    } else {
+        nalType = (chunk[NAL_START_SIZE] & 0x7E) >> 1;
+    }
+
+    input->pts = pts;
+    input->size += chunkSize;
+    input->randomAccess = input->randomAccess || isRandomAccess(input->codec, nalType);
+
+    if (isVCL(input->codec, nalType)) {
+        writeVideo(input);
+    }
+}
+
+void MPEGTSMuxer::writeVideo(Input* input)
+{
+    if (input->size == 0) {
+        return;
+    }
+
+    packetizer.writeFrame(input->stream, input->buffer.data(), input->size, input->pts,
+                          !input->started || input->pts != input->lastPts, input->randomAccess);
+
+    input->lastPts = input->pts;
+    input->started = true;
+    input->randomAccess = false;
+    input->size = 0;
+}
+
+void MPEGTSMuxer::onSourceClosure(void* clientData)
+{
+    Input* input = (Input*) clientData;
+    input->reading = false;
+    FramedSource::handleClosure(input->muxer);
+}
@@ -0,0 +1,114 @@
+/*
+ *  MPEGTSMuxer.hh - live555 source muxing elementary streams in MPEG-TS
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _MPEGTS_MUXER_HH
+#define _MPEGTS_MUXER_HH
+
+#include <vector>
+#include <liveMedia.hh>
+
+#include "TSPacketizer.hh"
+#include "../../Types.hh"
+
+#define TS_VIDEO_BUFFER_SIZE 2*1024*1024 //!< Largest video access unit part staged before its VCL NAL unit
+#define TS_AUDIO_BUFFER_SIZE 8192
+#define TS_MAX_PENDING_PACKETS 4096     //!< Inputs are not read while more TS packets wait to be delivered
+
+/*! Native MPEG-TS muxer of one program. Each input frame is written once, as a PES packet, into the
+    preallocated TS packets of a TSPacketizer, and TS_PACKETS_PER_DATAGRAM packets are delivered at a time.
+    Video inputs must deliver H.264 or H.265 NAL units with start codes: the non VCL ones are staged and
+    written together with the next VCL NAL unit, and only the first PES of each access unit carries a PTS.
+    Sinks keep the usual live555 interface, so it replaces MPEG2TransportStreamFromESSource for RTP, SRT
+    or any other sink consuming a TS byte stream.
+*/
+class MPEGTSMuxer: public FramedSource {
+
+public:
+    /**
+    * Constructor wrapper
+    * @param env Live555 environement
+    * @return Pointer to the object if succeded and NULL if not
+    */
+    static MPEGTSMuxer* createNew(UsageEnvironment& env);
+
+    /**
+    * Adds a video input, which is closed with the muxer
+    * @param source Source delivering NAL units preceded by a start code
+    * @param codec H264 or H265
+    * @return True if succeeded and false if not
+    */
+    bool addVideoSource(FramedSource* source, VCodecType codec);
+
+    /**
+    * Adds an audio input, which is closed with the muxer
+    * @param source Source delivering AAC ADTS or MP3 frames
+    * @param codec AAC or MP3
+    * @return True if succeeded and false if not
+    */
+    bool addAudioSource(FramedSource* source, ACodecType codec);
+
+    size_t getWrittenPackets() const {return packetizer.getWrittenPackets();};
+
+protected:
+    MPEGTSMuxer(UsageEnvironment& env);
+    virtual ~MPEGTSMuxer();
+
+private:
+    struct Input {
+        MPEGTSMuxer* muxer;
+        FramedSource* source;
+        int stream;
+        VCodecType codec;               //!< VC_NONE for audio inputs
+        std::vector<unsigned char> buffer;
+        unsigned size;                  //!< Staged bytes of a video input
+        uint64_t pts;
+        uint64_t lastPts;
+        bool started;
+        bool randomAccess;
+        bool reading;
+    };
+
+    bool addInput(FramedSource* source, int stream, VCodecType codec, unsigned bufferSize);
+    void doGetNextFrame();
+    void doStopGettingFrames();
+    void readInputs();
+    void deliver();
+    void addVideoChunk(Input* input, unsigned chunkSize, uint64_t pts);
+    void writeVideo(Input* input);
+
+    static void afterGettingFrame(void* clientData, unsigned frameSize,
+                                  unsigned numTruncatedBytes,
+                                  struct timeval presentationTime,
+                                  unsigned durationInMicroseconds);
+    void afterGettingFrame1(Input* input, unsigned frameSize,
+                            unsigned numTruncatedBytes,
+                            struct timeval presentationTime);
+    static void onSourceClosure(void* clientData);
+
+    TSPacketizer packetizer;
+    std::vector<Input*> inputs;
+
+    bool fetching;
+    bool fetchAgain;
+};
+
+#endif
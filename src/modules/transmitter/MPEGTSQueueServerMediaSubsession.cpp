@@ -111,24 +111,22 @@ FramedSource* MPEGTSQueueServerMediaSubsession::createNewStreamSource(unsigned c
                                                                       unsigned& estBitrate)
 {
     FramedSource* startCodeInjector;
-    MPEG2TransportStreamFromESSource* tsFramer;
+    MPEGTSMuxer* tsMuxer;
     //TODO: WTF
     estBitrate = 2000; // kbps, estimate
     
-    tsFramer = MPEG2TransportStreamFromESSource::createNew(envir());
+    tsMuxer = MPEGTSMuxer::createNew(envir());
     
     if (vReplicator){
         startCodeInjector = H264or5StartCodeInjector::createNew(envir(), vReplicator->createStreamReplica(), vCodec);
-        if (vCodec == H264) tsFramer->addNewVideoSource(startCodeInjector, 5/*mpegVersion: H.264*/);
-        if (vCodec == H265) tsFramer->addNewVideoSource(startCodeInjector, 6 /* mpegVersion: H.265*/);
+        tsMuxer->addVideoSource(startCodeInjector, vCodec);
     }
     
     if (aReplicator){
-        if (aCodec == AAC) tsFramer->addNewAudioSource(aReplicator->createStreamReplica(), 4/*mpegVersion: AAC*/);
-        if (aCodec == MP3) tsFramer->addNewAudioSource(aReplicator->createStreamReplica(), 1/*mpegVersion: MP3*/);
+        tsMuxer->addAudioSource(aReplicator->createStreamReplica(), aCodec);
     }
     
-    return tsFramer;
+    return tsMuxer;
 }
 
 RTPSink* MPEGTSQueueServerMediaSubsession::createNewRTPSink(Groupsock* rtpGroupsock,
@@ -0,0 +1,213 @@
+/*
+ *  OpusRepacketizer.cpp - Filter joining consecutive Opus frames in a packet
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+
+#include "OpusRepacketizer.hh"
+#include "../../Utils.hh"
+
+OpusRepacketizer* OpusRepacketizer::createNew(UsageEnvironment& env, FramedSource* inputSource, unsigned ptime)
+{
+    return new OpusRepacketizer(env, inputSource, ptime);
+}
+
+OpusRepacketizer::OpusRepacketizer(UsageEnvironment& env, FramedSource* inputSource, unsigned ptime) :
+    FramedFilter(env, inputSource), fPtime(ptime*10), fInputSize(0), fInputDuration(0), fToc(0), fFramesDuration(0)
+{
+    fFrames.reserve(OPUS_MAX_PACKET_SIZE);
+    fFrameSizes.reserve(OPUS_MAX_FRAMES);
+}
+
+OpusRepacketizer::~OpusRepacketizer()
+{
+}
+
+unsigned OpusRepacketizer::frameDuration(unsigned char toc)
+{
+    static const unsigned silkDurations[4] = {100, 200, 400, 600};
+    unsigned config = toc >> 3;
+
+    //NOTE: configurations 0-11 are SILK, 12-15 hybrid and 16-31 CELT (RFC 6716, section 3.1)
+    if (config < 12) {
+        return silkDurations[config & 0x03];
+    }
+
+    if (config < 16) {
+        return 100 << (config & 0x01);
+    }
+
+    return 25 << (config & 0x03);
+}
+
+unsigned OpusRepacketizer::maxPayloadSize() const
+{
+    return fMaxSize < OPUS_MAX_PACKET_SIZE ? fMaxSize : OPUS_MAX_PACKET_SIZE;
+}
+
+void OpusRepacketizer::doGetNextFrame()
+{
+    fFrames.clear();
+    fFrameSizes.clear();
+    fFramesDuration = 0;
+
+    //NOTE: the packet which could not be joined to the previous ones starts this one
+    if (fInputSize > 0) {
+        addPacket();
+        return;
+    }
+
+    getNextPacket();
+}
+
+void OpusRepacketizer::getNextPacket()
+{
+    fInputSource->getNextFrame(fInputBuffer, OPUS_MAX_PACKET_SIZE,
+                               afterGettingFrame, this,
+                               FramedSource::handleClosure, this);
+}
+
+void OpusRepacketizer::afterGettingFrame(void* clientData, unsigned frameSize,
+                                         unsigned numTruncatedBytes,
+                                         struct timeval presentationTime,
+                                         unsigned durationInMicroseconds)
+{
+    OpusRepacketizer* repacketizer = (OpusRepacketizer*) clientData;
+    repacketizer->afterGettingFrame1(frameSize, numTruncatedBytes, presentationTime,
+                                     durationInMicroseconds);
+}
+
+void OpusRepacketizer::afterGettingFrame1(unsigned frameSize,
+                                          unsigned numTruncatedBytes,
+                                          struct timeval presentationTime,
+                                          unsigned durationInMicroseconds)
+{
+    if (numTruncatedBytes > 0) {
+        utils::warningMsg("Opus packet too large, it has been truncated");
+    }
+
+    fInputSize = frameSize;
+    fInputTime = presentationTime;
+    fInputDuration = durationInMicroseconds;
+
+    if (fInputSize == 0) {
+        getNextPacket();
+        return;
+    }
+
+    addPacket();
+}
+
+void OpusRepacketizer::addPacket()
+{
+    unsigned frameSize = fInputSize - 1;
+    unsigned size;
+
+    //NOTE: only code 0 packets carry a single frame which can be copied as it is
+    if ((fInputBuffer[0] & 0x03) != 0 || frameSize > OPUS_MAX_FRAME_SIZE) {
+        if (fFrameSizes.empty()) {
+            deliverInput();
+        } else {
+            deliverFrames();
+        }
+        return;
+    }
+
+    if (!fFrameSizes.empty()) {
+        //NOTE: TOC, frame count, the size of every frame but the last one and the frames
+        size = 2 + 2*fFrameSizes.size() + fFrames.size() + frameSize;
+
+        if ((fInputBuffer[0] & 0xFC) != fToc || size > maxPayloadSize() ||
+            (fFrameSizes.size() + 1)*frameDuration(fToc) > OPUS_MAX_DURATION) {
+            deliverFrames();
+            return;
+        }
+    } else {
+        fToc = fInputBuffer[0] & 0xFC;
+        fFramesTime = fInputTime;
+    }
+
+    fFrames.insert(fFrames.end(), fInputBuffer + 1, fInputBuffer + fInputSize);
+    fFrameSizes.push_back(frameSize);
+    fFramesDuration += fInputDuration;
+    fInputSize = 0;
+
+    if (fFrameSizes.size()*frameDuration(fToc) >= fPtime) {
+        deliverFrames();
+        return;
+    }
+
+    getNextPacket();
+}
+
+void OpusRepacketizer::deliverFrames()
+{
+    unsigned char* header = fTo;
+    unsigned size;
+
+    if (fFrameSizes.size() == 1) {
+        *header++ = fToc;
+    } else {
+        // Code 3 packet with VBR frames and no padding, every frame size but the last one is coded
+        *header++ = fToc | 0x03;
+        *header++ = 0x80 | fFrameSizes.size();
+
+        for (size_t i = 0; i + 1 < fFrameSizes.size(); i++) {
+            size = fFrameSizes[i];
+            if (size < 252) {
+                *header++ = size;
+            } else {
+                *header++ = 252 + (size & 0x03);
+                *header++ = (size - 252) >> 2;
+            }
+        }
+    }
+
+    memcpy(header, fFrames.data(), fFrames.size());
+
+    fFrameSize = (header - fTo) + fFrames.size();
+    fNumTruncatedBytes = 0;
+    fPresentationTime = fFramesTime;
+    fDurationInMicroseconds = fFramesDuration;
+
+    afterGetting(this);
+}
+
+void OpusRepacketizer::deliverInput()
+{
+    unsigned size = fInputSize;
+
+    if (size > fMaxSize) {
+        fNumTruncatedBytes = size - fMaxSize;
+        size = fMaxSize;
+    } else {
+        fNumTruncatedBytes = 0;
+    }
+
+    memcpy(fTo, fInputBuffer, size);
+
+    fFrameSize = size;
+    fPresentationTime = fInputTime;
+    fDurationInMicroseconds = fInputDuration;
+    fInputSize = 0;
+
+    afterGetting(this);
+}
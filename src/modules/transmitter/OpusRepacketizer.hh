@@ -0,0 +1,89 @@
+/*
+ *  OpusRepacketizer.hh - Filter joining consecutive Opus frames in a packet
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _OPUS_REPACKETIZER_HH
+#define _OPUS_REPACKETIZER_HH
+
+#include <vector>
+#include "FramedFilter.hh"
+
+#define OPUS_MAX_FRAME_SIZE 1275        //!< Largest compressed Opus frame
+#define OPUS_MAX_FRAMES 48              //!< Largest number of frames of an Opus packet (120 msec)
+#define OPUS_MAX_DURATION 1200          //!< Longest Opus packet in tenths of msec
+#define OPUS_MAX_PACKET_SIZE 1200       //!< Largest repacketized payload, so it fits a single RTP packet
+
+/*! RFC 7587 only allows one Opus packet per RTP packet, so the encoder frames are joined in a
+    single code 3 (VBR) Opus packet until it lasts the requested ptime. Only single frame (code 0)
+    packets with the same configuration are joined, other packets are delivered as they are.
+*/
+class OpusRepacketizer: public FramedFilter {
+public:
+    /**
+    * Constructor wrapper
+    * @param env Live555 environement
+    * @param inputSource Input source, which contains Opus packets
+    * @param ptime Audio duration in msec of each output packet
+    * @return Pointer to the object if succeded and NULL if not
+    */
+    static OpusRepacketizer* createNew(UsageEnvironment& env, FramedSource* inputSource, unsigned ptime);
+
+    /**
+    * @param toc TOC byte of an Opus packet
+    * @return Duration of each frame of the packet in tenths of msec
+    */
+    static unsigned frameDuration(unsigned char toc);
+
+protected:
+    OpusRepacketizer(UsageEnvironment& env, FramedSource* inputSource, unsigned ptime);
+    virtual ~OpusRepacketizer();
+
+private:
+    void doGetNextFrame();
+    static void afterGettingFrame(void* clientData, unsigned frameSize,
+                                  unsigned numTruncatedBytes,
+                                  struct timeval presentationTime,
+                                  unsigned durationInMicroseconds);
+    void afterGettingFrame1(unsigned frameSize,
+                            unsigned numTruncatedBytes,
+                            struct timeval presentationTime,
+                            unsigned durationInMicroseconds);
+    void getNextPacket();
+    void addPacket();
+    void deliverFrames();
+    void deliverInput();
+    unsigned maxPayloadSize() const;
+
+    unsigned fPtime;                    //!< In tenths of msec
+
+    unsigned char fInputBuffer[OPUS_MAX_PACKET_SIZE];
+    unsigned fInputSize;                //!< Size of the packet waiting in fInputBuffer, 0 if none
+    struct timeval fInputTime;
+    unsigned fInputDuration;
+
+    std::vector<unsigned char> fFrames;
+    std::vector<unsigned> fFrameSizes;
+    unsigned char fToc;
+    struct timeval fFramesTime;
+    unsigned fFramesDuration;
+};
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ *  PCMAudioRTPSink.cpp - Simple RTP sink packing a ptime of audio samples per packet
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "PCMAudioRTPSink.hh"
+#include "../../Utils.hh"
+
+PCMAudioRTPSink* PCMAudioRTPSink::createNew(UsageEnvironment& env, Groupsock* RTPgs, unsigned char rtpPayloadFormat,
+                                            ACodecType codec, unsigned channels, unsigned sampleRate,
+                                            SampleFmt sampleFormat, char const* codecStr, unsigned ptime)
+{
+    int bytesPerSample;
+
+    //NOTE: PCMU and G711 carry one byte per sample whatever the format of the decoded samples
+    if (codec == PCMU || codec == G711) {
+        bytesPerSample = 1;
+    } else if (codec == PCM) {
+        bytesPerSample = utils::getBytesPerSampleFromFormat(sampleFormat);
+    } else {
+        bytesPerSample = 0;
+    }
+
+    if (bytesPerSample <= 0 || ptime == 0) {
+        utils::errorMsg("PCMAudioRTPSink only supports sample based codecs and a ptime");
+        return NULL;
+    }
+
+    return new PCMAudioRTPSink(env, RTPgs, rtpPayloadFormat, channels, sampleRate, codecStr,
+                               ptime*sampleRate/1000*channels*bytesPerSample);
+}
+
+PCMAudioRTPSink::PCMAudioRTPSink(UsageEnvironment& env, Groupsock* RTPgs, unsigned char rtpPayloadFormat,
+                                 unsigned channels, unsigned sampleRate, char const* codecStr, unsigned ptimeBytes) :
+    SimpleRTPSink(env, RTPgs, rtpPayloadFormat, sampleRate, "audio", codecStr, channels, True, True),
+    fPtimeBytes(ptimeBytes), fPacketBytes(0)
+{
+    //NOTE: the preferred size would close the packets before reaching the ptime
+    setPacketSizes(ourMaxPacketSize(), ourMaxPacketSize());
+}
+
+Boolean PCMAudioRTPSink::frameCanAppearAfterPacketStart(unsigned char const* /*frameStart*/,
+                                                        unsigned numBytesInFrame) const
+{
+    return fPacketBytes + numBytesInFrame <= fPtimeBytes;
+}
+
+void PCMAudioRTPSink::doSpecialFrameHandling(unsigned fragmentationOffset,
+                                             unsigned char* frameStart,
+                                             unsigned numBytesInFrame,
+                                             struct timeval framePresentationTime,
+                                             unsigned numRemainingBytes)
+{
+    if (isFirstFrameInPacket()) {
+        fPacketBytes = 0;
+    }
+
+    fPacketBytes += numBytesInFrame;
+
+    SimpleRTPSink::doSpecialFrameHandling(fragmentationOffset, frameStart, numBytesInFrame,
+                                          framePresentationTime, numRemainingBytes);
+}
@@ -0,0 +1,70 @@
+/*
+ *  PCMAudioRTPSink.hh - Simple RTP sink packing a ptime of audio samples per packet
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _PCM_AUDIO_RTP_SINK_HH
+#define _PCM_AUDIO_RTP_SINK_HH
+
+#include <liveMedia.hh>
+#include "../../Types.hh"
+
+/*! Simple RTP sink for sample based codecs (L16, PCMU and G711). Consecutive frames are packed
+    in the same packet until it holds ptime msec of samples or it is full, instead of sending
+    each frame of the queue in a packet of its own.
+*/
+class PCMAudioRTPSink: public SimpleRTPSink {
+
+public:
+    /**
+    * Constructor wrapper
+    * @param env Live555 environement
+    * @param RTPgs Live555 RTP groupsock
+    * @param rtpPayloadFormat RTP payload format
+    * @param codec Audio codec, it must be sample based
+    * @param channels Number of channels
+    * @param sampleRate Sample rate in Hz, used as RTP timestamp frequency
+    * @param sampleFormat Sample format of PCM streams
+    * @param codecStr RTP payload format name
+    * @param ptime Audio duration in msec packed in each packet
+    * @return Pointer to the object if succeded and NULL if not
+    */
+    static PCMAudioRTPSink* createNew(UsageEnvironment& env, Groupsock* RTPgs, unsigned char rtpPayloadFormat,
+                                      ACodecType codec, unsigned channels, unsigned sampleRate,
+                                      SampleFmt sampleFormat, char const* codecStr, unsigned ptime);
+
+protected:
+    PCMAudioRTPSink(UsageEnvironment& env, Groupsock* RTPgs, unsigned char rtpPayloadFormat,
+                    unsigned channels, unsigned sampleRate, char const* codecStr, unsigned ptimeBytes);
+
+private:
+    Boolean frameCanAppearAfterPacketStart(unsigned char const* frameStart,
+                                           unsigned numBytesInFrame) const;
+    void doSpecialFrameHandling(unsigned fragmentationOffset,
+                                unsigned char* frameStart,
+                                unsigned numBytesInFrame,
+                                struct timeval framePresentationTime,
+                                unsigned numRemainingBytes);
+
+    unsigned fPtimeBytes;
+    unsigned fPacketBytes;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "QueueSource.hh"
 #include "SinkManager.hh"
+#include "../../FramePool.hh"
 
 QueueSource* QueueSource::createNew(UsageEnvironment& env, const StreamInfo* streamInfo) 
 {
@@ -8,13 +9,24 @@ QueueSource* QueueSource::createNew(UsageEnvironment& env, const StreamInfo* str
 
 
 QueueSource::QueueSource(UsageEnvironment& env, const StreamInfo* streamInfo)
-  : FramedSource(env), eventTriggerId(0), frame(NULL), si(streamInfo), processedFrame(false), stopFrames(true)
+  : FramedSource(env), eventTriggerId(0), si(streamInfo), head(0), pending(0)
 {
+    for (unsigned i = 0; i < QUEUE_SOURCE_FRAMES; i++) {
+        frames[i].frame = NULL;
+    }
+
     if (eventTriggerId == 0){
         eventTriggerId = envir().taskScheduler().createEventTrigger(deliverFrame0);
     }
 }
 
+QueueSource::~QueueSource()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    releaseFrames();
+}
+
 void QueueSource::doGetNextFrame() 
 {
     //TODO: check status, i.e. client disconnected!
@@ -23,13 +35,7 @@ void QueueSource::doGetNextFrame()
         return;
     }
     
-    if (stopFrames){
-        stopFrames = false; 
-    }
-    
-    if (frame) {
-        deliverFrame();
-    }    
+    deliverFrame();
 }
 
 void QueueSource::deliverFrame0(void* clientData) {
@@ -38,50 +44,98 @@ void QueueSource::deliverFrame0(void* clientData) {
 
 void QueueSource::deliverFrame()
 {
+    QueuedFrame* qFrame;
+
     if (!isCurrentlyAwaitingData()) {
         return; 
     }
     
-    if (!frame || processedFrame) {
+    std::unique_lock<std::mutex> guard(mtx);
+
+    if (pending == 0) {
         return;
     }
 
-    fPresentationTime.tv_sec = frame->getPresentationTime().count()/std::micro::den;
-    fPresentationTime.tv_usec = frame->getPresentationTime().count()%std::micro::den;
+    qFrame = &frames[head];
+
+    fPresentationTime.tv_sec = qFrame->pts.count()/std::micro::den;
+    fPresentationTime.tv_usec = qFrame->pts.count()%std::micro::den;
 
-    if (fMaxSize < frame->getLength()){
+    if (fMaxSize < qFrame->size){
         fFrameSize = fMaxSize;
-        fNumTruncatedBytes = frame->getLength() - fMaxSize;
+        fNumTruncatedBytes = qFrame->size - fMaxSize;
     } else {
         fNumTruncatedBytes = 0; 
-        fFrameSize = frame->getLength();
+        fFrameSize = qFrame->size;
     }
     
-    memcpy(fTo, frame->getDataBuf(), fFrameSize);
-    processedFrame = true;
-    
+    memcpy(fTo, qFrame->data, fFrameSize);
+
+    if (qFrame->frame) {
+        FramePool::getInstance()->releaseFrame(qFrame->frame);
+        qFrame->frame = NULL;
+    }
+
+    head = (head + 1) % QUEUE_SOURCE_FRAMES;
+    pending--;
+
+    //NOTE: afterGetting may ask for the next frame right away
+    guard.unlock();
     afterGetting(this);
 }
 
-bool QueueSource::gotFrame()
-{   
-    if (processedFrame || stopFrames){
-        processedFrame = false;
-        if (frame){
-            frame = NULL;
-            return true;
-        }
+bool QueueSource::setFrame(Frame *f)
+{
+    if (!f){
+        return false;
     }
-    return false;
+
+    return pushFrame(f, 0);
 }
 
-bool QueueSource::setFrame(Frame *f)
+bool QueueSource::pushFrame(Frame* f, unsigned offset)
+{
+    QueuedFrame* qFrame;
+    unsigned char const* data = f->getDataBuf() + offset;
+    unsigned size = f->getLength() - offset;
+
+    std::lock_guard<std::mutex> guard(mtx);
+
+    if (pending >= QUEUE_SOURCE_FRAMES){
+        return false;
+    }
+
+    qFrame = &frames[(head + pending) % QUEUE_SOURCE_FRAMES];
+
+    //NOTE: pooled frames retained here are replaced in their queue, so their data is not written again
+    if (FramePool::getInstance()->isPooled(f)) {
+        f->retain();
+        qFrame->frame = f;
+        qFrame->data = data;
+    } else {
+        qFrame->copy.assign(data, data + size);
+        qFrame->data = qFrame->copy.data();
+    }
+
+    qFrame->size = size;
+    qFrame->pts = f->getPresentationTime();
+    pending++;
+
+    return true;
+}
+
+void QueueSource::releaseFrames()
 {
-    if (f && !frame){
-        frame = f;
-        return true;
+    for (; pending > 0; pending--) {
+        if (frames[head].frame) {
+            FramePool::getInstance()->releaseFrame(frames[head].frame);
+            frames[head].frame = NULL;
+        }
+
+        head = (head + 1) % QUEUE_SOURCE_FRAMES;
     }
-    return false;
+
+    head = 0;
 }
 
 bool QueueSource::signalNewFrameData(TaskScheduler* ourScheduler, QueueSource* ourSource) 
@@ -90,13 +144,16 @@ bool QueueSource::signalNewFrameData(TaskScheduler* ourScheduler, QueueSource* o
         return false;
     }
 
+    //NOTE: triggerEvent is the only live555 call which is safe out of the event loop thread
     ourScheduler->triggerEvent(ourSource->getTriggerId(), ourSource);
     return true;
 }
 
+//NOTE: frames not delivered yet would be stale once the source is restarted
 void QueueSource::doStopGettingFrames()
 {
+    std::lock_guard<std::mutex> guard(mtx);
+
     envir().taskScheduler().unscheduleDelayedTask(nextTask());
-    stopFrames = true;
+    releaseFrames();
 }
-
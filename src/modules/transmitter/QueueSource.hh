@@ -2,34 +2,63 @@
 #define _QUEUE_SOURCE_HH
 
 #include <liveMedia.hh>
+#include <mutex>
+#include <vector>
+#include <chrono>
 
 #include "../../FrameQueue.hh"
 #include "../../Frame.hh"
 
 #define POLL_TIME 1000
+#define QUEUE_SOURCE_FRAMES 8   //!< Frames handed over to the event loop thread and not delivered yet
+
+/*! live555 source fed with the frames of a LMS queue. Frames are handed over from the filter thread,
+    which retains them and fires the event trigger, and delivered by the live555 event loop thread,
+    which copies them straight into the sink buffer and releases them. Frames that do not come from
+    the FramePool are rewritten by their queue, so they are copied when handed over instead. */
 
 class QueueSource: public FramedSource {
 
 public:
     static QueueSource* createNew(UsageEnvironment& env, const StreamInfo* streamInfo);
-    bool setFrame(Frame *f);
-    bool gotFrame();
+
+    /**
+    * Hands a frame over to be delivered by the event loop thread. It can be called from any thread
+    * @param f frame to deliver, it can be removed from its queue once the call returns
+    * @return false if the frame has been dropped because the event loop thread is not keeping up
+    */
+    virtual bool setFrame(Frame *f);
+
     EventTriggerId getTriggerId() const {return eventTriggerId;};
+    const StreamInfo* getStreamInfo() const {return si;};
     static bool signalNewFrameData(TaskScheduler* ourScheduler, QueueSource* ourSource);
 
 protected:
+    struct QueuedFrame {
+        Frame* frame;                       //!< Retained frame, NULL if the data has been copied
+        std::vector<unsigned char> copy;
+        unsigned char const* data;
+        unsigned size;
+        std::chrono::microseconds pts;
+    };
+
     void doGetNextFrame();
     QueueSource(UsageEnvironment& env, const StreamInfo* streamInfo);
+    virtual ~QueueSource();
     static void deliverFrame0(void* clientData);
     virtual void deliverFrame();
     void doStopGettingFrames();
+    bool pushFrame(Frame* f, unsigned offset);
+    void releaseFrames();
 
 protected:
     EventTriggerId eventTriggerId;
-    Frame* frame;
     const StreamInfo* si;
-    bool processedFrame;
-    bool stopFrames;
+
+    std::mutex mtx;
+    QueuedFrame frames[QUEUE_SOURCE_FRAMES];    //!< Ring of handed over frames, copy buffers keep their capacity
+    unsigned head;
+    unsigned pending;
 };
 
 #endif
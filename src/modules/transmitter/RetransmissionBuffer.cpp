@@ -0,0 +1,170 @@
+/*
+ *  RetransmissionBuffer.cpp - History of sent RTP packets for RTX retransmissions
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+
+#include "RetransmissionBuffer.hh"
+
+static uint16_t readSeq(const unsigned char* packet)
+{
+    return (packet[2] << 8) | packet[3];
+}
+
+static uint32_t readSSRC(const unsigned char* packet)
+{
+    return (packet[8] << 24) | (packet[9] << 16) | (packet[10] << 8) | packet[11];
+}
+
+RetransmissionBuffer::RetransmissionBuffer(uint32_t ssrc, uint16_t firstSeq, unsigned char payloadType,
+                                           unsigned historyTime) :
+    rtxSSRC(ssrc), rtxSeq(firstSeq), rtxPayloadType(payloadType), history(historyTime),
+    retransmitted(0), unrecoverable(0)
+{
+
+}
+
+void RetransmissionBuffer::store(const unsigned char* packet, unsigned size,
+                                 std::chrono::steady_clock::time_point now)
+{
+    StoredPacket stored;
+
+    if (size < RTP_HEADER_SIZE || size + 2 > RTX_MAX_PACKET_SIZE || (packet[0] >> 6) != 2) {
+        return;
+    }
+
+    if (readSSRC(packet) == rtxSSRC) {
+        return;
+    }
+
+    if (!packets.empty() && packets.back().seq == readSeq(packet)) {
+        return;
+    }
+
+    expire(now);
+
+    if (packets.size() >= RTX_MAX_PACKETS) {
+        packets.pop_front();
+    }
+
+    //NOTE: buffers are reused, so storing does not allocate once the stream bitrate is stable
+    if (!spare.empty()) {
+        stored.data = std::move(spare.back());
+        spare.pop_back();
+    }
+
+    stored.seq = readSeq(packet);
+    stored.time = now;
+    stored.retransmitted = false;
+    stored.data.assign(packet, packet + size);
+
+    packets.push_back(std::move(stored));
+}
+
+unsigned RetransmissionBuffer::retransmission(uint16_t seq, unsigned char* buffer,
+                                              std::chrono::steady_clock::time_point now)
+{
+    StoredPacket* stored;
+    const unsigned char* packet;
+    unsigned size;
+    unsigned headerSize;
+
+    expire(now);
+
+    if (!(stored = find(seq))) {
+        unrecoverable++;
+        return 0;
+    }
+
+    if (stored->retransmitted &&
+        now - stored->lastRetransmission < std::chrono::milliseconds(RTX_REPEAT_INTERVAL)) {
+        return 0;
+    }
+
+    packet = stored->data.data();
+    size = stored->data.size();
+    headerSize = RTP_HEADER_SIZE + 4*(packet[0] & 0x0F);
+
+    if (packet[0] & 0x10) {
+        if (headerSize + 4 > size) {
+            return 0;
+        }
+        headerSize += 4 + 4*((packet[headerSize + 2] << 8) | packet[headerSize + 3]);
+    }
+
+    if (headerSize > size) {
+        return 0;
+    }
+
+    //NOTE: the RTX header is the original one with the RTX payload type, sequence number and SSRC
+    memcpy(buffer, packet, headerSize);
+    buffer[1] = (packet[1] & 0x80) | (rtxPayloadType & 0x7F);
+    buffer[2] = rtxSeq >> 8;
+    buffer[3] = rtxSeq & 0xFF;
+    buffer[8] = rtxSSRC >> 24;
+    buffer[9] = (rtxSSRC >> 16) & 0xFF;
+    buffer[10] = (rtxSSRC >> 8) & 0xFF;
+    buffer[11] = rtxSSRC & 0xFF;
+    buffer[headerSize] = seq >> 8;
+    buffer[headerSize + 1] = seq & 0xFF;
+    memcpy(buffer + headerSize + 2, packet + headerSize, size - headerSize);
+
+    rtxSeq++;
+    retransmitted++;
+    stored->retransmitted = true;
+    stored->lastRetransmission = now;
+
+    return size + 2;
+}
+
+void RetransmissionBuffer::expire(std::chrono::steady_clock::time_point now)
+{
+    while (!packets.empty() && now - packets.front().time > history) {
+        if (spare.size() < RTX_SPARE_BUFFERS) {
+            spare.push_back(std::move(packets.front().data));
+        }
+        packets.pop_front();
+    }
+}
+
+RetransmissionBuffer::StoredPacket* RetransmissionBuffer::find(uint16_t seq)
+{
+    uint16_t offset;
+
+    if (packets.empty()) {
+        return NULL;
+    }
+
+    //NOTE: sequence numbers of a stream are consecutive, the search is only needed if some were not stored
+    offset = seq - packets.front().seq;
+
+    if (offset < packets.size() && packets[offset].seq == seq) {
+        return &packets[offset];
+    }
+
+    for (auto& stored : packets) {
+        if (stored.seq == seq) {
+            return &stored;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,107 @@
+/*
+ *  RetransmissionBuffer.hh - History of sent RTP packets for RTX retransmissions
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _RETRANSMISSION_BUFFER_HH
+#define _RETRANSMISSION_BUFFER_HH
+
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <stdint.h>
+
+#define RTX_PAYLOAD_TYPE 99             //!< Dynamic payload type of the RTX streams
+#define RTX_HISTORY_TIME 1000           //!< Time in msec a sent packet can be retransmitted
+#define RTX_REPEAT_INTERVAL 50          //!< Time in msec before the same packet can be retransmitted again
+#define RTX_MAX_PACKETS 32768           //!< Half the sequence number space, so lookups are never ambiguous
+#define RTX_MAX_PACKET_SIZE 2048        //!< Largest RTX packet, stored packets must leave room for the OSN
+#define RTX_SPARE_BUFFERS 256           //!< Expired packet buffers kept to be reused
+#define RTP_HEADER_SIZE 12
+
+/*! History of the RTP packets sent by a connection, which builds RFC 4588 retransmissions of them.
+    Packets are kept for RTX_HISTORY_TIME, so memory depends on the stream bitrate and not on its GOP.
+    RTX packets are SSRC multiplexed: they carry their own SSRC, payload type and sequence numbers, the
+    original timestamp, and the original sequence number (OSN) before the original payload.
+*/
+class RetransmissionBuffer {
+
+public:
+    /**
+    * Class constructor
+    * @param ssrc SSRC of the RTX stream, it must differ from the one of the original stream
+    * @param firstSeq sequence number of the first RTX packet
+    * @param payloadType payload type of the RTX packets
+    * @param historyTime time in msec sent packets are kept
+    */
+    RetransmissionBuffer(uint32_t ssrc, uint16_t firstSeq, unsigned char payloadType = RTX_PAYLOAD_TYPE,
+                         unsigned historyTime = RTX_HISTORY_TIME);
+
+    /**
+    * Keeps a copy of a sent RTP packet. The RTX packets and the copies of a packet sent to several
+    * destinations are not stored
+    * @param packet RTP packet
+    * @param size packet size in bytes
+    * @param now sending time
+    */
+    void store(const unsigned char* packet, unsigned size,
+               std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    /**
+    * Builds the RTX packet of a stored packet
+    * @param seq sequence number of the original packet
+    * @param buffer output buffer, it must hold at least RTX_MAX_PACKET_SIZE bytes
+    * @param now retransmission time
+    * @return RTX packet size, 0 if the packet has expired or has just been retransmitted
+    */
+    unsigned retransmission(uint16_t seq, unsigned char* buffer,
+                            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    uint32_t getSSRC() const {return rtxSSRC;};
+    unsigned char getPayloadType() const {return rtxPayloadType;};
+    size_t getStoredPackets() const {return packets.size();};
+    size_t getRetransmitted() const {return retransmitted;};
+    size_t getUnrecoverable() const {return unrecoverable;};
+
+private:
+    struct StoredPacket {
+        uint16_t seq;
+        std::chrono::steady_clock::time_point time;
+        std::chrono::steady_clock::time_point lastRetransmission;
+        bool retransmitted;
+        std::vector<unsigned char> data;
+    };
+
+    void expire(std::chrono::steady_clock::time_point now);
+    StoredPacket* find(uint16_t seq);
+
+    std::deque<StoredPacket> packets;
+    std::vector<std::vector<unsigned char>> spare;
+
+    uint32_t rtxSSRC;
+    uint16_t rtxSeq;
+    unsigned char rtxPayloadType;
+    std::chrono::milliseconds history;
+
+    size_t retransmitted;
+    size_t unrecoverable;
+};
+
+#endif
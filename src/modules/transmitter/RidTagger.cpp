@@ -0,0 +1,99 @@
+/*
+ *  RidTagger.cpp - RTP stream id header extension of simulcast layers
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <cctype>
+
+#include "RidTagger.hh"
+
+#define RTP_FIXED_HEADER_SIZE 12
+#define ONE_BYTE_PROFILE_0 0xBE
+#define ONE_BYTE_PROFILE_1 0xDE
+
+RidTagger::RidTagger(unsigned char extensionId) : extId(extensionId)
+{
+}
+
+bool RidTagger::setRid(uint32_t ssrc, std::string rid)
+{
+    if (rid.empty() || rid.size() > RID_MAX_SIZE || extId < 1 || extId > 14) {
+        return false;
+    }
+
+    for (auto c : rid) {
+        if (!isalnum((unsigned char) c) && c != '-' && c != '_') {
+            return false;
+        }
+    }
+
+    rids[ssrc] = rid;
+    return true;
+}
+
+std::string RidTagger::getRid(uint32_t ssrc) const
+{
+    auto it = rids.find(ssrc);
+
+    return it == rids.end() ? "" : it->second;
+}
+
+unsigned RidTagger::tag(unsigned char const* packet, unsigned size, unsigned char* buffer, unsigned maxSize) const
+{
+    unsigned headerSize;
+    unsigned extensionSize;
+    uint32_t ssrc;
+
+    if (size < RTP_FIXED_HEADER_SIZE || (packet[0] >> 6) != 2 || (packet[0] & 0x10)) {
+        return 0;
+    }
+
+    ssrc = (packet[8] << 24) | (packet[9] << 16) | (packet[10] << 8) | packet[11];
+    auto it = rids.find(ssrc);
+
+    headerSize = RTP_FIXED_HEADER_SIZE + (packet[0] & 0x0F)*4;
+
+    if (it == rids.end() || headerSize > size) {
+        return 0;
+    }
+
+    //NOTE: the element (its header byte and the RID) is padded to 32 bit words
+    extensionSize = (1 + it->second.size() + 3)/4*4;
+
+    if (size + 4 + extensionSize > maxSize) {
+        return 0;
+    }
+
+    memcpy(buffer, packet, headerSize);
+    buffer[0] |= 0x10;
+    buffer[headerSize] = ONE_BYTE_PROFILE_0;
+    buffer[headerSize + 1] = ONE_BYTE_PROFILE_1;
+    buffer[headerSize + 2] = (extensionSize/4) >> 8;
+    buffer[headerSize + 3] = (extensionSize/4) & 0xFF;
+
+    memset(buffer + headerSize + 4, 0, extensionSize);
+    buffer[headerSize + 4] = (extId << 4) | (it->second.size() - 1);
+    memcpy(buffer + headerSize + 5, it->second.data(), it->second.size());
+
+    memcpy(buffer + headerSize + 4 + extensionSize, packet + headerSize, size - headerSize);
+
+    return size + 4 + extensionSize;
+}
@@ -0,0 +1,72 @@
+/*
+ *  RidTagger.hh - RTP stream id header extension of simulcast layers
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _RID_TAGGER_HH
+#define _RID_TAGGER_HH
+
+#include <map>
+#include <string>
+#include <stdint.h>
+
+#define RID_EXTENSION_ID 1              //!< Header extension id, urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id
+#define RID_MAX_SIZE 16                 //!< Longest RID a one-byte header extension element can carry
+#define RID_MAX_PACKET_SIZE 2048        //!< Largest tagged RTP packet
+
+/*! Adds the RTP stream id (RID, RFC 8852) of its layer to each RTP packet of a simulcast session, as a
+    RFC 8285 one-byte header extension. Layers are told apart by their SSRC; packets of other SSRCs, such
+    as RTX or FEC ones, and packets which already carry a header extension are left untouched.
+*/
+class RidTagger {
+
+public:
+    /**
+    * Class constructor
+    * @param extensionId header extension id, from 1 to 14
+    */
+    RidTagger(unsigned char extensionId = RID_EXTENSION_ID);
+
+    /**
+    * @param ssrc SSRC of the layer
+    * @param rid RID of the layer, up to RID_MAX_SIZE alphanumeric, '-' or '_' characters
+    * @return false if the RID is not valid
+    */
+    bool setRid(uint32_t ssrc, std::string rid);
+
+    /**
+    * Builds the tagged version of a packet
+    * @param packet RTP packet
+    * @param size packet size in bytes
+    * @param buffer output buffer
+    * @param maxSize output buffer size
+    * @return tagged packet size, 0 if the packet is not tagged
+    */
+    unsigned tag(unsigned char const* packet, unsigned size, unsigned char* buffer, unsigned maxSize) const;
+
+    std::string getRid(uint32_t ssrc) const;
+    unsigned char getExtensionId() const {return extId;};
+
+private:
+    std::map<uint32_t, std::string> rids;
+    unsigned char extId;
+};
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ *  SRTPContext.cpp - SRTP and SRTCP protection with AES_CM_128_HMAC_SHA1_80
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <openssl/hmac.h>
+
+#include "SRTPContext.hh"
+#include "../../Utils.hh"
+
+#define RTP_MIN_HEADER 12
+#define RTCP_MIN_HEADER 8
+#define AES_BLOCK 16
+#define SRTCP_E_FLAG 0x80000000
+#define SRTCP_INDEX_MASK 0x7FFFFFFF
+
+enum KeyLabel {RTP_CIPHER_LABEL, RTP_AUTH_LABEL, RTP_SALT_LABEL,
+               RTCP_CIPHER_LABEL, RTCP_AUTH_LABEL, RTCP_SALT_LABEL};
+
+static uint32_t readU32(const unsigned char* p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static void writeU32(unsigned char* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+SRTPContext::SRTPContext() : rtpCipher(NULL), rtcpCipher(NULL), rtcpIndex(0), keyed(false)
+{
+    rtpCipher = EVP_CIPHER_CTX_new();
+    rtcpCipher = EVP_CIPHER_CTX_new();
+}
+
+SRTPContext::~SRTPContext()
+{
+    EVP_CIPHER_CTX_free(rtpCipher);
+    EVP_CIPHER_CTX_free(rtcpCipher);
+    OPENSSL_cleanse(&rtp, sizeof(rtp));
+    OPENSSL_cleanse(&rtcp, sizeof(rtcp));
+}
+
+bool SRTPContext::derive(EVP_CIPHER_CTX* master, const unsigned char* masterSalt, unsigned label,
+                         unsigned char* key, unsigned size)
+{
+    unsigned char iv[AES_BLOCK] = {0};
+    int len;
+
+    //NOTE: key_id = label || index DIV kdr, with a key derivation rate of 0 it is just the label
+    memcpy(iv, masterSalt, SRTP_MASTER_SALT_SIZE);
+    iv[7] ^= label;
+
+    memset(key, 0, size);
+    return EVP_EncryptInit_ex(master, NULL, NULL, NULL, iv) == 1 &&
+           EVP_EncryptUpdate(master, key, &len, key, size) == 1;
+}
+
+bool SRTPContext::setKey(const unsigned char* masterKey, const unsigned char* masterSalt)
+{
+    EVP_CIPHER_CTX* master = EVP_CIPHER_CTX_new();
+    bool ok;
+
+    keyed = false;
+    ssrcs.clear();
+    rtcpIndex = 0;
+
+    ok = master && EVP_EncryptInit_ex(master, EVP_aes_128_ctr(), NULL, masterKey, NULL) == 1 &&
+         derive(master, masterSalt, RTP_CIPHER_LABEL, rtp.cipherKey, SRTP_MASTER_KEY_SIZE) &&
+         derive(master, masterSalt, RTP_AUTH_LABEL, rtp.authKey, SRTP_AUTH_KEY_SIZE) &&
+         derive(master, masterSalt, RTP_SALT_LABEL, rtp.salt, SRTP_MASTER_SALT_SIZE) &&
+         derive(master, masterSalt, RTCP_CIPHER_LABEL, rtcp.cipherKey, SRTP_MASTER_KEY_SIZE) &&
+         derive(master, masterSalt, RTCP_AUTH_LABEL, rtcp.authKey, SRTP_AUTH_KEY_SIZE) &&
+         derive(master, masterSalt, RTCP_SALT_LABEL, rtcp.salt, SRTP_MASTER_SALT_SIZE);
+
+    EVP_CIPHER_CTX_free(master);
+
+    ok = ok && EVP_EncryptInit_ex(rtpCipher, EVP_aes_128_ctr(), NULL, rtp.cipherKey, NULL) == 1 &&
+         EVP_EncryptInit_ex(rtcpCipher, EVP_aes_128_ctr(), NULL, rtcp.cipherKey, NULL) == 1;
+
+    if (!ok) {
+        utils::errorMsg("[SRTPContext] Session keys could not be derived");
+        return false;
+    }
+
+    keyed = true;
+    return true;
+}
+
+bool SRTPContext::getSessionKey(unsigned label, unsigned char* key) const
+{
+    const Keys &keys = label < RTCP_CIPHER_LABEL ? rtp : rtcp;
+
+    switch (label % 3) {
+        case RTP_CIPHER_LABEL:
+            memcpy(key, keys.cipherKey, SRTP_MASTER_KEY_SIZE);
+            break;
+        case RTP_AUTH_LABEL:
+            memcpy(key, keys.authKey, SRTP_AUTH_KEY_SIZE);
+            break;
+        default:
+            memcpy(key, keys.salt, SRTP_MASTER_SALT_SIZE);
+            break;
+    }
+
+    return label <= RTCP_SALT_LABEL;
+}
+
+bool SRTPContext::encrypt(EVP_CIPHER_CTX* ctx, const unsigned char* salt, uint32_t ssrc, uint64_t index,
+                          unsigned char* data, unsigned size)
+{
+    unsigned char iv[AES_BLOCK] = {0};
+    int len;
+
+    //NOTE: IV = (salt * 2^16) XOR (SSRC * 2^64) XOR (index * 2^16), the CTR mode counts the low bytes
+    memcpy(iv, salt, SRTP_MASTER_SALT_SIZE);
+    for (unsigned i = 0; i < 4; i++) {
+        iv[4 + i] ^= (ssrc >> (24 - 8*i)) & 0xFF;
+    }
+    for (unsigned i = 0; i < 6; i++) {
+        iv[8 + i] ^= (index >> (40 - 8*i)) & 0xFF;
+    }
+
+    return EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) == 1 &&
+           EVP_EncryptUpdate(ctx, data, &len, data, size) == 1;
+}
+
+void SRTPContext::authenticate(const unsigned char* authKey, unsigned char* data, unsigned size, unsigned char* tag)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned len;
+
+    HMAC(EVP_sha1(), authKey, SRTP_AUTH_KEY_SIZE, data, size, digest, &len);
+    memcpy(tag, digest, SRTP_AUTH_TAG_SIZE);
+}
+
+bool SRTPContext::protectRtp(unsigned char* packet, unsigned &size)
+{
+    unsigned header;
+    uint16_t seq;
+    uint32_t ssrc;
+    uint32_t roc;
+
+    if (!keyed || size < RTP_MIN_HEADER || (packet[0] >> 6) != 2) {
+        return false;
+    }
+
+    header = RTP_MIN_HEADER + 4*(packet[0] & 0x0F);
+    if (packet[0] & 0x10) {
+        if (size < header + 4) {
+            return false;
+        }
+        header += 4 + 4*((packet[header + 2] << 8) | packet[header + 3]);
+    }
+
+    if (size < header) {
+        return false;
+    }
+
+    seq = (packet[2] << 8) | packet[3];
+    ssrc = readU32(packet + 8);
+
+    SsrcState &state = ssrcs[ssrc];
+    //NOTE: index estimation of RFC 3711 3.3.1, a sequence number far behind the last one wrapped and
+    //      one far ahead of it is a late packet from before the last wrap
+    roc = state.roc;
+    if (state.started && seq < state.lastSeq && state.lastSeq - seq > 0x8000) {
+        roc = ++state.roc;
+        state.lastSeq = seq;
+    } else if (state.started && seq > state.lastSeq && seq - state.lastSeq > 0x8000) {
+        roc = state.roc - 1;
+    } else if (!state.started || seq > state.lastSeq) {
+        state.lastSeq = seq;
+    }
+    state.started = true;
+
+    if (!encrypt(rtpCipher, rtp.salt, ssrc, ((uint64_t) roc << 16) | seq, packet + header, size - header)) {
+        return false;
+    }
+
+    //NOTE: the tag covers the packet and the ROC, which is written where the tag goes
+    writeU32(packet + size, roc);
+    authenticate(rtp.authKey, packet, size + 4, packet + size);
+
+    size += SRTP_AUTH_TAG_SIZE;
+    return true;
+}
+
+bool SRTPContext::protectRtcp(unsigned char* packet, unsigned &size)
+{
+    uint32_t ssrc;
+    uint32_t index;
+
+    if (!keyed || size < RTCP_MIN_HEADER || (packet[0] >> 6) != 2) {
+        return false;
+    }
+
+    ssrc = readU32(packet + 4);
+    index = rtcpIndex;
+    rtcpIndex = (rtcpIndex + 1) & SRTCP_INDEX_MASK;
+
+    if (!encrypt(rtcpCipher, rtcp.salt, ssrc, index, packet + RTCP_MIN_HEADER, size - RTCP_MIN_HEADER)) {
+        return false;
+    }
+
+    writeU32(packet + size, SRTCP_E_FLAG | index);
+    size += SRTCP_INDEX_SIZE;
+
+    authenticate(rtcp.authKey, packet, size, packet + size);
+    size += SRTP_AUTH_TAG_SIZE;
+    return true;
+}
@@ -0,0 +1,112 @@
+/*
+ *  SRTPContext.hh - SRTP and SRTCP protection with AES_CM_128_HMAC_SHA1_80
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _SRTP_CONTEXT_HH
+#define _SRTP_CONTEXT_HH
+
+#include <map>
+#include <stdint.h>
+#include <openssl/evp.h>
+
+#define SRTP_MASTER_KEY_SIZE 16     //!< AES-128 master key bytes
+#define SRTP_MASTER_SALT_SIZE 14    //!< Master salt bytes
+#define SRTP_AUTH_KEY_SIZE 20       //!< HMAC-SHA1 session key bytes
+#define SRTP_AUTH_TAG_SIZE 10       //!< HMAC-SHA1-80 tag bytes, appended to each packet
+#define SRTCP_INDEX_SIZE 4          //!< E flag and SRTCP index, appended to each RTCP packet
+#define SRTP_MAX_OVERHEAD (SRTP_AUTH_TAG_SIZE + SRTCP_INDEX_SIZE)
+
+/*! Sender side SRTP and SRTCP cryptographic context of the AES_CM_128_HMAC_SHA1_80 profile
+    (RFC 3711), keyed from a master key and salt (e.g. exported by DTLS-SRTP). Payloads are
+    encrypted in place with OpenSSL AES-128-CTR, which uses AES-NI where available. The rollover
+    counter of each SSRC is tracked from the sequence numbers of the packets it protects.
+*/
+class SRTPContext {
+
+public:
+    SRTPContext();
+    ~SRTPContext();
+
+    /**
+    * Derives the session keys, the rollover counters are reset
+    * @param masterKey SRTP_MASTER_KEY_SIZE bytes
+    * @param masterSalt SRTP_MASTER_SALT_SIZE bytes
+    * @return false if the ciphers could not be initialised
+    */
+    bool setKey(const unsigned char* masterKey, const unsigned char* masterSalt);
+
+    /**
+    * Encrypts an RTP packet in place and appends its authentication tag
+    * @param packet RTP packet, its buffer must hold SRTP_AUTH_TAG_SIZE bytes more
+    * @param size packet size, updated with the protected size
+    * @return false if the packet is not a valid RTP packet or the context has no key
+    */
+    bool protectRtp(unsigned char* packet, unsigned &size);
+
+    /**
+    * Encrypts an RTCP compound packet in place and appends its index and authentication tag
+    * @param packet RTCP packet, its buffer must hold SRTP_MAX_OVERHEAD bytes more
+    * @param size packet size, updated with the protected size
+    * @return false if the packet is not a valid RTCP packet or the context has no key
+    */
+    bool protectRtcp(unsigned char* packet, unsigned &size);
+
+    bool hasKey() const {return keyed;};
+
+    /**
+    * Gets a derived session key, for testing purposes
+    * @param label key derivation label (RFC 3711 4.3.2), 0 to 5
+    * @param key destination, of the size of the key
+    * @return false if the label is not valid
+    */
+    bool getSessionKey(unsigned label, unsigned char* key) const;
+
+private:
+    struct Keys {
+        unsigned char cipherKey[SRTP_MASTER_KEY_SIZE];
+        unsigned char salt[SRTP_MASTER_SALT_SIZE];
+        unsigned char authKey[SRTP_AUTH_KEY_SIZE];
+    };
+
+    struct SsrcState {
+        SsrcState() : roc(0), lastSeq(0), started(false) {};
+
+        uint32_t roc;
+        uint16_t lastSeq;
+        bool started;
+    };
+
+    bool derive(EVP_CIPHER_CTX* master, const unsigned char* masterSalt, unsigned label,
+                unsigned char* key, unsigned size);
+    bool encrypt(EVP_CIPHER_CTX* ctx, const unsigned char* salt, uint32_t ssrc, uint64_t index,
+                 unsigned char* data, unsigned size);
+    void authenticate(const unsigned char* authKey, unsigned char* data, unsigned size, unsigned char* tag);
+
+    Keys rtp;
+    Keys rtcp;
+    EVP_CIPHER_CTX* rtpCipher;
+    EVP_CIPHER_CTX* rtcpCipher;
+    std::map<uint32_t, SsrcState> ssrcs;
+    uint32_t rtcpIndex;
+    bool keyed;
+};
+
+#endif
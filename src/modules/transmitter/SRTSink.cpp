@@ -0,0 +1,282 @@
+/*
+ *  SRTSink.cpp - live555 sink sending an MPEG-TS stream through SRT
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <arpa/inet.h>
+
+#include "SRTSink.hh"
+#include "../../Utils.hh"
+
+SRTSink* SRTSink::createNew(UsageEnvironment& env, std::string ip, unsigned port, SRTMode mode, unsigned latency)
+{
+    SRTSink* sink;
+
+    //NOTE: srt_startup only initializes the library the first time it is called
+    if (srt_startup() < 0) {
+        utils::errorMsg("Could not initialize SRT: " + std::string(srt_getlasterror_str()));
+        return NULL;
+    }
+
+    sink = new SRTSink(env, ip, port, mode, latency);
+
+    if (!sink->open()) {
+        Medium::close(sink);
+        return NULL;
+    }
+
+    return sink;
+}
+
+SRTSink::SRTSink(UsageEnvironment& env, std::string ip, unsigned port, SRTMode mode, unsigned latency) :
+    MediaSink(env), fIp(ip), fPort(port), fMode(mode), fLatency(latency), sock(SRT_INVALID_SOCK),
+    fetching(false), fetchAgain(false), droppedChunks(0)
+{
+    memset(&address, 0, sizeof(address));
+}
+
+SRTSink::~SRTSink()
+{
+    for (auto peer : peers) {
+        if (peer != sock) {
+            srt_close(peer);
+        }
+    }
+
+    if (sock != SRT_INVALID_SOCK) {
+        srt_close(sock);
+    }
+}
+
+bool SRTSink::open()
+{
+    address.sin_family = AF_INET;
+    address.sin_port = htons(fPort);
+
+    if (fMode == SRT_LISTENER && fIp.empty()) {
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+    } else if (inet_pton(AF_INET, fIp.c_str(), &address.sin_addr) != 1) {
+        utils::errorMsg("SRT address is not valid: " + fIp);
+        return false;
+    }
+
+    if (fMode == SRT_CALLER) {
+        connect();
+        return true;
+    }
+
+    if ((sock = createSocket()) == SRT_INVALID_SOCK) {
+        return false;
+    }
+
+    if (srt_bind(sock, (struct sockaddr*) &address, sizeof(address)) == SRT_ERROR ||
+        srt_listen(sock, SRT_MAX_PEERS) == SRT_ERROR) {
+        utils::errorMsg("SRT listener could not be opened: " + std::string(srt_getlasterror_str()));
+        return false;
+    }
+
+    return true;
+}
+
+SRTSOCKET SRTSink::createSocket()
+{
+    SRTSOCKET s;
+    int transtype = SRTT_LIVE;
+    int latency = fLatency;
+    int sync = 0;
+
+    if ((s = srt_create_socket()) == SRT_INVALID_SOCK) {
+        utils::errorMsg("SRT socket could not be created: " + std::string(srt_getlasterror_str()));
+        return s;
+    }
+
+    //NOTE: accepted sockets inherit the listener options, so all of them are non blocking
+    srt_setsockflag(s, SRTO_TRANSTYPE, &transtype, sizeof(transtype));
+    srt_setsockflag(s, SRTO_LATENCY, &latency, sizeof(latency));
+    srt_setsockflag(s, SRTO_SNDSYN, &sync, sizeof(sync));
+    srt_setsockflag(s, SRTO_RCVSYN, &sync, sizeof(sync));
+
+    return s;
+}
+
+void SRTSink::connect()
+{
+    lastConnect = std::chrono::steady_clock::now();
+
+    if (sock != SRT_INVALID_SOCK) {
+        srt_close(sock);
+    }
+
+    if ((sock = createSocket()) == SRT_INVALID_SOCK) {
+        return;
+    }
+
+    //NOTE: the socket is non blocking, so the connection is completed in the background
+    if (srt_connect(sock, (struct sockaddr*) &address, sizeof(address)) == SRT_ERROR) {
+        utils::warningMsg("SRT connection to " + fIp + " failed: " + std::string(srt_getlasterror_str()));
+    }
+}
+
+void SRTSink::checkPeers()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    struct sockaddr_storage peerAddress;
+    int addressLength;
+    SRTSOCKET peer;
+    SRT_SOCKSTATUS state;
+
+    if (now - lastCheck < std::chrono::milliseconds(SRT_CHECK_INTERVAL)) {
+        return;
+    }
+
+    lastCheck = now;
+
+    for (auto it = peers.begin(); it != peers.end();) {
+        if (srt_getsockstate(*it) == SRTS_CONNECTED) {
+            it++;
+            continue;
+        }
+
+        if (*it != sock) {
+            srt_close(*it);
+        }
+
+        utils::warningMsg("SRT peer disconnected");
+        it = peers.erase(it);
+    }
+
+    if (fMode == SRT_LISTENER) {
+        addressLength = sizeof(peerAddress);
+
+        while ((peer = srt_accept(sock, (struct sockaddr*) &peerAddress, &addressLength)) != SRT_INVALID_SOCK) {
+            utils::infoMsg("SRT peer connected");
+            peers.push_back(peer);
+            addressLength = sizeof(peerAddress);
+        }
+
+        return;
+    }
+
+    state = sock != SRT_INVALID_SOCK ? srt_getsockstate(sock) : SRTS_NONEXIST;
+
+    if (state == SRTS_CONNECTED) {
+        if (peers.empty()) {
+            utils::infoMsg("SRT connected to " + fIp);
+            peers.push_back(sock);
+        }
+        return;
+    }
+
+    if (state != SRTS_CONNECTING && now - lastConnect >= std::chrono::milliseconds(SRT_RECONNECT_INTERVAL)) {
+        connect();
+    }
+}
+
+Boolean SRTSink::continuePlaying()
+{
+    getNextChunk();
+    return True;
+}
+
+void SRTSink::getNextChunk()
+{
+    //NOTE: sources deliver from getNextFrame when they have data ready, looping here instead
+    //      of calling it again from afterGettingFrame avoids nesting a call per chunk
+    if (fetching) {
+        fetchAgain = true;
+        return;
+    }
+
+    fetching = true;
+
+    do {
+        fetchAgain = false;
+
+        if (!fSource) {
+            break;
+        }
+
+        fSource->getNextFrame(buffer, SRT_PAYLOAD_SIZE, afterGettingFrame, this, onSourceClosure, this);
+    } while (fetchAgain);
+
+    fetching = false;
+}
+
+void SRTSink::afterGettingFrame(void* clientData, unsigned frameSize, unsigned /*numTruncatedBytes*/,
+                                struct timeval /*presentationTime*/, unsigned /*durationInMicroseconds*/)
+{
+    SRTSink* sink = (SRTSink*) clientData;
+
+    sink->sendChunk(frameSize);
+    sink->getNextChunk();
+}
+
+void SRTSink::sendChunk(unsigned size)
+{
+    checkPeers();
+
+    for (auto peer : peers) {
+        //NOTE: a full sending buffer means the chunk is late for this peer, live mode drops it
+        if (srt_sendmsg2(peer, (char*) buffer, size, NULL) == SRT_ERROR) {
+            droppedChunks++;
+        }
+    }
+}
+
+std::vector<SRTPeerStats> SRTSink::getStats()
+{
+    std::vector<SRTPeerStats> stats;
+    SRT_TRACEBSTATS perf;
+    SRTPeerStats peerStats;
+    struct sockaddr_in peerAddress;
+    char peerIp[INET_ADDRSTRLEN];
+    int length;
+
+    for (auto peer : peers) {
+        if (srt_bstats(peer, &perf, 0) == SRT_ERROR) {
+            continue;
+        }
+
+        length = sizeof(peerAddress);
+        if (srt_getpeername(peer, (struct sockaddr*) &peerAddress, &length) != SRT_ERROR &&
+            inet_ntop(AF_INET, &peerAddress.sin_addr, peerIp, sizeof(peerIp))) {
+            peerStats.address = std::string(peerIp) + ":" + std::to_string(ntohs(peerAddress.sin_port));
+        } else {
+            peerStats.address = "";
+        }
+
+        length = sizeof(peerStats.latency);
+        if (srt_getsockflag(peer, SRTO_PEERLATENCY, &peerStats.latency, &length) == SRT_ERROR) {
+            peerStats.latency = fLatency;
+        }
+
+        peerStats.rtt = perf.msRTT;
+        peerStats.bandwidth = perf.mbpsBandwidth;
+        peerStats.sendRate = perf.mbpsSendRate;
+        peerStats.retransmitted = perf.pktRetransTotal;
+        peerStats.lost = perf.pktSndLossTotal;
+        peerStats.dropped = perf.pktSndDropTotal;
+
+        stats.push_back(peerStats);
+    }
+
+    return stats;
+}
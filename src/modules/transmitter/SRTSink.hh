@@ -0,0 +1,114 @@
+/*
+ *  SRTSink.hh - live555 sink sending an MPEG-TS stream through SRT
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _SRT_SINK_HH
+#define _SRT_SINK_HH
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <netinet/in.h>
+#include <liveMedia.hh>
+#include <srt/srt.h>
+
+#define SRT_PAYLOAD_SIZE 1316           //!< 7 TS packets, the payload size of SRT live mode
+#define SRT_DEFAULT_LATENCY 120         //!< Default receiver buffering in msec, it bounds the retransmissions
+#define SRT_CHECK_INTERVAL 100          //!< Time in msec between peer state checks and listener accepts
+#define SRT_RECONNECT_INTERVAL 1000     //!< Time in msec between caller connection attempts
+#define SRT_MAX_PEERS 16                //!< Pending connections of a listener
+
+enum SRTMode {SRT_CALLER, SRT_LISTENER};
+
+/*! Statistics of an SRT peer, see srt_bstats */
+struct SRTPeerStats {
+    std::string address;
+    int latency;                        //!< Negotiated latency in msec
+    double rtt;                         //!< Round trip time in msec
+    double bandwidth;                   //!< Estimated link bandwidth in Mbps
+    double sendRate;                    //!< Sending rate in Mbps
+    int64_t retransmitted;              //!< Retransmitted packets
+    int64_t lost;                       //!< Packets reported as lost by the peer
+    int64_t dropped;                    //!< Packets dropped because they were too late to be sent
+};
+
+/*! live555 sink which sends the chunks of 7 TS packets of an MPEG-TS source through SRT. A caller
+    connects to a remote listener and reconnects when the connection breaks, a listener accepts any
+    number of peers and sends the stream to all of them. Sockets are non blocking, so chunks are dropped
+    for the peers whose sending buffer is full instead of stalling the event loop.
+*/
+class SRTSink : public MediaSink {
+
+public:
+    /**
+    * Creates the sink, its socket is connected or listening once created
+    * @param env live555 environment
+    * @param ip remote address in caller mode, local address in listener mode (empty for any)
+    * @param port remote port in caller mode, local port in listener mode
+    * @param mode SRT_CALLER or SRT_LISTENER
+    * @param latency receiver buffering in msec
+    * @return the sink, NULL if the address is not valid or the listener socket cannot be opened
+    */
+    static SRTSink* createNew(UsageEnvironment& env, std::string ip, unsigned port, SRTMode mode,
+                              unsigned latency = SRT_DEFAULT_LATENCY);
+
+    /**
+    * @return the statistics of each connected peer
+    */
+    std::vector<SRTPeerStats> getStats();
+
+    size_t getDroppedChunks() const {return droppedChunks;};
+
+protected:
+    SRTSink(UsageEnvironment& env, std::string ip, unsigned port, SRTMode mode, unsigned latency);
+    virtual ~SRTSink();
+
+    Boolean continuePlaying();
+
+private:
+    bool open();
+    SRTSOCKET createSocket();
+    void connect();
+    void checkPeers();
+    void getNextChunk();
+    void sendChunk(unsigned size);
+
+    static void afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
+                                  struct timeval presentationTime, unsigned durationInMicroseconds);
+
+    std::string fIp;
+    unsigned fPort;
+    SRTMode fMode;
+    unsigned fLatency;
+    struct sockaddr_in address;
+
+    SRTSOCKET sock;                     //!< Caller or listener socket
+    std::vector<SRTSOCKET> peers;       //!< Connected sockets, the caller one or the accepted ones
+    std::chrono::steady_clock::time_point lastCheck;
+    std::chrono::steady_clock::time_point lastConnect;
+
+    unsigned char buffer[SRT_PAYLOAD_SIZE];
+    bool fetching;
+    bool fetchAgain;
+    size_t droppedChunks;
+};
+
+#endif
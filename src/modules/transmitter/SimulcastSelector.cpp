@@ -0,0 +1,118 @@
+/*
+ *  SimulcastSelector.cpp - Layer selection of simulcast forwarding connections
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "SimulcastSelector.hh"
+
+SimulcastSelector::SimulcastSelector(VCodecType codec, unsigned layers) :
+    fCodec(codec), bitrates(layers, 0), paramSets(layers), current(-1), pending(layers > 0 ? 0 : -1),
+    switches(0)
+{
+}
+
+void SimulcastSelector::setLayerBitrate(unsigned layer, unsigned bitrate)
+{
+    if (layer < bitrates.size()) {
+        bitrates[layer] = bitrate;
+    }
+}
+
+void SimulcastSelector::setTargetBitrate(unsigned bitrate)
+{
+    int layer;
+
+    if (bitrate == 0 || bitrates.empty()) {
+        return;
+    }
+
+    layer = choose(bitrate);
+    pending = layer == current ? -1 : layer;
+}
+
+int SimulcastSelector::choose(unsigned target) const
+{
+    int best = -1;
+    int lowest = 0;
+    double limit;
+
+    for (unsigned i = 0; i < bitrates.size(); i++) {
+        //NOTE: staying on a layer or going down does not need any margin
+        limit = current >= 0 && bitrates[i] > bitrates[current] ? target/SIMULCAST_UP_MARGIN : target;
+
+        if (bitrates[i] <= limit && (best < 0 || bitrates[i] > bitrates[best])) {
+            best = i;
+        }
+
+        if (bitrates[i] < bitrates[lowest]) {
+            lowest = i;
+        }
+    }
+
+    return best < 0 ? lowest : best;
+}
+
+bool SimulcastSelector::forward(unsigned layer, unsigned char const* nal, unsigned size, bool &switched)
+{
+    unsigned char type;
+
+    switched = false;
+
+    if (layer >= bitrates.size() || !nal || size == 0) {
+        return false;
+    }
+
+    type = fCodec == H264 ? nal[0] & 0x1F : (nal[0] & 0x7E) >> 1;
+
+    if (isParameterSet(type)) {
+        paramSets[layer][type].assign(nal, nal + size);
+    }
+
+    if ((int) layer == pending && startsKeyPicture(nal, size)) {
+        if (current >= 0) {
+            switches++;
+        }
+
+        current = pending;
+        pending = -1;
+        switched = true;
+    }
+
+    return (int) layer == current;
+}
+
+bool SimulcastSelector::isParameterSet(unsigned char type) const
+{
+    return fCodec == H264 ? (type == 7 || type == 8) : (type >= 32 && type <= 34);
+}
+
+bool SimulcastSelector::startsKeyPicture(unsigned char const* nal, unsigned size) const
+{
+    unsigned char type;
+
+    //NOTE: first_mb_in_slice is 0 (ue(v) '1' bit) or first_slice_segment_in_pic_flag is set
+    if (fCodec == H264) {
+        type = nal[0] & 0x1F;
+        return type == 5 && size > 1 && (nal[1] & 0x80);
+    }
+
+    type = (nal[0] & 0x7E) >> 1;
+    return type >= 16 && type <= 21 && size > 2 && (nal[2] & 0x80);
+}
@@ -0,0 +1,106 @@
+/*
+ *  SimulcastSelector.hh - Layer selection of simulcast forwarding connections
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _SIMULCAST_SELECTOR_HH
+#define _SIMULCAST_SELECTOR_HH
+
+#include <map>
+#include <vector>
+#include <cstddef>
+
+#include "../../Types.hh"
+
+#define SIMULCAST_UP_MARGIN 1.2     //!< Times its bitrate the target must reach to switch up to a higher layer
+
+/*! Chooses which layer of a simulcast stream is forwarded to a receiver. The layer is the one with the
+    highest nominal bitrate that fits the target bitrate estimated from the receiver reports; a higher
+    layer must fit it with a SIMULCAST_UP_MARGIN margin, so the estimate does not make the stream flap.
+    The forwarded layer only changes at the first slice of an IRAP picture of the new one, so receivers
+    decode it from a picture without references. Layers are fed with NAL units without start code.
+*/
+class SimulcastSelector {
+
+public:
+    /**
+    * Class constructor, the lowest layer is selected until there is a target bitrate
+    * @param codec coded format of the layers, H264 or H265
+    * @param layers number of layers
+    */
+    SimulcastSelector(VCodecType codec, unsigned layers);
+
+    /**
+    * @param layer layer index
+    * @param bitrate nominal bitrate of the layer in kbps, 0 if it is unknown
+    */
+    void setLayerBitrate(unsigned layer, unsigned bitrate);
+
+    /**
+    * Selects the layer to switch to at its next IRAP picture
+    * @param bitrate receiver target bitrate in kbps, 0 keeps the selection
+    */
+    void setTargetBitrate(unsigned bitrate);
+
+    /**
+    * Checks a NAL unit of a layer, its last parameter sets are kept
+    * @param layer layer index
+    * @param nal NAL unit without start code
+    * @param size NAL unit size
+    * @param switched set to true if the NAL unit starts the forwarding of a new layer, whose parameter
+    *        sets (see getParameterSets) must be sent before it
+    * @return true if the NAL unit is forwarded
+    */
+    bool forward(unsigned layer, unsigned char const* nal, unsigned size, bool &switched);
+
+    /**
+    * @param layer layer index
+    * @return last parameter sets of each type received in band, without start code
+    */
+    std::map<unsigned char, std::vector<unsigned char>> const& getParameterSets(unsigned layer) const
+        {return paramSets[layer];};
+
+    /**
+    * @return index of the forwarded layer, -1 if there is none yet
+    */
+    int getLayer() const {return current;};
+
+    /**
+    * @return index of the layer to switch to, -1 if there is no pending switch
+    */
+    int getPendingLayer() const {return pending;};
+
+    size_t getSwitches() const {return switches;};
+    unsigned getLayers() const {return bitrates.size();};
+
+private:
+    int choose(unsigned target) const;
+    bool isParameterSet(unsigned char type) const;
+    bool startsKeyPicture(unsigned char const* nal, unsigned size) const;
+
+    VCodecType fCodec;
+    std::vector<unsigned> bitrates;
+    std::vector<std::map<unsigned char, std::vector<unsigned char>>> paramSets;
+    int current;
+    int pending;
+    size_t switches;
+};
+
+#endif
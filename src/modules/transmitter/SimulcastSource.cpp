@@ -0,0 +1,226 @@
+/*
+ *  SimulcastSource.cpp - Source forwarding one layer of a simulcast stream
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+
+#include "SimulcastSource.hh"
+#include "../../Utils.hh"
+
+SimulcastSource* SimulcastSource::createNew(UsageEnvironment& env, VCodecType codec, std::vector<FramedSource*> layers,
+                                            std::vector<H264or5QueueSource*> parameterSets,
+                                            std::vector<const StreamInfo*> infos)
+{
+    if (codec != H264 && codec != H265) {
+        utils::errorMsg("[SimulcastSource] Only H264 and H265 layers are supported");
+        return NULL;
+    }
+
+    if (layers.empty() || layers.size() != parameterSets.size() || layers.size() != infos.size()) {
+        utils::errorMsg("[SimulcastSource] Each layer needs its source, parameter sets and StreamInfo");
+        return NULL;
+    }
+
+    for (auto layer : layers) {
+        if (!layer) {
+            utils::errorMsg("[SimulcastSource] Layer sources cannot be NULL");
+            return NULL;
+        }
+    }
+
+    return new SimulcastSource(env, codec, layers, parameterSets, infos);
+}
+
+SimulcastSource::SimulcastSource(UsageEnvironment& env, VCodecType codec, std::vector<FramedSource*> layers,
+                                 std::vector<H264or5QueueSource*> parameterSets,
+                                 std::vector<const StreamInfo*> infos) :
+    FramedSource(env), fCodec(codec), selector(codec, layers.size()), droppedNals(0)
+{
+    //NOTE: layers are the client data of their reads, so the vector is not resized afterwards
+    fLayers.resize(layers.size());
+
+    for (unsigned i = 0; i < layers.size(); i++) {
+        fLayers[i].source = this;
+        fLayers[i].index = i;
+        fLayers[i].input = layers[i];
+        fLayers[i].parameterSets = parameterSets[i];
+        fLayers[i].info = infos[i];
+        fLayers[i].buffer.resize(MAX_H264_OR_5_NAL_SIZE);
+    }
+}
+
+SimulcastSource::~SimulcastSource()
+{
+    for (auto &layer : fLayers) {
+        Medium::close(layer.input);
+    }
+}
+
+void SimulcastSource::doGetNextFrame()
+{
+    for (auto &layer : fLayers) {
+        if (!layer.input->isCurrentlyAwaitingData()) {
+            readLayer(&layer);
+        }
+    }
+
+    //NOTE: delivering from here would recurse into the sink, it is left to the event loop
+    if (!queued.empty()) {
+        nextTask() = envir().taskScheduler().scheduleDelayedTask(0, (TaskFunc*) deliverTask, this);
+    }
+}
+
+void SimulcastSource::doStopGettingFrames()
+{
+    FramedSource::doStopGettingFrames();
+
+    for (auto &layer : fLayers) {
+        layer.input->stopGettingFrames();
+    }
+
+    queued.clear();
+}
+
+void SimulcastSource::readLayer(Layer* layer)
+{
+    layer->input->getNextFrame(layer->buffer.data(), layer->buffer.size(), afterGettingLayer, layer,
+                               FramedSource::handleClosure, this);
+}
+
+void SimulcastSource::afterGettingLayer(void* clientData, unsigned frameSize, unsigned /*numTruncatedBytes*/,
+                                        struct timeval presentationTime, unsigned /*durationInMicroseconds*/)
+{
+    Layer* layer = (Layer*) clientData;
+    layer->source->afterGettingLayer1(layer, frameSize, presentationTime);
+}
+
+void SimulcastSource::afterGettingLayer1(Layer* layer, unsigned frameSize, struct timeval presentationTime)
+{
+    bool switched;
+
+    if (layer->info) {
+        selector.setLayerBitrate(layer->index, layer->info->bitrate);
+    }
+
+    if (targetBitrate) {
+        selector.setTargetBitrate(targetBitrate());
+    }
+
+    if (selector.forward(layer->index, layer->buffer.data(), frameSize, switched)) {
+        if (switched) {
+            queueParameterSets(layer, presentationTime);
+        }
+
+        queueNal(layer->buffer.data(), frameSize, presentationTime);
+    }
+
+    readLayer(layer);
+
+    if (isCurrentlyAwaitingData() && !queued.empty()) {
+        deliver();
+    }
+}
+
+void SimulcastSource::queueParameterSets(Layer* layer, struct timeval presentationTime)
+{
+    std::map<unsigned char, std::vector<unsigned char>> const& inBand = selector.getParameterSets(layer->index);
+    std::vector<unsigned char> types;
+
+    if (fCodec == H264) {
+        types = {7, 8};
+    } else {
+        types = {32, 33, 34};
+    }
+
+    //NOTE: in band parameter sets are the current ones, the extradata ones are used for missing types
+    if (layer->parameterSets) {
+        layer->parameterSets->parseExtradata();
+    }
+
+    for (auto type : types) {
+        auto it = inBand.find(type);
+
+        if (it != inBand.end()) {
+            queueNal(it->second.data(), it->second.size(), presentationTime);
+            continue;
+        }
+
+        if (!layer->parameterSets) {
+            continue;
+        }
+
+        if ((type == 7 || type == 33) && layer->parameterSets->getSPS()) {
+            queueNal(layer->parameterSets->getSPS(), layer->parameterSets->getSPSSize(), presentationTime);
+        } else if ((type == 8 || type == 34) && layer->parameterSets->getPPS()) {
+            queueNal(layer->parameterSets->getPPS(), layer->parameterSets->getPPSSize(), presentationTime);
+        } else if (type == 32 && layer->parameterSets->getVPS()) {
+            queueNal(layer->parameterSets->getVPS(), layer->parameterSets->getVPSSize(), presentationTime);
+        }
+    }
+
+    utils::debugMsg("[SimulcastSource] Forwarding layer " + std::to_string(layer->index));
+}
+
+void SimulcastSource::queueNal(unsigned char const* nal, unsigned size, struct timeval presentationTime)
+{
+    QueuedNal q;
+
+    if (queued.size() >= SIMULCAST_MAX_QUEUED_NALS) {
+        queued.pop_front();
+        droppedNals++;
+    }
+
+    q.data.assign(nal, nal + size);
+    q.presentationTime = presentationTime;
+    queued.push_back(std::move(q));
+}
+
+void SimulcastSource::deliverTask(void* clientData)
+{
+    SimulcastSource* source = (SimulcastSource*) clientData;
+
+    source->nextTask() = NULL;
+
+    if (source->isCurrentlyAwaitingData() && !source->queued.empty()) {
+        source->deliver();
+    }
+}
+
+void SimulcastSource::deliver()
+{
+    QueuedNal &nal = queued.front();
+
+    if (nal.data.size() > fMaxSize) {
+        fFrameSize = fMaxSize;
+        fNumTruncatedBytes = nal.data.size() - fMaxSize;
+    } else {
+        fFrameSize = nal.data.size();
+        fNumTruncatedBytes = 0;
+    }
+
+    memcpy(fTo, nal.data.data(), fFrameSize);
+    fPresentationTime = nal.presentationTime;
+    fDurationInMicroseconds = 0;
+
+    queued.pop_front();
+
+    FramedSource::afterGetting(this);
+}
@@ -0,0 +1,106 @@
+/*
+ *  SimulcastSource.hh - Source forwarding one layer of a simulcast stream
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _SIMULCAST_SOURCE_HH
+#define _SIMULCAST_SOURCE_HH
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <liveMedia.hh>
+
+#include "../../StreamInfo.hh"
+#include "H264or5QueueSource.hh"
+#include "SimulcastSelector.hh"
+
+#define SIMULCAST_MAX_QUEUED_NALS 512   //!< Forwarded NAL units waiting for the sink, the oldest are dropped
+
+/*! FramedSource delivering the NAL units of one of several layers, which are replicas of the readers of
+    a ladder encoder, see SimulcastSelector. Every layer is read continuously, so the replicators are not
+    stalled by the layers which are not forwarded. The parameter sets of a layer are sent before its
+    first picture; the last ones received in band are used, or its extradata if there are none.
+*/
+class SimulcastSource : public FramedSource {
+
+public:
+    /**
+    * @param env Live555 UsageEnvironement
+    * @param codec coded format of the layers, H264 or H265
+    * @param layers replicas of the layers readers
+    * @param parameterSets sources of the layers readers, whose extradata parameter sets are used
+    * @param infos StreamInfo of the layers readers, their bitrate is the layer nominal bitrate
+    * @return the new source, NULL if the layers are not consistent
+    */
+    static SimulcastSource* createNew(UsageEnvironment& env, VCodecType codec, std::vector<FramedSource*> layers,
+                                      std::vector<H264or5QueueSource*> parameterSets,
+                                      std::vector<const StreamInfo*> infos);
+
+    /**
+    * @param target function returning the receiver target bitrate in kbps, 0 if it is unknown
+    */
+    void setTargetBitrate(std::function<unsigned()> target) {targetBitrate = target;};
+
+    int getLayer() const {return selector.getLayer();};
+    size_t getSwitches() const {return selector.getSwitches();};
+    size_t getDroppedNals() const {return droppedNals;};
+
+protected:
+    SimulcastSource(UsageEnvironment& env, VCodecType codec, std::vector<FramedSource*> layers,
+                    std::vector<H264or5QueueSource*> parameterSets, std::vector<const StreamInfo*> infos);
+    ~SimulcastSource();
+
+    void doGetNextFrame();
+    void doStopGettingFrames();
+
+private:
+    struct Layer {
+        SimulcastSource* source;
+        unsigned index;
+        FramedSource* input;
+        H264or5QueueSource* parameterSets;
+        const StreamInfo* info;
+        std::vector<unsigned char> buffer;
+    };
+
+    struct QueuedNal {
+        std::vector<unsigned char> data;
+        struct timeval presentationTime;
+    };
+
+    static void afterGettingLayer(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
+                                  struct timeval presentationTime, unsigned durationInMicroseconds);
+    static void deliverTask(void* clientData);
+    void afterGettingLayer1(Layer* layer, unsigned frameSize, struct timeval presentationTime);
+    void readLayer(Layer* layer);
+    void queueParameterSets(Layer* layer, struct timeval presentationTime);
+    void queueNal(unsigned char const* nal, unsigned size, struct timeval presentationTime);
+    void deliver();
+
+    VCodecType fCodec;
+    std::vector<Layer> fLayers;
+    SimulcastSelector selector;
+    std::deque<QueuedNal> queued;
+    std::function<unsigned()> targetBitrate;
+    size_t droppedNals;
+};
+
+#endif
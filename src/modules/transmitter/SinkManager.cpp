@@ -47,7 +47,7 @@ SinkManager* SinkManager::createNew(unsigned readersNum)
 }
 
 SinkManager::SinkManager(unsigned readersNum) :
-TailFilter(readersNum, SERVER, true), rtspServer(NULL)
+TailFilter(readersNum, SERVER, true), rtspServer(NULL), webrtcServer(NULL), envWaiters(0), stopLoop(false)
 {
     scheduler = BasicTaskScheduler::createNew();
     env = BasicUsageEnvironment::createNew(*scheduler);
@@ -67,10 +67,20 @@ TailFilter(readersNum, SERVER, true), rtspServer(NULL)
 
     fType = TRANSMITTER;
     initializeEventMap();
+
+    if (rtspServer) {
+        loopThread = std::thread(&SinkManager::eventLoop, this);
+    }
 }
 
 SinkManager::~SinkManager()
 {
+    stopLoop = true;
+
+    if (loopThread.joinable()) {
+        loopThread.join();
+    }
+
     stop();
     delete scheduler;
     envir()->reclaim();
@@ -84,6 +94,9 @@ void SinkManager::stop()
     }
     connections.clear();
 
+    delete webrtcServer;
+    webrtcServer = NULL;
+
     //NOTE: Medium::close() over replicators fail for some reason, even when numReplicas == 0
 //     for (auto it : replicators) {
 //         if (it.second->numReplicas() == 0){
@@ -121,6 +134,8 @@ bool SinkManager::readerInConnection(int rId)
 
 bool SinkManager::specificReaderDelete(int readerId)
 {
+    std::unique_lock<std::mutex> guard = lockEnvironment();
+
     if (removeConnectionByReaderId(readerId) && sources.count(readerId) > 0 && replicators.count(readerId) > 0){
         Medium::close(sources[readerId]);
         sources.erase(readerId);
@@ -130,45 +145,127 @@ bool SinkManager::specificReaderDelete(int readerId)
     return false;
 }
 
-bool SinkManager::doProcessFrame(std::map<int, Frame*> &oFrames, std::vector<int> newFrames, int& ret)
+bool SinkManager::doProcessFrame(FrameMap &oFrames, std::vector<int> &newFrames, int& ret)
 {   
+    bool pFrames = false;
+
     if (envir() == NULL){
         return false;
     }
     
-    int pFrames = 0;
-       
     for (auto id : newFrames){
-        if (oFrames.count(id) > 0){
-            if (sources.count(id) > 0 && sources[id]->setFrame(oFrames[id])){
-                QueueSource::signalNewFrameData(scheduler, sources[id]);
-                pFrames++;
-            }
+        if (oFrames.count(id) <= 0 || sources.count(id) <= 0){
+            continue;
         }
+
+        if (!sources[id]->setFrame(oFrames[id])){
+            utils::warningMsg("Frame of reader " + std::to_string(id) + " dropped, the event loop is not keeping up");
+            continue;
+        }
+
+        QueueSource::signalNewFrameData(scheduler, sources[id]);
+        pFrames = true;
     }
     
-    ret = 0;
-    
-    if (pFrames == 0){
-        scheduler->SingleStep();
-        return false;
+    ret = pFrames ? 0 : WAIT;
+    return pFrames;
+}
+
+void SinkManager::eventLoop()
+{
+    std::map<int, unsigned> targets;
+
+    while (!stopLoop) {
+        {
+            std::lock_guard<std::mutex> guard(envMtx);
+            scheduler->SingleStep(EVENT_LOOP_MAX_DELAY);
+            flushPackets();
+            getTargetBitrates(targets);
+        }
+
+        //NOTE: reader queues are reached through the filter lock, the event loop does not wait for it holding
+        //      the environment, reader configuration takes both the other way round
+        publishTargetBitrates(targets);
+
+        //NOTE: std::mutex is not fair, the environment is handed over to the threads waiting for it
+        while (envWaiters > 0 && !stopLoop) {
+            std::this_thread::yield();
+        }
     }
+}
+
+std::unique_lock<std::mutex> SinkManager::lockEnvironment()
+{
+    envWaiters++;
+    std::unique_lock<std::mutex> guard(envMtx);
+    envWaiters--;
+
+    return guard;
+}
+
+//NOTE: live555 runs a single delayed task per step and RTP sinks schedule one for each packet, so RTP packets
+//      are batched across steps and sent once their batch is full or BATCH_MAX_DELAY old
+void SinkManager::flushPackets()
+{
+    RTPConnection* rtpConn;
+
+    for (auto it : connections){
+        if ((rtpConn = dynamic_cast<RTPConnection*>(it.second))){
+            rtpConn->flushPackets();
+        }
+    }
+}
+
+//NOTE: RTSP sessions can be shared by several clients, so only RTP connections publish the bitrate estimated 
+//      from their receiver reports to the queues they read from, see VideoEncoderX264or5::configAdaptiveBitrate
+void SinkManager::getTargetBitrates(std::map<int, unsigned> &targets)
+{
+    unsigned target;
     
-    while (pFrames > 0){
-        scheduler->SingleStep();
-        for (auto it : sources){
-            if (it.second && it.second->gotFrame()){
-                pFrames--;
+    targets.clear();
+
+    for (auto it : connections){
+        //NOTE: simulcast layers keep their ladder bitrates, forwarding connections switch layers instead
+        if (!dynamic_cast<RTPConnection*>(it.second) || dynamic_cast<SimulcastConnection*>(it.second)){
+            continue;
+        }
+        
+        target = 0;
+        for (auto iter : it.second->getConnectionRTCPInstanceMap()){
+            if (iter.second->getTargetBitrate() > 0 && (target == 0 || iter.second->getTargetBitrate() < target)){
+                target = iter.second->getTargetBitrate();
             }
         }
+        
+        for (auto id : it.second->getReaders()){
+            targets[id] = target;
+        }
+    }
+}
+
+void SinkManager::publishTargetBitrates(std::map<int, unsigned> &targets)
+{
+    std::shared_ptr<Reader> reader;
+
+    if (targets == publishedBitrates){
+        return;
     }
     
-    return true;
+    for (auto it : targets){
+        reader = getReader(it.first);
+        if (reader && reader->getQueue()){
+            reader->getQueue()->setReaderBitrate(it.second);
+        }
+    }
+
+    publishedBitrates = targets;
 }
 
 bool SinkManager::removeConnection(int id)
 {
     Connection* connection;
+    std::unique_lock<std::mutex> guard = lockEnvironment();
+
     if (connections.count(id) <= 0){
         return false;
     }
@@ -183,9 +280,17 @@ bool SinkManager::removeConnection(int id)
 }
 
 bool SinkManager::addRTSPConnection(std::vector<int> readers, int id, TxFormat txformat, 
-                                    std::string name, std::string info, std::string desc)
+                                    std::string name, std::string info, std::string desc, bool shared,
+                                    unsigned ptime)
 {
     RTSPConnection* connection;
+    std::unique_lock<std::mutex> guard = lockEnvironment();
+
+    if (ptime > MAX_AUDIO_PTIME) {
+        utils::errorMsg("RTSP Connection not added, ptime must be " + std::to_string(MAX_AUDIO_PTIME) + " ms at most");
+        return false;
+    }
+
     if (!rtspServer){
         utils::errorMsg("Unitialized RTSPServer");
         return false;
@@ -201,7 +306,7 @@ bool SinkManager::addRTSPConnection(std::vector<int> readers, int id, TxFormat t
         return false;
     }
 
-    connection = new RTSPConnection(env, txformat, rtspServer, name, info, desc);
+    connection = new RTSPConnection(env, txformat, rtspServer, name, info, desc, shared, ptime);
 
     for (auto & reader : readers){
         if (!addSubsessionByReader(connection, reader)) {
@@ -221,15 +326,43 @@ bool SinkManager::addRTSPConnection(std::vector<int> readers, int id, TxFormat t
     return true;
 }
 
-bool SinkManager::addRTPConnection(std::vector<int> inputReaders, int id, std::string ip, int port, TxFormat txFormat)
+bool SinkManager::addRTPConnection(std::vector<int> inputReaders, int id, std::string ip, int port, TxFormat txFormat,
+                                   float pacing, bool retransmission, float fec, unsigned ptime, bool forwarding)
 {
     bool ret;
+    unsigned columns;
+    unsigned rows;
+    std::unique_lock<std::mutex> guard = lockEnvironment();
     
     if (connections.count(id) > 0) {
         utils::errorMsg("Error creating RTP connection. Specified ID already in use");
         return false;
     }
 
+    if (pacing != 0 && pacing < 1) {
+        utils::errorMsg("Error creating RTP connection. Pacing must be 0 (disabled) or at least 1");
+        return false;
+    }
+
+    if (fec != 0 && !FECEncoder::matrixSize(fec, columns, rows)) {
+        utils::errorMsg("Error creating RTP connection. FEC ratio must be 0 (disabled) or between " +
+                        std::to_string(FEC_MIN_RATIO) + " and 1");
+        return false;
+    }
+
+    if (ptime > MAX_AUDIO_PTIME) {
+        utils::errorMsg("Error creating RTP connection. Ptime must be " + std::to_string(MAX_AUDIO_PTIME) +
+                        " ms at most");
+        return false;
+    }
+
+    //NOTE: RTX and FEC streams protect a single SSRC, the one of the forwarded layer
+    if (txFormat == SIMULCAST && !forwarding && (retransmission || fec > 0)) {
+        utils::errorMsg("Error creating RTP connection. Simulcast connections only support retransmission and "
+                        "FEC in forwarding mode");
+        return false;
+    }
+
     for (auto iReader : inputReaders) {
         if (getReader(iReader) == NULL) {
             utils::errorMsg("Error creating RTP connection. Specified ID already in use");
@@ -239,7 +372,7 @@ bool SinkManager::addRTPConnection(std::vector<int> inputReaders, int id, std::s
     
     switch (txFormat) {
         case STD_RTP:
-            ret = addStdRTPConnection(inputReaders, id, ip, port);
+            ret = addStdRTPConnection(inputReaders, id, ip, port, ptime);
             break;
         case ULTRAGRID:
             ret = addUltraGridRTPConnection(inputReaders, id, ip, port);
@@ -247,35 +380,160 @@ bool SinkManager::addRTPConnection(std::vector<int> inputReaders, int id, std::s
         case MPEGTS:
             ret = addMpegTsRTPConnection(inputReaders, id, ip, port);
             break;
+        case SIMULCAST:
+            ret = addSimulcastRTPConnection(inputReaders, id, ip, port, forwarding);
+            break;
         default:
             ret = false;
             break;
     }
 
+    if (ret && pacing > 0) {
+        ret = dynamic_cast<RTPConnection*>(connections[id])->setPacing(pacing);
+    }
+
+    if (ret && retransmission) {
+        ret = dynamic_cast<RTPConnection*>(connections[id])->setRetransmission(true);
+    }
+
+    if (ret && fec > 0) {
+        ret = dynamic_cast<RTPConnection*>(connections[id])->setFEC(fec);
+    }
+
     return ret;
 }
 
-bool SinkManager::addMpegTsRTPConnection(std::vector<int> inputReaders, int id, std::string ip, int port)
+bool SinkManager::addSRTConnection(std::vector<int> readers, int id, std::string ip, int port,
+                                   SRTMode mode, unsigned latency)
+{
+    SRTConnection* conn;
+    std::unique_lock<std::mutex> guard = lockEnvironment();
+
+    if (connections.count(id) > 0) {
+        utils::errorMsg("Error creating SRT connection. Specified ID already in use");
+        return false;
+    }
+
+    if (readers.size() <= 0 || readers.size() > 2) {
+        utils::errorMsg("Error in SRT connection setup. Only 1 or 2 readers are supported");
+        return false;
+    }
+
+    for (auto iReader : readers) {
+        if (getReader(iReader) == NULL) {
+            utils::errorMsg("Error creating SRT connection. Reader does not exist");
+            return false;
+        }
+    }
+
+    conn = new SRTConnection(envir(), ip, port, mode, latency);
+
+    if (!addTsSources(conn, readers)) {
+        utils::errorMsg("Error creating SRT connection. Readers not valid");
+        delete conn;
+        return false;
+    }
+
+    if (!conn->setup()) {
+        utils::errorMsg("Error in SRT connection setup");
+        delete conn;
+        return false;
+    }
+
+    connections[id] = conn;
+    return true;
+}
+
+bool SinkManager::addWebRTCConnection(std::vector<int> readers, int id, std::string name, std::string ip,
+                                      unsigned whepPort, unsigned mediaPort)
 {
+    WebRTCConnection* conn;
     VideoFrameQueue *vQueue = NULL;
     AudioFrameQueue *aQueue = NULL;
-    MpegTsConnection* conn = NULL;
-    bool success = false;
-    bool hasVideo = false;
-    bool hasAudio = false;
+    bool success = true;
+    std::unique_lock<std::mutex> guard = lockEnvironment();
 
-    if (inputReaders.size() <= 0 || inputReaders.size() > 2) {
-        utils::errorMsg("Error in MPEG-TS RTP connection setup. Only 1 or 2 readers are supported");
+    if (connections.count(id) > 0) {
+        utils::errorMsg("Error creating WebRTC connection. Specified ID already in use");
         return false;
     }
-    
-    conn = new MpegTsConnection(envir(), ip, port);
 
-    if (!conn) {
-        utils::errorMsg("Error creating MpegTSRTPConnection");
+    if (readers.size() <= 0 || readers.size() > 2) {
+        utils::errorMsg("Error in WebRTC connection setup. Only 1 or 2 readers are supported");
         return false;
     }
-    
+
+    for (auto iReader : readers) {
+        if (getReader(iReader) == NULL || replicators.count(iReader) <= 0) {
+            utils::errorMsg("Error creating WebRTC connection. Reader does not exist");
+            return false;
+        }
+    }
+
+    if (!webrtcServer) {
+        webrtcServer = WebRTCServer::createNew(envir(), ip, whepPort, mediaPort);
+    } else if (webrtcServer->getWhepPort() != whepPort || webrtcServer->getMediaPort() != mediaPort ||
+               webrtcServer->getIP() != ip) {
+        utils::errorMsg("Error creating WebRTC connection. The WebRTC server is already running at ports " +
+                        std::to_string(webrtcServer->getWhepPort()) + " and " +
+                        std::to_string(webrtcServer->getMediaPort()));
+        return false;
+    }
+
+    if (!webrtcServer) {
+        utils::errorMsg("Error creating WebRTC connection. WebRTC server could not be started");
+        return false;
+    }
+
+    conn = new WebRTCConnection(envir(), webrtcServer, name);
+
+    for (auto iReader : readers) {
+        vQueue = dynamic_cast<VideoFrameQueue*>(getReader(iReader)->getQueue());
+        aQueue = dynamic_cast<AudioFrameQueue*>(getReader(iReader)->getQueue());
+
+        if (vQueue) {
+            success = conn->addVideoSource(replicators[iReader]->createStreamReplica(),
+                                           vQueue->getStreamInfo()->video.codec, iReader,
+                                           dynamic_cast<H264or5QueueSource*>(sources[iReader]));
+        } else if (aQueue) {
+            success = conn->addAudioSource(replicators[iReader]->createStreamReplica(),
+                                           aQueue->getStreamInfo()->audio.codec, iReader);
+        } else {
+            success = false;
+        }
+
+        if (!success) {
+            break;
+        }
+    }
+
+    if (!success) {
+        utils::errorMsg("Error creating WebRTC connection. Readers not valid");
+        delete conn;
+        return false;
+    }
+
+    if (!conn->setup()) {
+        utils::errorMsg("Error in WebRTC connection setup");
+        delete conn;
+        return false;
+    }
+
+    connections[id] = conn;
+    utils::infoMsg("WebRTC stream " + name + " published at port " + std::to_string(webrtcServer->getWhepPort()) +
+                   conn->getPath());
+    return true;
+}
+
+template <class TsConnection>
+bool SinkManager::addTsSources(TsConnection* conn, std::vector<int> inputReaders)
+{
+    VideoFrameQueue *vQueue = NULL;
+    AudioFrameQueue *aQueue = NULL;
+    bool success = false;
+    bool hasVideo = false;
+    bool hasAudio = false;
+
     for (auto inReader : inputReaders) {
 
         vQueue = dynamic_cast<VideoFrameQueue*>(getReader(inReader)->getQueue());
@@ -293,12 +551,31 @@ bool SinkManager::addMpegTsRTPConnection(std::vector<int> inputReaders, int id,
             success = conn->addAudioSource(replicators[inReader]->createStreamReplica(), aQueue->getStreamInfo()->audio.codec, inReader);
             hasAudio = true;
         } else {
-            utils::errorMsg("Error creating MpegTSRTPConnection. Only one video and/or one audio is supported");
+            utils::errorMsg("Error creating MPEG-TS connection. Only one video and/or one audio is supported");
             success = false;
         }
     }
 
-    if (!success) {
+    return success;
+}
+
+bool SinkManager::addMpegTsRTPConnection(std::vector<int> inputReaders, int id, std::string ip, int port)
+{
+    MpegTsConnection* conn = NULL;
+
+    if (inputReaders.size() <= 0 || inputReaders.size() > 2) {
+        utils::errorMsg("Error in MPEG-TS RTP connection setup. Only 1 or 2 readers are supported");
+        return false;
+    }
+    
+    conn = new MpegTsConnection(envir(), ip, port);
+
+    if (!conn) {
+        utils::errorMsg("Error creating MpegTSRTPConnection");
+        return false;
+    }
+    
+    if (!addTsSources(conn, inputReaders)) {
         utils::errorMsg("Error creating MpegTSRTPConnection. Readers not valid");
         return false;
     }
@@ -313,7 +590,7 @@ bool SinkManager::addMpegTsRTPConnection(std::vector<int> inputReaders, int id,
     return true;
 }
 
-bool SinkManager::addStdRTPConnection(std::vector<int> readers, int id, std::string ip, int port)
+bool SinkManager::addStdRTPConnection(std::vector<int> readers, int id, std::string ip, int port, unsigned ptime)
 {
     VideoFrameQueue *vQueue;
     AudioFrameQueue *aQueue;
@@ -341,7 +618,7 @@ bool SinkManager::addStdRTPConnection(std::vector<int> readers, int id, std::str
         const StreamInfo *si = aQueue->getStreamInfo();
         conn = new AudioConnection(envir(), replicators[readers.front()]->createStreamReplica(),
                 ip, port, si->audio.codec, si->audio.channels,
-                si->audio.sampleRate, si->audio.sampleFormat, readers.front());
+                si->audio.sampleRate, si->audio.sampleFormat, readers.front(), ptime);
     }
 
     if (!conn) {
@@ -359,6 +636,55 @@ bool SinkManager::addStdRTPConnection(std::vector<int> readers, int id, std::str
     return true;
 }
 
+bool SinkManager::addSimulcastRTPConnection(std::vector<int> readers, int id, std::string ip, int port,
+                                            bool forwarding)
+{
+    std::vector<FramedSource*> layers;
+    std::vector<H264or5QueueSource*> parameterSets;
+    std::vector<const StreamInfo*> infos;
+    VideoFrameQueue *vQueue;
+    VCodecType codec = VC_NONE;
+    SimulcastConnection* conn;
+    std::shared_ptr<Reader> r;
+
+    for (auto reader : readers) {
+        r = getReader(reader);
+
+        if (!r || !(vQueue = dynamic_cast<VideoFrameQueue*>(r->getQueue()))) {
+            utils::errorMsg("Error in simulcast connection setup. Layers must be video readers");
+            return false;
+        }
+
+        if (codec == VC_NONE) {
+            codec = vQueue->getStreamInfo()->video.codec;
+        }
+
+        if (vQueue->getStreamInfo()->video.codec != codec || (codec != H264 && codec != H265)) {
+            utils::errorMsg("Error in simulcast connection setup. Layers must be all H264 or all H265");
+            return false;
+        }
+
+        infos.push_back(vQueue->getStreamInfo());
+        parameterSets.push_back(dynamic_cast<H264or5QueueSource*>(sources[reader]));
+    }
+
+    //NOTE: replicas are created once the layers are validated, an unused replica would stall its replicator
+    for (auto reader : readers) {
+        layers.push_back(replicators[reader]->createStreamReplica());
+    }
+
+    conn = new SimulcastConnection(envir(), layers, parameterSets, infos, readers, ip, port, codec, forwarding);
+
+    if (!conn->setup()) {
+        utils::errorMsg("Error in simulcast connection setup");
+        delete conn;
+        return false;
+    }
+
+    connections[id] = conn;
+    return true;
+}
+
 bool SinkManager::addUltraGridRTPConnection(std::vector<int> readers, int id, std::string ip, int port)
 {
     VideoFrameQueue *vQueue = NULL;
@@ -412,6 +738,7 @@ bool SinkManager::specificReaderConfig(int readerId, FrameQueue* queue)
 {
     VideoFrameQueue *vQueue;
     AudioFrameQueue *aQueue;  
+    std::unique_lock<std::mutex> guard = lockEnvironment();
 
     if ((vQueue = dynamic_cast<VideoFrameQueue*>(queue)) != NULL){
         return createVideoQueueSource(vQueue->getStreamInfo(), readerId);
@@ -433,6 +760,8 @@ bool SinkManager::createVideoQueueSource(const StreamInfo* si, int readerId)
             replicators[readerId] = StreamReplicator::createNew(*(envir()), sources[readerId], False);
             break;
         case VP8:
+        case VP9:
+        case AV1:
             sources[readerId] = QueueSource::createNew(*(envir()), si);
             replicators[readerId] =  StreamReplicator::createNew(*(envir()), sources[readerId], False);
             break;
@@ -522,6 +851,8 @@ void SinkManager::initializeEventMap()
 {
     eventMap["addRTSPConnection"] = std::bind(&SinkManager::addRTSPConnectionEvent, this, std::placeholders::_1);
     eventMap["addRTPConnection"] = std::bind(&SinkManager::addRTPConnectionEvent, this, std::placeholders::_1);
+    eventMap["addSRTConnection"] = std::bind(&SinkManager::addSRTConnectionEvent, this, std::placeholders::_1);
+    eventMap["addWebRTCConnection"] = std::bind(&SinkManager::addWebRTCConnectionEvent, this, std::placeholders::_1);
     eventMap["removeConnection"] = std::bind(&SinkManager::removeConnectionEvent, this, std::placeholders::_1);
 }
 
@@ -552,6 +883,8 @@ bool SinkManager::addRTSPConnectionEvent(Jzon::Node* params)
     std::string name, strTxFormat;
     std::string info = "";
     std::string desc = "";
+    bool shared = false;
+    unsigned ptime = 0;
     std::vector<int> readers;
 
     if (!params) {
@@ -583,6 +916,14 @@ bool SinkManager::addRTSPConnectionEvent(Jzon::Node* params)
         desc = params->Get("desc").ToString();
     }
 
+    if (params->Has("shared") && params->Get("shared").IsBool()) {
+        shared = params->Get("shared").ToBool();
+    }
+
+    if (params->Has("ptime") && params->Get("ptime").IsNumber()) {
+        ptime = params->Get("ptime").ToInt();
+    }
+
     Jzon::Array jsonReaders = params->Get("readers").AsArray();
 
     for (Jzon::Array::iterator it = jsonReaders.begin(); it != jsonReaders.end(); ++it) {
@@ -593,7 +934,7 @@ bool SinkManager::addRTSPConnectionEvent(Jzon::Node* params)
         return false;
     }
 
-    return addRTSPConnection(readers, id, txFormat, name, info, desc);
+    return addRTSPConnection(readers, id, txFormat, name, info, desc, shared, ptime);
 }
 
 bool SinkManager::addRTPConnectionEvent(Jzon::Node* params)
@@ -604,6 +945,11 @@ bool SinkManager::addRTPConnectionEvent(Jzon::Node* params)
     int port;
     std::string stringTxFormat;
     TxFormat txFormat;
+    float pacing = 0;
+    bool retransmission = false;
+    float fec = 0;
+    unsigned ptime = 0;
+    bool forwarding = false;
 
     if (!params) {
         return false;
@@ -627,6 +973,26 @@ bool SinkManager::addRTPConnectionEvent(Jzon::Node* params)
     stringTxFormat = params->Get("txFormat").ToString();
     txFormat = utils::getTxFormatFromString(stringTxFormat);
 
+    if (params->Has("pacing") && params->Get("pacing").IsNumber()) {
+        pacing = params->Get("pacing").ToFloat();
+    }
+
+    if (params->Has("retransmission") && params->Get("retransmission").IsBool()) {
+        retransmission = params->Get("retransmission").ToBool();
+    }
+
+    if (params->Has("fec") && params->Get("fec").IsNumber()) {
+        fec = params->Get("fec").ToFloat();
+    }
+
+    if (params->Has("ptime") && params->Get("ptime").IsNumber()) {
+        ptime = params->Get("ptime").ToInt();
+    }
+
+    if (params->Has("forwarding") && params->Get("forwarding").IsBool()) {
+        forwarding = params->Get("forwarding").ToBool();
+    }
+
     Jzon::Array jsonReaders = params->Get("readers").AsArray();
 
     for (Jzon::Array::iterator it = jsonReaders.begin(); it != jsonReaders.end(); ++it) {
@@ -637,7 +1003,111 @@ bool SinkManager::addRTPConnectionEvent(Jzon::Node* params)
         return false;
     }
 
-    return addRTPConnection(readers, connectionId, ip, port, txFormat);
+    return addRTPConnection(readers, connectionId, ip, port, txFormat, pacing, retransmission, fec, ptime,
+                            forwarding);
+}
+
+bool SinkManager::addSRTConnectionEvent(Jzon::Node* params)
+{
+    std::vector<int> readers;
+    int connectionId;
+    std::string ip = "";
+    std::string mode;
+    int port;
+    unsigned latency = SRT_DEFAULT_LATENCY;
+
+    if (!params) {
+        return false;
+    }
+
+    if (!params->Has("id") || !params->Has("port") || !params->Has("mode") || !params->Has("readers")) {
+        return false;
+    }
+
+    if (!params->Get("readers").IsArray()){
+        return false;
+    }
+
+    connectionId = params->Get("id").ToInt();
+    port = params->Get("port").ToInt();
+    mode = params->Get("mode").ToString();
+
+    if (mode != "caller" && mode != "listener") {
+        utils::errorMsg("SRT mode must be caller or listener");
+        return false;
+    }
+
+    //NOTE: the IP is the destination of a caller and the optional local address of a listener
+    if (params->Has("ip")) {
+        ip = params->Get("ip").ToString();
+    } else if (mode == "caller") {
+        return false;
+    }
+
+    if (params->Has("latency")) {
+        latency = params->Get("latency").ToInt();
+    }
+
+    Jzon::Array jsonReaders = params->Get("readers").AsArray();
+
+    for (Jzon::Array::iterator it = jsonReaders.begin(); it != jsonReaders.end(); ++it) {
+        readers.push_back((*it).ToInt());
+    }
+
+    if (readers.empty()) {
+        return false;
+    }
+
+    return addSRTConnection(readers, connectionId, ip, port, mode == "caller" ? SRT_CALLER : SRT_LISTENER, latency);
+}
+
+bool SinkManager::addWebRTCConnectionEvent(Jzon::Node* params)
+{
+    std::vector<int> readers;
+    int connectionId;
+    std::string name;
+    std::string ip = "";
+    unsigned whepPort = WEBRTC_WHEP_PORT;
+    unsigned mediaPort = WEBRTC_MEDIA_PORT;
+
+    if (!params) {
+        return false;
+    }
+
+    if (!params->Has("id") || !params->Has("name") || !params->Has("readers")) {
+        return false;
+    }
+
+    if (!params->Get("readers").IsArray()){
+        return false;
+    }
+
+    connectionId = params->Get("id").ToInt();
+    name = params->Get("name").ToString();
+
+    if (params->Has("ip")) {
+        ip = params->Get("ip").ToString();
+    }
+
+    if (params->Has("whepPort")) {
+        whepPort = params->Get("whepPort").ToInt();
+    }
+
+    if (params->Has("mediaPort")) {
+        mediaPort = params->Get("mediaPort").ToInt();
+    }
+
+    Jzon::Array jsonReaders = params->Get("readers").AsArray();
+
+    for (Jzon::Array::iterator it = jsonReaders.begin(); it != jsonReaders.end(); ++it) {
+        readers.push_back((*it).ToInt());
+    }
+
+    if (readers.empty()) {
+        return false;
+    }
+
+    return addWebRTCConnection(readers, connectionId, name, ip, whepPort, mediaPort);
 }
 
 void SinkManager::doGetState(Jzon::Object &filterNode)
@@ -646,7 +1116,12 @@ void SinkManager::doGetState(Jzon::Object &filterNode)
 
     RTPConnection* rtpConn;
     RTSPConnection* rtspConn;
+    SRTConnection* srtConn;
+    WebRTCConnection* webrtcConn;
+    AudioConnection* audioConn;
+    SimulcastConnection* simulcastConn;
     std::string uri;
+    std::unique_lock<std::mutex> guard = lockEnvironment();
 
     for (auto it : connections) {
         Jzon::Array jsonReaders;
@@ -657,6 +1132,8 @@ void SinkManager::doGetState(Jzon::Object &filterNode)
         if ((rtspConn = dynamic_cast<RTSPConnection*>(it.second))){
             jsonConnection.Add("name", rtspConn->getName());
             jsonConnection.Add("uri", rtspConn->getURI());
+            jsonConnection.Add("shared", rtspConn->isShared());
+            jsonConnection.Add("ptime", (int)rtspConn->getPtime());
             for (auto iter : it.second->getConnectionRTCPInstanceMap()) {
                 jsonSubsessionStat.Add("SSRC", std::to_string(iter.second->getSSRC()));
                 jsonSubsessionStat.Add("avgBitrateInKbps", (float)iter.second->getAvgBitrate());
@@ -677,6 +1154,50 @@ void SinkManager::doGetState(Jzon::Object &filterNode)
         } else if ((rtpConn = dynamic_cast<RTPConnection*>(it.second))){
             jsonConnection.Add("ip", rtpConn->getIP());
             jsonConnection.Add("port", std::to_string(rtpConn->getPort()));
+            jsonConnection.Add("sentPackets", (int)rtpConn->getSentPackets());
+            jsonConnection.Add("sendCalls", (int)rtpConn->getSendCalls());
+            jsonConnection.Add("pacing", rtpConn->getPacing());
+            jsonConnection.Add("retransmission", rtpConn->getRetransmission());
+            if (rtpConn->getRetransmission()) {
+                jsonConnection.Add("rtxSSRC", std::to_string(rtpConn->getRtxSSRC()));
+                jsonConnection.Add("rtxPayloadType", RTX_PAYLOAD_TYPE);
+                jsonConnection.Add("retransmittedPackets", (int)rtpConn->getRetransmittedPackets());
+                jsonConnection.Add("unrecoverablePackets", (int)rtpConn->getUnrecoverablePackets());
+            }
+            jsonConnection.Add("fec", rtpConn->getFEC());
+            if (rtpConn->getFEC() > 0) {
+                jsonConnection.Add("fecSSRC", std::to_string(rtpConn->getFecSSRC()));
+                jsonConnection.Add("fecPayloadType", FEC_PAYLOAD_TYPE);
+                jsonConnection.Add("fecColumns", (int)rtpConn->getFecColumns());
+                jsonConnection.Add("fecRows", (int)rtpConn->getFecRows());
+                jsonConnection.Add("fecPackets", (int)rtpConn->getFecPackets());
+            }
+            if ((audioConn = dynamic_cast<AudioConnection*>(rtpConn))) {
+                jsonConnection.Add("ptime", (int)audioConn->getPtime());
+            }
+            if ((simulcastConn = dynamic_cast<SimulcastConnection*>(rtpConn))) {
+                Jzon::Array jsonLayers;
+                std::vector<uint32_t> ssrcs = simulcastConn->getLayerSSRCs();
+                std::vector<int> layerReaders = simulcastConn->getReaders();
+
+                jsonConnection.Add("forwarding", simulcastConn->isForwarding());
+                if (simulcastConn->isForwarding()) {
+                    jsonConnection.Add("forwardedLayer", simulcastConn->getForwardedLayer());
+                    jsonConnection.Add("layerSwitches", (int)simulcastConn->getLayerSwitches());
+                } else {
+                    jsonConnection.Add("ridExtensionId", (int)simulcastConn->getRidExtensionId());
+                }
+                for (unsigned i = 0; i < layerReaders.size(); i++) {
+                    Jzon::Object jsonLayer;
+                    jsonLayer.Add("reader", layerReaders[i]);
+                    if (!simulcastConn->isForwarding()) {
+                        jsonLayer.Add("rid", simulcastConn->getRid(i));
+                        jsonLayer.Add("SSRC", i < ssrcs.size() ? std::to_string(ssrcs[i]) : "");
+                    }
+                    jsonLayers.Add(jsonLayer);
+                }
+                jsonConnection.Add("layers", jsonLayers);
+            }
             for (auto iter : it.second->getConnectionRTCPInstanceMap()) {
                 jsonSubsessionStat.Add("SSRC", std::to_string(iter.second->getSSRC()));
                 jsonSubsessionStat.Add("avgBitrateInKbps", (float)iter.second->getAvgBitrate());
@@ -691,9 +1212,47 @@ void SinkManager::doGetState(Jzon::Object &filterNode)
                 jsonSubsessionStat.Add("roundTripDelayMilliseconds", (int)iter.second->getRoundTripDelay());
                 jsonSubsessionStat.Add("minRoundTripDelayMilliseconds", (int)iter.second->getMinRoundTripDelay());
                 jsonSubsessionStat.Add("maxRoundTripDelayMilliseconds", (int)iter.second->getMaxRoundTripDelay());
+                jsonSubsessionStat.Add("targetBitrateInKbps", (int)iter.second->getTargetBitrate());
+                jsonSubsessionStat.Add("nackedPackets", (int)iter.second->getNackedPackets());
                 
                 jsonSubsessionsStats.Add(jsonSubsessionStat);    
             }
+        } else if ((srtConn = dynamic_cast<SRTConnection*>(it.second))){
+            jsonConnection.Add("ip", srtConn->getIP());
+            jsonConnection.Add("port", std::to_string(srtConn->getPort()));
+            jsonConnection.Add("mode", srtConn->getMode() == SRT_CALLER ? "caller" : "listener");
+            jsonConnection.Add("latencyMilliseconds", (int)srtConn->getLatency());
+            jsonConnection.Add("droppedChunks", (int)srtConn->getDroppedChunks());
+            for (auto peer : srtConn->getStats()) {
+                jsonSubsessionStat.Add("address", peer.address);
+                jsonSubsessionStat.Add("latencyMilliseconds", peer.latency);
+                jsonSubsessionStat.Add("roundTripDelayMilliseconds", (float)peer.rtt);
+                jsonSubsessionStat.Add("bandwidthInMbps", (float)peer.bandwidth);
+                jsonSubsessionStat.Add("sendRateInMbps", (float)peer.sendRate);
+                jsonSubsessionStat.Add("retransmittedPackets", (int)peer.retransmitted);
+                jsonSubsessionStat.Add("lostPackets", (int)peer.lost);
+                jsonSubsessionStat.Add("droppedPackets", (int)peer.dropped);
+
+                jsonSubsessionsStats.Add(jsonSubsessionStat);
+            }
+        } else if ((webrtcConn = dynamic_cast<WebRTCConnection*>(it.second))){
+            std::vector<WebRTCViewerStats> viewers = webrtcConn->getViewers();
+
+            jsonConnection.Add("name", webrtcConn->getName());
+            jsonConnection.Add("whepPath", webrtcConn->getPath());
+            jsonConnection.Add("whepPort", (int)webrtcServer->getWhepPort());
+            jsonConnection.Add("mediaPort", (int)webrtcServer->getMediaPort());
+            jsonConnection.Add("viewers", (int)viewers.size());
+            for (auto viewer : viewers) {
+                jsonSubsessionStat.Add("id", viewer.id);
+                jsonSubsessionStat.Add("address", viewer.address);
+                jsonSubsessionStat.Add("connected", viewer.connected);
+                jsonSubsessionStat.Add("sentPackets", (int)viewer.sentPackets);
+                jsonSubsessionStat.Add("sentBytes", std::to_string(viewer.sentBytes));
+                jsonSubsessionStat.Add("droppedPackets", (int)viewer.droppedPackets);
+
+                jsonSubsessionsStats.Add(jsonSubsessionStat);
+            }
         } else {
             filterNode.Add("error", Jzon::null);
         }
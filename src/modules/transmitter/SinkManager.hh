@@ -32,6 +32,9 @@
 
 #include <map>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include <liveMedia/liveMedia.hh>
 #include <BasicUsageEnvironment.hh>
 
@@ -39,6 +42,12 @@
 #define MAX_VIDEO_FRAME_SIZE 1024*1024*2 //2MB
 #define MANUAL_CLIENT_SESSION_ID 1
 #define INIT_SEGMENT 0
+#define EVENT_LOOP_MAX_DELAY 1000 //!< usec, live555 checks triggered events (new frames) at least this often
+
+/*! TailFilter transmitting its readers over RTP and RTSP. The live555 environment runs on its own event
+    loop thread. Frames are copied to QueueSource and handed over through its event trigger, so the filter
+    returns right after that. live555 is not thread safe, the environment lock is held by the event loop
+    while it runs and must be held by any other thread using the environment. */
 
 
 class SinkManager : public TailFilter {
@@ -54,9 +63,18 @@ public:
     * @param ip Destination IP
     * @param port Destination port
     * @param txFormat Transmission format which can be STD_RTP (no container), MPEGTS, Destination port
+    *        or SIMULCAST (the video layers of a ladder encoder in one session, see SimulcastConnection)
+    * @param pacing Rate limit as a multiple of the stream bitrate used to spread large frames, 0 disables it
+    * @param retransmission Answers the receivers generic NACKs with RTX retransmissions (RFC 4588)
+    * @param fec FlexFEC repair packets per protected packet, from FEC_MIN_RATIO to 1, 0 disables it
+    * @param ptime Audio duration in msec packed in each packet of STD_RTP audio connections, up to
+    *        MAX_AUDIO_PTIME, 0 sends each audio frame in its own packet
+    * @param forwarding SIMULCAST connections send the layer fitting the receiver reports instead of all of them
     * @return True if succeded and false if not
     */
-    bool addRTPConnection(std::vector<int> readers, int id, std::string ip, int port, TxFormat txFormat);
+    bool addRTPConnection(std::vector<int> readers, int id, std::string ip, int port, TxFormat txFormat,
+                          float pacing = 0, bool retransmission = false, float fec = 0, unsigned ptime = 0,
+                          bool forwarding = false);
     
     /**
     * Adds an RTSP connection
@@ -66,11 +84,42 @@ public:
     * @param name name of the RTSP session used to generate the session URI
     * @param info information field of the session (optional)
     * @param desc description of the RTSP session (optional)
+    * @param shared if true RTP packets are built once per subsession and sent to all its clients (optional)
+    * @param ptime audio duration in msec packed in each packet of the STD_RTP audio subsessions, up to
+    *        MAX_AUDIO_PTIME (optional)
     * @return True if succeded and false if not
     */
     bool addRTSPConnection(std::vector<int> readers, int id, TxFormat txformat, 
-                           std::string name, std::string info = "", std::string desc = "");
+                           std::string name, std::string info = "", std::string desc = "", bool shared = false,
+                           unsigned ptime = 0);
+
+    /**
+    * Adds an SRT connection, which carries the readers muxed in MPEG-TS
+    * @param readers Readers associated to the connection, one video and/or one audio
+    * @param id Connection Id, which must be unique for each one
+    * @param ip Destination IP in caller mode, local IP in listener mode (empty for any)
+    * @param port Destination port in caller mode, local port in listener mode
+    * @param mode SRT_CALLER connects to a remote listener, SRT_LISTENER accepts remote callers
+    * @param latency SRT receiver buffering in msec, it bounds the retransmissions (optional)
+    * @return True if succeded and false if not
+    */
+    bool addSRTConnection(std::vector<int> readers, int id, std::string ip, int port,
+                          SRTMode mode, unsigned latency = SRT_DEFAULT_LATENCY);
     
+    /**
+    * Adds a WebRTC connection, which publishes the readers to the browsers at /whep/<name>. The WebRTC
+    * server is started with the first one, all of them share its ports
+    * @param readers Readers associated to the connection, one H264 or VP8 video and/or one Opus audio
+    * @param id Connection Id, which must be unique for each one
+    * @param name Stream name, part of its WHEP URL
+    * @param ip Address of the ICE host candidate, empty to use the one the viewers reached the server at (optional)
+    * @param whepPort TCP port of the WHEP signalling (optional)
+    * @param mediaPort UDP port shared by the media of all the viewers (optional)
+    * @return True if succeded and false if not
+    */
+    bool addWebRTCConnection(std::vector<int> readers, int id, std::string name, std::string ip = "",
+                             unsigned whepPort = WEBRTC_WHEP_PORT, unsigned mediaPort = WEBRTC_MEDIA_PORT);
+
     /**
     * Removes the connection determined by the id
     * @param id Connection Id to delete
@@ -95,20 +144,29 @@ private:
     
     bool isGood() {return rtspServer != NULL;};
     
-    bool addStdRTPConnection(std::vector<int> readers, int id, std::string ip, int port);
+    bool addStdRTPConnection(std::vector<int> readers, int id, std::string ip, int port, unsigned ptime);
     bool addUltraGridRTPConnection(std::vector<int> readers, int id, std::string ip, int port);
     bool addMpegTsRTPConnection(std::vector<int> readers, int id, std::string ip, int port);
+    bool addSimulcastRTPConnection(std::vector<int> readers, int id, std::string ip, int port, bool forwarding);
+    template <class TsConnection> bool addTsSources(TsConnection* conn, std::vector<int> readers);
     void initializeEventMap();
     
     bool removeConnectionByReaderId(int readerId);
     
     bool addRTSPConnectionEvent(Jzon::Node* params);
     bool addRTPConnectionEvent(Jzon::Node* params);
+    bool addSRTConnectionEvent(Jzon::Node* params);
+    bool addWebRTCConnectionEvent(Jzon::Node* params);
     
     bool specificReaderConfig(int readerID, FrameQueue* queue);
     bool specificReaderDelete(int readerID);
 
-    bool doProcessFrame(std::map<int, Frame*> &oFrames, std::vector<int> newFrames, int& ret);
+    bool doProcessFrame(FrameMap &oFrames, std::vector<int> &newFrames, int& ret);
+    void eventLoop();
+    std::unique_lock<std::mutex> lockEnvironment();
+    void flushPackets();
+    void getTargetBitrates(std::map<int, unsigned> &targets);
+    void publishTargetBitrates(std::map<int, unsigned> &targets);
     void stop();
 
     bool addSubsessionByReader(RTSPConnection* connection, int readerId);
@@ -122,8 +180,15 @@ private:
     std::map<int, Connection*> connections;
 
     RTSPServer* rtspServer;
+    WebRTCServer* webrtcServer;             //!< Started by the first WebRTC connection
     UsageEnvironment* env;
     BasicTaskScheduler0* scheduler;
+
+    std::thread loopThread;
+    std::mutex envMtx;
+    std::atomic<unsigned> envWaiters;
+    std::atomic<bool> stopLoop;
+    std::map<int, unsigned> publishedBitrates;      //!< Accessed by the event loop thread only
 };
 
 #endif
@@ -0,0 +1,383 @@
+/*
+ *  TSPacketizer.cpp - MPEG-TS packetizer writing PES packets in preallocated TS packets
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+
+#include "TSPacketizer.hh"
+
+#define TS_HEADER_SIZE 4
+#define TS_PAYLOAD_SIZE (TS_PACKET_SIZE - TS_HEADER_SIZE)
+#define PES_HEADER_SIZE 9
+#define PES_PTS_SIZE 5
+
+static const unsigned char h264AUD[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xF0};
+static const unsigned char h265AUD[] = {0x00, 0x00, 0x00, 0x01, 0x46, 0x01, 0x50};
+
+static bool isVideo(unsigned char streamType)
+{
+    return streamType == TS_STREAM_H264 || streamType == TS_STREAM_H265;
+}
+
+static uint32_t crc32(const unsigned char* data, unsigned size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    //NOTE: PSI are only built when the program changes, so the bitwise CRC is enough
+    for (unsigned i = 0; i < size; i++) {
+        crc ^= (uint32_t) data[i] << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+static void writeCRC(unsigned char* section, unsigned size)
+{
+    uint32_t crc = crc32(section, size);
+
+    section[size] = crc >> 24;
+    section[size + 1] = (crc >> 16) & 0xFF;
+    section[size + 2] = (crc >> 8) & 0xFF;
+    section[size + 3] = crc & 0xFF;
+}
+
+TSPacketizer::TSPacketizer() :
+    pcrStream(-1), psiCC(0), psiVersion(0), psiBuilt(false), psiSent(false), lastPSI(0), psiPackets(0),
+    written(0), consumed(0), writtenPackets(0)
+{
+    arena.resize(TS_ARENA_PACKETS*TS_PACKET_SIZE);
+}
+
+int TSPacketizer::addStream(unsigned char streamType)
+{
+    Stream stream;
+    unsigned sameKind = 0;
+
+    if (streamType != TS_STREAM_H264 && streamType != TS_STREAM_H265 &&
+        streamType != TS_STREAM_AAC && streamType != TS_STREAM_MP3) {
+        return -1;
+    }
+
+    if (streams.size() >= TS_MAX_STREAMS) {
+        return -1;
+    }
+
+    for (auto& s : streams) {
+        if (isVideo(s.streamType) == isVideo(streamType)) {
+            sameKind++;
+        }
+    }
+
+    stream.pid = TS_FIRST_ES_PID + streams.size();
+    stream.streamType = streamType;
+    stream.streamId = (isVideo(streamType) ? 0xE0 : 0xC0) + sameKind;
+    stream.cc = 0;
+    streams.push_back(stream);
+
+    if (pcrStream < 0 || (isVideo(streamType) && !isVideo(streams[pcrStream].streamType))) {
+        pcrStream = streams.size() - 1;
+    }
+
+    //NOTE: receivers only read a PMT again if its version changes
+    if (psiBuilt) {
+        psiBuilt = false;
+        psiVersion = (psiVersion + 1) & 0x1F;
+    }
+
+    return streams.size() - 1;
+}
+
+bool TSPacketizer::writeFrame(unsigned stream, const unsigned char* data, unsigned size, uint64_t pts,
+                              bool unitStart, bool randomAccess)
+{
+    Segment segments[3];
+    unsigned count = 0;
+    unsigned headerSize = PES_HEADER_SIZE + (unitStart ? PES_PTS_SIZE : 0);
+    unsigned pesSize;
+    unsigned payloadSize;
+    unsigned char header[PES_HEADER_SIZE + PES_PTS_SIZE];
+    Stream* s;
+
+    if (stream >= streams.size() || !data || size == 0) {
+        return false;
+    }
+
+    s = &streams[stream];
+    pts &= TS_PTS_MASK;
+
+    if (!psiBuilt) {
+        buildPSI();
+    }
+
+    //NOTE: the tables are not repeated if nothing has been written after them
+    if (!psiSent || (unitStart && writtenPackets != psiPackets && (randomAccess ||
+        ((int) stream == pcrStream && ((pts - lastPSI) & TS_PTS_MASK) >= TS_PSI_INTERVAL)))) {
+        writePSI();
+        lastPSI = pts;
+    }
+
+    segments[count++] = {header, headerSize};
+
+    if (unitStart && s->streamType == TS_STREAM_H264 && !(size > 4 && (data[4] & 0x1F) == 9)) {
+        segments[count++] = {h264AUD, sizeof(h264AUD)};
+    } else if (unitStart && s->streamType == TS_STREAM_H265 && !(size > 4 && ((data[4] >> 1) & 0x3F) == 35)) {
+        segments[count++] = {h265AUD, sizeof(h265AUD)};
+    }
+
+    segments[count++] = {data, size};
+
+    pesSize = 0;
+    for (unsigned i = 0; i < count; i++) {
+        pesSize += segments[i].size;
+    }
+
+    //NOTE: video PES packets may exceed the 16 bit length, so it is left unbounded
+    payloadSize = pesSize - 6;
+    if (isVideo(s->streamType) || payloadSize > 0xFFFF) {
+        payloadSize = 0;
+    }
+
+    header[0] = 0x00;
+    header[1] = 0x00;
+    header[2] = 0x01;
+    header[3] = s->streamId;
+    header[4] = payloadSize >> 8;
+    header[5] = payloadSize & 0xFF;
+    header[6] = 0x80;
+    header[7] = unitStart ? 0x80 : 0x00;
+    header[8] = unitStart ? PES_PTS_SIZE : 0;
+
+    if (unitStart) {
+        header[9] = 0x21 | ((pts >> 29) & 0x0E);
+        header[10] = (pts >> 22) & 0xFF;
+        header[11] = 0x01 | ((pts >> 14) & 0xFE);
+        header[12] = (pts >> 7) & 0xFF;
+        header[13] = 0x01 | ((pts << 1) & 0xFE);
+    }
+
+    writePES(*s, segments, count, pesSize, unitStart && (int) stream == pcrStream, pts, randomAccess);
+
+    return true;
+}
+
+void TSPacketizer::consume(unsigned packets)
+{
+    consumed += packets*TS_PACKET_SIZE;
+
+    if (consumed >= written) {
+        consumed = 0;
+        written = 0;
+    }
+}
+
+void TSPacketizer::buildPSI()
+{
+    unsigned char* section;
+    unsigned sectionLength;
+    uint16_t pcrPid = pcrStream >= 0 ? streams[pcrStream].pid : 0x1FFF;
+    unsigned i;
+
+    memset(pat, 0xFF, TS_PACKET_SIZE);
+    pat[0] = 0x47;
+    pat[1] = 0x40;
+    pat[2] = 0x00;
+    pat[3] = 0x10;
+    pat[4] = 0x00;
+
+    section = pat + 5;
+    sectionLength = 5 + 4 + 4;
+    section[0] = 0x00;
+    section[1] = 0xB0 | (sectionLength >> 8);
+    section[2] = sectionLength & 0xFF;
+    section[3] = 0x00;
+    section[4] = 0x01;
+    section[5] = 0xC1 | (psiVersion << 1);
+    section[6] = 0x00;
+    section[7] = 0x00;
+    section[8] = 0x00;
+    section[9] = 0x01;
+    section[10] = 0xE0 | (TS_PMT_PID >> 8);
+    section[11] = TS_PMT_PID & 0xFF;
+    writeCRC(section, 12);
+
+    memset(pmt, 0xFF, TS_PACKET_SIZE);
+    pmt[0] = 0x47;
+    pmt[1] = 0x40 | (TS_PMT_PID >> 8);
+    pmt[2] = TS_PMT_PID & 0xFF;
+    pmt[3] = 0x10;
+    pmt[4] = 0x00;
+
+    section = pmt + 5;
+    sectionLength = 9 + 5*streams.size() + 4;
+    section[0] = 0x02;
+    section[1] = 0xB0 | (sectionLength >> 8);
+    section[2] = sectionLength & 0xFF;
+    section[3] = 0x00;
+    section[4] = 0x01;
+    section[5] = 0xC1 | (psiVersion << 1);
+    section[6] = 0x00;
+    section[7] = 0x00;
+    section[8] = 0xE0 | (pcrPid >> 8);
+    section[9] = pcrPid & 0xFF;
+    section[10] = 0xF0;
+    section[11] = 0x00;
+
+    i = 12;
+    for (auto& stream : streams) {
+        section[i++] = stream.streamType;
+        section[i++] = 0xE0 | (stream.pid >> 8);
+        section[i++] = stream.pid & 0xFF;
+        section[i++] = 0xF0;
+        section[i++] = 0x00;
+    }
+    writeCRC(section, i);
+
+    psiBuilt = true;
+}
+
+void TSPacketizer::writePSI()
+{
+    unsigned char* packet;
+
+    packet = newPacket();
+    memcpy(packet, pat, TS_PACKET_SIZE);
+    packet[3] = 0x10 | psiCC;
+
+    packet = newPacket();
+    memcpy(packet, pmt, TS_PACKET_SIZE);
+    packet[3] = 0x10 | psiCC;
+
+    psiCC = (psiCC + 1) & 0x0F;
+    psiSent = true;
+    psiPackets = writtenPackets;
+}
+
+void TSPacketizer::writePES(Stream& stream, Segment* segments, unsigned count, unsigned size, bool pcr,
+                            uint64_t pts, bool randomAccess)
+{
+    unsigned char* packet;
+    unsigned char* payload;
+    unsigned adaptation;
+    unsigned char flags;
+    unsigned payloadSize;
+    unsigned chunk;
+    unsigned segment = 0;
+    unsigned offset = 0;
+    uint64_t pcrBase = (pts - TS_PCR_DELAY) & TS_PTS_MASK;
+    bool first = true;
+
+    while (size > 0) {
+        packet = newPacket();
+
+        adaptation = 0;
+        flags = 0;
+
+        if (first && (pcr || randomAccess)) {
+            flags = (randomAccess ? 0x40 : 0x00) | (pcr ? 0x10 : 0x00);
+            adaptation = 2 + (pcr ? 6 : 0);
+        }
+
+        //NOTE: the last packet of the PES is completed with adaptation field stuffing
+        payloadSize = TS_PAYLOAD_SIZE - adaptation;
+        if (size < payloadSize) {
+            adaptation += payloadSize - size;
+            payloadSize = size;
+        }
+
+        packet[0] = 0x47;
+        packet[1] = (first ? 0x40 : 0x00) | ((stream.pid >> 8) & 0x1F);
+        packet[2] = stream.pid & 0xFF;
+        packet[3] = (adaptation > 0 ? 0x30 : 0x10) | stream.cc;
+        stream.cc = (stream.cc + 1) & 0x0F;
+
+        payload = packet + TS_HEADER_SIZE;
+
+        if (adaptation > 0) {
+            payload[0] = adaptation - 1;
+
+            if (adaptation > 1) {
+                payload[1] = flags;
+                chunk = 2;
+
+                if (flags & 0x10) {
+                    payload[2] = pcrBase >> 25;
+                    payload[3] = (pcrBase >> 17) & 0xFF;
+                    payload[4] = (pcrBase >> 9) & 0xFF;
+                    payload[5] = (pcrBase >> 1) & 0xFF;
+                    payload[6] = ((pcrBase & 0x01) << 7) | 0x7E;
+                    payload[7] = 0x00;
+                    chunk += 6;
+                }
+
+                memset(payload + chunk, 0xFF, adaptation - chunk);
+            }
+
+            payload += adaptation;
+        }
+
+        size -= payloadSize;
+        first = false;
+
+        while (payloadSize > 0 && segment < count) {
+            chunk = segments[segment].size - offset;
+            if (chunk > payloadSize) {
+                chunk = payloadSize;
+            }
+
+            memcpy(payload, segments[segment].data + offset, chunk);
+            payload += chunk;
+            payloadSize -= chunk;
+            offset += chunk;
+
+            if (offset == segments[segment].size) {
+                segment++;
+                offset = 0;
+            }
+        }
+    }
+}
+
+unsigned char* TSPacketizer::newPacket()
+{
+    unsigned char* packet;
+
+    if (written + TS_PACKET_SIZE > arena.size()) {
+        //NOTE: pending packets are moved to the start before growing the arena
+        if (consumed > 0) {
+            memmove(arena.data(), arena.data() + consumed, written - consumed);
+            written -= consumed;
+            consumed = 0;
+        }
+
+        if (written + TS_PACKET_SIZE > arena.size()) {
+            arena.resize(arena.size()*2);
+        }
+    }
+
+    packet = arena.data() + written;
+    written += TS_PACKET_SIZE;
+    writtenPackets++;
+
+    return packet;
+}
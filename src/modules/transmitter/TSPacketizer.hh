@@ -0,0 +1,134 @@
+/*
+ *  TSPacketizer.hh - MPEG-TS packetizer writing PES packets in preallocated TS packets
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _TS_PACKETIZER_HH
+#define _TS_PACKETIZER_HH
+
+#include <vector>
+#include <stdint.h>
+
+#define TS_PACKET_SIZE 188
+#define TS_PACKETS_PER_DATAGRAM 7       //!< 1316 bytes, the usual TS over UDP/SRT payload
+#define TS_ARENA_PACKETS 1024           //!< Packets preallocated, the arena only grows for larger frames
+#define TS_MAX_STREAMS 8
+#define TS_PMT_PID 0x1000
+#define TS_FIRST_ES_PID 0x100
+#define TS_PSI_INTERVAL 9000            //!< Longest time between PAT/PMT in 90 kHz units (100 ms)
+#define TS_PCR_DELAY 9000               //!< PCR lag behind the PTS of the PCR stream in 90 kHz units
+#define TS_PTS_MASK 0x1FFFFFFFFULL      //!< PTS are 33 bits
+
+#define TS_STREAM_MP3 0x03
+#define TS_STREAM_AAC 0x0F              //!< AAC with ADTS headers
+#define TS_STREAM_H264 0x1B
+#define TS_STREAM_H265 0x24
+
+/*! Writes elementary stream frames as PES packets split in TS packets of a single program.
+    PAT and PMT packets are built once and only their continuity counter is updated when they are
+    repeated, before each random access point and at least every TS_PSI_INTERVAL. TS packets are
+    written in place in a preallocated arena and kept until they are consumed. The PCR goes in the
+    first packet of the PES packets of the first video stream, or of the first one if there is no video.
+*/
+class TSPacketizer {
+
+public:
+    /**
+    * Class constructor
+    */
+    TSPacketizer();
+
+    /**
+    * Adds an elementary stream to the program
+    * @param streamType PMT stream type (TS_STREAM_H264, TS_STREAM_H265, TS_STREAM_AAC or TS_STREAM_MP3)
+    * @return index of the stream, -1 if the stream type is not supported or there are too many streams
+    */
+    int addStream(unsigned char streamType);
+
+    /**
+    * Writes a frame, or a part of it, as a PES packet. Video access units start with an access
+    * unit delimiter, which is added when the frame starts a new one
+    * @param stream index returned by addStream
+    * @param data elementary stream data
+    * @param size data size in bytes
+    * @param pts presentation time stamp in 90 kHz units
+    * @param unitStart true if the data starts an access unit, only those PES packets carry a PTS
+    * @param randomAccess true if decoding can start with this data
+    * @return false if the stream does not exist
+    */
+    bool writeFrame(unsigned stream, const unsigned char* data, unsigned size, uint64_t pts,
+                    bool unitStart = true, bool randomAccess = false);
+
+    /**
+    * @return TS packets written and not consumed yet
+    */
+    unsigned getPendingPackets() const {return (written - consumed)/TS_PACKET_SIZE;};
+
+    /**
+    * @return first TS packet not consumed yet
+    */
+    const unsigned char* getPackets() const {return arena.data() + consumed;};
+
+    /**
+    * Releases the first pending TS packets
+    * @param packets number of packets
+    */
+    void consume(unsigned packets);
+
+    size_t getWrittenPackets() const {return writtenPackets;};
+
+private:
+    struct Stream {
+        uint16_t pid;
+        unsigned char streamType;
+        unsigned char streamId;
+        unsigned char cc;
+    };
+
+    struct Segment {
+        const unsigned char* data;
+        unsigned size;
+    };
+
+    void buildPSI();
+    void writePSI();
+    void writePES(Stream& stream, Segment* segments, unsigned count, unsigned size, bool pcr, uint64_t pts,
+                  bool randomAccess);
+    unsigned char* newPacket();
+
+    std::vector<Stream> streams;
+    int pcrStream;
+
+    unsigned char pat[TS_PACKET_SIZE];
+    unsigned char pmt[TS_PACKET_SIZE];
+    unsigned char psiCC;
+    unsigned char psiVersion;
+    bool psiBuilt;
+    bool psiSent;
+    uint64_t lastPSI;
+    size_t psiPackets;                  //!< Packets written when the tables were last written
+
+    std::vector<unsigned char> arena;
+    unsigned written;
+    unsigned consumed;
+    size_t writtenPackets;
+};
+
+#endif
@@ -24,6 +24,7 @@
 #include "UltraGridVideoRTPSink.hh"
 #include "H264VideoStreamSampler.hh"
 #include <cmath>
+#include <cstring>
 #include <iostream>
 
 #ifdef WORDS_BIGENDIAN
@@ -51,6 +52,7 @@ public:
 
 private: // redefined virtual functions:
   virtual void doGetNextFrame();
+  void setFrameHeader();
   void loadPayloadHeader(unsigned char* payload, uint32_t* header, int header_size);
   static void afterGettingFrame(void* clientData, unsigned frameSize,
         unsigned numTruncatedBytes,
@@ -206,9 +208,7 @@ UltraGridVideoFragmenter::~UltraGridVideoFragmenter() {
 }
 
 void UltraGridVideoFragmenter::doGetNextFrame() {
-  uint32_t fHeaderTmp;
-  unsigned int fpsd, fd, fps, fi;
-  unsigned numBytesToSend = 0;
+  unsigned numPayloadBytes;
 
   H264VideoStreamSampler* src = (H264VideoStreamSampler*) fInputSource;
   setSize(src->getWidth(), src->getHeight());
@@ -228,94 +228,79 @@ void UltraGridVideoFragmenter::doGetNextFrame() {
       fMaxSize = fMaxOutputPacketSize;
     }
 
-    fLastFragmentCompletedFrameUnit = True; 
-    if (fCurDataOffset == 0) { 
-    	//set UltraGrid video RTP payload header (6 words)
-    	/* word 4 */
-		fMainUltraGridHeader[3] = (fWidth << 16 | fHeight);
-
-		/* word 5 */
-		fMainUltraGridHeader[4] = htonl(to_fourcc('A', 'V', 'C', '1'));
-
-		/* word 6 */
-		fHeaderTmp = fInterlacing << 29;
-		fps = round(fFPS);
-		fpsd = 1;
-		if (fabs(fFPS - round(fFPS) / 1.001) < 0.005) {
-			fd = 1;
-		} else {
-			fd = 0;
-		}
-		fi = 0;
-
-		fHeaderTmp |= fps << 19;
-		fHeaderTmp |= fpsd << 15;
-		fHeaderTmp |= fd << 14;
-		fHeaderTmp |= fi << 13;
-		fMainUltraGridHeader[5] = fHeaderTmp;
-		fHeaderTmp = 0;
-
-		if (fNumValidDataBytes + UG_PAYLOAD_HEADER_SIZE <= fMaxSize) { // case 1
-		  numBytesToSend = fNumValidDataBytes + UG_PAYLOAD_HEADER_SIZE;
-		}
-		else {
-	  	  numBytesToSend = fMaxSize;
-		  fLastFragmentCompletedFrameUnit = False;
-		}
-
-		//set UltraGrid video RTP payload header (6 words)
-    	/* word 3 */
-		fMainUltraGridHeader[2] = fNumValidDataBytes;
+    if (fCurDataOffset == 0) {
+      setFrameHeader();
+    }
 
-		/* word 1 */
-		fHeaderTmp = fTileIDx << 22;
-		fHeaderTmp |= 0x3fffff & fBufferIDx;
-		fMainUltraGridHeader[0] = fHeaderTmp;
+    // Send as much of the remaining data as fits after the payload header.
+    // Set fLastFragmentCompletedFrameUnit = False if there are more packets to deliver yet.
+    numPayloadBytes = fNumValidDataBytes - fCurDataOffset;
+    fLastFragmentCompletedFrameUnit = True;
+
+    if (numPayloadBytes + UG_PAYLOAD_HEADER_SIZE > fMaxSize) {
+      numPayloadBytes = fMaxSize - UG_PAYLOAD_HEADER_SIZE;
+      fLastFragmentCompletedFrameUnit = False;
+    } else if (fCurDataOffset > 0) {
+      // This is the last fragment
+      fNumTruncatedBytes = fSaveNumTruncatedBytes;
+    }
 
-		/* word 2 */
-		fMainUltraGridHeader[1] = 0;
+    /* word 2 */
+    fMainUltraGridHeader[1] = fCurDataOffset;
 
-		loadPayloadHeader(fTo, fMainUltraGridHeader, UG_PAYLOAD_HEADER_SIZE);
+    //NOTE: the header is written in the space reserved at the start of the packet buffer, so the
+    //      payload of each fragment is copied once and the rest of the frame is not touched
+    loadPayloadHeader(fTo, fMainUltraGridHeader, UG_PAYLOAD_HEADER_SIZE);
+    memcpy(fTo + UG_PAYLOAD_HEADER_SIZE, fInputBuffer + fCurDataOffset, numPayloadBytes);
 
-		memmove(fTo + UG_PAYLOAD_HEADER_SIZE, fInputBuffer, fNumValidDataBytes + UG_PAYLOAD_HEADER_SIZE);
+    fFrameSize = numPayloadBytes + UG_PAYLOAD_HEADER_SIZE;
+    fCurDataOffset += numPayloadBytes;
 
-		fFrameSize = numBytesToSend;
-		fCurDataOffset += numBytesToSend -UG_PAYLOAD_HEADER_SIZE;
+    if (fCurDataOffset == fNumValidDataBytes) {
+      fNumValidDataBytes = 0;
+      fCurDataOffset = 0;
+      fBufferIDx++;
     }
-    else { // case 3
-		// We've already sent the first packet (fragment).  Now, send the next fragment.
-		// Set fLastFragmentCompletedFrameUnit = False if there are more packets to deliver yet.
-		numBytesToSend = UG_PAYLOAD_HEADER_SIZE
-				+ (fNumValidDataBytes - fCurDataOffset);
-		if (numBytesToSend > fMaxSize) {
-			// We can't send all of the remaining data this time:
-			numBytesToSend = fMaxSize;
-			fLastFragmentCompletedFrameUnit = False;
-		} else {
-			// This is the last fragment
-			fNumTruncatedBytes = fSaveNumTruncatedBytes;
-		}
 
-		//set UltraGrid video RTP payload header (6 words)
-  		/* word 2 */
-  		fMainUltraGridHeader[1] = fCurDataOffset;
+    FramedSource::afterGetting(this);
+  }
+}
 
-  		loadPayloadHeader(fTo, fMainUltraGridHeader, UG_PAYLOAD_HEADER_SIZE);
+void UltraGridVideoFragmenter::setFrameHeader() {
+  uint32_t fHeaderTmp;
+  unsigned int fpsd, fd, fps, fi;
 
-		memmove(fTo + UG_PAYLOAD_HEADER_SIZE, &fInputBuffer[fCurDataOffset], numBytesToSend - UG_PAYLOAD_HEADER_SIZE);
+  //set UltraGrid video RTP payload header (6 words), word 2 is the offset of each fragment
+  /* word 1 */
+  fHeaderTmp = fTileIDx << 22;
+  fHeaderTmp |= 0x3fffff & fBufferIDx;
+  fMainUltraGridHeader[0] = fHeaderTmp;
 
-		fFrameSize = numBytesToSend;
-		fCurDataOffset += numBytesToSend - UG_PAYLOAD_HEADER_SIZE;
-	}
+  /* word 3 */
+  fMainUltraGridHeader[2] = fNumValidDataBytes;
 
-	if (fCurDataOffset == fNumValidDataBytes) {
-		fNumValidDataBytes = 0;
-		fCurDataOffset = 0;
-		fBufferIDx++;
-	}
+  /* word 4 */
+  fMainUltraGridHeader[3] = (fWidth << 16 | fHeight);
 
-    FramedSource::afterGetting(this);
+  /* word 5 */
+  fMainUltraGridHeader[4] = htonl(to_fourcc('A', 'V', 'C', '1'));
+
+  /* word 6 */
+  fHeaderTmp = fInterlacing << 29;
+  fps = round(fFPS);
+  fpsd = 1;
+  if (fabs(fFPS - round(fFPS) / 1.001) < 0.005) {
+    fd = 1;
+  } else {
+    fd = 0;
   }
+  fi = 0;
+
+  fHeaderTmp |= fps << 19;
+  fHeaderTmp |= fpsd << 15;
+  fHeaderTmp |= fd << 14;
+  fHeaderTmp |= fi << 13;
+  fMainUltraGridHeader[5] = fHeaderTmp;
 }
 
 void UltraGridVideoFragmenter::loadPayloadHeader(unsigned char* payload, uint32_t* header, int header_size){
@@ -0,0 +1,229 @@
+/*
+ *  WebRTCPacketizer.cpp - RTP packetization of the WebRTC tracks
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <openssl/rand.h>
+
+#include "WebRTCPacketizer.hh"
+
+#define H264_NALU_TYPE_MASK 0x1F
+#define H264_FU_A 28
+#define H264_IDR 5
+#define H264_SPS 7
+#define H264_PPS 8
+#define FU_START 0x80
+#define FU_END 0x40
+
+#define VP8_START_OF_PARTITION 0x10
+#define VP8_INTER_FRAME 0x01
+
+WebRTCPacketizer::WebRTCPacketizer(WebRTCCodec codec_, uint32_t ssrc_) :
+    codec(codec_), ssrc(ssrc_), sequence(0), timestampBase(0), lastTimestamp(0), parameterSetsSent(false)
+{
+    clockRate = codec == WEBRTC_OPUS ? WEBRTC_AUDIO_CLOCK : WEBRTC_VIDEO_CLOCK;
+
+    //NOTE: random initial values (RFC 3550 5.1), a failure just leaves them predictable
+    RAND_bytes((unsigned char*) &sequence, sizeof(sequence));
+    RAND_bytes((unsigned char*) &timestampBase, sizeof(timestampBase));
+
+    lastTime.tv_sec = 0;
+    lastTime.tv_usec = 0;
+    lastKeyTime = lastTime;
+}
+
+void WebRTCPacketizer::setParameterSets(const unsigned char* sps_, unsigned spsSize,
+                                        const unsigned char* pps_, unsigned ppsSize)
+{
+    sps.assign(sps_, sps_ + spsSize);
+    pps.assign(pps_, pps_ + ppsSize);
+}
+
+std::string WebRTCPacketizer::getProfileLevelId() const
+{
+    char hex[7];
+
+    if (sps.size() < 4) {
+        return "";
+    }
+
+    snprintf(hex, sizeof(hex), "%02x%02x%02x", sps[1], sps[2], sps[3]);
+    return hex;
+}
+
+uint32_t WebRTCPacketizer::toTimestamp(struct timeval time) const
+{
+    uint64_t ticks = (uint64_t) time.tv_sec*clockRate + (uint64_t) time.tv_usec*clockRate/1000000;
+
+    return timestampBase + (uint32_t) ticks;
+}
+
+uint32_t WebRTCPacketizer::timestampAt(struct timeval time) const
+{
+    int64_t elapsed = (int64_t) (time.tv_sec - lastTime.tv_sec)*1000000 + (time.tv_usec - lastTime.tv_usec);
+
+    return lastTimestamp + (uint32_t) (elapsed*clockRate/1000000);
+}
+
+size_t WebRTCPacketizer::packetize(const unsigned char* frame, unsigned size, struct timeval presentationTime)
+{
+    uint8_t nalType;
+    bool newKeyframe;
+
+    data.clear();
+    packets.clear();
+
+    if (!frame || size == 0) {
+        return 0;
+    }
+
+    lastTimestamp = toTimestamp(presentationTime);
+    lastTime = presentationTime;
+
+    switch (codec) {
+        case WEBRTC_H264:
+            nalType = frame[0] & H264_NALU_TYPE_MASK;
+            newKeyframe = lastKeyTime.tv_sec != presentationTime.tv_sec ||
+                          lastKeyTime.tv_usec != presentationTime.tv_usec;
+
+            if (nalType == H264_SPS) {
+                parameterSetsSent = true;
+                lastKeyTime = presentationTime;
+                addPacket(NULL, 0, frame, size, false, true);
+                break;
+            }
+
+            //NOTE: a decoder can only start at an IDR picture preceded by its parameter sets
+            if (nalType == H264_IDR && !parameterSetsSent && newKeyframe) {
+                if (!sps.empty() && !pps.empty()) {
+                    addPacket(NULL, 0, sps.data(), sps.size(), false, true);
+                    addPacket(NULL, 0, pps.data(), pps.size(), false, false);
+                    packetizeH264(frame, size, true);
+                } else {
+                    packetizeH264(frame, size, true);
+                    packets.front().keyframe = true;
+                }
+                lastKeyTime = presentationTime;
+                break;
+            }
+
+            if (nalType == H264_IDR) {
+                parameterSetsSent = false;
+            }
+
+            //NOTE: as the live555 discrete framer does, each VCL NAL unit is taken as the end of its picture
+            packetizeH264(frame, size, nalType >= 1 && nalType <= H264_IDR);
+            break;
+        case WEBRTC_VP8:
+            packetizeVP8(frame, size);
+            break;
+        case WEBRTC_OPUS:
+            addPacket(NULL, 0, frame, size, false, true);
+            break;
+    }
+
+    return packets.size();
+}
+
+void WebRTCPacketizer::packetizeH264(const unsigned char* nal, unsigned size, bool marker)
+{
+    unsigned char fu[2];
+    unsigned offset = 1;
+    unsigned chunk;
+
+    if (size <= WEBRTC_MAX_PAYLOAD) {
+        addPacket(NULL, 0, nal, size, marker, false);
+        return;
+    }
+
+    //NOTE: FU-A indicator keeps F and NRI of the NAL header, the FU header carries its type
+    fu[0] = (nal[0] & 0xE0) | H264_FU_A;
+
+    while (offset < size) {
+        chunk = std::min(size - offset, (unsigned) WEBRTC_MAX_PAYLOAD - 2);
+        fu[1] = nal[0] & H264_NALU_TYPE_MASK;
+
+        if (offset == 1) {
+            fu[1] |= FU_START;
+        }
+
+        if (offset + chunk == size) {
+            fu[1] |= FU_END;
+        }
+
+        addPacket(fu, 2, nal + offset, chunk, marker && offset + chunk == size, false);
+        offset += chunk;
+    }
+}
+
+void WebRTCPacketizer::packetizeVP8(const unsigned char* frame, unsigned size)
+{
+    unsigned char descriptor;
+    unsigned offset = 0;
+    unsigned chunk;
+    bool keyframe = (frame[0] & VP8_INTER_FRAME) == 0;
+
+    while (offset < size) {
+        chunk = std::min(size - offset, (unsigned) WEBRTC_MAX_PAYLOAD - 1);
+        descriptor = offset == 0 ? VP8_START_OF_PARTITION : 0;
+
+        addPacket(&descriptor, 1, frame + offset, chunk, offset + chunk == size, keyframe && offset == 0);
+        offset += chunk;
+    }
+}
+
+void WebRTCPacketizer::addPacket(const unsigned char* header, unsigned headerSize, const unsigned char* payload,
+                                 unsigned size, bool marker, bool keyframe)
+{
+    WebRTCPacket packet;
+    unsigned char* rtp;
+
+    packet.offset = data.size();
+    packet.size = WEBRTC_RTP_HEADER + headerSize + size;
+    packet.keyframe = keyframe;
+
+    data.resize(packet.offset + packet.size);
+    rtp = data.data() + packet.offset;
+
+    //NOTE: the payload type is left to 0, it is set for each viewer
+    rtp[0] = 0x80;
+    rtp[1] = marker ? 0x80 : 0;
+    rtp[2] = sequence >> 8;
+    rtp[3] = sequence & 0xFF;
+    rtp[4] = lastTimestamp >> 24;
+    rtp[5] = (lastTimestamp >> 16) & 0xFF;
+    rtp[6] = (lastTimestamp >> 8) & 0xFF;
+    rtp[7] = lastTimestamp & 0xFF;
+    rtp[8] = ssrc >> 24;
+    rtp[9] = (ssrc >> 16) & 0xFF;
+    rtp[10] = (ssrc >> 8) & 0xFF;
+    rtp[11] = ssrc & 0xFF;
+
+    if (headerSize > 0) {
+        memcpy(rtp + WEBRTC_RTP_HEADER, header, headerSize);
+    }
+    memcpy(rtp + WEBRTC_RTP_HEADER + headerSize, payload, size);
+
+    packets.push_back(packet);
+    sequence++;
+}
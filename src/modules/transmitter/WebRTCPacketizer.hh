@@ -0,0 +1,123 @@
+/*
+ *  WebRTCPacketizer.hh - RTP packetization of the WebRTC tracks
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _WEBRTC_PACKETIZER_HH
+#define _WEBRTC_PACKETIZER_HH
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/time.h>
+
+#define WEBRTC_RTP_HEADER 12
+#define WEBRTC_MAX_PACKET 1200          //!< RTP packet size limit before SRTP, under any usual path MTU
+#define WEBRTC_MAX_PAYLOAD (WEBRTC_MAX_PACKET - WEBRTC_RTP_HEADER)
+#define WEBRTC_VIDEO_CLOCK 90000
+#define WEBRTC_AUDIO_CLOCK 48000        //!< Opus RTP clock, whatever the sampling rate is (RFC 7587)
+
+enum WebRTCCodec {WEBRTC_H264, WEBRTC_VP8, WEBRTC_OPUS};
+
+/*! RTP packet of the shared packetization of a track */
+struct WebRTCPacket {
+    size_t offset;                      //!< Position in the packetizer buffer
+    unsigned size;
+    bool keyframe;                      //!< First packet of a frame from which a new viewer can decode
+};
+
+/*! RTP packetizer of a WebRTC track, each frame is packetized once and the packets are encrypted for
+    each viewer. H264 NAL units are sent as single NAL unit packets or FU-A fragments (RFC 6184,
+    packetization-mode=1), VP8 frames with the payload descriptor of RFC 7741 and Opus packets as they
+    are (RFC 7587). The payload type is negotiated by each viewer, it is set when the packets are sent.
+*/
+class WebRTCPacketizer {
+
+public:
+    /**
+    * @param codec track codec
+    * @param ssrc track SSRC, shared by all the viewers
+    */
+    WebRTCPacketizer(WebRTCCodec codec, uint32_t ssrc);
+
+    /**
+    * Packetizes a frame, the previous packets are discarded
+    * @param data H264 NAL unit without start code, VP8 frame or Opus packet
+    * @param size frame size
+    * @param presentationTime frame presentation time
+    * @return number of packets of the frame
+    */
+    size_t packetize(const unsigned char* data, unsigned size, struct timeval presentationTime);
+
+    /**
+    * Parameter sets sent before the IDR NAL units which are not preceded by them in band
+    */
+    void setParameterSets(const unsigned char* sps, unsigned spsSize, const unsigned char* pps, unsigned ppsSize);
+
+    /**
+    * @return "PPCCLL" hex profile-level-id of the parameter sets, empty if they are not known
+    */
+    std::string getProfileLevelId() const;
+
+    const std::vector<WebRTCPacket>& getPackets() const {return packets;};
+    unsigned char* getPacketData(const WebRTCPacket &packet) {return data.data() + packet.offset;};
+
+    WebRTCCodec getCodec() const {return codec;};
+    uint32_t getSSRC() const {return ssrc;};
+    unsigned getClockRate() const {return clockRate;};
+    bool isVideo() const {return codec != WEBRTC_OPUS;};
+
+    /**
+    * @return RTP timestamp of the last packetized frame
+    */
+    uint32_t getLastTimestamp() const {return lastTimestamp;};
+
+    /**
+    * @return RTP timestamp of a wallclock time, extrapolated from the last frame
+    */
+    uint32_t timestampAt(struct timeval time) const;
+
+    uint16_t getNextSequence() const {return sequence;};
+
+private:
+    void packetizeH264(const unsigned char* nal, unsigned size, bool marker);
+    void packetizeVP8(const unsigned char* frame, unsigned size);
+    void addPacket(const unsigned char* header, unsigned headerSize, const unsigned char* payload,
+                   unsigned size, bool marker, bool keyframe);
+    uint32_t toTimestamp(struct timeval time) const;
+
+    WebRTCCodec codec;
+    uint32_t ssrc;
+    unsigned clockRate;
+    uint16_t sequence;
+    uint32_t timestampBase;
+    uint32_t lastTimestamp;
+    struct timeval lastTime;
+    struct timeval lastKeyTime;         //!< Presentation time of the last picture sent with parameter sets
+
+    std::vector<unsigned char> sps;
+    std::vector<unsigned char> pps;
+    bool parameterSetsSent;             //!< SPS and PPS went in band since the last IDR
+
+    std::vector<unsigned char> data;
+    std::vector<WebRTCPacket> packets;
+};
+
+#endif
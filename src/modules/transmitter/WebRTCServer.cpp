@@ -0,0 +1,1012 @@
+/*
+ *  WebRTCServer.cpp - WHEP signalling and media transport of the WebRTC viewers
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <cstdio>
+#include <sstream>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <openssl/rand.h>
+
+#include "WebRTCServer.hh"
+#include "IceLite.hh"
+#include "../../Utils.hh"
+
+#define SLOT_SIZE (WEBRTC_MAX_PACKET + SRTP_MAX_OVERHEAD)
+#define MEDIA_READ_BURST 64             //!< Datagrams read per readable event, so the event loop is not starved
+#define UFRAG_LENGTH 8
+#define PWD_LENGTH 24
+#define RTCP_SR 200
+#define RTCP_SDES 202
+#define RTCP_SDES_CNAME 1
+#define NTP_EPOCH_OFFSET 2208988800U    //!< Seconds from 1900 to 1970
+
+#define CORS_HEADERS "Access-Control-Allow-Origin: *\r\n" \
+                     "Access-Control-Allow-Methods: POST, DELETE, OPTIONS\r\n" \
+                     "Access-Control-Allow-Headers: Content-Type, Authorization, If-Match\r\n" \
+                     "Access-Control-Expose-Headers: Location\r\n"
+
+///////////////////////////
+// SDP NEGOTIATION       //
+///////////////////////////
+
+struct OfferMedia {
+    OfferMedia() : port(0), rtcpMux(false) {};
+
+    std::string type;
+    std::string proto;
+    std::string formats;
+    unsigned port;
+    std::string mid;
+    std::string direction;
+    std::vector<int> payloadTypes;
+    std::map<int, std::string> rtpmaps;
+    std::map<int, std::string> fmtps;
+    bool rtcpMux;
+};
+
+struct Offer {
+    std::string ufrag;
+    std::string pwd;
+    std::string fingerprint;
+    std::string setup;
+    bool bundle;
+    std::vector<OfferMedia> media;
+};
+
+static bool startsWith(const std::string &line, const char* prefix)
+{
+    return line.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static bool parseOffer(std::string sdp, Offer &offer)
+{
+    std::istringstream lines(sdp);
+    std::string line;
+    OfferMedia* media = NULL;
+    int pt;
+
+    offer.bundle = false;
+
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+
+        if (startsWith(line, "m=")) {
+            std::istringstream fields(line.substr(2));
+            offer.media.push_back(OfferMedia());
+            media = &offer.media.back();
+
+            fields >> media->type >> media->port >> media->proto;
+            while (fields >> pt) {
+                media->payloadTypes.push_back(pt);
+                media->formats += " " + std::to_string(pt);
+            }
+        } else if (startsWith(line, "a=ice-ufrag:") && offer.ufrag.empty()) {
+            offer.ufrag = line.substr(12);
+        } else if (startsWith(line, "a=ice-pwd:") && offer.pwd.empty()) {
+            offer.pwd = line.substr(10);
+        } else if (startsWith(line, "a=fingerprint:") && offer.fingerprint.empty()) {
+            if (strncasecmp(line.c_str() + 14, "sha-256 ", 8) == 0) {
+                offer.fingerprint = line.substr(22);
+            }
+        } else if (startsWith(line, "a=setup:") && offer.setup.empty()) {
+            offer.setup = line.substr(8);
+        } else if (startsWith(line, "a=group:BUNDLE")) {
+            offer.bundle = true;
+        } else if (!media) {
+            continue;
+        } else if (startsWith(line, "a=mid:")) {
+            media->mid = line.substr(6);
+        } else if (startsWith(line, "a=rtcp-mux")) {
+            media->rtcpMux = true;
+        } else if (line == "a=sendrecv" || line == "a=recvonly" || line == "a=sendonly" || line == "a=inactive") {
+            media->direction = line.substr(2);
+        } else if (startsWith(line, "a=rtpmap:")) {
+            pt = atoi(line.c_str() + 9);
+            media->rtpmaps[pt] = line.substr(line.find(' ') + 1);
+        } else if (startsWith(line, "a=fmtp:")) {
+            pt = atoi(line.c_str() + 7);
+            media->fmtps[pt] = line.substr(line.find(' ') + 1);
+        }
+    }
+
+    return !offer.ufrag.empty() && !offer.pwd.empty() && !offer.fingerprint.empty() && !offer.media.empty();
+}
+
+//NOTE: H264 needs packetization-mode=1 (FU-A), the payload type of the profile of the stream is preferred
+static int selectPayloadType(const OfferMedia &media, WebRTCPacketizer* track)
+{
+    const char* encoding;
+    std::string profile = track->getProfileLevelId().substr(0, 4);
+    int selected = -1;
+
+    switch (track->getCodec()) {
+        case WEBRTC_H264:
+            encoding = "H264/90000";
+            break;
+        case WEBRTC_VP8:
+            encoding = "VP8/90000";
+            break;
+        default:
+            encoding = "opus/48000/2";
+            break;
+    }
+
+    for (auto pt : media.payloadTypes) {
+        auto rtpmap = media.rtpmaps.find(pt);
+        auto fmtp = media.fmtps.find(pt);
+        std::string parameters = fmtp != media.fmtps.end() ? fmtp->second : "";
+
+        if (rtpmap == media.rtpmaps.end() || strcasecmp(rtpmap->second.c_str(), encoding) != 0) {
+            continue;
+        }
+
+        if (track->getCodec() != WEBRTC_H264) {
+            return pt;
+        }
+
+        if (parameters.find("packetization-mode=1") == std::string::npos) {
+            continue;
+        }
+
+        std::transform(parameters.begin(), parameters.end(), parameters.begin(), ::tolower);
+        if (!profile.empty() && parameters.find("profile-level-id=" + profile) != std::string::npos) {
+            return pt;
+        }
+
+        if (selected < 0) {
+            selected = pt;
+        }
+    }
+
+    return selected;
+}
+
+static std::string randomHex(unsigned bytes)
+{
+    std::vector<unsigned char> random(bytes);
+    std::string hex;
+    char digits[3];
+
+    RAND_bytes(random.data(), bytes);
+
+    for (auto r : random) {
+        snprintf(digits, sizeof(digits), "%02x", r);
+        hex += digits;
+    }
+
+    return hex;
+}
+
+static uint64_t addressKey(const struct sockaddr_in &address)
+{
+    return ((uint64_t) address.sin_addr.s_addr << 16) | address.sin_port;
+}
+
+static std::string addressString(const struct sockaddr_in &address)
+{
+    char ip[INET_ADDRSTRLEN];
+
+    if (!inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip))) {
+        return "";
+    }
+
+    return std::string(ip) + ":" + std::to_string(ntohs(address.sin_port));
+}
+
+static void writeU32(unsigned char* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static std::string httpResponse(std::string status, std::string headers = "", std::string body = "")
+{
+    return "HTTP/1.1 " + status + "\r\n" + CORS_HEADERS + headers +
+           "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+           "Connection: close\r\n\r\n" + body;
+}
+
+///////////////////////////
+// WEBRTC SERVER         //
+///////////////////////////
+
+WebRTCServer* WebRTCServer::createNew(UsageEnvironment* env, std::string ip, unsigned whepPort, unsigned mediaPort)
+{
+    WebRTCServer* server;
+
+    if (!DTLSCertificate::getInstance()->getContext()) {
+        utils::errorMsg("Error creating WebRTC server. DTLS certificate not available");
+        return NULL;
+    }
+
+    server = new WebRTCServer(env, ip, whepPort, mediaPort);
+
+    if (!server->open()) {
+        delete server;
+        return NULL;
+    }
+
+    return server;
+}
+
+WebRTCServer::WebRTCServer(UsageEnvironment* env, std::string ip, unsigned whepPort, unsigned mediaPort) :
+    fEnv(env), fIp(ip), fWhepPort(whepPort), fMediaPort(mediaPort), httpSock(-1), mediaSock(-1),
+    checkToken(NULL), batchSize(0)
+{
+    batchData.resize(WEBRTC_BATCH_PACKETS*SLOT_SIZE);
+    batchHeaders.resize(WEBRTC_BATCH_PACKETS);
+    batchVectors.resize(WEBRTC_BATCH_PACKETS);
+    batchSessions.resize(WEBRTC_BATCH_PACKETS);
+}
+
+WebRTCServer::~WebRTCServer()
+{
+    while (!sessionsByUfrag.empty()) {
+        closeSession(sessionsByUfrag.begin()->second);
+    }
+
+    while (!clients.empty()) {
+        closeClient(clients.begin()->first);
+    }
+
+    fEnv->taskScheduler().unscheduleDelayedTask(checkToken);
+
+    if (httpSock >= 0) {
+        fEnv->taskScheduler().disableBackgroundHandling(httpSock);
+        close(httpSock);
+    }
+
+    if (mediaSock >= 0) {
+        fEnv->taskScheduler().disableBackgroundHandling(mediaSock);
+        close(mediaSock);
+    }
+}
+
+bool WebRTCServer::open()
+{
+    struct sockaddr_in address;
+    int reuse = 1;
+    int buffer = WEBRTC_SOCKET_BUFFER;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (!fIp.empty() && inet_pton(AF_INET, fIp.c_str(), &address.sin_addr) != 1) {
+        utils::errorMsg("WebRTC address is not valid: " + fIp);
+        return false;
+    }
+
+    httpSock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    address.sin_port = htons(fWhepPort);
+    setsockopt(httpSock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if (httpSock < 0 || bind(httpSock, (struct sockaddr*) &address, sizeof(address)) < 0 ||
+        listen(httpSock, SOMAXCONN) < 0) {
+        utils::errorMsg("Error creating WebRTC server. WHEP port " + std::to_string(fWhepPort) +
+                        " could not be opened: " + strerror(errno));
+        return false;
+    }
+
+    mediaSock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    address.sin_port = htons(fMediaPort);
+
+    if (mediaSock < 0 || bind(mediaSock, (struct sockaddr*) &address, sizeof(address)) < 0) {
+        utils::errorMsg("Error creating WebRTC server. Media port " + std::to_string(fMediaPort) +
+                        " could not be opened: " + strerror(errno));
+        return false;
+    }
+
+    //NOTE: the kernel may cap it to net.core.wmem_max, which just means more drops on bursts
+    setsockopt(mediaSock, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+
+    fEnv->taskScheduler().setBackgroundHandling(httpSock, SOCKET_READABLE, incomingConnectionHandler, this);
+    fEnv->taskScheduler().setBackgroundHandling(mediaSock, SOCKET_READABLE, mediaHandler, this);
+    checkToken = fEnv->taskScheduler().scheduleDelayedTask(WEBRTC_CHECK_INTERVAL*1000, checkTask, this);
+
+    return true;
+}
+
+bool WebRTCServer::addStream(std::string name, WebRTCPacketizer* video, WebRTCPacketizer* audio)
+{
+    Stream stream;
+
+    if (name.empty() || name.find('/') != std::string::npos || streams.count(name) > 0) {
+        utils::errorMsg("WebRTC stream name not valid or already in use: " + name);
+        return false;
+    }
+
+    stream.video = video;
+    stream.audio = audio;
+    streams[name] = stream;
+    return true;
+}
+
+void WebRTCServer::removeStream(std::string name)
+{
+    if (streams.count(name) == 0) {
+        return;
+    }
+
+    while (!streams[name].sessions.empty()) {
+        closeSession(streams[name].sessions.back());
+    }
+
+    streams.erase(name);
+}
+
+std::vector<WebRTCViewerStats> WebRTCServer::getViewers(std::string name)
+{
+    std::vector<WebRTCViewerStats> viewers;
+    WebRTCViewerStats stats;
+
+    if (streams.count(name) == 0) {
+        return viewers;
+    }
+
+    for (auto session : streams[name].sessions) {
+        stats.id = session->id;
+        stats.address = session->hasAddress ? addressString(session->address) : "";
+        stats.connected = session->dtls.isConnected();
+        stats.sentPackets = session->sentPackets;
+        stats.sentBytes = session->sentBytes;
+        stats.droppedPackets = session->droppedPackets;
+        viewers.push_back(stats);
+    }
+
+    return viewers;
+}
+
+///////////////////////////
+// WHEP SIGNALLING       //
+///////////////////////////
+
+void WebRTCServer::incomingConnectionHandler(void* clientData, int /*mask*/)
+{
+    ((WebRTCServer*) clientData)->acceptConnection();
+}
+
+void WebRTCServer::httpRequestHandler(void* clientData, int /*mask*/)
+{
+    HttpClient* client = (HttpClient*) clientData;
+
+    client->server->readRequest(client->fd);
+}
+
+void WebRTCServer::acceptConnection()
+{
+    HttpClient* client;
+    socklen_t length;
+    int fd;
+
+    while ((fd = accept4(httpSock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        client = new HttpClient();
+        client->server = this;
+        client->fd = fd;
+        client->accepted = std::chrono::steady_clock::now();
+
+        length = sizeof(client->local);
+        if (getsockname(fd, (struct sockaddr*) &client->local, &length) < 0) {
+            memset(&client->local, 0, sizeof(client->local));
+        }
+
+        clients[fd] = client;
+        fEnv->taskScheduler().setBackgroundHandling(fd, SOCKET_READABLE, httpRequestHandler, client);
+    }
+}
+
+void WebRTCServer::closeClient(int fd)
+{
+    if (clients.count(fd) == 0) {
+        return;
+    }
+
+    fEnv->taskScheduler().disableBackgroundHandling(fd);
+    close(fd);
+    delete clients[fd];
+    clients.erase(fd);
+}
+
+void WebRTCServer::readRequest(int fd)
+{
+    HttpClient* client = clients[fd];
+    char buffer[4096];
+    std::string response;
+    size_t headerEnd;
+    size_t contentLength = 0;
+    size_t header;
+    ssize_t ret;
+
+    while ((ret = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        client->request.append(buffer, ret);
+    }
+
+    if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        closeClient(fd);
+        return;
+    }
+
+    if (client->request.size() > WEBRTC_HTTP_MAX_REQUEST) {
+        response = httpResponse("413 Payload Too Large");
+    } else if ((headerEnd = client->request.find("\r\n\r\n")) == std::string::npos) {
+        return;
+    } else {
+        std::string headers = client->request.substr(0, headerEnd);
+        std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+
+        if ((header = headers.find("\r\ncontent-length:")) != std::string::npos) {
+            contentLength = strtoul(headers.c_str() + header + 17, NULL, 10);
+        }
+
+        if (client->request.size() < headerEnd + 4 + contentLength) {
+            return;
+        }
+
+        response = handleRequest(*client);
+    }
+
+    //NOTE: responses are small enough for the socket buffer, the connection is closed right after
+    if (send(fd, response.data(), response.size(), MSG_NOSIGNAL) < (ssize_t) response.size()) {
+        utils::warningMsg("WHEP response could not be sent completely");
+    }
+
+    closeClient(fd);
+}
+
+std::string WebRTCServer::handleRequest(HttpClient &client)
+{
+    std::istringstream requestLine(client.request.substr(0, client.request.find("\r\n")));
+    size_t headerEnd = client.request.find("\r\n\r\n");
+    std::string headers = client.request.substr(0, headerEnd);
+    std::string method;
+    std::string target;
+    std::string name;
+    std::string id;
+    std::string location;
+    std::string answer;
+    std::string ip = fIp;
+    char localIp[INET_ADDRSTRLEN];
+    size_t separator;
+
+    requestLine >> method >> target;
+    target = target.substr(0, target.find('?'));
+
+    if (method == "OPTIONS") {
+        return httpResponse("204 No Content", "Accept-Post: application/sdp\r\n");
+    }
+
+    if (!startsWith(target, "/whep/")) {
+        return httpResponse("404 Not Found");
+    }
+
+    name = target.substr(6);
+    if ((separator = name.find('/')) != std::string::npos) {
+        id = name.substr(separator + 1);
+        name = name.substr(0, separator);
+    }
+
+    if (streams.count(name) == 0) {
+        return httpResponse("404 Not Found");
+    }
+
+    if (id.empty()) {
+        if (method != "POST") {
+            return httpResponse("405 Method Not Allowed", "Allow: POST, OPTIONS\r\n");
+        }
+
+        std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+        if (headers.find("\r\ncontent-type: application/sdp") == std::string::npos) {
+            return httpResponse("415 Unsupported Media Type");
+        }
+
+        //NOTE: without a configured address the candidate is the one the viewer reached the server at
+        if (ip.empty() && inet_ntop(AF_INET, &client.local.sin_addr, localIp, sizeof(localIp))) {
+            ip = localIp;
+        }
+
+        answer = createSession(name, client.request.substr(headerEnd + 4), ip, location);
+
+        if (answer.empty()) {
+            return httpResponse("400 Bad Request");
+        }
+
+        return httpResponse("201 Created", "Content-Type: application/sdp\r\nLocation: " + location + "\r\n", answer);
+    }
+
+    if (method == "DELETE") {
+        for (auto session : streams[name].sessions) {
+            if (session->id == id) {
+                closeSession(session);
+                return httpResponse("200 OK");
+            }
+        }
+        return httpResponse("404 Not Found");
+    }
+
+    //NOTE: trickle ICE and ICE restarts are not supported, the server has a single host candidate
+    return httpResponse("405 Method Not Allowed", "Allow: DELETE, OPTIONS\r\n");
+}
+
+std::string WebRTCServer::createSession(std::string name, std::string sdp, std::string ip, std::string &location)
+{
+    Stream &stream = streams[name];
+    Offer offer;
+    Session* session;
+    std::ostringstream answer;
+    std::ostringstream media;
+    std::vector<std::string> bundle;
+    bool videoTaken = false;
+    bool audioTaken = false;
+
+    if (!parseOffer(sdp, offer)) {
+        utils::warningMsg("WHEP offer with no ICE credentials, DTLS fingerprint or media");
+        return "";
+    }
+
+    if (offer.setup == "passive") {
+        utils::warningMsg("WHEP offer with setup:passive, the server is always the DTLS server");
+        return "";
+    }
+
+    session = new Session(offer.fingerprint);
+    session->id = randomHex(8);
+    session->stream = name;
+    session->localUfrag = IceLite::randomCredential(UFRAG_LENGTH);
+    session->localPwd = IceLite::randomCredential(PWD_LENGTH);
+    session->cname = randomHex(8);
+    session->lastCheck = session->lastReport = std::chrono::steady_clock::now();
+
+    for (auto &m : offer.media) {
+        WebRTCPacketizer* track = NULL;
+        SessionTrack* sessionTrack = NULL;
+        int pt = -1;
+
+        if (m.type == "video" && !videoTaken) {
+            track = stream.video;
+            sessionTrack = &session->video;
+        } else if (m.type == "audio" && !audioTaken) {
+            track = stream.audio;
+            sessionTrack = &session->audio;
+        }
+
+        //NOTE: without BUNDLE a single media can be carried by the single candidate
+        if (track && m.rtcpMux && m.port > 0 && (m.direction.empty() || m.direction == "recvonly" ||
+            m.direction == "sendrecv") && (offer.bundle || bundle.empty())) {
+            pt = selectPayloadType(m, track);
+        }
+
+        if (pt < 0) {
+            media << "m=" << m.type << " 0 " << m.proto << m.formats << "\r\n"
+                  << "c=IN IP4 0.0.0.0\r\n";
+            if (!m.mid.empty()) {
+                media << "a=mid:" << m.mid << "\r\n";
+            }
+            media << "a=inactive\r\n";
+            continue;
+        }
+
+        sessionTrack->payloadType = pt;
+        videoTaken = videoTaken || track == stream.video;
+        audioTaken = audioTaken || track == stream.audio;
+        bundle.push_back(m.mid);
+
+        media << "m=" << m.type << " " << fMediaPort << " " << m.proto << " " << pt << "\r\n"
+              << "c=IN IP4 " << ip << "\r\n";
+        if (!m.mid.empty()) {
+            media << "a=mid:" << m.mid << "\r\n";
+        }
+        media << "a=ice-ufrag:" << session->localUfrag << "\r\n"
+              << "a=ice-pwd:" << session->localPwd << "\r\n"
+              << "a=fingerprint:sha-256 " << DTLSCertificate::getInstance()->getFingerprint() << "\r\n"
+              << "a=setup:passive\r\n"
+              << "a=rtcp-mux\r\n"
+              << "a=sendonly\r\n"
+              << "a=rtpmap:" << pt << " " << m.rtpmaps[pt] << "\r\n";
+        if (m.fmtps.count(pt) > 0) {
+            media << "a=fmtp:" << pt << " " << m.fmtps[pt] << "\r\n";
+        }
+        media << "a=msid:" << name << " " << m.type << "\r\n"
+              << "a=ssrc:" << track->getSSRC() << " cname:" << session->cname << "\r\n"
+              << "a=candidate:1 1 UDP 2130706431 " << ip << " " << fMediaPort << " typ host\r\n"
+              << "a=end-of-candidates\r\n";
+    }
+
+    if (bundle.empty()) {
+        utils::warningMsg("WHEP offer without any media of stream " + name);
+        delete session;
+        return "";
+    }
+
+    answer << "v=0\r\n"
+           << "o=- " << session->id.substr(0, 8) << " 2 IN IP4 " << ip << "\r\n"
+           << "s=liveMediaStreamer\r\n"
+           << "t=0 0\r\n"
+           << "a=ice-lite\r\n";
+    if (offer.bundle) {
+        answer << "a=group:BUNDLE";
+        for (auto mid : bundle) {
+            answer << " " << mid;
+        }
+        answer << "\r\n";
+    }
+    answer << "a=msid-semantic: WMS " << name << "\r\n" << media.str();
+
+    stream.sessions.push_back(session);
+    sessionsByUfrag[session->localUfrag] = session;
+    location = "/whep/" + name + "/" + session->id;
+
+    utils::infoMsg("WebRTC viewer " + session->id + " of stream " + name + " negotiated");
+    return answer.str();
+}
+
+///////////////////////////
+// MEDIA TRANSPORT       //
+///////////////////////////
+
+void WebRTCServer::mediaHandler(void* clientData, int /*mask*/)
+{
+    ((WebRTCServer*) clientData)->readMedia();
+}
+
+void WebRTCServer::readMedia()
+{
+    unsigned char buffer[2048];
+    struct sockaddr_in from;
+    socklen_t length;
+    ssize_t size;
+
+    for (unsigned i = 0; i < MEDIA_READ_BURST; i++) {
+        length = sizeof(from);
+        size = recvfrom(mediaSock, buffer, sizeof(buffer), 0, (struct sockaddr*) &from, &length);
+
+        if (size <= 0) {
+            break;
+        }
+
+        //NOTE: RFC 7983, first byte 0-3 is STUN, 20-63 DTLS and 128-191 RTP/RTCP. Viewer RTCP (receiver
+        //      reports, NACK, PLI) is not handled, viewers start at the next keyframe
+        if (buffer[0] <= 3) {
+            handleStun(buffer, size, from);
+        } else if (buffer[0] >= 20 && buffer[0] <= 63) {
+            auto session = sessionsByAddress.find(addressKey(from));
+            if (session != sessionsByAddress.end()) {
+                handleDtls(session->second, buffer, size);
+            }
+        }
+    }
+}
+
+void WebRTCServer::handleStun(const unsigned char* data, unsigned size, const struct sockaddr_in &from)
+{
+    StunRequest request;
+    std::vector<unsigned char> response;
+    Session* session;
+    size_t separator;
+
+    if (!IceLite::parseBindingRequest(data, size, request)) {
+        return;
+    }
+
+    separator = request.username.find(':');
+    auto found = sessionsByUfrag.find(request.username.substr(0, separator));
+
+    if (found == sessionsByUfrag.end()) {
+        return;
+    }
+
+    session = found->second;
+
+    if (!IceLite::checkIntegrity(data, size, session->localPwd)) {
+        return;
+    }
+
+    IceLite::buildBindingResponse(request, from, session->localPwd, response);
+    sendto(mediaSock, response.data(), response.size(), 0, (const struct sockaddr*) &from, sizeof(from));
+
+    session->lastCheck = std::chrono::steady_clock::now();
+
+    //NOTE: the first valid check gives the address, a nominated pair replaces it
+    if (session->hasAddress && (addressKey(session->address) == addressKey(from) || !request.useCandidate)) {
+        return;
+    }
+
+    releaseAddress(session);
+    session->address = from;
+    session->hasAddress = true;
+    sessionsByAddress[addressKey(from)] = session;
+}
+
+void WebRTCServer::handleDtls(Session* session, const unsigned char* data, unsigned size)
+{
+    bool wasConnected = session->dtls.isConnected();
+
+    session->dtls.receive(data, size);
+    sendDatagrams(session, session->dtls.takeOutgoing());
+
+    if (session->dtls.hasFailed()) {
+        utils::warningMsg("WebRTC viewer " + session->id + " DTLS failed, closing it");
+        closeSession(session);
+        return;
+    }
+
+    if (!wasConnected && session->dtls.isConnected()) {
+        utils::infoMsg("WebRTC viewer " + session->id + " connected from " + addressString(session->address));
+    }
+}
+
+void WebRTCServer::sendDatagrams(Session* session, const std::vector<std::string> &datagrams)
+{
+    if (!session->hasAddress) {
+        return;
+    }
+
+    for (auto &datagram : datagrams) {
+        sendto(mediaSock, datagram.data(), datagram.size(), 0, (const struct sockaddr*) &session->address,
+               sizeof(session->address));
+    }
+}
+
+void WebRTCServer::sendPackets(std::string name, WebRTCPacketizer* track)
+{
+    auto stream = streams.find(name);
+    const std::vector<WebRTCPacket> &packets = track->getPackets();
+    SessionTrack* sessionTrack;
+    SRTPContext* srtp;
+    unsigned char* slot;
+    unsigned size;
+    size_t first;
+
+    if (stream == streams.end() || packets.empty()) {
+        return;
+    }
+
+    for (auto session : stream->second.sessions) {
+        sessionTrack = track == stream->second.video ? &session->video : &session->audio;
+        srtp = session->dtls.getSRTP();
+
+        if (!srtp || sessionTrack->payloadType < 0) {
+            continue;
+        }
+
+        first = 0;
+        if (!sessionTrack->started) {
+            while (first < packets.size() && !packets[first].keyframe) {
+                first++;
+            }
+
+            if (first == packets.size()) {
+                continue;
+            }
+
+            sessionTrack->started = true;
+        }
+
+        //NOTE: the packets are shared, each viewer gets its own copy with its payload type and encryption
+        for (size_t i = first; i < packets.size(); i++) {
+            slot = batchData.data() + batchSize*SLOT_SIZE;
+            size = packets[i].size;
+
+            memcpy(slot, track->getPacketData(packets[i]), size);
+            slot[1] = (slot[1] & 0x80) | sessionTrack->payloadType;
+
+            if (!srtp->protectRtp(slot, size)) {
+                continue;
+            }
+
+            sessionTrack->packets++;
+            sessionTrack->octets += packets[i].size - WEBRTC_RTP_HEADER;
+            queuePacket(session, slot, size);
+        }
+    }
+
+    flush();
+}
+
+void WebRTCServer::sendReports(Session* session, std::chrono::steady_clock::time_point now)
+{
+    Stream &stream = streams[session->stream];
+    SRTPContext* srtp = session->dtls.getSRTP();
+    WebRTCPacketizer* tracks[2] = {stream.video, stream.audio};
+    SessionTrack* sessionTracks[2] = {&session->video, &session->audio};
+    struct timeval wallclock;
+    unsigned char* slot;
+    unsigned size;
+    unsigned cnameSize = std::min(session->cname.size(), (size_t) 255);
+    unsigned sdesSize = (8 + 2 + cnameSize + 1 + 3) & ~3;
+
+    session->lastReport = now;
+    gettimeofday(&wallclock, NULL);
+
+    for (unsigned i = 0; i < 2; i++) {
+        if (!srtp || !tracks[i] || !sessionTracks[i]->started) {
+            continue;
+        }
+
+        slot = batchData.data() + batchSize*SLOT_SIZE;
+        memset(slot, 0, 28 + sdesSize);
+
+        slot[0] = 0x80;
+        slot[1] = RTCP_SR;
+        slot[3] = 6;
+        writeU32(slot + 4, tracks[i]->getSSRC());
+        writeU32(slot + 8, wallclock.tv_sec + NTP_EPOCH_OFFSET);
+        writeU32(slot + 12, (uint32_t) (((uint64_t) wallclock.tv_usec << 32)/1000000));
+        writeU32(slot + 16, tracks[i]->timestampAt(wallclock));
+        writeU32(slot + 20, sessionTracks[i]->packets);
+        writeU32(slot + 24, sessionTracks[i]->octets);
+
+        slot[28] = 0x81;
+        slot[29] = RTCP_SDES;
+        slot[31] = sdesSize/4 - 1;
+        writeU32(slot + 32, tracks[i]->getSSRC());
+        slot[36] = RTCP_SDES_CNAME;
+        slot[37] = cnameSize;
+        memcpy(slot + 38, session->cname.data(), cnameSize);
+
+        size = 28 + sdesSize;
+        if (srtp->protectRtcp(slot, size)) {
+            queuePacket(session, slot, size);
+        }
+    }
+
+    flush();
+}
+
+void WebRTCServer::queuePacket(Session* session, unsigned char* packet, unsigned size)
+{
+    struct mmsghdr &header = batchHeaders[batchSize];
+
+    batchVectors[batchSize].iov_base = packet;
+    batchVectors[batchSize].iov_len = size;
+
+    memset(&header, 0, sizeof(header));
+    header.msg_hdr.msg_name = &session->address;
+    header.msg_hdr.msg_namelen = sizeof(session->address);
+    header.msg_hdr.msg_iov = &batchVectors[batchSize];
+    header.msg_hdr.msg_iovlen = 1;
+
+    batchSessions[batchSize] = session;
+
+    if (++batchSize == WEBRTC_BATCH_PACKETS) {
+        flush();
+    }
+}
+
+void WebRTCServer::flush()
+{
+    unsigned sent = 0;
+    int ret;
+
+    while (sent < batchSize) {
+        ret = sendmmsg(mediaSock, batchHeaders.data() + sent, batchSize - sent, 0);
+
+        if (ret > 0) {
+            for (int i = 0; i < ret; i++) {
+                batchSessions[sent + i]->sentPackets++;
+                batchSessions[sent + i]->sentBytes += batchVectors[sent + i].iov_len;
+            }
+            sent += ret;
+            continue;
+        }
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        //NOTE: a full socket buffer drops the rest of the batch, other errors (e.g. an unreachable
+        //      viewer) only drop the packet they failed at
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+            for (; sent < batchSize; sent++) {
+                batchSessions[sent]->droppedPackets++;
+            }
+            break;
+        }
+
+        batchSessions[sent++]->droppedPackets++;
+    }
+
+    batchSize = 0;
+}
+
+///////////////////////////
+// SESSION CHECKS        //
+///////////////////////////
+
+void WebRTCServer::checkTask(void* clientData)
+{
+    WebRTCServer* server = (WebRTCServer*) clientData;
+
+    server->check();
+    server->checkToken = server->fEnv->taskScheduler().scheduleDelayedTask(WEBRTC_CHECK_INTERVAL*1000,
+                                                                          checkTask, server);
+}
+
+void WebRTCServer::check()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::vector<Session*> expired;
+    std::vector<int> stale;
+
+    for (auto it : clients) {
+        if (now - it.second->accepted > std::chrono::seconds(WEBRTC_HTTP_TIMEOUT)) {
+            stale.push_back(it.first);
+        }
+    }
+
+    for (auto fd : stale) {
+        closeClient(fd);
+    }
+
+    for (auto it : sessionsByUfrag) {
+        Session* session = it.second;
+
+        if (!session->dtls.handleTimeout() || now - session->lastCheck > std::chrono::seconds(WEBRTC_SESSION_TIMEOUT)) {
+            expired.push_back(session);
+            continue;
+        }
+
+        sendDatagrams(session, session->dtls.takeOutgoing());
+
+        if (session->dtls.isConnected() &&
+            now - session->lastReport >= std::chrono::milliseconds(WEBRTC_REPORT_INTERVAL)) {
+            sendReports(session, now);
+        }
+    }
+
+    for (auto session : expired) {
+        utils::infoMsg("WebRTC viewer " + session->id + " timed out");
+        closeSession(session);
+    }
+}
+
+void WebRTCServer::releaseAddress(Session* session)
+{
+    //NOTE: another session may have taken the address since, e.g. a viewer reconnecting from the same port
+    auto owner = session->hasAddress ? sessionsByAddress.find(addressKey(session->address)) : sessionsByAddress.end();
+
+    if (owner != sessionsByAddress.end() && owner->second == session) {
+        sessionsByAddress.erase(owner);
+    }
+}
+
+void WebRTCServer::closeSession(Session* session)
+{
+    auto stream = streams.find(session->stream);
+
+    if (stream != streams.end()) {
+        std::vector<Session*> &sessions = stream->second.sessions;
+        sessions.erase(std::remove(sessions.begin(), sessions.end(), session), sessions.end());
+    }
+
+    releaseAddress(session);
+    sessionsByUfrag.erase(session->localUfrag);
+    delete session;
+}
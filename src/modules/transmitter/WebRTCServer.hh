@@ -0,0 +1,206 @@
+/*
+ *  WebRTCServer.hh - WHEP signalling and media transport of the WebRTC viewers
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _WEBRTC_SERVER_HH
+#define _WEBRTC_SERVER_HH
+
+#include <map>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <liveMedia.hh>
+
+#include "WebRTCPacketizer.hh"
+#include "DTLSTransport.hh"
+#include "SRTPContext.hh"
+
+#define WEBRTC_WHEP_PORT 8889               //!< Default WHEP signalling port
+#define WEBRTC_MEDIA_PORT 8189              //!< Default UDP port shared by all the viewers
+#define WEBRTC_CHECK_INTERVAL 100           //!< Time in msec between DTLS retransmissions and session checks
+#define WEBRTC_REPORT_INTERVAL 1000         //!< Time in msec between the sender reports of a viewer
+#define WEBRTC_SESSION_TIMEOUT 30           //!< Time in sec without connectivity checks before a viewer is closed
+#define WEBRTC_HTTP_TIMEOUT 10              //!< Time in sec to receive a whole WHEP request
+#define WEBRTC_HTTP_MAX_REQUEST 65536       //!< Largest WHEP request accepted
+#define WEBRTC_BATCH_PACKETS 64             //!< Packets sent by a single sendmmsg call
+#define WEBRTC_SOCKET_BUFFER 4*1024*1024    //!< Send buffer of the media socket, which carries every viewer
+
+/*! Statistics of a WebRTC viewer */
+struct WebRTCViewerStats {
+    std::string id;
+    std::string address;
+    bool connected;                     //!< DTLS is done and media is being sent
+    size_t sentPackets;
+    size_t sentBytes;
+    size_t droppedPackets;              //!< Packets not sent because the socket buffer was full
+};
+
+/*! WebRTC egress server shared by the WebRTC connections of a SinkManager. Viewers negotiate a stream
+    with WHEP (a POST of their SDP offer to /whep/<name>, answered with the SDP answer and the
+    resource of the session, which is closed by a DELETE). The server is an ICE-lite agent with a
+    single host candidate, so all the viewers share one UDP socket, demultiplexed by RFC 7983: STUN
+    checks find the session by their username, DTLS and RTCP by the address the checks came from.
+    Media is packetized once per track and each packet is encrypted with the SRTP keys of each viewer.
+    Everything runs on the live555 event loop.
+*/
+class WebRTCServer {
+
+public:
+    /**
+    * Creates the server and opens its sockets
+    * @param env live555 environment
+    * @param ip address of the host candidate, empty to use the one each WHEP request was received at
+    * @param whepPort TCP port of the WHEP signalling
+    * @param mediaPort UDP port of the media
+    * @return the server, NULL if the sockets cannot be opened
+    */
+    static WebRTCServer* createNew(UsageEnvironment* env, std::string ip, unsigned whepPort, unsigned mediaPort);
+
+    /**
+    * Closes all the sessions and the sockets
+    */
+    ~WebRTCServer();
+
+    /**
+    * Publishes a stream at /whep/<name>
+    * @param video packetizer of the video track, NULL if none
+    * @param audio packetizer of the audio track, NULL if none
+    * @return false if the name is already in use
+    */
+    bool addStream(std::string name, WebRTCPacketizer* video, WebRTCPacketizer* audio);
+
+    /**
+    * Unpublishes a stream and closes its viewers
+    */
+    void removeStream(std::string name);
+
+    /**
+    * Sends the last packetized frame of a track to the viewers of the stream
+    */
+    void sendPackets(std::string name, WebRTCPacketizer* track);
+
+    /**
+    * @return the statistics of each viewer of the stream
+    */
+    std::vector<WebRTCViewerStats> getViewers(std::string name);
+
+    size_t getStreamsNumber() const {return streams.size();};
+
+    std::string getIP() const {return fIp;};
+    unsigned getWhepPort() const {return fWhepPort;};
+    unsigned getMediaPort() const {return fMediaPort;};
+
+private:
+    /*! Negotiated track of a viewer */
+    struct SessionTrack {
+        SessionTrack() : payloadType(-1), started(false), packets(0), octets(0) {};
+
+        int payloadType;                //!< -1 if the track was not accepted
+        bool started;                   //!< A keyframe was sent, so the viewer can decode what follows
+        uint32_t packets;               //!< Sender report counters
+        uint32_t octets;
+    };
+
+    struct Session {
+        Session(std::string fingerprint) : dtls(fingerprint), hasAddress(false), sentPackets(0),
+                                           sentBytes(0), droppedPackets(0) {};
+
+        std::string id;
+        std::string stream;
+        std::string localUfrag;
+        std::string localPwd;
+        std::string cname;
+        DTLSTransport dtls;
+        struct sockaddr_in address;
+        bool hasAddress;
+        SessionTrack video;
+        SessionTrack audio;
+        std::chrono::steady_clock::time_point lastCheck;
+        std::chrono::steady_clock::time_point lastReport;
+        size_t sentPackets;
+        size_t sentBytes;
+        size_t droppedPackets;
+    };
+
+    struct Stream {
+        WebRTCPacketizer* video;
+        WebRTCPacketizer* audio;
+        std::vector<Session*> sessions;
+    };
+
+    struct HttpClient {
+        WebRTCServer* server;
+        int fd;
+        std::string request;
+        struct sockaddr_in local;       //!< Address the request was received at
+        std::chrono::steady_clock::time_point accepted;
+    };
+
+    WebRTCServer(UsageEnvironment* env, std::string ip, unsigned whepPort, unsigned mediaPort);
+
+    bool open();
+
+    static void incomingConnectionHandler(void* clientData, int mask);
+    static void httpRequestHandler(void* clientData, int mask);
+    static void mediaHandler(void* clientData, int mask);
+    static void checkTask(void* clientData);
+
+    void acceptConnection();
+    void readRequest(int fd);
+    void closeClient(int fd);
+    std::string handleRequest(HttpClient &client);
+    std::string createSession(std::string name, std::string offer, std::string ip, std::string &location);
+
+    void readMedia();
+    void handleStun(const unsigned char* data, unsigned size, const struct sockaddr_in &from);
+    void handleDtls(Session* session, const unsigned char* data, unsigned size);
+    void sendDatagrams(Session* session, const std::vector<std::string> &datagrams);
+    void sendReports(Session* session, std::chrono::steady_clock::time_point now);
+    void check();
+    void releaseAddress(Session* session);
+    void closeSession(Session* session);
+
+    void queuePacket(Session* session, unsigned char* packet, unsigned size);
+    void flush();
+
+    UsageEnvironment* fEnv;
+    std::string fIp;
+    unsigned fWhepPort;
+    unsigned fMediaPort;
+    int httpSock;
+    int mediaSock;
+    TaskToken checkToken;
+
+    std::map<std::string, Stream> streams;
+    std::map<std::string, Session*> sessionsByUfrag;
+    std::map<uint64_t, Session*> sessionsByAddress;
+    std::map<int, HttpClient*> clients;
+
+    std::vector<unsigned char> batchData;       //!< Protected packets waiting for sendmmsg
+    std::vector<struct mmsghdr> batchHeaders;
+    std::vector<struct iovec> batchVectors;
+    std::vector<Session*> batchSessions;
+    unsigned batchSize;
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ *  WebRTCSink.cpp - live555 sink feeding a track of the WebRTC viewers
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <openssl/rand.h>
+
+#include "WebRTCSink.hh"
+
+static uint32_t randomSSRC()
+{
+    uint32_t ssrc = 0;
+
+    RAND_bytes((unsigned char*) &ssrc, sizeof(ssrc));
+    return ssrc;
+}
+
+WebRTCSink* WebRTCSink::createNew(UsageEnvironment& env, WebRTCServer* server, std::string name,
+                                  WebRTCCodec codec, H264or5QueueSource* parameterSets)
+{
+    if (!server) {
+        return NULL;
+    }
+
+    return new WebRTCSink(env, server, name, codec, parameterSets);
+}
+
+WebRTCSink::WebRTCSink(UsageEnvironment& env, WebRTCServer* server, std::string name,
+                       WebRTCCodec codec, H264or5QueueSource* parameterSets) :
+    MediaSink(env), fServer(server), fName(name), packetizer(codec, randomSSRC()),
+    fParameterSets(parameterSets), lastSPS(NULL), fetching(false), fetchAgain(false)
+{
+    buffer.resize(codec == WEBRTC_OPUS ? WEBRTC_AUDIO_BUFFER : WEBRTC_VIDEO_BUFFER);
+    updateParameterSets();
+}
+
+WebRTCSink::~WebRTCSink()
+{
+}
+
+Boolean WebRTCSink::continuePlaying()
+{
+    getNextFrame();
+    return True;
+}
+
+//NOTE: as in SRTSink, looping here avoids nesting a call per frame when the source delivers right away
+void WebRTCSink::getNextFrame()
+{
+    if (fetching) {
+        fetchAgain = true;
+        return;
+    }
+
+    fetching = true;
+
+    do {
+        fetchAgain = false;
+
+        if (!fSource) {
+            break;
+        }
+
+        fSource->getNextFrame(buffer.data(), buffer.size(), afterGettingFrame, this, onSourceClosure, this);
+    } while (fetchAgain);
+
+    fetching = false;
+}
+
+void WebRTCSink::afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
+                                   struct timeval presentationTime, unsigned /*durationInMicroseconds*/)
+{
+    WebRTCSink* sink = (WebRTCSink*) clientData;
+
+    //NOTE: a truncated frame cannot be decoded, it is dropped and the viewers recover at the next one
+    if (numTruncatedBytes == 0) {
+        sink->sendFrame(frameSize, presentationTime);
+    }
+
+    sink->getNextFrame();
+}
+
+void WebRTCSink::sendFrame(unsigned size, struct timeval presentationTime)
+{
+    updateParameterSets();
+
+    if (packetizer.packetize(buffer.data(), size, presentationTime) > 0) {
+        fServer->sendPackets(fName, &packetizer);
+    }
+}
+
+void WebRTCSink::updateParameterSets()
+{
+    if (!fParameterSets || !fParameterSets->parseExtradata() || fParameterSets->getSPS() == lastSPS) {
+        return;
+    }
+
+    lastSPS = fParameterSets->getSPS();
+    packetizer.setParameterSets(fParameterSets->getSPS(), fParameterSets->getSPSSize(),
+                                fParameterSets->getPPS(), fParameterSets->getPPSSize());
+}
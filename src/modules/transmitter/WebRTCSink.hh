@@ -0,0 +1,83 @@
+/*
+ *  WebRTCSink.hh - live555 sink feeding a track of the WebRTC viewers
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _WEBRTC_SINK_HH
+#define _WEBRTC_SINK_HH
+
+#include <string>
+#include <vector>
+#include <liveMedia.hh>
+
+#include "WebRTCPacketizer.hh"
+#include "WebRTCServer.hh"
+#include "H264or5QueueSource.hh"
+
+#define WEBRTC_VIDEO_BUFFER 2*1024*1024     //!< Largest H264 NAL unit or VP8 frame
+#define WEBRTC_AUDIO_BUFFER 4096            //!< Largest Opus packet
+
+/*! live555 sink which packetizes the frames of a coded stream replica once and hands the packets over
+    to the WebRTC server, which sends them to every viewer of the stream. Frames are not transcoded,
+    so the stream must be H264, VP8 or Opus.
+*/
+class WebRTCSink : public MediaSink {
+
+public:
+    /**
+    * @param env live555 environment
+    * @param server server sending the packets
+    * @param name stream the track belongs to
+    * @param codec track codec
+    * @param parameterSets H264 source whose extradata parameter sets are sent before the IDR pictures
+    *        lacking them, NULL if none
+    */
+    static WebRTCSink* createNew(UsageEnvironment& env, WebRTCServer* server, std::string name,
+                                 WebRTCCodec codec, H264or5QueueSource* parameterSets = NULL);
+
+    WebRTCPacketizer* getPacketizer() {return &packetizer;};
+
+protected:
+    WebRTCSink(UsageEnvironment& env, WebRTCServer* server, std::string name,
+               WebRTCCodec codec, H264or5QueueSource* parameterSets);
+    virtual ~WebRTCSink();
+
+    Boolean continuePlaying();
+
+private:
+    void getNextFrame();
+    void sendFrame(unsigned size, struct timeval presentationTime);
+    void updateParameterSets();
+
+    static void afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
+                                  struct timeval presentationTime, unsigned durationInMicroseconds);
+
+    WebRTCServer* fServer;
+    std::string fName;
+    WebRTCPacketizer packetizer;
+    H264or5QueueSource* fParameterSets;
+    uint8_t const* lastSPS;
+
+    std::vector<unsigned char> buffer;
+    bool fetching;
+    bool fetchAgain;
+};
+
+#endif
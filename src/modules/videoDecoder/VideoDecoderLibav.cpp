@@ -23,11 +23,20 @@
 
 #include "VideoDecoderLibav.hh"
 #include "../../AVFramedQueue.hh"
+#include "../../HardwareVideoFrame.hh"
 #include "../../Utils.hh"
+#include "../../AsyncLog.hh"
+#include "../../ThreadBudget.hh"
 
 PixType getPixelFormat(AVPixelFormat format);
 
-VideoDecoderLibav::VideoDecoderLibav() : OneToOneFilter()
+//NOTE: one reference per device type is kept while any decoder uses it
+static std::map<AVHWDeviceType, AVBufferRef*> sharedDevices;
+static std::mutex devicesMutex;
+int getThreadType(std::string threadType);
+std::string getThreadTypeAsString(int threadType);
+
+VideoDecoderLibav::VideoDecoderLibav() : OneToOneFilterT()
 {
     avcodec_register_all();
     codecCtx = NULL;;
@@ -39,24 +48,68 @@ VideoDecoderLibav::VideoDecoderLibav() : OneToOneFilter()
 
     outputStreamInfo = new StreamInfo (VIDEO);
     outputStreamInfo->video.codec = RAW;
-    outputStreamInfo->video.pixelFormat = RGB24;
+    //NOTE: decoders output YUV420P for most streams, planar frames get it without repacking
+    outputStreamInfo->video.pixelFormat = YUV420P;
 
     frame = av_frame_alloc();
     frameCopy = av_frame_alloc();
+    hwDownload = av_frame_alloc();
+    hwUpload = av_frame_alloc();
+    
+    hwDeviceCtx = NULL;
+    hwType = AV_HWDEVICE_TYPE_NONE;
+    hwDownloadOnly = false;
+    hwPixFmt = AV_PIX_FMT_NONE;
+    uploadFramesCtx = NULL;
     
     psi.inputWidth = 0;
     psi.inputHeight = 0;
+    psi.inputFormat = AV_PIX_FMT_NONE;
+    skippedFrames = 0;
+    
+    loadShedding = false;
+    shedLevel = 0;
+    shedHold = 0;
+    lastKeyFrame = false;
+    shedFrames = 0;
+    
+    previewDecode = false;
+    previewLevel = 0;
+    codedWidth = 0;
+    codedHeight = 0;
+    
+    bufferPool = NULL;
+    poolBufferSize = 0;
+    
+    threadType = FF_THREAD_SLICE;
+    threadCount = 0;
+    packetCount = 0;
+    drained = false;
 
     psi.fCodec = VC_NONE;
+    
+    ThreadBudget::getInstance()->join(this, threadCount);
+    initializeEventMap();
 }
 
 VideoDecoderLibav::~VideoDecoderLibav()
 {
+    ThreadBudget::getInstance()->leave(this);
+    if (codecCtx) {
+        av_buffer_unref(&codecCtx->hw_device_ctx);
+    }
     avcodec_close(codecCtx);
     av_free(codecCtx);
     av_free(frame);
     av_free(frameCopy);
+    av_frame_free(&hwDownload);
+    av_frame_free(&hwUpload);
+    av_buffer_unref(&uploadFramesCtx);
+    releaseSharedDevice(&hwDeviceCtx, hwType);
     av_packet_unref(&pkt);
+    flushPending();
+    //NOTE: buffers still referenced by queued frames are freed when they are released
+    av_buffer_pool_uninit(&bufferPool);
 
     delete outputStreamInfo;
 }
@@ -67,51 +120,405 @@ FrameQueue* VideoDecoderLibav::allocQueue(ConnectionData cData)
     return VideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_RAW_VIDEO_FRAMES);
 }
 
-bool VideoDecoderLibav::doProcessFrame(Frame *org, Frame *dst)
+bool VideoDecoderLibav::doProcessFrame(VideoFrame *org, VideoFrame *dst)
 {
-    int len, gotFrame = 0;
-    VideoFrame* vDecodedFrame = dynamic_cast<VideoFrame*>(dst);
-    VideoFrame* vCodedFrame = dynamic_cast<VideoFrame*>(org);
+    int ret;
+    bool keep;
+    PacketInfo *info;
+    std::shared_ptr<Writer> writer = getWriter(DEFAULT_ID);
+    
+    drained = false;
+    
+    if (!reconfigure(org->getCodec())){
+        return false;
+    }
+    
+    if (writer && writer->getQueue()) {
+        scheduler.setFrameTime(writer->getQueue()->getReaderFrameTime());
+    }
     
-    if (!reconfigure(vCodedFrame->getCodec())){
+    //NOTE: the reader takes the same decisions from the same timestamps, reference frames 
+    //      are still decoded because the following frames need them
+    keep = scheduler.keep(org->getPresentationTime());
+    codecCtx->skip_frame = std::max(keep ? AVDISCARD_DEFAULT : AVDISCARD_NONREF, shedDiscard());
+    
+    if (!setPreview(org)) {
+        return false;
+    }
+    
+    //NOTE: empty packets would flush the decoder
+    if (org->getLength() == 0) {
         return false;
     }
        
     pkt.size = org->getLength();
     pkt.data = org->getDataBuf();
-   
-    while (pkt.size > 0) {
-        len = avcodec_decode_video2(codecCtx, frame, &gotFrame, &pkt);
+    pkt.pts = org->getPresentationTime().count();
+    
+    //NOTE: libav passes reordered_opaque to the frame decoded from the packet, also across frame threads
+    info = &packets[packetCount % DECODER_PACKET_HISTORY];
+    info->pts = org->getPresentationTime();
+    info->originTime = org->getOriginTime();
+    info->sequenceNumber = org->getSequenceNumber();
+    info->sideData = org->getSideData();
+    codecCtx->reordered_opaque = packetCount++;
+    
+    ret = avcodec_send_packet(codecCtx, &pkt);
+    
+    //NOTE: the decoder does not take more packets until its decoded frames are received
+    if (ret == AVERROR(EAGAIN) && receiveFrames(DECODER_MAX_PENDING)) {
+        ret = avcodec_send_packet(codecCtx, &pkt);
+    }
+    
+    if (ret < 0 || !receiveFrames(DECODER_MAX_PENDING)) {
+        ERROR_MSG("Decoding video frame, reconfiguring decoder");
+        flushPending();
+        inputConfig();
+        return false;
+    }
+    
+    if (pending.empty()) {
+        if (!keep) {
+            skippedFrames++;
+        } else if (shedLevel > 0) {
+            shedFrames++;
+        }
+        return false;
+    }
+    
+    return passPending(dst, org);
+}
+
+//NOTE: the input has ended, the delayed frames are passed one per call
+bool VideoDecoderLibav::drainFrame(VideoFrame *dst)
+{
+    if (!drained) {
+        drain();
+        drained = true;
+    }
+    
+    if (pending.empty()) {
+        return false;
+    }
+    
+    passPending(dst, NULL);
+    
+    return true;
+}
+
+void VideoDecoderLibav::exportSideData(VideoFrame *dst, AVFrame *decoded)
+{
+    AVFrameSideData *sd;
+    
+    //NOTE: metadata parsed from the bitstream replaces the one of the container
+    if ((sd = av_frame_get_side_data(decoded, AV_FRAME_DATA_A53_CC))) {
+        dst->getSideData().set(SD_CAPTIONS, sd->data, sd->size);
+    }
+    
+    if ((sd = av_frame_get_side_data(decoded, AV_FRAME_DATA_S12M_TIMECODE))) {
+        dst->getSideData().set(SD_TIMECODE, sd->data, sd->size);
+    }
+    
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(56, 59, 100)
+    for (int i = 0; i < decoded->nb_side_data; i++) {
+        sd = decoded->side_data[i];
+        if (sd->type == AV_FRAME_DATA_SEI_UNREGISTERED) {
+            dst->getSideData().add(SD_SEI, sd->data, sd->size);
+        }
+    }
+#endif
+}
+
+bool VideoDecoderLibav::passPending(VideoFrame *dst, VideoFrame *org)
+{
+    AVFrame *decoded;
+    PacketInfo *info;
+    int64_t packetId;
+    
+    decoded = pending.front();
+    pending.pop_front();
+    lastKeyFrame = decoded->key_frame;
+    
+    //NOTE: a new picture size or format is signalled in band, readers reconfigure at this frame and
+    //      the queue frames are fitted to it, so there is no need to reconnect
+    if (psi.inputWidth > 0 && ((int) psi.inputWidth != decoded->width || 
+        (int) psi.inputHeight != decoded->height || psi.inputFormat != decoded->format)) {
+        outputStreamInfo->changeFormat();
+        utils::infoMsg("[VideoDecoderLibav] Decoded format changed to " + std::to_string(decoded->width) + 
+                       "x" + std::to_string(decoded->height));
+    }
+    psi.inputFormat = decoded->format;
+    
+    if (!toSurface(dst, decoded)) {
+        av_frame_free(&decoded);
+        return false;
+    }
+    
+    dst->setConsumed(true);
+    dst->setFormatVersion(outputStreamInfo->getFormatVersion());
+    dst->setFieldOrder(!decoded->interlaced_frame ? FO_PROGRESSIVE : 
+                       decoded->top_field_first ? FO_TOP_FIRST : FO_BOTTOM_FIRST);
+    
+    //NOTE: decoded frames come from an earlier packet than the processed one when frames are reordered or 
+    //      decoded by frame threads
+    packetId = decoded->reordered_opaque;
+    if (packetId >= 0 && packetId < packetCount && packetCount - packetId <= DECODER_PACKET_HISTORY) {
+        info = &packets[packetId % DECODER_PACKET_HISTORY];
+        dst->setPresentationTime(info->pts);
+        dst->setOriginTime(info->originTime);
+        dst->setSequenceNumber(info->sequenceNumber);
+        dst->getSideData() = info->sideData;
+    } else {
+        if (decoded->best_effort_timestamp != AV_NOPTS_VALUE) {
+            dst->setPresentationTime(std::chrono::microseconds(decoded->best_effort_timestamp));
+        } else if (org) {
+            dst->setPresentationTime(org->getPresentationTime());
+        }
+        if (org) {
+            dst->setOriginTime(org->getOriginTime());
+            dst->setSequenceNumber(org->getSequenceNumber());
+            dst->getSideData() = org->getSideData();
+        }
+    }
+    
+    dst->setDecodeTime(dst->getPresentationTime());
+    exportSideData(dst, decoded);
+    
+    av_frame_free(&decoded);
+    
+    return true;
+}
+
+//NOTE: levels change one step at a time and are kept at least DECODER_SHED_HOLD packets. Decoding the 
+//      non key frames again only starts after a key frame, so their references have been decoded
+AVDiscard VideoDecoderLibav::shedDiscard()
+{
+    static const AVDiscard levels[] = {AVDISCARD_DEFAULT, AVDISCARD_NONREF, AVDISCARD_NONKEY};
+    std::shared_ptr<Writer> writer = getWriter(DEFAULT_ID);
+    AVFramedQueue *queue = writer ? dynamic_cast<AVFramedQueue*>(writer->getQueue()) : NULL;
+    float fill;
+    
+    if (!loadShedding || !queue) {
+        shedLevel = 0;
+        return AVDISCARD_DEFAULT;
+    }
+    
+    fill = (float) queue->getElements() / (queue->getMaxFrames() - 1);
+    
+    if (shedHold > 0) {
+        shedHold--;
+    } else if (fill >= DECODER_SHED_HIGH && shedLevel < 2) {
+        shedLevel++;
+        shedHold = DECODER_SHED_HOLD;
+    } else if (fill <= DECODER_SHED_LOW && shedLevel > 0 && (shedLevel < 2 || lastKeyFrame)) {
+        shedLevel--;
+        shedHold = DECODER_SHED_HOLD;
+    }
+    
+    return levels[shedLevel];
+}
+
+//NOTE: level L decodes pictures of 1/2^L the coded size, the largest one still covering the reader picture size
+int VideoDecoderLibav::previewScale()
+{
+    std::shared_ptr<Writer> writer = getWriter(DEFAULT_ID);
+    unsigned width, height;
+    int level = 0;
+    
+    if (codecCtx->coded_width > 0 && codecCtx->coded_height > 0) {
+        codedWidth = codecCtx->coded_width;
+        codedHeight = codecCtx->coded_height;
+    }
+    
+    if (!previewDecode || !writer || !writer->getQueue() || codedWidth == 0 || codedHeight == 0) {
+        return 0;
+    }
+    
+    writer->getQueue()->getReaderPictureSize(width, height);
+    
+    if (width == 0 || height == 0) {
+        return 0;
+    }
+    
+    while (level < DECODER_MAX_PREVIEW && (codedWidth >> (level + 1)) >= (int) width && 
+           (codedHeight >> (level + 1)) >= (int) height) {
+        level++;
+    }
+    
+    return level;
+}
+
+//NOTE: the loop filter is skipped at once, its missing deblocking drifts until the next key frame. The codec
+//      is only opened again with a new lowres on pictures decoded without references (all of them for MJPEG)
+bool VideoDecoderLibav::setPreview(VideoFrame *org)
+{
+    int lowres;
+    
+    previewLevel = previewScale();
+    codecCtx->skip_loop_filter = previewLevel > 0 ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    
+    lowres = hwDeviceCtx ? 0 : std::min(previewLevel, (int) codec->max_lowres);
+    
+    if (lowres == codecCtx->lowres) {
+        return true;
+    }
+    
+    if (!org->isKeyFrame() && !(codecCtx->codec_descriptor && 
+                                (codecCtx->codec_descriptor->props & AV_CODEC_PROP_INTRA_ONLY))) {
+        return true;
+    }
+    
+    drain();
+    
+    if (!inputConfig()) {
+        utils::errorMsg("[VideoDecoderLibav] Could not open the decoder at the preview resolution");
+        return false;
+    }
+    
+    return true;
+}
 
-        if(len < 0) {
-            utils::errorMsg("Decoding video frame, reconfiguring decoder");
-            inputConfig();
+//NOTE: a packet can yield several frames, they are passed one per processed packet and the oldest 
+//      ones are dropped beyond maxPending
+bool VideoDecoderLibav::receiveFrames(size_t maxPending)
+{
+    int ret;
+    AVFrame *decoded;
+    
+    while ((ret = avcodec_receive_frame(codecCtx, frame)) >= 0) {
+        if (pending.size() >= maxPending) {
+            WARNING_MSG("[VideoDecoderLibav] Too many decoded frames pending, dropping the oldest one");
+            av_frame_free(&pending.front());
+            pending.pop_front();
+        }
+        
+        if (!(decoded = av_frame_alloc())) {
+            av_frame_unref(frame);
             return false;
         }
+        
+        av_frame_move_ref(decoded, frame);
+        pending.push_back(decoded);
+    }
+    
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+}
 
-        if (gotFrame) {
-            if (toBuffer(vDecodedFrame, vCodedFrame)) {
-                
-                dst->setConsumed(true);
-                dst->setPresentationTime(org->getPresentationTime());
-                dst->setDecodeTime(org->getPresentationTime());
-                dst->setOriginTime(org->getOriginTime());
-                dst->setSequenceNumber(org->getSequenceNumber());
-                
-                return true;
-            }
+void VideoDecoderLibav::flushPending()
+{
+    for (auto f : pending) {
+        av_frame_free(&f);
+    }
+    
+    pending.clear();
+}
+
+//NOTE: frame threads hold up to one frame per extra thread, they are kept pending so that they are still
+//      passed while the next decoder fills its own threads
+void VideoDecoderLibav::drain()
+{
+    if (!codecCtx || !avcodec_is_open(codecCtx)) {
+        return;
+    }
+    
+    if (avcodec_send_packet(codecCtx, NULL) < 0 || 
+        !receiveFrames(DECODER_MAX_PENDING + codecCtx->thread_count)) {
+        utils::warningMsg("[VideoDecoderLibav] Could not drain the decoder, its delayed frames are lost");
+    }
+}
+
+int VideoDecoderLibav::getBuffer(AVCodecContext *ctx, AVFrame *frame, int flags)
+{
+    VideoDecoderLibav *decoder = static_cast<VideoDecoderLibav*>(ctx->opaque);
+    AVPixelFormat format = (AVPixelFormat) frame->format;
+    int width = frame->width;
+    int height = frame->height;
+    int strideAlign[AV_NUM_DATA_POINTERS];
+    int linesize[4];
+    uint8_t *data[4];
+    int size, unaligned;
+    int ret;
+    
+    //NOTE: surfaces and packed formats keep the libav allocator, their frames are copied or referenced as before
+    if (!decoder || !(ctx->codec->capabilities & CODEC_CAP_DR1) || 
+        !VideoFrame::isPlanarFormat(getPixelFormat(format))) {
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+    
+    avcodec_align_dimensions2(ctx, &width, &height, strideAlign);
+    
+    //NOTE: the width grows until every plane line is a multiple of FRAME_ALIGNMENT, as libav does for its own alignment
+    do {
+        if ((size = av_image_fill_linesizes(linesize, format, width)) < 0) {
+            return size;
+        }
+        
+        unaligned = 0;
+        for (unsigned i = 0; i < 4; i++) {
+            unaligned |= linesize[i] % FRAME_ALIGNMENT;
         }
         
-        if (pkt.data){
-            pkt.size -= len;
-            pkt.data += len;
+        width += width & ~(width - 1);
+    } while (unaligned);
+    
+    if ((size = av_image_fill_pointers(data, format, height, NULL, linesize)) < 0) {
+        return size;
+    }
+    
+    //NOTE: decoders may write a few bytes beyond the last line
+    size += 16 + FRAME_ALIGNMENT - 1;
+    
+    //NOTE: frame threads call it concurrently, see thread_safe_callbacks at inputConfig
+    {
+        std::lock_guard<std::mutex> guard(decoder->poolMutex);
+        
+        if (!decoder->bufferPool || decoder->poolBufferSize != size) {
+            av_buffer_pool_uninit(&decoder->bufferPool);
+            decoder->bufferPool = av_buffer_pool_init(size, allocPoolBuffer);
+            decoder->poolBufferSize = size;
         }
+        
+        ret = decoder->bufferPool && (frame->buf[0] = av_buffer_pool_get(decoder->bufferPool)) ? 0 : AVERROR(ENOMEM);
+    }
+    
+    if (ret < 0) {
+        return ret;
+    }
+    
+    //NOTE: the pointers filled from a NULL buffer are the offsets of the planes
+    for (unsigned i = 0; i < 4; i++) {
+        frame->data[i] = linesize[i] > 0 ? frame->buf[0]->data + (uintptr_t) data[i] : NULL;
+        frame->linesize[i] = linesize[i];
     }
+    
+    frame->extended_data = frame->data;
+    
+    return 0;
+}
 
-    return false;
+AVBufferRef* VideoDecoderLibav::allocPoolBuffer(int size)
+{
+    AVBufferRef *ref;
+    unsigned char *buffer = Frame::allocBuffer(size, true);
+    
+    if (!buffer) {
+        return NULL;
+    }
+    
+    if (!(ref = av_buffer_create(buffer, size, freePoolBuffer, NULL, 0))) {
+        Frame::freeBuffer(buffer);
+        return NULL;
+    }
+    
+    return ref;
 }
 
-bool VideoDecoderLibav::inputConfig()
+void VideoDecoderLibav::freePoolBuffer(void* /*opaque*/, uint8_t *data)
+{
+    Frame::freeBuffer(data);
+}
+
+bool VideoDecoderLibav::inputConfig(const StreamInfo *si)
 {   
     switch(psi.fCodec){
         case H264:
@@ -123,7 +530,14 @@ bool VideoDecoderLibav::inputConfig()
         case VP8: 
             libavCodecId = AV_CODEC_ID_VP8;
             break;
-        case MJPEG: //TODO
+        case VP9:
+            libavCodecId = AV_CODEC_ID_VP9;
+            break;
+        case AV1:
+            libavCodecId = AV_CODEC_ID_AV1;
+            break;
+        //NOTE: camera pictures are full range 4:2:2 or 4:2:0, the libav hwaccels (vaapi, cuda) decode them in hardware
+        case MJPEG:
             libavCodecId = AV_CODEC_ID_MJPEG;
             break;
         case RAW:
@@ -136,6 +550,7 @@ bool VideoDecoderLibav::inputConfig()
 
     if (codecCtx != NULL) {
         avcodec_close(codecCtx);
+        av_buffer_unref(&codecCtx->hw_device_ctx);
         av_free(codecCtx);
     }
 
@@ -151,20 +566,49 @@ bool VideoDecoderLibav::inputConfig()
         return false;
     }
 
-    if (codec->capabilities & CODEC_CAP_TRUNCATED){
-        codecCtx->flags |= CODEC_FLAG_TRUNCATED;
-    }
-     
+    //NOTE: libav uses frame threads when both types are enabled and the codec supports them
+    codecCtx->thread_type = 0;
     if (codec->capabilities & CODEC_CAP_SLICE_THREADS) {
-        codecCtx->thread_count = 0; 
-        codecCtx->thread_type = FF_THREAD_SLICE;
+        codecCtx->thread_type |= threadType & FF_THREAD_SLICE;
+    }
+    if (codec->capabilities & CODEC_CAP_FRAME_THREADS) {
+        codecCtx->thread_type |= threadType & FF_THREAD_FRAME;
     }
+    //NOTE: the share of the thread budget is taken when the codec is opened, a running decoder is not
+    //      opened again when it changes because its reference frames would be lost
+    codecCtx->thread_count = codecCtx->thread_type ? ThreadBudget::getInstance()->getThreads(this) : 1;
 
-    codecCtx->flags2 |= CODEC_FLAG2_CHUNKS;
+    //NOTE: frame threads need whole frames per packet, libav disables them for truncated or chunked input
+    if (!(codecCtx->thread_type & FF_THREAD_FRAME)) {
+        if (codec->capabilities & CODEC_CAP_TRUNCATED){
+            codecCtx->flags |= CODEC_FLAG_TRUNCATED;
+        }
+        
+        codecCtx->flags2 |= CODEC_FLAG2_CHUNKS;
+    }
+    
+    codecCtx->opaque = this;
+    codecCtx->get_buffer2 = getBuffer;
+    codecCtx->thread_safe_callbacks = 1;
+    
+    //NOTE: lowres is not supported by hardware decoding, the loop filter is skipped on each packet
+    if (previewDecode) {
+        codecCtx->flags2 |= CODEC_FLAG2_FAST;
+        codecCtx->lowres = hwDeviceCtx ? 0 : std::min(previewLevel, (int) codec->max_lowres);
+    }
+    
+    if (hwDeviceCtx && !hwConfig()) {
+        utils::warningMsg("[VideoDecoderLibav] Hardware decoding not available, using software decoding");
+    }
+
+    if (si == NULL) {
+        si = getReader(DEFAULT_ID)->getQueue()->getStreamInfo();
+    }
 
-    FrameQueue *in_queue = getReader(DEFAULT_ID)->getQueue();
-    codecCtx->extradata = in_queue->getStreamInfo()->extradata;
-    codecCtx->extradata_size = in_queue->getStreamInfo()->extradata_size;
+    //NOTE: the codec reads the version of the extradata it is opened with, the decoder holds it
+    extradata = si->getExtraData();
+    codecCtx->extradata = extradata ? const_cast<uint8_t*>(extradata->data()) : NULL;
+    codecCtx->extradata_size = extradata ? extradata->size() : 0;
 
     AVDictionary* dictionary = NULL;
     if (avcodec_open2(codecCtx, codec, &dictionary) < 0)
@@ -176,39 +620,257 @@ bool VideoDecoderLibav::inputConfig()
     return true;
 }
 
-bool VideoDecoderLibav::toBuffer(VideoFrame *decodedFrame, VideoFrame *codedFrame)
+//NOTE: whether the codec supports the device is only known when it offers the formats, see getHwFormat
+bool VideoDecoderLibav::hwConfig()
+{
+    hwPixFmt = getSurfaceFormat(hwType);
+    
+    if (hwPixFmt == AV_PIX_FMT_NONE) {
+        return false;
+    }
+    
+    codecCtx->hw_device_ctx = av_buffer_ref(hwDeviceCtx);
+    codecCtx->opaque = this;
+    codecCtx->get_format = getHwFormat;
+    //NOTE: queued frames hold their surfaces, the decoder pool has to outlast a full output queue
+    codecCtx->extra_hw_frames = surfaceFrames();
+    
+    return codecCtx->hw_device_ctx != NULL;
+}
+
+AVBufferRef* VideoDecoderLibav::getSharedDevice(AVHWDeviceType type)
+{
+    AVBufferRef *deviceCtx = NULL;
+    std::lock_guard<std::mutex> guard(devicesMutex);
+    
+    if (sharedDevices.count(type) == 0) {
+        if (av_hwdevice_ctx_create(&deviceCtx, type, NULL, NULL, 0) < 0) {
+            return NULL;
+        }
+        
+        sharedDevices[type] = deviceCtx;
+    }
+    
+    return av_buffer_ref(sharedDevices[type]);
+}
+
+//NOTE: surfaces still queued keep their own reference to the device
+void VideoDecoderLibav::releaseSharedDevice(AVBufferRef **deviceCtx, AVHWDeviceType type)
+{
+    std::lock_guard<std::mutex> guard(devicesMutex);
+    
+    if (!*deviceCtx) {
+        return;
+    }
+    
+    av_buffer_unref(deviceCtx);
+    
+    if (sharedDevices.count(type) > 0 && av_buffer_get_ref_count(sharedDevices[type]) == 1) {
+        av_buffer_unref(&sharedDevices[type]);
+        sharedDevices.erase(type);
+    }
+}
+
+AVPixelFormat VideoDecoderLibav::getSurfaceFormat(AVHWDeviceType type)
+{
+    switch (type) {
+        case AV_HWDEVICE_TYPE_CUDA:
+            return AV_PIX_FMT_CUDA;
+        case AV_HWDEVICE_TYPE_VAAPI:
+            return AV_PIX_FMT_VAAPI;
+        case AV_HWDEVICE_TYPE_QSV:
+            return AV_PIX_FMT_QSV;
+        default:
+            return AV_PIX_FMT_NONE;
+    }
+}
+
+int VideoDecoderLibav::surfaceFrames()
+{
+    std::shared_ptr<Writer> writer = getWriter(DEFAULT_ID);
+    AVFramedQueue *queue = writer ? dynamic_cast<AVFramedQueue*>(writer->getQueue()) : NULL;
+    
+    return queue ? queue->getMaxFrames() : DEFAULT_RAW_VIDEO_FRAMES;
+}
+
+AVPixelFormat VideoDecoderLibav::getHwFormat(AVCodecContext *ctx, const AVPixelFormat *formats)
+{
+    VideoDecoderLibav *decoder = static_cast<VideoDecoderLibav*>(ctx->opaque);
+    
+    for (const AVPixelFormat *f = formats; *f != AV_PIX_FMT_NONE; f++) {
+        if (*f == decoder->hwPixFmt) {
+            return *f;
+        }
+    }
+    
+    //NOTE: libav lists software formats after the hardware ones
+    utils::warningMsg("[VideoDecoderLibav] Hardware surface format not offered, using software decoding");
+    return avcodec_default_get_format(ctx, formats);
+}
+
+//NOTE: surfaces go to hardware frames untouched, other frames get them downloaded once
+bool VideoDecoderLibav::toSurface(VideoFrame *decodedFrame, AVFrame *decoded)
+{
+    HardwareVideoFrame *hwFrame = dynamic_cast<HardwareVideoFrame*>(decodedFrame);
+    PlanarVideoFrame *planarFrame = dynamic_cast<PlanarVideoFrame*>(decodedFrame);
+    
+    if (hwFrame) {
+        //NOTE: the codec fell back to software decoding, readers of the queue still expect surfaces
+        if (!decoded->hw_frames_ctx) {
+            if (!uploadSurface(decoded)) {
+                ERROR_MSG("[VideoDecoderLibav] Could not upload the software decoded frame to a surface");
+                return false;
+            }
+            
+            decoded = hwUpload;
+        }
+        
+        psi.inputWidth = decoded->width;
+        psi.inputHeight = decoded->height;
+        
+        return hwFrame->setSurface(decoded);
+    }
+    
+    if (decoded->hw_frames_ctx) {
+        av_frame_unref(hwDownload);
+        
+        if (av_hwframe_transfer_data(hwDownload, decoded, 0) < 0) {
+            ERROR_MSG("[VideoDecoderLibav] Could not download the decoded surface");
+            return false;
+        }
+        
+        return toBuffer(decodedFrame, hwDownload);
+    }
+    
+    if (planarFrame && toPlanes(planarFrame, decoded)) {
+        return true;
+    }
+    
+    return toBuffer(decodedFrame, decoded);
+}
+
+//NOTE: the frames context is made again when the picture size or format changes, surfaces still
+//      queued keep a reference to the previous one
+bool VideoDecoderLibav::uploadSurface(AVFrame *decoded)
+{
+    AVHWFramesContext *framesCtx = uploadFramesCtx ? (AVHWFramesContext*) uploadFramesCtx->data : NULL;
+    
+    if (!hwDeviceCtx || hwPixFmt == AV_PIX_FMT_NONE) {
+        return false;
+    }
+    
+    if (!framesCtx || framesCtx->width != decoded->width || framesCtx->height != decoded->height || 
+        framesCtx->sw_format != decoded->format) {
+        av_buffer_unref(&uploadFramesCtx);
+        
+        if (!(uploadFramesCtx = av_hwframe_ctx_alloc(hwDeviceCtx))) {
+            return false;
+        }
+        
+        framesCtx = (AVHWFramesContext*) uploadFramesCtx->data;
+        framesCtx->format = hwPixFmt;
+        framesCtx->sw_format = (AVPixelFormat) decoded->format;
+        framesCtx->width = decoded->width;
+        framesCtx->height = decoded->height;
+        //NOTE: every queued frame may hold a surface while the next one is uploaded
+        framesCtx->initial_pool_size = surfaceFrames() + 1;
+        
+        if (av_hwframe_ctx_init(uploadFramesCtx) < 0) {
+            av_buffer_unref(&uploadFramesCtx);
+            return false;
+        }
+    }
+    
+    av_frame_unref(hwUpload);
+    
+    if (av_hwframe_get_buffer(uploadFramesCtx, hwUpload, 0) < 0 || av_hwframe_transfer_data(hwUpload, decoded, 0) < 0) {
+        return false;
+    }
+    
+    av_frame_copy_props(hwUpload, decoded);
+    
+    return true;
+}
+
+//NOTE: the frame keeps a reference to the decoded picture, its buffer goes back to the pool once 
+//      the decoder and the readers are done with it
+bool VideoDecoderLibav::toPlanes(PlanarVideoFrame *decodedFrame, AVFrame *decoded)
+{
+    AVFrame *ref;
+    std::shared_ptr<void> owner;
+    PixType pixelFormat = getPixelFormat((AVPixelFormat) decoded->format);
+    
+    if (!decoded->buf[0] || !VideoFrame::isPlanarFormat(pixelFormat) || !(ref = av_frame_clone(decoded))) {
+        return false;
+    }
+    
+    owner = std::shared_ptr<void>(ref, [](void* f) {
+        AVFrame *refFrame = static_cast<AVFrame*>(f);
+        av_frame_free(&refFrame);
+    });
+    
+    if (!decodedFrame->setExternalPlanes(decoded->width, decoded->height, pixelFormat, ref->data, ref->linesize, owner)) {
+        return false;
+    }
+    
+    psi.inputWidth = decoded->width;
+    psi.inputHeight = decoded->height;
+    
+    return true;
+}
+
+bool VideoDecoderLibav::toBuffer(VideoFrame *decodedFrame, AVFrame *decoded)
 {
     int ret, length;
     
-    length = av_image_fill_arrays(frameCopy->data, frameCopy->linesize, decodedFrame->getDataBuf(), 
-                            (AVPixelFormat) frame->format, frame->width, frame->height, 1); 
+    decodedFrame->fitBuffer(decoded->width, decoded->height, getPixelFormat((AVPixelFormat) decoded->format));
+    length = decodedFrame->getPlanes(frameCopy->data, frameCopy->linesize);
     if (length <= 0){
-        utils::errorMsg("Could not fill decoded frame");
+        ERROR_MSG("Could not fill decoded frame");
         return false;
     }
     
-    frameCopy->width = frame->width;
-    frameCopy->height = frame->height;
-    frameCopy->format = frame->format;
+    frameCopy->width = decoded->width;
+    frameCopy->height = decoded->height;
+    frameCopy->format = decoded->format;
     
-    psi.inputWidth = frame->width;
-    psi.inputHeight = frame->height;
+    psi.inputWidth = decoded->width;
+    psi.inputHeight = decoded->height;
 
-    ret = av_frame_copy(frameCopy, frame);
+    ret = av_frame_copy(frameCopy, decoded);
     if (ret < 0){
-        utils::errorMsg("Could not copy decoded frame data");
+        ERROR_MSG("Could not copy decoded frame data");
         return false;
     }
     
     decodedFrame->setLength(length);
-    decodedFrame->setSize(frame->width, frame->height);
-    decodedFrame->setPixelFormat(getPixelFormat((AVPixelFormat) frame->format));
     
     return true;
 }
 
 
 
+//NOTE: the codec is opened with the stream parameter sets as soon as the reader is set, so the first frame
+//      is decoded at once. The filter has no reader then, so no frame is being decoded
+bool VideoDecoderLibav::specificReaderConfig(int /*readerID*/, FrameQueue* queue)
+{
+    const StreamInfo *si = queue ? queue->getStreamInfo() : NULL;
+
+    if (!si || si->type != VIDEO || si->video.codec == VC_NONE) {
+        return true;
+    }
+
+    flushPending();
+    psi.fCodec = si->video.codec;
+
+    if (!inputConfig(si)) {
+        utils::warningMsg("[VideoDecoderLibav] Could not open the decoder before the first frame");
+        psi.fCodec = VC_NONE;
+    }
+
+    return true;
+}
+
 bool VideoDecoderLibav::reconfigure(VCodecType codec)
 {
     if (psi.fCodec == codec) {
@@ -216,6 +878,8 @@ bool VideoDecoderLibav::reconfigure(VCodecType codec)
     }
 
     psi.fCodec = codec;
+    
+    drain();
 
     if(!inputConfig()) {
         utils::errorMsg("Configuring decoder");
@@ -225,9 +889,116 @@ bool VideoDecoderLibav::reconfigure(VCodecType codec)
     return true;
 }
 
+bool VideoDecoderLibav::configure0(std::string hwDevice, bool hwDownload, int threadType, int threads, bool loadShedding, 
+                                   bool previewDecode)
+{
+    AVHWDeviceType type = AV_HWDEVICE_TYPE_NONE;
+    AVBufferRef *deviceCtx = NULL;
+    std::string currentDevice = hwDeviceCtx ? av_hwdevice_get_type_name(hwType) : "none";
+    
+    if (threadType == 0 || threads < 0) {
+        utils::errorMsg("[VideoDecoderLibav] Invalid decoding threads configuration");
+        return false;
+    }
+    
+    if (hwDevice != currentDevice && hwDevice != "none") {
+        type = av_hwdevice_find_type_by_name(hwDevice.c_str());
+        if (type == AV_HWDEVICE_TYPE_NONE) {
+            utils::errorMsg("[VideoDecoderLibav] Unknown hardware device " + hwDevice);
+            return false;
+        }
+        
+        if (!(deviceCtx = getSharedDevice(type))) {
+            utils::warningMsg("[VideoDecoderLibav] Could not open hardware device " + hwDevice + ", using software decoding");
+            type = AV_HWDEVICE_TYPE_NONE;
+        }
+    }
+    
+    if (hwDevice != currentDevice) {
+        releaseSharedDevice(&hwDeviceCtx, hwType);
+        hwDeviceCtx = deviceCtx;
+        hwType = type;
+    }
+    
+    hwDownloadOnly = hwDownload;
+    //NOTE: devices without a known surface format decode in software, their readers get frames in host memory
+    outputStreamInfo->video.pixelFormat = hwDeviceCtx && !hwDownloadOnly && getSurfaceFormat(hwType) != AV_PIX_FMT_NONE ? 
+                                          HW_SURFACE : YUV420P;
+    
+    this->threadType = threadType;
+    threadCount = threads;
+    ThreadBudget::getInstance()->join(this, threadCount);
+    this->loadShedding = loadShedding;
+    this->previewDecode = previewDecode;
+    previewLevel = 0;
+    
+    //NOTE: the codec is drained and opened again with the new configuration on next frame
+    psi.fCodec = VC_NONE;
+    
+    return true;
+}
+
+bool VideoDecoderLibav::configEvent(Jzon::Node* params)
+{
+    std::string tmpHwDevice = hwDeviceCtx ? av_hwdevice_get_type_name(hwType) : "none";
+    bool tmpHwDownload = hwDownloadOnly;
+    bool tmpLoadShedding = loadShedding;
+    bool tmpPreviewDecode = previewDecode;
+    int tmpThreadType = threadType;
+    int tmpThreads = threadCount;
+    
+    if (!params) {
+        return false;
+    }
+    
+    if (params->Has("hwDevice") && params->Get("hwDevice").IsString()) {
+        tmpHwDevice = params->Get("hwDevice").ToString();
+    }
+    
+    if (params->Has("hwDownload") && params->Get("hwDownload").IsBool()) {
+        tmpHwDownload = params->Get("hwDownload").ToBool();
+    }
+    
+    if (params->Has("loadShedding") && params->Get("loadShedding").IsBool()) {
+        tmpLoadShedding = params->Get("loadShedding").ToBool();
+    }
+    
+    if (params->Has("previewDecode") && params->Get("previewDecode").IsBool()) {
+        tmpPreviewDecode = params->Get("previewDecode").ToBool();
+    }
+    
+    if (params->Has("threadType") && params->Get("threadType").IsString()) {
+        tmpThreadType = getThreadType(params->Get("threadType").ToString());
+    }
+    
+    if (params->Has("threads") && params->Get("threads").IsNumber()) {
+        tmpThreads = params->Get("threads").ToInt();
+    }
+    
+    return configure0(tmpHwDevice, tmpHwDownload, tmpThreadType, tmpThreads, tmpLoadShedding, tmpPreviewDecode);
+}
+
+bool VideoDecoderLibav::configure(std::string hwDevice, std::string threadType, int threads, bool hwDownload, 
+                                  bool loadShedding, bool previewDecode)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configure");
+    params.Add("hwDevice", hwDevice);
+    params.Add("hwDownload", hwDownload);
+    params.Add("threadType", threadType);
+    params.Add("threads", threads);
+    params.Add("loadShedding", loadShedding);
+    params.Add("previewDecode", previewDecode);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
 void VideoDecoderLibav::initializeEventMap()
 {
-	
+    eventMap["configure"] = std::bind(&VideoDecoderLibav::configEvent, this, std::placeholders::_1);
 }
 
 void VideoDecoderLibav::doGetState(Jzon::Object &filterNode)
@@ -237,6 +1008,21 @@ void VideoDecoderLibav::doGetState(Jzon::Object &filterNode)
     jsonDecoderConfig.Add("codec", utils::getVideoCodecAsString(psi.fCodec));
     jsonDecoderConfig.Add("width", (int) psi.inputWidth);
     jsonDecoderConfig.Add("height", (int) psi.inputHeight);
+    jsonDecoderConfig.Add("hwDevice", hwDeviceCtx ? av_hwdevice_get_type_name(hwType) : "none");
+    jsonDecoderConfig.Add("hwDownload", hwDownloadOnly);
+    jsonDecoderConfig.Add("skippedFrames", (int) skippedFrames);
+    jsonDecoderConfig.Add("loadShedding", loadShedding);
+    jsonDecoderConfig.Add("shedLevel", shedLevel);
+    jsonDecoderConfig.Add("shedFrames", (int) shedFrames);
+    jsonDecoderConfig.Add("previewDecode", previewDecode);
+    jsonDecoderConfig.Add("previewLevel", previewLevel);
+    jsonDecoderConfig.Add("threadType", getThreadTypeAsString(threadType));
+    jsonDecoderConfig.Add("threads", threadCount);
+    
+    if (codecCtx && avcodec_is_open(codecCtx)) {
+        jsonDecoderConfig.Add("activeThreadType", getThreadTypeAsString(codecCtx->active_thread_type));
+        jsonDecoderConfig.Add("activeThreads", codecCtx->thread_count);
+    }
 
     filterNode.Add("inputInfo", jsonDecoderConfig);
 }
@@ -265,6 +1051,12 @@ PixType getPixelFormat(AVPixelFormat format)
         case AV_PIX_FMT_YUVJ420P:
             return YUVJ420P;
             break;
+        case AV_PIX_FMT_YUVJ422P:
+            return YUVJ422P;
+            break;
+        case AV_PIX_FMT_NV12:
+            return NV12;
+            break;
         default:
             utils::errorMsg("[Decoder] Unknown output pixel format");
             break;
@@ -272,3 +1064,37 @@ PixType getPixelFormat(AVPixelFormat format)
     
     return P_NONE;
 }
+
+int getThreadType(std::string threadType)
+{
+    if (threadType == "slice") {
+        return FF_THREAD_SLICE;
+    }
+    
+    if (threadType == "frame") {
+        return FF_THREAD_FRAME;
+    }
+    
+    if (threadType == "auto") {
+        return FF_THREAD_FRAME | FF_THREAD_SLICE;
+    }
+    
+    return 0;
+}
+
+std::string getThreadTypeAsString(int threadType)
+{
+    if ((threadType & FF_THREAD_FRAME) && (threadType & FF_THREAD_SLICE)) {
+        return "auto";
+    }
+    
+    if (threadType & FF_THREAD_FRAME) {
+        return "frame";
+    }
+    
+    if (threadType & FF_THREAD_SLICE) {
+        return "slice";
+    }
+    
+    return "none";
+}
@@ -27,31 +27,110 @@
 extern "C" {
     #include <libavcodec/avcodec.h>
     #include <libavutil/imgutils.h>
+    #include <libavutil/hwcontext.h>
+    #include <libavutil/buffer.h>
 }
 
+#include <deque>
+#include <mutex>
+#include <map>
+
 #include "../../VideoFrame.hh"
 #include "../../FrameQueue.hh"
 #include "../../Filter.hh"
 #include "../../StreamInfo.hh"
+#include "../../FrameRateScheduler.hh"
+
+#define DECODER_MAX_PENDING 4       //!< Decoded frames kept when packets yield more frames than they are processed
+#define DECODER_PACKET_HISTORY 64   //!< Processed packets whose timestamps are kept for the frames decoded later (reordering and frame threads delay)
+#define DECODER_SHED_HIGH 0.75      //!< Output queue fill ratio from which load shedding skips more frames
+#define DECODER_SHED_LOW 0.25       //!< Output queue fill ratio under which load shedding skips less frames
+#define DECODER_SHED_HOLD 8         //!< Packets a load shedding level is kept at least
+#define DECODER_MAX_PREVIEW 3       //!< Maximum preview level, pictures down to 1/8 of the coded size
 
 
-class VideoDecoderLibav : public OneToOneFilter {
+/*! Libav video decoder. When its reader publishes a frame time (see FrameQueue::setReaderFrameTime)
+*   it follows the same frame selection and skips decoding the non reference frames that will be dropped.
+*   Planar pictures are decoded into pooled FRAME_ALIGNMENT buffers which planar output frames reference
+*   (see PlanarVideoFrame::setExternalPlanes), so they reach the next filter without being copied.
+*   With frame threading, frames come out several packets after their own one; output frames get the
+*   timestamps of the packet they were decoded from.
+*   With load shedding enabled, a filling output queue makes it skip the non reference frames and then
+*   the non key frames, so that the load is shed before decoding instead of flushing decoded frames.
+*   With preview decoding enabled, a reader publishing a picture size smaller than half of the coded one (see 
+*   FrameQueue::setReaderPictureSize) gets pictures decoded without the loop filter, and at a reduced resolution
+*   (libav lowres) when the codec supports it.
+*/
+class VideoDecoderLibav : public OneToOneFilterT<VideoFrame, VideoFrame> {
 
 public:
     VideoDecoderLibav();
     ~VideoDecoderLibav();
+    
+    /**
+    * Configures hardware decoding and decoding threads. Output queues connected afterwards carry the decoded surfaces
+    * (see HardwareVideoFrame), previous ones get the surfaces downloaded to host memory. Decoders of the same
+    * device type share its device context, and decoding falls back to software when it can not be opened.
+    * @param hwDevice libav hardware device type (i.e. cuda, vaapi or qsv), none for software decoding
+    * @param hwDownload if true the surfaces are always downloaded, for readers that need frames in host memory
+    * @param loadShedding if true frames are skipped while the output queue is filling up
+    * @param threadType decoding threads type: slice, frame (adds one frame of delay per extra thread) or auto 
+    *        (frame threads when the codec supports them, slice threads otherwise)
+    * @param threads maximum decoding threads, 0 for no limit. Threads are allocated from the process ThreadBudget
+    * @param previewDecode if true pictures are decoded faster, at a lower quality and resolution, for readers 
+    *        that need small pictures (i.e. mixer tiles or thumbnails)
+    * @return true if the configuration event has been pushed
+    */
+    bool configure(std::string hwDevice, std::string threadType = "slice", int threads = 0, bool hwDownload = false, 
+                   bool loadShedding = false, bool previewDecode = false);
+
+    /**
+    * Gets the device context of a hardware device type, shared by all the filters of the process using it
+    * @param type libav hardware device type
+    * @return a new reference to the device context, NULL if it could not be opened
+    */
+    static AVBufferRef* getSharedDevice(AVHWDeviceType type);
+
+    /**
+    * Releases a reference got with getSharedDevice, the device is closed with its last reference
+    * @param deviceCtx reference to release, set to NULL
+    * @param type libav hardware device type of the reference
+    */
+    static void releaseSharedDevice(AVBufferRef **deviceCtx, AVHWDeviceType type);
         
 private:
     void initializeEventMap();
     FrameQueue* allocQueue(ConnectionData cData);
-    bool doProcessFrame(Frame *org, Frame *dst);
-    bool toBuffer(VideoFrame *decodedFrame, VideoFrame *codedFrame);
+    bool doProcessFrame(VideoFrame *org, VideoFrame *dst);
+    bool drainFrame(VideoFrame *dst);
+    bool passPending(VideoFrame *dst, VideoFrame *org);
+    void exportSideData(VideoFrame *dst, AVFrame *decoded);
+    bool toBuffer(VideoFrame *decodedFrame, AVFrame *decoded);
+    bool toPlanes(PlanarVideoFrame *decodedFrame, AVFrame *decoded);
+    bool toSurface(VideoFrame *decodedFrame, AVFrame *decoded);
+    bool uploadSurface(AVFrame *decoded);
+    int surfaceFrames();
+    bool receiveFrames(size_t maxPending);
+    void flushPending();
+    void drain();
     bool reconfigure(VCodecType codec);
-    bool inputConfig();
+    bool inputConfig(const StreamInfo *si = NULL);
+    bool hwConfig();
     void doGetState(Jzon::Object &filterNode);
+    bool configure0(std::string hwDevice, bool hwDownload, int threadType, int threads, bool loadShedding, 
+                    bool previewDecode);
+    AVDiscard shedDiscard();
+    int previewScale();
+    bool setPreview(VideoFrame *org);
+    bool configEvent(Jzon::Node* params);
+    
+    static AVPixelFormat getHwFormat(AVCodecContext *ctx, const AVPixelFormat *formats);
+    static AVPixelFormat getSurfaceFormat(AVHWDeviceType type);
+    static int getBuffer(AVCodecContext *ctx, AVFrame *frame, int flags);
+    static AVBufferRef* allocPoolBuffer(int size);
+    static void freePoolBuffer(void *opaque, uint8_t *data);
 
-    //There is no need of specific reader configuration
-    bool specificReaderConfig(int /*readerID*/, FrameQueue* /*queue*/)  {return true;};
+    bool specificReaderConfig(int readerID, FrameQueue* queue);
     bool specificReaderDelete(int /*readerID*/) {return true;};
     
     //NOTE: There is no need of specific writer configuration
@@ -60,17 +139,56 @@ private:
     
     AVCodec             *codec;
     AVCodecContext      *codecCtx;
-    AVFrame             *frame, *frameCopy;
+    AVFrame             *frame, *frameCopy, *hwDownload, *hwUpload;
     AVPacket            pkt;
     AVCodecID           libavCodecId;
-
     
+    AVBufferRef         *hwDeviceCtx;
+    AVHWDeviceType      hwType;
+    bool                hwDownloadOnly;
+    AVPixelFormat       hwPixFmt;
+    AVBufferRef         *uploadFramesCtx;   //!< Surfaces software decoded pictures are uploaded to
+    
+    FrameRateScheduler  scheduler;
+    size_t              skippedFrames;
+    
+    bool                loadShedding;
+    int                 shedLevel;
+    unsigned            shedHold;
+    bool                lastKeyFrame;
+    size_t              shedFrames;
+    
+    bool                previewDecode;
+    int                 previewLevel;   //!< Picture size reduction by powers of 2 the reader allows
+    int                 codedWidth;     //!< Full coded size, the decoded one is reduced by lowres
+    int                 codedHeight;
+    
+    AVBufferPool        *bufferPool;
+    int                 poolBufferSize;
+    std::mutex          poolMutex;
+    std::deque<AVFrame*> pending;
+    
+    int                 threadType;
+    int                 threadCount;
+    
+    struct PacketInfo {
+        std::chrono::microseconds               pts;
+        std::chrono::system_clock::time_point   originTime;
+        size_t                                  sequenceNumber;
+        FrameSideData                           sideData;
+    };
+    
+    PacketInfo          packets[DECODER_PACKET_HISTORY];
+    int64_t             packetCount;
+    bool                drained;        //!< The decoder has been drained at the end of the stream
 
     StreamInfo *outputStreamInfo;
+    std::shared_ptr<const ExtraData> extradata;
 
     struct InputStreamInfo {
         unsigned    inputWidth;
         unsigned    inputHeight;
+        int         inputFormat;    //!< AVPixelFormat of the last decoded picture
         VCodecType  fCodec;
     };
 
@@ -0,0 +1,575 @@
+/*
+ *  VideoEncoderLibav - Libav-based H264 video encoder using hardware encoders
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *            David Cassany <david.cassany@i2cat.net>
+ */
+
+#include "VideoEncoderLibav.hh"
+#include "../videoDecoder/VideoDecoderLibav.hh"
+#include "../../SlicedVideoFrameQueue.hh"
+#include <algorithm>
+#include <vector>
+
+extern "C" {
+    #include <libavutil/opt.h>
+}
+
+#define MAX_PLANES_PER_PICTURE 4
+
+AVPixelFormat getLibavPixFmt(PixType pixType);
+
+/**
+* Maps a x264 preset to the closest one of a libav encoder
+* @return the preset name, empty if the encoder has no presets
+*/
+static std::string getEncoderPreset(std::string codecName, std::string preset)
+{
+    if (codecName == "h264_nvenc") {
+        if (preset == "ultrafast" || preset == "superfast" || preset == "veryfast") {
+            return "hp";
+        }
+        if (preset == "faster" || preset == "fast") {
+            return "fast";
+        }
+        if (preset == "medium") {
+            return "medium";
+        }
+        return "slow";
+    }
+
+    if (codecName == "h264_qsv") {
+        if (preset == "ultrafast" || preset == "superfast") {
+            return "veryfast";
+        }
+        if (preset == "placebo") {
+            return "veryslow";
+        }
+        return preset;
+    }
+
+    if (codecName == FALLBACK_ENCODER) {
+        return preset;
+    }
+
+    return "";
+}
+
+/**
+* Splits an Annex B packet in its NALs, each one keeping its start code
+* @return the number of NALs
+*/
+static unsigned splitNals(uint8_t *data, int size, std::vector<std::pair<uint8_t*, int>> &nals)
+{
+    int start = -1;
+
+    nals.clear();
+
+    for (int i = 0; i + 2 < size; i++) {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+            continue;
+        }
+
+        //NOTE: 4 bytes start codes keep their leading zero
+        int codeStart = (i > 0 && data[i - 1] == 0) ? i - 1 : i;
+
+        if (start >= 0) {
+            nals.push_back(std::make_pair(data + start, codeStart - start));
+        }
+
+        start = codeStart;
+        i += 2;
+    }
+
+    if (start >= 0) {
+        nals.push_back(std::make_pair(data + start, size - start));
+    }
+
+    return nals.size();
+}
+
+VideoEncoderLibav::VideoEncoderLibav() :
+VideoEncoderX264or5(), codecCtx(NULL), swsCtx(NULL), hwType(AV_HWDEVICE_TYPE_NONE), hwPixFmt(AV_PIX_FMT_NONE),
+    hwDeviceCtx(NULL), uploadFramesCtx(NULL), zeroCopy(false), surfaceInput(false)
+{
+    fType = VIDEO_HW_ENCODER;
+    outputStreamInfo->video.codec = H264;
+
+    sendFrame = av_frame_alloc();
+    hostFrame = av_frame_alloc();
+    nv12Frame = av_frame_alloc();
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+
+    initializeEventMap();
+    configHardware0(DEFAULT_HW_ENCODER);
+}
+
+VideoEncoderLibav::~VideoEncoderLibav()
+{
+    closeCodec();
+    av_packet_unref(&pkt);
+    av_frame_free(&sendFrame);
+    av_frame_free(&hostFrame);
+    av_frame_free(&nv12Frame);
+    sws_freeContext(swsCtx);
+    VideoDecoderLibav::releaseSharedDevice(&hwDeviceCtx, hwType);
+}
+
+FrameQueue* VideoEncoderLibav::allocQueue(ConnectionData cData)
+{
+    return SlicedVideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_VIDEO_FRAMES, MAX_H264_OR_5_NAL_SIZE);
+}
+
+bool VideoEncoderLibav::reconfigure(VideoFrame* orgFrame, VideoFrame* /*dstFrame*/)
+{
+    HardwareVideoFrame *hwFrame = dynamic_cast<HardwareVideoFrame*>(orgFrame);
+    AVFrame *surface = hwFrame ? hwFrame->getSurface() : NULL;
+    std::string codecName;
+
+    if (hwFrame && !surface) {
+        utils::errorMsg("[VideoEncoderLibav] Hardware frame without surface");
+        return false;
+    }
+
+    if (!needsConfig && codecCtx && orgFrame->getWidth() == codecCtx->width &&
+        orgFrame->getHeight() == codecCtx->height && orgFrame->getPixelFormat() == inPixFmt &&
+        (surface != NULL) == surfaceInput &&
+        (!zeroCopy || surface->hw_frames_ctx->data == codecCtx->hw_frames_ctx->data)) {
+        return true;
+    }
+
+    closeCodec();
+
+    inPixFmt = orgFrame->getPixelFormat();
+    surfaceInput = surface != NULL;
+
+    if (hwType != AV_HWDEVICE_TYPE_NONE) {
+        codecName = "h264_" + hwEncoder;
+
+        if (openCodec(codecName, orgFrame, surface)) {
+            needsConfig = false;
+            return true;
+        }
+
+        closeCodec();
+        utils::warningMsg("[VideoEncoderLibav] Could not open " + codecName + ", falling back to " + FALLBACK_ENCODER);
+    }
+
+    if (!openCodec(FALLBACK_ENCODER, orgFrame, surface)) {
+        closeCodec();
+        utils::errorMsg("[VideoEncoderLibav] Could not open " + std::string(FALLBACK_ENCODER));
+        return false;
+    }
+
+    needsConfig = false;
+    return true;
+}
+
+bool VideoEncoderLibav::openCodec(std::string codecName, VideoFrame *orgFrame, AVFrame *surface)
+{
+    AVCodec *codec;
+    AVDictionary *opts = NULL;
+    AVHWFramesContext *framesCtx;
+    std::string encoderPreset;
+    bool hardware = codecName != FALLBACK_ENCODER;
+    int ret;
+
+    codec = avcodec_find_encoder_by_name(codecName.c_str());
+
+    if (!codec) {
+        utils::warningMsg("[VideoEncoderLibav] Encoder " + codecName + " not found");
+        return false;
+    }
+
+    codecCtx = avcodec_alloc_context3(codec);
+
+    if (!codecCtx) {
+        return false;
+    }
+
+    codecCtx->width = orgFrame->getWidth();
+    codecCtx->height = orgFrame->getHeight();
+    codecCtx->time_base = (AVRational){1, (int) fps};
+    codecCtx->framerate = (AVRational){(int) fps, 1};
+    codecCtx->gop_size = gop;
+    codecCtx->max_b_frames = lowLatency ? 0 : bFrames;
+    codecCtx->bit_rate = activeBitrate*1000;
+    codecCtx->rc_max_rate = lowLatency ? activeBitrate*1000 : activeBitrate*1050;
+    codecCtx->rc_buffer_size = lowLatency ? std::max(activeBitrate*1000/fps, 1u) : activeBitrate*2000;
+    //NOTE: hardware encoders keep their share, so rebalancing does not open them again
+    codecCtx->thread_count = codecThreads();
+    if (hardware) {
+        codecCtx->thread_count = 1;
+    }
+
+    zeroCopy = false;
+
+    if (surface && hardware && surface->hw_frames_ctx) {
+        framesCtx = (AVHWFramesContext*) surface->hw_frames_ctx->data;
+        zeroCopy = framesCtx->device_ctx->type == hwType;
+    }
+
+    //NOTE: surfaces are encoded in the frames context they come from, host frames are uploaded
+    //      by the encoders only taking surfaces, nvenc and libx264 take host planes
+    if (zeroCopy) {
+        codecCtx->pix_fmt = (AVPixelFormat) surface->format;
+        codecCtx->hw_frames_ctx = av_buffer_ref(surface->hw_frames_ctx);
+    } else if (hardware && hwType != AV_HWDEVICE_TYPE_CUDA) {
+        if (!(uploadFramesCtx = av_hwframe_ctx_alloc(hwDeviceCtx))) {
+            return false;
+        }
+
+        framesCtx = (AVHWFramesContext*) uploadFramesCtx->data;
+        framesCtx->format = hwPixFmt;
+        framesCtx->sw_format = AV_PIX_FMT_NV12;
+        framesCtx->width = codecCtx->width;
+        framesCtx->height = codecCtx->height;
+        framesCtx->initial_pool_size = HW_ENCODER_UPLOAD_POOL;
+
+        if (av_hwframe_ctx_init(uploadFramesCtx) < 0) {
+            utils::warningMsg("[VideoEncoderLibav] Could not create the upload surfaces pool");
+            return false;
+        }
+
+        codecCtx->pix_fmt = hwPixFmt;
+        codecCtx->hw_frames_ctx = av_buffer_ref(uploadFramesCtx);
+    } else if (surface) {
+        //NOTE: downloaded surfaces keep the software format of their frames context
+        codecCtx->pix_fmt = surface->hw_frames_ctx ?
+            ((AVHWFramesContext*) surface->hw_frames_ctx->data)->sw_format : AV_PIX_FMT_NV12;
+    } else {
+        codecCtx->pix_fmt = getLibavPixFmt(orgFrame->getPixelFormat());
+    }
+
+    if (codecCtx->pix_fmt == AV_PIX_FMT_NONE) {
+        utils::errorMsg("[VideoEncoderLibav] Uncompatible input pixel format");
+        return false;
+    }
+
+    encoderPreset = getEncoderPreset(codecName, preset);
+    if (!encoderPreset.empty()) {
+        av_dict_set(&opts, "preset", encoderPreset.c_str(), 0);
+    }
+
+    if (codecName == "h264_qsv") {
+        av_dict_set(&opts, "look_ahead", lowLatency || lookahead == 0 ? "0" : "1", 0);
+        av_dict_set(&opts, "look_ahead_depth", std::to_string(lookahead).c_str(), 0);
+    } else if (codecName != "h264_vaapi") {
+        av_dict_set(&opts, "rc-lookahead", std::to_string(lowLatency ? 0 : lookahead).c_str(), 0);
+    }
+
+    if (lowLatency && codecName == "h264_nvenc") {
+        av_dict_set(&opts, "zerolatency", "1", 0);
+        av_dict_set(&opts, "delay", "0", 0);
+    } else if (lowLatency && codecName == FALLBACK_ENCODER) {
+        av_dict_set(&opts, "tune", "zerolatency", 0);
+    }
+
+    if (codecName == "h264_nvenc" || codecName == FALLBACK_ENCODER) {
+        av_dict_set(&opts, "forced-idr", "1", 0);
+    }
+
+    if (codecName == FALLBACK_ENCODER) {
+        av_dict_set(&opts, "x264-params", lowLatency ? "intra-refresh=1:aud=1:scenecut=0" : "aud=1:scenecut=0", 0);
+    }
+
+    ret = avcodec_open2(codecCtx, codec, &opts);
+    av_dict_free(&opts);
+
+    if (ret < 0) {
+        utils::warningMsg("[VideoEncoderLibav] Could not open encoder " + codecName);
+        return false;
+    }
+
+    //NOTE: parameter sets are not global, they are repeated in the stream and taken from its first IDR
+    outputStreamInfo->setExtraData(NULL, 0);
+
+    if (!outputStreamInfo->video.h264or5.annexb) {
+        utils::warningMsg("[VideoEncoderLibav] Libav hardware encoders output Annex B streams");
+        outputStreamInfo->video.h264or5.annexb = true;
+    }
+
+    activeEncoder = codecName;
+    return true;
+}
+
+void VideoEncoderLibav::closeCodec()
+{
+    if (codecCtx) {
+        avcodec_free_context(&codecCtx);
+    }
+
+    av_buffer_unref(&uploadFramesCtx);
+    av_frame_unref(sendFrame);
+    activeEncoder = "";
+    zeroCopy = false;
+}
+
+bool VideoEncoderLibav::fill_x264or5_picture(VideoFrame* videoFrame)
+{
+    HardwareVideoFrame *hwFrame = dynamic_cast<HardwareVideoFrame*>(videoFrame);
+    AVFrame *src = midFrame;
+
+    av_frame_unref(sendFrame);
+
+    if (hwFrame && zeroCopy) {
+        return av_frame_ref(sendFrame, hwFrame->getSurface()) == 0;
+    }
+
+    if (hwFrame) {
+        if (!hwFrame->download(hostFrame)) {
+            return false;
+        }
+        src = hostFrame;
+    } else {
+        if (videoFrame->getPlanes(midFrame->data, midFrame->linesize) == 0) {
+            utils::errorMsg("[VideoEncoderLibav] Could not feed AVFrame");
+            return false;
+        }
+
+        midFrame->width = videoFrame->getWidth();
+        midFrame->height = videoFrame->getHeight();
+        midFrame->format = getLibavPixFmt(videoFrame->getPixelFormat());
+    }
+
+    if (uploadFramesCtx) {
+        return upload(src);
+    }
+
+    sendFrame->width = src->width;
+    sendFrame->height = src->height;
+    sendFrame->format = src->format;
+
+    return fillPicturePlanes(src->data, src->linesize);
+}
+
+//NOTE: host planes are pointed, not referenced, libav copies them if the encoder keeps the frame
+bool VideoEncoderLibav::fillPicturePlanes(unsigned char** data, int* linesize)
+{
+    for (int i = 0; i < MAX_PLANES_PER_PICTURE; i++) {
+        sendFrame->data[i] = data[i];
+        sendFrame->linesize[i] = linesize[i];
+    }
+
+    return true;
+}
+
+bool VideoEncoderLibav::upload(AVFrame *src)
+{
+    AVFrame *nv12 = src;
+
+    if (src->format != AV_PIX_FMT_NV12) {
+        swsCtx = sws_getCachedContext(swsCtx, src->width, src->height, (AVPixelFormat) src->format,
+                                      src->width, src->height, AV_PIX_FMT_NV12, SWS_FAST_BILINEAR, 0, 0, 0);
+
+        if (!swsCtx) {
+            utils::errorMsg("[VideoEncoderLibav] Could not get the swscale context");
+            return false;
+        }
+
+        if (nv12Frame->width != src->width || nv12Frame->height != src->height) {
+            av_frame_unref(nv12Frame);
+            nv12Frame->width = src->width;
+            nv12Frame->height = src->height;
+            nv12Frame->format = AV_PIX_FMT_NV12;
+
+            if (av_frame_get_buffer(nv12Frame, 32) < 0) {
+                utils::errorMsg("[VideoEncoderLibav] Could not allocate the NV12 picture");
+                return false;
+            }
+        }
+
+        sws_scale(swsCtx, src->data, src->linesize, 0, src->height, nv12Frame->data, nv12Frame->linesize);
+        nv12 = nv12Frame;
+    }
+
+    if (av_hwframe_get_buffer(uploadFramesCtx, sendFrame, 0) < 0) {
+        utils::errorMsg("[VideoEncoderLibav] Could not get an upload surface");
+        return false;
+    }
+
+    if (av_hwframe_transfer_data(sendFrame, nv12, 0) < 0) {
+        utils::errorMsg("[VideoEncoderLibav] Could not upload the picture");
+        return false;
+    }
+
+    return true;
+}
+
+bool VideoEncoderLibav::encodeFrame(VideoFrame* codedFrame)
+{
+    SlicedVideoFrame* slicedFrame = dynamic_cast<SlicedVideoFrame*> (codedFrame);
+    std::vector<std::pair<uint8_t*, int>> nals;
+    int ret;
+
+    if (!slicedFrame || !codecCtx) {
+        utils::errorMsg("[VideoEncoderLibav] Target frame or encoder are NULL");
+        return false;
+    }
+
+    sendFrame->pts = inPts;
+    sendFrame->pict_type = forceIntra ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    forceIntra = false;
+
+    ret = avcodec_send_frame(codecCtx, sendFrame);
+    av_frame_unref(sendFrame);
+
+    if (ret < 0 && ret != AVERROR(EAGAIN)) {
+        utils::errorMsg("[VideoEncoderLibav] Could not encode video frame");
+        return false;
+    }
+
+    inPts++;
+
+    //NOTE: the previous packet slices are pointed by the previous frame, already processed
+    av_packet_unref(&pkt);
+    ret = avcodec_receive_packet(codecCtx, &pkt);
+
+    if (ret == AVERROR(EAGAIN)) {
+        return false;
+    }
+
+    if (ret < 0) {
+        utils::errorMsg("[VideoEncoderLibav] Could not get encoded packet");
+        return false;
+    }
+
+    outPts = pkt.pts;
+    dts = pkt.dts;
+
+    if ((pkt.flags & AV_PKT_FLAG_KEY) && !outputStreamInfo->getExtraData()) {
+        setParameterSets(&pkt);
+    }
+
+    splitNals(pkt.data, pkt.size, nals);
+
+    for (auto nal : nals) {
+        if (!slicedFrame->setSlice(nal.first, nal.second)) {
+            utils::errorMsg("[VideoEncoderLibav] Too many NALs for one slicedFrame");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void VideoEncoderLibav::setParameterSets(AVPacket *packet)
+{
+    std::vector<std::pair<uint8_t*, int>> nals;
+    std::vector<uint8_t> sets;
+    uint8_t *header;
+    int type;
+
+    splitNals(packet->data, packet->size, nals);
+
+    for (auto nal : nals) {
+        header = nal.first + (nal.first[2] == 1 ? 3 : 4);
+        type = header[0] & 0x1f;
+
+        //NOTE: 7 is SPS and 8 is PPS
+        if (type == 7 || type == 8) {
+            sets.insert(sets.end(), nal.first, nal.first + nal.second);
+        }
+    }
+
+    if (!sets.empty()) {
+        outputStreamInfo->setExtraData(sets.data(), sets.size());
+    }
+}
+
+bool VideoEncoderLibav::configHardware0(std::string hwEncoder)
+{
+    AVHWDeviceType type = AV_HWDEVICE_TYPE_NONE;
+    AVPixelFormat pixFmt = AV_PIX_FMT_NONE;
+    AVBufferRef *deviceCtx = NULL;
+
+    if (hwEncoder == "nvenc") {
+        type = AV_HWDEVICE_TYPE_CUDA;
+        pixFmt = AV_PIX_FMT_CUDA;
+    } else if (hwEncoder == "qsv") {
+        type = AV_HWDEVICE_TYPE_QSV;
+        pixFmt = AV_PIX_FMT_QSV;
+    } else if (hwEncoder == "vaapi") {
+        type = AV_HWDEVICE_TYPE_VAAPI;
+        pixFmt = AV_PIX_FMT_VAAPI;
+    } else if (hwEncoder != "none") {
+        utils::errorMsg("[VideoEncoderLibav] Unknown hardware encoder " + hwEncoder);
+        return false;
+    }
+
+    //NOTE: the device is shared with the decoders using it, so their surfaces can be encoded in place
+    if (type != AV_HWDEVICE_TYPE_NONE && !(deviceCtx = VideoDecoderLibav::getSharedDevice(type))) {
+        utils::warningMsg("[VideoEncoderLibav] Could not open hardware device for " + hwEncoder + ", using " + FALLBACK_ENCODER);
+        type = AV_HWDEVICE_TYPE_NONE;
+        pixFmt = AV_PIX_FMT_NONE;
+    }
+
+    closeCodec();
+    VideoDecoderLibav::releaseSharedDevice(&hwDeviceCtx, hwType);
+
+    hwDeviceCtx = deviceCtx;
+    hwType = type;
+    hwPixFmt = pixFmt;
+    this->hwEncoder = hwEncoder;
+    needsConfig = true;
+
+    return true;
+}
+
+bool VideoEncoderLibav::configHardwareEvent(Jzon::Node* params)
+{
+    std::string tmpHwEncoder = hwEncoder;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("hwEncoder") && params->Get("hwEncoder").IsString()) {
+        tmpHwEncoder = params->Get("hwEncoder").ToString();
+    }
+
+    return configHardware0(tmpHwEncoder);
+}
+
+void VideoEncoderLibav::initializeEventMap()
+{
+    eventMap["configHardware"] = std::bind(&VideoEncoderLibav::configHardwareEvent, this, std::placeholders::_1);
+}
+
+void VideoEncoderLibav::doGetState(Jzon::Object &filterNode)
+{
+    VideoEncoderX264or5::doGetState(filterNode);
+    filterNode.Add("hwEncoder", hwEncoder);
+    filterNode.Add("activeEncoder", activeEncoder);
+    filterNode.Add("zeroCopy", zeroCopy);
+}
+
+bool VideoEncoderLibav::configHardware(std::string hwEncoder)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configHardware");
+    params.Add("hwEncoder", hwEncoder);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
@@ -0,0 +1,91 @@
+/*
+ *  VideoEncoderLibav - Libav-based H264 video encoder using hardware encoders
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *            David Cassany <david.cassany@i2cat.net>
+ */
+
+#ifndef _VIDEO_ENCODER_LIBAV_HH
+#define _VIDEO_ENCODER_LIBAV_HH
+
+#include "VideoEncoderX264or5.hh"
+#include "../../HardwareVideoFrame.hh"
+
+extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/hwcontext.h>
+    #include <libavutil/buffer.h>
+    #include <libswscale/swscale.h>
+}
+
+#define DEFAULT_HW_ENCODER "nvenc"
+#define FALLBACK_ENCODER "libx264"          //!< Software encoder used when the hardware one can not be opened
+#define HW_ENCODER_UPLOAD_POOL 20           //!< Surfaces of the pool host frames are uploaded to
+
+/*! H264 encoder driving the libav hardware encoders (nvenc, qsv or vaapi) with the configuration
+*   of VideoEncoderX264or5. Hardware surfaces of the encoder device (see HardwareVideoFrame) are
+*   encoded in place, without being copied. Host frames are uploaded, and surfaces of other devices
+*   downloaded first. If the hardware encoder can not be opened it falls back to libx264.
+*   Presets are mapped to the closest preset of each encoder. Streams are always Annex B.
+*/
+class VideoEncoderLibav : public VideoEncoderX264or5 {
+
+public:
+    VideoEncoderLibav();
+    ~VideoEncoderLibav();
+
+    /**
+    * Configures the hardware encoder, it is opened again on next frame
+    * @param hwEncoder nvenc, qsv, vaapi or none to use libx264
+    */
+    bool configHardware(std::string hwEncoder);
+
+private:
+    FrameQueue* allocQueue(ConnectionData cData);
+    void initializeEventMap();
+    bool configHardwareEvent(Jzon::Node* params);
+    bool configHardware0(std::string hwEncoder);
+    void doGetState(Jzon::Object &filterNode);
+
+    bool acceptsSurfaces() {return true;};
+    bool fill_x264or5_picture(VideoFrame* videoFrame);
+    bool fillPicturePlanes(unsigned char** data, int* linesize);
+    bool encodeFrame(VideoFrame* codedFrame);
+    bool reconfigure(VideoFrame *orgFrame, VideoFrame* dstFrame);
+    bool openCodec(std::string codecName, VideoFrame *orgFrame, AVFrame *surface);
+    void closeCodec();
+    bool upload(AVFrame *src);
+    void setParameterSets(AVPacket *packet);
+
+    AVCodecContext      *codecCtx;
+    AVFrame             *sendFrame, *hostFrame, *nv12Frame;
+    AVPacket            pkt;
+    struct SwsContext   *swsCtx;
+
+    std::string         hwEncoder;
+    std::string         activeEncoder;
+    AVHWDeviceType      hwType;
+    AVPixelFormat       hwPixFmt;
+    AVBufferRef         *hwDeviceCtx;
+    AVBufferRef         *uploadFramesCtx;
+    bool                zeroCopy;           //!< Surfaces are sent to the encoder as they come
+    bool                surfaceInput;
+};
+
+#endif
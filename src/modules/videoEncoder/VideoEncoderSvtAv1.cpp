@@ -0,0 +1,382 @@
+/*
+ *  VideoEncoderSvtAv1 - SVT-AV1 based AV1 video encoder
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *            David Cassany <david.cassany@i2cat.net>
+ */
+
+#include <cstring>
+#include <algorithm>
+#include "VideoEncoderSvtAv1.hh"
+#include "../../AVFramedQueue.hh"
+
+#define SVT_AV1_MIN_PRESET -1
+#define SVT_AV1_MAX_PRESET 13
+#define SVT_AV1_MAX_LOOKAHEAD 120       //!< Maximum lookahead in frames accepted by SVT-AV1
+#define SVT_AV1_MAX_TILES_LOG2 6
+#define SVT_AV1_VBR_BUFFER_MS 2000      //!< Rate control buffer out of low latency mode
+
+VideoEncoderSvtAv1::VideoEncoderSvtAv1() :
+VideoEncoderX264or5(), handle(NULL), opened(false), eosSent(false), preset(0), tileColumns(0), tileRows(0)
+{
+    fType = VIDEO_AV1_ENCODER;
+    outputStreamInfo->video.codec = AV1;
+    outputStreamInfo->video.frameTypes = true;
+    memset(&cfg, 0, sizeof(cfg));
+    memset(&picture, 0, sizeof(picture));
+    memset(&input, 0, sizeof(input));
+
+    initializeEventMap();
+    configSvtAv10(DEFAULT_SVT_AV1_PRESET, DEFAULT_SVT_AV1_TILE_COLUMNS, DEFAULT_SVT_AV1_TILE_ROWS);
+}
+
+VideoEncoderSvtAv1::~VideoEncoderSvtAv1()
+{
+    closeCodec();
+}
+
+FrameQueue* VideoEncoderSvtAv1::allocQueue(ConnectionData cData)
+{
+    return VideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_VIDEO_FRAMES);
+}
+
+bool VideoEncoderSvtAv1::fillPicturePlanes(unsigned char** data, int* linesize)
+{
+    //NOTE: strides are in pixels, the same as bytes for 8 bit input
+    picture.luma = data[0];
+    picture.cb = data[1];
+    picture.cr = data[2];
+    picture.y_stride = linesize[0];
+    picture.cb_stride = linesize[1];
+    picture.cr_stride = linesize[2];
+
+    input.n_filled_len = linesize[0]*cfg.source_height + (linesize[1] + linesize[2])*((cfg.source_height + 1)/2);
+
+    return true;
+}
+
+bool VideoEncoderSvtAv1::getPackets(bool flushing)
+{
+    EbBufferHeaderType *out = NULL;
+    SvtAv1Packet packet;
+    EbErrorType ret;
+
+    //NOTE: once the end of stream is sent the call waits for the delayed temporal units
+    while ((ret = svt_av1_enc_get_packet(handle, &out, flushing ? 1 : 0)) == EB_ErrorNone) {
+        if (out->flags & EB_BUFFERFLAG_EOS) {
+            svt_av1_enc_release_out_buffer(&out);
+            return false;
+        }
+
+        packet.data.assign(out->p_buffer, out->p_buffer + out->n_filled_len);
+        packet.pts = out->pts;
+        packet.key = out->pic_type == EB_AV1_KEY_PICTURE;
+        packet.ref = out->pic_type != EB_AV1_NON_REF_PICTURE;
+        packets.push_back(packet);
+
+        svt_av1_enc_release_out_buffer(&out);
+
+        if (flushing) {
+            return true;
+        }
+    }
+
+    if (ret != EB_NoErrorEmptyQueue) {
+        utils::errorMsg("[VideoEncoderSvtAv1] Could not get encoded temporal unit");
+        return false;
+    }
+
+    return true;
+}
+
+bool VideoEncoderSvtAv1::writePacket(VideoFrame* codedFrame)
+{
+    while (!packets.empty()) {
+        SvtAv1Packet &packet = packets.front();
+
+        if (packet.data.size() > codedFrame->getMaxLength()) {
+            utils::errorMsg("[VideoEncoderSvtAv1] Encoded temporal unit exceeds the frame buffer, discarding it");
+            packets.pop_front();
+            continue;
+        }
+
+        memcpy(codedFrame->getDataBuf(), packet.data.data(), packet.data.size());
+        codedFrame->setLength(packet.data.size());
+        codedFrame->setFrameType(packet.key, packet.ref);
+        outPts = packet.pts;
+        packets.pop_front();
+
+        //NOTE: each temporal unit holds one shown frame, they are output in presentation order
+        dts = outPts;
+        return true;
+    }
+
+    return false;
+}
+
+bool VideoEncoderSvtAv1::encodeFrame(VideoFrame* codedFrame)
+{
+    if (!opened) {
+        utils::errorMsg("[VideoEncoderSvtAv1] Could not encode video frame, encoder is not opened");
+        return false;
+    }
+
+    input.p_buffer = (uint8_t*) &picture;
+    input.pts = inPts;
+    input.flags = 0;
+    input.pic_type = EB_AV1_INVALID_PICTURE;
+
+    if (forceIntra) {
+        input.pic_type = EB_AV1_KEY_PICTURE;
+        forceIntra = false;
+    }
+
+    if (svt_av1_enc_send_picture(handle, &input) != EB_ErrorNone) {
+        utils::errorMsg("[VideoEncoderSvtAv1] Could not encode video frame");
+        return false;
+    }
+
+    inPts++;
+
+    //NOTE: the first temporal unit is copied right away, the next ones (if any) wait in order for the next calls
+    getPackets(false);
+    return writePacket(codedFrame);
+}
+
+bool VideoEncoderSvtAv1::flushFrame(VideoFrame* codedFrame)
+{
+    EbBufferHeaderType eos;
+
+    if (!opened) {
+        return false;
+    }
+
+    if (!packets.empty()) {
+        return writePacket(codedFrame);
+    }
+
+    if (!eosSent) {
+        memset(&eos, 0, sizeof(eos));
+        eos.size = sizeof(eos);
+        eos.flags = EB_BUFFERFLAG_EOS;
+        eos.pic_type = EB_AV1_INVALID_PICTURE;
+
+        if (svt_av1_enc_send_picture(handle, &eos) != EB_ErrorNone) {
+            utils::errorMsg("[VideoEncoderSvtAv1] Could not flush the encoder");
+            return false;
+        }
+
+        eosSent = true;
+    }
+
+    if (!getPackets(true)) {
+        return false;
+    }
+
+    return writePacket(codedFrame);
+}
+
+void VideoEncoderSvtAv1::fillConfig()
+{
+    unsigned threads = codecThreads();
+    unsigned bufferMs;
+
+    cfg.enc_mode = preset;
+    cfg.frame_rate_numerator = fps;
+    cfg.frame_rate_denominator = 1;
+    cfg.target_bit_rate = activeBitrate*1000;
+    cfg.encoder_bit_depth = 8;
+    cfg.encoder_color_format = EB_YUV420;
+    cfg.tile_columns = tileColumns;
+    cfg.tile_rows = tileRows;
+    //NOTE: closed GOPs with key frames, which are also written when forcing intra
+    cfg.intra_period_length = std::max((int) gop - 1, 0);
+    cfg.intra_refresh_type = SVT_AV1_KF_REFRESH;
+    cfg.force_key_frames = 1;
+
+#if SVT_AV1_CHECK_VERSION(3, 0, 0)
+    cfg.level_of_parallelism = threads;
+#else
+    cfg.logical_processors = threads;
+#endif
+
+    if (lowLatency) {
+        bufferMs = std::max(1000/fps, 1u);
+        cfg.pred_structure = SVT_AV1_PRED_LOW_DELAY_B;
+        cfg.rate_control_mode = SVT_AV1_RC_MODE_CBR;
+        cfg.look_ahead_distance = 0;
+    } else {
+        bufferMs = SVT_AV1_VBR_BUFFER_MS;
+        cfg.pred_structure = SVT_AV1_PRED_RANDOM_ACCESS;
+        cfg.rate_control_mode = SVT_AV1_RC_MODE_VBR;
+        cfg.look_ahead_distance = std::min(lookahead, (unsigned) SVT_AV1_MAX_LOOKAHEAD);
+    }
+
+    cfg.maximum_buffer_size_ms = bufferMs;
+    cfg.starting_buffer_level_ms = bufferMs/2;
+    cfg.optimal_buffer_level_ms = bufferMs/2;
+}
+
+bool VideoEncoderSvtAv1::openCodec(VideoFrame *orgFrame)
+{
+    if (inPixFmt != YUV420P) {
+        utils::errorMsg("[VideoEncoderSvtAv1] Uncompatibe input pixel format, only YUV420P is supported");
+        return false;
+    }
+
+    //NOTE: the handle is initialized with the default configuration
+#if SVT_AV1_CHECK_VERSION(3, 0, 0)
+    if (svt_av1_enc_init_handle(&handle, &cfg) != EB_ErrorNone) {
+#else
+    if (svt_av1_enc_init_handle(&handle, NULL, &cfg) != EB_ErrorNone) {
+#endif
+        utils::errorMsg("[VideoEncoderSvtAv1] Could not get the default configuration");
+        handle = NULL;
+        return false;
+    }
+
+    cfg.source_width = orgFrame->getWidth();
+    cfg.source_height = orgFrame->getHeight();
+    fillConfig();
+
+    if (svt_av1_enc_set_parameter(handle, &cfg) != EB_ErrorNone) {
+        utils::errorMsg("[VideoEncoderSvtAv1] Invalid encoder configuration");
+        return false;
+    }
+
+    if (svt_av1_enc_init(handle) != EB_ErrorNone) {
+        utils::errorMsg("[VideoEncoderSvtAv1] Could not open encoder");
+        return false;
+    }
+
+    memset(&picture, 0, sizeof(picture));
+    memset(&input, 0, sizeof(input));
+    input.size = sizeof(input);
+
+    opened = true;
+    eosSent = false;
+    return true;
+}
+
+void VideoEncoderSvtAv1::closeCodec()
+{
+    if (opened) {
+        svt_av1_enc_deinit(handle);
+        opened = false;
+    }
+
+    if (handle) {
+        svt_av1_enc_deinit_handle(handle);
+        handle = NULL;
+    }
+
+    packets.clear();
+}
+
+bool VideoEncoderSvtAv1::reconfigure(VideoFrame* orgFrame, VideoFrame* /*dstFrame*/)
+{
+    bool sameInput = opened && orgFrame->getWidth() == (int) cfg.source_width &&
+                     orgFrame->getHeight() == (int) cfg.source_height && orgFrame->getPixelFormat() == inPixFmt;
+
+    if (sameInput && !needsConfig) {
+        return true;
+    }
+
+    //NOTE: SVT-AV1 configuration is fixed when opening the encoder, rate and thread changes open it again
+    closeCodec();
+    inPixFmt = orgFrame->getPixelFormat();
+
+    if (!openCodec(orgFrame)) {
+        closeCodec();
+        return false;
+    }
+
+    needsConfig = false;
+    return true;
+}
+
+bool VideoEncoderSvtAv1::configSvtAv10(int preset_, int tileColumns_, int tileRows_)
+{
+    if (preset_ < SVT_AV1_MIN_PRESET || preset_ > SVT_AV1_MAX_PRESET ||
+        tileColumns_ < 0 || tileColumns_ > SVT_AV1_MAX_TILES_LOG2 ||
+        tileRows_ < 0 || tileRows_ > SVT_AV1_MAX_TILES_LOG2) {
+        utils::errorMsg("[VideoEncoderSvtAv1] Invalid configuration values");
+        return false;
+    }
+
+    preset = preset_;
+    tileColumns = tileColumns_;
+    tileRows = tileRows_;
+    needsConfig = true;
+
+    return true;
+}
+
+bool VideoEncoderSvtAv1::configSvtAv1Event(Jzon::Node* params)
+{
+    int tmpPreset = preset;
+    int tmpTileColumns = tileColumns;
+    int tmpTileRows = tileRows;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("preset")) {
+        tmpPreset = params->Get("preset").ToInt();
+    }
+
+    if (params->Has("tileColumns")) {
+        tmpTileColumns = params->Get("tileColumns").ToInt();
+    }
+
+    if (params->Has("tileRows")) {
+        tmpTileRows = params->Get("tileRows").ToInt();
+    }
+
+    return configSvtAv10(tmpPreset, tmpTileColumns, tmpTileRows);
+}
+
+void VideoEncoderSvtAv1::initializeEventMap()
+{
+    eventMap["configSvtAv1"] = std::bind(&VideoEncoderSvtAv1::configSvtAv1Event, this, std::placeholders::_1);
+}
+
+void VideoEncoderSvtAv1::doGetState(Jzon::Object &filterNode)
+{
+    VideoEncoderX264or5::doGetState(filterNode);
+    filterNode.Add("codec", utils::getVideoCodecAsString(AV1));
+    filterNode.Add("svtPreset", preset);
+    filterNode.Add("tileColumns", tileColumns);
+    filterNode.Add("tileRows", tileRows);
+}
+
+bool VideoEncoderSvtAv1::configSvtAv1(int preset, int tileColumns, int tileRows)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configSvtAv1");
+    params.Add("preset", preset);
+    params.Add("tileColumns", tileColumns);
+    params.Add("tileRows", tileRows);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
@@ -0,0 +1,98 @@
+/*
+ *  VideoEncoderSvtAv1 - SVT-AV1 based AV1 video encoder
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *            David Cassany <david.cassany@i2cat.net>
+ */
+
+#ifndef _VIDEO_ENCODER_SVT_AV1_HH
+#define _VIDEO_ENCODER_SVT_AV1_HH
+
+#include <deque>
+#include <vector>
+#include "VideoEncoderX264or5.hh"
+
+extern "C" {
+    #include <svt-av1/EbSvtAv1Enc.h>
+}
+
+#define DEFAULT_SVT_AV1_PRESET 10           //!< Speed preset, 10 to 13 are the real-time ones
+#define DEFAULT_SVT_AV1_TILE_COLUMNS 1      //!< log2 of the tile columns
+#define DEFAULT_SVT_AV1_TILE_ROWS 0         //!< log2 of the tile rows
+
+/*! AV1 encoder based on SVT-AV1, configured like the H264 encoders (see VideoEncoderX264or5).
+*   The preset and the B-frames of the common configuration are ignored, the speed is set by the SVT-AV1
+*   preset. Tiles are encoded in parallel with the threads of the encoder share of the ThreadBudget.
+*   Low latency mode uses the low delay prediction structure with CBR and no lookahead, otherwise random
+*   access with VBR. Temporal units are output whole in low overhead bitstream format, the Dasher and
+*   AV1VideoRTPSink split them in OBUs. Any configuration change opens the encoder again, starting with
+*   a key frame.
+*/
+class VideoEncoderSvtAv1 : public VideoEncoderX264or5 {
+
+public:
+    VideoEncoderSvtAv1();
+    ~VideoEncoderSvtAv1();
+
+    /**
+    * Configures the SVT-AV1 specific parameters, the encoder is opened again on next frame
+    * @param preset speed preset, higher values are faster and use less cpu
+    * @param tileColumns log2 of the tile columns
+    * @param tileRows log2 of the tile rows
+    */
+    bool configSvtAv1(int preset, int tileColumns, int tileRows);
+
+private:
+    struct SvtAv1Packet {
+        std::vector<unsigned char> data;
+        int64_t pts;
+        bool key;
+        bool ref;
+    };
+
+    FrameQueue* allocQueue(ConnectionData cData);
+    void initializeEventMap();
+    bool configSvtAv1Event(Jzon::Node* params);
+    bool configSvtAv10(int preset_, int tileColumns_, int tileRows_);
+    void doGetState(Jzon::Object &filterNode);
+
+    bool fillPicturePlanes(unsigned char** data, int* linesize);
+    bool encodeFrame(VideoFrame* codedFrame);
+    bool flushFrame(VideoFrame* codedFrame);
+    bool reconfigure(VideoFrame *orgFrame, VideoFrame* dstFrame);
+    bool openCodec(VideoFrame *orgFrame);
+    void closeCodec();
+    void fillConfig();
+    bool getPackets(bool flushing);
+    bool writePacket(VideoFrame* codedFrame);
+
+    EbComponentType *handle;
+    EbSvtAv1EncConfiguration cfg;
+    EbSvtIOFormat picture;
+    EbBufferHeaderType input;
+    bool opened;
+    bool eosSent;
+    std::deque<SvtAv1Packet> packets;   //!< Temporal units output by SVT-AV1 and not written yet
+
+    int preset;
+    int tileColumns;
+    int tileRows;
+};
+
+#endif
@@ -0,0 +1,399 @@
+/*
+ *  VideoEncoderVpx - libvpx based VP8 and VP9 video encoder
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *            David Cassany <david.cassany@i2cat.net>
+ */
+
+#include <cstring>
+#include <algorithm>
+#include "VideoEncoderVpx.hh"
+#include "../../AVFramedQueue.hh"
+
+#define VPX_MAX_LAG 25              //!< Maximum lag in frames accepted by libvpx
+#define VPX_VBR_BUFFER_MS 2000      //!< Rate control buffer out of low latency mode
+
+VideoEncoderVpx::VideoEncoderVpx() :
+VideoEncoderX264or5(), opened(false), codec(DEFAULT_VPX_CODEC), vpxDeadline(VPX_DL_REALTIME), cpuUsed(0),
+    rowMt(false), tileColumns(0), tokenPartitions(0)
+{
+    fType = VIDEO_VPX_ENCODER;
+    outputStreamInfo->video.codec = DEFAULT_VPX_CODEC;
+    outputStreamInfo->video.frameTypes = true;
+    memset(&image, 0, sizeof(image));
+    memset(&cfg, 0, sizeof(cfg));
+
+    initializeEventMap();
+    configVpx0(DEFAULT_VPX_CODEC, DEFAULT_VPX_DEADLINE, DEFAULT_VPX_CPU_USED, DEFAULT_VPX_ROW_MT,
+               DEFAULT_VPX_TILE_COLUMNS, DEFAULT_VPX_TOKEN_PARTITIONS);
+}
+
+VideoEncoderVpx::~VideoEncoderVpx()
+{
+    closeCodec();
+}
+
+FrameQueue* VideoEncoderVpx::allocQueue(ConnectionData cData)
+{
+    return VideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_VIDEO_FRAMES);
+}
+
+bool VideoEncoderVpx::fillPicturePlanes(unsigned char** data, int* linesize)
+{
+    image.planes[VPX_PLANE_Y] = data[0];
+    image.planes[VPX_PLANE_U] = data[1];
+    image.planes[VPX_PLANE_V] = data[2];
+    image.stride[VPX_PLANE_Y] = linesize[0];
+    image.stride[VPX_PLANE_U] = linesize[1];
+    image.stride[VPX_PLANE_V] = linesize[2];
+
+    return true;
+}
+
+bool VideoEncoderVpx::encodeFrame(VideoFrame* codedFrame)
+{
+    const vpx_codec_cx_pkt_t *pkt;
+    vpx_codec_iter_t iter = NULL;
+    vpx_enc_frame_flags_t flags = 0;
+    VpxPacket packet;
+    bool written = false;
+
+    if (!opened) {
+        utils::errorMsg("[VideoEncoderVpx] Could not encode video frame, encoder is not opened");
+        return false;
+    }
+
+    if (forceIntra) {
+        flags |= VPX_EFLAG_FORCE_KF;
+        forceIntra = false;
+    }
+
+    if (vpx_codec_encode(&codecCtx, &image, inPts, 1, flags, vpxDeadline) != VPX_CODEC_OK) {
+        utils::errorMsg("[VideoEncoderVpx] Could not encode video frame: " + std::string(vpx_codec_error(&codecCtx)));
+        return false;
+    }
+
+    inPts++;
+
+    //NOTE: the first frame is copied right away, the next ones (if any) wait in order for the next calls
+    while ((pkt = vpx_codec_get_cx_data(&codecCtx, &iter)) != NULL) {
+        if (pkt->kind != VPX_CODEC_CX_FRAME_PKT) {
+            continue;
+        }
+
+        if (pkt->data.frame.sz > codedFrame->getMaxLength()) {
+            utils::errorMsg("[VideoEncoderVpx] Encoded frame exceeds the frame buffer, discarding it");
+            continue;
+        }
+
+        if (!written && packets.empty()) {
+            memcpy(codedFrame->getDataBuf(), pkt->data.frame.buf, pkt->data.frame.sz);
+            codedFrame->setLength(pkt->data.frame.sz);
+            codedFrame->setFrameType(pkt->data.frame.flags & VPX_FRAME_IS_KEY, !(pkt->data.frame.flags & VPX_FRAME_IS_DROPPABLE));
+            outPts = pkt->data.frame.pts;
+            written = true;
+            continue;
+        }
+
+        packet.data.assign((unsigned char*) pkt->data.frame.buf, (unsigned char*) pkt->data.frame.buf + pkt->data.frame.sz);
+        packet.pts = pkt->data.frame.pts;
+        packet.flags = pkt->data.frame.flags;
+        packets.push_back(packet);
+    }
+
+    if (!written && !packets.empty()) {
+        memcpy(codedFrame->getDataBuf(), packets.front().data.data(), packets.front().data.size());
+        codedFrame->setLength(packets.front().data.size());
+        codedFrame->setFrameType(packets.front().flags & VPX_FRAME_IS_KEY, !(packets.front().flags & VPX_FRAME_IS_DROPPABLE));
+        outPts = packets.front().pts;
+        packets.pop_front();
+        written = true;
+    }
+
+    //NOTE: there are no B-frames, frames are output in presentation order
+    dts = outPts;
+    return written;
+}
+
+void VideoEncoderVpx::fillConfig()
+{
+    unsigned bufferMs;
+
+    cfg.g_timebase.num = 1;
+    cfg.g_timebase.den = fps;
+    cfg.g_pass = VPX_RC_ONE_PASS;
+    cfg.g_threads = codecThreads();
+    cfg.rc_target_bitrate = activeBitrate;
+    cfg.kf_mode = VPX_KF_AUTO;
+    cfg.kf_min_dist = 0;
+    cfg.kf_max_dist = gop;
+
+    if (lowLatency) {
+        bufferMs = std::max(1000/fps, 1u);
+        cfg.rc_end_usage = VPX_CBR;
+        cfg.g_lag_in_frames = 0;
+        cfg.g_error_resilient = VPX_ERROR_RESILIENT_DEFAULT;
+    } else {
+        bufferMs = VPX_VBR_BUFFER_MS;
+        cfg.rc_end_usage = VPX_VBR;
+        cfg.g_lag_in_frames = std::min(lookahead, (unsigned) VPX_MAX_LAG);
+        cfg.g_error_resilient = 0;
+    }
+
+    cfg.rc_buf_sz = bufferMs;
+    cfg.rc_buf_initial_sz = bufferMs/2;
+    cfg.rc_buf_optimal_sz = bufferMs/2;
+}
+
+bool VideoEncoderVpx::openCodec(VideoFrame *orgFrame)
+{
+    vpx_codec_iface_t *iface = codec == VP9 ? vpx_codec_vp9_cx() : vpx_codec_vp8_cx();
+    vpx_img_fmt_t imgFmt;
+
+    if (vpx_codec_enc_config_default(iface, &cfg, 0) != VPX_CODEC_OK) {
+        utils::errorMsg("[VideoEncoderVpx] Could not get the default configuration");
+        return false;
+    }
+
+    memset(&image, 0, sizeof(image));
+
+    //NOTE: VP8 only supports 4:2:0, VP9 encodes other chroma subsamplings with the profile 1
+    switch (inPixFmt) {
+        case YUV420P:
+            imgFmt = VPX_IMG_FMT_I420;
+            image.x_chroma_shift = 1;
+            image.y_chroma_shift = 1;
+            image.bps = 12;
+            cfg.g_profile = 0;
+            break;
+        case YUV422P:
+            imgFmt = VPX_IMG_FMT_I422;
+            image.x_chroma_shift = 1;
+            image.bps = 16;
+            cfg.g_profile = 1;
+            break;
+        case YUV444P:
+            imgFmt = VPX_IMG_FMT_I444;
+            image.bps = 24;
+            cfg.g_profile = 1;
+            break;
+        default:
+            utils::errorMsg("[VideoEncoderVpx] Uncompatibe input pixel format");
+            return false;
+    }
+
+    if (codec == VP8 && imgFmt != VPX_IMG_FMT_I420) {
+        utils::errorMsg("[VideoEncoderVpx] VP8 only supports YUV420P input");
+        return false;
+    }
+
+    image.fmt = imgFmt;
+    image.bit_depth = 8;
+    image.w = image.d_w = orgFrame->getWidth();
+    image.h = image.d_h = orgFrame->getHeight();
+
+    cfg.g_w = orgFrame->getWidth();
+    cfg.g_h = orgFrame->getHeight();
+    fillConfig();
+
+    if (vpx_codec_enc_init(&codecCtx, iface, &cfg, 0) != VPX_CODEC_OK) {
+        utils::errorMsg("[VideoEncoderVpx] Could not open encoder: " + std::string(vpx_codec_error(&codecCtx)));
+        return false;
+    }
+
+    opened = true;
+
+    if (codec == VP9) {
+        vpx_codec_control(&codecCtx, VP8E_SET_CPUUSED, std::min(cpuUsed, 9));
+        vpx_codec_control(&codecCtx, VP9E_SET_ROW_MT, rowMt ? 1 : 0);
+        vpx_codec_control(&codecCtx, VP9E_SET_TILE_COLUMNS, tileColumns);
+        if (lowLatency) {
+            vpx_codec_control(&codecCtx, VP9E_SET_AQ_MODE, 3);
+        }
+    } else {
+        vpx_codec_control(&codecCtx, VP8E_SET_CPUUSED, cpuUsed);
+        vpx_codec_control(&codecCtx, VP8E_SET_TOKEN_PARTITIONS, tokenPartitions);
+        //NOTE: VP8 has no superframes, hidden alternate reference frames would be output on their own
+        vpx_codec_control(&codecCtx, VP8E_SET_ENABLEAUTOALTREF, 0);
+    }
+
+    return true;
+}
+
+void VideoEncoderVpx::closeCodec()
+{
+    if (opened) {
+        vpx_codec_destroy(&codecCtx);
+        opened = false;
+    }
+
+    packets.clear();
+}
+
+bool VideoEncoderVpx::reconfigure(VideoFrame* orgFrame, VideoFrame* /*dstFrame*/)
+{
+    unsigned threads;
+    bool sameInput = opened && orgFrame->getWidth() == (int) cfg.g_w &&
+                     orgFrame->getHeight() == (int) cfg.g_h && orgFrame->getPixelFormat() == inPixFmt;
+
+    if (sameInput && !needsConfig) {
+        return true;
+    }
+
+    //NOTE: rate control changes are applied to the running encoder, thread changes need to open it again
+    if (sameInput) {
+        threads = cfg.g_threads;
+        fillConfig();
+        if (cfg.g_threads == threads && vpx_codec_enc_config_set(&codecCtx, &cfg) == VPX_CODEC_OK) {
+            needsConfig = false;
+            return true;
+        }
+    }
+
+    closeCodec();
+    inPixFmt = orgFrame->getPixelFormat();
+
+    if (!openCodec(orgFrame)) {
+        closeCodec();
+        return false;
+    }
+
+    needsConfig = false;
+    return true;
+}
+
+bool VideoEncoderVpx::configVpx0(VCodecType codec_, std::string deadline_, int cpuUsed_, bool rowMt_, int tileColumns_, int tokenPartitions_)
+{
+    unsigned long tmpDeadline;
+
+    if (codec_ != VP8 && codec_ != VP9) {
+        utils::errorMsg("[VideoEncoderVpx] Only VP8 and VP9 are supported");
+        return false;
+    }
+
+    if (deadline_ == "realtime") {
+        tmpDeadline = VPX_DL_REALTIME;
+    } else if (deadline_ == "good") {
+        tmpDeadline = VPX_DL_GOOD_QUALITY;
+    } else if (deadline_ == "best") {
+        tmpDeadline = VPX_DL_BEST_QUALITY;
+    } else {
+        utils::errorMsg("[VideoEncoderVpx] Unknown deadline " + deadline_);
+        return false;
+    }
+
+    if (cpuUsed_ < -16 || cpuUsed_ > 16 || tileColumns_ < 0 || tileColumns_ > 6 ||
+        tokenPartitions_ < 0 || tokenPartitions_ > 3) {
+        utils::errorMsg("[VideoEncoderVpx] Invalid configuration values");
+        return false;
+    }
+
+    //NOTE: the queues of the readers are allocated with the stream codec when connecting them
+    if (codec_ != codec && isWConnected(DEFAULT_ID)) {
+        utils::errorMsg("[VideoEncoderVpx] The codec can not be changed once the encoder is connected");
+        return false;
+    }
+
+    closeCodec();
+
+    codec = codec_;
+    outputStreamInfo->video.codec = codec_;
+    deadline = deadline_;
+    vpxDeadline = tmpDeadline;
+    cpuUsed = cpuUsed_;
+    rowMt = rowMt_;
+    tileColumns = tileColumns_;
+    tokenPartitions = tokenPartitions_;
+    needsConfig = true;
+
+    return true;
+}
+
+bool VideoEncoderVpx::configVpxEvent(Jzon::Node* params)
+{
+    VCodecType tmpCodec = codec;
+    std::string tmpDeadline = deadline;
+    int tmpCpuUsed = cpuUsed;
+    bool tmpRowMt = rowMt;
+    int tmpTileColumns = tileColumns;
+    int tmpTokenPartitions = tokenPartitions;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("codec")) {
+        tmpCodec = utils::getVideoCodecFromString(params->Get("codec").ToString());
+    }
+
+    if (params->Has("deadline")) {
+        tmpDeadline = params->Get("deadline").ToString();
+    }
+
+    if (params->Has("cpuUsed")) {
+        tmpCpuUsed = params->Get("cpuUsed").ToInt();
+    }
+
+    if (params->Has("rowMt")) {
+        tmpRowMt = params->Get("rowMt").ToBool();
+    }
+
+    if (params->Has("tileColumns")) {
+        tmpTileColumns = params->Get("tileColumns").ToInt();
+    }
+
+    if (params->Has("tokenPartitions")) {
+        tmpTokenPartitions = params->Get("tokenPartitions").ToInt();
+    }
+
+    return configVpx0(tmpCodec, tmpDeadline, tmpCpuUsed, tmpRowMt, tmpTileColumns, tmpTokenPartitions);
+}
+
+void VideoEncoderVpx::initializeEventMap()
+{
+    eventMap["configVpx"] = std::bind(&VideoEncoderVpx::configVpxEvent, this, std::placeholders::_1);
+}
+
+void VideoEncoderVpx::doGetState(Jzon::Object &filterNode)
+{
+    VideoEncoderX264or5::doGetState(filterNode);
+    filterNode.Add("codec", utils::getVideoCodecAsString(codec));
+    filterNode.Add("deadline", deadline);
+    filterNode.Add("cpuUsed", cpuUsed);
+    filterNode.Add("rowMt", rowMt);
+    filterNode.Add("tileColumns", tileColumns);
+    filterNode.Add("tokenPartitions", tokenPartitions);
+}
+
+bool VideoEncoderVpx::configVpx(VCodecType codec, std::string deadline, int cpuUsed, bool rowMt, int tileColumns, int tokenPartitions)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configVpx");
+    params.Add("codec", utils::getVideoCodecAsString(codec));
+    params.Add("deadline", deadline);
+    params.Add("cpuUsed", cpuUsed);
+    params.Add("rowMt", rowMt);
+    params.Add("tileColumns", tileColumns);
+    params.Add("tokenPartitions", tokenPartitions);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
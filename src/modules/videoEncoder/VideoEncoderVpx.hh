@@ -0,0 +1,102 @@
+/*
+ *  VideoEncoderVpx - libvpx based VP8 and VP9 video encoder
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *            David Cassany <david.cassany@i2cat.net>
+ */
+
+#ifndef _VIDEO_ENCODER_VPX_HH
+#define _VIDEO_ENCODER_VPX_HH
+
+#include <deque>
+#include <vector>
+#include "VideoEncoderX264or5.hh"
+
+extern "C" {
+    #include <vpx/vpx_encoder.h>
+    #include <vpx/vp8cx.h>
+}
+
+#define DEFAULT_VPX_CODEC VP8
+#define DEFAULT_VPX_DEADLINE "realtime"
+#define DEFAULT_VPX_CPU_USED 8              //!< Speed setting, higher values are faster (up to 16 for VP8, 9 for VP9)
+#define DEFAULT_VPX_ROW_MT true
+#define DEFAULT_VPX_TILE_COLUMNS 2          //!< log2 of the VP9 tile columns
+#define DEFAULT_VPX_TOKEN_PARTITIONS 2      //!< log2 of the VP8 token partitions
+
+/*! VP8 and VP9 encoder based on libvpx, configured like the H264 encoders (see VideoEncoderX264or5).
+*   The preset and the B-frames of the common configuration are ignored, the speed is set by the deadline
+*   (realtime, good or best) and cpu-used. VP9 encodes tile columns in parallel, and with row based
+*   multithreading the rows of each tile too, VP8 splits frames in token partitions that can be decoded in
+*   parallel. Frames are output whole, the RTP sinks split them in packets. Low latency mode uses CBR,
+*   no lag and error resilient frames.
+*/
+class VideoEncoderVpx : public VideoEncoderX264or5 {
+
+public:
+    VideoEncoderVpx();
+    ~VideoEncoderVpx();
+
+    /**
+    * Configures the libvpx specific parameters, the encoder is opened again on next frame
+    * @param codec VP8 or VP9, it can only be changed before connecting the encoder
+    * @param deadline realtime, good or best
+    * @param cpuUsed speed setting, higher values are faster and use less cpu
+    * @param rowMt if true VP9 rows are encoded in parallel
+    * @param tileColumns log2 of the VP9 tile columns
+    * @param tokenPartitions log2 of the VP8 token partitions
+    */
+    bool configVpx(VCodecType codec, std::string deadline, int cpuUsed, bool rowMt, int tileColumns, int tokenPartitions);
+
+private:
+    struct VpxPacket {
+        std::vector<unsigned char> data;
+        int64_t pts;
+        vpx_codec_frame_flags_t flags;
+    };
+
+    FrameQueue* allocQueue(ConnectionData cData);
+    void initializeEventMap();
+    bool configVpxEvent(Jzon::Node* params);
+    bool configVpx0(VCodecType codec_, std::string deadline_, int cpuUsed_, bool rowMt_, int tileColumns_, int tokenPartitions_);
+    void doGetState(Jzon::Object &filterNode);
+
+    bool fillPicturePlanes(unsigned char** data, int* linesize);
+    bool encodeFrame(VideoFrame* codedFrame);
+    bool reconfigure(VideoFrame *orgFrame, VideoFrame* dstFrame);
+    bool openCodec(VideoFrame *orgFrame);
+    void closeCodec();
+    void fillConfig();
+
+    vpx_codec_ctx_t codecCtx;
+    vpx_codec_enc_cfg_t cfg;
+    vpx_image_t image;
+    bool opened;
+    std::deque<VpxPacket> packets;  //!< Frames output by libvpx and not written yet
+
+    VCodecType codec;
+    std::string deadline;
+    unsigned long vpxDeadline;
+    int cpuUsed;
+    bool rowMt;
+    int tileColumns;
+    int tokenPartitions;
+};
+
+#endif
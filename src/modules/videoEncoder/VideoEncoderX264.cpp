@@ -22,21 +22,36 @@
  */
 
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include "VideoEncoderX264.hh"
 #include "../../SlicedVideoFrameQueue.hh"
+#include "../../FramePool.hh"
 
 #define MAX_PLANES_PER_PICTURE 4
+#define SEI_USER_DATA_REGISTERED 4
+#define SEI_USER_DATA_UNREGISTERED 5
+#define CC_MAX_COUNT 31
 
 VideoEncoderX264::VideoEncoderX264() :
-VideoEncoderX264or5(), encoder(NULL)
+VideoEncoderX264or5(), encoder(NULL), async(DEFAULT_ASYNC_ENCODING), pendingFrame(NULL),
+    encoding(false), stopEncoding(false), pool(NULL), subframe(false), subframeNalNum(0), nextMb(0),
+    slicesStarted(false), subframeFrame(NULL), subframeQueue(NULL), subframePool(NULL), subframeWrites(0)
 {
     outputStreamInfo->video.codec = H264;
     x264_picture_init(&picIn);
     x264_picture_init(&picOut);
+    //NOTE: x264 passes it to naluProcess for the NALs of the picture
+    picIn.opaque = this;
+    initializeEventMap();
 }
 
 VideoEncoderX264::~VideoEncoderX264()
 {
+    stopAsync();
+    freeSei(picIn.extra_sei);
+
     if (encoder != NULL){
         x264_encoder_close(encoder);
         encoder = NULL;
@@ -53,6 +68,102 @@ bool VideoEncoderX264::fillPicturePlanes(unsigned char** data, int* linesize)
     return true;
 }
 
+bool VideoEncoderX264::fill_x264or5_picture(VideoFrame* videoFrame)
+{
+    if (!VideoEncoderX264or5::fill_x264or5_picture(videoFrame)) {
+        return false;
+    }
+
+    if (!fillSei(videoFrame)) {
+        return false;
+    }
+
+    //NOTE: the picture points to the planes of the frame, it is kept until the encoding thread is done
+    if (async) {
+        videoFrame->retain();
+        pendingFrame = videoFrame;
+    }
+
+    return true;
+}
+
+//NOTE: captions are written as ATSC A/53 user data registered SEI, which decoders export again as A53 side data
+bool VideoEncoderX264::fillSei(VideoFrame* videoFrame)
+{
+    const FrameSideData &sideData = videoFrame->getSideData();
+    x264_sei_t &sei = picIn.extra_sei;
+    const unsigned char *data;
+    unsigned size;
+    unsigned ccCount;
+    unsigned char *payload;
+
+    freeSei(sei);
+
+    if (!sideData.has(SD_CAPTIONS) && !sideData.has(SD_SEI)) {
+        return true;
+    }
+
+    //NOTE: x264 frees the payloads and their array with sei_free once they are written
+    sei.payloads = (x264_sei_payload_t*) malloc(sideData.getEntries()*sizeof(x264_sei_payload_t));
+    if (!sei.payloads) {
+        utils::errorMsg("X264 Encoder: could not allocate the SEI of the picture");
+        return false;
+    }
+    sei.sei_free = free;
+
+    for (unsigned i = 0; i < sideData.getEntries(); i++) {
+        data = sideData.getData(i);
+        size = sideData.getSize(i);
+
+        if (sideData.getType(i) == SD_CAPTIONS) {
+            ccCount = std::min(size/3, (unsigned) CC_MAX_COUNT);
+            if (ccCount == 0 || !(payload = (unsigned char*) malloc(ccCount*3 + 11))) {
+                continue;
+            }
+            const unsigned char header[] = {0xB5, 0x00, 0x31, 'G', 'A', '9', '4', 0x03,
+                                            (unsigned char) (0x40 | ccCount), 0xFF};
+            memcpy(payload, header, sizeof(header));
+            memcpy(payload + sizeof(header), data, ccCount*3);
+            payload[ccCount*3 + 10] = 0xFF;
+            sei.payloads[sei.num_payloads].payload_type = SEI_USER_DATA_REGISTERED;
+            sei.payloads[sei.num_payloads].payload_size = ccCount*3 + 11;
+        } else if (sideData.getType(i) == SD_SEI) {
+            if (size <= 16 || !(payload = (unsigned char*) malloc(size))) {
+                continue;
+            }
+            memcpy(payload, data, size);
+            sei.payloads[sei.num_payloads].payload_type = SEI_USER_DATA_UNREGISTERED;
+            sei.payloads[sei.num_payloads].payload_size = size;
+        } else {
+            continue;
+        }
+
+        sei.payloads[sei.num_payloads].payload = payload;
+        sei.num_payloads++;
+    }
+
+    return true;
+}
+
+void VideoEncoderX264::freeSei(x264_sei_t &sei)
+{
+    if (sei.sei_free) {
+        for (int i = 0; i < sei.num_payloads; i++) {
+            sei.sei_free(sei.payloads[i].payload);
+        }
+        sei.sei_free(sei.payloads);
+    }
+
+    releaseSei(sei);
+}
+
+void VideoEncoderX264::releaseSei(x264_sei_t &sei)
+{
+    sei.num_payloads = 0;
+    sei.payloads = NULL;
+    sei.sei_free = NULL;
+}
+
 bool VideoEncoderX264::encodeFrame(VideoFrame* codedFrame)
 {
     int success;
@@ -67,15 +178,30 @@ bool VideoEncoderX264::encodeFrame(VideoFrame* codedFrame)
         return false;
     }
 
-    if (forceIntra) {
+    if (async) {
+        return encodeFrameAsync(slicedFrame);
+    }
+
+    picIn.i_type = X264_TYPE_AUTO;
+
+    //NOTE: with intra refresh a new refresh wave is started instead of sending a whole intra frame
+    if (forceIntra && xparams.b_intra_refresh) {
+        x264_encoder_intra_refresh(encoder);
+        forceIntra = false;
+    } else if (forceIntra) {
         picIn.i_type = X264_TYPE_I;
         forceIntra = false;
-    } else {
-        picIn.i_type = X264_TYPE_AUTO;
+    }
+
+    if (subframe) {
+        startSubframe(slicedFrame);
     }
 
     picIn.i_pts = inPts;
     success = x264_encoder_encode(encoder, &nals, &piNal, &picIn, &picOut);
+    //NOTE: the SEI payloads belong to x264 now
+    releaseSei(picIn.extra_sei);
+    subframeFrame = NULL;
 
     if (success < 0) {
         utils::errorMsg("X264 Encoder: Could not encode video frame");
@@ -91,31 +217,399 @@ bool VideoEncoderX264::encodeFrame(VideoFrame* codedFrame)
     outPts = picOut.i_pts;
     dts = picOut.i_dts;
 
-    for (int i = 0; i < piNal; i++) {
+    return setNals(slicedFrame, nals, piNal);
+}
+
+//NOTE: with naluProcess the returned NALs are not valid, the ones not written yet are taken from its buffers
+bool VideoEncoderX264::setNals(SlicedVideoFrame* slicedFrame, x264_nal_t* nals, int piNal)
+{
+    std::vector<SubframeNal*> pending;
+
+    if (!subframe) {
+        for (int i = 0; i < piNal; i++) {
+            if (!slicedFrame->setSlice(nals[i].p_payload, nals[i].i_payload)) {
+                utils::errorMsg("X264 Encoder: too many NALs for one slicedFrame");
+                return false;
+            }
+        }
+
+        return true;
+    }
 
-        if (!slicedFrame->setSlice(nals[i].p_payload, nals[i].i_payload)) {
+    for (unsigned i = 0; i < subframeNalNum; i++) {
+        if (!subframeNals[i].written) {
+            pending.push_back(&subframeNals[i]);
+        }
+    }
+
+    std::stable_sort(pending.begin(), pending.end(), [](const SubframeNal* a, const SubframeNal* b) {
+        return a->beforeSlices != b->beforeSlices ? a->beforeSlices : 
+            a->vcl && b->vcl ? a->firstMb < b->firstMb : a->vcl && !b->vcl;
+    });
+
+    for (auto nal : pending) {
+        if (!slicedFrame->setSlice(nal->data.data(), nal->size)) {
             utils::errorMsg("X264 Encoder: too many NALs for one slicedFrame");
             return false;
         }
+        nal->written = true;
     }
 
     return true;
 }
 
+void VideoEncoderX264::startSubframe(SlicedVideoFrame* slicedFrame)
+{
+    std::shared_ptr<Writer> writer = getWriter(DEFAULT_ID);
+
+    subframeNalNum = 0;
+    nextMb = 0;
+    slicesStarted = false;
+    subframeFrame = slicedFrame;
+    subframePool = WorkersPool::current();
+    subframeQueue = NULL;
+
+    //NOTE: slices are only written early if the coded frame is the input frame of the output queue
+    if (writer && writer->getQueue()) {
+        subframeQueue = dynamic_cast<SlicedVideoFrameQueue*>(writer->getQueue());
+    }
+
+    if (subframeQueue && subframeQueue->forceGetRear() != slicedFrame) {
+        subframeQueue = NULL;
+    }
+
+    setInputTimes(slicedFrame);
+}
+
+//NOTE: called by the slice threads, which may finish in any order
+void VideoEncoderX264::naluProcess(x264_t *h, x264_nal_t *nal, void *opaque)
+{
+    VideoEncoderX264 *encoder = (VideoEncoderX264*) opaque;
+    SubframeNal *subframeNal;
+
+    std::lock_guard<std::mutex> guard(encoder->subframeMtx);
+
+    if (encoder->subframeNalNum == encoder->subframeNals.size()) {
+        encoder->subframeNals.emplace_back();
+    }
+
+    subframeNal = &encoder->subframeNals[encoder->subframeNalNum++];
+    subframeNal->data.resize(nal->i_payload*3/2 + 5 + 64);
+    x264_nal_encode(h, subframeNal->data.data(), nal);
+
+    subframeNal->size = nal->i_payload;
+    subframeNal->firstMb = nal->i_first_mb;
+    subframeNal->lastMb = nal->i_last_mb;
+    subframeNal->vcl = nal->i_type == NAL_SLICE || nal->i_type == NAL_SLICE_IDR;
+    subframeNal->written = false;
+
+    encoder->slicesStarted |= subframeNal->vcl;
+    subframeNal->beforeSlices = !encoder->slicesStarted;
+
+    if (subframeNal->vcl) {
+        encoder->writeSlices();
+    }
+}
+
+//NOTE: slices are written by macroblock order, the first one together with the picture headers so 
+//      the queue types the group from it. The NALs after the last slice are written with the frame
+void VideoEncoderX264::writeSlices()
+{
+    bool found = true;
+    unsigned written = 0;
+
+    if (!subframeFrame || !subframeQueue) {
+        return;
+    }
+
+    while (found) {
+        found = false;
+
+        for (unsigned i = 0; i < subframeNalNum; i++) {
+            SubframeNal &nal = subframeNals[i];
+
+            if (nal.written || !nal.vcl || nal.firstMb != nextMb) {
+                continue;
+            }
+
+            for (unsigned j = 0; nextMb == 0 && j < subframeNalNum; j++) {
+                if (subframeNals[j].beforeSlices && !subframeNals[j].written && 
+                    subframeFrame->setSlice(subframeNals[j].data.data(), subframeNals[j].size)) {
+                    subframeNals[j].written = true;
+                    written++;
+                }
+            }
+
+            if (!subframeFrame->setSlice(nal.data.data(), nal.size)) {
+                break;
+            }
+
+            nal.written = true;
+            nextMb = nal.lastMb + 1;
+            found = true;
+            written++;
+        }
+    }
+
+    if (written == 0) {
+        return;
+    }
+
+    for (auto id : subframeQueue->addSlices()) {
+        if (subframePool) {
+            subframePool->wakeUp(id);
+        }
+    }
+
+    subframeWrites++;
+}
+
+bool VideoEncoderX264::encodeFrameAsync(SlicedVideoFrame* slicedFrame)
+{
+    AsyncJob job;
+    unsigned offset = 0;
+
+    if (pendingFrame) {
+        job.frame = pendingFrame;
+        job.picture = picIn;
+        job.picture.i_type = X264_TYPE_AUTO;
+        job.intraRefresh = false;
+
+        if (forceIntra && xparams.b_intra_refresh) {
+            job.intraRefresh = true;
+            forceIntra = false;
+        } else if (forceIntra) {
+            job.picture.i_type = X264_TYPE_I;
+            forceIntra = false;
+        }
+
+        job.picture.i_pts = inPts;
+        releaseSei(picIn.extra_sei);
+        pendingFrame = NULL;
+        pool = WorkersPool::current();
+
+        if (!encodingThread.joinable()) {
+            encodingThread = std::thread(&VideoEncoderX264::encodingLoop, this);
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(asyncMtx);
+            submitted.push_back(job);
+        }
+        asyncCheck.notify_all();
+
+        inPts++;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(asyncMtx);
+        if (completed.empty()) {
+            return false;
+        }
+
+        written = std::move(completed.front());
+        completed.pop_front();
+    }
+
+    outPts = written.pts;
+    dts = written.dts;
+
+    for (auto size : written.sizes) {
+        if (!slicedFrame->setSlice(written.data.data() + offset, size)) {
+            utils::errorMsg("X264 Encoder: too many NALs for one slicedFrame");
+            return false;
+        }
+        offset += size;
+    }
+
+    return true;
+}
+
+bool VideoEncoderX264::flushFrame(VideoFrame* codedFrame)
+{
+    int success;
+    int piNal;
+    x264_nal_t* nals;
+    SlicedVideoFrame* slicedFrame;
+
+    slicedFrame = dynamic_cast<SlicedVideoFrame*> (codedFrame);
+
+    if (!slicedFrame || !encoder) {
+        return false;
+    }
+
+    //NOTE: the retained picture is submitted and the encoded ones written first. Once drained the 
+    //      encoding thread is idle, so the delayed frames are flushed from the worker
+    if (async) {
+        if (encodeFrameAsync(slicedFrame)) {
+            return true;
+        }
+        drainAsync();
+        if (encodeFrameAsync(slicedFrame)) {
+            return true;
+        }
+    }
+
+    while (x264_encoder_delayed_frames(encoder) > 0) {
+        subframeNalNum = 0;
+        success = x264_encoder_encode(encoder, &nals, &piNal, NULL, &picOut);
+
+        if (success < 0) {
+            utils::errorMsg("X264 Encoder: Could not flush delayed video frame");
+            return false;
+        }
+
+        if (success == 0) {
+            continue;
+        }
+
+        outPts = picOut.i_pts;
+        dts = picOut.i_dts;
+
+        if (!setNals(slicedFrame, nals, piNal)) {
+            return false;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void VideoEncoderX264::encodingLoop()
+{
+    AsyncJob job;
+    AsyncOutput output;
+    x264_picture_t pictureOut;
+    x264_nal_t* nals;
+    int piNal;
+    int success;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(asyncMtx);
+            asyncCheck.wait(guard, [this]{return stopEncoding || !submitted.empty();});
+
+            if (stopEncoding) {
+                return;
+            }
+
+            job = submitted.front();
+            submitted.pop_front();
+            encoding = true;
+        }
+
+        if (job.intraRefresh) {
+            x264_encoder_intra_refresh(encoder);
+        }
+
+        x264_picture_init(&pictureOut);
+        success = x264_encoder_encode(encoder, &nals, &piNal, &job.picture, &pictureOut);
+        FramePool::getInstance()->releaseFrame(job.frame);
+
+        if (success < 0) {
+            utils::errorMsg("X264 Encoder: Could not encode video frame");
+        }
+
+        //NOTE: NALs point to x264 buffers that are reused by the next encode, so they are copied
+        if (success > 0) {
+            output.data.clear();
+            output.sizes.clear();
+            for (int i = 0; i < piNal; i++) {
+                output.data.insert(output.data.end(), nals[i].p_payload, nals[i].p_payload + nals[i].i_payload);
+                output.sizes.push_back(nals[i].i_payload);
+            }
+            output.pts = pictureOut.i_pts;
+            output.dts = pictureOut.i_dts;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(asyncMtx);
+            if (success > 0) {
+                completed.push_back(std::move(output));
+            }
+            encoding = false;
+        }
+        asyncCheck.notify_all();
+
+        if (success > 0 && pool) {
+            pool.load()->wakeUp(getId());
+        }
+    }
+}
+
+void VideoEncoderX264::drainAsync()
+{
+    std::unique_lock<std::mutex> guard(asyncMtx);
+    asyncCheck.wait(guard, [this]{return !encodingThread.joinable() || (submitted.empty() && !encoding);});
+}
+
+void VideoEncoderX264::stopAsync()
+{
+    if (encodingThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(asyncMtx);
+            stopEncoding = true;
+        }
+        asyncCheck.notify_all();
+        encodingThread.join();
+    }
+
+    for (auto job : submitted) {
+        freeSei(job.picture.extra_sei);
+        FramePool::getInstance()->releaseFrame(job.frame);
+    }
+
+    if (pendingFrame) {
+        FramePool::getInstance()->releaseFrame(pendingFrame);
+        pendingFrame = NULL;
+    }
+
+    submitted.clear();
+    completed.clear();
+    stopEncoding = false;
+}
+
+bool VideoEncoderX264::hasPendingOutput()
+{
+    std::lock_guard<std::mutex> guard(asyncMtx);
+    return !completed.empty() || VideoEncoderX264or5::hasPendingOutput();
+}
+
 bool VideoEncoderX264::encodeHeadersFrame()
 {
     int encodeSize;
     int piNal;
     x264_nal_t* nals;
+    x264_param_t headersParams;
+    x264_t* headersEncoder = encoder;
+
+    //NOTE: an encoder with naluProcess does not return its headers, they are taken from a twin encoder without it
+    if (xparams.nalu_process) {
+        headersParams = xparams;
+        headersParams.nalu_process = NULL;
+        headersEncoder = x264_encoder_open(&headersParams);
+    }
 
-    encodeSize = x264_encoder_headers(encoder, &nals, &piNal);
+    if (!headersEncoder) {
+        utils::errorMsg("Could not open x264 encoder for the headers");
+        return false;
+    }
+
+    encodeSize = x264_encoder_headers(headersEncoder, &nals, &piNal);
+
+    if (encodeSize >= 0) {
+        outputStreamInfo->setExtraData(nals[0].p_payload, encodeSize);
+    }
+
+    if (headersEncoder != encoder) {
+        x264_encoder_close(headersEncoder);
+    }
 
     if (encodeSize < 0) {
         utils::errorMsg("Could not encode headers");
         return false;
     }
-       
-    outputStreamInfo->setExtraData(nals[0].p_payload, encodeSize);
 
     return true;
 }
@@ -134,6 +628,9 @@ bool VideoEncoderX264::reconfigure(VideoFrame* orgFrame, VideoFrame* dstFrame)
         return true;
     }
 
+    //NOTE: the encoding thread must be idle while the encoder is reconfigured or opened again
+    drainAsync();
+
     inPixFmt = orgFrame->getPixelFormat();
     switch (inPixFmt) {
         case YUV420P:
@@ -157,27 +654,47 @@ bool VideoEncoderX264::reconfigure(VideoFrame* orgFrame, VideoFrame* dstFrame)
     }
 
     picIn.img.i_csp = colorspace;
-    x264_param_default_preset(&xparams, preset.c_str(), NULL);
+    x264_param_default_preset(&xparams, preset.c_str(), lowLatency ? "zerolatency" : NULL);
     x264_param_apply_profile(&xparams, "high");
 
     x264_param_parse(&xparams, "keyint", std::to_string(gop).c_str());
     x264_param_parse(&xparams, "fps", std::to_string(fps).c_str());
-    x264_param_parse(&xparams, "intra-refresh", std::to_string(0).c_str());
-    x264_param_parse(&xparams, "threads", std::to_string(threads).c_str());
+    x264_param_parse(&xparams, "threads", std::to_string(codecThreads()).c_str());
     x264_param_parse(&xparams, "aud", std::to_string(1).c_str());
-    x264_param_parse(&xparams, "bitrate", std::to_string(bitrate).c_str());
-    x264_param_parse(&xparams, "bframes", std::to_string(bFrames).c_str());
+    x264_param_parse(&xparams, "bitrate", std::to_string(activeBitrate).c_str());
     x264_param_parse(&xparams, "repeat-headers", std::to_string(0).c_str());
-    x264_param_parse(&xparams, "vbv-maxrate", std::to_string(bitrate*1.05).c_str());
-    x264_param_parse(&xparams, "vbv-bufsize", std::to_string(bitrate*2).c_str());
-    x264_param_parse(&xparams, "rc-lookahead", std::to_string(lookahead).c_str());
     x264_param_parse(&xparams, "scenecut", std::to_string(0).c_str());
 
+    //NOTE: in low latency mode each frame is output by the same call encoding it, its slices are
+    //      encoded in parallel and the intra refresh column spreads the keyframe cost over the gop
+    if (lowLatency) {
+        x264_param_parse(&xparams, "sliced-threads", std::to_string(1).c_str());
+        x264_param_parse(&xparams, "sync-lookahead", std::to_string(0).c_str());
+        x264_param_parse(&xparams, "intra-refresh", std::to_string(1).c_str());
+        x264_param_parse(&xparams, "bframes", std::to_string(0).c_str());
+        x264_param_parse(&xparams, "rc-lookahead", std::to_string(0).c_str());
+        x264_param_parse(&xparams, "vbv-maxrate", std::to_string(activeBitrate).c_str());
+        x264_param_parse(&xparams, "vbv-bufsize", std::to_string(std::max(activeBitrate/fps, 1u)).c_str());
+    } else {
+        x264_param_parse(&xparams, "intra-refresh", std::to_string(0).c_str());
+        x264_param_parse(&xparams, "bframes", std::to_string(bFrames).c_str());
+        x264_param_parse(&xparams, "rc-lookahead", std::to_string(lookahead).c_str());
+        x264_param_parse(&xparams, "vbv-maxrate", std::to_string(activeBitrate*1.05).c_str());
+        x264_param_parse(&xparams, "vbv-bufsize", std::to_string(activeBitrate*2).c_str());
+    }
+
     if (outputStreamInfo->video.h264or5.annexb) {
         x264_param_parse(&xparams, "repeat-headers", std::to_string(1).c_str());
         x264_param_parse(&xparams, "annexb", std::to_string(1).c_str());
     }
 
+    //NOTE: x264 does not reconfigure the callback, the encoder is opened again to change it
+    xparams.nalu_process = lowLatency && !async ? naluProcess : NULL;
+    if (encoder != NULL && subframe != (xparams.nalu_process != NULL)) {
+        x264_encoder_close(encoder);
+        encoder = NULL;
+    }
+
     if (orgFrame->getWidth() != xparams.i_width || orgFrame->getHeight() != xparams.i_height) {
         xparams.i_width = orgFrame->getWidth();
         xparams.i_height = orgFrame->getHeight();
@@ -202,7 +719,64 @@ bool VideoEncoderX264::reconfigure(VideoFrame* orgFrame, VideoFrame* dstFrame)
     }
 
     needsConfig = false;
+    subframe = xparams.nalu_process != NULL;
    
     return encodeHeadersFrame();
 
 }
+
+bool VideoEncoderX264::configAsync0(bool async_)
+{
+    if (async && !async_) {
+        drainAsync();
+        stopAsync();
+    }
+
+    //NOTE: slices are only written early by synchronous encoders, see reconfigure
+    if (lowLatency && async != async_) {
+        needsConfig = true;
+    }
+
+    async = async_;
+    return true;
+}
+
+bool VideoEncoderX264::configAsyncEvent(Jzon::Node* params)
+{
+    bool tmpAsync = async;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("async")) {
+        tmpAsync = params->Get("async").ToBool();
+    }
+
+    return configAsync0(tmpAsync);
+}
+
+void VideoEncoderX264::initializeEventMap()
+{
+    eventMap["configAsync"] = std::bind(&VideoEncoderX264::configAsyncEvent, this, std::placeholders::_1);
+}
+
+void VideoEncoderX264::doGetState(Jzon::Object &filterNode)
+{
+    VideoEncoderX264or5::doGetState(filterNode);
+    filterNode.Add("async", async);
+    filterNode.Add("subframe", subframe);
+    filterNode.Add("subframeWrites", (int) subframeWrites);
+}
+
+bool VideoEncoderX264::configAsync(bool async)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configAsync");
+    params.Add("async", async);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
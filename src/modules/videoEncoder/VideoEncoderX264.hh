@@ -27,35 +27,124 @@
 
 #include "VideoEncoderX264or5.hh"
 #include <stdint.h>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include "../../Utils.hh"
 #include "../../VideoFrame.hh"
 #include "../../Filter.hh"
 #include "../../FrameQueue.hh"
+#include "../../SlicedVideoFrameQueue.hh"
 #include "../../Types.hh"
+#include "../../WorkersPool.hh"
 
 extern "C" {
 #include <x264.h>
 }
 
+#define DEFAULT_ASYNC_ENCODING false
+
+/*! H264 encoder based on x264. In asynchronous mode input frames are retained and submitted to an
+*   encoding thread, so the worker processing the filter does not wait for x264 (lookahead and frame
+*   threads included) and the input slot is released right away. Encoded frames are kept in a
+*   completion queue and the filter is woken up to write them, see BaseFilter::hasPendingOutput.
+*   In synchronous low latency mode each slice is written to the output queue as soon as its slice
+*   thread finishes it (see x264_param_t::nalu_process), so readers send it while the rest is encoded.
+*/
 class VideoEncoderX264 : public VideoEncoderX264or5 {
 
 public:
     VideoEncoderX264();
     ~VideoEncoderX264();
 
+    /**
+    * Enables or disables the asynchronous encoding. Frames already submitted are encoded before
+    * disabling it, encoded frames still not written are discarded
+    * @param async true to encode in a dedicated thread
+    */
+    bool configAsync(bool async);
+
 private:
+    struct AsyncJob {
+        VideoFrame *frame;          //!< Retained input frame, the picture points to its planes
+        x264_picture_t picture;
+        bool intraRefresh;
+    };
+
+    struct AsyncOutput {
+        std::vector<unsigned char> data;    //!< Payload of all the NALs, one after the other
+        std::vector<unsigned> sizes;
+        int64_t pts;
+        int64_t dts;
+    };
+
+    struct SubframeNal {
+        std::vector<unsigned char> data;    //!< Encapsulated NAL, the coded frame points to it
+        unsigned size;
+        int firstMb;
+        int lastMb;
+        bool vcl;
+        bool beforeSlices;                  //!< Picture headers, written before the first slice
+        bool written;
+    };
+
     FrameQueue* allocQueue(ConnectionData cData);
     void initializeEventMap();
+    bool configAsyncEvent(Jzon::Node* params);
+    bool configAsync0(bool async_);
+    void doGetState(Jzon::Object &filterNode);
+    bool hasPendingOutput();
 
     x264_picture_t picIn;
     x264_picture_t picOut;
     x264_param_t xparams;
     x264_t* encoder;
 
+    bool fill_x264or5_picture(VideoFrame* videoFrame);
     bool fillPicturePlanes(unsigned char** data, int* linesize);
+    bool fillSei(VideoFrame* videoFrame);
+    void freeSei(x264_sei_t &sei);
+    void releaseSei(x264_sei_t &sei);
     bool encodeFrame(VideoFrame* codedFrame);
+    bool encodeFrameAsync(SlicedVideoFrame* slicedFrame);
+    bool flushFrame(VideoFrame* codedFrame);
     bool reconfigure(VideoFrame *orgFrame, VideoFrame* dstFrame);
     bool encodeHeadersFrame();
+    bool setNals(SlicedVideoFrame* slicedFrame, x264_nal_t* nals, int piNal);
+
+    static void naluProcess(x264_t *h, x264_nal_t *nal, void *opaque);
+    void startSubframe(SlicedVideoFrame* slicedFrame);
+    void writeSlices();
+
+    void encodingLoop();
+    void drainAsync();
+    void stopAsync();
+
+    bool async;
+    VideoFrame *pendingFrame;               //!< Retained frame of the picture to be submitted
+    std::thread encodingThread;
+    std::mutex asyncMtx;
+    std::condition_variable asyncCheck;
+    std::deque<AsyncJob> submitted;
+    std::deque<AsyncOutput> completed;
+    AsyncOutput written;                    //!< Output being written, the queue copies its NALs
+    bool encoding;
+    bool stopEncoding;
+    std::atomic<WorkersPool*> pool;
+
+    bool subframe;                          //!< The open encoder outputs its NALs through naluProcess
+    std::mutex subframeMtx;
+    std::deque<SubframeNal> subframeNals;   //!< NALs of the picture being encoded, by completion order
+    unsigned subframeNalNum;
+    int nextMb;                             //!< First macroblock of the next slice to be written
+    bool slicesStarted;
+    SlicedVideoFrame *subframeFrame;
+    SlicedVideoFrameQueue *subframeQueue;
+    WorkersPool *subframePool;
+    size_t subframeWrites;                  //!< Slice groups written before their picture was complete
 };
 
 #endif
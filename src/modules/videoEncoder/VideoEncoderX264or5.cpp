@@ -22,10 +22,15 @@
  */
 
 #include "VideoEncoderX264or5.hh"
+#include "../../ThreadBudget.hh"
+#include "../../FramePool.hh"
+#include <algorithm>
 
 VideoEncoderX264or5::VideoEncoderX264or5() :
-OneToOneFilter(), inPixFmt(P_NONE), forceIntra(false), fps(0), bitrate(0), gop(0), 
-    threads(0), bFrames(0), needsConfig(false), inPts(0), outPts(0), dts(0)
+OneToOneFilterT(), inPixFmt(P_NONE), forceIntra(false), fps(0), bitrate(0), gop(0), 
+    threads(0), bFrames(0), needsConfig(false), lowLatency(false), inPts(0), outPts(0), dts(0),
+    activeThreads(0), budgetGeneration(0), activeBitrate(0), outWidth(0), outHeight(0), inWidth(0), inHeight(0), 
+    inFormatVersion(0), adaptive(false), minBitrate(DEFAULT_MIN_ADAPTIVE_BITRATE), forcedKeyFrameTime(0)
 {
     fType = VIDEO_ENCODER;
     midFrame = av_frame_alloc();
@@ -38,68 +43,231 @@ OneToOneFilter(), inPixFmt(P_NONE), forceIntra(false), fps(0), bitrate(0), gop(0
 
 VideoEncoderX264or5::~VideoEncoderX264or5()
 {
+    ThreadBudget::getInstance()->leave(this);
+    for (auto frame : held) {
+        FramePool::getInstance()->releaseFrame(frame);
+    }
     if (midFrame){
         av_frame_free(&midFrame);
     }
 }
 
-bool VideoEncoderX264or5::doProcessFrame(Frame *org, Frame *dst)
+bool VideoEncoderX264or5::doProcessFrame(VideoFrame *rawFrame, VideoFrame *codedFrame)
 {
-    FrameTimeParams frameTP;
-    
-    if (!(org && dst)) {
+    if (!(rawFrame && codedFrame)) {
         utils::errorMsg("Error encoding video frame: org or dst are NULL");
         return false;
     }
 
-    VideoFrame* rawFrame = dynamic_cast<VideoFrame*> (org);
-    VideoFrame* codedFrame = dynamic_cast<VideoFrame*> (dst);
-
-    if (!rawFrame || !codedFrame) {
-        utils::errorMsg("Error encoding video frame: org and dst MUST be VideoFrame");
+    //NOTE: x264 and x265 encode from host memory, a VideoResampler downloads the surfaces once
+    if (rawFrame->getPixelFormat() == HW_SURFACE && !acceptsSurfaces()) {
+        utils::errorMsg("Error encoding video frame: hardware surfaces must be downloaded by a resampler");
         return false;
     }
 
-    //TODO: recofigure with estimated fps
-    if (!reconfigure(rawFrame, codedFrame)) {
-        utils::errorMsg("Error encoding video frame: reconfigure failed");
-        return false;
+    //NOTE: the encoder is opened again with its new share of the thread budget, starting with an IDR
+    if (budgetGeneration != ThreadBudget::getInstance()->getGeneration()) {
+        budgetGeneration = ThreadBudget::getInstance()->getGeneration();
+        if (ThreadBudget::getInstance()->getThreads(this) != activeThreads) {
+            needsConfig = true;
+        }
+    }
+
+    if (adaptive) {
+        adaptBitrate();
+    }
+
+    //NOTE: an origin frame not consumed means that an asynchronous encoder woke the filter up
+    //      to write its pending output, there is no new input to submit
+    if (!rawFrame->getConsumed()) {
+        return encodeInput(NULL, codedFrame);
+    }
+
+    //NOTE: from the first frame of a new input format on, input frames are retained in order until
+    //      the encoder has written the frames it delayed
+    if (!held.empty() || newFormat(rawFrame)) {
+        rawFrame->retain();
+        held.push_back(rawFrame);
+        return encodeInput(NULL, codedFrame);
+    }
+
+    followReaderKeyFrames(rawFrame);
+    return encodeInput(rawFrame, codedFrame);
+}
+
+void VideoEncoderX264or5::followReaderKeyFrames(VideoFrame* rawFrame)
+{
+    std::shared_ptr<Writer> writer = getWriter(DEFAULT_ID);
+    std::chrono::microseconds keyFrameTime;
+
+    if (!writer || !writer->getQueue()) {
+        return;
+    }
+
+    keyFrameTime = writer->getQueue()->getReaderKeyFrameTime();
+
+    //NOTE: the reader publishes the next time once it has the forced frame, it is only forced once
+    if (keyFrameTime.count() > 0 && keyFrameTime != forcedKeyFrameTime && 
+        rawFrame->getPresentationTime() >= keyFrameTime) {
+        forcedKeyFrameTime = keyFrameTime;
+        setIntra();
+    }
+}
+
+bool VideoEncoderX264or5::encodeInput(VideoFrame *rawFrame, VideoFrame *codedFrame)
+{
+    FrameTimeParams frameTP;
+    VideoFrame *heldFrame = NULL;
+    bool submitted = true;
+    bool encoded;
+
+    if (!rawFrame && !held.empty()) {
+        if (newFormat(held.front()) && flushFrame(codedFrame)) {
+            setEncodedTimes(codedFrame);
+            return true;
+        }
+
+        heldFrame = held.front();
+        held.pop_front();
+        rawFrame = heldFrame;
+    }
+
+    if (rawFrame) {
+        //TODO: recofigure with estimated fps
+        if (!reconfigure(rawFrame, codedFrame)) {
+            utils::errorMsg("Error encoding video frame: reconfigure failed");
+            submitted = false;
+        } else if (!fill_x264or5_picture(rawFrame)) {
+            utils::errorMsg("Could not fill x264_picture_t from frame");
+            submitted = false;
+        } else {
+            inWidth = rawFrame->getWidth();
+            inHeight = rawFrame->getHeight();
+            inFormatVersion = rawFrame->getFormatVersion();
+
+            frameTP.pTime = rawFrame->getPresentationTime();
+            frameTP.oTime = rawFrame->getOriginTime();
+            frameTP.seqNum = rawFrame->getSequenceNumber();
+            frameTP.sideData = rawFrame->getSideData();
+            qFTP[inPts] = frameTP;
+        }
+
     }
 
-    if (!fill_x264or5_picture(rawFrame)){
-        utils::errorMsg("Could not fill x264_picture_t from frame");
+    encoded = submitted && encodeFrame(codedFrame);
+
+    //NOTE: the picture has been encoded, or retained by an asynchronous encoder (see fill_x264or5_picture)
+    if (heldFrame) {
+        FramePool::getInstance()->releaseFrame(heldFrame);
+    }
+
+    if (!submitted) {
         return false;
     }
     
-    frameTP.pTime = org->getPresentationTime();
-    frameTP.oTime = org->getOriginTime();
-    frameTP.seqNum = org->getSequenceNumber();
-    qFTP[inPts] = frameTP;
-    
-    if (!encodeFrame(codedFrame)) {
+    if (!encoded) {
         utils::warningMsg("Could not encode video frame");
         return false;
     }
 
-    codedFrame->setSize(rawFrame->getWidth(), rawFrame->getHeight());
+    outWidth = inWidth;
+    outHeight = inHeight;
     
-    dst->setConsumed(true);
-    dst->setPresentationTime(qFTP[outPts].pTime);
-    dst->setDecodeTime(qFTP[dts].pTime);
-    dst->setOriginTime(qFTP[outPts].oTime);
-    dst->setSequenceNumber(qFTP[outPts].seqNum);
+    setEncodedTimes(codedFrame);
     
-    qFTP.erase(dts);
+    return true;
+}
+
+//NOTE: the input has ended, the frames delayed by lookahead and B frames are written one per call
+bool VideoEncoderX264or5::drainFrame(VideoFrame *codedFrame)
+{
+    //NOTE: retained input frames are encoded first, the call does not always write a frame then
+    if (!held.empty()) {
+        encodeInput(NULL, codedFrame);
+        return true;
+    }
+
+    if (!flushFrame(codedFrame)) {
+        return false;
+    }
+    
+    setEncodedTimes(codedFrame);
     
     return true;
 }
 
-//TODO: this should be done without libav
+//NOTE: the delayed frames are only drained when the picture changes, e.g. not for a new crop of the same size
+bool VideoEncoderX264or5::newFormat(VideoFrame* rawFrame)
+{
+    return inWidth > 0 && rawFrame->getFormatVersion() != inFormatVersion &&
+           (rawFrame->getWidth() != (int) inWidth || rawFrame->getHeight() != (int) inHeight || 
+            rawFrame->getPixelFormat() != inPixFmt);
+}
+
+//NOTE: retained frames are encoded without new input, unless the output is blocked
+bool VideoEncoderX264or5::pendingJobs()
+{
+    return OneToOneFilterT::pendingJobs() || (!held.empty() && !stalled());
+}
+
+void VideoEncoderX264or5::setEncodedTimes(VideoFrame* codedFrame)
+{
+    codedFrame->setSize(outWidth, outHeight);
+    
+    codedFrame->setConsumed(true);
+    codedFrame->setPresentationTime(qFTP[outPts].pTime);
+    codedFrame->setDecodeTime(qFTP[dts].pTime);
+    codedFrame->setOriginTime(qFTP[outPts].oTime);
+    codedFrame->setSequenceNumber(qFTP[outPts].seqNum);
+    codedFrame->getSideData() = qFTP[outPts].sideData;
+    
+    qFTP.erase(dts);
+}
+
+void VideoEncoderX264or5::setInputTimes(VideoFrame* codedFrame)
+{
+    std::map<int64_t, FrameTimeParams>::iterator it = qFTP.find(inPts);
+
+    if (it == qFTP.end()) {
+        return;
+    }
+
+    codedFrame->setSize(inWidth, inHeight);
+    codedFrame->setPresentationTime(it->second.pTime);
+    codedFrame->setDecodeTime(it->second.pTime);
+    codedFrame->setOriginTime(it->second.oTime);
+    codedFrame->setSequenceNumber(it->second.seqNum);
+    codedFrame->getSideData() = it->second.sideData;
+}
+
+void VideoEncoderX264or5::adaptBitrate()
+{
+    std::shared_ptr<Writer> writer = getWriter(DEFAULT_ID);
+    unsigned target = bitrate;
+    unsigned step;
+
+    if (writer && writer->getQueue() && writer->getQueue()->getReaderBitrate() > 0) {
+        target = std::min(bitrate, std::max(writer->getQueue()->getReaderBitrate(), minBitrate));
+    }
+
+    //NOTE: small changes are not applied, the encoder might be opened again with an IDR
+    step = target > activeBitrate ? target - activeBitrate : activeBitrate - target;
+    if (step > 0 && (target == bitrate || step*100 >= activeBitrate*ADAPTIVE_BITRATE_STEP)) {
+        activeBitrate = target;
+        needsConfig = true;
+    }
+}
+
+unsigned VideoEncoderX264or5::codecThreads()
+{
+    activeThreads = std::max(ThreadBudget::getInstance()->getThreads(this), 1u);
+    return activeThreads;
+}
+
+//NOTE: planar frames lines are aligned, so their planes are passed to the encoder in place
 bool VideoEncoderX264or5::fill_x264or5_picture(VideoFrame* videoFrame)
 {
-    if (av_image_fill_arrays(midFrame->data, midFrame->linesize, videoFrame->getDataBuf(),
-            (AVPixelFormat) libavInPixFmt, videoFrame->getWidth(),
-            videoFrame->getHeight(), 1) <= 0){
+    if (videoFrame->getPlanes(midFrame->data, midFrame->linesize) == 0){
         utils::errorMsg("Could not feed AVFrame");
         return false;
     }
@@ -114,7 +282,7 @@ bool VideoEncoderX264or5::fill_x264or5_picture(VideoFrame* videoFrame)
 
 bool VideoEncoderX264or5::configure0(unsigned bitrate_, unsigned fps_, unsigned gop_, 
                                      unsigned lookahead_, unsigned bFrames_, unsigned threads_, 
-                                     bool annexB_, std::string preset_)
+                                     bool annexB_, std::string preset_, bool lowLatency_)
 {
     if (bitrate_ <= 0 || gop_ <= 0 || lookahead_ < 0 || threads_ <= 0 || preset_.empty()) {
         utils::errorMsg("Error configuring VideoEncoderX264or5: invalid configuration values");
@@ -122,10 +290,13 @@ bool VideoEncoderX264or5::configure0(unsigned bitrate_, unsigned fps_, unsigned
     }
 
     bitrate = bitrate_;
+    activeBitrate = bitrate_;
     gop = gop_;
     lookahead = lookahead_;
     threads = threads_;
     bFrames = bFrames_;
+    ThreadBudget::getInstance()->join(this, threads);
+    lowLatency = lowLatency_;
 
     outputStreamInfo->video.h264or5.annexb = annexB_;
     preset = preset_;
@@ -151,6 +322,7 @@ bool VideoEncoderX264or5::configEvent(Jzon::Node* params)
     unsigned tmpThreads;
     unsigned tmpBFrames;
     bool tmpAnnexB;
+    bool tmpLowLatency;
     std::string tmpPreset;
 
     if (!params) {
@@ -165,6 +337,7 @@ bool VideoEncoderX264or5::configEvent(Jzon::Node* params)
     tmpAnnexB = outputStreamInfo->video.h264or5.annexb;
     tmpPreset = preset;
     tmpBFrames = bFrames;
+    tmpLowLatency = lowLatency;
 
     if (params->Has("bitrate")) {
         tmpBitrate = params->Get("bitrate").ToInt();
@@ -198,7 +371,52 @@ bool VideoEncoderX264or5::configEvent(Jzon::Node* params)
         tmpPreset = params->Get("preset").ToString();
     }
 
-    return configure0(tmpBitrate, tmpFps, tmpGop, tmpLookahead, tmpBFrames, tmpThreads, tmpAnnexB, tmpPreset);
+    if (params->Has("lowLatency")) {
+        tmpLowLatency = params->Get("lowLatency").ToBool();
+    }
+
+    return configure0(tmpBitrate, tmpFps, tmpGop, tmpLookahead, tmpBFrames, tmpThreads, tmpAnnexB, tmpPreset, tmpLowLatency);
+}
+
+bool VideoEncoderX264or5::configAdaptiveBitrate0(bool adaptive_, unsigned minBitrate_)
+{
+    if (minBitrate_ <= 0) {
+        utils::errorMsg("Error configuring VideoEncoderX264or5: invalid minimum bitrate");
+        return false;
+    }
+
+    adaptive = adaptive_;
+    minBitrate = minBitrate_;
+
+    if (!adaptive && activeBitrate != bitrate) {
+        activeBitrate = bitrate;
+        needsConfig = true;
+    }
+
+    return true;
+}
+
+bool VideoEncoderX264or5::configAdaptiveBitrateEvent(Jzon::Node* params)
+{
+    bool tmpAdaptive;
+    unsigned tmpMinBitrate;
+
+    if (!params) {
+        return false;
+    }
+
+    tmpAdaptive = adaptive;
+    tmpMinBitrate = minBitrate;
+
+    if (params->Has("adaptive")) {
+        tmpAdaptive = params->Get("adaptive").ToBool();
+    }
+
+    if (params->Has("minBitrate")) {
+        tmpMinBitrate = params->Get("minBitrate").ToInt();
+    }
+
+    return configAdaptiveBitrate0(tmpAdaptive, tmpMinBitrate);
 }
 
 bool VideoEncoderX264or5::forceIntraEvent(Jzon::Node*)
@@ -211,6 +429,7 @@ void VideoEncoderX264or5::initializeEventMap()
 {
     eventMap["forceIntra"] = std::bind(&VideoEncoderX264or5::forceIntraEvent, this, std::placeholders::_1);
     eventMap["configure"] = std::bind(&VideoEncoderX264or5::configEvent, this, std::placeholders::_1);
+    eventMap["configAdaptiveBitrate"] = std::bind(&VideoEncoderX264or5::configAdaptiveBitrateEvent, this, std::placeholders::_1);
 }
 
 void VideoEncoderX264or5::doGetState(Jzon::Object &filterNode)
@@ -220,12 +439,18 @@ void VideoEncoderX264or5::doGetState(Jzon::Object &filterNode)
     filterNode.Add("gop", (int) gop);
     filterNode.Add("lookahead", (int) lookahead);
     filterNode.Add("threads", (int) threads);
+    filterNode.Add("activeThreads", (int) activeThreads);
     filterNode.Add("annexb", outputStreamInfo->video.h264or5.annexb);
     filterNode.Add("bframes", (int) bFrames);
     filterNode.Add("preset", preset);
+    filterNode.Add("lowLatency", lowLatency);
+    filterNode.Add("adaptive", adaptive);
+    filterNode.Add("minBitrate", (int) minBitrate);
+    filterNode.Add("activeBitrate", (int) activeBitrate);
 }
 
-bool VideoEncoderX264or5::configure(int bitrate, int fps, int gop, int lookahead, int bFrames, int threads, bool annexB, std::string preset)
+bool VideoEncoderX264or5::configure(int bitrate, int fps, int gop, int lookahead, int bFrames, int threads, bool annexB, std::string preset,
+                                    bool lowLatency)
 {
     Jzon::Object root, params;
     root.Add("action", "configure");
@@ -237,6 +462,7 @@ bool VideoEncoderX264or5::configure(int bitrate, int fps, int gop, int lookahead
     params.Add("threads", threads);
     params.Add("annexb", annexB);
     params.Add("preset", preset);
+    params.Add("lowLatency", lowLatency);
     root.Add("params", params);
 
     Event e(root, std::chrono::system_clock::now(), 0);
@@ -244,3 +470,16 @@ bool VideoEncoderX264or5::configure(int bitrate, int fps, int gop, int lookahead
     return true;
 }
 
+
+bool VideoEncoderX264or5::configAdaptiveBitrate(bool adaptive, int minBitrate)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configAdaptiveBitrate");
+    params.Add("adaptive", adaptive);
+    params.Add("minBitrate", minBitrate);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
@@ -26,6 +26,7 @@
 
 #include <stdint.h>
 #include <chrono>
+#include <deque>
 #include "../../Utils.hh"
 #include "../../VideoFrame.hh"
 #include "../../Filter.hh"
@@ -46,10 +47,18 @@ extern "C" {
 #define DEFAULT_ANNEXB true
 #define DEFAULT_B_FRAMES 4
 #define DEFAULT_PRESET "ultrafast"
+#define DEFAULT_LOW_LATENCY false
+#define DEFAULT_MIN_ADAPTIVE_BITRATE 200    //!< Lower bound in kbps of the network driven bitrate
+#define ADAPTIVE_BITRATE_STEP 10            //!< Percentage of change needed to apply a network driven bitrate
 
-/*! Base class for VideoEncoderX264 and VideoEncoderX265. It implements common methods, basically configure and doProcessFrame */
+/*! Base class for VideoEncoderX264 and VideoEncoderX265. It implements common methods, basically configure and doProcessFrame.
+*   When the input announces a new picture size or pixel format (see StreamInfo::changeFormat) the frames delayed
+*   by the encoder are written before it is opened again, the input frames are retained meanwhile so none is dropped.
+*   If the reader publishes the time of its next keyframe (e.g. a Dasher segment boundary, see 
+*   FrameQueue::setReaderKeyFrameTime), the first input frame reaching it is forced to be intra, so the GOP can
+*   be much longer than the segments. */
 
-class VideoEncoderX264or5 : public OneToOneFilter {
+class VideoEncoderX264or5 : public OneToOneFilterT<VideoFrame, VideoFrame> {
     
 public:
     /**
@@ -62,7 +71,30 @@ public:
     */
     virtual ~VideoEncoderX264or5();
 
-    bool configure(int bitrate, int fps, int gop, int lookahead, int bFrames, int threads, bool annexB, std::string preset);
+    /**
+    * Configures the encoder
+    * @param bitrate target bitrate in kbps
+    * @param fps output frames per second, 0 follows the input
+    * @param gop frames between IDRs, or intra refresh period in low latency mode
+    * @param lookahead rate control lookahead in frames
+    * @param bFrames maximum consecutive B-frames
+    * @param threads maximum encoder threads, they are allocated from the process ThreadBudget
+    * @param annexB if true NALs are delimited with start codes
+    * @param preset encoder preset
+    * @param lowLatency if true frames are output without delay: sliced threads, periodic intra refresh
+    * instead of IDRs, no lookahead nor B-frames and a VBV of one frame. Lookahead and B-frames are ignored
+    */
+    bool configure(int bitrate, int fps, int gop, int lookahead, int bFrames, int threads, bool annexB, std::string preset,
+                   bool lowLatency = DEFAULT_LOW_LATENCY);
+
+    /**
+    * Enables or disables the network driven bitrate. When enabled the encoder bitrate and VBV follow the
+    * bitrate published by its reader (see FrameQueue::setReaderBitrate), e.g. estimated by a transmitter
+    * from the RTCP receiver reports, without exceeding the configured bitrate
+    * @param adaptive true to follow the reader bitrate
+    * @param minBitrate lower bound of the encoder bitrate in kbps
+    */
+    bool configAdaptiveBitrate(bool adaptive, int minBitrate = DEFAULT_MIN_ADAPTIVE_BITRATE);
     
 protected:
     AVPixelFormat libavInPixFmt;
@@ -77,27 +109,63 @@ protected:
     unsigned lookahead;
     unsigned bFrames;
     bool needsConfig;
+    bool lowLatency;
     std::string preset;
     int64_t inPts;
     int64_t outPts;
     int64_t dts;
+    unsigned activeThreads;
+    unsigned budgetGeneration;
+    unsigned activeBitrate;         //!< Bitrate applied to the encoder, the configured one unless it is adaptive
 
     StreamInfo *outputStreamInfo;
     
-    bool doProcessFrame(Frame *org, Frame *dst);
+    bool doProcessFrame(VideoFrame *rawFrame, VideoFrame *codedFrame);
+    bool drainFrame(VideoFrame *codedFrame);
     void initializeEventMap();      
     virtual bool fillPicturePlanes(unsigned char** data, int* linesize) = 0;
     virtual bool encodeFrame(VideoFrame* codedFrame) = 0;
+    /**
+    * Writes the next frame delayed by the encoder once the input has ended
+    * @param codedFrame destination frame
+    * @return false if there are no more delayed frames
+    */
+    virtual bool flushFrame(VideoFrame* /*codedFrame*/) {return false;};
     virtual bool reconfigure(VideoFrame* orgFrame, VideoFrame* dstFrame) = 0;
     void setIntra(){forceIntra = true;};
-    bool fill_x264or5_picture(VideoFrame* videoFrame);
+    /**
+    * Stamps the coded frame with the times and metadata of the picture being encoded, for encoders 
+    * writing its slices before it is complete (no reordering, so decode and presentation times match)
+    * @param codedFrame destination frame
+    */
+    void setInputTimes(VideoFrame* codedFrame);
+    
+    /**
+    * Gets the encoder threads from the thread budget, to be called when opening the encoder
+    * @return the share of the thread budget of the encoder
+    */
+    unsigned codecThreads();
+    virtual bool fill_x264or5_picture(VideoFrame* videoFrame);
+    //NOTE: encoders accepting hardware surfaces (see HardwareVideoFrame) override it
+    virtual bool acceptsSurfaces() {return false;};
 
-    bool configure0(unsigned bitrate_, unsigned fps_, unsigned gop_, unsigned lookahead_, unsigned bFrames_, unsigned threads_, bool annexB_, std::string preset_);
+    void doGetState(Jzon::Object &filterNode);
+    bool hasPendingOutput() {return !held.empty();};
+    bool pendingJobs();
+
+    bool configure0(unsigned bitrate_, unsigned fps_, unsigned gop_, unsigned lookahead_, unsigned bFrames_, unsigned threads_, 
+                    bool annexB_, std::string preset_, bool lowLatency_ = DEFAULT_LOW_LATENCY);
     
 private:
     bool forceIntraEvent(Jzon::Node* params);
     bool configEvent(Jzon::Node* params);
-    void doGetState(Jzon::Object &filterNode);
+    bool configAdaptiveBitrateEvent(Jzon::Node* params);
+    bool configAdaptiveBitrate0(bool adaptive_, unsigned minBitrate_);
+    void adaptBitrate();
+    void followReaderKeyFrames(VideoFrame* rawFrame);
+    void setEncodedTimes(VideoFrame* codedFrame);
+    bool newFormat(VideoFrame* rawFrame);
+    bool encodeInput(VideoFrame *rawFrame, VideoFrame *codedFrame);
     
     //There is no need of specific reader configuration
     bool specificReaderConfig(int /*readerID*/, FrameQueue* /*queue*/)  {return true;};
@@ -111,9 +179,19 @@ private:
         std::chrono::microseconds pTime;
         std::chrono::system_clock::time_point oTime;
         size_t seqNum;
+        FrameSideData sideData;
     };
     
     std::map<int64_t, FrameTimeParams> qFTP;
+    unsigned outWidth;
+    unsigned outHeight;
+    unsigned inWidth;                   //!< Picture size of the last submitted input frame
+    unsigned inHeight;
+    unsigned inFormatVersion;           //!< Format version of the last submitted input frame
+    std::deque<VideoFrame*> held;       //!< Retained input frames, waiting for the encoder to be drained
+    bool adaptive;
+    unsigned minBitrate;
+    std::chrono::microseconds forcedKeyFrameTime;   //!< Last reader keyframe time an intra frame was forced for
 };
 
 #endif
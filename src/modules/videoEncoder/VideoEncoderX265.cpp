@@ -23,6 +23,7 @@
  */
 
 #include <cmath>
+#include <algorithm>
 #include "VideoEncoderX265.hh"
 #include "../../SlicedVideoFrameQueue.hh"
 
@@ -163,7 +164,7 @@ bool VideoEncoderX265::reconfigure(VideoFrame* orgFrame, VideoFrame* dstFrame)
     }
 
     picIn->colorSpace = colorspace;
-    x265_param_default_preset(xparams, preset.c_str(), NULL);
+    x265_param_default_preset(xparams, preset.c_str(), lowLatency ? "zerolatency" : NULL);
     /*TODO check with NULL profile*/
     x265_param_apply_profile(xparams, "main");
 
@@ -171,17 +172,30 @@ bool VideoEncoderX265::reconfigure(VideoFrame* orgFrame, VideoFrame* dstFrame)
     x265_param_parse(xparams, "fps", std::to_string(fps).c_str());
     x265_param_parse(xparams, "input-res", (std::to_string(orgFrame->getWidth()) + 'x' + std::to_string(orgFrame->getHeight())).c_str());
 
-    //TODO check same management for intra-refresh like x264
-    //x265_param_parse(xparams, "intra-refresh", std::to_string(0).c_str());
-
-    x265_param_parse(xparams, "frame-threads", std::to_string(threads).c_str());
     x265_param_parse(xparams, "aud", std::to_string(1).c_str());
-    x265_param_parse(xparams, "bitrate", std::to_string(bitrate).c_str());
-    x265_param_parse(xparams, "bframes", std::to_string(bFrames).c_str());
+    x265_param_parse(xparams, "bitrate", std::to_string(activeBitrate).c_str());
     x265_param_parse(xparams, "repeat-headers", std::to_string(0).c_str());
-    x265_param_parse(xparams, "vbv-maxrate", std::to_string(bitrate*1.05).c_str());
-    x265_param_parse(xparams, "vbv-bufsize", std::to_string(bitrate*2).c_str());
-    x265_param_parse(xparams, "rc-lookahead", std::to_string(lookahead).c_str());
+
+    //NOTE: x265 has no sliced threads, a single frame thread keeps frames from being delayed and
+    //      the threads are used as wavefront rows of the frame being encoded instead
+    if (lowLatency) {
+        x265_param_parse(xparams, "frame-threads", std::to_string(1).c_str());
+        x265_param_parse(xparams, "pools", std::to_string(codecThreads()).c_str());
+        x265_param_parse(xparams, "wpp", std::to_string(1).c_str());
+        x265_param_parse(xparams, "intra-refresh", std::to_string(1).c_str());
+        x265_param_parse(xparams, "bframes", std::to_string(0).c_str());
+        x265_param_parse(xparams, "rc-lookahead", std::to_string(0).c_str());
+        x265_param_parse(xparams, "vbv-maxrate", std::to_string(activeBitrate).c_str());
+        x265_param_parse(xparams, "vbv-bufsize", std::to_string(std::max(activeBitrate/fps, 1u)).c_str());
+    } else {
+        //NOTE: x265 has no pool shared between encoders, each one gets a worker pool of its share
+        x265_param_parse(xparams, "frame-threads", std::to_string(codecThreads()).c_str());
+        x265_param_parse(xparams, "pools", std::to_string(activeThreads).c_str());
+        x265_param_parse(xparams, "bframes", std::to_string(bFrames).c_str());
+        x265_param_parse(xparams, "rc-lookahead", std::to_string(lookahead).c_str());
+        x265_param_parse(xparams, "vbv-maxrate", std::to_string(activeBitrate*1.05).c_str());
+        x265_param_parse(xparams, "vbv-bufsize", std::to_string(activeBitrate*2).c_str());
+    }
     x265_param_parse(xparams, "annexb", std::to_string(1).c_str());
     x265_param_parse(xparams, "scenecut", std::to_string(0).c_str());
 
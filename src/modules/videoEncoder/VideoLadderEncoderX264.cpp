@@ -0,0 +1,645 @@
+/*
+ *  VideoLadderEncoderX264 - x264 video encoder with several aligned bitrates
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *            David Cassany <david.cassany@i2cat.net>
+ */
+
+#include "VideoLadderEncoderX264.hh"
+#include "../../SlicedVideoFrameQueue.hh"
+#include "../../WorkersPool.hh"
+#include "../../Utils.hh"
+#include "../../ThreadBudget.hh"
+#include <algorithm>
+
+#define MAX_PLANES_PER_PICTURE 4
+
+AVPixelFormat getLibavPixFmt(PixType pixType);
+
+///////////////////////////////////////////////////
+//                LadderRung Struct              //
+///////////////////////////////////////////////////
+
+LadderRung::LadderRung() : width(0), height(0), bitrate(DEFAULT_BITRATE), needsConfig(true),
+    encoder(NULL), ctx(NULL), outPts(0), dts(0)
+{
+    x264_param_default(&xparams);
+    xparams.i_width = 0;
+    xparams.i_height = 0;
+    x264_picture_init(&picIn);
+    x264_picture_init(&picOut);
+    picIn.img.i_csp = X264_CSP_I420;
+    scaled = av_frame_alloc();
+}
+
+LadderRung::~LadderRung()
+{
+    if (encoder) {
+        x264_encoder_close(encoder);
+    }
+
+    sws_freeContext(ctx);
+    av_frame_free(&scaled);
+}
+
+///////////////////////////////////////////////////
+//          VideoLadderEncoderX264 Class         //
+///////////////////////////////////////////////////
+
+VideoLadderEncoderX264::VideoLadderEncoderX264() : OneToManyFilterT(LADDER_MAX_RUNGS),
+    forceIntra(false), inPts(0), gopFrames(0), activeThreads(0), budgetGeneration(0)
+{
+    fType = VIDEO_LADDER_ENCODER;
+    inFrame = av_frame_alloc();
+
+    initializeEventMap();
+    configure0(VIDEO_DEFAULT_FRAMERATE, DEFAULT_GOP, DEFAULT_LOOKAHEAD, DEFAULT_B_FRAMES,
+               DEFAULT_THREADS, DEFAULT_ANNEXB, DEFAULT_PRESET);
+}
+
+VideoLadderEncoderX264::~VideoLadderEncoderX264()
+{
+    ThreadBudget::getInstance()->leave(this);
+
+    for (auto it : rungs) {
+        delete it.second;
+    }
+
+    for (auto it : outputStreamInfos) {
+        delete it.second;
+    }
+
+    av_frame_free(&inFrame);
+}
+
+FrameQueue* VideoLadderEncoderX264::allocQueue(ConnectionData cData)
+{
+    return SlicedVideoFrameQueue::createNew(cData, outputStreamInfos[cData.writerId], DEFAULT_VIDEO_FRAMES, MAX_H264_OR_5_NAL_SIZE);
+}
+
+bool VideoLadderEncoderX264::doProcessFrame(VideoFrame *rawFrame, FrameMap &dstFrames)
+{
+    std::vector<LadderRung*> active;
+    std::vector<SlicedVideoFrame*> frames;
+    std::vector<char> encoded;
+    FrameTimeParams frameTP;
+    int64_t minDts;
+    int type = X264_TYPE_AUTO;
+    bool processed = false;
+
+    if (!rawFrame) {
+        utils::errorMsg("[LadderEncoderX264] Origin frame must be a VideoFrame");
+        return false;
+    }
+
+    //NOTE: x264 encodes from host memory, a VideoResampler downloads the surfaces once
+    if (rawFrame->getPixelFormat() == HW_SURFACE) {
+        utils::errorMsg("[LadderEncoderX264] Hardware surfaces must be downloaded by a resampler");
+        return false;
+    }
+
+    if (rawFrame->getPlanes(inFrame->data, inFrame->linesize) == 0) {
+        utils::errorMsg("[LadderEncoderX264] Could not feed AVFrame");
+        return false;
+    }
+
+    inFrame->width = rawFrame->getWidth();
+    inFrame->height = rawFrame->getHeight();
+    inFrame->format = getLibavPixFmt(rawFrame->getPixelFormat());
+
+    if (inFrame->format == AV_PIX_FMT_NONE) {
+        utils::errorMsg("[LadderEncoderX264] Uncompatible input pixel format");
+        return false;
+    }
+
+    //NOTE: rungs are opened again with the new share of the thread budget, the ladder restarts its GOP
+    if (budgetGeneration != ThreadBudget::getInstance()->getGeneration()) {
+        budgetGeneration = ThreadBudget::getInstance()->getGeneration();
+        if (ThreadBudget::getInstance()->getThreads(this) != activeThreads) {
+            activeThreads = ThreadBudget::getInstance()->getThreads(this);
+            for (auto it : rungs) {
+                it.second->needsConfig = true;
+            }
+        }
+    }
+
+    for (auto it : dstFrames) {
+        if (rungs.count(it.first) == 0 || !dynamic_cast<SlicedVideoFrame*>(it.second)) {
+            it.second->setConsumed(false);
+            continue;
+        }
+
+        if (!reconfigureRung(it.first, rungs[it.first], inFrame->width, inFrame->height)) {
+            it.second->setConsumed(false);
+            continue;
+        }
+
+        active.push_back(rungs[it.first]);
+        frames.push_back(dynamic_cast<SlicedVideoFrame*>(it.second));
+    }
+
+    if (active.empty()) {
+        return false;
+    }
+
+    //NOTE: the same decision is taken for every rung, the B-frames pattern is fixed so the rest follows
+    if (forceIntra || gopFrames == 0 || gopFrames >= gop) {
+        type = X264_TYPE_IDR;
+        forceIntra = false;
+        gopFrames = 0;
+    }
+
+    frameTP.pTime = rawFrame->getPresentationTime();
+    frameTP.oTime = rawFrame->getOriginTime();
+    frameTP.seqNum = rawFrame->getSequenceNumber();
+    frameTP.sideData = rawFrame->getSideData();
+    qFTP[inPts] = frameTP;
+
+    encoded.assign(active.size(), 0);
+
+    auto encodeStep = [&](unsigned i) {
+        encoded[i] = encodeRung(active[i], inFrame, frames[i], type);
+    };
+
+    if (WorkersPool::current()) {
+        WorkersPool::current()->parallelFor(active.size(), encodeStep);
+    } else {
+        for (unsigned i = 0; i < active.size(); i++) {
+            encodeStep(i);
+        }
+    }
+
+    inPts++;
+    gopFrames++;
+    minDts = inPts;
+
+    for (unsigned i = 0; i < active.size(); i++) {
+        LadderRung *rung = active[i];
+        SlicedVideoFrame *dst = frames[i];
+        auto pTP = qFTP.find(rung->outPts);
+        auto dTP = qFTP.find(rung->dts);
+
+        minDts = std::min(minDts, rung->dts);
+
+        if (!encoded[i] || pTP == qFTP.end()) {
+            dst->setConsumed(false);
+            continue;
+        }
+
+        //NOTE: with B-frames x264 shifts the first decoding timestamps before the first pts
+        if (dTP == qFTP.end()) {
+            dTP = pTP;
+        }
+
+        dst->setSize(rung->xparams.i_width, rung->xparams.i_height);
+        dst->setConsumed(true);
+        dst->setPresentationTime(pTP->second.pTime);
+        dst->setDecodeTime(dTP->second.pTime);
+        dst->setOriginTime(pTP->second.oTime);
+        dst->setSequenceNumber(pTP->second.seqNum);
+        dst->getSideData() = pTP->second.sideData;
+        processed = true;
+    }
+
+    //NOTE: timestamps are shared by all the rungs, they are kept until every rung has decoded them
+    qFTP.erase(qFTP.begin(), qFTP.lower_bound(minDts));
+
+    return processed;
+}
+
+bool VideoLadderEncoderX264::encodeRung(LadderRung *rung, AVFrame *src, SlicedVideoFrame *codedFrame, int type)
+{
+    AVFrame *pic = src;
+    int success;
+    int piNal;
+    x264_nal_t* nals;
+
+    if (src->format != AV_PIX_FMT_YUV420P || src->width != rung->xparams.i_width || src->height != rung->xparams.i_height) {
+        //NOTE: the cached context is only rebuilt if any of its parameters changes
+        rung->ctx = sws_getCachedContext(rung->ctx, src->width, src->height, (AVPixelFormat) src->format,
+                                         rung->xparams.i_width, rung->xparams.i_height, AV_PIX_FMT_YUV420P,
+                                         SWS_FAST_BILINEAR, 0, 0, 0);
+
+        if (!rung->ctx) {
+            utils::errorMsg("[LadderEncoderX264] Could not get the swscale context");
+            return false;
+        }
+
+        if (rung->scaled->width != rung->xparams.i_width || rung->scaled->height != rung->xparams.i_height) {
+            av_frame_unref(rung->scaled);
+            rung->scaled->width = rung->xparams.i_width;
+            rung->scaled->height = rung->xparams.i_height;
+            rung->scaled->format = AV_PIX_FMT_YUV420P;
+
+            if (av_frame_get_buffer(rung->scaled, 32) < 0) {
+                utils::errorMsg("[LadderEncoderX264] Could not allocate the scaled picture");
+                return false;
+            }
+        }
+
+        if (sws_scale(rung->ctx, src->data, src->linesize, 0, src->height,
+                      rung->scaled->data, rung->scaled->linesize) <= 0) {
+            utils::errorMsg("[LadderEncoderX264] Could not convert image");
+            return false;
+        }
+
+        pic = rung->scaled;
+    }
+
+    for (int i = 0; i < MAX_PLANES_PER_PICTURE; i++) {
+        rung->picIn.img.i_stride[i] = pic->linesize[i];
+        rung->picIn.img.plane[i] = pic->data[i];
+    }
+
+    rung->picIn.i_type = type;
+    rung->picIn.i_pts = inPts;
+
+    success = x264_encoder_encode(rung->encoder, &nals, &piNal, &rung->picIn, &rung->picOut);
+
+    if (success < 0) {
+        utils::errorMsg("[LadderEncoderX264] Could not encode video frame");
+        return false;
+    }
+
+    if (success == 0) {
+        return false;
+    }
+
+    rung->outPts = rung->picOut.i_pts;
+    rung->dts = rung->picOut.i_dts;
+
+    for (int i = 0; i < piNal; i++) {
+        if (!codedFrame->setSlice(nals[i].p_payload, nals[i].i_payload)) {
+            utils::errorMsg("[LadderEncoderX264] Too many NALs for one slicedFrame");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool VideoLadderEncoderX264::reconfigureRung(int writerId, LadderRung *rung, int width, int height)
+{
+    int encodeSize;
+    int piNal;
+    x264_nal_t* nals;
+    bool reopen;
+    int rungThreads = std::max(activeThreads/std::max((unsigned) rungs.size(), 1u), 1u);
+
+    width = rung->width ? rung->width : width;
+    height = rung->height ? rung->height : height;
+
+    //NOTE: x264 needs even sizes for I420
+    width -= width % 2;
+    height -= height % 2;
+
+    if (!rung->needsConfig && rung->encoder && width == rung->xparams.i_width && height == rung->xparams.i_height) {
+        return true;
+    }
+
+    //NOTE: x264 can not change its threads without being opened again
+    reopen = !rung->encoder || width != rung->xparams.i_width || height != rung->xparams.i_height ||
+             rungThreads != rung->xparams.i_threads;
+
+    x264_param_default_preset(&rung->xparams, preset.c_str(), NULL);
+    x264_param_apply_profile(&rung->xparams, "high");
+
+    //NOTE: frame types only depend on the input order, IDRs are forced by the filter
+    x264_param_parse(&rung->xparams, "keyint", "infinite");
+    x264_param_parse(&rung->xparams, "b-adapt", std::to_string(0).c_str());
+    x264_param_parse(&rung->xparams, "scenecut", std::to_string(0).c_str());
+    x264_param_parse(&rung->xparams, "open-gop", std::to_string(0).c_str());
+
+    x264_param_parse(&rung->xparams, "fps", std::to_string(fps).c_str());
+    x264_param_parse(&rung->xparams, "intra-refresh", std::to_string(0).c_str());
+    x264_param_parse(&rung->xparams, "threads", std::to_string(rungThreads).c_str());
+    x264_param_parse(&rung->xparams, "aud", std::to_string(1).c_str());
+    x264_param_parse(&rung->xparams, "bitrate", std::to_string(rung->bitrate).c_str());
+    x264_param_parse(&rung->xparams, "bframes", std::to_string(bFrames).c_str());
+    x264_param_parse(&rung->xparams, "repeat-headers", std::to_string(0).c_str());
+    x264_param_parse(&rung->xparams, "vbv-maxrate", std::to_string(rung->bitrate*1.05).c_str());
+    x264_param_parse(&rung->xparams, "vbv-bufsize", std::to_string(rung->bitrate*2).c_str());
+    x264_param_parse(&rung->xparams, "rc-lookahead", std::to_string(lookahead).c_str());
+
+    if (annexB) {
+        x264_param_parse(&rung->xparams, "repeat-headers", std::to_string(1).c_str());
+        x264_param_parse(&rung->xparams, "annexb", std::to_string(1).c_str());
+    }
+
+    rung->xparams.i_width = width;
+    rung->xparams.i_height = height;
+    rung->xparams.i_csp = X264_CSP_I420;
+
+    if (reopen && rung->encoder) {
+        x264_encoder_close(rung->encoder);
+        rung->encoder = NULL;
+    }
+
+    if (!rung->encoder) {
+        rung->encoder = x264_encoder_open(&rung->xparams);
+    } else if (x264_encoder_reconfig(rung->encoder, &rung->xparams) < 0) {
+        utils::errorMsg("[LadderEncoderX264] Could not reconfigure x264 encoder, closing and opening again");
+        x264_encoder_close(rung->encoder);
+        rung->encoder = x264_encoder_open(&rung->xparams);
+    }
+
+    if (!rung->encoder) {
+        utils::errorMsg("[LadderEncoderX264] Error opening x264 encoder of writer " + std::to_string(writerId));
+        return false;
+    }
+
+    //NOTE: a reopened encoder starts with an IDR, the whole ladder restarts its GOP with it
+    if (reopen) {
+        rung->outPts = inPts;
+        rung->dts = inPts;
+        forceIntra = true;
+    }
+
+    encodeSize = x264_encoder_headers(rung->encoder, &nals, &piNal);
+
+    if (encodeSize < 0) {
+        utils::errorMsg("[LadderEncoderX264] Could not encode headers");
+        return false;
+    }
+
+    outputStreamInfos[writerId]->setExtraData(nals[0].p_payload, encodeSize);
+    rung->needsConfig = false;
+
+    return true;
+}
+
+void VideoLadderEncoderX264::joinBudget()
+{
+    ThreadBudget::getInstance()->join(this, threads*std::max((unsigned) rungs.size(), 1u));
+}
+
+bool VideoLadderEncoderX264::configure0(unsigned fps_, unsigned gop_, unsigned lookahead_, unsigned bFrames_,
+                                        unsigned threads_, bool annexB_, std::string preset_)
+{
+    if (gop_ <= 0 || threads_ <= 0 || preset_.empty()) {
+        utils::errorMsg("[LadderEncoderX264] Invalid configuration values");
+        return false;
+    }
+
+    gop = gop_;
+    lookahead = lookahead_;
+    bFrames = bFrames_;
+    threads = threads_;
+    annexB = annexB_;
+    joinBudget();
+    preset = preset_;
+
+    if (fps_ <= 0) {
+        fps = VIDEO_DEFAULT_FRAMERATE;
+        setFrameTime(std::chrono::microseconds(0));
+    } else {
+        fps = fps_;
+        setFrameTime(std::chrono::microseconds(std::micro::den/fps));
+    }
+
+    for (auto it : outputStreamInfos) {
+        it.second->video.h264or5.annexb = annexB;
+    }
+
+    for (auto it : rungs) {
+        it.second->needsConfig = true;
+    }
+
+    return true;
+}
+
+bool VideoLadderEncoderX264::configRung0(int writerId, int width, int height, unsigned bitrate)
+{
+    if (width < 0 || height < 0 || bitrate <= 0) {
+        utils::errorMsg("[LadderEncoderX264] Rung configuration is not valid");
+        return false;
+    }
+
+    if (rungs.count(writerId) == 0) {
+        if (rungs.size() >= LADDER_MAX_RUNGS) {
+            utils::errorMsg("[LadderEncoderX264] Up to " + std::to_string(LADDER_MAX_RUNGS) + " rungs are supported");
+            return false;
+        }
+
+        rungs[writerId] = new LadderRung();
+    }
+
+    if (outputStreamInfos.count(writerId) == 0) {
+        outputStreamInfos[writerId] = new StreamInfo(VIDEO);
+        outputStreamInfos[writerId]->video.codec = H264;
+    }
+
+    outputStreamInfos[writerId]->video.h264or5.annexb = annexB;
+    //NOTE: readers such as simulcast connections choose between rungs by their nominal bitrate
+    outputStreamInfos[writerId]->bitrate = bitrate;
+
+    joinBudget();
+
+    rungs[writerId]->width = width;
+    rungs[writerId]->height = height;
+    rungs[writerId]->bitrate = bitrate;
+    rungs[writerId]->needsConfig = true;
+
+    return true;
+}
+
+bool VideoLadderEncoderX264::specificWriterConfig(int writerID)
+{
+    //NOTE: a writer without a configured rung keeps the input size at the default bitrate
+    if (rungs.count(writerID) > 0) {
+        return true;
+    }
+
+    return configRung0(writerID, 0, 0, DEFAULT_BITRATE);
+}
+
+bool VideoLadderEncoderX264::specificWriterDelete(int writerID)
+{
+    if (rungs.count(writerID) == 0) {
+        utils::errorMsg("[LadderEncoderX264] Error deleting writer. This writerId doesn't exist " + std::to_string(writerID));
+        return false;
+    }
+
+    delete rungs[writerID];
+    rungs.erase(writerID);
+    joinBudget();
+
+    return true;
+}
+
+bool VideoLadderEncoderX264::configEvent(Jzon::Node* params)
+{
+    unsigned tmpFps;
+    unsigned tmpGop;
+    unsigned tmpLookahead;
+    unsigned tmpBFrames;
+    unsigned tmpThreads;
+    bool tmpAnnexB;
+    std::string tmpPreset;
+
+    if (!params) {
+        return false;
+    }
+
+    tmpFps = fps;
+    tmpGop = gop;
+    tmpLookahead = lookahead;
+    tmpBFrames = bFrames;
+    tmpThreads = threads;
+    tmpAnnexB = annexB;
+    tmpPreset = preset;
+
+    if (params->Has("fps")) {
+        tmpFps = params->Get("fps").ToInt();
+    }
+
+    if (params->Has("gop")) {
+        tmpGop = params->Get("gop").ToInt();
+    }
+
+    if (params->Has("lookahead")) {
+        tmpLookahead = params->Get("lookahead").ToInt();
+    }
+
+    if (params->Has("bframes")) {
+        tmpBFrames = params->Get("bframes").ToInt();
+    }
+
+    if (params->Has("threads")) {
+        tmpThreads = params->Get("threads").ToInt();
+    }
+
+    if (params->Has("annexb")) {
+        tmpAnnexB = params->Get("annexb").ToBool();
+    }
+
+    if (params->Has("preset")) {
+        tmpPreset = params->Get("preset").ToString();
+    }
+
+    return configure0(tmpFps, tmpGop, tmpLookahead, tmpBFrames, tmpThreads, tmpAnnexB, tmpPreset);
+}
+
+bool VideoLadderEncoderX264::configRungEvent(Jzon::Node* params)
+{
+    int id, width, height, rate;
+
+    if (!params) {
+        return false;
+    }
+
+    if (!params->Has("id") || !params->Get("id").IsNumber()) {
+        utils::errorMsg("[LadderEncoderX264::configRungEvent] Params node not complete");
+        return false;
+    }
+
+    id = params->Get("id").ToInt();
+    width = rungs.count(id) > 0 ? rungs[id]->width : 0;
+    height = rungs.count(id) > 0 ? rungs[id]->height : 0;
+    rate = rungs.count(id) > 0 ? rungs[id]->bitrate : DEFAULT_BITRATE;
+
+    if (params->Has("width") && params->Get("width").IsNumber()){
+        width = params->Get("width").ToInt();
+    }
+
+    if (params->Has("height") && params->Get("height").IsNumber()){
+        height = params->Get("height").ToInt();
+    }
+
+    if (params->Has("bitrate") && params->Get("bitrate").IsNumber()){
+        rate = params->Get("bitrate").ToInt();
+    }
+
+    if (rate <= 0) {
+        utils::errorMsg("[LadderEncoderX264] Rung bitrate must be positive");
+        return false;
+    }
+
+    return configRung0(id, width, height, rate);
+}
+
+bool VideoLadderEncoderX264::forceIntraEvent(Jzon::Node*)
+{
+    forceIntra = true;
+    return true;
+}
+
+void VideoLadderEncoderX264::initializeEventMap()
+{
+    eventMap["forceIntra"] = std::bind(&VideoLadderEncoderX264::forceIntraEvent, this, std::placeholders::_1);
+    eventMap["configure"] = std::bind(&VideoLadderEncoderX264::configEvent, this, std::placeholders::_1);
+    eventMap["configRung"] = std::bind(&VideoLadderEncoderX264::configRungEvent, this, std::placeholders::_1);
+}
+
+void VideoLadderEncoderX264::doGetState(Jzon::Object &filterNode)
+{
+    Jzon::Array jsonRungs;
+
+    for (auto it : rungs) {
+        Jzon::Object rung;
+        rung.Add("id", it.first);
+        rung.Add("width", it.second->width);
+        rung.Add("height", it.second->height);
+        rung.Add("bitrate", (int) it.second->bitrate);
+        jsonRungs.Add(rung);
+    }
+
+    filterNode.Add("fps", (int) fps);
+    filterNode.Add("gop", (int) gop);
+    filterNode.Add("lookahead", (int) lookahead);
+    filterNode.Add("bframes", (int) bFrames);
+    filterNode.Add("threads", (int) threads);
+    filterNode.Add("activeThreads", (int) activeThreads);
+    filterNode.Add("annexb", annexB);
+    filterNode.Add("preset", preset);
+    filterNode.Add("rungs", jsonRungs);
+}
+
+bool VideoLadderEncoderX264::configure(int fps, int gop, int lookahead, int bFrames, int threads, bool annexB, std::string preset)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configure");
+    params.Add("fps", fps);
+    params.Add("gop", gop);
+    params.Add("lookahead", lookahead);
+    params.Add("bframes", bFrames);
+    params.Add("threads", threads);
+    params.Add("annexb", annexB);
+    params.Add("preset", preset);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
+
+bool VideoLadderEncoderX264::configRung(int writerId, int width, int height, int bitrate)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configRung");
+    params.Add("id", writerId);
+    params.Add("width", width);
+    params.Add("height", height);
+    params.Add("bitrate", bitrate);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
@@ -0,0 +1,147 @@
+/*
+ *  VideoLadderEncoderX264 - x264 video encoder with several aligned bitrates
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *            David Cassany <david.cassany@i2cat.net>
+ */
+
+#ifndef _VIDEO_LADDER_ENCODER_X264_HH
+#define _VIDEO_LADDER_ENCODER_X264_HH
+
+#include <stdint.h>
+#include <chrono>
+#include "VideoEncoderX264or5.hh"
+#include "../../VideoFrame.hh"
+#include "../../FrameQueue.hh"
+#include "../../Filter.hh"
+#include "../../StreamInfo.hh"
+
+extern "C" {
+    #include <x264.h>
+    #include <libswscale/swscale.h>
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/imgutils.h>
+}
+
+#define LADDER_MAX_RUNGS 8      //!< Maximum number of rungs, one per writer
+
+/*! Rung of the ladder: one x264 encoder and its scaled copy of the input. The encoder is
+*   only reopened when the rung size changes, bitrate changes are applied with x264_encoder_reconfig.
+*/
+struct LadderRung {
+    LadderRung();
+    ~LadderRung();
+
+    int width;                      //!< Encoded width, 0 keeps the input one
+    int height;                     //!< Encoded height, 0 keeps the input one
+    unsigned bitrate;               //!< Target bitrate in kbps
+    bool needsConfig;
+    x264_t *encoder;
+    x264_param_t xparams;
+    x264_picture_t picIn;
+    x264_picture_t picOut;
+    struct SwsContext *ctx;
+    AVFrame *scaled;                //!< Scaled input, unused if the input is already I420 of the rung size
+    int64_t outPts;
+    int64_t dts;
+};
+
+/*! Encoder producing several H264 bitrates (and sizes) of one input, one per writer, in lock-step.
+*   All the rungs get the same frame type decisions: adaptive B-frames and scenecut detection
+*   are disabled and IDRs are placed by the filter itself, every gop frames or when forceIntra
+*   is received, on the same input frame for every rung, so GOPs and segments line up across
+*   the ladder (e.g. for DASH). Each rung scales the input and encodes it in parallel on the pool
+*   workers. Hardware surfaces must be downloaded before, see VideoResampler.
+*/
+class VideoLadderEncoderX264 : public OneToManyFilterT<VideoFrame, VideoFrame> {
+
+public:
+    VideoLadderEncoderX264();
+    ~VideoLadderEncoderX264();
+
+    /**
+    * Configures the parameters shared by all the rungs
+    * @param fps output frames per second, 0 follows the input
+    * @param gop frames between IDRs
+    * @param lookahead rate control lookahead in frames
+    * @param bFrames fixed number of consecutive B-frames
+    * @param threads maximum x264 threads of each rung, the ladder threads are allocated from the process ThreadBudget
+    * @param annexB if true NALs are delimited with start codes
+    * @param preset x264 preset
+    */
+    bool configure(int fps, int gop, int lookahead, int bFrames, int threads, bool annexB, std::string preset);
+
+    /**
+    * Configures the rung of a writer, it can be done before connecting it
+    * @param writerId id of the writer
+    * @param width encoded width in pixels, 0 keeps the input one
+    * @param height encoded height in pixels, 0 keeps the input one
+    * @param bitrate target bitrate in kbps
+    */
+    bool configRung(int writerId, int width, int height, int bitrate);
+
+private:
+    bool doProcessFrame(VideoFrame *rawFrame, FrameMap &dstFrames);
+    FrameQueue* allocQueue(ConnectionData cData);
+    void initializeEventMap();
+    bool configEvent(Jzon::Node* params);
+    bool configRungEvent(Jzon::Node* params);
+    bool forceIntraEvent(Jzon::Node* params);
+    void doGetState(Jzon::Object &filterNode);
+    bool configure0(unsigned fps_, unsigned gop_, unsigned lookahead_, unsigned bFrames_, unsigned threads_, bool annexB_, std::string preset_);
+    bool configRung0(int writerId, int width, int height, unsigned bitrate);
+    bool reconfigureRung(int writerId, LadderRung *rung, int width, int height);
+    void joinBudget();
+    bool encodeRung(LadderRung *rung, AVFrame *src, SlicedVideoFrame *codedFrame, int type);
+
+    //NOTE: There is no need of specific reader configuration
+    bool specificReaderConfig(int /*readerID*/, FrameQueue* /*queue*/)  {return true;};
+    bool specificReaderDelete(int /*readerID*/) {return true;};
+
+    bool specificWriterConfig(int writerID);
+    bool specificWriterDelete(int writerID);
+
+    struct FrameTimeParams {
+        std::chrono::microseconds pTime;
+        std::chrono::system_clock::time_point oTime;
+        size_t seqNum;
+        FrameSideData sideData;
+    };
+
+    AVFrame *inFrame;
+    std::map<int, LadderRung*> rungs;
+    //NOTE: not freed with their rung, the sliced queue of a removed rung still hands its SPS/PPS extradata to readers
+    std::map<int, StreamInfo*> outputStreamInfos;
+    std::map<int64_t, FrameTimeParams> qFTP;
+
+    unsigned fps;
+    unsigned gop;
+    unsigned lookahead;
+    unsigned bFrames;
+    unsigned threads;
+    bool annexB;
+    std::string preset;
+    bool forceIntra;
+    int64_t inPts;
+    unsigned gopFrames;             //!< Frames encoded since the last IDR
+    unsigned activeThreads;         //!< Share of the thread budget of the whole ladder
+    unsigned budgetGeneration;
+};
+
+#endif
@@ -22,7 +22,14 @@
 
 #include "VideoMixer.hh"
 #include "../../AVFramedQueue.hh"
+#include "../../WorkersPool.hh"
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <chrono>
+#include <set>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
 
 ///////////////////////////////////////////////////
 //                ChannelConfig Class            //
@@ -44,11 +51,65 @@ void ChannelConfig::config(float width, float height, float x, float y, int laye
     this->opacity = opacity;
 }
 
+void ChannelConfig::interpolate(ChannelConfig &from, ChannelConfig &to, float t)
+{
+    ChannelConfig &start = from.enabled ? from : to;
+    ChannelConfig &end = to.enabled ? to : from;
+    float startOpacity = from.enabled ? from.opacity : 0;
+    float endOpacity = to.enabled ? to.opacity : 0;
+
+    width = start.width + (end.width - start.width)*t;
+    height = start.height + (end.height - start.height)*t;
+    x = start.x + (end.x - start.x)*t;
+    y = start.y + (end.y - start.y)*t;
+    layer = end.layer;
+    enabled = from.enabled || to.enabled;
+    opacity = startOpacity + (endOpacity - startOpacity)*t;
+}
+
 ///////////////////////////////////////////////////
 //                VideoMixer Class               //
 ///////////////////////////////////////////////////
 
-VideoMixer* VideoMixer::createNew(int inputChannels, int outWidth, int outHeight, std::chrono::microseconds fTime)
+/**
+* Gets the planes layout of a composition pixel format
+* @param format composition pixel format
+* @param cvTypes (out) OpenCV type of each plane
+* @param shifts (out) subsampling shift of each plane, 1 for half resolution chroma
+* @param background (out) black of each plane
+* @return number of planes, 0 if the pixel format is not supported
+*/
+static unsigned compositionPlanes(PixType format, int cvTypes[], int shifts[], cv::Scalar background[])
+{
+    switch (format) {
+        case RGB24:
+            cvTypes[0] = CV_8UC3;
+            shifts[0] = 0;
+            background[0] = cv::Scalar(0, 0, 0);
+            return 1;
+        case YUV420P:
+            for (unsigned p = 0; p < 3; p++) {
+                cvTypes[p] = CV_8UC1;
+                shifts[p] = p == 0 ? 0 : 1;
+                //NOTE: limited range black, as RGB24 black once converted
+                background[p] = cv::Scalar(p == 0 ? 16 : 128);
+            }
+            return 3;
+        case NV12:
+            cvTypes[0] = CV_8UC1;
+            shifts[0] = 0;
+            background[0] = cv::Scalar(16);
+            cvTypes[1] = CV_8UC2;
+            shifts[1] = 1;
+            background[1] = cv::Scalar(128, 128);
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+VideoMixer* VideoMixer::createNew(int inputChannels, int outWidth, int outHeight, std::chrono::microseconds fTime, 
+                                  ComposeBackend backend)
 {
     if (outWidth <= 0 || outWidth > DEFAULT_WIDTH || outHeight <= 0 || outHeight > DEFAULT_HEIGHT) {
         utils::errorMsg("[VideoMixer] Error creating VideoMixer, output size range is  (0," + 
@@ -56,301 +117,1731 @@ VideoMixer* VideoMixer::createNew(int inputChannels, int outWidth, int outHeight
         return NULL;
     }
 
-    if (fTime.count() < 0) {
-        utils::errorMsg("[VideoMixer] Error creating VideoMixer, negative frame time is not valid");
-        return NULL;
+    if (fTime.count() < 0) {
+        utils::errorMsg("[VideoMixer] Error creating VideoMixer, negative frame time is not valid");
+        return NULL;
+    }
+
+    if (backend == CB_NONE) {
+        utils::errorMsg("[VideoMixer] Error creating VideoMixer, composition backend not valid");
+        return NULL;
+    }
+
+    if (backend == OPENCL_COMPOSE && !cv::ocl::haveOpenCL()) {
+        utils::warningMsg("[VideoMixer] No OpenCL device available, composing on the CPU");
+        backend = CPU_COMPOSE;
+    }
+
+    return new VideoMixer(inputChannels, outWidth, outHeight, fTime, backend);
+}
+
+VideoMixer::VideoMixer(int inputChannels, 
+                       int outWidth, int outHeight, std::chrono::microseconds fTime, ComposeBackend backend) :
+ManyToManyFilter(inputChannels, VMIXER_MAX_LAYOUTS), pixelFormat(RGB24), backend(backend), maxChannels(inputChannels)
+{
+    outputStreamInfo = new StreamInfo(VIDEO);
+    outputStreamInfo->video.codec = RAW;
+    outputStreamInfo->video.pixelFormat = pixelFormat;
+
+    configure0(outWidth, outHeight, 0, pixelFormat);
+    initializeEventMap();
+    fType = VIDEO_MIXER;
+    
+    setFrameTime(fTime);
+}
+
+VideoMixer::~VideoMixer()
+{
+    layouts.clear();
+    scaledTiles.clear();
+
+    delete outputStreamInfo;
+}
+
+FrameQueue* VideoMixer::allocQueue(ConnectionData cData)
+{
+    return VideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_RAW_VIDEO_FRAMES);
+}
+
+/**
+* Merges overlapping rects into their bounding rect until none of them overlap
+* @param rects (in/out) rects to merge, empty ones are removed
+*/
+static void mergeRects(std::vector<cv::Rect> &rects)
+{
+    bool merged = true;
+
+    rects.erase(std::remove_if(rects.begin(), rects.end(), [](const cv::Rect &r) {return r.area() <= 0;}), rects.end());
+
+    while (merged) {
+        merged = false;
+
+        for (unsigned i = 0; i < rects.size() && !merged; i++) {
+            for (unsigned j = i + 1; j < rects.size() && !merged; j++) {
+                if ((rects[i] & rects[j]).area() > 0) {
+                    rects[i] = rects[i] | rects[j];
+                    rects.erase(rects.begin() + j);
+                    merged = true;
+                }
+            }
+        }
+    }
+}
+
+/**
+* Gets the rect of a plane covering a layout rect
+* @param rect rect in layout pixels
+* @param shift subsampling shift of the plane
+* @param plane size of the plane, the rect is clipped to it
+* @return the rect in plane samples
+*/
+static cv::Rect planeRect(cv::Rect rect, int shift, cv::Size plane)
+{
+    cv::Rect pRect(rect.x >> shift, rect.y >> shift, (rect.width + shift) >> shift, (rect.height + shift) >> shift);
+
+    return pRect & cv::Rect(0, 0, plane.width, plane.height);
+}
+
+/**
+* Points a cached plane to a region of its storage, which is only reallocated if it is too small
+* @param storage buffer holding the plane
+* @param plane (out) plane of the given size
+* @param sz size of the plane
+* @param capacity minimum size of the storage when it is reallocated
+* @param type OpenCV type of the plane
+*/
+template <typename M>
+static void fitPlane(M &storage, M &plane, cv::Size sz, cv::Size capacity, int type)
+{
+    if (storage.cols < sz.width || storage.rows < sz.height || storage.type() != type) {
+        storage.create(std::max(sz.height, capacity.height), std::max(sz.width, capacity.width), type);
+    }
+
+    plane = storage(cv::Rect(0, 0, sz.width, sz.height));
+}
+
+/**
+* Runs fn(0) ... fn(items - 1) on the workers of the calling worker pool, if any
+* @param parallel if false, items are run one after the other by the calling thread
+*/
+static void runParallel(unsigned items, bool parallel, const std::function<void(unsigned)> &fn)
+{
+    WorkersPool* pool = WorkersPool::current();
+
+    if (pool && parallel) {
+        pool->parallelFor(items, fn);
+        return;
+    }
+
+    for (unsigned i = 0; i < items; i++) {
+        fn(i);
+    }
+}
+
+/**
+* Pastes a tile into the composition, blending it if it is not opaque
+* @param src tile pixels, host (cv::Mat) or device (cv::UMat) ones
+* @param dst composition area, of the same size and kind as src
+* @param opacity tile opacity [0.0, 1.0]
+*/
+template <typename M>
+static void blendPlane(const M &src, const M &dst, float opacity)
+{
+    if (opacity == 1) {
+        src.copyTo(dst);
+    } else {
+        cv::addWeighted(src, opacity, dst, 1 - opacity, 0.0, dst);
+    }
+}
+
+/**
+* Composites premultiplied pixels over the composition, dst = dst*(255 - alpha)/255 + src. The
+* multiply and add kernels of OpenCV are vectorized, or run on the device with cv::UMat
+* @param premultiplied pixels premultiplied by their alpha
+* @param inverse 255 - alpha, with the channels of the plane
+* @param dst composition area, of the same size and kind as the others
+*/
+template <typename M>
+static void overlayPlane(const M &premultiplied, const M &inverse, const M &dst)
+{
+    cv::multiply(dst, inverse, dst, 1/255.0);
+    cv::add(dst, premultiplied, dst);
+}
+
+/**
+* Converts an RGB picture to the planes of a composition format
+* @param rgb CV_8UC3 picture, of even width and height
+* @param sz size of the composition, up to the picture one
+* @param format composition pixel format
+* @param planes (out) planes of the composition size
+*/
+static void rgbToPlanes(const cv::Mat &rgb, cv::Size sz, PixType format, cv::Mat planes[])
+{
+    cv::Mat yuv;
+    int w = rgb.cols;
+    int h = rgb.rows;
+
+    if (format == RGB24) {
+        planes[0] = rgb(cv::Rect(0, 0, sz.width, sz.height)).clone();
+        return;
+    }
+
+    //NOTE: limited range BT.601, as the black of compositionPlanes
+    cv::cvtColor(rgb, yuv, cv::COLOR_RGB2YUV_I420);
+    planes[0] = yuv(cv::Rect(0, 0, sz.width, sz.height)).clone();
+
+    cv::Mat u(h/2, w/2, CV_8UC1, yuv.ptr(h));
+    cv::Mat v(h/2, w/2, CV_8UC1, yuv.ptr(h) + (h/2)*(w/2));
+
+    if (format == NV12) {
+        cv::Mat uv[2] = {u, v};
+        cv::merge(uv, 2, planes[1]);
+    } else {
+        planes[1] = u.clone();
+        planes[2] = v.clone();
+    }
+}
+
+bool VideoMixer::doProcessFrame(FrameMap &orgFrames, FrameMap &dstFrames, std::vector<int> &newFrames)
+{
+    std::chrono::microseconds outTs = std::chrono::microseconds(0);
+    std::map<int, VideoFrame*> frames;
+    std::map<int, MixerLayout*> writerLayouts;
+    std::vector<MixerLayout*> active;
+    VideoFrame *vFrame;
+    MixerLayout *layout;
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int cvTypes[MAX_PLANES];
+    int shifts[MAX_PLANES];
+    cv::Scalar background[MAX_PLANES];
+    unsigned planes;
+    unsigned length;
+
+    planes = compositionPlanes(pixelFormat, cvTypes, shifts, background);
+
+    followSpeakers();
+    stepTransitions();
+
+    for (auto it : orgFrames) {
+        if (!it.second) {
+            continue;
+        }
+
+        vFrame = dynamic_cast<VideoFrame*>(it.second);
+
+        if (!vFrame) {
+            utils::errorMsg("[VideoMixer] Origin frame must be a VideoFrame");
+            return false;
+        }
+
+        if (vFrame->getPixelFormat() != pixelFormat) {
+            utils::errorMsg("[VideoMixer] Channel " + std::to_string(it.first) + " pixel format is not the composition one, " + 
+                            utils::getPixTypeAsString(pixelFormat));
+            continue;
+        }
+
+        frames[it.first] = vFrame;
+    }
+
+    //NOTE: each layout is composed once, whatever the number of writers sharing it
+    for (auto it : dstFrames) {
+        layout = layouts.count(it.first) > 0 ? &layouts[it.first] : &layouts[DEFAULT_ID];
+        writerLayouts[it.first] = layout;
+
+        if (std::find(active.begin(), active.end(), layout) == active.end()) {
+            active.push_back(layout);
+        }
+    }
+
+    for (auto l : active) {
+        for (auto &ch : l->channels) {
+            if (ch.second.isEnabled() && frames.count(ch.first) > 0) {
+                outTs = std::max(frames[ch.first]->getPresentationTime(), outTs);
+            }
+        }
+    }
+
+    scaleInputs(active, frames);
+    publishTileSizes(active);
+
+    //NOTE: OpenCL kernels are queued by the filter thread, the device runs them in parallel
+    runParallel(active.size(), backend == CPU_COMPOSE, [&](unsigned i) {
+        composeLayout(*active[i], frames, newFrames);
+    });
+
+    for (auto it : dstFrames) {
+        vFrame = dynamic_cast<VideoFrame*>(it.second);
+        layout = writerLayouts[it.first];
+
+        if (!vFrame) {
+            utils::errorMsg("[VideoMixer] Destination frame must be a VideoFrame");
+            return false;
+        }
+
+        vFrame->fitBuffer(layout->width, layout->height, pixelFormat);
+        length = vFrame->getPlanes(data, linesize);
+
+        if (length == 0 || planes == 0) {
+            utils::errorMsg("[VideoMixer] Destination frame has no picture planes");
+            return false;
+        }
+
+        //NOTE: queue frames are not the previous output, the kept composition is copied
+        for (unsigned p = 0; p < planes; p++) {
+            cv::Size pSz((layout->width + shifts[p]) >> shifts[p], (layout->height + shifts[p]) >> shifts[p]);
+            cv::Mat dst(pSz.height, pSz.width, cvTypes[p], data[p], linesize[p]);
+
+            if (backend == OPENCL_COMPOSE) {
+                layout->gpuComposition[p].copyTo(dst);
+            } else {
+                layout->composition[p].copyTo(dst);
+            }
+        }
+
+        vFrame->setLength(length);
+        vFrame->setConsumed(true);
+    
+        if (getFrameTime().count() <= 0) {
+            vFrame->setPresentationTime(outTs);
+        } else {
+            vFrame->setPresentationTime(getSyncTs());
+        }
+    
+        vFrame->setDecodeTime(vFrame->getPresentationTime());
+    }
+
+    if (getFrameTime().count() <= 0) {
+        setSyncTs(outTs);
+    }
+
+    return true;
+}
+
+void VideoMixer::scaleInputs(std::vector<MixerLayout*> &active, std::map<int, VideoFrame*> &frames)
+{
+    std::vector<std::pair<VideoFrame*, TileCache*>> uploads;
+    std::vector<std::pair<VideoFrame*, TileCache*>> jobs;
+    std::vector<cv::Size> sizes;
+    std::vector<cv::Size> capacities;
+    std::vector<int> channels;
+    TileCache* cache;
+    VideoFrame* vFrame;
+    cv::Size sz(0, 0);
+    int x, y;
+
+    for (auto &ch : scaledTiles) {
+        for (auto &c : ch.second) {
+            c.second.used = false;
+        }
+    }
+
+    //NOTE: tiles with the size of their input are pasted from it, the rest are scaled once per size.
+    //      The OpenCL backend keeps the uploaded input as the cache of its own size
+    for (auto l : active) {
+        for (auto &ch : l->channels) {
+            if (!ch.second.isEnabled() || frames.count(ch.first) == 0) {
+                continue;
+            }
+
+            vFrame = frames[ch.first];
+            tileGeometry(*l, ch.second, sz, x, y);
+
+            if (backend == OPENCL_COMPOSE) {
+                cache = tileOf(ch.first, cv::Size(vFrame->getWidth(), vFrame->getHeight()));
+
+                if (!cache->used && (cache->source != vFrame || cache->sourceTs != vFrame->getPresentationTime())) {
+                    uploads.push_back(std::make_pair(vFrame, cache));
+                }
+
+                cache->used = true;
+            }
+
+            if (vFrame->getWidth() == sz.width && vFrame->getHeight() == sz.height) {
+                continue;
+            }
+
+            cache = tileOf(ch.first, sz);
+
+            if (!cache->used && (cache->source != vFrame || cache->sourceTs != vFrame->getPresentationTime())) {
+                jobs.push_back(std::make_pair(vFrame, cache));
+                sizes.push_back(sz);
+                capacities.push_back(capacityOf(ch.first));
+                channels.push_back(ch.first);
+            }
+
+            cache->used = true;
+        }
+    }
+
+    //NOTE: during transitions the planes of the caches not used anymore are kept for the next tile sizes
+    for (auto &ch : scaledTiles) {
+        auto spares = spareTiles.find(ch.first);
+
+        for (auto c = ch.second.begin(); c != ch.second.end(); ) {
+            if (c->second.used) {
+                ++c;
+                continue;
+            }
+
+            if (spares != spareTiles.end() && spares->second.size() < VMIXER_SPARE_TILES) {
+                spares->second.push_back(TileCache());
+                std::copy(c->second.storage, c->second.storage + MAX_PLANES, spares->second.back().storage);
+                std::copy(c->second.gpuStorage, c->second.gpuStorage + MAX_PLANES, spares->second.back().gpuStorage);
+            }
+
+            c = ch.second.erase(c);
+        }
+    }
+
+    for (auto job : uploads) {
+        unsigned char* data[MAX_PLANES];
+        int linesize[MAX_PLANES];
+        int cvTypes[MAX_PLANES];
+        int shifts[MAX_PLANES];
+        cv::Scalar background[MAX_PLANES];
+        unsigned planes;
+        VideoFrame* frame = job.first;
+        int s;
+
+        if (frame->getPlanes(data, linesize) == 0) {
+            utils::errorMsg("[VideoMixer] Input frame has no picture planes");
+            continue;
+        }
+
+        planes = compositionPlanes(pixelFormat, cvTypes, shifts, background);
+
+        for (unsigned p = 0; p < planes; p++) {
+            s = shifts[p];
+            cv::Size pSz((frame->getWidth() + s) >> s, (frame->getHeight() + s) >> s);
+
+            fitPlane<cv::UMat>(job.second->gpuStorage[p], job.second->gpuScaled[p], pSz, cv::Size(0, 0), cvTypes[p]);
+            cv::Mat(pSz.height, pSz.width, cvTypes[p], data[p], linesize[p]).copyTo(job.second->gpuScaled[p]);
+        }
+
+        job.second->source = frame;
+        job.second->sourceTs = frame->getPresentationTime();
+    }
+
+    runParallel(jobs.size(), backend == CPU_COMPOSE, [&](unsigned k) {
+        unsigned char* data[MAX_PLANES];
+        int linesize[MAX_PLANES];
+        int cvTypes[MAX_PLANES];
+        int shifts[MAX_PLANES];
+        cv::Scalar background[MAX_PLANES];
+        unsigned planes;
+        VideoFrame* frame = jobs[k].first;
+        TileCache* tile = jobs[k].second;
+        TileCache* uploaded;
+        int s;
+
+        //NOTE: line size is given, planar frames lines are padded
+        if (frame->getPlanes(data, linesize) == 0) {
+            utils::errorMsg("[VideoMixer] Input frame has no picture planes");
+            return;
+        }
+
+        planes = compositionPlanes(pixelFormat, cvTypes, shifts, background);
+        uploaded = cacheOf(channels[k], cv::Size(frame->getWidth(), frame->getHeight()));
+
+        for (unsigned p = 0; p < planes; p++) {
+            s = shifts[p];
+            cv::Size pSz((sizes[k].width + s) >> s, (sizes[k].height + s) >> s);
+            cv::Size pCapacity((capacities[k].width + s) >> s, (capacities[k].height + s) >> s);
+
+            //NOTE: the cached plane is only reallocated if it does not fit in its storage
+            if (uploaded) {
+                fitPlane<cv::UMat>(tile->gpuStorage[p], tile->gpuScaled[p], pSz, pCapacity, cvTypes[p]);
+                cv::resize(uploaded->gpuScaled[p], tile->gpuScaled[p], pSz);
+            } else {
+                cv::Mat img((frame->getHeight() + s) >> s, (frame->getWidth() + s) >> s, cvTypes[p], data[p], linesize[p]);
+                fitPlane<cv::Mat>(tile->storage[p], tile->scaled[p], pSz, pCapacity, cvTypes[p]);
+                cv::resize(img, tile->scaled[p], pSz);
+            }
+        }
+
+        tile->source = frame;
+        tile->sourceTs = frame->getPresentationTime();
+    });
+}
+
+//NOTE: the largest tile of each channel is published to its writer, i.e. a decoder may decode smaller pictures.
+//      Disabled channels and inputs read by other filters need the full size pictures
+void VideoMixer::publishTileSizes(std::vector<MixerLayout*> &active)
+{
+    std::map<int, cv::Size> tiles;
+    std::shared_ptr<Reader> reader;
+    cv::Size sz(0, 0);
+    int x, y;
+
+    for (auto l : active) {
+        for (auto &ch : l->channels) {
+            if (!ch.second.isEnabled()) {
+                continue;
+            }
+
+            tileGeometry(*l, ch.second, sz, x, y);
+            cv::Size &tile = tiles[ch.first];
+            tile = cv::Size(std::max(tile.width, sz.width), std::max(tile.height, sz.height));
+        }
+    }
+
+    for (auto &ch : layouts[DEFAULT_ID].channels) {
+        reader = getReader(ch.first);
+
+        if (!reader || !reader->getQueue()) {
+            continue;
+        }
+
+        if (reader->isShared() || tiles.count(ch.first) == 0) {
+            reader->getQueue()->setReaderPictureSize(0, 0);
+        } else {
+            reader->getQueue()->setReaderPictureSize(tiles[ch.first].width, tiles[ch.first].height);
+        }
+    }
+}
+
+void VideoMixer::composeLayout(MixerLayout &layout, std::map<int, VideoFrame*> &frames, std::vector<int> &newFrames)
+{
+    int cvTypes[MAX_PLANES];
+    int shifts[MAX_PLANES];
+    cv::Scalar background[MAX_PLANES];
+    std::vector<cv::Rect> dirty;
+    std::vector<int> ids;
+    std::set<int> changed;
+    unsigned planes;
+    bool repaint;
+
+    planes = compositionPlanes(pixelFormat, cvTypes, shifts, background);
+
+    if (!layout.staticValid) {
+        composeStatic(layout);
+    }
+
+    //NOTE: the previous composition is kept, any configuration change repaints it from scratch
+    if (!layout.compositionValid) {
+        for (unsigned p = 0; p < planes; p++) {
+            if (backend == OPENCL_COMPOSE) {
+                layout.gpuComposition[p].create((layout.height + shifts[p]) >> shifts[p], (layout.width + shifts[p]) >> shifts[p], cvTypes[p]);
+            } else {
+                layout.composition[p].create((layout.height + shifts[p]) >> shifts[p], (layout.width + shifts[p]) >> shifts[p], cvTypes[p]);
+            }
+        }
+
+        clearRegion(layout, cv::Rect(0, 0, layout.width, layout.height));
+    }
+
+    repaint = !layout.compositionValid;
+
+    for (int lay = 0; lay <= maxChannels; lay++) {
+        for (auto &ch : layout.channels) {
+            if (ch.second.getLayer() == lay && ch.second.isEnabled() && frames.count(ch.first) > 0) {
+                ids.push_back(ch.first);
+            }
+        }
+    }
+
+    for (auto id : ids) {
+        if (!layout.compositionValid || std::find(newFrames.begin(), newFrames.end(), id) != newFrames.end()) {
+            changed.insert(id);
+            dirty.push_back(tileRect(layout, layout.channels[id]));
+        }
+    }
+
+    //NOTE: each dirty region is cleared and all the tiles over it repainted in z-order, 
+    //      regions are merged so that no area is blended twice
+    mergeRects(dirty);
+
+    for (auto region : dirty) {
+        if (!repaint) {
+            clearRegion(layout, region);
+        }
+
+        composeTiles(layout, frames, ids, changed, region);
+    }
+
+    //NOTE: overlays are composited once over each repainted area, on top of all the tiles
+    if (repaint) {
+        overlayRegion(layout, layout.overlayRect);
+    } else {
+        for (auto region : dirty) {
+            overlayRegion(layout, region & layout.overlayRect);
+        }
+    }
+
+    layout.compositionValid = true;
+}
+
+void VideoMixer::clearRegion(MixerLayout &layout, cv::Rect region)
+{
+    int cvTypes[MAX_PLANES];
+    int shifts[MAX_PLANES];
+    cv::Scalar background[MAX_PLANES];
+    unsigned planes;
+    cv::Rect pRect;
+
+    planes = compositionPlanes(pixelFormat, cvTypes, shifts, background);
+
+    for (unsigned p = 0; p < planes; p++) {
+        if (backend == OPENCL_COMPOSE) {
+            pRect = planeRect(region, shifts[p], layout.gpuComposition[p].size());
+
+            if (layout.gpuStaticBackground[p].empty()) {
+                layout.gpuComposition[p](pRect).setTo(background[p]);
+            } else {
+                layout.gpuStaticBackground[p](pRect).copyTo(layout.gpuComposition[p](pRect));
+            }
+        } else {
+            pRect = planeRect(region, shifts[p], layout.composition[p].size());
+
+            if (layout.staticBackground[p].empty()) {
+                layout.composition[p](pRect) = background[p];
+            } else {
+                layout.staticBackground[p](pRect).copyTo(layout.composition[p](pRect));
+            }
+        }
+    }
+}
+
+void VideoMixer::overlayRegion(MixerLayout &layout, cv::Rect region)
+{
+    int cvTypes[MAX_PLANES];
+    int shifts[MAX_PLANES];
+    cv::Scalar background[MAX_PLANES];
+    unsigned planes;
+    cv::Rect pRect;
+
+    if (region.area() <= 0 || layout.overlay[0].empty()) {
+        return;
+    }
+
+    planes = compositionPlanes(pixelFormat, cvTypes, shifts, background);
+
+    for (unsigned p = 0; p < planes; p++) {
+        pRect = planeRect(region, shifts[p], layout.overlay[p].size());
+
+        if (backend == OPENCL_COMPOSE) {
+            overlayPlane<cv::UMat>(layout.gpuOverlay[p](pRect), layout.gpuOverlayInv[p](pRect), layout.gpuComposition[p](pRect));
+        } else {
+            overlayPlane<cv::Mat>(layout.overlay[p](pRect), layout.overlayInv[p](pRect), layout.composition[p](pRect));
+        }
+    }
+}
+
+//NOTE: layers are composed in RGB at the layout size, with straight alpha "over", then converted to the 
+//      composition format. Overlays are kept premultiplied by the alpha of each plane, subsampled with the chroma
+void VideoMixer::composeStatic(MixerLayout &layout)
+{
+    int cvTypes[MAX_PLANES];
+    int shifts[MAX_PLANES];
+    cv::Scalar background[MAX_PLANES];
+    std::vector<StaticLayer*> layers;
+    cv::Mat bg, color, alpha;
+    cv::Mat scaled, rgba, rgb, a, blended, safeAlpha;
+    cv::Mat rgb8, alpha8, pAlpha, pAlphaN;
+    cv::Rect rect, visible;
+    bool hasBackground = false;
+    unsigned planes;
+    //NOTE: subsampled chroma is converted from an even size picture
+    cv::Size sz((layout.width + 1) & ~1, (layout.height + 1) & ~1);
+    int fromTo[] = {0, 0, 1, 1, 2, 2, 3, 3, 3, 4, 3, 5};
+
+    planes = compositionPlanes(pixelFormat, cvTypes, shifts, background);
+
+    for (unsigned p = 0; p < MAX_PLANES; p++) {
+        layout.staticBackground[p].release();
+        layout.gpuStaticBackground[p].release();
+        layout.overlay[p].release();
+        layout.gpuOverlay[p].release();
+        layout.overlayInv[p].release();
+        layout.gpuOverlayInv[p].release();
+    }
+
+    layout.overlayRect = cv::Rect();
+    layout.staticValid = true;
+    layout.compositionValid = false;
+
+    if (layout.staticLayers.empty()) {
+        return;
+    }
+
+    for (auto &it : layout.staticLayers) {
+        layers.push_back(&it.second);
+    }
+
+    std::stable_sort(layers.begin(), layers.end(), [](StaticLayer* l, StaticLayer* r) {return l->layer < r->layer;});
+
+    bg = cv::Mat::zeros(sz, CV_32FC3);
+    color = cv::Mat::zeros(sz, CV_32FC3);
+    alpha = cv::Mat::zeros(sz, CV_32FC3);
+
+    for (auto l : layers) {
+        rect = cv::Rect(l->x*layout.width, l->y*layout.height, 
+                        std::max(1, (int) (l->width*layout.width)), std::max(1, (int) (l->height*layout.height)));
+        visible = rect & cv::Rect(0, 0, layout.width, layout.height);
+
+        if (visible.area() <= 0) {
+            continue;
+        }
+
+        //NOTE: images are scaled once, to the size they have in the layout
+        cv::resize(l->image, scaled, rect.size(), 0, 0, cv::INTER_AREA);
+        scaled(cv::Rect(visible.x - rect.x, visible.y - rect.y, visible.width, visible.height)).convertTo(rgba, CV_32FC4, 1/255.0);
+
+        rgb.create(visible.size(), CV_32FC3);
+        a.create(visible.size(), CV_32FC3);
+        cv::Mat straight[2] = {rgb, a};
+        cv::mixChannels(&rgba, 1, straight, 2, fromTo, 6);
+
+        if (l->overlay) {
+            blended = rgb.mul(a) + color(visible).mul(cv::Scalar::all(1) - a);
+            blended.copyTo(color(visible));
+            blended = a + alpha(visible).mul(cv::Scalar::all(1) - a);
+            blended.copyTo(alpha(visible));
+            layout.overlayRect = layout.overlayRect.area() > 0 ? layout.overlayRect | visible : visible;
+        } else {
+            blended = rgb.mul(a) + bg(visible).mul(cv::Scalar::all(1) - a);
+            blended.copyTo(bg(visible));
+            hasBackground = true;
+        }
+    }
+
+    if (hasBackground) {
+        bg.convertTo(rgb8, CV_8UC3, 255);
+        rgbToPlanes(rgb8, cv::Size(layout.width, layout.height), pixelFormat, layout.staticBackground);
+    }
+
+    if (layout.overlayRect.area() <= 0) {
+        layout.overlayRect = cv::Rect();
+    } else {
+        //NOTE: subsampled chroma samples are composited whole
+        if (planes > 1) {
+            rect = layout.overlayRect;
+            layout.overlayRect.x = rect.x & ~1;
+            layout.overlayRect.y = rect.y & ~1;
+            layout.overlayRect.width = ((rect.x + rect.width + 1) & ~1) - layout.overlayRect.x;
+            layout.overlayRect.height = ((rect.y + rect.height + 1) & ~1) - layout.overlayRect.y;
+            layout.overlayRect &= cv::Rect(0, 0, layout.width, layout.height);
+        }
+
+        //NOTE: colours are converted without their alpha, then premultiplied by the alpha of each plane
+        cv::max(alpha, cv::Scalar::all(1e-6), safeAlpha);
+        cv::divide(color, safeAlpha, color);
+        color.convertTo(rgb8, CV_8UC3, 255);
+        cv::extractChannel(alpha, a, 0);
+        a.convertTo(alpha8, CV_8UC1, 255);
+        rgbToPlanes(rgb8, cv::Size(layout.width, layout.height), pixelFormat, layout.overlay);
+
+        for (unsigned p = 0; p < planes; p++) {
+            if (shifts[p] > 0) {
+                cv::resize(alpha8, pAlpha, layout.overlay[p].size(), 0, 0, cv::INTER_AREA);
+            } else {
+                pAlpha = alpha8(cv::Rect(0, 0, layout.width, layout.height));
+            }
+
+            std::vector<cv::Mat> channels(CV_MAT_CN(cvTypes[p]), pAlpha);
+            cv::merge(channels, pAlphaN);
+            cv::multiply(layout.overlay[p], pAlphaN, layout.overlay[p], 1/255.0);
+            cv::subtract(cv::Scalar::all(255), pAlphaN, layout.overlayInv[p]);
+        }
+    }
+
+    if (backend != OPENCL_COMPOSE) {
+        return;
+    }
+
+    for (unsigned p = 0; p < planes; p++) {
+        layout.staticBackground[p].copyTo(layout.gpuStaticBackground[p]);
+        layout.overlay[p].copyTo(layout.gpuOverlay[p]);
+        layout.overlayInv[p].copyTo(layout.gpuOverlayInv[p]);
+    }
+}
+
+void VideoMixer::composeTiles(MixerLayout &layout, std::map<int, VideoFrame*> &frames, std::vector<int> &ids, 
+                              std::set<int> &changed, cv::Rect region)
+{
+    std::vector<int> tiles;
+    std::vector<cv::Rect> rects;
+    std::vector<unsigned> waves;
+    std::vector<unsigned> wave;
+    std::vector<TileCache*> caches;
+    unsigned nWaves = 0;
+    cv::Size sz(0, 0);
+    cv::Rect rect;
+    int x, y;
+
+    //NOTE: a tile is composed after the tiles it overlaps and that are below it, in waves 
+    //      of tiles which do not overlap each other
+    for (auto id : ids) {
+        rect = tileRect(layout, layout.channels[id]) & region;
+
+        if (rect.area() <= 0) {
+            continue;
+        }
+
+        tileGeometry(layout, layout.channels[id], sz, x, y);
+
+        tiles.push_back(id);
+        rects.push_back(rect);
+        caches.push_back(cacheOf(id, sz));
+        waves.push_back(0);
+
+        for (unsigned j = 0; j + 1 < tiles.size(); j++) {
+            if ((rects.back() & rects[j]).area() > 0) {
+                waves.back() = std::max(waves.back(), waves[j] + 1);
+            }
+        }
+
+        nWaves = std::max(nWaves, waves.back() + 1);
+    }
+
+    for (unsigned w = 0; w < nWaves; w++) {
+        wave.clear();
+
+        for (unsigned i = 0; i < tiles.size(); i++) {
+            if (waves[i] == w) {
+                wave.push_back(i);
+            }
+        }
+
+        runParallel(wave.size(), backend == CPU_COMPOSE, [&](unsigned k) {
+            unsigned i = wave[k];
+            pasteToLayout(frames[tiles[i]], layout, layout.channels[tiles[i]], caches[i], region);
+        });
+    }
+}
+
+cv::Rect VideoMixer::tileRect(MixerLayout &layout, ChannelConfig &chConfig)
+{
+    cv::Size sz(0, 0);
+    int x, y;
+
+    tileGeometry(layout, chConfig, sz, x, y);
+
+    //NOTE: sizes are rounded up to even, as the chroma planes of subsampled formats are
+    return cv::Rect(x, y, (sz.width + 1) & ~1, (sz.height + 1) & ~1) & cv::Rect(0, 0, layout.width, layout.height);
+}
+
+void VideoMixer::tileGeometry(MixerLayout &layout, ChannelConfig &chConfig, cv::Size &sz, int &x, int &y)
+{
+    int cvTypes[MAX_PLANES];
+    int shifts[MAX_PLANES];
+    cv::Scalar background[MAX_PLANES];
+
+    sz = cv::Size(chConfig.getWidth()*layout.width, chConfig.getHeight()*layout.height);
+    x = chConfig.getX()*layout.width;
+    y = chConfig.getY()*layout.height;
+    
+    //NOTE: subsampled chroma needs even positions, otherwise luma and chroma would not be aligned
+    if (compositionPlanes(pixelFormat, cvTypes, shifts, background) > 1) {
+        x &= ~1;
+        y &= ~1;
+    }
+}
+
+TileCache* VideoMixer::cacheOf(int id, cv::Size sz)
+{
+    auto ch = scaledTiles.find(id);
+
+    if (ch == scaledTiles.end()) {
+        return NULL;
+    }
+
+    auto cache = ch->second.find(std::make_pair(sz.width, sz.height));
+
+    return cache == ch->second.end() ? NULL : &cache->second;
+}
+
+TileCache* VideoMixer::tileOf(int id, cv::Size sz)
+{
+    std::map<std::pair<int, int>, TileCache> &tiles = scaledTiles[id];
+    auto key = std::make_pair(sz.width, sz.height);
+    auto cache = tiles.find(key);
+    auto spares = spareTiles.find(id);
+    TileCache* tile;
+
+    if (cache != tiles.end()) {
+        return &cache->second;
+    }
+
+    tile = &tiles[key];
+
+    //NOTE: new tile sizes of a transition take the planes of a spare cache
+    if (spares != spareTiles.end() && !spares->second.empty()) {
+        std::copy(spares->second.back().storage, spares->second.back().storage + MAX_PLANES, tile->storage);
+        std::copy(spares->second.back().gpuStorage, spares->second.back().gpuStorage + MAX_PLANES, tile->gpuStorage);
+        spares->second.pop_back();
+    }
+
+    return tile;
+}
+
+cv::Size VideoMixer::capacityOf(int id)
+{
+    auto capacity = tileCapacity.find(id);
+
+    return capacity == tileCapacity.end() ? cv::Size(0, 0) : capacity->second;
+}
+
+void VideoMixer::reserveTiles(MixerLayout &layout)
+{
+    int cvTypes[MAX_PLANES];
+    int shifts[MAX_PLANES];
+    cv::Scalar background[MAX_PLANES];
+    unsigned planes;
+    cv::Size sz(0, 0);
+    cv::Mat plane;
+    cv::UMat gpuPlane;
+    int x, y;
+    int s;
+
+    planes = compositionPlanes(pixelFormat, cvTypes, shifts, background);
+
+    //NOTE: the storage of each channel fits its biggest tile, at the start or the end of the transition
+    for (auto &ch : layout.to) {
+        cv::Size capacity = capacityOf(ch.first);
+
+        for (ChannelConfig* config : {&layout.from[ch.first], &ch.second}) {
+            if (!config->isEnabled()) {
+                continue;
+            }
+
+            tileGeometry(layout, *config, sz, x, y);
+            capacity = cv::Size(std::max(capacity.width, sz.width), std::max(capacity.height, sz.height));
+        }
+
+        if (capacity.area() <= 0) {
+            continue;
+        }
+
+        tileCapacity[ch.first] = capacity;
+        std::vector<TileCache> &spares = spareTiles[ch.first];
+        spares.reserve(VMIXER_SPARE_TILES);
+
+        while (spares.size() < VMIXER_SPARE_TILES) {
+            spares.push_back(TileCache());
+        }
+
+        for (auto &spare : spares) {
+            for (unsigned p = 0; p < planes; p++) {
+                s = shifts[p];
+                cv::Size pCapacity((capacity.width + s) >> s, (capacity.height + s) >> s);
+
+                if (backend == OPENCL_COMPOSE) {
+                    fitPlane<cv::UMat>(spare.gpuStorage[p], gpuPlane, pCapacity, pCapacity, cvTypes[p]);
+                } else {
+                    fitPlane<cv::Mat>(spare.storage[p], plane, pCapacity, pCapacity, cvTypes[p]);
+                }
+            }
+        }
+    }
+}
+
+void VideoMixer::stepTransitions()
+{
+    bool running = false;
+    float t;
+
+    for (auto &l : layouts) {
+        MixerLayout &layout = l.second;
+
+        if (layout.transitionFrames == 0) {
+            continue;
+        }
+
+        layout.transitionStep++;
+        t = std::min(1.0f, (float) layout.transitionStep / layout.transitionFrames);
+
+        //NOTE: channels connected or deleted during the transition are not in both ends, they are left as they are
+        for (auto &ch : layout.channels) {
+            auto from = layout.from.find(ch.first);
+            auto to = layout.to.find(ch.first);
+
+            if (from == layout.from.end() || to == layout.to.end()) {
+                continue;
+            }
+
+            if (t < 1) {
+                ch.second.interpolate(from->second, to->second, t);
+            } else {
+                ch.second = to->second;
+            }
+        }
+
+        layout.compositionValid = false;
+
+        if (t < 1) {
+            running = true;
+        } else {
+            layout.transitionFrames = 0;
+        }
+    }
+
+    if (!running) {
+        spareTiles.clear();
+        tileCapacity.clear();
+    }
+}
+
+void VideoMixer::pasteToLayout(VideoFrame* vFrame, MixerLayout &layout, ChannelConfig &chConfig, TileCache* cache, 
+                               cv::Rect region)
+{
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int cvTypes[MAX_PLANES];
+    int shifts[MAX_PLANES];
+    cv::Scalar background[MAX_PLANES];
+    unsigned planes;
+    cv::Size sz(0, 0);
+    int x, y;
+    int s;
+    cv::Rect dstRect;
+    cv::Rect srcRect;
+    cv::Mat img;
+    
+    if (vFrame->getPlanes(data, linesize) == 0) {
+        utils::errorMsg("[VideoMixer] Input frame has no picture planes");
+        return;
+    }
+    
+    planes = compositionPlanes(pixelFormat, cvTypes, shifts, background);
+    tileGeometry(layout, chConfig, sz, x, y);
+
+    //NOTE: tiles with another size than their input must have been scaled by scaleInputs, 
+    //      and all of them uploaded with the OpenCL backend
+    if (!cache && (backend == OPENCL_COMPOSE || vFrame->getWidth() != sz.width || vFrame->getHeight() != sz.height)) {
+        utils::errorMsg("[VideoMixer] Missing scaled input for a tile");
+        return;
+    }
+
+    for (unsigned p = 0; p < planes; p++) {
+        s = shifts[p];
+        cv::Size pSz((sz.width + s) >> s, (sz.height + s) >> s);
+        int pX = x >> s;
+        int pY = y >> s;
+
+        //NOTE: only the part of the tile inside the repainted region is pasted
+        dstRect = cv::Rect(pX, pY, pSz.width, pSz.height) & planeRect(region, s, cv::Size((layout.width + s) >> s, (layout.height + s) >> s));
+        
+        if (dstRect.area() <= 0) {
+            continue;
+        }
+        
+        srcRect = cv::Rect(dstRect.x - pX, dstRect.y - pY, dstRect.width, dstRect.height);
+
+        if (backend == OPENCL_COMPOSE) {
+            blendPlane<cv::UMat>(cache->gpuScaled[p](srcRect), layout.gpuComposition[p](dstRect), chConfig.getOpacity());
+            continue;
+        }
+
+        if (cache) {
+            img = cache->scaled[p];
+        } else {
+            img = cv::Mat(pSz.height, pSz.width, cvTypes[p], data[p], linesize[p]);
+        }
+        
+        blendPlane<cv::Mat>(img(srcRect), layout.composition[p](dstRect), chConfig.getOpacity());
+    }
+}
+
+bool VideoMixer::configChannel0(int id, float width, float height, float x, float y, int layer, bool enabled, float opacity,
+                                int layout)
+{
+    if (layouts.count(layout) <= 0 || layouts[layout].channels.count(id) <= 0) {
+        return false;
+    }
+
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 || opacity < 0 || opacity > 1.0) {
+        utils::errorMsg("[VideoMixer] Error configuring channel. Incoherent values");
+        return false;
+    }
+
+    if (x + width > 1 || y + height > 1) {
+        utils::warningMsg("[VideoMixer] Position + size exceed layout edges!");
+    }
+
+    if (layer < 0 || layer > maxChannels) {
+        utils::errorMsg("[VideoMixer] Error configuring channel. Layer value is not valid");
+        return false;
+    }
+
+    //NOTE: the channel would be overwritten by a running transition, which is stopped
+    layouts[layout].channels[id].config(width, height, x, y, layer, enabled, opacity);
+    layouts[layout].compositionValid = false;
+    layouts[layout].transitionFrames = 0;
+
+    return true;
+}
+
+bool VideoMixer::configure0(int width, int height, int fps, PixType format)
+{
+    int cvTypes[MAX_PLANES];
+    int shifts[MAX_PLANES];
+    cv::Scalar background[MAX_PLANES];
+    
+    if (format == P_NONE){
+        format = pixelFormat;
+    }
+    
+    if (compositionPlanes(format, cvTypes, shifts, background) == 0){
+        utils::errorMsg("[Video Mixer] Not valid composition pixel format, it must be RGB24, YUV420P or NV12");
+        return false;
+    }
+    
+    if (!configLayout0(DEFAULT_ID, width, height)){
+        return false;
+    }
+    
+    if (fps > 0){
+        setFrameTime(std::chrono::microseconds(std::micro::den/fps));
+    }
+    
+    if (format != pixelFormat){
+        for (auto &l : layouts) {
+            l.second.compositionValid = false;
+            l.second.staticValid = false;
+        }
+        scaledTiles.clear();
+    }
+    
+    pixelFormat = format;
+    
+    //NOTE: it is the format of the output queues, which are created when connecting the mixer
+    outputStreamInfo->video.pixelFormat = pixelFormat;
+    
+    return true;
+}
+
+bool VideoMixer::configLayout0(int writerId, int width, int height)
+{
+    if (width <= 0 || width > DEFAULT_WIDTH || height <= 0 || height > DEFAULT_HEIGHT){
+        utils::errorMsg("[Video Mixer] Not valid layout resolution");
+        return false;
+    }
+    
+    if (layouts.count(writerId) == 0){
+        if (layouts.size() >= VMIXER_MAX_LAYOUTS){
+            utils::errorMsg("[Video Mixer] Up to " + std::to_string(VMIXER_MAX_LAYOUTS) + " layouts are supported");
+            return false;
+        }
+        
+        //NOTE: the default layout has all the channels, a new one starts with all of them disabled
+        layouts[writerId] = MixerLayout(width, height);
+        if (writerId != DEFAULT_ID){
+            for (auto &ch : layouts[DEFAULT_ID].channels){
+                layouts[writerId].channels[ch.first] = ChannelConfig();
+            }
+        }
+    }
+    
+    layouts[writerId].width = width;
+    layouts[writerId].height = height;
+    layouts[writerId].compositionValid = false;
+    layouts[writerId].staticValid = false;
+    
+    return true;
+}
+
+bool VideoMixer::specificReaderConfig(int readerId, FrameQueue* /*queue*/)
+{
+    if (layouts[DEFAULT_ID].channels.count(readerId) > 0) {
+        utils::errorMsg("[VideoMixer::specificReaderConfig] Error configuring. This readerId exist " + std::to_string(readerId));
+        return false;
+    }
+
+    for (auto &l : layouts) {
+        l.second.channels[readerId] = ChannelConfig();
+        l.second.compositionValid = false;
+    }
+
+    return true;
+}
+
+bool VideoMixer::specificReaderDelete(int readerID)
+{
+    if (layouts[DEFAULT_ID].channels.count(readerID) <= 0) {
+        utils::errorMsg("[VideoMixer::specificReaderDelete] Error configuring. This readerId doesn't exist " + std::to_string(readerID));
+        return false;
+    }
+
+    for (auto &l : layouts) {
+        l.second.channels.erase(readerID);
+        l.second.compositionValid = false;
+    }
+
+    scaledTiles.erase(readerID);
+    spareTiles.erase(readerID);
+    tileCapacity.erase(readerID);
+    
+    return true;
+}
+
+void VideoMixer::initializeEventMap()
+{
+    eventMap["configChannel"] = std::bind(&VideoMixer::configChannelEvent, this, std::placeholders::_1);
+    eventMap["configure"] = std::bind(&VideoMixer::configureEvent, this, std::placeholders::_1);
+    eventMap["configLayout"] = std::bind(&VideoMixer::configLayoutEvent, this, std::placeholders::_1);
+    eventMap["removeLayout"] = std::bind(&VideoMixer::removeLayoutEvent, this, std::placeholders::_1);
+    eventMap["savePreset"] = std::bind(&VideoMixer::savePresetEvent, this, std::placeholders::_1);
+    eventMap["applyPreset"] = std::bind(&VideoMixer::applyPresetEvent, this, std::placeholders::_1);
+    eventMap["removePreset"] = std::bind(&VideoMixer::removePresetEvent, this, std::placeholders::_1);
+    eventMap["followSpeaker"] = std::bind(&VideoMixer::followSpeakerEvent, this, std::placeholders::_1);
+    eventMap["addStaticLayer"] = std::bind(&VideoMixer::addStaticLayerEvent, this, std::placeholders::_1);
+    eventMap["removeStaticLayer"] = std::bind(&VideoMixer::removeStaticLayerEvent, this, std::placeholders::_1);
+}
+
+bool VideoMixer::configChannelEvent(Jzon::Node* params)
+{
+    int layout = DEFAULT_ID;
+    
+    if (!params) {
+        utils::errorMsg("[VideoMixer::configChannelEvent] Params node missing");
+        return false;
+    }
+
+    if (!params->Has("id") || !params->Has("width") || !params->Has("height") ||
+            !params->Has("x") || !params->Has("y") || !params->Has("layer") ||
+                !params->Has("enabled") || !params->Has("opacity")) {
+
+        utils::errorMsg("[VideoMixer::configChannelEvent] Params node not complete");
+        return false;
+    }
+
+    int id = params->Get("id").ToInt();
+    float width = params->Get("width").ToFloat();
+    float height = params->Get("height").ToFloat();
+    float x = params->Get("x").ToFloat();
+    float y = params->Get("y").ToFloat();
+    int layer = params->Get("layer").ToInt();
+    bool enabled = params->Get("enabled").ToBool();
+    float opacity = params->Get("opacity").ToFloat();
+    
+    if (params->Has("layout") && params->Get("layout").IsNumber()) {
+        layout = params->Get("layout").ToInt();
+    }
+
+    return configChannel0(id, width, height, x, y, layer, enabled, opacity, layout);
+}
+
+bool VideoMixer::configureEvent(Jzon::Node* params)
+{
+    int width = layouts[DEFAULT_ID].width;
+    int height = layouts[DEFAULT_ID].height;
+    int fps = 0;
+    PixType format = P_NONE;
+       
+    if (!params) {
+        utils::errorMsg("[VideoMixer::configChannelEvent] Params node missing");
+        return false;
+    }
+
+    if (params->Has("width") && params->Has("height") && 
+        params->Get("width").IsNumber() && params->Get("height").IsNumber()) {
+        width = params->Get("width").ToInt();
+        height = params->Get("height").ToInt();
+    }
+    
+    if (params->Has("fps") && params->Get("fps").IsNumber()) {
+        fps = params->Get("fps").ToInt();
+    }
+    
+    if (params->Has("pixelFormat") && params->Get("pixelFormat").IsString()) {
+        format = utils::getPixTypeFromString(params->Get("pixelFormat").ToString());
+        
+        if (format == P_NONE) {
+            utils::errorMsg("[VideoMixer::configureEvent] Unknown pixel format");
+            return false;
+        }
+    }
+
+    return configure0(width, height, fps, format);
+}
+
+bool VideoMixer::configLayoutEvent(Jzon::Node* params)
+{
+    if (!params) {
+        utils::errorMsg("[VideoMixer::configLayoutEvent] Params node missing");
+        return false;
+    }
+
+    if (!params->Has("id") || !params->Has("width") || !params->Has("height") ||
+        !params->Get("id").IsNumber() || !params->Get("width").IsNumber() || !params->Get("height").IsNumber()) {
+        utils::errorMsg("[VideoMixer::configLayoutEvent] Params node not complete");
+        return false;
+    }
+
+    return configLayout0(params->Get("id").ToInt(), params->Get("width").ToInt(), params->Get("height").ToInt());
+}
+
+bool VideoMixer::removeLayoutEvent(Jzon::Node* params)
+{
+    int id;
+    
+    if (!params || !params->Has("id") || !params->Get("id").IsNumber()) {
+        utils::errorMsg("[VideoMixer::removeLayoutEvent] Params node not complete");
+        return false;
+    }
+
+    id = params->Get("id").ToInt();
+
+    if (id == DEFAULT_ID || layouts.count(id) == 0) {
+        utils::errorMsg("[VideoMixer::removeLayoutEvent] Only existing layouts other than the default one can be removed");
+        return false;
+    }
+
+    layouts.erase(id);
+    speakerLayouts.erase(id);
+    return true;
+}
+
+bool VideoMixer::savePreset0(std::string name, int layout)
+{
+    if (name.empty() || layouts.count(layout) == 0) {
+        utils::errorMsg("[VideoMixer] Error saving preset, it needs a name and an existing layout");
+        return false;
+    }
+
+    if (presets.count(name) == 0 && presets.size() >= VMIXER_MAX_PRESETS) {
+        utils::errorMsg("[VideoMixer] Up to " + std::to_string(VMIXER_MAX_PRESETS) + " presets are supported");
+        return false;
+    }
+
+    //NOTE: a layout in transition is saved as it ends
+    presets[name] = layouts[layout].transitionFrames > 0 ? layouts[layout].to : layouts[layout].channels;
+    return true;
+}
+
+bool VideoMixer::applyPreset0(std::string name, unsigned frames, int layout)
+{
+    MixerLayout *mLayout;
+
+    if (presets.count(name) == 0 || layouts.count(layout) == 0) {
+        utils::errorMsg("[VideoMixer] Error applying preset, unknown preset or layout");
+        return false;
+    }
+
+    mLayout = &layouts[layout];
+    transitionTo(*mLayout, presets[name], frames);
+
+    return true;
+}
+
+//NOTE: channels of the layout without configuration in the target keep the current one
+void VideoMixer::transitionTo(MixerLayout &layout, std::map<int, ChannelConfig> &target, unsigned frames)
+{
+    layout.from = layout.channels;
+    layout.to = layout.channels;
+
+    for (auto &ch : target) {
+        if (layout.to.count(ch.first) > 0) {
+            layout.to[ch.first] = ch.second;
+        }
+    }
+
+    layout.compositionValid = false;
+
+    if (frames == 0) {
+        layout.channels = layout.to;
+        layout.transitionFrames = 0;
+        return;
     }
 
-    return new VideoMixer(inputChannels, outWidth, outHeight, fTime);
+    layout.transitionFrames = frames;
+    layout.transitionStep = 0;
+    reserveTiles(layout);
 }
 
-VideoMixer::VideoMixer(int inputChannels, 
-                       int outWidth, int outHeight, std::chrono::microseconds fTime) :
-ManyToOneFilter(inputChannels), maxChannels(inputChannels)
+//NOTE: the levels are read once per composed frame, only when the mixer published new ones
+void VideoMixer::followSpeakers()
 {
-    configure0(outWidth, outHeight, 0);
-    initializeEventMap();
-    fType = VIDEO_MIXER;
-    
-    setFrameTime(fTime);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    int previous, speaker, channel;
 
-    outputStreamInfo = new StreamInfo(VIDEO);
-    outputStreamInfo->video.codec = RAW;
-    outputStreamInfo->video.pixelFormat = RGB24;
+    for (auto &it : speakerLayouts) {
+        SpeakerFollow &follow = it.second;
+
+        if (layouts.count(it.first) == 0 ||
+            !SpeakerActivity::getInstance()->read(follow.mixerId, follow.levels, follow.seq)) {
+            continue;
+        }
+
+        previous = follow.selector.getSpeaker();
+        speaker = follow.selector.select(follow.levels, now);
+
+        if (speaker < 0 || speaker == previous) {
+            continue;
+        }
+
+        channel = follow.channels.count(speaker) > 0 ? follow.channels[speaker] : speaker;
+        promote(layouts[it.first], channel, follow.frames);
+    }
 }
 
-VideoMixer::~VideoMixer()
+bool VideoMixer::promote(MixerLayout &layout, int id, unsigned frames)
 {
-    for (auto it : channelsConfig) {
-        delete it.second;
+    std::map<int, ChannelConfig> target = layout.transitionFrames > 0 ? layout.to : layout.channels;
+    int main = -1;
+    float area = 0;
+
+    for (auto &ch : target) {
+        if (ch.second.isEnabled() && ch.second.getWidth()*ch.second.getHeight() > area) {
+            area = ch.second.getWidth()*ch.second.getHeight();
+            main = ch.first;
+        }
     }
 
-    channelsConfig.clear();
+    if (target.count(id) == 0 || main < 0 || main == id) {
+        return false;
+    }
 
-    delete outputStreamInfo;
-}
+    std::swap(target[id], target[main]);
+    transitionTo(layout, target, frames);
 
-FrameQueue* VideoMixer::allocQueue(ConnectionData cData)
-{
-    return VideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_RAW_VIDEO_FRAMES);
+    return true;
 }
 
-bool VideoMixer::doProcessFrame(std::map<int, Frame*> &orgFrames, Frame *dst, std::vector<int> /*newFrames*/)
+bool VideoMixer::savePresetEvent(Jzon::Node* params)
 {
-    int frameNumber = orgFrames.size();
-    std::chrono::microseconds outTs = std::chrono::microseconds(0);
-    VideoFrame *vFrame;
+    int layout = DEFAULT_ID;
 
-    vFrame = dynamic_cast<VideoFrame*>(dst);
-
-    if (!vFrame) {
-        utils::errorMsg("[VideoMixer] Destination frame must be a VideoFrame");
+    if (!params || !params->Has("name") || !params->Get("name").IsString()) {
+        utils::errorMsg("[VideoMixer::savePresetEvent] Params node not complete");
         return false;
     }
 
-    layoutImg.data = vFrame->getDataBuf();
-    vFrame->setLength(layoutImg.step * outputHeight);
-    vFrame->setSize(outputWidth, outputHeight);
-
-    layoutImg = cv::Scalar(0, 0, 0);
+    if (params->Has("layout") && params->Get("layout").IsNumber()) {
+        layout = params->Get("layout").ToInt();
+    }
 
-    for (int lay=0; lay < maxChannels; lay++) {
+    return savePreset0(params->Get("name").ToString(), layout);
+}
 
-        for (auto it : orgFrames) {
+bool VideoMixer::applyPresetEvent(Jzon::Node* params)
+{
+    int layout = DEFAULT_ID;
+    int frames = 0;
 
-            if (channelsConfig.count(it.first) <= 0 || 
-                channelsConfig[it.first]->getLayer() != lay) {
-                continue;
-            }
+    if (!params || !params->Has("name") || !params->Get("name").IsString()) {
+        utils::errorMsg("[VideoMixer::applyPresetEvent] Params node not complete");
+        return false;
+    }
 
-            if (!it.second || !channelsConfig[it.first]->isEnabled()) {
-                frameNumber--;
-                continue;
-            }
+    if (params->Has("layout") && params->Get("layout").IsNumber()) {
+        layout = params->Get("layout").ToInt();
+    }
 
-            vFrame = dynamic_cast<VideoFrame*>(it.second);
+    if (params->Has("frames") && params->Get("frames").IsNumber()) {
+        frames = params->Get("frames").ToInt();
+    }
 
-            if (!vFrame) {
-                utils::errorMsg("[VideoMixer] Origin frame must be a VideoFrame");
-                return false;
-            }
+    if (frames < 0) {
+        utils::errorMsg("[VideoMixer::applyPresetEvent] Transition frames must not be negative");
+        return false;
+    }
 
-            pasteToLayout(it.first, vFrame);
-            outTs = std::max(vFrame->getPresentationTime(), outTs);
-            frameNumber--;
-        }
+    return applyPreset0(params->Get("name").ToString(), frames, layout);
+}
 
-        if (frameNumber <= 0) {
-            break;
-        }
+bool VideoMixer::removePresetEvent(Jzon::Node* params)
+{
+    if (!params || !params->Has("name") || !params->Get("name").IsString()) {
+        utils::errorMsg("[VideoMixer::removePresetEvent] Params node not complete");
+        return false;
     }
 
-    dst->setConsumed(true);
-    
-    if (getFrameTime().count() <= 0) {
-        dst->setPresentationTime(outTs);
-        setSyncTs(outTs);
-    } else {
-        dst->setPresentationTime(getSyncTs());
+    if (presets.erase(params->Get("name").ToString()) == 0) {
+        utils::errorMsg("[VideoMixer::removePresetEvent] Unknown preset");
+        return false;
     }
-    
-    dst->setDecodeTime(dst->getPresentationTime());
 
     return true;
 }
 
-bool VideoMixer::configChannel0(int id, float width, float height, float x, float y, int layer, bool enabled, float opacity)
+bool VideoMixer::followSpeakerEvent(Jzon::Node* params)
 {
-    if (channelsConfig.count(id) <= 0) {
+    SpeakerFollow follow;
+    int layout = DEFAULT_ID;
+    float margin = SPEAKER_MARGIN;
+    int hold = SPEAKER_HOLD;
+    int frames = 0;
+
+    if (!params || !params->Has("mixerId") || !params->Get("mixerId").IsNumber()) {
+        utils::errorMsg("[VideoMixer::followSpeakerEvent] Params node not complete");
         return false;
     }
 
-    if (x < 0 || y < 0 || width <= 0 || height <= 0 || opacity < 0 || opacity > 1.0) {
-        utils::errorMsg("[VideoMixer] Error configuring channel. Incoherent values");
-        return false;
+    if (params->Has("layout") && params->Get("layout").IsNumber()) {
+        layout = params->Get("layout").ToInt();
     }
 
-    if (x + width > 1 || y + height > 1) {
-        utils::warningMsg("[VideoMixer] Position + size exceed layout edges!");
+    if (params->Get("mixerId").ToInt() < 0) {
+        return speakerLayouts.erase(layout) > 0;
     }
 
-    if (layer < 0 || layer > maxChannels) {
-        utils::errorMsg("[VideoMixer] Error configuring channel. Layer value is not valid");
+    if (layouts.count(layout) == 0) {
+        utils::errorMsg("[VideoMixer::followSpeakerEvent] Unknown layout");
         return false;
     }
 
-    channelsConfig[id]->config(width, height, x, y, layer, enabled, opacity);
+    if (params->Has("margin") && params->Get("margin").IsNumber()) {
+        margin = params->Get("margin").ToFloat();
+    }
 
-    return true;
-}
+    if (params->Has("hold") && params->Get("hold").IsNumber()) {
+        hold = params->Get("hold").ToInt();
+    }
 
-bool VideoMixer::configure0(int width, int height, int fps)
-{
-    if (width <= 0 || width > DEFAULT_WIDTH || height <= 0 || height > DEFAULT_HEIGHT){
-        utils::errorMsg("[Video Mixer] Not valid layout resolution");
+    if (params->Has("frames") && params->Get("frames").IsNumber()) {
+        frames = params->Get("frames").ToInt();
+    }
+
+    if (frames < 0 || !follow.selector.configure(margin, std::chrono::milliseconds(hold))) {
+        utils::errorMsg("[VideoMixer::followSpeakerEvent] Invalid margin, hold or transition frames");
         return false;
     }
-    
-    if (fps > 0){
-        setFrameTime(std::chrono::microseconds(std::micro::den/fps));
+
+    if (params->Has("channels") && params->Get("channels").IsObject()) {
+        for (auto it : params->Get("channels").AsObject()) {
+            if (it.second.IsNumber()) {
+                follow.channels[atoi(it.first.c_str())] = it.second.ToInt();
+            }
+        }
     }
-    
-    outputHeight = height;
-    outputWidth = width;
-    
-    
-    layoutImg.release();
-        
-    layoutImg = cv::Mat(outputHeight, outputWidth, CV_8UC3);
-    
+
+    follow.mixerId = params->Get("mixerId").ToInt();
+    follow.frames = frames;
+    speakerLayouts[layout] = follow;
+
     return true;
 }
 
-void VideoMixer::pasteToLayout(int frameID, VideoFrame* vFrame)
+bool VideoMixer::addStaticLayer0(std::string name, cv::Mat image, float width, float height, float x, float y, 
+                                 int layer, bool overlay, int layout)
 {
-    ChannelConfig* chConfig = channelsConfig[frameID];
-    cv::Mat img(vFrame->getHeight(), vFrame->getWidth(), CV_8UC3, vFrame->getDataBuf());
+    StaticLayer sLayer;
 
-    cv::Size sz(chConfig->getWidth()*outputWidth, chConfig->getHeight()*outputHeight);
-
-    int x = chConfig->getX()*outputWidth;
-    int y = chConfig->getY()*outputHeight;
+    if (name.empty() || layouts.count(layout) == 0) {
+        utils::errorMsg("[VideoMixer] Error adding static layer, it needs a name and an existing layout");
+        return false;
+    }
 
-    if (vFrame->getHeight() != sz.height || vFrame->getWidth() != sz.width) {
-        cv::Mat resized(sz, img.type());
-        cv::resize(img, resized,sz);
-        cv::swap(img, resized);
-        resized.release();
+    if (image.empty() || image.depth() != CV_8U || (image.channels() != 3 && image.channels() != 4)) {
+        utils::errorMsg("[VideoMixer] Error adding static layer, the image must be 8 bit RGB or RGBA");
+        return false;
     }
-    
-    if (x + sz.width > outputWidth){
-        sz.width = outputWidth - x;
+
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 || layer < 0) {
+        utils::errorMsg("[VideoMixer] Error adding static layer. Incoherent values");
+        return false;
     }
-    
-    if (y + sz.height > outputHeight){
-        sz.height = outputHeight - y;
+
+    if (layouts[layout].staticLayers.count(name) == 0 && layouts[layout].staticLayers.size() >= VMIXER_MAX_STATIC_LAYERS) {
+        utils::errorMsg("[VideoMixer] Up to " + std::to_string(VMIXER_MAX_STATIC_LAYERS) + " static layers per layout are supported");
+        return false;
     }
-    
-    if (chConfig->getOpacity() == 1) {
-        img(cv::Rect(0, 0, sz.width, sz.height)).copyTo(layoutImg(cv::Rect(x, y, sz.width, sz.height)));
+
+    if (image.channels() == 3) {
+        cv::cvtColor(image, sLayer.image, cv::COLOR_RGB2RGBA);
     } else {
-        addWeighted(
-            img(cv::Rect(0, 0, sz.width, sz.height)),
-            chConfig->getOpacity(),
-            layoutImg(cv::Rect(x, y, sz.width, sz.height)),
-            1 - chConfig->getOpacity(),
-            0.0,
-            layoutImg(cv::Rect(x, y, sz.width, sz.height))
-        );
+        sLayer.image = image.clone();
     }
-}
 
-bool VideoMixer::specificReaderConfig(int readerId, FrameQueue* /*queue*/)
-{
-    if (channelsConfig.count(readerId) <= 0) {
-        channelsConfig[readerId] = new ChannelConfig();
-        return true;
-    }
+    sLayer.width = width;
+    sLayer.height = height;
+    sLayer.x = x;
+    sLayer.y = y;
+    sLayer.layer = layer;
+    sLayer.overlay = overlay;
 
-    utils::errorMsg("[VideoMixer::specificReaderConfig] Error configuring. This readerId exist " + std::to_string(readerId));
-    return false;
+    layouts[layout].staticLayers[name] = sLayer;
+    layouts[layout].staticValid = false;
+
+    return true;
 }
 
-bool VideoMixer::specificReaderDelete(int readerID)
+bool VideoMixer::removeStaticLayer0(std::string name, int layout)
 {
-    if (channelsConfig.count(readerID) <= 0) {
-        utils::errorMsg("[VideoMixer::specificReaderDelete] Error configuring. This readerId doesn't exist " + std::to_string(readerID));
+    if (layouts.count(layout) == 0 || layouts[layout].staticLayers.erase(name) == 0) {
+        utils::errorMsg("[VideoMixer] Error removing static layer, unknown layer or layout");
         return false;
     }
 
-    delete channelsConfig[readerID];
-    channelsConfig.erase(readerID);
-    
+    layouts[layout].staticValid = false;
+
     return true;
 }
 
-void VideoMixer::initializeEventMap()
+bool VideoMixer::addStaticLayerEvent(Jzon::Node* params)
 {
-    eventMap["configChannel"] = std::bind(&VideoMixer::configChannelEvent, this, std::placeholders::_1);
-    eventMap["configure"] = std::bind(&VideoMixer::configureEvent, this, std::placeholders::_1);
-}
+    int layout = DEFAULT_ID;
+    int layer = 0;
+    bool overlay = false;
+    cv::Mat image;
 
-bool VideoMixer::configChannelEvent(Jzon::Node* params)
-{
     if (!params) {
-        utils::errorMsg("[VideoMixer::configChannelEvent] Params node missing");
+        utils::errorMsg("[VideoMixer::addStaticLayerEvent] Params node missing");
         return false;
     }
 
-    if (!params->Has("id") || !params->Has("width") || !params->Has("height") ||
-            !params->Has("x") || !params->Has("y") || !params->Has("layer") ||
-                !params->Has("enabled") || !params->Has("opacity")) {
+    if (!params->Has("name") || !params->Has("path") || !params->Has("width") || !params->Has("height") ||
+        !params->Has("x") || !params->Has("y") || !params->Get("name").IsString() || !params->Get("path").IsString()) {
+        utils::errorMsg("[VideoMixer::addStaticLayerEvent] Params node not complete");
+        return false;
+    }
 
-        utils::errorMsg("[VideoMixer::configChannelEvent] Params node not complete");
+    if (params->Has("layer") && params->Get("layer").IsNumber()) {
+        layer = params->Get("layer").ToInt();
+    }
+
+    if (params->Has("overlay") && params->Get("overlay").IsBool()) {
+        overlay = params->Get("overlay").ToBool();
+    }
+
+    if (params->Has("layout") && params->Get("layout").IsNumber()) {
+        layout = params->Get("layout").ToInt();
+    }
+
+    //NOTE: the image is read once, in BGR(A) order as OpenCV decodes it
+    image = cv::imread(params->Get("path").ToString(), cv::IMREAD_UNCHANGED);
+
+    if (image.empty()) {
+        utils::errorMsg("[VideoMixer::addStaticLayerEvent] Could not read image " + params->Get("path").ToString());
         return false;
     }
 
-    int id = params->Get("id").ToInt();
-    float width = params->Get("width").ToFloat();
-    float height = params->Get("height").ToFloat();
-    float x = params->Get("x").ToFloat();
-    float y = params->Get("y").ToFloat();
-    int layer = params->Get("layer").ToInt();
-    bool enabled = params->Get("enabled").ToBool();
-    float opacity = params->Get("opacity").ToFloat();
+    if (image.depth() == CV_16U) {
+        image.convertTo(image, CV_8U, 1/256.0);
+    }
+
+    switch (image.channels()) {
+        case 1:
+            cv::cvtColor(image, image, cv::COLOR_GRAY2RGB);
+            break;
+        case 3:
+            cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
+            break;
+        case 4:
+            cv::cvtColor(image, image, cv::COLOR_BGRA2RGBA);
+            break;
+        default:
+            break;
+    }
 
-    return configChannel0(id, width, height, x, y, layer, enabled, opacity);
+    return addStaticLayer0(params->Get("name").ToString(), image, 
+                           params->Get("width").ToFloat(), params->Get("height").ToFloat(),
+                           params->Get("x").ToFloat(), params->Get("y").ToFloat(), layer, overlay, layout);
 }
 
-bool VideoMixer::configureEvent(Jzon::Node* params)
+bool VideoMixer::removeStaticLayerEvent(Jzon::Node* params)
 {
-    int width = outputWidth;
-    int height = outputHeight;
-    int fps = 0;
-       
-    if (!params) {
-        utils::errorMsg("[VideoMixer::configChannelEvent] Params node missing");
+    int layout = DEFAULT_ID;
+
+    if (!params || !params->Has("name") || !params->Get("name").IsString()) {
+        utils::errorMsg("[VideoMixer::removeStaticLayerEvent] Params node not complete");
         return false;
     }
 
-    if (params->Has("width") && params->Has("height") && 
-        params->Get("width").IsNumber() && params->Get("height").IsNumber()) {
-        width = params->Get("width").ToInt();
-        height = params->Get("height").ToInt();
-    }
-    
-    if (params->Has("fps") && params->Get("fps").IsNumber()) {
-        fps = params->Get("fps").ToInt();
+    if (params->Has("layout") && params->Get("layout").IsNumber()) {
+        layout = params->Get("layout").ToInt();
     }
 
-    return configure0(width, height, fps);
+    return removeStaticLayer0(params->Get("name").ToString(), layout);
 }
 
 void VideoMixer::doGetState(Jzon::Object &filterNode)
 {
-    Jzon::Array jsonChannelConfigs;
+    Jzon::Array jsonLayouts;
+    Jzon::Array jsonPresets;
+    Jzon::Array jsonSpeakers;
+
+    auto transitionState = [](MixerLayout &layout) {
+        return layout.transitionFrames > 0 ? (int) (layout.transitionFrames - layout.transitionStep) : 0;
+    };
 
-    filterNode.Add("width", outputWidth);
-    filterNode.Add("height", outputHeight);
+    auto channelsState = [](MixerLayout &layout) {
+        Jzon::Array jsonChannelConfigs;
+
+        for (auto &it : layout.channels) {
+            Jzon::Object chConfig;
+            chConfig.Add("id", it.first);
+            chConfig.Add("width", it.second.getWidth());
+            chConfig.Add("height", it.second.getHeight());
+            chConfig.Add("x", it.second.getX());
+            chConfig.Add("y", it.second.getY());
+            chConfig.Add("layer", it.second.getLayer());
+            chConfig.Add("enabled", it.second.isEnabled());
+            chConfig.Add("opacity", it.second.getOpacity());
+            jsonChannelConfigs.Add(chConfig);
+        }
+
+        return jsonChannelConfigs;
+    };
+
+    auto staticLayersState = [](MixerLayout &layout) {
+        Jzon::Array jsonStaticLayers;
+
+        for (auto &it : layout.staticLayers) {
+            Jzon::Object sLayer;
+            sLayer.Add("name", it.first);
+            sLayer.Add("width", it.second.width);
+            sLayer.Add("height", it.second.height);
+            sLayer.Add("x", it.second.x);
+            sLayer.Add("y", it.second.y);
+            sLayer.Add("layer", it.second.layer);
+            sLayer.Add("overlay", it.second.overlay);
+            sLayer.Add("imageWidth", it.second.image.cols);
+            sLayer.Add("imageHeight", it.second.image.rows);
+            jsonStaticLayers.Add(sLayer);
+        }
+
+        return jsonStaticLayers;
+    };
+
+    filterNode.Add("width", layouts[DEFAULT_ID].width);
+    filterNode.Add("height", layouts[DEFAULT_ID].height);
     filterNode.Add("maxChannels", maxChannels);
+    filterNode.Add("pixelFormat", utils::getPixTypeAsString(pixelFormat));
+    filterNode.Add("fps", getFrameTime().count() > 0 ? (int) (std::micro::den/getFrameTime().count()) : 0);
+    filterNode.Add("backend", utils::getComposeBackendAsString(backend));
+    filterNode.Add("channels", channelsState(layouts[DEFAULT_ID]));
+    filterNode.Add("transitionFrames", transitionState(layouts[DEFAULT_ID]));
+    filterNode.Add("staticLayers", staticLayersState(layouts[DEFAULT_ID]));
 
-    for (auto it : channelsConfig) {
-        Jzon::Object chConfig;
-        chConfig.Add("id", it.first);
-        chConfig.Add("width", it.second->getWidth());
-        chConfig.Add("height", it.second->getHeight());
-        chConfig.Add("x", it.second->getX());
-        chConfig.Add("y", it.second->getY());
-        chConfig.Add("layer", it.second->getLayer());
-        chConfig.Add("enabled", it.second->isEnabled());
-        chConfig.Add("opacity", it.second->getOpacity());
-        jsonChannelConfigs.Add(chConfig);
+    for (auto &it : layouts) {
+        if (it.first == DEFAULT_ID) {
+            continue;
+        }
+
+        Jzon::Object jsonLayout;
+        jsonLayout.Add("id", it.first);
+        jsonLayout.Add("width", it.second.width);
+        jsonLayout.Add("height", it.second.height);
+        jsonLayout.Add("channels", channelsState(it.second));
+        jsonLayout.Add("transitionFrames", transitionState(it.second));
+        jsonLayout.Add("staticLayers", staticLayersState(it.second));
+        jsonLayouts.Add(jsonLayout);
+    }
+
+    for (auto &it : presets) {
+        jsonPresets.Add(it.first);
     }
 
-    filterNode.Add("channels", jsonChannelConfigs);
+    for (auto &it : speakerLayouts) {
+        Jzon::Object jsonSpeaker;
+        jsonSpeaker.Add("layout", it.first);
+        jsonSpeaker.Add("mixerId", it.second.mixerId);
+        jsonSpeaker.Add("speaker", it.second.selector.getSpeaker());
+        jsonSpeaker.Add("switches", (int) it.second.selector.getSwitches());
+        jsonSpeakers.Add(jsonSpeaker);
+    }
+
+    filterNode.Add("layouts", jsonLayouts);
+    filterNode.Add("presets", jsonPresets);
+    filterNode.Add("speakerLayouts", jsonSpeakers);
 }
 
-bool VideoMixer::configChannel(int id, float width, float height, float x, float y, int layer, bool enabled, float opacity)
+bool VideoMixer::configChannel(int id, float width, float height, float x, float y, int layer, bool enabled, float opacity,
+                               int layout)
 {
     Jzon::Object root, params;
     root.Add("action", "configChannel");
@@ -362,6 +1853,7 @@ bool VideoMixer::configChannel(int id, float width, float height, float x, float
     params.Add("layer", layer);
     params.Add("enabled", enabled);
     params.Add("opacity", opacity);
+    params.Add("layout", layout);
     root.Add("params", params);
 
     Event e(root, std::chrono::system_clock::now(), 0);
@@ -369,13 +1861,138 @@ bool VideoMixer::configChannel(int id, float width, float height, float x, float
     return true;
 }
 
-bool VideoMixer::configure(int width, int height, int fps)
+bool VideoMixer::configure(int width, int height, int fps, PixType pixelFormat)
 {
     Jzon::Object root, params;
     root.Add("action", "configure");
     params.Add("width", width);
     params.Add("height", height);
     params.Add("fps", fps);
+    if (pixelFormat != P_NONE) {
+        params.Add("pixelFormat", utils::getPixTypeAsString(pixelFormat));
+    }
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool VideoMixer::configLayout(int writerId, int width, int height)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configLayout");
+    params.Add("id", writerId);
+    params.Add("width", width);
+    params.Add("height", height);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool VideoMixer::removeLayout(int writerId)
+{
+    Jzon::Object root, params;
+    root.Add("action", "removeLayout");
+    params.Add("id", writerId);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool VideoMixer::savePreset(std::string name, int layout)
+{
+    Jzon::Object root, params;
+    root.Add("action", "savePreset");
+    params.Add("name", name);
+    params.Add("layout", layout);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool VideoMixer::applyPreset(std::string name, unsigned frames, int layout)
+{
+    Jzon::Object root, params;
+    root.Add("action", "applyPreset");
+    params.Add("name", name);
+    params.Add("frames", (int) frames);
+    params.Add("layout", layout);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool VideoMixer::removePreset(std::string name)
+{
+    Jzon::Object root, params;
+    root.Add("action", "removePreset");
+    params.Add("name", name);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool VideoMixer::followSpeaker(int mixerId, std::map<int, int> channels, float margin, int hold, unsigned frames,
+                               int layout)
+{
+    Jzon::Object root, params, jsonChannels;
+    root.Add("action", "followSpeaker");
+    params.Add("mixerId", mixerId);
+
+    for (auto it : channels) {
+        jsonChannels.Add(std::to_string(it.first), it.second);
+    }
+
+    params.Add("channels", jsonChannels);
+    params.Add("margin", margin);
+    params.Add("hold", hold);
+    params.Add("frames", (int) frames);
+    params.Add("layout", layout);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool VideoMixer::addStaticLayer(std::string name, std::string path, float width, float height, float x, float y, 
+                                int layer, bool overlay, int layout)
+{
+    Jzon::Object root, params;
+    root.Add("action", "addStaticLayer");
+    params.Add("name", name);
+    params.Add("path", path);
+    params.Add("width", width);
+    params.Add("height", height);
+    params.Add("x", x);
+    params.Add("y", y);
+    params.Add("layer", layer);
+    params.Add("overlay", overlay);
+    params.Add("layout", layout);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e); 
+    return true;
+}
+
+bool VideoMixer::removeStaticLayer(std::string name, int layout)
+{
+    Jzon::Object root, params;
+    root.Add("action", "removeStaticLayer");
+    params.Add("name", name);
+    params.Add("layout", layout);
     root.Add("params", params);
 
     Event e(root, std::chrono::system_clock::now(), 0);
@@ -26,9 +26,15 @@
 #include "../../VideoFrame.hh"
 #include "../../Filter.hh"
 #include "../../StreamInfo.hh"
+#include "../../SpeakerActivity.hh"
 #include <opencv/cv.hpp>
+#include <set>
 
 #define VMIXER_MAX_CHANNELS 16
+#define VMIXER_MAX_LAYOUTS 8        //!< Maximum number of output layouts, one per writer
+#define VMIXER_MAX_PRESETS 16       //!< Maximum number of saved channels configurations
+#define VMIXER_SPARE_TILES 2        //!< Scaled planes kept per channel while a transition resizes its tiles
+#define VMIXER_MAX_STATIC_LAYERS 8  //!< Maximum number of static layers of a layout
 
 /*! Class that contains one mixer channel configuration */
 
@@ -53,6 +59,15 @@ public:
     */
     void config(float width, float height, float x, float y, int layer, bool enabled, float opacity);
 
+    /**
+    * Sets the configuration between two others. Channels enabled in only one of them stay where they are
+    * enabled and fade in or out.
+    * @param from configuration at the start
+    * @param to configuration at the end
+    * @param t progress between them [0.0, 1.0]
+    */
+    void interpolate(ChannelConfig &from, ChannelConfig &to, float t);
+
     float getWidth() {return width;};
     float getHeight() {return height;};
     float getX() {return x;};
@@ -71,11 +86,103 @@ private:
     float opacity;
 };
 
+/*! Planes of an input scaled to a tile size. They are kept between frames and shared by all the
+*   layouts with tiles of that size, so each input is scaled once per size and the planes are only
+*   reallocated when the size or the composition format changes. Planes are regions of their storage, 
+*   which transitions keep big enough for all the sizes of the tile, so resizing it does not reallocate them.
+*/
+struct TileCache {
+    TileCache() : source(NULL), sourceTs(-1), used(false) {};
+
+    cv::Mat scaled[MAX_PLANES];
+    cv::UMat gpuScaled[MAX_PLANES];         //!< Device planes, used by the OpenCL backend
+    cv::Mat storage[MAX_PLANES];            //!< Buffers holding the planes
+    cv::UMat gpuStorage[MAX_PLANES];        //!< Buffers holding the device planes
+    Frame* source;                          //!< Frame the planes were scaled from
+    std::chrono::microseconds sourceTs;     //!< Presentation time of that frame
+    bool used;                              //!< True if a layout tile needs it, unused caches are released
+};
+
+/*! Static image of a layout, such as a background plate, a logo or a lower third. Backgrounds are
+*   below all the channels and overlays above them. Images are kept as uploaded, in RGBA, and they 
+*   are only scaled and converted when the layout composes its static layers.
+*/
+struct StaticLayer {
+    StaticLayer() : width(1), height(1), x(0), y(0), layer(0), overlay(false) {};
+
+    cv::Mat image;                          //!< RGBA pixels, straight alpha
+    float width;
+    float height;
+    float x;
+    float y;
+    int layer;                              //!< Order among the static layers of its kind, 0 is the rear
+    bool overlay;                           //!< True if it is drawn over the channels
+};
+
+/*! Output layout of the mixer, with its own size and channels configuration. Its composition 
+*   is kept between frames, so only the regions of the tiles with a new frame are repainted.
+*   During a transition channels are interpolated on each composed frame, see VideoMixer::applyPreset.
+*   Static layers are composed once in the composition format: the backgrounds into the plate that 
+*   repainted regions are cleared to, and the overlays into premultiplied planes composited over the tiles.
+*/
+struct MixerLayout {
+    MixerLayout(int w = DEFAULT_WIDTH, int h = DEFAULT_HEIGHT) : 
+        width(w), height(h), compositionValid(false), transitionFrames(0), transitionStep(0), staticValid(false) {};
+
+    int width;
+    int height;
+    std::map<int, ChannelConfig> channels;
+    cv::Mat composition[MAX_PLANES];
+    cv::UMat gpuComposition[MAX_PLANES];    //!< Device composition, used by the OpenCL backend
+    bool compositionValid;
+    std::map<int, ChannelConfig> from;      //!< Channels at the start of the transition
+    std::map<int, ChannelConfig> to;        //!< Channels at the end of the transition
+    unsigned transitionFrames;              //!< Frames of the transition, 0 if there is none
+    unsigned transitionStep;                //!< Frames of the transition already composed
+    std::map<std::string, StaticLayer> staticLayers;
+    cv::Mat staticBackground[MAX_PLANES];   //!< Composed background layers, empty if there are none
+    cv::UMat gpuStaticBackground[MAX_PLANES];
+    cv::Mat overlay[MAX_PLANES];            //!< Composed overlay layers, premultiplied by their alpha
+    cv::UMat gpuOverlay[MAX_PLANES];
+    cv::Mat overlayInv[MAX_PLANES];         //!< 255 - alpha of the overlays, for each channel of the plane
+    cv::UMat gpuOverlayInv[MAX_PLANES];
+    cv::Rect overlayRect;                   //!< Bounding rect of the overlays, empty if there are none
+    bool staticValid;                       //!< False if the static layers must be composed again
+};
+
+/*! Speaker layout of a mixer layout: the channel of the active speaker of an audio mixer, picked
+*   from its published levels (see SpeakerActivity), is promoted to the main tile of the layout.
+*/
+struct SpeakerFollow {
+    SpeakerFollow() : mixerId(-1), frames(0), seq(0) {};
+
+    int mixerId;                            //!< Filter ID of the audio mixer
+    std::map<int, int> channels;            //!< Video channel of each audio channel, the same ID if empty
+    unsigned frames;                        //!< Frames of the promotion transition
+    SpeakerSelector selector;
+    uint64_t seq;                           //!< Last levels publication read
+    std::map<int, float> levels;
+};
+
 /*! Filter that mixes different video frames in one frame. Each channel is identified by and Id 
-*   (which coincides with the reader associated to it) and has its own configuration 
+*   (which coincides with the reader associated to it) and has its own configuration.
+*   Frames are composed in RGB24, YUV420P or NV12, scaling and blending each plane on its own,
+*   so YUV inputs and encoders need no colour conversion. Inputs must be in the composition format.
+*   Each writer can have its own layout, the ones without it get the default layout (DEFAULT_ID). 
+*   Inputs are scaled once for all the layouts with tiles of the same size, then the layouts, and 
+*   the tiles of each layout which do not overlap any previous one, are composed in parallel 
+*   on the pool workers.
+*   With the OpenCL backend, inputs are uploaded once and scaled, blended and kept composed in 
+*   device memory (OpenCV UMat), so only the uploads and the output downloads use the CPU.
+*   Channels configurations can be saved as presets and applied to any layout, moving and fading 
+*   the channels from their current configuration over a number of frames.
+*   A layout can follow the active speaker of an audio mixer, whose channel swaps its tile with the
+*   biggest one of the layout as soon as the mixer publishes the levels that make it the speaker.
+*   Static images (backgrounds and overlays) are not inputs: they are uploaded once and composed
+*   with the layout, so each frame only copies the background and blends the premultiplied overlays.
 */
 
-class VideoMixer : public ManyToOneFilter {
+class VideoMixer : public ManyToManyFilter {
 
     public:
         /**
@@ -83,12 +190,14 @@ class VideoMixer : public ManyToOneFilter {
         * @param outWidth Mixed frames width in pixels
         * @param outHeight Mixed frames height in pixels
         * @param fTime Frame time in microseconds
+        * @param backend Composition backend, OPENCL_COMPOSE falls back to CPU_COMPOSE without an OpenCL device
         * @return Pointer to new object if succeed of NULL if not
         */
         static VideoMixer* createNew(int inputChannels = VMIXER_MAX_CHANNELS,
                    int outputWidth = DEFAULT_WIDTH,
                    int outputHeight = DEFAULT_HEIGHT,
-                   std::chrono::microseconds fTime = std::chrono::microseconds(0));
+                   std::chrono::microseconds fTime = std::chrono::microseconds(0),
+                   ComposeBackend backend = CPU_COMPOSE);
         /**
         * Class destructor
         */
@@ -104,52 +213,179 @@ class VideoMixer : public ManyToOneFilter {
         * @param layer See ChannelConfig::config
         * @param enabled See ChannelConfig::config
         * @param opacity See ChannelConfig::config
+        * @param layout Id of the writer whose layout is configured, DEFAULT_ID for the default one
         */
-        bool configChannel(int id, float width, float height, float x, float y, int layer, bool enabled, float opacity);
+        bool configChannel(int id, float width, float height, float x, float y, int layer, bool enabled, float opacity,
+                           int layout = DEFAULT_ID);
         
         /**
-        * Configure layout, validating introduced data
+        * Configure the default layout, validating introduced data
         * @param width width in pixels of the layout
         * @param height height in pixels of the layout
         * @param fps maximum output frames per second
+        * @param pixelFormat composition pixel format (RGB24, YUV420P or NV12), P_NONE keeps the current one
         */
-        bool configure(int width, int height, int fps);
+        bool configure(int width, int height, int fps, PixType pixelFormat = P_NONE);
+
+        /**
+        * Adds a layout for a writer or resizes it. Its channels start disabled.
+        * @param writerId id of the writer, DEFAULT_ID resizes the default layout
+        * @param width width in pixels of the layout
+        * @param height height in pixels of the layout
+        */
+        bool configLayout(int writerId, int width, int height);
+
+        /**
+        * Removes the layout of a writer, which gets the default one afterwards
+        * @param writerId id of the writer, the default layout cannot be removed
+        */
+        bool removeLayout(int writerId);
+
+        /**
+        * Saves the channels configuration of a layout as a preset, replacing any preset with that name
+        * @param name name of the preset
+        * @param layout Id of the writer whose layout is saved, DEFAULT_ID for the default one
+        */
+        bool savePreset(std::string name, int layout = DEFAULT_ID);
+
+        /**
+        * Moves the channels of a layout to a saved configuration. Positions, sizes and opacities are 
+        * interpolated over the given frames, composed without reallocating the layout or the scaled inputs.
+        * Configuring a channel of the layout stops its transition.
+        * @param name name of the preset
+        * @param frames frames of the transition, 0 applies the preset at once
+        * @param layout Id of the writer whose layout is configured, DEFAULT_ID for the default one
+        */
+        bool applyPreset(std::string name, unsigned frames = 0, int layout = DEFAULT_ID);
+
+        /**
+        * Removes a saved preset
+        * @param name name of the preset
+        */
+        bool removePreset(std::string name);
+
+        /**
+        * Makes a layout follow the active speaker of an audio mixer, see SpeakerSelector. When the speaker
+        * changes, its channel swaps its configuration with the channel of the biggest enabled tile.
+        * @param mixerId filter ID of the audio mixer, negative to stop following it
+        * @param channels video channel of each audio channel, the same ID for the ones not given
+        * @param margin times louder than the speaker a channel must be to take the floor
+        * @param hold minimum time in ms the speaker keeps the floor
+        * @param frames frames of the promotion transition, 0 swaps the tiles at once
+        * @param layout Id of the writer whose layout follows the speaker, DEFAULT_ID for the default one
+        */
+        bool followSpeaker(int mixerId, std::map<int, int> channels = std::map<int, int>(),
+                           float margin = SPEAKER_MARGIN, int hold = SPEAKER_HOLD, unsigned frames = 0,
+                           int layout = DEFAULT_ID);
+
+        /**
+        * Adds a static image to a layout, replacing any static layer with that name
+        * @param name name of the layer
+        * @param path image file, its alpha channel is kept if it has one
+        * @param width See ChannelConfig::config
+        * @param height See ChannelConfig::config
+        * @param x See ChannelConfig::config
+        * @param y See ChannelConfig::config
+        * @param layer order among the static layers of its kind, 0 is the rear
+        * @param overlay if true, the image is drawn over the channels, otherwise below them
+        * @param layout Id of the writer whose layout is configured, DEFAULT_ID for the default one
+        */
+        bool addStaticLayer(std::string name, std::string path, float width, float height, float x, float y, 
+                            int layer = 0, bool overlay = false, int layout = DEFAULT_ID);
+
+        /**
+        * Removes a static image of a layout
+        * @param name name of the layer
+        * @param layout Id of the writer whose layout is configured, DEFAULT_ID for the default one
+        */
+        bool removeStaticLayer(std::string name, int layout = DEFAULT_ID);
 
         /**
         * @return Mixing max channels
         */
         int getMaxChannels() {return maxChannels;};
 
+        /**
+        * @return Composition pixel format
+        */
+        PixType getPixelFormat() {return pixelFormat;};
+
+        /**
+        * @return Composition backend
+        */
+        ComposeBackend getBackend() {return backend;};
+
     protected:
         //Protected for testing purposes
         VideoMixer(int inputChannels,
                    int outWidth, int outHeight,
-                   std::chrono::microseconds fTime);
+                   std::chrono::microseconds fTime, ComposeBackend backend = CPU_COMPOSE);
         FrameQueue *allocQueue(ConnectionData cData);
-        bool doProcessFrame(std::map<int, Frame*> &orgFrames, Frame *dst, std::vector<int> /*newFrames*/);
+        bool doProcessFrame(FrameMap &orgFrames, FrameMap &dstFrames, std::vector<int> &newFrames);
         void doGetState(Jzon::Object &filterNode);
-        bool configChannel0(int id, float width, float height, float x, float y, int layer, bool enabled, float opacity);
+        bool configChannel0(int id, float width, float height, float x, float y, int layer, bool enabled, float opacity,
+                            int layout = DEFAULT_ID);
         bool specificReaderConfig(int readerID, FrameQueue* /*queue*/);
+        bool addStaticLayer0(std::string name, cv::Mat image, float width, float height, float x, float y, 
+                             int layer, bool overlay, int layout);
+        bool removeStaticLayer0(std::string name, int layout);
 
     private:
         void initializeEventMap();
-        void pasteToLayout(int frameID, VideoFrame* vFrame);
+        void scaleInputs(std::vector<MixerLayout*> &active, std::map<int, VideoFrame*> &frames);
+        void publishTileSizes(std::vector<MixerLayout*> &active);
+        void composeLayout(MixerLayout &layout, std::map<int, VideoFrame*> &frames, std::vector<int> &newFrames);
+        void composeTiles(MixerLayout &layout, std::map<int, VideoFrame*> &frames, std::vector<int> &ids, 
+                          std::set<int> &changed, cv::Rect region);
+        void tileGeometry(MixerLayout &layout, ChannelConfig &chConfig, cv::Size &sz, int &x, int &y);
+        cv::Rect tileRect(MixerLayout &layout, ChannelConfig &chConfig);
+        TileCache* cacheOf(int id, cv::Size sz);
+        TileCache* tileOf(int id, cv::Size sz);
+        cv::Size capacityOf(int id);
+        void reserveTiles(MixerLayout &layout);
+        void stepTransitions();
+        void transitionTo(MixerLayout &layout, std::map<int, ChannelConfig> &target, unsigned frames);
+        void followSpeakers();
+        bool promote(MixerLayout &layout, int id, unsigned frames);
+        void composeStatic(MixerLayout &layout);
+        void clearRegion(MixerLayout &layout, cv::Rect region);
+        void overlayRegion(MixerLayout &layout, cv::Rect region);
+        void pasteToLayout(VideoFrame* vFrame, MixerLayout &layout, ChannelConfig &chConfig, TileCache* cache, 
+                           cv::Rect region);
         bool configChannelEvent(Jzon::Node* params);
         
-        bool configure0(int width, int height, int fps);
+        bool configure0(int width, int height, int fps, PixType format);
         bool configureEvent(Jzon::Node* params);
+        bool configLayout0(int writerId, int width, int height);
+        bool configLayoutEvent(Jzon::Node* params);
+        bool removeLayoutEvent(Jzon::Node* params);
+        bool savePreset0(std::string name, int layout);
+        bool savePresetEvent(Jzon::Node* params);
+        bool applyPreset0(std::string name, unsigned frames, int layout);
+        bool applyPresetEvent(Jzon::Node* params);
+        bool removePresetEvent(Jzon::Node* params);
+        bool followSpeakerEvent(Jzon::Node* params);
+        bool addStaticLayerEvent(Jzon::Node* params);
+        bool removeStaticLayerEvent(Jzon::Node* params);
         
         bool specificReaderDelete(int readerID);
         
-        //NOTE: There is no need of specific writer configuration
+        //NOTE: layouts are kept when their writer is deleted, they are removed explicitly
         bool specificWriterConfig(int /*writerID*/) {return true;};
         bool specificWriterDelete(int /*writerID*/) {return true;};
 
         StreamInfo *outputStreamInfo;
-        std::map<int, ChannelConfig*> channelsConfig;
-        int outputWidth;
-        int outputHeight;
-        cv::Mat layoutImg;
+        std::map<int, MixerLayout> layouts;
+        //NOTE: scaled planes of each channel by tile size
+        std::map<int, std::map<std::pair<int, int>, TileCache>> scaledTiles;
+        //NOTE: while transitions run, planes of the caches of each channel that are not used anymore
+        //      and the biggest tile size of the channel, new tile sizes take their planes
+        std::map<int, std::vector<TileCache>> spareTiles;
+        std::map<int, cv::Size> tileCapacity;
+        std::map<std::string, std::map<int, ChannelConfig>> presets;
+        std::map<int, SpeakerFollow> speakerLayouts;
+        PixType pixelFormat;
+        ComposeBackend backend;
         int maxChannels;
 };
 
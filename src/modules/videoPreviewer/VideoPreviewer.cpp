@@ -0,0 +1,529 @@
+/*
+ *  VideoPreviewer - Keyframe only JPEG previews of coded video streams
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "VideoPreviewer.hh"
+#include "../dasher/DashHttpOrigin.hh"
+#include "../../AVFramedQueue.hh"
+#include "../../NalSplitter.hh"
+#include "../../Utils.hh"
+#include "../../AsyncLog.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+
+#define NAL_START_SIZE 4
+
+static const unsigned char nalStartCode[NAL_START_SIZE] = {0x00, 0x00, 0x00, 0x01};
+
+static bool isParameterSet(VCodecType codec, unsigned char nalType)
+{
+    return codec == H264 ? (nalType == 7 || nalType == 8) : (nalType >= 32 && nalType <= 34);
+}
+
+static bool isKeySlice(VCodecType codec, unsigned char nalType)
+{
+    return codec == H264 ? nalType == 5 : (nalType >= 16 && nalType <= 21);
+}
+
+VideoPreviewer::VideoPreviewer(unsigned readersNum) :
+    TailFilter(readersNum), origin(NULL), width(PREVIEW_DEFAULT_WIDTH), quality(PREVIEW_DEFAULT_QUALITY),
+    interval(std::chrono::milliseconds(PREVIEW_DEFAULT_INTERVAL)), configured(false), previews(0), failedPreviews(0)
+{
+    avcodec_register_all();
+    fType = VIDEO_PREVIEWER;
+    initializeEventMap();
+}
+
+VideoPreviewer::~VideoPreviewer()
+{
+    for (auto &it : inputs) {
+        freeInput(it.second);
+    }
+
+    delete origin;
+}
+
+bool VideoPreviewer::configure(std::string folder, std::string baseName_, unsigned width_,
+                               unsigned intervalMs, unsigned quality_)
+{
+    if (!folder.empty() && access(folder.c_str(), W_OK) != 0) {
+        utils::errorMsg("Error configuring VideoPreviewer: provided folder is not writable");
+        return false;
+    }
+
+    if (baseName_.empty() || width_ < 2 || quality_ < 2 || quality_ > 31) {
+        utils::errorMsg("Error configuring VideoPreviewer: invalid parameters");
+        return false;
+    }
+
+    if (!folder.empty() && folder.back() != '/') {
+        folder += "/";
+    }
+
+    basePath = folder;
+    baseName = baseName_;
+    width = width_ & ~1U;
+    quality = quality_;
+    interval = std::chrono::milliseconds(intervalMs);
+    configured = true;
+
+    //NOTE: encoders are opened again with the new size and quality
+    for (auto &it : inputs) {
+        avcodec_free_context(&it.second.encoder);
+    }
+
+    return true;
+}
+
+bool VideoPreviewer::doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& /*ret*/)
+{
+    if (!configured) {
+        return true;
+    }
+
+    for (auto id : newFrames) {
+        auto it = inputs.find(id);
+
+        if (it == inputs.end()) {
+            continue;
+        }
+
+        //NOTE: a unit is complete once a NAL unit of another access unit arrives
+        if (it->second.size > 0 && orgFrames[id]->getPresentationTime() != it->second.ts) {
+            finishUnit(id, it->second);
+        }
+
+        addNal(it->second, orgFrames[id]);
+    }
+
+    return true;
+}
+
+void VideoPreviewer::addNal(PreviewInput &input, Frame* frame)
+{
+    unsigned char* data = frame->getDataBuf();
+    unsigned length = frame->getLength();
+    unsigned start = NalSplitter::startCodeLength(data, length);
+    std::chrono::microseconds ts = frame->getPresentationTime();
+    unsigned char nalType;
+
+    if (length <= start) {
+        return;
+    }
+
+    //NOTE: until the interval elapses nothing is staged, non key frames are never copied
+    if (input.previews > 0 && ts - input.lastPreview < interval) {
+        return;
+    }
+
+    nalType = input.codec == H264 ? data[start] & 0x1F : (data[start] & 0x7E) >> 1;
+
+    if (!isParameterSet(input.codec, nalType) && !isKeySlice(input.codec, nalType)) {
+        return;
+    }
+
+    if (input.size + length + NAL_START_SIZE > input.unit.size()) {
+        input.unit.resize(input.size + length + NAL_START_SIZE);
+    }
+
+    if (start == 0) {
+        memcpy(input.unit.data() + input.size, nalStartCode, NAL_START_SIZE);
+        input.size += NAL_START_SIZE;
+    }
+
+    memcpy(input.unit.data() + input.size, data, length);
+    input.size += length;
+    input.ts = ts;
+    input.key = input.key || isKeySlice(input.codec, nalType);
+}
+
+void VideoPreviewer::finishUnit(int id, PreviewInput &input)
+{
+    //NOTE: parameter sets without IDR slices are dropped, the next keyframe carries them again
+    if (input.key) {
+        if (decodeUnit(id, input)) {
+            input.lastPreview = input.ts;
+            input.previews++;
+            previews++;
+        } else {
+            failedPreviews++;
+        }
+    }
+
+    input.size = 0;
+    input.key = false;
+}
+
+bool VideoPreviewer::decodeUnit(int id, PreviewInput &input)
+{
+    AVPacket pkt;
+    bool encoded = false;
+
+    av_init_packet(&pkt);
+    pkt.data = input.unit.data();
+    pkt.size = input.size;
+    pkt.pts = input.ts.count();
+
+    if (avcodec_send_packet(input.decoder, &pkt) < 0) {
+        ERROR_MSG("[VideoPreviewer] Error decoding keyframe of reader %d", id);
+        return false;
+    }
+
+    while (avcodec_receive_frame(input.decoder, input.decoded) >= 0) {
+        encoded = encodePreview(id, input) || encoded;
+        av_frame_unref(input.decoded);
+    }
+
+    return encoded;
+}
+
+bool VideoPreviewer::encodePreview(int id, PreviewInput &input)
+{
+    AVFrame *pic = input.decoded;
+    AVPacket pkt;
+    int height;
+
+    if (pic->width <= 0 || pic->height <= 0) {
+        return false;
+    }
+
+    height = std::max(2, (int) ((int64_t) width*pic->height/pic->width) & ~1);
+
+    if (!input.encoder || input.encoder->height != height) {
+        avcodec_free_context(&input.encoder);
+
+        if (!openEncoder(input, height)) {
+            ERROR_MSG("[VideoPreviewer] Error opening the JPEG encoder of reader %d", id);
+            return false;
+        }
+    }
+
+    input.sws = sws_getCachedContext(input.sws, pic->width, pic->height, (AVPixelFormat) pic->format,
+                                     width, height, AV_PIX_FMT_YUVJ420P, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (!input.sws) {
+        return false;
+    }
+
+    if (av_frame_make_writable(input.scaled) < 0) {
+        return false;
+    }
+
+    sws_scale(input.sws, pic->data, pic->linesize, 0, pic->height, input.scaled->data, input.scaled->linesize);
+
+    input.scaled->pts = input.previews;
+    input.scaled->quality = input.encoder->global_quality;
+
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+
+    if (avcodec_send_frame(input.encoder, input.scaled) < 0 || avcodec_receive_packet(input.encoder, &pkt) < 0) {
+        ERROR_MSG("[VideoPreviewer] Error encoding the preview of reader %d", id);
+        return false;
+    }
+
+    publish(id, pkt.data, pkt.size);
+    av_packet_unref(&pkt);
+
+    return true;
+}
+
+bool VideoPreviewer::openEncoder(PreviewInput &input, int height)
+{
+    AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+
+    if (!codec || !(input.encoder = avcodec_alloc_context3(codec))) {
+        return false;
+    }
+
+    input.encoder->width = width;
+    input.encoder->height = height;
+    input.encoder->pix_fmt = AV_PIX_FMT_YUVJ420P;
+    input.encoder->time_base = (AVRational) {1, 1};
+    input.encoder->flags |= CODEC_FLAG_QSCALE;
+    input.encoder->global_quality = FF_QP2LAMBDA*quality;
+
+    if (avcodec_open2(input.encoder, codec, NULL) < 0) {
+        avcodec_free_context(&input.encoder);
+        return false;
+    }
+
+    av_frame_unref(input.scaled);
+    input.scaled->width = width;
+    input.scaled->height = height;
+    input.scaled->format = AV_PIX_FMT_YUVJ420P;
+
+    if (av_frame_get_buffer(input.scaled, FRAME_ALIGNMENT) < 0) {
+        avcodec_free_context(&input.encoder);
+        return false;
+    }
+
+    return true;
+}
+
+void VideoPreviewer::publish(int id, const unsigned char* data, size_t length)
+{
+    std::string name = baseName + "_" + std::to_string(id) + PREVIEW_EXT;
+    std::string path = basePath + name;
+    std::string tmpPath = path + ".tmp";
+
+    if (origin) {
+        origin->publish(name, data, length);
+    }
+
+    if (basePath.empty()) {
+        return;
+    }
+
+    //NOTE: previews are small and few per second, they are written in place with a temporary name
+    //      so readers never get a partial picture
+    std::ofstream file(tmpPath.c_str(), std::ofstream::binary | std::ofstream::trunc);
+    file.write((const char*) data, length);
+    file.close();
+
+    if (!file || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        ERROR_MSG("[VideoPreviewer] Error writing preview %s", path.c_str());
+        failedPreviews++;
+    }
+}
+
+bool VideoPreviewer::specificReaderConfig(int readerId, FrameQueue* queue)
+{
+    VideoFrameQueue *vQueue;
+    AVCodec *codec;
+    PreviewInput input;
+
+    if ((vQueue = dynamic_cast<VideoFrameQueue*>(queue)) == NULL) {
+        utils::errorMsg("Error setting previewer reader: only video queues are supported");
+        return false;
+    }
+
+    input.codec = vQueue->getStreamInfo()->video.codec;
+
+    if (input.codec != H264 && input.codec != H265) {
+        utils::errorMsg("Error setting previewer reader: only H264 & H265 codecs are supported");
+        return false;
+    }
+
+    codec = avcodec_find_decoder(input.codec == H264 ? AV_CODEC_ID_H264 : AV_CODEC_ID_HEVC);
+    if (!codec || !(input.decoder = avcodec_alloc_context3(codec))) {
+        utils::errorMsg("Error setting previewer reader: required codec not found");
+        return false;
+    }
+
+    //NOTE: only keyframes are fed, they are output right away without waiting for reordering
+    input.decoder->skip_frame = AVDISCARD_NONKEY;
+    input.decoder->flags |= CODEC_FLAG_LOW_DELAY;
+    input.decoder->thread_count = 1;
+    //NOTE: keyframes carry their parameter sets, so later versions of the extradata are not needed
+    input.extradata = vQueue->getStreamInfo()->getExtraData();
+    input.decoder->extradata = input.extradata ? const_cast<uint8_t*>(input.extradata->data()) : NULL;
+    input.decoder->extradata_size = input.extradata ? input.extradata->size() : 0;
+
+    if (avcodec_open2(input.decoder, codec, NULL) < 0) {
+        utils::errorMsg("Error setting previewer reader: could not open the decoder");
+        input.decoder->extradata = NULL;
+        avcodec_free_context(&input.decoder);
+        return false;
+    }
+
+    input.encoder = NULL;
+    input.sws = NULL;
+    input.decoded = av_frame_alloc();
+    input.scaled = av_frame_alloc();
+    input.unit.resize(PREVIEW_UNIT_SIZE);
+    input.size = 0;
+    input.key = false;
+    input.ts = std::chrono::microseconds(0);
+    input.lastPreview = std::chrono::microseconds(0);
+    input.previews = 0;
+
+    inputs[readerId] = input;
+
+    return true;
+}
+
+bool VideoPreviewer::specificReaderDelete(int readerId)
+{
+    std::string name = baseName + "_" + std::to_string(readerId) + PREVIEW_EXT;
+
+    if (inputs.count(readerId) == 0) {
+        return false;
+    }
+
+    freeInput(inputs[readerId]);
+    inputs.erase(readerId);
+
+    if (origin) {
+        origin->remove(name);
+    }
+
+    return true;
+}
+
+void VideoPreviewer::freeInput(PreviewInput &input)
+{
+    //NOTE: the extradata belongs to the stream info, the input holds the version the decoder uses
+    if (input.decoder) {
+        input.decoder->extradata = NULL;
+        input.decoder->extradata_size = 0;
+    }
+
+    avcodec_free_context(&input.decoder);
+    avcodec_free_context(&input.encoder);
+    sws_freeContext(input.sws);
+    input.sws = NULL;
+    av_frame_free(&input.decoded);
+    av_frame_free(&input.scaled);
+    input.extradata.reset();
+}
+
+void VideoPreviewer::initializeEventMap()
+{
+    eventMap["configure"] = std::bind(&VideoPreviewer::configureEvent, this, std::placeholders::_1);
+    eventMap["configOrigin"] = std::bind(&VideoPreviewer::configOriginEvent, this, std::placeholders::_1);
+}
+
+size_t VideoPreviewer::getInternalBytes()
+{
+    size_t bytes = 0;
+
+    for (auto &it : inputs) {
+        bytes += it.second.unit.capacity();
+    }
+
+    return bytes;
+}
+
+void VideoPreviewer::doGetState(Jzon::Object &filterNode)
+{
+    Jzon::Array readersList;
+    Jzon::Object originNode;
+
+    filterNode.Add("folder", basePath);
+    filterNode.Add("baseName", baseName);
+    filterNode.Add("width", (int) width);
+    filterNode.Add("intervalMs", (int) std::chrono::duration_cast<std::chrono::milliseconds>(interval).count());
+    filterNode.Add("quality", (int) quality);
+    filterNode.Add("previews", (int) previews);
+    filterNode.Add("failedPreviews", (int) failedPreviews);
+
+    for (auto &it : inputs) {
+        readersList.Add(it.first);
+    }
+
+    filterNode.Add("readers", readersList);
+
+    if (origin) {
+        origin->getState(originNode);
+        filterNode.Add("origin", originNode);
+    }
+}
+
+bool VideoPreviewer::configureEvent(Jzon::Node* params)
+{
+    std::string folder = basePath;
+    std::string bName = baseName;
+    unsigned w = width;
+    unsigned intervalMs = std::chrono::duration_cast<std::chrono::milliseconds>(interval).count();
+    unsigned q = quality;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("folder") && params->Get("folder").IsString()) {
+        folder = params->Get("folder").ToString();
+    }
+
+    if (params->Has("baseName") && params->Get("baseName").IsString()) {
+        bName = params->Get("baseName").ToString();
+    }
+
+    if (params->Has("width") && params->Get("width").IsNumber()) {
+        w = params->Get("width").ToInt();
+    }
+
+    if (params->Has("intervalMs") && params->Get("intervalMs").IsNumber()) {
+        intervalMs = params->Get("intervalMs").ToInt();
+    }
+
+    if (params->Has("quality") && params->Get("quality").IsNumber()) {
+        q = params->Get("quality").ToInt();
+    }
+
+    return configure(folder, bName, w, intervalMs, q);
+}
+
+bool VideoPreviewer::configOriginEvent(Jzon::Node* params)
+{
+    int port = origin ? origin->getPort() : 0;
+
+    if (!params) {
+        return false;
+    }
+
+    if (params->Has("port") && params->Get("port").IsNumber()) {
+        port = params->Get("port").ToInt();
+    }
+
+    return configOrigin0(port);
+}
+
+bool VideoPreviewer::configOrigin0(int port)
+{
+    if (port < 0 || port > 65535) {
+        utils::errorMsg("Error configuring preview origin: invalid port");
+        return false;
+    }
+
+    if (origin && (int) origin->getPort() != port) {
+        delete origin;
+        origin = NULL;
+    }
+
+    if (port > 0 && !origin) {
+        origin = new DashHttpOrigin();
+
+        if (!origin->start(port)) {
+            utils::errorMsg("Error configuring preview origin: could not listen on port " + std::to_string(port));
+            delete origin;
+            origin = NULL;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool VideoPreviewer::configOrigin(unsigned port)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configOrigin");
+    params.Add("port", (int) port);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
@@ -0,0 +1,133 @@
+/*
+ *  VideoPreviewer - Keyframe only JPEG previews of coded video streams
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _VIDEO_PREVIEWER_HH
+#define _VIDEO_PREVIEWER_HH
+
+extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libswscale/swscale.h>
+}
+
+#include <map>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "../../Filter.hh"
+#include "../../VideoFrame.hh"
+
+#define PREVIEW_EXT                 ".jpg"
+#define PREVIEW_DEFAULT_WIDTH       320
+#define PREVIEW_DEFAULT_INTERVAL    1000            //!< Milliseconds between previews of a stream
+#define PREVIEW_DEFAULT_QUALITY     5               //!< JPEG quantizer scale, from 2 (best) to 31
+#define PREVIEW_UNIT_SIZE           (512*1024)      //!< Initial staging buffer of a keyframe, grown on demand
+
+class DashHttpOrigin;
+
+/*! Preview state of a reader */
+struct PreviewInput {
+    VCodecType codec;
+    AVCodecContext *decoder;
+    std::shared_ptr<const ExtraData> extradata;
+    AVCodecContext *encoder;
+    SwsContext *sws;
+    AVFrame *decoded;
+    AVFrame *scaled;
+    std::vector<unsigned char> unit;        //!< Parameter sets and IDR slices of the keyframe in progress
+    unsigned size;
+    bool key;                               //!< The staged unit has IDR slices
+    std::chrono::microseconds ts;
+    std::chrono::microseconds lastPreview;
+    size_t previews;
+};
+
+/*! Generates small JPEG previews of coded video streams, for monitoring walls and thumbnails.
+*   Only the parameter sets and the IDR slices are handed to the decoders, at most once per interval,
+*   so a preview costs the decoding of a single intra picture and non key frames are not even copied.
+*   Previews are named baseName_<readerId>.jpg and published to the origin, written to disk or both.
+*/
+class VideoPreviewer : public TailFilter {
+
+public:
+    /**
+    * Class constructor
+    * @param readersNum maximum number of previewed streams
+    */
+    VideoPreviewer(unsigned readersNum = MAX_READERS);
+
+    /**
+    * Class destructor
+    */
+    ~VideoPreviewer();
+
+    /**
+    * Configures the previews, as long as it is not configured frames are discarded
+    * @param folder folder where previews are written, empty to not write them to disk
+    * @param baseName previews base name
+    * @param width previews width, the height keeps the input aspect ratio
+    * @param intervalMs minimum time between previews of a stream, previews are taken at the next keyframe
+    * @param quality JPEG quantizer scale, from 2 (best) to 31
+    * @return false if the folder is not writable or the parameters are not valid
+    */
+    bool configure(std::string folder, std::string baseName, unsigned width = PREVIEW_DEFAULT_WIDTH,
+                   unsigned intervalMs = PREVIEW_DEFAULT_INTERVAL, unsigned quality = PREVIEW_DEFAULT_QUALITY);
+
+    /**
+    * Configures the HTTP origin, which serves the previews from memory at "/baseName_<readerId>.jpg"
+    * @param port TCP port of the origin, 0 to stop it
+    * @return true if the configuration event has been pushed
+    */
+    bool configOrigin(unsigned port);
+
+private:
+    bool doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& ret);
+    void doGetState(Jzon::Object &filterNode);
+    size_t getInternalBytes();
+    bool specificReaderConfig(int readerId, FrameQueue* queue);
+    bool specificReaderDelete(int readerId);
+    void initializeEventMap();
+
+    bool configureEvent(Jzon::Node* params);
+    bool configOriginEvent(Jzon::Node* params);
+    bool configOrigin0(int port);
+
+    void addNal(PreviewInput &input, Frame* frame);
+    void finishUnit(int id, PreviewInput &input);
+    bool decodeUnit(int id, PreviewInput &input);
+    bool encodePreview(int id, PreviewInput &input);
+    bool openEncoder(PreviewInput &input, int height);
+    void publish(int id, const unsigned char* data, size_t length);
+    void freeInput(PreviewInput &input);
+
+    std::map<int, PreviewInput> inputs;
+    DashHttpOrigin* origin;
+    std::string basePath;
+    std::string baseName;
+    unsigned width;
+    unsigned quality;
+    std::chrono::microseconds interval;
+    bool configured;
+
+    size_t previews;
+    size_t failedPreviews;
+};
+
+#endif
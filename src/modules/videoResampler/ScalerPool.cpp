@@ -0,0 +1,199 @@
+/*
+ *  ScalerPool.cpp - Process wide pool of swscale contexts
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <tuple>
+#include <vector>
+
+#include "ScalerPool.hh"
+
+bool ScalerPool::ScalerSpec::operator<(const ScalerSpec &other) const
+{
+    return std::tie(inWidth, inHeight, inFormat, outWidth, outHeight, outFormat, flags) <
+        std::tie(other.inWidth, other.inHeight, other.inFormat, other.outWidth, other.outHeight, other.outFormat,
+                 other.flags);
+}
+
+bool ScalerPool::ScalerSpec::operator==(const ScalerSpec &other) const
+{
+    return !(*this < other) && !(other < *this);
+}
+
+ScalerPool* ScalerPool::getInstance()
+{
+    static ScalerPool instance;
+
+    return &instance;
+}
+
+ScalerPool::ScalerPool() : maxIdle(SCALER_POOL_MAX_IDLE), hits(0), misses(0)
+{
+}
+
+ScalerPool::~ScalerPool()
+{
+    trim();
+}
+
+struct SwsContext* ScalerPool::getContext(int inWidth, int inHeight, AVPixelFormat inFormat,
+                                          int outWidth, int outHeight, AVPixelFormat outFormat, int flags)
+{
+    ScalerSpec spec = {inWidth, inHeight, inFormat, outWidth, outHeight, outFormat, flags};
+    struct SwsContext* ctx;
+
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+
+        auto it = idle.find(spec);
+        if (it != idle.end() && !it->second.empty()){
+            ctx = it->second.back();
+            it->second.pop_back();
+            released.remove(ctx);
+            hits++;
+            return ctx;
+        }
+
+        misses++;
+    }
+
+    //NOTE: the filter coefficients are computed here, out of the lock
+    ctx = sws_getContext(inWidth, inHeight, inFormat, outWidth, outHeight, outFormat, flags, NULL, NULL, NULL);
+
+    if (!ctx){
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> guard(mtx);
+    owned[ctx] = spec;
+
+    return ctx;
+}
+
+struct SwsContext* ScalerPool::getCachedContext(struct SwsContext* ctx, int inWidth, int inHeight, AVPixelFormat inFormat,
+                                                int outWidth, int outHeight, AVPixelFormat outFormat, int flags)
+{
+    ScalerSpec spec = {inWidth, inHeight, inFormat, outWidth, outHeight, outFormat, flags};
+
+    if (ctx){
+        std::lock_guard<std::mutex> guard(mtx);
+
+        auto it = owned.find(ctx);
+        if (it != owned.end() && it->second == spec){
+            return ctx;
+        }
+    }
+
+    releaseContext(ctx);
+
+    return getContext(inWidth, inHeight, inFormat, outWidth, outHeight, outFormat, flags);
+}
+
+void ScalerPool::releaseContext(struct SwsContext* ctx)
+{
+    if (!ctx){
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+
+        auto it = owned.find(ctx);
+        if (it != owned.end()){
+            idle[it->second].push_back(ctx);
+            released.push_back(ctx);
+            ctx = NULL;
+        }
+    }
+
+    sws_freeContext(ctx);
+
+    shrink(maxIdle);
+}
+
+void ScalerPool::setMaxIdle(size_t contexts)
+{
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        maxIdle = contexts;
+    }
+
+    shrink(contexts);
+}
+
+void ScalerPool::trim()
+{
+    shrink(0);
+}
+
+void ScalerPool::shrink(size_t contexts)
+{
+    std::vector<struct SwsContext*> extra;
+
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+
+        while (released.size() > contexts){
+            struct SwsContext* ctx = released.front();
+            auto it = idle.find(owned[ctx]);
+
+            released.pop_front();
+            it->second.remove(ctx);
+            if (it->second.empty()){
+                idle.erase(it);
+            }
+            owned.erase(ctx);
+            extra.push_back(ctx);
+        }
+    }
+
+    for (auto ctx : extra){
+        sws_freeContext(ctx);
+    }
+}
+
+size_t ScalerPool::getHits()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return hits;
+}
+
+size_t ScalerPool::getMisses()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return misses;
+}
+
+size_t ScalerPool::getIdleContexts()
+{
+    std::lock_guard<std::mutex> guard(mtx);
+    return released.size();
+}
+
+void ScalerPool::getState(Jzon::Object &node)
+{
+    std::lock_guard<std::mutex> guard(mtx);
+
+    node.Add("hits", (int) hits);
+    node.Add("misses", (int) misses);
+    node.Add("idleContexts", (int) released.size());
+    node.Add("usedContexts", (int) (owned.size() - released.size()));
+    node.Add("maxIdleContexts", (int) maxIdle);
+}
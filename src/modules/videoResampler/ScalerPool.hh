@@ -0,0 +1,140 @@
+/*
+ *  ScalerPool.hh - Process wide pool of swscale contexts
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _SCALER_POOL_HH
+#define _SCALER_POOL_HH
+
+extern "C" {
+    #include <libswscale/swscale.h>
+    #include <libavutil/pixfmt.h>
+}
+
+#include <map>
+#include <list>
+#include <mutex>
+
+#include "../../Jzon.h"
+
+#define SCALER_POOL_MAX_IDLE 64     //!< Default limit of idle contexts, the least recently released are freed
+
+/*! ScalerPool is a process wide pool of swscale contexts shared by all the resamplers. Contexts are
+    grouped by their conversion (input size and format, output size and format, scaling flags) and each
+    one is used by a single filter at a time, since swscale contexts are not reentrant: filters scaling
+    the same conversion concurrently get their own context, and released contexts are kept idle so that
+    going back to a previous conversion (e.g. an input resolution switching back and forth) does not
+    initialize the filter coefficients again.
+*/
+class ScalerPool {
+
+public:
+    /**
+     * Gets the ScalerPool instance, it is created the first time it is requested
+     * @return the process wide pool
+     */
+    static ScalerPool* getInstance();
+
+    /**
+     * Gets a context for a conversion, see sws_getContext
+     * @return an idle context of the same conversion, a new one if there is none or NULL if swscale does not
+     *         support the conversion
+     */
+    struct SwsContext* getContext(int inWidth, int inHeight, AVPixelFormat inFormat,
+                                  int outWidth, int outHeight, AVPixelFormat outFormat, int flags);
+
+    /**
+     * Pool counterpart of sws_getCachedContext: the context is kept if it already is of the conversion,
+     * otherwise it is released and another one is got
+     * @param ctx context got from the pool, it can be NULL
+     * @return the context of the conversion, NULL if it could not be got
+     */
+    struct SwsContext* getCachedContext(struct SwsContext* ctx, int inWidth, int inHeight, AVPixelFormat inFormat,
+                                        int outWidth, int outHeight, AVPixelFormat outFormat, int flags);
+
+    /**
+     * Gives a context back to the pool, it must not be used afterwards. Contexts not obtained from the pool
+     * are freed
+     * @param ctx context to release, it can be NULL
+     */
+    void releaseContext(struct SwsContext* ctx);
+
+    /**
+     * Sets the limit of idle contexts, extra idle contexts are freed
+     * @param contexts maximum number of idle contexts
+     */
+    void setMaxIdle(size_t contexts);
+
+    /**
+     * Frees all the idle contexts
+     */
+    void trim();
+
+    /**
+     * Adds the pool counters to the state node: hits, misses, idle and used contexts and the idle limit
+     * @param node Jzon object to fill
+     */
+    void getState(Jzon::Object &node);
+
+    /**
+     * @return number of contexts served from idle pooled ones
+     */
+    size_t getHits();
+
+    /**
+     * @return number of contexts that had to be initialized
+     */
+    size_t getMisses();
+
+    /**
+     * @return number of idle contexts kept by the pool
+     */
+    size_t getIdleContexts();
+
+private:
+    struct ScalerSpec {
+        int inWidth;
+        int inHeight;
+        AVPixelFormat inFormat;
+        int outWidth;
+        int outHeight;
+        AVPixelFormat outFormat;
+        int flags;
+
+        bool operator<(const ScalerSpec &other) const;
+        bool operator==(const ScalerSpec &other) const;
+    };
+
+    ScalerPool();
+    ~ScalerPool();
+
+    void shrink(size_t contexts);
+
+    std::map<ScalerSpec, std::list<struct SwsContext*>> idle;
+    std::map<struct SwsContext*, ScalerSpec> owned;
+    std::list<struct SwsContext*> released;     //!< Idle contexts, the least recently released first
+    std::mutex mtx;
+
+    size_t maxIdle;
+    size_t hits;
+    size_t misses;
+};
+
+#endif
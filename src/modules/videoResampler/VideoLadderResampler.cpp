@@ -0,0 +1,454 @@
+/*
+ *  VideoLadderResampler.cpp - A libav-based video resampler with several outputs
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors: David Cassany <david.cassany@i2cat.net>
+ *           Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "VideoLadderResampler.hh"
+#include "../../AVFramedQueue.hh"
+#include "../../WorkersPool.hh"
+#include "../../Utils.hh"
+#include "ScalerPool.hh"
+#include <algorithm>
+
+AVPixelFormat getLibavPixFmt(PixType pixType);
+
+///////////////////////////////////////////////////
+//                 Rendition Struct              //
+///////////////////////////////////////////////////
+
+Rendition::Rendition() : width(0), height(0), pixelFormat(RGB24), source(-1), ctx(NULL)
+{
+    outFrame = av_frame_alloc();
+}
+
+Rendition::~Rendition()
+{
+    ScalerPool::getInstance()->releaseContext(ctx);
+    av_frame_free(&outFrame);
+}
+
+///////////////////////////////////////////////////
+//           VideoLadderResampler Class          //
+///////////////////////////////////////////////////
+
+/**
+* Points a libav frame to the planes of a frame, planar frames are used in place
+* @return false if the frame has no planes
+*/
+static bool setAVFrame(AVFrame *aFrame, VideoFrame* vFrame, AVPixelFormat format)
+{
+    if (vFrame->getPlanes(aFrame->data, aFrame->linesize) == 0){
+        utils::errorMsg("[LadderResampler] Could not feed AVFrame");
+        return false;
+    }
+
+    aFrame->width = vFrame->getWidth();
+    aFrame->height = vFrame->getHeight();
+    aFrame->format = format;
+
+    return true;
+}
+
+VideoLadderResampler::VideoLadderResampler() : OneToManyFilterT(LADDER_MAX_RENDITIONS), cascade(true)
+{
+    fType = VIDEO_LADDER_RESAMPLER;
+
+    inFrame = av_frame_alloc();
+    hwDownload = av_frame_alloc();
+
+    initializeEventMap();
+}
+
+VideoLadderResampler::~VideoLadderResampler()
+{
+    for (auto it : renditions) {
+        delete it.second;
+    }
+
+    for (auto it : outputStreamInfos) {
+        delete it.second;
+    }
+
+    av_free(inFrame);
+    av_frame_free(&hwDownload);
+}
+
+FrameQueue* VideoLadderResampler::allocQueue(ConnectionData cData)
+{
+    return VideoFrameQueue::createNew(cData, outputStreamInfos[cData.writerId], DEFAULT_RAW_VIDEO_FRAMES);
+}
+
+bool VideoLadderResampler::doProcessFrame(VideoFrame *orgFrame, FrameMap &dstFrames)
+{
+    HardwareVideoFrame* hwOrgFrame = dynamic_cast<HardwareVideoFrame*>(orgFrame);
+    AVFrame *srcFrame = inFrame;
+    std::vector<int> order;
+    std::vector<Rendition*> outputs;
+    std::vector<VideoFrame*> frames;
+    std::vector<int> widths, heights, sources, steps;
+    std::vector<char> scaled;
+    std::vector<unsigned> batch;
+    int maxStep = 0;
+    bool processed = false;
+    std::shared_ptr<Reader> reader = getReader(DEFAULT_ID);
+
+    if (!orgFrame) {
+        utils::errorMsg("[LadderResampler] Origin frame must be a VideoFrame");
+        return false;
+    }
+    
+    //NOTE: the writer can only skip the frames dropped here if no other filter reads them
+    if (reader && reader->getQueue()) {
+        reader->getQueue()->setReaderFrameTime(reader->isShared() ? std::chrono::microseconds(0) : scheduler.getFrameTime());
+    }
+    
+    if (!scheduler.keep(orgFrame->getPresentationTime())) {
+        return false;
+    }
+
+    //NOTE: surfaces are downloaded once for all the renditions
+    if (hwOrgFrame) {
+        if (!hwOrgFrame->download(hwDownload)) {
+            return false;
+        }
+        srcFrame = hwDownload;
+    } else if (!setAVFrame(inFrame, orgFrame, getLibavPixFmt(orgFrame->getPixelFormat()))) {
+        return false;
+    }
+
+    for (auto it : dstFrames) {
+        if (renditions.count(it.first) > 0) {
+            order.push_back(it.first);
+        }
+    }
+
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        int areaA = (renditions[a]->width ? renditions[a]->width : srcFrame->width) *
+                    (renditions[a]->height ? renditions[a]->height : srcFrame->height);
+        int areaB = (renditions[b]->width ? renditions[b]->width : srcFrame->width) *
+                    (renditions[b]->height ? renditions[b]->height : srcFrame->height);
+        return areaA > areaB;
+    });
+
+    //NOTE: each rendition is scaled from the smallest larger one of its format, up to the cascade ratio,
+    //      downscaling each step at most that ratio keeps bilinear scaling quality
+    for (unsigned i = 0; i < order.size(); i++) {
+        Rendition *r = renditions[order[i]];
+
+        outputs.push_back(r);
+        frames.push_back(static_cast<VideoFrame*>(dstFrames[order[i]]));
+        widths.push_back(r->width ? r->width : srcFrame->width);
+        heights.push_back(r->height ? r->height : srcFrame->height);
+        sources.push_back(-1);
+        steps.push_back(0);
+
+        for (int j = i - 1; cascade && j >= 0; j--) {
+            if (outputs[j]->pixelFormat == r->pixelFormat &&
+                widths[j] >= widths[i] && heights[j] >= heights[i] &&
+                widths[j] <= widths[i]*LADDER_MAX_CASCADE_RATIO && heights[j] <= heights[i]*LADDER_MAX_CASCADE_RATIO &&
+                widths[j]*heights[j] < srcFrame->width*srcFrame->height) {
+                sources[i] = j;
+                steps[i] = steps[j] + 1;
+                break;
+            }
+        }
+
+        maxStep = std::max(maxStep, steps[i]);
+    }
+
+    scaled.assign(order.size(), 0);
+
+    for (int s = 0; s <= maxStep; s++) {
+        batch.clear();
+
+        for (unsigned i = 0; i < order.size(); i++) {
+            if (steps[i] == s) {
+                batch.push_back(i);
+            }
+        }
+
+        auto scaleStep = [&](unsigned k) {
+            unsigned i = batch[k];
+            AVFrame *src = srcFrame;
+
+            //NOTE: if the larger rendition failed, this one falls back to the input
+            if (sources[i] >= 0 && scaled[sources[i]]) {
+                src = outputs[sources[i]]->outFrame;
+                outputs[i]->source = order[sources[i]];
+            } else {
+                outputs[i]->source = -1;
+            }
+
+            scaled[i] = scaleRendition(outputs[i], src, frames[i], widths[i], heights[i]);
+        };
+
+        if (WorkersPool::current()) {
+            WorkersPool::current()->parallelFor(batch.size(), scaleStep);
+        } else {
+            for (unsigned k = 0; k < batch.size(); k++) {
+                scaleStep(k);
+            }
+        }
+    }
+
+    for (auto it : dstFrames) {
+        auto pos = std::find(order.begin(), order.end(), it.first);
+
+        if (pos == order.end() || !scaled[pos - order.begin()]) {
+            it.second->setConsumed(false);
+            continue;
+        }
+
+        it.second->setConsumed(true);
+        it.second->setPresentationTime(orgFrame->getPresentationTime());
+        it.second->setDecodeTime(orgFrame->getDecodeTime());
+        it.second->setOriginTime(orgFrame->getOriginTime());
+        it.second->setSequenceNumber(orgFrame->getSequenceNumber());
+        it.second->getSideData() = orgFrame->getSideData();
+        processed = true;
+    }
+
+    return processed;
+}
+
+bool VideoLadderResampler::scaleRendition(Rendition *rendition, AVFrame *src, VideoFrame *dstFrame, int width, int height)
+{
+    AVPixelFormat outFormat = getLibavPixFmt(rendition->pixelFormat);
+
+    if (!dstFrame || outFormat == AV_PIX_FMT_NONE) {
+        return false;
+    }
+
+    //NOTE: the context is only changed if any of its parameters changes, previous ones are kept by the pool
+    rendition->ctx = ScalerPool::getInstance()->getCachedContext(rendition->ctx, src->width, src->height, 
+                                                                (AVPixelFormat) src->format, width, height, 
+                                                                outFormat, SWS_FAST_BILINEAR);
+
+    if (!rendition->ctx) {
+        utils::errorMsg("[LadderResampler] Could not get the swscale context");
+        return false;
+    }
+
+    dstFrame->fitBuffer(width, height, rendition->pixelFormat);
+
+    if (!setAVFrame(rendition->outFrame, dstFrame, outFormat)) {
+        return false;
+    }
+
+    if (sws_scale(rendition->ctx, src->data, src->linesize, 0, src->height,
+                  rendition->outFrame->data, rendition->outFrame->linesize) <= 0) {
+        utils::errorMsg("[LadderResampler] Could not convert image");
+        return false;
+    }
+
+    return true;
+}
+
+bool VideoLadderResampler::configure0(int fps, bool cascade)
+{
+    if (fps < 0) {
+        utils::errorMsg("[LadderResampler] Negative fps is not valid");
+        return false;
+    }
+
+    if (fps == 0) {
+        scheduler.setFrameTime(std::chrono::microseconds(0));
+    } else {
+        scheduler.setFrameTime(std::chrono::microseconds(std::micro::den/fps));
+    }
+
+    this->cascade = cascade;
+    return true;
+}
+
+bool VideoLadderResampler::configRendition0(int writerId, int width, int height, PixType pixelFormat)
+{
+    if (width < 0 || height < 0) {
+        utils::errorMsg("[LadderResampler] Rendition size is not valid");
+        return false;
+    }
+
+    if (pixelFormat == HW_SURFACE || getLibavPixFmt(pixelFormat) == AV_PIX_FMT_NONE) {
+        utils::errorMsg("[LadderResampler] Rendition pixel format is not valid");
+        return false;
+    }
+
+    if (renditions.count(writerId) == 0) {
+        if (renditions.size() >= LADDER_MAX_RENDITIONS) {
+            utils::errorMsg("[LadderResampler] Up to " + std::to_string(LADDER_MAX_RENDITIONS) + " renditions are supported");
+            return false;
+        }
+
+        renditions[writerId] = new Rendition();
+    }
+
+    if (outputStreamInfos.count(writerId) == 0) {
+        outputStreamInfos[writerId] = new StreamInfo(VIDEO);
+        outputStreamInfos[writerId]->video.codec = RAW;
+    }
+
+    renditions[writerId]->width = width;
+    renditions[writerId]->height = height;
+    renditions[writerId]->pixelFormat = pixelFormat;
+
+    //NOTE: output queues allocated afterwards get planar frames for planar formats
+    outputStreamInfos[writerId]->video.pixelFormat = pixelFormat;
+
+    return true;
+}
+
+bool VideoLadderResampler::specificWriterConfig(int writerID)
+{
+    //NOTE: a writer without a configured rendition keeps the input size in RGB24
+    if (renditions.count(writerID) > 0) {
+        return true;
+    }
+
+    return configRendition0(writerID, 0, 0, RGB24);
+}
+
+bool VideoLadderResampler::specificWriterDelete(int writerID)
+{
+    if (renditions.count(writerID) == 0) {
+        utils::errorMsg("[LadderResampler] Error deleting writer. This writerId doesn't exist " + std::to_string(writerID));
+        return false;
+    }
+
+    delete renditions[writerID];
+    renditions.erase(writerID);
+
+    return true;
+}
+
+bool VideoLadderResampler::configEvent(Jzon::Node* params)
+{
+    int fps = 0;
+    bool cascading = cascade;
+
+    if (!params) {
+        return false;
+    }
+
+    if (scheduler.getFrameTime().count() > 0){
+        fps = std::micro::den/scheduler.getFrameTime().count();
+    }
+
+    if (params->Has("fps") && params->Get("fps").IsNumber()){
+        fps = params->Get("fps").ToInt();
+    }
+
+    if (params->Has("cascade") && params->Get("cascade").IsBool()){
+        cascading = params->Get("cascade").ToBool();
+    }
+
+    return configure0(fps, cascading);
+}
+
+bool VideoLadderResampler::configRenditionEvent(Jzon::Node* params)
+{
+    int id, width, height;
+    PixType pixelFormat = RGB24;
+
+    if (!params) {
+        return false;
+    }
+
+    if (!params->Has("id") || !params->Get("id").IsNumber()) {
+        utils::errorMsg("[LadderResampler::configRenditionEvent] Params node not complete");
+        return false;
+    }
+
+    id = params->Get("id").ToInt();
+    width = renditions.count(id) > 0 ? renditions[id]->width : 0;
+    height = renditions.count(id) > 0 ? renditions[id]->height : 0;
+
+    if (renditions.count(id) > 0) {
+        pixelFormat = renditions[id]->pixelFormat;
+    }
+
+    if (params->Has("width") && params->Get("width").IsNumber()){
+        width = params->Get("width").ToInt();
+    }
+
+    if (params->Has("height") && params->Get("height").IsNumber()){
+        height = params->Get("height").ToInt();
+    }
+
+    if (params->Has("pixelFormat")){
+        pixelFormat = utils::getPixTypeFromString(params->Get("pixelFormat").ToString());
+    }
+
+    return configRendition0(id, width, height, pixelFormat);
+}
+
+void VideoLadderResampler::initializeEventMap()
+{
+    eventMap["configure"] = std::bind(&VideoLadderResampler::configEvent, this, std::placeholders::_1);
+    eventMap["configRendition"] = std::bind(&VideoLadderResampler::configRenditionEvent, this, std::placeholders::_1);
+}
+
+void VideoLadderResampler::doGetState(Jzon::Object &filterNode)
+{
+    Jzon::Array jsonRenditions;
+
+    for (auto it : renditions) {
+        Jzon::Object rendition;
+        rendition.Add("id", it.first);
+        rendition.Add("width", it.second->width);
+        rendition.Add("height", it.second->height);
+        rendition.Add("pixelFormat", utils::getPixTypeAsString(it.second->pixelFormat));
+        rendition.Add("source", it.second->source);
+        jsonRenditions.Add(rendition);
+    }
+
+    filterNode.Add("frameTime", (int) scheduler.getFrameTime().count());
+    filterNode.Add("droppedFrames", (int) scheduler.getDropped());
+    filterNode.Add("cascade", cascade);
+    filterNode.Add("renditions", jsonRenditions);
+}
+
+bool VideoLadderResampler::configure(int fps, bool cascade)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configure");
+    params.Add("fps", fps);
+    params.Add("cascade", cascade);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
+
+bool VideoLadderResampler::configRendition(int writerId, int width, int height, PixType pixelFormat)
+{
+    Jzon::Object root, params;
+    root.Add("action", "configRendition");
+    params.Add("id", writerId);
+    params.Add("width", width);
+    params.Add("height", height);
+    params.Add("pixelFormat", utils::getPixTypeAsString(pixelFormat));
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
@@ -0,0 +1,115 @@
+/*
+ *  VideoLadderResampler.hh - A libav-based video resampler with several outputs
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors: David Cassany <david.cassany@i2cat.net>
+ *           Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _VIDEO_LADDER_RESAMPLER_HH
+#define _VIDEO_LADDER_RESAMPLER_HH
+
+extern "C" {
+    #include <libswscale/swscale.h>
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/imgutils.h>
+}
+
+#include "../../VideoFrame.hh"
+#include "../../HardwareVideoFrame.hh"
+#include "../../FrameQueue.hh"
+#include "../../Filter.hh"
+#include "../../StreamInfo.hh"
+#include "../../FrameRateScheduler.hh"
+
+#define LADDER_MAX_RENDITIONS 8        //!< Maximum number of renditions, one per writer
+#define LADDER_MAX_CASCADE_RATIO 2     //!< A rendition is only scaled from a larger one up to this ratio per side
+
+/*! Output of the ladder. Its swscale context is only rebuilt when the source or the output
+*   size or format change.
+*/
+struct Rendition {
+    Rendition();
+    ~Rendition();
+
+    int width;                      //!< Output width, 0 keeps the input one
+    int height;                     //!< Output height, 0 keeps the input one
+    PixType pixelFormat;
+    int source;                     //!< Writer of the rendition it was last scaled from, -1 for the input
+    struct SwsContext *ctx;
+    AVFrame *outFrame;
+};
+
+/*! Resampler producing several renditions (size and pixel format) of one input, one per writer.
+*   Renditions are scaled from the largest to the smallest, each one from the smallest rendition
+*   already scaled which is larger than it and at most LADDER_MAX_CASCADE_RATIO times its size,
+*   and of its pixel format (e.g. 1080p -> 720p -> 480p), or from the input otherwise. Renditions
+*   of the same step are scaled in parallel on the pool workers. Hardware surfaces are downloaded
+*   once for all the renditions. Frames are selected for the output frame rate before scaling them, 
+*   see FrameRateScheduler.
+*/
+class VideoLadderResampler : public OneToManyFilterT<VideoFrame, VideoFrame> {
+
+    public:
+        VideoLadderResampler();
+        ~VideoLadderResampler();
+
+        /**
+        * Configures the filter
+        * @param fps maximum output frames per second, 0 follows the input
+        * @param cascade if false all the renditions are scaled from the input
+        */
+        bool configure(int fps, bool cascade = true);
+
+        /**
+        * Configures the rendition of a writer, it can be done before connecting it
+        * @param writerId id of the writer
+        * @param width output width in pixels, 0 keeps the input one
+        * @param height output height in pixels, 0 keeps the input one
+        * @param pixelFormat output pixel format, hardware surfaces are not supported
+        */
+        bool configRendition(int writerId, int width, int height, PixType pixelFormat);
+
+    private:
+        bool doProcessFrame(VideoFrame *orgFrame, FrameMap &dstFrames);
+        FrameQueue* allocQueue(ConnectionData cData);
+        void initializeEventMap();
+        bool configEvent(Jzon::Node* params);
+        bool configRenditionEvent(Jzon::Node* params);
+        void doGetState(Jzon::Object &filterNode);
+        bool configure0(int fps, bool cascade);
+        bool configRendition0(int writerId, int width, int height, PixType pixelFormat);
+        bool scaleRendition(Rendition *rendition, AVFrame *src, VideoFrame *dstFrame, int width, int height);
+
+        //NOTE: There is no need of specific reader configuration
+        bool specificReaderConfig(int /*readerID*/, FrameQueue* /*queue*/)  {return true;};
+        bool specificReaderDelete(int /*readerID*/) {return true;};
+
+        bool specificWriterConfig(int writerID);
+        bool specificWriterDelete(int writerID);
+
+        AVFrame             *inFrame, *hwDownload;
+
+        std::map<int, Rendition*> renditions;
+        //NOTE: stream infos are kept until destruction, the queues of deleted writers may outlive them
+        std::map<int, StreamInfo*> outputStreamInfos;
+        bool                cascade;
+        FrameRateScheduler  scheduler;
+};
+
+#endif
@@ -23,24 +23,38 @@
 
 #include "VideoResampler.hh"
 #include "../../AVFramedQueue.hh"
+#include "../../WorkersPool.hh"
 #include "../../Utils.hh"
+#include "../../PixelConverter.hh"
+#include "ScalerPool.hh"
+#include <algorithm>
 
 AVPixelFormat getLibavPixFmt(PixType pixType);
+PixType getPixelFormat(AVPixelFormat format);
 
-VideoResampler::VideoResampler() : OneToOneFilter()
+VideoResampler::VideoResampler() : OneToOneFilterT()
 {
     fType = VIDEO_RESAMPLER;
 
     inFrame = av_frame_alloc();
     outFrame = av_frame_alloc();
+    hwDownload = av_frame_alloc();
 
     imgConvertCtx = NULL;
 
+    inputWidth = 0;
+    inputHeight = 0;
     outputWidth = 0;
     outputHeight = 0;
+    inFormatVersion = 0;
+    writtenWidth = 0;
+    writtenHeight = 0;
+    writtenPixFmt = P_NONE;
     libavOutPixFmt = getLibavPixFmt(outPixFmt);
 
+    threads = 1;
     needsConfig = false;
+    convertedFrames = 0;
 
     outputStreamInfo = new StreamInfo(VIDEO);
     outputStreamInfo->video.codec = RAW;
@@ -53,7 +67,9 @@ VideoResampler::~VideoResampler()
 {
     av_free(inFrame);
     av_free(outFrame);
-    sws_freeContext(imgConvertCtx);
+    av_frame_free(&hwDownload);
+    ScalerPool::getInstance()->releaseContext(imgConvertCtx);
+    freeBands();
 
     delete outputStreamInfo;
 }
@@ -63,14 +79,14 @@ FrameQueue* VideoResampler::allocQueue(ConnectionData cData)
     return VideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_RAW_VIDEO_FRAMES);
 }
 
-bool VideoResampler::reconfigure(VideoFrame* orgFrame)
+bool VideoResampler::reconfigure(int inWidth, int inHeight, PixType inPixelFormat)
 {      
     if (!imgConvertCtx || needsConfig || 
-        orgFrame->getWidth() != inFrame->width ||
-        orgFrame->getHeight() != inFrame->height ||
-        orgFrame->getPixelFormat() != inPixFmt)
+        inWidth != inputWidth ||
+        inHeight != inputHeight ||
+        inPixelFormat != inPixFmt)
     {
-        inPixFmt = orgFrame->getPixelFormat();
+        inPixFmt = inPixelFormat;
         libavInPixFmt = getLibavPixFmt(inPixFmt);
 
         if (libavInPixFmt == AV_PIX_FMT_NONE){
@@ -79,110 +95,415 @@ bool VideoResampler::reconfigure(VideoFrame* orgFrame)
         
         int outWidth, outHeight;
         if (outputWidth == 0){
-            outWidth = orgFrame->getWidth();
+            outWidth = inWidth;
         } else {
             outWidth = outputWidth;
         }
         
         if (outputHeight == 0){
-            outHeight = orgFrame->getHeight();
+            outHeight = inHeight;
         } else {
             outHeight = outputHeight;
         }
         
-        imgConvertCtx = sws_getContext(orgFrame->getWidth(), orgFrame->getHeight(), 
-                                       libavInPixFmt, outWidth, outHeight,
-                                       libavOutPixFmt, SWS_FAST_BILINEAR, 0, 0, 0);
+        //NOTE: contexts of previous conversions are kept by the pool, switching back to them is free
+        imgConvertCtx = ScalerPool::getInstance()->getCachedContext(imgConvertCtx, inWidth, inHeight, 
+                                                                   libavInPixFmt, outWidth, outHeight,
+                                                                   libavOutPixFmt, SWS_FAST_BILINEAR);
 
         if (!imgConvertCtx){
             utils::errorMsg("Could not get the swscale context");
             return false;
         }
+        
+        if (!configureBands(inWidth, inHeight, outWidth, outHeight)){
+            return false;
+        }
 
+        inputWidth = inWidth;
+        inputHeight = inHeight;
         needsConfig = false;
     }
     return true;
 }
 
-bool VideoResampler::doProcessFrame(Frame *org, Frame *dst)
+static int gcd(int a, int b)
 {
-    int outWidth, outHeight;
-    int height;
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    
+    return a;
+}
 
-    VideoFrame* dstFrame = dynamic_cast<VideoFrame*>(dst);
-    VideoFrame* orgFrame = dynamic_cast<VideoFrame*>(org);
+void VideoResampler::freeBands()
+{
+    for (auto ctx : bandCtxs) {
+        ScalerPool::getInstance()->releaseContext(ctx);
+    }
+    
+    bandCtxs.clear();
+    bandInRows.clear();
+    bandOutRows.clear();
+}
+
+bool VideoResampler::configureBands(int inWidth, int inHeight, int outWidth, int outHeight)
+{
+    int inShiftH, inShiftV, outShiftH, outShiftV;
+    int unitIn, unitOut, units, bands, k, g;
+    
+    freeBands();
+    
+    if (threads <= 1 || inHeight <= 0 || outHeight <= 0) {
+        return true;
+    }
+    
+    av_pix_fmt_get_chroma_sub_sample(libavInPixFmt, &inShiftH, &inShiftV);
+    av_pix_fmt_get_chroma_sub_sample(libavOutPixFmt, &outShiftH, &outShiftV);
+    
+    //NOTE: a band unit is the least number of rows mapping whole input rows to whole output rows, 
+    //      starting both at a chroma row
+    g = gcd(inHeight, outHeight);
+    unitIn = inHeight/g;
+    unitOut = outHeight/g;
+    
+    for (k = 1; (unitIn*k) % (1 << inShiftV) != 0 || (unitOut*k) % (1 << outShiftV) != 0; k++);
+    
+    unitIn *= k;
+    unitOut *= k;
+    units = outHeight/unitOut;
+    bands = std::min(threads, units);
+    
+    //NOTE: heights without at least two units are scaled in one pass
+    if (bands <= 1) {
+        return true;
+    }
+    
+    for (int b = 0; b < bands; b++) {
+        bandInRows.push_back((b*units/bands)*unitIn);
+        bandOutRows.push_back((b*units/bands)*unitOut);
+    }
+    
+    bandInRows.push_back(inHeight);
+    bandOutRows.push_back(outHeight);
+    
+    for (int b = 0; b < bands; b++) {
+        bandCtxs.push_back(ScalerPool::getInstance()->getContext(inWidth, bandInRows[b + 1] - bandInRows[b], 
+                                                                 libavInPixFmt, outWidth, 
+                                                                 bandOutRows[b + 1] - bandOutRows[b], 
+                                                                 libavOutPixFmt, SWS_FAST_BILINEAR));
+        
+        if (!bandCtxs.back()) {
+            utils::errorMsg("[Resampler] Could not get the swscale context of a band");
+            freeBands();
+            return false;
+        }
+    }
+    
+    return true;
+}
 
-    if (!reconfigure(orgFrame)){
+bool VideoResampler::scaleBands(AVFrame *src, AVFrame *dst)
+{
+    int inShiftH, inShiftV, outShiftH, outShiftV;
+    std::vector<int> heights(bandCtxs.size(), 0);
+    
+    av_pix_fmt_get_chroma_sub_sample((AVPixelFormat) src->format, &inShiftH, &inShiftV);
+    av_pix_fmt_get_chroma_sub_sample((AVPixelFormat) dst->format, &outShiftH, &outShiftV);
+    
+    auto scaleBand = [&](unsigned b) {
+        uint8_t *srcData[AV_NUM_DATA_POINTERS];
+        uint8_t *dstData[AV_NUM_DATA_POINTERS];
+        
+        //NOTE: planes 1 and 2 are the chroma ones, plane 0 and alpha are not subsampled
+        for (unsigned p = 0; p < AV_NUM_DATA_POINTERS; p++) {
+            int inShift = (p == 1 || p == 2) ? inShiftV : 0;
+            int outShift = (p == 1 || p == 2) ? outShiftV : 0;
+            
+            srcData[p] = src->data[p] ? src->data[p] + (bandInRows[b] >> inShift)*src->linesize[p] : NULL;
+            dstData[p] = dst->data[p] ? dst->data[p] + (bandOutRows[b] >> outShift)*dst->linesize[p] : NULL;
+        }
+        
+        heights[b] = sws_scale(bandCtxs[b], srcData, src->linesize, 0, bandInRows[b + 1] - bandInRows[b], 
+                               dstData, dst->linesize);
+    };
+    
+    if (WorkersPool::current()) {
+        WorkersPool::current()->parallelFor(bandCtxs.size(), scaleBand);
+    } else {
+        for (unsigned b = 0; b < bandCtxs.size(); b++) {
+            scaleBand(b);
+        }
+    }
+    
+    return std::find_if(heights.begin(), heights.end(), [](int h) {return h <= 0;}) == heights.end();
+}
+
+//NOTE: surfaces can not be scaled by swscale, they are only passed through when no scaling is needed
+bool VideoResampler::passSurface(HardwareVideoFrame* orgFrame, HardwareVideoFrame* dstFrame)
+{
+    if ((outputWidth != 0 && outputWidth != orgFrame->getWidth()) || 
+        (outputHeight != 0 && outputHeight != orgFrame->getHeight())) {
+        utils::errorMsg("[Resampler] Hardware surfaces can not be scaled, output must be a host pixel format");
         return false;
     }
+    
+    return dstFrame->setSurface(orgFrame->getSurface());
+}
 
-    if (!setAVFrame(inFrame, orgFrame, libavInPixFmt)){
+//NOTE: the picture is moved instead of copied when this filter is the only reader of a new frame that 
+//      nobody retained. The origin slot gets the previous destination buffer, which its writer fits 
+//      before filling it again
+bool VideoResampler::passFrame(VideoFrame* orgFrame, VideoFrame* dstFrame, bool sharedInput)
+{
+    if (sharedInput || !orgFrame->getConsumed() || orgFrame->getRefs() > 1 || orgFrame->getCodec() != RAW ||
+        (outputWidth != 0 && outputWidth != orgFrame->getWidth()) || 
+        (outputHeight != 0 && outputHeight != orgFrame->getHeight()) || 
+        outPixFmt != orgFrame->getPixelFormat()) {
         return false;
     }
+    
+    return dstFrame->swapBuffer(orgFrame);
+}
 
-    if (outputWidth == 0){
-        outWidth = orgFrame->getWidth();
-    } else {
-        outWidth = outputWidth;
+//NOTE: no swscale context is set up for frames that keep their size, bands of even rows are converted
+//      in parallel as scaled bands are
+bool VideoResampler::convertFrame(VideoFrame* orgFrame, VideoFrame* dstFrame)
+{
+    unsigned char* srcData[MAX_PLANES];
+    unsigned char* dstData[MAX_PLANES];
+    int srcLinesize[MAX_PLANES];
+    int dstLinesize[MAX_PLANES];
+    int width = orgFrame->getWidth();
+    int height = orgFrame->getHeight();
+    PixType inPixel = orgFrame->getPixelFormat();
+    int bands = std::min(threads, height/2);
+    bool success = true;
+    
+    if (orgFrame->getCodec() != RAW || (outputWidth != 0 && outputWidth != width) || 
+        (outputHeight != 0 && outputHeight != height) || !PixelConverter::isSupported(inPixel, outPixFmt)) {
+        return false;
+    }
+    
+    if (orgFrame->getPlanes(srcData, srcLinesize) == 0) {
+        return false;
+    }
+    
+    dstFrame->fitBuffer(width, height, outPixFmt);
+    
+    if (dstFrame->getPlanes(dstData, dstLinesize) == 0) {
+        return false;
     }
     
-    if (outputHeight == 0){
-        outHeight = orgFrame->getHeight();
+    if (bands <= 1 || !WorkersPool::current()) {
+        success = PixelConverter::convert(srcData, srcLinesize, inPixel, dstData, dstLinesize, outPixFmt, width, height);
     } else {
-        outHeight = outputHeight;
+        std::vector<char> converted(bands, true);
+        
+        WorkersPool::current()->parallelFor(bands, [&](unsigned b) {
+            int first = 2*((height/2)*b/bands);
+            int last = b + 1 == (unsigned) bands ? height : 2*((height/2)*(b + 1)/bands);
+            
+            converted[b] = PixelConverter::convert(srcData, srcLinesize, inPixel, dstData, dstLinesize, outPixFmt, 
+                                                   width, height, first, last - first);
+        });
+        
+        success = std::find(converted.begin(), converted.end(), false) == converted.end();
+    }
+    
+    if (success) {
+        convertedFrames++;
     }
     
-    dstFrame->setLength(av_image_get_buffer_size(libavOutPixFmt, outWidth, outHeight, 1));
-    dstFrame->setSize(outWidth, outHeight);
-    dstFrame->setPixelFormat(outPixFmt);
+    return success;
+}
 
-    if (!setAVFrame(outFrame, dstFrame, libavOutPixFmt)){
-        return false;
+//NOTE: pictures are scaled to the output size, or kept at their size for the reader of the output
+void VideoResampler::publishPictureSize(FrameQueue *queue, bool sharedInput)
+{
+    std::shared_ptr<Writer> writer = getWriter(DEFAULT_ID);
+    unsigned width = 0;
+    unsigned height = 0;
+
+    if (sharedInput) {
+        //NOTE: other readers may need the full size pictures
+    } else if (outputWidth > 0 && outputHeight > 0) {
+        width = outputWidth;
+        height = outputHeight;
+    } else if (outputWidth == 0 && outputHeight == 0 && writer && writer->getQueue()) {
+        writer->getQueue()->getReaderPictureSize(width, height);
     }
+
+    queue->setReaderPictureSize(width, height);
+}
+
+bool VideoResampler::doProcessFrame(VideoFrame *orgFrame, VideoFrame *dstFrame)
+{
+    int outWidth, outHeight;
+    int height;
+    int inWidth, inHeight;
+    PixType inPixel;
+    AVFrame *srcFrame = inFrame;
+    bool sharedInput = true;
+    std::shared_ptr<Reader> reader = getReader(DEFAULT_ID);
+
+    HardwareVideoFrame* hwOrgFrame = dynamic_cast<HardwareVideoFrame*>(orgFrame);
+    HardwareVideoFrame* hwDstFrame = dynamic_cast<HardwareVideoFrame*>(dstFrame);
     
-    height = sws_scale(imgConvertCtx, inFrame->data, inFrame->linesize, 0, 
-              inFrame->height, outFrame->data, outFrame->linesize);
+    //NOTE: the writer can only skip the frames dropped here if no other filter reads them
+    if (reader && reader->getQueue()) {
+        sharedInput = reader->isShared();
+        reader->getQueue()->setReaderFrameTime(sharedInput ? std::chrono::microseconds(0) : scheduler.getFrameTime());
+        publishPictureSize(reader->getQueue(), sharedInput);
+    }
     
-    if (height <= 0){
-        utils::errorMsg("Could not convert image");
+    if (!scheduler.keep(orgFrame->getPresentationTime())) {
         return false;
     }
 
-    dst->setConsumed(true);
-    dst->setPresentationTime(org->getPresentationTime());
-    dst->setDecodeTime(org->getDecodeTime());
-    dst->setOriginTime(org->getOriginTime());
-    dst->setSequenceNumber(org->getSequenceNumber());
+    //NOTE: the conversion is set up again at the first frame of a new origin format, see StreamInfo
+    if (orgFrame->getFormatVersion() != inFormatVersion) {
+        inFormatVersion = orgFrame->getFormatVersion();
+        needsConfig = true;
+    }
+
+    if (hwDstFrame) {
+        if (!hwOrgFrame) {
+            utils::errorMsg("[Resampler] Host frames can not be uploaded to hardware surfaces");
+            return false;
+        }
+        
+        if (!passSurface(hwOrgFrame, hwDstFrame)) {
+            return false;
+        }
+    } else if (!hwOrgFrame && passFrame(orgFrame, dstFrame, sharedInput)) {
+        //NOTE: the picture has been forwarded as is
+    } else if (!hwOrgFrame && convertFrame(orgFrame, dstFrame)) {
+        //NOTE: the picture has been converted without scaling it
+    } else {
+        inWidth = orgFrame->getWidth();
+        inHeight = orgFrame->getHeight();
+        inPixel = orgFrame->getPixelFormat();
+        
+        if (hwOrgFrame) {
+            if (!hwOrgFrame->download(hwDownload)) {
+                return false;
+            }
+            srcFrame = hwDownload;
+            inWidth = hwDownload->width;
+            inHeight = hwDownload->height;
+            inPixel = getPixelFormat((AVPixelFormat) hwDownload->format);
+        }
+        
+        if (!reconfigure(inWidth, inHeight, inPixel)){
+            return false;
+        }
+
+        if (!hwOrgFrame && !setAVFrame(inFrame, orgFrame, libavInPixFmt)){
+            return false;
+        }
+
+        if (outputWidth == 0){
+            outWidth = srcFrame->width;
+        } else {
+            outWidth = outputWidth;
+        }
+        
+        if (outputHeight == 0){
+            outHeight = srcFrame->height;
+        } else {
+            outHeight = outputHeight;
+        }
+        
+        dstFrame->fitBuffer(outWidth, outHeight, outPixFmt);
+
+        if (!setAVFrame(outFrame, dstFrame, libavOutPixFmt)){
+            return false;
+        }
+        
+        if (!bandCtxs.empty()){
+            height = scaleBands(srcFrame, outFrame) ? outHeight : 0;
+        } else {
+            height = sws_scale(imgConvertCtx, srcFrame->data, srcFrame->linesize, 0, 
+                      srcFrame->height, outFrame->data, outFrame->linesize);
+        }
+        
+        if (height <= 0){
+            utils::errorMsg("Could not convert image");
+            return false;
+        }
+    }
+
+    dstFrame->setConsumed(true);
+    dstFrame->setPresentationTime(orgFrame->getPresentationTime());
+    dstFrame->setDecodeTime(orgFrame->getDecodeTime());
+    dstFrame->setOriginTime(orgFrame->getOriginTime());
+    dstFrame->setSequenceNumber(orgFrame->getSequenceNumber());
+    dstFrame->setFieldOrder(orgFrame->getFieldOrder());
+    dstFrame->getSideData() = orgFrame->getSideData();
+    stampFormat(dstFrame);
     
     return true;
 }
 
+void VideoResampler::stampFormat(VideoFrame *dstFrame)
+{
+    if (writtenWidth > 0 && (dstFrame->getWidth() != writtenWidth || 
+        dstFrame->getHeight() != writtenHeight || dstFrame->getPixelFormat() != writtenPixFmt)) {
+        outputStreamInfo->changeFormat();
+    }
+    
+    writtenWidth = dstFrame->getWidth();
+    writtenHeight = dstFrame->getHeight();
+    writtenPixFmt = dstFrame->getPixelFormat();
+    dstFrame->setFormatVersion(outputStreamInfo->getFormatVersion());
+}
 
-bool VideoResampler::configure0(int width, int height, int fps, PixType pixelFormat) 
+
+bool VideoResampler::configure0(int width, int height, int fps, PixType pixelFormat, int threads) 
 {
+    if (threads < 1 || threads > RESAMPLER_MAX_THREADS){
+        utils::errorMsg("[Resampler] Threads must be in [1, " + std::to_string(RESAMPLER_MAX_THREADS) + "]");
+        return false;
+    }
+    
+    this->threads = threads;
     outputWidth = width;
     outputHeight = height;
     outPixFmt = pixelFormat;
     
-    libavOutPixFmt = getLibavPixFmt(outPixFmt);
     needsConfig = true;
     
     if (fps <= 0) {
-        setFrameTime(std::chrono::microseconds(0));
+        scheduler.setFrameTime(std::chrono::microseconds(0));
     } else {
-        setFrameTime(std::chrono::microseconds(std::micro::den/fps));
+        scheduler.setFrameTime(std::chrono::microseconds(std::micro::den/fps));
+    }
+    
+    //NOTE: HW_SURFACE output passes decoded surfaces through, there is no host output format
+    if (outPixFmt == HW_SURFACE){
+        libavOutPixFmt = AV_PIX_FMT_NONE;
+        outputStreamInfo->video.pixelFormat = outPixFmt;
+        return true;
     }
     
+    libavOutPixFmt = getLibavPixFmt(outPixFmt);
+    
     if (libavOutPixFmt == AV_PIX_FMT_NONE){
         return false;
     }
     
+    //NOTE: output queues allocated afterwards get planar frames for planar formats
+    outputStreamInfo->video.pixelFormat = outPixFmt;
+    
     return true;
 }
 
 bool VideoResampler::configEvent(Jzon::Node* params)
 {
-    int width, height, fps;
+    int width, height, fps, slices;
     PixType pixelType;
        
     if (!params) {
@@ -191,12 +512,13 @@ bool VideoResampler::configEvent(Jzon::Node* params)
     
     width = outputWidth;
     height = outputHeight;
-    if (getFrameTime().count() > 0){
-        fps = std::micro::den/getFrameTime().count();
+    if (scheduler.getFrameTime().count() > 0){
+        fps = std::micro::den/scheduler.getFrameTime().count();
     } else {
         fps = 0;
     }
     pixelType = outPixFmt;
+    slices = threads;
     
     if (params->Has("width")){
         width = params->Get("width").ToInt();
@@ -212,13 +534,17 @@ bool VideoResampler::configEvent(Jzon::Node* params)
     
     if (params->Has("pixelFormat")){
         int pixel = params->Get("pixelFormat").ToInt();
-        if ((pixel < P_NONE) || (pixel > YUYV422)) {
+        if ((pixel < P_NONE) || (pixel > YUVJ422P)) {
             return false;
         }
         pixelType = static_cast<PixType> (pixel);
     }
+    
+    if (params->Has("threads") && params->Get("threads").IsNumber()){
+        slices = params->Get("threads").ToInt();
+    }
 
-    return configure0(width, height, fps, pixelType);
+    return configure0(width, height, fps, pixelType, slices);
 }
 
 void VideoResampler::initializeEventMap()
@@ -228,7 +554,9 @@ void VideoResampler::initializeEventMap()
 
 void VideoResampler::doGetState(Jzon::Object &filterNode)
 {
-    //TODO:
+    filterNode.Add("frameTime", (int) scheduler.getFrameTime().count());
+    filterNode.Add("droppedFrames", (int) scheduler.getDropped());
+    filterNode.Add("convertedFrames", (int) convertedFrames);
 }
 
 AVPixelFormat getLibavPixFmt(PixType pixType)
@@ -255,6 +583,12 @@ AVPixelFormat getLibavPixFmt(PixType pixType)
         case YUVJ420P:
             return AV_PIX_FMT_YUVJ420P;
             break;
+        case YUVJ422P:
+            return AV_PIX_FMT_YUVJ422P;
+            break;
+        case NV12:
+            return AV_PIX_FMT_NV12;
+            break;
         default:
             utils::errorMsg("[Resampler] Unknown output pixel format");
             break;
@@ -265,9 +599,8 @@ AVPixelFormat getLibavPixFmt(PixType pixType)
 
 bool VideoResampler::setAVFrame(AVFrame *aFrame, VideoFrame* vFrame, AVPixelFormat format)
 {      
-    if (av_image_fill_arrays(aFrame->data, aFrame->linesize, vFrame->getDataBuf(), 
-            format, vFrame->getWidth(), 
-            vFrame->getHeight(), 1) <= 0){
+    //NOTE: planar frames are used in place, with their own line sizes
+    if (vFrame->getPlanes(aFrame->data, aFrame->linesize) == 0){
         utils::errorMsg("Could not feed AVFrame");
         return false;
     }
@@ -279,7 +612,7 @@ bool VideoResampler::setAVFrame(AVFrame *aFrame, VideoFrame* vFrame, AVPixelForm
     return true;
 }
 
-bool VideoResampler::configure(int width, int height, int fps, PixType pixelFormat) 
+bool VideoResampler::configure(int width, int height, int fps, PixType pixelFormat, int threads) 
 {
     Jzon::Object root, params;
     root.Add("action", "configure");
@@ -287,6 +620,7 @@ bool VideoResampler::configure(int width, int height, int fps, PixType pixelForm
     params.Add("height", height);
     params.Add("fps", fps);
     params.Add("pixelFormat", pixelFormat);
+    params.Add("threads", threads);
     root.Add("params", params);
 
     Event e(root, std::chrono::system_clock::now(), 0);
@@ -28,29 +28,61 @@ extern "C" {
     #include <libswscale/swscale.h>
     #include <libavcodec/avcodec.h>
     #include <libavutil/imgutils.h>
+    #include <libavutil/pixdesc.h>
 }
 
 #include "../../VideoFrame.hh"
+#include "../../HardwareVideoFrame.hh"
 #include "../../FrameQueue.hh"
 #include "../../Filter.hh"
 #include "../../StreamInfo.hh"
+#include "../../FrameRateScheduler.hh"
+#include <vector>
 
-class VideoResampler : public OneToOneFilter {
+#define RESAMPLER_MAX_THREADS 16       //!< Maximum number of horizontal bands scaled in parallel
+
+/*! Libav-based resampler. With more than one thread the frame is split in horizontal bands, 
+*   each one with its own swscale context, which are scaled in parallel on the pool workers. 
+*   Band edges map to whole input rows of the same chroma parity, so the bands scale exactly 
+*   the rows a single pass would, only the filter taps at the band edges do not cross them.
+*   Frames already matching the output size and pixel format are forwarded without scaling them, and
+*   frames of the output size are converted by PixelConverter kernels when it supports the formats.
+*   The output frame rate is reduced by selecting the frames from their timestamps before scaling 
+*   them, the selection is published to the input queue so the upstream decoder can skip them too.
+*/
+class VideoResampler : public OneToOneFilterT<VideoFrame, VideoFrame> {
 
     public:
         VideoResampler();
         ~VideoResampler();
-        bool configure(int width, int height, int fps, PixType pixelFormat);
+        
+        /**
+        * Configures the output
+        * @param width output width, 0 keeps the input one
+        * @param height output height, 0 keeps the input one
+        * @param fps maximum output frames per second, 0 follows the input
+        * @param pixelFormat output pixel format
+        * @param threads number of bands scaled in parallel [1, RESAMPLER_MAX_THREADS]
+        */
+        bool configure(int width, int height, int fps, PixType pixelFormat, int threads = 1);
         
     private:
-        bool configure0(int width, int height, int fps, PixType pixelFormat);
-        bool doProcessFrame(Frame *org, Frame *dst);
+        bool configure0(int width, int height, int fps, PixType pixelFormat, int threads);
+        bool doProcessFrame(VideoFrame *orgFrame, VideoFrame *dstFrame);
         FrameQueue* allocQueue(ConnectionData cData);
         void initializeEventMap();
         bool configEvent(Jzon::Node* params);
         void doGetState(Jzon::Object &filterNode);
-        bool reconfigure(VideoFrame* orgFrame);
+        bool reconfigure(int inWidth, int inHeight, PixType inPixelFormat);
         bool setAVFrame(AVFrame *aFrame, VideoFrame* vFrame, AVPixelFormat format);
+        bool passSurface(HardwareVideoFrame* orgFrame, HardwareVideoFrame* dstFrame);
+        bool passFrame(VideoFrame* orgFrame, VideoFrame* dstFrame, bool sharedInput);
+        bool convertFrame(VideoFrame* orgFrame, VideoFrame* dstFrame);
+        void publishPictureSize(FrameQueue* queue, bool sharedInput);
+        void stampFormat(VideoFrame *dstFrame);
+        bool configureBands(int inWidth, int inHeight, int outWidth, int outHeight);
+        void freeBands();
+        bool scaleBands(AVFrame *src, AVFrame *dst);
         
         //NOTE: There is no need of specific reader configuration
         bool specificReaderConfig(int /*readerID*/, FrameQueue* /*queue*/)  {return true;};
@@ -61,15 +93,27 @@ class VideoResampler : public OneToOneFilter {
         bool specificWriterDelete(int /*writerID*/) {return true;};
         
         struct SwsContext   *imgConvertCtx;
-        AVFrame             *inFrame, *outFrame;
+        std::vector<struct SwsContext*> bandCtxs;
+        std::vector<int>    bandInRows;     //!< First input row of each band, plus the input height
+        std::vector<int>    bandOutRows;    //!< First output row of each band, plus the output height
+        AVFrame             *inFrame, *outFrame, *hwDownload;
         AVPixelFormat       libavInPixFmt, libavOutPixFmt;
 
         StreamInfo          *outputStreamInfo;
 
+        int                 inputWidth;
+        int                 inputHeight;
         int                 outputWidth;
         int                 outputHeight;
         PixType             inPixFmt, outPixFmt;
+        unsigned            inFormatVersion;    //!< Format version of the last origin frame
+        int                 writtenWidth;       //!< Picture size and format of the last written frame
+        int                 writtenHeight;
+        PixType             writtenPixFmt;
+        int                 threads;
+        FrameRateScheduler  scheduler;
         bool                needsConfig;
+        size_t              convertedFrames;    //!< Frames converted without swscale, see PixelConverter
 };
 
 #endif
@@ -22,14 +22,18 @@
 
 #include "VideoSplitter.hh"
 #include "../../AVFramedQueue.hh"
+#include "../../FramePool.hh"
+#include "../../WorkersPool.hh"
+#include <opencv2/core/ocl.hpp>
 #include <iostream>
 #include <chrono> 
+#include <algorithm>
 
 ///////////////////////////////////////////////////
 //                 CropConfig Class              //
 ///////////////////////////////////////////////////
 
-CropConfig::CropConfig() : width(0), height(0), x(-1), y(-1), degree(0)
+CropConfig::CropConfig() : width(0), height(0), x(-1), y(-1), degree(0), view(false)
 {
 
 }
@@ -41,23 +45,30 @@ void CropConfig::config(int width, int height, int x, int y, int degree)
     this->x = x;
     this->y = y;
     this->degree = degree;
-    cv::Mat img(height, width, CV_8UC3);
-    img.copyTo(this->crop);
-
 }
 
 ///////////////////////////////////////////////////
 //              VideoSplitter Class              //
 ///////////////////////////////////////////////////
 
-VideoSplitter* VideoSplitter::createNew(std::chrono::microseconds fTime)
+VideoSplitter* VideoSplitter::createNew(std::chrono::microseconds fTime, ComposeBackend backend)
 {
 	if (fTime.count() < 0) {
         utils::errorMsg("[VideoSplitter] Error creating VideoSplitter, negative frame time is not valid");
         return NULL;
     }
 
-    return new VideoSplitter(fTime);
+    if (backend == CB_NONE) {
+        utils::errorMsg("[VideoSplitter] Error creating VideoSplitter, cropping backend not valid");
+        return NULL;
+    }
+
+    if (backend == OPENCL_COMPOSE && !cv::ocl::haveOpenCL()) {
+        utils::warningMsg("[VideoSplitter] No OpenCL device available, cropping on the CPU");
+        backend = CPU_COMPOSE;
+    }
+
+    return new VideoSplitter(fTime, backend);
 }
 
 VideoSplitter::~VideoSplitter()
@@ -99,8 +110,8 @@ bool VideoSplitter::configure(int fTime)
 }
 
 
-VideoSplitter::VideoSplitter(std::chrono::microseconds fTime):
-OneToManyFilter()
+VideoSplitter::VideoSplitter(std::chrono::microseconds fTime, ComposeBackend backend):
+OneToManyFilterT(), backend(backend), orgFormatVersion(0), orgWidth(0), orgHeight(0)
 {
 
 	initializeEventMap();
@@ -117,54 +128,159 @@ FrameQueue* VideoSplitter::allocQueue(ConnectionData cData)
     return VideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_RAW_VIDEO_FRAMES);
 }
 
-bool VideoSplitter::doProcessFrame(Frame *org, std::map<int, Frame *> &dstFrames)
+bool VideoSplitter::doProcessFrame(VideoFrame *org, FrameMap &dstFrames)
 {
 	bool processFrame = false;
 	int xROI = -1;
 	int yROI = -1;
 	int widthROI = 0;
 	int heightROI = 0;
-	VideoFrame *vFrame;
+	CropConfig *crop;
 	VideoFrame *vFrameDst;
-
-	vFrame = dynamic_cast<VideoFrame*>(org);
-	
-	if(!vFrame){
-		utils::errorMsg("[VideoSplitter] No origin frame");
-		return false;
+	unsigned char* data[MAX_PLANES];
+	int linesize[MAX_PLANES];
+
+	//NOTE: crops are scaled at the first frame of a new origin format, their outputs format changes too
+	if (org->getFormatVersion() != orgFormatVersion) {
+		if (orgWidth > 0 && orgHeight > 0 && (org->getWidth() != orgWidth || org->getHeight() != orgHeight)) {
+			fitCrops(org->getWidth(), org->getHeight());
+			outputStreamInfo->changeFormat();
+		}
+		orgFormatVersion = org->getFormatVersion();
 	}
-	
-	cv::Mat orgFrame(vFrame->getHeight(), vFrame->getWidth(), CV_8UC3, vFrame->getDataBuf());
+	orgWidth = org->getWidth();
+	orgHeight = org->getHeight();
+
+	org->getPlanes(data, linesize);
+	cv::Mat orgFrame(org->getHeight(), org->getWidth(), CV_8UC3, data[0], linesize[0]);
+
+	copies.clear();
 	
 	for (auto it : dstFrames){
-		xROI = cropsConfig[it.first]->getX();
-		yROI = cropsConfig[it.first]->getY();
-		widthROI = cropsConfig[it.first]->getWidth();
-		heightROI = cropsConfig[it.first]->getHeight();
-
-		if((xROI >= 0 || yROI >= 0 || widthROI > 0 || heightROI > 0) && xROI+widthROI <= vFrame->getWidth() && yROI+heightROI <= vFrame->getHeight()){
-			vFrameDst = dynamic_cast<VideoFrame*>(it.second);
-			cropsConfig[it.first]->getCrop()->data = vFrameDst->getDataBuf();
-			vFrameDst->setLength(widthROI * heightROI);
-    		vFrameDst->setSize(widthROI, heightROI);
-    		orgFrame(cv::Rect(xROI, yROI, widthROI, heightROI)).copyTo(cropsConfig[it.first]->getCropRect(0, 0, widthROI, heightROI));
+		crop = cropsConfig[it.first];
+		xROI = crop->getX();
+		yROI = crop->getY();
+		widthROI = crop->getWidth();
+		heightROI = crop->getHeight();
+
+		if((xROI >= 0 || yROI >= 0 || widthROI > 0 || heightROI > 0) && xROI+widthROI <= org->getWidth() && yROI+heightROI <= org->getHeight()){
+			vFrameDst = static_cast<VideoFrame*>(it.second);
+			crop->setView(crop->getRotation() == 0 && setView(org, vFrameDst, crop));
+			if (!crop->isView()) {
+				copies.push_back(std::make_pair(crop, vFrameDst));
+			}
 			it.second->setConsumed(true);
 			it.second->setPresentationTime(org->getPresentationTime());
             it.second->setDecodeTime(org->getDecodeTime());
 			it.second->setOriginTime(org->getOriginTime());
     		it.second->setSequenceNumber(org->getSequenceNumber());
+			it.second->getSideData() = org->getSideData();
+			vFrameDst->setFormatVersion(outputStreamInfo->getFormatVersion());
 			processFrame = true;
 		} else {
 			utils::warningMsg("[VideoSplitter] Crop not configured or out of scope (Crop ID: " + std::to_string(it.first) 
-							+ " - Origin width: " + std::to_string(vFrame->getWidth()) + " - Origin height: " + std::to_string(vFrame->getHeight()) + ")");
+							+ " - Origin width: " + std::to_string(org->getWidth()) + " - Origin height: " + std::to_string(org->getHeight()) + ")");
 
 			it.second->setConsumed(false);
 		}
 	}
 
+	if (copies.empty()) {
+		return processFrame;
+	}
+
+	//NOTE: the upload buffer is only reallocated if the origin size changes
+	if (backend == OPENCL_COMPOSE) {
+		orgFrame.copyTo(gpuFrame);
+	}
+
+	//NOTE: each crop writes its own output frame, OpenCL crops share the device queue so they are not split
+	auto copyItem = [&](unsigned i) {
+		copyCrop(orgFrame, copies[i].second, copies[i].first);
+	};
+
+	if (WorkersPool::current() && backend == CPU_COMPOSE) {
+		WorkersPool::current()->parallelFor(copies.size(), copyItem);
+	} else {
+		for (unsigned i = 0; i < copies.size(); i++) {
+			copyItem(i);
+		}
+	}
+
 	return processFrame;
 }
 
+bool VideoSplitter::setView(VideoFrame *org, VideoFrame *dst, CropConfig *crop)
+{
+	InterleavedVideoFrame *orgFrame = dynamic_cast<InterleavedVideoFrame*>(org);
+	InterleavedVideoFrame *dstFrame = dynamic_cast<InterleavedVideoFrame*>(dst);
+	unsigned char* data[MAX_PLANES];
+	int linesize[MAX_PLANES];
+	unsigned char* start;
+	int stride;
+
+	//NOTE: only pooled frames are replaced in their queue while retained, others would be written again
+	if (!orgFrame || !dstFrame || !FramePool::getInstance()->isPooled(org) || org->getPixelFormat() != RGB24 ||
+		org->getPlanes(data, linesize) == 0) {
+		return false;
+	}
+
+	start = data[0] + crop->getY()*linesize[0] + crop->getX()*3;
+	//NOTE: full width crops of packed origins are packed too
+	stride = crop->getWidth()*3 == linesize[0] ? 0 : linesize[0];
+
+	org->retain();
+	std::shared_ptr<void> owner(start, [org](void*) {
+		FramePool::getInstance()->releaseFrame(org);
+	});
+
+	return dstFrame->setExternalBuffer(crop->getWidth(), crop->getHeight(), RGB24, start, owner, stride);
+}
+
+/**
+* Copies a crop into the output picture, rotating it clockwise
+* @param transposed intermediate picture of right angle rotations, kept by the crop so it is not reallocated
+*/
+static void rotateCrop(cv::InputArray roi, cv::Mat &out, int rotation, cv::Mat &transposed)
+{
+	switch (rotation) {
+		case 0:
+			roi.copyTo(out);
+			break;
+		case 180:
+			cv::flip(roi, out, -1);
+			break;
+		default:
+			//NOTE: clockwise 90 is the transpose mirrored horizontally, 270 mirrored vertically
+			cv::transpose(roi, transposed);
+			cv::flip(transposed, out, rotation == 90 ? 1 : 0);
+			break;
+	}
+}
+
+void VideoSplitter::copyCrop(const cv::Mat &orgFrame, VideoFrame *dst, CropConfig *crop)
+{
+	cv::Rect rect(crop->getX(), crop->getY(), crop->getWidth(), crop->getHeight());
+	int rotation = crop->getRotation();
+	bool swapped = rotation == 90 || rotation == 270;
+	unsigned char* data[MAX_PLANES];
+	int linesize[MAX_PLANES];
+
+	dst->fitBuffer(swapped ? rect.height : rect.width, swapped ? rect.width : rect.height, dst->getPixelFormat());
+	if (dst->getPlanes(data, linesize) == 0) {
+		return;
+	}
+
+	//NOTE: OpenCV writes into the output frame buffer as the header already has the output size and type
+	cv::Mat out(dst->getHeight(), dst->getWidth(), CV_8UC3, data[0], linesize[0]);
+
+	if (backend == OPENCL_COMPOSE) {
+		rotateCrop(gpuFrame(rect), out, rotation, crop->getTransposed());
+	} else {
+		rotateCrop(orgFrame(rect), out, rotation, crop->getTransposed());
+	}
+}
+
 void VideoSplitter::doGetState(Jzon::Object &filterNode)
 {
 	Jzon::Array jsonCropsConfigs;
@@ -177,9 +293,11 @@ void VideoSplitter::doGetState(Jzon::Object &filterNode)
         crConfig.Add("x", it.second->getX());
         crConfig.Add("y", it.second->getY());
         crConfig.Add("degree", it.second->getDegree());
+        crConfig.Add("view", it.second->isView());
 		jsonCropsConfigs.Add(crConfig);
 	}
 	filterNode.Add("frameTime", getConfigure());
+	filterNode.Add("backend", utils::getComposeBackendAsString(backend));
 	filterNode.Add("crops", jsonCropsConfigs);
 }
 
@@ -196,10 +314,31 @@ bool VideoSplitter::configCrop0(int id, int width, int height, int x, int y, int
         return false;
     }
 
+    if (degree % 90 != 0) {
+        utils::errorMsg("[VideoSplitter] Error configuring crop. Only right angle rotations are supported");
+        return false;
+    }
+
     cropsConfig[id]->config(width, height, x, y, degree);
+    outputStreamInfo->changeFormat();
     return true;
 }
 
+void VideoSplitter::fitCrops(int width, int height)
+{
+	CropConfig *crop;
+
+	for (auto it : cropsConfig) {
+		crop = it.second;
+		if (crop->getWidth() <= 0 || crop->getHeight() <= 0) {
+			continue;
+		}
+
+		crop->config(std::max(crop->getWidth()*width/orgWidth, 1), std::max(crop->getHeight()*height/orgHeight, 1),
+					 crop->getX()*width/orgWidth, crop->getY()*height/orgHeight, crop->getDegree());
+	}
+}
+
 bool VideoSplitter::configure0(std::chrono::microseconds fTime)
 {
 	if (fTime.count() < 0) {
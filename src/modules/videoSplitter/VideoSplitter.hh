@@ -43,7 +43,7 @@ class CropConfig {
 	    * @param height Channel
 	    * @param x Upper left corner X position
 	    * @param y Upper left corner Y position
-	    * @param degree [-360º,360º] rotate image
+	    * @param degree [-360º,360º] rotate image, clockwise, in right angles
 	    */
 		void config(int width, int height, int x, int y, int degree = 0);
 
@@ -78,42 +78,53 @@ class CropConfig {
 	    int getDegree() {return degree;};
 
 	    /**
-	    * Class constructor.
-	    * @return Crop
+	    * Get Rotation.
+	    * @return clockwise rotation of Crop, 0, 90, 180 or 270
 	    */
-	    cv::Mat *getCrop() {return &crop;};
+	    int getRotation() {return ((degree % 360) + 360) % 360;};
 
 	    /**
-	    * Class constructor.
-	    * @param x Upper left corner X position
-	    * @param y Upper left corner Y position
-	    * @param w width Channel
-	    * @param h height Channel 
-	    * @return Crop based on params
+	    * @return true if the last output of Crop referenced the origin frame instead of copying it
 	    */
-	    cv::Mat getCropRect(int x, int y, int w, int h) { return crop(cv::Rect(x,y,w,h)); };
+	    bool isView() {return view;};
+
+	    void setView(bool view) {this->view = view;};
+
+	    /**
+	    * @return intermediate picture of right angle rotations
+	    */
+	    cv::Mat &getTransposed() {return transposed;};
 	private:
 		int width;
 	    int height;
 	    int x;
 	    int y;
 	    int degree;
-	    cv::Mat crop;
+	    bool view;
+	    cv::Mat transposed;
 };
 
 /*
 * 	Video Splitter
+*	Crops without rotation reference the origin frame as strided views, retaining it while
+*	they are in use, so they are not copied. The rest are copied (and rotated) in parallel 
+*	by the workers pool. With the OpenCL backend each origin frame is uploaded once and those 
+*	crops are cut from device memory (OpenCV UMat), being downloaded straight into the output frames.
+*	When the origin announces a new picture size (see StreamInfo::changeFormat) crops are scaled to it, 
+*	so they keep covering the same region and their frames are not dropped.
 */
 
-class VideoSplitter : public OneToManyFilter {
+class VideoSplitter : public OneToManyFilterT<VideoFrame, VideoFrame> {
 	public:
 		/**
         * Class constructor
         * @param outputChannels 
         * @param fTime Frame time in microseconds
+        * @param backend Cropping backend, OPENCL_COMPOSE falls back to CPU_COMPOSE without an OpenCL device
         * @return Pointer to new object if succeed of NULL if not
         */
-		static VideoSplitter* createNew(std::chrono::microseconds fTime = std::chrono::microseconds(0));
+		static VideoSplitter* createNew(std::chrono::microseconds fTime = std::chrono::microseconds(0), 
+                                        ComposeBackend backend = CPU_COMPOSE);
 		/**
         * Class destructor
         */
@@ -140,10 +151,15 @@ class VideoSplitter : public OneToManyFilter {
         */
     	int getConfigure(){return getFrameTime().count();};
 
+        /**
+        * @return Cropping backend
+        */
+        ComposeBackend getBackend() {return backend;};
+
 	protected:
-		VideoSplitter(std::chrono::microseconds fTime);
+		VideoSplitter(std::chrono::microseconds fTime, ComposeBackend backend = CPU_COMPOSE);
 		FrameQueue *allocQueue(ConnectionData cData);
-		bool doProcessFrame(Frame *org, std::map<int, Frame *> &dstFrames);
+		bool doProcessFrame(VideoFrame *org, FrameMap &dstFrames);
 		void doGetState(Jzon::Object &filterNode);
 		bool configCrop0(int id, int width, int height, int x, int y, int degree=0);
 		bool configure0(std::chrono::microseconds fTime);
@@ -152,6 +168,9 @@ class VideoSplitter : public OneToManyFilter {
 
 	private:
 		void initializeEventMap();
+		bool setView(VideoFrame *org, VideoFrame *dst, CropConfig *crop);
+		void copyCrop(const cv::Mat &orgFrame, VideoFrame *dst, CropConfig *crop);
+		void fitCrops(int width, int height);
         bool configCropEvent(Jzon::Node* params);
         bool configureEvent(Jzon::Node* params);
         
@@ -162,6 +181,12 @@ class VideoSplitter : public OneToManyFilter {
 
         StreamInfo *outputStreamInfo;
         std::map<int, CropConfig*> cropsConfig;
+        ComposeBackend backend;
+        cv::UMat gpuFrame;          //!< Uploaded origin frame, used by the OpenCL backend
+        std::vector<std::pair<CropConfig*, VideoFrame*>> copies;    //!< Crops of the frame being processed that are copied
+        unsigned orgFormatVersion;  //!< Format version of the last origin frame
+        int orgWidth;               //!< Size of the last origin frame, crops are relative to it
+        int orgHeight;
 };
 
 #endif
\ No newline at end of file
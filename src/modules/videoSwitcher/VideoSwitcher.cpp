@@ -0,0 +1,429 @@
+/*
+ *  VideoSwitcher - Coded video input switcher
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "VideoSwitcher.hh"
+#include "../../AVFramedQueue.hh"
+#include "../../SlicedVideoFrameQueue.hh"
+#include "../../NalSplitter.hh"
+#include "../../Utils.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#define NAL_START_SIZE 4
+#define H264_AUD 9
+#define H265_AUD 35
+
+static const unsigned char nalStartCode[NAL_START_SIZE] = {0x00, 0x00, 0x00, 0x01};
+
+static unsigned char nalTypeOf(VCodecType codec, unsigned char header)
+{
+    return codec == H264 ? header & 0x1F : (header & 0x7E) >> 1;
+}
+
+static bool isParameterSet(VCodecType codec, unsigned char nalType)
+{
+    return codec == H264 ? (nalType == 7 || nalType == 8) : (nalType >= 32 && nalType <= 34);
+}
+
+static bool isSlice(VCodecType codec, unsigned char nalType)
+{
+    return codec == H264 ? (nalType >= 1 && nalType <= 5) : nalType <= 31;
+}
+
+static bool isKeySlice(VCodecType codec, unsigned char nalType)
+{
+    return codec == H264 ? nalType == 5 : (nalType >= 16 && nalType <= 21);
+}
+
+VideoSwitcher* VideoSwitcher::createNew(VCodecType codec, unsigned inputs)
+{
+    if (codec != H264 && codec != H265) {
+        utils::errorMsg("[VideoSwitcher] Error creating VideoSwitcher, only H264 and H265 are supported");
+        return NULL;
+    }
+
+    if (inputs == 0) {
+        utils::errorMsg("[VideoSwitcher] Error creating VideoSwitcher, it needs at least one input");
+        return NULL;
+    }
+
+    return new VideoSwitcher(codec, inputs);
+}
+
+VideoSwitcher::VideoSwitcher(VCodecType codec, unsigned inputs) : ManyToOneFilter(inputs),
+    active(-1), pending(-1), tsOffset(0), lastTs(-1), pictureTime(VSWITCHER_FRAME_TIME), switches(0)
+{
+    outputStreamInfo = new StreamInfo(VIDEO);
+    outputStreamInfo->video.codec = codec;
+    outputStreamInfo->setCodecDefaults();
+    //NOTE: the type of the pictures is read from the NAL units by the output queue
+    outputStreamInfo->video.frameTypes = true;
+
+    fType = VIDEO_SWITCHER;
+    initializeEventMap();
+}
+
+VideoSwitcher::~VideoSwitcher()
+{
+    delete outputStreamInfo;
+}
+
+FrameQueue* VideoSwitcher::allocQueue(ConnectionData cData)
+{
+    return SlicedVideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_VIDEO_FRAMES, MAX_H264_OR_5_NAL_SIZE);
+}
+
+bool VideoSwitcher::doProcessFrame(FrameMap &orgFrames, Frame *dst, std::vector<int> &newFrames)
+{
+    SlicedVideoFrame *out = dynamic_cast<SlicedVideoFrame*>(dst);
+    VCodecType codec = outputStreamInfo->video.codec;
+    unsigned char* data;
+    unsigned length;
+    unsigned start;
+    unsigned char type;
+    bool switched = false;
+    Frame* frame;
+
+    if (!out) {
+        utils::errorMsg("[VideoSwitcher] Destination frame must be a SlicedVideoFrame");
+        return false;
+    }
+
+    //NOTE: candidates are checked first, the IDR access unit of a switch replaces the NAL unit of the previous input
+    for (auto id : newFrames) {
+        auto it = inputs.find(id);
+
+        if (it == inputs.end() || !(frame = orgFrames[id])) {
+            continue;
+        }
+
+        data = frame->getDataBuf();
+        length = frame->getLength();
+        start = NalSplitter::startCodeLength(data, length);
+
+        if (!data || length <= start) {
+            continue;
+        }
+
+        type = nalTypeOf(codec, data[start]);
+
+        if (isParameterSet(codec, type)) {
+            std::vector<unsigned char> &ps = it->second.paramSets[type];
+            ps.assign(nalStartCode, nalStartCode + NAL_START_SIZE);
+            ps.insert(ps.end(), data + start, data + length);
+        }
+
+        //NOTE: without an active input nor a requested one, every input is a candidate
+        if (switched || id == active || !(id == pending || (active < 0 && pending < 0))) {
+            continue;
+        }
+
+        if (stageNal(it->second, frame, data + start, length - start)) {
+            switchTo(id, it->second, frame, data + start, length - start, out);
+            switched = true;
+        }
+    }
+
+    if (switched || active < 0 || std::find(newFrames.begin(), newFrames.end(), active) == newFrames.end()) {
+        return true;
+    }
+
+    frame = orgFrames[active];
+    data = frame->getDataBuf();
+    length = frame->getLength();
+    start = NalSplitter::startCodeLength(data, length);
+
+    if (!data || length <= start) {
+        return true;
+    }
+
+    //NOTE: NAL units with their start code are pointed to, the output queue copies them
+    if (start > 0) {
+        out->setSlice(data, length);
+    } else {
+        unit.clear();
+        sizes.clear();
+        appendNal(data, length);
+        out->setSlice(unit.data(), unit.size());
+    }
+
+    //NOTE: readers extradata change with encoder reconfigurations, the active one is followed
+    std::shared_ptr<Reader> reader = getReader(active);
+    if (reader && reader->getQueue() &&
+        reader->getQueue()->getStreamInfo()->getExtraDataVersion() != inputs[active].extradataVersion) {
+        publishExtraData(active, inputs[active]);
+    }
+
+    setTimestamps(frame, out);
+    out->setConsumed(true);
+
+    return true;
+}
+
+bool VideoSwitcher::stageNal(SwitcherInput &input, Frame* frame, unsigned char const* nal, unsigned size)
+{
+    VCodecType codec = outputStreamInfo->video.codec;
+    unsigned char type = nalTypeOf(codec, nal[0]);
+
+    if (frame->getPresentationTime() != input.unitTs) {
+        input.unit.clear();
+        input.sizes.clear();
+        input.unitTs = frame->getPresentationTime();
+        input.sliced = false;
+    }
+
+    //NOTE: access units are only switched to at their first slice, the rest of a non IDR one is ignored
+    if (input.sliced) {
+        return false;
+    }
+
+    if (!isSlice(codec, type)) {
+        input.unit.insert(input.unit.end(), nalStartCode, nalStartCode + NAL_START_SIZE);
+        input.unit.insert(input.unit.end(), nal, nal + size);
+        input.sizes.push_back(NAL_START_SIZE + size);
+        return false;
+    }
+
+    input.sliced = true;
+
+    if (!isKeySlice(codec, type)) {
+        return false;
+    }
+
+    input.keyUnits++;
+    return true;
+}
+
+void VideoSwitcher::switchTo(int id, SwitcherInput &input, Frame* frame, unsigned char const* nal, unsigned size,
+                             SlicedVideoFrame* out)
+{
+    VCodecType codec = outputStreamInfo->video.codec;
+    unsigned char aud = codec == H264 ? H264_AUD : H265_AUD;
+    unsigned char type;
+    unsigned offset = 0;
+
+    unit.clear();
+    sizes.clear();
+
+    //NOTE: the access unit delimiter stays first, then the last parameter sets of each type in their type
+    //      order (the staged ones are already cached), then the rest of the staged NAL units
+    if (!input.sizes.empty() && nalTypeOf(codec, input.unit[NAL_START_SIZE]) == aud) {
+        unit.insert(unit.end(), input.unit.begin(), input.unit.begin() + input.sizes[0]);
+        sizes.push_back(input.sizes[0]);
+    }
+
+    for (auto &ps : input.paramSets) {
+        unit.insert(unit.end(), ps.second.begin(), ps.second.end());
+        sizes.push_back(ps.second.size());
+    }
+
+    for (auto s : input.sizes) {
+        type = nalTypeOf(codec, input.unit[offset + NAL_START_SIZE]);
+        if (type != aud && !isParameterSet(codec, type)) {
+            unit.insert(unit.end(), input.unit.begin() + offset, input.unit.begin() + offset + s);
+            sizes.push_back(s);
+        }
+        offset += s;
+    }
+
+    appendNal(nal, size);
+
+    //NOTE: slices point to the filter buffer, which is not modified until the next output
+    offset = 0;
+    for (auto s : sizes) {
+        if (!out->setSlice(unit.data() + offset, s)) {
+            utils::errorMsg("[VideoSwitcher] Too many NAL units in the switching access unit");
+            break;
+        }
+        offset += s;
+    }
+
+    //NOTE: the first picture of the new input follows the last output one
+    if (lastTs.count() >= 0) {
+        tsOffset = lastTs + pictureTime - frame->getDecodeTime();
+    }
+
+    if (active >= 0) {
+        switches++;
+        utils::infoMsg("[VideoSwitcher] Switched from input " + std::to_string(active) + " to " + std::to_string(id));
+    }
+
+    active = id;
+    pending = -1;
+
+    publishExtraData(id, input);
+    setTimestamps(frame, out);
+    out->setConsumed(true);
+}
+
+void VideoSwitcher::appendNal(unsigned char const* nal, unsigned size)
+{
+    unit.insert(unit.end(), nalStartCode, nalStartCode + NAL_START_SIZE);
+    unit.insert(unit.end(), nal, nal + size);
+    sizes.push_back(NAL_START_SIZE + size);
+}
+
+void VideoSwitcher::publishExtraData(int id, SwitcherInput &input)
+{
+    std::shared_ptr<Reader> reader = getReader(id);
+    std::shared_ptr<const ExtraData> ed;
+    std::vector<unsigned char> sets;
+
+    if (reader && reader->getQueue()) {
+        ed = reader->getQueue()->getStreamInfo()->getExtraData();
+        input.extradataVersion = reader->getQueue()->getStreamInfo()->getExtraDataVersion();
+    }
+
+    //NOTE: inputs without extradata, i.e. received ones, are described by their in band parameter sets
+    if (ed) {
+        outputStreamInfo->setExtraData(ed->data(), ed->size());
+        return;
+    }
+
+    for (auto &ps : input.paramSets) {
+        sets.insert(sets.end(), ps.second.begin(), ps.second.end());
+    }
+
+    if (!sets.empty()) {
+        outputStreamInfo->setExtraData(sets.data(), sets.size());
+    }
+}
+
+void VideoSwitcher::setTimestamps(Frame* frame, SlicedVideoFrame* out)
+{
+    VideoFrame* vFrame = dynamic_cast<VideoFrame*>(frame);
+    std::chrono::microseconds dts = frame->getDecodeTime() + tsOffset;
+
+    //NOTE: decode times are increasing, unlike presentation times of streams with reordered pictures
+    if (lastTs.count() >= 0 && dts > lastTs) {
+        pictureTime = dts - lastTs;
+    }
+
+    lastTs = std::max(lastTs, dts);
+
+    out->setPresentationTime(frame->getPresentationTime() + tsOffset);
+    out->setDecodeTime(dts);
+
+    if (vFrame) {
+        out->setSize(vFrame->getWidth(), vFrame->getHeight());
+    }
+}
+
+bool VideoSwitcher::specificReaderConfig(int readerID, FrameQueue* queue)
+{
+    VideoFrameQueue *vQueue;
+
+    if ((vQueue = dynamic_cast<VideoFrameQueue*>(queue)) == NULL) {
+        utils::errorMsg("[VideoSwitcher] Only video queues can be switched");
+        return false;
+    }
+
+    if (vQueue->getStreamInfo()->video.codec != outputStreamInfo->video.codec) {
+        utils::errorMsg("[VideoSwitcher] Input codec must be " + utils::getVideoCodecAsString(outputStreamInfo->video.codec));
+        return false;
+    }
+
+    if (!vQueue->getStreamInfo()->video.h264or5.annexb) {
+        utils::errorMsg("[VideoSwitcher] Only Annex B inputs are supported");
+        return false;
+    }
+
+    inputs[readerID] = SwitcherInput();
+
+    return true;
+}
+
+bool VideoSwitcher::specificReaderDelete(int readerID)
+{
+    inputs.erase(readerID);
+
+    //NOTE: the output stalls until another input is switched to, or sends an IDR access unit if none is requested
+    if (active == readerID) {
+        active = -1;
+    }
+
+    if (pending == readerID) {
+        pending = -1;
+    }
+
+    return true;
+}
+
+bool VideoSwitcher::switchInput0(int id)
+{
+    if (inputs.count(id) == 0) {
+        utils::errorMsg("[VideoSwitcher] Unknown input " + std::to_string(id));
+        return false;
+    }
+
+    pending = id == active ? -1 : id;
+
+    return true;
+}
+
+void VideoSwitcher::initializeEventMap()
+{
+    eventMap["switchInput"] = std::bind(&VideoSwitcher::switchInputEvent, this, std::placeholders::_1);
+}
+
+bool VideoSwitcher::switchInputEvent(Jzon::Node* params)
+{
+    if (!params || !params->Has("id") || !params->Get("id").IsNumber()) {
+        utils::errorMsg("[VideoSwitcher::switchInputEvent] Params node not complete");
+        return false;
+    }
+
+    return switchInput0(params->Get("id").ToInt());
+}
+
+void VideoSwitcher::doGetState(Jzon::Object &filterNode)
+{
+    Jzon::Array jsonInputs;
+
+    filterNode.Add("codec", utils::getVideoCodecAsString(outputStreamInfo->video.codec));
+    filterNode.Add("active", active);
+    filterNode.Add("pending", pending);
+    filterNode.Add("switches", (int) switches);
+
+    for (auto &it : inputs) {
+        Jzon::Object jsonInput;
+        jsonInput.Add("id", it.first);
+        jsonInput.Add("keyUnits", (int) it.second.keyUnits);
+        jsonInput.Add("parameterSets", (int) it.second.paramSets.size());
+        jsonInputs.Add(jsonInput);
+    }
+
+    filterNode.Add("inputs", jsonInputs);
+}
+
+bool VideoSwitcher::switchInput(int id)
+{
+    Jzon::Object root, params;
+    root.Add("action", "switchInput");
+    params.Add("id", id);
+    root.Add("params", params);
+
+    Event e(root, std::chrono::system_clock::now(), 0);
+    pushEvent(e);
+    return true;
+}
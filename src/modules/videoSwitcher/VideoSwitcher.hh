@@ -0,0 +1,121 @@
+/*
+ *  VideoSwitcher - Coded video input switcher
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of media-streamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _VIDEO_SWITCHER_HH
+#define _VIDEO_SWITCHER_HH
+
+#include <map>
+#include <vector>
+#include <chrono>
+
+#include "../../Filter.hh"
+#include "../../VideoFrame.hh"
+#include "../../StreamInfo.hh"
+
+#define VSWITCHER_MAX_INPUTS 8
+#define VSWITCHER_FRAME_TIME 40000      //!< Microseconds between the last picture of a source and the first
+                                        //!< one of the next, until the picture rate of the output is known
+
+/*! Switching state of a reader */
+struct SwitcherInput {
+    SwitcherInput() : unitTs(-1), sliced(false), extradataVersion(0), keyUnits(0) {};
+
+    std::map<unsigned char, std::vector<unsigned char>> paramSets;  //!< Last parameter set of each type, in Annex B
+    std::vector<unsigned char> unit;        //!< NAL units before the first slice of the access unit in progress
+    std::vector<unsigned> sizes;            //!< Size of each staged NAL unit
+    std::chrono::microseconds unitTs;       //!< Presentation time of the access unit in progress
+    bool sliced;                            //!< The access unit in progress already had a slice
+    unsigned extradataVersion;              //!< Version of the reader extradata already published
+    size_t keyUnits;                        //!< IDR access units received
+};
+
+/*! Switches between coded H264 or H265 sources without transcoding them. The output follows
+*   one input (the active one) and a switch to another input happens at its next IDR access unit,
+*   which is output with the parameter sets of its source, so decoders downstream replace theirs
+*   before the first slice of the new source. Timestamps are rewritten to be continuous across
+*   switches and the output StreamInfo extradata is replaced by the one of the active input.
+*   Until an input is selected, the first input sending an IDR access unit becomes the active one.
+*/
+class VideoSwitcher : public ManyToOneFilter {
+
+public:
+    /**
+    * Class constructor wrapper used to validate input params
+    * @param codec coded format of the inputs and the output, H264 or H265
+    * @param inputs maximum number of inputs
+    * @return Pointer to new object if succeed of NULL if not
+    */
+    static VideoSwitcher* createNew(VCodecType codec = H264, unsigned inputs = VSWITCHER_MAX_INPUTS);
+
+    /**
+    * Class destructor
+    */
+    ~VideoSwitcher();
+
+    /**
+    * Switches the output to an input at its next IDR access unit
+    * @param id input reader id
+    * @return true if the switch event has been pushed
+    */
+    bool switchInput(int id);
+
+    /**
+    * @return reader id of the active input, -1 if there is none
+    */
+    int getActiveInput() {return active;};
+
+protected:
+    //Protected for testing purposes
+    VideoSwitcher(VCodecType codec, unsigned inputs);
+    bool doProcessFrame(FrameMap &orgFrames, Frame *dst, std::vector<int> &newFrames);
+    bool specificReaderConfig(int readerID, FrameQueue* queue);
+    bool specificReaderDelete(int readerID);
+    bool specificWriterConfig(int /*writerID*/) {return true;};
+    bool specificWriterDelete(int /*writerID*/) {return true;};
+    bool switchInput0(int id);
+
+private:
+    FrameQueue *allocQueue(ConnectionData cData);
+    void doGetState(Jzon::Object &filterNode);
+    void initializeEventMap();
+    bool switchInputEvent(Jzon::Node* params);
+
+    bool stageNal(SwitcherInput &input, Frame* frame, unsigned char const* nal, unsigned size);
+    void switchTo(int id, SwitcherInput &input, Frame* frame, unsigned char const* nal, unsigned size,
+                  SlicedVideoFrame* out);
+    void appendNal(unsigned char const* nal, unsigned size);
+    void publishExtraData(int id, SwitcherInput &input);
+    void setTimestamps(Frame* frame, SlicedVideoFrame* out);
+
+    StreamInfo *outputStreamInfo;
+    std::map<int, SwitcherInput> inputs;
+    std::vector<unsigned char> unit;        //!< Output NAL units copied by the filter, see appendNal
+    std::vector<unsigned> sizes;
+    int active;
+    int pending;
+    std::chrono::microseconds tsOffset;     //!< Added to the timestamps of the active input
+    std::chrono::microseconds lastTs;       //!< Last output presentation time
+    std::chrono::microseconds pictureTime;  //!< Last time between output pictures
+    size_t switches;
+};
+
+#endif
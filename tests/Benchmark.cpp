@@ -0,0 +1,259 @@
+/*
+ *  Benchmark.cpp - Minimal microbenchmark harness
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include "Benchmark.hh"
+#include "../src/Utils.hh"
+
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <inttypes.h>
+#include <unistd.h>
+
+static std::chrono::duration<double> processCpuTime()
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) {
+        return std::chrono::duration<double>(0);
+    }
+
+    return std::chrono::duration<double>(ts.tv_sec + ts.tv_nsec/1e9);
+}
+
+static std::string escape(std::string text)
+{
+    std::string escaped;
+
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+static std::string formatNumber(double value)
+{
+    char text[32];
+
+    snprintf(text, sizeof(text), "%.17g", value);
+    return std::string(text);
+}
+
+BenchmarkState::BenchmarkState(uint64_t iterations_) :
+iterations(iterations_), left(iterations_), itemsProcessed(0), bytesProcessed(0), running(false),
+realTime(0), cpuTime(0)
+{
+}
+
+void BenchmarkState::start()
+{
+    realTime = std::chrono::duration<double>(0);
+    cpuTime = std::chrono::duration<double>(0);
+    resumeTiming();
+}
+
+void BenchmarkState::stop()
+{
+    pauseTiming();
+}
+
+void BenchmarkState::pauseTiming()
+{
+    if (!running) {
+        return;
+    }
+
+    realTime += std::chrono::steady_clock::now() - realStart;
+    cpuTime += processCpuTime() - cpuStart;
+    running = false;
+}
+
+void BenchmarkState::resumeTiming()
+{
+    if (running) {
+        return;
+    }
+
+    running = true;
+    cpuStart = processCpuTime();
+    realStart = std::chrono::steady_clock::now();
+}
+
+Benchmarks* Benchmarks::getInstance()
+{
+    static Benchmarks instance;
+
+    return &instance;
+}
+
+bool Benchmarks::add(std::string name, BenchmarkFunction function)
+{
+    benchmarks.push_back(std::make_pair(name, function));
+    return true;
+}
+
+int Benchmarks::run(int argc, char* argv[])
+{
+    std::vector<Result> results;
+    std::string filter;
+    std::string json;
+    double minTime = BENCHMARK_MIN_TIME;
+    Result r;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--min_time=", 11) == 0) {
+            minTime = std::stod(argv[i] + 11);
+        } else if (strncmp(argv[i], "--json=", 7) == 0) {
+            json = argv[i] + 7;
+        } else {
+            utils::infoMsg("Usage: " + std::string(argv[0]) + " [--filter=<substring>] [--min_time=<seconds>] [--json=<file>]");
+            return 1;
+        }
+    }
+
+    printf("%-48s %14s %14s %12s %s\n", "Benchmark", "Time (ns)", "CPU (ns)", "Iterations", "Throughput");
+
+    for (auto &b : benchmarks) {
+        if (!filter.empty() && b.first.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        r = runOne(b.first, b.second, minTime);
+        results.push_back(r);
+
+        printf("%-48s %14.1f %14.1f %12" PRIu64 " ", r.name.c_str(), r.realTime, r.cpuTime, r.iterations);
+
+        if (r.bytesPerSecond > 0) {
+            printf("%.1f MB/s ", r.bytesPerSecond/1e6);
+        }
+
+        if (r.itemsPerSecond > 0) {
+            printf("%.1f k items/s ", r.itemsPerSecond/1e3);
+        }
+
+        printf("%s\n", r.label.c_str());
+        fflush(stdout);
+    }
+
+    if (!json.empty() && !writeJson(json, results)) {
+        utils::errorMsg("Error writing benchmark results to " + json);
+        return 1;
+    }
+
+    return 0;
+}
+
+Benchmarks::Result Benchmarks::runOne(std::string name, BenchmarkFunction &function, double minTime)
+{
+    Result r;
+    uint64_t iterations = 1;
+    double multiplier;
+
+    while (true) {
+        BenchmarkState state(iterations);
+
+        function(state);
+
+        //NOTE: the next run aims a bit over the minimum time, growing at most 10 times per run
+        if (state.getRealTime() < minTime && iterations < BENCHMARK_MAX_ITERATIONS) {
+            multiplier = state.getRealTime() > 0 ? minTime*1.4/state.getRealTime() : 10;
+            multiplier = std::min(multiplier, 10.0);
+            iterations = std::max(iterations + 1, (uint64_t) (iterations*multiplier));
+            iterations = std::min(iterations, (uint64_t) BENCHMARK_MAX_ITERATIONS);
+            continue;
+        }
+
+        r.name = name;
+        r.iterations = iterations;
+        r.realTime = state.getRealTime()*1e9/iterations;
+        r.cpuTime = state.getCpuTime()*1e9/iterations;
+        r.bytesPerSecond = state.getRealTime() > 0 ? state.getBytesProcessed()/state.getRealTime() : 0;
+        r.itemsPerSecond = state.getRealTime() > 0 ? state.getItemsProcessed()/state.getRealTime() : 0;
+        r.label = state.getLabel();
+        return r;
+    }
+}
+
+bool Benchmarks::writeJson(std::string file, const std::vector<Result> &results)
+{
+    std::ofstream out(file.c_str());
+    char date[64];
+    char host[256] = "";
+    time_t now = time(NULL);
+
+    if (!out.is_open()) {
+        return false;
+    }
+
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    gethostname(host, sizeof(host) - 1);
+
+    out << "{\n  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+    out << "    \"host_name\": \"" << escape(host) << "\",\n";
+    out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+    out << "    \"library_build_type\": \"release\"\n";
+#else
+    out << "    \"library_build_type\": \"debug\"\n";
+#endif
+    out << "  },\n  \"benchmarks\": [";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+
+        out << (i == 0 ? "\n" : ",\n") << "    {\n";
+        out << "      \"name\": \"" << escape(r.name) << "\",\n";
+        out << "      \"run_name\": \"" << escape(r.name) << "\",\n";
+        out << "      \"run_type\": \"iteration\",\n";
+        out << "      \"iterations\": " << r.iterations << ",\n";
+        out << "      \"real_time\": " << formatNumber(r.realTime) << ",\n";
+        out << "      \"cpu_time\": " << formatNumber(r.cpuTime) << ",\n";
+        out << "      \"time_unit\": \"ns\"";
+
+        if (r.bytesPerSecond > 0) {
+            out << ",\n      \"bytes_per_second\": " << formatNumber(r.bytesPerSecond);
+        }
+
+        if (r.itemsPerSecond > 0) {
+            out << ",\n      \"items_per_second\": " << formatNumber(r.itemsPerSecond);
+        }
+
+        if (!r.label.empty()) {
+            out << ",\n      \"label\": \"" << escape(r.label) << "\"";
+        }
+
+        out << "\n    }";
+    }
+
+    out << "\n  ]\n}\n";
+    return out.good();
+}
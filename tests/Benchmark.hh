@@ -0,0 +1,171 @@
+/*
+ *  Benchmark.hh - Minimal microbenchmark harness
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _BENCHMARK_HH
+#define _BENCHMARK_HH
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+#define BENCHMARK_MIN_TIME 0.5              //!< Seconds each benchmark runs at least by default
+#define BENCHMARK_MAX_ITERATIONS 1000000000 //!< Iterations limit of a single run
+
+/*! Timing state handed to each benchmark. The measured section is the loop while keepRunning() holds,
+    any setup before it or after it is not timed. The harness calls the benchmark with a growing number
+    of iterations until a run lasts the minimum time.
+*/
+class BenchmarkState {
+
+public:
+    BenchmarkState(uint64_t iterations);
+
+    /**
+     * Starts the timers the first time it is called and stops them once all the iterations are done
+     * @return true while there are iterations left
+     */
+    bool keepRunning()
+    {
+        if (left == iterations) {
+            start();
+        }
+
+        if (left == 0) {
+            stop();
+            return false;
+        }
+
+        left--;
+        return true;
+    };
+
+    /**
+     * Stops the timers, i.e. to prepare the input of the next iterations
+     */
+    void pauseTiming();
+
+    /**
+     * Starts again the timers stopped by pauseTiming
+     */
+    void resumeTiming();
+
+    /**
+     * @param items items processed by all the iterations, reported as items per second
+     */
+    void setItemsProcessed(uint64_t items) {itemsProcessed = items;};
+
+    /**
+     * @param bytes bytes processed by all the iterations, reported as bytes per second
+     */
+    void setBytesProcessed(uint64_t bytes) {bytesProcessed = bytes;};
+
+    /**
+     * @param text free text shown along with the results
+     */
+    void setLabel(std::string text) {label = text;};
+
+    uint64_t getIterations() const {return iterations;};
+    uint64_t getItemsProcessed() const {return itemsProcessed;};
+    uint64_t getBytesProcessed() const {return bytesProcessed;};
+    std::string getLabel() const {return label;};
+
+    /**
+     * @return wall clock time measured, in seconds
+     */
+    double getRealTime() const {return realTime.count();};
+
+    /**
+     * @return CPU time of the whole process measured, in seconds
+     */
+    double getCpuTime() const {return cpuTime.count();};
+
+private:
+    void start();
+    void stop();
+
+    uint64_t iterations;
+    uint64_t left;
+    uint64_t itemsProcessed;
+    uint64_t bytesProcessed;
+    std::string label;
+    bool running;
+
+    std::chrono::steady_clock::time_point realStart;
+    std::chrono::duration<double> cpuStart;
+    std::chrono::duration<double> realTime;
+    std::chrono::duration<double> cpuTime;
+};
+
+typedef std::function<void(BenchmarkState&)> BenchmarkFunction;
+
+/*! Registry of the benchmarks of a program. It runs them in registration order and writes the results
+    to the console and, optionally, to a JSON file following the Google Benchmark output format, so runs
+    can be compared with its tools.
+*/
+class Benchmarks {
+
+public:
+    /**
+     * Gets the Benchmarks instance, it is created the first time it is requested
+     * @return the program benchmarks
+     */
+    static Benchmarks* getInstance();
+
+    /**
+     * @param name unique name, components are separated with slashes, i.e. AudioMixer/mix/4
+     * @param function benchmark body
+     * @return true, so registration can initialize a static variable
+     */
+    bool add(std::string name, BenchmarkFunction function);
+
+    /**
+     * Runs the benchmarks. Accepted arguments are --filter=<substring>, --min_time=<seconds> and
+     * --json=<file>
+     * @return process exit status
+     */
+    int run(int argc, char* argv[]);
+
+private:
+    struct Result {
+        std::string name;
+        uint64_t iterations;
+        double realTime;
+        double cpuTime;
+        double bytesPerSecond;
+        double itemsPerSecond;
+        std::string label;
+    };
+
+    Benchmarks() {};
+
+    Result runOne(std::string name, BenchmarkFunction &function, double minTime);
+    bool writeJson(std::string file, const std::vector<Result> &results);
+
+    std::vector<std::pair<std::string, BenchmarkFunction>> benchmarks;
+};
+
+#define REGISTER_BENCHMARK(name, function) \
+    static bool function##Registered __attribute__((unused)) = Benchmarks::getInstance()->add(name, function)
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ *  LoadMeasureSink.cpp - Receiver side measurement of load test streams
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <chrono>
+#include <GroupsockHelper.hh>
+
+#include "LoadMeasureSink.hh"
+#include "../src/Utils.hh"
+
+static uint64_t systemTime()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+///////////////////////////
+// LOAD STREAM STATS     //
+///////////////////////////
+
+LoadStreamStats::LoadStreamStats() : playing(false), failed(false)
+{
+    reset();
+}
+
+void LoadStreamStats::reset()
+{
+    bytes = 0;
+    nals = 0;
+    stamps = 0;
+    lostStamps = 0;
+    latencySum = 0;
+    latencyMax = 0;
+    rtpExpected = 0;
+    rtpReceived = 0;
+
+    for (size_t i = 0; i < LOAD_LATENCY_BUCKETS; i++) {
+        latencyHist[i] = 0;
+    }
+}
+
+void LoadStreamStats::addLatency(int64_t latency)
+{
+    size_t bucket = 0;
+    uint64_t us = latency > 0 ? latency : 0;
+
+    while ((us >> bucket) > 0 && bucket < LOAD_LATENCY_BUCKETS - 1) {
+        bucket++;
+    }
+
+    stamps.fetch_add(1, std::memory_order_relaxed);
+    latencySum.fetch_add(us, std::memory_order_relaxed);
+    latencyHist[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    //NOTE: only the receiving event loop writes it
+    if (us > latencyMax.load(std::memory_order_relaxed)) {
+        latencyMax.store(us, std::memory_order_relaxed);
+    }
+}
+
+///////////////////////////
+// LOAD MEASURE SINK     //
+///////////////////////////
+
+LoadMeasureSink* LoadMeasureSink::createNew(UsageEnvironment& env, LoadStreamStats &stats, RTPSource* rtpSource)
+{
+    return new LoadMeasureSink(env, stats, rtpSource);
+}
+
+LoadMeasureSink::LoadMeasureSink(UsageEnvironment& env, LoadStreamStats &stats_, RTPSource* rtpSource_) :
+    MediaSink(env), stats(stats_), rtpSource(rtpSource_), lastSeq(-1), lastRtpStats(0)
+{
+    buffer = new unsigned char[LOAD_RECEIVE_BUFFER];
+}
+
+LoadMeasureSink::~LoadMeasureSink()
+{
+    delete[] buffer;
+}
+
+Boolean LoadMeasureSink::continuePlaying()
+{
+    if (fSource == NULL) {
+        return False;
+    }
+
+    fSource->getNextFrame(buffer, LOAD_RECEIVE_BUFFER, afterGettingFrame, this, onSourceClosure, this);
+    return True;
+}
+
+void LoadMeasureSink::afterGettingFrame(void* clientData, unsigned frameSize, unsigned /*numTruncatedBytes*/,
+                                        struct timeval /*presentationTime*/, unsigned /*durationInMicroseconds*/)
+{
+    ((LoadMeasureSink*) clientData)->afterGettingFrame(frameSize);
+}
+
+void LoadMeasureSink::afterGettingFrame(unsigned frameSize)
+{
+    uint64_t now = systemTime();
+    LoadStamp stamp;
+
+    stats.bytes.fetch_add(frameSize, std::memory_order_relaxed);
+    stats.nals.fetch_add(1, std::memory_order_relaxed);
+
+    if (stamp.parse(buffer, frameSize)) {
+        stats.addLatency((int64_t) (now - stamp.time));
+
+        if (lastSeq >= 0 && stamp.seq > lastSeq + 1) {
+            stats.lostStamps.fetch_add(stamp.seq - lastSeq - 1, std::memory_order_relaxed);
+        }
+        lastSeq = stamp.seq;
+    }
+
+    if (now - lastRtpStats >= LOAD_RTP_STATS_INTERVAL) {
+        updateRtpStats();
+        lastRtpStats = now;
+    }
+
+    continuePlaying();
+}
+
+void LoadMeasureSink::updateRtpStats()
+{
+    RTPReceptionStatsDB::Iterator statsIter(rtpSource->receptionStatsDB());
+    RTPReceptionStats* rtpStats;
+    uint64_t expected = 0;
+    uint64_t received = 0;
+
+    while ((rtpStats = statsIter.next(True)) != NULL) {
+        expected += rtpStats->totNumPacketsExpected();
+        received += rtpStats->totNumPacketsReceived();
+    }
+
+    stats.rtpExpected.store(expected, std::memory_order_relaxed);
+    stats.rtpReceived.store(received, std::memory_order_relaxed);
+}
+
+///////////////////////////
+// LOAD CLIENT           //
+///////////////////////////
+
+LoadClient* LoadClient::createNew(UsageEnvironment& env, std::string url, LoadStreamStats &stats)
+{
+    return new LoadClient(env, url, stats);
+}
+
+LoadClient::LoadClient(UsageEnvironment& env, std::string url, LoadStreamStats &stats_) :
+    RTSPClient(env, url.c_str(), 0, "loadGenerator", 0, -1), stats(stats_), session(NULL), iter(NULL), subsession(NULL)
+{
+}
+
+LoadClient::~LoadClient()
+{
+    delete iter;
+    if (session) {
+        Medium::close(session);
+    }
+}
+
+void LoadClient::start()
+{
+    sendDescribeCommand(continueAfterDESCRIBE);
+}
+
+void LoadClient::fail(std::string error)
+{
+    utils::errorMsg("[LoadClient] " + std::string(url()) + ": " + error);
+    stats.failed = true;
+}
+
+void LoadClient::continueAfterDESCRIBE(RTSPClient* rtspClient, int resultCode, char* resultString)
+{
+    LoadClient* client = (LoadClient*) rtspClient;
+
+    if (resultCode != 0) {
+        client->fail("DESCRIBE failed, " + std::string(resultString ? resultString : ""));
+        delete[] resultString;
+        return;
+    }
+
+    client->session = MediaSession::createNew(client->envir(), resultString);
+    delete[] resultString;
+
+    if (!client->session || !client->session->hasSubsessions()) {
+        client->fail("the description has no subsessions");
+        return;
+    }
+
+    client->iter = new MediaSubsessionIterator(*client->session);
+    client->setupNextSubsession();
+}
+
+void LoadClient::setupNextSubsession()
+{
+    while ((subsession = iter->next()) != NULL) {
+        if (strcmp(subsession->mediumName(), "video") != 0 || !subsession->initiate()) {
+            continue;
+        }
+
+        increaseReceiveBufferTo(envir(), subsession->rtpSource()->RTPgs()->socketNum(), LOAD_RECEIVE_BUFFER);
+        sendSetupCommand(*subsession, continueAfterSETUP, False, False);
+        return;
+    }
+
+    sendPlayCommand(*session, continueAfterPLAY);
+}
+
+void LoadClient::continueAfterSETUP(RTSPClient* rtspClient, int resultCode, char* resultString)
+{
+    LoadClient* client = (LoadClient*) rtspClient;
+    MediaSubsession* subsession = client->subsession;
+
+    delete[] resultString;
+
+    if (resultCode != 0) {
+        client->fail("SETUP failed");
+    } else {
+        subsession->sink = LoadMeasureSink::createNew(client->envir(), client->stats, subsession->rtpSource());
+        subsession->sink->startPlaying(*subsession->readSource(), subsessionAfterPlaying, subsession);
+    }
+
+    client->setupNextSubsession();
+}
+
+void LoadClient::continueAfterPLAY(RTSPClient* rtspClient, int resultCode, char* resultString)
+{
+    LoadClient* client = (LoadClient*) rtspClient;
+
+    delete[] resultString;
+
+    if (resultCode != 0) {
+        client->fail("PLAY failed");
+        return;
+    }
+
+    client->stats.playing = true;
+}
+
+void LoadClient::subsessionAfterPlaying(void* clientData)
+{
+    MediaSubsession* subsession = (MediaSubsession*) clientData;
+
+    Medium::close(subsession->sink);
+    subsession->sink = NULL;
+}
@@ -0,0 +1,116 @@
+/*
+ *  LoadMeasureSink.hh - Receiver side measurement of load test streams
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _LOAD_MEASURE_SINK_HH
+#define _LOAD_MEASURE_SINK_HH
+
+#include <liveMedia.hh>
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+#include "LoadStreamSource.hh"
+
+#define LOAD_LATENCY_BUCKETS 32         //!< Log2 latency histogram buckets, the last one covers latencies above 2^30 usec
+#define LOAD_RECEIVE_BUFFER 2000000     //!< Largest NAL unit received
+#define LOAD_RTP_STATS_INTERVAL 1000000 //!< Time in usec between updates of the RTP reception counters
+
+/*! Measurements of a received stream. They are updated by the event loop receiving it and read
+    by the reporting thread, so all of them are relaxed atomics.
+*/
+struct LoadStreamStats {
+    LoadStreamStats();
+
+    void addLatency(int64_t latency);
+    void reset();
+
+    std::atomic<bool> playing;
+    std::atomic<bool> failed;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> nals;
+    std::atomic<uint64_t> stamps;
+    std::atomic<uint64_t> lostStamps;
+    std::atomic<uint64_t> latencySum;
+    std::atomic<uint64_t> latencyMax;
+    std::atomic<uint64_t> latencyHist[LOAD_LATENCY_BUCKETS];
+    std::atomic<uint64_t> rtpExpected;
+    std::atomic<uint64_t> rtpReceived;
+};
+
+/*! Sink of a received load test stream: accounts its bytes and NAL units, the latency of its
+    LoadStamp SEIs against the system clock, the stamps lost or dropped on the way (gaps in their
+    sequence numbers) and the RTP packets expected and received.
+*/
+class LoadMeasureSink : public MediaSink {
+
+public:
+    static LoadMeasureSink* createNew(UsageEnvironment& env, LoadStreamStats &stats, RTPSource* rtpSource);
+
+protected:
+    LoadMeasureSink(UsageEnvironment& env, LoadStreamStats &stats, RTPSource* rtpSource);
+    virtual ~LoadMeasureSink();
+
+private:
+    virtual Boolean continuePlaying();
+
+    static void afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
+                                  struct timeval presentationTime, unsigned durationInMicroseconds);
+    void afterGettingFrame(unsigned frameSize);
+    void updateRtpStats();
+
+    LoadStreamStats &stats;
+    RTPSource* rtpSource;
+    unsigned char* buffer;
+    int64_t lastSeq;
+    uint64_t lastRtpStats;
+};
+
+/*! RTSP client playing a load test stream into a LoadMeasureSink */
+class LoadClient : public RTSPClient {
+
+public:
+    static LoadClient* createNew(UsageEnvironment& env, std::string url, LoadStreamStats &stats);
+
+    /**
+    * Sends the DESCRIBE request, the setup of the subsessions and the PLAY follow it
+    */
+    void start();
+
+protected:
+    LoadClient(UsageEnvironment& env, std::string url, LoadStreamStats &stats);
+    virtual ~LoadClient();
+
+private:
+    static void continueAfterDESCRIBE(RTSPClient* client, int resultCode, char* resultString);
+    static void continueAfterSETUP(RTSPClient* client, int resultCode, char* resultString);
+    static void continueAfterPLAY(RTSPClient* client, int resultCode, char* resultString);
+    static void subsessionAfterPlaying(void* clientData);
+    void setupNextSubsession();
+    void fail(std::string error);
+
+    LoadStreamStats &stats;
+    MediaSession* session;
+    MediaSubsessionIterator* iter;
+    MediaSubsession* subsession;
+};
+
+#endif
@@ -0,0 +1,403 @@
+/*
+ *  LoadStreamSource.cpp - Looped H264 source with impairments for load tests
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <sys/time.h>
+
+#include "LoadStreamSource.hh"
+#include "../src/Utils.hh"
+
+#define H264_SEI 6
+#define H264_SPS 7
+#define H264_PPS 8
+#define H264_AUD 9
+#define H264_FILLER 12
+#define SEI_USER_DATA_UNREGISTERED 5
+#define FILLER_OVERHEAD 2               //!< NAL header and trailing bits of a filler data NAL unit
+
+static const unsigned char stampUUID[16] = {'l', 'i', 'v', 'e', 'M', 'e', 'd', 'i',
+                                            'a', 'L', 'o', 'a', 'd', 'G', 'e', 'n'};
+
+static bool isSlice(unsigned char type)
+{
+    return type == 1 || type == 5;
+}
+
+static void putUint(unsigned char* to, uint64_t value, unsigned bytes)
+{
+    for (unsigned i = 0; i < bytes; i++) {
+        to[i] = value >> (8*(bytes - 1 - i));
+    }
+}
+
+static uint64_t getUint(unsigned char const* from, unsigned bytes)
+{
+    uint64_t value = 0;
+
+    for (unsigned i = 0; i < bytes; i++) {
+        value = (value << 8) | from[i];
+    }
+
+    return value;
+}
+
+///////////////////////////
+// LOAD STAMP            //
+///////////////////////////
+
+unsigned LoadStamp::write(unsigned char* to) const
+{
+    unsigned char rbsp[LOAD_STAMP_PAYLOAD + 3];
+    unsigned size = 1;
+    unsigned zeros = 0;
+
+    rbsp[0] = SEI_USER_DATA_UNREGISTERED;
+    rbsp[1] = LOAD_STAMP_PAYLOAD;
+    memcpy(rbsp + 2, stampUUID, sizeof(stampUUID));
+    putUint(rbsp + 18, time, 8);
+    putUint(rbsp + 26, stream, 4);
+    putUint(rbsp + 30, seq, 4);
+    rbsp[LOAD_STAMP_PAYLOAD + 2] = 0x80;
+
+    //NOTE: the times and counters may contain start code prefixes, they are escaped
+    to[0] = H264_SEI;
+    for (unsigned i = 0; i < sizeof(rbsp); i++) {
+        if (zeros == 2 && rbsp[i] <= 3) {
+            to[size++] = 3;
+            zeros = 0;
+        }
+
+        to[size++] = rbsp[i];
+        zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+    }
+
+    return size;
+}
+
+bool LoadStamp::parse(unsigned char const* nal, unsigned size)
+{
+    unsigned char rbsp[LOAD_STAMP_PAYLOAD + 3];
+    unsigned length = 0;
+    unsigned zeros = 0;
+
+    if (size < sizeof(rbsp) + 1 || (nal[0] & 0x1F) != H264_SEI || size > LOAD_STAMP_MAX_SIZE) {
+        return false;
+    }
+
+    for (unsigned i = 1; i < size && length < sizeof(rbsp); i++) {
+        if (zeros == 2 && nal[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+
+        rbsp[length++] = nal[i];
+        zeros = nal[i] == 0 ? zeros + 1 : 0;
+    }
+
+    if (length < sizeof(rbsp) || rbsp[0] != SEI_USER_DATA_UNREGISTERED || rbsp[1] != LOAD_STAMP_PAYLOAD ||
+        memcmp(rbsp + 2, stampUUID, sizeof(stampUUID)) != 0) {
+        return false;
+    }
+
+    time = getUint(rbsp + 18, 8);
+    stream = getUint(rbsp + 26, 4);
+    seq = getUint(rbsp + 30, 4);
+    return true;
+}
+
+///////////////////////////
+// LOAD CLIP             //
+///////////////////////////
+
+LoadClip* LoadClip::createNew(std::string file)
+{
+    LoadClip* clip = new LoadClip();
+
+    if (!clip->load(file)) {
+        delete clip;
+        return NULL;
+    }
+
+    return clip;
+}
+
+bool LoadClip::load(std::string file)
+{
+    std::ifstream in(file.c_str(), std::ios::in | std::ios::binary);
+    std::vector<NalSpan> accessUnit;
+    bool hasSlice = false;
+    NalSpan nal;
+
+    if (!in.is_open()) {
+        utils::errorMsg("[LoadClip] Could not open " + file);
+        return false;
+    }
+
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (data.empty()) {
+        utils::errorMsg("[LoadClip] " + file + " is empty");
+        return false;
+    }
+
+    NalSplitter splitter(data.data(), data.size());
+
+    //NOTE: an access unit ends before the next non VCL NAL unit or the next slice with first_mb_in_slice 0
+    while (splitter.next(nal)) {
+        if (nal.size == 0 || (nal.data[0] & 0x1F) == H264_AUD) {
+            continue;
+        }
+
+        unsigned char type = nal.data[0] & 0x1F;
+
+        if (hasSlice && (!isSlice(type) || (nal.size > 1 && (nal.data[1] & 0x80)))) {
+            accessUnits.push_back(accessUnit);
+            accessUnit.clear();
+            hasSlice = false;
+        }
+
+        if (type == H264_SPS && !sps.data) {
+            sps = nal;
+        } else if (type == H264_PPS && !pps.data) {
+            pps = nal;
+        }
+
+        accessUnit.push_back(nal);
+        hasSlice |= isSlice(type);
+    }
+
+    if (hasSlice) {
+        accessUnits.push_back(accessUnit);
+    }
+
+    if (accessUnits.empty() || !sps.data || !pps.data) {
+        utils::errorMsg("[LoadClip] " + file + " is not an H264 Annex B stream with SPS, PPS and slices");
+        return false;
+    }
+
+    return true;
+}
+
+unsigned LoadClip::getBitrate(unsigned fps) const
+{
+    uint64_t bytes = 0;
+
+    for (auto &au : accessUnits) {
+        for (auto &nal : au) {
+            bytes += nal.size;
+        }
+    }
+
+    return bytes*8*fps/accessUnits.size()/1000;
+}
+
+///////////////////////////
+// LOAD STREAM SOURCE    //
+///////////////////////////
+
+LoadStreamSource* LoadStreamSource::createNew(UsageEnvironment& env, const LoadClip* clip,
+                                              LoadImpairments impairments, unsigned streamId)
+{
+    return new LoadStreamSource(env, clip, impairments, streamId);
+}
+
+LoadStreamSource::LoadStreamSource(UsageEnvironment& env, const LoadClip* clip_,
+                                   LoadImpairments impairments_, unsigned streamId_) :
+    FramedSource(env), clip(clip_), impairments(impairments_), streamId(streamId_),
+    period(std::chrono::microseconds(1000000/std::max(impairments_.fps, 1U))), auIndex(0), nalIndex(0),
+    filler(0), seq(0), due(false), stamped(false), start(std::chrono::steady_clock::now()),
+    generator(streamId_), lossDistribution(0, 1), jitterDistribution(0, impairments_.jitter), dueTask(NULL)
+{
+    gettimeofday(&startTime, NULL);
+    filler = fillerSize();
+}
+
+LoadStreamSource::~LoadStreamSource()
+{
+    envir().taskScheduler().unscheduleDelayedTask(dueTask);
+}
+
+void LoadStreamSource::doGetNextFrame()
+{
+    if (!due) {
+        scheduleAccessUnit();
+        return;
+    }
+
+    deliverNal();
+}
+
+void LoadStreamSource::doStopGettingFrames()
+{
+    envir().taskScheduler().unscheduleDelayedTask(dueTask);
+    FramedSource::doStopGettingFrames();
+}
+
+void LoadStreamSource::accessUnitDue(void* clientData)
+{
+    LoadStreamSource* source = (LoadStreamSource*) clientData;
+
+    source->dueTask = NULL;
+    source->due = true;
+    source->deliverNal();
+}
+
+void LoadStreamSource::scheduleAccessUnit()
+{
+    std::chrono::steady_clock::time_point time = start + period*seq;
+    int64_t delay = std::chrono::duration_cast<std::chrono::microseconds>(time - std::chrono::steady_clock::now()).count();
+
+    //NOTE: the jitter delays the delivery only, the next access unit is still due at its nominal time
+    if (impairments.jitter > 0) {
+        delay += jitterDistribution(generator);
+    }
+
+    dueTask = envir().taskScheduler().scheduleDelayedTask(std::max(delay, (int64_t) 0), accessUnitDue, this);
+}
+
+bool LoadStreamSource::lost()
+{
+    return impairments.loss > 0 && lossDistribution(generator) < impairments.loss;
+}
+
+void LoadStreamSource::deliverNal()
+{
+    const std::vector<NalSpan> &au = clip->getAccessUnits()[auIndex];
+    unsigned char stamp[LOAD_STAMP_MAX_SIZE];
+    LoadStamp s;
+
+    if (!stamped) {
+        stamped = true;
+        s.time = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+        s.stream = streamId;
+        s.seq = seq;
+
+        if (!lost()) {
+            deliver(stamp, s.write(stamp));
+            return;
+        }
+    }
+
+    while (nalIndex < au.size()) {
+        const NalSpan &nal = au[nalIndex++];
+
+        if (!lost()) {
+            deliver(nal.data, nal.size);
+            return;
+        }
+    }
+
+    if (filler > 0) {
+        unsigned size = std::min(filler, fMaxSize);
+
+        fTo[0] = H264_FILLER;
+        memset(fTo + 1, 0xFF, size - FILLER_OVERHEAD);
+        fTo[size - 1] = 0x80;
+        filler = 0;
+
+        deliver(NULL, size);
+        return;
+    }
+
+    nextAccessUnit();
+    scheduleAccessUnit();
+}
+
+void LoadStreamSource::nextAccessUnit()
+{
+    auIndex = (auIndex + 1) % clip->getAccessUnits().size();
+    nalIndex = 0;
+    seq++;
+    due = false;
+    stamped = false;
+    filler = fillerSize();
+}
+
+unsigned LoadStreamSource::fillerSize()
+{
+    unsigned target = impairments.bitrate*1000/8/std::max(impairments.fps, 1U);
+    unsigned bytes = LOAD_STAMP_MAX_SIZE;
+
+    for (auto &nal : clip->getAccessUnits()[auIndex]) {
+        bytes += nal.size;
+    }
+
+    //NOTE: clips above the target bitrate are sent as they are
+    return target > bytes + FILLER_OVERHEAD ? target - bytes : 0;
+}
+
+void LoadStreamSource::deliver(unsigned char const* nal, unsigned size)
+{
+    uint64_t pts = startTime.tv_usec + (uint64_t) period.count()*seq;
+
+    if (size > fMaxSize) {
+        fNumTruncatedBytes = size - fMaxSize;
+        size = fMaxSize;
+    } else {
+        fNumTruncatedBytes = 0;
+    }
+
+    if (nal) {
+        memcpy(fTo, nal, size);
+    }
+
+    fFrameSize = size;
+    fPresentationTime.tv_sec = startTime.tv_sec + pts/1000000;
+    fPresentationTime.tv_usec = pts % 1000000;
+    fDurationInMicroseconds = 0;
+
+    FramedSource::afterGetting(this);
+}
+
+///////////////////////////////////
+// LOAD SERVER MEDIA SUBSESSION  //
+///////////////////////////////////
+
+LoadServerMediaSubsession* LoadServerMediaSubsession::createNew(UsageEnvironment& env, const LoadClip* clip,
+                                                                LoadImpairments impairments, unsigned streamId)
+{
+    return new LoadServerMediaSubsession(env, clip, impairments, streamId);
+}
+
+LoadServerMediaSubsession::LoadServerMediaSubsession(UsageEnvironment& env, const LoadClip* clip_,
+                                                     LoadImpairments impairments_, unsigned streamId_) :
+    OnDemandServerMediaSubsession(env, False), clip(clip_), impairments(impairments_), streamId(streamId_)
+{
+}
+
+FramedSource* LoadServerMediaSubsession::createNewStreamSource(unsigned /*clientSessionId*/, unsigned& estBitrate)
+{
+    estBitrate = std::max(impairments.bitrate, clip->getBitrate(impairments.fps));
+
+    return H264VideoStreamDiscreteFramer::createNew(envir(),
+                LoadStreamSource::createNew(envir(), clip, impairments, streamId));
+}
+
+RTPSink* LoadServerMediaSubsession::createNewRTPSink(Groupsock* rtpGroupsock, unsigned char rtpPayloadTypeIfDynamic,
+                                                     FramedSource* /*inputSource*/)
+{
+    return H264VideoRTPSink::createNew(envir(), rtpGroupsock, rtpPayloadTypeIfDynamic,
+                                       clip->getSPS(), clip->getSPSSize(),
+                                       clip->getPPS(), clip->getPPSSize());
+}
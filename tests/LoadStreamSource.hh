@@ -0,0 +1,174 @@
+/*
+ *  LoadStreamSource.hh - Looped H264 source with impairments for load tests
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#ifndef _LOAD_STREAM_SOURCE_HH
+#define _LOAD_STREAM_SOURCE_HH
+
+#include <liveMedia.hh>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <stdint.h>
+
+#include "../src/NalSplitter.hh"
+
+#define LOAD_STAMP_PAYLOAD 32       //!< UUID, send time, stream and sequence number of a stamp SEI
+#define LOAD_STAMP_MAX_SIZE 64      //!< Stamp SEI NAL unit size including emulation prevention bytes
+
+/*! Send time of an access unit, carried in a user data unregistered SEI NAL unit sent before it.
+    The time is the system clock in usec, so latencies are measured when the generator and the
+    measurement sink run on the same box or on synchronised ones.
+*/
+struct LoadStamp {
+    uint64_t time;
+    uint32_t stream;
+    uint32_t seq;
+
+    /**
+    * Writes the stamp SEI NAL unit, without start code
+    * @param to destination buffer of at least LOAD_STAMP_MAX_SIZE bytes
+    * @return NAL unit size
+    */
+    unsigned write(unsigned char* to) const;
+
+    /**
+    * Parses a stamp SEI NAL unit
+    * @param nal NAL unit, without start code
+    * @param size NAL unit size
+    * @return false if the NAL unit is not a stamp
+    */
+    bool parse(unsigned char const* nal, unsigned size);
+};
+
+/*! Impairments and rate of the generated streams */
+struct LoadImpairments {
+    LoadImpairments() : fps(25), bitrate(0), loss(0), jitter(0) {};
+
+    unsigned fps;                   //!< Access units per second
+    unsigned bitrate;               //!< Target kbps, reached with filler data NAL units, 0 sends the clip rate
+    double loss;                    //!< Probability of dropping each NAL unit, stamps included
+    unsigned jitter;                //!< Maximum random delay of each access unit in usec
+};
+
+/*! H264 Annex B file loaded in memory and split in access units. It is read only once loaded, so
+    the generated streams of all the event loops share it.
+*/
+class LoadClip {
+
+public:
+    /**
+    * Loads a clip
+    * @param file H264 Annex B elementary stream
+    * @return NULL if it cannot be read or it has no SPS, PPS or slices
+    */
+    static LoadClip* createNew(std::string file);
+
+    const std::vector<std::vector<NalSpan>>& getAccessUnits() const {return accessUnits;};
+    unsigned char const* getSPS() const {return sps.data;};
+    unsigned getSPSSize() const {return sps.size;};
+    unsigned char const* getPPS() const {return pps.data;};
+    unsigned getPPSSize() const {return pps.size;};
+
+    /**
+    * @param fps access units per second
+    * @return bitrate of the clip in kbps
+    */
+    unsigned getBitrate(unsigned fps) const;
+
+private:
+    LoadClip() : sps(), pps() {};
+    bool load(std::string file);
+
+    std::vector<unsigned char> data;
+    std::vector<std::vector<NalSpan>> accessUnits;
+    NalSpan sps;
+    NalSpan pps;
+};
+
+/*! Discrete NAL unit source looping a LoadClip at a constant access unit rate. Each access unit
+    is preceded by a LoadStamp SEI and followed by a filler data NAL unit up to the target bitrate.
+    NAL units are dropped and access units delayed as configured, the presentation times keep the
+    nominal rate, so the impairments show as loss and jitter at the receiver.
+*/
+class LoadStreamSource : public FramedSource {
+
+public:
+    static LoadStreamSource* createNew(UsageEnvironment& env, const LoadClip* clip,
+                                       LoadImpairments impairments, unsigned streamId);
+
+protected:
+    LoadStreamSource(UsageEnvironment& env, const LoadClip* clip, LoadImpairments impairments, unsigned streamId);
+    virtual ~LoadStreamSource();
+
+private:
+    virtual void doGetNextFrame();
+    virtual void doStopGettingFrames();
+
+    static void accessUnitDue(void* clientData);
+    void scheduleAccessUnit();
+    void deliverNal();
+    void nextAccessUnit();
+    unsigned fillerSize();
+    void deliver(unsigned char const* nal, unsigned size);
+    bool lost();
+
+    const LoadClip* clip;
+    const LoadImpairments impairments;
+    const unsigned streamId;
+    const std::chrono::microseconds period;
+    unsigned auIndex;
+    unsigned nalIndex;
+    unsigned filler;
+    uint32_t seq;
+    bool due;
+    bool stamped;
+    std::chrono::steady_clock::time_point start;
+    struct timeval startTime;
+    std::default_random_engine generator;
+    std::uniform_real_distribution<double> lossDistribution;
+    std::uniform_int_distribution<unsigned> jitterDistribution;
+    TaskToken dueTask;
+};
+
+/*! On demand subsession of a LoadStreamSource, each client gets its own stream */
+class LoadServerMediaSubsession : public OnDemandServerMediaSubsession {
+
+public:
+    static LoadServerMediaSubsession* createNew(UsageEnvironment& env, const LoadClip* clip,
+                                                LoadImpairments impairments, unsigned streamId);
+
+protected:
+    LoadServerMediaSubsession(UsageEnvironment& env, const LoadClip* clip,
+                              LoadImpairments impairments, unsigned streamId);
+
+    virtual FramedSource* createNewStreamSource(unsigned clientSessionId, unsigned& estBitrate);
+    virtual RTPSink* createNewRTPSink(Groupsock* rtpGroupsock, unsigned char rtpPayloadTypeIfDynamic,
+                                      FramedSource* inputSource);
+
+private:
+    const LoadClip* clip;
+    const LoadImpairments impairments;
+    const unsigned streamId;
+};
+
+#endif
@@ -0,0 +1,408 @@
+/*
+ *  coreBenchmark.cpp - Microbenchmarks of the core data structures and kernels
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <atomic>
+#include <thread>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+
+#include "Benchmark.hh"
+#include "../src/AVFramedQueue.hh"
+#include "../src/AudioCircularBuffer.hh"
+#include "../src/SlicedVideoFrameQueue.hh"
+#include "../src/WorkersPool.hh"
+#include "../src/Clock.hh"
+#include "../src/NalSplitter.hh"
+#include "../src/Jzon.h"
+#include "../src/modules/audioMixer/AudioMixer.hh"
+#include "../src/modules/videoMixer/VideoMixer.hh"
+
+#define MIXER_CHANNELS 4
+#define SCAN_BUFFER_SIZE 1024*1024   //!< Bytes of the start code scanning input
+#define SCAN_NAL_SIZE 1400           //!< Bytes between start codes, one NAL per RTP packet
+#define SCHEDULE_RUNNABLES 8         //!< Periodic runnables of the simulated schedule
+
+//NOTE: mixers are driven through their processing method, as their connected readers would do
+
+class AudioMixerBench : public AudioMixer {
+
+public:
+    AudioMixerBench(int channels) : AudioMixer(channels) {};
+    using AudioMixer::doProcessFrame;
+    using AudioMixer::specificReaderConfig;
+};
+
+class VideoMixerBench : public VideoMixer {
+
+public:
+    VideoMixerBench(int channels, int width, int height) :
+    VideoMixer(channels, width, height, std::chrono::microseconds(0)) {};
+    using VideoMixer::doProcessFrame;
+    using VideoMixer::specificReaderConfig;
+    using VideoMixer::configChannel0;
+};
+
+class PeriodicRunnable : public Runnable {
+
+public:
+    PeriodicRunnable(int period_) : Runnable(true), period(period_) {};
+
+protected:
+    void processFrame(int& ret, std::vector<int> &/*enabledJobs*/)
+    {
+        ret = period;
+    };
+
+    bool pendingJobs() {return false;};
+
+private:
+    int period;
+};
+
+class DispatchRunnable : public Runnable {
+
+public:
+    DispatchRunnable() : Runnable(false), runs(0), target(0) {setId(1);};
+
+    std::atomic<uint64_t> runs;
+    std::atomic<uint64_t> target;
+
+    bool pendingJobs() {return runs.load() < target.load();};
+
+protected:
+    void processFrame(int& ret, std::vector<int> &/*enabledJobs*/)
+    {
+        ret = 0;
+        runs++;
+    };
+};
+
+static void avFramedQueueAddRemove(BenchmarkState &state)
+{
+    ConnectionData cData;
+    ReaderData reader;
+    StreamInfo si(VIDEO);
+    VideoFrameQueue *queue;
+    Frame *frame;
+
+    si.video.codec = H264;
+    cData.readers.push_back(reader);
+    queue = VideoFrameQueue::createNew(cData, &si, DEFAULT_VIDEO_FRAMES);
+
+    while (state.keepRunning()) {
+        frame = queue->getRear();
+        frame->setLength(SCAN_NAL_SIZE);
+        queue->addFrame();
+
+        frame = queue->getFront();
+        queue->removeFrame();
+    }
+
+    state.setItemsProcessed(state.getIterations());
+    delete queue;
+}
+REGISTER_BENCHMARK("AVFramedQueue/addRemove", avFramedQueueAddRemove);
+
+static void audioCircularBufferPushPop(BenchmarkState &state)
+{
+    ConnectionData cData;
+    ReaderData reader;
+    AudioCircularBuffer *buffer;
+    AudioFrame *aFrame;
+    std::chrono::microseconds ts(0);
+    unsigned samples = AudioFrame::getDefaultSamples(DEFAULT_SAMPLE_RATE);
+
+    cData.readers.push_back(reader);
+    buffer = AudioCircularBuffer::createNew(cData, DEFAULT_CHANNELS, DEFAULT_SAMPLE_RATE,
+                                            AudioFrame::getMaxSamples(DEFAULT_SAMPLE_RATE)*4, FLTP);
+    buffer->setOutputFrameSamples(samples);
+
+    while (state.keepRunning()) {
+        aFrame = dynamic_cast<AudioFrame*>(buffer->getRear());
+        aFrame->setSamples(samples);
+        aFrame->setLength(samples*sizeof(float));
+        aFrame->setPresentationTime(ts);
+        buffer->addFrame();
+
+        if (buffer->getFront()) {
+            buffer->removeFrame();
+        }
+
+        ts += std::chrono::microseconds(samples*std::micro::den/DEFAULT_SAMPLE_RATE);
+    }
+
+    state.setBytesProcessed(state.getIterations()*samples*sizeof(float)*DEFAULT_CHANNELS);
+    delete buffer;
+}
+REGISTER_BENCHMARK("AudioCircularBuffer/pushPop", audioCircularBufferPushPop);
+
+static void audioMixerMix(BenchmarkState &state)
+{
+    ConnectionData cData;
+    AudioMixerBench mixer(MIXER_CHANNELS);
+    std::map<int, AudioCircularBuffer*> queues;
+    FrameMap orgFrames;
+    FrameMap dstFrames;
+    std::vector<int> newFrames;
+    std::chrono::microseconds ts(0);
+    PlanarAudioFrame *aFrame;
+    unsigned samples = mixer.getInputFrameSamples();
+
+    for (int id = 1; id <= MIXER_CHANNELS; id++) {
+        queues[id] = AudioCircularBuffer::createNew(cData, DEFAULT_CHANNELS, DEFAULT_SAMPLE_RATE,
+                                                    AudioFrame::getMaxSamples(DEFAULT_SAMPLE_RATE), FLTP);
+        mixer.specificReaderConfig(id, queues[id]);
+
+        aFrame = PlanarAudioFrame::createNew(DEFAULT_CHANNELS, DEFAULT_SAMPLE_RATE,
+                                             AudioFrame::getMaxSamples(DEFAULT_SAMPLE_RATE), PCM, FLTP);
+        for (int c = 0; c < DEFAULT_CHANNELS; c++) {
+            for (unsigned i = 0; i < samples; i++) {
+                AudioMixer::floatToBytes(aFrame->getPlanarDataBuf()[c] + i*sizeof(float),
+                                         0.25*sin(i*(id + 1)*0.01), FLTP);
+            }
+        }
+        aFrame->setSamples(samples);
+        aFrame->setLength(samples*sizeof(float));
+
+        orgFrames[id] = aFrame;
+        newFrames.push_back(id);
+    }
+
+    dstFrames[DEFAULT_ID] = PlanarAudioFrame::createNew(DEFAULT_CHANNELS, DEFAULT_SAMPLE_RATE,
+                                                        AudioFrame::getMaxSamples(DEFAULT_SAMPLE_RATE), PCM, FLTP);
+
+    //NOTE: each iteration pushes a frame per channel and, once over the mixing threshold, extracts a mixed one
+    while (state.keepRunning()) {
+        for (auto f : orgFrames) {
+            f.second->setPresentationTime(ts);
+        }
+
+        mixer.doProcessFrame(orgFrames, dstFrames, newFrames);
+        ts += std::chrono::microseconds(samples*std::micro::den/DEFAULT_SAMPLE_RATE);
+    }
+
+    state.setItemsProcessed(state.getIterations()*samples*MIXER_CHANNELS);
+    state.setLabel(std::to_string(MIXER_CHANNELS) + " channels");
+
+    for (auto f : orgFrames) {
+        delete f.second;
+        delete queues[f.first];
+    }
+    delete dstFrames[DEFAULT_ID];
+}
+REGISTER_BENCHMARK("AudioMixer/mix", audioMixerMix);
+
+static void videoMixerCompose(BenchmarkState &state)
+{
+    VideoMixerBench mixer(MIXER_CHANNELS, DEFAULT_WIDTH, DEFAULT_HEIGHT);
+    FrameMap orgFrames;
+    FrameMap dstFrames;
+    std::vector<int> newFrames;
+    InterleavedVideoFrame *vFrame;
+    std::chrono::microseconds ts(0);
+
+    for (int id = 1; id <= MIXER_CHANNELS; id++) {
+        mixer.specificReaderConfig(id, NULL);
+        mixer.configChannel0(id, 0.5, 0.5, 0.5*((id - 1) % 2), 0.5*((id - 1) / 2), id, true, 1.0);
+
+        vFrame = InterleavedVideoFrame::createNew(RAW, 1280, 720, RGB24);
+        memset(vFrame->getDataBuf(), id*40, vFrame->getMaxLength());
+        vFrame->setLength(vFrame->getMaxLength());
+
+        orgFrames[id] = vFrame;
+        newFrames.push_back(id);
+    }
+
+    dstFrames[DEFAULT_ID] = InterleavedVideoFrame::createNew(RAW, DEFAULT_WIDTH, DEFAULT_HEIGHT, RGB24);
+
+    //NOTE: all the channels are new each time, so every tile is scaled and pasted again
+    while (state.keepRunning()) {
+        for (auto f : orgFrames) {
+            f.second->setPresentationTime(ts);
+        }
+
+        mixer.doProcessFrame(orgFrames, dstFrames, newFrames);
+        ts += std::chrono::microseconds(40000);
+    }
+
+    state.setItemsProcessed(state.getIterations());
+    state.setLabel(std::to_string(MIXER_CHANNELS) + " 720p channels to 1080p");
+
+    for (auto f : orgFrames) {
+        delete f.second;
+    }
+    delete dstFrames[DEFAULT_ID];
+}
+REGISTER_BENCHMARK("VideoMixer/compose", videoMixerCompose);
+
+static void slicedVideoFrameQueueAddRemove(BenchmarkState &state)
+{
+    ConnectionData cData;
+    ReaderData reader;
+    StreamInfo si(VIDEO);
+    SlicedVideoFrameQueue *queue;
+    SlicedVideoFrame *sFrame;
+    unsigned char nal[SCAN_NAL_SIZE];
+    unsigned slices = 8;
+
+    si.video.codec = H264;
+    memset(nal, 0xAB, sizeof(nal));
+    cData.readers.push_back(reader);
+    queue = SlicedVideoFrameQueue::createNew(cData, &si, DEFAULT_VIDEO_FRAMES*slices, SCAN_NAL_SIZE);
+
+    //NOTE: each iteration is a coded picture of several slices, which are queued and read one by one
+    while (state.keepRunning()) {
+        sFrame = dynamic_cast<SlicedVideoFrame*>(queue->getRear());
+
+        for (unsigned i = 0; i < slices; i++) {
+            sFrame->setSlice(nal, sizeof(nal));
+        }
+
+        queue->addFrame();
+
+        while (queue->getFront()) {
+            queue->removeFrame();
+        }
+    }
+
+    state.setBytesProcessed(state.getIterations()*slices*sizeof(nal));
+    delete queue;
+}
+REGISTER_BENCHMARK("SlicedVideoFrameQueue/addRemove", slicedVideoFrameQueueAddRemove);
+
+static void workersPoolDispatch(BenchmarkState &state)
+{
+    WorkersPool pool(1);
+    DispatchRunnable runnable;
+    uint64_t done = 0;
+
+    runnable.target = state.getIterations();
+
+    //NOTE: the runnable is scheduled again while it has pending jobs, each iteration waits for one run
+    while (state.keepRunning()) {
+        if (done == 0) {
+            pool.addTask(&runnable);
+        }
+
+        done++;
+
+        while (runnable.runs.load() < done) {
+            std::this_thread::yield();
+        }
+    }
+
+    pool.removeTask(runnable.getId());
+    pool.stop();
+    state.setItemsProcessed(state.getIterations());
+}
+REGISTER_BENCHMARK("WorkersPool/dispatch", workersPoolDispatch);
+
+static void runnableSimulatedSchedule(BenchmarkState &state)
+{
+    SimulatedClock clock;
+    std::vector<PeriodicRunnable*> runnables;
+
+    Clock::install(&clock);
+
+    //NOTE: periods of 25, 30 and 50 fps streams, each run jumps the clock to the earliest runnable
+    for (unsigned i = 0; i < SCHEDULE_RUNNABLES; i++) {
+        runnables.push_back(new PeriodicRunnable(i % 3 == 0 ? 40000 : (i % 3 == 1 ? 33333 : 20000)));
+    }
+    std::make_heap(runnables.begin(), runnables.end(), RunnableLater());
+
+    while (state.keepRunning()) {
+        std::pop_heap(runnables.begin(), runnables.end(), RunnableLater());
+        runnables.back()->sleepUntilReady();
+        runnables.back()->runProcessFrame();
+        std::push_heap(runnables.begin(), runnables.end(), RunnableLater());
+    }
+
+    Clock::install(NULL);
+    for (auto r : runnables) {
+        delete r;
+    }
+    state.setItemsProcessed(state.getIterations());
+}
+REGISTER_BENCHMARK("Runnable/simulatedSchedule", runnableSimulatedSchedule);
+
+static void jzonEventParsing(BenchmarkState &state)
+{
+    std::string event = "{\"events\":[{\"action\":\"configChannel\",\"filterId\":4,\"delay\":0,"
+                        "\"params\":{\"id\":1,\"width\":0.5,\"height\":0.5,\"x\":0,\"y\":0,"
+                        "\"layer\":1,\"enabled\":true,\"opacity\":1.0}},"
+                        "{\"action\":\"changeChannelVolume\",\"filterId\":5,\"delay\":100,"
+                        "\"params\":{\"id\":2,\"volume\":0.8}}]}";
+
+    while (state.keepRunning()) {
+        Jzon::Object root;
+        Jzon::Parser parser(root);
+
+        parser.SetJson(event);
+        parser.Parse();
+    }
+
+    state.setBytesProcessed(state.getIterations()*event.size());
+}
+REGISTER_BENCHMARK("Jzon/eventParsing", jzonEventParsing);
+
+static void nalSplitterStartCodes(BenchmarkState &state)
+{
+    std::vector<unsigned char> buffer(SCAN_BUFFER_SIZE);
+    std::default_random_engine generator;
+    std::uniform_int_distribution<int> distribution(2, 255);
+    unsigned char const* ptr;
+    unsigned char const* end;
+    unsigned length = 0;
+    uint64_t found = 0;
+
+    //NOTE: payload bytes avoid start code emulation, as coded NAL units do
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = (unsigned char) distribution(generator);
+    }
+
+    for (size_t i = 0; i + 4 < buffer.size(); i += SCAN_NAL_SIZE) {
+        memcpy(&buffer[i], "\x00\x00\x00\x01", 4);
+    }
+
+    end = buffer.data() + buffer.size();
+
+    while (state.keepRunning()) {
+        ptr = buffer.data();
+
+        while ((ptr = NalSplitter::findStartCode(ptr, end, length))) {
+            ptr += length;
+            found++;
+        }
+    }
+
+    state.setBytesProcessed(state.getIterations()*buffer.size());
+    state.setItemsProcessed(found);
+}
+REGISTER_BENCHMARK("NalSplitter/findStartCode", nalSplitterStartCodes);
+
+int main(int argc, char* argv[])
+{
+    utils::setLogLevel(ERROR);
+    return Benchmarks::getInstance()->run(argc, argv);
+}
@@ -0,0 +1,659 @@
+/*
+ *  encoderBench.cpp - Encoder presets and threads benchmark for capacity planning
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <ctime>
+#include <cmath>
+#include <thread>
+#include <string.h>
+
+extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libavformat/avformat.h>
+    #include <libswscale/swscale.h>
+}
+
+#include "../src/Utils.hh"
+#include "../src/Jzon.h"
+#include "../src/VideoFrame.hh"
+#include "../src/modules/videoEncoder/VideoEncoderX264.hh"
+#include "../src/modules/videoEncoder/VideoEncoderX265.hh"
+#include "../src/modules/videoEncoder/VideoEncoderVpx.hh"
+#include "../src/modules/videoEncoder/VideoEncoderSvtAv1.hh"
+#include "../src/modules/videoEncoder/VideoEncoderLibav.hh"
+
+#define BENCH_FRAMES 100            //!< Pictures of the clip loaded by default, they are kept decoded in memory
+#define BENCH_FPS 25                //!< Frame rate the capacity is planned for by default
+#define BENCH_BITRATE 2000          //!< kbps
+#define BENCH_GOP 50
+#define SSIM_BLOCK 8                //!< Side of the luma blocks SSIM is computed on
+
+//NOTE: encoders are driven through their processing method, as their connected reader would do
+
+class EncoderRun {
+
+public:
+    virtual ~EncoderRun() {};
+    virtual VideoEncoderX264or5* getEncoder() = 0;
+    virtual bool encode(VideoFrame *raw, VideoFrame *coded) = 0;
+    virtual bool drain(VideoFrame *coded) = 0;
+};
+
+template <class Encoder>
+class BenchEncoder : public Encoder, public EncoderRun {
+
+public:
+    VideoEncoderX264or5* getEncoder() {return this;};
+    bool encode(VideoFrame *raw, VideoFrame *coded) {return Encoder::doProcessFrame(raw, coded);};
+    bool drain(VideoFrame *coded) {return Encoder::drainFrame(coded);};
+};
+
+struct SweepPoint {
+    std::string encoder;
+    std::string preset;
+    std::string hardware;
+    unsigned threads;
+    unsigned lookahead;
+    unsigned bFrames;
+};
+
+struct EncodedPacket {
+    std::vector<unsigned char> data;
+    int64_t index;                  //!< Picture of the clip, in presentation order
+};
+
+struct BenchResult {
+    unsigned frames;
+    double fps;
+    double cpuPerFrame;             //!< Milliseconds of process CPU time per frame
+    double bitrate;                 //!< Output kbps at the planned frame rate
+    double psnr;                    //!< Luma PSNR and SSIM of the decoded output, 0 if it can not be decoded
+    double ssim;
+};
+
+void usage()
+{
+    utils::infoMsg("Usage:\n"
+        "-sweep <sweep JSON file>\n"
+        "-clip <reference clip, i.e. one of unitTests/testsData>\n"
+        "-frames <pictures of the clip encoded by each run>\n"
+        "-json <output table filename>\n"
+        "\n"
+        "encoderbench decodes the clip once and encodes its pictures with every combination of the\n"
+        "\"presets\", \"threads\", \"lookahead\" and \"bFrames\" arrays of each \"sweeps\" entry, whose\n"
+        "\"encoder\" is x264, x265, vp8, vp9, svtav1 or libav (with its \"hardware\" encoder, i.e. nvenc).\n"
+        "Presets are x264 preset names, except the cpu-used speed of vp8 and vp9 and the SVT-AV1 preset.\n"
+        "The sweep may also set \"clip\", \"frames\", \"fps\", \"bitrate\" and \"gop\", the arguments\n"
+        "override them. Each run reports its fps, process CPU time per frame, output bitrate and luma\n"
+        "PSNR and SSIM, and how many real-time encodes of that configuration the CPU cores fit.\n");
+}
+
+double processCpuTime()
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+bool copyPicture(AVFrame *decoded, SwsContext **sws, std::vector<PlanarVideoFrame*> &pictures)
+{
+    PlanarVideoFrame *picture = PlanarVideoFrame::createNew(RAW, decoded->width, decoded->height, YUV420P);
+    unsigned char **planes = picture->getPlanarDataBuf();
+    int *linesize = picture->getLinesize();
+
+    if (decoded->format == AV_PIX_FMT_YUV420P || decoded->format == AV_PIX_FMT_YUVJ420P) {
+        for (int p = 0; p < 3; p++) {
+            int w = p == 0 ? decoded->width : (decoded->width + 1)/2;
+            int h = p == 0 ? decoded->height : (decoded->height + 1)/2;
+
+            for (int y = 0; y < h; y++) {
+                memcpy(planes[p] + y*linesize[p], decoded->data[p] + y*decoded->linesize[p], w);
+            }
+        }
+    } else {
+        *sws = sws_getCachedContext(*sws, decoded->width, decoded->height, (AVPixelFormat) decoded->format,
+                                    decoded->width, decoded->height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+        if (!*sws) {
+            utils::errorMsg("Could not convert the clip pictures to YUV420P");
+            delete picture;
+            return false;
+        }
+
+        sws_scale(*sws, decoded->data, decoded->linesize, 0, decoded->height, planes, linesize);
+    }
+
+    pictures.push_back(picture);
+    return true;
+}
+
+bool loadClip(std::string file, unsigned frames, std::vector<PlanarVideoFrame*> &pictures)
+{
+    AVFormatContext *fmtCtx = NULL;
+    AVCodecContext *decoder = NULL;
+    AVCodec *codec;
+    AVFrame *decoded;
+    SwsContext *sws = NULL;
+    AVPacket pkt;
+    int stream = -1;
+    bool success = true;
+
+    av_register_all();
+
+    if (avformat_open_input(&fmtCtx, file.c_str(), NULL, NULL) < 0 || avformat_find_stream_info(fmtCtx, NULL) < 0) {
+        utils::errorMsg("Could not open the clip " + file);
+        avformat_close_input(&fmtCtx);
+        return false;
+    }
+
+    for (unsigned i = 0; i < fmtCtx->nb_streams; i++) {
+        if (fmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            stream = i;
+            break;
+        }
+    }
+
+    if (stream < 0 || !(codec = avcodec_find_decoder(fmtCtx->streams[stream]->codecpar->codec_id)) ||
+        !(decoder = avcodec_alloc_context3(codec)) ||
+        avcodec_parameters_to_context(decoder, fmtCtx->streams[stream]->codecpar) < 0 ||
+        avcodec_open2(decoder, codec, NULL) < 0) {
+        utils::errorMsg("Could not decode the clip " + file);
+        avcodec_free_context(&decoder);
+        avformat_close_input(&fmtCtx);
+        return false;
+    }
+
+    decoded = av_frame_alloc();
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+
+    //NOTE: the decoder is flushed with an empty packet once the clip ends
+    while (success && pictures.size() < frames) {
+        bool ended = av_read_frame(fmtCtx, &pkt) < 0;
+
+        if (!ended && pkt.stream_index != stream) {
+            av_packet_unref(&pkt);
+            continue;
+        }
+
+        avcodec_send_packet(decoder, ended ? NULL : &pkt);
+        av_packet_unref(&pkt);
+
+        while (success && pictures.size() < frames && avcodec_receive_frame(decoder, decoded) >= 0) {
+            success = copyPicture(decoded, &sws, pictures);
+        }
+
+        if (ended) {
+            break;
+        }
+    }
+
+    av_frame_free(&decoded);
+    sws_freeContext(sws);
+    avcodec_free_context(&decoder);
+    avformat_close_input(&fmtCtx);
+
+    return success && !pictures.empty();
+}
+
+//NOTE: mean SSIM of non overlapping luma blocks
+double blocksSsim(const unsigned char *a, int aStride, const unsigned char *b, int bStride, int width, int height)
+{
+    const double c1 = (0.01*255)*(0.01*255);
+    const double c2 = (0.03*255)*(0.03*255);
+    const double n = SSIM_BLOCK*SSIM_BLOCK;
+    double sum = 0;
+    unsigned blocks = 0;
+
+    for (int by = 0; by + SSIM_BLOCK <= height; by += SSIM_BLOCK) {
+        for (int bx = 0; bx + SSIM_BLOCK <= width; bx += SSIM_BLOCK) {
+            int64_t sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+
+            for (int y = by; y < by + SSIM_BLOCK; y++) {
+                for (int x = bx; x < bx + SSIM_BLOCK; x++) {
+                    int pa = a[y*aStride + x];
+                    int pb = b[y*bStride + x];
+                    sa += pa;
+                    sb += pb;
+                    saa += pa*pa;
+                    sbb += pb*pb;
+                    sab += pa*pb;
+                }
+            }
+
+            double ma = sa/n, mb = sb/n;
+            double va = saa/n - ma*ma, vb = sbb/n - mb*mb, cov = sab/n - ma*mb;
+
+            sum += ((2*ma*mb + c1)*(2*cov + c2))/((ma*ma + mb*mb + c1)*(va + vb + c2));
+            blocks++;
+        }
+    }
+
+    return blocks > 0 ? sum/blocks : 1;
+}
+
+AVCodecID getCodecId(VCodecType codec)
+{
+    switch (codec) {
+        case H264:
+            return AV_CODEC_ID_H264;
+        case H265:
+            return AV_CODEC_ID_HEVC;
+        case VP8:
+            return AV_CODEC_ID_VP8;
+        case VP9:
+            return AV_CODEC_ID_VP9;
+        case AV1:
+            return AV_CODEC_ID_AV1;
+        default:
+            return AV_CODEC_ID_NONE;
+    }
+}
+
+//NOTE: pictures are matched by their timestamp, decoders output them in presentation order
+bool measureQuality(VCodecType codec, const std::vector<EncodedPacket> &packets,
+                    const std::vector<PlanarVideoFrame*> &pictures, BenchResult &result)
+{
+    AVCodec *avCodec = avcodec_find_decoder(getCodecId(codec));
+    AVCodecContext *decoder = NULL;
+    AVFrame *decoded;
+    AVPacket pkt;
+    double sse = 0, ssim = 0, pixels = 0;
+    unsigned compared = 0;
+
+    if (!avCodec || !(decoder = avcodec_alloc_context3(avCodec)) || avcodec_open2(decoder, avCodec, NULL) < 0) {
+        utils::warningMsg("No decoder to measure the quality of " + utils::getVideoCodecAsString(codec));
+        avcodec_free_context(&decoder);
+        return false;
+    }
+
+    decoded = av_frame_alloc();
+
+    for (size_t i = 0; i <= packets.size(); i++) {
+        av_init_packet(&pkt);
+        pkt.data = i < packets.size() ? const_cast<unsigned char*>(packets[i].data.data()) : NULL;
+        pkt.size = i < packets.size() ? packets[i].data.size() : 0;
+        pkt.pts = i < packets.size() ? packets[i].index : AV_NOPTS_VALUE;
+
+        avcodec_send_packet(decoder, i < packets.size() ? &pkt : NULL);
+
+        while (avcodec_receive_frame(decoder, decoded) >= 0) {
+            PlanarVideoFrame *picture;
+
+            if (decoded->pts < 0 || decoded->pts >= (int64_t) pictures.size()) {
+                continue;
+            }
+
+            picture = pictures[decoded->pts];
+            if (decoded->width != picture->getWidth() || decoded->height != picture->getHeight()) {
+                continue;
+            }
+
+            for (int y = 0; y < decoded->height; y++) {
+                const unsigned char *a = picture->getPlanarDataBuf()[0] + y*picture->getLinesize()[0];
+                const unsigned char *b = decoded->data[0] + y*decoded->linesize[0];
+
+                for (int x = 0; x < decoded->width; x++) {
+                    int d = a[x] - b[x];
+                    sse += d*d;
+                }
+            }
+
+            ssim += blocksSsim(picture->getPlanarDataBuf()[0], picture->getLinesize()[0],
+                               decoded->data[0], decoded->linesize[0], decoded->width, decoded->height);
+            pixels += decoded->width*decoded->height;
+            compared++;
+        }
+    }
+
+    av_frame_free(&decoded);
+    avcodec_free_context(&decoder);
+
+    if (compared == 0) {
+        return false;
+    }
+
+    result.psnr = sse > 0 ? 10*log10(255.0*255.0*pixels/sse) : 100;
+    result.ssim = ssim/compared;
+
+    return true;
+}
+
+EncoderRun* createEncoder(const SweepPoint &point, VCodecType &codec)
+{
+    EncoderRun *encoder = NULL;
+    int speed = atoi(point.preset.c_str());
+
+    if (point.encoder == "x264") {
+        encoder = new BenchEncoder<VideoEncoderX264>();
+        codec = H264;
+    } else if (point.encoder == "x265") {
+        encoder = new BenchEncoder<VideoEncoderX265>();
+        codec = H265;
+    } else if (point.encoder == "vp8" || point.encoder == "vp9") {
+        BenchEncoder<VideoEncoderVpx> *vpx = new BenchEncoder<VideoEncoderVpx>();
+        codec = point.encoder == "vp8" ? VP8 : VP9;
+        vpx->configVpx(codec, DEFAULT_VPX_DEADLINE, speed, DEFAULT_VPX_ROW_MT,
+                       DEFAULT_VPX_TILE_COLUMNS, DEFAULT_VPX_TOKEN_PARTITIONS);
+        encoder = vpx;
+    } else if (point.encoder == "svtav1") {
+        BenchEncoder<VideoEncoderSvtAv1> *svt = new BenchEncoder<VideoEncoderSvtAv1>();
+        codec = AV1;
+        svt->configSvtAv1(speed, DEFAULT_SVT_AV1_TILE_COLUMNS, DEFAULT_SVT_AV1_TILE_ROWS);
+        encoder = svt;
+    } else if (point.encoder == "libav") {
+        BenchEncoder<VideoEncoderLibav> *libav = new BenchEncoder<VideoEncoderLibav>();
+        codec = H264;
+        libav->configHardware(point.hardware.empty() ? DEFAULT_HW_ENCODER : point.hardware);
+        encoder = libav;
+    } else {
+        utils::errorMsg("Unknown encoder " + point.encoder);
+    }
+
+    return encoder;
+}
+
+void collectPacket(VideoFrame *coded, unsigned fps, std::vector<EncodedPacket> &packets)
+{
+    EncodedPacket packet;
+    SlicedVideoFrame *sliced = dynamic_cast<SlicedVideoFrame*>(coded);
+
+    if (!coded->getConsumed()) {
+        return;
+    }
+
+    if (sliced) {
+        for (int i = 0; i < sliced->getSliceNum(); i++) {
+            Slice &s = sliced->getSlices()[i];
+            packet.data.insert(packet.data.end(), s.getData(), s.getData() + s.getDataSize());
+        }
+    } else {
+        packet.data.assign(coded->getDataBuf(), coded->getDataBuf() + coded->getLength());
+    }
+
+    if (packet.data.empty()) {
+        return;
+    }
+
+    packet.index = llround(coded->getPresentationTime().count()*fps/1e6);
+    packets.push_back(std::move(packet));
+}
+
+void resetCoded(VideoFrame *coded)
+{
+    SlicedVideoFrame *sliced = dynamic_cast<SlicedVideoFrame*>(coded);
+
+    if (sliced) {
+        sliced->clear();
+    } else {
+        coded->setLength(0);
+    }
+
+    coded->setConsumed(false);
+}
+
+bool runPoint(const SweepPoint &point, const std::vector<PlanarVideoFrame*> &pictures, unsigned fps,
+              unsigned bitrate, unsigned gop, BenchResult &result)
+{
+    VCodecType codec = VC_NONE;
+    EncoderRun *encoder = createEncoder(point, codec);
+    VideoFrame *coded;
+    std::vector<EncodedPacket> packets;
+    size_t bytes = 0;
+    int ret;
+
+    if (!encoder) {
+        return false;
+    }
+
+    encoder->getEncoder()->configure(bitrate, fps, gop, point.lookahead, point.bFrames, point.threads, true,
+                       codec == VP8 || codec == VP9 || codec == AV1 ? DEFAULT_PRESET : point.preset);
+    //NOTE: an unconnected filter only executes its pending configuration events
+    encoder->getEncoder()->processFrame(ret);
+
+    if (codec == H264 || codec == H265) {
+        coded = SlicedVideoFrame::createNew(codec);
+    } else {
+        coded = InterleavedVideoFrame::createNew(codec, codec == VP8 ? LENGTH_VP8 : codec == VP9 ? LENGTH_VP9 : LENGTH_AV1);
+    }
+
+    double cpuStart = processCpuTime();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < pictures.size(); i++) {
+        pictures[i]->setPresentationTime(std::chrono::microseconds(i*1000000/fps));
+        pictures[i]->setSequenceNumber(i);
+        pictures[i]->setConsumed(true);
+
+        resetCoded(coded);
+        if (encoder->encode(pictures[i], coded)) {
+            collectPacket(coded, fps, packets);
+        }
+    }
+
+    resetCoded(coded);
+    while (encoder->drain(coded)) {
+        collectPacket(coded, fps, packets);
+        resetCoded(coded);
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = processCpuTime() - cpuStart;
+
+    delete encoder;
+    delete coded;
+
+    for (auto &p : packets) {
+        bytes += p.data.size();
+    }
+
+    result.frames = packets.size();
+    result.fps = elapsed > 0 ? pictures.size()/elapsed : 0;
+    result.cpuPerFrame = cpu*1000/pictures.size();
+    result.bitrate = bytes*8.0*fps/pictures.size()/1000;
+    result.psnr = 0;
+    result.ssim = 0;
+
+    if (packets.empty()) {
+        utils::errorMsg(point.encoder + " " + point.preset + " did not output any frame");
+        return false;
+    }
+
+    measureQuality(codec, packets, pictures, result);
+
+    return true;
+}
+
+std::vector<unsigned> getValues(Jzon::Node &sweep, std::string name, unsigned value)
+{
+    std::vector<unsigned> values;
+
+    if (!sweep.Has(name)) {
+        values.push_back(value);
+        return values;
+    }
+
+    for (auto &v : sweep.Get(name).AsArray()) {
+        values.push_back(v.ToInt());
+    }
+
+    return values;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string sweepFile, clip, jsonFile;
+    unsigned frames = BENCH_FRAMES, fps = BENCH_FPS, bitrate = BENCH_BITRATE, gop = BENCH_GOP;
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<PlanarVideoFrame*> pictures;
+    std::vector<SweepPoint> points;
+    Jzon::Object sweepNode;
+    Jzon::Array table;
+
+    utils::setLogLevel(ERROR);
+
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i],"-sweep")==0) {
+            sweepFile = argv[i+1];
+        }
+    }
+
+    if (sweepFile.empty()) {
+        usage();
+        return 1;
+    }
+
+    if (!Jzon::FileReader::ReadFile(sweepFile, sweepNode) || !sweepNode.Has("sweeps")) {
+        utils::errorMsg("Invalid sweep file: " + sweepFile);
+        return 1;
+    }
+
+    if (sweepNode.Has("clip")) {
+        clip = sweepNode.Get("clip").ToString();
+    }
+    if (sweepNode.Has("frames")) {
+        frames = sweepNode.Get("frames").ToInt();
+    }
+    if (sweepNode.Has("fps")) {
+        fps = sweepNode.Get("fps").ToInt();
+    }
+    if (sweepNode.Has("bitrate")) {
+        bitrate = sweepNode.Get("bitrate").ToInt();
+    }
+    if (sweepNode.Has("gop")) {
+        gop = sweepNode.Get("gop").ToInt();
+    }
+
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i],"-clip")==0) {
+            clip = argv[i+1];
+        } else if (strcmp(argv[i],"-frames")==0) {
+            frames = std::stoi(argv[i+1]);
+        } else if (strcmp(argv[i],"-json")==0) {
+            jsonFile = argv[i+1];
+        }
+    }
+
+    if (clip.empty() || frames == 0 || fps == 0) {
+        usage();
+        return 1;
+    }
+
+    for (auto &sweep : sweepNode.Get("sweeps").AsArray()) {
+        SweepPoint point;
+        std::vector<std::string> presets;
+
+        point.encoder = sweep.Get("encoder").ToString();
+        point.hardware = sweep.Has("hardware") ? sweep.Get("hardware").ToString() : "";
+
+        if (sweep.Has("presets")) {
+            for (auto &p : sweep.Get("presets").AsArray()) {
+                presets.push_back(p.ToString());
+            }
+        } else {
+            presets.push_back(DEFAULT_PRESET);
+        }
+
+        for (auto &preset : presets) {
+            for (unsigned threads : getValues(sweep, "threads", DEFAULT_THREADS)) {
+                for (unsigned lookahead : getValues(sweep, "lookahead", DEFAULT_LOOKAHEAD)) {
+                    for (unsigned bFrames : getValues(sweep, "bFrames", DEFAULT_B_FRAMES)) {
+                        point.preset = preset;
+                        point.threads = threads;
+                        point.lookahead = lookahead;
+                        point.bFrames = bFrames;
+                        points.push_back(point);
+                    }
+                }
+            }
+        }
+    }
+
+    if (!loadClip(clip, frames, pictures)) {
+        return 1;
+    }
+
+    printf("%u pictures of %dx%d from %s, %u cores, planned for %u fps at %u kbps\n", (unsigned) pictures.size(),
+           pictures.front()->getWidth(), pictures.front()->getHeight(), clip.c_str(), cores, fps, bitrate);
+    printf("%-8s %-10s %7s %9s %7s %9s %10s %9s %8s %7s %8s\n", "Encoder", "Preset", "Threads", "Lookahead",
+           "BFrames", "FPS", "CPU ms/f", "kbps", "PSNR", "SSIM", "Per box");
+
+    for (auto &point : points) {
+        BenchResult result;
+        Jzon::Object row;
+        double coresPerEncode;
+        unsigned perBox = 0;
+
+        if (!runPoint(point, pictures, fps, bitrate, gop, result)) {
+            continue;
+        }
+
+        //NOTE: an encode fits the box if it runs in real time by itself and the cores cover its CPU time
+        coresPerEncode = result.cpuPerFrame*fps/1000;
+        if (result.fps >= fps && coresPerEncode > 0) {
+            perBox = (unsigned) (cores/coresPerEncode);
+        }
+
+        printf("%-8s %-10s %7u %9u %7u %9.1f %10.2f %9.0f %8.2f %7.4f %8u\n", point.encoder.c_str(), point.preset.c_str(),
+               point.threads, point.lookahead, point.bFrames, result.fps, result.cpuPerFrame, result.bitrate,
+               result.psnr, result.ssim, perBox);
+
+        row.Add("encoder", point.encoder);
+        row.Add("hardware", point.hardware);
+        row.Add("preset", point.preset);
+        row.Add("threads", (int) point.threads);
+        row.Add("lookahead", (int) point.lookahead);
+        row.Add("bFrames", (int) point.bFrames);
+        row.Add("frames", (int) result.frames);
+        row.Add("fps", result.fps);
+        row.Add("cpuPerFrameMs", result.cpuPerFrame);
+        row.Add("coresPerEncode", coresPerEncode);
+        row.Add("bitrate", result.bitrate);
+        row.Add("psnr", result.psnr);
+        row.Add("ssim", result.ssim);
+        row.Add("realTime", result.fps >= fps);
+        row.Add("encodesPerBox", (int) perBox);
+        table.Add(row);
+    }
+
+    for (auto p : pictures) {
+        delete p;
+    }
+
+    if (!jsonFile.empty()) {
+        Jzon::Object report;
+
+        report.Add("clip", clip);
+        report.Add("frames", (int) frames);
+        report.Add("fps", (int) fps);
+        report.Add("bitrate", (int) bitrate);
+        report.Add("gop", (int) gop);
+        report.Add("cores", (int) cores);
+        report.Add("runs", table);
+        Jzon::FileWriter::WriteFile(jsonFile, report, Jzon::StandardFormat);
+    }
+
+    return 0;
+}
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <iostream>
 #include "../src/Controller.hh"
@@ -36,6 +37,7 @@ int main(int argc, char *argv[]) {
 
     if (argc < 2) {
         fprintf(stderr,"ERROR, no port provided\n");
+        fprintf(stderr,"usage: %s <port> [snapshot file]\n", argv[0]);
         exit(1);
     }
 
@@ -48,6 +50,23 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
+    //NOTE: with a snapshot file the previous graph is rebuilt at once and kept up to date from then on
+    if (argc > 2) {
+        Jzon::Object params, result;
+        params.Add("file", argv[2]);
+        params.Add("autoSave", true);
+
+        if (access(argv[2], F_OK) == 0) {
+            PipelineManager::getInstance()->restoreSnapshotEvent(&params, result);
+        } else {
+            PipelineManager::getInstance()->configureSnapshotEvent(&params, result);
+        }
+
+        if (!result.Get("error").IsNull()) {
+            utils::errorMsg(result.Get("error").ToString());
+        }
+    }
+
     while (ctrl->run()) {
         if (!ctrl->listenSocket()) {
             continue;
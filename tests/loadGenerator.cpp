@@ -0,0 +1,334 @@
+/*
+ *  loadGenerator.cpp - Sharded RTSP load generator and measurement receiver
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <liveMedia.hh>
+#include <BasicUsageEnvironment.hh>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+
+#include "LoadStreamSource.hh"
+#include "LoadMeasureSink.hh"
+#include "../src/Utils.hh"
+
+#define DEFAULT_PORT 8666
+#define DEFAULT_SHARDS 4
+#define STARTUP_DELAY 1 //!< Seconds the receiver waits for the local servers
+
+static char stop = 0;
+
+void signalHandler(int /*signum*/)
+{
+    stop = 1;
+}
+
+struct LoadConfig {
+    LoadConfig() : send(false), receive(false), streams(1), shards(DEFAULT_SHARDS), servers(0),
+        port(DEFAULT_PORT), host("127.0.0.1"), duration(0) {};
+
+    bool send;
+    bool receive;
+    std::string file;
+    unsigned streams;
+    unsigned shards;
+    unsigned servers;           //!< Sender shards serving the received streams, 0 means the same as shards
+    unsigned port;              //!< RTSP port of the first sender shard, each shard uses the next one
+    std::string host;
+    unsigned duration;          //!< Seconds, 0 runs until interrupted
+    std::string statsFile;
+    LoadImpairments impairments;
+};
+
+static std::string streamName(unsigned stream)
+{
+    return "stream" + std::to_string(stream);
+}
+
+void sendShard(const LoadConfig &config, const LoadClip* clip, unsigned shard)
+{
+    TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+    UsageEnvironment* env = BasicUsageEnvironment::createNew(*scheduler);
+    RTSPServer* server = RTSPServer::createNew(*env, config.port + shard, NULL);
+
+    if (!server) {
+        utils::errorMsg("Failed to create RTSP server on port " + std::to_string(config.port + shard)
+                        + ": " + env->getResultMsg());
+        stop = 1;
+        return;
+    }
+
+    for (unsigned i = shard; i < config.streams; i += config.shards) {
+        ServerMediaSession* sms = ServerMediaSession::createNew(*env, streamName(i).c_str(),
+                                    streamName(i).c_str(), "Load generator stream");
+
+        sms->addSubsession(LoadServerMediaSubsession::createNew(*env, clip, config.impairments, i));
+        server->addServerMediaSession(sms);
+    }
+
+    env->taskScheduler().doEventLoop(&stop);
+
+    Medium::close(server);
+    env->reclaim();
+    delete scheduler;
+}
+
+void receiveShard(const LoadConfig &config, std::vector<LoadStreamStats> &stats, unsigned shard)
+{
+    TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+    UsageEnvironment* env = BasicUsageEnvironment::createNew(*scheduler);
+    std::vector<LoadClient*> clients;
+    unsigned servers = config.servers > 0 ? config.servers : config.shards;
+
+    for (unsigned i = shard; i < config.streams; i += config.shards) {
+        std::string url = "rtsp://" + config.host + ":" + std::to_string(config.port + i % servers)
+                          + "/" + streamName(i);
+        LoadClient* client = LoadClient::createNew(*env, url, stats[i]);
+
+        client->start();
+        clients.push_back(client);
+    }
+
+    env->taskScheduler().doEventLoop(&stop);
+
+    for (auto client : clients) {
+        Medium::close(client);
+    }
+    env->reclaim();
+    delete scheduler;
+}
+
+/*! Aggregate of the streams stats at a point in time */
+struct LoadReport {
+    LoadReport() : playing(0), failed(0), bytes(0), stamps(0), lostStamps(0),
+        latencySum(0), latencyMax(0), rtpExpected(0), rtpReceived(0), hist() {};
+
+    void add(const LoadStreamStats &s) {
+        playing += s.playing ? 1 : 0;
+        failed += s.failed ? 1 : 0;
+        bytes += s.bytes.load(std::memory_order_relaxed);
+        stamps += s.stamps.load(std::memory_order_relaxed);
+        lostStamps += s.lostStamps.load(std::memory_order_relaxed);
+        latencySum += s.latencySum.load(std::memory_order_relaxed);
+        latencyMax = std::max(latencyMax, (uint64_t) s.latencyMax.load(std::memory_order_relaxed));
+        rtpExpected += s.rtpExpected.load(std::memory_order_relaxed);
+        rtpReceived += s.rtpReceived.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i < LOAD_LATENCY_BUCKETS; i++) {
+            hist[i] += s.latencyHist[i].load(std::memory_order_relaxed);
+        }
+    };
+
+    //NOTE: upper bound of the bucket holding the percentile
+    uint64_t percentile(double p) const {
+        uint64_t target = stamps * p;
+        uint64_t count = 0;
+
+        for (size_t i = 0; i < LOAD_LATENCY_BUCKETS; i++) {
+            count += hist[i];
+            if (count > target) {
+                return ((uint64_t) 1) << i;
+            }
+        }
+        return latencyMax;
+    };
+
+    double rtpLoss() const {
+        return rtpExpected > 0 ? 100.0 * (1.0 - (double) rtpReceived / rtpExpected) : 0;
+    };
+
+    unsigned playing;
+    unsigned failed;
+    uint64_t bytes;
+    uint64_t stamps;
+    uint64_t lostStamps;
+    uint64_t latencySum;
+    uint64_t latencyMax;
+    uint64_t rtpExpected;
+    uint64_t rtpReceived;
+    uint64_t hist[LOAD_LATENCY_BUCKETS];
+};
+
+static LoadReport collect(const std::vector<LoadStreamStats> &stats)
+{
+    LoadReport report;
+
+    for (auto &s : stats) {
+        report.add(s);
+    }
+    return report;
+}
+
+void usage(char* name)
+{
+    std::cerr << "Usage: " << name << " [-send] [-receive] -v <h264 file> [options]" << std::endl
+              << "  -streams <n>      streams served or received (1)" << std::endl
+              << "  -shards <n>       event loop threads of each side (" << DEFAULT_SHARDS << ")" << std::endl
+              << "  -servers <n>      sender shards when only receiving (same as -shards)" << std::endl
+              << "  -port <port>      RTSP port of the first sender shard (" << DEFAULT_PORT << ")" << std::endl
+              << "  -host <addr>      sender address when only receiving (127.0.0.1)" << std::endl
+              << "  -fps <n>          access units per second (25)" << std::endl
+              << "  -bitrate <kbps>   target bitrate padded with filler data (clip rate)" << std::endl
+              << "  -loss <percent>   NAL units dropped at the sender (0)" << std::endl
+              << "  -jitter <ms>      maximum random delay of each access unit (0)" << std::endl
+              << "  -duration <s>     run time, 0 runs until interrupted (0)" << std::endl
+              << "  -statsfile <file> appends a CSV line with the final measures" << std::endl
+              << "Without -send nor -receive both sides run in this process." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    LoadConfig config;
+    LoadClip* clip = NULL;
+    std::vector<std::thread> threads;
+    std::vector<LoadStreamStats> stats;
+    LoadReport last;
+    unsigned seconds = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-send") == 0) {
+            config.send = true;
+        } else if (strcmp(argv[i], "-receive") == 0) {
+            config.receive = true;
+        } else if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            config.file = argv[++i];
+        } else if (strcmp(argv[i], "-streams") == 0) {
+            config.streams = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "-shards") == 0) {
+            config.shards = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "-servers") == 0) {
+            config.servers = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "-port") == 0) {
+            config.port = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "-host") == 0) {
+            config.host = argv[++i];
+        } else if (strcmp(argv[i], "-fps") == 0) {
+            config.impairments.fps = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "-bitrate") == 0) {
+            config.impairments.bitrate = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "-loss") == 0) {
+            config.impairments.loss = std::stod(argv[++i]) / 100.0;
+        } else if (strcmp(argv[i], "-jitter") == 0) {
+            config.impairments.jitter = std::stoi(argv[++i]) * 1000;
+        } else if (strcmp(argv[i], "-duration") == 0) {
+            config.duration = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "-statsfile") == 0) {
+            config.statsFile = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!config.send && !config.receive) {
+        config.send = config.receive = true;
+    }
+
+    if (config.streams == 0 || config.shards == 0 || config.impairments.fps == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (config.send) {
+        if (config.file.empty() || !(clip = LoadClip::createNew(config.file))) {
+            usage(argv[0]);
+            return 1;
+        }
+        utils::infoMsg("Serving " + std::to_string(config.streams) + " streams of " + config.file
+                       + " at " + std::to_string(config.impairments.bitrate > 0 ?
+                            config.impairments.bitrate : clip->getBitrate(config.impairments.fps)) + " kbps");
+    }
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    OutPacketBuffer::maxSize = 1066804;
+
+    stats = std::vector<LoadStreamStats>(config.streams);
+
+    if (config.send) {
+        for (unsigned s = 0; s < config.shards; s++) {
+            threads.push_back(std::thread(sendShard, std::cref(config), clip, s));
+        }
+        if (config.receive) {
+            std::this_thread::sleep_for(std::chrono::seconds(STARTUP_DELAY));
+        }
+    }
+
+    if (config.receive) {
+        for (unsigned s = 0; s < config.shards; s++) {
+            threads.push_back(std::thread(receiveShard, std::cref(config), std::ref(stats), s));
+        }
+    }
+
+    while (!stop && (config.duration == 0 || seconds < config.duration)) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        seconds++;
+
+        if (!config.receive) {
+            continue;
+        }
+
+        LoadReport report = collect(stats);
+
+        std::cout << seconds << "s playing " << report.playing << "/" << config.streams
+                  << " failed " << report.failed
+                  << " kbps " << (report.bytes - last.bytes) * 8 / 1000
+                  << " latency avg " << (report.stamps > 0 ? report.latencySum / report.stamps : 0)
+                  << " p99 " << report.percentile(0.99) << " max " << report.latencyMax << " us"
+                  << " lost AUs " << report.lostStamps
+                  << " RTP loss " << report.rtpLoss() << "%" << std::endl;
+        last = report;
+    }
+
+    stop = 1;
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    if (config.receive && !config.statsFile.empty() && seconds > 0) {
+        std::ofstream statsFile(config.statsFile, std::ios::app);
+        LoadReport report = collect(stats);
+
+        //NOTE: streams, shards, bitrate (kbps), loss (%), jitter (ms), playing, failed,
+        //      received bitrate (kbps), avg latency (us), p50 (us), p99 (us), max (us), lost AUs, RTP loss (%)
+        statsFile << config.streams << ", " << config.shards << ", " << config.impairments.bitrate << ", "
+                  << config.impairments.loss * 100 << ", " << config.impairments.jitter / 1000 << ", "
+                  << report.playing << ", " << report.failed << ", "
+                  << report.bytes * 8 / 1000 / seconds << ", "
+                  << (report.stamps > 0 ? report.latencySum / report.stamps : 0) << ", "
+                  << report.percentile(0.5) << ", " << report.percentile(0.99) << ", " << report.latencyMax << ", "
+                  << report.lostStamps << ", " << report.rtpLoss() << std::endl;
+    }
+
+    delete clip;
+
+    return 0;
+}
@@ -0,0 +1,331 @@
+/*
+ *  replayBench.cpp - Deterministic replay benchmark of pipeline scenarios
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <csignal>
+#include <ctime>
+#include <array>
+#include <thread>
+#include <string.h>
+
+#include "../src/PipelineManager.hh"
+#include "../src/Utils.hh"
+#include "../src/Jzon.h"
+
+#define REPLAY_POLL 100             //!< Time in msec between checks of the end of the run
+#define REPLAY_WARMUP 2             //!< Seconds discarded before measuring by default
+
+typedef std::map<int, std::array<uint64_t, FILTER_METRICS>> FilterSamples;
+
+bool run = true;
+
+void signalHandler(int /*signum*/)
+{
+    utils::infoMsg("Interruption signal received");
+    run = false;
+}
+
+void usage()
+{
+    utils::infoMsg("Usage:\n"
+        "-scenario <scenario JSON file>\n"
+        "-rate <playback speed of the demuxers, 1 is real time and 0 as fast as possible>\n"
+        "-warmup <seconds discarded before measuring>\n"
+        "-duration <seconds measured, 0 runs until the end of the input in throughput mode>\n"
+        "-throughput <1 to block on full queues instead of dropping frames>\n"
+        "-threads <workers of the pool, 0 means hardware based default>\n"
+        "-json <output report filename>\n"
+        "\n"
+        "replaybench builds the scenario \"graph\" with a createGraph event, after configuring the\n"
+        "pool with its \"pool\" params, if any. Its demuxers replay recorded files (i.e. the ones at\n"
+        "unitTests/testsData) paced at the given rate, so the same input reaches the pipeline at the\n"
+        "same times on every run. The scenario may also set \"rate\", \"warmup\", \"duration\" and\n"
+        "\"throughput\", the arguments override them. Throughput, delay percentiles, CPU time per filter\n"
+        "and drops of the measured interval are reported.\n");
+}
+
+double processCpuTime()
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+FilterSamples sampleFilters(PipelineManager *pipe)
+{
+    FilterSamples samples;
+    uint64_t values[FILTER_METRICS];
+
+    for (auto it : pipe->getFilters()) {
+        it.second->getMetrics(values);
+        std::copy(values, values + FILTER_METRICS, samples[it.first].begin());
+    }
+
+    return samples;
+}
+
+std::map<int, int> sampleLostBlocs(PipelineManager *pipe)
+{
+    std::map<int, int> lostBlocs;
+    Jzon::Object state;
+
+    pipe->getStateEvent(NULL, state);
+
+    for (auto &p : state.Get("paths").AsArray()) {
+        lostBlocs[p.Get("id").ToInt()] = p.Get("lostBlocs").ToInt();
+    }
+
+    return lostBlocs;
+}
+
+//NOTE: rate events are pushed along with the scenario ones, before the demuxers run
+void addRateEvents(Jzon::Object &graph, double rate)
+{
+    if (!graph.Has("filters")) {
+        return;
+    }
+
+    if (!graph.Has("events")) {
+        Jzon::Array events;
+        graph.Add("events", events);
+    }
+
+    for (auto &f : graph.Get("filters").AsArray()) {
+        if (utils::getFilterTypeFromString(f.Get("type").ToString()) != DEMUXER) {
+            continue;
+        }
+
+        Jzon::Object event;
+        Jzon::Object params;
+        params.Add("rate", rate);
+        event.Add("filterId", f.Get("id").ToInt());
+        event.Add("action", "configure");
+        event.Add("params", params);
+        graph.Get("events").AsArray().Add(event);
+    }
+}
+
+bool failed(Jzon::Object &outputNode)
+{
+    if (outputNode.Has("error") && !outputNode.Get("error").IsNull()) {
+        utils::errorMsg(outputNode.Get("error").ToString());
+        return true;
+    }
+
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string scenarioFile, jsonFile;
+    double rate = 1, warmup = REPLAY_WARMUP, duration = 0;
+    bool throughput = false;
+    unsigned threads = 0;
+    Jzon::Object scenario;
+
+    utils::setLogLevel(INFO);
+
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i],"-scenario")==0) {
+            scenarioFile = argv[i+1];
+        }
+    }
+
+    if (scenarioFile.empty()) {
+        usage();
+        return 1;
+    }
+
+    if (!Jzon::FileReader::ReadFile(scenarioFile, scenario) || !scenario.Has("graph")) {
+        utils::errorMsg("Invalid scenario file: " + scenarioFile);
+        return 1;
+    }
+
+    if (scenario.Has("rate")) {
+        rate = scenario.Get("rate").ToDouble();
+    }
+    if (scenario.Has("warmup")) {
+        warmup = scenario.Get("warmup").ToDouble();
+    }
+    if (scenario.Has("duration")) {
+        duration = scenario.Get("duration").ToDouble();
+    }
+    if (scenario.Has("throughput")) {
+        throughput = scenario.Get("throughput").ToBool();
+    }
+
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i],"-rate")==0) {
+            rate = std::stod(argv[i+1]);
+        } else if (strcmp(argv[i],"-warmup")==0) {
+            warmup = std::stod(argv[i+1]);
+        } else if (strcmp(argv[i],"-duration")==0) {
+            duration = std::stod(argv[i+1]);
+        } else if (strcmp(argv[i],"-throughput")==0) {
+            throughput = std::stoi(argv[i+1]) != 0;
+        } else if (strcmp(argv[i],"-threads")==0) {
+            threads = std::stoi(argv[i+1]);
+        } else if (strcmp(argv[i],"-json")==0) {
+            jsonFile = argv[i+1];
+        }
+    }
+
+    //NOTE: live pipelines have no end of stream, so they are measured for a fixed time
+    if (rate < 0 || warmup < 0 || duration < 0 || (!throughput && duration == 0)) {
+        usage();
+        return 1;
+    }
+
+    utils::infoMsg("replaying " + scenarioFile + " at rate " + std::to_string(rate) +
+                   (throughput ? " in throughput mode" : ""));
+
+    PipelineManager *pipe = PipelineManager::getInstance(threads);
+    Jzon::Object poolNode;
+    Jzon::Object graphNode;
+
+    pipe->setThroughput(throughput);
+
+    if (scenario.Has("pool")) {
+        pipe->configurePoolEvent(&scenario.Get("pool"), poolNode);
+        if (failed(poolNode)) {
+            PipelineManager::destroyInstance();
+            return 1;
+        }
+    }
+
+    Jzon::Object graph = scenario.Get("graph").AsObject();
+    addRateEvents(graph, rate);
+
+    pipe->createGraphEvent(&graph, graphNode);
+    if (failed(graphNode)) {
+        PipelineManager::destroyInstance();
+        return 1;
+    }
+
+    signal(SIGINT, signalHandler);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (run && std::chrono::steady_clock::now() - start < std::chrono::duration<double>(warmup)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(REPLAY_POLL));
+    }
+
+    // The measured interval starts here, the warm up frames are discarded
+    FilterSamples firstSamples = sampleFilters(pipe);
+    std::map<int, int> firstLostBlocs = sampleLostBlocs(pipe);
+    for (auto it : pipe->getFilters()) {
+        it.second->clearReadersRunDelays();
+    }
+    double firstCpu = processCpuTime();
+    start = std::chrono::steady_clock::now();
+
+    while (run && (duration == 0 || std::chrono::steady_clock::now() - start < std::chrono::duration<double>(duration))) {
+        if (throughput && pipe->isEndOfStream()) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(REPLAY_POLL));
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = processCpuTime() - firstCpu;
+    FilterSamples lastSamples = sampleFilters(pipe);
+    std::map<int, int> lastLostBlocs = sampleLostBlocs(pipe);
+
+    Jzon::Object report;
+    Jzon::Array filterList;
+    Jzon::Array pathList;
+    uint64_t tailFrames = 0;
+    int drops = 0;
+
+    for (auto it : pipe->getFilters()) {
+        Jzon::Object filter;
+        const std::array<uint64_t, FILTER_METRICS> &first = firstSamples[it.first];
+        const std::array<uint64_t, FILTER_METRICS> &last = lastSamples[it.first];
+        double filterCpu = (last[4] - first[4])/1e6;
+
+        filter.Add("id", it.first);
+        filter.Add("type", utils::getFilterTypeAsString(it.second->getType()));
+        filter.Add("readFrames", (double) (last[5] - first[5]));
+        filter.Add("writtenFrames", (double) (last[6] - first[6]));
+        filter.Add("cpuTime", filterCpu);
+        filter.Add("cpuShare", cpu > 0 ? filterCpu/cpu : 0);
+        filterList.Add(filter);
+
+        if (it.second->getMaxWriters() == 0) {
+            tailFrames += last[5] - first[5];
+        }
+
+        utils::infoMsg("filter " + std::to_string(it.first) + " (" + utils::getFilterTypeAsString(it.second->getType()) +
+                       "): " + std::to_string(last[6] - first[6]) + " frames, " + std::to_string(filterCpu) + "s cpu");
+    }
+
+    for (auto it : pipe->getPaths()) {
+        Jzon::Object path;
+        BaseFilter *f = pipe->getFilter(it.second->getDestinationFilterID());
+        int rId = it.second->getDstReaderID();
+        int lostBlocs = lastLostBlocs[it.first] - firstLostBlocs[it.first];
+
+        path.Add("id", it.first);
+        path.Add("lostBlocs", lostBlocs);
+        if (f) {
+            path.Add("delayP50", (int) f->getReaderRunDelayPercentile(rId, 50).count());
+            path.Add("delayP90", (int) f->getReaderRunDelayPercentile(rId, 90).count());
+            path.Add("delayP99", (int) f->getReaderRunDelayPercentile(rId, 99).count());
+            path.Add("maxDelay", (int) f->getReaderRunDelayPercentile(rId, 100).count());
+            utils::infoMsg("path " + std::to_string(it.first) + ": delay p50 " +
+                           std::to_string(f->getReaderRunDelayPercentile(rId, 50).count()) + "us, p99 " +
+                           std::to_string(f->getReaderRunDelayPercentile(rId, 99).count()) + "us, " +
+                           std::to_string(lostBlocs) + " lost blocs");
+        }
+        pathList.Add(path);
+        drops += lostBlocs;
+    }
+
+    report.Add("scenario", scenarioFile);
+    report.Add("rate", rate);
+    report.Add("throughputMode", throughput);
+    report.Add("warmup", warmup);
+    report.Add("duration", elapsed);
+    report.Add("endOfStream", pipe->isEndOfStream());
+    report.Add("frames", (double) tailFrames);
+    report.Add("fps", elapsed > 0 ? tailFrames/elapsed : 0);
+    report.Add("lostBlocs", drops);
+    report.Add("cpuTime", cpu);
+    report.Add("cpuLoad", elapsed > 0 ? cpu/elapsed : 0);
+    report.Add("filters", filterList);
+    report.Add("paths", pathList);
+
+    utils::infoMsg(std::to_string(tailFrames) + " frames in " + std::to_string(elapsed) + "s (" +
+                   std::to_string(elapsed > 0 ? tailFrames/elapsed : 0) + " fps), " +
+                   std::to_string(cpu) + "s cpu, " + std::to_string(drops) + " lost blocs");
+
+    if (!jsonFile.empty()) {
+        Jzon::FileWriter::WriteFile(jsonFile, report, Jzon::StandardFormat);
+    }
+
+    pipe->stop();
+    PipelineManager::destroyInstance();
+
+    return 0;
+}
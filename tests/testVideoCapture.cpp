@@ -103,7 +103,7 @@ int main(int argc, char* argv[])
     
     pipe->addFilter(transmitterID, transmitter); 
     
-    if (!pipe->createPath(1, captureID, transmitterID, -1, -1, midFilters)) {
+    if (!pipe->createPath(1, captureID, transmitterID, DEFAULT_ID, -1, midFilters)) {
         utils::errorMsg("Error creating video path");
         return 1;
     }   
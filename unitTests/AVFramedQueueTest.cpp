@@ -23,6 +23,7 @@
 #include <iostream>
 #include <fstream>
 #include <string.h>
+#include <thread>
 
 #include <cppunit/extensions/TestFactoryRegistry.h>
 #include <cppunit/extensions/HelperMacros.h>
@@ -31,7 +32,14 @@
 #include <cppunit/TestResultCollector.h>
 #include <cppunit/XmlOutputter.h>
 
+extern "C" {
+    #include <libavutil/frame.h>
+}
+
 #include "AVFramedQueue.hh"
+#include "FramePool.hh"
+#include "VideoFrame.hh"
+#include "HardwareVideoFrame.hh"
 #include "FilterMockup.hh"
 #include "Utils.hh"
 #include "StreamInfo.hh"
@@ -42,6 +50,21 @@ class AVFramedQueueTest : public CppUnit::TestFixture
     CPPUNIT_TEST(normalBehaviour);
     CPPUNIT_TEST(forceGetRearTest);
     CPPUNIT_TEST(forceGetFrontTest);
+    CPPUNIT_TEST(concurrentBehaviour);
+    CPPUNIT_TEST(framePool);
+    CPPUNIT_TEST(retainedFrame);
+    CPPUNIT_TEST(bytesBudget);
+    CPPUNIT_TEST(rawFrameSizing);
+    CPPUNIT_TEST(alignedBuffers);
+    CPPUNIT_TEST(planarVideoFrame);
+    CPPUNIT_TEST(mjpegFrames);
+    CPPUNIT_TEST(swapVideoFrames);
+    CPPUNIT_TEST(externalPlanes);
+    CPPUNIT_TEST(externalBuffer);
+    CPPUNIT_TEST(hardwareVideoFrame);
+    CPPUNIT_TEST(queueTelemetry);
+    CPPUNIT_TEST(latencyBound);
+    CPPUNIT_TEST(autoDepth);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -52,6 +75,21 @@ protected:
     void normalBehaviour();
     void forceGetRearTest();
     void forceGetFrontTest();
+    void concurrentBehaviour();
+    void framePool();
+    void retainedFrame();
+    void bytesBudget();
+    void rawFrameSizing();
+    void alignedBuffers();
+    void planarVideoFrame();
+    void mjpegFrames();
+    void swapVideoFrames();
+    void externalPlanes();
+    void externalBuffer();
+    void hardwareVideoFrame();
+    void queueTelemetry();
+    void latencyBound();
+    void autoDepth();
 
     ConnectionData cData;
     ReaderData reader;
@@ -177,6 +215,612 @@ void AVFramedQueueTest::forceGetFrontTest()
     CPPUNIT_ASSERT(frame->getSequenceNumber() == seq - 1);
 }
 
+void AVFramedQueueTest::concurrentBehaviour()
+{
+    const size_t total = 10000;
+    size_t seq = 0;
+    Frame* frame = NULL;
+    
+    std::thread writer([this, total](){
+        Frame* wFrame;
+        size_t wSeq = 0;
+        
+        while (wSeq < total){
+            if ((wFrame = q->getRear()) == NULL){
+                std::this_thread::yield();
+                continue;
+            }
+            wFrame->setSequenceNumber(wSeq++);
+            q->addFrame();
+        }
+    });
+    
+    while (seq < total){
+        if ((frame = q->getFront()) == NULL){
+            std::this_thread::yield();
+            continue;
+        }
+        CPPUNIT_ASSERT(frame->getSequenceNumber() == seq++);
+        CPPUNIT_ASSERT(q->removeFrame() == cData.wFilterId);
+    }
+    
+    writer.join();
+    CPPUNIT_ASSERT(q->getElements() == 0);
+}
+
+void AVFramedQueueTest::framePool()
+{
+    FramePool* fPool = FramePool::getInstance();
+    size_t hits = fPool->getHits();
+    size_t misses = fPool->getMisses();
+    size_t idle = fPool->getIdleFrames();
+    Frame* frame;
+    Frame* other;
+    
+    frame = fPool->getVideoFrame(H264, 1024);
+    CPPUNIT_ASSERT(frame);
+    CPPUNIT_ASSERT(fPool->getMisses() == misses + 1);
+    frame->setLength(512);
+    
+    fPool->releaseFrame(frame);
+    CPPUNIT_ASSERT(fPool->getIdleFrames() == idle + 1);
+    CPPUNIT_ASSERT(fPool->getIdleBytes() >= 1024);
+    
+    other = fPool->getVideoFrame(VP8, 1024);
+    CPPUNIT_ASSERT(other != frame);
+    CPPUNIT_ASSERT(fPool->getMisses() == misses + 2);
+    
+    CPPUNIT_ASSERT(fPool->getVideoFrame(H264, 1024) == frame);
+    CPPUNIT_ASSERT(fPool->getHits() == hits + 1);
+    CPPUNIT_ASSERT(frame->getLength() == 0);
+    
+    fPool->setMaxIdleBytes(0);
+    fPool->releaseFrame(frame);
+    fPool->releaseFrame(other);
+    CPPUNIT_ASSERT(fPool->getIdleFrames() == 0);
+    fPool->setMaxIdleBytes(POOL_MAX_IDLE_BYTES);
+}
+
+void AVFramedQueueTest::retainedFrame()
+{
+    StreamInfo si = {VIDEO};
+    Frame* frame = NULL;
+    Frame* retained = NULL;
+    size_t idle = FramePool::getInstance()->getIdleFrames();
+    
+    si.video.codec = VP8;
+    AVFramedQueue* vq = VideoFrameQueue::createNew(cData, &si, 2);
+    CPPUNIT_ASSERT(vq);
+    
+    frame = vq->getRear();
+    frame->setSequenceNumber(7);
+    vq->addFrame();
+    
+    retained = vq->getFront();
+    retained->retain();
+    CPPUNIT_ASSERT(retained->getRefs() == 2);
+    vq->removeFrame();
+    
+    vq->getRear()->setSequenceNumber(8);
+    vq->addFrame();
+    CPPUNIT_ASSERT(vq->getFront()->getSequenceNumber() == 8);
+    vq->removeFrame();
+    
+    frame = vq->getRear();
+    CPPUNIT_ASSERT(frame && frame != retained);
+    frame->setSequenceNumber(9);
+    CPPUNIT_ASSERT(retained->getSequenceNumber() == 7);
+    CPPUNIT_ASSERT(retained->getRefs() == 1);
+    
+    FramePool::getInstance()->releaseFrame(retained);
+    CPPUNIT_ASSERT(FramePool::getInstance()->getIdleFrames() == idle + 1);
+    
+    delete vq;
+    CPPUNIT_ASSERT(FramePool::getInstance()->getIdleFrames() == idle + 3);
+}
+
+void AVFramedQueueTest::bytesBudget()
+{
+    StreamInfo si = {VIDEO};
+    ConnectionData bData = cData;
+    Frame* frame = NULL;
+    
+    si.video.codec = VP8;
+    bData.maxFrames = 10;
+    bData.maxBytes = 1000;
+    AVFramedQueue* vq = VideoFrameQueue::createNew(bData, &si, 3);
+    CPPUNIT_ASSERT(vq);
+    CPPUNIT_ASSERT(vq->getMaxFrames() == 10);
+    CPPUNIT_ASSERT(vq->getMaxBytes() == 1000);
+    
+    for (unsigned i = 0; i < 2; i++) {
+        frame = vq->getRear();
+        CPPUNIT_ASSERT(frame);
+        frame->setLength(600);
+        frame->setSequenceNumber(i);
+        vq->addFrame();
+    }
+    
+    CPPUNIT_ASSERT(vq->getBytes() == 1200);
+    CPPUNIT_ASSERT(vq->isFull());
+    CPPUNIT_ASSERT(!vq->getRear());
+    
+    frame = vq->forceGetRear();
+    CPPUNIT_ASSERT(frame);
+    CPPUNIT_ASSERT(vq->getElements() == 1);
+    CPPUNIT_ASSERT(vq->getBytes() == 600);
+    
+    frame = vq->getFront();
+    CPPUNIT_ASSERT(frame && frame->getSequenceNumber() == 0);
+    vq->removeFrame();
+    CPPUNIT_ASSERT(vq->getBytes() == 0);
+    CPPUNIT_ASSERT(!vq->isFull());
+    
+    delete vq;
+}
+
+void AVFramedQueueTest::rawFrameSizing()
+{
+    StreamInfo si = {VIDEO};
+    VideoFrame* frame = NULL;
+    
+    FramePool::getInstance()->trim();
+    si.video.codec = RAW;
+    si.video.pixelFormat = RGB24;
+    AVFramedQueue* vq = VideoFrameQueue::createNew(cData, &si, 3);
+    CPPUNIT_ASSERT(vq);
+    
+    frame = dynamic_cast<VideoFrame*>(vq->getRear());
+    CPPUNIT_ASSERT(frame);
+    CPPUNIT_ASSERT(frame->getMaxLength() == 0);
+    
+    frame->fitBuffer(640, 360, RGB24);
+    CPPUNIT_ASSERT(frame->getMaxLength() == 640*360*3);
+    CPPUNIT_ASSERT(frame->getWidth() == 640 && frame->getHeight() == 360);
+    
+    frame->fitBuffer(1280, 720, RGB24);
+    CPPUNIT_ASSERT(frame->getMaxLength() == 1280*720*3);
+    
+    frame->fitBuffer(1280, 600, RGB24);
+    CPPUNIT_ASSERT(frame->getMaxLength() == 1280*720*3);
+    
+    frame->fitBuffer(320, 180, RGB24);
+    CPPUNIT_ASSERT(frame->getMaxLength() == 320*180*3);
+    
+    InterleavedVideoFrame::setShrinkRatio(0);
+    frame->fitBuffer(160, 90, RGB24);
+    CPPUNIT_ASSERT(frame->getMaxLength() == 320*180*3);
+    InterleavedVideoFrame::setShrinkRatio(DEFAULT_SHRINK_RATIO);
+    
+    CPPUNIT_ASSERT(dynamic_cast<VideoFrame*>(vq->forceGetFront())->getDataBuf());
+    
+    delete vq;
+}
+
+void AVFramedQueueTest::alignedBuffers()
+{
+    unsigned char* buffer = NULL;
+    InterleavedVideoFrame* vFrame = NULL;
+    AudioFrame* aFrame = NULL;
+    
+    buffer = Frame::allocBuffer(100);
+    CPPUNIT_ASSERT(buffer && ((uintptr_t) buffer) % FRAME_ALIGNMENT == 0);
+    for (unsigned i = 0; i < 100 + FRAME_PADDING; i++){
+        CPPUNIT_ASSERT(buffer[i] == 0);
+    }
+    Frame::freeBuffer(buffer);
+    
+    Frame::setHugePages(true);
+    buffer = Frame::allocBuffer(HUGE_PAGE_SIZE, true);
+    CPPUNIT_ASSERT(buffer && ((uintptr_t) buffer) % HUGE_PAGE_SIZE == 0);
+    Frame::freeBuffer(buffer);
+    Frame::setHugePages(false);
+    
+    vFrame = InterleavedVideoFrame::createNew(RAW, 1277, 719, RGB24);
+    CPPUNIT_ASSERT(((uintptr_t) vFrame->getDataBuf()) % FRAME_ALIGNMENT == 0);
+    delete vFrame;
+    
+    aFrame = PlanarAudioFrame::createNew(2, 48000, AudioFrame::getMaxSamples(48000), PCM, S16P);
+    for (unsigned i = 0; i < 2; i++){
+        CPPUNIT_ASSERT(((uintptr_t) aFrame->getPlanarDataBuf()[i]) % FRAME_ALIGNMENT == 0);
+    }
+    delete aFrame;
+    
+    aFrame = InterleavedAudioFrame::createNew(2, 48000, AudioFrame::getMaxSamples(48000), PCM, S16);
+    CPPUNIT_ASSERT(((uintptr_t) aFrame->getDataBuf()) % FRAME_ALIGNMENT == 0);
+    aFrame->fillWithValue(0);
+    delete aFrame;
+}
+
+void AVFramedQueueTest::planarVideoFrame()
+{
+    StreamInfo si = {VIDEO};
+    VideoFrame* frame = NULL;
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    
+    si.video.codec = RAW;
+    si.video.pixelFormat = YUV420P;
+    AVFramedQueue* vq = VideoFrameQueue::createNew(cData, &si, 3);
+    CPPUNIT_ASSERT(vq);
+    
+    frame = dynamic_cast<PlanarVideoFrame*>(vq->getRear());
+    CPPUNIT_ASSERT(frame && frame->isPlanar() && !frame->getDataBuf());
+    
+    frame->fitBuffer(1279, 719, YUV420P);
+    CPPUNIT_ASSERT(frame->getPlanes(data, linesize) == 1280*719 + 2*640*360);
+    CPPUNIT_ASSERT(frame->getLength() == 1280*719 + 2*640*360);
+    for (unsigned i = 0; i < 3; i++){
+        CPPUNIT_ASSERT(((uintptr_t) data[i]) % FRAME_ALIGNMENT == 0);
+        CPPUNIT_ASSERT(linesize[i] % FRAME_ALIGNMENT == 0);
+        CPPUNIT_ASSERT(data[i] == frame->getPlanarDataBuf()[i]);
+    }
+    CPPUNIT_ASSERT(linesize[0] == 1280 && linesize[1] == 640 && linesize[2] == 640);
+    CPPUNIT_ASSERT(data[1] == data[0] + 1280*719);
+    CPPUNIT_ASSERT(!data[3] && linesize[3] == 0);
+    
+    frame->fitBuffer(640, 360, RGB24);
+    CPPUNIT_ASSERT(frame->getPlanes(data, linesize) == 640*360*3);
+    CPPUNIT_ASSERT(linesize[0] == 640*3 && !data[1]);
+    
+    delete vq;
+    
+    frame = InterleavedVideoFrame::createNew(RAW, 1279, 719, YUV420P);
+    frame->fitBuffer(1279, 719, YUV420P);
+    CPPUNIT_ASSERT(frame->getPlanes(data, linesize) == 1279*719 + 2*640*360);
+    CPPUNIT_ASSERT(frame->getMaxLength() == 1279*719 + 2*640*360);
+    CPPUNIT_ASSERT(data[0] == frame->getDataBuf() && data[1] == data[0] + 1279*719);
+    CPPUNIT_ASSERT(data[2] == data[1] + 640*360 && linesize[1] == 640);
+    delete frame;
+    
+    CPPUNIT_ASSERT(VideoFrame::isPlanarFormat(YUV422P) && !VideoFrame::isPlanarFormat(YUYV422));
+}
+
+void AVFramedQueueTest::mjpegFrames()
+{
+    StreamInfo si = {VIDEO};
+    VideoFrame* frame = NULL;
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+
+    si.video.codec = MJPEG;
+    AVFramedQueue* vq = VideoFrameQueue::createNew(cData, &si, 3);
+    CPPUNIT_ASSERT(vq);
+
+    frame = dynamic_cast<InterleavedVideoFrame*>(vq->getRear());
+    CPPUNIT_ASSERT(frame && frame->getDataBuf() && frame->getMaxLength() == LENGTH_MJPEG);
+    CPPUNIT_ASSERT(frame->getPlanes(data, linesize) == 0);
+    delete vq;
+
+    frame = PlanarVideoFrame::createNew(RAW, 0, 0, YUVJ422P);
+    frame->fitBuffer(1920, 1080, YUVJ422P);
+    CPPUNIT_ASSERT(frame->getPlanes(data, linesize) == 1920*1080*2);
+    CPPUNIT_ASSERT(linesize[1] == 960 && linesize[2] == 960);
+    CPPUNIT_ASSERT(data[2] == data[1] + 960*1080);
+    delete frame;
+
+    CPPUNIT_ASSERT(utils::getPixTypeFromString(utils::getPixTypeAsString(YUVJ422P)) == YUVJ422P);
+}
+
+void AVFramedQueueTest::swapVideoFrames()
+{
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    unsigned char* picture;
+    
+    PlanarVideoFrame* planar = PlanarVideoFrame::createNew(RAW, 0, 0, YUV420P);
+    PlanarVideoFrame* other = PlanarVideoFrame::createNew(RAW, 0, 0, YUV420P);
+    InterleavedVideoFrame* interleaved = InterleavedVideoFrame::createNew(RAW, 0, 0, RGB24);
+    InterleavedVideoFrame* coded = InterleavedVideoFrame::createNew(H264, 1024);
+    
+    planar->fitBuffer(640, 360, YUV420P);
+    planar->getPlanes(data, linesize);
+    picture = data[0];
+    picture[0] = 7;
+    other->fitBuffer(320, 240, YUV422P);
+    
+    CPPUNIT_ASSERT(other->swapBuffer(planar));
+    CPPUNIT_ASSERT(other->getWidth() == 640 && other->getHeight() == 360 && other->getPixelFormat() == YUV420P);
+    CPPUNIT_ASSERT(other->getPlanarDataBuf()[0] == picture && picture[0] == 7);
+    CPPUNIT_ASSERT(planar->getWidth() == 320 && planar->getPixelFormat() == YUV422P);
+    CPPUNIT_ASSERT(planar->getPlanes(data, linesize) == planar->getLength() && data[0] != picture);
+    
+    CPPUNIT_ASSERT(!other->swapBuffer(interleaved) && !interleaved->swapBuffer(other));
+    CPPUNIT_ASSERT(!interleaved->swapBuffer(coded) && !other->swapBuffer(other));
+    
+    interleaved->fitBuffer(2, 2, RGB24);
+    picture = interleaved->getDataBuf();
+    CPPUNIT_ASSERT(!coded->swapBuffer(interleaved));
+    CPPUNIT_ASSERT(interleaved->getDataBuf() == picture && interleaved->getLength() == 12);
+    
+    delete planar;
+    delete other;
+    delete interleaved;
+    delete coded;
+}
+
+void AVFramedQueueTest::externalPlanes()
+{
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    unsigned char* planes[MAX_PLANES] = {NULL, NULL, NULL, NULL};
+    int lines[MAX_PLANES] = {704, 384, 384, 0};
+    unsigned char* picture = Frame::allocBuffer(704*480 + 2*384*240);
+    std::shared_ptr<void> owner(picture, [](void* p) {Frame::freeBuffer((unsigned char*) p);});
+    std::weak_ptr<void> alive = owner;
+    
+    StreamInfo si = {VIDEO};
+    si.video.codec = RAW;
+    si.video.pixelFormat = YUV420P;
+    AVFramedQueue* vq = VideoFrameQueue::createNew(cData, &si, 3);
+    PlanarVideoFrame* frame = dynamic_cast<PlanarVideoFrame*>(vq->getRear());
+    CPPUNIT_ASSERT(frame && !frame->hasExternalPlanes());
+    
+    planes[0] = picture;
+    planes[1] = picture + 704*480;
+    planes[2] = picture + 704*480 + 384*240;
+    
+    CPPUNIT_ASSERT(!frame->setExternalPlanes(720, 480, YUV420P, planes, lines, owner));
+    CPPUNIT_ASSERT(!frame->setExternalPlanes(704, 480, RGB24, planes, lines, owner));
+    CPPUNIT_ASSERT(frame->setExternalPlanes(704, 480, YUV420P, planes, lines, owner));
+    owner.reset();
+    
+    CPPUNIT_ASSERT(frame->hasExternalPlanes() && !alive.expired());
+    CPPUNIT_ASSERT(frame->getWidth() == 704 && frame->getHeight() == 480);
+    CPPUNIT_ASSERT(frame->getPlanes(data, linesize) == 704*480 + 2*384*240);
+    CPPUNIT_ASSERT(frame->getLength() == 704*480 + 2*384*240);
+    CPPUNIT_ASSERT(data[0] == picture && data[2] == planes[2] && linesize[1] == 384 && !data[3]);
+    CPPUNIT_ASSERT(frame->getPlanarDataBuf()[1] == planes[1]);
+    
+    //NOTE: writing a new picture goes back to the own buffer
+    frame->fitBuffer(704, 480, YUV420P);
+    CPPUNIT_ASSERT(!frame->hasExternalPlanes() && alive.expired());
+    CPPUNIT_ASSERT(frame->getPlanarDataBuf()[0] && frame->getLinesize()[1] == 384);
+    
+    owner = std::shared_ptr<void>(Frame::allocBuffer(704*480 + 2*384*240),
+                                  [](void* p) {Frame::freeBuffer((unsigned char*) p);});
+    alive = owner;
+    planes[0] = (unsigned char*) owner.get();
+    planes[1] = planes[0] + 704*480;
+    planes[2] = planes[1] + 384*240;
+    CPPUNIT_ASSERT(frame->setExternalPlanes(704, 480, YUV420P, planes, lines, owner));
+    owner.reset();
+    
+    frame->releasePlanes();
+    CPPUNIT_ASSERT(!frame->hasExternalPlanes() && alive.expired());
+    CPPUNIT_ASSERT(frame->getPlanes(data, linesize) == 704*480 + 2*384*240 && data[0]);
+    
+    delete vq;
+}
+
+void AVFramedQueueTest::externalBuffer()
+{
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    unsigned char* picture = Frame::allocBuffer(640*480*2);
+    std::shared_ptr<void> owner(picture, [](void* p) {Frame::freeBuffer((unsigned char*) p);});
+    std::weak_ptr<void> alive = owner;
+    InterleavedVideoFrame* coded = InterleavedVideoFrame::createNew(H264, 1000);
+    
+    StreamInfo si = {VIDEO};
+    si.video.codec = RAW;
+    si.video.pixelFormat = YUYV422;
+    AVFramedQueue* vq = VideoFrameQueue::createNew(cData, &si, 3);
+    InterleavedVideoFrame* frame = dynamic_cast<InterleavedVideoFrame*>(vq->getRear());
+    CPPUNIT_ASSERT(frame && !frame->hasExternalBuffer());
+    
+    CPPUNIT_ASSERT(!coded->setExternalBuffer(640, 480, YUYV422, picture, owner));
+    CPPUNIT_ASSERT(!frame->setExternalBuffer(640, 480, YUV420P, picture, owner));
+    CPPUNIT_ASSERT(frame->setExternalBuffer(640, 480, YUYV422, picture, owner));
+    owner.reset();
+    
+    CPPUNIT_ASSERT(frame->hasExternalBuffer() && !alive.expired());
+    CPPUNIT_ASSERT(frame->getDataBuf() == picture && frame->getLength() == 640*480*2);
+    CPPUNIT_ASSERT(frame->getPlanes(data, linesize) == 640*480*2);
+    CPPUNIT_ASSERT(data[0] == picture && linesize[0] == 640*2 && !data[1]);
+    
+    //NOTE: writing a new picture goes back to the own buffer, which may be allocated where the released one was
+    frame->fitBuffer(640, 480, YUYV422);
+    CPPUNIT_ASSERT(!frame->hasExternalBuffer() && alive.expired());
+    CPPUNIT_ASSERT(frame->getDataBuf() && frame->getLength() == 640*480*2);
+    
+    owner = std::shared_ptr<void>(Frame::allocBuffer(640*480*2), [](void* p) {Frame::freeBuffer((unsigned char*) p);});
+    alive = owner;
+    CPPUNIT_ASSERT(frame->setExternalBuffer(640, 480, YUYV422, (unsigned char*) owner.get(), owner));
+    owner.reset();
+    
+    frame->releaseBuffer();
+    CPPUNIT_ASSERT(!frame->hasExternalBuffer() && alive.expired());
+    CPPUNIT_ASSERT(frame->getDataBuf() != NULL);
+    
+    delete coded;
+    delete vq;
+}
+
+void AVFramedQueueTest::hardwareVideoFrame()
+{
+    StreamInfo si = {VIDEO};
+    HardwareVideoFrame* frame = NULL;
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    AVFrame* swFrame = av_frame_alloc();
+    
+    si.video.codec = RAW;
+    si.video.pixelFormat = HW_SURFACE;
+    AVFramedQueue* vq = VideoFrameQueue::createNew(cData, &si, 3);
+    CPPUNIT_ASSERT(vq);
+    
+    frame = dynamic_cast<HardwareVideoFrame*>(vq->getRear());
+    CPPUNIT_ASSERT(frame && frame->getPixelFormat() == HW_SURFACE);
+    CPPUNIT_ASSERT(!frame->getDataBuf() && frame->getMaxLength() == 0);
+    CPPUNIT_ASSERT(frame->getPlanes(data, linesize) == 0 && !data[0]);
+    
+    CPPUNIT_ASSERT(!frame->getSurface());
+    CPPUNIT_ASSERT(!frame->setSurface(swFrame));
+    CPPUNIT_ASSERT(!frame->download(swFrame));
+    
+    av_frame_free(&swFrame);
+    delete vq;
+}
+
+void AVFramedQueueTest::queueTelemetry()
+{
+    Jzon::Object node;
+    
+    for (unsigned i = 0; i < maxFrames - 1; i++) {
+        CPPUNIT_ASSERT(q->getRear());
+        q->addFrame();
+    }
+    CPPUNIT_ASSERT(q->getHighWater() == maxFrames - 1);
+    CPPUNIT_ASSERT(q->getOccupancy(OCCUPANCY_BUCKETS - 1) == 1);
+    CPPUNIT_ASSERT(q->getForcedFlushes() == 0);
+    
+    CPPUNIT_ASSERT(q->forceGetRear());
+    q->addFrame();
+    CPPUNIT_ASSERT(q->getForcedFlushes() == 1);
+    CPPUNIT_ASSERT(q->getLostBlocs() == 1);
+    CPPUNIT_ASSERT(q->getOccupancy(OCCUPANCY_BUCKETS - 1) == 2);
+    
+    while (q->getFront()) {
+        q->removeFrame();
+    }
+    CPPUNIT_ASSERT(q->getAvgResidency().count() == 0);
+    
+    for (unsigned i = 0; i < RESIDENCY_WINDOW; i++) {
+        CPPUNIT_ASSERT(q->getRear());
+        q->addFrame();
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+        CPPUNIT_ASSERT(q->getFront());
+        q->removeFrame();
+    }
+    CPPUNIT_ASSERT(q->getAvgResidency().count() >= 500);
+    CPPUNIT_ASSERT(q->getHighWater() == maxFrames - 1);
+    
+    q->getState(node);
+    CPPUNIT_ASSERT(node.Get("highWater").ToInt() == (int) maxFrames - 1);
+    CPPUNIT_ASSERT(node.Get("forcedFlushes").ToInt() == 1);
+    CPPUNIT_ASSERT(node.Get("occupancy").GetCount() == OCCUPANCY_BUCKETS);
+}
+
+void AVFramedQueueTest::latencyBound()
+{
+    StreamInfo ai(AUDIO);
+    StreamInfo vi(VIDEO);
+    ConnectionData lData = cData;
+    AVFramedQueue* aq;
+    AVFramedQueue* vq;
+    Frame* frame;
+    std::chrono::system_clock::time_point late = Frame::getOriginNow() - std::chrono::seconds(1);
+
+    ai.audio.codec = OPUS;
+    ai.audio.channels = 2;
+    ai.audio.sampleRate = 48000;
+    ai.audio.sampleFormat = S16;
+    vi.video.codec = VP8;
+    lData.maxFrames = 8;
+    lData.maxLatency = std::chrono::milliseconds(100);
+
+    aq = AudioFrameQueue::createNew(lData, &ai, 8);
+    CPPUNIT_ASSERT(aq && aq->getMaxLatency() == lData.maxLatency);
+
+    //NOTE: late frames are skipped, the newest one is kept even if it is late
+    for (unsigned i = 0; i < 4; i++) {
+        frame = aq->getRear();
+        frame->setSequenceNumber(i);
+        frame->setOriginTime(i < 2 ? late : Frame::getOriginNow());
+        aq->addFrame();
+    }
+
+    frame = aq->getFront();
+    CPPUNIT_ASSERT(frame && frame->getSequenceNumber() == 2);
+    CPPUNIT_ASSERT(aq->getSkippedFrames() == 2);
+    CPPUNIT_ASSERT(aq->getElements() == 2);
+    aq->removeFrame();
+    aq->removeFrame();
+
+    for (unsigned i = 0; i < 2; i++) {
+        frame = aq->getRear();
+        frame->setSequenceNumber(i);
+        frame->setOriginTime(late);
+        aq->addFrame();
+    }
+
+    frame = aq->getFront();
+    CPPUNIT_ASSERT(frame && frame->getSequenceNumber() == 1);
+    CPPUNIT_ASSERT(aq->getSkippedFrames() == 3);
+
+    //NOTE: coded frames without type are never skipped
+    vq = VideoFrameQueue::createNew(lData, &vi, 8);
+    CPPUNIT_ASSERT(vq);
+
+    for (unsigned i = 0; i < 2; i++) {
+        frame = vq->getRear();
+        frame->setSequenceNumber(i);
+        frame->setOriginTime(late);
+        vq->addFrame();
+    }
+
+    frame = vq->getFront();
+    CPPUNIT_ASSERT(frame && frame->getSequenceNumber() == 0);
+    CPPUNIT_ASSERT(vq->getSkippedFrames() == 0);
+
+    delete vq;
+    delete aq;
+}
+
+void AVFramedQueueTest::autoDepth()
+{
+    StreamInfo ai(AUDIO);
+    ConnectionData tData = cData;
+    AVFramedQueue* aq;
+    Jzon::Object node;
+    size_t bytes;
+
+    ai.audio.codec = OPUS;
+    ai.audio.channels = 2;
+    ai.audio.sampleRate = 48000;
+    ai.audio.sampleFormat = S16;
+    tData.maxFrames = 32;
+    tData.dropTarget = 0.01;
+
+    CPPUNIT_ASSERT(q->getDepth() == maxFrames - 1 && q->getDropTarget() == 0);
+
+    aq = AudioFrameQueue::createNew(tData, &ai, 8);
+    CPPUNIT_ASSERT(aq && aq->getDepth() == tData.maxFrames - 1);
+    bytes = aq->getAllocatedBytes();
+
+    //NOTE: a reader keeping up shrinks the depth by half each window, the freed frames are reused
+    for (unsigned i = 0; i < 5*TUNE_WINDOW; i++) {
+        CPPUNIT_ASSERT(aq->getRear());
+        aq->addFrame();
+        CPPUNIT_ASSERT(aq->getFront());
+        aq->removeFrame();
+    }
+    CPPUNIT_ASSERT(aq->getDepth() == MIN_TUNED_DEPTH);
+    CPPUNIT_ASSERT(aq->getAllocatedBytes() == bytes);
+    CPPUNIT_ASSERT(aq->getForcedFlushes() == 0);
+
+    CPPUNIT_ASSERT(aq->getRear());
+    aq->addFrame();
+    CPPUNIT_ASSERT(aq->getRear());
+    aq->addFrame();
+    CPPUNIT_ASSERT(!aq->getRear());
+
+    //NOTE: a stalled reader makes frames drop above the target, the depth doubles
+    for (unsigned i = 0; i < TUNE_WINDOW; i++) {
+        CPPUNIT_ASSERT(aq->forceGetRear());
+        aq->addFrame();
+    }
+    CPPUNIT_ASSERT(aq->getDepth() == 2*MIN_TUNED_DEPTH);
+    CPPUNIT_ASSERT(aq->getForcedFlushes() > 0);
+
+    aq->getState(node);
+    CPPUNIT_ASSERT(node.Get("depth").ToInt() == 2*MIN_TUNED_DEPTH);
+    CPPUNIT_ASSERT(node.Get("dropTarget").ToDouble() > 0);
+
+    delete aq;
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(AVFramedQueueTest);
 
 int main(int argc, char* argv[])
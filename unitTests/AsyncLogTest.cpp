@@ -0,0 +1,184 @@
+/*
+ *  AsyncLogTest.cpp - AsyncLog class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "AsyncLog.hh"
+#include "Utils.hh"
+
+class AsyncLogTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(AsyncLogTest);
+    CPPUNIT_TEST(levels);
+    CPPUNIT_TEST(formatting);
+    CPPUNIT_TEST(rateLimit);
+    CPPUNIT_TEST(dropping);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void levels();
+    void formatting();
+    void rateLimit();
+    void dropping();
+
+    void sink(DefinedLogLevel level, const char *message);
+
+    AsyncLog *log;
+    std::mutex mtx;
+    std::mutex blockMtx;
+    std::atomic<bool> sinking;
+    std::vector<std::pair<DefinedLogLevel, std::string>> messages;
+};
+
+void AsyncLogTest::setUp()
+{
+    sinking = false;
+    log = new AsyncLog(std::bind(&AsyncLogTest::sink, this, std::placeholders::_1, std::placeholders::_2));
+}
+
+void AsyncLogTest::tearDown()
+{
+    delete log;
+    messages.clear();
+}
+
+void AsyncLogTest::sink(DefinedLogLevel level, const char *message)
+{
+    sinking = true;
+    std::lock_guard<std::mutex> block(blockMtx);
+    std::lock_guard<std::mutex> guard(mtx);
+    messages.push_back(std::make_pair(level, std::string(message)));
+}
+
+void AsyncLogTest::levels()
+{
+    CPPUNIT_ASSERT_EQUAL(INFO, log->getLevel());
+    CPPUNIT_ASSERT(log->isEnabled(ERROR));
+    CPPUNIT_ASSERT(log->isEnabled(INFO));
+    CPPUNIT_ASSERT(!log->isEnabled(DEBUG));
+
+    log->setLevel(WARNING);
+    CPPUNIT_ASSERT(log->isEnabled(WARNING));
+    CPPUNIT_ASSERT(!log->isEnabled(INFO));
+
+    log->setLevel(DEBUG);
+    CPPUNIT_ASSERT(log->isEnabled(DEBUG));
+
+    log->write(ERROR, "error");
+    log->write(DEBUG, "debug");
+    log->flush();
+
+    CPPUNIT_ASSERT_EQUAL((size_t) 2, messages.size());
+    CPPUNIT_ASSERT_EQUAL(ERROR, messages[0].first);
+    CPPUNIT_ASSERT_EQUAL(std::string("error"), messages[0].second);
+    CPPUNIT_ASSERT_EQUAL(DEBUG, messages[1].first);
+}
+
+void AsyncLogTest::formatting()
+{
+    log->write(WARNING, 0, "channel %d of %s", 3, "mixer");
+    log->write(WARNING, 5, "discarded");
+    log->write(INFO, std::string(LOG_MESSAGE_LENGTH*2, 'x'));
+    log->flush();
+
+    CPPUNIT_ASSERT_EQUAL((size_t) 3, messages.size());
+    CPPUNIT_ASSERT_EQUAL(std::string("channel 3 of mixer"), messages[0].second);
+    CPPUNIT_ASSERT_EQUAL(std::string("discarded (5 similar messages suppressed)"), messages[1].second);
+    CPPUNIT_ASSERT_EQUAL((size_t) LOG_MESSAGE_LENGTH - 1, messages[2].second.size());
+}
+
+void AsyncLogTest::rateLimit()
+{
+    LogRateLimit limit;
+    unsigned suppressed = 0;
+    unsigned allowed = 0;
+
+    for (unsigned i = 0; i < LOG_RATE_BURST + 5; i++) {
+        if (limit.allow(suppressed)) {
+            CPPUNIT_ASSERT_EQUAL(0u, suppressed);
+            allowed++;
+        }
+    }
+
+    CPPUNIT_ASSERT_EQUAL((unsigned) LOG_RATE_BURST, allowed);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(LOG_RATE_PERIOD + 10));
+
+    CPPUNIT_ASSERT(limit.allow(suppressed));
+    CPPUNIT_ASSERT_EQUAL(5u, suppressed);
+}
+
+void AsyncLogTest::dropping()
+{
+    size_t written = LOG_SLOTS + 10;
+
+    {
+        //NOTE: the drain thread blocks on the first message, so the ring fills up
+        std::lock_guard<std::mutex> block(blockMtx);
+        log->write(INFO, "first");
+        while (!sinking) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        for (size_t i = 0; i < written; i++) {
+            log->write(INFO, 0, "message %zu", i);
+        }
+    }
+
+    log->flush();
+
+    CPPUNIT_ASSERT(log->getDropped() >= 10);
+    CPPUNIT_ASSERT_EQUAL(written + 2, messages.size() + log->getDropped());
+    CPPUNIT_ASSERT_EQUAL(WARNING, messages.back().first);
+    CPPUNIT_ASSERT(messages.back().second.find("log messages dropped") != std::string::npos);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(AsyncLogTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("AsyncLogTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
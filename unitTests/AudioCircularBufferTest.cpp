@@ -20,9 +20,12 @@
  */
 
 #include <string>
+#include <thread>
 #include <iostream>
 #include <fstream>
 #include <string.h>
+#include <cmath>
+#include <algorithm>
 
 #include <cppunit/extensions/TestFactoryRegistry.h>
 #include <cppunit/extensions/HelperMacros.h>
@@ -32,6 +35,7 @@
 #include <cppunit/XmlOutputter.h>
 
 #include "AudioCircularBuffer.hh"
+#include "SampleConverter.hh"
 #include "Utils.hh"
 
 typedef struct {
@@ -47,6 +51,13 @@ class AudioCircularBufferTest : public CppUnit::TestFixture
     CPPUNIT_TEST(timestampGap);
     CPPUNIT_TEST(timestampOverlapping);
     CPPUNIT_TEST(flushBecauseOfDeviation);
+    CPPUNIT_TEST(flushFullBuffer);
+    CPPUNIT_TEST(concurrentBehaviour);
+    CPPUNIT_TEST(interleavedFormat);
+    CPPUNIT_TEST(sampleConversion);
+    CPPUNIT_TEST(surroundChannels);
+    CPPUNIT_TEST(driftCompensation);
+    CPPUNIT_TEST(defaultFrameTime);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -59,6 +70,13 @@ protected:
     void timestampGap();
     void timestampOverlapping();
     void flushBecauseOfDeviation();
+    void flushFullBuffer();
+    void concurrentBehaviour();
+    void interleavedFormat();
+    void sampleConversion();
+    void surroundChannels();
+    void driftCompensation();
+    void defaultFrameTime();
 
     struct ConnectionData cData;
 
@@ -89,7 +107,7 @@ void AudioCircularBufferTest::create()
     unsigned badMaxSamples = 0;
     unsigned badChannels = 0;
     unsigned badSampleRate = 0;
-    SampleFmt badFormat = FLT;
+    SampleFmt badFormat = S_NONE;
     AudioCircularBuffer* tmpbuffer;
 
     tmpbuffer = AudioCircularBuffer::createNew(cData, badChannels, sampleRate, maxSamples, format);
@@ -101,7 +119,7 @@ void AudioCircularBufferTest::create()
     tmpbuffer = AudioCircularBuffer::createNew(cData, channels, sampleRate, badMaxSamples, format);
     CPPUNIT_ASSERT(!tmpbuffer);
 
-    tmpbuffer = AudioCircularBuffer::createNew(cData, channels, badSampleRate, maxSamples, badFormat);
+    tmpbuffer = AudioCircularBuffer::createNew(cData, channels, sampleRate, maxSamples, badFormat);
     CPPUNIT_ASSERT(!tmpbuffer);
 
     tmpbuffer = AudioCircularBuffer::createNew(cData, channels, sampleRate, maxSamples, format);
@@ -326,6 +344,384 @@ void AudioCircularBufferTest::flushBecauseOfDeviation()
     buffer->removeFrame();
 }
 
+void AudioCircularBufferTest::flushFullBuffer()
+{
+    AudioFrame* aFrame;
+    Frame* outFrame;
+    const unsigned samplesPerFrame = 40;
+    const int freeSamples = buffer->getFreeSamples();
+    std::chrono::microseconds ts(0);
+    std::chrono::microseconds newSyncTime(1000000);
+    unsigned frames = 0;
+    buffer->setOutputFrameSamples(samplesPerFrame);
+
+    while (buffer->getFreeSamples() >= (int) samplesPerFrame) {
+        aFrame = dynamic_cast<AudioFrame*>(buffer->getRear());
+        aFrame->fillWithValue(1);
+        aFrame->setSamples(samplesPerFrame);
+        aFrame->setPresentationTime(ts + std::chrono::microseconds(frames*samplesPerFrame*std::micro::den/sampleRate));
+        buffer->addFrame();
+        frames++;
+    }
+
+    CPPUNIT_ASSERT(buffer->getElements() == frames);
+
+    buffer->flush();
+    CPPUNIT_ASSERT(buffer->getElements() == 0);
+
+    //NOTE: the flushed samples are free before the reader skips them
+    CPPUNIT_ASSERT(buffer->getFreeSamples() == freeSamples);
+
+    //NOTE: keeps pushing and popping for more than the ring length
+    for (unsigned i = 0; i < 3*frames; i++) {
+        aFrame = dynamic_cast<AudioFrame*>(buffer->getRear());
+        aFrame->fillWithValue(i % 256);
+        aFrame->setSamples(samplesPerFrame);
+        aFrame->setPresentationTime(newSyncTime + std::chrono::microseconds(i*samplesPerFrame*std::micro::den/sampleRate));
+        buffer->addFrame();
+
+        outFrame = buffer->getFront();
+        CPPUNIT_ASSERT(outFrame);
+        CPPUNIT_ASSERT(outFrame->getPlanarDataBuf()[1][0] == i % 256);
+        CPPUNIT_ASSERT(outFrame->getPresentationTime() == newSyncTime + std::chrono::microseconds(i*samplesPerFrame*std::micro::den/sampleRate));
+        buffer->removeFrame();
+    }
+
+    CPPUNIT_ASSERT(buffer->getElements() == 0);
+}
+
+void AudioCircularBufferTest::concurrentBehaviour()
+{
+    const unsigned samplesPerFrame = 40;
+    const unsigned outputSamples = 80;
+    const unsigned frames = 20000;
+    bool ordered = true;
+    buffer->setOutputFrameSamples(outputSamples);
+
+    std::thread writer([&](){
+        for (unsigned i = 0; i < frames; i++) {
+            AudioFrame* aFrame = dynamic_cast<AudioFrame*>(buffer->getRear());
+            
+            while (buffer->getFreeSamples() < (int) samplesPerFrame) {
+                std::this_thread::yield();
+            }
+            
+            aFrame->fillWithValue(i % 256);
+            aFrame->setSamples(samplesPerFrame);
+            aFrame->setPresentationTime(std::chrono::microseconds(i*samplesPerFrame*std::micro::den/sampleRate));
+            buffer->addFrame();
+        }
+    });
+
+    for (unsigned o = 0; o < frames*samplesPerFrame/outputSamples; o++) {
+        Frame* outFrame;
+        
+        while (!(outFrame = buffer->getFront())) {
+            std::this_thread::yield();
+        }
+        
+        for (unsigned ch = 0; ch < channels; ch++) {
+            unsigned char* samples = outFrame->getPlanarDataBuf()[ch];
+            for (unsigned b = 0; b < outputSamples*bytesPerSample; b++) {
+                ordered &= samples[b] == (2*o + b/(samplesPerFrame*bytesPerSample)) % 256;
+            }
+        }
+        
+        ordered &= outFrame->getPresentationTime() == 
+            std::chrono::microseconds(o*outputSamples*std::micro::den/sampleRate);
+        buffer->removeFrame();
+    }
+
+    writer.join();
+    CPPUNIT_ASSERT(ordered);
+    CPPUNIT_ASSERT(buffer->getElements() == 0);
+}
+
+void AudioCircularBufferTest::interleavedFormat()
+{
+    AudioCircularBuffer* sBuffer;
+    AudioFrame* inFrame;
+    AudioFrame* outFrame;
+    unsigned samplesPerFrame = 60;
+    unsigned outputSamples = 80;
+    int16_t* in;
+    int16_t* out;
+    unsigned outCount = 0;
+
+    sBuffer = AudioCircularBuffer::createNew(cData, channels, sampleRate, maxSamples, S16);
+    CPPUNIT_ASSERT(sBuffer);
+    sBuffer->setOutputFrameSamples(outputSamples);
+
+    //NOTE: frames wrap the ring several times, each sample carries its index and channel
+    for (unsigned f = 0; f < 40; f++) {
+        inFrame = dynamic_cast<AudioFrame*>(sBuffer->getRear());
+        CPPUNIT_ASSERT(inFrame && !inFrame->isPlanar());
+        in = (int16_t*) inFrame->getDataBuf();
+
+        for (unsigned i = 0; i < samplesPerFrame; i++) {
+            in[i*channels] = f*samplesPerFrame + i;
+            in[i*channels + 1] = -(int16_t)(f*samplesPerFrame + i);
+        }
+
+        inFrame->setSamples(samplesPerFrame);
+        inFrame->setLength(samplesPerFrame*channels*bytesPerSample);
+        inFrame->setPresentationTime(std::chrono::microseconds(f*samplesPerFrame*std::micro::den/sampleRate));
+        sBuffer->addFrame();
+
+        while ((outFrame = dynamic_cast<AudioFrame*>(sBuffer->getFront())) != NULL) {
+            CPPUNIT_ASSERT(!outFrame->isPlanar());
+            CPPUNIT_ASSERT(outFrame->getLength() == outputSamples*channels*bytesPerSample);
+            out = (int16_t*) outFrame->getDataBuf();
+
+            for (unsigned i = 0; i < outputSamples; i++) {
+                CPPUNIT_ASSERT(out[i*channels] == (int16_t)(outCount + i));
+                CPPUNIT_ASSERT(out[i*channels + 1] == -(int16_t)(outCount + i));
+            }
+
+            outCount += outputSamples;
+            sBuffer->removeFrame();
+        }
+    }
+
+    CPPUNIT_ASSERT(outCount == (40*samplesPerFrame/outputSamples)*outputSamples);
+    delete sBuffer;
+}
+
+void AudioCircularBufferTest::sampleConversion()
+{
+    const unsigned samples = 301;
+    unsigned char s16[samples*2*2];
+    unsigned char u8[samples*2];
+    float planes[2][samples];
+    float back[2][samples];
+    unsigned char* fltPlanes[2] = {(unsigned char*) planes[0], (unsigned char*) planes[1]};
+    unsigned char* backPlanes[2] = {(unsigned char*) back[0], (unsigned char*) back[1]};
+    unsigned char* s16Buffer[1] = {s16};
+    unsigned char* u8Buffer[1] = {u8};
+
+    for (unsigned i = 0; i < samples; i++) {
+        planes[0][i] = (i % 64)/32.0f - 1;
+        planes[1][i] = i == 0 ? 1.5f : -planes[0][i]*0.5f;
+    }
+
+    CPPUNIT_ASSERT(SampleConverter::convert(fltPlanes, FLTP, s16Buffer, S16, 2, samples));
+    CPPUNIT_ASSERT(s16[2] == 0xFF && s16[3] == 0x7F);
+    CPPUNIT_ASSERT(SampleConverter::convert(s16Buffer, S16, backPlanes, FLTP, 2, samples));
+    
+    for (unsigned i = 1; i < samples; i++) {
+        CPPUNIT_ASSERT(back[0][i] == planes[0][i] && back[1][i] == planes[1][i]);
+    }
+    
+    CPPUNIT_ASSERT(SampleConverter::convert(s16Buffer, S16, u8Buffer, U8, 2, samples));
+    CPPUNIT_ASSERT(SampleConverter::convert(u8Buffer, U8, backPlanes, FLTP, 2, samples));
+    
+    for (unsigned i = 1; i < samples; i++) {
+        CPPUNIT_ASSERT(std::abs(back[0][i] - planes[0][i]) < 1/128.0f);
+    }
+
+    CPPUNIT_ASSERT(!SampleConverter::convert(s16Buffer, S16, backPlanes, S_NONE, 2, samples));
+
+    //NOTE: kernels selected once give the same samples than the conversions selecting them per call
+    SampleConverter::ToFloatKernel toFloat = SampleConverter::getToFloatKernel(S16, 2);
+    CPPUNIT_ASSERT(toFloat && toFloat == SampleConverter::getToFloatKernel(S16P, 2));
+    CPPUNIT_ASSERT(toFloat != SampleConverter::getToFloatKernel(S16, 1));
+    CPPUNIT_ASSERT(!SampleConverter::getToFloatKernel(S_NONE) && !SampleConverter::getFromFloatKernel(S_NONE));
+
+    toFloat(s16 + 2, back[1], samples, 2);
+    CPPUNIT_ASSERT(SampleConverter::toFloat(s16 + 2, S16, back[0], samples, 2));
+    CPPUNIT_ASSERT(memcmp(back[0], back[1], sizeof(back[0])) == 0);
+
+    SampleConverter::getFromFloatKernel(S16P)(back[1], s16, samples, 1);
+    CPPUNIT_ASSERT(SampleConverter::fromFloat(back[1], s16 + samples*2, S16P, samples));
+    CPPUNIT_ASSERT(memcmp(s16, s16 + samples*2, samples*2) == 0);
+}
+
+void AudioCircularBufferTest::surroundChannels()
+{
+    AudioCircularBuffer* sBuffer;
+    AudioFrame* inFrame;
+    AudioFrame* outFrame;
+    unsigned surroundCh = utils::getChannelsFromLayout(SURROUND_5_1);
+    unsigned samplesPerFrame = 60;
+    unsigned outputSamples = 80;
+    int16_t* in;
+    int16_t* out;
+    float* plane;
+    unsigned outCount = 0;
+
+    CPPUNIT_ASSERT(!AudioCircularBuffer::createNew(cData, MAX_CHANNELS + 1, sampleRate, maxSamples, S16));
+
+    sBuffer = AudioCircularBuffer::createNew(cData, surroundCh, sampleRate, maxSamples, S16);
+    CPPUNIT_ASSERT(sBuffer);
+    sBuffer->setOutputFrameSamples(outputSamples);
+
+    for (unsigned f = 0; f < 20; f++) {
+        inFrame = dynamic_cast<AudioFrame*>(sBuffer->getRear());
+        CPPUNIT_ASSERT(inFrame && inFrame->getChannels() == surroundCh);
+        in = (int16_t*) inFrame->getDataBuf();
+
+        for (unsigned i = 0; i < samplesPerFrame; i++) {
+            for (unsigned c = 0; c < surroundCh; c++) {
+                in[i*surroundCh + c] = (f*samplesPerFrame + i)*(c + 1);
+            }
+        }
+
+        inFrame->setSamples(samplesPerFrame);
+        inFrame->setLength(samplesPerFrame*surroundCh*bytesPerSample);
+        inFrame->setPresentationTime(std::chrono::microseconds(f*samplesPerFrame*std::micro::den/sampleRate));
+        sBuffer->addFrame();
+
+        while ((outFrame = dynamic_cast<AudioFrame*>(sBuffer->getFront())) != NULL) {
+            CPPUNIT_ASSERT(outFrame->getLength() == outputSamples*surroundCh*bytesPerSample);
+            out = (int16_t*) outFrame->getDataBuf();
+
+            for (unsigned i = 0; i < outputSamples; i++) {
+                for (unsigned c = 0; c < surroundCh; c++) {
+                    CPPUNIT_ASSERT(out[i*surroundCh + c] == (int16_t)((outCount + i)*(c + 1)));
+                }
+            }
+
+            outCount += outputSamples;
+            sBuffer->removeFrame();
+        }
+    }
+
+    CPPUNIT_ASSERT(outCount == (20*samplesPerFrame/outputSamples)*outputSamples);
+    delete sBuffer;
+
+    sBuffer = AudioCircularBuffer::createNew(cData, MAX_CHANNELS, sampleRate, maxSamples, FLTP);
+    CPPUNIT_ASSERT(sBuffer);
+    sBuffer->setOutputFrameSamples(samplesPerFrame);
+
+    inFrame = dynamic_cast<AudioFrame*>(sBuffer->getRear());
+    CPPUNIT_ASSERT(inFrame && inFrame->getPlanarDataBuf()[MAX_CHANNELS - 1]);
+
+    for (unsigned c = 0; c < MAX_CHANNELS; c++) {
+        plane = (float*) inFrame->getPlanarDataBuf()[c];
+        std::fill_n(plane, samplesPerFrame, c/(float)MAX_CHANNELS);
+    }
+
+    inFrame->setSamples(samplesPerFrame);
+    inFrame->setLength(samplesPerFrame*sizeof(float));
+    inFrame->setPresentationTime(std::chrono::microseconds(0));
+    sBuffer->addFrame();
+
+    outFrame = dynamic_cast<AudioFrame*>(sBuffer->getFront());
+    CPPUNIT_ASSERT(outFrame && outFrame->getChannels() == MAX_CHANNELS);
+
+    for (unsigned c = 0; c < MAX_CHANNELS; c++) {
+        plane = (float*) outFrame->getPlanarDataBuf()[c];
+        CPPUNIT_ASSERT(plane[0] == c/(float)MAX_CHANNELS && plane[samplesPerFrame - 1] == c/(float)MAX_CHANNELS);
+    }
+
+    delete sBuffer;
+}
+
+void AudioCircularBufferTest::driftCompensation()
+{
+    AudioCircularBuffer* sBuffer;
+    AudioFrame* inFrame;
+    AudioFrame* outFrame;
+    const unsigned writerSamples = 2401;
+    const unsigned readerSamples = 480;
+    const unsigned target = 4800;
+    const unsigned ticks = 30000;
+    std::chrono::microseconds lastTs(-1);
+    size_t pushed = 0;
+    unsigned underruns = 0;
+    unsigned fill = 0;
+    float* plane;
+
+    sBuffer = AudioCircularBuffer::createNew(cData, channels, sampleRate, maxSamples, FLTP);
+    CPPUNIT_ASSERT(sBuffer);
+    sBuffer->setOutputFrameSamples(readerSamples);
+    sBuffer->setDriftCompensation(target);
+    CPPUNIT_ASSERT(sBuffer->getDriftTarget() == target && sBuffer->getDriftRatio() == 1);
+
+    //NOTE: the writer clock runs 1/2400 faster than the reader one, one extra sample every 5 reads
+    for (unsigned t = 0; t < ticks; t++) {
+        while (t % 5 == 0 && pushed < (t/5 + 2)*writerSamples) {
+            inFrame = dynamic_cast<AudioFrame*>(sBuffer->getRear());
+            inFrame->setSamples(writerSamples);
+            inFrame->setLength(writerSamples*sizeof(float));
+
+            for (unsigned c = 0; c < channels; c++) {
+                std::fill((float*) inFrame->getPlanarDataBuf()[c], (float*) inFrame->getPlanarDataBuf()[c] + writerSamples, 0.5f);
+            }
+
+            inFrame->setPresentationTime(std::chrono::microseconds(pushed*std::micro::den/sampleRate));
+            sBuffer->addFrame();
+            pushed += writerSamples;
+        }
+
+        outFrame = dynamic_cast<AudioFrame*>(sBuffer->getFront());
+
+        if (!outFrame) {
+            underruns++;
+            continue;
+        }
+
+        //NOTE: output frames follow each other at the nominal rate, whatever they consumed
+        if (lastTs.count() >= 0) {
+            CPPUNIT_ASSERT(outFrame->getPresentationTime() - lastTs == std::chrono::microseconds(10000));
+        }
+
+        lastTs = outFrame->getPresentationTime();
+        plane = (float*) outFrame->getPlanarDataBuf()[1];
+
+        if (t > ticks/2) {
+            CPPUNIT_ASSERT(std::abs(plane[0] - 0.5f) < 1e-3 && std::abs(plane[readerSamples - 1] - 0.5f) < 1e-3);
+        }
+
+        sBuffer->removeFrame();
+        fill = sBuffer->getChannelMaxSamples()*(sampleRate/1000) - sBuffer->getFreeSamples();
+    }
+
+    CPPUNIT_ASSERT(underruns == 0);
+    CPPUNIT_ASSERT(fill > target/2 && fill < target*3/2);
+    CPPUNIT_ASSERT(std::abs(sBuffer->getDriftRatio() - (1 + 1.0/2400)) < 100e-6);
+
+    sBuffer->setDriftCompensation(0);
+    CPPUNIT_ASSERT(sBuffer->getDriftRatio() == 1);
+
+    delete sBuffer;
+}
+
+void AudioCircularBufferTest::defaultFrameTime()
+{
+    AudioCircularBuffer* sBuffer;
+    AudioFrame* inFrame;
+    AudioFrame* outFrame;
+    const unsigned frameSamples = 240;
+
+    CPPUNIT_ASSERT(!AudioFrame::setDefaultFrameTime(std::chrono::microseconds(1000)));
+    CPPUNIT_ASSERT(!AudioFrame::setDefaultFrameTime(std::chrono::microseconds(MAX_FRAME_TIME*1000 + 1)));
+    CPPUNIT_ASSERT(AudioFrame::getDefaultFrameTime() == std::chrono::microseconds(DEFAULT_FRAME_TIME));
+
+    CPPUNIT_ASSERT(AudioFrame::setDefaultFrameTime(std::chrono::microseconds(5000)));
+    CPPUNIT_ASSERT(AudioFrame::getDefaultSamples(sampleRate) == frameSamples);
+
+    //NOTE: buffers created afterwards output the shorter frames
+    sBuffer = AudioCircularBuffer::createNew(cData, channels, sampleRate, maxSamples, format);
+    CPPUNIT_ASSERT(sBuffer);
+
+    inFrame = dynamic_cast<AudioFrame*>(sBuffer->getRear());
+    inFrame->setSamples(frameSamples*2);
+    inFrame->setLength(frameSamples*2*bytesPerSample);
+    inFrame->setPresentationTime(std::chrono::microseconds(0));
+    sBuffer->addFrame();
+
+    outFrame = dynamic_cast<AudioFrame*>(sBuffer->getFront());
+    CPPUNIT_ASSERT(outFrame && outFrame->getSamples() == frameSamples);
+    sBuffer->removeFrame();
+
+    outFrame = dynamic_cast<AudioFrame*>(sBuffer->getFront());
+    CPPUNIT_ASSERT(outFrame && outFrame->getPresentationTime() == std::chrono::microseconds(5000));
+
+    delete sBuffer;
+    CPPUNIT_ASSERT(AudioFrame::setDefaultFrameTime(std::chrono::microseconds(DEFAULT_FRAME_TIME)));
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(AudioCircularBufferTest);
 
 int main(int argc, char* argv[])
@@ -22,6 +22,8 @@
 #include <string>
 #include <iostream>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
 #include <fstream>
 
 #include <cppunit/extensions/TestFactoryRegistry.h>
@@ -61,6 +63,11 @@ class AudioMixerFunctionalTest : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(AudioMixerFunctionalTest);
     CPPUNIT_TEST(mixingTest);
+    CPPUNIT_TEST(mixingKernels);
+    CPPUNIT_TEST(mixMinusTest);
+    CPPUNIT_TEST(silenceDetection);
+    CPPUNIT_TEST(groupedMixing);
+    CPPUNIT_TEST(groupedCompression);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -69,6 +76,12 @@ public:
 
 protected:
     void mixingTest();
+    void mixingKernels();
+    void mixMinusTest();
+    void silenceDetection();
+    void groupedMixing();
+    void groupedCompression();
+    float mixConstantInputs(unsigned groups, int inputs, float step);
 
     int channels = 2;
     int sampleRate = 48000;
@@ -171,6 +184,385 @@ void AudioMixerFunctionalTest::mixingTest()
     }
 }
 
+void AudioMixerFunctionalTest::mixingKernels()
+{
+    const unsigned nOfSamples = 1027;
+    const unsigned participants = 32;
+    const float gain = 0.8*DEFAULT_MASTER_GAIN;
+    float* spans[participants];
+    unsigned char* s16Spans[participants];
+    float mixed[nOfSamples];
+    float reference[nOfSamples];
+
+    for (unsigned p = 0; p < participants; p++) {
+        spans[p] = new float[nOfSamples];
+        s16Spans[p] = new unsigned char[nOfSamples*2];
+
+        for (unsigned i = 0; i < nOfSamples; i++) {
+            spans[p][i] = sinf(i*(p + 1)*0.01f);
+            AudioMixer::floatToBytes(s16Spans[p] + i*2, spans[p][i]*0.99f, S16P);
+        }
+    }
+
+    std::fill_n(mixed, nOfSamples, 0);
+    std::fill_n(reference, nOfSamples, 0);
+
+    for (unsigned p = 0; p < participants; p++) {
+        //NOTE: an odd offset leaves unaligned heads and tails to the vectorised kernel
+        CPPUNIT_ASSERT(AudioMixer::mixSamples(mixed + 1, (unsigned char*) (spans[p] + 1), nOfSamples - 1, FLTP, gain, COMPRESSION_THRESHOLD));
+        CPPUNIT_ASSERT(AudioMixer::mixSamplesScalar(reference + 1, (unsigned char*) (spans[p] + 1), nOfSamples - 1, FLTP, gain, COMPRESSION_THRESHOLD));
+    }
+
+    for (unsigned i = 0; i < nOfSamples; i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(reference[i], mixed[i], 1e-5);
+        CPPUNIT_ASSERT(mixed[i] <= 1 && mixed[i] >= -1);
+    }
+
+    std::fill_n(mixed, nOfSamples, 0);
+    std::fill_n(reference, nOfSamples, 0);
+
+    for (unsigned p = 0; p < participants; p++) {
+        CPPUNIT_ASSERT(AudioMixer::mixSamples(mixed, s16Spans[p], nOfSamples, S16P, gain, COMPRESSION_THRESHOLD));
+        CPPUNIT_ASSERT(AudioMixer::mixSamplesScalar(reference, s16Spans[p], nOfSamples, S16P, gain, COMPRESSION_THRESHOLD));
+    }
+
+    for (unsigned i = 0; i < nOfSamples; i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(reference[i], mixed[i], 1e-5);
+    }
+
+    std::fill_n(mixed, nOfSamples, 0);
+    std::fill_n(reference, nOfSamples, 0);
+
+    //NOTE: the right channel of interleaved stereo S16 spans
+    for (unsigned p = 0; p < participants; p++) {
+        CPPUNIT_ASSERT(AudioMixer::mixSamples(mixed, s16Spans[p] + 2, nOfSamples/2, S16, gain, COMPRESSION_THRESHOLD, 2));
+        CPPUNIT_ASSERT(AudioMixer::mixSamplesScalar(reference, s16Spans[p] + 2, nOfSamples/2, S16, gain, COMPRESSION_THRESHOLD, 2));
+    }
+
+    for (unsigned i = 0; i < nOfSamples/2; i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(reference[i], mixed[i], 1e-5);
+    }
+
+    CPPUNIT_ASSERT(!AudioMixer::mixSamples(mixed, s16Spans[0], nOfSamples, S_NONE, gain, COMPRESSION_THRESHOLD));
+
+    for (unsigned p = 0; p < participants; p++) {
+        delete[] spans[p];
+        delete[] s16Spans[p];
+    }
+}
+
+void AudioMixerFunctionalTest::mixMinusTest()
+{
+    const int fullMixId = 0;
+    std::map<int, float> values = {{1, 0.1}, {2, 0.2}, {3, 0.05}};
+    std::map<int, PlanarAudioFrame*> frames;
+    AudioMixer* mmMixer;
+    ManyToOneAudioScenarioMockup* mmScenario;
+    PlanarAudioFrame* mixedFrame;
+    std::chrono::microseconds ts;
+    std::chrono::microseconds tsIncrement;
+    unsigned introducedSamples;
+    unsigned nOfSamples;
+    int bytesPerSample;
+    float total;
+    float expected;
+    float sample;
+
+    mmMixer = new AudioMixer();
+    mmScenario = new ManyToOneAudioScenarioMockup(mmMixer);
+    nOfSamples = mmMixer->getInputFrameSamples();
+    bytesPerSample = utils::getBytesPerSampleFromFormat(sFmt);
+    total = 0;
+
+    for (auto v : values) {
+        CPPUNIT_ASSERT(mmScenario->addHeadFilter(v.first, channels, sampleRate, sFmt)); 
+        CPPUNIT_ASSERT(mmScenario->addTailFilter(v.first)); 
+
+        frames[v.first] = PlanarAudioFrame::createNew(channels, sampleRate, AudioFrame::getMaxSamples(sampleRate), PCM, sFmt);
+
+        for (int c = 0; c < channels; c++) {
+            for (unsigned i = 0; i < nOfSamples; i++) {
+                AudioMixer::floatToBytes(frames[v.first]->getPlanarDataBuf()[c] + i*bytesPerSample, v.second, sFmt);
+            }
+        }
+
+        frames[v.first]->setLength(nOfSamples*bytesPerSample);
+        frames[v.first]->setSamples(nOfSamples);
+        total += v.second;
+    }
+
+    CPPUNIT_ASSERT(mmScenario->addTailFilter(fullMixId)); 
+    CPPUNIT_ASSERT(mmScenario->connectFilters());
+    CPPUNIT_ASSERT(mmMixer->setMixMinus(true));
+
+    introducedSamples = 0;
+    ts = std::chrono::microseconds(40000);
+    tsIncrement = std::chrono::microseconds(nOfSamples*std::micro::den/sampleRate);
+
+    while (introducedSamples < mmMixer->getMixingThreshold()) {
+        for (auto f : frames) {
+            f.second->setPresentationTime(ts);
+        }
+
+        mmScenario->processFrames(frames);
+        introducedSamples += nOfSamples;
+        ts += tsIncrement;
+    }
+
+    CPPUNIT_ASSERT(mmMixer->isMixMinus());
+
+    values[fullMixId] = 0;
+
+    //NOTE: the mixed values are under the compression threshold, so each output is exactly its linear mix
+    for (auto v : values) {
+        mixedFrame = mmScenario->extractFrame(v.first);
+        CPPUNIT_ASSERT(mixedFrame);
+        CPPUNIT_ASSERT(mixedFrame->getSamples() == nOfSamples);
+
+        expected = (total - v.second)*DEFAULT_MASTER_GAIN;
+
+        for (unsigned c = 0; c < mixedFrame->getChannels(); c++) {
+            for (unsigned i = 0; i < nOfSamples; i++) {
+                CPPUNIT_ASSERT(AudioMixer::bytesToFloat(mixedFrame->getPlanarDataBuf()[c] + i*bytesPerSample, sample, sFmt));
+                CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, sample, 1e-5);
+            }
+        }
+    }
+
+    delete mmScenario;
+    delete mmMixer;
+
+    for (auto f : frames) {
+        delete f.second;
+    }
+}
+
+void AudioMixerFunctionalTest::silenceDetection()
+{
+    std::map<int, PlanarAudioFrame*> frames;
+    PlanarAudioFrame* silentFrame;
+    PlanarAudioFrame* mixedFrame;
+    std::chrono::microseconds ts;
+    std::chrono::microseconds tsIncrement;
+    unsigned introducedSamples;
+    int bytesPerSample;
+    float peak;
+    float sumSquares;
+    float sample;
+
+    bytesPerSample = utils::getBytesPerSampleFromFormat(sFmt);
+
+    peak = 0;
+    sumSquares = 0;
+    CPPUNIT_ASSERT(AudioMixer::measureSamples(inputFrame->getPlanarDataBuf()[0], inputFrame->getSamples(), 
+                                              sFmt, peak, sumSquares));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, peak, 1e-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.25*inputFrame->getSamples(), sumSquares, 1e-2);
+
+    silentFrame = PlanarAudioFrame::createNew(channels, sampleRate, AudioFrame::getMaxSamples(sampleRate), PCM, sFmt);
+    silentFrame->fillWithValue(0);
+    silentFrame->setLength(inputFrame->getLength());
+    silentFrame->setSamples(inputFrame->getSamples());
+
+    frames[1] = inputFrame;
+    frames[2] = silentFrame;
+
+    introducedSamples = 0;
+    ts = std::chrono::microseconds(40000);
+    tsIncrement = std::chrono::microseconds(inputFrame->getSamples()*std::micro::den/sampleRate);
+
+    while (introducedSamples < mixer->getMixingThreshold()) {
+        inputFrame->setPresentationTime(ts);
+        silentFrame->setPresentationTime(ts);
+        mixScenario->processFrames(frames);
+        introducedSamples += inputFrame->getSamples();
+        ts += tsIncrement;
+    }
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, mixer->getChannelLevel(1), 1e-5);
+    CPPUNIT_ASSERT(mixer->getChannelLevel(2) == 0);
+    CPPUNIT_ASSERT(mixer->getActiveSpeaker() == 1);
+
+    //NOTE: the silent input is skipped but the mixing window still moves
+    mixedFrame = mixScenario->extractFrame();
+    CPPUNIT_ASSERT(mixedFrame);
+
+    for (unsigned i = 0; i < mixedFrame->getSamples(); i++) {
+        CPPUNIT_ASSERT(AudioMixer::bytesToFloat(mixedFrame->getPlanarDataBuf()[0] + i*bytesPerSample, sample, sFmt));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5*DEFAULT_MASTER_GAIN, sample, 1e-6);
+    }
+
+    delete silentFrame;
+}
+
+void AudioMixerFunctionalTest::groupedMixing()
+{
+    std::map<int, PlanarAudioFrame*> frames;
+    AudioMixer* gMixer;
+    ManyToOneAudioScenarioMockup* gScenario;
+    PlanarAudioFrame* mixedFrame;
+    std::chrono::microseconds ts;
+    std::chrono::microseconds tsIncrement;
+    unsigned introducedSamples;
+    unsigned nOfSamples;
+    int bytesPerSample;
+    float total;
+    float sample;
+
+    gMixer = new AudioMixer();
+    gScenario = new ManyToOneAudioScenarioMockup(gMixer);
+    nOfSamples = gMixer->getInputFrameSamples();
+    bytesPerSample = utils::getBytesPerSampleFromFormat(sFmt);
+    total = 0;
+
+    for (int id = 1; id <= 6; id++) {
+        CPPUNIT_ASSERT(gScenario->addHeadFilter(id, channels, sampleRate, sFmt)); 
+
+        frames[id] = PlanarAudioFrame::createNew(channels, sampleRate, AudioFrame::getMaxSamples(sampleRate), PCM, sFmt);
+
+        for (int c = 0; c < channels; c++) {
+            for (unsigned i = 0; i < nOfSamples; i++) {
+                AudioMixer::floatToBytes(frames[id]->getPlanarDataBuf()[c] + i*bytesPerSample, 0.01*id, sFmt);
+            }
+        }
+
+        frames[id]->setLength(nOfSamples*bytesPerSample);
+        frames[id]->setSamples(nOfSamples);
+        total += 0.01*id;
+    }
+
+    CPPUNIT_ASSERT(gScenario->connectFilters());
+    CPPUNIT_ASSERT(gMixer->setMixingGroups(4));
+
+    introducedSamples = 0;
+    ts = std::chrono::microseconds(40000);
+    tsIncrement = std::chrono::microseconds(nOfSamples*std::micro::den/sampleRate);
+
+    while (introducedSamples < gMixer->getMixingThreshold()) {
+        for (auto f : frames) {
+            f.second->setPresentationTime(ts);
+        }
+
+        gScenario->processFrames(frames);
+        introducedSamples += nOfSamples;
+        ts += tsIncrement;
+    }
+
+    CPPUNIT_ASSERT(gMixer->getMixingGroups() == 4);
+
+    for (auto f : frames) {
+        CPPUNIT_ASSERT(gMixer->getChannelLevel(f.first) > 0);
+    }
+
+    //NOTE: under the compression threshold the grouped mix is the linear mix of all the inputs
+    mixedFrame = gScenario->extractFrame();
+    CPPUNIT_ASSERT(mixedFrame);
+    CPPUNIT_ASSERT(mixedFrame->getSamples() == nOfSamples);
+
+    for (unsigned c = 0; c < mixedFrame->getChannels(); c++) {
+        for (unsigned i = 0; i < nOfSamples; i++) {
+            CPPUNIT_ASSERT(AudioMixer::bytesToFloat(mixedFrame->getPlanarDataBuf()[c] + i*bytesPerSample, sample, sFmt));
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(total*DEFAULT_MASTER_GAIN, sample, 1e-5);
+        }
+    }
+
+    delete gScenario;
+    delete gMixer;
+
+    for (auto f : frames) {
+        delete f.second;
+    }
+}
+
+//NOTE: each input id gets the constant value step*id, the first mixed sample is returned
+float AudioMixerFunctionalTest::mixConstantInputs(unsigned groups, int inputs, float step)
+{
+    std::map<int, PlanarAudioFrame*> frames;
+    AudioMixer* gMixer;
+    ManyToOneAudioScenarioMockup* gScenario;
+    PlanarAudioFrame* mixedFrame;
+    std::chrono::microseconds ts;
+    std::chrono::microseconds tsIncrement;
+    unsigned introducedSamples;
+    unsigned nOfSamples;
+    int bytesPerSample;
+    float sample = 0;
+
+    gMixer = new AudioMixer();
+    gScenario = new ManyToOneAudioScenarioMockup(gMixer);
+    nOfSamples = gMixer->getInputFrameSamples();
+    bytesPerSample = utils::getBytesPerSampleFromFormat(sFmt);
+
+    for (int id = 1; id <= inputs; id++) {
+        CPPUNIT_ASSERT(gScenario->addHeadFilter(id, channels, sampleRate, sFmt));
+
+        frames[id] = PlanarAudioFrame::createNew(channels, sampleRate, AudioFrame::getMaxSamples(sampleRate), PCM, sFmt);
+
+        for (int c = 0; c < channels; c++) {
+            for (unsigned i = 0; i < nOfSamples; i++) {
+                AudioMixer::floatToBytes(frames[id]->getPlanarDataBuf()[c] + i*bytesPerSample, step*id, sFmt);
+            }
+        }
+
+        frames[id]->setLength(nOfSamples*bytesPerSample);
+        frames[id]->setSamples(nOfSamples);
+    }
+
+    CPPUNIT_ASSERT(gScenario->connectFilters());
+    CPPUNIT_ASSERT(gMixer->setMixingGroups(groups));
+
+    introducedSamples = 0;
+    ts = std::chrono::microseconds(40000);
+    tsIncrement = std::chrono::microseconds(nOfSamples*std::micro::den/sampleRate);
+
+    while (introducedSamples < gMixer->getMixingThreshold()) {
+        for (auto f : frames) {
+            f.second->setPresentationTime(ts);
+        }
+
+        gScenario->processFrames(frames);
+        introducedSamples += nOfSamples;
+        ts += tsIncrement;
+    }
+
+    mixedFrame = gScenario->extractFrame();
+    CPPUNIT_ASSERT(mixedFrame);
+    CPPUNIT_ASSERT(AudioMixer::bytesToFloat(mixedFrame->getPlanarDataBuf()[0], sample, sFmt));
+
+    delete gScenario;
+    delete gMixer;
+
+    for (auto f : frames) {
+        delete f.second;
+    }
+
+    return sample;
+}
+
+void AudioMixerFunctionalTest::groupedCompression()
+{
+    const float th = COMPRESSION_THRESHOLD;
+    const float slope = (1 - th)/(2 - th);
+    float total = 0;
+    float serial;
+    float grouped;
+
+    //NOTE: under the threshold the serial and grouped mixes only differ by rounding
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(mixConstantInputs(1, 6, 0.01), mixConstantInputs(4, 6, 0.01), 1e-5);
+
+    for (int id = 1; id <= 6; id++) {
+        total += 0.1*id*DEFAULT_MASTER_GAIN;
+    }
+
+    //NOTE: over it the groups compress the linear sum once, the serial mix compresses it after each input
+    serial = mixConstantInputs(1, 6, 0.1);
+    grouped = mixConstantInputs(4, 6, 0.1);
+
+    CPPUNIT_ASSERT(total > th);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(th + slope*(total - th), grouped, 1e-5);
+    CPPUNIT_ASSERT(serial >= th - 1e-5 && serial <= grouped + 1e-5);
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(AudioMixerFunctionalTest);
 
 int main(int argc, char* argv[])
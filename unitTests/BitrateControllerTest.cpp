@@ -0,0 +1,133 @@
+/*
+ *  BitrateControllerTest.cpp - BitrateController class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "BitrateController.hh"
+#include "Utils.hh"
+
+class BitrateControllerTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(BitrateControllerTest);
+    CPPUNIT_TEST(lossBased);
+    CPPUNIT_TEST(queuingDelay);
+    CPPUNIT_TEST(probing);
+    CPPUNIT_TEST(bounds);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void lossBased();
+    void queuingDelay();
+    void probing();
+    void bounds();
+};
+
+void BitrateControllerTest::lossBased()
+{
+    BitrateController controller;
+    
+    CPPUNIT_ASSERT(controller.getBitrate() == 0);
+    CPPUNIT_ASSERT(controller.update(0.05, 0, 2000) == 2000);
+    
+    CPPUNIT_ASSERT(controller.update(0.2, 0, 2000) == 1800);
+    CPPUNIT_ASSERT(controller.update(0.05, 0, 1800) == 1800);
+    CPPUNIT_ASSERT(controller.update(0, 0, 1800) > 1800);
+    
+    controller.reset();
+    CPPUNIT_ASSERT(controller.getBitrate() == 0);
+}
+
+void BitrateControllerTest::queuingDelay()
+{
+    BitrateController controller;
+    
+    CPPUNIT_ASSERT(controller.update(0, 40, 2000) > 2000);
+    CPPUNIT_ASSERT(controller.update(0, 50, 2000) > 2000);
+    
+    //NOTE: a round trip time rising without losses still decreases the estimate
+    controller.reset();
+    controller.update(0.05, 40, 2000);
+    CPPUNIT_ASSERT(controller.update(0, 100, 2000) == 1700);
+}
+
+void BitrateControllerTest::probing()
+{
+    BitrateController controller;
+    unsigned bitrate = 0;
+    
+    controller.update(0, 0, 1000);
+    for (unsigned i = 0; i < 50; i++) {
+        bitrate = controller.update(0, 0, 1000);
+    }
+    
+    CPPUNIT_ASSERT(bitrate == 1500);
+    
+    for (unsigned i = 0; i < 200; i++) {
+        bitrate = controller.update(0, 0, 0);
+    }
+    
+    CPPUNIT_ASSERT(bitrate == BRC_MAX_BITRATE);
+}
+
+void BitrateControllerTest::bounds()
+{
+    BitrateController controller;
+    
+    CPPUNIT_ASSERT(!controller.setBounds(0, 1000));
+    CPPUNIT_ASSERT(!controller.setBounds(2000, 1000));
+    CPPUNIT_ASSERT(controller.setBounds(500, 3000));
+    
+    CPPUNIT_ASSERT(controller.update(0.05, 0, 0) == 3000);
+    
+    for (unsigned i = 0; i < 50; i++) {
+        controller.update(0.5, 0, 0);
+    }
+    
+    CPPUNIT_ASSERT(controller.getBitrate() == 500);
+    
+    CPPUNIT_ASSERT(controller.setBounds(800, 3000));
+    CPPUNIT_ASSERT(controller.getBitrate() == 800);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(BitrateControllerTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("BitrateControllerTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+    
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+} 
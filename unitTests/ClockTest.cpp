@@ -0,0 +1,184 @@
+/*
+ *  ClockTest.cpp - Injectable and simulated clock test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "Clock.hh"
+#include "Runnable.hh"
+#include "Frame.hh"
+#include "Utils.hh"
+
+#define PERIOD 40000
+
+class PeriodicRunnableMockup : public Runnable {
+public:
+    PeriodicRunnableMockup() : Runnable(true), calls(0) {};
+
+    unsigned calls;
+
+protected:
+    void processFrame(int& ret, std::vector<int> &/*jobs*/) {
+        calls++;
+        ret = PERIOD;
+    };
+
+    bool pendingJobs() {return false;};
+};
+
+class ClockTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ClockTest);
+    CPPUNIT_TEST(install);
+    CPPUNIT_TEST(advance);
+    CPPUNIT_TEST(schedule);
+    CPPUNIT_TEST(waitAdvance);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void tearDown();
+
+protected:
+    void install();
+    void advance();
+    void schedule();
+    void waitAdvance();
+};
+
+void ClockTest::tearDown()
+{
+    Clock::install(NULL);
+}
+
+void ClockTest::install()
+{
+    SimulatedClock clock;
+
+    CPPUNIT_ASSERT(Clock::get() == SystemClock::getInstance());
+
+    Clock::install(&clock);
+    CPPUNIT_ASSERT(Clock::get() == &clock);
+    CPPUNIT_ASSERT(Frame::getOriginNow() ==
+                   std::chrono::system_clock::time_point(std::chrono::seconds(SIMULATED_EPOCH)));
+
+    Clock::install(NULL);
+    CPPUNIT_ASSERT(Clock::get() == SystemClock::getInstance());
+}
+
+void ClockTest::advance()
+{
+    SimulatedClock clock;
+    std::chrono::system_clock::time_point start = clock.time();
+    std::chrono::system_clock::time_point deadline;
+
+    clock.advance(std::chrono::microseconds(1500));
+    CPPUNIT_ASSERT(clock.time() - start == std::chrono::microseconds(1500));
+
+    //NOTE: the clock never goes backwards
+    clock.advanceTo(start);
+    clock.advance(std::chrono::microseconds(-10));
+    CPPUNIT_ASSERT(clock.time() - start == std::chrono::microseconds(1500));
+
+    clock.sleep(start + std::chrono::seconds(2));
+    CPPUNIT_ASSERT(clock.time() - start == std::chrono::seconds(2));
+
+    //NOTE: deadlines are real time points, the ones far in simulated time are bounded
+    deadline = clock.deadline(start);
+    CPPUNIT_ASSERT(deadline <= std::chrono::system_clock::now());
+    deadline = clock.deadline(start + std::chrono::hours(1));
+    CPPUNIT_ASSERT(deadline <= std::chrono::system_clock::now() + std::chrono::microseconds(SIMULATED_WAIT));
+}
+
+void ClockTest::schedule()
+{
+    SimulatedClock clock;
+    std::chrono::system_clock::time_point start = clock.time();
+
+    Clock::install(&clock);
+    PeriodicRunnableMockup job;
+
+    CPPUNIT_ASSERT(!job.ready());
+    clock.advance(std::chrono::microseconds(1));
+    CPPUNIT_ASSERT(job.ready());
+
+    job.runProcessFrame();
+    CPPUNIT_ASSERT(job.getTime() == start + std::chrono::microseconds(PERIOD + 1));
+    CPPUNIT_ASSERT(!job.ready());
+
+    clock.advance(std::chrono::microseconds(PERIOD));
+    CPPUNIT_ASSERT(!job.ready());
+    clock.advance(std::chrono::microseconds(1));
+    CPPUNIT_ASSERT(job.ready());
+
+    //NOTE: with auto advance the schedule is replayed without waiting, in exactly 100 periods
+    job.runProcessFrame();
+    for (unsigned i = 0; i < 100; i++){
+        job.sleepUntilReady();
+        job.runProcessFrame();
+    }
+    CPPUNIT_ASSERT(job.calls == 102);
+    CPPUNIT_ASSERT(clock.time() == start + std::chrono::microseconds(101*PERIOD + 2));
+}
+
+void ClockTest::waitAdvance()
+{
+    SimulatedClock clock(false);
+    std::chrono::system_clock::time_point until = clock.time() + std::chrono::seconds(10);
+    bool woken = false;
+
+    std::thread sleeper([&clock, &woken, until]{
+        clock.sleep(until);
+        woken = true;
+    });
+
+    clock.advance(std::chrono::seconds(5));
+    clock.advance(std::chrono::seconds(5));
+    sleeper.join();
+
+    CPPUNIT_ASSERT(woken);
+    CPPUNIT_ASSERT(clock.time() == until);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ClockTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("ClockTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/*
+ *  ClusterCoordinatorTest.cpp - Cluster graph placement test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "ClusterCoordinator.hh"
+#include "Utils.hh"
+
+#define LINK_ID_BASE 100
+
+static const char* transcodingGraph =
+    "{\"filters\":[{\"id\":1,\"type\":\"receiver\",\"node\":\"ingest\"},"
+                  "{\"id\":2,\"type\":\"videoDecoder\"},"
+                  "{\"id\":3,\"type\":\"videoEncoder\"},"
+                  "{\"id\":4,\"type\":\"dasher\"}],"
+     "\"paths\":[{\"id\":10,\"orgFilterId\":1,\"dstFilterId\":4,\"orgWriterId\":7,\"dstReaderId\":9,"
+                 "\"midFiltersIds\":[2,3],\"queueFrames\":20,\"link\":{\"codec\":\"H265\"}}],"
+     "\"events\":[{\"filterId\":3,\"action\":\"configure\",\"params\":{\"bitrate\":2000}}]}";
+
+class ClusterCoordinatorTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ClusterCoordinatorTest);
+    CPPUNIT_TEST(singleNode);
+    CPPUNIT_TEST(splitAcrossNodes);
+    CPPUNIT_TEST(defaultLinkCodec);
+    CPPUNIT_TEST(noCapacity);
+    CPPUNIT_TEST(capacityFromState);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+
+protected:
+    void singleNode();
+    void splitAcrossNodes();
+    void defaultLinkCodec();
+    void noCapacity();
+    void capacityFromState();
+
+    ClusterNode node(std::string name, float capacity);
+    Jzon::Object* findFilter(Jzon::Object &graph, int id);
+    Jzon::Object* findPath(Jzon::Object &graph, int orgFilterId);
+
+    Jzon::Object graph;
+};
+
+void ClusterCoordinatorTest::setUp()
+{
+    Jzon::Parser parser(graph, transcodingGraph);
+    CPPUNIT_ASSERT(parser.Parse());
+}
+
+ClusterNode ClusterCoordinatorTest::node(std::string name, float capacity)
+{
+    ClusterNode n;
+
+    n.name = name;
+    n.host = name;
+    n.port = 7777;
+    n.linkHost = name + ".cluster";
+    n.linkPort = 21000;
+    n.local = false;
+    n.capacity = capacity;
+    n.memory = -1;
+
+    return n;
+}
+
+Jzon::Object* ClusterCoordinatorTest::findFilter(Jzon::Object &g, int id)
+{
+    for (auto &f : g.Get("filters").AsArray()) {
+        if (f.Get("id").ToInt() == id) {
+            return &f.AsObject();
+        }
+    }
+
+    return NULL;
+}
+
+Jzon::Object* ClusterCoordinatorTest::findPath(Jzon::Object &g, int orgFilterId)
+{
+    for (auto &p : g.Get("paths").AsArray()) {
+        if (p.Get("orgFilterId").ToInt() == orgFilterId) {
+            return &p.AsObject();
+        }
+    }
+
+    return NULL;
+}
+
+void ClusterCoordinatorTest::singleNode()
+{
+    std::vector<ClusterNode> nodes = {node("ingest", 8)};
+    ClusterPlanner planner(nodes, LINK_ID_BASE);
+    Jzon::Object* path;
+
+    CPPUNIT_ASSERT(planner.plan(graph));
+    CPPUNIT_ASSERT(planner.getLinks() == 0);
+    CPPUNIT_ASSERT(planner.getGraph(0).Get("filters").GetCount() == 4);
+    CPPUNIT_ASSERT(planner.getGraph(0).Get("events").GetCount() == 1);
+
+    //NOTE: the placement fields are not forwarded to the nodes
+    CPPUNIT_ASSERT(!findFilter(planner.getGraph(0), 1)->Has("node"));
+
+    CPPUNIT_ASSERT((path = findPath(planner.getGraph(0), 1)));
+    CPPUNIT_ASSERT(path->Get("id").ToInt() == 10 && path->Get("dstFilterId").ToInt() == 4);
+    CPPUNIT_ASSERT(path->Get("midFiltersIds").GetCount() == 2);
+    CPPUNIT_ASSERT(nodes[0].capacity < 8);
+}
+
+void ClusterCoordinatorTest::splitAcrossNodes()
+{
+    std::vector<ClusterNode> nodes = {node("ingest", 0.6), node("transcoder", 2)};
+    ClusterPlanner planner(nodes, LINK_ID_BASE);
+    Jzon::Object *sender, *receiver, *first, *second;
+
+    CPPUNIT_ASSERT(planner.plan(graph));
+    CPPUNIT_ASSERT(planner.getNode(1) == 0 && planner.getNode(2) == 0);
+    CPPUNIT_ASSERT(planner.getNode(3) == 1 && planner.getNode(4) == 1);
+    CPPUNIT_ASSERT(planner.getLinks() == 1);
+
+    CPPUNIT_ASSERT((sender = findFilter(planner.getGraph(0), LINK_ID_BASE)));
+    CPPUNIT_ASSERT(sender->Get("type").ToString() == "frameLinkSender");
+    CPPUNIT_ASSERT(sender->Get("host").ToString() == "transcoder.cluster");
+    CPPUNIT_ASSERT(sender->Get("port").ToInt() == 21000);
+
+    CPPUNIT_ASSERT((receiver = findFilter(planner.getGraph(1), LINK_ID_BASE + 1)));
+    CPPUNIT_ASSERT(receiver->Get("type").ToString() == "frameLinkReceiver");
+    CPPUNIT_ASSERT(receiver->Get("codec").ToString() == "H265");
+    CPPUNIT_ASSERT(receiver->Get("port").ToInt() == 21000);
+    CPPUNIT_ASSERT(nodes[1].linkPort == 21001);
+
+    CPPUNIT_ASSERT((first = findPath(planner.getGraph(0), 1)));
+    CPPUNIT_ASSERT(first->Get("id").ToInt() == 10 && first->Get("dstFilterId").ToInt() == LINK_ID_BASE);
+    CPPUNIT_ASSERT(first->Get("orgWriterId").ToInt() == 7 && first->Get("dstReaderId").ToInt() == -1);
+    CPPUNIT_ASSERT(first->Get("midFiltersIds").GetCount() == 1 && first->Get("queueFrames").ToInt() == 20);
+    CPPUNIT_ASSERT(!first->Has("link"));
+
+    CPPUNIT_ASSERT((second = findPath(planner.getGraph(1), LINK_ID_BASE + 1)));
+    CPPUNIT_ASSERT(second->Get("id").ToInt() == LINK_ID_BASE + 2 && second->Get("dstFilterId").ToInt() == 4);
+    CPPUNIT_ASSERT(second->Get("orgWriterId").ToInt() == -1 && second->Get("dstReaderId").ToInt() == 9);
+    CPPUNIT_ASSERT(second->Get("midFiltersIds").GetCount() == 1);
+    CPPUNIT_ASSERT(second->Get("midFiltersIds").Get(0).ToInt() == 3);
+
+    CPPUNIT_ASSERT(planner.getGraph(0).Get("events").GetCount() == 0);
+    CPPUNIT_ASSERT(planner.getGraph(1).Get("events").GetCount() == 1);
+}
+
+void ClusterCoordinatorTest::defaultLinkCodec()
+{
+    std::vector<ClusterNode> nodes = {node("ingest", 0.6), node("transcoder", 2)};
+    ClusterPlanner planner(nodes, LINK_ID_BASE);
+    Jzon::Object* receiver;
+
+    graph.Get("paths").Get(0).AsObject().Remove("link");
+    CPPUNIT_ASSERT(planner.plan(graph));
+    CPPUNIT_ASSERT((receiver = findFilter(planner.getGraph(1), LINK_ID_BASE + 1)));
+    CPPUNIT_ASSERT(utils::getVideoCodecFromString(receiver->Get("codec").ToString()) == H264);
+}
+
+void ClusterCoordinatorTest::noCapacity()
+{
+    std::vector<ClusterNode> nodes = {node("ingest", 0.6), node("transcoder", 0.6)};
+    ClusterPlanner planner(nodes, LINK_ID_BASE);
+    ClusterPlanner lowBase(nodes, 4);
+
+    CPPUNIT_ASSERT(!planner.plan(graph));
+    CPPUNIT_ASSERT(planner.getError().find("Filter 3") != std::string::npos);
+
+    //NOTE: link IDs must not collide with the graph ones
+    CPPUNIT_ASSERT(!lowBase.plan(graph));
+}
+
+void ClusterCoordinatorTest::capacityFromState()
+{
+    ClusterNode n = node("transcoder", 0);
+    Jzon::Object state;
+    Jzon::Parser parser(state, "{\"pool\":{\"maxWorkers\":16,\"utilisation\":0.25},"
+                               "\"threadBudget\":{\"threadBudget\":8},"
+                               "\"memoryBudget\":{\"memoryBudget\":1000,\"usedBytes\":400}}");
+
+    CPPUNIT_ASSERT(parser.Parse());
+    ClusterCoordinator::setCapacity(state, n);
+    CPPUNIT_ASSERT(n.capacity == 6);
+    CPPUNIT_ASSERT(n.memory == 600);
+
+    state.Remove("memoryBudget");
+    ClusterCoordinator::setCapacity(state, n);
+    CPPUNIT_ASSERT(n.memory < 0);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ClusterCoordinatorTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("ClusterCoordinatorTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -96,9 +96,8 @@ private:
 class ManyToOneVideoScenarioMockup {
 
 public:
-    ManyToOneVideoScenarioMockup(ManyToOneFilter* fToTest): filterToTest(fToTest)
+    ManyToOneVideoScenarioMockup(BaseFilter* fToTest): filterToTest(fToTest)
     {
-        tailF = new VideoTailFilterMockup();
     };
 
     ~ManyToOneVideoScenarioMockup()
@@ -107,7 +106,9 @@ public:
             delete f.second;
         }
 
-        delete tailF;
+        for (auto f : tailFilters) {
+            delete f.second;
+        }
     }
 
     bool addHeadFilter(int id, VCodecType c, PixType pix = P_NONE)
@@ -120,6 +121,16 @@ public:
         return true;
     }
 
+    bool addTailFilter(int writerId)
+    {
+        if (tailFilters.count(writerId) > 0) {
+            return false;
+        }
+
+        tailFilters[writerId] = new VideoTailFilterMockup();
+        return true;
+    }
+
     bool connectFilters()
     {
         if (filterToTest == NULL || headFilters.empty()) {
@@ -132,8 +143,16 @@ public:
             }
         }
 
-        if (!filterToTest->connectOneToOne(tailF)) {
-            return false;
+        //NOTE: without explicit tails there is a single one connected to the default writer
+        if (tailFilters.empty()) {
+            tailFilters[DEFAULT_ID] = new VideoTailFilterMockup();
+            return filterToTest->connectOneToOne(tailFilters[DEFAULT_ID]);
+        }
+
+        for (auto f : tailFilters) {
+            if (!filterToTest->connectManyToOne(f.second, f.first)) {
+                return false;
+            }
         }
 
         return true;
@@ -154,18 +173,36 @@ public:
         return ret;
     }
 
-    InterleavedVideoFrame *extractFrame()
+    int processFrame(InterleavedVideoFrame* srcFrame, int headId)
     {
         int ret;
-        tailF->processFrame(ret);
-        return tailF->extract();
+
+        if (headFilters.count(headId) == 0 || !headFilters[headId]->inject(srcFrame)) {
+            return 0;
+        }
+
+        headFilters[headId]->processFrame(ret);
+        filterToTest->processFrame(ret);
+        return ret;
+    }
+
+    InterleavedVideoFrame *extractFrame(int writerId = DEFAULT_ID)
+    {
+        int ret;
+
+        if (tailFilters.count(writerId) == 0) {
+            return NULL;
+        }
+
+        tailFilters[writerId]->processFrame(ret);
+        return tailFilters[writerId]->extract();
     }
 
 private:
 
     std::map<int,VideoHeadFilterMockup*> headFilters;
-    ManyToOneFilter *filterToTest;
-    VideoTailFilterMockup *tailF;
+    std::map<int,VideoTailFilterMockup*> tailFilters;
+    BaseFilter *filterToTest;
 };
 
 class OneToManyVideoScenarioMockup {
@@ -243,9 +280,8 @@ private:
 class ManyToOneAudioScenarioMockup {
 
 public:
-    ManyToOneAudioScenarioMockup(ManyToOneFilter* fToTest): filterToTest(fToTest)
+    ManyToOneAudioScenarioMockup(BaseFilter* fToTest): filterToTest(fToTest)
     {
-        tailF = new AudioTailFilterMockup();
     };
 
     ~ManyToOneAudioScenarioMockup()
@@ -255,7 +291,9 @@ public:
             delete f.second;
         }
 
-        delete tailF;
+        for (auto f : tailFilters) {
+            delete f.second;
+        }
     }
 
     bool addHeadFilter(int id, int channels, int sampleRate, SampleFmt sampleFormat)
@@ -268,6 +306,16 @@ public:
         return true;
     }
 
+    bool addTailFilter(int writerId)
+    {
+        if (tailFilters.count(writerId) > 0) {
+            return false;
+        }
+
+        tailFilters[writerId] = new AudioTailFilterMockup();
+        return true;
+    }
+
     bool connectFilters()
     {
         if (filterToTest == NULL || headFilters.empty()) {
@@ -280,19 +328,38 @@ public:
             }
         }
 
-        if (!filterToTest->connectOneToOne(tailF)) {
-            return false;
+        //NOTE: without explicit tails there is a single one connected to the default writer
+        if (tailFilters.empty()) {
+            tailFilters[DEFAULT_ID] = new AudioTailFilterMockup();
+            return filterToTest->connectOneToOne(tailFilters[DEFAULT_ID]);
+        }
+
+        for (auto f : tailFilters) {
+            if (!filterToTest->connectManyToOne(f.second, f.first)) {
+                return false;
+            }
         }
 
         return true;
     };
 
     int processFrame(PlanarAudioFrame* srcFrame)
+    {
+        std::map<int, PlanarAudioFrame*> srcFrames;
+
+        for (auto f : headFilters) {
+            srcFrames[f.first] = srcFrame;
+        }
+
+        return processFrames(srcFrames);
+    }
+
+    int processFrames(std::map<int, PlanarAudioFrame*> srcFrames)
     {
         int ret;
 
         for (auto f : headFilters) {
-            if (!f.second->inject(srcFrame)) {
+            if (srcFrames.count(f.first) == 0 || !f.second->inject(srcFrames[f.first])) {
                 return 0;
             }
             f.second->processFrame(ret);
@@ -302,17 +369,22 @@ public:
         return ret;
     }
 
-    PlanarAudioFrame *extractFrame()
+    PlanarAudioFrame *extractFrame(int writerId = DEFAULT_ID)
     {
         int ret;
-        tailF->processFrame(ret);
-        return tailF->extract();
+
+        if (tailFilters.count(writerId) == 0) {
+            return NULL;
+        }
+
+        tailFilters[writerId]->processFrame(ret);
+        return tailFilters[writerId]->extract();
     }
 
 private:
     std::map<int,AudioHeadFilterMockup*> headFilters;
-    ManyToOneFilter *filterToTest;
-    AudioTailFilterMockup *tailF;
+    std::map<int,AudioTailFilterMockup*> tailFilters;
+    BaseFilter *filterToTest;
 };
 
 class InterleavedFramesWriter {
@@ -482,6 +554,9 @@ static AVPixelFormat getPixelFormat(PixType format)
         case YUVJ420P:
             return AV_PIX_FMT_YUVJ420P;
             break;
+        case YUVJ422P:
+            return AV_PIX_FMT_YUVJ422P;
+            break;
         default:
             utils::errorMsg("Unknown output pixel format");
             break;
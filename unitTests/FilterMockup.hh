@@ -61,7 +61,7 @@ private:
     bool specificWriterConfig(int /*writerID*/) {return true;};
     bool specificWriterDelete(int /*writerID*/) {return true;};
 
-    bool runDoProcessFrame(std::map<int, Frame*> &oFrames, std::map<int, Frame*> &dFrames, std::vector<int> newFrames, int& ret) {
+    bool runDoProcessFrame(FrameMap &oFrames, FrameMap &dFrames, std::vector<int> &newFrames, int& ret) {
         return true;
     };
 };
@@ -83,6 +83,7 @@ protected:
         if (!org->isPlanar() && !dst->isPlanar() && org->getConsumed()){
             memcpy(dst->getDataBuf(), org->getDataBuf(), org->getLength());
             dst->setSequenceNumber(org->getSequenceNumber());
+            dst->setOriginTime(org->getOriginTime());
             dst->setLength(org->getLength());
             dst->setConsumed(gotFrame);
         } 
@@ -118,7 +119,7 @@ public:
     using BaseFilter::getReader;
 
 protected:
-    bool doProcessFrame(Frame *org, std::map<int, Frame *> &dstFrames) {
+    bool doProcessFrame(Frame *org, FrameMap &dstFrames) {
         for (auto dst : dstFrames) {
             dst.second->setConsumed(gotFrame);
         }
@@ -201,7 +202,7 @@ public:
     void doGetState(Jzon::Object &filterNode){};
 
 protected:
-    bool doProcessFrame(std::map<int, Frame*> &dstFrames, int& ret) {
+    bool doProcessFrame(FrameMap &dstFrames, int& ret) {
         if (!newFrame){
             return false;
         }
@@ -257,7 +258,7 @@ public:
     void doGetState(Jzon::Object &filterNode){};
 
 protected:
-    bool doProcessFrame(std::map<int, Frame*> &orgFrames, std::vector<int> /*newFrames*/, int& ret) { 
+    bool doProcessFrame(FrameMap &orgFrames, std::vector<int> &/*newFrames*/, int& ret) { 
         bool gotframe = false;
         for (auto it : orgFrames){
             if (!it.second->isPlanar() && it.second->getConsumed()){
@@ -310,10 +311,11 @@ public:
     void doGetState(Jzon::Object &filterNode){};
     
 protected:
-    bool doProcessFrame(std::map<int, Frame*> &dstFrames, int& ret) {
+    bool doProcessFrame(FrameMap &dstFrames, int& ret) {
         // There is only one frame in the map
         Frame *dst = dstFrames.begin()->second;
         InterleavedVideoFrame *dstFrame;
+        PlanarVideoFrame *pDstFrame;
         
         if ((dstFrame = dynamic_cast<InterleavedVideoFrame*>(dst)) != NULL){
             memmove(dstFrame->getDataBuf(), srcFrame->getDataBuf(), sizeof(unsigned char)*srcFrame->getLength());
@@ -327,6 +329,31 @@ protected:
             return true;
         }
         
+        //NOTE: planar pixel formats queues hold PlanarVideoFrames, planes are copied line by line
+        if ((pDstFrame = dynamic_cast<PlanarVideoFrame*>(dst)) != NULL){
+            unsigned char* srcData[MAX_PLANES];
+            unsigned char* dstData[MAX_PLANES];
+            int srcLinesize[MAX_PLANES];
+            int dstLinesize[MAX_PLANES];
+            int lineBytes, rows;
+            
+            pDstFrame->fitBuffer(srcFrame->getWidth(), srcFrame->getHeight(), srcFrame->getPixelFormat());
+            srcFrame->getPlanes(srcData, srcLinesize);
+            pDstFrame->getPlanes(dstData, dstLinesize);
+            
+            for (unsigned p = 0; VideoFrame::planeSize(srcFrame->getPixelFormat(), srcFrame->getWidth(), 
+                                                       srcFrame->getHeight(), p, lineBytes, rows); p++) {
+                for (int r = 0; r < rows; r++) {
+                    memcpy(dstData[p] + r*dstLinesize[p], srcData[p] + r*srcLinesize[p], lineBytes);
+                }
+            }
+            
+            pDstFrame->setPresentationTime(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()));
+            pDstFrame->setOriginTime(srcFrame->getOriginTime());
+            pDstFrame->setConsumed(true);
+            return true;
+        }
+        
         return false;
     }
 
@@ -372,7 +399,7 @@ public:
     void doGetState(Jzon::Object &filterNode){};
     
 protected:
-    bool doProcessFrame(std::map<int, Frame*> &dstFrames, int& ret) {
+    bool doProcessFrame(FrameMap &dstFrames, int& ret) {
         // There is only one frame in the map
         Frame *dst = dstFrames.begin()->second;
         PlanarAudioFrame *dstFrame;
@@ -436,7 +463,7 @@ public:
     void doGetState(Jzon::Object &filterNode){};
     
 protected:
-    bool doProcessFrame(std::map<int, Frame*> &orgFrames, std::vector<int> /*newFrame*/, int& ret) {
+    bool doProcessFrame(FrameMap &orgFrames, std::vector<int> &/*newFrame*/, int& ret) {
         InterleavedVideoFrame *orgFrame;
  
         if ((orgFrame = dynamic_cast<InterleavedVideoFrame*>(orgFrames.begin()->second)) != NULL){
@@ -445,9 +472,14 @@ protected:
                                                           DEFAULT_WIDTH, DEFAULT_HEIGHT, orgFrame->getPixelFormat());
             }
             
-            memmove(oFrame->getDataBuf(), orgFrame->getDataBuf(), sizeof(unsigned char)*orgFrame->getLength());
+            if (orgFrame->getExternalStride() > 0) {
+                //NOTE: strided views (i.e. splitter crops) are packed
+                packLines(orgFrame);
+            } else {
+                memmove(oFrame->getDataBuf(), orgFrame->getDataBuf(), sizeof(unsigned char)*orgFrame->getLength());
+                oFrame->setLength(orgFrame->getLength());
+            }
             
-            oFrame->setLength(orgFrame->getLength());
             oFrame->setSize(orgFrame->getWidth(), orgFrame->getHeight());
             oFrame->setPresentationTime(orgFrame->getPresentationTime());
             oFrame->setOriginTime(orgFrame->getOriginTime());
@@ -462,6 +494,20 @@ protected:
         return false;
     }
     
+    void packLines(InterleavedVideoFrame *orgFrame) {
+        unsigned char* data[MAX_PLANES];
+        int linesize[MAX_PLANES];
+        int lineBytes, rows;
+        
+        orgFrame->getPlanes(data, linesize);
+        VideoFrame::planeSize(orgFrame->getPixelFormat(), orgFrame->getWidth(), orgFrame->getHeight(), 0, lineBytes, rows);
+        
+        for (int r = 0; r < rows; r++) {
+            memmove(oFrame->getDataBuf() + r*lineBytes, data[0] + r*linesize[0], lineBytes);
+        }
+        
+        oFrame->setLength(lineBytes*rows);
+    }
 
 private:
     //There is no need of specific reader configuration
@@ -497,7 +543,7 @@ public:
     void doGetState(Jzon::Object &filterNode){};
 
 protected:
-    bool doProcessFrame(std::map<int, Frame*> &orgFrames, std::vector<int> /*newFrame*/, int& ret) {
+    bool doProcessFrame(FrameMap &orgFrames, std::vector<int> &/*newFrame*/, int& ret) {
         PlanarAudioFrame *orgFrame;
 
         if ((orgFrame = dynamic_cast<PlanarAudioFrame*>(orgFrames.begin()->second)) != NULL){
@@ -25,6 +25,7 @@
 #include <fstream>
 #include <chrono>
 #include <thread>
+#include <algorithm>
 #include <cppunit/extensions/TestFactoryRegistry.h>
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/ui/text/TextTestRunner.h>
@@ -35,6 +36,112 @@
 #include "FilterMockup.hh"
 #include "WorkersPool.hh"
 
+class PendingOutputFilterMockup : public OneToOneFilterMockup
+{
+public:
+    PendingOutputFilterMockup() : OneToOneFilterMockup(4, true, std::chrono::microseconds(0)),
+        pending(false), processed(0), consumed(false) {};
+
+    bool pending;
+    unsigned processed;
+    bool consumed;
+
+protected:
+    bool hasPendingOutput() {return pending;};
+    bool doProcessFrame(Frame *org, Frame *dst) {
+        processed++;
+        consumed = org->getConsumed();
+        return OneToOneFilterMockup::doProcessFrame(org, dst);
+    }
+};
+
+class TypedVideoFilterMockup : public OneToOneFilterT<VideoFrame, VideoFrame>
+{
+public:
+    TypedVideoFilterMockup(bool audioOutput = false) : OneToOneFilterT(), processed(0) {
+        outputStreamInfo = new StreamInfo(audioOutput ? AUDIO : VIDEO);
+        if (audioOutput) {
+            outputStreamInfo->audio.codec = AAC;
+        } else {
+            outputStreamInfo->video.codec = H264;
+        }
+        outputStreamInfo->setCodecDefaults();
+    };
+
+    ~TypedVideoFilterMockup() {delete outputStreamInfo;};
+
+    unsigned processed;
+
+protected:
+    FrameQueue *allocQueue(ConnectionData cData) {
+        if (outputStreamInfo->type == AUDIO) {
+            return AudioFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_AUDIO_FRAMES);
+        }
+        return VideoFrameQueue::createNew(cData, outputStreamInfo, DEFAULT_VIDEO_FRAMES);
+    };
+    bool doProcessFrame(VideoFrame */*org*/, VideoFrame *dst) {
+        processed++;
+        dst->setConsumed(true);
+        return true;
+    };
+    bool specificReaderConfig(int /*readerID*/, FrameQueue* /*queue*/) {return true;};
+    bool specificReaderDelete(int /*readerID*/) {return true;};
+    bool specificWriterConfig(int /*writerID*/) {return true;};
+    bool specificWriterDelete(int /*writerID*/) {return true;};
+    void doGetState(Jzon::Object &/*filterNode*/) {};
+
+private:
+    StreamInfo *outputStreamInfo;
+};
+
+class EventFilterMockup : public OneToOneFilterMockup
+{
+public:
+    EventFilterMockup() : OneToOneFilterMockup(4, true, std::chrono::microseconds(0)), executed(0) {
+        eventMap["count"] = [this](Jzon::Node* params) {
+            executed += params ? params->Get("inc").ToInt() : 1;
+            return true;
+        };
+    };
+
+    std::atomic<int> executed;
+};
+
+class TimedHeadFilterMockup : public HeadFilterMockup
+{
+public:
+    void setTime(int ms) {time = std::chrono::milliseconds(ms);};
+
+protected:
+    bool doProcessFrame(FrameMap &dstFrames, int& ret) {
+        for (auto it : dstFrames){
+            it.second->setPresentationTime(time);
+        }
+        return HeadFilterMockup::doProcessFrame(dstFrames, ret);
+    }
+
+private:
+    std::chrono::microseconds time;
+};
+
+class SyncFilterMockup : public BaseFilterMockup
+{
+public:
+    SyncFilterMockup(unsigned readers) : BaseFilterMockup(readers, 1) {setSync(true);};
+
+    std::vector<int> syncedReaders() {
+        FrameMap oFrames;
+        std::vector<int> newFrames;
+        std::vector<int> ids;
+
+        demandOriginFrames(oFrames, newFrames);
+        for (auto &it : oFrames) {
+            ids.push_back(it.first);
+        }
+        return ids;
+    };
+};
+
 class FilterUnitTest : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(FilterUnitTest);
@@ -43,6 +150,15 @@ class FilterUnitTest : public CppUnit::TestFixture
     CPPUNIT_TEST(connectOneToMany);
     CPPUNIT_TEST(connectManyToMany);
     CPPUNIT_TEST(shareReader);
+    CPPUNIT_TEST(edgeTriggered);
+    CPPUNIT_TEST(fusedChain);
+    CPPUNIT_TEST(profiling);
+    CPPUNIT_TEST(pendingOutput);
+    CPPUNIT_TEST(typedConnection);
+    CPPUNIT_TEST(concurrentEvents);
+    CPPUNIT_TEST(syncGroups);
+    CPPUNIT_TEST(burst);
+    CPPUNIT_TEST(suspendWriter);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -55,6 +171,15 @@ protected:
     void connectOneToMany();
     void connectManyToMany();
     void shareReader();
+    void edgeTriggered();
+    void fusedChain();
+    void profiling();
+    void pendingOutput();
+    void typedConnection();
+    void concurrentEvents();
+    void syncGroups();
+    void burst();
+    void suspendWriter();
 };
 
 void FilterUnitTest::setUp()
@@ -179,6 +304,262 @@ void FilterUnitTest::shareReader()
     delete satelliteFilter2;
 }
 
+void FilterUnitTest::edgeTriggered()
+{
+    int ret = 0;
+    BaseFilter* originFilter = new BaseFilterMockup(1,1);
+    BaseFilter* filterToTest = new OneToOneFilterMockup(4, true, std::chrono::microseconds(0));
+    Runnable* job = filterToTest;
+    
+    originFilter->setId(1);
+    filterToTest->setId(2);
+    
+    CPPUNIT_ASSERT(originFilter->connectOneToOne(filterToTest));
+    CPPUNIT_ASSERT(!filterToTest->isEdgeTriggered());
+    
+    filterToTest->processFrame(ret);
+    CPPUNIT_ASSERT(ret == WAIT);
+    
+    filterToTest->setEdgeTriggered(true);
+    filterToTest->processFrame(ret);
+    CPPUNIT_ASSERT(ret == 0);
+    CPPUNIT_ASSERT(!job->pendingJobs());
+    
+    delete originFilter;
+    delete filterToTest;
+}
+
+void FilterUnitTest::fusedChain()
+{
+    int ret = 0;
+    std::vector<int> enabledJobs;
+    HeadFilterMockup* head = new HeadFilterMockup();
+    BaseFilter* first = new OneToOneFilterMockup(4, true, std::chrono::microseconds(0));
+    BaseFilter* second = new OneToOneFilterMockup(4, true, std::chrono::microseconds(0));
+    TailFilterMockup* tail = new TailFilterMockup();
+    Frame* frame = FrameMock::createNew(0);
+    
+    head->setId(1);
+    first->setId(2);
+    second->setId(3);
+    tail->setId(4);
+    
+    CPPUNIT_ASSERT(head->connectOneToOne(first));
+    CPPUNIT_ASSERT(first->connectOneToOne(second));
+    CPPUNIT_ASSERT(second->connectOneToOne(tail));
+    
+    CPPUNIT_ASSERT(first->isFusable());
+    CPPUNIT_ASSERT(!head->isFusable());
+    CPPUNIT_ASSERT(!tail->isFusable());
+    CPPUNIT_ASSERT(!first->fuse(std::vector<BaseFilter*>(1, tail)));
+    CPPUNIT_ASSERT(!second->fuse(std::vector<BaseFilter*>(1, first)));
+    CPPUNIT_ASSERT(first->fuse(std::vector<BaseFilter*>(1, second)));
+    CPPUNIT_ASSERT(first->getFused().size() == 1);
+    
+    CPPUNIT_ASSERT(head->inject(frame));
+    head->processFrame(ret);
+    enabledJobs = first->processFrame(ret);
+    CPPUNIT_ASSERT(std::find(enabledJobs.begin(), enabledJobs.end(), 3) == enabledJobs.end());
+    CPPUNIT_ASSERT(std::find(enabledJobs.begin(), enabledJobs.end(), 4) != enabledJobs.end());
+    
+    tail->processFrame(ret);
+    CPPUNIT_ASSERT(tail->getFrames() == 1);
+    
+    CPPUNIT_ASSERT(first->fuse(std::vector<BaseFilter*>()));
+    CPPUNIT_ASSERT(first->getFused().empty());
+    
+    delete head;
+    delete first;
+    delete second;
+    delete tail;
+    delete frame;
+}
+
+void FilterUnitTest::profiling()
+{
+    HeadFilterMockup* head = new HeadFilterMockup();
+    BaseFilter* filterToTest = new OneToOneFilterMockup(4, true, std::chrono::microseconds(0));
+    TailFilterMockup* tail = new TailFilterMockup();
+    Runnable* job = filterToTest;
+    Frame* frame = FrameMock::createNew(0);
+    Jzon::Object state;
+    
+    head->setId(1);
+    filterToTest->setId(2);
+    tail->setId(3);
+    
+    CPPUNIT_ASSERT(head->connectOneToOne(filterToTest));
+    CPPUNIT_ASSERT(filterToTest->connectOneToOne(tail));
+    CPPUNIT_ASSERT(job->getProfile().getCalls() == 0);
+    CPPUNIT_ASSERT(job->getProfile().getWallPercentile(99) == 0);
+    
+    job->runProcessFrame();
+    CPPUNIT_ASSERT(job->getProfile().getCalls() == 1);
+    CPPUNIT_ASSERT(job->getProfile().getStalls() == 1);
+    
+    CPPUNIT_ASSERT(head->inject(frame));
+    head->runProcessFrame();
+    job->runProcessFrame();
+    CPPUNIT_ASSERT(job->getProfile().getCalls() == 2);
+    CPPUNIT_ASSERT(job->getProfile().getFrames() == 1);
+    CPPUNIT_ASSERT(job->getProfile().getWallPercentile(50) <= job->getProfile().getWallPercentile(99));
+    
+    filterToTest->getState(state);
+    CPPUNIT_ASSERT(state.Get("profile").Get("calls").ToInt() == 2);
+    CPPUNIT_ASSERT(state.Get("profile").Get("waits").ToInt() == 1);
+    CPPUNIT_ASSERT(state.Get("profile").Get("wallTime").Has("p95"));
+    
+    delete head;
+    delete filterToTest;
+    delete tail;
+    delete frame;
+}
+
+void FilterUnitTest::pendingOutput()
+{
+    int ret = 0;
+    HeadFilterMockup* head = new HeadFilterMockup();
+    PendingOutputFilterMockup* filterToTest = new PendingOutputFilterMockup();
+    TailFilterMockup* tail = new TailFilterMockup();
+    Frame* frame = FrameMock::createNew(0);
+    
+    head->setId(1);
+    filterToTest->setId(2);
+    tail->setId(3);
+    
+    CPPUNIT_ASSERT(head->connectOneToOne(filterToTest));
+    CPPUNIT_ASSERT(filterToTest->connectOneToOne(tail));
+    
+    CPPUNIT_ASSERT(head->inject(frame));
+    head->processFrame(ret);
+    filterToTest->processFrame(ret);
+    CPPUNIT_ASSERT(filterToTest->processed == 1);
+    CPPUNIT_ASSERT(filterToTest->consumed);
+    
+    filterToTest->processFrame(ret);
+    CPPUNIT_ASSERT(filterToTest->processed == 1);
+    
+    filterToTest->pending = true;
+    filterToTest->processFrame(ret);
+    CPPUNIT_ASSERT(filterToTest->processed == 2);
+    CPPUNIT_ASSERT(!filterToTest->consumed);
+    
+    delete head;
+    delete filterToTest;
+    delete tail;
+    delete frame;
+}
+
+void FilterUnitTest::typedConnection()
+{
+    VideoFilterMockup* video = new VideoFilterMockup(H264);
+    AudioFilterMockup* audio = new AudioFilterMockup(AAC);
+    TypedVideoFilterMockup* typed = new TypedVideoFilterMockup();
+    TypedVideoFilterMockup* audioTyped = new TypedVideoFilterMockup(true);
+    BaseFilter* tail = new BaseFilterMockup(1,1);
+    
+    video->setId(1);
+    audio->setId(2);
+    typed->setId(3);
+    audioTyped->setId(4);
+    
+    //NOTE: the frames of the queues are checked once, when connecting the filters
+    CPPUNIT_ASSERT(!audio->connectOneToOne(typed));
+    CPPUNIT_ASSERT(!typed->isRConnected(DEFAULT_ID));
+    CPPUNIT_ASSERT(video->connectOneToOne(typed));
+    CPPUNIT_ASSERT(typed->isRConnected(DEFAULT_ID));
+    
+    CPPUNIT_ASSERT(!audioTyped->connectOneToOne(tail));
+    CPPUNIT_ASSERT(!audioTyped->isWConnected(DEFAULT_ID));
+    CPPUNIT_ASSERT(typed->connectOneToOne(tail));
+    
+    delete video;
+    delete audio;
+    delete typed;
+    delete audioTyped;
+    delete tail;
+}
+
+void FilterUnitTest::concurrentEvents()
+{
+    int ret = 0;
+    EventFilterMockup* filterToTest = new EventFilterMockup();
+    std::vector<std::thread> producers;
+    Jzon::Object root, params;
+    const int eventsPerProducer = 500;
+
+    root.Add("action", "count");
+    params.Add("inc", 1);
+    root.Add("params", params);
+
+    //NOTE: events are pushed while the filter executes the ones already in its inbox
+    for (int p = 0; p < 4; p++) {
+        producers.push_back(std::thread([filterToTest, &root]() {
+            for (int i = 0; i < eventsPerProducer; i++) {
+                filterToTest->pushEvent(Event(root, std::chrono::system_clock::now()));
+            }
+        }));
+    }
+
+    while (filterToTest->executed < 2*eventsPerProducer) {
+        filterToTest->processFrame(ret);
+    }
+
+    for (auto &t : producers) {
+        t.join();
+    }
+
+    filterToTest->processFrame(ret);
+    CPPUNIT_ASSERT(filterToTest->executed == 4*eventsPerProducer);
+
+    filterToTest->pushEvent(Event(root, std::chrono::system_clock::now(), 50));
+    filterToTest->processFrame(ret);
+    CPPUNIT_ASSERT(filterToTest->executed == 4*eventsPerProducer);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    filterToTest->processFrame(ret);
+    CPPUNIT_ASSERT(filterToTest->executed == 4*eventsPerProducer + 1);
+
+    delete filterToTest;
+}
+
+void FilterUnitTest::syncGroups()
+{
+    int ret = 0;
+    SyncFilterMockup* filterToTest = new SyncFilterMockup(3);
+    TimedHeadFilterMockup heads[3];
+    Frame* frame = FrameMock::createNew(0);
+    int times[] = {0, 100};
+
+    filterToTest->setId(10);
+
+    for (int i = 0; i < 3; i++) {
+        heads[i].setId(i + 1);
+        CPPUNIT_ASSERT(heads[i].connectOneToMany(filterToTest, i + 1));
+    }
+
+    //NOTE: the third reader gets no frame, readers ahead of the first one wait for it
+    for (int i = 0; i < 2; i++) {
+        heads[i].setTime(times[i]);
+        CPPUNIT_ASSERT(heads[i].inject(frame));
+        heads[i].processFrame(ret);
+    }
+
+    CPPUNIT_ASSERT(filterToTest->syncedReaders() == std::vector<int>({1}));
+
+    //NOTE: alone in their groups, readers do not wait for the other ones
+    filterToTest->setSyncGroup(2, 1);
+    filterToTest->setSyncGroup(3, 2);
+    CPPUNIT_ASSERT(filterToTest->getSyncGroup(3) == 2);
+    CPPUNIT_ASSERT(filterToTest->syncedReaders() == std::vector<int>({1, 2}));
+
+    filterToTest->setSyncGroup(3, 1);
+    CPPUNIT_ASSERT(filterToTest->syncedReaders() == std::vector<int>({1}));
+
+    delete filterToTest;
+    delete frame;
+}
+
 class FilterFunctionalTest : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(FilterFunctionalTest);
@@ -210,6 +591,91 @@ void FilterFunctionalTest::functionalTest()
 }
 
 CPPUNIT_TEST_SUITE_REGISTRATION(FilterFunctionalTest);
+void FilterUnitTest::burst()
+{
+    HeadFilterMockup* head = new HeadFilterMockup();
+    PendingOutputFilterMockup* filterToTest = new PendingOutputFilterMockup();
+    TailFilterMockup* tail = new TailFilterMockup();
+    Runnable* job = filterToTest;
+    Frame* frame = FrameMock::createNew(0);
+    Jzon::Object state;
+    
+    head->setId(1);
+    filterToTest->setId(2);
+    tail->setId(3);
+    
+    CPPUNIT_ASSERT(head->connectOneToOne(filterToTest));
+    CPPUNIT_ASSERT(filterToTest->connectOneToOne(tail));
+    
+    for (unsigned i = 0; i < 3; i++){
+        CPPUNIT_ASSERT(head->inject(frame));
+        head->runProcessFrame();
+    }
+    
+    job->runProcessFrame();
+    CPPUNIT_ASSERT(filterToTest->processed == 1);
+    
+    //NOTE: the burst is bound by the frames left, not by its size
+    filterToTest->setBurst(4);
+    job->runProcessFrame();
+    CPPUNIT_ASSERT(filterToTest->processed == 3);
+    CPPUNIT_ASSERT(job->getProfile().getCalls() == 2);
+    CPPUNIT_ASSERT(job->getProfile().getStalls() == 0);
+    
+    for (unsigned i = 0; i < 3; i++){
+        CPPUNIT_ASSERT(head->inject(frame));
+        head->runProcessFrame();
+    }
+    
+    filterToTest->setBurst(2);
+    job->runProcessFrame();
+    CPPUNIT_ASSERT(filterToTest->processed == 5);
+    
+    filterToTest->getState(state);
+    CPPUNIT_ASSERT(state.Get("burst").Get("frames").ToInt() == 2);
+    CPPUNIT_ASSERT(state.Get("burst").Get("burstedFrames").ToInt() == 2);
+    
+    filterToTest->setBurst(0);
+    CPPUNIT_ASSERT(filterToTest->getBurstFrames() == 1);
+    
+    delete head;
+    delete filterToTest;
+    delete tail;
+    delete frame;
+}
+
+void FilterUnitTest::suspendWriter()
+{
+    HeadFilterMockup* head = new HeadFilterMockup();
+    TailFilterMockup* tail = new TailFilterMockup();
+    Frame* frame = FrameMock::createNew(0);
+    
+    head->setId(1);
+    tail->setId(2);
+    
+    CPPUNIT_ASSERT(!head->suspendWriter(DEFAULT_ID, true));
+    CPPUNIT_ASSERT(head->connectManyToOne(tail, DEFAULT_ID));
+    CPPUNIT_ASSERT(head->suspendWriter(DEFAULT_ID, true));
+    CPPUNIT_ASSERT(head->isWriterSuspended(DEFAULT_ID));
+    
+    //NOTE: a filter whose writers are all suspended waits as if they were full
+    CPPUNIT_ASSERT(head->inject(frame));
+    head->runProcessFrame();
+    tail->runProcessFrame();
+    CPPUNIT_ASSERT(tail->getFrames() == 0);
+    CPPUNIT_ASSERT(!head->inject(frame));
+    
+    CPPUNIT_ASSERT(head->suspendWriter(DEFAULT_ID, false));
+    CPPUNIT_ASSERT(!head->isWriterSuspended(DEFAULT_ID));
+    head->runProcessFrame();
+    tail->runProcessFrame();
+    CPPUNIT_ASSERT(tail->getFrames() == 1);
+    
+    delete head;
+    delete tail;
+    delete frame;
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(FilterUnitTest);
 
 int main(int argc, char* argv[])
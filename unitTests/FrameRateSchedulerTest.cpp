@@ -0,0 +1,144 @@
+/*
+ *  FrameRateSchedulerTest.cpp - FrameRateScheduler class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "FrameRateScheduler.hh"
+#include "Utils.hh"
+
+class FrameRateSchedulerTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(FrameRateSchedulerTest);
+    CPPUNIT_TEST(keepAll);
+    CPPUNIT_TEST(decimation);
+    CPPUNIT_TEST(jitterAndGaps);
+    CPPUNIT_TEST(lateStart);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void keepAll();
+    void decimation();
+    void jitterAndGaps();
+    void lateStart();
+    
+    unsigned countKept(FrameRateScheduler &scheduler, unsigned frames, int interval, int start = 0);
+};
+
+unsigned FrameRateSchedulerTest::countKept(FrameRateScheduler &scheduler, unsigned frames, int interval, int start)
+{
+    unsigned kept = 0;
+    
+    for (unsigned i = 0; i < frames; i++) {
+        if (scheduler.keep(std::chrono::microseconds(start + i*interval))) {
+            kept++;
+        }
+    }
+    
+    return kept;
+}
+
+void FrameRateSchedulerTest::keepAll()
+{
+    FrameRateScheduler scheduler;
+    
+    CPPUNIT_ASSERT(countKept(scheduler, 100, 16667) == 100);
+    
+    scheduler.setFrameTime(std::chrono::microseconds(10000));
+    CPPUNIT_ASSERT(countKept(scheduler, 100, 40000) == 100);
+    CPPUNIT_ASSERT(scheduler.getDropped() == 0);
+}
+
+void FrameRateSchedulerTest::decimation()
+{
+    FrameRateScheduler scheduler;
+    
+    scheduler.setFrameTime(std::chrono::microseconds(33333));
+    CPPUNIT_ASSERT(countKept(scheduler, 300, 16667) == 150);
+    CPPUNIT_ASSERT(scheduler.getDropped() == 150);
+    
+    //NOTE: 51 frames at 50 fps cover a second, which has 31 slots at 30 fps
+    scheduler.reset();
+    CPPUNIT_ASSERT(countKept(scheduler, 51, 20000, 10000000) == 31);
+}
+
+void FrameRateSchedulerTest::jitterAndGaps()
+{
+    FrameRateScheduler scheduler;
+    unsigned kept = 0;
+    
+    scheduler.setFrameTime(std::chrono::microseconds(100000));
+    
+    for (unsigned i = 0; i < 250; i++) {
+        if (scheduler.keep(std::chrono::microseconds(i*40000 + (i % 3)*3000))) {
+            kept++;
+        }
+    }
+    CPPUNIT_ASSERT(kept == 100);
+    
+    CPPUNIT_ASSERT(countKept(scheduler, 10, 40000, 100000000) == 4);
+    CPPUNIT_ASSERT(countKept(scheduler, 10, 40000, 0) == 4);
+}
+
+void FrameRateSchedulerTest::lateStart()
+{
+    FrameRateScheduler first, late;
+    bool keep;
+    
+    first.setFrameTime(std::chrono::microseconds(33333));
+    late.setFrameTime(std::chrono::microseconds(33333));
+    
+    for (unsigned i = 0; i < 300; i++) {
+        keep = first.keep(std::chrono::microseconds(i*16667));
+        
+        //NOTE: the first frame of a late scheduler is kept, the next ones follow the same slots
+        if (i == 37) {
+            CPPUNIT_ASSERT(late.keep(std::chrono::microseconds(i*16667)));
+        } else if (i > 37) {
+            CPPUNIT_ASSERT(late.keep(std::chrono::microseconds(i*16667)) == keep);
+        }
+    }
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(FrameRateSchedulerTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("FrameRateSchedulerTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+    
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+} 
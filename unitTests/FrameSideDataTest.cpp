@@ -0,0 +1,233 @@
+/*
+ *  FrameSideDataTest.cpp - FrameSideData class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "Frame.hh"
+#include "VideoFrame.hh"
+#include "AVFramedQueue.hh"
+#include "FramePool.hh"
+#include "Utils.hh"
+
+class FrameSideDataTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(FrameSideDataTest);
+    CPPUNIT_TEST(inlineData);
+    CPPUNIT_TEST(spillData);
+    CPPUNIT_TEST(setAndRemove);
+    CPPUNIT_TEST(copy);
+    CPPUNIT_TEST(recycledFrames);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void inlineData();
+    void spillData();
+    void setAndRemove();
+    void copy();
+    void recycledFrames();
+};
+
+void FrameSideDataTest::inlineData()
+{
+    FrameSideData sd;
+    const unsigned char timecode[] = {1, 0, 0, 0, 0x12, 0x34, 0x56, 0x78};
+    const unsigned char cc[] = {0xFC, 0x94, 0x20, 0xFD, 0x80, 0x80};
+    const unsigned char* data;
+    unsigned size;
+
+    CPPUNIT_ASSERT(sd.empty());
+    CPPUNIT_ASSERT(!sd.get(SD_TIMECODE, size) && size == 0);
+
+    CPPUNIT_ASSERT(sd.add(SD_TIMECODE, timecode, sizeof(timecode)));
+    CPPUNIT_ASSERT(sd.add(SD_CAPTIONS, cc, sizeof(cc)));
+    CPPUNIT_ASSERT(sd.add(SD_CAPTIONS, cc, 3));
+    CPPUNIT_ASSERT(!sd.add(SD_SEI, NULL, 4));
+
+    CPPUNIT_ASSERT(sd.getEntries() == 3 && sd.has(SD_CAPTIONS) && !sd.has(SD_SEI));
+
+    data = sd.get(SD_TIMECODE, size);
+    CPPUNIT_ASSERT(size == sizeof(timecode) && memcmp(data, timecode, size) == 0);
+    data = sd.get(SD_CAPTIONS, size);
+    CPPUNIT_ASSERT(size == sizeof(cc) && memcmp(data, cc, size) == 0);
+    data = sd.get(SD_CAPTIONS, size, 1);
+    CPPUNIT_ASSERT(size == 3 && memcmp(data, cc, size) == 0);
+    CPPUNIT_ASSERT(!sd.get(SD_CAPTIONS, size, 2));
+
+    for (unsigned i = 3; i < SIDE_DATA_MAX_ENTRIES; i++) {
+        CPPUNIT_ASSERT(sd.add(SD_SEI, cc, sizeof(cc)));
+    }
+    CPPUNIT_ASSERT(!sd.add(SD_SEI, cc, sizeof(cc)));
+
+    sd.clear();
+    CPPUNIT_ASSERT(sd.empty() && !sd.has(SD_TIMECODE));
+}
+
+void FrameSideDataTest::spillData()
+{
+    FrameSideData sd;
+    std::vector<unsigned char> big(SIDE_DATA_INLINE_SIZE + 100);
+    std::vector<unsigned char> half(SIDE_DATA_INLINE_SIZE/2 + 1, 0xAA);
+    const unsigned char small[] = {1, 2, 3};
+    const unsigned char* data;
+    unsigned size;
+
+    for (unsigned i = 0; i < big.size(); i++) {
+        big[i] = i;
+    }
+
+    CPPUNIT_ASSERT(sd.add(SD_SEI, big.data(), big.size()));
+    CPPUNIT_ASSERT(sd.add(SD_CAPTIONS, half.data(), half.size()));
+    CPPUNIT_ASSERT(sd.add(SD_CAPTIONS, half.data(), half.size()));
+    CPPUNIT_ASSERT(sd.add(SD_TIMECODE, small, sizeof(small)));
+
+    data = sd.get(SD_SEI, size);
+    CPPUNIT_ASSERT(size == big.size() && memcmp(data, big.data(), size) == 0);
+    data = sd.get(SD_CAPTIONS, size, 1);
+    CPPUNIT_ASSERT(size == half.size() && memcmp(data, half.data(), size) == 0);
+    data = sd.get(SD_TIMECODE, size);
+    CPPUNIT_ASSERT(size == sizeof(small) && memcmp(data, small, size) == 0);
+}
+
+void FrameSideDataTest::setAndRemove()
+{
+    FrameSideData sd;
+    std::vector<unsigned char> big(SIDE_DATA_INLINE_SIZE, 0x55);
+    const unsigned char first[] = {1, 2, 3, 4};
+    const unsigned char second[] = {5, 6};
+    const unsigned char third[] = {7, 8, 9};
+    const unsigned char* data;
+    unsigned size;
+
+    CPPUNIT_ASSERT(sd.add(SD_CAPTIONS, first, sizeof(first)));
+    CPPUNIT_ASSERT(sd.add(SD_TIMECODE, second, sizeof(second)));
+    CPPUNIT_ASSERT(sd.add(SD_CAPTIONS, big.data(), big.size()));
+    CPPUNIT_ASSERT(sd.add(SD_SEI, third, sizeof(third)));
+
+    CPPUNIT_ASSERT(sd.set(SD_CAPTIONS, third, sizeof(third)));
+    CPPUNIT_ASSERT(sd.getEntries() == 3);
+
+    data = sd.get(SD_TIMECODE, size);
+    CPPUNIT_ASSERT(size == sizeof(second) && memcmp(data, second, size) == 0);
+    data = sd.get(SD_SEI, size);
+    CPPUNIT_ASSERT(size == sizeof(third) && memcmp(data, third, size) == 0);
+    data = sd.get(SD_CAPTIONS, size);
+    CPPUNIT_ASSERT(size == sizeof(third) && memcmp(data, third, size) == 0);
+    CPPUNIT_ASSERT(!sd.get(SD_CAPTIONS, size, 1));
+
+    sd.remove(SD_TIMECODE);
+    CPPUNIT_ASSERT(sd.getEntries() == 2 && !sd.has(SD_TIMECODE));
+    data = sd.get(SD_SEI, size);
+    CPPUNIT_ASSERT(size == sizeof(third) && memcmp(data, third, size) == 0);
+
+    //NOTE: the room of removed payloads is used again
+    CPPUNIT_ASSERT(sd.add(SD_TIMECODE, big.data(), big.size() - 2*sizeof(third)));
+    data = sd.get(SD_TIMECODE, size);
+    CPPUNIT_ASSERT(size == big.size() - 2*sizeof(third) && memcmp(data, big.data(), size) == 0);
+    data = sd.get(SD_CAPTIONS, size);
+    CPPUNIT_ASSERT(size == sizeof(third) && memcmp(data, third, size) == 0);
+}
+
+void FrameSideDataTest::copy()
+{
+    FrameSideData sd;
+    std::vector<unsigned char> big(SIDE_DATA_INLINE_SIZE + 1, 0x33);
+    const unsigned char cc[] = {0xFC, 0x94, 0x20};
+    const unsigned char* data;
+    unsigned size;
+
+    CPPUNIT_ASSERT(sd.add(SD_CAPTIONS, cc, sizeof(cc)));
+    CPPUNIT_ASSERT(sd.add(SD_SEI, big.data(), big.size()));
+
+    FrameSideData copied(sd);
+    FrameSideData assigned;
+    assigned.add(SD_TIMECODE, cc, 2);
+    assigned = sd;
+    sd.clear();
+
+    CPPUNIT_ASSERT(copied.getEntries() == 2 && assigned.getEntries() == 2 && !assigned.has(SD_TIMECODE));
+
+    data = copied.get(SD_SEI, size);
+    CPPUNIT_ASSERT(size == big.size() && memcmp(data, big.data(), size) == 0);
+    data = assigned.get(SD_CAPTIONS, size);
+    CPPUNIT_ASSERT(size == sizeof(cc) && memcmp(data, cc, size) == 0);
+}
+
+void FrameSideDataTest::recycledFrames()
+{
+    const unsigned char cc[] = {0xFC, 0x94, 0x20};
+    StreamInfo si(VIDEO);
+    AVFramedQueue* queue;
+    Frame* frame;
+
+    si.video.codec = H264;
+    queue = VideoFrameQueue::createNew(ConnectionData(), &si, 2);
+    CPPUNIT_ASSERT(queue);
+
+    frame = queue->getRear();
+    frame->getSideData().add(SD_CAPTIONS, cc, sizeof(cc));
+    queue->addFrame();
+    CPPUNIT_ASSERT(queue->getFront()->getSideData().has(SD_CAPTIONS));
+    queue->removeFrame();
+
+    queue->getRear();
+    queue->addFrame();
+    queue->getFront();
+    queue->removeFrame();
+
+    //NOTE: the slot written first is handed again to the writer, without the metadata
+    CPPUNIT_ASSERT(queue->getRear()->getSideData().empty());
+    delete queue;
+
+    frame = FramePool::getInstance()->getVideoFrame(RAW, 64, 64, YUV420P);
+    frame->getSideData().add(SD_CAPTIONS, cc, sizeof(cc));
+    FramePool::getInstance()->releaseFrame(frame);
+    frame = FramePool::getInstance()->getVideoFrame(RAW, 64, 64, YUV420P);
+    CPPUNIT_ASSERT(frame->getSideData().empty());
+    FramePool::getInstance()->releaseFrame(frame);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(FrameSideDataTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("FrameSideDataTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/*
+ *  FrameTracerTest.cpp - FrameTracer class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <fstream>
+#include <thread>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "FrameTracer.hh"
+#include "VideoFrame.hh"
+#include "Jzon.h"
+#include "Utils.hh"
+
+class FrameTracerTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(FrameTracerTest);
+    CPPUNIT_TEST(sampling);
+    CPPUNIT_TEST(chromeTrace);
+    CPPUNIT_TEST(wrapping);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void sampling();
+    void chromeTrace();
+    void wrapping();
+
+    FrameTracer *tracer;
+    Frame *frame;
+    Frame *coded;
+};
+
+void FrameTracerTest::setUp()
+{
+    tracer = FrameTracer::getInstance();
+    frame = InterleavedVideoFrame::createNew(RAW, 64, 64, YUV420P);
+    coded = InterleavedVideoFrame::createNew(H264, 1024);
+}
+
+void FrameTracerTest::tearDown()
+{
+    tracer->setSampling(0);
+    delete frame;
+    delete coded;
+}
+
+void FrameTracerTest::sampling()
+{
+    std::chrono::system_clock::time_point origin = std::chrono::system_clock::now();
+    unsigned traced = 0;
+
+    frame->setOriginTime(origin);
+    CPPUNIT_ASSERT(!tracer->isTraced(frame));
+
+    tracer->setSampling(1);
+    CPPUNIT_ASSERT(tracer->isTraced(frame));
+
+    tracer->setSampling(4);
+    for (unsigned i = 0; i < 1000; i++) {
+        frame->setOriginTime(origin + std::chrono::milliseconds(40*i));
+        coded->setOriginTime(frame->getOriginTime());
+
+        //NOTE: frames carrying the same origin time are always sampled alike
+        CPPUNIT_ASSERT_EQUAL(tracer->isTraced(frame), tracer->isTraced(coded));
+        traced += tracer->isTraced(frame) ? 1 : 0;
+    }
+
+    CPPUNIT_ASSERT(traced > 150 && traced < 350);
+}
+
+void FrameTracerTest::chromeTrace()
+{
+    std::map<int, std::string> names;
+    Jzon::Object root;
+    Jzon::Parser parser(root);
+    std::map<std::string, unsigned> events;
+    std::string trace;
+    int queueDur = 0;
+    bool named = false;
+
+    names[2] = "videoDecoder";
+    tracer->setSampling(1);
+
+    frame->setOriginTime(std::chrono::system_clock::now() - std::chrono::milliseconds(10));
+    coded->setOriginTime(frame->getOriginTime());
+
+    tracer->stamp(coded, 1, ENQUEUE);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    tracer->stamp(coded, 2, DEQUEUE, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    tracer->stamp(frame, 2, ENQUEUE);
+    tracer->stamp(frame, 2, ENQUEUE);
+    tracer->stamp(frame, 3, DEQUEUE, 2);
+    CPPUNIT_ASSERT_EQUAL((size_t) 5, tracer->getStamps());
+
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, tracer->getChromeTrace(trace, names));
+
+    parser.SetJson(trace);
+    CPPUNIT_ASSERT(parser.Parse());
+    CPPUNIT_ASSERT(root.Has("traceEvents"));
+
+    for (auto it = root.Get("traceEvents").AsArray().begin(); it != root.Get("traceEvents").AsArray().end(); ++it) {
+        events[(*it).Get("name").ToString()]++;
+
+        if ((*it).Get("name").ToString() == "queue" && (*it).Get("tid").ToInt() == 2) {
+            queueDur = (*it).Get("dur").ToInt();
+            CPPUNIT_ASSERT_EQUAL(1, (*it).Get("args").Get("from").ToInt());
+        }
+
+        if ((*it).Get("name").ToString() == "thread_name" && (*it).Get("tid").ToInt() == 2) {
+            named = (*it).Get("args").Get("name").ToString() == "2 videoDecoder";
+        }
+    }
+
+    //NOTE: the head filter processes from the origin time, the second writer does not add a hop
+    CPPUNIT_ASSERT_EQUAL(1u, events["frame"]);
+    CPPUNIT_ASSERT_EQUAL(2u, events["process"]);
+    CPPUNIT_ASSERT_EQUAL(2u, events["queue"]);
+    CPPUNIT_ASSERT_EQUAL(4u, events["thread_name"]);
+    CPPUNIT_ASSERT(queueDur >= 5000);
+    CPPUNIT_ASSERT(named);
+}
+
+void FrameTracerTest::wrapping()
+{
+    std::string trace;
+
+    tracer->setSampling(1);
+    frame->setOriginTime(std::chrono::system_clock::now());
+
+    for (unsigned i = 0; i < TRACE_MAX_STAMPS + 10; i++) {
+        tracer->stamp(frame, 1, ENQUEUE);
+    }
+
+    CPPUNIT_ASSERT_EQUAL((size_t) TRACE_MAX_STAMPS, tracer->getStamps());
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, tracer->getChromeTrace(trace, std::map<int, std::string>()));
+
+    tracer->setSampling(1);
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, tracer->getStamps());
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(FrameTracerTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("FrameTracerTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
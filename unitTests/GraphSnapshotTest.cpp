@@ -0,0 +1,214 @@
+/*
+ *  GraphSnapshotTest.cpp - Graph snapshot test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "GraphSnapshot.hh"
+#include "Utils.hh"
+
+#define SNAPSHOT_FILE "/tmp/graphSnapshotTest.json"
+
+class GraphSnapshotTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(GraphSnapshotTest);
+    CPPUNIT_TEST(recordAndRemove);
+    CPPUNIT_TEST(mergeSettings);
+    CPPUNIT_TEST(saveAndLoad);
+    CPPUNIT_TEST(autoSave);
+    CPPUNIT_TEST(invalidFile);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void tearDown();
+
+protected:
+    void recordAndRemove();
+    void mergeSettings();
+    void saveAndLoad();
+    void autoSave();
+    void invalidFile();
+
+    void parse(std::string json, Jzon::Object &node);
+    void record(GraphSnapshot &snapshot);
+};
+
+void GraphSnapshotTest::tearDown()
+{
+    std::remove(SNAPSHOT_FILE);
+}
+
+void GraphSnapshotTest::parse(std::string json, Jzon::Object &node)
+{
+    Jzon::Parser parser(node, json);
+    CPPUNIT_ASSERT(parser.Parse());
+}
+
+void GraphSnapshotTest::record(GraphSnapshot &snapshot)
+{
+    Jzon::Object receiver, encoder, path, event;
+
+    parse("{\"id\":1,\"type\":\"receiver\"}", receiver);
+    parse("{\"id\":2,\"type\":\"videoEncoder\",\"codec\":\"H264\"}", encoder);
+    parse("{\"id\":10,\"orgFilterId\":1,\"dstFilterId\":2,\"orgWriterId\":7,\"dstReaderId\":-1,"
+          "\"midFiltersIds\":[]}", path);
+    parse("{\"filterId\":2,\"action\":\"configure\",\"params\":{\"bitrate\":2000},\"delay\":500}", event);
+
+    snapshot.addFilter(receiver);
+    snapshot.addFilter(encoder);
+    snapshot.addPath(path);
+    snapshot.addEvent(event);
+}
+
+void GraphSnapshotTest::recordAndRemove()
+{
+    GraphSnapshot snapshot;
+    Jzon::Object root, event, state;
+    std::string json;
+
+    record(snapshot);
+
+    //NOTE: a repeated event is recorded once
+    parse("{\"filterId\":2,\"action\":\"configure\",\"params\":{\"bitrate\":2000}}", event);
+    snapshot.addEvent(event);
+
+    snapshot.serialise(json);
+    parse(json, root);
+    CPPUNIT_ASSERT(root.Get("version").ToInt() == SNAPSHOT_VERSION);
+    CPPUNIT_ASSERT(root.Get("graph").Get("filters").GetCount() == 2);
+    CPPUNIT_ASSERT(root.Get("graph").Get("paths").GetCount() == 1);
+    CPPUNIT_ASSERT(root.Get("graph").Get("events").GetCount() == 1);
+    CPPUNIT_ASSERT(!root.Get("graph").Get("events").Get(0).Has("delay"));
+    CPPUNIT_ASSERT(root.Get("graph").Get("filters").Get(1).Get("codec").ToString() == "H264");
+
+    snapshot.removePath(10);
+    snapshot.removeFilter(2);
+    snapshot.getState(state);
+    CPPUNIT_ASSERT(state.Get("filters").ToInt() == 1);
+    CPPUNIT_ASSERT(state.Get("paths").ToInt() == 0);
+    CPPUNIT_ASSERT(state.Get("events").ToInt() == 0);
+}
+
+void GraphSnapshotTest::mergeSettings()
+{
+    GraphSnapshot snapshot;
+    Jzon::Object first, second, root;
+    std::string json;
+
+    parse("{\"maxWorkers\":8,\"minWorkers\":2,\"threadBudget\":4}", first);
+    parse("{\"threadBudget\":6,\"hugePages\":true}", second);
+
+    snapshot.addSetting("configurePool", first);
+    snapshot.addSetting("configurePool", second);
+    snapshot.serialise(json);
+    parse(json, root);
+
+    Jzon::Object &pool = root.Get("settings").Get("configurePool").AsObject();
+    CPPUNIT_ASSERT(pool.GetCount() == 4);
+    CPPUNIT_ASSERT(pool.Get("maxWorkers").ToInt() == 8);
+    CPPUNIT_ASSERT(pool.Get("threadBudget").ToInt() == 6);
+    CPPUNIT_ASSERT(pool.Get("hugePages").ToBool());
+}
+
+void GraphSnapshotTest::saveAndLoad()
+{
+    GraphSnapshot snapshot;
+    Jzon::Object loaded;
+    std::string error;
+
+    record(snapshot);
+    CPPUNIT_ASSERT(snapshot.save(SNAPSHOT_FILE));
+    CPPUNIT_ASSERT(GraphSnapshot::load(SNAPSHOT_FILE, loaded, error));
+    CPPUNIT_ASSERT(error.empty());
+    CPPUNIT_ASSERT(loaded.Get("graph").Get("filters").GetCount() == 2);
+    CPPUNIT_ASSERT(loaded.Get("graph").Get("paths").Get(0).Get("orgWriterId").ToInt() == 7);
+    CPPUNIT_ASSERT(loaded.Get("graph").Get("events").Get(0).Get("params").Get("bitrate").ToInt() == 2000);
+}
+
+void GraphSnapshotTest::autoSave()
+{
+    GraphSnapshot snapshot;
+    Jzon::Object loaded, state;
+    std::string error;
+
+    snapshot.configure(SNAPSHOT_FILE, true);
+    record(snapshot);
+
+    //NOTE: nothing is written until the request is committed
+    CPPUNIT_ASSERT(!GraphSnapshot::load(SNAPSHOT_FILE, loaded, error));
+
+    snapshot.hold(true);
+    snapshot.commit();
+    CPPUNIT_ASSERT(!GraphSnapshot::load(SNAPSHOT_FILE, loaded, error));
+
+    snapshot.hold(false);
+    snapshot.commit();
+    snapshot.commit();
+    snapshot.getState(state);
+    CPPUNIT_ASSERT(state.Get("saves").ToInt() == 1);
+
+    Jzon::Object reloaded;
+    CPPUNIT_ASSERT(GraphSnapshot::load(SNAPSHOT_FILE, reloaded, error));
+    CPPUNIT_ASSERT(reloaded.Get("graph").Get("filters").GetCount() == 2);
+}
+
+void GraphSnapshotTest::invalidFile()
+{
+    Jzon::Object loaded;
+    std::string error;
+    std::ofstream file(SNAPSHOT_FILE);
+
+    file << "{\"version\":99,\"graph\":{}}";
+    file.close();
+
+    CPPUNIT_ASSERT(!GraphSnapshot::load(SNAPSHOT_FILE, loaded, error));
+    CPPUNIT_ASSERT(error.find("version") != std::string::npos);
+
+    error.clear();
+    CPPUNIT_ASSERT(!GraphSnapshot::load("/tmp/graphSnapshotTest.missing", loaded, error));
+    CPPUNIT_ASSERT(!error.empty());
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(GraphSnapshotTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("GraphSnapshotTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -37,6 +37,7 @@ class IOInterfaceTest : public CppUnit::TestFixture
     CPPUNIT_TEST_SUITE(IOInterfaceTest);
     CPPUNIT_TEST(readerTest);
     CPPUNIT_TEST(setConnectionTest);
+    CPPUNIT_TEST(delayHistogramTest);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -46,6 +47,7 @@ public:
 protected:
     void readerTest();
     void setConnectionTest();
+    void delayHistogramTest();
     
 private:
     Reader *reader;
@@ -125,7 +127,9 @@ void IOInterfaceTest::readerTest()
     reader->getFrame(2, gotFrame);
     CPPUNIT_ASSERT(gotFrame == true);
     
+    CPPUNIT_ASSERT(!reader->isShared());
     reader->addReader(3, 3);
+    CPPUNIT_ASSERT(reader->isShared());
     queue->addFrame();
     queue->addFrame();
     queue->addFrame();
@@ -251,6 +255,34 @@ void IOInterfaceTest::readerTest()
     CPPUNIT_ASSERT(!queue->isConnected());
 }
 
+void IOInterfaceTest::delayHistogramTest()
+{
+    DelayHistogram hist;
+
+    CPPUNIT_ASSERT(hist.getPercentile(50).count() == 0);
+
+    hist.add(std::chrono::microseconds(5));
+    hist.add(std::chrono::microseconds(-3));
+    CPPUNIT_ASSERT(hist.getCount() == 2);
+    CPPUNIT_ASSERT(hist.getPercentile(50).count() == 0);
+    CPPUNIT_ASSERT(hist.getPercentile(100).count() == 5);
+
+    hist.clear();
+    for (int i = 1; i <= 1000; i++) {
+        hist.add(std::chrono::milliseconds(i));
+    }
+
+    //NOTE: percentiles are the bucket upper bounds, within 12.5% of the exact ones
+    CPPUNIT_ASSERT(hist.getPercentile(50).count() >= 500000 && hist.getPercentile(50).count() <= 562500);
+    CPPUNIT_ASSERT(hist.getPercentile(90).count() >= 900000 && hist.getPercentile(90).count() <= 1000000);
+    CPPUNIT_ASSERT(hist.getPercentile(99).count() >= 990000 && hist.getPercentile(99).count() <= 1000000);
+    CPPUNIT_ASSERT(hist.getPercentile(100).count() == 1000000);
+
+    hist.add(std::chrono::hours(100));
+    CPPUNIT_ASSERT(hist.getPercentile(100) == std::chrono::hours(100));
+    CPPUNIT_ASSERT(hist.getPercentile(99).count() <= 1125000);
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(IOInterfaceTest);
 
 int main(int argc, char* argv[])
@@ -0,0 +1,239 @@
+/*
+ *  IOReactorTest.cpp - IOReactor and Awaiter classes test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "IOReactor.hh"
+#include "WorkersPool.hh"
+#include "Utils.hh"
+
+#define REACTOR_TEST_TIMEOUT 2000   //!< msec waiting for a handler
+
+static bool waitFor(std::atomic<unsigned> &counter, unsigned value)
+{
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() +
+                                                std::chrono::milliseconds(REACTOR_TEST_TIMEOUT);
+
+    while (counter < value && std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return counter >= value;
+}
+
+/*! Non periodic runnable reading an eventfd, it suspends until the descriptor is readable */
+class ReadingRunnable : public Runnable {
+public:
+    ReadingRunnable(int fd_) : Runnable(false), awaiter(this), fd(fd_), runs(0), reads(0) {};
+
+    Awaiter awaiter;
+    std::atomic<unsigned> runs;
+    std::atomic<unsigned> reads;
+
+protected:
+    void processFrame(int& ret, std::vector<int> &/*jobs*/) {
+        uint64_t value;
+
+        awaiter.bind();
+        awaiter.consume();
+        runs++;
+
+        if (read(fd, &value, sizeof(value)) > 0) {
+            reads++;
+        }
+
+        awaiter.awaitReadable(fd);
+        ret = 0;
+    };
+
+    bool pendingJobs() {return awaiter.isResumed();};
+
+private:
+    int fd;
+};
+
+class IOReactorTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(IOReactorTest);
+    CPPUNIT_TEST(watchOnce);
+    CPPUNIT_TEST(unwatch);
+    CPPUNIT_TEST(timers);
+    CPPUNIT_TEST(awaiterFlag);
+    CPPUNIT_TEST(resumeInPool);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void watchOnce();
+    void unwatch();
+    void timers();
+    void awaiterFlag();
+    void resumeInPool();
+};
+
+void IOReactorTest::watchOnce()
+{
+    IOReactor *reactor = IOReactor::getInstance();
+    std::atomic<unsigned> calls(0);
+    uint64_t one = 1;
+    int fd = eventfd(0, EFD_NONBLOCK);
+
+    CPPUNIT_ASSERT(reactor->watch(fd, EPOLLIN, [&calls] (unsigned events) {
+        if (events & EPOLLIN) {
+            calls++;
+        }
+    }));
+    CPPUNIT_ASSERT(!reactor->watch(fd, EPOLLIN, [] (unsigned) {}));
+
+    CPPUNIT_ASSERT(write(fd, &one, sizeof(one)) == sizeof(one));
+    CPPUNIT_ASSERT(waitFor(calls, 1));
+
+    //NOTE: the descriptor is still readable, but it has been forgotten
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CPPUNIT_ASSERT(calls == 1);
+    CPPUNIT_ASSERT(reactor->getWatchedNum() == 0);
+    CPPUNIT_ASSERT(!reactor->unwatch(fd));
+
+    close(fd);
+}
+
+void IOReactorTest::unwatch()
+{
+    IOReactor *reactor = IOReactor::getInstance();
+    std::atomic<unsigned> calls(0);
+    uint64_t one = 1;
+    int fd = eventfd(0, EFD_NONBLOCK);
+
+    CPPUNIT_ASSERT(reactor->watch(fd, EPOLLIN, [&calls] (unsigned) {calls++;}));
+    CPPUNIT_ASSERT(reactor->unwatch(fd));
+
+    CPPUNIT_ASSERT(write(fd, &one, sizeof(one)) == sizeof(one));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CPPUNIT_ASSERT(calls == 0);
+
+    close(fd);
+}
+
+void IOReactorTest::timers()
+{
+    IOReactor *reactor = IOReactor::getInstance();
+    std::atomic<unsigned> order(0);
+    std::atomic<unsigned> fast(0);
+    std::atomic<unsigned> slow(0);
+    std::atomic<unsigned> cancelled(0);
+    unsigned id;
+
+    reactor->addTimer(std::chrono::milliseconds(30), [&] () {slow = ++order;});
+    reactor->addTimer(std::chrono::milliseconds(5), [&] () {fast = ++order;});
+    id = reactor->addTimer(std::chrono::milliseconds(10), [&] () {cancelled++;});
+
+    CPPUNIT_ASSERT(id != 0);
+    CPPUNIT_ASSERT(reactor->cancelTimer(id));
+    CPPUNIT_ASSERT(!reactor->cancelTimer(id));
+
+    CPPUNIT_ASSERT(waitFor(order, 2));
+    CPPUNIT_ASSERT(fast == 1 && slow == 2);
+    CPPUNIT_ASSERT(cancelled == 0);
+    CPPUNIT_ASSERT(reactor->getTimersNum() == 0);
+}
+
+void IOReactorTest::awaiterFlag()
+{
+    ReadingRunnable job(-1);
+    std::atomic<unsigned> waited(0);
+
+    //NOTE: without a pool the awaiter only keeps the flag
+    job.awaiter.resume();
+    CPPUNIT_ASSERT(job.awaiter.isResumed());
+    CPPUNIT_ASSERT(job.awaiter.consume());
+    CPPUNIT_ASSERT(!job.awaiter.consume());
+
+    CPPUNIT_ASSERT(job.awaiter.awaitTimer(std::chrono::milliseconds(5)));
+    IOReactor::getInstance()->addTimer(std::chrono::milliseconds(30), [&waited] () {waited++;});
+    CPPUNIT_ASSERT(waitFor(waited, 1));
+    CPPUNIT_ASSERT(job.awaiter.consume());
+
+    //NOTE: cancelled waits do not resume it
+    CPPUNIT_ASSERT(job.awaiter.awaitTimer(std::chrono::milliseconds(5)));
+    job.awaiter.cancel();
+    IOReactor::getInstance()->addTimer(std::chrono::milliseconds(30), [&waited] () {waited++;});
+    CPPUNIT_ASSERT(waitFor(waited, 2));
+    CPPUNIT_ASSERT(!job.awaiter.isResumed());
+}
+
+void IOReactorTest::resumeInPool()
+{
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ReadingRunnable *job = new ReadingRunnable(fd);
+    WorkersPool *pool = new WorkersPool(2);
+    uint64_t one = 1;
+    unsigned runs;
+
+    CPPUNIT_ASSERT(job->setId(1));
+    CPPUNIT_ASSERT(pool->addTask(job));
+    CPPUNIT_ASSERT(waitFor(job->runs, 1));
+
+    //NOTE: the suspended runnable is not polled
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    runs = job->runs;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CPPUNIT_ASSERT(job->runs == runs);
+
+    for (unsigned i = 1; i <= 3; i++) {
+        CPPUNIT_ASSERT(write(fd, &one, sizeof(one)) == sizeof(one));
+        CPPUNIT_ASSERT(waitFor(job->reads, i));
+    }
+
+    pool->stop();
+    delete pool;
+    delete job;
+    close(fd);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(IOReactorTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("IOReactorTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
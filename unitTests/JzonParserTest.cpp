@@ -0,0 +1,161 @@
+/*
+ *  JzonParserTest.cpp - Jzon parser test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "Jzon.h"
+#include "Utils.hh"
+
+class JzonParserTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(JzonParserTest);
+    CPPUNIT_TEST(parseRequest);
+    CPPUNIT_TEST(parseValues);
+    CPPUNIT_TEST(parseErrors);
+    CPPUNIT_TEST(roundTrip);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void parseRequest();
+    void parseValues();
+    void parseErrors();
+    void roundTrip();
+};
+
+void JzonParserTest::parseRequest()
+{
+    Jzon::Object root;
+    Jzon::Parser parser(root);
+    std::string json = "{\"id\": 3, \"events\": [ {\"action\": \"changeChannelGain\", \"filterId\": 12, "
+                       "\"delay\": 0, \"params\": {\"id\": 1, \"gain\": 0.5}}, /* comment */ "
+                       "{\"action\": \"getState\", \"params\": {}} ]}";
+
+    parser.SetJson(json);
+    CPPUNIT_ASSERT(parser.Parse());
+
+    CPPUNIT_ASSERT(root.Get("id").ToInt() == 3);
+    CPPUNIT_ASSERT(root.Get("events").IsArray());
+    CPPUNIT_ASSERT(root.Get("events").GetCount() == 2);
+
+    Jzon::Node &event = root.Get("events").Get(0);
+    CPPUNIT_ASSERT(event.Get("action").ToString() == "changeChannelGain");
+    CPPUNIT_ASSERT(event.Get("filterId").ToInt() == 12);
+    CPPUNIT_ASSERT(event.Get("params").Get("gain").ToFloat() == 0.5f);
+    CPPUNIT_ASSERT(root.Get("events").Get(1).Get("params").IsObject());
+    CPPUNIT_ASSERT(root.Get("events").Get(1).Get("params").GetCount() == 0);
+}
+
+void JzonParserTest::parseValues()
+{
+    Jzon::Object root;
+    Jzon::Parser parser(root);
+
+    parser.SetJson("{\"s\":\"a \\\"quoted\\\" text\",\"n\":-1.25,\"t\":true,\"f\":FALSE,\"z\":null,"
+                   "\"a\":[1,[],[2,{\"x\":\"y\"}]]}");
+    CPPUNIT_ASSERT(parser.Parse());
+
+    CPPUNIT_ASSERT(root.Get("s").ToString() == "a \"quoted\" text");
+    CPPUNIT_ASSERT(root.Get("n").ToDouble() == -1.25);
+    CPPUNIT_ASSERT(root.Get("t").ToBool());
+    CPPUNIT_ASSERT(root.Get("f").IsBool() && !root.Get("f").ToBool());
+    CPPUNIT_ASSERT(root.Get("z").IsNull());
+    CPPUNIT_ASSERT(root.Get("a").GetCount() == 3);
+    CPPUNIT_ASSERT(root.Get("a").Get(1).GetCount() == 0);
+    CPPUNIT_ASSERT(root.Get("a").Get(2).Get(1).Get("x").ToString() == "y");
+}
+
+void JzonParserTest::parseErrors()
+{
+    const char* invalid[] = {"{\"a\":}", "{\"a\" 1}", "{\"a\":1", "{1:2}", "[1,2", "{\"a\":wrong}", "{\"a\":\"open}",
+                             "{\"a\":1}}", "{\"a\":1}{\"b\":2}", "{\"a\":[1]]}"};
+    Jzon::Array array, nested;
+    Jzon::Parser arrayParser(array, "{\"a\":1}");
+    Jzon::Parser nestedParser(nested);
+
+    for (auto json : invalid) {
+        Jzon::Object root;
+        Jzon::Parser parser(root, json);
+
+        CPPUNIT_ASSERT(!parser.Parse());
+        CPPUNIT_ASSERT(!parser.GetError().empty());
+    }
+
+    CPPUNIT_ASSERT(!arrayParser.Parse());
+
+    //NOTE: deep nesting is rejected before it can exhaust the stack
+    nestedParser.SetJson(std::string(600000, '['));
+    CPPUNIT_ASSERT(!nestedParser.Parse());
+    CPPUNIT_ASSERT(!nestedParser.GetError().empty());
+
+    nestedParser.SetJson(std::string(256, '[') + std::string(256, ']'));
+    CPPUNIT_ASSERT(nestedParser.Parse());
+
+    nestedParser.SetJson(std::string(257, '[') + std::string(257, ']'));
+    CPPUNIT_ASSERT(!nestedParser.Parse());
+}
+
+void JzonParserTest::roundTrip()
+{
+    Jzon::Object root, parsed, params;
+    Jzon::Array ids;
+    Jzon::Parser parser(parsed);
+
+    ids.Add(1);
+    ids.Add(2);
+    params.Add("name", "mixer \"main\"");
+    params.Add("ids", ids);
+    root.Add("action", "configure");
+    root.Add("params", params);
+
+    Jzon::Writer writer(root, Jzon::NoFormat);
+    writer.Write();
+
+    parser.SetJson(writer.GetResult());
+    CPPUNIT_ASSERT(parser.Parse());
+
+    Jzon::Writer parsedWriter(parsed, Jzon::NoFormat);
+    parsedWriter.Write();
+    CPPUNIT_ASSERT(parsedWriter.GetResult() == writer.GetResult());
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(JzonParserTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("JzonParserTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+/*
+ *  LoadGovernorTest.cpp - LoadGovernor class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "LoadGovernor.hh"
+#include "Utils.hh"
+
+#define HIGH std::chrono::microseconds(GOVERNOR_HIGH_RESIDENCY)
+#define LOW std::chrono::microseconds(GOVERNOR_LOW_RESIDENCY)
+
+class LoadGovernorTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(LoadGovernorTest);
+    CPPUNIT_TEST(configuration);
+    CPPUNIT_TEST(degradation);
+    CPPUNIT_TEST(restoration);
+    CPPUNIT_TEST(disabling);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void configuration();
+    void degradation();
+    void restoration();
+    void disabling();
+
+    LoadGovernor *governor;
+};
+
+void LoadGovernorTest::setUp()
+{
+    governor = new LoadGovernor();
+    CPPUNIT_ASSERT(governor->configure(true, 0.9, 0.7, HIGH, LOW, std::chrono::seconds(1), 2));
+}
+
+void LoadGovernorTest::tearDown()
+{
+    delete governor;
+}
+
+void LoadGovernorTest::configuration()
+{
+    LoadGovernor g;
+
+    CPPUNIT_ASSERT(!g.isEnabled());
+    CPPUNIT_ASSERT(!g.update(1, HIGH));
+    CPPUNIT_ASSERT(g.getLevel() == 0);
+
+    CPPUNIT_ASSERT(!g.configure(true, 1.5, 0.7, HIGH, LOW, std::chrono::seconds(1), 2));
+    CPPUNIT_ASSERT(!g.configure(true, 0.7, 0.9, HIGH, LOW, std::chrono::seconds(1), 2));
+    CPPUNIT_ASSERT(!g.configure(true, 0.9, 0.7, LOW, HIGH, std::chrono::seconds(1), 2));
+    CPPUNIT_ASSERT(!g.configure(true, 0.9, 0.7, HIGH, LOW, std::chrono::seconds(0), 2));
+    CPPUNIT_ASSERT(!g.configure(true, 0.9, 0.7, HIGH, LOW, std::chrono::seconds(1), 0));
+    CPPUNIT_ASSERT(!g.isEnabled());
+
+    CPPUNIT_ASSERT(g.configure(true, 0.9, 0.7, HIGH, LOW, std::chrono::seconds(2), 1));
+    CPPUNIT_ASSERT(g.isEnabled());
+    CPPUNIT_ASSERT(g.getPeriod() == std::chrono::seconds(2));
+}
+
+void LoadGovernorTest::degradation()
+{
+    //NOTE: either signal overloads the node
+    CPPUNIT_ASSERT(governor->update(0.95, std::chrono::microseconds(0)));
+    CPPUNIT_ASSERT(governor->getLevel() == 1);
+
+    //NOTE: the level is held before stepping again
+    CPPUNIT_ASSERT(!governor->update(0.5, HIGH));
+    CPPUNIT_ASSERT(governor->getLevel() == 1);
+    CPPUNIT_ASSERT(governor->update(0.5, HIGH));
+    CPPUNIT_ASSERT(governor->getLevel() == 2);
+
+    for (unsigned i = 0; i < 4*GOVERNOR_LEVELS; i++) {
+        governor->update(1, HIGH);
+    }
+
+    CPPUNIT_ASSERT(governor->getLevel() == GOVERNOR_LEVELS);
+}
+
+void LoadGovernorTest::restoration()
+{
+    governor->update(1, HIGH);
+    governor->update(1, HIGH);
+    governor->update(1, HIGH);
+    CPPUNIT_ASSERT(governor->getLevel() == 2);
+
+    //NOTE: loads between the thresholds keep the level
+    for (unsigned i = 0; i < 4; i++) {
+        CPPUNIT_ASSERT(!governor->update(0.8, LOW));
+    }
+
+    CPPUNIT_ASSERT(governor->getLevel() == 2);
+
+    //NOTE: restoring takes consecutive relieved checks
+    CPPUNIT_ASSERT(!governor->update(0.5, LOW));
+    CPPUNIT_ASSERT(!governor->update(0.8, LOW));
+    CPPUNIT_ASSERT(!governor->update(0.5, LOW));
+    CPPUNIT_ASSERT(governor->update(0.5, LOW));
+    CPPUNIT_ASSERT(governor->getLevel() == 1);
+
+    CPPUNIT_ASSERT(!governor->update(0.5, LOW));
+    CPPUNIT_ASSERT(governor->update(0.5, LOW));
+    CPPUNIT_ASSERT(governor->getLevel() == 0);
+    CPPUNIT_ASSERT(!governor->update(0.5, LOW));
+}
+
+void LoadGovernorTest::disabling()
+{
+    Jzon::Object state;
+
+    governor->update(1, HIGH);
+    CPPUNIT_ASSERT(governor->getLevel() == 1);
+
+    CPPUNIT_ASSERT(governor->configure(false, 0.9, 0.7, HIGH, LOW, std::chrono::seconds(1), 2));
+    CPPUNIT_ASSERT(governor->getLevel() == 0);
+    CPPUNIT_ASSERT(!governor->update(1, HIGH));
+
+    governor->getState(state);
+    CPPUNIT_ASSERT(!state.Get("enabled").ToBool());
+    CPPUNIT_ASSERT(state.Get("level").ToInt() == 0);
+    CPPUNIT_ASSERT(state.Get("degradations").ToInt() == 1);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LoadGovernorTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("LoadGovernorTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
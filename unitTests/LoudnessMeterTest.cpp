@@ -0,0 +1,188 @@
+/*
+ *  LoudnessMeterTest.cpp - EBU R128 loudness meter test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cmath>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "LoudnessMeter.hh"
+#include "Utils.hh"
+
+#define SAMPLE_RATE 48000
+#define FRAME_SAMPLES 1024
+#define TOLERANCE 0.1       //!< LU, EBU Tech 3341 allows +-0.1 LU for the stationary signals
+
+class LoudnessMeterTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(LoudnessMeterTest);
+    CPPUNIT_TEST(invalidConfig);
+    CPPUNIT_TEST(sineReference);
+    CPPUNIT_TEST(channelWeights);
+    CPPUNIT_TEST(windows);
+    CPPUNIT_TEST(gating);
+    CPPUNIT_TEST(otherRate);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void invalidConfig();
+    void sineReference();
+    void channelWeights();
+    void windows();
+    void gating();
+    void otherRate();
+
+    //NOTE: 1 kHz sines of the given amplitudes, continuing the phase of the previous call
+    void feed(LoudnessMeter &meter, std::vector<float> amplitudes, double seconds, unsigned rate = SAMPLE_RATE);
+
+    size_t phase = 0;
+};
+
+void LoudnessMeterTest::feed(LoudnessMeter &meter, std::vector<float> amplitudes, double seconds, unsigned rate)
+{
+    std::vector<std::vector<float>> planes(amplitudes.size(), std::vector<float>(FRAME_SAMPLES));
+    std::vector<float const*> pointers;
+    size_t total = seconds*rate;
+    size_t n;
+
+    for (auto &p : planes) {
+        pointers.push_back(p.data());
+    }
+
+    for (size_t done = 0; done < total; done += n) {
+        n = std::min<size_t>(FRAME_SAMPLES, total - done);
+
+        for (size_t i = 0; i < n; i++, phase++) {
+            for (size_t c = 0; c < amplitudes.size(); c++) {
+                planes[c][i] = amplitudes[c]*sin(2*M_PI*1000.0*phase/rate);
+            }
+        }
+
+        meter.process(pointers.data(), n);
+    }
+}
+
+void LoudnessMeterTest::invalidConfig()
+{
+    LoudnessMeter meter;
+
+    CPPUNIT_ASSERT(!meter.configure(0, SAMPLE_RATE));
+    CPPUNIT_ASSERT(!meter.configure(LOUDNESS_LANES + 1, SAMPLE_RATE));
+    CPPUNIT_ASSERT(!meter.configure(2, 0));
+    CPPUNIT_ASSERT(meter.getIntegrated() == LOUDNESS_SILENCE);
+    CPPUNIT_ASSERT(meter.getMomentary() == LOUDNESS_SILENCE);
+}
+
+void LoudnessMeterTest::sineReference()
+{
+    LoudnessMeter meter;
+
+    //NOTE: BS.1770 reference, a 0 dBFS 1 kHz sine in a front channel measures -3.01 LKFS
+    CPPUNIT_ASSERT(meter.configure(1, SAMPLE_RATE));
+    feed(meter, {1.0}, 5);
+
+    CPPUNIT_ASSERT(fabs(meter.getMomentary() + 3.01) < TOLERANCE);
+    CPPUNIT_ASSERT(fabs(meter.getShortTerm() + 3.01) < TOLERANCE);
+    CPPUNIT_ASSERT(fabs(meter.getIntegrated() + 3.01) < TOLERANCE);
+
+    meter.reset();
+    feed(meter, {0.1}, 5);
+    CPPUNIT_ASSERT(fabs(meter.getIntegrated() + 23.01) < TOLERANCE);
+}
+
+void LoudnessMeterTest::channelWeights()
+{
+    LoudnessMeter stereo;
+    LoudnessMeter surround;
+
+    //NOTE: both channels add their energy, +3 dB
+    CPPUNIT_ASSERT(stereo.configure(2, SAMPLE_RATE));
+    feed(stereo, {0.1, 0.1}, 3);
+    CPPUNIT_ASSERT(fabs(stereo.getIntegrated() + 20.0) < TOLERANCE);
+
+    //NOTE: the LFE is not measured and the surrounds weight 1.41
+    CPPUNIT_ASSERT(surround.configure(6, SAMPLE_RATE));
+    feed(surround, {0, 0, 0, 1.0, 0.1, 0}, 3);
+    CPPUNIT_ASSERT(fabs(surround.getIntegrated() - (-23.01 + 10*log10(1.41))) < TOLERANCE);
+}
+
+void LoudnessMeterTest::windows()
+{
+    LoudnessMeter meter;
+
+    CPPUNIT_ASSERT(meter.configure(1, SAMPLE_RATE));
+    feed(meter, {0.1}, 5);
+    feed(meter, {0.01}, 1);
+
+    //NOTE: the momentary window only holds the quiet part, the short-term one mixes both
+    CPPUNIT_ASSERT(fabs(meter.getMomentary() + 43.01) < TOLERANCE);
+    CPPUNIT_ASSERT(meter.getShortTerm() > -43.0 && meter.getShortTerm() < -23.0);
+}
+
+void LoudnessMeterTest::gating()
+{
+    LoudnessMeter meter;
+
+    CPPUNIT_ASSERT(meter.configure(1, SAMPLE_RATE));
+
+    //NOTE: silence is under the absolute gate and the quiet part under the relative one
+    feed(meter, {0.1}, 10);
+    feed(meter, {0}, 10);
+    CPPUNIT_ASSERT(fabs(meter.getIntegrated() + 23.01) < TOLERANCE);
+
+    feed(meter, {0.005}, 10);
+    CPPUNIT_ASSERT(fabs(meter.getIntegrated() + 23.01) < 3*TOLERANCE);
+    CPPUNIT_ASSERT(meter.getGatingBlocks() > 2*100);
+}
+
+void LoudnessMeterTest::otherRate()
+{
+    LoudnessMeter meter;
+
+    CPPUNIT_ASSERT(meter.configure(1, 44100));
+    feed(meter, {0.1}, 5, 44100);
+    CPPUNIT_ASSERT(fabs(meter.getIntegrated() + 23.01) < TOLERANCE);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LoudnessMeterTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("LoudnessMeterTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
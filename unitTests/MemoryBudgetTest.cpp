@@ -0,0 +1,142 @@
+/*
+ *  MemoryBudgetTest.cpp - MemoryBudget class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "MemoryBudget.hh"
+#include "AVFramedQueue.hh"
+#include "Utils.hh"
+
+class MemoryBudgetTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(MemoryBudgetTest);
+    CPPUNIT_TEST(accounting);
+    CPPUNIT_TEST(budget);
+    CPPUNIT_TEST(queueCharges);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void accounting();
+    void budget();
+    void queueCharges();
+
+    MemoryBudget *memory;
+};
+
+void MemoryBudgetTest::setUp()
+{
+    memory = MemoryBudget::getInstance();
+}
+
+void MemoryBudgetTest::tearDown()
+{
+    memory->setBudget(0);
+}
+
+void MemoryBudgetTest::accounting()
+{
+    memory->charge(1, 1, 1000);
+    memory->charge(1, 2, 500);
+    memory->charge(2, 1, 200);
+
+    CPPUNIT_ASSERT(memory->getQueueBytes(1, 1) == 1000);
+    CPPUNIT_ASSERT(memory->getQueueBytes(1, 2) == 500);
+    CPPUNIT_ASSERT(memory->getFilterBytes(1) == 1500);
+    CPPUNIT_ASSERT(memory->getFilterBytes(2) == 200);
+    CPPUNIT_ASSERT(memory->getFilterBytes(3) == 0);
+    CPPUNIT_ASSERT(memory->getQueuesBytes() == 1700);
+
+    //NOTE: queues never release more than they charged
+    memory->discharge(1, 1, 1000);
+    memory->discharge(2, 1, 300);
+    memory->discharge(3, 1, 300);
+    CPPUNIT_ASSERT(memory->getQueueBytes(1, 1) == 0);
+    CPPUNIT_ASSERT(memory->getFilterBytes(2) == 0);
+    CPPUNIT_ASSERT(memory->getQueuesBytes() == 500);
+
+    memory->discharge(1, 2, 500);
+    CPPUNIT_ASSERT(memory->getQueuesBytes() == 0);
+}
+
+void MemoryBudgetTest::budget()
+{
+    CPPUNIT_ASSERT(memory->getBudget() == 0);
+    CPPUNIT_ASSERT(memory->fits(1024*1024*1024, 1024*1024*1024));
+
+    memory->setBudget(1000);
+    memory->charge(1, 1, 600);
+
+    CPPUNIT_ASSERT(memory->fits(400, 0));
+    CPPUNIT_ASSERT(!memory->fits(401, 0));
+    CPPUNIT_ASSERT(!memory->fits(300, 200));
+
+    memory->discharge(1, 1, 600);
+    CPPUNIT_ASSERT(memory->fits(800, 200));
+}
+
+void MemoryBudgetTest::queueCharges()
+{
+    ConnectionData cData;
+    StreamInfo si = {VIDEO};
+    VideoFrameQueue *queue;
+
+    cData.wFilterId = 7;
+    cData.writerId = 3;
+    si.video.codec = H264;
+
+    queue = VideoFrameQueue::createNew(cData, &si, 4);
+    CPPUNIT_ASSERT(queue);
+    CPPUNIT_ASSERT(queue->getAllocatedBytes() >= 4*MAX_H264_OR_5_NAL_SIZE);
+    CPPUNIT_ASSERT(memory->getQueueBytes(7, 3) == queue->getAllocatedBytes());
+    CPPUNIT_ASSERT(memory->getFilterBytes(7) == queue->getAllocatedBytes());
+
+    delete queue;
+    CPPUNIT_ASSERT(memory->getFilterBytes(7) == 0);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MemoryBudgetTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("MemoryBudgetTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
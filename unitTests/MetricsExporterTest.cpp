@@ -0,0 +1,195 @@
+/*
+ *  MetricsExporterTest.cpp - MetricsExporter class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "MetricsExporter.hh"
+#include "Utils.hh"
+
+class MetricsExporterTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(MetricsExporterTest);
+    CPPUNIT_TEST(metricNames);
+    CPPUNIT_TEST(exposition);
+    CPPUNIT_TEST(stateFlattening);
+    CPPUNIT_TEST(serving);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void metricNames();
+    void exposition();
+    void stateFlattening();
+    void serving();
+};
+
+void MetricsExporterTest::metricNames()
+{
+    CPPUNIT_ASSERT_EQUAL(std::string("avg_bitrate_in_kbps"), MetricsExporter::toMetricName("avgBitrateInKbps"));
+    CPPUNIT_ASSERT_EQUAL(std::string("ssrc"), MetricsExporter::toMetricName("SSRC"));
+    CPPUNIT_ASSERT_EQUAL(std::string("rtcp_rtt"), MetricsExporter::toMetricName("RTCPRtt"));
+    CPPUNIT_ASSERT_EQUAL(std::string("p50"), MetricsExporter::toMetricName("p50"));
+    CPPUNIT_ASSERT_EQUAL(std::string("lost_fraction"), MetricsExporter::toMetricName("lost-fraction"));
+    CPPUNIT_ASSERT_EQUAL(std::string("_264"), MetricsExporter::toMetricName("264"));
+}
+
+void MetricsExporterTest::exposition()
+{
+    MetricsExporter exporter;
+    MetricLabels first;
+    MetricLabels second;
+    std::string text;
+
+    first["filter"] = "1";
+    second["filter"] = "2";
+    second["name"] = "a \"quoted\\\" \nname";
+
+    exporter.add("filter_frames_total", "counter", "Frames processed", first, 10);
+    exporter.add("pool_utilisation", "gauge", "Busy fraction", MetricLabels(), 0.25);
+    exporter.add("filter_frames_total", "counter", "Ignored", second, 12345678901.0);
+
+    text = exporter.getText();
+    CPPUNIT_ASSERT_EQUAL(std::string(
+        "# HELP lms_filter_frames_total Frames processed\n"
+        "# TYPE lms_filter_frames_total counter\n"
+        "lms_filter_frames_total{filter=\"1\"} 10\n"
+        "lms_filter_frames_total{filter=\"2\",name=\"a \\\"quoted\\\\\\\" \\nname\"} 12345678901\n"
+        "# HELP lms_pool_utilisation Busy fraction\n"
+        "# TYPE lms_pool_utilisation gauge\n"
+        "lms_pool_utilisation 0.25\n"), text);
+
+    exporter.publish();
+    CPPUNIT_ASSERT(exporter.getText().empty());
+}
+
+void MetricsExporterTest::stateFlattening()
+{
+    MetricsExporter exporter;
+    MetricLabels labels;
+    Jzon::Object state;
+    Jzon::Object session;
+    Jzon::Array subsessions;
+    Jzon::Object video;
+    Jzon::Object audio;
+    Jzon::Array list;
+    std::string text;
+
+    labels["filter"] = "3";
+
+    video.Add("SSRC", "1234");
+    video.Add("packetLossRatio", 0.5);
+    audio.Add("SSRC", "5678");
+    audio.Add("packetLossRatio", 0);
+    subsessions.Add(video);
+    subsessions.Add(audio);
+    session.Add("subsessionsStats", subsessions);
+    list.Add(1);
+    list.Add(2);
+
+    state.Add("type", "transmitter");
+    state.Add("bitrate", 2000);
+    state.Add("dedicated", true);
+    state.Add("fusedFilters", list);
+    state.Add("session", session);
+
+    exporter.addState("filter_state", state, labels);
+    text = exporter.getText();
+
+    CPPUNIT_ASSERT(text.find("lms_filter_state_bitrate{filter=\"3\"} 2000\n") != std::string::npos);
+    CPPUNIT_ASSERT(text.find("lms_filter_state_dedicated{filter=\"3\"} 1\n") != std::string::npos);
+    CPPUNIT_ASSERT(text.find("# TYPE lms_filter_state_session_subsessions_stats_packet_loss_ratio gauge\n") != std::string::npos);
+    CPPUNIT_ASSERT(text.find("lms_filter_state_session_subsessions_stats_packet_loss_ratio"
+                             "{filter=\"3\",ssrc=\"1234\",stats=\"0\"} 0.5\n") != std::string::npos);
+    CPPUNIT_ASSERT(text.find("lms_filter_state_session_subsessions_stats_packet_loss_ratio"
+                             "{filter=\"3\",ssrc=\"5678\",stats=\"1\"} 0\n") != std::string::npos);
+    CPPUNIT_ASSERT(text.find("type") == std::string::npos);
+    CPPUNIT_ASSERT(text.find("fused") == std::string::npos);
+}
+
+void MetricsExporterTest::serving()
+{
+    MetricsExporter exporter;
+    struct sockaddr_in addr;
+    std::string req = "GET /" METRICS_RESOURCE " HTTP/1.1\r\nConnection: close\r\n\r\n";
+    std::string res;
+    char buffer[4096];
+    ssize_t len;
+    int fd;
+
+    CPPUNIT_ASSERT_EQUAL(0u, exporter.getPort());
+    CPPUNIT_ASSERT(exporter.start(0));
+    CPPUNIT_ASSERT(exporter.getPort() > 0);
+
+    exporter.add("pool_workers", "gauge", "Active workers", MetricLabels(), 4);
+    exporter.publish();
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(exporter.getPort());
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    CPPUNIT_ASSERT(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    CPPUNIT_ASSERT(send(fd, req.data(), req.size(), 0) == (ssize_t) req.size());
+
+    while ((len = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        res.append(buffer, len);
+    }
+    close(fd);
+
+    CPPUNIT_ASSERT(res.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CPPUNIT_ASSERT(res.find("Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n") != std::string::npos);
+    CPPUNIT_ASSERT(res.find("Cache-Control: no-cache\r\n") != std::string::npos);
+    CPPUNIT_ASSERT(res.find("\r\n\r\n# HELP lms_pool_workers Active workers\n# TYPE lms_pool_workers gauge\n"
+                            "lms_pool_workers 4\n") != std::string::npos);
+
+    exporter.stop();
+    CPPUNIT_ASSERT_EQUAL(0u, exporter.getPort());
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MetricsExporterTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("MetricsExporterTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+/*
+ *  NalSplitterTest.cpp - NalSplitter class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "NalSplitter.hh"
+#include "Utils.hh"
+
+class NalSplitterTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(NalSplitterTest);
+    CPPUNIT_TEST(startCodeLength);
+    CPPUNIT_TEST(findStartCode);
+    CPPUNIT_TEST(splitStream);
+    CPPUNIT_TEST(leadingData);
+    CPPUNIT_TEST(noStartCode);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void startCodeLength();
+    void findStartCode();
+    void splitStream();
+    void leadingData();
+    void noStartCode();
+};
+
+void NalSplitterTest::startCodeLength()
+{
+    unsigned char shortCode[] = {0x00, 0x00, 0x01, 0x67};
+    unsigned char longCode[] = {0x00, 0x00, 0x00, 0x01, 0x67};
+    unsigned char noCode[] = {0x00, 0x00, 0x02, 0x01};
+
+    CPPUNIT_ASSERT(NalSplitter::startCodeLength(shortCode, sizeof(shortCode)) == SHORT_START_CODE_LENGTH);
+    CPPUNIT_ASSERT(NalSplitter::startCodeLength(longCode, sizeof(longCode)) == LONG_START_CODE_LENGTH);
+    CPPUNIT_ASSERT(NalSplitter::startCodeLength(noCode, sizeof(noCode)) == 0);
+    CPPUNIT_ASSERT(NalSplitter::startCodeLength(longCode, 3) == 0);
+    CPPUNIT_ASSERT(NalSplitter::startCodeLength(NULL, 4) == 0);
+}
+
+void NalSplitterTest::findStartCode()
+{
+    unsigned char data[] = {0x01, 0x00, 0x01, 0x05, 0x00, 0x00, 0x01, 0x41, 0x00, 0x00, 0x00, 0x01, 0x65};
+    unsigned char const* code;
+    unsigned length;
+
+    code = NalSplitter::findStartCode(data, data + sizeof(data), length);
+    CPPUNIT_ASSERT(code == data + 4);
+    CPPUNIT_ASSERT(length == SHORT_START_CODE_LENGTH);
+
+    code = NalSplitter::findStartCode(code + length, data + sizeof(data), length);
+    CPPUNIT_ASSERT(code == data + 8);
+    CPPUNIT_ASSERT(length == LONG_START_CODE_LENGTH);
+
+    //NOTE: a start code cut by the end of the buffer is not found
+    CPPUNIT_ASSERT(!NalSplitter::findStartCode(data + 10, data + sizeof(data), length));
+    CPPUNIT_ASSERT(!NalSplitter::findStartCode(data + 4, data + 6, length));
+}
+
+void NalSplitterTest::splitStream()
+{
+    std::vector<unsigned char> stream;
+    std::vector<std::string> nals;
+    NalSpan nal;
+
+    nals.push_back(std::string("\x67\x42\x01\x1e", 4));
+    nals.push_back(std::string("\x68\xce", 2));
+    nals.push_back(std::string(5000, '\x11') + std::string("\x01\x00\x01", 3) + std::string(3000, '\x22'));
+
+    for (unsigned i = 0; i < nals.size(); i++) {
+        if (i != 1) {
+            stream.push_back(0x00);
+        }
+        stream.insert(stream.end(), {0x00, 0x00, 0x01});
+        stream.insert(stream.end(), nals[i].begin(), nals[i].end());
+    }
+
+    NalSplitter splitter(stream.data(), stream.size());
+
+    for (unsigned i = 0; i < nals.size(); i++) {
+        CPPUNIT_ASSERT(splitter.next(nal));
+        CPPUNIT_ASSERT(nal.startCodeLength == (i != 1 ? LONG_START_CODE_LENGTH : SHORT_START_CODE_LENGTH));
+        CPPUNIT_ASSERT(std::string((char const*) nal.data, nal.size) == nals[i]);
+    }
+
+    CPPUNIT_ASSERT(!splitter.next(nal));
+}
+
+void NalSplitterTest::leadingData()
+{
+    unsigned char data[] = {0x09, 0x10, 0x00, 0x00, 0x01, 0x09, 0x00, 0x00, 0x01};
+    NalSpan nal;
+
+    NalSplitter splitter(data, sizeof(data));
+
+    CPPUNIT_ASSERT(splitter.next(nal));
+    CPPUNIT_ASSERT(nal.data == data + 5 && nal.size == 1);
+
+    //NOTE: a start code at the end of the stream delimits an empty NAL unit
+    CPPUNIT_ASSERT(splitter.next(nal));
+    CPPUNIT_ASSERT(nal.size == 0);
+    CPPUNIT_ASSERT(!splitter.next(nal));
+}
+
+void NalSplitterTest::noStartCode()
+{
+    unsigned char data[] = {0x01, 0x01, 0x00, 0x01, 0x00, 0x00};
+    NalSpan nal;
+
+    NalSplitter splitter(data, sizeof(data));
+    CPPUNIT_ASSERT(!splitter.next(nal));
+
+    NalSplitter empty(NULL, 0);
+    CPPUNIT_ASSERT(!empty.next(nal));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(NalSplitterTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("NalSplitterTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
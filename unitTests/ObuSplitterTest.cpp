@@ -0,0 +1,165 @@
+/*
+ *  ObuSplitterTest.cpp - ObuSplitter class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "ObuSplitter.hh"
+#include "Utils.hh"
+
+//NOTE: profile 0, level 4.0, main tier, 8 bit 4:2:0, 1280x720
+static unsigned char sequenceHeader[] = {0x0A, 0x0B, 0x00, 0x00, 0x00, 0x42, 0xA6, 0x7F, 0xD9, 0xE0, 0x13, 0xCC, 0x04};
+
+class ObuSplitterTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ObuSplitterTest);
+    CPPUNIT_TEST(leb128);
+    CPPUNIT_TEST(splitTemporalUnit);
+    CPPUNIT_TEST(malformed);
+    CPPUNIT_TEST(sequenceHeaderFields);
+    CPPUNIT_TEST(keyFrames);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void leb128();
+    void splitTemporalUnit();
+    void malformed();
+    void sequenceHeaderFields();
+    void keyFrames();
+};
+
+void ObuSplitterTest::leb128()
+{
+    unsigned char out[LEB128_MAX_SIZE];
+    unsigned char padded[] = {0x85, 0x80, 0x00};
+    unsigned char unterminated[] = {0x80, 0x80};
+    uint64_t value;
+
+    CPPUNIT_ASSERT(ObuSplitter::writeLeb128(5, out) == 1 && out[0] == 0x05);
+    CPPUNIT_ASSERT(ObuSplitter::writeLeb128(300, out) == 2 && out[0] == 0xAC && out[1] == 0x02);
+    CPPUNIT_ASSERT(ObuSplitter::readLeb128(out, 2, value) == 2 && value == 300);
+
+    //NOTE: zero padded values are valid
+    CPPUNIT_ASSERT(ObuSplitter::readLeb128(padded, sizeof(padded), value) == 3 && value == 5);
+    CPPUNIT_ASSERT(ObuSplitter::readLeb128(unterminated, sizeof(unterminated), value) == 0);
+}
+
+void ObuSplitterTest::splitTemporalUnit()
+{
+    std::vector<unsigned char> tu = {0x12, 0x00};
+    ObuSpan obu;
+
+    tu.insert(tu.end(), sequenceHeader, sequenceHeader + sizeof(sequenceHeader));
+    //NOTE: a frame OBU with extension and size field, followed by a tile group without size field
+    tu.insert(tu.end(), {0x36, 0x10, 0x03, 0x10, 0xAA, 0xBB, 0x20, 0xCC, 0xDD});
+
+    ObuSplitter splitter(tu.data(), tu.size());
+
+    CPPUNIT_ASSERT(splitter.next(obu));
+    CPPUNIT_ASSERT(obu.type == OBU_TEMPORAL_DELIMITER && obu.size == 2 && obu.headerSize == 2);
+
+    CPPUNIT_ASSERT(splitter.next(obu));
+    CPPUNIT_ASSERT(obu.type == OBU_SEQUENCE_HEADER && obu.data == tu.data() + 2);
+    CPPUNIT_ASSERT(obu.size == sizeof(sequenceHeader) && obu.headerSize == 2);
+
+    CPPUNIT_ASSERT(splitter.next(obu));
+    CPPUNIT_ASSERT(obu.type == OBU_FRAME && obu.headerSize == 3 && obu.size == 6);
+
+    CPPUNIT_ASSERT(splitter.next(obu));
+    CPPUNIT_ASSERT(obu.type == OBU_TILE_GROUP && obu.headerSize == 1 && obu.size == 3);
+
+    CPPUNIT_ASSERT(!splitter.next(obu));
+    CPPUNIT_ASSERT(!splitter.isBroken());
+}
+
+void ObuSplitterTest::malformed()
+{
+    unsigned char truncated[] = {0x32, 0x05, 0x10, 0x00};
+    unsigned char forbidden[] = {0x92, 0x00};
+    ObuSpan obu;
+
+    ObuSplitter truncatedSplitter(truncated, sizeof(truncated));
+    CPPUNIT_ASSERT(!truncatedSplitter.next(obu) && truncatedSplitter.isBroken());
+
+    ObuSplitter forbiddenSplitter(forbidden, sizeof(forbidden));
+    CPPUNIT_ASSERT(!forbiddenSplitter.next(obu) && forbiddenSplitter.isBroken());
+
+    ObuSplitter empty(NULL, 10);
+    CPPUNIT_ASSERT(!empty.next(obu) && !empty.isBroken());
+}
+
+void ObuSplitterTest::sequenceHeaderFields()
+{
+    Av1SequenceHeader header;
+    std::vector<unsigned char> record;
+
+    CPPUNIT_ASSERT(header.parse(sequenceHeader + 2, sizeof(sequenceHeader) - 2));
+    CPPUNIT_ASSERT(header.profile == 0 && header.level == 8 && header.tier == 0);
+    CPPUNIT_ASSERT(header.bitDepth == 8 && !header.monochrome);
+    CPPUNIT_ASSERT(header.subsamplingX && header.subsamplingY);
+    CPPUNIT_ASSERT(header.maxWidth == 1280 && header.maxHeight == 720);
+    CPPUNIT_ASSERT(!header.reducedStillPictureHeader);
+    CPPUNIT_ASSERT(header.codecString() == "av01.0.08M.08");
+
+    record = header.configRecord(sequenceHeader, sizeof(sequenceHeader));
+    CPPUNIT_ASSERT(record.size() == AV1C_HEADER_SIZE + sizeof(sequenceHeader));
+    CPPUNIT_ASSERT(record[0] == 0x81 && record[1] == 0x08 && record[2] == 0x0C && record[3] == 0x00);
+    CPPUNIT_ASSERT(record[AV1C_HEADER_SIZE] == sequenceHeader[0]);
+
+    CPPUNIT_ASSERT(!header.parse(sequenceHeader + 2, 4));
+}
+
+void ObuSplitterTest::keyFrames()
+{
+    unsigned char key[] = {0x10};
+    unsigned char inter[] = {0x30};
+    unsigned char showExisting[] = {0x80};
+
+    CPPUNIT_ASSERT(ObuSplitter::isKeyFrame(key, sizeof(key), false));
+    CPPUNIT_ASSERT(!ObuSplitter::isKeyFrame(inter, sizeof(inter), false));
+    CPPUNIT_ASSERT(!ObuSplitter::isKeyFrame(showExisting, sizeof(showExisting), false));
+    CPPUNIT_ASSERT(ObuSplitter::isKeyFrame(inter, sizeof(inter), true));
+    CPPUNIT_ASSERT(!ObuSplitter::isKeyFrame(key, 0, false));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ObuSplitterTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("ObuSplitterTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+/*
+ *  PerfCountersTest.cpp - Hardware performance counters test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "Runnable.hh"
+#include "PerfCounters.hh"
+#include "Utils.hh"
+
+class CountedRunnableMockup : public Runnable {
+public:
+    CountedRunnableMockup() : Runnable(false), sum(0) {};
+
+    volatile unsigned long sum;
+
+protected:
+    void processFrame(int& ret, std::vector<int> &/*jobs*/) {
+        for (unsigned long i = 0; i < 100000; i++) {
+            sum = sum + i;
+        }
+        ret = 0;
+    };
+
+    bool pendingJobs() {return false;};
+};
+
+class PerfCountersTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(PerfCountersTest);
+    CPPUNIT_TEST(sampling);
+    CPPUNIT_TEST(accumulation);
+    CPPUNIT_TEST(runnable);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void tearDown();
+
+protected:
+    void sampling();
+    void accumulation();
+    void runnable();
+};
+
+void PerfCountersTest::tearDown()
+{
+    PerfCounters::setInterval(0);
+}
+
+void PerfCountersTest::sampling()
+{
+    CPPUNIT_ASSERT(PerfCounters::getInterval() == 0);
+    CPPUNIT_ASSERT(!PerfCounters::isSampled(0));
+
+    PerfCounters::setInterval(4);
+    CPPUNIT_ASSERT(PerfCounters::isSampled(0) && PerfCounters::isSampled(8));
+    CPPUNIT_ASSERT(!PerfCounters::isSampled(3));
+}
+
+void PerfCountersTest::accumulation()
+{
+    ProcessProfile profile;
+    PerfSample start, end;
+
+    start.values[PERF_CYCLES] = 1000;
+    start.values[PERF_INSTRUCTIONS] = 500;
+    end.values[PERF_CYCLES] = 3000;
+    end.values[PERF_INSTRUCTIONS] = 4500;
+    end.values[PERF_CACHE_MISSES] = 7;
+
+    profile.addCounters(start, end);
+    profile.addCounters(start, end);
+
+    CPPUNIT_ASSERT(profile.getCountedCalls() == 2);
+    CPPUNIT_ASSERT(profile.getCounter(PERF_CYCLES) == 4000);
+    CPPUNIT_ASSERT(profile.getCounter(PERF_INSTRUCTIONS) == 8000);
+    CPPUNIT_ASSERT(profile.getCounter(PERF_CACHE_MISSES) == 14);
+    CPPUNIT_ASSERT(profile.getCounter(PERF_BRANCH_MISSES) == 0);
+
+    //NOTE: a counter going backwards (e.g. a multiplexing rescale) is not accounted
+    profile.addCounters(end, start);
+    CPPUNIT_ASSERT(profile.getCounter(PERF_CYCLES) == 4000);
+}
+
+void PerfCountersTest::runnable()
+{
+    CountedRunnableMockup job;
+    PerfSample sample;
+    Jzon::Object state;
+
+    for (unsigned i = 0; i < 4; i++) {
+        job.runProcessFrame();
+    }
+    CPPUNIT_ASSERT(job.getProfile().getCountedCalls() == 0);
+
+    PerfCounters::setInterval(2);
+    for (unsigned i = 0; i < 4; i++) {
+        job.runProcessFrame();
+    }
+
+    //NOTE: counters may be unavailable (e.g. virtual machines without PMU), calls are not measured then
+    if (!PerfCounters::read(sample)) {
+        CPPUNIT_ASSERT(job.getProfile().getCountedCalls() == 0);
+        PerfCounters::getState(state);
+        CPPUNIT_ASSERT(state.Get("failedThreads").ToInt() == 1);
+        return;
+    }
+
+    CPPUNIT_ASSERT(job.getProfile().getCountedCalls() == 2);
+    CPPUNIT_ASSERT(job.getProfile().getCounter(PERF_INSTRUCTIONS) > 100000);
+
+    PerfCounters::getState(state);
+    CPPUNIT_ASSERT(state.Get("interval").ToInt() == 2);
+    CPPUNIT_ASSERT(state.Get("threads").ToInt() == 1);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(PerfCountersTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("PerfCountersTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
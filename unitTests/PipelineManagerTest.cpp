@@ -19,6 +19,7 @@
  *
  */
 
+#include <atomic>
 #include <cppunit/extensions/TestFactoryRegistry.h>
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/ui/text/TextTestRunner.h>
@@ -31,6 +32,49 @@
 
 #define TIME_WAIT 10
 
+class DecoderMockup : public OneToOneFilterMockup
+{
+public:
+    DecoderMockup() : OneToOneFilterMockup(4, true, std::chrono::microseconds(0)) {
+        fType = VIDEO_DECODER;
+    };
+};
+
+class EncoderMockup : public OneToOneFilterMockup
+{
+public:
+    EncoderMockup() : OneToOneFilterMockup(4, true, std::chrono::microseconds(0)) {
+        fType = VIDEO_ENCODER;
+    };
+};
+
+class DasherMockup : public TailFilterMockup
+{
+public:
+    DasherMockup() : TailFilterMockup() {
+        fType = DASHER;
+    };
+};
+
+//NOTE: a 1280x720 H.264 source announced at 2000 kbps before being connected, as receivers do
+class CodedHeadMockup : public VideoHeadFilterMockup
+{
+public:
+    CodedHeadMockup() : VideoHeadFilterMockup(H264), info(VIDEO) {
+        unsigned char sps[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 
+                               0x16, 0xe8, 0x06, 0xd0, 0xa1, 0x35};
+        info.video.codec = H264;
+        info.setCodecDefaults();
+        info.setExtraData(sps, sizeof(sps));
+        info.bitrate = 2000;
+    };
+    
+    const StreamInfo* getWriterStreamInfo(int /*wId*/) {return &info;};
+
+private:
+    StreamInfo info;
+};
+
 class PipelineManagerTest : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(PipelineManagerTest);
@@ -90,11 +134,19 @@ class PipelineManagerFunctionalTest : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(PipelineManagerFunctionalTest);
     CPPUNIT_TEST(lineConnection);
+    CPPUNIT_TEST(fusedLineConnection);
     CPPUNIT_TEST(diamondConnection);
     CPPUNIT_TEST(forkConnectionOrigin);
     CPPUNIT_TEST(forkConnectionEnding);
     CPPUNIT_TEST(forkedDiamondConnectionOrigin);
     CPPUNIT_TEST(forkedDiamondConnectionEnding);
+    CPPUNIT_TEST(sharedDecoderConnection);
+    CPPUNIT_TEST(bypassedConnection);
+    CPPUNIT_TEST(graphConnection);
+    CPPUNIT_TEST(metricsSnapshot);
+    CPPUNIT_TEST(frameTracing);
+    CPPUNIT_TEST(frameLinkReceiverDefaults);
+    CPPUNIT_TEST(concurrentGraphs);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -103,11 +155,19 @@ public:
 
 protected:
     void lineConnection();
+    void fusedLineConnection();
     void diamondConnection();
     void forkConnectionOrigin();
     void forkConnectionEnding();
     void forkedDiamondConnectionOrigin();
     void forkedDiamondConnectionEnding();
+    void sharedDecoderConnection();
+    void bypassedConnection();
+    void graphConnection();
+    void metricsSnapshot();
+    void frameTracing();
+    void frameLinkReceiverDefaults();
+    void concurrentGraphs();
     
 private:
     PipelineManager *pipe;
@@ -151,6 +211,39 @@ void PipelineManagerFunctionalTest::lineConnection()
     CPPUNIT_ASSERT(tail->getFrames() == 2);
 }
 
+void PipelineManagerFunctionalTest::fusedLineConnection()
+{
+    HeadFilterMockup *head = new HeadFilterMockup();
+    TailFilterMockup *tail = new TailFilterMockup();
+    OneToOneFilter *mid = new OneToOneFilterMockup(4, true, std::chrono::microseconds(0));
+    OneToOneFilter *mid2 = new OneToOneFilterMockup(4, true, std::chrono::microseconds(0));
+    
+    CPPUNIT_ASSERT(pipe->addFilter(1, head));
+    CPPUNIT_ASSERT(pipe->addFilter(4, tail));
+    CPPUNIT_ASSERT(pipe->addFilter(2, mid));
+    CPPUNIT_ASSERT(pipe->addFilter(3, mid2));
+    
+    std::vector<int> midFilters({2, 3});
+    
+    CPPUNIT_ASSERT(pipe->createPath(1, 1, 4, -1, -1, midFilters));
+    CPPUNIT_ASSERT(pipe->connectPath(1));
+    CPPUNIT_ASSERT(mid->getFused().size() == 1);
+    CPPUNIT_ASSERT(mid->getFused().front() == mid2);
+    
+    CPPUNIT_ASSERT(head->inject(FrameMock::createNew(0)));
+    while (tail->getFrames() < 1){
+        std::this_thread::sleep_for(std::chrono::milliseconds(TIME_WAIT));
+    }
+    CPPUNIT_ASSERT(tail->getFrames() == 1);
+    head->inject(FrameMock::createNew(1));
+    while (tail->getFrames() < 2){
+        std::this_thread::sleep_for(std::chrono::milliseconds(TIME_WAIT));
+    }
+    CPPUNIT_ASSERT(tail->getFrames() == 2);
+    
+    CPPUNIT_ASSERT(pipe->removePath(1));
+}
+
 void PipelineManagerFunctionalTest::diamondConnection()
 {
     HeadFilterMockup *head = new HeadFilterMockup();
@@ -366,6 +459,355 @@ void PipelineManagerFunctionalTest::forkedDiamondConnectionEnding()
     CPPUNIT_ASSERT(tail2->getFrames() == 2);
 }
 
+void PipelineManagerFunctionalTest::sharedDecoderConnection()
+{
+    HeadFilterMockup *head = new HeadFilterMockup();
+    TailFilterMockup *tail = new TailFilterMockup();
+    TailFilterMockup *tail2 = new TailFilterMockup();
+    OneToOneFilter *decoder = new DecoderMockup();
+    OneToOneFilter *decoder2 = new DecoderMockup();
+    OneToOneFilter *mid = new OneToOneFilterMockup(4, true, std::chrono::microseconds(0));
+    Frame *frame;
+    
+    CPPUNIT_ASSERT(pipe->addFilter(1, head));
+    CPPUNIT_ASSERT(pipe->addFilter(2, decoder));
+    CPPUNIT_ASSERT(pipe->addFilter(3, decoder2));
+    CPPUNIT_ASSERT(pipe->addFilter(4, tail));
+    CPPUNIT_ASSERT(pipe->addFilter(5, tail2));
+    CPPUNIT_ASSERT(pipe->addFilter(6, mid));
+    
+    std::vector<int> midFilters({2});
+    CPPUNIT_ASSERT(pipe->createPath(1, 1, 4, 1, -1, midFilters));
+    
+    std::vector<int> midFilters2({3, 6});
+    CPPUNIT_ASSERT(pipe->createPath(2, 1, 5, 1, -1, midFilters2));
+    
+    CPPUNIT_ASSERT(pipe->connectPath(1));
+    CPPUNIT_ASSERT(pipe->connectPath(2));
+    
+    CPPUNIT_ASSERT(pipe->getFilters().count(3) == 0);
+    CPPUNIT_ASSERT(pipe->getPath(2)->getFilters().front() == 2);
+    
+    CPPUNIT_ASSERT(head->inject(FrameMock::createNew(0)));
+    while (tail->getFrames() < 1 || tail2->getFrames() < 1){
+        std::this_thread::sleep_for(std::chrono::milliseconds(TIME_WAIT));
+    }
+    CPPUNIT_ASSERT(tail->getFrames() == 1);
+    CPPUNIT_ASSERT(tail2->getFrames() == 1);
+    
+    frame = tail2->extract();
+    CPPUNIT_ASSERT(frame && frame->getSequenceNumber() == 0);
+    
+    CPPUNIT_ASSERT(pipe->removePath(1));
+    CPPUNIT_ASSERT(pipe->getFilters().count(2) == 1);
+    
+    head->inject(FrameMock::createNew(1));
+    while (tail2->getFrames() < 2){
+        std::this_thread::sleep_for(std::chrono::milliseconds(TIME_WAIT));
+    }
+    CPPUNIT_ASSERT(tail2->getFrames() == 2);
+    
+    frame = tail2->extract();
+    CPPUNIT_ASSERT(frame && frame->getSequenceNumber() == 1);
+    
+    CPPUNIT_ASSERT(pipe->removePath(2));
+    CPPUNIT_ASSERT(pipe->getFilters().count(2) == 0);
+}
+
+void PipelineManagerFunctionalTest::bypassedConnection()
+{
+    CodedHeadMockup *head = new CodedHeadMockup();
+    TailFilterMockup *dasher = new DasherMockup();
+    TailFilterMockup *tail = new TailFilterMockup();
+    OneToOneFilter *decoder = new DecoderMockup();
+    OneToOneFilter *encoder = new EncoderMockup();
+    OneToOneFilter *decoder2 = new DecoderMockup();
+    OneToOneFilter *encoder2 = new EncoderMockup();
+    
+    CPPUNIT_ASSERT(pipe->addFilter(1, head));
+    CPPUNIT_ASSERT(pipe->addFilter(2, decoder));
+    CPPUNIT_ASSERT(pipe->addFilter(3, encoder));
+    CPPUNIT_ASSERT(pipe->addFilter(4, dasher));
+    CPPUNIT_ASSERT(pipe->addFilter(5, decoder2));
+    CPPUNIT_ASSERT(pipe->addFilter(6, encoder2));
+    CPPUNIT_ASSERT(pipe->addFilter(7, tail));
+    
+    //NOTE: the source bitrate is over the profile one, so it is transcoded
+    std::vector<int> midFilters({2, 3});
+    CPPUNIT_ASSERT(pipe->createPath(1, 1, 4, 1, -1, midFilters));
+    pipe->getPath(1)->setOutputProfile({H264, 1280, 720, 1000});
+    CPPUNIT_ASSERT(pipe->connectPath(1));
+    CPPUNIT_ASSERT(pipe->getPath(1)->getFilters().size() == 2);
+    CPPUNIT_ASSERT(pipe->removePath(1));
+    
+    //NOTE: only filters consuming coded streams get the source as is
+    std::vector<int> midFilters2({5, 6});
+    CPPUNIT_ASSERT(pipe->createPath(2, 1, 7, 2, -1, midFilters2));
+    pipe->getPath(2)->setOutputProfile({H264, 1280, 720, 3000});
+    CPPUNIT_ASSERT(pipe->connectPath(2));
+    CPPUNIT_ASSERT(pipe->getPath(2)->getFilters().size() == 2);
+    CPPUNIT_ASSERT(pipe->removePath(2));
+    
+    decoder = new DecoderMockup();
+    encoder = new EncoderMockup();
+    CPPUNIT_ASSERT(pipe->addFilter(2, decoder));
+    CPPUNIT_ASSERT(pipe->addFilter(3, encoder));
+    
+    CPPUNIT_ASSERT(pipe->createPath(3, 1, 4, 3, -1, midFilters));
+    pipe->getPath(3)->setOutputProfile({H264, 1280, 0, 3000});
+    CPPUNIT_ASSERT(pipe->connectPath(3));
+    
+    CPPUNIT_ASSERT(pipe->getPath(3)->getFilters().empty());
+    CPPUNIT_ASSERT(pipe->getFilters().count(2) == 0);
+    CPPUNIT_ASSERT(pipe->getFilters().count(3) == 0);
+    CPPUNIT_ASSERT(head->isWConnected(3));
+    
+    CPPUNIT_ASSERT(pipe->removePath(3));
+}
+
+void PipelineManagerFunctionalTest::graphConnection()
+{
+    HeadFilterMockup *head = new HeadFilterMockup();
+    TailFilterMockup *tail = new TailFilterMockup();
+    OneToOneFilter *mid = new OneToOneFilterMockup(4, true, std::chrono::microseconds(0));
+    std::string path = "{\"id\":1,\"orgFilterId\":1,\"dstFilterId\":3,\"orgWriterId\":-1,\"dstReaderId\":-1,"
+                       "\"midFiltersIds\":[2]}";
+    std::string wrongPath = "{\"id\":2,\"orgFilterId\":1,\"dstFilterId\":3,\"orgWriterId\":-1,\"dstReaderId\":-1,"
+                            "\"midFiltersIds\":[9]}";
+    std::string clashingPath = "{\"id\":5,\"orgFilterId\":1,\"dstFilterId\":3,\"orgWriterId\":-1,\"dstReaderId\":-1,"
+                               "\"midFiltersIds\":[2]}";
+    Jzon::Object params, output;
+    Jzon::Parser parser(params);
+
+    CPPUNIT_ASSERT(pipe->addFilter(1, head));
+    CPPUNIT_ASSERT(pipe->addFilter(3, tail));
+    CPPUNIT_ASSERT(pipe->addFilter(2, mid));
+
+    parser.SetJson("{\"paths\":[" + path + "," + path + "]}");
+    CPPUNIT_ASSERT(parser.Parse());
+    pipe->createGraphEvent(&params, output);
+    CPPUNIT_ASSERT(!output.Get("error").IsNull());
+    CPPUNIT_ASSERT(pipe->getPaths().empty());
+
+    params.Clear();
+    output.Clear();
+    parser.SetJson("{\"paths\":[" + path + "," + wrongPath + "]}");
+    CPPUNIT_ASSERT(parser.Parse());
+    pipe->createGraphEvent(&params, output);
+    CPPUNIT_ASSERT(!output.Get("error").IsNull());
+    CPPUNIT_ASSERT(pipe->getPaths().empty());
+
+    params.Clear();
+    output.Clear();
+    parser.SetJson("{\"paths\":[" + path + "," + clashingPath + "]}");
+    CPPUNIT_ASSERT(parser.Parse());
+    pipe->createGraphEvent(&params, output);
+    CPPUNIT_ASSERT(!output.Get("error").IsNull());
+    CPPUNIT_ASSERT(pipe->getPaths().empty());
+    CPPUNIT_ASSERT(!tail->isRConnected(-1));
+
+    params.Clear();
+    output.Clear();
+    parser.SetJson("{\"paths\":[" + path + "]}");
+    CPPUNIT_ASSERT(parser.Parse());
+    pipe->createGraphEvent(&params, output);
+    CPPUNIT_ASSERT(output.Get("error").IsNull());
+    CPPUNIT_ASSERT(pipe->getPaths().size() == 1);
+
+    CPPUNIT_ASSERT(head->inject(FrameMock::createNew(0)));
+    while (tail->getFrames() < 1){
+        std::this_thread::sleep_for(std::chrono::milliseconds(TIME_WAIT));
+    }
+    CPPUNIT_ASSERT(tail->getFrames() == 1);
+}
+
+void PipelineManagerFunctionalTest::metricsSnapshot()
+{
+    HeadFilterMockup *head = new HeadFilterMockup();
+    TailFilterMockup *tail = new TailFilterMockup();
+    OneToOneFilter *mid = new OneToOneFilterMockup(4, true, std::chrono::microseconds(0));
+    std::vector<int> midFilters(1, 2);
+    std::string metrics;
+    Jzon::Object root;
+    Jzon::Parser parser(root);
+
+    CPPUNIT_ASSERT(pipe->addFilter(1, head));
+    CPPUNIT_ASSERT(pipe->addFilter(3, tail));
+    CPPUNIT_ASSERT(pipe->addFilter(2, mid));
+    CPPUNIT_ASSERT(pipe->createPath(1, 1, 3, -1, -1, midFilters));
+    CPPUNIT_ASSERT(pipe->connectPath(1));
+
+    CPPUNIT_ASSERT(head->inject(FrameMock::createNew(0)));
+    while (tail->getFrames() < 1){
+        std::this_thread::sleep_for(std::chrono::milliseconds(TIME_WAIT));
+    }
+
+    pipe->getMetrics(metrics, true);
+    parser.SetJson(metrics);
+    CPPUNIT_ASSERT(parser.Parse());
+    CPPUNIT_ASSERT(root.Get("filters").GetCount() == 3);
+    CPPUNIT_ASSERT(root.Get("filters").Get("1").Get("writtenFrames").ToInt() == 1);
+    CPPUNIT_ASSERT(root.Get("filters").Get("2").Get("readFrames").ToInt() == 1);
+    CPPUNIT_ASSERT(root.Get("filters").Get("2").Get("writtenFrames").ToInt() == 1);
+    CPPUNIT_ASSERT(root.Get("filters").Get("3").Get("readFrames").ToInt() == 1);
+    CPPUNIT_ASSERT(!root.Has("removed"));
+
+    CPPUNIT_ASSERT(pipe->removePath(1));
+
+    metrics.clear();
+    root.Clear();
+    pipe->getMetrics(metrics, true);
+    parser.SetJson(metrics);
+    CPPUNIT_ASSERT(parser.Parse());
+    CPPUNIT_ASSERT(root.Get("filters").GetCount() == 0);
+    CPPUNIT_ASSERT(root.Get("removed").GetCount() == 3);
+}
+
+void PipelineManagerFunctionalTest::frameTracing()
+{
+    HeadFilterMockup *head = new HeadFilterMockup();
+    TailFilterMockup *tail = new TailFilterMockup();
+    OneToOneFilter *mid = new OneToOneFilterMockup(4, true, std::chrono::microseconds(0));
+    std::vector<int> midFilters(1, 2);
+    std::map<std::string, unsigned> events;
+    std::ifstream file;
+    std::string trace;
+    Jzon::Object params;
+    Jzon::Object output;
+    Jzon::Object root;
+    Jzon::Parser parser(root);
+
+    params.Add("sampling", 1);
+    pipe->configureTracingEvent(&params, output);
+    CPPUNIT_ASSERT(output.Get("error").IsNull());
+
+    CPPUNIT_ASSERT(pipe->addFilter(1, head));
+    CPPUNIT_ASSERT(pipe->addFilter(3, tail));
+    CPPUNIT_ASSERT(pipe->addFilter(2, mid));
+    CPPUNIT_ASSERT(pipe->createPath(1, 1, 3, -1, -1, midFilters));
+    CPPUNIT_ASSERT(pipe->connectPath(1));
+
+    CPPUNIT_ASSERT(head->inject(FrameMock::createNew(0)));
+    while (tail->getFrames() < 1){
+        std::this_thread::sleep_for(std::chrono::milliseconds(TIME_WAIT));
+    }
+
+    params.Clear();
+    output.Clear();
+    params.Add("file", "PipelineManagerTrace.json");
+    pipe->dumpTraceEvent(&params, output);
+    CPPUNIT_ASSERT(output.Get("error").IsNull());
+    CPPUNIT_ASSERT(output.Get("traces").ToInt() == 1);
+
+    file.open("PipelineManagerTrace.json");
+    trace.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    parser.SetJson(trace);
+    CPPUNIT_ASSERT(parser.Parse());
+
+    for (auto it = root.Get("traceEvents").AsArray().begin(); it != root.Get("traceEvents").AsArray().end(); ++it) {
+        events[(*it).Get("name").ToString() + std::to_string((*it).Get("tid").ToInt())]++;
+    }
+
+    //NOTE: the frame is processed by the head and the mid filters and queued before the mid and the tail ones
+    CPPUNIT_ASSERT(events["frame0"] == 1);
+    CPPUNIT_ASSERT(events["process1"] == 1);
+    CPPUNIT_ASSERT(events["queue2"] == 1);
+    CPPUNIT_ASSERT(events["process2"] == 1);
+    CPPUNIT_ASSERT(events["queue3"] == 1);
+
+    params.Clear();
+    output.Clear();
+    params.Add("sampling", 0);
+    pipe->configureTracingEvent(&params, output);
+    CPPUNIT_ASSERT(output.Get("error").IsNull());
+}
+
+void PipelineManagerFunctionalTest::frameLinkReceiverDefaults()
+{
+    Jzon::Object params, output, state;
+    Jzon::Parser parser(params);
+
+    //NOTE: without a codec the receiver declares an H264 video stream
+    parser.SetJson("{\"id\":5,\"type\":\"frameLinkReceiver\"}");
+    CPPUNIT_ASSERT(parser.Parse());
+    pipe->createFilterEvent(&params, output);
+    CPPUNIT_ASSERT(output.Get("error").IsNull());
+
+    CPPUNIT_ASSERT(pipe->getFilter(5));
+    pipe->getFilter(5)->getState(state);
+    CPPUNIT_ASSERT(state.Get("codec").ToString() == "H264");
+    CPPUNIT_ASSERT(utils::getVideoCodecFromString(state.Get("codec").ToString()) == H264);
+}
+
+void PipelineManagerFunctionalTest::concurrentGraphs()
+{
+    const int graphs = 4;
+    HeadFilterMockup *heads[graphs];
+    TailFilterMockup *tails[graphs];
+    std::vector<std::thread> controls;
+    std::atomic<int> created(0);
+    std::atomic<bool> reading(true);
+    std::thread reader;
+
+    for (int g = 0; g < graphs; g++) {
+        heads[g] = new HeadFilterMockup();
+        tails[g] = new TailFilterMockup();
+    }
+
+    //NOTE: readers go through the graph while it is being built
+    reader = std::thread([this, &reading] () {
+        while (reading) {
+            Jzon::Object params, output;
+            std::string metrics;
+            pipe->getStateEvent(&params, output);
+            pipe->getMetrics(metrics, false);
+        }
+    });
+
+    for (int g = 0; g < graphs; g++) {
+        controls.push_back(std::thread([this, g, &heads, &tails, &created] () {
+            int base = (g + 1)*10;
+            std::string path = "{\"paths\":[{\"id\":" + std::to_string(base) + ",\"orgFilterId\":" +
+                               std::to_string(base + 1) + ",\"dstFilterId\":" + std::to_string(base + 3) +
+                               ",\"orgWriterId\":-1,\"dstReaderId\":-1,\"midFiltersIds\":[" +
+                               std::to_string(base + 2) + "]}]}";
+            Jzon::Object params, output;
+            Jzon::Parser parser(params);
+
+            if (!pipe->addFilter(base + 1, heads[g]) || !pipe->addFilter(base + 3, tails[g]) ||
+                !pipe->addFilter(base + 2, new OneToOneFilterMockup(4, true, std::chrono::microseconds(0)))) {
+                return;
+            }
+
+            parser.SetJson(path);
+            if (parser.Parse()) {
+                pipe->createGraphEvent(&params, output);
+                if (output.Get("error").IsNull()) {
+                    created++;
+                }
+            }
+        }));
+    }
+
+    for (auto &c : controls) {
+        c.join();
+    }
+
+    reading = false;
+    reader.join();
+
+    CPPUNIT_ASSERT(created == graphs);
+    CPPUNIT_ASSERT(pipe->getPaths().size() == (size_t) graphs);
+    CPPUNIT_ASSERT(pipe->getFilters().size() == (size_t) graphs*3);
+
+    for (int g = 0; g < graphs; g++) {
+        CPPUNIT_ASSERT(heads[g]->inject(FrameMock::createNew(g)));
+        while (tails[g]->getFrames() < 1){
+            std::this_thread::sleep_for(std::chrono::milliseconds(TIME_WAIT));
+        }
+    }
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(PipelineManagerTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(PipelineManagerFunctionalTest);
 
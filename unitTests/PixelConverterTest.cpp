@@ -0,0 +1,307 @@
+/*
+ *  PixelConverterTest.cpp - PixelConverter class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdlib>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "PixelConverter.hh"
+#include "VideoFrame.hh"
+#include "Utils.hh"
+
+#define TEST_WIDTH 37
+#define TEST_HEIGHT 21
+
+class PixelConverterTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(PixelConverterTest);
+    CPPUNIT_TEST(supportedFormats);
+    CPPUNIT_TEST(rgbReferenceColours);
+    CPPUNIT_TEST(rgbRoundTrip);
+    CPPUNIT_TEST(yuyvConversion);
+    CPPUNIT_TEST(nv12RoundTrip);
+    CPPUNIT_TEST(bands);
+    CPPUNIT_TEST(invalidRows);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void supportedFormats();
+    void rgbReferenceColours();
+    void rgbRoundTrip();
+    void yuyvConversion();
+    void nv12RoundTrip();
+    void bands();
+    void invalidRows();
+
+    PlanarVideoFrame* newPlanar(PixType fmt, int width, int height);
+    InterleavedVideoFrame* newInterleaved(PixType fmt, int width, int height);
+    bool convert(VideoFrame* src, VideoFrame* dst, int firstRow = 0, int rows = -1);
+    void fill(VideoFrame* frame, unsigned seed);
+};
+
+PlanarVideoFrame* PixelConverterTest::newPlanar(PixType fmt, int width, int height)
+{
+    PlanarVideoFrame* frame = PlanarVideoFrame::createNew(RAW, width, height, fmt);
+    frame->fitBuffer(width, height, fmt);
+    return frame;
+}
+
+InterleavedVideoFrame* PixelConverterTest::newInterleaved(PixType fmt, int width, int height)
+{
+    InterleavedVideoFrame* frame = InterleavedVideoFrame::createNew(RAW, width, height, fmt);
+    frame->fitBuffer(width, height, fmt);
+    return frame;
+}
+
+bool PixelConverterTest::convert(VideoFrame* src, VideoFrame* dst, int firstRow, int rows)
+{
+    unsigned char* srcData[MAX_PLANES];
+    unsigned char* dstData[MAX_PLANES];
+    int srcLinesize[MAX_PLANES];
+    int dstLinesize[MAX_PLANES];
+
+    src->getPlanes(srcData, srcLinesize);
+    dst->getPlanes(dstData, dstLinesize);
+
+    return PixelConverter::convert(srcData, srcLinesize, src->getPixelFormat(), dstData, dstLinesize,
+                                   dst->getPixelFormat(), src->getWidth(), src->getHeight(), firstRow, rows);
+}
+
+void PixelConverterTest::fill(VideoFrame* frame, unsigned seed)
+{
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int lineBytes, rows;
+
+    frame->getPlanes(data, linesize);
+    srand(seed);
+
+    for (unsigned p = 0; VideoFrame::planeSize(frame->getPixelFormat(), frame->getWidth(), frame->getHeight(),
+            p, lineBytes, rows); p++) {
+        for (int r = 0; r < rows; r++) {
+            for (int b = 0; b < lineBytes; b++) {
+                data[p][r*linesize[p] + b] = 16 + rand() % 220;
+            }
+        }
+    }
+}
+
+void PixelConverterTest::supportedFormats()
+{
+    CPPUNIT_ASSERT(PixelConverter::isSupported(YUYV422, YUV420P) && PixelConverter::isSupported(YUV420P, YUYV422));
+    CPPUNIT_ASSERT(PixelConverter::isSupported(NV12, YUV420P) && PixelConverter::isSupported(YUV420P, NV12));
+    CPPUNIT_ASSERT(PixelConverter::isSupported(RGB24, YUV420P) && PixelConverter::isSupported(YUV420P, RGB24));
+    CPPUNIT_ASSERT(!PixelConverter::isSupported(RGB24, NV12) && !PixelConverter::isSupported(YUV420P, YUV420P));
+    CPPUNIT_ASSERT(!PixelConverter::isSupported(YUV422P, RGB24) && !PixelConverter::isSupported(HW_SURFACE, YUV420P));
+}
+
+void PixelConverterTest::rgbReferenceColours()
+{
+    const unsigned char colours[4][3] = {{255, 255, 255}, {0, 0, 0}, {255, 0, 0}, {0, 0, 255}};
+    const unsigned char yuv[4][3] = {{235, 128, 128}, {16, 128, 128}, {82, 90, 240}, {41, 240, 110}};
+    InterleavedVideoFrame* rgb = newInterleaved(RGB24, 2, 2);
+    PlanarVideoFrame* planar = newPlanar(YUV420P, 2, 2);
+    InterleavedVideoFrame* back = newInterleaved(RGB24, 2, 2);
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+
+    for (unsigned c = 0; c < 4; c++) {
+        for (unsigned i = 0; i < 4; i++) {
+            memcpy(rgb->getDataBuf() + 3*i, colours[c], 3);
+        }
+
+        CPPUNIT_ASSERT(convert(rgb, planar));
+        planar->getPlanes(data, linesize);
+        CPPUNIT_ASSERT(std::abs(data[0][0] - yuv[c][0]) <= 1 && data[0][linesize[0] + 1] == data[0][0]);
+        CPPUNIT_ASSERT(std::abs(data[1][0] - yuv[c][1]) <= 1 && std::abs(data[2][0] - yuv[c][2]) <= 1);
+
+        CPPUNIT_ASSERT(convert(planar, back));
+        for (unsigned b = 0; b < 12; b++) {
+            CPPUNIT_ASSERT(std::abs(back->getDataBuf()[b] - colours[c][b % 3]) <= 3);
+        }
+    }
+
+    delete rgb;
+    delete planar;
+    delete back;
+}
+
+void PixelConverterTest::rgbRoundTrip()
+{
+    InterleavedVideoFrame* rgb = newInterleaved(RGB24, TEST_WIDTH, TEST_HEIGHT);
+    PlanarVideoFrame* planar = newPlanar(YUV420P, TEST_WIDTH, TEST_HEIGHT);
+    InterleavedVideoFrame* back = newInterleaved(RGB24, TEST_WIDTH, TEST_HEIGHT);
+    unsigned char* pixel;
+
+    //NOTE: grey pictures have no chroma, so they survive the subsampling
+    pixel = rgb->getDataBuf();
+    for (unsigned i = 0; i < TEST_WIDTH*TEST_HEIGHT; i++) {
+        pixel[3*i] = pixel[3*i + 1] = pixel[3*i + 2] = (i*7) % 256;
+    }
+
+    CPPUNIT_ASSERT(convert(rgb, planar));
+    CPPUNIT_ASSERT(convert(planar, back));
+
+    for (unsigned b = 0; b < TEST_WIDTH*TEST_HEIGHT*3; b++) {
+        CPPUNIT_ASSERT(std::abs(back->getDataBuf()[b] - pixel[b]) <= 2);
+    }
+
+    delete rgb;
+    delete planar;
+    delete back;
+}
+
+void PixelConverterTest::yuyvConversion()
+{
+    InterleavedVideoFrame* yuyv = newInterleaved(YUYV422, TEST_WIDTH + 1, TEST_HEIGHT);
+    PlanarVideoFrame* planar = newPlanar(YUV420P, TEST_WIDTH + 1, TEST_HEIGHT);
+    InterleavedVideoFrame* back = newInterleaved(YUYV422, TEST_WIDTH + 1, TEST_HEIGHT);
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    unsigned char* src;
+    unsigned char* dst;
+    int lineBytes = (TEST_WIDTH + 1)*2;
+
+    fill(yuyv, 1);
+    CPPUNIT_ASSERT(convert(yuyv, planar));
+    CPPUNIT_ASSERT(convert(planar, back));
+    planar->getPlanes(data, linesize);
+
+    src = yuyv->getDataBuf();
+    dst = back->getDataBuf();
+    for (int r = 0; r < TEST_HEIGHT; r++) {
+        for (int x = 0; x < TEST_WIDTH + 1; x++) {
+            CPPUNIT_ASSERT(data[0][r*linesize[0] + x] == src[r*lineBytes + 2*x]);
+            CPPUNIT_ASSERT(dst[r*lineBytes + 2*x] == src[r*lineBytes + 2*x]);
+        }
+    }
+
+    //NOTE: chroma of each row pair is averaged, the last row of odd heights is alone
+    CPPUNIT_ASSERT(data[1][0] == (src[1] + src[lineBytes + 1] + 1)/2);
+    CPPUNIT_ASSERT(data[2][linesize[2] + 1] == (src[2*lineBytes + 7] + src[3*lineBytes + 7] + 1)/2);
+    CPPUNIT_ASSERT(data[1][(TEST_HEIGHT/2)*linesize[1]] == src[(TEST_HEIGHT - 1)*lineBytes + 1]);
+    CPPUNIT_ASSERT(dst[1] == data[1][0] && dst[lineBytes + 3] == data[2][0]);
+
+    delete yuyv;
+    delete planar;
+    delete back;
+}
+
+void PixelConverterTest::nv12RoundTrip()
+{
+    PlanarVideoFrame* nv12 = newPlanar(NV12, TEST_WIDTH, TEST_HEIGHT);
+    PlanarVideoFrame* planar = newPlanar(YUV420P, TEST_WIDTH, TEST_HEIGHT);
+    PlanarVideoFrame* back = newPlanar(NV12, TEST_WIDTH, TEST_HEIGHT);
+    unsigned char* data[MAX_PLANES];
+    unsigned char* yuv[MAX_PLANES];
+    unsigned char* result[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int yuvLinesize[MAX_PLANES];
+    int resultLinesize[MAX_PLANES];
+    int chromaWidth = (TEST_WIDTH + 1)/2;
+
+    fill(nv12, 2);
+    CPPUNIT_ASSERT(convert(nv12, planar));
+    CPPUNIT_ASSERT(convert(planar, back));
+
+    nv12->getPlanes(data, linesize);
+    planar->getPlanes(yuv, yuvLinesize);
+    back->getPlanes(result, resultLinesize);
+
+    for (int r = 0; r < TEST_HEIGHT; r++) {
+        CPPUNIT_ASSERT(memcmp(data[0] + r*linesize[0], result[0] + r*resultLinesize[0], TEST_WIDTH) == 0);
+    }
+
+    for (int r = 0; r < (TEST_HEIGHT + 1)/2; r++) {
+        CPPUNIT_ASSERT(memcmp(data[1] + r*linesize[1], result[1] + r*resultLinesize[1], 2*chromaWidth) == 0);
+        CPPUNIT_ASSERT(yuv[1][r*yuvLinesize[1] + chromaWidth - 1] == data[1][r*linesize[1] + 2*chromaWidth - 2]);
+        CPPUNIT_ASSERT(yuv[2][r*yuvLinesize[2]] == data[1][r*linesize[1] + 1]);
+    }
+
+    delete nv12;
+    delete planar;
+    delete back;
+}
+
+void PixelConverterTest::bands()
+{
+    InterleavedVideoFrame* rgb = newInterleaved(RGB24, TEST_WIDTH, TEST_HEIGHT);
+    PlanarVideoFrame* whole = newPlanar(YUV420P, TEST_WIDTH, TEST_HEIGHT);
+    PlanarVideoFrame* banded = newPlanar(YUV420P, TEST_WIDTH, TEST_HEIGHT);
+
+    fill(rgb, 3);
+    CPPUNIT_ASSERT(convert(rgb, whole));
+    CPPUNIT_ASSERT(convert(rgb, banded, 0, 8));
+    CPPUNIT_ASSERT(convert(rgb, banded, 8, 6));
+    CPPUNIT_ASSERT(convert(rgb, banded, 14));
+
+    CPPUNIT_ASSERT(whole->getLength() == banded->getLength());
+    CPPUNIT_ASSERT(memcmp(whole->getPlanarDataBuf()[0], banded->getPlanarDataBuf()[0], whole->getLength()) == 0);
+
+    delete rgb;
+    delete whole;
+    delete banded;
+}
+
+void PixelConverterTest::invalidRows()
+{
+    InterleavedVideoFrame* odd = newInterleaved(YUYV422, TEST_WIDTH, TEST_HEIGHT);
+    InterleavedVideoFrame* rgb = newInterleaved(RGB24, TEST_WIDTH, TEST_HEIGHT);
+    PlanarVideoFrame* planar = newPlanar(YUV420P, TEST_WIDTH, TEST_HEIGHT);
+    PlanarVideoFrame* other = newPlanar(YUV422P, TEST_WIDTH, TEST_HEIGHT);
+
+    CPPUNIT_ASSERT(!convert(odd, planar));
+    CPPUNIT_ASSERT(!convert(rgb, planar, 1, 2));
+    CPPUNIT_ASSERT(!convert(rgb, planar, 0, 3));
+    CPPUNIT_ASSERT(!convert(rgb, planar, 20, 2));
+    CPPUNIT_ASSERT(convert(rgb, planar, 20, 1));
+    CPPUNIT_ASSERT(!convert(rgb, other));
+
+    delete odd;
+    delete rgb;
+    delete planar;
+    delete other;
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(PixelConverterTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("PixelConverterTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+/*
+ *  ProfiledMutexTest.cpp - Lock contention profiling test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <thread>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "ProfiledMutex.hh"
+#include "Utils.hh"
+
+class ProfiledMutexTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ProfiledMutexTest);
+    CPPUNIT_TEST(disabled);
+    CPPUNIT_TEST(uncontended);
+    CPPUNIT_TEST(contended);
+    CPPUNIT_TEST(state);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void tearDown();
+
+protected:
+    void disabled();
+    void uncontended();
+    void contended();
+    void state();
+};
+
+void ProfiledMutexTest::tearDown()
+{
+    ProfiledMutex::setProfiling(false);
+}
+
+void ProfiledMutexTest::disabled()
+{
+    ProfiledMutex mtx(FILTER_LOCK);
+
+    ProfiledMutex::setProfiling(true);
+    ProfiledMutex::setProfiling(false);
+
+    {
+        std::lock_guard<ProfiledMutex> guard(mtx);
+    }
+
+    CPPUNIT_ASSERT(!ProfiledMutex::getProfiling());
+    CPPUNIT_ASSERT(ProfiledMutex::getProfile(FILTER_LOCK).getAcquisitions() == 0);
+}
+
+void ProfiledMutexTest::uncontended()
+{
+    ProfiledMutex mtx(READER_LOCK);
+
+    ProfiledMutex::setProfiling(true);
+
+    for (unsigned i = 0; i < 10; i++) {
+        std::lock_guard<ProfiledMutex> guard(mtx);
+    }
+
+    {
+        std::unique_lock<std::mutex> guard = mtx.uniqueLock();
+        CPPUNIT_ASSERT(guard.owns_lock());
+    }
+
+    CPPUNIT_ASSERT(ProfiledMutex::getProfile(READER_LOCK).getAcquisitions() == 11);
+    CPPUNIT_ASSERT(ProfiledMutex::getProfile(READER_LOCK).getContended() == 0);
+    CPPUNIT_ASSERT(ProfiledMutex::getProfile(READER_LOCK).getWaitPercentile(99) == 0);
+    CPPUNIT_ASSERT(ProfiledMutex::getProfile(POOL_LOCK).getAcquisitions() == 0);
+}
+
+void ProfiledMutexTest::contended()
+{
+    ProfiledMutex mtx(POOL_LOCK);
+    LockProfile &profile = ProfiledMutex::getProfile(POOL_LOCK);
+    std::thread waiter;
+
+    ProfiledMutex::setProfiling(true);
+
+    mtx.lock();
+    waiter = std::thread([&mtx]() {
+        std::lock_guard<ProfiledMutex> guard(mtx);
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    mtx.unlock();
+    waiter.join();
+
+    CPPUNIT_ASSERT(profile.getAcquisitions() == 2);
+    CPPUNIT_ASSERT(profile.getContended() == 1);
+    CPPUNIT_ASSERT(profile.getWaitTime() >= std::chrono::milliseconds(10));
+    CPPUNIT_ASSERT(profile.getWaitPercentile(50) >= 10000000);
+
+    //NOTE: enabling the profiling again resets the statistics
+    ProfiledMutex::setProfiling(false);
+    ProfiledMutex::setProfiling(true);
+    CPPUNIT_ASSERT(profile.getAcquisitions() == 0 && profile.getContended() == 0);
+}
+
+void ProfiledMutexTest::state()
+{
+    ProfiledMutex mtx(WORKER_LOCK);
+    Jzon::Object node;
+
+    ProfiledMutex::setProfiling(true);
+    mtx.lock();
+    mtx.unlock();
+
+    ProfiledMutex::getState(node);
+    CPPUNIT_ASSERT(node.Get("profiling").ToBool());
+    CPPUNIT_ASSERT(node.Get("sites").Has("filter") && node.Get("sites").Has("reader"));
+    CPPUNIT_ASSERT(node.Get("sites").Has("pool"));
+    CPPUNIT_ASSERT(node.Get("sites").Get("stealingWorker").Get("acquisitions").ToInt() == 1);
+    CPPUNIT_ASSERT(node.Get("sites").Get("stealingWorker").Get("waitHistogram").GetCount() == LOCK_WAIT_BUCKETS);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ProfiledMutexTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("ProfiledMutexTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
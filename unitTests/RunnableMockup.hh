@@ -36,7 +36,7 @@ public:
     }
     
 protected:
-    std::vector<int> processFrame(int& ret) {
+    void processFrame(int& ret, std::vector<int> &jobs) {
         std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
         size_t realProcessTime;
         std::chrono::microseconds remaining, diff;
@@ -66,7 +66,7 @@ protected:
             ret = 0;
         }
         
-        return enabledJobs;
+        jobs.insert(jobs.end(), enabledJobs.begin(), enabledJobs.end());
     }
     
     bool pendingJobs(){
@@ -81,4 +81,22 @@ private:
     bool first;
 };
 
+class TimedRunnableMockup : public Runnable {
+    
+public:
+    TimedRunnableMockup(int delay_) : Runnable(true), delay(delay_) {};
+    
+protected:
+    void processFrame(int& ret, std::vector<int> &/*enabledJobs*/) {
+        ret = delay;
+    }
+    
+    bool pendingJobs(){
+        return false;
+    }
+
+private:
+    int delay;
+};
+
 #endif
\ No newline at end of file
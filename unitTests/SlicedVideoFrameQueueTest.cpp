@@ -31,6 +31,7 @@
 #include <cppunit/XmlOutputter.h>
 
 #include "SlicedVideoFrameQueue.hh"
+#include "FramePool.hh"
 #include "Utils.hh"
 #include "StreamInfo.hh"
 
@@ -41,12 +42,42 @@ typedef struct {
 
 static StreamInfo mockStreamInfo = { VIDEO };
 
+#define KEY_NAL 0x65
+#define REF_NAL 0x41
+#define NON_REF_NAL 0x01
+
+static void writePicture(SlicedVideoFrameQueue* q, unsigned char type, unsigned char id,
+                         std::chrono::system_clock::time_point origin = Frame::getOriginNow())
+{
+    unsigned char nal[6] = {0, 0, 0, 1, type, id};
+    SlicedVideoFrame* slicedFrame = dynamic_cast<SlicedVideoFrame*>(q->forceGetRear());
+
+    slicedFrame->setSlice(nal, sizeof(nal));
+    slicedFrame->setOriginTime(origin);
+    q->addFrame();
+}
+
+static unsigned char readPicture(SlicedVideoFrameQueue* q)
+{
+    unsigned char id = q->getFront()->getDataBuf()[5];
+
+    q->removeFrame();
+    return id;
+}
+
 class SlicedVideoFrameQueueTest : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(SlicedVideoFrameQueueTest);
     CPPUNIT_TEST(create);
     CPPUNIT_TEST(okSliceBehaviour);
     CPPUNIT_TEST(tooManySlices);
+    CPPUNIT_TEST(sharedSliceStore);
+    CPPUNIT_TEST(dropNonReference);
+    CPPUNIT_TEST(dropGop);
+    CPPUNIT_TEST(dropToKeyframe);
+    CPPUNIT_TEST(latencyBound);
+    CPPUNIT_TEST(sideData);
+    CPPUNIT_TEST(partialPicture);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -57,6 +88,13 @@ protected:
     void create();
     void okSliceBehaviour();
     void tooManySlices();
+    void sharedSliceStore();
+    void dropNonReference();
+    void dropGop();
+    void dropToKeyframe();
+    void latencyBound();
+    void sideData();
+    void partialPicture();
 
     SlicedVideoFrameQueue* queue;
     unsigned maxFrames;
@@ -201,6 +239,269 @@ void SlicedVideoFrameQueueTest::tooManySlices()
     CPPUNIT_ASSERT(!outputFrame);
 }
 
+void SlicedVideoFrameQueueTest::sharedSliceStore()
+{
+    unsigned char picture[6] = {1, 2, 2, 3, 3, 3};
+    unsigned char other[2] = {4, 5};
+    SlicedVideoFrame* slicedFrame;
+    Frame* outputFrame;
+    Frame* retained;
+    unsigned char* first;
+
+    slicedFrame = dynamic_cast<SlicedVideoFrame*>(queue->getRear());
+    CPPUNIT_ASSERT(slicedFrame);
+    CPPUNIT_ASSERT(slicedFrame->setSlice(picture, 1));
+    CPPUNIT_ASSERT(slicedFrame->setSlice(picture + 1, 2));
+    CPPUNIT_ASSERT(slicedFrame->setSlice(picture + 3, 3));
+    queue->addFrame();
+    CPPUNIT_ASSERT(queue->getElements() == 3);
+
+    retained = queue->getFront();
+    CPPUNIT_ASSERT(retained->getLength() == 1 && *retained->getDataBuf() == 1);
+    CPPUNIT_ASSERT(retained->getDataBuf() != picture);
+    first = retained->getDataBuf();
+    retained->retain();
+    queue->removeFrame();
+
+    for (unsigned i = 2; i <= 3; i++) {
+        outputFrame = queue->getFront();
+        CPPUNIT_ASSERT(outputFrame->getLength() == i);
+        CPPUNIT_ASSERT(outputFrame->getDataBuf()[i - 1] == i);
+        queue->removeFrame();
+    }
+    CPPUNIT_ASSERT(outputFrame->getDataBuf() == first + 3);
+
+    slicedFrame = dynamic_cast<SlicedVideoFrame*>(queue->getRear());
+    CPPUNIT_ASSERT(slicedFrame->setSlice(other, 1));
+    CPPUNIT_ASSERT(slicedFrame->setSlice(other + 1, 1));
+    queue->addFrame();
+
+    for (unsigned i = 0; i < 2; i++) {
+        outputFrame = queue->getFront();
+        CPPUNIT_ASSERT(*outputFrame->getDataBuf() == other[i]);
+        queue->removeFrame();
+    }
+
+    CPPUNIT_ASSERT(*retained->getDataBuf() == 1);
+    FramePool::getInstance()->releaseFrame(retained);
+}
+
+void SlicedVideoFrameQueueTest::dropNonReference()
+{
+    StreamInfo si(VIDEO);
+    ConnectionData policyData;
+    SlicedVideoFrameQueue* q;
+
+    si.video.codec = H264;
+    si.video.h264or5.annexb = true;
+    policyData.dropPolicy = DROP_NON_REFERENCE;
+
+    CPPUNIT_ASSERT(queue->getDropPolicy() == DROP_NEWEST);
+
+    q = SlicedVideoFrameQueue::createNew(policyData, &si, 4, maxSliceSize);
+    CPPUNIT_ASSERT(q && q->getDropPolicy() == DROP_NON_REFERENCE);
+
+    writePicture(q, KEY_NAL, 1);
+    writePicture(q, REF_NAL, 2);
+    writePicture(q, NON_REF_NAL, 3);
+    CPPUNIT_ASSERT(q->getElements() == 3);
+
+    //NOTE: the non reference picture is dropped, the queue goes on as usual
+    writePicture(q, REF_NAL, 4);
+    CPPUNIT_ASSERT(q->getElements() == 3);
+    CPPUNIT_ASSERT(q->getLostBlocs() == 1);
+
+    //NOTE: dropping a reference picture skips the next ones until a keyframe
+    writePicture(q, REF_NAL, 5);
+    writePicture(q, NON_REF_NAL, 6);
+    CPPUNIT_ASSERT(q->getElements() == 2);
+    writePicture(q, KEY_NAL, 7);
+    CPPUNIT_ASSERT(q->getLostBlocs() == 4);
+
+    CPPUNIT_ASSERT(readPicture(q) == 1);
+    CPPUNIT_ASSERT(readPicture(q) == 2);
+    CPPUNIT_ASSERT(readPicture(q) == 7);
+    CPPUNIT_ASSERT(q->getElements() == 0);
+
+    delete q;
+}
+
+void SlicedVideoFrameQueueTest::dropGop()
+{
+    StreamInfo si(VIDEO);
+    ConnectionData policyData;
+    SlicedVideoFrameQueue* q;
+    unsigned char expected[] = {1, 2, 3, 9};
+
+    si.video.codec = H264;
+    si.video.h264or5.annexb = true;
+    policyData.dropPolicy = DROP_GOP;
+
+    q = SlicedVideoFrameQueue::createNew(policyData, &si, 6, maxSliceSize);
+    CPPUNIT_ASSERT(q);
+
+    writePicture(q, KEY_NAL, 1);
+    writePicture(q, REF_NAL, 2);
+    writePicture(q, REF_NAL, 3);
+    writePicture(q, KEY_NAL, 4);
+    writePicture(q, REF_NAL, 5);
+    CPPUNIT_ASSERT(q->getElements() == 5);
+
+    //NOTE: the GOP being written is dropped and the next pictures until a keyframe
+    writePicture(q, REF_NAL, 6);
+    CPPUNIT_ASSERT(q->getElements() == 3);
+    writePicture(q, NON_REF_NAL, 7);
+    writePicture(q, REF_NAL, 8);
+    CPPUNIT_ASSERT(q->getElements() == 3);
+    writePicture(q, KEY_NAL, 9);
+
+    for (auto id : expected) {
+        CPPUNIT_ASSERT(readPicture(q) == id);
+    }
+    CPPUNIT_ASSERT(q->getElements() == 0);
+
+    delete q;
+}
+
+void SlicedVideoFrameQueueTest::dropToKeyframe()
+{
+    StreamInfo si(VIDEO);
+    ConnectionData policyData;
+    SlicedVideoFrameQueue* q;
+
+    si.video.codec = H264;
+    si.video.h264or5.annexb = true;
+    policyData.dropPolicy = DROP_TO_KEYFRAME;
+
+    q = SlicedVideoFrameQueue::createNew(policyData, &si, 6, maxSliceSize);
+    CPPUNIT_ASSERT(q);
+
+    writePicture(q, KEY_NAL, 1);
+    writePicture(q, REF_NAL, 2);
+    writePicture(q, KEY_NAL, 3);
+    writePicture(q, REF_NAL, 4);
+    writePicture(q, KEY_NAL, 5);
+
+    //NOTE: the newest GOP is dropped and the reader jumps to the last queued one
+    writePicture(q, REF_NAL, 6);
+    CPPUNIT_ASSERT(q->getElements() == 4);
+
+    CPPUNIT_ASSERT(readPicture(q) == 3);
+    CPPUNIT_ASSERT(q->getSkippedFrames() == 2);
+    CPPUNIT_ASSERT(readPicture(q) == 4);
+    CPPUNIT_ASSERT(!q->getFront());
+
+    writePicture(q, KEY_NAL, 7);
+    CPPUNIT_ASSERT(readPicture(q) == 7);
+
+    delete q;
+}
+
+void SlicedVideoFrameQueueTest::latencyBound()
+{
+    StreamInfo si(VIDEO);
+    ConnectionData latencyData;
+    SlicedVideoFrameQueue* q;
+    std::chrono::system_clock::time_point late = Frame::getOriginNow() - std::chrono::seconds(1);
+
+    si.video.codec = H264;
+    si.video.h264or5.annexb = true;
+    latencyData.maxLatency = std::chrono::milliseconds(100);
+
+    q = SlicedVideoFrameQueue::createNew(latencyData, &si, 8, maxSliceSize);
+    CPPUNIT_ASSERT(q);
+
+    //NOTE: late pictures are kept until a keyframe is queued
+    writePicture(q, KEY_NAL, 1, late);
+    writePicture(q, REF_NAL, 2, late);
+    writePicture(q, REF_NAL, 3, late);
+    CPPUNIT_ASSERT(readPicture(q) == 1);
+    CPPUNIT_ASSERT(q->getSkippedFrames() == 0);
+
+    writePicture(q, KEY_NAL, 4, late);
+    writePicture(q, REF_NAL, 5);
+    writePicture(q, KEY_NAL, 6);
+    writePicture(q, REF_NAL, 7);
+
+    //NOTE: the reader jumps to the first keyframe within the bound
+    CPPUNIT_ASSERT(readPicture(q) == 6);
+    CPPUNIT_ASSERT(q->getSkippedFrames() == 4);
+    CPPUNIT_ASSERT(readPicture(q) == 7);
+
+    delete q;
+}
+
+void SlicedVideoFrameQueueTest::sideData()
+{
+    unsigned char slice[] = {0, 0, 0, 1, 0x65, 1};
+    unsigned char cc[] = {0xFC, 0x94, 0x20};
+    SlicedVideoFrame* slicedFrame;
+
+    slicedFrame = dynamic_cast<SlicedVideoFrame*>(queue->getRear());
+    CPPUNIT_ASSERT(slicedFrame->setSlice(slice, sizeof(slice)));
+    CPPUNIT_ASSERT(slicedFrame->setSlice(slice, sizeof(slice)));
+    slicedFrame->getSideData().add(SD_CAPTIONS, cc, sizeof(cc));
+    queue->addFrame();
+
+    CPPUNIT_ASSERT(queue->getFront()->getSideData().has(SD_CAPTIONS));
+    queue->removeFrame();
+    CPPUNIT_ASSERT(queue->getFront()->getSideData().empty());
+    queue->removeFrame();
+
+    slicedFrame = dynamic_cast<SlicedVideoFrame*>(queue->getRear());
+    CPPUNIT_ASSERT(slicedFrame->getSideData().empty());
+    CPPUNIT_ASSERT(slicedFrame->setSlice(slice, sizeof(slice)));
+    queue->addFrame();
+    CPPUNIT_ASSERT(queue->getFront()->getSideData().empty());
+}
+
+void SlicedVideoFrameQueueTest::partialPicture()
+{
+    unsigned char aud[] = {0, 0, 0, 1, 0x09, 0xF0};
+    unsigned char first[] = {0, 0, 0, 1, 0x65, 1};
+    unsigned char second[] = {0, 0, 0, 1, 0x65, 2};
+    unsigned char filler[] = {0, 0, 0, 1, 0x0C, 0xFF};
+    unsigned char cc[] = {0xFC, 0x94, 0x20};
+    SlicedVideoFrame* slicedFrame;
+
+    slicedFrame = dynamic_cast<SlicedVideoFrame*>(queue->getRear());
+    slicedFrame->setPresentationTime(std::chrono::microseconds(40000));
+    slicedFrame->getSideData().add(SD_CAPTIONS, cc, sizeof(cc));
+    CPPUNIT_ASSERT(slicedFrame->setSlice(aud, sizeof(aud)));
+    CPPUNIT_ASSERT(slicedFrame->setSlice(first, sizeof(first)));
+    queue->addSlices();
+
+    //NOTE: the queued slices can be read before the picture is complete
+    CPPUNIT_ASSERT(slicedFrame->getSliceNum() == 0);
+    CPPUNIT_ASSERT(queue->getElements() == 2);
+    CPPUNIT_ASSERT(queue->getFront()->getSideData().has(SD_CAPTIONS));
+    queue->removeFrame();
+    CPPUNIT_ASSERT(queue->getFront()->getDataBuf()[5] == 1 && dynamic_cast<VideoFrame*>(queue->getFront())->isKeyFrame());
+    queue->removeFrame();
+
+    CPPUNIT_ASSERT(slicedFrame->setSlice(second, sizeof(second)));
+    queue->addSlices();
+    queue->addSlices();
+    CPPUNIT_ASSERT(slicedFrame->setSlice(filler, sizeof(filler)));
+    queue->addFrame();
+
+    CPPUNIT_ASSERT(queue->getElements() == 2);
+    CPPUNIT_ASSERT(queue->getFront()->getDataBuf()[5] == 2);
+    CPPUNIT_ASSERT(queue->getFront()->getPresentationTime() == std::chrono::microseconds(40000));
+    CPPUNIT_ASSERT(queue->getFront()->getSideData().empty());
+    queue->removeFrame();
+    CPPUNIT_ASSERT(queue->getFront()->getDataBuf()[5] == 0xFF);
+    CPPUNIT_ASSERT(queue->getFront()->getSideData().empty());
+    queue->removeFrame();
+
+    //NOTE: the next picture starts again with its own metadata
+    CPPUNIT_ASSERT(queue->getRear()->getSideData().empty());
+    CPPUNIT_ASSERT(slicedFrame->setSlice(first, sizeof(first)));
+    slicedFrame->getSideData().add(SD_CAPTIONS, cc, sizeof(cc));
+    queue->addFrame();
+    CPPUNIT_ASSERT(queue->getFront()->getSideData().has(SD_CAPTIONS));
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(SlicedVideoFrameQueueTest);
 
 int main(int argc, char* argv[])
@@ -0,0 +1,144 @@
+/*
+ *  SlotMapTest.cpp - SlotMap class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "SlotMap.hh"
+#include "Utils.hh"
+
+class SlotMapTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(SlotMapTest);
+    CPPUNIT_TEST(insertAndFind);
+    CPPUNIT_TEST(ordering);
+    CPPUNIT_TEST(erasing);
+    CPPUNIT_TEST(reservedStorage);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void insertAndFind();
+    void ordering();
+    void erasing();
+    void reservedStorage();
+};
+
+void SlotMapTest::insertAndFind()
+{
+    SlotMap<int> slots;
+
+    CPPUNIT_ASSERT(slots.empty());
+    CPPUNIT_ASSERT(slots.count(3) == 0);
+    CPPUNIT_ASSERT(slots.find(3) == slots.end());
+
+    slots[3] = 30;
+    slots[1] = 10;
+
+    CPPUNIT_ASSERT(slots.size() == 2);
+    CPPUNIT_ASSERT(slots.count(3) == 1);
+    CPPUNIT_ASSERT(slots.find(1)->second == 10);
+    CPPUNIT_ASSERT(slots[3] == 30);
+
+    //NOTE: as std::map, reading a missing slot inserts it
+    CPPUNIT_ASSERT(slots[2] == 0);
+    CPPUNIT_ASSERT(slots.size() == 3);
+}
+
+void SlotMapTest::ordering()
+{
+    SlotMap<int> slots;
+    int ids[] = {42, 7, 1000, -1, 7};
+    int prev = -2;
+
+    for (auto id : ids) {
+        slots[id] = id;
+    }
+
+    CPPUNIT_ASSERT(slots.size() == 4);
+
+    for (auto &slot : slots) {
+        CPPUNIT_ASSERT(slot.first > prev);
+        CPPUNIT_ASSERT(slot.first == slot.second);
+        prev = slot.first;
+    }
+}
+
+void SlotMapTest::erasing()
+{
+    SlotMap<int> slots;
+    SlotMap<int>::iterator it;
+
+    slots[1] = 1;
+    slots[2] = 2;
+    slots[3] = 3;
+
+    CPPUNIT_ASSERT(slots.erase(4) == 0);
+    CPPUNIT_ASSERT(slots.erase(2) == 1);
+    CPPUNIT_ASSERT(slots.count(2) == 0);
+
+    it = slots.erase(slots.begin());
+    CPPUNIT_ASSERT(it->first == 3);
+    CPPUNIT_ASSERT(slots.size() == 1);
+
+    slots.clear();
+    CPPUNIT_ASSERT(slots.empty());
+}
+
+void SlotMapTest::reservedStorage()
+{
+    SlotMap<int> slots(4);
+    int *first;
+
+    slots[1] = 1;
+    first = &slots[1];
+
+    //NOTE: filling up to the reserved slots does not reallocate the storage
+    for (int i = 0; i < 3; i++) {
+        slots[i + 2] = i;
+    }
+
+    slots.clear();
+    slots[1] = 1;
+    CPPUNIT_ASSERT(first == &slots[1]);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SlotMapTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("SlotMapTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/*
+ *  SpeakerActivityTest.cpp - Active speaker board and selector test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "SpeakerActivity.hh"
+#include "Utils.hh"
+
+#define MIXER_ID 5
+
+class SpeakerActivityTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(SpeakerActivityTest);
+    CPPUNIT_TEST(publishAndRead);
+    CPPUNIT_TEST(firstSpeaker);
+    CPPUNIT_TEST(hysteresis);
+    CPPUNIT_TEST(silenceKeepsFloor);
+    CPPUNIT_TEST(invalidConfig);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void publishAndRead();
+    void firstSpeaker();
+    void hysteresis();
+    void silenceKeepsFloor();
+    void invalidConfig();
+
+    SpeakerSelector selector;
+    std::chrono::steady_clock::time_point start;
+};
+
+void SpeakerActivityTest::setUp()
+{
+    CPPUNIT_ASSERT(selector.configure(2, std::chrono::milliseconds(500)));
+    start = std::chrono::steady_clock::now();
+}
+
+void SpeakerActivityTest::tearDown()
+{
+    SpeakerActivity::getInstance()->remove(MIXER_ID);
+}
+
+void SpeakerActivityTest::publishAndRead()
+{
+    SpeakerActivity* board = SpeakerActivity::getInstance();
+    std::map<int, float> levels;
+    uint64_t seq = 0;
+
+    CPPUNIT_ASSERT(!board->read(MIXER_ID, levels, seq));
+
+    board->publish(MIXER_ID, {{1, 0.1}, {2, 0.2}});
+    CPPUNIT_ASSERT(board->read(MIXER_ID, levels, seq));
+    CPPUNIT_ASSERT(levels.size() == 2 && levels[2] == 0.2f);
+
+    //NOTE: the same publication is only read once
+    CPPUNIT_ASSERT(!board->read(MIXER_ID, levels, seq));
+
+    board->publish(MIXER_ID, {{1, 0.3}});
+    CPPUNIT_ASSERT(board->read(MIXER_ID, levels, seq));
+    CPPUNIT_ASSERT(levels.size() == 1 && levels[1] == 0.3f);
+
+    board->remove(MIXER_ID);
+    board->publish(MIXER_ID + 1, {{1, 0.3}});
+    CPPUNIT_ASSERT(!board->read(MIXER_ID, levels, seq));
+    board->remove(MIXER_ID + 1);
+}
+
+void SpeakerActivityTest::firstSpeaker()
+{
+    CPPUNIT_ASSERT(selector.select({{1, 0.0001}, {2, 0.0002}}, start) == -1);
+    CPPUNIT_ASSERT(selector.select({{1, 0.01}, {2, 0.05}}, start) == 2);
+    CPPUNIT_ASSERT(selector.getSwitches() == 1);
+}
+
+void SpeakerActivityTest::hysteresis()
+{
+    std::chrono::milliseconds ms(1);
+
+    CPPUNIT_ASSERT(selector.select({{1, 0.1}, {2, 0.01}}, start) == 1);
+
+    //NOTE: louder but within the hold time, then louder but within the margin
+    CPPUNIT_ASSERT(selector.select({{1, 0.1}, {2, 0.5}}, start + 100*ms) == 1);
+    CPPUNIT_ASSERT(selector.select({{1, 0.1}, {2, 0.15}}, start + 600*ms) == 1);
+
+    CPPUNIT_ASSERT(selector.select({{1, 0.1}, {2, 0.25}}, start + 600*ms) == 2);
+    CPPUNIT_ASSERT(selector.getSwitches() == 2);
+
+    //NOTE: a speaker no longer there loses the floor at once
+    CPPUNIT_ASSERT(selector.select({{1, 0.1}}, start + 700*ms) == 1);
+}
+
+void SpeakerActivityTest::silenceKeepsFloor()
+{
+    CPPUNIT_ASSERT(selector.select({{1, 0.1}, {2, 0.01}}, start) == 1);
+    CPPUNIT_ASSERT(selector.select({{1, 0.0001}, {2, 0.0002}}, start + std::chrono::seconds(5)) == 1);
+
+    selector.reset();
+    CPPUNIT_ASSERT(selector.getSpeaker() == -1);
+}
+
+void SpeakerActivityTest::invalidConfig()
+{
+    CPPUNIT_ASSERT(!selector.configure(0.5, std::chrono::milliseconds(100)));
+    CPPUNIT_ASSERT(!selector.configure(2, std::chrono::milliseconds(-1)));
+    CPPUNIT_ASSERT(selector.getMargin() == 2 && selector.getHold().count() == 500);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SpeakerActivityTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("SpeakerActivityTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/*
+ *  StreamInfoTest.cpp - StreamInfo extradata versions test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "StreamInfo.hh"
+#include "VideoFrame.hh"
+#include "Utils.hh"
+
+#define VERSIONS 10000
+
+class StreamInfoTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(StreamInfoTest);
+    CPPUNIT_TEST(versions);
+    CPPUNIT_TEST(concurrentReaders);
+    CPPUNIT_TEST(formatChanges);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void versions();
+    void concurrentReaders();
+    void formatChanges();
+};
+
+void StreamInfoTest::versions()
+{
+    StreamInfo si(VIDEO);
+    uint8_t first[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x42};
+    uint8_t second[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00};
+    std::shared_ptr<const ExtraData> held;
+
+    CPPUNIT_ASSERT(!si.getExtraData());
+    CPPUNIT_ASSERT(si.getExtraDataVersion() == 0);
+
+    si.setExtraData(first, sizeof(first));
+    held = si.getExtraData();
+    CPPUNIT_ASSERT(held && held->size() == sizeof(first));
+    CPPUNIT_ASSERT(si.getExtraDataVersion() == 1);
+
+    //NOTE: readers share the published version instead of copying it
+    CPPUNIT_ASSERT(si.getExtraData() == held);
+
+    si.setExtraData(second, sizeof(second));
+    CPPUNIT_ASSERT(si.getExtraDataVersion() == 2);
+    CPPUNIT_ASSERT(si.getExtraData()->size() == sizeof(second));
+    CPPUNIT_ASSERT(held->size() == sizeof(first) && (*held)[5] == 0x42);
+
+    si.setExtraData(NULL, 0);
+    CPPUNIT_ASSERT(!si.getExtraData());
+    CPPUNIT_ASSERT(si.getExtraDataVersion() == 3);
+    CPPUNIT_ASSERT(held.use_count() == 1);
+}
+
+void StreamInfoTest::concurrentReaders()
+{
+    StreamInfo si(VIDEO);
+    uint8_t data[4];
+    bool valid = true;
+
+    si.setExtraData(data, 1);
+
+    std::thread reader([&si, &valid] {
+        std::shared_ptr<const ExtraData> ed;
+        unsigned version = 0;
+
+        while (version < VERSIONS) {
+            version = si.getExtraDataVersion();
+            ed = si.getExtraData();
+            valid = valid && ed && ed->size() >= 1 && ed->size() <= 4 && (*ed)[0] == ed->size();
+        }
+    });
+
+    for (unsigned i = 1; i <= VERSIONS; i++) {
+        data[0] = i%4 + 1;
+        si.setExtraData(data, data[0]);
+    }
+
+    reader.join();
+    CPPUNIT_ASSERT(valid);
+}
+
+void StreamInfoTest::formatChanges()
+{
+    StreamInfo si(VIDEO);
+    InterleavedVideoFrame *frame = InterleavedVideoFrame::createNew(RAW, 64, 48, YUV420P);
+    unsigned char *buffer;
+
+    CPPUNIT_ASSERT(si.getFormatVersion() == 0);
+    CPPUNIT_ASSERT(frame->getFormatVersion() == 0);
+
+    frame->setFormatVersion(si.getFormatVersion());
+    buffer = frame->getDataBuf();
+
+    //NOTE: the extradata version is independent
+    CPPUNIT_ASSERT(si.changeFormat() == 1);
+    CPPUNIT_ASSERT(si.getFormatVersion() == 1 && si.getExtraDataVersion() == 0);
+
+    //NOTE: a smaller picture is fitted in the same buffer, the frame only carries the new version
+    frame->fitBuffer(56, 40, YUV420P);
+    frame->setFormatVersion(si.getFormatVersion());
+    CPPUNIT_ASSERT(frame->getDataBuf() == buffer);
+    CPPUNIT_ASSERT(frame->getWidth() == 56 && frame->getHeight() == 40);
+    CPPUNIT_ASSERT(frame->getFormatVersion() == 1);
+
+    CPPUNIT_ASSERT(si.changeFormat() == 2);
+    CPPUNIT_ASSERT(frame->getFormatVersion() != si.getFormatVersion());
+
+    delete frame;
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(StreamInfoTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("StreamInfoTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
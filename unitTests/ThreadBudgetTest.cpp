@@ -0,0 +1,157 @@
+/*
+ *  ThreadBudgetTest.cpp - ThreadBudget class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "ThreadBudget.hh"
+#include "Utils.hh"
+
+class ThreadBudgetTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ThreadBudgetTest);
+    CPPUNIT_TEST(evenShares);
+    CPPUNIT_TEST(smallDemands);
+    CPPUNIT_TEST(oversubscribed);
+    CPPUNIT_TEST(rebalance);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void evenShares();
+    void smallDemands();
+    void oversubscribed();
+    void rebalance();
+    
+    ThreadBudget *budget;
+    int consumers[4];
+};
+
+void ThreadBudgetTest::setUp()
+{
+    budget = ThreadBudget::getInstance();
+    budget->setBudget(16);
+}
+
+void ThreadBudgetTest::tearDown()
+{
+    for (unsigned i = 0; i < 4; i++) {
+        budget->leave(&consumers[i]);
+    }
+    
+    budget->setBudget(0);
+}
+
+void ThreadBudgetTest::evenShares()
+{
+    budget->join(&consumers[0], 0);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[0]) == 16);
+    
+    budget->join(&consumers[1], 0);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[0]) == 8);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[1]) == 8);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[2]) == 0);
+}
+
+void ThreadBudgetTest::smallDemands()
+{
+    budget->join(&consumers[0], 2);
+    budget->join(&consumers[1], 0);
+    budget->join(&consumers[2], 0);
+    
+    //NOTE: the threads the small consumer does not use are given to the others
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[0]) == 2);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[1]) == 7);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[2]) == 7);
+    
+    budget->join(&consumers[3], 4);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[0]) == 2);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[3]) == 4);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[1]) == 5);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[2]) == 5);
+}
+
+void ThreadBudgetTest::oversubscribed()
+{
+    budget->setBudget(2);
+    
+    for (unsigned i = 0; i < 4; i++) {
+        budget->join(&consumers[i], 4);
+    }
+    
+    //NOTE: every consumer gets at least one thread
+    for (unsigned i = 0; i < 4; i++) {
+        CPPUNIT_ASSERT(budget->getThreads(&consumers[i]) == 1);
+    }
+}
+
+void ThreadBudgetTest::rebalance()
+{
+    unsigned generation;
+    
+    budget->join(&consumers[0], 0);
+    budget->join(&consumers[1], 0);
+    generation = budget->getGeneration();
+    
+    //NOTE: joining again with the same demand does not move the shares
+    budget->join(&consumers[0], 0);
+    CPPUNIT_ASSERT(budget->getGeneration() == generation);
+    
+    budget->leave(&consumers[1]);
+    CPPUNIT_ASSERT(budget->getGeneration() != generation);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[0]) == 16);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[1]) == 0);
+    
+    generation = budget->getGeneration();
+    budget->join(&consumers[0], 16);
+    CPPUNIT_ASSERT(budget->getGeneration() == generation);
+    
+    budget->setBudget(8);
+    CPPUNIT_ASSERT(budget->getGeneration() != generation);
+    CPPUNIT_ASSERT(budget->getThreads(&consumers[0]) == 8);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ThreadBudgetTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("ThreadBudgetTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+    
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+} 
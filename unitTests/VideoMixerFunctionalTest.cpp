@@ -22,7 +22,9 @@
 #include <string>
 #include <iostream>
 #include <chrono>
+#include <cstdio>
 
+#include <opencv2/imgcodecs.hpp>
 #include <cppunit/extensions/TestFactoryRegistry.h>
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/ui/text/TextTestRunner.h>
@@ -37,6 +39,12 @@ class VideoMixerFunctionalTest : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(VideoMixerFunctionalTest);
     CPPUNIT_TEST(mixingTest);
+    CPPUNIT_TEST(yuvMixingTest);
+    CPPUNIT_TEST(incrementalMixingTest);
+    CPPUNIT_TEST(multiLayoutTest);
+    CPPUNIT_TEST(backendsTest);
+    CPPUNIT_TEST(transitionTest);
+    CPPUNIT_TEST(staticLayersTest);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -45,6 +53,12 @@ public:
 
 protected:
     void mixingTest();
+    void yuvMixingTest();
+    void incrementalMixingTest();
+    void multiLayoutTest();
+    void backendsTest();
+    void transitionTest();
+    void staticLayersTest();
 
     int mixWidth = 1920;
     int mixHeight = 1080;
@@ -104,6 +118,376 @@ void VideoMixerFunctionalTest::mixingTest()
     CPPUNIT_ASSERT(memcmp(frame->getDataBuf(), mixedFrame->getDataBuf(), frame->getLength()) == 0);
 }
 
+void VideoMixerFunctionalTest::yuvMixingTest()
+{
+    VideoMixer* yuvMixer;
+    ManyToOneVideoScenarioMockup* yuvScenario;
+    InterleavedVideoFrame *frame = NULL;
+    InterleavedVideoFrame *mixedFrame = NULL;
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    unsigned char values[3] = {200, 60, 90};
+    unsigned char background[3] = {16, 128, 128};
+    int lineBytes, rows;
+    int blended;
+
+    yuvMixer = VideoMixer::createNew(channels, mixWidth, mixHeight);
+    yuvScenario = new ManyToOneVideoScenarioMockup(yuvMixer);
+
+    CPPUNIT_ASSERT(yuvScenario->addHeadFilter(1, RAW, YUV420P)); 
+    CPPUNIT_ASSERT(yuvScenario->addHeadFilter(2, RAW, YUV420P)); 
+    CPPUNIT_ASSERT(yuvScenario->connectFilters());
+    CPPUNIT_ASSERT(yuvMixer->configure(mixWidth, mixHeight, 0, YUV420P));
+    CPPUNIT_ASSERT(yuvMixer->configChannel(1, 0.5, 0.5, 0, 0, 1, true, 1));
+    CPPUNIT_ASSERT(yuvMixer->configChannel(2, 0.5, 0.5, 0.25, 0.25, 1, true, 0.5));
+
+    frame = InterleavedVideoFrame::createNew(RAW, mixWidth/2, mixHeight/2, YUV420P);
+    CPPUNIT_ASSERT(frame);
+    frame->setLength(frame->getPlanes(data, linesize));
+
+    for (unsigned p = 0; VideoFrame::planeSize(YUV420P, mixWidth/2, mixHeight/2, p, lineBytes, rows); p++) {
+        memset(data[p], values[p], linesize[p]*rows);
+    }
+
+    //NOTE: the second frame reuses the scaled planes of the first one
+    for (int f = 0; f < 2; f++) {
+        yuvScenario->processFrame(frame);
+        mixedFrame = yuvScenario->extractFrame();
+        CPPUNIT_ASSERT(mixedFrame);
+        CPPUNIT_ASSERT(yuvMixer->getPixelFormat() == YUV420P);
+        CPPUNIT_ASSERT(mixedFrame->getPixelFormat() == YUV420P);
+        CPPUNIT_ASSERT(mixedFrame->getWidth() == mixWidth && mixedFrame->getHeight() == mixHeight);
+
+        //NOTE: channel 1 covers the upper left quarter and channel 2 is blended over its lower right 
+        //      corner, the rest of the layout is black
+        CPPUNIT_ASSERT(mixedFrame->getPlanes(data, linesize) > 0);
+
+        for (unsigned p = 0; p < 3; p++) {
+            VideoFrame::planeSize(YUV420P, mixWidth, mixHeight, p, lineBytes, rows);
+            blended = (values[p] + background[p] + 1)/2;
+            CPPUNIT_ASSERT(data[p][(rows/8)*linesize[p] + lineBytes/8] == values[p]);
+            CPPUNIT_ASSERT(data[p][(3*rows/8)*linesize[p] + 3*lineBytes/8] == values[p]);
+            CPPUNIT_ASSERT(std::abs(data[p][(5*rows/8)*linesize[p] + 5*lineBytes/8] - blended) <= 1);
+            CPPUNIT_ASSERT(data[p][(7*rows/8)*linesize[p] + 7*lineBytes/8] == background[p]);
+        }
+    }
+
+    delete yuvScenario;
+    delete yuvMixer;
+    delete frame;
+}
+
+void VideoMixerFunctionalTest::incrementalMixingTest()
+{
+    VideoMixer* yuvMixer;
+    ManyToOneVideoScenarioMockup* yuvScenario;
+    InterleavedVideoFrame *frames[2];
+    InterleavedVideoFrame *mixedFrame = NULL;
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    unsigned char values[2] = {200, 100};
+    int lineBytes, rows;
+
+    yuvMixer = VideoMixer::createNew(channels, mixWidth, mixHeight);
+    yuvScenario = new ManyToOneVideoScenarioMockup(yuvMixer);
+
+    for (int id = 1; id <= 3; id++) {
+        CPPUNIT_ASSERT(yuvScenario->addHeadFilter(id, RAW, YUV420P)); 
+    }
+
+    CPPUNIT_ASSERT(yuvScenario->connectFilters());
+    CPPUNIT_ASSERT(yuvMixer->configure(mixWidth, mixHeight, 0, YUV420P));
+    CPPUNIT_ASSERT(yuvMixer->configChannel(1, 0.5, 0.5, 0, 0, 1, true, 1));
+    CPPUNIT_ASSERT(yuvMixer->configChannel(2, 0.5, 0.5, 0.5, 0.5, 1, true, 1));
+    CPPUNIT_ASSERT(yuvMixer->configChannel(3, 0.5, 0.5, 0.25, 0.25, 2, true, 0.5));
+
+    for (int f = 0; f < 2; f++) {
+        frames[f] = InterleavedVideoFrame::createNew(RAW, mixWidth/2, mixHeight/2, YUV420P);
+        CPPUNIT_ASSERT(frames[f]);
+        frames[f]->setLength(frames[f]->getPlanes(data, linesize));
+        VideoFrame::planeSize(YUV420P, mixWidth/2, mixHeight/2, 0, lineBytes, rows);
+        memset(data[0], values[f], linesize[0]*rows);
+    }
+
+    yuvScenario->processFrame(frames[0]);
+    mixedFrame = yuvScenario->extractFrame();
+    CPPUNIT_ASSERT(mixedFrame);
+
+    //NOTE: only channel 2 region is repainted, channel 3 is blended once over it and kept elsewhere
+    yuvScenario->processFrame(frames[1], 2);
+    mixedFrame = yuvScenario->extractFrame();
+    CPPUNIT_ASSERT(mixedFrame);
+    CPPUNIT_ASSERT(mixedFrame->getPlanes(data, linesize) > 0);
+
+    VideoFrame::planeSize(YUV420P, mixWidth, mixHeight, 0, lineBytes, rows);
+    CPPUNIT_ASSERT(data[0][(rows/8)*linesize[0] + lineBytes/8] == 200);
+    CPPUNIT_ASSERT(data[0][(7*rows/8)*linesize[0] + 7*lineBytes/8] == 100);
+    CPPUNIT_ASSERT(std::abs(data[0][(6*rows/10)*linesize[0] + 6*lineBytes/10] - 150) <= 1);
+    CPPUNIT_ASSERT(std::abs(data[0][(6*rows/10)*linesize[0] + 3*lineBytes/10] - 108) <= 1);
+    CPPUNIT_ASSERT(data[0][(7*rows/8)*linesize[0] + lineBytes/8] == 16);
+
+    delete yuvScenario;
+    delete yuvMixer;
+    delete frames[0];
+    delete frames[1];
+}
+
+void VideoMixerFunctionalTest::multiLayoutTest()
+{
+    VideoMixer* yuvMixer;
+    ManyToOneVideoScenarioMockup* yuvScenario;
+    InterleavedVideoFrame *frame;
+    InterleavedVideoFrame *mixedFrame = NULL;
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int lineBytes, rows;
+    int writerId = 7;
+
+    yuvMixer = VideoMixer::createNew(channels, mixWidth, mixHeight);
+    yuvScenario = new ManyToOneVideoScenarioMockup(yuvMixer);
+
+    CPPUNIT_ASSERT(yuvScenario->addHeadFilter(1, RAW, YUV420P)); 
+    CPPUNIT_ASSERT(yuvScenario->addHeadFilter(2, RAW, YUV420P)); 
+    CPPUNIT_ASSERT(yuvScenario->addTailFilter(DEFAULT_ID)); 
+    CPPUNIT_ASSERT(yuvScenario->addTailFilter(writerId)); 
+
+    CPPUNIT_ASSERT(yuvScenario->connectFilters());
+    CPPUNIT_ASSERT(yuvMixer->configure(mixWidth, mixHeight, 0, YUV420P));
+    CPPUNIT_ASSERT(yuvMixer->configLayout(writerId, mixWidth/3, mixHeight/3));
+    CPPUNIT_ASSERT(yuvMixer->configChannel(1, 0.5, 0.5, 0, 0, 1, true, 1));
+    CPPUNIT_ASSERT(yuvMixer->configChannel(2, 0.5, 0.5, 0.5, 0.5, 1, true, 1));
+    CPPUNIT_ASSERT(yuvMixer->configChannel(2, 1, 1, 0, 0, 1, true, 1, writerId));
+
+    frame = InterleavedVideoFrame::createNew(RAW, mixWidth/2, mixHeight/2, YUV420P);
+    CPPUNIT_ASSERT(frame);
+    frame->setLength(frame->getPlanes(data, linesize));
+    VideoFrame::planeSize(YUV420P, mixWidth/2, mixHeight/2, 0, lineBytes, rows);
+    memset(data[0], 200, linesize[0]*rows);
+
+    yuvScenario->processFrame(frame);
+
+    mixedFrame = yuvScenario->extractFrame();
+    CPPUNIT_ASSERT(mixedFrame);
+    CPPUNIT_ASSERT(mixedFrame->getWidth() == mixWidth && mixedFrame->getHeight() == mixHeight);
+    CPPUNIT_ASSERT(mixedFrame->getPlanes(data, linesize) > 0);
+    VideoFrame::planeSize(YUV420P, mixWidth, mixHeight, 0, lineBytes, rows);
+    CPPUNIT_ASSERT(data[0][(rows/4)*linesize[0] + lineBytes/4] == 200);
+    CPPUNIT_ASSERT(data[0][(rows/4)*linesize[0] + 3*lineBytes/4] == 16);
+
+    //NOTE: channel 1 is disabled in the new layout, channel 2 is scaled to fill it
+    mixedFrame = yuvScenario->extractFrame(writerId);
+    CPPUNIT_ASSERT(mixedFrame);
+    CPPUNIT_ASSERT(mixedFrame->getWidth() == mixWidth/3 && mixedFrame->getHeight() == mixHeight/3);
+    CPPUNIT_ASSERT(mixedFrame->getPlanes(data, linesize) > 0);
+    VideoFrame::planeSize(YUV420P, mixWidth/3, mixHeight/3, 0, lineBytes, rows);
+    CPPUNIT_ASSERT(data[0][(rows/4)*linesize[0] + lineBytes/4] == 200);
+    CPPUNIT_ASSERT(data[0][(3*rows/4)*linesize[0] + 3*lineBytes/4] == 200);
+
+    CPPUNIT_ASSERT(yuvMixer->removeLayout(writerId));
+
+    delete yuvScenario;
+    delete yuvMixer;
+    delete frame;
+}
+
+void VideoMixerFunctionalTest::backendsTest()
+{
+    VideoMixer* mixers[2];
+    ManyToOneVideoScenarioMockup* scenarios[2];
+    ComposeBackend backends[2] = {CPU_COMPOSE, OPENCL_COMPOSE};
+    InterleavedVideoFrame *frame;
+    InterleavedVideoFrame *mixedFrames[2];
+    unsigned char* data[2][MAX_PLANES];
+    int linesize[2][MAX_PLANES];
+    int lineBytes, rows;
+
+    frame = InterleavedVideoFrame::createNew(RAW, mixWidth/2, mixHeight/2, YUV420P);
+    CPPUNIT_ASSERT(frame);
+    frame->setLength(frame->getPlanes(data[0], linesize[0]));
+
+    for (unsigned p = 0; VideoFrame::planeSize(YUV420P, mixWidth/2, mixHeight/2, p, lineBytes, rows); p++) {
+        for (int y = 0; y < rows; y++) {
+            for (int x = 0; x < lineBytes; x++) {
+                data[0][p][y*linesize[0][p] + x] = (x + y)/8;
+            }
+        }
+    }
+
+    //NOTE: without an OpenCL device the second mixer falls back to the CPU, both outputs must match
+    for (int b = 0; b < 2; b++) {
+        mixers[b] = VideoMixer::createNew(channels, mixWidth, mixHeight, std::chrono::microseconds(0), backends[b]);
+        CPPUNIT_ASSERT(mixers[b]);
+        scenarios[b] = new ManyToOneVideoScenarioMockup(mixers[b]);
+
+        CPPUNIT_ASSERT(scenarios[b]->addHeadFilter(1, RAW, YUV420P)); 
+        CPPUNIT_ASSERT(scenarios[b]->addHeadFilter(2, RAW, YUV420P)); 
+        CPPUNIT_ASSERT(scenarios[b]->connectFilters());
+        CPPUNIT_ASSERT(mixers[b]->configure(mixWidth, mixHeight, 0, YUV420P));
+        CPPUNIT_ASSERT(mixers[b]->configChannel(1, 0.75, 0.75, 0, 0, 1, true, 1));
+        CPPUNIT_ASSERT(mixers[b]->configChannel(2, 0.5, 0.5, 0.5, 0.5, 2, true, 0.5));
+
+        scenarios[b]->processFrame(frame);
+        mixedFrames[b] = scenarios[b]->extractFrame();
+        CPPUNIT_ASSERT(mixedFrames[b]);
+        CPPUNIT_ASSERT(mixedFrames[b]->getPlanes(data[b], linesize[b]) > 0);
+    }
+
+    CPPUNIT_ASSERT(mixers[0]->getBackend() == CPU_COMPOSE);
+
+    for (unsigned p = 0; VideoFrame::planeSize(YUV420P, mixWidth, mixHeight, p, lineBytes, rows); p++) {
+        for (int y = 0; y < rows; y++) {
+            for (int x = 0; x < lineBytes; x++) {
+                CPPUNIT_ASSERT(std::abs(data[0][p][y*linesize[0][p] + x] - data[1][p][y*linesize[1][p] + x]) <= 2);
+            }
+        }
+    }
+
+    for (int b = 0; b < 2; b++) {
+        delete scenarios[b];
+        delete mixers[b];
+    }
+
+    delete frame;
+}
+
+void VideoMixerFunctionalTest::transitionTest()
+{
+    VideoMixer* yuvMixer;
+    ManyToOneVideoScenarioMockup* yuvScenario;
+    InterleavedVideoFrame *frame;
+    InterleavedVideoFrame *mixedFrame = NULL;
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int lineBytes, rows;
+
+    yuvMixer = VideoMixer::createNew(channels, mixWidth, mixHeight);
+    yuvScenario = new ManyToOneVideoScenarioMockup(yuvMixer);
+
+    CPPUNIT_ASSERT(yuvScenario->addHeadFilter(1, RAW, YUV420P)); 
+    CPPUNIT_ASSERT(yuvScenario->addHeadFilter(2, RAW, YUV420P)); 
+    CPPUNIT_ASSERT(yuvScenario->connectFilters());
+    CPPUNIT_ASSERT(yuvMixer->configure(mixWidth, mixHeight, 0, YUV420P));
+
+    //NOTE: channel 2 is only enabled in the second preset, so it fades in
+    CPPUNIT_ASSERT(yuvMixer->configChannel(1, 0.5, 0.5, 0, 0, 1, true, 1));
+    CPPUNIT_ASSERT(yuvMixer->savePreset("topLeft"));
+    CPPUNIT_ASSERT(yuvMixer->configChannel(1, 0.5, 0.5, 0.5, 0.5, 1, true, 1));
+    CPPUNIT_ASSERT(yuvMixer->configChannel(2, 0.5, 0.5, 0, 0, 1, true, 1));
+    CPPUNIT_ASSERT(yuvMixer->savePreset("bottomRight"));
+    CPPUNIT_ASSERT(yuvMixer->applyPreset("topLeft"));
+
+    frame = InterleavedVideoFrame::createNew(RAW, mixWidth/2, mixHeight/2, YUV420P);
+    CPPUNIT_ASSERT(frame);
+    frame->setLength(frame->getPlanes(data, linesize));
+    VideoFrame::planeSize(YUV420P, mixWidth/2, mixHeight/2, 0, lineBytes, rows);
+    memset(data[0], 200, linesize[0]*rows);
+
+    yuvScenario->processFrame(frame);
+    mixedFrame = yuvScenario->extractFrame();
+    CPPUNIT_ASSERT(mixedFrame);
+    CPPUNIT_ASSERT(mixedFrame->getPlanes(data, linesize) > 0);
+    VideoFrame::planeSize(YUV420P, mixWidth, mixHeight, 0, lineBytes, rows);
+    CPPUNIT_ASSERT(data[0][(rows/4)*linesize[0] + lineBytes/4] == 200);
+    CPPUNIT_ASSERT(data[0][(7*rows/8)*linesize[0] + 7*lineBytes/8] == 16);
+
+    //NOTE: halfway, channel 1 is centered and channel 2 is half transparent
+    CPPUNIT_ASSERT(yuvMixer->applyPreset("bottomRight", 2));
+    yuvScenario->processFrame(frame);
+    mixedFrame = yuvScenario->extractFrame();
+    CPPUNIT_ASSERT(mixedFrame);
+    CPPUNIT_ASSERT(mixedFrame->getPlanes(data, linesize) > 0);
+    CPPUNIT_ASSERT(data[0][(rows/2)*linesize[0] + lineBytes/2] == 200);
+    CPPUNIT_ASSERT(std::abs(data[0][(rows/8)*linesize[0] + lineBytes/8] - 108) <= 1);
+    CPPUNIT_ASSERT(data[0][(7*rows/8)*linesize[0] + 7*lineBytes/8] == 16);
+
+    yuvScenario->processFrame(frame);
+    mixedFrame = yuvScenario->extractFrame();
+    CPPUNIT_ASSERT(mixedFrame);
+    CPPUNIT_ASSERT(mixedFrame->getPlanes(data, linesize) > 0);
+    CPPUNIT_ASSERT(data[0][(7*rows/8)*linesize[0] + 7*lineBytes/8] == 200);
+    CPPUNIT_ASSERT(data[0][(rows/8)*linesize[0] + lineBytes/8] == 200);
+    CPPUNIT_ASSERT(data[0][(rows/4)*linesize[0] + 3*lineBytes/4] == 16);
+
+    CPPUNIT_ASSERT(yuvMixer->removePreset("topLeft"));
+
+    delete yuvScenario;
+    delete yuvMixer;
+    delete frame;
+}
+
+void VideoMixerFunctionalTest::staticLayersTest()
+{
+    VideoMixer* yuvMixer;
+    ManyToOneVideoScenarioMockup* yuvScenario;
+    InterleavedVideoFrame *frame;
+    InterleavedVideoFrame *mixedFrame = NULL;
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int lineBytes, rows;
+    int chromaBytes, chromaRows;
+
+    //NOTE: an opaque white plate and a half transparent gray overlay, which is Y 126 once converted
+    CPPUNIT_ASSERT(cv::imwrite("staticLayersTestBackground.png", cv::Mat(16, 16, CV_8UC4, cv::Scalar(255, 255, 255, 255))));
+    CPPUNIT_ASSERT(cv::imwrite("staticLayersTestOverlay.png", cv::Mat(16, 16, CV_8UC4, cv::Scalar(128, 128, 128, 128))));
+
+    yuvMixer = VideoMixer::createNew(channels, mixWidth, mixHeight);
+    yuvScenario = new ManyToOneVideoScenarioMockup(yuvMixer);
+
+    CPPUNIT_ASSERT(yuvScenario->addHeadFilter(1, RAW, YUV420P)); 
+    CPPUNIT_ASSERT(yuvScenario->connectFilters());
+    CPPUNIT_ASSERT(yuvMixer->configure(mixWidth, mixHeight, 0, YUV420P));
+    CPPUNIT_ASSERT(yuvMixer->configChannel(1, 0.5, 0.5, 0, 0, 1, true, 1));
+    CPPUNIT_ASSERT(yuvMixer->addStaticLayer("plate", "staticLayersTestBackground.png", 1, 1, 0, 0));
+    CPPUNIT_ASSERT(yuvMixer->addStaticLayer("logo", "staticLayersTestOverlay.png", 0.5, 0.5, 0.25, 0.25, 0, true));
+
+    frame = InterleavedVideoFrame::createNew(RAW, mixWidth/2, mixHeight/2, YUV420P);
+    CPPUNIT_ASSERT(frame);
+    frame->setLength(frame->getPlanes(data, linesize));
+
+    for (unsigned p = 0; VideoFrame::planeSize(YUV420P, mixWidth/2, mixHeight/2, p, lineBytes, rows); p++) {
+        memset(data[p], p == 0 ? 200 : 60, linesize[p]*rows);
+    }
+
+    //NOTE: the second frame only repaints channel 1, the overlay must be composited once again over it
+    for (int f = 0; f < 2; f++) {
+        if (f == 0) {
+            yuvScenario->processFrame(frame);
+        } else {
+            yuvScenario->processFrame(frame, 1);
+        }
+
+        mixedFrame = yuvScenario->extractFrame();
+        CPPUNIT_ASSERT(mixedFrame);
+        CPPUNIT_ASSERT(mixedFrame->getPlanes(data, linesize) > 0);
+
+        VideoFrame::planeSize(YUV420P, mixWidth, mixHeight, 0, lineBytes, rows);
+        VideoFrame::planeSize(YUV420P, mixWidth, mixHeight, 1, chromaBytes, chromaRows);
+        CPPUNIT_ASSERT(data[0][(rows/8)*linesize[0] + lineBytes/8] == 200);
+        CPPUNIT_ASSERT(data[1][(chromaRows/8)*linesize[1] + chromaBytes/8] == 60);
+        CPPUNIT_ASSERT(std::abs(data[0][(7*rows/8)*linesize[0] + 7*lineBytes/8] - 235) <= 1);
+        CPPUNIT_ASSERT(std::abs(data[1][(7*chromaRows/8)*linesize[1] + 7*chromaBytes/8] - 128) <= 1);
+        CPPUNIT_ASSERT(std::abs(data[0][(3*rows/8)*linesize[0] + 3*lineBytes/8] - 163) <= 2);
+        CPPUNIT_ASSERT(std::abs(data[1][(3*chromaRows/8)*linesize[1] + 3*chromaBytes/8] - 94) <= 2);
+        CPPUNIT_ASSERT(std::abs(data[0][(5*rows/8)*linesize[0] + 5*lineBytes/8] - 181) <= 2);
+    }
+
+    CPPUNIT_ASSERT(yuvMixer->removeStaticLayer("plate"));
+    CPPUNIT_ASSERT(yuvMixer->removeStaticLayer("logo"));
+    yuvScenario->processFrame(frame);
+    mixedFrame = yuvScenario->extractFrame();
+    CPPUNIT_ASSERT(mixedFrame);
+    CPPUNIT_ASSERT(mixedFrame->getPlanes(data, linesize) > 0);
+    CPPUNIT_ASSERT(data[0][(3*rows/8)*linesize[0] + 3*lineBytes/8] == 200);
+    CPPUNIT_ASSERT(data[0][(7*rows/8)*linesize[0] + 7*lineBytes/8] == 16);
+
+    delete yuvScenario;
+    delete yuvMixer;
+    delete frame;
+
+    std::remove("staticLayersTestBackground.png");
+    std::remove("staticLayersTestOverlay.png");
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(VideoMixerFunctionalTest);
 
 int main(int argc, char* argv[])
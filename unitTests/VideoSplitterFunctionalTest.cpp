@@ -18,6 +18,7 @@
  *  Authors:  Alejandro Jiménez <alejandro.jimenez@i2cat.net>
  */
 #include <string>
+#include <vector>
 #include <iostream>
 #include <chrono>
 
@@ -35,6 +36,7 @@ class VideoSplitterFunctionalTest : public CppUnit::TestFixture {
 	
 	CPPUNIT_TEST_SUITE(VideoSplitterFunctionalTest);
 	CPPUNIT_TEST(splittingTest);
+	CPPUNIT_TEST(rotationTest);
 	CPPUNIT_TEST_SUITE_END();
 	
 	public:
@@ -43,6 +45,7 @@ class VideoSplitterFunctionalTest : public CppUnit::TestFixture {
 	
 	protected:
 		void splittingTest();
+		void rotationTest();
 
 		OneToManyVideoScenarioMockup *splitterScenario;
 		VideoSplitter* splitter;
@@ -104,6 +107,38 @@ void VideoSplitterFunctionalTest::splittingTest()
 
 }
 
+void VideoSplitterFunctionalTest::rotationTest()
+{
+	InterleavedVideoFrame *frame = NULL;
+	InterleavedVideoFrame *rotated = NULL;
+	std::vector<unsigned char> org;
+	int orgWidth = 400;
+
+	//NOTE: a 100x50 crop rotated clockwise gives a 50x100 picture, out(r, c) = crop(49 - c, r)
+	CPPUNIT_ASSERT(splitter->configCrop(1,100,50,20,10,90));
+
+	CPPUNIT_ASSERT(reader->openFile("testsData/videoSplitterFunctionalTestInputImage.rgb", RAW, RGB24, 400, 400));
+	frame = reader->getFrame();
+	CPPUNIT_ASSERT(frame);
+	org.assign(frame->getDataBuf(), frame->getDataBuf() + frame->getLength());
+	splitterScenario->processFrame(frame);
+	reader->close();
+
+	rotated = splitterScenario->extractFrame(1);
+	CPPUNIT_ASSERT(rotated);
+	CPPUNIT_ASSERT(rotated->getWidth() == 50);
+	CPPUNIT_ASSERT(rotated->getHeight() == 100);
+	CPPUNIT_ASSERT(rotated->getLength() == 50*100*3);
+
+	for (int r = 0; r < 100; r++) {
+		for (int c = 0; c < 50; c++) {
+			unsigned char *out = rotated->getDataBuf() + (r*50 + c)*3;
+			unsigned char *in = org.data() + ((10 + 49 - c)*orgWidth + 20 + r)*3;
+			CPPUNIT_ASSERT(memcmp(out, in, 3) == 0);
+		}
+	}
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(VideoSplitterFunctionalTest);
 
 int main(int argc, char* argv[])
@@ -25,6 +25,9 @@
 #include <fstream>
 #include <chrono>
 #include <thread>
+#include <set>
+#include <mutex>
+#include <atomic>
 #include <cppunit/extensions/TestFactoryRegistry.h>
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/ui/text/TextTestRunner.h>
@@ -35,10 +38,53 @@
 #include "WorkersPool.hh"
 #include "RunnableMockup.hh"
 
+class HandOffRunnableMockup : public Runnable {
+public:
+    HandOffRunnableMockup(HandOffRunnableMockup *producer_ = NULL) : Runnable(producer_ == NULL), 
+        producer(producer_), runs(0), sameThread(0) {};
+    
+    std::atomic<unsigned> runs;
+    std::atomic<unsigned> sameThread;
+
+protected:
+    void processFrame(int& ret, std::vector<int> &jobs) {
+        std::lock_guard<std::mutex> guard(threadMtx);
+        
+        runs++;
+        lastThread = std::this_thread::get_id();
+        
+        if (producer){
+            std::lock_guard<std::mutex> pGuard(producer->threadMtx);
+            sameThread += producer->lastThread == lastThread;
+            ret = 0;
+            return;
+        }
+        
+        jobs.push_back(getId() + 1);
+        jobs.push_back(getId());
+        ret = 1000;
+    };
+    
+    bool pendingJobs() {return false;};
+
+private:
+    HandOffRunnableMockup *producer;
+    std::thread::id lastThread;
+    std::mutex threadMtx;
+};
+
 class WorkersPoolTest : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(WorkersPoolTest);
     CPPUNIT_TEST(addAndRemoveTask);
+    CPPUNIT_TEST(workStealingAddAndRemoveTask);
+    CPPUNIT_TEST(taskQueueTimers);
+    CPPUNIT_TEST(pinnedWorkers);
+    CPPUNIT_TEST(priorityClasses);
+    CPPUNIT_TEST(dedicatedTask);
+    CPPUNIT_TEST(elasticPool);
+    CPPUNIT_TEST(parallelFor);
+    CPPUNIT_TEST(handOff);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -47,6 +93,14 @@ public:
 
 protected:
     void addAndRemoveTask();
+    void workStealingAddAndRemoveTask();
+    void taskQueueTimers();
+    void pinnedWorkers();
+    void priorityClasses();
+    void dedicatedTask();
+    void elasticPool();
+    void parallelFor();
+    void handOff();
 
 private:
     WorkersPool* pool;
@@ -88,6 +142,280 @@ void WorkersPoolTest::addAndRemoveTask()
     delete notPeriodicR;
 }
 
+void WorkersPoolTest::workStealingAddAndRemoveTask()
+{
+    WorkersPool* wsPool = new WorkersPool(4, WORK_STEALING);
+    std::vector<int> periodic(1,2);
+    std::vector<int> notPeriodic(1,1);
+    Runnable* periodicR = new RunnableMockup(40000, periodic, true);
+    Runnable* notPeriodicR = new RunnableMockup(40000, notPeriodic, false);
+    periodicR->setId(1);
+    notPeriodicR->setId(2);
+    
+    CPPUNIT_ASSERT(wsPool->getMode() == WORK_STEALING);
+    CPPUNIT_ASSERT(wsPool->addTask(periodicR));
+    CPPUNIT_ASSERT(!wsPool->addTask(periodicR));
+    CPPUNIT_ASSERT(wsPool->addTask(notPeriodicR));
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    
+    CPPUNIT_ASSERT(wsPool->removeTask(1));
+    CPPUNIT_ASSERT(wsPool->removeTask(2));
+    CPPUNIT_ASSERT(!periodicR->isRunning());
+    CPPUNIT_ASSERT(!notPeriodicR->isRunning());
+    CPPUNIT_ASSERT(!wsPool->removeTask(1));
+    CPPUNIT_ASSERT(!wsPool->removeTask(2));
+    
+    delete wsPool;
+    
+    delete periodicR;
+    delete notPeriodicR;
+}
+
+void WorkersPoolTest::taskQueueTimers()
+{
+    TaskQueue queue;
+    std::chrono::system_clock::time_point deadline;
+    Runnable* early = new TimedRunnableMockup(20000);
+    Runnable* late = new TimedRunnableMockup(40000);
+    early->setId(1);
+    late->setId(2);
+    
+    late->runProcessFrame();
+    early->runProcessFrame();
+    
+    CPPUNIT_ASSERT(queue.pushBack(late));
+    CPPUNIT_ASSERT(queue.pushBack(early));
+    CPPUNIT_ASSERT(!queue.pushBack(early));
+    CPPUNIT_ASSERT(!queue.current());
+    CPPUNIT_ASSERT(queue.nextDeadline(deadline));
+    CPPUNIT_ASSERT(deadline == early->getTime());
+    
+    std::this_thread::sleep_until(deadline + std::chrono::milliseconds(1));
+    queue.expireTimers();
+    CPPUNIT_ASSERT(queue.current() == early);
+    CPPUNIT_ASSERT(queue.nextDeadline(deadline));
+    CPPUNIT_ASSERT(deadline == late->getTime());
+    
+    queue.pop();
+    CPPUNIT_ASSERT(!queue.current());
+    queue.remove(late);
+    CPPUNIT_ASSERT(!queue.nextDeadline(deadline));
+    
+    delete early;
+    delete late;
+}
+
+void WorkersPoolTest::pinnedWorkers()
+{
+    WorkersPool* wsPool = new WorkersPool(2, WORK_STEALING);
+    Runnable* affineR = new TimedRunnableMockup(1000);
+    Runnable* sharedR = new TimedRunnableMockup(1000);
+    std::chrono::system_clock::time_point start;
+    affineR->setId(1);
+    sharedR->setId(1);
+    affineR->setAffinity(0);
+    
+    CPPUNIT_ASSERT(!pool->isPinned());
+    CPPUNIT_ASSERT(pool->pinWorkers(true));
+    CPPUNIT_ASSERT(pool->isPinned());
+    CPPUNIT_ASSERT(wsPool->pinWorkers(true));
+    
+    start = std::chrono::system_clock::now();
+    CPPUNIT_ASSERT(pool->addTask(affineR));
+    CPPUNIT_ASSERT(wsPool->addTask(sharedR));
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    CPPUNIT_ASSERT(pool->removeTask(1));
+    CPPUNIT_ASSERT(wsPool->removeTask(1));
+    CPPUNIT_ASSERT(affineR->getTime() > start);
+    CPPUNIT_ASSERT(sharedR->getTime() > start);
+    
+    CPPUNIT_ASSERT(pool->pinWorkers(false));
+    CPPUNIT_ASSERT(!pool->isPinned());
+    
+    delete wsPool;
+    
+    delete affineR;
+    delete sharedR;
+}
+
+void WorkersPoolTest::priorityClasses()
+{
+    for (SchedulingMode mode : {SHARED_QUEUE, WORK_STEALING}){
+        WorkersPool* prioPool = new WorkersPool(2, mode);
+        Runnable* highR = new TimedRunnableMockup(1000);
+        Runnable* normalR = new TimedRunnableMockup(1000);
+        std::chrono::system_clock::time_point start;
+        highR->setId(1);
+        normalR->setId(2);
+        
+        CPPUNIT_ASSERT(normalR->getPriority() == NORMAL_PRIORITY);
+        CPPUNIT_ASSERT(!highR->setPriority(RP_NONE));
+        CPPUNIT_ASSERT(highR->setPriority(HIGH_PRIORITY));
+        CPPUNIT_ASSERT(highR->getPriority() == HIGH_PRIORITY);
+        
+        CPPUNIT_ASSERT(!prioPool->reserveWorkers(2));
+        CPPUNIT_ASSERT(prioPool->reserveWorkers(1));
+        CPPUNIT_ASSERT(prioPool->getReservedWorkers() == 1);
+        
+        start = std::chrono::system_clock::now();
+        CPPUNIT_ASSERT(prioPool->addTask(highR));
+        CPPUNIT_ASSERT(prioPool->addTask(normalR));
+        
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        
+        CPPUNIT_ASSERT(prioPool->removeTask(1));
+        CPPUNIT_ASSERT(prioPool->removeTask(2));
+        CPPUNIT_ASSERT(highR->getTime() > start);
+        CPPUNIT_ASSERT(normalR->getTime() > start);
+        
+        delete prioPool;
+        
+        delete highR;
+        delete normalR;
+    }
+}
+
+void WorkersPoolTest::dedicatedTask()
+{
+    for (SchedulingMode mode : {SHARED_QUEUE, WORK_STEALING}){
+        WorkersPool* dPool = new WorkersPool(2, mode);
+        Runnable* dedicatedR = new TimedRunnableMockup(1000);
+        std::chrono::system_clock::time_point start;
+        dedicatedR->setId(1);
+        dedicatedR->setDedicated(true);
+        
+        start = std::chrono::system_clock::now();
+        CPPUNIT_ASSERT(dPool->addTask(dedicatedR));
+        CPPUNIT_ASSERT(!dPool->addTask(dedicatedR));
+        
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        CPPUNIT_ASSERT(dedicatedR->getTime() > start);
+        
+        CPPUNIT_ASSERT(dPool->setDedicated(dedicatedR, false));
+        CPPUNIT_ASSERT(!dedicatedR->isDedicated());
+        CPPUNIT_ASSERT(!dPool->addTask(dedicatedR));
+        CPPUNIT_ASSERT(dPool->setDedicated(dedicatedR, true));
+        
+        CPPUNIT_ASSERT(dPool->removeTask(1));
+        CPPUNIT_ASSERT(!dedicatedR->isRunning());
+        CPPUNIT_ASSERT(!dPool->removeTask(1));
+        
+        delete dPool;
+        
+        delete dedicatedR;
+    }
+}
+
+void WorkersPoolTest::elasticPool()
+{
+    WorkersPool* ePool = new WorkersPool(1);
+    WorkersPool* wsPool = new WorkersPool(1, WORK_STEALING);
+    std::vector<Runnable*> busyR;
+    
+    CPPUNIT_ASSERT(!wsPool->setElastic(1, 3));
+    CPPUNIT_ASSERT(!ePool->setElastic(0, 3));
+    CPPUNIT_ASSERT(!ePool->setElastic(3, 1));
+    CPPUNIT_ASSERT(ePool->setElastic(1, 3));
+    CPPUNIT_ASSERT(ePool->getMinWorkers() == 1);
+    CPPUNIT_ASSERT(ePool->getMaxWorkers() == 3);
+    CPPUNIT_ASSERT(ePool->getActiveWorkers() == 1);
+    
+    for (int id = 1; id <= 3; id++){
+        busyR.push_back(new RunnableMockup(20000, std::vector<int>(1, id), false));
+        busyR.back()->setId(id);
+        CPPUNIT_ASSERT(ePool->addTask(busyR.back()));
+    }
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    CPPUNIT_ASSERT(ePool->getActiveWorkers() == 3);
+    CPPUNIT_ASSERT(ePool->getUtilisation() > 0);
+    
+    for (int id = 1; id <= 3; id++){
+        CPPUNIT_ASSERT(ePool->removeTask(id));
+    }
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(ELASTIC_IDLE + 200));
+    CPPUNIT_ASSERT(ePool->getActiveWorkers() == 1);
+    
+    delete ePool;
+    delete wsPool;
+    
+    for (auto r : busyR){
+        delete r;
+    }
+}
+
+void WorkersPoolTest::parallelFor()
+{
+    WorkersPool* wsPool = new WorkersPool(4, WORK_STEALING);
+    std::vector<std::atomic<int>> counts(64);
+    std::set<std::thread::id> threads;
+    std::mutex mtx;
+    
+    auto item = [&](unsigned i){
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        counts[i]++;
+        std::lock_guard<std::mutex> guard(mtx);
+        threads.insert(std::this_thread::get_id());
+    };
+    
+    for (auto &c : counts){
+        c = 0;
+    }
+    
+    CPPUNIT_ASSERT(WorkersPool::current() == NULL);
+    
+    pool->parallelFor(counts.size(), item);
+    for (auto &c : counts){
+        CPPUNIT_ASSERT(c == 1);
+    }
+    CPPUNIT_ASSERT(threads.size() > 1);
+    CPPUNIT_ASSERT(threads.count(std::this_thread::get_id()) > 0);
+    
+    threads.clear();
+    wsPool->parallelFor(counts.size(), item);
+    for (auto &c : counts){
+        CPPUNIT_ASSERT(c == 2);
+    }
+    CPPUNIT_ASSERT(threads.size() == 1);
+    
+    delete wsPool;
+}
+
+void WorkersPoolTest::handOff()
+{
+    for (SchedulingMode mode : {SHARED_QUEUE, WORK_STEALING}){
+        WorkersPool* hPool = new WorkersPool(4, mode);
+        HandOffRunnableMockup* producer = new HandOffRunnableMockup();
+        HandOffRunnableMockup* consumer = new HandOffRunnableMockup(producer);
+        producer->setId(1);
+        consumer->setId(2);
+        
+        CPPUNIT_ASSERT(!hPool->getHandOff());
+        hPool->setHandOff(true);
+        CPPUNIT_ASSERT(hPool->addTask(producer));
+        CPPUNIT_ASSERT(hPool->addTask(consumer));
+        
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        
+        CPPUNIT_ASSERT(hPool->removeTask(1));
+        CPPUNIT_ASSERT(hPool->removeTask(2));
+        
+        //NOTE: the consumer runs on the worker that has just run the producer
+        CPPUNIT_ASSERT(consumer->runs > 10);
+        CPPUNIT_ASSERT(hPool->getHandOffs() > 0);
+        CPPUNIT_ASSERT(consumer->sameThread >= consumer->runs*9/10);
+        
+        delete hPool;
+        
+        delete producer;
+        delete consumer;
+    }
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(WorkersPoolTest);
 
 int main(int argc, char* argv[])
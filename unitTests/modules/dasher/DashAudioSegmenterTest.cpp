@@ -33,6 +33,7 @@
 #include "modules/dasher/DashAudioSegmenter.hh"
 
 #define SEG_DURATION 2
+#define MODEL_MAX_LENGTH 10*1024*1024
 #define BASE_NAME "testsData/modules/dasher/dashAudioSegmenterTest/test"
 #define CHANNELS 2
 #define SAMPLE_RATE 48000
@@ -111,7 +112,7 @@ void DashAudioSegmenterTest::manageFrame()
 
 void DashAudioSegmenterTest::generateInitSegment()
 {
-    char* initModel = new char[MAX_DAT];
+    char* initModel = new char[MODEL_MAX_LENGTH];
     size_t initModelLength;
     DashSegment* initSegment = new DashSegment();
     std::chrono::microseconds ts = std::chrono::microseconds(1000);
@@ -152,7 +153,7 @@ void DashAudioSegmenterTest::generateSegment()
 {
     std::string segName;
     size_t segmentModelLength;
-    char* segmentModel = new char[MAX_DAT];
+    char* segmentModel = new char[MODEL_MAX_LENGTH];
     DashSegment* segment = new DashSegment();
 
     Frame* frame;
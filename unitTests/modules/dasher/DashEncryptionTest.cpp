@@ -0,0 +1,543 @@
+/*
+ *  DashEncryptionTest.cpp - Common Encryption of the DASH segments test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:    Marc Palau <marc.palau@i2cat.net>
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <openssl/evp.h>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "Utils.hh"
+
+extern "C" {
+    #include "modules/dasher/i2libdash.h"
+    #include "modules/dasher/i2libcenc.h"
+}
+
+#define TIME_BASE 90000
+#define FRAME_DURATION 3600
+#define SEGMENT_FRAMES 3
+#define OUTPUT_LENGTH 1024*1024
+
+typedef std::vector<unsigned char> Bytes;
+
+struct Box {
+    size_t pos;                     //!< Position of the payload, after the header
+    size_t size;                    //!< Payload size
+};
+
+static uint32_t readU32(const unsigned char* p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+//NOTE: boxes are looked for among the children of the payload from pos to pos + size
+static bool findBox(const Bytes &data, size_t pos, size_t size, const char* type, Box &box)
+{
+    size_t end = pos + size;
+
+    while (pos + 8 <= end) {
+        uint32_t boxSize = readU32(&data[pos]);
+
+        if (boxSize < 8 || pos + boxSize > end) {
+            return false;
+        }
+
+        if (memcmp(&data[pos + 4], type, 4) == 0) {
+            box.pos = pos + 8;
+            box.size = boxSize - 8;
+            return true;
+        }
+
+        pos += boxSize;
+    }
+
+    return false;
+}
+
+static bool contains(const Bytes &data, const void* value, size_t length)
+{
+    for (size_t i = 0; i + length <= data.size(); i++) {
+        if (memcmp(&data[i], value, length) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*! One encrypted fragment parsed from a segment */
+struct Fragment {
+    Bytes mdat;
+    std::vector<Bytes> ivs;
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> subsamples;
+    Bytes kid;                      //!< From the seig sample group, empty without key rotation
+    bool mdatOffsetOk;
+    bool auxOffsetOk;
+};
+
+static bool parseFragment(const Bytes &segment, unsigned ivSize, Fragment &frag)
+{
+    Box moof, mdat, traf, trun, senc, saio, sgpd;
+    size_t pos, moofStart;
+    uint32_t flags, count;
+
+    if (!findBox(segment, 0, segment.size(), "moof", moof) || !findBox(segment, 0, segment.size(), "mdat", mdat) ||
+        !findBox(segment, moof.pos, moof.size, "traf", traf) || !findBox(segment, traf.pos, traf.size, "trun", trun)) {
+        return false;
+    }
+
+    moofStart = moof.pos - 8;
+    frag.mdat.assign(segment.begin() + mdat.pos, segment.begin() + mdat.pos + mdat.size);
+    frag.mdatOffsetOk = moofStart + readU32(&segment[trun.pos + 8]) == mdat.pos;
+    frag.auxOffsetOk = true;
+
+    if (findBox(segment, traf.pos, traf.size, "sgpd", sgpd)) {
+        frag.kid.assign(segment.begin() + sgpd.pos + 20, segment.begin() + sgpd.pos + 36);
+    }
+
+    if (!findBox(segment, traf.pos, traf.size, "senc", senc)) {
+        return true;
+    }
+
+    if (!findBox(segment, traf.pos, traf.size, "saio", saio) ||
+        moofStart + readU32(&segment[saio.pos + 8]) != senc.pos + 8) {
+        frag.auxOffsetOk = false;
+    }
+
+    flags = readU32(&segment[senc.pos]) & 0xFFFFFF;
+    count = readU32(&segment[senc.pos + 4]);
+    pos = senc.pos + 8;
+
+    for (uint32_t i = 0; i < count; i++) {
+        std::vector<std::pair<uint32_t, uint32_t>> entries;
+
+        frag.ivs.push_back(Bytes(segment.begin() + pos, segment.begin() + pos + ivSize));
+        pos += ivSize;
+
+        if (flags & 0x2) {
+            unsigned entriesCount = (segment[pos] << 8) | segment[pos + 1];
+            pos += 2;
+
+            for (unsigned e = 0; e < entriesCount; e++) {
+                entries.push_back(std::make_pair((segment[pos] << 8) | segment[pos + 1], readU32(&segment[pos + 2])));
+                pos += 6;
+            }
+        }
+
+        frag.subsamples.push_back(entries);
+    }
+
+    return pos == senc.pos + senc.size;
+}
+
+//NOTE: CTR decryption is the same as encryption, the keystream of a sample goes on through its protected ranges
+static void decryptCenc(const unsigned char* key, Fragment &frag, const std::vector<uint32_t> &sizes)
+{
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    unsigned char iv[16];
+    size_t pos = 0;
+    int len;
+
+    EVP_EncryptInit_ex(ctx, EVP_aes_128_ctr(), NULL, key, NULL);
+
+    for (size_t i = 0; i < sizes.size(); i++) {
+        memset(iv, 0, sizeof(iv));
+        memcpy(iv, &frag.ivs[i][0], 8);
+        EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv);
+
+        if (frag.subsamples[i].empty()) {
+            EVP_EncryptUpdate(ctx, &frag.mdat[pos], &len, &frag.mdat[pos], sizes[i]);
+        }
+
+        size_t offset = pos;
+        for (auto &s : frag.subsamples[i]) {
+            offset += s.first;
+            EVP_EncryptUpdate(ctx, &frag.mdat[offset], &len, &frag.mdat[offset], s.second);
+            offset += s.second;
+        }
+
+        pos += sizes[i];
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+static void decryptCbcs(const unsigned char* key, const unsigned char* iv, Fragment &frag, const std::vector<uint32_t> &sizes)
+{
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    size_t pos = 0;
+    int len;
+
+    EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, key, iv);
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+
+    for (size_t i = 0; i < sizes.size(); i++) {
+        size_t offset = pos;
+
+        for (auto &s : frag.subsamples[i]) {
+            offset += s.first;
+            EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv);
+
+            //NOTE: 1:9 pattern, the partial block at the end is clear
+            for (size_t b = 0; (b + 1) * 16 <= s.second; b += 10) {
+                EVP_DecryptUpdate(ctx, &frag.mdat[offset + b*16], &len, &frag.mdat[offset + b*16], 16);
+            }
+
+            offset += s.second;
+        }
+
+        pos += sizes[i];
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+class DashEncryptionTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(DashEncryptionTest);
+    CPPUNIT_TEST(invalidKeys);
+    CPPUNIT_TEST(initSegment);
+    CPPUNIT_TEST(cencVideoSegment);
+    CPPUNIT_TEST(cbcsVideoSegment);
+    CPPUNIT_TEST(keyRotation);
+    CPPUNIT_TEST(cencAudioSegment);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void invalidKeys();
+    void initSegment();
+    void cencVideoSegment();
+    void cbcsVideoSegment();
+    void keyRotation();
+    void cencAudioSegment();
+
+    Bytes makeSample(unsigned index, bool intra);
+    Bytes generateVideoSegment(unsigned firstFrame, unsigned seqNumber, Bytes &clear, std::vector<uint32_t> &sizes);
+
+    i2ctx* context;
+    unsigned char kids[2][16];
+    unsigned char keys[2][16];
+};
+
+void DashEncryptionTest::setUp()
+{
+    context = NULL;
+
+    for (unsigned k = 0; k < 2; k++) {
+        for (unsigned i = 0; i < 16; i++) {
+            kids[k][i] = 0x10 * (k + 1) + i;
+            keys[k][i] = 0xA0 + 0x10 * k + i;
+        }
+    }
+}
+
+void DashEncryptionTest::tearDown()
+{
+    free_context(&context);
+}
+
+//NOTE: an AUD, an SEI and a slice, the slice length is not a multiple of the AES block size
+Bytes DashEncryptionTest::makeSample(unsigned index, bool intra)
+{
+    Bytes sample;
+    unsigned sliceSize = 300 + 7*index;
+    unsigned char aud[] = {0, 0, 0, 2, 0x09, 0xF0};
+    unsigned char sei[] = {0, 0, 0, 6, 0x06, 0x05, 0x02, 0x11, 0x22, 0x80};
+
+    sample.insert(sample.end(), aud, aud + sizeof(aud));
+    sample.insert(sample.end(), sei, sei + sizeof(sei));
+    sample.push_back(0);
+    sample.push_back(0);
+    sample.push_back(sliceSize >> 8);
+    sample.push_back(sliceSize & 0xFF);
+    sample.push_back(intra ? 0x65 : 0x41);
+
+    for (unsigned i = 1; i < sliceSize; i++) {
+        sample.push_back((i * 31 + index) & 0xFF);
+    }
+
+    return sample;
+}
+
+Bytes DashEncryptionTest::generateVideoSegment(unsigned firstFrame, unsigned seqNumber, Bytes &clear, std::vector<uint32_t> &sizes)
+{
+    Bytes output(OUTPUT_LENGTH);
+    uint64_t segTimestamp;
+    uint32_t segDuration;
+    uint32_t length;
+
+    clear.clear();
+    sizes.clear();
+
+    for (unsigned i = firstFrame; i < firstFrame + SEGMENT_FRAMES; i++) {
+        Bytes sample = makeSample(i, i == firstFrame);
+        uint64_t ts = i * FRAME_DURATION;
+
+        if (add_video_sample(&sample[0], sample.size(), ts, ts, seqNumber, i == firstFrame, &context) != I2OK) {
+            return Bytes();
+        }
+
+        clear.insert(clear.end(), sample.begin(), sample.end());
+        sizes.push_back(sample.size());
+    }
+
+    length = generate_video_segment(TRUE, (firstFrame + SEGMENT_FRAMES) * FRAME_DURATION, &output[0],
+                                    &context, &segTimestamp, &segDuration);
+
+    if (length <= I2ERROR_MAX) {
+        return Bytes();
+    }
+
+    output.resize(length);
+    return output;
+}
+
+static void setupVideo(i2ctx** context)
+{
+    generate_context(context, VIDEO_TYPE_AVC);
+    fill_video_context(context, 640, 360, TIME_BASE);
+    set_segment_duration(SEGMENT_FRAMES * FRAME_DURATION, context);
+}
+
+void DashEncryptionTest::invalidKeys()
+{
+    unsigned char pssh[] = {0, 0, 0, 12, 'm', 'o', 'o', 'v', 0, 0, 0, 0};
+    uint8_t badScheme, badLength, badPssh, none;
+    bool disabled;
+
+    setupVideo(&context);
+
+    badScheme = set_encryption(7, kids[0], keys[0], 1, 0, NULL, 0, &context);
+    badLength = set_encryption(CENC_SCHEME_CENC, kids[0], keys[0], CENC_MAX_KEYS + 1, 0, NULL, 0, &context);
+    badPssh = set_encryption(CENC_SCHEME_CENC, kids[0], keys[0], 1, 0, pssh, sizeof(pssh), &context);
+    set_encryption(CENC_SCHEME_CENC, kids[0], keys[0], 1, 0, NULL, 0, &context);
+    none = set_encryption(CENC_SCHEME_NONE, NULL, NULL, 0, 0, NULL, 0, &context);
+    disabled = context->ctxcrypto == NULL;
+
+    CPPUNIT_ASSERT(badScheme != I2OK);
+    CPPUNIT_ASSERT(badLength != I2OK);
+    CPPUNIT_ASSERT(badPssh != I2OK);
+    CPPUNIT_ASSERT(none == I2OK);
+    CPPUNIT_ASSERT(disabled);
+}
+
+void DashEncryptionTest::initSegment()
+{
+    unsigned char avcc[] = {0x01, 0x42, 0xC0, 0x1E, 0xFF, 0xE1, 0x00, 0x04, 0x67, 0x42, 0xC0, 0x1E,
+                            0x01, 0x00, 0x04, 0x68, 0xCE, 0x3C, 0x80};
+    unsigned char pssh[] = {0, 0, 0, 32, 'p', 's', 's', 'h', 0, 0, 0, 0, 0xED, 0xEF, 0x8B, 0xA9, 0x79, 0xD6,
+                            0x4A, 0xCE, 0xA3, 0xC8, 0x27, 0xDC, 0xD5, 0x1D, 0x21, 0xED, 0, 0, 0, 0};
+    Bytes output(OUTPUT_LENGTH);
+    Box moov, trak, stsd, moovPssh;
+    uint8_t i2error;
+    uint32_t length;
+    bool encv, frma, tenc, kid, commonPssh, extraPssh, stsdFound;
+
+    setupVideo(&context);
+    i2error = set_encryption(CENC_SCHEME_CENC, &kids[0][0], &keys[0][0], 2, 1, pssh, sizeof(pssh), &context);
+    CPPUNIT_ASSERT(i2error == I2OK);
+    CPPUNIT_ASSERT(get_init_encryption_size(context) >= 97 + 36 + 32 + sizeof(pssh));
+
+    length = new_init_video_handler(avcc, sizeof(avcc), &output[0], &context);
+    CPPUNIT_ASSERT(length > I2ERROR_MAX);
+    output.resize(length);
+
+    stsdFound = findBox(output, 0, output.size(), "moov", moov) && findBox(output, moov.pos, moov.size, "trak", trak) &&
+                contains(output, "stsd", 4);
+    encv = contains(output, "encv", 4) && !contains(output, "\0\0\0\0avc1", 8);
+    frma = contains(output, "frmaavc1", 8);
+    tenc = contains(output, "schm\0\0\0\0cenc\0\x01\0\0", 16) && contains(output, "tenc", 4);
+    kid = contains(output, kids[0], 16) && contains(output, kids[1], 16);
+    commonPssh = findBox(output, moov.pos, moov.size, "pssh", moovPssh) && readU32(&output[moovPssh.pos + 20]) == 2;
+    extraPssh = contains(output, pssh + 12, 16);
+
+    CPPUNIT_ASSERT(stsdFound);
+    CPPUNIT_ASSERT(encv);
+    CPPUNIT_ASSERT(frma);
+    CPPUNIT_ASSERT(tenc);
+    CPPUNIT_ASSERT(kid);
+    CPPUNIT_ASSERT(commonPssh);
+    CPPUNIT_ASSERT(extraPssh);
+    (void) stsd;
+}
+
+void DashEncryptionTest::cencVideoSegment()
+{
+    Bytes clear, segment;
+    std::vector<uint32_t> sizes;
+    Fragment frag;
+    bool parsed, headersClear, encrypted, aligned;
+
+    setupVideo(&context);
+    CPPUNIT_ASSERT(set_encryption(CENC_SCHEME_CENC, kids[0], keys[0], 1, 0, NULL, 0, &context) == I2OK);
+
+    segment = generateVideoSegment(0, 0, clear, sizes);
+    CPPUNIT_ASSERT(!segment.empty());
+
+    parsed = parseFragment(segment, 8, frag);
+    CPPUNIT_ASSERT(parsed);
+    CPPUNIT_ASSERT(frag.mdatOffsetOk);
+    CPPUNIT_ASSERT(frag.auxOffsetOk);
+    CPPUNIT_ASSERT(frag.ivs.size() == SEGMENT_FRAMES);
+    CPPUNIT_ASSERT(frag.mdat.size() == clear.size());
+
+    //NOTE: AUD and SEI are merged with the slice header as a single clear range, protected bytes are whole blocks
+    headersClear = frag.subsamples[0].size() == 1 && frag.subsamples[0][0].first >= 6 + 10 + 5 &&
+                   memcmp(&frag.mdat[0], &clear[0], frag.subsamples[0][0].first) == 0;
+    aligned = frag.subsamples[0][0].second % 16 == 0 && frag.subsamples[0][0].first + frag.subsamples[0][0].second == sizes[0];
+    encrypted = frag.mdat != clear;
+    CPPUNIT_ASSERT(headersClear);
+    CPPUNIT_ASSERT(aligned);
+    CPPUNIT_ASSERT(encrypted);
+    CPPUNIT_ASSERT(frag.ivs[0] != frag.ivs[1]);
+
+    decryptCenc(keys[0], frag, sizes);
+    CPPUNIT_ASSERT(frag.mdat == clear);
+}
+
+void DashEncryptionTest::cbcsVideoSegment()
+{
+    Bytes clear, segment;
+    std::vector<uint32_t> sizes;
+    Fragment frag;
+    bool parsed, sliceHeaderClear, encrypted;
+
+    setupVideo(&context);
+    CPPUNIT_ASSERT(set_encryption(CENC_SCHEME_CBCS, kids[0], keys[0], 1, 0, NULL, 0, &context) == I2OK);
+
+    segment = generateVideoSegment(0, 0, clear, sizes);
+    CPPUNIT_ASSERT(!segment.empty());
+
+    parsed = parseFragment(segment, 0, frag);
+    CPPUNIT_ASSERT(parsed);
+    CPPUNIT_ASSERT(frag.mdatOffsetOk);
+    CPPUNIT_ASSERT(frag.auxOffsetOk);
+    CPPUNIT_ASSERT(frag.subsamples.size() == SEGMENT_FRAMES);
+
+    sliceHeaderClear = frag.subsamples[0].size() == 1 && frag.subsamples[0][0].first == 6 + 10 + 4 + CBCS_CLEAR_NAL;
+    encrypted = frag.mdat != clear;
+    CPPUNIT_ASSERT(sliceHeaderClear);
+    CPPUNIT_ASSERT(encrypted);
+
+    decryptCbcs(keys[0], context->ctxcrypto->constant_iv, frag, sizes);
+    CPPUNIT_ASSERT(frag.mdat == clear);
+}
+
+void DashEncryptionTest::keyRotation()
+{
+    Bytes clear, segment;
+    std::vector<uint32_t> sizes;
+    Fragment first, second;
+    bool firstParsed, secondParsed;
+
+    setupVideo(&context);
+    CPPUNIT_ASSERT(set_encryption(CENC_SCHEME_CENC, &kids[0][0], &keys[0][0], 2, 1, NULL, 0, &context) == I2OK);
+
+    segment = generateVideoSegment(0, 2, clear, sizes);
+    firstParsed = parseFragment(segment, 8, first);
+    CPPUNIT_ASSERT(firstParsed);
+    CPPUNIT_ASSERT(first.mdatOffsetOk);
+    CPPUNIT_ASSERT(first.auxOffsetOk);
+    CPPUNIT_ASSERT(first.kid == Bytes(kids[0], kids[0] + 16));
+    decryptCenc(keys[0], first, sizes);
+    CPPUNIT_ASSERT(first.mdat == clear);
+
+    segment = generateVideoSegment(SEGMENT_FRAMES + 1, 3, clear, sizes);
+    secondParsed = parseFragment(segment, 8, second);
+    CPPUNIT_ASSERT(secondParsed);
+    CPPUNIT_ASSERT(second.kid == Bytes(kids[1], kids[1] + 16));
+    decryptCenc(keys[1], second, sizes);
+    CPPUNIT_ASSERT(second.mdat == clear);
+}
+
+void DashEncryptionTest::cencAudioSegment()
+{
+    unsigned char aac[] = {0x12, 0x10};
+    Bytes output(OUTPUT_LENGTH), init(OUTPUT_LENGTH), clear;
+    std::vector<uint32_t> sizes;
+    uint64_t segTimestamp;
+    uint32_t segDuration, length, initLength;
+    Fragment frag;
+    bool parsed, enca, fullSample;
+
+    generate_context(&context, AUDIO_TYPE);
+    fill_audio_context(&context, 2, 48000, 16, 48000, 1024);
+    set_segment_duration(4096, &context);
+    CPPUNIT_ASSERT(set_encryption(CENC_SCHEME_CENC, kids[0], keys[0], 1, 0, NULL, 0, &context) == I2OK);
+
+    initLength = init_audio_handler(aac, sizeof(aac), &init[0], &context);
+    CPPUNIT_ASSERT(initLength > I2ERROR_MAX);
+    init.resize(initLength);
+    enca = contains(init, "enca", 4) && contains(init, "frmamp4a", 8);
+    CPPUNIT_ASSERT(enca);
+
+    for (unsigned i = 0; i < 4; i++) {
+        Bytes sample(200 + i, 0x21 + i);
+        CPPUNIT_ASSERT(add_audio_sample(&sample[0], sample.size(), 1024, i*1024, i*1024, 0, &context) == I2OK);
+        clear.insert(clear.end(), sample.begin(), sample.end());
+        sizes.push_back(sample.size());
+    }
+
+    length = generate_audio_segment(&output[0], &context, &segTimestamp, &segDuration);
+    CPPUNIT_ASSERT(length > I2ERROR_MAX);
+    output.resize(length);
+
+    parsed = parseFragment(output, 8, frag);
+    CPPUNIT_ASSERT(parsed);
+    CPPUNIT_ASSERT(frag.mdatOffsetOk);
+    CPPUNIT_ASSERT(frag.auxOffsetOk);
+
+    fullSample = frag.ivs.size() == sizes.size() && frag.subsamples[0].empty() && frag.mdat[0] != clear[0];
+    CPPUNIT_ASSERT(fullSample);
+
+    decryptCenc(keys[0], frag, sizes);
+    CPPUNIT_ASSERT(frag.mdat == clear);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DashEncryptionTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("DashEncryptionTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,327 @@
+/*
+ *  DashHttpOriginTest.cpp - DashHttpOrigin class test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *
+ */
+
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/dasher/DashHttpOrigin.hh"
+#include "Utils.hh"
+
+#define SEGMENT_NAME "test_0_1000.m4v"
+#define MPD_NAME "test.mpd"
+#define CHUNKED_NAME "test_0_2000.m4v"
+#define SEGMENT_LENGTH 100000
+
+class DashHttpOriginTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(DashHttpOriginTest);
+    CPPUNIT_TEST(getContent);
+    CPPUNIT_TEST(headAndErrors);
+    CPPUNIT_TEST(persistentConnection);
+    CPPUNIT_TEST(removeContent);
+    CPPUNIT_TEST(chunkedContent);
+    CPPUNIT_TEST(idleConnection);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void getContent();
+    void headAndErrors();
+    void persistentConnection();
+    void removeContent();
+    void chunkedContent();
+    void idleConnection();
+
+    int connectOrigin();
+    std::string request(int fd, std::string req, size_t responses = 1);
+    std::string receive(int fd, std::string res, std::string until);
+
+    DashHttpOrigin* origin = NULL;
+    std::string segment;
+};
+
+void DashHttpOriginTest::setUp()
+{
+    origin = new DashHttpOrigin();
+    CPPUNIT_ASSERT(origin->start(0));
+    CPPUNIT_ASSERT(origin->getPort() > 0);
+
+    segment.clear();
+    for (unsigned i = 0; i < SEGMENT_LENGTH; i++) {
+        segment.push_back(i % 251);
+    }
+
+    origin->publish(SEGMENT_NAME, (const unsigned char*) segment.data(), segment.size());
+    origin->publish(MPD_NAME, "<MPD/>");
+}
+
+void DashHttpOriginTest::tearDown()
+{
+    delete origin;
+}
+
+int DashHttpOriginTest::connectOrigin()
+{
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(origin->getPort());
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    CPPUNIT_ASSERT(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+//NOTE: reads until the expected number of complete responses or until the server closes
+std::string DashHttpOriginTest::request(int fd, std::string req, size_t responses)
+{
+    std::string res;
+    char buffer[4096];
+    ssize_t len;
+    size_t pos, headEnd, count;
+
+    CPPUNIT_ASSERT(send(fd, req.data(), req.size(), 0) == (ssize_t) req.size());
+
+    while (true) {
+        count = 0;
+        pos = 0;
+
+        while ((headEnd = res.find("\r\n\r\n", pos)) != std::string::npos) {
+            size_t lenPos = res.find("Content-Length: ", pos);
+            size_t bodyLength = lenPos < headEnd ? std::stoul(res.substr(lenPos + 16)) : 0;
+
+            if (req.compare(0, 4, "HEAD") == 0) {
+                bodyLength = 0;
+            }
+
+            if (res.size() < headEnd + 4 + bodyLength) {
+                break;
+            }
+
+            pos = headEnd + 4 + bodyLength;
+            count++;
+        }
+
+        if (count >= responses) {
+            return res;
+        }
+
+        len = recv(fd, buffer, sizeof(buffer), 0);
+
+        if (len <= 0) {
+            return res;
+        }
+
+        res.append(buffer, len);
+    }
+}
+
+//NOTE: reads until the received data contains the expected string or until the server closes
+std::string DashHttpOriginTest::receive(int fd, std::string res, std::string until)
+{
+    char buffer[4096];
+    ssize_t len;
+
+    while (res.find(until) == std::string::npos) {
+        len = recv(fd, buffer, sizeof(buffer), 0);
+
+        if (len <= 0) {
+            break;
+        }
+
+        res.append(buffer, len);
+    }
+
+    return res;
+}
+
+void DashHttpOriginTest::getContent()
+{
+    int fd = connectOrigin();
+    std::string res = request(fd, "GET /" SEGMENT_NAME " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+
+    CPPUNIT_ASSERT(res.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CPPUNIT_ASSERT(res.find("Content-Type: video/mp4") != std::string::npos);
+    CPPUNIT_ASSERT(res.find("Content-Length: " + std::to_string(SEGMENT_LENGTH)) != std::string::npos);
+    CPPUNIT_ASSERT(res.substr(res.find("\r\n\r\n") + 4) == segment);
+    close(fd);
+
+    fd = connectOrigin();
+    res = request(fd, "GET /" MPD_NAME "?t=1 HTTP/1.1\r\nHost: localhost\r\n\r\n");
+
+    CPPUNIT_ASSERT(res.find("Content-Type: application/dash+xml") != std::string::npos);
+    CPPUNIT_ASSERT(res.find("Cache-Control: no-cache") != std::string::npos);
+    CPPUNIT_ASSERT(res.substr(res.find("\r\n\r\n") + 4) == "<MPD/>");
+    close(fd);
+}
+
+void DashHttpOriginTest::headAndErrors()
+{
+    int fd = connectOrigin();
+    std::string res = request(fd, "HEAD /" SEGMENT_NAME " HTTP/1.1\r\n\r\n");
+
+    CPPUNIT_ASSERT(res.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CPPUNIT_ASSERT(res.find("Content-Length: " + std::to_string(SEGMENT_LENGTH)) != std::string::npos);
+    CPPUNIT_ASSERT(res.size() == res.find("\r\n\r\n") + 4);
+
+    res = request(fd, "GET /missing.m4v HTTP/1.1\r\n\r\n");
+    CPPUNIT_ASSERT(res.compare(0, 12, "HTTP/1.1 404") == 0);
+
+    res = request(fd, "DELETE /" SEGMENT_NAME " HTTP/1.1\r\n\r\n");
+    CPPUNIT_ASSERT(res.compare(0, 12, "HTTP/1.1 405") == 0);
+    close(fd);
+
+    fd = connectOrigin();
+    res = request(fd, "GET /" MPD_NAME " HTTP/2.0\r\n\r\n");
+    CPPUNIT_ASSERT(res.compare(0, 12, "HTTP/1.1 505") == 0);
+    close(fd);
+}
+
+void DashHttpOriginTest::persistentConnection()
+{
+    int fd = connectOrigin();
+    std::string res;
+
+    //NOTE: both requests are pipelined in the same write, responses are read until the server closes
+    res = request(fd, "GET /" MPD_NAME " HTTP/1.1\r\n\r\nGET /" SEGMENT_NAME " HTTP/1.1\r\nConnection: close\r\n\r\n", 3);
+
+    CPPUNIT_ASSERT(res.find("HTTP/1.1 200 OK") == 0);
+    CPPUNIT_ASSERT(res.find("HTTP/1.1 200 OK", 1) != std::string::npos);
+    CPPUNIT_ASSERT(res.find("Connection: close") != std::string::npos);
+    CPPUNIT_ASSERT(res.substr(res.size() - SEGMENT_LENGTH) == segment);
+    close(fd);
+}
+
+void DashHttpOriginTest::removeContent()
+{
+    int fd;
+    std::string res;
+
+    CPPUNIT_ASSERT(origin->getContents() == 2);
+    origin->remove(SEGMENT_NAME);
+    CPPUNIT_ASSERT(origin->getContents() == 1);
+
+    fd = connectOrigin();
+    res = request(fd, "GET /" SEGMENT_NAME " HTTP/1.0\r\n\r\n");
+    CPPUNIT_ASSERT(res.compare(0, 12, "HTTP/1.1 404") == 0);
+    CPPUNIT_ASSERT(res.find("Connection: close") != std::string::npos);
+    close(fd);
+}
+
+void DashHttpOriginTest::chunkedContent()
+{
+    int fd;
+    std::string res;
+    std::string req = "GET /" CHUNKED_NAME " HTTP/1.1\r\n\r\n";
+
+    origin->publishChunk(CHUNKED_NAME, (const unsigned char*) "abc", 3);
+    CPPUNIT_ASSERT(origin->getContents() == 3);
+
+    fd = connectOrigin();
+    CPPUNIT_ASSERT(send(fd, req.data(), req.size(), 0) == (ssize_t) req.size());
+    res = receive(fd, "", "3\r\nabc");
+
+    CPPUNIT_ASSERT(res.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CPPUNIT_ASSERT(res.find("Transfer-Encoding: chunked") != std::string::npos);
+    CPPUNIT_ASSERT(res.find("Content-Length") == std::string::npos);
+
+    //NOTE: chunks published while the response is in flight are sent right away
+    origin->publishChunk(CHUNKED_NAME, (const unsigned char*) "defghijklmnopqrs", 16);
+    res = receive(fd, res, "\r\n10\r\ndefghijklmnopqrs");
+    CPPUNIT_ASSERT(res.find("\r\n10\r\ndefghijklmnopqrs") != std::string::npos);
+
+    origin->finish(CHUNKED_NAME);
+    res = receive(fd, res, "\r\n0\r\n\r\n");
+    CPPUNIT_ASSERT(res.substr(res.find("\r\n\r\n") + 4) == "3\r\nabc\r\n10\r\ndefghijklmnopqrs\r\n0\r\n\r\n");
+
+    //NOTE: the connection stays open and the finished content is served as a whole
+    res = request(fd, req);
+    CPPUNIT_ASSERT(res.find("Content-Length: 19") != std::string::npos);
+    CPPUNIT_ASSERT(res.substr(res.find("\r\n\r\n") + 4) == "abcdefghijklmnopqrs");
+    CPPUNIT_ASSERT(origin->getContents() == 3);
+    close(fd);
+}
+
+void DashHttpOriginTest::idleConnection()
+{
+    struct timeval timeout = {5, 0};
+    Jzon::Object state;
+    char buffer[16];
+    int fd, waiting;
+    std::string res;
+    std::string req = "GET /" CHUNKED_NAME " HTTP/1.1\r\n\r\n";
+
+    origin->setIdleTimeout(1);
+    origin->publishChunk(CHUNKED_NAME, (const unsigned char*) "abc", 3);
+
+    //NOTE: a client waiting for the next chunk is kept, a silent one is closed
+    waiting = connectOrigin();
+    CPPUNIT_ASSERT(send(waiting, req.data(), req.size(), 0) == (ssize_t) req.size());
+    res = receive(waiting, "", "3\r\nabc");
+    CPPUNIT_ASSERT(res.find("3\r\nabc") != std::string::npos);
+
+    fd = connectOrigin();
+    CPPUNIT_ASSERT(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0);
+    CPPUNIT_ASSERT(recv(fd, buffer, sizeof(buffer), 0) == 0);
+    close(fd);
+
+    origin->getState(state);
+    CPPUNIT_ASSERT(state.Get("connections").ToInt() == 1);
+
+    origin->finish(CHUNKED_NAME);
+    res = receive(waiting, res, "\r\n0\r\n\r\n");
+    CPPUNIT_ASSERT(res.find("\r\n0\r\n\r\n") != std::string::npos);
+    close(waiting);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DashHttpOriginTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("DashHttpOriginTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
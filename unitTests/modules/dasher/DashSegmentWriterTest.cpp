@@ -0,0 +1,234 @@
+/*
+ *  DashSegmentWriterTest.cpp - DashSegmentWriter class test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *
+ */
+
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/dasher/DashSegmentWriter.hh"
+
+#define SEGMENT_PATH "/tmp/dashsegmentwritertest.m4v"
+#define MPD_PATH "/tmp/dashsegmentwritertest.mpd"
+#define PLAYLIST_PATH "/tmp/dashsegmentwritertest.m3u8"
+#define INVALID_PATH "/nonExistance/dashsegmentwritertest.m4v"
+#define SEGMENT_LENGTH 1000
+
+class DashSegmentWriterTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(DashSegmentWriterTest);
+    CPPUNIT_TEST(writeJob);
+    CPPUNIT_TEST(removeSegments);
+    CPPUNIT_TEST(failedWrites);
+    CPPUNIT_TEST(recycleSegments);
+    CPPUNIT_TEST(appendChunks);
+    CPPUNIT_TEST(growSegments);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void writeJob();
+    void removeSegments();
+    void failedWrites();
+    void recycleSegments();
+    void appendChunks();
+    void growSegments();
+
+    DashSegment* fillSegment(unsigned char value);
+    std::string readFile(std::string path);
+
+    DashSegmentWriter* writer = NULL;
+};
+
+void DashSegmentWriterTest::setUp()
+{
+    writer = new DashSegmentWriter();
+}
+
+void DashSegmentWriterTest::tearDown()
+{
+    delete writer;
+    std::remove(SEGMENT_PATH);
+    std::remove(MPD_PATH);
+    std::remove(PLAYLIST_PATH);
+}
+
+DashSegment* DashSegmentWriterTest::fillSegment(unsigned char value)
+{
+    DashSegment* seg = writer->getSegment();
+
+    memset(seg->getDataBuffer(), value, SEGMENT_LENGTH);
+    seg->setDataLength(SEGMENT_LENGTH);
+    seg->setComplete(true);
+
+    return seg;
+}
+
+std::string DashSegmentWriterTest::readFile(std::string path)
+{
+    std::ifstream file(path.c_str(), std::ifstream::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+void DashSegmentWriterTest::writeJob()
+{
+    DashWriterJob* job = new DashWriterJob();
+
+    job->segments.push_back(std::make_pair(std::string(SEGMENT_PATH), fillSegment(7)));
+    job->mpdPath = MPD_PATH;
+    job->mpd = "<MPD/>";
+    job->playlists.push_back(std::make_pair(std::string(PLAYLIST_PATH), std::string("#EXTM3U\n")));
+
+    CPPUNIT_ASSERT(writer->push(job));
+    writer->flush();
+
+    CPPUNIT_ASSERT(writer->getPendingJobs() == 0);
+    CPPUNIT_ASSERT(writer->getFailedWrites() == 0);
+    CPPUNIT_ASSERT(readFile(SEGMENT_PATH) == std::string(SEGMENT_LENGTH, 7));
+    CPPUNIT_ASSERT(readFile(MPD_PATH) == "<MPD/>");
+    CPPUNIT_ASSERT(readFile(PLAYLIST_PATH) == "#EXTM3U\n");
+    CPPUNIT_ASSERT(access((std::string(SEGMENT_PATH) + DASH_TMP_EXT).c_str(), F_OK) != 0);
+    CPPUNIT_ASSERT(access((std::string(MPD_PATH) + DASH_TMP_EXT).c_str(), F_OK) != 0);
+}
+
+void DashSegmentWriterTest::removeSegments()
+{
+    DashWriterJob* job = new DashWriterJob();
+
+    job->segments.push_back(std::make_pair(std::string(SEGMENT_PATH), fillSegment(1)));
+    CPPUNIT_ASSERT(writer->push(job));
+
+    job = new DashWriterJob();
+    job->removals.push_back(SEGMENT_PATH);
+    CPPUNIT_ASSERT(writer->push(job));
+
+    writer->flush();
+
+    CPPUNIT_ASSERT(access(SEGMENT_PATH, F_OK) != 0);
+    CPPUNIT_ASSERT(writer->getFailedWrites() == 0);
+}
+
+void DashSegmentWriterTest::failedWrites()
+{
+    DashWriterJob* job = new DashWriterJob();
+
+    CPPUNIT_ASSERT(!writer->push(NULL));
+
+    job->segments.push_back(std::make_pair(std::string(INVALID_PATH), fillSegment(1)));
+    job->removals.push_back(INVALID_PATH);
+    CPPUNIT_ASSERT(writer->push(job));
+
+    writer->flush();
+
+    CPPUNIT_ASSERT(writer->getFailedWrites() == 2);
+}
+
+void DashSegmentWriterTest::recycleSegments()
+{
+    DashWriterJob* job = new DashWriterJob();
+    DashSegment* seg = fillSegment(3);
+
+    seg->setSeqNumber(5);
+    job->segments.push_back(std::make_pair(std::string(SEGMENT_PATH), seg));
+
+    CPPUNIT_ASSERT(writer->push(job));
+    writer->flush();
+
+    CPPUNIT_ASSERT(writer->getSegment() == seg);
+    CPPUNIT_ASSERT(seg->isEmpty() && !seg->isComplete());
+
+    delete seg;
+}
+
+void DashSegmentWriterTest::appendChunks()
+{
+    DashWriterJob* job = new DashWriterJob();
+
+    job->segments.push_back(std::make_pair(std::string(SEGMENT_PATH), fillSegment(1)));
+    CPPUNIT_ASSERT(writer->push(job));
+
+    //NOTE: the first chunk replaces the previous file
+    job = new DashWriterJob();
+    job->chunks.push_back(DashChunk{SEGMENT_PATH, "abc", true});
+    CPPUNIT_ASSERT(writer->push(job));
+    writer->flush();
+
+    CPPUNIT_ASSERT(readFile(SEGMENT_PATH) == "abc");
+
+    job = new DashWriterJob();
+    job->chunks.push_back(DashChunk{SEGMENT_PATH, "def", false});
+    job->chunks.push_back(DashChunk{SEGMENT_PATH, "g", false});
+    job->chunks.push_back(DashChunk{INVALID_PATH, "h", true});
+    CPPUNIT_ASSERT(writer->push(job));
+    writer->flush();
+
+    CPPUNIT_ASSERT(readFile(SEGMENT_PATH) == "abcdefg");
+    CPPUNIT_ASSERT(writer->getFailedWrites() == 1);
+}
+
+void DashSegmentWriterTest::growSegments()
+{
+    DashWriterJob* job = new DashWriterJob();
+    DashSegment* seg = fillSegment(9);
+    unsigned int size = DASH_SEGMENT_INITIAL_SIZE*3;
+
+    CPPUNIT_ASSERT(seg->reserve(size));
+    CPPUNIT_ASSERT(seg->getCapacity() >= size);
+    CPPUNIT_ASSERT(std::string((char*) seg->getDataBuffer(), seg->getDataLength()) == std::string(SEGMENT_LENGTH, 9));
+    CPPUNIT_ASSERT(!seg->reserve(MAX_DAT + 1));
+
+    job->segments.push_back(std::make_pair(std::string(SEGMENT_PATH), seg));
+    CPPUNIT_ASSERT(writer->push(job));
+    writer->flush();
+
+    //NOTE: recycled segments keep their buffer
+    CPPUNIT_ASSERT(writer->getSegment() == seg);
+    CPPUNIT_ASSERT(seg->getCapacity() >= size);
+
+    delete seg;
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DashSegmentWriterTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("DashSegmentWriterTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -36,6 +36,7 @@
 #include "modules/dasher/DashVideoSegmenterHEVC.hh"
 
 #define SEG_DURATION 2
+#define MODEL_MAX_LENGTH 10*1024*1024
 #define BASE_NAME_AVC "testsData/modules/dasher/dashVideoSegmenterAVCTest/test"
 #define BASE_NAME_HEVC "testsData/modules/dasher/dashVideoSegmenterHEVCTest/test"
 #define WIDTH 1280
@@ -262,7 +263,7 @@ void DashVideoSegmenterAVCTest::manageNonIDRNals()
 
 void DashVideoSegmenterAVCTest::generateInitSegment()
 {
-    char* initModel = new char[MAX_DAT];
+    char* initModel = new char[MODEL_MAX_LENGTH];
     size_t initModelLength;
     DashSegment* initSegment = new DashSegment();
     std::chrono::microseconds ts(1000);
@@ -317,7 +318,7 @@ void DashVideoSegmenterAVCTest::appendFrameToDashSegment()
 
 void DashVideoSegmenterAVCTest::generateSegment()
 {
-    char* segmentModel = new char[MAX_DAT];
+    char* segmentModel = new char[MODEL_MAX_LENGTH];
     size_t segmentModelLength;
     DashSegment* segment = new DashSegment();
 
@@ -614,7 +615,7 @@ void DashVideoSegmenterHEVCTest::manageNonIDRNals()
 
 void DashVideoSegmenterHEVCTest::generateInitSegment()
 {
-    char* initModel = new char[MAX_DAT];
+    char* initModel = new char[MODEL_MAX_LENGTH];
     size_t initModelLength;
     DashSegment* initSegment = new DashSegment();
     std::chrono::microseconds ts(1000);
@@ -679,7 +680,7 @@ void DashVideoSegmenterHEVCTest::appendFrameToDashSegment()
 
 void DashVideoSegmenterHEVCTest::generateSegment()
 {
-    char* segmentModel = new char[MAX_DAT];
+    char* segmentModel = new char[MODEL_MAX_LENGTH];
     size_t segmentModelLength;
     DashSegment* segment = new DashSegment();
 
@@ -0,0 +1,198 @@
+/*
+ *  HlsManagerTest.cpp - HlsManager class test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/dasher/HlsManager.hh"
+#include "Utils.hh"
+
+#define BASE_NAME "test"
+#define MAX_SEGMENTS 4
+#define SEG_DURATION 2
+#define TIMESCALE 1000
+#define V_ID "0"
+#define A_ID "1"
+
+class HlsManagerTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(HlsManagerTest);
+    CPPUNIT_TEST(masterPlaylist);
+    CPPUNIT_TEST(mediaPlaylist);
+    CPPUNIT_TEST(slidingWindow);
+    CPPUNIT_TEST(removeTimestamps);
+    CPPUNIT_TEST(removeRepresentation);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void masterPlaylist();
+    void mediaPlaylist();
+    void slidingWindow();
+    void removeTimestamps();
+    void removeRepresentation();
+
+    std::string getPlaylist(std::string name);
+
+    HlsManager* manager = NULL;
+};
+
+void HlsManagerTest::setUp()
+{
+    manager = new HlsManager();
+    manager->configure(BASE_NAME, MAX_SEGMENTS, SEG_DURATION);
+
+    manager->updateVideoAdaptationSet(V_ID, TIMESCALE, BASE_NAME "_$RepresentationID$_$Time$.m4v", BASE_NAME "_$RepresentationID$_init.m4v");
+    manager->updateVideoRepresentation(V_ID, "2", "avc1.42c01e", 1280, 720, 2000000, 25);
+    manager->updateAudioAdaptationSet(A_ID, TIMESCALE, BASE_NAME "_$RepresentationID$_$Time$.m4a", BASE_NAME "_$RepresentationID$_init.m4a");
+    manager->updateAudioRepresentation(A_ID, "3", "mp4a.40.2", 48000, 128000, 2);
+}
+
+void HlsManagerTest::tearDown()
+{
+    delete manager;
+}
+
+std::string HlsManagerTest::getPlaylist(std::string name)
+{
+    std::vector<std::pair<std::string, std::string>> playlists;
+
+    manager->getPlaylists(playlists);
+
+    for (auto playlist : playlists) {
+        if (playlist.first == name) {
+            return playlist.second;
+        }
+    }
+
+    return "";
+}
+
+void HlsManagerTest::masterPlaylist()
+{
+    std::vector<std::pair<std::string, std::string>> playlists;
+    std::string master;
+
+    manager->getPlaylists(playlists);
+    CPPUNIT_ASSERT(playlists.size() == 3);
+    CPPUNIT_ASSERT(playlists[0].first == BASE_NAME ".m3u8");
+
+    master = playlists[0].second;
+    CPPUNIT_ASSERT(master.compare(0, 8, "#EXTM3U\n") == 0);
+    CPPUNIT_ASSERT(master.find("#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"audio\"") != std::string::npos);
+    CPPUNIT_ASSERT(master.find("URI=\"" BASE_NAME "_3.m3u8\"") != std::string::npos);
+    CPPUNIT_ASSERT(master.find("BANDWIDTH=2128000,CODECS=\"avc1.42c01e,mp4a.40.2\",RESOLUTION=1280x720") != std::string::npos);
+    CPPUNIT_ASSERT(master.find("AUDIO=\"audio\"\n" BASE_NAME "_2.m3u8\n") != std::string::npos);
+}
+
+void HlsManagerTest::mediaPlaylist()
+{
+    std::string media;
+
+    CPPUNIT_ASSERT(manager->updateAdaptationSetTimestamp(V_ID, 0, 2000));
+    CPPUNIT_ASSERT(manager->updateAdaptationSetTimestamp(V_ID, 2000, 1960));
+    CPPUNIT_ASSERT(!manager->updateAdaptationSetTimestamp("9", 0, 2000));
+
+    media = getPlaylist(BASE_NAME "_2.m3u8");
+    CPPUNIT_ASSERT(media.find("#EXT-X-TARGETDURATION:2\n") != std::string::npos);
+    CPPUNIT_ASSERT(media.find("#EXT-X-MEDIA-SEQUENCE:0\n") != std::string::npos);
+    CPPUNIT_ASSERT(media.find("#EXT-X-MAP:URI=\"" BASE_NAME "_2_init.m4v\"\n") != std::string::npos);
+    CPPUNIT_ASSERT(media.find("#EXTINF:2.000,\n" BASE_NAME "_2_0.m4v\n") != std::string::npos);
+    CPPUNIT_ASSERT(media.find("#EXTINF:1.960,\n" BASE_NAME "_2_2000.m4v\n") != std::string::npos);
+
+    //NOTE: the last segment is updated, a longer one raises the target duration
+    CPPUNIT_ASSERT(manager->updateAdaptationSetTimestamp(V_ID, 2000, 2600));
+    media = getPlaylist(BASE_NAME "_2.m3u8");
+    CPPUNIT_ASSERT(manager->getSegments(V_ID) == 2);
+    CPPUNIT_ASSERT(media.find("#EXT-X-TARGETDURATION:3\n") != std::string::npos);
+    CPPUNIT_ASSERT(media.find("#EXTINF:2.600,") != std::string::npos);
+
+    CPPUNIT_ASSERT(getPlaylist(BASE_NAME "_3.m3u8").find("#EXTINF") == std::string::npos);
+}
+
+void HlsManagerTest::slidingWindow()
+{
+    std::string media;
+
+    for (unsigned i = 0; i < MAX_SEGMENTS + 2; i++) {
+        CPPUNIT_ASSERT(manager->updateAdaptationSetTimestamp(A_ID, i*2000, 2000));
+    }
+
+    media = getPlaylist(BASE_NAME "_3.m3u8");
+    CPPUNIT_ASSERT(manager->getSegments(A_ID) == MAX_SEGMENTS);
+    CPPUNIT_ASSERT(media.find("#EXT-X-MEDIA-SEQUENCE:2\n") != std::string::npos);
+    CPPUNIT_ASSERT(media.find(BASE_NAME "_3_2000.m4a") == std::string::npos);
+    CPPUNIT_ASSERT(media.find(BASE_NAME "_3_4000.m4a") != std::string::npos);
+}
+
+void HlsManagerTest::removeTimestamps()
+{
+    for (unsigned i = 0; i < 3; i++) {
+        CPPUNIT_ASSERT(manager->updateAdaptationSetTimestamp(V_ID, i*2000, 2000));
+    }
+
+    CPPUNIT_ASSERT(manager->removeTimestamps(V_ID, 2000));
+    CPPUNIT_ASSERT(manager->getSegments(V_ID) == 1);
+    CPPUNIT_ASSERT(getPlaylist(BASE_NAME "_2.m3u8").find("#EXT-X-MEDIA-SEQUENCE:2\n") != std::string::npos);
+    CPPUNIT_ASSERT(!manager->removeTimestamps("9", 2000));
+}
+
+void HlsManagerTest::removeRepresentation()
+{
+    std::vector<std::pair<std::string, std::string>> playlists;
+
+    CPPUNIT_ASSERT(manager->removeRepresentation(V_ID, "2"));
+    CPPUNIT_ASSERT(!manager->removeRepresentation(V_ID, "2"));
+
+    //NOTE: without video the audio representation is a variant itself
+    manager->getPlaylists(playlists);
+    CPPUNIT_ASSERT(playlists.size() == 2);
+    CPPUNIT_ASSERT(playlists[0].second.find("#EXT-X-MEDIA") == std::string::npos);
+    CPPUNIT_ASSERT(playlists[0].second.find("BANDWIDTH=128000,CODECS=\"mp4a.40.2\"\n" BASE_NAME "_3.m3u8\n") != std::string::npos);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(HlsManagerTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("HlsManagerTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
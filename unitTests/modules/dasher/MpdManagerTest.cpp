@@ -20,6 +20,9 @@
  *
  */
 #include <unistd.h>
+#include <string>
+#include <fstream>
+#include <tinyxml2.h>
 
 #include "modules/dasher/MpdManager.hh"
 
@@ -44,6 +47,9 @@ class MpdManagerTest : public CppUnit::TestFixture
     CPPUNIT_TEST(updateVideoRepresentation);
     CPPUNIT_TEST(updateAudioRepresentation);
     CPPUNIT_TEST(removeRepresentation);
+    CPPUNIT_TEST(incrementalUpdates);
+    CPPUNIT_TEST(contentProtection);
+    CPPUNIT_TEST(captions);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -59,6 +65,9 @@ protected:
     void updateVideoRepresentation();
     void updateAudioRepresentation();
     void removeRepresentation();
+    void incrementalUpdates();
+    void contentProtection();
+    void captions();
 
 protected:
     MpdManager* manager = NULL;
@@ -480,6 +489,99 @@ void MpdManagerTest::removeRepresentation()
     CPPUNIT_ASSERT(!manager->removeRepresentation(aAdSetId, audioReprId));
 }
 
+void MpdManagerTest::incrementalUpdates()
+{
+    const std::string id = "one-id";
+    const std::string reprId = "repr-Id";
+    std::string mpd;
+    std::ifstream file;
+
+    manager->updateVideoAdaptationSet(id, 1, "a-segment", "the-init");
+    manager->updateVideoRepresentation(id, reprId, "repr-Codec", 2, 3, 4, 5);
+    manager->updateAdaptationSetTimestamp(id, 10, 2);
+    manager->updateAdaptationSetTimestamp(id, 12, 2);
+    mpd = manager->toString();
+
+    CPPUNIT_ASSERT(mpd.find("t=\"10\" d=\"2\"") != std::string::npos);
+    CPPUNIT_ASSERT(mpd.find("t=\"12\" d=\"2\"") != std::string::npos);
+
+    //NOTE: unchanged values do not modify the document
+    manager->updateVideoAdaptationSet(id, 1, "a-segment", "the-init");
+    manager->updateVideoRepresentation(id, reprId, "repr-Codec", 2, 3, 4, 5);
+    CPPUNIT_ASSERT(manager->toString() == mpd);
+
+    CPPUNIT_ASSERT(manager->updateAdaptationSetTimestamp(id, 14, 2) == 10);
+    manager->updateAdaptationSetTimestamp(id, 14, 3);
+    manager->updateVideoRepresentation(id, reprId, "repr-Codec", 2, 3, 6, 5);
+    mpd = manager->toString();
+
+    CPPUNIT_ASSERT(mpd.find("t=\"10\"") == std::string::npos);
+    CPPUNIT_ASSERT(mpd.find("t=\"14\" d=\"3\"") != std::string::npos);
+    CPPUNIT_ASSERT(mpd.find("bandwidth=\"6\"") != std::string::npos);
+
+    manager->writeToDisk(FILE_NAME);
+    file.open(FILE_NAME, std::ifstream::binary);
+    CPPUNIT_ASSERT(std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()) == mpd);
+}
+
+void MpdManagerTest::contentProtection()
+{
+    const std::string vId = "video-id";
+    const std::string aId = "audio-id";
+    const std::string kid = "00112233-4455-6677-8899-aabbccddeeff";
+    std::string mpd;
+
+    manager->updateVideoAdaptationSet(vId, 1, "v-segment", "v-init");
+    manager->updateAudioAdaptationSet(aId, 1, "a-segment", "a-init");
+    mpd = manager->toString();
+
+    CPPUNIT_ASSERT(mpd.find("ContentProtection") == std::string::npos);
+    CPPUNIT_ASSERT(mpd.find("xmlns:cenc") == std::string::npos);
+    CPPUNIT_ASSERT(!manager->setContentProtection("no-id", "cenc", kid));
+
+    CPPUNIT_ASSERT(manager->setContentProtection(vId, "cenc", kid));
+    CPPUNIT_ASSERT(manager->setContentProtection(aId, "cenc", kid));
+    mpd = manager->toString();
+
+    CPPUNIT_ASSERT(mpd.find("xmlns:cenc=\"" XMLNS_CENC "\"") != std::string::npos);
+    CPPUNIT_ASSERT(mpd.find("schemeIdUri=\"" CENC_SCHEME_ID_URI "\" value=\"cenc\" cenc:default_KID=\"" + kid + "\"")
+        != mpd.rfind("schemeIdUri=\"" CENC_SCHEME_ID_URI "\" value=\"cenc\" cenc:default_KID=\"" + kid + "\""));
+    CPPUNIT_ASSERT(mpd.find(COMMON_PSSH_SCHEME_ID_URI) != mpd.rfind(COMMON_PSSH_SCHEME_ID_URI));
+
+    CPPUNIT_ASSERT(manager->setContentProtection(vId, "", ""));
+    CPPUNIT_ASSERT(manager->setContentProtection(aId, "", ""));
+    mpd = manager->toString();
+
+    CPPUNIT_ASSERT(mpd.find("ContentProtection") == std::string::npos);
+    CPPUNIT_ASSERT(mpd.find("xmlns:cenc") == std::string::npos);
+}
+
+void MpdManagerTest::captions()
+{
+    const std::string vId = "video-id";
+    const std::string aId = "audio-id";
+    std::string mpd;
+
+    manager->updateVideoAdaptationSet(vId, 1, "v-segment", "v-init");
+    manager->updateAudioAdaptationSet(aId, 1, "a-segment", "a-init");
+    mpd = manager->toString();
+
+    CPPUNIT_ASSERT(mpd.find("Accessibility") == std::string::npos);
+    CPPUNIT_ASSERT(!manager->setCaptions("no-id", true));
+
+    CPPUNIT_ASSERT(manager->setCaptions(vId, true));
+    mpd = manager->toString();
+
+    CPPUNIT_ASSERT(mpd.find("<Accessibility schemeIdUri=\"" CEA608_SCHEME_ID_URI "\" value=\"" CEA608_CHANNELS "\"/>") 
+        != std::string::npos);
+    CPPUNIT_ASSERT(mpd.find("Accessibility") == mpd.rfind("Accessibility"));
+
+    CPPUNIT_ASSERT(manager->setCaptions(vId, false));
+    mpd = manager->toString();
+
+    CPPUNIT_ASSERT(mpd.find("Accessibility") == std::string::npos);
+}
+
 class AdaptationSetTest : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(AdaptationSetTest);
@@ -491,6 +593,8 @@ protected:
     void updateTest();
     void updateTimestampTest();
 
+    tinyxml2::XMLElement* toMpd(tinyxml2::XMLDocument& doc);
+
 protected:
     const int iSegTimescale = 100;
     const std::string sSegTempl = "segTemp";
@@ -499,6 +603,17 @@ protected:
     AdaptationSet* as = NULL;
 };
 
+//NOTE: the adaptation set is rendered as text, it is parsed to check its nodes
+tinyxml2::XMLElement* AdaptationSetTest::toMpd(tinyxml2::XMLDocument& doc)
+{
+    std::string xml;
+
+    as->toMpd(xml, "as-id");
+    CPPUNIT_ASSERT(doc.Parse(xml.c_str()) == tinyxml2::XML_SUCCESS);
+
+    return doc.FirstChildElement("AdaptationSet");
+}
+
 void AdaptationSetTest::updateTest()
 {
     CPPUNIT_ASSERT(as != NULL);
@@ -511,11 +626,9 @@ void AdaptationSetTest::updateTest()
     const std::string sNewSegTempl = "newSegTemp";
     const std::string sNewInitTempl = "newInitTemp";
 
-    adaptSet = doc.NewElement("newElement");
-
     as->update(iNewTimescale, sNewSegTempl, sNewInitTempl);
 
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
 
     CPPUNIT_ASSERT((segmentTemplate = (const tinyxml2::XMLElement*)adaptSet->FirstChildElement("SegmentTemplate")) != NULL);
 
@@ -542,11 +655,9 @@ void AdaptationSetTest::updateTimestampTest()
     const int iTimestamp = 1;
     const int iDuration = 2;
 
-    adaptSet = doc.NewElement("newElement");
-
     as->updateTimestamp(iTimestamp, iDuration, MAX_SEGMENTS);
 
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
 
     CPPUNIT_ASSERT((segmentTemplate = (const tinyxml2::XMLElement*)adaptSet->FirstChildElement("SegmentTemplate")) != NULL);
     CPPUNIT_ASSERT((segmentTimeline = (const tinyxml2::XMLElement*)segmentTemplate->FirstChildElement("SegmentTimeline")) != NULL);
@@ -595,8 +706,7 @@ void VideoAdaptationSetTest::toMpdTest()
     const tinyxml2::XMLElement *segmentTemplate;
     const tinyxml2::XMLAttribute* attrib;
 
-    adaptSet = doc.NewElement("newElement");
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
 
     CPPUNIT_ASSERT(((const tinyxml2::XMLElement*)adaptSet)->FindAttribute("noValidAttribute") == NULL);
     CPPUNIT_ASSERT(((const tinyxml2::XMLElement*)adaptSet)->FindAttribute("mimeType") != NULL);
@@ -613,7 +723,7 @@ void VideoAdaptationSetTest::toMpdTest()
         attrib = attrib->Next();
     }
 
-    CPPUNIT_ASSERT(nAttribs == 8);
+    CPPUNIT_ASSERT(nAttribs == 9);
 
     CPPUNIT_ASSERT((segmentTemplate = (const tinyxml2::XMLElement*)adaptSet->FirstChildElement("SegmentTemplate")) != NULL);
 
@@ -641,15 +751,13 @@ void VideoAdaptationSetTest::updateVideoRepresentationTest()
     const tinyxml2::XMLElement* repElem;
     const tinyxml2::XMLAttribute* attrib;
 
-    adaptSet = doc.NewElement("newElement");
-
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
     CPPUNIT_ASSERT(adaptSet->FirstChildElement(representationName.c_str()) == NULL);
 
     as->updateVideoRepresentation(representationId, representationCodec, representationWidth, representationHeight,
             representationBandwidth, representationFps);
 
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
     repElem = adaptSet->FirstChildElement(representationName.c_str());
 
     CPPUNIT_ASSERT(repElem != NULL);
@@ -689,22 +797,19 @@ void VideoAdaptationSetTest::removeRepresentationTest()
     tinyxml2::XMLElement* adaptSet;
     const tinyxml2::XMLElement* repElem;
 
-    adaptSet = doc.NewElement("newElement");
-
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
     CPPUNIT_ASSERT(adaptSet->FirstChildElement(representationName.c_str()) == NULL);
 
     as->updateVideoRepresentation(representationId, representationCodec, representationWidth, representationHeight,
             representationBandwidth, representationFps);
 
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
     repElem = adaptSet->FirstChildElement(representationName.c_str());
 
     CPPUNIT_ASSERT(repElem != NULL);
     CPPUNIT_ASSERT(as->removeRepresentation(representationId));
 
-    adaptSet = doc.NewElement("newElement");
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
     CPPUNIT_ASSERT(adaptSet->FirstChildElement(representationName.c_str()) == NULL);
 }
 
@@ -744,8 +849,7 @@ void AudioAdaptationSetTest::toMpdTest()
     const tinyxml2::XMLElement *segmentTemplate, *role;
     const tinyxml2::XMLAttribute* attrib;
 
-    adaptSet = doc.NewElement("newElement");
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
     doc.SaveFile(FILE_NAME);
 
     CPPUNIT_ASSERT(((const tinyxml2::XMLElement*)adaptSet)->FindAttribute("noValidAttribute") == NULL);
@@ -761,7 +865,7 @@ void AudioAdaptationSetTest::toMpdTest()
         attrib = attrib->Next();
     }
 
-    CPPUNIT_ASSERT(nAttribs == 6);
+    CPPUNIT_ASSERT(nAttribs == 7);
 
     CPPUNIT_ASSERT((role = (const tinyxml2::XMLElement*)adaptSet->FirstChildElement("Role")) != NULL);
     CPPUNIT_ASSERT(((const tinyxml2::XMLElement*)role)->FindAttribute("schemeIdUri") != NULL);
@@ -792,15 +896,13 @@ void AudioAdaptationSetTest::updateAudioRepresentationTest()
     const tinyxml2::XMLElement* repElem, *audElem;
     const tinyxml2::XMLAttribute* attrib;
 
-    adaptSet = doc.NewElement("newElement");
-
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
     CPPUNIT_ASSERT(adaptSet->FirstChildElement(representationName.c_str()) == NULL);
 
     as->updateAudioRepresentation(representationId, representationCodec, representationAudioSamplingRate,
             representationBandwidth, representationChannels);
 
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
     repElem = adaptSet->FirstChildElement(representationName.c_str());
 
     CPPUNIT_ASSERT(repElem != NULL);
@@ -844,22 +946,19 @@ void AudioAdaptationSetTest::removeRepresentationTest()
     tinyxml2::XMLElement* adaptSet;
     const tinyxml2::XMLElement* repElem;
 
-    adaptSet = doc.NewElement("newElement");
-
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
     CPPUNIT_ASSERT(adaptSet->FirstChildElement(representationName.c_str()) == NULL);
 
     as->updateAudioRepresentation(representationId, representationCodec, representationAudioSamplingRate,
             representationBandwidth, representationChannels);
 
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
     repElem = adaptSet->FirstChildElement(representationName.c_str());
 
     CPPUNIT_ASSERT(repElem != NULL);
     CPPUNIT_ASSERT(as->removeRepresentation(representationId));
 
-    adaptSet = doc.NewElement("newElement");
-    as->toMpd(doc, adaptSet);
+    adaptSet = toMpd(doc);
     CPPUNIT_ASSERT(adaptSet->FirstChildElement(representationName.c_str()) == NULL);
 }
 
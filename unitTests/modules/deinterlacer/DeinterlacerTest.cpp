@@ -0,0 +1,420 @@
+/*
+ *  DeinterlacerTest.cpp - Deinterlacer class test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+#include <algorithm>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/deinterlacer/Deinterlacer.hh"
+#include "FramePool.hh"
+#include "Utils.hh"
+
+#define WIDTH 64
+#define HEIGHT 32
+
+class DeinterlacerMock : public Deinterlacer {
+public:
+    DeinterlacerMock() : Deinterlacer() {};
+    using Deinterlacer::doProcessFrame;
+    using Deinterlacer::configure0;
+};
+
+class DeinterlacerTest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(DeinterlacerTest);
+    CPPUNIT_TEST(progressiveTest);
+    CPPUNIT_TEST(delayTest);
+    CPPUNIT_TEST(staticTest);
+    CPPUNIT_TEST(combTest);
+    CPPUNIT_TEST(bottomFirstTest);
+    CPPUNIT_TEST(bandsTest);
+    CPPUNIT_TEST(boundaryTest);
+    CPPUNIT_TEST(referenceTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void progressiveTest();
+    void delayTest();
+    void staticTest();
+    void combTest();
+    void bottomFirstTest();
+    void bandsTest();
+    void boundaryTest();
+    void referenceTest();
+
+    //NOTE: pooled frames are held by reference, the others are copied
+    VideoFrame* picture(bool pooled, FieldOrder order, int pts, std::function<unsigned char(int, int, int)> pixel,
+                        int width = WIDTH, int height = HEIGHT);
+    bool samePicture(VideoFrame* a, VideoFrame* b);
+    bool flatLuma(VideoFrame* frame, unsigned char value);
+
+    DeinterlacerMock* deinterlacer;
+    PlanarVideoFrame* out;
+};
+
+void DeinterlacerTest::setUp()
+{
+    deinterlacer = new DeinterlacerMock();
+    out = PlanarVideoFrame::createNew(RAW, WIDTH, HEIGHT, YUV420P);
+}
+
+void DeinterlacerTest::tearDown()
+{
+    delete deinterlacer;
+    delete out;
+}
+
+VideoFrame* DeinterlacerTest::picture(bool pooled, FieldOrder order, int pts,
+                                      std::function<unsigned char(int, int, int)> pixel, int width, int height)
+{
+    VideoFrame* frame;
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+    int lineBytes, rows;
+
+    if (pooled) {
+        frame = dynamic_cast<VideoFrame*>(FramePool::getInstance()->getVideoFrame(RAW, width, height, YUV420P));
+    } else {
+        frame = PlanarVideoFrame::createNew(RAW, width, height, YUV420P);
+    }
+
+    frame->fitBuffer(width, height, YUV420P);
+    frame->getPlanes(data, linesize);
+
+    for (unsigned p = 0; VideoFrame::planeSize(YUV420P, width, height, p, lineBytes, rows); p++) {
+        for (int y = 0; y < rows; y++) {
+            for (int x = 0; x < lineBytes; x++) {
+                data[p][y*linesize[p] + x] = pixel(p, x, y);
+            }
+        }
+    }
+
+    frame->setFieldOrder(order);
+    frame->setPresentationTime(std::chrono::microseconds(pts));
+    return frame;
+}
+
+bool DeinterlacerTest::samePicture(VideoFrame* a, VideoFrame* b)
+{
+    unsigned char* aData[MAX_PLANES];
+    unsigned char* bData[MAX_PLANES];
+    int aLinesize[MAX_PLANES];
+    int bLinesize[MAX_PLANES];
+    int lineBytes, rows;
+
+    if (a->getWidth() != b->getWidth() || a->getHeight() != b->getHeight() ||
+        a->getPlanes(aData, aLinesize) == 0 || b->getPlanes(bData, bLinesize) == 0) {
+        return false;
+    }
+
+    for (unsigned p = 0; VideoFrame::planeSize(YUV420P, a->getWidth(), a->getHeight(), p, lineBytes, rows); p++) {
+        for (int y = 0; y < rows; y++) {
+            if (memcmp(aData[p] + y*aLinesize[p], bData[p] + y*bLinesize[p], lineBytes) != 0) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+//NOTE: lines next to the top and bottom borders are not checked against the lines two away, see yadif
+bool DeinterlacerTest::flatLuma(VideoFrame* frame, unsigned char value)
+{
+    unsigned char* data[MAX_PLANES];
+    int linesize[MAX_PLANES];
+
+    if (frame->getPlanes(data, linesize) == 0) {
+        return false;
+    }
+
+    for (int y = 2; y < frame->getHeight() - 2; y++) {
+        for (int x = 0; x < frame->getWidth(); x++) {
+            if (data[0][y*linesize[0] + x] != value) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void DeinterlacerTest::progressiveTest()
+{
+    VideoFrame* in = picture(true, FO_PROGRESSIVE, 1000, [](int p, int x, int y) {return p*50 + x + y;});
+
+    CPPUNIT_ASSERT(deinterlacer->doProcessFrame(in, out));
+    CPPUNIT_ASSERT(out->hasExternalPlanes());
+    CPPUNIT_ASSERT(in->getRefs() == 2);
+    CPPUNIT_ASSERT(samePicture(in, out));
+    CPPUNIT_ASSERT(out->getPresentationTime() == std::chrono::microseconds(1000));
+    CPPUNIT_ASSERT(deinterlacer->getPassed() == 1 && deinterlacer->getDeinterlaced() == 0);
+
+    //NOTE: the input is released once the output frame is fitted again
+    out->fitBuffer(WIDTH, HEIGHT, YUV420P);
+    CPPUNIT_ASSERT(in->getRefs() == 1);
+    FramePool::getInstance()->releaseFrame(in);
+}
+
+void DeinterlacerTest::delayTest()
+{
+    auto pixel = [](int p, int x, int y) {return p*50 + x + y;};
+    VideoFrame* frames[3];
+
+    for (int i = 0; i < 3; i++) {
+        frames[i] = picture(true, FO_TOP_FIRST, 1000*(i + 1), pixel);
+    }
+
+    CPPUNIT_ASSERT(!deinterlacer->doProcessFrame(frames[0], out));
+    CPPUNIT_ASSERT(frames[0]->getRefs() == 2);
+
+    CPPUNIT_ASSERT(deinterlacer->doProcessFrame(frames[1], out));
+    CPPUNIT_ASSERT(out->getPresentationTime() == std::chrono::microseconds(1000));
+    CPPUNIT_ASSERT(out->getFieldOrder() == FO_PROGRESSIVE);
+    CPPUNIT_ASSERT(!out->hasExternalPlanes());
+
+    CPPUNIT_ASSERT(deinterlacer->doProcessFrame(frames[2], out));
+    CPPUNIT_ASSERT(out->getPresentationTime() == std::chrono::microseconds(2000));
+    CPPUNIT_ASSERT(deinterlacer->getDeinterlaced() == 2);
+
+    //NOTE: the previous and the current pictures are held
+    CPPUNIT_ASSERT(frames[0]->getRefs() == 1);
+    CPPUNIT_ASSERT(frames[1]->getRefs() == 2 && frames[2]->getRefs() == 2);
+
+    delete deinterlacer;
+    deinterlacer = NULL;
+
+    for (int i = 0; i < 3; i++) {
+        CPPUNIT_ASSERT(frames[i]->getRefs() == 1);
+        FramePool::getInstance()->releaseFrame(frames[i]);
+    }
+}
+
+void DeinterlacerTest::staticTest()
+{
+    auto pixel = [](int p, int x, int y) {return p*10 + x + 2*y;};
+    VideoFrame* frames[3];
+
+    for (int i = 0; i < 3; i++) {
+        frames[i] = picture(false, FO_TOP_FIRST, 1000*(i + 1), pixel);
+    }
+
+    CPPUNIT_ASSERT(!deinterlacer->doProcessFrame(frames[0], out));
+    CPPUNIT_ASSERT(deinterlacer->doProcessFrame(frames[1], out));
+    CPPUNIT_ASSERT(samePicture(out, frames[0]));
+    CPPUNIT_ASSERT(deinterlacer->doProcessFrame(frames[2], out));
+    CPPUNIT_ASSERT(samePicture(out, frames[1]));
+
+    for (int i = 0; i < 3; i++) {
+        delete frames[i];
+    }
+}
+
+void DeinterlacerTest::combTest()
+{
+    //NOTE: the fields do not match, the second one is rebuilt from the first one
+    auto comb = [](int /*p*/, int /*x*/, int y) {return y % 2 == 0 ? 200 : 50;};
+    VideoFrame* frames[2];
+
+    for (int i = 0; i < 2; i++) {
+        frames[i] = picture(false, FO_TOP_FIRST, 1000*(i + 1), comb);
+    }
+
+    CPPUNIT_ASSERT(!deinterlacer->doProcessFrame(frames[0], out));
+    CPPUNIT_ASSERT(deinterlacer->doProcessFrame(frames[1], out));
+    CPPUNIT_ASSERT(flatLuma(out, 200));
+
+    for (int i = 0; i < 2; i++) {
+        delete frames[i];
+    }
+}
+
+void DeinterlacerTest::bottomFirstTest()
+{
+    auto comb = [](int /*p*/, int /*x*/, int y) {return y % 2 == 0 ? 200 : 50;};
+    VideoFrame* frames[2];
+
+    //NOTE: unflagged pictures are deinterlaced as top field first in forced mode, flagged ones as they say
+    CPPUNIT_ASSERT(deinterlacer->configure0(true, 1));
+    frames[0] = picture(false, FO_BOTTOM_FIRST, 1000, comb);
+    frames[1] = picture(false, FO_PROGRESSIVE, 2000, comb);
+
+    CPPUNIT_ASSERT(!deinterlacer->doProcessFrame(frames[0], out));
+    CPPUNIT_ASSERT(deinterlacer->doProcessFrame(frames[1], out));
+    CPPUNIT_ASSERT(flatLuma(out, 50));
+
+    for (int i = 0; i < 2; i++) {
+        delete frames[i];
+    }
+}
+
+void DeinterlacerTest::bandsTest()
+{
+    DeinterlacerMock banded;
+    PlanarVideoFrame* bandedOut = PlanarVideoFrame::createNew(RAW, WIDTH, HEIGHT, YUV420P);
+    VideoFrame* frames[3];
+
+    srand(7);
+    for (int i = 0; i < 3; i++) {
+        frames[i] = picture(false, FO_TOP_FIRST, 1000*(i + 1), [](int, int, int) {return rand() % 256;});
+    }
+
+    CPPUNIT_ASSERT(!banded.configure0(false, DEINTERLACER_MAX_THREADS + 1));
+    CPPUNIT_ASSERT(banded.configure0(false, 4));
+
+    for (int i = 0; i < 3; i++) {
+        CPPUNIT_ASSERT(deinterlacer->doProcessFrame(frames[i], out) == (i > 0));
+        CPPUNIT_ASSERT(banded.doProcessFrame(frames[i], bandedOut) == (i > 0));
+        if (i > 0) {
+            CPPUNIT_ASSERT(samePicture(out, bandedOut));
+        }
+    }
+
+    //NOTE: the kept field lines are the ones of the input
+    CPPUNIT_ASSERT(memcmp(out->getPlanarDataBuf()[0], frames[1]->getPlanarDataBuf()[0], WIDTH) == 0);
+
+    for (int i = 0; i < 3; i++) {
+        delete frames[i];
+    }
+    delete bandedOut;
+}
+
+void DeinterlacerTest::boundaryTest()
+{
+    auto pixel = [](int p, int x, int y) {return p*50 + x + y;};
+    VideoFrame* first = picture(false, FO_TOP_FIRST, 1000, pixel);
+    VideoFrame* smaller = picture(false, FO_TOP_FIRST, 2000, pixel, WIDTH/2, HEIGHT/2);
+    VideoFrame* last = picture(false, FO_TOP_FIRST, 3000, pixel, WIDTH/2, HEIGHT/2);
+
+    CPPUNIT_ASSERT(!deinterlacer->doProcessFrame(first, out));
+
+    //NOTE: the last picture of the previous size is output when the size changes
+    CPPUNIT_ASSERT(deinterlacer->doProcessFrame(smaller, out));
+    CPPUNIT_ASSERT(out->getWidth() == WIDTH && out->getPresentationTime() == std::chrono::microseconds(1000));
+    CPPUNIT_ASSERT(samePicture(out, first));
+
+    CPPUNIT_ASSERT(deinterlacer->doProcessFrame(last, out));
+    CPPUNIT_ASSERT(out->getWidth() == WIDTH/2 && out->getPresentationTime() == std::chrono::microseconds(2000));
+    CPPUNIT_ASSERT(out->getFormatVersion() == 1);
+
+    delete first;
+    delete smaller;
+    delete last;
+}
+
+//NOTE: yadif filter_line with branches, for the pixels with room for the direction checks
+static int referencePixel(unsigned char const* prev, unsigned char const* cur, unsigned char const* next, int w, int x,
+                          int y)
+{
+    unsigned char const* cUp = cur + (y - 1)*w;
+    unsigned char const* cDown = cur + (y + 1)*w;
+    int c = cUp[x], e = cDown[x];
+    int d = (prev[y*w + x] + cur[y*w + x]) >> 1;
+    int diff = std::max(std::abs(prev[y*w + x] - cur[y*w + x]) >> 1,
+                        std::max((std::abs(prev[(y - 1)*w + x] - c) + std::abs(prev[(y + 1)*w + x] - e)) >> 1,
+                                 (std::abs(next[(y - 1)*w + x] - c) + std::abs(next[(y + 1)*w + x] - e)) >> 1));
+    int pred = (c + e) >> 1;
+    int score = std::abs(cUp[x - 1] - cDown[x - 1]) + std::abs(c - e) + std::abs(cUp[x + 1] - cDown[x + 1]) - 1;
+    int b = (prev[(y - 2)*w + x] + cur[(y - 2)*w + x]) >> 1;
+    int f = (prev[(y + 2)*w + x] + cur[(y + 2)*w + x]) >> 1;
+
+    for (int side = -1; side <= 1; side += 2) {
+        for (int j = side; j == side || j == 2*side; j += side) {
+            int s = std::abs(cUp[x - 1 + j] - cDown[x - 1 - j]) + std::abs(cUp[x + j] - cDown[x - j]) +
+                    std::abs(cUp[x + 1 + j] - cDown[x + 1 - j]);
+            if (s >= score) {
+                break;
+            }
+            score = s;
+            pred = (cUp[x + j] + cDown[x - j]) >> 1;
+        }
+    }
+
+    diff = std::max(diff, std::max(std::min(std::min(d - e, d - c), std::max(b - c, f - e)),
+                                   -std::max(std::max(d - e, d - c), std::min(b - c, f - e))));
+
+    return std::min(std::max(pred, d - diff), d + diff);
+}
+
+void DeinterlacerTest::referenceTest()
+{
+    std::vector<unsigned char> planes[4];
+    int linesize[4] = {WIDTH, WIDTH, WIDTH, WIDTH};
+
+    srand(3);
+    for (int i = 0; i < 4; i++) {
+        planes[i].resize(WIDTH*HEIGHT);
+    }
+
+    //NOTE: smooth pictures with noise, so there are edges to follow and motion to detect
+    for (int i = 1; i < 4; i++) {
+        for (int y = 0; y < HEIGHT; y++) {
+            for (int x = 0; x < WIDTH; x++) {
+                planes[i][y*WIDTH + x] = (3*x + 5*y + 40*i + rand() % 48) % 256;
+            }
+        }
+    }
+
+    Deinterlacer::filterPlane(planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data(), linesize,
+                              WIDTH, HEIGHT, true, 0, HEIGHT);
+
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            if (y % 2 == 0) {
+                CPPUNIT_ASSERT(planes[0][y*WIDTH + x] == planes[2][y*WIDTH + x]);
+            } else if (y >= 2 && y + 2 < HEIGHT && x >= 3 && x + 3 < WIDTH) {
+                CPPUNIT_ASSERT_EQUAL(referencePixel(planes[1].data(), planes[2].data(), planes[3].data(), WIDTH, x, y),
+                                     (int) planes[0][y*WIDTH + x]);
+            }
+        }
+    }
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DeinterlacerTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("DeinterlacerTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
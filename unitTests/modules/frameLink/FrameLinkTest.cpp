@@ -0,0 +1,480 @@
+/*
+ *  FrameLinkTest - FrameLink wire format and loopback transport test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This file is part of liveMediaStreamer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "FilterMockup.hh"
+#include "modules/frameLink/FrameLink.hh"
+#include "modules/frameLink/FrameLinkSender.hh"
+#include "modules/frameLink/FrameLinkReceiver.hh"
+
+#define LINK_TEST_PORT 23457
+#define LINK_TEST_PATH "/tmp/frameLinkTest.sock"
+#define FRAME_SIZE 5000
+#define RAW_WIDTH 1280
+#define RAW_HEIGHT 720
+
+/*! Tail filter keeping the last coded frame it reads */
+class CodedTailMockup : public TailFilter
+{
+public:
+    CodedTailMockup() : TailFilter(1), length(0), key(false), pts(0), frames(0) {};
+
+    void doGetState(Jzon::Object &/*filterNode*/) {};
+
+    unsigned char data[FRAME_SIZE];
+    unsigned length;
+    bool key;
+    std::chrono::microseconds pts;
+    unsigned frames;
+
+protected:
+    bool doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& /*ret*/) {
+        VideoFrame* frame;
+
+        if (newFrames.empty() || !(frame = dynamic_cast<VideoFrame*>(orgFrames.begin()->second))) {
+            return false;
+        }
+
+        length = frame->getLength();
+        memcpy(data, frame->getDataBuf(), length);
+        key = frame->isKeyFrame();
+        pts = frame->getPresentationTime();
+        frames++;
+
+        return true;
+    }
+
+private:
+    bool specificReaderConfig(int /*readerID*/, FrameQueue* /*queue*/) {return true;};
+    bool specificReaderDelete(int /*readerID*/) {return true;};
+    bool specificWriterConfig(int /*writerID*/) {return true;};
+    bool specificWriterDelete(int /*writerID*/) {return true;};
+};
+
+/*! Head filter writing the coded frames it is given */
+class CodedHeadMockup : public HeadFilter
+{
+public:
+    CodedHeadMockup() : HeadFilter(1), frame(NULL) {
+        si = new StreamInfo(VIDEO);
+        si->video.codec = H264;
+        si->setCodecDefaults();
+        si->video.frameTypes = true;
+    };
+
+    ~CodedHeadMockup() {delete si;};
+
+    void doGetState(Jzon::Object &/*filterNode*/) {};
+
+    StreamInfo* si;
+    InterleavedVideoFrame* frame;
+
+protected:
+    bool doProcessFrame(FrameMap &dstFrames, int& /*ret*/) {
+        VideoFrame* dst = dynamic_cast<VideoFrame*>(dstFrames.begin()->second);
+
+        if (!frame) {
+            return false;
+        }
+
+        memcpy(dst->getDataBuf(), frame->getDataBuf(), frame->getLength());
+        dst->setLength(frame->getLength());
+        dst->setPresentationTime(frame->getPresentationTime());
+        dst->setFrameType(frame->isKeyFrame(), true);
+        dst->setConsumed(true);
+        frame = NULL;
+
+        return true;
+    }
+
+private:
+    FrameQueue *allocQueue(struct ConnectionData cData) {
+        return VideoFrameQueue::createNew(cData, si, 10);
+    };
+
+    bool specificWriterConfig(int /*writerID*/) {return true;};
+    bool specificWriterDelete(int /*writerID*/) {return true;};
+};
+
+/*! Head filter writing YUV420P pictures whose pixels depend on their position and frame number */
+class RawHeadMockup : public HeadFilter
+{
+public:
+    RawHeadMockup() : HeadFilter(1), pending(false), number(0) {
+        si = new StreamInfo(VIDEO);
+        si->video.codec = RAW;
+        si->video.pixelFormat = YUV420P;
+    };
+
+    ~RawHeadMockup() {delete si;};
+
+    void doGetState(Jzon::Object &/*filterNode*/) {};
+
+    StreamInfo* si;
+    bool pending;
+    unsigned number;
+
+protected:
+    bool doProcessFrame(FrameMap &dstFrames, int& /*ret*/) {
+        VideoFrame* dst = dynamic_cast<VideoFrame*>(dstFrames.begin()->second);
+        unsigned char* data[MAX_PLANES];
+        int linesize[MAX_PLANES];
+        int lineBytes, rows;
+
+        if (!pending) {
+            return false;
+        }
+
+        dst->fitBuffer(RAW_WIDTH, RAW_HEIGHT, YUV420P);
+        dst->getPlanes(data, linesize);
+
+        for (unsigned i = 0; VideoFrame::planeSize(YUV420P, RAW_WIDTH, RAW_HEIGHT, i, lineBytes, rows); i++) {
+            for (int r = 0; r < rows; r++) {
+                for (int c = 0; c < lineBytes; c++) {
+                    data[i][r*linesize[i] + c] = (i*7 + r*3 + c + number) % 251;
+                }
+            }
+        }
+
+        dst->setPresentationTime(std::chrono::microseconds(1000*(number + 1)));
+        dst->setConsumed(true);
+        pending = false;
+        number++;
+
+        return true;
+    }
+
+private:
+    FrameQueue *allocQueue(struct ConnectionData cData) {
+        return VideoFrameQueue::createNew(cData, si, 4);
+    };
+
+    bool specificWriterConfig(int /*writerID*/) {return true;};
+    bool specificWriterDelete(int /*writerID*/) {return true;};
+};
+
+/*! Tail filter checking the pictures a RawHeadMockup writes */
+class RawTailMockup : public TailFilter
+{
+public:
+    RawTailMockup() : TailFilter(1), frames(0), valid(0) {};
+
+    void doGetState(Jzon::Object &/*filterNode*/) {};
+
+    unsigned frames;
+    unsigned valid;
+
+protected:
+    bool doProcessFrame(FrameMap &orgFrames, std::vector<int> &newFrames, int& /*ret*/) {
+        VideoFrame* frame;
+        unsigned char* data[MAX_PLANES];
+        int linesize[MAX_PLANES];
+        int lineBytes, rows;
+        unsigned number;
+        bool ok = true;
+
+        if (newFrames.empty() || !(frame = dynamic_cast<VideoFrame*>(orgFrames.begin()->second))) {
+            return false;
+        }
+
+        number = frame->getPresentationTime().count()/1000 - 1;
+        ok = frame->getWidth() == RAW_WIDTH && frame->getHeight() == RAW_HEIGHT && frame->getPlanes(data, linesize) > 0;
+
+        for (unsigned i = 0; ok && VideoFrame::planeSize(YUV420P, RAW_WIDTH, RAW_HEIGHT, i, lineBytes, rows); i++) {
+            for (int r = 0; ok && r < rows; r++) {
+                for (int c = 0; ok && c < lineBytes; c++) {
+                    ok = data[i][r*linesize[i] + c] == (i*7 + r*3 + c + number) % 251;
+                }
+            }
+        }
+
+        frames++;
+        valid += ok ? 1 : 0;
+
+        return true;
+    }
+
+private:
+    bool specificReaderConfig(int /*readerID*/, FrameQueue* /*queue*/) {return true;};
+    bool specificReaderDelete(int /*readerID*/) {return true;};
+    bool specificWriterConfig(int /*writerID*/) {return true;};
+    bool specificWriterDelete(int /*writerID*/) {return true;};
+};
+
+class FrameLinkTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(FrameLinkTest);
+    CPPUNIT_TEST(headerRoundTrip);
+    CPPUNIT_TEST(streamRoundTrip);
+    CPPUNIT_TEST(pictureRoundTrip);
+    CPPUNIT_TEST(loopbackLink);
+    CPPUNIT_TEST(rawBackpressureLink);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void headerRoundTrip();
+    void streamRoundTrip();
+    void pictureRoundTrip();
+    void loopbackLink();
+    void rawBackpressureLink();
+};
+
+void FrameLinkTest::headerRoundTrip()
+{
+    uint8_t buffer[LINK_HEADER_SIZE];
+    LinkHeader h = {LINK_MAGIC, LINK_VERSION, LINK_FRAME, 1234, LINK_KEY_FRAME, -40000, 1LL << 40, 7, 1024};
+    LinkHeader r;
+
+    FrameLink::writeHeader(buffer, h);
+    CPPUNIT_ASSERT(FrameLink::readHeader(buffer, r));
+    CPPUNIT_ASSERT(r.type == LINK_FRAME && r.length == 1234 && r.flags == LINK_KEY_FRAME);
+    CPPUNIT_ASSERT(r.pts == -40000 && r.dts == 1LL << 40 && r.seqNum == 7 && r.samples == 1024);
+
+    //NOTE: the length is sent first, so a bad magic tells a desynchronised stream
+    buffer[0] ^= 0xFF;
+    CPPUNIT_ASSERT(!FrameLink::readHeader(buffer, r));
+
+    h.length = LINK_MAX_PAYLOAD + 1;
+    FrameLink::writeHeader(buffer, h);
+    CPPUNIT_ASSERT(!FrameLink::readHeader(buffer, r));
+}
+
+void FrameLinkTest::streamRoundTrip()
+{
+    const uint8_t extradata[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x42};
+    std::vector<uint8_t> payload(LINK_STREAM_SIZE);
+    StreamInfo video(VIDEO), audio(AUDIO), read;
+
+    video.video.codec = H265;
+    video.setCodecDefaults();
+    video.bitrate = 3000;
+    video.setExtraData(extradata, sizeof(extradata));
+
+    FrameLink::writeStream(payload.data(), &video);
+    payload.insert(payload.end(), extradata, extradata + sizeof(extradata));
+
+    CPPUNIT_ASSERT(FrameLink::readStream(payload.data(), payload.size(), &read));
+    CPPUNIT_ASSERT(read.type == VIDEO && read.video.codec == H265 && read.bitrate == 3000);
+    CPPUNIT_ASSERT(read.video.h264or5.annexb && read.video.h264or5.framed && !read.video.frameTypes);
+    CPPUNIT_ASSERT(read.getExtraData() && *read.getExtraData() == *video.getExtraData());
+    CPPUNIT_ASSERT(FrameLink::sameStream(&read, &video));
+
+    audio.audio.codec = OPUS;
+    audio.audio.sampleRate = 48000;
+    audio.audio.channels = 2;
+    audio.audio.channelLayout = CL_NONE;
+    audio.setCodecDefaults();
+
+    FrameLink::writeStream(payload.data(), &audio);
+    CPPUNIT_ASSERT(FrameLink::readStream(payload.data(), LINK_STREAM_SIZE, &read));
+    CPPUNIT_ASSERT(read.type == AUDIO && read.audio.codec == OPUS && read.audio.channelLayout == CL_NONE);
+    CPPUNIT_ASSERT(!read.getExtraData());
+    CPPUNIT_ASSERT(!FrameLink::sameStream(&read, &video));
+
+    CPPUNIT_ASSERT(!FrameLink::readStream(payload.data(), LINK_STREAM_SIZE - 1, &read));
+
+    audio.audio.codec = PCM;
+    audio.audio.sampleFormat = S16P;
+    CPPUNIT_ASSERT(FrameLink::isLinkable(&audio));
+
+    //NOTE: raw pictures are only linked with a known pixel format
+    video.video.codec = RAW;
+    video.video.pixelFormat = P_NONE;
+    CPPUNIT_ASSERT(!FrameLink::isLinkable(&video));
+
+    video.video.pixelFormat = YUV420P;
+    FrameLink::writeStream(payload.data(), &video);
+    CPPUNIT_ASSERT(FrameLink::readStream(payload.data(), LINK_STREAM_SIZE, &read));
+    CPPUNIT_ASSERT(read.video.codec == RAW && read.video.pixelFormat == YUV420P);
+    CPPUNIT_ASSERT(FrameLink::sameStream(&read, &video));
+
+    read.video.pixelFormat = RGB24;
+    CPPUNIT_ASSERT(!FrameLink::sameStream(&read, &video));
+}
+
+void FrameLinkTest::pictureRoundTrip()
+{
+    LinkPicture p = {64, 32, YUV420P, 3, {128, 64, 64, 0}};
+    LinkPicture r;
+    size_t length = LINK_PICTURE_SIZE + 128*31 + 64 + 2*(64*15 + 32);
+    std::vector<uint8_t> payload(length);
+
+    FrameLink::writePicture(payload.data(), p);
+    CPPUNIT_ASSERT(FrameLink::readPicture(payload.data(), length, r));
+    CPPUNIT_ASSERT(r.width == 64 && r.height == 32 && r.pixelFormat == YUV420P && r.planes == 3);
+    CPPUNIT_ASSERT(r.stride[0] == 128 && r.stride[1] == 64 && r.stride[2] == 64);
+
+    //NOTE: the padded planes must fit the payload, and lines their stride
+    CPPUNIT_ASSERT(!FrameLink::readPicture(payload.data(), length - 1, r));
+
+    p.stride[1] = 16;
+    FrameLink::writePicture(payload.data(), p);
+    CPPUNIT_ASSERT(!FrameLink::readPicture(payload.data(), length, r));
+
+    p.stride[1] = 64;
+    p.planes = 1;
+    FrameLink::writePicture(payload.data(), p);
+    CPPUNIT_ASSERT(!FrameLink::readPicture(payload.data(), length, r));
+}
+
+void FrameLinkTest::loopbackLink()
+{
+    int ret = 0;
+    StreamInfo si(VIDEO);
+    CodedHeadMockup* head = new CodedHeadMockup();
+    FrameLinkSender* sender = new FrameLinkSender();
+    FrameLinkReceiver* receiver;
+    CodedTailMockup* tail = new CodedTailMockup();
+    InterleavedVideoFrame* frame = InterleavedVideoFrame::createNew(H264, FRAME_SIZE);
+
+    si.video.codec = H264;
+    si.setCodecDefaults();
+    si.video.frameTypes = true;
+    receiver = FrameLinkReceiver::createNew(si);
+
+    CPPUNIT_ASSERT(receiver);
+    CPPUNIT_ASSERT(receiver->listenPort(LINK_TEST_PORT));
+    CPPUNIT_ASSERT(sender->configure("127.0.0.1", LINK_TEST_PORT));
+
+    head->setId(1);
+    sender->setId(2);
+    receiver->setId(3);
+    tail->setId(4);
+
+    CPPUNIT_ASSERT(head->connectOneToOne(sender));
+    CPPUNIT_ASSERT(receiver->connectOneToOne(tail));
+
+    for (unsigned i = 0; i < FRAME_SIZE; i++) {
+        frame->getDataBuf()[i] = i % 251;
+    }
+    frame->setLength(FRAME_SIZE);
+
+    //NOTE: the sender waits for a keyframe, so the receiver gets a decodable stream
+    for (unsigned n = 0; n < 50 && tail->frames < 2; n++) {
+        frame->setPresentationTime(std::chrono::microseconds(1000*(n + 1)));
+        frame->setFrameType(n % 10 == 5, true);
+        head->frame = frame;
+
+        head->processFrame(ret);
+        sender->processFrame(ret);
+        receiver->processFrame(ret);
+        tail->processFrame(ret);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    CPPUNIT_ASSERT(tail->frames >= 1);
+    CPPUNIT_ASSERT(tail->length == FRAME_SIZE);
+    CPPUNIT_ASSERT(memcmp(tail->data, frame->getDataBuf(), FRAME_SIZE) == 0);
+    CPPUNIT_ASSERT(tail->pts.count() >= 6000);
+
+    delete head;
+    delete sender;
+    delete receiver;
+    delete tail;
+    delete frame;
+}
+
+void FrameLinkTest::rawBackpressureLink()
+{
+    int ret = 0;
+    StreamInfo si(VIDEO);
+    RawHeadMockup* head = new RawHeadMockup();
+    FrameLinkSender* sender = new FrameLinkSender();
+    FrameLinkReceiver* receiver;
+    RawTailMockup* tail = new RawTailMockup();
+    unsigned held = 0;
+    int dropped = 0;
+
+    si.video.codec = RAW;
+    si.video.pixelFormat = YUV420P;
+    receiver = FrameLinkReceiver::createNew(si);
+
+    CPPUNIT_ASSERT(receiver);
+    CPPUNIT_ASSERT(receiver->listenPath(LINK_TEST_PATH));
+    CPPUNIT_ASSERT(sender->configurePath(LINK_TEST_PATH));
+    sender->setBackpressure(true);
+
+    head->setId(1);
+    sender->setId(2);
+    receiver->setId(3);
+    tail->setId(4);
+
+    CPPUNIT_ASSERT(head->connectOneToOne(sender));
+    CPPUNIT_ASSERT(receiver->connectOneToOne(tail));
+
+    //NOTE: a picture is larger than the socket buffer, so it is held until the receiver reads it
+    for (unsigned n = 0; n < 500 && tail->frames < 3; n++) {
+        if (!head->pending && head->number < 3) {
+            head->pending = true;
+            head->processFrame(ret);
+        }
+
+        sender->processFrame(ret);
+
+        Jzon::Object state;
+        sender->getState(state);
+        held += state.Get("held").ToBool() ? 1 : 0;
+        dropped = state.Get("dropped").ToInt();
+
+        receiver->processFrame(ret);
+        tail->processFrame(ret);
+    }
+
+    CPPUNIT_ASSERT(held > 0);
+    CPPUNIT_ASSERT(tail->frames == 3 && tail->valid == 3);
+    CPPUNIT_ASSERT(dropped == 0);
+
+    delete head;
+    delete sender;
+    delete receiver;
+    delete tail;
+
+    CPPUNIT_ASSERT(access(LINK_TEST_PATH, F_OK) != 0);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(FrameLinkTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("FrameLinkTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
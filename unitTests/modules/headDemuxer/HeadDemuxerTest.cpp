@@ -36,6 +36,7 @@ class HeadDemuxerTest : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(HeadDemuxerTest);
     CPPUNIT_TEST(demuxingTest);
+    CPPUNIT_TEST(streamSelectionTest);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -44,6 +45,7 @@ public:
 
 protected:
     void demuxingTest();
+    void streamSelectionTest();
 
     HeadDemuxerLibav* demuxer;
 };
@@ -98,6 +100,33 @@ void HeadDemuxerTest::demuxingTest()
     */
 }
 
+void HeadDemuxerTest::streamSelectionTest()
+{
+    static const std::string good_uri = "http://download.blender.org/durian/trailer/sintel_trailer-480p.mp4";
+    Jzon::Object state;
+
+    CPPUNIT_ASSERT (!demuxer->selectStreams (-2, std::vector<int>()));
+    CPPUNIT_ASSERT (!demuxer->selectStreams (DEMUX_ALL_PROGRAMS, std::vector<int>({-1})));
+
+    // No program of a MP4 file has this number
+    CPPUNIT_ASSERT (demuxer->selectStreams (1234, std::vector<int>()));
+    CPPUNIT_ASSERT (demuxer->setURI (good_uri) == false);
+
+    // The audio track id, only the stream selected gets a writer
+    CPPUNIT_ASSERT (demuxer->selectStreams (DEMUX_ALL_PROGRAMS, std::vector<int>({2})));
+    CPPUNIT_ASSERT (demuxer->setURI (good_uri));
+    demuxer->getState (state);
+
+    CPPUNIT_ASSERT (state.Get("program").ToInt() == DEMUX_ALL_PROGRAMS);
+    CPPUNIT_ASSERT (state.Get("pids").AsArray().GetCount() == 1);
+
+    Jzon::Array &array = state.Get("streams").AsArray();
+    CPPUNIT_ASSERT (array.GetCount() == 1);
+    CPPUNIT_ASSERT (array.Get(0).Get("wId").ToInt() == 1);
+    CPPUNIT_ASSERT (array.Get(0).Get("pid").ToInt() == 2);
+    CPPUNIT_ASSERT (array.Get(0).Get("type").ToInt() == AUDIO);
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(HeadDemuxerTest);
 
 int main(int argc, char* argv[])
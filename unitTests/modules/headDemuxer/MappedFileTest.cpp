@@ -0,0 +1,177 @@
+/*
+ *  MappedFileTest.cpp - MappedFile class test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Xavi Artigas <xavier.artigas@i2cat.net>
+ *
+ */
+
+#include <string>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <unistd.h>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/headDemuxer/MappedFile.hh"
+#include "Utils.hh"
+
+#define FILE_SIZE (MAPPED_FILE_PREFETCH + 12345)
+
+class MappedFileTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(MappedFileTest);
+    CPPUNIT_TEST(localPath);
+    CPPUNIT_TEST(invalidFiles);
+    CPPUNIT_TEST(sequentialRead);
+    CPPUNIT_TEST(seekAndRead);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void localPath();
+    void invalidFiles();
+    void sequentialRead();
+    void seekAndRead();
+
+    std::string path;
+    std::vector<uint8_t> content;
+    MappedFile* file;
+};
+
+void MappedFileTest::setUp()
+{
+    char name[] = "/tmp/mappedFileTestXXXXXX";
+    int fd = mkstemp(name);
+    std::ofstream out;
+
+    CPPUNIT_ASSERT(fd >= 0);
+    close(fd);
+    path = name;
+
+    content.resize(FILE_SIZE);
+    for (size_t i = 0; i < content.size(); i++) {
+        content[i] = (i * 7 + i / 251) & 0xFF;
+    }
+
+    out.open(path.c_str(), std::ios::binary);
+    out.write((const char*) content.data(), content.size());
+    out.close();
+
+    file = new MappedFile();
+}
+
+void MappedFileTest::tearDown()
+{
+    delete file;
+    remove(path.c_str());
+}
+
+void MappedFileTest::localPath()
+{
+    CPPUNIT_ASSERT(MappedFile::localPath("file:/tmp/a.mp4") == "/tmp/a.mp4");
+    CPPUNIT_ASSERT(MappedFile::localPath("file:///tmp/a.mp4") == "/tmp/a.mp4");
+    CPPUNIT_ASSERT(MappedFile::localPath("movies/a.mp4") == "movies/a.mp4");
+    CPPUNIT_ASSERT(MappedFile::localPath("rtsp://host/a.mp4").empty());
+    CPPUNIT_ASSERT(MappedFile::localPath("http://host/a.mp4").empty());
+}
+
+void MappedFileTest::invalidFiles()
+{
+    std::ofstream out;
+    std::string empty = path + ".empty";
+
+    CPPUNIT_ASSERT(!file->open("/tmp/mappedFileTest/none.mp4"));
+    CPPUNIT_ASSERT(!file->open("/tmp"));
+    CPPUNIT_ASSERT(!file->open("rtsp://localhost/a.mp4"));
+
+    out.open(empty.c_str());
+    out.close();
+    CPPUNIT_ASSERT(!file->open(empty));
+    remove(empty.c_str());
+
+    CPPUNIT_ASSERT(!file->isOpen());
+    CPPUNIT_ASSERT(file->seek(0, SEEK_SET) == -1);
+}
+
+void MappedFileTest::sequentialRead()
+{
+    std::vector<uint8_t> read;
+    uint8_t buffer[4096];
+    size_t bytes;
+
+    CPPUNIT_ASSERT(file->open("file:" + path));
+    CPPUNIT_ASSERT(file->getSize() == FILE_SIZE);
+
+    while ((bytes = file->read(buffer, sizeof(buffer))) > 0) {
+        read.insert(read.end(), buffer, buffer + bytes);
+    }
+
+    CPPUNIT_ASSERT(read == content);
+    CPPUNIT_ASSERT(file->getPosition() == FILE_SIZE);
+    CPPUNIT_ASSERT(file->read(buffer, sizeof(buffer)) == 0);
+}
+
+void MappedFileTest::seekAndRead()
+{
+    uint8_t buffer[100];
+
+    CPPUNIT_ASSERT(file->open(path));
+
+    CPPUNIT_ASSERT(file->seek(FILE_SIZE - 10, SEEK_SET) == FILE_SIZE - 10);
+    CPPUNIT_ASSERT(file->read(buffer, sizeof(buffer)) == 10);
+    CPPUNIT_ASSERT(buffer[0] == content[FILE_SIZE - 10]);
+
+    CPPUNIT_ASSERT(file->seek(-50, SEEK_END) == FILE_SIZE - 50);
+    CPPUNIT_ASSERT(file->seek(-1000, SEEK_CUR) == FILE_SIZE - 1050);
+    CPPUNIT_ASSERT(file->read(buffer, sizeof(buffer)) == sizeof(buffer));
+    CPPUNIT_ASSERT(buffer[99] == content[FILE_SIZE - 1050 + 99]);
+
+    CPPUNIT_ASSERT(file->seek(-1, SEEK_SET) == -1);
+    CPPUNIT_ASSERT(file->seek(1, SEEK_END) == -1);
+    CPPUNIT_ASSERT(file->getPosition() == FILE_SIZE - 950);
+
+    CPPUNIT_ASSERT(file->seek(0, SEEK_SET) == 0);
+    CPPUNIT_ASSERT(file->read(buffer, sizeof(buffer)) == sizeof(buffer));
+    CPPUNIT_ASSERT(buffer[1] == content[1]);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MappedFileTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("MappedFileTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,237 @@
+/*
+ *  LoudnessNormalizerTest.cpp - LoudnessNormalizer class test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cmath>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/loudnessNormalizer/LoudnessNormalizer.hh"
+#include "AudioCircularBuffer.hh"
+#include "Utils.hh"
+
+#define CHANNELS 2
+#define SAMPLE_RATE 48000
+#define FRAME_SAMPLES 1024
+
+class LoudnessNormalizerMock : public LoudnessNormalizer {
+public:
+    LoudnessNormalizerMock() : LoudnessNormalizer(CHANNELS, SAMPLE_RATE, FLTP) {};
+    using LoudnessNormalizer::doProcessFrame;
+    using LoudnessNormalizer::specificReaderConfig;
+    using LoudnessNormalizer::configure0;
+};
+
+class LoudnessNormalizerTest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(LoudnessNormalizerTest);
+    CPPUNIT_TEST(createTest);
+    CPPUNIT_TEST(readerConfigTest);
+    CPPUNIT_TEST(normalizeTest);
+    CPPUNIT_TEST(maxGainTest);
+    CPPUNIT_TEST(silenceTest);
+    CPPUNIT_TEST(measureOnlyTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void createTest();
+    void readerConfigTest();
+    void normalizeTest();
+    void maxGainTest();
+    void silenceTest();
+    void measureOnlyTest();
+
+    //NOTE: 1 kHz sine in both channels, of loudness 20*log10(amplitude) LUFS; the output is measured by output
+    void feed(float amplitude, double seconds, LoudnessMeter* output = NULL);
+
+    LoudnessNormalizerMock* normalizer;
+    AudioCircularBuffer* queue;
+    PlanarAudioFrame* in;
+    PlanarAudioFrame* out;
+    size_t phase;
+};
+
+void LoudnessNormalizerTest::setUp()
+{
+    struct ConnectionData cData;
+
+    normalizer = new LoudnessNormalizerMock();
+    queue = AudioCircularBuffer::createNew(cData, CHANNELS, SAMPLE_RATE, DEFAULT_BUFFER_SIZE, FLTP);
+    in = PlanarAudioFrame::createNew(CHANNELS, SAMPLE_RATE, FRAME_SAMPLES, PCM, FLTP);
+    out = PlanarAudioFrame::createNew(CHANNELS, SAMPLE_RATE, FRAME_SAMPLES, PCM, FLTP);
+    phase = 0;
+
+    CPPUNIT_ASSERT(normalizer->specificReaderConfig(1, queue));
+}
+
+void LoudnessNormalizerTest::tearDown()
+{
+    delete normalizer;
+    delete queue;
+    delete in;
+    delete out;
+}
+
+void LoudnessNormalizerTest::feed(float amplitude, double seconds, LoudnessMeter* output)
+{
+    size_t frames = seconds*SAMPLE_RATE/FRAME_SAMPLES;
+    float const* planes[CHANNELS];
+    float sample;
+
+    for (size_t f = 0; f < frames; f++) {
+        for (unsigned i = 0; i < FRAME_SAMPLES; i++, phase++) {
+            sample = amplitude*sin(2*M_PI*1000.0*phase/SAMPLE_RATE);
+            for (unsigned c = 0; c < CHANNELS; c++) {
+                ((float*) in->getPlanarDataBuf()[c])[i] = sample;
+            }
+        }
+
+        in->setSamples(FRAME_SAMPLES);
+        in->setLength(FRAME_SAMPLES*sizeof(float));
+        out->setConsumed(false);
+
+        CPPUNIT_ASSERT(normalizer->doProcessFrame(in, out));
+        CPPUNIT_ASSERT(out->getConsumed() && out->getSamples() == FRAME_SAMPLES);
+
+        if (output) {
+            for (unsigned c = 0; c < CHANNELS; c++) {
+                planes[c] = (float const*) out->getPlanarDataBuf()[c];
+            }
+            output->process(planes, FRAME_SAMPLES);
+        }
+    }
+}
+
+void LoudnessNormalizerTest::createTest()
+{
+    LoudnessNormalizer* tmp;
+
+    tmp = LoudnessNormalizer::createNew(0);
+    CPPUNIT_ASSERT(!tmp);
+
+    tmp = LoudnessNormalizer::createNew(2, SAMPLE_RATE, S_NONE);
+    CPPUNIT_ASSERT(!tmp);
+
+    tmp = LoudnessNormalizer::createNew(6, 44100, S16);
+    CPPUNIT_ASSERT(tmp);
+    CPPUNIT_ASSERT(tmp->getGain() == 0);
+    delete tmp;
+}
+
+void LoudnessNormalizerTest::readerConfigTest()
+{
+    struct ConnectionData cData;
+    AudioCircularBuffer* mono;
+
+    mono = AudioCircularBuffer::createNew(cData, 1, SAMPLE_RATE, DEFAULT_BUFFER_SIZE, FLTP);
+    CPPUNIT_ASSERT(!normalizer->specificReaderConfig(2, mono));
+    delete mono;
+
+    CPPUNIT_ASSERT(!normalizer->configure0(10, LNORM_DEFAULT_MAX_GAIN, LNORM_DEFAULT_SMOOTHING, true));
+    CPPUNIT_ASSERT(!normalizer->configure0(LNORM_DEFAULT_TARGET, -1, LNORM_DEFAULT_SMOOTHING, true));
+    CPPUNIT_ASSERT(!normalizer->configure0(LNORM_DEFAULT_TARGET, LNORM_DEFAULT_MAX_GAIN, 0, true));
+}
+
+void LoudnessNormalizerTest::normalizeTest()
+{
+    LoudnessMeter output;
+
+    CPPUNIT_ASSERT(output.configure(CHANNELS, SAMPLE_RATE));
+    CPPUNIT_ASSERT(normalizer->configure0(LNORM_DEFAULT_TARGET, LNORM_DEFAULT_MAX_GAIN, 1000, true));
+
+    feed(pow(10, -33/20.0), 15);
+    CPPUNIT_ASSERT(fabs(normalizer->getMeter().getIntegrated() + 33) < 0.2);
+    CPPUNIT_ASSERT(fabs(normalizer->getGain() - 10) < 0.3);
+
+    feed(pow(10, -33/20.0), 5, &output);
+    CPPUNIT_ASSERT(fabs(output.getIntegrated() - LNORM_DEFAULT_TARGET) < 0.3);
+
+    //NOTE: louder inputs are lowered
+    feed(pow(10, -13/20.0), 15);
+    CPPUNIT_ASSERT(fabs(normalizer->getGain() + 10) < 0.3);
+}
+
+void LoudnessNormalizerTest::maxGainTest()
+{
+    CPPUNIT_ASSERT(normalizer->configure0(LNORM_DEFAULT_TARGET, 6, 1000, true));
+
+    feed(pow(10, -50/20.0), 15);
+    CPPUNIT_ASSERT(fabs(normalizer->getGain() - 6) < 0.1);
+}
+
+void LoudnessNormalizerTest::silenceTest()
+{
+    double gain;
+
+    CPPUNIT_ASSERT(normalizer->configure0(LNORM_DEFAULT_TARGET, LNORM_DEFAULT_MAX_GAIN, 1000, true));
+
+    feed(pow(10, -30/20.0), 15);
+    gain = normalizer->getGain();
+    CPPUNIT_ASSERT(fabs(gain - 7) < 0.3);
+
+    //NOTE: once the short-term window is over the pause the gain is held
+    feed(0, 3);
+    gain = normalizer->getGain();
+    feed(0, 5);
+    CPPUNIT_ASSERT(normalizer->getGain() == gain);
+    CPPUNIT_ASSERT(gain > 5);
+}
+
+void LoudnessNormalizerTest::measureOnlyTest()
+{
+    CPPUNIT_ASSERT(normalizer->configure0(LNORM_DEFAULT_TARGET, LNORM_DEFAULT_MAX_GAIN, 1000, false));
+
+    feed(0.5, 2);
+    CPPUNIT_ASSERT(normalizer->getGain() == 0);
+
+    for (unsigned c = 0; c < CHANNELS; c++) {
+        CPPUNIT_ASSERT(memcmp(in->getPlanarDataBuf()[c], out->getPlanarDataBuf()[c], FRAME_SAMPLES*sizeof(float)) == 0);
+    }
+
+    CPPUNIT_ASSERT(fabs(normalizer->getMeter().getMomentary() - 20*log10(0.5)) < 0.1);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LoudnessNormalizerTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("LoudnessNormalizerTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+    delete outputter;
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
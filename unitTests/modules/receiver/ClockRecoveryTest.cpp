@@ -0,0 +1,196 @@
+/*
+ *  ClockRecoveryTest.cpp - ClockRecovery class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/receiver/ClockRecovery.hh"
+#include "Utils.hh"
+
+#define FRAME_TIME 20000
+#define SOURCE_EPOCH 3600000000LL
+#define NETWORK_DELAY 30000
+#define NETWORK_JITTER 10000
+
+class ClockRecoveryTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ClockRecoveryTest);
+    CPPUNIT_TEST(firstFrame);
+    CPPUNIT_TEST(jitterAndSkew);
+    CPPUNIT_TEST(remapping);
+    CPPUNIT_TEST(reordering);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+
+protected:
+    void firstFrame();
+    void jitterAndSkew();
+    void remapping();
+    void reordering();
+
+    std::chrono::microseconds feed(ClockRecovery& recovery, int64_t pts, double skew, int64_t jitter);
+    int64_t arrival(int64_t pts, double skew) const;
+
+    std::chrono::steady_clock::time_point start;
+};
+
+void ClockRecoveryTest::setUp()
+{
+    start = std::chrono::steady_clock::now();
+    srand(1);
+}
+
+//NOTE: arrival time in usec since the start of the local clock of a frame sent at pts by a source whose
+//      clock runs skew faster than the local one
+int64_t ClockRecoveryTest::arrival(int64_t pts, double skew) const
+{
+    return (int64_t) ((pts - SOURCE_EPOCH)/(1 + skew)) + NETWORK_DELAY;
+}
+
+std::chrono::microseconds ClockRecoveryTest::feed(ClockRecovery& recovery, int64_t pts, double skew, int64_t jitter)
+{
+    int64_t delay = jitter > 0 ? rand() % jitter : 0;
+
+    return recovery.recover(std::chrono::microseconds(pts),
+                            start + std::chrono::microseconds(arrival(pts, skew) + delay));
+}
+
+void ClockRecoveryTest::firstFrame()
+{
+    ClockRecovery recovery;
+    std::chrono::microseconds first, second;
+
+    CPPUNIT_ASSERT(!recovery.isLocked());
+
+    first = feed(recovery, SOURCE_EPOCH, 0, 0);
+    CPPUNIT_ASSERT(recovery.isLocked());
+
+    //NOTE: recovered times are on the local clock, in the system clock epoch
+    CPPUNIT_ASSERT(std::abs((first - std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())).count()) < 1000000);
+
+    //NOTE: units of the same frame get the same time
+    CPPUNIT_ASSERT(feed(recovery, SOURCE_EPOCH, 0, 0) == first);
+
+    second = feed(recovery, SOURCE_EPOCH + FRAME_TIME, 0, 0);
+    CPPUNIT_ASSERT(second - first == std::chrono::microseconds(FRAME_TIME));
+    CPPUNIT_ASSERT(recovery.getResyncs() == 0);
+}
+
+void ClockRecoveryTest::jitterAndSkew()
+{
+    ClockRecovery recovery;
+    const double skew = 200e-6;
+    const unsigned frames = 15000;
+    std::chrono::microseconds out, last;
+    int64_t interval;
+    int64_t maxDeviation = 0;
+
+    for (unsigned i = 0; i < frames; i++) {
+        out = feed(recovery, SOURCE_EPOCH + i*FRAME_TIME, skew, NETWORK_JITTER);
+
+        //NOTE: once locked, the frame intervals are the source ones on the local clock
+        if (i > frames/2) {
+            interval = (out - last).count() - (int64_t) (FRAME_TIME/(1 + skew));
+            maxDeviation = std::max(maxDeviation, std::abs(interval));
+        }
+
+        last = out;
+    }
+
+    CPPUNIT_ASSERT(maxDeviation < NETWORK_JITTER/20);
+    CPPUNIT_ASSERT(std::abs(recovery.getSkew() - skew*1e6) < 50);
+    CPPUNIT_ASSERT(recovery.getResyncs() == 0);
+}
+
+void ClockRecoveryTest::remapping()
+{
+    ClockRecovery recovery;
+    std::chrono::microseconds out, last;
+    const int64_t step = 20000;
+    unsigned i;
+
+    for (i = 0; i < 1000; i++) {
+        last = feed(recovery, SOURCE_EPOCH + i*FRAME_TIME, 0, 0);
+    }
+
+    //NOTE: a small step of the source timeline is slewed back to the arrival timeline
+    for (; i < 3000; i++) {
+        out = recovery.recover(std::chrono::microseconds(SOURCE_EPOCH + i*FRAME_TIME + step),
+                               start + std::chrono::microseconds(arrival(SOURCE_EPOCH + i*FRAME_TIME, 0)));
+        CPPUNIT_ASSERT(i == 1000 || std::abs((out - last).count() - FRAME_TIME) < step/20);
+        last = out;
+    }
+
+    CPPUNIT_ASSERT(std::abs(recovery.getError().count()) < step/100);
+    CPPUNIT_ASSERT(recovery.getResyncs() == 0);
+
+    //NOTE: a large one restarts the recovery
+    recovery.recover(std::chrono::microseconds(SOURCE_EPOCH + 10000000000LL),
+                     start + std::chrono::microseconds(arrival(SOURCE_EPOCH + i*FRAME_TIME, 0)));
+    CPPUNIT_ASSERT(recovery.getResyncs() == 1);
+    CPPUNIT_ASSERT(recovery.getError().count() == 0);
+}
+
+void ClockRecoveryTest::reordering()
+{
+    ClockRecovery recovery;
+    std::chrono::microseconds first, next, reordered, last;
+
+    first = feed(recovery, SOURCE_EPOCH, 0, 0);
+    next = feed(recovery, SOURCE_EPOCH + 3*FRAME_TIME, 0, 0);
+
+    //NOTE: a B picture displayed before the last received frame is mapped between them
+    reordered = feed(recovery, SOURCE_EPOCH + FRAME_TIME, 0, 0);
+    CPPUNIT_ASSERT(reordered > first && reordered < next);
+    CPPUNIT_ASSERT(reordered - first == std::chrono::microseconds(FRAME_TIME));
+
+    last = feed(recovery, SOURCE_EPOCH + 4*FRAME_TIME, 0, 0);
+    CPPUNIT_ASSERT(last - next == std::chrono::microseconds(FRAME_TIME));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ClockRecoveryTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("ClockRecoveryTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+/*
+ *  GopCacheTest.cpp - GopCache class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/receiver/GopCache.hh"
+#include "Utils.hh"
+
+#define NAL_SIZE 100
+#define FRAME_TIME 40000
+
+class GopCacheTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(GopCacheTest);
+    CPPUNIT_TEST(waitKeyframe);
+    CPPUNIT_TEST(newGop);
+    CPPUNIT_TEST(multipleSlices);
+    CPPUNIT_TEST(h265);
+    CPPUNIT_TEST(overflow);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void waitKeyframe();
+    void newGop();
+    void multipleSlices();
+    void h265();
+    void overflow();
+
+    void push(GopCache& cache, unsigned char header, unsigned char slice, int64_t pts, unsigned size = NAL_SIZE);
+    void pushH265(GopCache& cache, unsigned type, unsigned char slice, int64_t pts);
+    unsigned char popType(GopCache& cache, int64_t& pts);
+};
+
+void GopCacheTest::push(GopCache& cache, unsigned char header, unsigned char slice, int64_t pts, unsigned size)
+{
+    unsigned char* buffer = cache.writeBuffer(size);
+
+    memset(buffer, 0, size);
+    buffer[3] = 0x01;
+    buffer[4] = header;
+    buffer[5] = slice;
+    cache.push(size, std::chrono::microseconds(pts));
+}
+
+void GopCacheTest::pushH265(GopCache& cache, unsigned type, unsigned char slice, int64_t pts)
+{
+    unsigned char* buffer = cache.writeBuffer(NAL_SIZE);
+
+    memset(buffer, 0, NAL_SIZE);
+    buffer[3] = 0x01;
+    buffer[4] = type << 1;
+    buffer[5] = 0x01;
+    buffer[6] = slice;
+    cache.push(NAL_SIZE, std::chrono::microseconds(pts));
+}
+
+unsigned char GopCacheTest::popType(GopCache& cache, int64_t& pts)
+{
+    unsigned char out[NAL_SIZE];
+    std::chrono::microseconds outPts;
+    unsigned length;
+
+    if (!cache.pop(out, NAL_SIZE, length, outPts)) {
+        return 0xFF;
+    }
+
+    pts = outPts.count();
+    return out[4];
+}
+
+void GopCacheTest::waitKeyframe()
+{
+    GopCache cache(H264);
+    int64_t pts;
+
+    push(cache, 0x41, 0x80, 0);
+    CPPUNIT_ASSERT(cache.empty());
+
+    push(cache, 0x67, 0, FRAME_TIME);
+    push(cache, 0x68, 0, FRAME_TIME);
+    CPPUNIT_ASSERT(cache.getUnits() == 2);
+    CPPUNIT_ASSERT(!cache.isKeyed());
+
+    push(cache, 0x65, 0x80, FRAME_TIME);
+    push(cache, 0x41, 0x80, 2*FRAME_TIME);
+    CPPUNIT_ASSERT(cache.isKeyed());
+    CPPUNIT_ASSERT(cache.getUnits() == 4);
+    CPPUNIT_ASSERT(cache.getSize() == 4*NAL_SIZE);
+
+    CPPUNIT_ASSERT(popType(cache, pts) == 0x67);
+    CPPUNIT_ASSERT(pts == FRAME_TIME);
+    CPPUNIT_ASSERT(popType(cache, pts) == 0x68);
+    CPPUNIT_ASSERT(popType(cache, pts) == 0x65);
+    CPPUNIT_ASSERT(popType(cache, pts) == 0x41);
+    CPPUNIT_ASSERT(pts == 2*FRAME_TIME);
+    CPPUNIT_ASSERT(popType(cache, pts) == 0xFF);
+    CPPUNIT_ASSERT(cache.getSize() == 0);
+}
+
+void GopCacheTest::newGop()
+{
+    GopCache cache(H264);
+    int64_t pts;
+
+    push(cache, 0x67, 0, 0);
+    push(cache, 0x68, 0, 0);
+    push(cache, 0x65, 0x80, 0);
+    push(cache, 0x06, 0, FRAME_TIME);
+    push(cache, 0x41, 0x80, FRAME_TIME);
+    push(cache, 0x41, 0x80, 2*FRAME_TIME);
+    CPPUNIT_ASSERT(cache.getUnits() == 6);
+
+    push(cache, 0x09, 0, 3*FRAME_TIME);
+    push(cache, 0x67, 0, 3*FRAME_TIME);
+    push(cache, 0x68, 0, 3*FRAME_TIME);
+    CPPUNIT_ASSERT(cache.getUnits() == 9);
+
+    push(cache, 0x65, 0x80, 3*FRAME_TIME);
+    CPPUNIT_ASSERT(cache.getUnits() == 4);
+    CPPUNIT_ASSERT(popType(cache, pts) == 0x09);
+    CPPUNIT_ASSERT(pts == 3*FRAME_TIME);
+    CPPUNIT_ASSERT(popType(cache, pts) == 0x67);
+
+    cache.clear();
+    CPPUNIT_ASSERT(cache.empty());
+    CPPUNIT_ASSERT(!cache.isKeyed());
+
+    push(cache, 0x65, 0x80, 4*FRAME_TIME);
+    CPPUNIT_ASSERT(cache.isKeyed());
+    CPPUNIT_ASSERT(popType(cache, pts) == 0x65);
+}
+
+void GopCacheTest::multipleSlices()
+{
+    GopCache cache(H264);
+
+    push(cache, 0x65, 0x80, 0);
+    push(cache, 0x65, 0x20, 0);
+    push(cache, 0x65, 0x10, 0);
+    CPPUNIT_ASSERT(cache.getUnits() == 3);
+
+    push(cache, 0x41, 0x80, FRAME_TIME);
+    push(cache, 0x41, 0x20, FRAME_TIME);
+    CPPUNIT_ASSERT(cache.getUnits() == 5);
+
+    cache.clear();
+    push(cache, 0x65, 0x20, 2*FRAME_TIME);
+    CPPUNIT_ASSERT(cache.empty());
+}
+
+void GopCacheTest::h265()
+{
+    GopCache cache(H265);
+    int64_t pts;
+
+    pushH265(cache, 1, 0x80, 0);
+    CPPUNIT_ASSERT(cache.empty());
+
+    pushH265(cache, 32, 0, FRAME_TIME);
+    pushH265(cache, 33, 0, FRAME_TIME);
+    pushH265(cache, 34, 0, FRAME_TIME);
+    pushH265(cache, 21, 0x80, FRAME_TIME);
+    pushH265(cache, 21, 0x00, FRAME_TIME);
+    pushH265(cache, 1, 0x80, 2*FRAME_TIME);
+    CPPUNIT_ASSERT(cache.isKeyed());
+    CPPUNIT_ASSERT(cache.getUnits() == 6);
+
+    pushH265(cache, 19, 0x80, 3*FRAME_TIME);
+    CPPUNIT_ASSERT(cache.getUnits() == 1);
+    CPPUNIT_ASSERT(popType(cache, pts) == 19 << 1);
+    CPPUNIT_ASSERT(pts == 3*FRAME_TIME);
+}
+
+void GopCacheTest::overflow()
+{
+    GopCache cache(H264, 10*NAL_SIZE);
+    unsigned char out[2*NAL_SIZE];
+    std::chrono::microseconds outPts;
+    unsigned length;
+
+    push(cache, 0x65, 0x80, 0);
+    for (int i = 1; i < 10; i++) {
+        push(cache, 0x41, 0x80, i*FRAME_TIME);
+    }
+    CPPUNIT_ASSERT(cache.getUnits() == 10);
+    CPPUNIT_ASSERT(cache.getOverflows() == 0);
+
+    push(cache, 0x41, 0x80, 10*FRAME_TIME);
+    CPPUNIT_ASSERT(cache.empty());
+    CPPUNIT_ASSERT(!cache.isKeyed());
+    CPPUNIT_ASSERT(cache.getOverflows() == 1);
+
+    push(cache, 0x65, 0x80, 11*FRAME_TIME);
+    CPPUNIT_ASSERT(cache.getUnits() == 1);
+
+    push(cache, 0x41, 0x80, 12*FRAME_TIME, 2*NAL_SIZE);
+    CPPUNIT_ASSERT(cache.getUnits() == 2);
+    CPPUNIT_ASSERT(cache.pop(out, NAL_SIZE, length, outPts));
+    CPPUNIT_ASSERT(!cache.pop(out, NAL_SIZE, length, outPts));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(GopCacheTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("GopCacheTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
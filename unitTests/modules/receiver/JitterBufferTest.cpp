@@ -0,0 +1,205 @@
+/*
+ *  JitterBufferTest.cpp - JitterBuffer class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/receiver/JitterBuffer.hh"
+#include "Utils.hh"
+
+#define FRAME_SIZE 1000
+#define FRAME_TIME 40000
+
+class JitterBufferTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(JitterBufferTest);
+    CPPUNIT_TEST(release);
+    CPPUNIT_TEST(jitterAbsorption);
+    CPPUNIT_TEST(adaptiveDelay);
+    CPPUNIT_TEST(resync);
+    CPPUNIT_TEST(overflow);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void release();
+    void jitterAbsorption();
+    void adaptiveDelay();
+    void resync();
+    void overflow();
+
+    void push(JitterBuffer& buffer, unsigned char value, std::chrono::microseconds pts,
+              std::chrono::steady_clock::time_point arrival);
+};
+
+void JitterBufferTest::push(JitterBuffer& buffer, unsigned char value, std::chrono::microseconds pts,
+                            std::chrono::steady_clock::time_point arrival)
+{
+    memset(buffer.writeBuffer(FRAME_SIZE), value, FRAME_SIZE);
+    buffer.push(FRAME_SIZE, pts, arrival);
+}
+
+void JitterBufferTest::release()
+{
+    JitterBuffer buffer(100, 30);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::microseconds pts(123456789);
+    std::chrono::microseconds outPts;
+    unsigned char out[FRAME_SIZE];
+    unsigned length;
+
+    CPPUNIT_ASSERT(buffer.timeToRelease(now).count() < 0);
+
+    push(buffer, 7, pts, now);
+    CPPUNIT_ASSERT(buffer.getFrames() == 1);
+    CPPUNIT_ASSERT(buffer.timeToRelease(now) == std::chrono::milliseconds(30));
+    CPPUNIT_ASSERT(!buffer.release(out, FRAME_SIZE, length, outPts, now + std::chrono::milliseconds(29)));
+
+    CPPUNIT_ASSERT(buffer.release(out, FRAME_SIZE, length, outPts, now + std::chrono::milliseconds(30)));
+    CPPUNIT_ASSERT(length == FRAME_SIZE);
+    CPPUNIT_ASSERT(outPts == pts);
+    CPPUNIT_ASSERT(out[0] == 7 && out[FRAME_SIZE - 1] == 7);
+    CPPUNIT_ASSERT(buffer.getFrames() == 0);
+
+    push(buffer, 8, pts + std::chrono::microseconds(FRAME_TIME), now + std::chrono::microseconds(FRAME_TIME));
+    CPPUNIT_ASSERT(!buffer.release(out, FRAME_SIZE - 1, length, outPts, now + std::chrono::seconds(1)));
+    CPPUNIT_ASSERT(buffer.getDropped() == 1);
+}
+
+void JitterBufferTest::jitterAbsorption()
+{
+    JitterBuffer buffer(100, 50);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point releaseTime;
+    std::chrono::microseconds pts(0);
+    std::chrono::microseconds outPts;
+    unsigned char out[FRAME_SIZE];
+    unsigned length;
+    int arrivalJitter[] = {0, 30000, 5000, 45000, 10000, 0, 20000, 40000};
+
+    for (int i = 0; i < 8; i++) {
+        push(buffer, i, pts + std::chrono::microseconds(i*FRAME_TIME),
+             now + std::chrono::microseconds(i*FRAME_TIME + arrivalJitter[i]));
+    }
+
+    //NOTE: frames are released evenly spaced, whatever their arrival time was
+    for (int i = 0; i < 8; i++) {
+        releaseTime = now + std::chrono::microseconds(i*FRAME_TIME) + std::chrono::milliseconds(50);
+        CPPUNIT_ASSERT(!buffer.release(out, FRAME_SIZE, length, outPts, releaseTime - std::chrono::microseconds(1)));
+        CPPUNIT_ASSERT(buffer.release(out, FRAME_SIZE, length, outPts, releaseTime));
+        CPPUNIT_ASSERT(outPts == pts + std::chrono::microseconds(i*FRAME_TIME));
+        CPPUNIT_ASSERT(out[0] == i);
+    }
+
+    CPPUNIT_ASSERT(buffer.getLate() == 0);
+}
+
+void JitterBufferTest::adaptiveDelay()
+{
+    JitterBuffer buffer(100, 10);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    CPPUNIT_ASSERT(buffer.getDelay() == std::chrono::milliseconds(10));
+
+    buffer.setJitter(std::chrono::milliseconds(5), now);
+    CPPUNIT_ASSERT(buffer.getDelay() == std::chrono::milliseconds(5*JITTER_BUFFER_JITTER_FACTOR));
+
+    buffer.setJitter(std::chrono::milliseconds(50), now + std::chrono::seconds(1));
+    CPPUNIT_ASSERT(buffer.getDelay() == std::chrono::milliseconds(100));
+
+    buffer.setJitter(std::chrono::milliseconds(1), now + std::chrono::seconds(2));
+    CPPUNIT_ASSERT(buffer.getDelay() == std::chrono::milliseconds(100 - JITTER_BUFFER_DECAY_RATE));
+
+    buffer.setJitter(std::chrono::milliseconds(1), now + std::chrono::seconds(60));
+    CPPUNIT_ASSERT(buffer.getDelay() == std::chrono::milliseconds(10));
+
+    buffer.setDelays(5, 20);
+    CPPUNIT_ASSERT(buffer.getMinDelay() == 5 && buffer.getMaxDelay() == 5);
+    CPPUNIT_ASSERT(buffer.getDelay() == std::chrono::milliseconds(5));
+}
+
+void JitterBufferTest::resync()
+{
+    JitterBuffer buffer(100, 100);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::microseconds outPts;
+    unsigned char out[FRAME_SIZE];
+    unsigned length;
+
+    push(buffer, 1, std::chrono::seconds(1000), now);
+    push(buffer, 2, std::chrono::seconds(1000) + std::chrono::microseconds(FRAME_TIME),
+         now + std::chrono::microseconds(FRAME_TIME));
+
+    //NOTE: the timestamps jump back, frames stored with the previous timing are not delayed again
+    push(buffer, 3, std::chrono::seconds(10), now + std::chrono::microseconds(2*FRAME_TIME));
+
+    CPPUNIT_ASSERT(buffer.release(out, FRAME_SIZE, length, outPts, now + std::chrono::microseconds(2*FRAME_TIME)));
+    CPPUNIT_ASSERT(out[0] == 1);
+    CPPUNIT_ASSERT(buffer.release(out, FRAME_SIZE, length, outPts, now + std::chrono::microseconds(2*FRAME_TIME)));
+    CPPUNIT_ASSERT(out[0] == 2);
+    CPPUNIT_ASSERT(!buffer.release(out, FRAME_SIZE, length, outPts, now + std::chrono::microseconds(2*FRAME_TIME)));
+    CPPUNIT_ASSERT(buffer.timeToRelease(now + std::chrono::microseconds(2*FRAME_TIME)) == std::chrono::milliseconds(100));
+}
+
+void JitterBufferTest::overflow()
+{
+    JitterBuffer buffer(100, 100);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::microseconds outPts;
+    unsigned char out[FRAME_SIZE];
+    unsigned length;
+
+    for (int i = 0; i < JITTER_BUFFER_MAX_FRAMES + 2; i++) {
+        push(buffer, i, std::chrono::microseconds(i*1000), now + std::chrono::microseconds(i*1000));
+    }
+
+    CPPUNIT_ASSERT(buffer.getFrames() == JITTER_BUFFER_MAX_FRAMES);
+    CPPUNIT_ASSERT(buffer.getDropped() == 2);
+    CPPUNIT_ASSERT(buffer.release(out, FRAME_SIZE, length, outPts, now + std::chrono::seconds(1)));
+    CPPUNIT_ASSERT(outPts == std::chrono::microseconds(2000));
+
+    buffer.flush();
+    CPPUNIT_ASSERT(buffer.getFrames() == 0);
+    CPPUNIT_ASSERT(buffer.timeToRelease(now).count() < 0);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(JitterBufferTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("JitterBufferTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,311 @@
+/*
+ *  MPEGTSDemuxerTest.cpp - MPEGTSDemuxer class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/receiver/MPEGTSDemuxer.hh"
+#include "modules/transmitter/TSPacketizer.hh"
+#include "Utils.hh"
+
+#define AUD_SIZE 6
+#define FRAME_TIME 3600
+
+struct Unit {
+    unsigned stream;
+    std::vector<unsigned char> data;
+    uint64_t pts;
+};
+
+class MPEGTSDemuxerTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(MPEGTSDemuxerTest);
+    CPPUNIT_TEST(programTables);
+    CPPUNIT_TEST(videoUnits);
+    CPPUNIT_TEST(adtsFrames);
+    CPPUNIT_TEST(lostPackets);
+    CPPUNIT_TEST(ptsWrap);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void programTables();
+    void videoUnits();
+    void adtsFrames();
+    void lostPackets();
+    void ptsWrap();
+
+    std::vector<unsigned char> frame(unsigned size, unsigned char seed);
+    std::vector<unsigned char> adts(unsigned payloadSize, unsigned char seed);
+    std::vector<unsigned char> drain(TSPacketizer& packetizer);
+
+    MPEGTSDemuxer* demuxer;
+    std::vector<Unit> units;
+};
+
+void MPEGTSDemuxerTest::setUp()
+{
+    units.clear();
+    demuxer = new MPEGTSDemuxer([this](unsigned stream, const unsigned char* data, unsigned size, uint64_t pts) {
+        units.push_back({stream, std::vector<unsigned char>(data, data + size), pts});
+    });
+}
+
+void MPEGTSDemuxerTest::tearDown()
+{
+    delete demuxer;
+}
+
+std::vector<unsigned char> MPEGTSDemuxerTest::frame(unsigned size, unsigned char seed)
+{
+    std::vector<unsigned char> f(size);
+
+    for (unsigned i = 0; i < size; i++) {
+        f[i] = seed + i*7;
+    }
+
+    f[0] = 0x00;
+    f[1] = 0x00;
+    f[2] = 0x00;
+    f[3] = 0x01;
+    f[4] = 0x65;
+
+    return f;
+}
+
+std::vector<unsigned char> MPEGTSDemuxerTest::adts(unsigned payloadSize, unsigned char seed)
+{
+    std::vector<unsigned char> f(7 + payloadSize, seed);
+    unsigned length = f.size();
+
+    //NOTE: AAC LC, 48 kHz, stereo, without CRC
+    f[0] = 0xFF;
+    f[1] = 0xF1;
+    f[2] = 0x4C;
+    f[3] = 0x80 | ((length >> 11) & 0x03);
+    f[4] = (length >> 3) & 0xFF;
+    f[5] = ((length & 0x07) << 5) | 0x1F;
+    f[6] = 0xFC;
+
+    return f;
+}
+
+std::vector<unsigned char> MPEGTSDemuxerTest::drain(TSPacketizer& packetizer)
+{
+    std::vector<unsigned char> data;
+    const unsigned char* p;
+
+    while (packetizer.getPendingPackets() > 0) {
+        p = packetizer.getPackets();
+        data.insert(data.end(), p, p + TS_PACKET_SIZE);
+        packetizer.consume(1);
+    }
+
+    return data;
+}
+
+void MPEGTSDemuxerTest::programTables()
+{
+    TSPacketizer packetizer;
+    std::vector<unsigned char> f = frame(100, 1);
+    std::vector<unsigned char> ts;
+    std::vector<unsigned char> junk(50, 0x11);
+
+    packetizer.addStream(TS_STREAM_H264);
+    packetizer.addStream(TS_STREAM_AAC);
+    packetizer.addStream(TS_STREAM_MP3);
+    packetizer.writeFrame(0, f.data(), f.size(), 0, true, true);
+    ts = drain(packetizer);
+
+    //NOTE: bytes before the first sync byte are skipped
+    ts.insert(ts.begin(), junk.begin(), junk.end());
+    CPPUNIT_ASSERT(demuxer->push(ts.data(), ts.size()) == (ts.size() - junk.size())/TS_PACKET_SIZE);
+
+    CPPUNIT_ASSERT(demuxer->getStreams().size() == 3);
+    CPPUNIT_ASSERT(demuxer->getStreams()[0].pid == TS_FIRST_ES_PID);
+    CPPUNIT_ASSERT(demuxer->getStreams()[0].streamType == TS_STREAM_H264);
+    CPPUNIT_ASSERT(demuxer->getStreams()[1].streamType == TS_STREAM_AAC);
+    CPPUNIT_ASSERT(demuxer->getStreams()[2].streamType == TS_STREAM_MP3);
+    CPPUNIT_ASSERT(demuxer->getStreams()[1].sampleRate == 0);
+
+    //NOTE: a new PMT version only adds the new streams
+    packetizer.addStream(TS_STREAM_H265);
+    packetizer.writeFrame(0, f.data(), f.size(), FRAME_TIME, true, true);
+    ts = drain(packetizer);
+    demuxer->push(ts.data(), ts.size());
+
+    CPPUNIT_ASSERT(demuxer->getStreams().size() == 4);
+    CPPUNIT_ASSERT(demuxer->getStreams()[0].pid == TS_FIRST_ES_PID);
+    CPPUNIT_ASSERT(demuxer->getStreams()[3].streamType == TS_STREAM_H265);
+}
+
+void MPEGTSDemuxerTest::videoUnits()
+{
+    TSPacketizer packetizer;
+    std::vector<unsigned char> f0 = frame(100, 1);
+    std::vector<unsigned char> f1 = frame(5000, 2);
+    std::vector<unsigned char> f2 = frame(700, 3);
+    std::vector<unsigned char> ts;
+
+    packetizer.addStream(TS_STREAM_H264);
+    packetizer.writeFrame(0, f0.data(), f0.size(), 1000, true, true);
+    packetizer.writeFrame(0, f1.data(), 3000, 1000 + FRAME_TIME, true, false);
+    packetizer.writeFrame(0, f1.data() + 3000, f1.size() - 3000, 1000 + FRAME_TIME, false, false);
+    packetizer.writeFrame(0, f2.data(), f2.size(), 1000 + 2*FRAME_TIME, true, false);
+    ts = drain(packetizer);
+
+    demuxer->push(ts.data(), ts.size());
+
+    //NOTE: the last access unit is delivered when the next one starts
+    CPPUNIT_ASSERT(units.size() == 2);
+    demuxer->flush();
+    CPPUNIT_ASSERT(units.size() == 3);
+
+    CPPUNIT_ASSERT(units[0].pts == 1000);
+    CPPUNIT_ASSERT(units[0].data.size() == AUD_SIZE + f0.size());
+    CPPUNIT_ASSERT(units[0].data[4] == 0x09);
+    CPPUNIT_ASSERT(memcmp(units[0].data.data() + AUD_SIZE, f0.data(), f0.size()) == 0);
+
+    //NOTE: the PES packet without PTS is part of the same access unit
+    CPPUNIT_ASSERT(units[1].pts == 1000 + FRAME_TIME);
+    CPPUNIT_ASSERT(units[1].data.size() == AUD_SIZE + f1.size());
+    CPPUNIT_ASSERT(memcmp(units[1].data.data() + AUD_SIZE, f1.data(), f1.size()) == 0);
+
+    CPPUNIT_ASSERT(units[2].pts == 1000 + 2*FRAME_TIME);
+    CPPUNIT_ASSERT(memcmp(units[2].data.data() + AUD_SIZE, f2.data(), f2.size()) == 0);
+    CPPUNIT_ASSERT(demuxer->getDroppedUnits() == 0);
+    CPPUNIT_ASSERT(demuxer->getDiscontinuities() == 0);
+}
+
+void MPEGTSDemuxerTest::adtsFrames()
+{
+    TSPacketizer packetizer;
+    std::vector<unsigned char> a0 = adts(300, 4);
+    std::vector<unsigned char> a1 = adts(250, 5);
+    std::vector<unsigned char> pes = a0;
+    std::vector<unsigned char> ts;
+
+    pes.insert(pes.end(), a1.begin(), a1.end());
+
+    packetizer.addStream(TS_STREAM_AAC);
+    packetizer.writeFrame(0, pes.data(), pes.size(), 9000, true, true);
+    ts = drain(packetizer);
+
+    demuxer->push(ts.data(), ts.size());
+
+    //NOTE: bounded PES packets are delivered at once, one unit per ADTS frame
+    CPPUNIT_ASSERT(units.size() == 2);
+    CPPUNIT_ASSERT(units[0].data == a0);
+    CPPUNIT_ASSERT(units[1].data == a1);
+    CPPUNIT_ASSERT(units[0].pts == 9000);
+    CPPUNIT_ASSERT(units[1].pts == 9000 + TS_AAC_FRAME_SAMPLES*90000/48000);
+    CPPUNIT_ASSERT(demuxer->getStreams()[0].sampleRate == 48000);
+    CPPUNIT_ASSERT(demuxer->getStreams()[0].channels == 2);
+}
+
+void MPEGTSDemuxerTest::lostPackets()
+{
+    TSPacketizer packetizer;
+    std::vector<unsigned char> f0 = frame(2000, 1);
+    std::vector<unsigned char> f1 = frame(2000, 2);
+    std::vector<unsigned char> f2 = frame(2000, 3);
+    std::vector<unsigned char> ts;
+    std::vector<unsigned char> lossy;
+    size_t lost;
+
+    packetizer.addStream(TS_STREAM_H264);
+    packetizer.writeFrame(0, f0.data(), f0.size(), 0, true, true);
+    ts = drain(packetizer);
+    lossy.insert(lossy.end(), ts.begin(), ts.end());
+
+    packetizer.writeFrame(0, f1.data(), f1.size(), FRAME_TIME, true, false);
+    ts = drain(packetizer);
+    lost = lossy.size() + 3*TS_PACKET_SIZE;
+    lossy.insert(lossy.end(), ts.begin(), ts.end());
+
+    packetizer.writeFrame(0, f2.data(), f2.size(), 2*FRAME_TIME, true, false);
+    ts = drain(packetizer);
+    lossy.insert(lossy.end(), ts.begin(), ts.end());
+
+    lossy.erase(lossy.begin() + lost, lossy.begin() + lost + TS_PACKET_SIZE);
+
+    demuxer->push(lossy.data(), lossy.size());
+    demuxer->flush();
+
+    CPPUNIT_ASSERT(units.size() == 2);
+    CPPUNIT_ASSERT(units[0].pts == 0);
+    CPPUNIT_ASSERT(units[1].pts == 2*FRAME_TIME);
+    CPPUNIT_ASSERT(memcmp(units[1].data.data() + AUD_SIZE, f2.data(), f2.size()) == 0);
+    CPPUNIT_ASSERT(demuxer->getDiscontinuities() == 1);
+    CPPUNIT_ASSERT(demuxer->getDroppedUnits() == 1);
+}
+
+void MPEGTSDemuxerTest::ptsWrap()
+{
+    TSPacketizer packetizer;
+    std::vector<unsigned char> f = frame(100, 1);
+    std::vector<unsigned char> ts;
+    uint64_t pts = TS_PTS_MASK - FRAME_TIME;
+
+    packetizer.addStream(TS_STREAM_H264);
+
+    for (int i = 0; i < 4; i++) {
+        packetizer.writeFrame(0, f.data(), f.size(), pts + i*FRAME_TIME, true, i == 0);
+    }
+
+    ts = drain(packetizer);
+    demuxer->push(ts.data(), ts.size());
+    demuxer->flush();
+
+    CPPUNIT_ASSERT(units.size() == 4);
+
+    for (int i = 0; i < 4; i++) {
+        CPPUNIT_ASSERT(units[i].pts == pts + i*FRAME_TIME);
+    }
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MPEGTSDemuxerTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("MPEGTSDemuxerTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
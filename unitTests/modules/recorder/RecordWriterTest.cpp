@@ -0,0 +1,150 @@
+/*
+ *  RecordWriterTest.cpp - RecordWriter class test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *
+ */
+
+#include <string>
+#include <cstdio>
+#include <fstream>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/recorder/RecordWriter.hh"
+#include "Utils.hh"
+
+#define FIRST_PATH "/tmp/recordwritertest_0.ts"
+#define SECOND_PATH "/tmp/recordwritertest_1.ts"
+#define INVALID_PATH "/nonExistance/recordwritertest.ts"
+#define TEST_BLOCK_SIZE RECORD_BLOCK_ALIGN
+
+class RecordWriterTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(RecordWriterTest);
+    CPPUNIT_TEST(writeBlocks);
+    CPPUNIT_TEST(rotateFiles);
+    CPPUNIT_TEST(failedWrites);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void writeBlocks();
+    void rotateFiles();
+    void failedWrites();
+
+    std::string readFile(std::string path);
+
+    RecordWriter* writer = NULL;
+};
+
+void RecordWriterTest::setUp()
+{
+    writer = new RecordWriter(2, TEST_BLOCK_SIZE);
+}
+
+void RecordWriterTest::tearDown()
+{
+    delete writer;
+    std::remove(FIRST_PATH);
+    std::remove(SECOND_PATH);
+}
+
+std::string RecordWriterTest::readFile(std::string path)
+{
+    std::ifstream file(path.c_str(), std::ifstream::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+void RecordWriterTest::writeBlocks()
+{
+    std::string data;
+
+    //NOTE: more data than blocks, with an unaligned tail
+    for (unsigned i = 0; i < 7*TEST_BLOCK_SIZE/2; i++) {
+        data += (char) (i % 251);
+    }
+
+    CPPUNIT_ASSERT(writer->open(FIRST_PATH));
+
+    for (size_t pos = 0; pos < data.size(); pos += 1000) {
+        CPPUNIT_ASSERT(writer->write((const unsigned char*) data.data() + pos, std::min((size_t) 1000, data.size() - pos)));
+    }
+
+    writer->close();
+    writer->flush();
+
+    CPPUNIT_ASSERT(!writer->isOpen());
+    CPPUNIT_ASSERT(readFile(FIRST_PATH) == data);
+    CPPUNIT_ASSERT(writer->getWrittenBytes() == data.size());
+    CPPUNIT_ASSERT(writer->getFailedWrites() == 0);
+}
+
+void RecordWriterTest::rotateFiles()
+{
+    CPPUNIT_ASSERT(writer->open(FIRST_PATH));
+    CPPUNIT_ASSERT(writer->write((const unsigned char*) "abc", 3));
+    CPPUNIT_ASSERT(writer->open(SECOND_PATH));
+    CPPUNIT_ASSERT(writer->write((const unsigned char*) "defg", 4));
+
+    writer->flush();
+    CPPUNIT_ASSERT(readFile(FIRST_PATH) == "abc");
+
+    writer->close();
+    writer->flush();
+    CPPUNIT_ASSERT(readFile(SECOND_PATH) == "defg");
+    CPPUNIT_ASSERT(writer->getWrittenBytes() == 7);
+}
+
+void RecordWriterTest::failedWrites()
+{
+    CPPUNIT_ASSERT(!writer->write((const unsigned char*) "abc", 3));
+    CPPUNIT_ASSERT(!writer->open(""));
+
+    CPPUNIT_ASSERT(writer->open(INVALID_PATH));
+    CPPUNIT_ASSERT(writer->write((const unsigned char*) "abc", 3));
+    writer->close();
+    writer->flush();
+
+    CPPUNIT_ASSERT(writer->getFailedWrites() == 1);
+    CPPUNIT_ASSERT(writer->getWrittenBytes() == 0);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RecordWriterTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("RecordWriterTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
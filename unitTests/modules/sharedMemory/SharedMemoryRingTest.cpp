@@ -0,0 +1,306 @@
+/*
+ *  SharedMemoryRingTest.cpp - ShmRingWriter and ShmRingReader test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:    Gerard Castillo <gerard.castillo@i2cat.net>
+ *
+ */
+
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/sharedMemory/SharedMemoryRing.hh"
+#include "Utils.hh"
+
+#define SLOTS 4
+#define FRAME_SIZE 1000
+#define THREAD_FRAMES 200
+
+class SharedMemoryRingTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(SharedMemoryRingTest);
+    CPPUNIT_TEST(layout);
+    CPPUNIT_TEST(readInOrder);
+    CPPUNIT_TEST(slowReader);
+    CPPUNIT_TEST(cancelWrite);
+    CPPUNIT_TEST(blockingReader);
+    CPPUNIT_TEST(closeRing);
+    CPPUNIT_TEST(acquireInPlace);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void layout();
+    void readInOrder();
+    void slowReader();
+    void cancelWrite();
+    void blockingReader();
+    void closeRing();
+    void acquireInPlace();
+
+    void write(uint16_t seqNum, unsigned length = FRAME_SIZE);
+
+    uint8_t* segment;
+    ShmRingWriter* writer;
+};
+
+void SharedMemoryRingTest::setUp()
+{
+    CPPUNIT_ASSERT(posix_memalign((void**) &segment, SHM_RING_ALIGNMENT,
+                                  ShmRingWriter::segmentSize(SLOTS, FRAME_SIZE)) == 0);
+    writer = new ShmRingWriter(segment, SLOTS, FRAME_SIZE);
+}
+
+void SharedMemoryRingTest::tearDown()
+{
+    delete writer;
+    free(segment);
+}
+
+void SharedMemoryRingTest::write(uint16_t seqNum, unsigned length)
+{
+    ShmSlotHeader* slot = writer->beginWrite();
+
+    slot->seqNum = seqNum;
+    slot->length = length;
+    memset(writer->getData(), seqNum & 0xFF, length);
+    writer->publish();
+}
+
+void SharedMemoryRingTest::layout()
+{
+    uint8_t invalid[SHM_RING_ALIGNMENT];
+    ShmRingHeader* header = (ShmRingHeader*) segment;
+
+    CPPUNIT_ASSERT(header->magic == SHM_RING_MAGIC);
+    CPPUNIT_ASSERT(header->slots == SLOTS);
+    CPPUNIT_ASSERT(header->slotSize % SHM_RING_ALIGNMENT == 0);
+    CPPUNIT_ASSERT(header->slotSize >= FRAME_SIZE + sizeof(ShmSlotHeader));
+    CPPUNIT_ASSERT(ShmRingWriter::segmentSize(SLOTS, FRAME_SIZE) >= SHM_RING_ALIGNMENT + SLOTS*header->slotSize);
+
+    memset(invalid, 0, sizeof(invalid));
+    CPPUNIT_ASSERT(!ShmRingReader(invalid).isValid());
+    CPPUNIT_ASSERT(ShmRingReader(segment).isValid());
+}
+
+void SharedMemoryRingTest::readInOrder()
+{
+    uint8_t out[FRAME_SIZE];
+    ShmSlotHeader info;
+    ShmRingReader reader(segment);
+
+    CPPUNIT_ASSERT(!reader.read(out, FRAME_SIZE, info, 0));
+
+    write(1);
+    write(2, FRAME_SIZE/2);
+
+    CPPUNIT_ASSERT(reader.read(out, FRAME_SIZE, info, 0));
+    CPPUNIT_ASSERT(info.seqNum == 1);
+    CPPUNIT_ASSERT(info.length == FRAME_SIZE);
+    CPPUNIT_ASSERT(out[0] == 1 && out[FRAME_SIZE - 1] == 1);
+
+    CPPUNIT_ASSERT(reader.read(out, FRAME_SIZE, info, 0));
+    CPPUNIT_ASSERT(info.seqNum == 2);
+    CPPUNIT_ASSERT(info.length == FRAME_SIZE/2);
+
+    CPPUNIT_ASSERT(!reader.read(out, FRAME_SIZE, info, 10));
+    CPPUNIT_ASSERT(reader.getSkipped() == 0);
+    CPPUNIT_ASSERT(writer->getWakeups() == 0);
+
+    ShmRingReader late(segment, true);
+    CPPUNIT_ASSERT(late.read(out, FRAME_SIZE, info, 0));
+    CPPUNIT_ASSERT(info.seqNum == 1);
+}
+
+void SharedMemoryRingTest::slowReader()
+{
+    uint8_t out[FRAME_SIZE];
+    ShmSlotHeader info;
+    ShmRingReader reader(segment);
+
+    for (uint16_t i = 1; i <= 10; i++) {
+        write(i);
+    }
+    CPPUNIT_ASSERT(writer->getPublished() == 10);
+
+    CPPUNIT_ASSERT(reader.read(out, FRAME_SIZE, info, 0));
+    CPPUNIT_ASSERT(info.seqNum == 10 - SLOTS + 1);
+    CPPUNIT_ASSERT(reader.getSkipped() == 10 - SLOTS);
+
+    write(11, FRAME_SIZE/2);
+    CPPUNIT_ASSERT(reader.read(out, FRAME_SIZE/2, info, 0));
+    CPPUNIT_ASSERT(info.seqNum == 11);
+    CPPUNIT_ASSERT(reader.getSkipped() == 10 - SLOTS + SLOTS - 1);
+    CPPUNIT_ASSERT(out[0] == 11);
+}
+
+void SharedMemoryRingTest::cancelWrite()
+{
+    uint8_t out[FRAME_SIZE];
+    ShmSlotHeader info;
+    ShmRingReader reader(segment, true);
+
+    for (uint16_t i = 1; i <= SLOTS; i++) {
+        write(i);
+    }
+
+    writer->beginWrite();
+    writer->cancel();
+    CPPUNIT_ASSERT(writer->getPublished() == SLOTS);
+
+    CPPUNIT_ASSERT(reader.read(out, FRAME_SIZE, info, 0));
+    CPPUNIT_ASSERT(info.seqNum == 1);
+    CPPUNIT_ASSERT(reader.getSkipped() == 0);
+}
+
+void SharedMemoryRingTest::blockingReader()
+{
+    uint8_t out[FRAME_SIZE];
+    ShmSlotHeader info;
+    ShmRingReader reader(segment);
+    std::chrono::steady_clock::time_point start;
+    unsigned received = 0;
+    uint16_t last = 0;
+    bool ordered = true;
+
+    std::thread writerThread([this]() {
+        for (uint16_t i = 1; i <= THREAD_FRAMES; i++) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            write(i);
+        }
+    });
+
+    while (last < THREAD_FRAMES && reader.read(out, FRAME_SIZE, info, 1000)) {
+        ordered &= info.seqNum > last && out[FRAME_SIZE - 1] == (info.seqNum & 0xFF);
+        last = info.seqNum;
+        received++;
+    }
+
+    writerThread.join();
+
+    CPPUNIT_ASSERT(ordered);
+    CPPUNIT_ASSERT(last == THREAD_FRAMES);
+    CPPUNIT_ASSERT(received + reader.getSkipped() == THREAD_FRAMES);
+    CPPUNIT_ASSERT(writer->getWakeups() > 0);
+
+    start = std::chrono::steady_clock::now();
+    CPPUNIT_ASSERT(!reader.read(out, FRAME_SIZE, info, 20));
+    CPPUNIT_ASSERT(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(15));
+}
+
+void SharedMemoryRingTest::closeRing()
+{
+    uint8_t out[FRAME_SIZE];
+    ShmSlotHeader info;
+    ShmRingReader reader(segment);
+    std::chrono::steady_clock::time_point start;
+    bool read = true;
+
+    write(1);
+    CPPUNIT_ASSERT(reader.read(out, FRAME_SIZE, info, 0));
+    CPPUNIT_ASSERT(reader.getGeneration() == 0);
+
+    start = std::chrono::steady_clock::now();
+    std::thread readerThread([&]() {
+        read = reader.read(out, FRAME_SIZE, info, 5000);
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    writer->close();
+    readerThread.join();
+
+    CPPUNIT_ASSERT(!read);
+    CPPUNIT_ASSERT(!reader.isValid());
+    CPPUNIT_ASSERT(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(1000));
+
+    delete writer;
+    writer = new ShmRingWriter(segment, SLOTS, FRAME_SIZE/2, 1);
+    write(1, FRAME_SIZE/2);
+
+    CPPUNIT_ASSERT(!reader.read(out, FRAME_SIZE, info, 0));
+
+    ShmRingReader remapped(segment, true);
+    CPPUNIT_ASSERT(remapped.isValid());
+    CPPUNIT_ASSERT(remapped.getGeneration() == 1);
+    CPPUNIT_ASSERT(remapped.read(out, FRAME_SIZE, info, 0));
+    CPPUNIT_ASSERT(info.length == FRAME_SIZE/2);
+}
+
+void SharedMemoryRingTest::acquireInPlace()
+{
+    ShmSlotHeader info;
+    ShmRingReader reader(segment);
+    const uint8_t* data;
+
+    CPPUNIT_ASSERT(!reader.latest(info));
+    CPPUNIT_ASSERT(reader.acquire(info, 0) == NULL);
+
+    write(1);
+    write(2);
+    CPPUNIT_ASSERT(reader.latest(info));
+    CPPUNIT_ASSERT(info.seqNum == 2);
+
+    data = reader.acquire(info, 0);
+    CPPUNIT_ASSERT(data != NULL);
+    CPPUNIT_ASSERT(info.seqNum == 1 && data[0] == 1);
+    CPPUNIT_ASSERT(reader.release());
+    CPPUNIT_ASSERT(!reader.release());
+
+    data = reader.acquire(info, 0);
+    CPPUNIT_ASSERT(data != NULL && info.seqNum == 2);
+
+    for (uint16_t i = 3; i <= 2 + SLOTS; i++) {
+        write(i);
+    }
+
+    CPPUNIT_ASSERT(!reader.release());
+    CPPUNIT_ASSERT(reader.getSkipped() == 1);
+
+    data = reader.acquire(info, 0);
+    CPPUNIT_ASSERT(data != NULL && info.seqNum == 3);
+    CPPUNIT_ASSERT(reader.release());
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SharedMemoryRingTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("SharedMemoryRingTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
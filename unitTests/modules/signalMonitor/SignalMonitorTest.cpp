@@ -0,0 +1,274 @@
+/*
+ *  SignalMonitorTest.cpp - SignalMonitor class test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cmath>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/signalMonitor/SignalMonitor.hh"
+#include "Utils.hh"
+
+#define WIDTH 320
+#define HEIGHT 180
+#define FRAME_TIME 40000        //!< usec, 25 fps
+#define VIDEO_ID 1
+#define AUDIO_ID 2
+#define SAMPLE_RATE 48000
+#define FRAME_SAMPLES 960
+
+class SignalMonitorMock : public SignalMonitor {
+public:
+    SignalMonitorMock() : SignalMonitor() {};
+    using SignalMonitor::doProcessFrame;
+    using SignalMonitor::setupInput;
+    using SignalMonitor::configure0;
+};
+
+class SignalMonitorTest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(SignalMonitorTest);
+    CPPUNIT_TEST(setupTest);
+    CPPUNIT_TEST(blackTest);
+    CPPUNIT_TEST(freezeTest);
+    CPPUNIT_TEST(silenceTest);
+    CPPUNIT_TEST(timestampsTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void setupTest();
+    void blackTest();
+    void freezeTest();
+    void silenceTest();
+    void timestampsTest();
+
+    //NOTE: pictures with noise of the given seed over a base luma, the same seed repeats the picture
+    void feedPicture(int luma, unsigned seed, int64_t ts);
+    void feedAudio(float amplitude, int64_t ts);
+
+    SignalMonitorMock* monitor;
+    PlanarVideoFrame* picture;
+    PlanarAudioFrame* audio;
+};
+
+void SignalMonitorTest::setUp()
+{
+    StreamInfo video(VIDEO);
+    StreamInfo pcm(AUDIO);
+
+    video.video.codec = RAW;
+    video.video.pixelFormat = YUV420P;
+    pcm.audio.codec = PCM;
+    pcm.audio.sampleFormat = FLTP;
+
+    monitor = new SignalMonitorMock();
+    picture = PlanarVideoFrame::createNew(RAW, WIDTH, HEIGHT, YUV420P);
+    audio = PlanarAudioFrame::createNew(2, SAMPLE_RATE, FRAME_SAMPLES, PCM, FLTP);
+
+    CPPUNIT_ASSERT(monitor->setupInput(VIDEO_ID, &video));
+    CPPUNIT_ASSERT(monitor->setupInput(AUDIO_ID, &pcm));
+}
+
+void SignalMonitorTest::tearDown()
+{
+    delete monitor;
+    delete picture;
+    delete audio;
+}
+
+void SignalMonitorTest::feedPicture(int luma, unsigned seed, int64_t ts)
+{
+    FrameMap frames;
+    std::vector<int> newFrames(1, VIDEO_ID);
+    int ret = 0;
+    unsigned char* luma0 = picture->getPlanarDataBuf()[0];
+
+    srand(seed);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            luma0[y*picture->getLinesize()[0] + x] = std::min(255, luma + rand() % 8);
+        }
+    }
+
+    picture->setPresentationTime(std::chrono::microseconds(ts));
+    frames[VIDEO_ID] = picture;
+    CPPUNIT_ASSERT(monitor->doProcessFrame(frames, newFrames, ret));
+}
+
+void SignalMonitorTest::feedAudio(float amplitude, int64_t ts)
+{
+    FrameMap frames;
+    std::vector<int> newFrames(1, AUDIO_ID);
+    int ret = 0;
+
+    for (unsigned c = 0; c < 2; c++) {
+        float* samples = (float*) audio->getPlanarDataBuf()[c];
+        for (unsigned i = 0; i < FRAME_SAMPLES; i++) {
+            samples[i] = amplitude*sin(2*M_PI*1000*i/SAMPLE_RATE);
+        }
+    }
+
+    audio->setSamples(FRAME_SAMPLES);
+    audio->setPresentationTime(std::chrono::microseconds(ts));
+    frames[AUDIO_ID] = audio;
+    CPPUNIT_ASSERT(monitor->doProcessFrame(frames, newFrames, ret));
+}
+
+void SignalMonitorTest::setupTest()
+{
+    StreamInfo coded(VIDEO);
+    StreamInfo rgb(VIDEO);
+
+    coded.video.codec = H264;
+    rgb.video.codec = RAW;
+    rgb.video.pixelFormat = RGB24;
+
+    CPPUNIT_ASSERT(!monitor->setupInput(3, &coded));
+    CPPUNIT_ASSERT(!monitor->setupInput(3, &rgb));
+    CPPUNIT_ASSERT(!monitor->getInput(3));
+    CPPUNIT_ASSERT(monitor->getInput(VIDEO_ID)->video && !monitor->getInput(AUDIO_ID)->video);
+
+    CPPUNIT_ASSERT(!monitor->configure0(0, -1, -1, -1, 1, -1, -1, -1));
+    CPPUNIT_ASSERT(!monitor->configure0(-1, 256, -1, -1, 1, -1, -1, -1));
+    CPPUNIT_ASSERT(!monitor->configure0(-1, -1, 1.5, -1, 1, -1, -1, -1));
+    CPPUNIT_ASSERT(monitor->configure0(8, -1, -1, -1, 1, -1, -1, -1));
+}
+
+void SignalMonitorTest::blackTest()
+{
+    const MonitorInput* input = monitor->getInput(VIDEO_ID);
+    int64_t ts = 0;
+
+    for (; ts < (MONITOR_DEFAULT_BLACK_TIME - 100)*1000; ts += FRAME_TIME) {
+        feedPicture(16, ts, ts);
+    }
+
+    CPPUNIT_ASSERT(input->dark == 1 && input->luma < 24);
+    CPPUNIT_ASSERT(!input->black.active);
+
+    for (; ts < (MONITOR_DEFAULT_BLACK_TIME + 100)*1000; ts += FRAME_TIME) {
+        feedPicture(16, ts, ts);
+    }
+
+    CPPUNIT_ASSERT(input->black.active && input->black.raised == 1);
+    CPPUNIT_ASSERT(!input->frozen.active);
+
+    feedPicture(120, ts, ts);
+    CPPUNIT_ASSERT(!input->black.active && input->dark == 0);
+    CPPUNIT_ASSERT(input->black.raised == 1);
+}
+
+void SignalMonitorTest::freezeTest()
+{
+    const MonitorInput* input = monitor->getInput(VIDEO_ID);
+    int64_t ts = 0;
+
+    CPPUNIT_ASSERT(monitor->configure0(-1, -1, -1, -1, 1, -1, 1000, -1));
+
+    feedPicture(100, 0, ts);
+    CPPUNIT_ASSERT(input->motion < 0);
+
+    //NOTE: noise is enough to tell live pictures apart
+    for (ts += FRAME_TIME; ts < 2000000; ts += FRAME_TIME) {
+        feedPicture(100, ts, ts);
+    }
+
+    CPPUNIT_ASSERT(input->motion > 1 && !input->frozen.active);
+
+    for (; ts < 3100000; ts += FRAME_TIME) {
+        feedPicture(100, 7, ts);
+    }
+
+    CPPUNIT_ASSERT(input->motion == 0 && input->frozen.active);
+    CPPUNIT_ASSERT(!input->black.active);
+
+    feedPicture(100, 8, ts);
+    CPPUNIT_ASSERT(!input->frozen.active && input->frozen.raised == 1);
+}
+
+void SignalMonitorTest::silenceTest()
+{
+    const MonitorInput* input = monitor->getInput(AUDIO_ID);
+    int64_t ts = 0;
+    int64_t frameTime = FRAME_SAMPLES*1000000LL/SAMPLE_RATE;
+
+    feedAudio(0.5, ts);
+    CPPUNIT_ASSERT(std::abs(input->peakDb + 6.02) < 0.1);
+    CPPUNIT_ASSERT(std::abs(input->rmsDb + 9.03) < 0.1);
+
+    for (ts += frameTime; ts < (MONITOR_DEFAULT_SILENCE_TIME + 200)*1000; ts += frameTime) {
+        feedAudio(0, ts);
+    }
+
+    CPPUNIT_ASSERT(input->silent.active && input->peakDb == MONITOR_FLOOR_DB);
+
+    //NOTE: noise under the level is still silence
+    feedAudio(0.0005, ts);
+    CPPUNIT_ASSERT(input->silent.active);
+
+    feedAudio(0.01, ts + frameTime);
+    CPPUNIT_ASSERT(!input->silent.active && input->silent.raised == 1);
+}
+
+void SignalMonitorTest::timestampsTest()
+{
+    const MonitorInput* input = monitor->getInput(VIDEO_ID);
+
+    CPPUNIT_ASSERT(monitor->configure0(-1, -1, -1, -1, 1, 1000, -1, -1));
+
+    feedPicture(16, 1, 10000000);
+    feedPicture(16, 2, 10900000);
+
+    //NOTE: a stream starting again counts from its own first frame
+    feedPicture(16, 3, 0);
+    feedPicture(16, 4, 200000);
+    CPPUNIT_ASSERT(!input->black.active);
+
+    feedPicture(16, 5, 1000000);
+    CPPUNIT_ASSERT(input->black.active);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SignalMonitorTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("SignalMonitorTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
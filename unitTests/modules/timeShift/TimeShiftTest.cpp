@@ -0,0 +1,314 @@
+/*
+ *  TimeShiftTest.cpp - TimeShift class test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/timeShift/TimeShift.hh"
+#include "AVFramedQueue.hh"
+#include "FramePool.hh"
+#include "Utils.hh"
+
+#define KEY_NAL 0x65
+#define REF_NAL 0x41
+#define NAL_SIZE 6
+#define FRAME_TIME 40000
+#define GOP_SIZE 10
+
+class TimeShiftMock : public TimeShift {
+public:
+    TimeShiftMock(std::chrono::seconds window, size_t memory) : TimeShift(H264, window, memory) {};
+    using TimeShift::doProcessFrame;
+    using TimeShift::specificReaderConfig;
+    using TimeShift::specificWriterConfig;
+    using TimeShift::setDelay0;
+    using TimeShift::openSpill;
+};
+
+class TimeShiftTest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(TimeShiftTest);
+    CPPUNIT_TEST(createTest);
+    CPPUNIT_TEST(readerConfigTest);
+    CPPUNIT_TEST(delayTest);
+    CPPUNIT_TEST(windowTest);
+    CPPUNIT_TEST(memoryTest);
+    CPPUNIT_TEST(spillTest);
+    CPPUNIT_TEST(restartTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void createTest();
+    void readerConfigTest();
+    void delayTest();
+    void windowTest();
+    void memoryTest();
+    void spillTest();
+    void restartTest();
+
+    void push(TimeShiftMock* shift, int index);
+    int outputIndex(SlicedVideoFrame* frame);
+
+    SlicedVideoFrame* outA;
+    SlicedVideoFrame* outB;
+};
+
+void TimeShiftTest::setUp()
+{
+    outA = SlicedVideoFrame::createNew(H264);
+    outB = SlicedVideoFrame::createNew(H264);
+}
+
+void TimeShiftTest::tearDown()
+{
+    delete outA;
+    delete outB;
+}
+
+void TimeShiftTest::push(TimeShiftMock* shift, int index)
+{
+    VideoFrame* frame = dynamic_cast<VideoFrame*>(FramePool::getInstance()->getVideoFrame(H264, 64));
+    bool key = index % GOP_SIZE == 0;
+    unsigned char nal[NAL_SIZE] = {0, 0, 0, 1, key ? KEY_NAL : REF_NAL, (unsigned char) index};
+    FrameMap dstFrames;
+
+    CPPUNIT_ASSERT(frame);
+    memcpy(frame->getDataBuf(), nal, sizeof(nal));
+    frame->setLength(sizeof(nal));
+    frame->setPresentationTime(std::chrono::microseconds(index*FRAME_TIME));
+    frame->setDecodeTime(std::chrono::microseconds(index*FRAME_TIME));
+    frame->setFrameType(key, true);
+
+    outA->clear();
+    outA->setConsumed(false);
+    outB->clear();
+    outB->setConsumed(false);
+    dstFrames[1] = outA;
+    dstFrames[2] = outB;
+
+    CPPUNIT_ASSERT(shift->doProcessFrame(frame, dstFrames));
+
+    //NOTE: the ring keeps its own reference, the queue slot would be replaced
+    FramePool::getInstance()->releaseFrame(frame);
+}
+
+int TimeShiftTest::outputIndex(SlicedVideoFrame* frame)
+{
+    if (!frame->getConsumed() || frame->getSliceNum() != 1) {
+        return -1;
+    }
+
+    CPPUNIT_ASSERT(frame->getSlices()[0].getDataSize() == NAL_SIZE);
+    CPPUNIT_ASSERT(frame->getPresentationTime().count() == frame->getSlices()[0].getData()[5]*FRAME_TIME);
+
+    return frame->getSlices()[0].getData()[5];
+}
+
+void TimeShiftTest::createTest()
+{
+    TimeShift* tmp;
+
+    tmp = TimeShift::createNew(VP8);
+    CPPUNIT_ASSERT(!tmp);
+
+    tmp = TimeShift::createNew(H264, std::chrono::seconds(0));
+    CPPUNIT_ASSERT(!tmp);
+
+    tmp = TimeShift::createNew(H264, std::chrono::seconds(10), 0);
+    CPPUNIT_ASSERT(!tmp);
+
+    tmp = TimeShift::createNew(H264, std::chrono::seconds(10), 1024, "timeShiftTest.spill", 0);
+    CPPUNIT_ASSERT(!tmp);
+
+    tmp = TimeShift::createNew(H265, std::chrono::seconds(10), 1024, "timeShiftTest.spill", 1024);
+    CPPUNIT_ASSERT(tmp);
+    CPPUNIT_ASSERT(tmp->getFrames() == 0);
+    delete tmp;
+}
+
+void TimeShiftTest::readerConfigTest()
+{
+    TimeShiftMock shift(std::chrono::seconds(10), 1024);
+    struct ConnectionData cData;
+    StreamInfo h264(VIDEO);
+    StreamInfo vp8(VIDEO);
+    VideoFrameQueue* queue;
+
+    vp8.video.codec = VP8;
+    vp8.setCodecDefaults();
+    queue = VideoFrameQueue::createNew(cData, &vp8, 4);
+    CPPUNIT_ASSERT(!shift.specificReaderConfig(1, queue));
+    delete queue;
+
+    h264.video.codec = H264;
+    h264.setCodecDefaults();
+    queue = VideoFrameQueue::createNew(cData, &h264, 4);
+    CPPUNIT_ASSERT(shift.specificReaderConfig(1, queue));
+    delete queue;
+}
+
+void TimeShiftTest::delayTest()
+{
+    TimeShiftMock shift(std::chrono::seconds(10), 1024*1024);
+
+    //NOTE: nothing is written until the first random access point
+    CPPUNIT_ASSERT(shift.specificWriterConfig(1));
+    CPPUNIT_ASSERT(shift.specificWriterConfig(2));
+    CPPUNIT_ASSERT(!shift.setDelay0(2, std::chrono::seconds(11)));
+
+    for (int i = 0; i < 30; i++) {
+        push(&shift, i);
+        CPPUNIT_ASSERT(outputIndex(outA) == i);
+        CPPUNIT_ASSERT(outputIndex(outB) == i);
+    }
+
+    CPPUNIT_ASSERT(shift.getFrames() == 30);
+    CPPUNIT_ASSERT(shift.getKeyFrames() == 3);
+
+    //NOTE: the next input is at 1200 ms, the closest access unit before 600 ms is the one at 400 ms
+    CPPUNIT_ASSERT(shift.setDelay0(2, std::chrono::milliseconds(600)));
+
+    for (int i = 30; i < 60; i++) {
+        push(&shift, i);
+        CPPUNIT_ASSERT(outputIndex(outA) == i);
+        CPPUNIT_ASSERT(outputIndex(outB) == i - 20);
+    }
+
+    //NOTE: delays longer than the ring start at its oldest random access point
+    CPPUNIT_ASSERT(shift.setDelay0(1, std::chrono::seconds(5)));
+    push(&shift, 60);
+    CPPUNIT_ASSERT(outputIndex(outA) == 0);
+    CPPUNIT_ASSERT(outputIndex(outB) == 40);
+}
+
+void TimeShiftTest::windowTest()
+{
+    TimeShiftMock shift(std::chrono::seconds(1), 1024*1024);
+
+    CPPUNIT_ASSERT(shift.specificWriterConfig(1));
+    CPPUNIT_ASSERT(shift.specificWriterConfig(2));
+
+    for (int i = 0; i < 100; i++) {
+        push(&shift, i);
+        CPPUNIT_ASSERT(shift.getSpan() <= std::chrono::seconds(1));
+    }
+
+    CPPUNIT_ASSERT(shift.getFrames() == 26);
+    CPPUNIT_ASSERT(shift.getMemoryBytes() == 26*NAL_SIZE);
+    CPPUNIT_ASSERT(shift.getKeyFrames() == 2);
+}
+
+void TimeShiftTest::memoryTest()
+{
+    TimeShiftMock shift(std::chrono::seconds(10), 15*NAL_SIZE);
+
+    CPPUNIT_ASSERT(shift.specificWriterConfig(1));
+    CPPUNIT_ASSERT(shift.specificWriterConfig(2));
+    CPPUNIT_ASSERT(shift.setDelay0(2, std::chrono::seconds(1)));
+
+    for (int i = 0; i < 25; i++) {
+        push(&shift, i);
+        CPPUNIT_ASSERT(shift.getMemoryBytes() <= 15*NAL_SIZE);
+    }
+
+    //NOTE: the random access point at 0 is gone, the delayed output started when the ring was shorter
+    CPPUNIT_ASSERT(shift.getFrames() == 15);
+    CPPUNIT_ASSERT(shift.getKeyFrames() == 2);
+    CPPUNIT_ASSERT(outputIndex(outA) == 24);
+    CPPUNIT_ASSERT(outputIndex(outB) == 24);
+
+    CPPUNIT_ASSERT(shift.setDelay0(2, std::chrono::seconds(1)));
+    push(&shift, 25);
+    CPPUNIT_ASSERT(outputIndex(outB) == 20);
+}
+
+void TimeShiftTest::spillTest()
+{
+    TimeShiftMock shift(std::chrono::seconds(10), 5*NAL_SIZE);
+
+    CPPUNIT_ASSERT(shift.openSpill("timeShiftTest.spill", 20*NAL_SIZE));
+    CPPUNIT_ASSERT(shift.specificWriterConfig(1));
+    CPPUNIT_ASSERT(shift.specificWriterConfig(2));
+
+    for (int i = 0; i < 40; i++) {
+        push(&shift, i);
+        CPPUNIT_ASSERT(shift.getMemoryBytes() <= 5*NAL_SIZE);
+    }
+
+    CPPUNIT_ASSERT(shift.getFrames() == 25);
+    CPPUNIT_ASSERT(shift.getSpilledBytes() == 20*NAL_SIZE);
+    CPPUNIT_ASSERT(shift.getKeyFrames() == 2);
+
+    //NOTE: spilled entries are read from the file
+    CPPUNIT_ASSERT(shift.setDelay0(2, std::chrono::milliseconds(600)));
+    for (int i = 40; i < 45; i++) {
+        push(&shift, i);
+        CPPUNIT_ASSERT(outputIndex(outA) == i);
+        CPPUNIT_ASSERT(outputIndex(outB) == i - 20);
+    }
+}
+
+void TimeShiftTest::restartTest()
+{
+    TimeShiftMock shift(std::chrono::seconds(10), 1024*1024);
+
+    CPPUNIT_ASSERT(shift.specificWriterConfig(1));
+    CPPUNIT_ASSERT(shift.specificWriterConfig(2));
+
+    for (int i = 0; i < 30; i++) {
+        push(&shift, i);
+    }
+
+    push(&shift, 10);
+    CPPUNIT_ASSERT(shift.getFrames() == 1);
+    CPPUNIT_ASSERT(shift.getKeyFrames() == 1);
+    CPPUNIT_ASSERT(outputIndex(outA) == 10);
+    CPPUNIT_ASSERT(outputIndex(outB) == 10);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TimeShiftTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("TimeShiftTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+    delete outputter;
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -74,6 +74,7 @@ class RTSPConnectionTest : public CppUnit::TestFixture
     CPPUNIT_TEST(addAudioAndVideoMPEGTS);
     CPPUNIT_TEST(addAudioSTD);
     CPPUNIT_TEST(addVideoSTD);
+    CPPUNIT_TEST(addSharedSTD);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -86,6 +87,7 @@ protected:
     void addAudioAndVideoMPEGTS();
     void addAudioSTD();
     void addVideoSTD();
+    void addSharedSTD();
 
 private:
     std::string name = "RTSPTest";
@@ -161,6 +163,19 @@ void RTSPConnectionTest::addVideoSTD()
     CPPUNIT_ASSERT(conn->setup());
 }
 
+void RTSPConnectionTest::addSharedSTD()
+{
+    conn = new RTSPConnection(env, STD_RTP, rtspServer, name, "", "", true);
+
+    CPPUNIT_ASSERT(conn != NULL);
+    CPPUNIT_ASSERT(conn->isShared());
+
+    CPPUNIT_ASSERT(conn->addVideoSubsession(H264, vReplicator, 1));
+    CPPUNIT_ASSERT(conn->addAudioSubsession(AAC, aReplicator, CHANNELS, SAMPLERATE, S16, 2));
+
+    CPPUNIT_ASSERT(conn->setup());
+}
+
 void RTSPConnectionTest::addAudioMPEGTS()
 {
     conn = new RTSPConnection(env, MPEGTS, rtspServer, name);
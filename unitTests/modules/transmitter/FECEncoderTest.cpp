@@ -0,0 +1,265 @@
+/*
+ *  FECEncoderTest.cpp - FECEncoder class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/transmitter/FECEncoder.hh"
+#include "modules/transmitter/RetransmissionBuffer.hh"
+#include "Utils.hh"
+
+#define MEDIA_SSRC 0x11223344
+#define FEC_SSRC 0x55667788
+#define MATRIX_SIZE 4
+
+class FECEncoderTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(FECEncoderTest);
+    CPPUNIT_TEST(matrixSize);
+    CPPUNIT_TEST(repairPackets);
+    CPPUNIT_TEST(rowRecovery);
+    CPPUNIT_TEST(burstRecovery);
+    CPPUNIT_TEST(sequenceGap);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void matrixSize();
+    void repairPackets();
+    void rowRecovery();
+    void burstRecovery();
+    void sequenceGap();
+
+    std::vector<unsigned char> packet(uint16_t seq);
+    std::vector<std::vector<unsigned char>> protect(FECEncoder& encoder, uint16_t first, unsigned count);
+    std::vector<unsigned char> recover(std::vector<unsigned char> const& repair,
+                                       std::vector<std::vector<unsigned char>> const& received);
+};
+
+std::vector<unsigned char> FECEncoderTest::packet(uint16_t seq)
+{
+    //NOTE: sizes, markers and timestamps differ, so the recovery fields are checked too
+    std::vector<unsigned char> p(RTP_HEADER_SIZE + 100 + (seq*37) % 300);
+
+    p[0] = 0x80;
+    p[1] = (seq % 3 == 0 ? 0x80 : 0) | 96;
+    p[2] = seq >> 8;
+    p[3] = seq & 0xFF;
+    p[4] = 0;
+    p[5] = 0;
+    p[6] = (seq / 5) >> 8;
+    p[7] = (seq / 5) & 0xFF;
+    p[8] = MEDIA_SSRC >> 24;
+    p[9] = (MEDIA_SSRC >> 16) & 0xFF;
+    p[10] = (MEDIA_SSRC >> 8) & 0xFF;
+    p[11] = MEDIA_SSRC & 0xFF;
+
+    for (size_t i = RTP_HEADER_SIZE; i < p.size(); i++) {
+        p[i] = (seq * 13 + i * 7) & 0xFF;
+    }
+
+    return p;
+}
+
+std::vector<std::vector<unsigned char>> FECEncoderTest::protect(FECEncoder& encoder, uint16_t first, unsigned count)
+{
+    std::vector<std::vector<unsigned char>> repairs;
+    unsigned char buffer[FEC_MAX_PACKET_SIZE];
+    unsigned size;
+
+    for (unsigned i = 0; i < count; i++) {
+        std::vector<unsigned char> p = packet(first + i);
+        encoder.protect(p.data(), p.size());
+
+        while ((size = encoder.getRepair(buffer))) {
+            repairs.push_back(std::vector<unsigned char>(buffer, buffer + size));
+        }
+    }
+
+    return repairs;
+}
+
+std::vector<unsigned char> FECEncoderTest::recover(std::vector<unsigned char> const& repair,
+                                                   std::vector<std::vector<unsigned char>> const& received)
+{
+    std::vector<unsigned char> bits(repair.begin() + 16, repair.begin() + FEC_HEADER_SIZE);
+    std::vector<unsigned char> payload(repair.begin() + FEC_HEADER_SIZE, repair.end());
+    std::vector<unsigned char> recovered;
+    unsigned length;
+
+    for (auto& p : received) {
+        unsigned l = p.size() - RTP_HEADER_SIZE;
+        bits[0] ^= p[0];
+        bits[1] ^= p[1];
+        bits[2] ^= l >> 8;
+        bits[3] ^= l & 0xFF;
+        for (unsigned i = 4; i < 8; i++) {
+            bits[i] ^= p[i];
+        }
+        for (unsigned i = 0; i < l; i++) {
+            payload[i] ^= p[RTP_HEADER_SIZE + i];
+        }
+    }
+
+    length = (bits[2] << 8) | bits[3];
+    recovered.resize(RTP_HEADER_SIZE + length);
+    recovered[0] = 0x80 | (bits[0] & 0x3F);
+    recovered[1] = bits[1];
+    memcpy(&recovered[4], &bits[4], 4);
+    memcpy(&recovered[RTP_HEADER_SIZE], payload.data(), length);
+
+    return recovered;
+}
+
+static bool sameRecovered(std::vector<unsigned char> const& recovered, std::vector<unsigned char> const& original)
+{
+    //NOTE: the sequence number and the SSRC are known by the receiver, they are not recovered
+    return recovered.size() == original.size() &&
+           memcmp(recovered.data(), original.data(), 2) == 0 &&
+           memcmp(recovered.data() + 4, original.data() + 4, 4) == 0 &&
+           memcmp(recovered.data() + RTP_HEADER_SIZE, original.data() + RTP_HEADER_SIZE,
+                  original.size() - RTP_HEADER_SIZE) == 0;
+}
+
+void FECEncoderTest::matrixSize()
+{
+    unsigned columns;
+    unsigned rows;
+
+    CPPUNIT_ASSERT(!FECEncoder::matrixSize(0.05, columns, rows));
+    CPPUNIT_ASSERT(!FECEncoder::matrixSize(1.5, columns, rows));
+
+    CPPUNIT_ASSERT(FECEncoder::matrixSize(1, columns, rows));
+    CPPUNIT_ASSERT(columns == 2 && rows == 2);
+
+    CPPUNIT_ASSERT(FECEncoder::matrixSize(0.3, columns, rows));
+    CPPUNIT_ASSERT(columns == 6 && rows == 6);
+
+    CPPUNIT_ASSERT(FECEncoder::matrixSize(0.1, columns, rows));
+    CPPUNIT_ASSERT(columns == 20 && rows == 20);
+}
+
+void FECEncoderTest::repairPackets()
+{
+    FECEncoder encoder(MEDIA_SSRC, FEC_SSRC, 1000, MATRIX_SIZE, MATRIX_SIZE);
+    std::vector<std::vector<unsigned char>> repairs;
+    std::vector<unsigned char> other = packet(0);
+
+    repairs = protect(encoder, 65534, MATRIX_SIZE*MATRIX_SIZE);
+    CPPUNIT_ASSERT(repairs.size() == 2*MATRIX_SIZE);
+    CPPUNIT_ASSERT(encoder.getRepairPackets() == 2*MATRIX_SIZE);
+
+    for (unsigned i = 0; i < repairs.size(); i++) {
+        CPPUNIT_ASSERT(repairs[i][0] == 0x81);
+        CPPUNIT_ASSERT(repairs[i][1] == FEC_PAYLOAD_TYPE);
+        CPPUNIT_ASSERT(((repairs[i][2] << 8) | repairs[i][3]) == 1000 + i);
+        CPPUNIT_ASSERT(repairs[i][8] == 0x55 && repairs[i][15] == 0x44);
+        CPPUNIT_ASSERT((repairs[i][16] & 0xC0) == 0x40);
+        CPPUNIT_ASSERT(repairs[i][26] == MATRIX_SIZE);
+    }
+
+    //NOTE: rows are sent as soon as they are complete, columns at the end of the matrix
+    CPPUNIT_ASSERT(((repairs[1][24] << 8) | repairs[1][25]) == 2);
+    CPPUNIT_ASSERT(repairs[1][27] == 1);
+    CPPUNIT_ASSERT(((repairs[5][24] << 8) | repairs[5][25]) == 65535);
+    CPPUNIT_ASSERT(repairs[5][27] == MATRIX_SIZE);
+
+    other[11] ^= 0xFF;
+    encoder.protect(other.data(), other.size());
+    CPPUNIT_ASSERT(encoder.getRepairPackets() == 2*MATRIX_SIZE);
+}
+
+void FECEncoderTest::rowRecovery()
+{
+    FECEncoder encoder(MEDIA_SSRC, FEC_SSRC, 0, MATRIX_SIZE, 0);
+    std::vector<std::vector<unsigned char>> repairs;
+    std::vector<std::vector<unsigned char>> received;
+
+    repairs = protect(encoder, 100, MATRIX_SIZE);
+    CPPUNIT_ASSERT(repairs.size() == 1);
+    CPPUNIT_ASSERT(repairs[0][27] == 0);
+
+    for (uint16_t seq = 100; seq < 100 + MATRIX_SIZE; seq++) {
+        if (seq != 102) {
+            received.push_back(packet(seq));
+        }
+    }
+
+    CPPUNIT_ASSERT(sameRecovered(recover(repairs[0], received), packet(102)));
+}
+
+void FECEncoderTest::burstRecovery()
+{
+    FECEncoder encoder(MEDIA_SSRC, FEC_SSRC, 0, MATRIX_SIZE, MATRIX_SIZE);
+    std::vector<std::vector<unsigned char>> repairs;
+    std::vector<std::vector<unsigned char>> received;
+    uint16_t first = 200;
+
+    repairs = protect(encoder, first, MATRIX_SIZE*MATRIX_SIZE);
+
+    //NOTE: a burst of a whole row is lost, each of its packets is recovered from its column
+    for (unsigned c = 0; c < MATRIX_SIZE; c++) {
+        received.clear();
+        for (unsigned r = 0; r < MATRIX_SIZE; r++) {
+            if (r != 1) {
+                received.push_back(packet(first + r*MATRIX_SIZE + c));
+            }
+        }
+
+        CPPUNIT_ASSERT(sameRecovered(recover(repairs[MATRIX_SIZE + c], received), packet(first + MATRIX_SIZE + c)));
+    }
+}
+
+void FECEncoderTest::sequenceGap()
+{
+    FECEncoder encoder(MEDIA_SSRC, FEC_SSRC, 0, MATRIX_SIZE, 0);
+    std::vector<std::vector<unsigned char>> repairs;
+
+    repairs = protect(encoder, 300, 2);
+    repairs = protect(encoder, 310, MATRIX_SIZE);
+
+    CPPUNIT_ASSERT(repairs.size() == 1);
+    CPPUNIT_ASSERT(((repairs[0][24] << 8) | repairs[0][25]) == 310);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(FECEncoderTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("FECEncoderTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
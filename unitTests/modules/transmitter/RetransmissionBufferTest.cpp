@@ -0,0 +1,182 @@
+/*
+ *  RetransmissionBufferTest.cpp - RetransmissionBuffer class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/transmitter/RetransmissionBuffer.hh"
+#include "Utils.hh"
+
+#define MEDIA_SSRC 0x11223344
+#define RTX_SSRC 0x55667788
+#define PAYLOAD_SIZE 100
+
+class RetransmissionBufferTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(RetransmissionBufferTest);
+    CPPUNIT_TEST(rtxPacket);
+    CPPUNIT_TEST(duplicates);
+    CPPUNIT_TEST(expiration);
+    CPPUNIT_TEST(repetition);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void rtxPacket();
+    void duplicates();
+    void expiration();
+    void repetition();
+
+    unsigned packet(unsigned char* buffer, uint16_t seq, uint32_t ssrc = MEDIA_SSRC);
+};
+
+unsigned RetransmissionBufferTest::packet(unsigned char* buffer, uint16_t seq, uint32_t ssrc)
+{
+    buffer[0] = 0x80;
+    buffer[1] = 0x80 | 96;
+    buffer[2] = seq >> 8;
+    buffer[3] = seq & 0xFF;
+    buffer[4] = 0x01;
+    buffer[5] = 0x02;
+    buffer[6] = 0x03;
+    buffer[7] = 0x04;
+    buffer[8] = ssrc >> 24;
+    buffer[9] = (ssrc >> 16) & 0xFF;
+    buffer[10] = (ssrc >> 8) & 0xFF;
+    buffer[11] = ssrc & 0xFF;
+    memset(buffer + RTP_HEADER_SIZE, seq & 0xFF, PAYLOAD_SIZE);
+
+    return RTP_HEADER_SIZE + PAYLOAD_SIZE;
+}
+
+void RetransmissionBufferTest::rtxPacket()
+{
+    RetransmissionBuffer buffer(RTX_SSRC, 500);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    unsigned char original[RTX_MAX_PACKET_SIZE];
+    unsigned char rtx[RTX_MAX_PACKET_SIZE];
+    unsigned size;
+
+    for (uint16_t seq = 65530; seq != 10; seq++) {
+        size = packet(original, seq);
+        buffer.store(original, size, now);
+    }
+
+    CPPUNIT_ASSERT(buffer.getStoredPackets() == 16);
+    CPPUNIT_ASSERT(buffer.retransmission(11, rtx, now) == 0);
+    CPPUNIT_ASSERT(buffer.getUnrecoverable() == 1);
+
+    size = packet(original, 3);
+    CPPUNIT_ASSERT(buffer.retransmission(3, rtx, now) == size + 2);
+    CPPUNIT_ASSERT(rtx[0] == original[0]);
+    CPPUNIT_ASSERT(rtx[1] == (0x80 | RTX_PAYLOAD_TYPE));
+    CPPUNIT_ASSERT(((rtx[2] << 8) | rtx[3]) == 500);
+    CPPUNIT_ASSERT(memcmp(rtx + 4, original + 4, 4) == 0);
+    CPPUNIT_ASSERT(rtx[8] == 0x55 && rtx[11] == 0x88);
+    CPPUNIT_ASSERT(rtx[12] == 0 && rtx[13] == 3);
+    CPPUNIT_ASSERT(memcmp(rtx + 14, original + RTP_HEADER_SIZE, PAYLOAD_SIZE) == 0);
+
+    CPPUNIT_ASSERT(buffer.retransmission(65531, rtx, now) == size + 2);
+    CPPUNIT_ASSERT(((rtx[2] << 8) | rtx[3]) == 501);
+    CPPUNIT_ASSERT(buffer.getRetransmitted() == 2);
+}
+
+void RetransmissionBufferTest::duplicates()
+{
+    RetransmissionBuffer buffer(RTX_SSRC, 0);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    unsigned char original[RTX_MAX_PACKET_SIZE];
+    unsigned char rtx[RTX_MAX_PACKET_SIZE];
+    unsigned size;
+
+    size = packet(original, 7);
+    buffer.store(original, size, now);
+    buffer.store(original, size, now);
+    CPPUNIT_ASSERT(buffer.getStoredPackets() == 1);
+
+    size = buffer.retransmission(7, rtx, now);
+    CPPUNIT_ASSERT(size > 0);
+    buffer.store(rtx, size, now);
+    CPPUNIT_ASSERT(buffer.getStoredPackets() == 1);
+
+    buffer.store(original, RTP_HEADER_SIZE - 1, now);
+    CPPUNIT_ASSERT(buffer.getStoredPackets() == 1);
+}
+
+void RetransmissionBufferTest::expiration()
+{
+    RetransmissionBuffer buffer(RTX_SSRC, 0, RTX_PAYLOAD_TYPE, 100);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    unsigned char original[RTX_MAX_PACKET_SIZE];
+    unsigned char rtx[RTX_MAX_PACKET_SIZE];
+    unsigned size;
+
+    for (uint16_t seq = 0; seq < 20; seq++) {
+        size = packet(original, seq);
+        buffer.store(original, size, now + std::chrono::milliseconds(10*seq));
+    }
+
+    CPPUNIT_ASSERT(buffer.getStoredPackets() == 11);
+    CPPUNIT_ASSERT(buffer.retransmission(8, rtx, now + std::chrono::milliseconds(190)) == 0);
+    CPPUNIT_ASSERT(buffer.retransmission(9, rtx, now + std::chrono::milliseconds(190)) > 0);
+    CPPUNIT_ASSERT(buffer.retransmission(19, rtx, now + std::chrono::milliseconds(300)) == 0);
+    CPPUNIT_ASSERT(buffer.getStoredPackets() == 0);
+}
+
+void RetransmissionBufferTest::repetition()
+{
+    RetransmissionBuffer buffer(RTX_SSRC, 0);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    unsigned char original[RTX_MAX_PACKET_SIZE];
+    unsigned char rtx[RTX_MAX_PACKET_SIZE];
+    unsigned size;
+
+    size = packet(original, 1);
+    buffer.store(original, size, now);
+
+    CPPUNIT_ASSERT(buffer.retransmission(1, rtx, now) > 0);
+    CPPUNIT_ASSERT(buffer.retransmission(1, rtx, now + std::chrono::milliseconds(RTX_REPEAT_INTERVAL/2)) == 0);
+    CPPUNIT_ASSERT(buffer.retransmission(1, rtx, now + std::chrono::milliseconds(RTX_REPEAT_INTERVAL)) > 0);
+    CPPUNIT_ASSERT(buffer.getRetransmitted() == 2);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RetransmissionBufferTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("RetransmissionBufferTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+/*
+ *  RidTaggerTest.cpp - RidTagger class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/transmitter/RidTagger.hh"
+#include "Utils.hh"
+
+#define LAYER_SSRC 0x11223344
+#define OTHER_SSRC 0x55667788
+#define PAYLOAD_SIZE 100
+
+class RidTaggerTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(RidTaggerTest);
+    CPPUNIT_TEST(validRids);
+    CPPUNIT_TEST(extension);
+    CPPUNIT_TEST(untagged);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void validRids();
+    void extension();
+    void untagged();
+
+    unsigned packet(unsigned char* buffer, uint32_t ssrc);
+};
+
+unsigned RidTaggerTest::packet(unsigned char* buffer, uint32_t ssrc)
+{
+    buffer[0] = 0x80;
+    buffer[1] = 0x80 | 96;
+    buffer[2] = 0x12;
+    buffer[3] = 0x34;
+    memset(buffer + 4, 0xAB, 4);
+    buffer[8] = ssrc >> 24;
+    buffer[9] = (ssrc >> 16) & 0xFF;
+    buffer[10] = (ssrc >> 8) & 0xFF;
+    buffer[11] = ssrc & 0xFF;
+
+    for (unsigned i = 0; i < PAYLOAD_SIZE; i++) {
+        buffer[12 + i] = i;
+    }
+
+    return 12 + PAYLOAD_SIZE;
+}
+
+void RidTaggerTest::validRids()
+{
+    RidTagger tagger;
+    RidTagger badId(15);
+
+    CPPUNIT_ASSERT(!tagger.setRid(LAYER_SSRC, ""));
+    CPPUNIT_ASSERT(!tagger.setRid(LAYER_SSRC, "r 0"));
+    CPPUNIT_ASSERT(!tagger.setRid(LAYER_SSRC, std::string(RID_MAX_SIZE + 1, 'a')));
+    CPPUNIT_ASSERT(!badId.setRid(LAYER_SSRC, "r0"));
+    CPPUNIT_ASSERT(tagger.setRid(LAYER_SSRC, "hi-res_1"));
+    CPPUNIT_ASSERT(tagger.getRid(LAYER_SSRC) == "hi-res_1");
+    CPPUNIT_ASSERT(tagger.getRid(OTHER_SSRC).empty());
+}
+
+void RidTaggerTest::extension()
+{
+    RidTagger tagger(3);
+    unsigned char in[RID_MAX_PACKET_SIZE];
+    unsigned char out[RID_MAX_PACKET_SIZE];
+    unsigned size = packet(in, LAYER_SSRC);
+    unsigned tagged;
+
+    CPPUNIT_ASSERT(tagger.setRid(LAYER_SSRC, "r1"));
+    tagged = tagger.tag(in, size, out, sizeof(out));
+
+    //NOTE: a 4 byte extension header and the element (1 + 2 bytes) padded to a 32 bit word
+    CPPUNIT_ASSERT(tagged == size + 8);
+    CPPUNIT_ASSERT(out[0] == 0x90);
+    CPPUNIT_ASSERT(memcmp(out + 1, in + 1, 11) == 0);
+    CPPUNIT_ASSERT(out[12] == 0xBE && out[13] == 0xDE);
+    CPPUNIT_ASSERT(out[14] == 0 && out[15] == 1);
+    CPPUNIT_ASSERT(out[16] == ((3 << 4) | 1));
+    CPPUNIT_ASSERT(out[17] == 'r' && out[18] == '1' && out[19] == 0);
+    CPPUNIT_ASSERT(memcmp(out + 20, in + 12, PAYLOAD_SIZE) == 0);
+
+    CPPUNIT_ASSERT(tagger.tag(in, size, out, size + 7) == 0);
+}
+
+void RidTaggerTest::untagged()
+{
+    RidTagger tagger;
+    unsigned char in[RID_MAX_PACKET_SIZE];
+    unsigned char out[RID_MAX_PACKET_SIZE];
+    unsigned size;
+
+    CPPUNIT_ASSERT(tagger.setRid(LAYER_SSRC, "r0"));
+
+    size = packet(in, OTHER_SSRC);
+    CPPUNIT_ASSERT(tagger.tag(in, size, out, sizeof(out)) == 0);
+
+    size = packet(in, LAYER_SSRC);
+    in[0] |= 0x10;
+    CPPUNIT_ASSERT(tagger.tag(in, size, out, sizeof(out)) == 0);
+
+    CPPUNIT_ASSERT(tagger.tag(in, 8, out, sizeof(out)) == 0);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RidTaggerTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("RidTaggerTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+/*
+ *  SimulcastSelectorTest.cpp - SimulcastSelector class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/transmitter/SimulcastSelector.hh"
+#include "Utils.hh"
+
+#define SPS_NAL 0x67
+#define IDR_NAL 0x65
+#define P_NAL 0x41
+#define FIRST_SLICE 0x80
+#define NEXT_SLICE 0x40
+
+class SimulcastSelectorTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(SimulcastSelectorTest);
+    CPPUNIT_TEST(initialLayer);
+    CPPUNIT_TEST(switchAtKeyPicture);
+    CPPUNIT_TEST(upMargin);
+    CPPUNIT_TEST(parameterSets);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void initialLayer();
+    void switchAtKeyPicture();
+    void upMargin();
+    void parameterSets();
+
+    bool nal(unsigned layer, unsigned char type, unsigned char slice = FIRST_SLICE);
+
+    SimulcastSelector* selector;
+    bool switched;
+};
+
+void SimulcastSelectorTest::setUp()
+{
+    selector = new SimulcastSelector(H264, 3);
+    selector->setLayerBitrate(0, 2000);
+    selector->setLayerBitrate(1, 500);
+    selector->setLayerBitrate(2, 1000);
+}
+
+void SimulcastSelectorTest::tearDown()
+{
+    delete selector;
+}
+
+bool SimulcastSelectorTest::nal(unsigned layer, unsigned char type, unsigned char slice)
+{
+    unsigned char data[3] = {type, slice, 0};
+
+    return selector->forward(layer, data, sizeof(data), switched);
+}
+
+void SimulcastSelectorTest::initialLayer()
+{
+    //NOTE: without a target, the first layer is forwarded from its first IDR
+    CPPUNIT_ASSERT(selector->getLayer() == -1);
+    CPPUNIT_ASSERT(!nal(0, P_NAL));
+    CPPUNIT_ASSERT(!nal(1, IDR_NAL));
+    CPPUNIT_ASSERT(nal(0, IDR_NAL) && switched);
+    CPPUNIT_ASSERT(selector->getLayer() == 0);
+    CPPUNIT_ASSERT(nal(0, IDR_NAL, NEXT_SLICE) && !switched);
+    CPPUNIT_ASSERT(selector->getSwitches() == 0);
+
+    selector->setTargetBitrate(0);
+    CPPUNIT_ASSERT(selector->getPendingLayer() == -1);
+}
+
+void SimulcastSelectorTest::switchAtKeyPicture()
+{
+    CPPUNIT_ASSERT(nal(0, IDR_NAL));
+
+    //NOTE: the layer which fits is the 1000 kbps one, not the first one of the list
+    selector->setTargetBitrate(1100);
+    CPPUNIT_ASSERT(selector->getPendingLayer() == 2);
+    CPPUNIT_ASSERT(nal(0, P_NAL));
+    CPPUNIT_ASSERT(!nal(2, P_NAL));
+    CPPUNIT_ASSERT(!nal(2, IDR_NAL, NEXT_SLICE));
+    CPPUNIT_ASSERT(nal(0, P_NAL));
+
+    CPPUNIT_ASSERT(nal(2, IDR_NAL) && switched);
+    CPPUNIT_ASSERT(!nal(0, IDR_NAL));
+    CPPUNIT_ASSERT(selector->getLayer() == 2);
+    CPPUNIT_ASSERT(selector->getSwitches() == 1);
+
+    //NOTE: below every layer, the lowest one is forwarded
+    selector->setTargetBitrate(100);
+    CPPUNIT_ASSERT(selector->getPendingLayer() == 1);
+}
+
+void SimulcastSelectorTest::upMargin()
+{
+    selector->setTargetBitrate(600);
+    CPPUNIT_ASSERT(nal(1, IDR_NAL));
+    CPPUNIT_ASSERT(selector->getLayer() == 1);
+
+    selector->setTargetBitrate(1100);
+    CPPUNIT_ASSERT(selector->getPendingLayer() == -1);
+
+    selector->setTargetBitrate(1200);
+    CPPUNIT_ASSERT(selector->getPendingLayer() == 2);
+    CPPUNIT_ASSERT(nal(2, IDR_NAL));
+
+    //NOTE: staying on the current layer does not need the margin
+    selector->setTargetBitrate(1000);
+    CPPUNIT_ASSERT(selector->getPendingLayer() == -1);
+
+    selector->setTargetBitrate(900);
+    CPPUNIT_ASSERT(selector->getPendingLayer() == 1);
+}
+
+void SimulcastSelectorTest::parameterSets()
+{
+    unsigned char sps[4] = {SPS_NAL, 0x42, 0x00, 0x1F};
+
+    CPPUNIT_ASSERT(!selector->forward(2, sps, sizeof(sps), switched));
+    CPPUNIT_ASSERT(selector->getParameterSets(2).size() == 1);
+    CPPUNIT_ASSERT(selector->getParameterSets(2).at(7).size() == sizeof(sps));
+    CPPUNIT_ASSERT(selector->getParameterSets(0).empty());
+    CPPUNIT_ASSERT(!selector->forward(3, sps, sizeof(sps), switched));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SimulcastSelectorTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("SimulcastSelectorTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -36,6 +36,8 @@ class SinkManagerTest : public CppUnit::TestFixture
     CPPUNIT_TEST(addMpegTsRTPConnection);
     CPPUNIT_TEST(addRTSPConnectionMPEGTS);
     CPPUNIT_TEST(addRTSPConnectionSTD);
+    CPPUNIT_TEST(addSRTConnection);
+    CPPUNIT_TEST(addWebRTCConnection);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -46,6 +48,8 @@ protected:
     void addMpegTsRTPConnection();
     void addRTSPConnectionMPEGTS();
     void addRTSPConnectionSTD();
+    void addSRTConnection();
+    void addWebRTCConnection();
 
 protected:
     SinkManager* sinkManager = NULL;
@@ -95,7 +99,11 @@ void SinkManagerTest::addMpegTsRTPConnection()
 
     readers.push_back(vReaderId);
     readers.push_back(aReaderId);
-    CPPUNIT_ASSERT(sinkManager->addRTPConnection(readers, id, ip, port, txFormat));
+    CPPUNIT_ASSERT(!sinkManager->addRTPConnection(readers, id, ip, port, txFormat, 0.5));
+    CPPUNIT_ASSERT(!sinkManager->addRTPConnection(readers, id, ip, port, txFormat, 0, false, 0.05));
+    CPPUNIT_ASSERT(!sinkManager->addRTPConnection(readers, id, ip, port, txFormat, 0, false, 0, MAX_AUDIO_PTIME + 1));
+    CPPUNIT_ASSERT(sinkManager->addRTPConnection(readers, id, ip, port, txFormat, 1.5));
+    CPPUNIT_ASSERT(dynamic_cast<RTPConnection*>(sinkManager->getConnections()[id])->getPacing() == 1.5);
 
     CPPUNIT_ASSERT(!sinkManager->addRTPConnection(readers, id, ip, port, txFormat));
     
@@ -161,6 +169,65 @@ void SinkManagerTest::addRTSPConnectionSTD()
     CPPUNIT_ASSERT(!sinkManager->removeConnection(id));
 }
 
+void SinkManagerTest::addSRTConnection()
+{
+    std::vector<int> readers;
+    int id = 4321;
+    std::string ip = "127.0.0.1";
+    int port = 6010;
+
+    CPPUNIT_ASSERT(sinkManager != NULL);
+
+    readers.push_back(fakevReaderId);
+    CPPUNIT_ASSERT(!sinkManager->addSRTConnection(readers, id, ip, port, SRT_LISTENER));
+    readers.clear();
+
+    readers.push_back(vReaderId);
+    readers.push_back(vReaderId);
+    CPPUNIT_ASSERT(!sinkManager->addSRTConnection(readers, id, ip, port, SRT_LISTENER));
+    readers.clear();
+
+    readers.push_back(vReaderId);
+    readers.push_back(aReaderId);
+    CPPUNIT_ASSERT(!sinkManager->addSRTConnection(readers, id, "not an ip", port, SRT_CALLER));
+    CPPUNIT_ASSERT(sinkManager->addSRTConnection(readers, id, ip, port, SRT_LISTENER));
+    CPPUNIT_ASSERT(dynamic_cast<SRTConnection*>(sinkManager->getConnections()[id])->getMode() == SRT_LISTENER);
+
+    CPPUNIT_ASSERT(!sinkManager->addSRTConnection(readers, id, ip, port, SRT_LISTENER));
+
+    CPPUNIT_ASSERT(sinkManager->removeConnection(id));
+    CPPUNIT_ASSERT(!sinkManager->removeConnection(id));
+}
+
+void SinkManagerTest::addWebRTCConnection()
+{
+    std::vector<int> readers;
+    int id = 5432;
+    std::string name = "testWebRTC";
+
+    CPPUNIT_ASSERT(sinkManager != NULL);
+
+    readers.push_back(fakevReaderId);
+    CPPUNIT_ASSERT(!sinkManager->addWebRTCConnection(readers, id, name));
+    readers.clear();
+
+    //NOTE: browsers only get opus audio, the AAC reader is refused
+    readers.push_back(vReaderId);
+    readers.push_back(aReaderId);
+    CPPUNIT_ASSERT(!sinkManager->addWebRTCConnection(readers, id, name));
+    readers.clear();
+
+    readers.push_back(vReaderId);
+    CPPUNIT_ASSERT(sinkManager->addWebRTCConnection(readers, id, name));
+    CPPUNIT_ASSERT(dynamic_cast<WebRTCConnection*>(sinkManager->getConnections()[id])->getPath() == "/whep/" + name);
+
+    CPPUNIT_ASSERT(!sinkManager->addWebRTCConnection(readers, id, name));
+    CPPUNIT_ASSERT(!sinkManager->addWebRTCConnection(readers, id + 1, name, "", WEBRTC_WHEP_PORT + 1));
+
+    CPPUNIT_ASSERT(sinkManager->removeConnection(id));
+    CPPUNIT_ASSERT(!sinkManager->removeConnection(id));
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION( SinkManagerTest );
 
 int main(int argc, char* argv[])
@@ -0,0 +1,325 @@
+/*
+ *  TSPacketizerTest.cpp - TSPacketizer class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/transmitter/TSPacketizer.hh"
+#include "Utils.hh"
+
+#define VIDEO_PID TS_FIRST_ES_PID
+#define AUDIO_PID (TS_FIRST_ES_PID + 1)
+
+class TSPacketizerTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TSPacketizerTest);
+    CPPUNIT_TEST(streams);
+    CPPUNIT_TEST(programTables);
+    CPPUNIT_TEST(audioPES);
+    CPPUNIT_TEST(videoPES);
+    CPPUNIT_TEST(continuityCounters);
+    CPPUNIT_TEST(arena);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void streams();
+    void programTables();
+    void audioPES();
+    void videoPES();
+    void continuityCounters();
+    void arena();
+
+    std::vector<unsigned char> frame(unsigned size, unsigned char seed);
+    std::vector<std::vector<unsigned char>> drain(TSPacketizer& packetizer);
+    std::vector<unsigned char> payload(std::vector<std::vector<unsigned char>> const& packets, uint16_t pid);
+};
+
+static uint16_t pid(std::vector<unsigned char> const& packet)
+{
+    return ((packet[1] & 0x1F) << 8) | packet[2];
+}
+
+static uint64_t readPTS(const unsigned char* p)
+{
+    return ((uint64_t) (p[0] & 0x0E) << 29) | (p[1] << 22) | ((p[2] & 0xFE) << 14) | (p[3] << 7) | (p[4] >> 1);
+}
+
+static uint32_t crc32(const unsigned char* data, unsigned size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (unsigned i = 0; i < size; i++) {
+        crc ^= (uint32_t) data[i] << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+std::vector<unsigned char> TSPacketizerTest::frame(unsigned size, unsigned char seed)
+{
+    std::vector<unsigned char> f(size);
+
+    for (unsigned i = 0; i < size; i++) {
+        f[i] = seed + i*7;
+    }
+
+    return f;
+}
+
+std::vector<std::vector<unsigned char>> TSPacketizerTest::drain(TSPacketizer& packetizer)
+{
+    std::vector<std::vector<unsigned char>> packets;
+    const unsigned char* p;
+
+    while (packetizer.getPendingPackets() > 0) {
+        p = packetizer.getPackets();
+        packets.push_back(std::vector<unsigned char>(p, p + TS_PACKET_SIZE));
+        packetizer.consume(1);
+    }
+
+    return packets;
+}
+
+std::vector<unsigned char> TSPacketizerTest::payload(std::vector<std::vector<unsigned char>> const& packets,
+                                                     uint16_t streamPid)
+{
+    std::vector<unsigned char> data;
+    unsigned offset;
+
+    for (auto& p : packets) {
+        if (pid(p) != streamPid) {
+            continue;
+        }
+
+        offset = 4;
+        if (p[3] & 0x20) {
+            offset += 1 + p[4];
+        }
+
+        data.insert(data.end(), p.begin() + offset, p.end());
+    }
+
+    return data;
+}
+
+void TSPacketizerTest::streams()
+{
+    TSPacketizer packetizer;
+    std::vector<unsigned char> f = frame(10, 0);
+
+    CPPUNIT_ASSERT(packetizer.addStream(0x06) == -1);
+    CPPUNIT_ASSERT(packetizer.addStream(TS_STREAM_H264) == 0);
+    CPPUNIT_ASSERT(packetizer.addStream(TS_STREAM_AAC) == 1);
+    CPPUNIT_ASSERT(!packetizer.writeFrame(2, f.data(), f.size(), 0));
+    CPPUNIT_ASSERT(!packetizer.writeFrame(0, f.data(), 0, 0));
+    CPPUNIT_ASSERT(packetizer.getPendingPackets() == 0);
+}
+
+void TSPacketizerTest::programTables()
+{
+    TSPacketizer packetizer;
+    std::vector<std::vector<unsigned char>> packets;
+    std::vector<unsigned char> f = frame(100, 1);
+    const unsigned char* section;
+    unsigned length;
+
+    packetizer.addStream(TS_STREAM_AAC);
+    packetizer.addStream(TS_STREAM_H265);
+    packetizer.writeFrame(0, f.data(), f.size(), 1000);
+    packets = drain(packetizer);
+
+    CPPUNIT_ASSERT(packets.size() == 3);
+    CPPUNIT_ASSERT(pid(packets[0]) == 0 && pid(packets[1]) == TS_PMT_PID);
+
+    section = packets[0].data() + 5;
+    length = ((section[1] & 0x0F) << 8) | section[2];
+    CPPUNIT_ASSERT(crc32(section, 3 + length) == 0);
+    CPPUNIT_ASSERT((((section[10] & 0x1F) << 8) | section[11]) == TS_PMT_PID);
+
+    //NOTE: the video stream carries the PCR although it was added after the audio one
+    section = packets[1].data() + 5;
+    length = ((section[1] & 0x0F) << 8) | section[2];
+    CPPUNIT_ASSERT(crc32(section, 3 + length) == 0);
+    CPPUNIT_ASSERT((((section[8] & 0x1F) << 8) | section[9]) == AUDIO_PID);
+    CPPUNIT_ASSERT(section[12] == TS_STREAM_AAC && section[17] == TS_STREAM_H265);
+
+    //NOTE: tables are repeated before random access points, with the next continuity counter
+    packetizer.writeFrame(1, f.data(), f.size(), 1000, true, true);
+    packets = drain(packetizer);
+    CPPUNIT_ASSERT(pid(packets[0]) == 0 && (packets[0][3] & 0x0F) == 1);
+
+    packetizer.writeFrame(1, f.data(), f.size(), 2000);
+    CPPUNIT_ASSERT(pid(drain(packetizer)[0]) == AUDIO_PID);
+
+    packetizer.writeFrame(1, f.data(), f.size(), 1000 + TS_PSI_INTERVAL);
+    CPPUNIT_ASSERT(pid(drain(packetizer)[0]) == 0);
+}
+
+void TSPacketizerTest::audioPES()
+{
+    TSPacketizer packetizer;
+    std::vector<std::vector<unsigned char>> packets;
+    std::vector<unsigned char> f = frame(400, 2);
+    std::vector<unsigned char> pes;
+    uint64_t pts = 0x1ABCDEF12ULL;
+
+    packetizer.addStream(TS_STREAM_AAC);
+    packetizer.writeFrame(0, f.data(), f.size(), pts);
+    packets = drain(packetizer);
+
+    CPPUNIT_ASSERT(packets.size() == 2 + 3);
+    for (auto& p : packets) {
+        CPPUNIT_ASSERT(p[0] == 0x47);
+    }
+
+    CPPUNIT_ASSERT(packets[2][1] & 0x40);
+    CPPUNIT_ASSERT(!(packets[3][1] & 0x40));
+
+    //NOTE: the audio stream is the PCR one, its PCR lags TS_PCR_DELAY behind the PTS
+    CPPUNIT_ASSERT((packets[2][3] & 0x20) && (packets[2][5] & 0x10));
+    CPPUNIT_ASSERT(((((uint64_t) packets[2][6] << 25) | (packets[2][7] << 17) | (packets[2][8] << 9) |
+                     (packets[2][9] << 1) | (packets[2][10] >> 7)) + TS_PCR_DELAY) == pts);
+
+    pes = payload(packets, TS_FIRST_ES_PID);
+    CPPUNIT_ASSERT(pes.size() == 14 + f.size());
+    CPPUNIT_ASSERT(pes[0] == 0 && pes[1] == 0 && pes[2] == 1 && pes[3] == 0xC0);
+    CPPUNIT_ASSERT(((pes[4] << 8) | pes[5]) == 8 + f.size());
+    CPPUNIT_ASSERT(pes[7] == 0x80 && pes[8] == 5);
+    CPPUNIT_ASSERT(readPTS(pes.data() + 9) == pts);
+    CPPUNIT_ASSERT(memcmp(pes.data() + 14, f.data(), f.size()) == 0);
+}
+
+void TSPacketizerTest::videoPES()
+{
+    TSPacketizer packetizer;
+    std::vector<std::vector<unsigned char>> packets;
+    std::vector<unsigned char> nal = frame(1000, 3);
+    std::vector<unsigned char> pes;
+    unsigned char aud[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xF0};
+
+    nal[0] = 0;
+    nal[1] = 0;
+    nal[2] = 0;
+    nal[3] = 1;
+    nal[4] = 0x65;
+
+    packetizer.addStream(TS_STREAM_H264);
+    packetizer.writeFrame(0, nal.data(), nal.size(), 3000, true, true);
+    packets = drain(packetizer);
+
+    CPPUNIT_ASSERT(packets[2][5] & 0x40);
+
+    pes = payload(packets, VIDEO_PID);
+    CPPUNIT_ASSERT(pes[3] == 0xE0 && pes[4] == 0 && pes[5] == 0);
+    CPPUNIT_ASSERT(memcmp(pes.data() + 14, aud, sizeof(aud)) == 0);
+    CPPUNIT_ASSERT(memcmp(pes.data() + 14 + sizeof(aud), nal.data(), nal.size()) == 0);
+
+    //NOTE: the rest of the access unit goes in PES packets without PTS nor delimiter
+    packetizer.writeFrame(0, nal.data(), nal.size(), 3000, false);
+    packets = drain(packetizer);
+    CPPUNIT_ASSERT(!(packets[0][3] & 0x20));
+
+    pes = payload(packets, VIDEO_PID);
+    CPPUNIT_ASSERT(pes.size() == 9 + nal.size());
+    CPPUNIT_ASSERT(pes[7] == 0 && pes[8] == 0);
+    CPPUNIT_ASSERT(memcmp(pes.data() + 9, nal.data(), nal.size()) == 0);
+}
+
+void TSPacketizerTest::continuityCounters()
+{
+    TSPacketizer packetizer;
+    std::vector<std::vector<unsigned char>> packets;
+    std::vector<unsigned char> f = frame(3000, 4);
+    unsigned char next[2] = {0, 0};
+    unsigned index;
+
+    packetizer.addStream(TS_STREAM_H264);
+    packetizer.addStream(TS_STREAM_MP3);
+
+    for (unsigned i = 0; i < 10; i++) {
+        packetizer.writeFrame(i % 2, f.data(), f.size() - i*100, i*3000);
+    }
+
+    packets = drain(packetizer);
+
+    for (auto& p : packets) {
+        if (pid(p) != VIDEO_PID && pid(p) != AUDIO_PID) {
+            continue;
+        }
+
+        index = pid(p) - TS_FIRST_ES_PID;
+        CPPUNIT_ASSERT((p[3] & 0x0F) == next[index]);
+        next[index] = (next[index] + 1) & 0x0F;
+    }
+
+    CPPUNIT_ASSERT(next[0] != 0 && next[1] != 0);
+}
+
+void TSPacketizerTest::arena()
+{
+    TSPacketizer packetizer;
+    std::vector<unsigned char> f = frame(TS_ARENA_PACKETS*TS_PACKET_SIZE, 5);
+    std::vector<unsigned char> pes;
+    unsigned pending;
+
+    packetizer.addStream(TS_STREAM_AAC);
+    packetizer.writeFrame(0, f.data(), 500, 0);
+    packetizer.consume(1);
+
+    //NOTE: a frame larger than the arena keeps the pending packets
+    packetizer.writeFrame(0, f.data(), f.size(), 100);
+    pending = packetizer.getPendingPackets();
+    CPPUNIT_ASSERT(pending > TS_ARENA_PACKETS);
+    CPPUNIT_ASSERT(packetizer.getWrittenPackets() == pending + 1);
+    CPPUNIT_ASSERT(packetizer.getPackets()[0] == 0x47 && ((packetizer.getPackets()[1] & 0x1F) << 8 |
+                   packetizer.getPackets()[2]) == TS_PMT_PID);
+
+    packetizer.consume(pending);
+    CPPUNIT_ASSERT(packetizer.getPendingPackets() == 0);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TSPacketizerTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("TSPacketizerTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
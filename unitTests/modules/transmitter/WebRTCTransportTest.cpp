@@ -0,0 +1,454 @@
+/*
+ *  WebRTCTransportTest.cpp - SRTPContext, IceLite and WebRTCPacketizer classes test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <arpa/inet.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/transmitter/SRTPContext.hh"
+#include "modules/transmitter/IceLite.hh"
+#include "modules/transmitter/WebRTCPacketizer.hh"
+#include "Utils.hh"
+
+#define MEDIA_SSRC 0x11223344
+#define STUN_PASSWORD "VOkJxbRl1RmTxUk/WvJxBt"
+
+//NOTE: RFC 3711 B.3 key derivation test vectors
+static const unsigned char masterKey[] = {0xE1, 0xF9, 0x7A, 0x0D, 0x3E, 0x01, 0x8B, 0xE0,
+                                          0xD6, 0x4F, 0xA3, 0x2C, 0x06, 0xDE, 0x41, 0x39};
+static const unsigned char masterSalt[] = {0x0E, 0xC6, 0x75, 0xAD, 0x49, 0x8A, 0xFE, 0xEB,
+                                           0xB6, 0x96, 0x0B, 0x3A, 0xAB, 0xE6};
+static const unsigned char cipherKey[] = {0xC6, 0x1E, 0x7A, 0x93, 0x74, 0x4F, 0x39, 0xEE,
+                                          0x10, 0x73, 0x4A, 0xFE, 0x3F, 0xF7, 0xA0, 0x87};
+static const unsigned char cipherSalt[] = {0x30, 0xCB, 0xBC, 0x08, 0x86, 0x3D, 0x8C, 0x85,
+                                           0xD4, 0x9D, 0xB3, 0x4A, 0x9A, 0xE1};
+static const unsigned char authKey[] = {0xCE, 0xBE, 0x32, 0x1F, 0x6F, 0xF7, 0x71, 0x6B, 0x6F, 0xD4,
+                                        0xAB, 0x49, 0xAF, 0x25, 0x6A, 0x15, 0x6D, 0x38, 0xBA, 0xA4};
+
+//NOTE: RFC 5769 2.1 sample request
+static const unsigned char stunRequest[] = {
+    0x00, 0x01, 0x00, 0x58, 0x21, 0x12, 0xa4, 0x42, 0xb7, 0xe7, 0xa7, 0x01, 0xbc, 0x34, 0xd6, 0x86,
+    0xfa, 0x87, 0xdf, 0xae, 0x80, 0x22, 0x00, 0x10, 0x53, 0x54, 0x55, 0x4e, 0x20, 0x74, 0x65, 0x73,
+    0x74, 0x20, 0x63, 0x6c, 0x69, 0x65, 0x6e, 0x74, 0x00, 0x24, 0x00, 0x04, 0x6e, 0x00, 0x01, 0xff,
+    0x80, 0x29, 0x00, 0x08, 0x93, 0x2f, 0xf9, 0xb1, 0x51, 0x26, 0x3b, 0x36, 0x00, 0x06, 0x00, 0x09,
+    0x65, 0x76, 0x74, 0x6a, 0x3a, 0x68, 0x36, 0x76, 0x59, 0x20, 0x20, 0x20, 0x00, 0x08, 0x00, 0x14,
+    0x9a, 0xea, 0xa7, 0x0c, 0xbf, 0xd8, 0xcb, 0x56, 0x78, 0x1e, 0xf2, 0xb5, 0xb2, 0xd3, 0xf2, 0x49,
+    0xc1, 0xb5, 0x71, 0xa2, 0x80, 0x28, 0x00, 0x04, 0xe5, 0x7a, 0x3b, 0xcf};
+
+class WebRTCTransportTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(WebRTCTransportTest);
+    CPPUNIT_TEST(keyDerivation);
+    CPPUNIT_TEST(protectRtp);
+    CPPUNIT_TEST(rolloverCounter);
+    CPPUNIT_TEST(protectRtcp);
+    CPPUNIT_TEST(stunRequestVector);
+    CPPUNIT_TEST(stunResponse);
+    CPPUNIT_TEST(h264Fragmentation);
+    CPPUNIT_TEST(h264ParameterSets);
+    CPPUNIT_TEST(vp8Descriptor);
+    CPPUNIT_TEST_SUITE_END();
+
+protected:
+    void keyDerivation();
+    void protectRtp();
+    void rolloverCounter();
+    void protectRtcp();
+    void stunRequestVector();
+    void stunResponse();
+    void h264Fragmentation();
+    void h264ParameterSets();
+    void vp8Descriptor();
+
+    std::vector<unsigned char> rtpPacket(uint16_t seq, unsigned payloadSize);
+    bool unprotect(const SRTPContext& srtp, std::vector<unsigned char> packet, unsigned size, uint32_t roc,
+                   std::vector<unsigned char> const& original);
+};
+
+std::vector<unsigned char> WebRTCTransportTest::rtpPacket(uint16_t seq, unsigned payloadSize)
+{
+    std::vector<unsigned char> packet(12 + payloadSize + SRTP_AUTH_TAG_SIZE, 0);
+
+    packet[0] = 0x80;
+    packet[1] = 96;
+    packet[2] = seq >> 8;
+    packet[3] = seq & 0xFF;
+    packet[8] = MEDIA_SSRC >> 24;
+    packet[9] = (MEDIA_SSRC >> 16) & 0xFF;
+    packet[10] = (MEDIA_SSRC >> 8) & 0xFF;
+    packet[11] = MEDIA_SSRC & 0xFF;
+
+    for (unsigned i = 0; i < payloadSize; i++) {
+        packet[12 + i] = i & 0xFF;
+    }
+
+    return packet;
+}
+
+//NOTE: checks the tag and decrypts with the session keys, as a receiver would (RFC 3711 3.3)
+bool WebRTCTransportTest::unprotect(const SRTPContext& srtp, std::vector<unsigned char> packet, unsigned size,
+                                    uint32_t roc, std::vector<unsigned char> const& original)
+{
+    unsigned char key[SRTP_MASTER_KEY_SIZE];
+    unsigned char salt[SRTP_MASTER_SALT_SIZE];
+    unsigned char auth[SRTP_AUTH_KEY_SIZE];
+    unsigned char iv[16] = {0};
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned digestLen;
+    unsigned length = size - SRTP_AUTH_TAG_SIZE;
+    std::vector<unsigned char> authenticated(packet.begin(), packet.begin() + length);
+    uint64_t index = ((uint64_t) roc << 16) | ((packet[2] << 8) | packet[3]);
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int len;
+
+    srtp.getSessionKey(0, key);
+    srtp.getSessionKey(1, auth);
+    srtp.getSessionKey(2, salt);
+
+    for (unsigned i = 0; i < 4; i++) {
+        authenticated.push_back((roc >> (24 - 8*i)) & 0xFF);
+    }
+
+    HMAC(EVP_sha1(), auth, sizeof(auth), authenticated.data(), authenticated.size(), digest, &digestLen);
+    if (memcmp(digest, packet.data() + length, SRTP_AUTH_TAG_SIZE) != 0) {
+        EVP_CIPHER_CTX_free(ctx);
+        return false;
+    }
+
+    memcpy(iv, salt, sizeof(salt));
+    for (unsigned i = 0; i < 4; i++) {
+        iv[4 + i] ^= (MEDIA_SSRC >> (24 - 8*i)) & 0xFF;
+    }
+    for (unsigned i = 0; i < 6; i++) {
+        iv[8 + i] ^= (index >> (40 - 8*i)) & 0xFF;
+    }
+
+    EVP_DecryptInit_ex(ctx, EVP_aes_128_ctr(), NULL, key, iv);
+    EVP_DecryptUpdate(ctx, packet.data() + 12, &len, packet.data() + 12, length - 12);
+    EVP_CIPHER_CTX_free(ctx);
+
+    return memcmp(packet.data(), original.data(), length) == 0;
+}
+
+void WebRTCTransportTest::keyDerivation()
+{
+    SRTPContext srtp;
+    unsigned char key[SRTP_MASTER_KEY_SIZE];
+    unsigned char salt[SRTP_MASTER_SALT_SIZE];
+    unsigned char auth[SRTP_AUTH_KEY_SIZE];
+
+    CPPUNIT_ASSERT(!srtp.hasKey());
+    CPPUNIT_ASSERT(srtp.setKey(masterKey, masterSalt));
+    CPPUNIT_ASSERT(srtp.hasKey());
+
+    CPPUNIT_ASSERT(srtp.getSessionKey(0, key));
+    CPPUNIT_ASSERT(srtp.getSessionKey(1, auth));
+    CPPUNIT_ASSERT(srtp.getSessionKey(2, salt));
+
+    CPPUNIT_ASSERT(memcmp(key, cipherKey, sizeof(key)) == 0);
+    CPPUNIT_ASSERT(memcmp(salt, cipherSalt, sizeof(salt)) == 0);
+    CPPUNIT_ASSERT(memcmp(auth, authKey, sizeof(auth)) == 0);
+
+    CPPUNIT_ASSERT(!srtp.getSessionKey(6, key));
+}
+
+void WebRTCTransportTest::protectRtp()
+{
+    SRTPContext srtp;
+    std::vector<unsigned char> original = rtpPacket(1000, 200);
+    std::vector<unsigned char> packet = original;
+    unsigned size = 212;
+    bool decrypted;
+
+    CPPUNIT_ASSERT(!srtp.protectRtp(packet.data(), size));
+
+    srtp.setKey(masterKey, masterSalt);
+    CPPUNIT_ASSERT(srtp.protectRtp(packet.data(), size));
+    CPPUNIT_ASSERT(size == 212 + SRTP_AUTH_TAG_SIZE);
+
+    CPPUNIT_ASSERT(memcmp(packet.data(), original.data(), 12) == 0);
+    CPPUNIT_ASSERT(memcmp(packet.data() + 12, original.data() + 12, 200) != 0);
+
+    decrypted = unprotect(srtp, packet, size, 0, original);
+    CPPUNIT_ASSERT(decrypted);
+
+    packet[20] ^= 1;
+    decrypted = unprotect(srtp, packet, size, 0, original);
+    CPPUNIT_ASSERT(!decrypted);
+}
+
+void WebRTCTransportTest::rolloverCounter()
+{
+    SRTPContext srtp;
+    std::vector<unsigned char> original;
+    std::vector<unsigned char> packet;
+    unsigned size;
+    bool decrypted;
+
+    srtp.setKey(masterKey, masterSalt);
+
+    original = rtpPacket(65535, 50);
+    packet = original;
+    size = 62;
+    CPPUNIT_ASSERT(srtp.protectRtp(packet.data(), size));
+    decrypted = unprotect(srtp, packet, size, 0, original);
+    CPPUNIT_ASSERT(decrypted);
+
+    original = rtpPacket(0, 50);
+    packet = original;
+    size = 62;
+    CPPUNIT_ASSERT(srtp.protectRtp(packet.data(), size));
+    decrypted = unprotect(srtp, packet, size, 1, original);
+    CPPUNIT_ASSERT(decrypted);
+
+    //NOTE: a late packet from before the wrap keeps the previous counter
+    original = rtpPacket(65534, 50);
+    packet = original;
+    size = 62;
+    CPPUNIT_ASSERT(srtp.protectRtp(packet.data(), size));
+    decrypted = unprotect(srtp, packet, size, 0, original);
+    CPPUNIT_ASSERT(decrypted);
+}
+
+void WebRTCTransportTest::protectRtcp()
+{
+    SRTPContext srtp;
+    std::vector<unsigned char> packet(28 + SRTP_MAX_OVERHEAD, 0);
+    unsigned char auth[SRTP_AUTH_KEY_SIZE];
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned digestLen;
+    unsigned size = 28;
+
+    packet[0] = 0x80;
+    packet[1] = 200;
+    packet[3] = 6;
+    packet[4] = 0x11;
+
+    srtp.setKey(masterKey, masterSalt);
+    CPPUNIT_ASSERT(srtp.protectRtcp(packet.data(), size));
+    CPPUNIT_ASSERT(size == 28 + SRTP_MAX_OVERHEAD);
+
+    //NOTE: E flag set and index 0, the tag covers the index
+    CPPUNIT_ASSERT(packet[28] == 0x80 && packet[29] == 0 && packet[30] == 0 && packet[31] == 0);
+
+    srtp.getSessionKey(4, auth);
+    HMAC(EVP_sha1(), auth, sizeof(auth), packet.data(), 32, digest, &digestLen);
+    CPPUNIT_ASSERT(memcmp(digest, packet.data() + 32, SRTP_AUTH_TAG_SIZE) == 0);
+
+    size = 28;
+    packet[1] = 200;
+    CPPUNIT_ASSERT(srtp.protectRtcp(packet.data(), size));
+    CPPUNIT_ASSERT(packet[31] == 1);
+}
+
+void WebRTCTransportTest::stunRequestVector()
+{
+    StunRequest request;
+    std::vector<unsigned char> tampered(stunRequest, stunRequest + sizeof(stunRequest));
+
+    CPPUNIT_ASSERT(IceLite::isStun(stunRequest, sizeof(stunRequest)));
+    CPPUNIT_ASSERT(IceLite::parseBindingRequest(stunRequest, sizeof(stunRequest), request));
+    CPPUNIT_ASSERT(request.username == "evtj:h6vY");
+    CPPUNIT_ASSERT(!request.useCandidate);
+    CPPUNIT_ASSERT(memcmp(request.transaction, stunRequest + 8, STUN_TRANSACTION_SIZE) == 0);
+
+    CPPUNIT_ASSERT(IceLite::checkIntegrity(stunRequest, sizeof(stunRequest), STUN_PASSWORD));
+    CPPUNIT_ASSERT(!IceLite::checkIntegrity(stunRequest, sizeof(stunRequest), "wrong"));
+
+    tampered[30] ^= 1;
+    CPPUNIT_ASSERT(!IceLite::checkIntegrity(tampered.data(), tampered.size(), STUN_PASSWORD));
+
+    //NOTE: DTLS and RTP datagrams are not STUN
+    tampered[0] = 22;
+    CPPUNIT_ASSERT(!IceLite::isStun(tampered.data(), tampered.size()));
+    tampered[0] = 0x80;
+    CPPUNIT_ASSERT(!IceLite::isStun(tampered.data(), tampered.size()));
+}
+
+void WebRTCTransportTest::stunResponse()
+{
+    StunRequest request;
+    std::vector<unsigned char> response;
+    struct sockaddr_in address;
+    struct sockaddr_in mapped;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(32853);
+    inet_pton(AF_INET, "192.0.2.1", &address.sin_addr);
+
+    CPPUNIT_ASSERT(IceLite::parseBindingRequest(stunRequest, sizeof(stunRequest), request));
+    IceLite::buildBindingResponse(request, address, STUN_PASSWORD, response);
+
+    CPPUNIT_ASSERT(IceLite::isStun(response.data(), response.size()));
+    CPPUNIT_ASSERT(((response[0] << 8) | response[1]) == STUN_BINDING_RESPONSE);
+    CPPUNIT_ASSERT(memcmp(response.data() + 8, request.transaction, STUN_TRANSACTION_SIZE) == 0);
+    CPPUNIT_ASSERT(IceLite::checkIntegrity(response.data(), response.size(), STUN_PASSWORD));
+
+    CPPUNIT_ASSERT(IceLite::getMappedAddress(response.data(), response.size(), mapped));
+    CPPUNIT_ASSERT(mapped.sin_port == address.sin_port);
+    CPPUNIT_ASSERT(mapped.sin_addr.s_addr == address.sin_addr.s_addr);
+
+    //NOTE: RFC 5769 2.2 XOR-MAPPED-ADDRESS of 192.0.2.1:32853
+    CPPUNIT_ASSERT(response[24] == 0 && response[25] == 1 && response[26] == 0xa1 && response[27] == 0x47);
+    CPPUNIT_ASSERT(response[28] == 0xe1 && response[29] == 0x12 && response[30] == 0xa6 && response[31] == 0x43);
+
+    CPPUNIT_ASSERT(IceLite::randomCredential(24).size() == 24);
+}
+
+void WebRTCTransportTest::h264Fragmentation()
+{
+    WebRTCPacketizer packetizer(WEBRTC_H264, MEDIA_SSRC);
+    std::vector<unsigned char> nal(3000);
+    std::vector<unsigned char> rebuilt;
+    struct timeval pts = {10, 0};
+    unsigned char* data;
+    size_t count;
+    uint16_t seq;
+
+    nal[0] = 0x65;
+    for (unsigned i = 1; i < nal.size(); i++) {
+        nal[i] = i & 0xFF;
+    }
+
+    count = packetizer.packetize(nal.data(), nal.size(), pts);
+    CPPUNIT_ASSERT(count == 3);
+
+    const std::vector<WebRTCPacket> &packets = packetizer.getPackets();
+    seq = (packetizer.getPacketData(packets[0])[2] << 8) | packetizer.getPacketData(packets[0])[3];
+
+    rebuilt.push_back(0x65);
+    for (size_t i = 0; i < count; i++) {
+        data = packetizer.getPacketData(packets[i]);
+
+        CPPUNIT_ASSERT(packets[i].size <= WEBRTC_MAX_PACKET);
+        CPPUNIT_ASSERT(((data[2] << 8) | data[3]) == (uint16_t) (seq + i));
+        CPPUNIT_ASSERT((data[1] & 0x80) == (i == count - 1 ? 0x80 : 0));
+        CPPUNIT_ASSERT(packets[i].keyframe == (i == 0));
+        CPPUNIT_ASSERT(data[12] == 0x7C);
+        CPPUNIT_ASSERT((data[13] & 0x1F) == 5);
+        CPPUNIT_ASSERT(((data[13] & 0x80) != 0) == (i == 0));
+        CPPUNIT_ASSERT(((data[13] & 0x40) != 0) == (i == count - 1));
+
+        rebuilt.insert(rebuilt.end(), data + 14, data + packets[i].size);
+    }
+
+    CPPUNIT_ASSERT(rebuilt == nal);
+
+    //NOTE: a small non VCL NAL unit goes in a single packet without marker
+    nal.resize(20);
+    nal[0] = 0x06;
+    count = packetizer.packetize(nal.data(), nal.size(), pts);
+    CPPUNIT_ASSERT(count == 1);
+    data = packetizer.getPacketData(packetizer.getPackets()[0]);
+    CPPUNIT_ASSERT(packetizer.getPackets()[0].size == 32);
+    CPPUNIT_ASSERT(data[12] == 0x06 && (data[1] & 0x80) == 0);
+    CPPUNIT_ASSERT(((data[2] << 8) | data[3]) == (uint16_t) (seq + 3));
+}
+
+void WebRTCTransportTest::h264ParameterSets()
+{
+    WebRTCPacketizer packetizer(WEBRTC_H264, MEDIA_SSRC);
+    const unsigned char sps[] = {0x67, 0x42, 0xe0, 0x1f, 0xaa};
+    const unsigned char pps[] = {0x68, 0xce, 0x38, 0x80};
+    const unsigned char idr[] = {0x65, 0x88, 0x84, 0x00};
+    struct timeval pts = {10, 0};
+    uint32_t timestamp;
+
+    CPPUNIT_ASSERT(packetizer.getProfileLevelId().empty());
+    packetizer.setParameterSets(sps, sizeof(sps), pps, sizeof(pps));
+    CPPUNIT_ASSERT(packetizer.getProfileLevelId() == "42e01f");
+
+    //NOTE: an IDR picture without parameter sets in band gets them first
+    CPPUNIT_ASSERT(packetizer.packetize(idr, sizeof(idr), pts) == 3);
+    CPPUNIT_ASSERT(packetizer.getPackets()[0].keyframe && !packetizer.getPackets()[2].keyframe);
+    CPPUNIT_ASSERT(packetizer.getPacketData(packetizer.getPackets()[0])[12] == 0x67);
+    CPPUNIT_ASSERT(packetizer.getPacketData(packetizer.getPackets()[1])[12] == 0x68);
+    CPPUNIT_ASSERT(packetizer.getPacketData(packetizer.getPackets()[2])[12] == 0x65);
+
+    //NOTE: later slices of the same picture are not preceded by them again
+    CPPUNIT_ASSERT(packetizer.packetize(idr, sizeof(idr), pts) == 1);
+
+    //NOTE: with parameter sets in band the SPS is where viewers start
+    pts.tv_sec = 12;
+    CPPUNIT_ASSERT(packetizer.packetize(sps, sizeof(sps), pts) == 1);
+    CPPUNIT_ASSERT(packetizer.getPackets()[0].keyframe);
+    CPPUNIT_ASSERT(packetizer.packetize(pps, sizeof(pps), pts) == 1);
+    CPPUNIT_ASSERT(packetizer.packetize(idr, sizeof(idr), pts) == 1);
+    CPPUNIT_ASSERT(!packetizer.getPackets()[0].keyframe);
+
+    //NOTE: 90 kHz timestamps follow the presentation times
+    timestamp = packetizer.getLastTimestamp();
+    pts.tv_usec = 500000;
+    packetizer.packetize(idr, sizeof(idr), pts);
+    CPPUNIT_ASSERT((uint32_t) (packetizer.getLastTimestamp() - timestamp) == 45000);
+}
+
+void WebRTCTransportTest::vp8Descriptor()
+{
+    WebRTCPacketizer packetizer(WEBRTC_VP8, MEDIA_SSRC);
+    std::vector<unsigned char> frame(2500, 0x9d);
+    struct timeval pts = {1, 0};
+    unsigned char* data;
+    size_t count;
+
+    frame[0] = 0x10;
+    count = packetizer.packetize(frame.data(), frame.size(), pts);
+    CPPUNIT_ASSERT(count == 3);
+
+    for (size_t i = 0; i < count; i++) {
+        data = packetizer.getPacketData(packetizer.getPackets()[i]);
+        CPPUNIT_ASSERT(data[12] == (i == 0 ? 0x10 : 0x00));
+        CPPUNIT_ASSERT((data[1] & 0x80) == (i == count - 1 ? 0x80 : 0));
+        CPPUNIT_ASSERT(packetizer.getPackets()[i].keyframe == (i == 0));
+    }
+
+    frame[0] = 0x11;
+    packetizer.packetize(frame.data(), frame.size(), pts);
+    CPPUNIT_ASSERT(!packetizer.getPackets()[0].keyframe);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(WebRTCTransportTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("WebRTCTransportTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+/*
+ *  VideoPreviewerTest.cpp - VideoPreviewer class test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ *
+ */
+
+#include <string>
+#include <fstream>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/videoPreviewer/VideoPreviewer.hh"
+#include "Utils.hh"
+
+#define PREVIEW_FOLDER "/tmp"
+#define INVALID_FOLDER "/nonExistance"
+
+class VideoPreviewerTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(VideoPreviewerTest);
+    CPPUNIT_TEST(configure);
+    CPPUNIT_TEST(originOnly);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void configure();
+    void originOnly();
+
+    VideoPreviewer* previewer = NULL;
+};
+
+void VideoPreviewerTest::setUp()
+{
+    previewer = new VideoPreviewer();
+}
+
+void VideoPreviewerTest::tearDown()
+{
+    delete previewer;
+}
+
+void VideoPreviewerTest::configure()
+{
+    CPPUNIT_ASSERT(!previewer->configure(INVALID_FOLDER, "preview"));
+    CPPUNIT_ASSERT(!previewer->configure(PREVIEW_FOLDER, ""));
+    CPPUNIT_ASSERT(!previewer->configure(PREVIEW_FOLDER, "preview", 1));
+    CPPUNIT_ASSERT(!previewer->configure(PREVIEW_FOLDER, "preview", 320, 1000, 1));
+    CPPUNIT_ASSERT(!previewer->configure(PREVIEW_FOLDER, "preview", 320, 1000, 32));
+
+    CPPUNIT_ASSERT(previewer->configure(PREVIEW_FOLDER, "preview", 320, 1000, 5));
+}
+
+void VideoPreviewerTest::originOnly()
+{
+    //NOTE: without a folder previews are only published to the origin
+    CPPUNIT_ASSERT(previewer->configure("", "preview", 160, 500));
+    CPPUNIT_ASSERT(previewer->configOrigin(0));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(VideoPreviewerTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("VideoPreviewerTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}
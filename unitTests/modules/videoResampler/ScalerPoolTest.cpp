@@ -0,0 +1,183 @@
+/*
+ *  ScalerPoolTest.cpp - ScalerPool class test
+ *  Copyright (C) 2014  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/videoResampler/ScalerPool.hh"
+#include "Utils.hh"
+
+class ScalerPoolTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ScalerPoolTest);
+    CPPUNIT_TEST(reuse);
+    CPPUNIT_TEST(concurrentUsers);
+    CPPUNIT_TEST(cachedContext);
+    CPPUNIT_TEST(idleLimit);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void reuse();
+    void concurrentUsers();
+    void cachedContext();
+    void idleLimit();
+    
+    struct SwsContext* get(int inWidth);
+    
+    ScalerPool *pool;
+};
+
+void ScalerPoolTest::setUp()
+{
+    pool = ScalerPool::getInstance();
+    pool->setMaxIdle(SCALER_POOL_MAX_IDLE);
+    pool->trim();
+}
+
+void ScalerPoolTest::tearDown()
+{
+    pool->trim();
+}
+
+struct SwsContext* ScalerPoolTest::get(int inWidth)
+{
+    return pool->getContext(inWidth, 480, AV_PIX_FMT_YUV420P, 320, 240, AV_PIX_FMT_RGB24, SWS_FAST_BILINEAR);
+}
+
+void ScalerPoolTest::reuse()
+{
+    size_t misses = pool->getMisses();
+    size_t hits = pool->getHits();
+    struct SwsContext *ctx, *other;
+    
+    ctx = get(640);
+    CPPUNIT_ASSERT(ctx != NULL);
+    CPPUNIT_ASSERT(pool->getMisses() == misses + 1);
+    
+    pool->releaseContext(ctx);
+    CPPUNIT_ASSERT(pool->getIdleContexts() == 1);
+    
+    //NOTE: a released context is given again for the same conversion only
+    other = get(800);
+    CPPUNIT_ASSERT(other != ctx);
+    CPPUNIT_ASSERT(get(640) == ctx);
+    CPPUNIT_ASSERT(pool->getHits() == hits + 1);
+    CPPUNIT_ASSERT(pool->getIdleContexts() == 0);
+    
+    pool->releaseContext(ctx);
+    pool->releaseContext(other);
+    pool->releaseContext(NULL);
+    CPPUNIT_ASSERT(pool->getIdleContexts() == 2);
+    
+    CPPUNIT_ASSERT(get(0) == NULL);
+}
+
+void ScalerPoolTest::concurrentUsers()
+{
+    struct SwsContext *first, *second;
+    
+    first = get(640);
+    second = get(640);
+    CPPUNIT_ASSERT(first != NULL && second != NULL);
+    CPPUNIT_ASSERT(first != second);
+    
+    pool->releaseContext(first);
+    pool->releaseContext(second);
+    CPPUNIT_ASSERT(pool->getIdleContexts() == 2);
+    
+    Jzon::Object state;
+    pool->getState(state);
+    CPPUNIT_ASSERT(state.Get("idleContexts").ToInt() == 2);
+    CPPUNIT_ASSERT(state.Get("usedContexts").ToInt() == 0);
+}
+
+void ScalerPoolTest::cachedContext()
+{
+    struct SwsContext *ctx, *other;
+    
+    ctx = pool->getCachedContext(NULL, 640, 480, AV_PIX_FMT_YUV420P, 320, 240, AV_PIX_FMT_RGB24, SWS_FAST_BILINEAR);
+    CPPUNIT_ASSERT(ctx != NULL);
+    CPPUNIT_ASSERT(pool->getCachedContext(ctx, 640, 480, AV_PIX_FMT_YUV420P, 320, 240, AV_PIX_FMT_RGB24, 
+                                          SWS_FAST_BILINEAR) == ctx);
+    
+    //NOTE: a new conversion releases the previous context, switching back takes it again
+    other = pool->getCachedContext(ctx, 1280, 720, AV_PIX_FMT_YUV420P, 320, 240, AV_PIX_FMT_RGB24, SWS_FAST_BILINEAR);
+    CPPUNIT_ASSERT(other != NULL && other != ctx);
+    CPPUNIT_ASSERT(pool->getIdleContexts() == 1);
+    CPPUNIT_ASSERT(pool->getCachedContext(other, 640, 480, AV_PIX_FMT_YUV420P, 320, 240, AV_PIX_FMT_RGB24, 
+                                          SWS_FAST_BILINEAR) == ctx);
+    
+    pool->releaseContext(ctx);
+}
+
+void ScalerPoolTest::idleLimit()
+{
+    struct SwsContext *ctxs[4];
+    
+    for (unsigned i = 0; i < 4; i++) {
+        ctxs[i] = get(640 + 16*i);
+    }
+    
+    pool->setMaxIdle(2);
+    
+    for (unsigned i = 0; i < 4; i++) {
+        pool->releaseContext(ctxs[i]);
+    }
+    
+    //NOTE: the least recently released contexts are freed
+    CPPUNIT_ASSERT(pool->getIdleContexts() == 2);
+    CPPUNIT_ASSERT(get(640 + 16*3) == ctxs[3]);
+    CPPUNIT_ASSERT(get(640 + 16*2) == ctxs[2]);
+    CPPUNIT_ASSERT(pool->getIdleContexts() == 0);
+    
+    pool->releaseContext(ctxs[2]);
+    pool->releaseContext(ctxs[3]);
+    pool->trim();
+    CPPUNIT_ASSERT(pool->getIdleContexts() == 0);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ScalerPoolTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("ScalerPoolTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest( CppUnit::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( "", false );
+    outputter->write();
+
+    delete outputter;
+    
+    utils::printMood(runner.result().wasSuccessful());
+    return runner.result().wasSuccessful() ? 0 : 1;
+} 
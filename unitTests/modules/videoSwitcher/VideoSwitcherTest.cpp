@@ -0,0 +1,210 @@
+/*
+ *  VideoSwitcherTest.cpp - VideoSwitcher class test
+ *  Copyright (C) 2015  Fundació i2CAT, Internet i Innovació digital a Catalunya
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Authors:  Marc Palau <marc.palau@i2cat.net>
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/ui/text/TextTestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/XmlOutputter.h>
+
+#include "modules/videoSwitcher/VideoSwitcher.hh"
+#include "AVFramedQueue.hh"
+#include "Utils.hh"
+
+#define SPS_NAL 0x67
+#define PPS_NAL 0x68
+#define KEY_NAL 0x65
+#define REF_NAL 0x41
+
+class VideoSwitcherMock : public VideoSwitcher {
+public:
+    VideoSwitcherMock() : VideoSwitcher(H264, 2) {};
+    using VideoSwitcher::doProcessFrame;
+    using VideoSwitcher::specificReaderConfig;
+    using VideoSwitcher::switchInput0;
+};
+
+class VideoSwitcherTest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(VideoSwitcherTest);
+    CPPUNIT_TEST(createTest);
+    CPPUNIT_TEST(readerConfigTest);
+    CPPUNIT_TEST(switchTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp();
+    void tearDown();
+
+protected:
+    void createTest();
+    void readerConfigTest();
+    void switchTest();
+
+    bool process(int id, unsigned char type, unsigned char tag, int ts);
+
+    VideoSwitcherMock* switcher;
+    InterleavedVideoFrame* frame;
+    SlicedVideoFrame* out;
+    StreamInfo* si;
+    VideoFrameQueue* queue;
+    struct ConnectionData cData;
+};
+
+void VideoSwitcherTest::setUp()
+{
+    switcher = new VideoSwitcherMock();
+    frame = InterleavedVideoFrame::createNew(H264, 64);
+    out = SlicedVideoFrame::createNew(H264);
+    si = new StreamInfo(VIDEO);
+    si->video.codec = H264;
+    si->setCodecDefaults();
+    queue = VideoFrameQueue::createNew(cData, si, 4);
+}
+
+void VideoSwitcherTest::tearDown()
+{
+    delete switcher;
+    delete frame;
+    delete out;
+    delete queue;
+    delete si;
+}
+
+bool VideoSwitcherTest::process(int id, unsigned char type, unsigned char tag, int ts)
+{
+    unsigned char nal[6] = {0, 0, 0, 1, type, tag};
+    std::vector<int> newFrames(1, id);
+    FrameMap orgFrames;
+
+    memcpy(frame->getDataBuf(), nal, sizeof(nal));
+    frame->setLength(sizeof(nal));
+    frame->setPresentationTime(std::chrono::microseconds(ts));
+    frame->setDecodeTime(std::chrono::microseconds(ts));
+    orgFrames[id] = frame;
+
+    out->clear();
+    out->setConsumed(false);
+    CPPUNIT_ASSERT(switcher->doProcessFrame(orgFrames, out, newFrames));
+
+    return out->getConsumed();
+}
+
+void VideoSwitcherTest::createTest()
+{
+    VideoSwitcher* tmp;
+
+    tmp = VideoSwitcher::createNew(VP8);
+    CPPUNIT_ASSERT(!tmp);
+
+    tmp = VideoSwitcher::createNew(H264, 0);
+    CPPUNIT_ASSERT(!tmp);
+
+    tmp = VideoSwitcher::createNew(H265, 4);
+    CPPUNIT_ASSERT(tmp);
+    CPPUNIT_ASSERT(tmp->getActiveInput() == -1);
+    delete tmp;
+}
+
+void VideoSwitcherTest::readerConfigTest()
+{
+    StreamInfo vp8(VIDEO);
+    VideoFrameQueue* vp8Queue;
+
+    vp8.video.codec = VP8;
+    vp8.setCodecDefaults();
+    vp8Queue = VideoFrameQueue::createNew(cData, &vp8, 4);
+
+    CPPUNIT_ASSERT(!switcher->specificReaderConfig(1, vp8Queue));
+    CPPUNIT_ASSERT(switcher->specificReaderConfig(1, queue));
+    CPPUNIT_ASSERT(!switcher->switchInput0(2));
+    CPPUNIT_ASSERT(switcher->switchInput0(1));
+
+    delete vp8Queue;
+}
+
+void VideoSwitcherTest::switchTest()
+{
+    Slice* slices;
+
+    CPPUNIT_ASSERT(switcher->specificReaderConfig(1, queue));
+    CPPUNIT_ASSERT(switcher->specificReaderConfig(2, queue));
+
+    //NOTE: nothing is output until an input sends an IDR access unit
+    CPPUNIT_ASSERT(!process(1, REF_NAL, 0, 0));
+    CPPUNIT_ASSERT(!process(1, SPS_NAL, 1, 40000));
+    CPPUNIT_ASSERT(!process(1, PPS_NAL, 1, 40000));
+    CPPUNIT_ASSERT(process(1, KEY_NAL, 1, 40000));
+    CPPUNIT_ASSERT(switcher->getActiveInput() == 1);
+    CPPUNIT_ASSERT(out->getSliceNum() == 3);
+    CPPUNIT_ASSERT(out->getSlices()[0].getData()[4] == SPS_NAL);
+    CPPUNIT_ASSERT(out->getSlices()[2].getData()[4] == KEY_NAL);
+    CPPUNIT_ASSERT(out->getPresentationTime().count() == 40000);
+
+    CPPUNIT_ASSERT(process(1, REF_NAL, 2, 80000));
+    CPPUNIT_ASSERT(out->getSliceNum() == 1);
+    CPPUNIT_ASSERT(out->getPresentationTime().count() == 80000);
+
+    //NOTE: the switch waits for an IDR access unit of the requested input
+    CPPUNIT_ASSERT(switcher->switchInput0(2));
+    CPPUNIT_ASSERT(!process(2, PPS_NAL, 1, 960000));
+    CPPUNIT_ASSERT(!process(2, REF_NAL, 1, 960000));
+    CPPUNIT_ASSERT(process(1, REF_NAL, 3, 120000));
+    CPPUNIT_ASSERT(switcher->getActiveInput() == 1);
+
+    //NOTE: the cached PPS is sent after the SPS of the IDR access unit
+    CPPUNIT_ASSERT(!process(2, SPS_NAL, 2, 1000000));
+    CPPUNIT_ASSERT(process(2, KEY_NAL, 2, 1000000));
+    CPPUNIT_ASSERT(switcher->getActiveInput() == 2);
+    CPPUNIT_ASSERT(out->getSliceNum() == 3);
+    slices = out->getSlices();
+    CPPUNIT_ASSERT(slices[0].getData()[4] == SPS_NAL && slices[0].getData()[5] == 2);
+    CPPUNIT_ASSERT(slices[1].getData()[4] == PPS_NAL && slices[1].getData()[5] == 1);
+    CPPUNIT_ASSERT(slices[2].getData()[4] == KEY_NAL && slices[2].getData()[5] == 2);
+
+    //NOTE: timestamps continue after the last picture of the previous input
+    CPPUNIT_ASSERT(out->getPresentationTime().count() == 160000);
+
+    CPPUNIT_ASSERT(!process(1, REF_NAL, 4, 160000));
+    CPPUNIT_ASSERT(process(2, REF_NAL, 3, 1040000));
+    CPPUNIT_ASSERT(out->getPresentationTime().count() == 200000);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(VideoSwitcherTest);
+
+int main(int argc, char* argv[])
+{
+    std::ofstream xmlout("VideoSwitcherTest.xml");
+    CPPUNIT_NS::TextTestRunner runner;
+    CPPUNIT_NS::XmlOutputter *outputter = new CPPUNIT_NS::XmlOutputter(&runner.result(), xmlout);
+
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+    runner.run("", false);
+    outputter->write();
+
+    utils::printMood(runner.result().wasSuccessful());
+    delete outputter;
+
+    return runner.result().wasSuccessful() ? 0 : 1;
+}